@@ -173,6 +173,7 @@ protected:
         HINSTANCE m_HInstance;              // handle to the app instance
         double m_LastStatsUpdateTime;       // last time the stats were updated
         DWORD m_LastStatsUpdateFrames;      // frames count since last time the stats were updated
+        UINT64 m_LastStatsUpdateAllocations; // heap allocation count when the stats were last updated
         float m_FPS;                        // frames per second
         int m_CurrentFrameNumber;         // the current frame number
         HHOOK m_KeyboardHook;               // handle to keyboard hook
@@ -245,6 +246,9 @@ protected:
         int m_OverrideQuitAfterFrame;     // if != 0, then it will force the app to quit after that frame
         int m_OverrideForceVsync;         // if == 0, then it will force the app to use D3DPRESENT_INTERVAL_IMMEDIATE, if == 1 force use of D3DPRESENT_INTERVAL_DEFAULT
         bool m_OverrideRelaunchMCE;          // if true, then force relaunch of MCE at exit
+        WCHAR m_OverrideProfileTrace[MAX_PATH]; // if not empty, the CPU profiler runs and writes a trace here at exit
+        WCHAR m_OverrideFrameStatsFile[MAX_PATH]; // if not empty, the recent frame times are written here at exit
+        bool m_OverrideFrameStatsCheck;    // if true, the frame time statistics are checked and the app exits
         bool m_AppCalledWasKeyPressed;      // true if the app ever calls DXUTWasKeyPressed().  Allows for optimzation
         bool m_ReleasingSwapChain;		  // if true, the app is releasing its swapchain
         bool m_IsInGammaCorrectMode;		// Tell DXUTRes and DXUTMisc that we are in gamma correct mode
@@ -431,6 +435,7 @@ public:
     GET_SET_ACCESSOR( HINSTANCE, HInstance );
     GET_SET_ACCESSOR( double, LastStatsUpdateTime );   
     GET_SET_ACCESSOR( DWORD, LastStatsUpdateFrames );   
+    GET_SET_ACCESSOR( UINT64, LastStatsUpdateAllocations );
     GET_SET_ACCESSOR( float, FPS );    
     GET_SET_ACCESSOR( int, CurrentFrameNumber );
     GET_SET_ACCESSOR( HHOOK, KeyboardHook );
@@ -502,6 +507,9 @@ public:
     GET_SET_ACCESSOR( int, OverrideQuitAfterFrame );
     GET_SET_ACCESSOR( int, OverrideForceVsync );
     GET_SET_ACCESSOR( bool, OverrideRelaunchMCE );
+    GET_ACCESSOR( WCHAR*, OverrideProfileTrace );
+    GET_ACCESSOR( WCHAR*, OverrideFrameStatsFile );
+    GET_SET_ACCESSOR( bool, OverrideFrameStatsCheck );
     GET_SET_ACCESSOR( bool, ReleasingSwapChain );
     GET_SET_ACCESSOR( bool, IsInGammaCorrectMode );
 
@@ -774,6 +782,9 @@ void DXUTGetCallbackD3D10DeviceAcceptable( LPDXUTCALLBACKISD3D10DEVICEACCEPTABLE
 //          -nostats                prevents the display of the stats
 //          -relaunchmce            re-launches the MCE UI after the app exits
 //          -automation             a hint to other components that automation is active 
+//          -profile:filename       records the CPU profiler and writes a Chrome trace to filename at exit
+//          -framestats:filename    writes the recent frame and subsystem times to a CSV file at exit
+//          -framestatscheck        checks the frame time statistics, prints the results and exits with 1 if any fail
 //--------------------------------------------------------------------------------------
 HRESULT WINAPI DXUTInit( bool bParseCommandLine, 
                          bool bShowMsgBoxOnError, 
@@ -784,6 +795,9 @@ HRESULT WINAPI DXUTInit( bool bParseCommandLine,
 
     GetDXUTState().SetDXUTInitCalled( true );
 
+    // DXUT renders on the thread that initializes it
+    DXUTProfilerSetThreadName( L"Render" );
+
     // Not always needed, but lets the app create GDI dialogs
     InitCommonControls();
 
@@ -807,6 +821,17 @@ HRESULT WINAPI DXUTInit( bool bParseCommandLine,
     if( strExtraCommandLineParams )
         DXUTParseCommandLine( strExtraCommandLineParams, false );
 
+    // Runs before any window or device is created, so it works headless
+    if( GetDXUTState().GetOverrideFrameStatsCheck() )
+    {
+        if( AttachConsole( ATTACH_PARENT_PROCESS ) )
+        {
+            FILE* pFile;
+            freopen_s( &pFile, "CONOUT$", "w", stdout );
+        }
+        exit( DXUTCheckFramePacing( stdout ) ? 1 : 0 );
+    }
+
     // Declare this process to be high DPI aware, and prevent automatic scaling
     // Warning: This is better done as a <dpiaware> manifest element to avoid
     //          problems based on code that has run before this point.
@@ -1029,6 +1054,31 @@ void DXUTParseCommandLine( __inout WCHAR* strCommandLine,
                 GetDXUTState().SetAutomation( true );
                 continue;
             }
+
+            if( DXUTIsNextArg( strCmdLine, L"profile" ) )
+            {
+                if( DXUTGetCmdParam( strCmdLine, strFlag ) )
+                {
+                    wcscpy_s( GetDXUTState().GetOverrideProfileTrace(), MAX_PATH, strFlag );
+                    DXUTProfilerEnable( true );
+                    continue;
+                }
+            }
+
+            if( DXUTIsNextArg( strCmdLine, L"framestatscheck" ) )
+            {
+                GetDXUTState().SetOverrideFrameStatsCheck( true );
+                continue;
+            }
+
+            if( DXUTIsNextArg( strCmdLine, L"framestats" ) )
+            {
+                if( DXUTGetCmdParam( strCmdLine, strFlag ) )
+                {
+                    wcscpy_s( GetDXUTState().GetOverrideFrameStatsFile(), MAX_PATH, strFlag );
+                    continue;
+                }
+            }
         }
 
         // Unrecognized flag
@@ -3252,7 +3302,10 @@ void DXUTRender3DEnvironment9()
     LPDXUTCALLBACKFRAMEMOVE pCallbackFrameMove = GetDXUTState().GetFrameMoveFunc();
     if( pCallbackFrameMove != NULL )
     {
-        pCallbackFrameMove( fTime, fElapsedTime, GetDXUTState().GetFrameMoveFuncUserContext() );
+        {
+            CDXUTFrameSubsystemScope FrameScope( DXUT_FRAME_SUBSYSTEM_FRAMEMOVE );
+            pCallbackFrameMove( fTime, fElapsedTime, GetDXUTState().GetFrameMoveFuncUserContext() );
+        }
         pd3dDevice = DXUTGetD3D9Device();
         if( NULL == pd3dDevice ) // Handle DXUTShutdown from inside callback
             return;
@@ -3264,8 +3317,11 @@ void DXUTRender3DEnvironment9()
         LPDXUTCALLBACKD3D9FRAMERENDER pCallbackFrameRender = GetDXUTState().GetD3D9FrameRenderFunc();
         if( pCallbackFrameRender != NULL )
         {
-            pCallbackFrameRender( pd3dDevice, fTime, fElapsedTime,
-                                  GetDXUTState().GetD3D9FrameRenderFuncUserContext() );
+            {
+                CDXUTFrameSubsystemScope FrameScope( DXUT_FRAME_SUBSYSTEM_FRAMERENDER );
+                pCallbackFrameRender( pd3dDevice, fTime, fElapsedTime,
+                                      GetDXUTState().GetD3D9FrameRenderFuncUserContext() );
+            }
             pd3dDevice = DXUTGetD3D9Device();
             if( NULL == pd3dDevice ) // Handle DXUTShutdown from inside callback
                 return;
@@ -3285,7 +3341,10 @@ void DXUTRender3DEnvironment9()
 #endif
 
         // Show the frame on the primary surface.
-        hr = pd3dDevice->Present( NULL, NULL, NULL, NULL );
+        {
+            CDXUTFrameSubsystemScope FrameScope( DXUT_FRAME_SUBSYSTEM_PRESENT );
+            hr = pd3dDevice->Present( NULL, NULL, NULL, NULL );
+        }
         if( FAILED( hr ) )
         {
             if( D3DERR_DEVICELOST == hr )
@@ -4125,7 +4184,10 @@ void DXUTRender3DEnvironment10()
     LPDXUTCALLBACKFRAMEMOVE pCallbackFrameMove = GetDXUTState().GetFrameMoveFunc();
     if( pCallbackFrameMove != NULL )
     {
-        pCallbackFrameMove( fTime, fElapsedTime, GetDXUTState().GetFrameMoveFuncUserContext() );
+        {
+            CDXUTFrameSubsystemScope FrameScope( DXUT_FRAME_SUBSYSTEM_FRAMEMOVE );
+            pCallbackFrameMove( fTime, fElapsedTime, GetDXUTState().GetFrameMoveFuncUserContext() );
+        }
         pd3dDevice = DXUTGetD3D10Device();
         if( NULL == pd3dDevice ) // Handle DXUTShutdown from inside callback
             return;
@@ -4137,8 +4199,11 @@ void DXUTRender3DEnvironment10()
         LPDXUTCALLBACKD3D10FRAMERENDER pCallbackFrameRender = GetDXUTState().GetD3D10FrameRenderFunc();
         if( pCallbackFrameRender != NULL && !GetDXUTState().GetRenderingOccluded() )
         {
-            pCallbackFrameRender( pd3dDevice, fTime, fElapsedTime,
-                                  GetDXUTState().GetD3D10FrameRenderFuncUserContext() );
+            {
+                CDXUTFrameSubsystemScope FrameScope( DXUT_FRAME_SUBSYSTEM_FRAMERENDER );
+                pCallbackFrameRender( pd3dDevice, fTime, fElapsedTime,
+                                      GetDXUTState().GetD3D10FrameRenderFuncUserContext() );
+            }
             pd3dDevice = DXUTGetD3D10Device();
             if( NULL == pd3dDevice ) // Handle DXUTShutdown from inside callback
                 return;
@@ -4166,7 +4231,10 @@ void DXUTRender3DEnvironment10()
     UINT SyncInterval = GetDXUTState().GetCurrentDeviceSettings()->d3d10.SyncInterval;
 
     // Show the frame on the primary surface.
-    hr = pSwapChain->Present( SyncInterval, dwFlags );
+    {
+        CDXUTFrameSubsystemScope FrameScope( DXUT_FRAME_SUBSYSTEM_PRESENT );
+        hr = pSwapChain->Present( SyncInterval, dwFlags );
+    }
     if( DXGI_STATUS_OCCLUDED == hr )
     {
         // There is a window covering our entire rendering area.
@@ -5763,6 +5831,14 @@ void DXUTCheckForWindowChangingMonitors()
 //--------------------------------------------------------------------------------------
 void WINAPI DXUTRender3DEnvironment()
 {
+    // Everything taken from the frame arena last frame is released here
+    DXUTBeginFrameMemory();
+    CDXUTProfileScope ProfileScope( L"Frame" );
+
+    // DXUT sleeps on purpose in these states, so those frames would only be noise
+    DXUTUpdateFramePacing( !DXUTIsRenderingPaused() && DXUTIsActive() &&
+                           !GetDXUTState().GetRenderingOccluded() && !GetDXUTState().GetDeviceLost() );
+
     if( DXUTIsCurrentDeviceD3D9() )
         DXUTRender3DEnvironment9();
     else
@@ -6170,8 +6246,19 @@ void DXUTUpdateFrameStats()
         GetDXUTState().SetLastStatsUpdateTime( fAbsTime );
         GetDXUTState().SetLastStatsUpdateFrames( 0 );
 
+        // Average DXUT's heap allocations over the same frames.  Only these are counted in
+        // every build, so the figure means the same in debug and release.
+        DXUT_MEMORY_STATS MemoryStats;
+        DXUTGetMemoryStats( &MemoryStats );
+        UINT64 nAllocations = MemoryStats.nTotalHeapAllocations - GetDXUTState().GetLastStatsUpdateAllocations();
+        GetDXUTState().SetLastStatsUpdateAllocations( MemoryStats.nTotalHeapAllocations );
+
+        // The worst frames over the same second, which the average hides
+        double fP99Ms = DXUTGetFramePacer()->GetRecentPercentileMs( 99.0, dwFrames );
+
         WCHAR* pstrFPS = GetDXUTState().GetFPSStats();
-        swprintf_s( pstrFPS, 64, L"%0.2f fps ", fFPS );
+        swprintf_s( pstrFPS, 64, L"%0.2f fps, %0.1f ms p99, %u DXUT allocs/frame ", fFPS, fP99Ms,
+                    ( UINT )( nAllocations / dwFrames ) );
     }
 }
 
@@ -6476,6 +6563,21 @@ void WINAPI DXUTShutdown( int nExitCode )
 
     if( GetDXUTState().GetOverrideRelaunchMCE() )
         DXUTReLaunchMediaCenter();
+
+    // Write the trace once, however many times DXUTShutdown is called
+    WCHAR* strProfileTrace = GetDXUTState().GetOverrideProfileTrace();
+    if( strProfileTrace[0] != 0 )
+    {
+        DXUTProfilerWriteTrace( strProfileTrace );
+        strProfileTrace[0] = 0;
+    }
+
+    WCHAR* strFrameStatsFile = GetDXUTState().GetOverrideFrameStatsFile();
+    if( strFrameStatsFile[0] != 0 )
+    {
+        DXUTWriteFramePacingCSV( strFrameStatsFile );
+        strFrameStatsFile[0] = 0;
+    }
 }
 
 //--------------------------------------------------------------------------------------
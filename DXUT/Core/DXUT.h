@@ -69,6 +69,8 @@
 #include <math.h>      
 #include <limits.h>      
 #include <stdio.h>
+#include <type_traits> // for CGrowableArray
+#include <utility>
 
 // CRT's memory leak detection
 #if defined(DEBUG) || defined(_DEBUG)
@@ -338,6 +340,7 @@ void      WINAPI DXUTDestroyState(); // Optional method to destroy DXUT's memory
 //--------------------------------------------------------------------------------------
 // DXUT core layer includes
 //--------------------------------------------------------------------------------------
+#include "DXUTFramePacer.h"
 #include "DXUTmisc.h"
 #include "DXUTenum.h"
 
@@ -0,0 +1,456 @@
+//--------------------------------------------------------------------------------------
+// File: DXUTFramePacer.cpp
+//
+// Frame time statistics.  Only standard C++ is used, so this file doesn't include DXUT.h
+// and doesn't use the precompiled header.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#include "DXUTFramePacer.h"
+#include <math.h>
+#include <string.h>
+#include <wchar.h>
+#include <algorithm>
+#include <vector>
+
+
+//--------------------------------------------------------------------------------------
+// Frame time histogram
+//--------------------------------------------------------------------------------------
+CDXUTFrameTimeHistogram::CDXUTFrameTimeHistogram()
+{
+    Reset();
+}
+
+
+//--------------------------------------------------------------------------------------
+void CDXUTFrameTimeHistogram::Reset()
+{
+    memset( m_anCounts, 0, sizeof( m_anCounts ) );
+    m_nCount = 0;
+    m_nMin = ~0ULL;
+    m_nMax = 0;
+    m_fTotalMs = 0.0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Values below 128 have a bucket each.  Above that, each power of two is split into 64
+// buckets: the value is shifted down until it is 64 to 127, and the shift picks the
+// group of buckets.
+//--------------------------------------------------------------------------------------
+unsigned CDXUTFrameTimeHistogram::GetBucket( unsigned long long nMicroseconds )
+{
+    const unsigned long long nLargest = ( 1ULL << ( MAX_SHIFT + SUB_BUCKET_BITS ) ) - 1;
+    if( nMicroseconds > nLargest )
+        nMicroseconds = nLargest;
+
+    unsigned nShift = 0;
+    while( ( nMicroseconds >> nShift ) >= ( 1ULL << SUB_BUCKET_BITS ) )
+        nShift++;
+
+    return nShift * SUB_BUCKET_HALF + ( unsigned )( nMicroseconds >> nShift );
+}
+
+
+//--------------------------------------------------------------------------------------
+unsigned long long CDXUTFrameTimeHistogram::GetBucketHighestValue( unsigned nBucket )
+{
+    if( nBucket < 2 * SUB_BUCKET_HALF )
+        return nBucket;
+
+    unsigned nShift = nBucket / SUB_BUCKET_HALF - 1;
+    unsigned long long nSubBucket = nBucket - nShift * SUB_BUCKET_HALF;
+    return ( ( nSubBucket + 1 ) << nShift ) - 1;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CDXUTFrameTimeHistogram::Record( double fMs )
+{
+    if( !( fMs >= 0.0 ) )
+        fMs = 0.0;
+
+    double fMicroseconds = fMs * 1000.0 + 0.5;
+    unsigned long long nMicroseconds = ( fMicroseconds < 1e18 ) ? ( unsigned long long )fMicroseconds : ( unsigned long long )1e18;
+
+    m_anCounts[GetBucket( nMicroseconds )]++;
+    m_nCount++;
+    m_nMin = ( nMicroseconds < m_nMin ) ? nMicroseconds : m_nMin;
+    m_nMax = ( nMicroseconds > m_nMax ) ? nMicroseconds : m_nMax;
+    m_fTotalMs += fMs;
+}
+
+
+//--------------------------------------------------------------------------------------
+double CDXUTFrameTimeHistogram::GetMinMs() const
+{
+    return m_nCount ? m_nMin / 1000.0 : 0.0;
+}
+
+
+//--------------------------------------------------------------------------------------
+double CDXUTFrameTimeHistogram::GetMaxMs() const
+{
+    return m_nMax / 1000.0;
+}
+
+
+//--------------------------------------------------------------------------------------
+double CDXUTFrameTimeHistogram::GetMeanMs() const
+{
+    return m_nCount ? m_fTotalMs / ( double )m_nCount : 0.0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Returns the highest time in the bucket holding the percentile, so the result is never
+// below the true value.  It is clamped to the largest time recorded.
+//--------------------------------------------------------------------------------------
+double CDXUTFrameTimeHistogram::GetPercentileMs( double fPercentile ) const
+{
+    if( m_nCount == 0 )
+        return 0.0;
+    if( fPercentile <= 0.0 )
+        return GetMinMs();
+
+    double fRank = ceil( fPercentile / 100.0 * ( double )m_nCount );
+    unsigned long long nRank = ( fRank < 1.0 ) ? 1 : ( fRank > ( double )m_nCount ) ? m_nCount : ( unsigned long long )fRank;
+
+    unsigned long long nSeen = 0;
+    for( unsigned i = 0; i < NUM_BUCKETS; i++ )
+    {
+        nSeen += m_anCounts[i];
+        if( nSeen >= nRank )
+        {
+            // The last bucket also holds every longer time
+            if( i == NUM_BUCKETS - 1 )
+                return GetMaxMs();
+
+            unsigned long long nValue = GetBucketHighestValue( i );
+            return ( ( nValue < m_nMax ) ? nValue : m_nMax ) / 1000.0;
+        }
+    }
+
+    return GetMaxMs();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Frame pacer
+//--------------------------------------------------------------------------------------
+CDXUTFramePacer::CDXUTFramePacer()
+{
+    m_nSubsystems = 0;
+    m_fStutterFactor = 2.0;
+    m_nMedianFrames = 60;
+    Reset();
+}
+
+
+//--------------------------------------------------------------------------------------
+void CDXUTFramePacer::Reset()
+{
+    m_Histogram.Reset();
+    m_nFrames = 0;
+    m_nStutters = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CDXUTFramePacer::SetStutterThreshold( double fFactor, unsigned nMedianFrames )
+{
+    m_fStutterFactor = fFactor;
+    m_nMedianFrames = ( nMedianFrames < 1 ) ? 1 :
+        ( nMedianFrames > DXUT_FRAME_PACING_HISTORY ) ? DXUT_FRAME_PACING_HISTORY : nMedianFrames;
+}
+
+
+//--------------------------------------------------------------------------------------
+int CDXUTFramePacer::RegisterSubsystem( const wchar_t* strName )
+{
+    for( unsigned i = 0; i < m_nSubsystems; i++ )
+    {
+        if( wcsncmp( m_astrSubsystems[i], strName, 31 ) == 0 )
+            return ( int )i;
+    }
+
+    if( m_nSubsystems == DXUT_MAX_FRAME_SUBSYSTEMS )
+        return -1;
+
+    unsigned nLength = 0;
+    for( ; nLength < 31 && strName[nLength]; nLength++ )
+        m_astrSubsystems[m_nSubsystems][nLength] = strName[nLength];
+    m_astrSubsystems[m_nSubsystems][nLength] = 0;
+    return ( int )m_nSubsystems++;
+}
+
+
+//--------------------------------------------------------------------------------------
+bool CDXUTFramePacer::AddFrame( double fFrameMs, const float* pafSubsystemMs )
+{
+    DXUT_FRAME_RECORD& Frame = m_aFrames[m_nFrames % DXUT_FRAME_PACING_HISTORY];
+
+    // The median of the frames before this one, once there are enough to go by
+    unsigned nPrevious = GetRecentFrameCount();
+    unsigned nMedianFrames = ( nPrevious < m_nMedianFrames ) ? nPrevious : m_nMedianFrames;
+    Frame.fMedianMs = 0.0;
+    if( nMedianFrames >= 8 )
+    {
+        for( unsigned i = 0; i < nMedianFrames; i++ )
+            m_afScratch[i] = GetRecentFrame( nPrevious - nMedianFrames + i ).fFrameMs;
+        std::nth_element( m_afScratch, m_afScratch + nMedianFrames / 2, m_afScratch + nMedianFrames );
+        Frame.fMedianMs = m_afScratch[nMedianFrames / 2];
+    }
+
+    Frame.nFrame = m_nFrames;
+    Frame.fFrameMs = fFrameMs;
+    Frame.bStutter = ( Frame.fMedianMs > 0.0 && fFrameMs > m_fStutterFactor * Frame.fMedianMs );
+    for( unsigned i = 0; i < DXUT_MAX_FRAME_SUBSYSTEMS; i++ )
+        Frame.afSubsystemMs[i] = ( pafSubsystemMs && i < m_nSubsystems ) ? pafSubsystemMs[i] : 0.0f;
+
+    m_Histogram.Record( fFrameMs );
+    m_nFrames++;
+
+    if( Frame.bStutter )
+    {
+        m_aStutters[m_nStutters % DXUT_FRAME_PACING_STUTTERS] = Frame;
+        m_nStutters++;
+    }
+
+    return Frame.bStutter;
+}
+
+
+//--------------------------------------------------------------------------------------
+unsigned CDXUTFramePacer::GetRecentFrameCount() const
+{
+    return ( m_nFrames < DXUT_FRAME_PACING_HISTORY ) ? ( unsigned )m_nFrames : DXUT_FRAME_PACING_HISTORY;
+}
+
+
+//--------------------------------------------------------------------------------------
+const DXUT_FRAME_RECORD& CDXUTFramePacer::GetRecentFrame( unsigned nIndex ) const
+{
+    unsigned long long nFrame = m_nFrames - GetRecentFrameCount() + nIndex;
+    return m_aFrames[nFrame % DXUT_FRAME_PACING_HISTORY];
+}
+
+
+//--------------------------------------------------------------------------------------
+unsigned CDXUTFramePacer::GetRecentStutterCount() const
+{
+    return ( m_nStutters < DXUT_FRAME_PACING_STUTTERS ) ? ( unsigned )m_nStutters : DXUT_FRAME_PACING_STUTTERS;
+}
+
+
+//--------------------------------------------------------------------------------------
+const DXUT_FRAME_RECORD& CDXUTFramePacer::GetRecentStutter( unsigned nIndex ) const
+{
+    unsigned long long nStutter = m_nStutters - GetRecentStutterCount() + nIndex;
+    return m_aStutters[nStutter % DXUT_FRAME_PACING_STUTTERS];
+}
+
+
+//--------------------------------------------------------------------------------------
+double CDXUTFramePacer::GetRecentPercentileMs( double fPercentile, unsigned nFrames ) const
+{
+    unsigned nRecent = GetRecentFrameCount();
+    if( nFrames > nRecent )
+        nFrames = nRecent;
+    if( nFrames == 0 )
+        return 0.0;
+
+    for( unsigned i = 0; i < nFrames; i++ )
+        m_afScratch[i] = GetRecentFrame( nRecent - nFrames + i ).fFrameMs;
+
+    double fRank = ceil( fPercentile / 100.0 * nFrames );
+    unsigned nIndex = ( fRank < 1.0 ) ? 0 : ( fRank >= nFrames ) ? nFrames - 1 : ( unsigned )fRank - 1;
+    std::nth_element( m_afScratch, m_afScratch + nIndex, m_afScratch + nFrames );
+    return m_afScratch[nIndex];
+}
+
+
+//--------------------------------------------------------------------------------------
+bool CDXUTFramePacer::WriteCSV( FILE* pFile ) const
+{
+    fprintf( pFile, "frame,ms,median_ms,stutter" );
+    for( unsigned i = 0; i < m_nSubsystems; i++ )
+        fprintf( pFile, ",%ls_ms", m_astrSubsystems[i] );
+    fprintf( pFile, "\n" );
+
+    for( unsigned nFrame = 0; nFrame < GetRecentFrameCount(); nFrame++ )
+    {
+        const DXUT_FRAME_RECORD& Frame = GetRecentFrame( nFrame );
+        fprintf( pFile, "%llu,%.3f,%.3f,%d", Frame.nFrame, Frame.fFrameMs, Frame.fMedianMs, Frame.bStutter ? 1 : 0 );
+        for( unsigned i = 0; i < m_nSubsystems; i++ )
+            fprintf( pFile, ",%.3f", Frame.afSubsystemMs[i] );
+        fprintf( pFile, "\n" );
+    }
+
+    return ferror( pFile ) == 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Self checks
+//--------------------------------------------------------------------------------------
+static unsigned DXUTFramePacingCheck( FILE* pFile, bool bPassed, const char* strCheck )
+{
+    fprintf( pFile, "%s: %s\n", bPassed ? "passed" : "FAILED", strCheck );
+    return bPassed ? 0 : 1;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Frame times from a fixed generator, so every platform checks the same values: mostly
+// near 16.7ms, with a spread of longer frames up to a few seconds and some very short ones
+//--------------------------------------------------------------------------------------
+static double DXUTNextCheckFrameMs( unsigned& nState )
+{
+    nState = nState * 1664525 + 1013904223;
+    double fUniform = ( nState >> 8 ) / ( double )( 1 << 24 );
+
+    switch( nState & 7 )
+    {
+        case 0:
+            return fUniform * 0.2;                          // Under 200us
+        case 1:
+            return 16.7 * exp( fUniform * 5.0 );            // Up to 2.5s
+        default:
+            return 16.2 + fUniform;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+unsigned DXUTCheckFramePacing( FILE* pFile )
+{
+    unsigned nFailed = 0;
+
+    //
+    // Histogram percentiles are never below the exact value, and within 1.6% or 1us of it
+    //
+    CDXUTFrameTimeHistogram Histogram;
+    nFailed += DXUTFramePacingCheck( pFile, Histogram.GetCount() == 0 && Histogram.GetPercentileMs( 50.0 ) == 0.0 &&
+                                     Histogram.GetMeanMs() == 0.0, "empty histogram" );
+
+    std::vector <double> Times;
+    unsigned nState = 1;
+    double fTotalMs = 0.0;
+    for( unsigned i = 0; i < 100000; i++ )
+    {
+        double fMs = DXUTNextCheckFrameMs( nState );
+        Histogram.Record( fMs );
+        Times.push_back( floor( fMs * 1000.0 + 0.5 ) / 1000.0 );   // The histogram keeps whole microseconds
+        fTotalMs += fMs;
+    }
+    std::sort( Times.begin(), Times.end() );
+
+    static const double s_afPercentiles[] = { 0.0, 1.0, 10.0, 50.0, 90.0, 99.0, 99.9, 99.99, 100.0 };
+    for( unsigned i = 0; i < sizeof( s_afPercentiles ) / sizeof( s_afPercentiles[0] ); i++ )
+    {
+        double fRank = ceil( s_afPercentiles[i] / 100.0 * Times.size() );
+        size_t nIndex = ( fRank < 1.0 ) ? 0 : ( size_t )fRank - 1;
+        double fExact = Times[nIndex];
+        double fMs = Histogram.GetPercentileMs( s_afPercentiles[i] );
+
+        char strCheck[128];
+        snprintf( strCheck, sizeof( strCheck ), "p%g is %.3f ms, exactly %.3f ms", s_afPercentiles[i], fMs, fExact );
+        nFailed += DXUTFramePacingCheck( pFile, fMs >= fExact - 1e-9 && fMs <= fExact * ( 1.0 + 1.0 / 64.0 ) + 0.001,
+                                         strCheck );
+    }
+
+    nFailed += DXUTFramePacingCheck( pFile, Histogram.GetCount() == Times.size() &&
+                                     Histogram.GetMinMs() == Times.front() && Histogram.GetMaxMs() == Times.back() &&
+                                     fabs( Histogram.GetMeanMs() - fTotalMs / Times.size() ) < 1e-6,
+                                     "histogram count, min, max and mean" );
+
+    Histogram.Record( 1e12 );
+    nFailed += DXUTFramePacingCheck( pFile, Histogram.GetPercentileMs( 100.0 ) == Histogram.GetMaxMs() &&
+                                     Histogram.GetPercentileMs( 100.0 ) > 1e9, "times past the last bucket" );
+
+    //
+    // Stutters are the frames over twice the median of the 60 before them
+    //
+    CDXUTFramePacer Pacer;
+    int nFirst = Pacer.RegisterSubsystem( L"First" );
+    int nSecond = Pacer.RegisterSubsystem( L"Second" );
+    bool bRegistered = nFirst == 0 && nSecond == 1 && Pacer.RegisterSubsystem( L"First" ) == 0;
+    for( int i = 2; i < DXUT_MAX_FRAME_SUBSYSTEMS; i++ )
+    {
+        wchar_t strName[32];
+        swprintf( strName, 32, L"Subsystem %d", i );
+        bRegistered = bRegistered && Pacer.RegisterSubsystem( strName ) == i;
+    }
+    bRegistered = bRegistered && Pacer.RegisterSubsystem( L"One too many" ) == -1 &&
+                  Pacer.RegisterSubsystem( L"Second" ) == 1 && Pacer.GetSubsystemCount() == DXUT_MAX_FRAME_SUBSYSTEMS &&
+                  wcscmp( Pacer.GetSubsystemName( 5 ), L"Subsystem 5" ) == 0;
+    nFailed += DXUTFramePacingCheck( pFile, bRegistered, "subsystem registration" );
+
+    CDXUTFramePacer Pacer2;
+    Pacer2.RegisterSubsystem( L"Work" );
+    const unsigned nFrames = 3000;
+    std::vector <unsigned> Expected;
+    bool bStuttersRight = true;
+    for( unsigned i = 0; i < nFrames; i++ )
+    {
+        // Steady frames with a little jitter, a long frame every 250, and frames just
+        // under the threshold that must not count
+        float fWorkMs = ( float )( i % 10 );
+        double fMs = 16.0 + ( i % 7 ) * 0.1;
+        if( i % 250 == 100 )
+        {
+            fMs = 50.0;
+            Expected.push_back( i );
+        }
+        else if( i % 250 == 200 )
+            fMs = 31.0;
+
+        // No frame counts before there are 8 to take a median of
+        if( i == 3 )
+            fMs = 100.0;
+
+        bStuttersRight = bStuttersRight && Pacer2.AddFrame( fMs, &fWorkMs ) == ( i % 250 == 100 );
+    }
+    nFailed += DXUTFramePacingCheck( pFile, bStuttersRight && Pacer2.GetStutterCount() == Expected.size(),
+                                     "stutters over twice the median" );
+
+    bool bRecentRight = Pacer2.GetRecentStutterCount() == Expected.size();
+    for( unsigned i = 0; bRecentRight && i < Pacer2.GetRecentStutterCount(); i++ )
+    {
+        const DXUT_FRAME_RECORD& Stutter = Pacer2.GetRecentStutter( i );
+        bRecentRight = Stutter.nFrame == Expected[i] && Stutter.bStutter && Stutter.fFrameMs == 50.0 &&
+                       Stutter.fMedianMs >= 16.0 && Stutter.fMedianMs <= 16.6 &&
+                       Stutter.afSubsystemMs[0] == ( float )( Expected[i] % 10 ) && Stutter.afSubsystemMs[1] == 0.0f;
+    }
+    nFailed += DXUTFramePacingCheck( pFile, bRecentRight, "stutter records, with subsystem times" );
+
+    bool bRingRight = Pacer2.GetFrameCount() == nFrames &&
+                      Pacer2.GetRecentFrameCount() == DXUT_FRAME_PACING_HISTORY &&
+                      Pacer2.GetRecentFrame( 0 ).nFrame == nFrames - DXUT_FRAME_PACING_HISTORY &&
+                      Pacer2.GetRecentFrame( DXUT_FRAME_PACING_HISTORY - 1 ).nFrame == nFrames - 1;
+    nFailed += DXUTFramePacingCheck( pFile, bRingRight, "recent frame ring" );
+
+    //
+    // Recent percentiles are exact
+    //
+    std::vector <double> Recent;
+    for( unsigned i = DXUT_FRAME_PACING_HISTORY - 300; i < DXUT_FRAME_PACING_HISTORY; i++ )
+        Recent.push_back( Pacer2.GetRecentFrame( i ).fFrameMs );
+    std::sort( Recent.begin(), Recent.end() );
+    nFailed += DXUTFramePacingCheck( pFile, Pacer2.GetRecentPercentileMs( 50.0, 300 ) == Recent[149] &&
+                                     Pacer2.GetRecentPercentileMs( 99.0, 300 ) == Recent[296] &&
+                                     Pacer2.GetRecentPercentileMs( 100.0, 300 ) == Recent[299] &&
+                                     Pacer2.GetRecentPercentileMs( 0.0, 300 ) == Recent[0] &&
+                                     Pacer2.GetRecentPercentileMs( 50.0, 0 ) == 0.0, "recent percentiles" );
+
+    Pacer2.Reset();
+    nFailed += DXUTFramePacingCheck( pFile, Pacer2.GetFrameCount() == 0 && Pacer2.GetRecentFrameCount() == 0 &&
+                                     Pacer2.GetHistogram().GetCount() == 0 && Pacer2.GetSubsystemCount() == 1,
+                                     "reset keeps the subsystems" );
+
+    fprintf( pFile, "%u frame pacing checks failed\n", nFailed );
+    return nFailed;
+}
@@ -0,0 +1,146 @@
+//--------------------------------------------------------------------------------------
+// File: DXUTFramePacer.h
+//
+// Frame time statistics: a histogram of all frame times, the recent frames, and the
+// stutters among them.  DXUT times every frame into one (see DXUTGetFramePacer in
+// DXUTmisc.h).  Only standard C++ is used here, so this builds and runs on any platform
+// without the rest of DXUT; DXUTCheckFramePacing tests it.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#pragma once
+#ifndef DXUT_FRAMEPACER_H
+#define DXUT_FRAMEPACER_H
+
+#include <stdio.h>
+
+#define DXUT_FRAME_PACING_HISTORY   1024    // Recent frames kept
+#define DXUT_FRAME_PACING_STUTTERS  256     // Recent stutters kept
+#define DXUT_MAX_FRAME_SUBSYSTEMS   16
+
+//--------------------------------------------------------------------------------------
+// Counts frame times in buckets that are 1us wide below 128us and then 1/64th of the
+// time, so percentiles are within 1.6% whatever the range.  Times up to 76 hours are
+// kept; longer ones are counted in the last bucket.
+//--------------------------------------------------------------------------------------
+class CDXUTFrameTimeHistogram
+{
+public:
+                        CDXUTFrameTimeHistogram();
+
+    void                Reset();
+    void                Record( double fMs );
+
+    unsigned long long  GetCount() const
+    {
+        return m_nCount;
+    }
+    double              GetMinMs() const;
+    double              GetMaxMs() const;
+    double              GetMeanMs() const;
+    double              GetPercentileMs( double fPercentile ) const;    // fPercentile is 0 to 100
+
+protected:
+    enum
+    {
+        SUB_BUCKET_BITS = 7,
+        SUB_BUCKET_HALF = 1 << ( SUB_BUCKET_BITS - 1 ),
+        MAX_SHIFT = 31,
+        NUM_BUCKETS = ( MAX_SHIFT + 2 ) * SUB_BUCKET_HALF
+    };
+
+    static unsigned             GetBucket( unsigned long long nMicroseconds );
+    static unsigned long long   GetBucketHighestValue( unsigned nBucket );
+
+    unsigned m_anCounts[NUM_BUCKETS];
+    unsigned long long m_nCount;
+    unsigned long long m_nMin;      // In microseconds
+    unsigned long long m_nMax;
+    double m_fTotalMs;
+};
+
+struct DXUT_FRAME_RECORD
+{
+    unsigned long long nFrame;
+    double fFrameMs;
+    double fMedianMs;               // Median of the frames before this one
+    bool bStutter;
+    float afSubsystemMs[DXUT_MAX_FRAME_SUBSYSTEMS];
+};
+
+//--------------------------------------------------------------------------------------
+// Keeps the frame time statistics and finds stutters
+//--------------------------------------------------------------------------------------
+class CDXUTFramePacer
+{
+public:
+                        CDXUTFramePacer();
+
+    void                Reset();        // Forgets the frames but keeps the subsystems and settings
+
+    // A frame is a stutter if it takes more than fFactor times the median of the
+    // nMedianFrames frames before it
+    void                SetStutterThreshold( double fFactor, unsigned nMedianFrames );
+
+    // Returns the subsystem's index, the same one if the name is registered again, or
+    // -1 if there are already DXUT_MAX_FRAME_SUBSYSTEMS
+    int                 RegisterSubsystem( const wchar_t* strName );
+    unsigned            GetSubsystemCount() const
+    {
+        return m_nSubsystems;
+    }
+    const wchar_t*      GetSubsystemName( unsigned nSubsystem ) const
+    {
+        return m_astrSubsystems[nSubsystem];
+    }
+
+    // pafSubsystemMs has GetSubsystemCount() times, or is NULL.  Returns true for a stutter.
+    bool                AddFrame( double fFrameMs, const float* pafSubsystemMs );
+
+    const CDXUTFrameTimeHistogram& GetHistogram() const
+    {
+        return m_Histogram;
+    }
+    unsigned long long  GetFrameCount() const
+    {
+        return m_nFrames;
+    }
+    unsigned long long  GetStutterCount() const
+    {
+        return m_nStutters;
+    }
+
+    // Recent frames and stutters, oldest first
+    unsigned            GetRecentFrameCount() const;
+    const DXUT_FRAME_RECORD& GetRecentFrame( unsigned nIndex ) const;
+    unsigned            GetRecentStutterCount() const;
+    const DXUT_FRAME_RECORD& GetRecentStutter( unsigned nIndex ) const;
+
+    // Percentile of the last nFrames frames, exactly rather than from the histogram
+    double              GetRecentPercentileMs( double fPercentile, unsigned nFrames ) const;
+
+    // One row per recent frame: frame, ms, median ms, stutter, then ms per subsystem
+    bool                WriteCSV( FILE* pFile ) const;
+
+protected:
+    CDXUTFrameTimeHistogram m_Histogram;
+    DXUT_FRAME_RECORD m_aFrames[DXUT_FRAME_PACING_HISTORY];
+    DXUT_FRAME_RECORD m_aStutters[DXUT_FRAME_PACING_STUTTERS];
+    mutable double m_afScratch[DXUT_FRAME_PACING_HISTORY];
+    wchar_t m_astrSubsystems[DXUT_MAX_FRAME_SUBSYSTEMS][32];
+    unsigned m_nSubsystems;
+    unsigned long long m_nFrames;
+    unsigned long long m_nStutters;
+    double m_fStutterFactor;
+    unsigned m_nMedianFrames;
+};
+
+//--------------------------------------------------------------------------------------
+// Checks histogram percentiles against exact ones and the pacer's stutter detection on
+// made-up frame sequences.  Prints a line per check to pFile and returns the number of
+// checks that failed.
+//--------------------------------------------------------------------------------------
+unsigned DXUTCheckFramePacing( FILE* pFile );
+
+#endif
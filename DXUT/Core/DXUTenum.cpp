@@ -2030,7 +2030,7 @@ void DXUTBuildValidD3D9DeviceSettings( DXUTD3D9DeviceSettings* pValidDeviceSetti
     bool bestEnableAutoDepthStencil;
 
     CGrowableArray <int> depthStencilRanking;
-    depthStencilRanking.SetSize( pBestDeviceSettingsCombo->depthStencilFormatList.GetSize() );
+    depthStencilRanking.Reserve( pBestDeviceSettingsCombo->depthStencilFormatList.GetSize() );
 
     UINT dwBackBufferBitDepth = DXUTGetD3D9ColorChannelBits( pBestDeviceSettingsCombo->BackBufferFormat );
     UINT dwInputDepthBitDepth = 0;
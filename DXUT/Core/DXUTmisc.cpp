@@ -204,6 +204,789 @@ void CDXUTTimer::LimitThreadAffinityToCurrentProc()
 }
 
 
+//--------------------------------------------------------------------------------------
+// DXUT's frame pacer.  Subsystem times are added up from any thread in ticks and
+// moved into the pacer once a frame by DXUTUpdateFramePacing.
+//--------------------------------------------------------------------------------------
+static volatile LONGLONG g_allDXUTFrameSubsystemTicks[DXUT_MAX_FRAME_SUBSYSTEMS] = {0};
+
+static CDXUTFramePacer* DXUTCreateFramePacer()
+{
+    static CDXUTFramePacer pacer;
+
+    // In the order of DXUT_FRAME_SUBSYSTEM
+    pacer.RegisterSubsystem( L"FrameMove" );
+    pacer.RegisterSubsystem( L"FrameRender" );
+    pacer.RegisterSubsystem( L"Present" );
+    return &pacer;
+}
+
+CDXUTFramePacer* WINAPI DXUTGetFramePacer()
+{
+    // Using an accessor function gives control of the construction order
+    static CDXUTFramePacer* s_pPacer = DXUTCreateFramePacer();
+    return s_pPacer;
+}
+
+
+//--------------------------------------------------------------------------------------
+int WINAPI DXUTRegisterFrameSubsystem( LPCWSTR strName )
+{
+    DXUTLock l;
+    return DXUTGetFramePacer()->RegisterSubsystem( strName );
+}
+
+
+//--------------------------------------------------------------------------------------
+void WINAPI DXUTAddFrameSubsystemTime( int nSubsystem, LONGLONG llTicks )
+{
+    if( nSubsystem >= 0 && nSubsystem < DXUT_MAX_FRAME_SUBSYSTEMS )
+        InterlockedExchangeAdd64( &g_allDXUTFrameSubsystemTicks[nSubsystem], llTicks );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Records the time since the last call as a frame, if both calls were for frames that
+// rendered normally
+//--------------------------------------------------------------------------------------
+void WINAPI DXUTUpdateFramePacing( bool bPaced )
+{
+    static LONGLONG s_llLastTime = 0;
+    static bool s_bLastPaced = false;
+
+    LARGE_INTEGER qwTime, qwTicksPerSec;
+    QueryPerformanceCounter( &qwTime );
+    QueryPerformanceFrequency( &qwTicksPerSec );
+    double fMsPerTick = 1000.0 / ( double )qwTicksPerSec.QuadPart;
+
+    // Always take the subsystem times, so time from frames that aren't recorded doesn't
+    // end up in the next one that is
+    float afSubsystemMs[DXUT_MAX_FRAME_SUBSYSTEMS];
+    for( int i = 0; i < DXUT_MAX_FRAME_SUBSYSTEMS; i++ )
+        afSubsystemMs[i] = ( float )( InterlockedExchange64( &g_allDXUTFrameSubsystemTicks[i], 0 ) * fMsPerTick );
+
+    if( bPaced && s_bLastPaced && s_llLastTime != 0 )
+    {
+        CDXUTFramePacer* pPacer = DXUTGetFramePacer();
+        if( pPacer->AddFrame( ( qwTime.QuadPart - s_llLastTime ) * fMsPerTick, afSubsystemMs ) )
+        {
+            const DXUT_FRAME_RECORD& Frame = pPacer->GetRecentStutter( pPacer->GetRecentStutterCount() - 1 );
+            DXUTOutputDebugString( L"DXUT: Frame %llu took %0.1f ms, median %0.1f ms\n", Frame.nFrame, Frame.fFrameMs,
+                                   Frame.fMedianMs );
+        }
+    }
+
+    s_llLastTime = qwTime.QuadPart;
+    s_bLastPaced = bPaced;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT WINAPI DXUTWriteFramePacingCSV( LPCWSTR strFileName )
+{
+    FILE* pFile = NULL;
+    if( _wfopen_s( &pFile, strFileName, L"w" ) != 0 || pFile == NULL )
+        return DXUT_ERR( L"_wfopen_s", E_FAIL );
+
+    bool bWritten = DXUTGetFramePacer()->WriteCSV( pFile );
+    fclose( pFile );
+    return bWritten ? S_OK : DXUT_ERR( L"fprintf", E_FAIL );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Heap allocation counting.  DXUT's own allocators call DXUTCountHeapAllocation in every
+// build, so the count means the same in debug and release.  Debug builds also hook the
+// CRT and count every allocation separately.
+//--------------------------------------------------------------------------------------
+static volatile LONGLONG g_nDXUTHeapAllocations = 0;
+static LONGLONG g_nDXUTFrameStartAllocations = 0;
+static UINT g_nDXUTLastFrameAllocations = 0;
+static volatile LONGLONG g_nDXUTCrtAllocations = 0;
+static LONGLONG g_nDXUTFrameStartCrtAllocations = 0;
+static UINT g_nDXUTLastFrameCrtAllocations = 0;
+static SIZE_T g_cbDXUTLastFrameArenaUsed = 0;
+
+#ifdef _DEBUG
+static _CRT_ALLOC_HOOK g_pfnDXUTPrevAllocHook = NULL;
+
+static int __cdecl DXUTAllocHook( int nAllocType, void* pvData, size_t nSize, int nBlockUse, long lRequest,
+                                  const unsigned char* szFileName, int nLine )
+{
+    // Only count; the hook must not allocate or call into the CRT
+    if( nAllocType != _HOOK_FREE )
+        InterlockedIncrement64( &g_nDXUTCrtAllocations );
+
+    if( g_pfnDXUTPrevAllocHook )
+        return g_pfnDXUTPrevAllocHook( nAllocType, pvData, nSize, nBlockUse, lRequest, szFileName, nLine );
+    return TRUE;
+}
+#endif
+
+
+//--------------------------------------------------------------------------------------
+void WINAPI DXUTCountHeapAllocation()
+{
+    InterlockedIncrement64( &g_nDXUTHeapAllocations );
+}
+
+
+//--------------------------------------------------------------------------------------
+void WINAPI DXUTBeginFrameMemory()
+{
+    static bool s_bFirstFrame = true;
+    LONGLONG nAllocations = g_nDXUTHeapAllocations;
+    LONGLONG nCrtAllocations = g_nDXUTCrtAllocations;
+
+    if( s_bFirstFrame )
+    {
+#ifdef _DEBUG
+        g_pfnDXUTPrevAllocHook = _CrtSetAllocHook( DXUTAllocHook );
+#endif
+        s_bFirstFrame = false;
+    }
+    else
+    {
+        g_nDXUTLastFrameAllocations = ( UINT )( nAllocations - g_nDXUTFrameStartAllocations );
+        g_nDXUTLastFrameCrtAllocations = ( UINT )( nCrtAllocations - g_nDXUTFrameStartCrtAllocations );
+    }
+    g_nDXUTFrameStartAllocations = nAllocations;
+    g_nDXUTFrameStartCrtAllocations = nCrtAllocations;
+
+    CDXUTArena* pArena = DXUTGetFrameArena();
+    g_cbDXUTLastFrameArenaUsed = pArena->GetUsed();
+    pArena->Reset();
+}
+
+
+//--------------------------------------------------------------------------------------
+void WINAPI DXUTGetMemoryStats( DXUT_MEMORY_STATS* pStats )
+{
+    if( pStats == NULL )
+        return;
+
+    CDXUTArena* pArena = DXUTGetFrameArena();
+    pStats->nFrameHeapAllocations = g_nDXUTLastFrameAllocations;
+    pStats->nTotalHeapAllocations = ( UINT64 )g_nDXUTHeapAllocations;
+    pStats->nFrameCrtAllocations = g_nDXUTLastFrameCrtAllocations;
+    pStats->nTotalCrtAllocations = ( UINT64 )g_nDXUTCrtAllocations;
+    pStats->cbFrameArenaUsed = g_cbDXUTLastFrameArenaUsed;
+    pStats->cbFrameArenaPeak = pArena->GetPeak();
+    pStats->cbFrameArenaReserved = pArena->GetReserved();
+}
+
+
+//--------------------------------------------------------------------------------------
+CDXUTArena* WINAPI DXUTGetFrameArena()
+{
+    // Using an accessor function gives control of the construction order
+    static CDXUTArena arena( 256 * 1024 );
+    return &arena;
+}
+
+
+//--------------------------------------------------------------------------------------
+CDXUTArena* WINAPI DXUTGetScratchArena()
+{
+    static thread_local CDXUTArena arena;
+    return &arena;
+}
+
+
+//--------------------------------------------------------------------------------------
+CDXUTArena::CDXUTArena( SIZE_T cbBlockSize )
+{
+    m_pFirst = NULL;
+    m_pCurrent = NULL;
+    m_cbUsedBefore = 0;
+    m_cbBlockSize = cbBlockSize;
+    m_cbPeak = 0;
+    m_cbReserved = 0;
+    m_pLast = NULL;
+}
+
+
+//--------------------------------------------------------------------------------------
+CDXUTArena::~CDXUTArena()
+{
+    Release();
+}
+
+
+//--------------------------------------------------------------------------------------
+CDXUTArena::BLOCK* CDXUTArena::AllocateBlock( SIZE_T cbSize )
+{
+    DXUTCountHeapAllocation();
+    BLOCK* pBlock = ( BLOCK* )malloc( sizeof( BLOCK ) + cbSize );
+    if( pBlock == NULL )
+        return NULL;
+
+    pBlock->pNext = NULL;
+    pBlock->cbSize = cbSize;
+    pBlock->cbUsed = 0;
+    m_cbReserved += cbSize;
+    return pBlock;
+}
+
+
+//--------------------------------------------------------------------------------------
+void* CDXUTArena::Allocate( SIZE_T cbSize, SIZE_T cbAlignment )
+{
+    assert( cbAlignment != 0 && ( cbAlignment & ( cbAlignment - 1 ) ) == 0 );
+
+    for(; ; )
+    {
+        if( m_pCurrent )
+        {
+            UINT_PTR nStart = ( UINT_PTR )GetBlockData( m_pCurrent );
+            UINT_PTR nAligned = ( nStart + m_pCurrent->cbUsed + cbAlignment - 1 ) & ~( UINT_PTR )( cbAlignment - 1 );
+            SIZE_T cbOffset = nAligned - nStart;
+            if( cbOffset <= m_pCurrent->cbSize && cbSize <= m_pCurrent->cbSize - cbOffset )
+            {
+                m_pCurrent->cbUsed = cbOffset + cbSize;
+                m_cbPeak = __max( m_cbPeak, GetUsed() );
+                m_pLast = ( void* )nAligned;
+                return m_pLast;
+            }
+
+            // Blocks kept from before a Rewind or Reset are used again before new ones
+            if( m_pCurrent->pNext )
+            {
+                m_cbUsedBefore += m_pCurrent->cbUsed;
+                m_pCurrent = m_pCurrent->pNext;
+                m_pCurrent->cbUsed = 0;
+                continue;
+            }
+        }
+
+        if( cbSize > ( SIZE_T )-1 - sizeof( BLOCK ) - cbAlignment )
+            return NULL;
+
+        BLOCK* pBlock = AllocateBlock( __max( m_cbBlockSize, cbSize + cbAlignment ) );
+        if( pBlock == NULL )
+            return NULL;
+
+        if( m_pCurrent )
+        {
+            m_cbUsedBefore += m_pCurrent->cbUsed;
+            m_pCurrent->pNext = pBlock;
+        }
+        else
+        {
+            m_pFirst = pBlock;
+        }
+        m_pCurrent = pBlock;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+void* CDXUTArena::Reallocate( void* pData, SIZE_T cbOldSize, SIZE_T cbNewSize )
+{
+    if( pData == NULL )
+        return Allocate( cbNewSize );
+    if( cbNewSize <= cbOldSize )
+        return pData;
+
+    // The most recent allocation can grow into the rest of its block
+    if( pData == m_pLast )
+    {
+        SIZE_T cbOffset = ( BYTE* )pData - GetBlockData( m_pCurrent );
+        if( cbNewSize <= m_pCurrent->cbSize - cbOffset )
+        {
+            m_pCurrent->cbUsed = cbOffset + cbNewSize;
+            m_cbPeak = __max( m_cbPeak, GetUsed() );
+            return pData;
+        }
+    }
+
+    void* pNewData = Allocate( cbNewSize );
+    if( pNewData )
+        memcpy( pNewData, pData, cbOldSize );
+    return pNewData;
+}
+
+
+//--------------------------------------------------------------------------------------
+WCHAR* CDXUTArena::FormatText( const WCHAR* strFormat, va_list args )
+{
+    va_list argsCopy;
+    va_copy( argsCopy, args );
+    int nLength = _vscwprintf( strFormat, argsCopy );
+    va_end( argsCopy );
+    if( nLength < 0 )
+        return NULL;
+
+    WCHAR* strText = ( WCHAR* )Allocate( ( nLength + 1 ) * sizeof( WCHAR ), sizeof( WCHAR ) );
+    if( strText )
+        vswprintf_s( strText, nLength + 1, strFormat, args );
+    return strText;
+}
+
+
+//--------------------------------------------------------------------------------------
+CDXUTArena::MARKER CDXUTArena::GetMarker() const
+{
+    MARKER Marker;
+    Marker.pBlock = m_pCurrent;
+    Marker.cbUsed = m_pCurrent ? m_pCurrent->cbUsed : 0;
+    Marker.cbUsedBefore = m_cbUsedBefore;
+    return Marker;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CDXUTArena::Rewind( const MARKER& Marker )
+{
+    m_pCurrent = Marker.pBlock ? ( BLOCK* )Marker.pBlock : m_pFirst;
+    if( m_pCurrent )
+        m_pCurrent->cbUsed = Marker.cbUsed;
+    m_cbUsedBefore = Marker.cbUsedBefore;
+    m_pLast = NULL;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CDXUTArena::Reset()
+{
+    // If the data didn't fit in one block, replace the chain with a block that holds
+    // the peak so later frames don't have to allocate
+    if( m_pFirst && m_pFirst->pNext )
+    {
+        Release();
+        m_pFirst = AllocateBlock( __max( m_cbBlockSize, m_cbPeak + m_cbPeak / 4 ) );
+    }
+
+    m_pCurrent = m_pFirst;
+    if( m_pCurrent )
+        m_pCurrent->cbUsed = 0;
+    m_cbUsedBefore = 0;
+    m_pLast = NULL;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CDXUTArena::Release()
+{
+    while( m_pFirst )
+    {
+        BLOCK* pNext = m_pFirst->pNext;
+        free( m_pFirst );
+        m_pFirst = pNext;
+    }
+
+    m_pCurrent = NULL;
+    m_cbUsedBefore = 0;
+    m_cbReserved = 0;
+    m_pLast = NULL;
+}
+
+
+//--------------------------------------------------------------------------------------
+CDXUTFixedPool::CDXUTFixedPool( SIZE_T cbBlockSize, UINT nBlocksPerPage )
+{
+    InitializeCriticalSectionAndSpinCount( &m_cs, 1000 );
+    m_pFreeList = NULL;
+    m_pPages = NULL;
+
+    // Free blocks hold the list link, and every block keeps the heap's 16 byte alignment
+    m_cbBlockSize = ( __max( cbBlockSize, sizeof( void* ) ) + 15 ) & ~( SIZE_T )15;
+    m_nBlocksPerPage = __max( nBlocksPerPage, 1 );
+    m_nLive = 0;
+    m_nCapacity = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+CDXUTFixedPool::~CDXUTFixedPool()
+{
+    while( m_pPages )
+    {
+        PAGE* pNext = m_pPages->pNext;
+        free( m_pPages );
+        m_pPages = pNext;
+    }
+    DeleteCriticalSection( &m_cs );
+}
+
+
+//--------------------------------------------------------------------------------------
+void* CDXUTFixedPool::Allocate()
+{
+    EnterCriticalSection( &m_cs );
+
+    if( m_pFreeList == NULL )
+    {
+        // Blocks start 16 bytes into the page, after the page link
+        DXUTCountHeapAllocation();
+        PAGE* pPage = ( PAGE* )malloc( 16 + m_cbBlockSize * m_nBlocksPerPage );
+        if( pPage == NULL )
+        {
+            LeaveCriticalSection( &m_cs );
+            return NULL;
+        }
+        pPage->pNext = m_pPages;
+        m_pPages = pPage;
+
+        BYTE* pBlocks = ( BYTE* )pPage + 16;
+        for( UINT i = m_nBlocksPerPage; i-- > 0; )
+        {
+            *( void** )( pBlocks + i * m_cbBlockSize ) = m_pFreeList;
+            m_pFreeList = pBlocks + i * m_cbBlockSize;
+        }
+        m_nCapacity += m_nBlocksPerPage;
+    }
+
+    void* pData = m_pFreeList;
+    m_pFreeList = *( void** )pData;
+    m_nLive++;
+
+    LeaveCriticalSection( &m_cs );
+    return pData;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CDXUTFixedPool::Free( void* pData )
+{
+    if( pData == NULL )
+        return;
+
+    EnterCriticalSection( &m_cs );
+    *( void** )pData = m_pFreeList;
+    m_pFreeList = pData;
+    m_nLive--;
+    LeaveCriticalSection( &m_cs );
+}
+
+
+//--------------------------------------------------------------------------------------
+// CPU profiler.  Each thread writes completed zones into its own ring and then
+// publishes the new count, so readers on other threads can copy a ring without
+// stopping the writer and throw away whatever was overwritten while they copied.
+// Rings come from VirtualAlloc so the profiler doesn't show up in the heap statistics,
+// and are never freed, as a thread may still be using one at exit.
+//--------------------------------------------------------------------------------------
+struct DXUT_PROFILE_EVENT
+{
+    LPCWSTR strName;
+    LONGLONG llStart;
+    LONGLONG llEnd;
+    DWORD dwThreadId;
+    UINT nDepth;
+};
+
+struct DXUT_PROFILE_THREAD
+{
+    DXUT_PROFILE_THREAD* pNext;
+    DWORD dwThreadId;
+    WCHAR strName[64];
+    volatile LONGLONG nWritten;     // Zones written so far.  The next goes in nWritten % DXUT_PROFILE_RING_SIZE.
+    UINT nDepth;
+    LPCWSTR astrOpen[DXUT_PROFILE_MAX_DEPTH];
+    LONGLONG allOpenStart[DXUT_PROFILE_MAX_DEPTH];
+    DXUT_PROFILE_EVENT aEvents[DXUT_PROFILE_RING_SIZE];
+};
+
+static volatile LONG g_bDXUTProfilerEnabled = FALSE;
+static LONGLONG g_llDXUTProfilerBase = 0;
+static DXUT_PROFILE_THREAD* volatile g_pDXUTProfileThreads = NULL;
+static thread_local DXUT_PROFILE_THREAD* t_pDXUTProfileThread = NULL;
+static thread_local LPCWSTR t_strDXUTProfileThreadName = NULL;
+
+
+//--------------------------------------------------------------------------------------
+static DXUT_PROFILE_THREAD* DXUTGetProfileThread()
+{
+    DXUT_PROFILE_THREAD* pThread = t_pDXUTProfileThread;
+    if( pThread )
+        return pThread;
+
+    // VirtualAlloc returns zeroed memory
+    pThread = ( DXUT_PROFILE_THREAD* )VirtualAlloc( NULL, sizeof( DXUT_PROFILE_THREAD ), MEM_COMMIT | MEM_RESERVE,
+                                                   PAGE_READWRITE );
+    if( pThread == NULL )
+        return NULL;
+
+    pThread->dwThreadId = GetCurrentThreadId();
+    if( t_strDXUTProfileThreadName )
+        wcscpy_s( pThread->strName, 64, t_strDXUTProfileThreadName );
+    else
+        swprintf_s( pThread->strName, 64, L"Thread %u", pThread->dwThreadId );
+
+    DXUT_PROFILE_THREAD* pHead;
+    do
+    {
+        pHead = g_pDXUTProfileThreads;
+        pThread->pNext = pHead;
+    } while( InterlockedCompareExchangePointer( ( PVOID volatile* )&g_pDXUTProfileThreads, pThread, pHead ) != pHead );
+
+    t_pDXUTProfileThread = pThread;
+    return pThread;
+}
+
+
+//--------------------------------------------------------------------------------------
+void WINAPI DXUTProfilerEnable( bool bEnable )
+{
+    if( bEnable && g_llDXUTProfilerBase == 0 )
+    {
+        LARGE_INTEGER qwTime;
+        QueryPerformanceCounter( &qwTime );
+        g_llDXUTProfilerBase = qwTime.QuadPart;
+    }
+    InterlockedExchange( &g_bDXUTProfilerEnabled, bEnable ? TRUE : FALSE );
+}
+
+
+//--------------------------------------------------------------------------------------
+bool WINAPI DXUTProfilerIsEnabled()
+{
+    return g_bDXUTProfilerEnabled != FALSE;
+}
+
+
+//--------------------------------------------------------------------------------------
+void WINAPI DXUTProfilerSetThreadName( LPCWSTR strName )
+{
+    t_strDXUTProfileThreadName = strName;
+    if( t_pDXUTProfileThread )
+        wcscpy_s( t_pDXUTProfileThread->strName, 64, strName );
+}
+
+
+//--------------------------------------------------------------------------------------
+void WINAPI DXUTProfileBegin( LPCWSTR strName )
+{
+    if( !g_bDXUTProfilerEnabled )
+        return;
+
+    DXUT_PROFILE_THREAD* pThread = DXUTGetProfileThread();
+    if( pThread == NULL )
+        return;
+
+    // Zones nested too deeply still count so the ends match up, but aren't recorded
+    if( pThread->nDepth < DXUT_PROFILE_MAX_DEPTH )
+    {
+        LARGE_INTEGER qwTime;
+        QueryPerformanceCounter( &qwTime );
+        pThread->astrOpen[pThread->nDepth] = strName;
+        pThread->allOpenStart[pThread->nDepth] = qwTime.QuadPart;
+    }
+    pThread->nDepth++;
+}
+
+
+//--------------------------------------------------------------------------------------
+void WINAPI DXUTProfileEnd()
+{
+    // Zones begun before the profiler was enabled have nothing to end
+    DXUT_PROFILE_THREAD* pThread = t_pDXUTProfileThread;
+    if( pThread == NULL || pThread->nDepth == 0 )
+        return;
+
+    UINT nDepth = --pThread->nDepth;
+    if( nDepth >= DXUT_PROFILE_MAX_DEPTH || !g_bDXUTProfilerEnabled )
+        return;
+
+    LARGE_INTEGER qwTime;
+    QueryPerformanceCounter( &qwTime );
+
+    LONGLONG nWritten = pThread->nWritten;
+    DXUT_PROFILE_EVENT& Event = pThread->aEvents[nWritten % DXUT_PROFILE_RING_SIZE];
+    Event.strName = pThread->astrOpen[nDepth];
+    Event.llStart = pThread->allOpenStart[nDepth];
+    Event.llEnd = qwTime.QuadPart;
+    Event.dwThreadId = pThread->dwThreadId;
+    Event.nDepth = nDepth;
+
+    // Publish the zone after it has been written
+    InterlockedExchange64( &pThread->nWritten, nWritten + 1 );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Copies the zones in one thread's ring that weren't overwritten during the copy
+//--------------------------------------------------------------------------------------
+static HRESULT DXUTCopyProfileEvents( DXUT_PROFILE_THREAD* pThread, CGrowableArray <DXUT_PROFILE_EVENT>& Events )
+{
+    HRESULT hr;
+
+    LONGLONG nEnd = InterlockedCompareExchange64( &pThread->nWritten, 0, -1 );
+    LONGLONG nBegin = __max( nEnd - DXUT_PROFILE_RING_SIZE, 0 );
+
+    CGrowableArray <DXUT_PROFILE_EVENT> Copy;
+    V_RETURN( Copy.Reserve( ( int )( nEnd - nBegin ) ) );
+    for( LONGLONG n = nBegin; n < nEnd; n++ )
+        V_RETURN( Copy.Add( pThread->aEvents[n % DXUT_PROFILE_RING_SIZE] ) );
+
+    // While copying, the writer may have replaced the oldest zones, including the one
+    // it is writing now
+    LONGLONG nAfter = InterlockedCompareExchange64( &pThread->nWritten, 0, -1 );
+    LONGLONG nValid = __max( nAfter + 1 - DXUT_PROFILE_RING_SIZE, nBegin );
+    for( LONGLONG n = nValid; n < nEnd; n++ )
+        V_RETURN( Events.Add( Copy[( int )( n - nBegin )] ) );
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+static HRESULT DXUTCopyAllProfileEvents( CGrowableArray <DXUT_PROFILE_EVENT>& Events )
+{
+    HRESULT hr;
+
+    for( DXUT_PROFILE_THREAD* pThread = g_pDXUTProfileThreads; pThread; pThread = pThread->pNext )
+        V_RETURN( DXUTCopyProfileEvents( pThread, Events ) );
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Sorts zones by name, then by duration
+//--------------------------------------------------------------------------------------
+static int __cdecl DXUTCompareProfileEvents( const void* pArg1, const void* pArg2 )
+{
+    const DXUT_PROFILE_EVENT* pEvent1 = ( const DXUT_PROFILE_EVENT* )pArg1;
+    const DXUT_PROFILE_EVENT* pEvent2 = ( const DXUT_PROFILE_EVENT* )pArg2;
+
+    int nCompare = wcscmp( pEvent1->strName, pEvent2->strName );
+    if( nCompare != 0 )
+        return nCompare;
+
+    LONGLONG llDuration1 = pEvent1->llEnd - pEvent1->llStart;
+    LONGLONG llDuration2 = pEvent2->llEnd - pEvent2->llStart;
+    return ( llDuration1 < llDuration2 ) ? -1 : ( llDuration1 > llDuration2 ) ? 1 : 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Returns the count, min, avg, 99th percentile and max time of each zone, over all
+// threads.  Zones are matched by name.
+//--------------------------------------------------------------------------------------
+HRESULT WINAPI DXUTProfilerGetZoneStats( CGrowableArray <DXUT_PROFILE_ZONE_STATS>* pStats )
+{
+    HRESULT hr;
+
+    if( pStats == NULL )
+        return E_INVALIDARG;
+    pStats->RemoveAll();
+
+    CGrowableArray <DXUT_PROFILE_EVENT> Events;
+    V_RETURN( DXUTCopyAllProfileEvents( Events ) );
+    if( Events.GetSize() == 0 )
+        return S_OK;
+
+    qsort( Events.GetData(), Events.GetSize(), sizeof( DXUT_PROFILE_EVENT ), DXUTCompareProfileEvents );
+
+    LARGE_INTEGER qwTicksPerSec;
+    QueryPerformanceFrequency( &qwTicksPerSec );
+    double fMsPerTick = 1000.0 / ( double )qwTicksPerSec.QuadPart;
+
+    int nFirst = 0;
+    while( nFirst < Events.GetSize() )
+    {
+        int nLast = nFirst;
+        double fTotal = 0.0;
+        while( nLast < Events.GetSize() && wcscmp( Events[nLast].strName, Events[nFirst].strName ) == 0 )
+        {
+            fTotal += ( double )( Events[nLast].llEnd - Events[nLast].llStart );
+            nLast++;
+        }
+
+        // The zones are sorted by duration, so the percentile is an index
+        int nCount = nLast - nFirst;
+        int nP99 = nFirst + ( nCount * 99 + 99 ) / 100 - 1;
+
+        DXUT_PROFILE_ZONE_STATS Stats;
+        Stats.strName = Events[nFirst].strName;
+        Stats.nCount = nCount;
+        Stats.fMinMs = ( Events[nFirst].llEnd - Events[nFirst].llStart ) * fMsPerTick;
+        Stats.fAvgMs = fTotal / nCount * fMsPerTick;
+        Stats.fP99Ms = ( Events[nP99].llEnd - Events[nP99].llStart ) * fMsPerTick;
+        Stats.fMaxMs = ( Events[nLast - 1].llEnd - Events[nLast - 1].llStart ) * fMsPerTick;
+        V_RETURN( pStats->Add( Stats ) );
+
+        nFirst = nLast;
+    }
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Writes a string as UTF-8 for a JSON file
+//--------------------------------------------------------------------------------------
+static void DXUTWriteJSONString( FILE* pFile, LPCWSTR strText )
+{
+    CHAR strUTF8[512];
+    if( WideCharToMultiByte( CP_UTF8, 0, strText, -1, strUTF8, sizeof( strUTF8 ), NULL, NULL ) == 0 )
+        strcpy_s( strUTF8, sizeof( strUTF8 ), "?" );
+
+    fputc( '"', pFile );
+    for( const CHAR* pch = strUTF8; *pch; pch++ )
+    {
+        if( *pch == '"' || *pch == '\\' )
+            fprintf( pFile, "\\%c", *pch );
+        else if( ( BYTE )*pch < 0x20 )
+            fprintf( pFile, "\\u%04x", ( BYTE )*pch );
+        else
+            fputc( *pch, pFile );
+    }
+    fputc( '"', pFile );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Writes the recorded zones as a Chrome trace
+//--------------------------------------------------------------------------------------
+HRESULT WINAPI DXUTProfilerWriteTrace( LPCWSTR strFileName )
+{
+    HRESULT hr;
+
+    CGrowableArray <DXUT_PROFILE_EVENT> Events;
+    V_RETURN( DXUTCopyAllProfileEvents( Events ) );
+
+    FILE* pFile = NULL;
+    if( _wfopen_s( &pFile, strFileName, L"w" ) != 0 || pFile == NULL )
+        return DXUT_ERR( L"_wfopen_s", E_FAIL );
+
+    LARGE_INTEGER qwTicksPerSec;
+    QueryPerformanceFrequency( &qwTicksPerSec );
+    double fUsPerTick = 1000000.0 / ( double )qwTicksPerSec.QuadPart;
+    DWORD dwProcessId = GetCurrentProcessId();
+
+    fprintf( pFile, "{\"traceEvents\":[\n" );
+
+    bool bFirst = true;
+    for( DXUT_PROFILE_THREAD* pThread = g_pDXUTProfileThreads; pThread; pThread = pThread->pNext )
+    {
+        fprintf( pFile, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%u,\"tid\":%u,\"args\":{\"name\":",
+                 bFirst ? "" : ",\n", dwProcessId, pThread->dwThreadId );
+        DXUTWriteJSONString( pFile, pThread->strName );
+        fprintf( pFile, "}}" );
+        bFirst = false;
+    }
+
+    for( int i = 0; i < Events.GetSize(); i++ )
+    {
+        const DXUT_PROFILE_EVENT& Event = Events[i];
+        fprintf( pFile, "%s{\"name\":", bFirst ? "" : ",\n" );
+        DXUTWriteJSONString( pFile, Event.strName );
+        fprintf( pFile, ",\"ph\":\"X\",\"pid\":%u,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", dwProcessId, Event.dwThreadId,
+                 ( Event.llStart - g_llDXUTProfilerBase ) * fUsPerTick, ( Event.llEnd - Event.llStart ) * fUsPerTick );
+        bFirst = false;
+    }
+
+    fprintf( pFile, "\n],\"displayTimeUnit\":\"ms\"}\n" );
+
+    bool bWriteFailed = ferror( pFile ) != 0;
+    fclose( pFile );
+    return bWriteFailed ? DXUT_ERR( L"fprintf", E_FAIL ) : S_OK;
+}
+
+
 //--------------------------------------------------------------------------------------
 // Returns the string for the given D3DFORMAT.
 //--------------------------------------------------------------------------------------
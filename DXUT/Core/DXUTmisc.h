@@ -67,19 +67,71 @@ HRESULT DXUTGetGamepadState( DWORD dwPort, DXUT_GAMEPAD* pGamePad, bool bThumbst
 HRESULT DXUTStopRumbleOnAllControllers();
 void DXUTEnableXInput( bool bEnable );
 
+//--------------------------------------------------------------------------------------
+// Default allocator for CGrowableArray.  Allocators provide
+//
+//      void* Allocate( size_t cbSize );
+//      void* Reallocate( void* pData, size_t cbOldSize, size_t cbNewSize );
+//      void  Free( void* pData );
+//
+// returning memory aligned for the element type, or NULL on failure.  Reallocate is only
+// used for elements that can be moved with memcpy, and must leave pData untouched if it
+// fails.  Arrays keep a copy of their allocator, so an allocator for an arena or a frame
+// heap should hold a pointer to it.
+//--------------------------------------------------------------------------------------
+void WINAPI DXUTCountHeapAllocation();
+
+struct CGrowableArrayHeap
+{
+    void* Allocate( size_t cbSize )
+    {
+        DXUTCountHeapAllocation(); return malloc( cbSize );
+    }
+    void* Reallocate( void* pData, size_t cbOldSize, size_t cbNewSize )
+    {
+        UNREFERENCED_PARAMETER( cbOldSize ); DXUTCountHeapAllocation(); return realloc( pData, cbNewSize );
+    }
+    void    Free( void* pData )
+    {
+        free( pData );
+    }
+};
+
+template<typename TYPE, typename ALLOC = CGrowableArrayHeap> class CGrowableArray;
+
+//--------------------------------------------------------------------------------------
+// Elements for which this is true are moved with memcpy when an array grows or shifts,
+// everything else is move constructed.  Specialize it for types that own resources but
+// never point into themselves, such as COM smart pointers.
+//--------------------------------------------------------------------------------------
+template<typename TYPE> struct DXUTIsRelocatable : std::is_trivially_copyable <TYPE>
+{
+};
+template<typename TYPE, typename ALLOC> struct DXUTIsRelocatable <CGrowableArray <TYPE, ALLOC> > : std::true_type
+{
+};
+
 //--------------------------------------------------------------------------------------
 // A growable array
 //--------------------------------------------------------------------------------------
-template<typename TYPE> class CGrowableArray
+template<typename TYPE, typename ALLOC> class CGrowableArray
 {
 public:
             CGrowableArray()
             {
-                m_pData = NULL; m_nSize = 0; m_nMaxSize = 0;
+                Construct( NULL, 0 );
             }
-            CGrowableArray( const CGrowableArray <TYPE>& a )
+    explicit CGrowableArray( const ALLOC& Alloc ) : m_Alloc( Alloc )
             {
-                for( int i = 0; i < a.m_nSize; i++ ) Add( a.m_pData[i] );
+                Construct( NULL, 0 );
+            }
+            CGrowableArray( const CGrowableArray <TYPE, ALLOC>& a ) : m_Alloc( a.m_Alloc )
+            {
+                Construct( NULL, 0 ); Copy( a );
+            }
+            CGrowableArray( CGrowableArray <TYPE, ALLOC>&& a ) : m_Alloc( a.m_Alloc )
+            {
+                Construct( NULL, 0 ); Move( a );
             }
             ~CGrowableArray()
             {
@@ -95,16 +147,30 @@ public:
         return GetAt( nIndex );
     }
 
-    CGrowableArray& operator=( const CGrowableArray <TYPE>& a )
+    CGrowableArray& operator=( const CGrowableArray <TYPE, ALLOC>& a )
+    {
+        if( this == &a ) return *this; Reset(); Copy( a ); return *this;
+    }
+    CGrowableArray& operator=( CGrowableArray <TYPE, ALLOC>&& a )
     {
-        if( this == &a ) return *this; RemoveAll(); for( int i = 0; i < a.m_nSize;
-                                                         i++ ) Add( a.m_pData[i] ); return *this;
+        if( this == &a ) return *this; RemoveAll(); Move( a ); return *this;
     }
 
     HRESULT SetSize( int nNewMaxSize );
-    HRESULT Add( const TYPE& value );
+    HRESULT Reserve( int nNewMaxSize );         // Allocates exactly, without adding elements
+    HRESULT Add( const TYPE& value )
+    {
+        return Emplace( value );
+    }
+    HRESULT Add( TYPE&& value )
+    {
+        return Emplace( std::move( value ) );
+    }
+    template<typename... ARGS> HRESULT Emplace( ARGS&&... args );   // Constructs in place at the end
     HRESULT Insert( int nIndex, const TYPE& value );
+    HRESULT Insert( int nIndex, TYPE&& value );
     HRESULT SetAt( int nIndex, const TYPE& value );
+    HRESULT SetAt( int nIndex, TYPE&& value );
     TYPE& GetAt( int nIndex ) const
     {
         assert( nIndex >= 0 && nIndex < m_nSize ); return m_pData[nIndex];
@@ -113,10 +179,22 @@ public:
     {
         return m_nSize;
     }
+    int     GetCapacity() const
+    {
+        return m_nMaxSize;
+    }
     TYPE* GetData()
     {
         return m_pData;
     }
+    const TYPE* GetData() const
+    {
+        return m_pData;
+    }
+    ALLOC& GetAllocator()
+    {
+        return m_Alloc;
+    }
     bool    Contains( const TYPE& value )
     {
         return ( -1 != IndexOf( value ) );
@@ -143,23 +221,352 @@ public:
     int     LastIndexOf( const TYPE& value, int nIndex, int nNumElements );
 
     HRESULT Remove( int nIndex );
+    HRESULT SwapRemove( int nIndex );           // Moves the last element into the gap, so order isn't kept
     void    RemoveAll()
     {
         SetSize( 0 );
     }
-    void    Reset()
+    void    Reset()                             // Removes the elements but keeps the memory
     {
-        m_nSize = 0;
+        for( int i = 0; i < m_nSize; ++i ) m_pData[i].~TYPE(); m_nSize = 0;
     }
 
 protected:
+    // For CSmallGrowableArray, which starts out in storage of its own
+            CGrowableArray( TYPE* pInline, int nInlineSize, const ALLOC& Alloc ) : m_Alloc( Alloc )
+            {
+                Construct( pInline, nInlineSize );
+            }
+
     TYPE* m_pData;      // the actual array of data
     int m_nSize;        // # of elements (upperBound - 1)
     int m_nMaxSize;     // max allocated
+    TYPE* m_pInline;    // storage that isn't freed, or NULL
+    int m_nInlineSize;  // # of elements that fit in m_pInline
+    ALLOC m_Alloc;
 
+    void    Construct( TYPE* pInline, int nInlineSize )
+    {
+        m_pData = m_pInline = pInline; m_nSize = 0; m_nMaxSize = m_nInlineSize = nInlineSize;
+    }
+    HRESULT Copy( const CGrowableArray <TYPE, ALLOC>& a );  // Expects an empty array
+    void    Move( CGrowableArray <TYPE, ALLOC>& a );        // Expects an empty array with no memory
     HRESULT SetSizeInternal( int nNewMaxSize );  // This version doesn't call ctor or dtor.
+    HRESULT Reallocate( int nNewMaxSize );
+    HRESULT InsertInternal( int nIndex, TYPE& value );
+
+    // Element moves, with memcpy for the types that allow it
+    static void CopyElements( TYPE* pDest, const TYPE* pSrc, int nCount, std::true_type );
+    static void CopyElements( TYPE* pDest, const TYPE* pSrc, int nCount, std::false_type );
+    static void Relocate( TYPE* pDest, TYPE* pSrc, int nCount, std::true_type );
+    static void Relocate( TYPE* pDest, TYPE* pSrc, int nCount, std::false_type );
+    static void OpenGap( TYPE* pData, int nIndex, int nSize, std::true_type );
+    static void OpenGap( TYPE* pData, int nIndex, int nSize, std::false_type );
+    static void CloseGap( TYPE* pData, int nIndex, int nSize, std::true_type );
+    static void CloseGap( TYPE* pData, int nIndex, int nSize, std::false_type );
+};
+
+
+//--------------------------------------------------------------------------------------
+// A growable array that holds its first INLINE_COUNT elements inside the object, so short
+// lists never allocate.  It can't be moved with memcpy.
+//--------------------------------------------------------------------------------------
+template<typename TYPE, int INLINE_COUNT, typename ALLOC = CGrowableArrayHeap> class CSmallGrowableArray :
+    public CGrowableArray <TYPE, ALLOC>
+{
+public:
+            CSmallGrowableArray() : CGrowableArray <TYPE, ALLOC>( ( TYPE* )m_Storage, INLINE_COUNT, ALLOC() )
+            {
+            }
+    explicit CSmallGrowableArray( const ALLOC& Alloc ) :
+                CGrowableArray <TYPE, ALLOC>( ( TYPE* )m_Storage, INLINE_COUNT, Alloc )
+            {
+            }
+            CSmallGrowableArray( const CSmallGrowableArray& a ) :
+                CGrowableArray <TYPE, ALLOC>( ( TYPE* )m_Storage, INLINE_COUNT, a.m_Alloc )
+            {
+                this->Copy( a );
+            }
+            CSmallGrowableArray( CSmallGrowableArray&& a ) :
+                CGrowableArray <TYPE, ALLOC>( ( TYPE* )m_Storage, INLINE_COUNT, a.m_Alloc )
+            {
+                this->Move( a );
+            }
+            ~CSmallGrowableArray()
+            {
+                this->RemoveAll();
+            }
+
+    CSmallGrowableArray& operator=( const CSmallGrowableArray& a )
+    {
+        CGrowableArray <TYPE, ALLOC>::operator=( a ); return *this;
+    }
+    CSmallGrowableArray& operator=( CSmallGrowableArray&& a )
+    {
+        CGrowableArray <TYPE, ALLOC>::operator=( std::move( a ) ); return *this;
+    }
+
+private:
+    typename std::aligned_storage <sizeof( TYPE ), __alignof( TYPE )>::type m_Storage[INLINE_COUNT];
+};
+
+
+//--------------------------------------------------------------------------------------
+// Memory for transient data, so steady-state frames don't touch the heap
+//
+// CDXUTArena hands out memory by bumping a pointer and takes it all back at once.  The
+// frame arena from DXUTGetFrameArena() is reset at the start of every frame by
+// DXUTRender3DEnvironment, so anything taken from it lives until the end of the frame
+// and may only be used on the thread that renders.  Each thread also has a scratch arena
+// for temporaries inside one function: declare a CDXUTScratchScope and everything taken
+// from it goes back when the scope ends.  Arenas keep their memory, and after a frame
+// that needed several blocks they merge them into one, so they stop allocating once the
+// peak is known.
+//
+// CGrowableArray can be built on an arena with CDXUTArenaAllocator, or CDXUTFrameArray
+// for the frame arena.  Such arrays must not outlive the frame or scope.
+//
+// CDXUTFixedPool recycles blocks of one size, for objects that are created and destroyed
+// all the time, and can be shared between threads.  DXUT_DECLARE_POOLED_NEW routes a
+// class's new and delete through one.
+//
+// DXUTGetMemoryStats reports heap allocations per frame.  Every build counts those made
+// by DXUT's containers, arenas and pools, and DXUTGetFrameStats shows that count next to
+// the frame rate.  Debug builds also count every CRT allocation from the first frame on.
+//--------------------------------------------------------------------------------------
+struct DXUT_MEMORY_STATS
+{
+    UINT nFrameHeapAllocations;     // DXUT heap allocations during the last frame
+    UINT64 nTotalHeapAllocations;   // DXUT heap allocations since startup
+    UINT nFrameCrtAllocations;      // All CRT allocations during the last frame; 0 in release builds
+    UINT64 nTotalCrtAllocations;    // All CRT allocations since the first frame; 0 in release builds
+    SIZE_T cbFrameArenaUsed;        // Bytes taken from the frame arena during the last frame
+    SIZE_T cbFrameArenaPeak;        // Most bytes taken from the frame arena in one frame
+    SIZE_T cbFrameArenaReserved;    // Bytes held by the frame arena
+};
+
+void WINAPI DXUTGetMemoryStats( DXUT_MEMORY_STATS* pStats );
+void WINAPI DXUTBeginFrameMemory();     // Called by DXUTRender3DEnvironment
+
+class CDXUTArena
+{
+public:
+    struct MARKER
+    {
+        void* pBlock;
+        SIZE_T cbUsed;
+        SIZE_T cbUsedBefore;
+    };
+
+                    CDXUTArena( SIZE_T cbBlockSize = 64 * 1024 );
+                    ~CDXUTArena();
+
+    void*           Allocate( SIZE_T cbSize, SIZE_T cbAlignment = 16 );
+    void*           Reallocate( void* pData, SIZE_T cbOldSize, SIZE_T cbNewSize );  // Grows the last allocation in place
+    WCHAR*          FormatText( const WCHAR* strFormat, va_list args );            // vswprintf into the arena
+
+    MARKER          GetMarker() const;
+    void            Rewind( const MARKER& Marker );     // Takes back everything allocated since the marker
+    void            Reset();                            // Takes back everything
+    void            Release();                          // Takes back everything and frees the memory
+
+    SIZE_T          GetUsed() const
+    {
+        return m_cbUsedBefore + ( m_pCurrent ? m_pCurrent->cbUsed : 0 );
+    }
+    SIZE_T          GetPeak() const
+    {
+        return m_cbPeak;
+    }
+    SIZE_T          GetReserved() const
+    {
+        return m_cbReserved;
+    }
+
+protected:
+    struct BLOCK
+    {
+        BLOCK* pNext;
+        SIZE_T cbSize;              // Bytes of data after the header
+        SIZE_T cbUsed;
+    };
+
+    BLOCK*          AllocateBlock( SIZE_T cbSize );
+    BYTE*           GetBlockData( BLOCK* pBlock ) const
+    {
+        return ( BYTE* )( pBlock + 1 );
+    }
+
+    BLOCK* m_pFirst;
+    BLOCK* m_pCurrent;
+    SIZE_T m_cbUsedBefore;          // Bytes used in the blocks before m_pCurrent
+    SIZE_T m_cbBlockSize;
+    SIZE_T m_cbPeak;
+    SIZE_T m_cbReserved;
+    void* m_pLast;                  // Most recent allocation, which Reallocate can grow
+};
+
+CDXUTArena* WINAPI DXUTGetFrameArena();
+CDXUTArena* WINAPI DXUTGetScratchArena();   // The calling thread's
+
+//--------------------------------------------------------------------------------------
+// Rewinds the calling thread's scratch arena when it goes out of scope
+//--------------------------------------------------------------------------------------
+class CDXUTScratchScope
+{
+public:
+                    CDXUTScratchScope()
+                    {
+                        m_pArena = DXUTGetScratchArena(); m_Marker = m_pArena->GetMarker();
+                    }
+                    ~CDXUTScratchScope()
+                    {
+                        m_pArena->Rewind( m_Marker );
+                    }
+
+    void*           Allocate( SIZE_T cbSize, SIZE_T cbAlignment = 16 )
+    {
+        return m_pArena->Allocate( cbSize, cbAlignment );
+    }
+    CDXUTArena*     GetArena()
+    {
+        return m_pArena;
+    }
+
+private:
+    CDXUTArena* m_pArena;
+    CDXUTArena::MARKER m_Marker;
+
+                    CDXUTScratchScope( const CDXUTScratchScope& );
+    CDXUTScratchScope& operator=( const CDXUTScratchScope& );
+};
+
+//--------------------------------------------------------------------------------------
+// CGrowableArray allocator for arenas.  Nothing is freed until the arena is rewound.
+//--------------------------------------------------------------------------------------
+struct CDXUTArenaAllocator
+{
+    CDXUTArena* pArena;
+
+    CDXUTArenaAllocator( CDXUTArena* pArenaToUse = DXUTGetFrameArena() ) : pArena( pArenaToUse )
+    {
+    }
+    void* Allocate( size_t cbSize )
+    {
+        return pArena->Allocate( cbSize );
+    }
+    void* Reallocate( void* pData, size_t cbOldSize, size_t cbNewSize )
+    {
+        return pArena->Reallocate( pData, cbOldSize, cbNewSize );
+    }
+    void    Free( void* pData )
+    {
+        UNREFERENCED_PARAMETER( pData );
+    }
+};
+
+template<typename TYPE> using CDXUTFrameArray = CGrowableArray <TYPE, CDXUTArenaAllocator>;
+
+//--------------------------------------------------------------------------------------
+// Recycles blocks of one size.  Memory is allocated a page of blocks at a time and only
+// returned by the destructor.  Thread safe.
+//--------------------------------------------------------------------------------------
+class CDXUTFixedPool
+{
+public:
+                    CDXUTFixedPool( SIZE_T cbBlockSize, UINT nBlocksPerPage = 64 );
+                    ~CDXUTFixedPool();
+
+    void*           Allocate();
+    void            Free( void* pData );
+
+    SIZE_T          GetBlockSize() const
+    {
+        return m_cbBlockSize;
+    }
+    UINT            GetLiveCount() const
+    {
+        return m_nLive;
+    }
+    UINT            GetCapacity() const
+    {
+        return m_nCapacity;
+    }
+
+private:
+    struct PAGE
+    {
+        PAGE* pNext;
+    };
+
+    CRITICAL_SECTION m_cs;
+    void* m_pFreeList;              // Free blocks, each holding a pointer to the next
+    PAGE* m_pPages;
+    SIZE_T m_cbBlockSize;
+    UINT m_nBlocksPerPage;
+    UINT m_nLive;
+    UINT m_nCapacity;
+
+                    CDXUTFixedPool( const CDXUTFixedPool& );
+    CDXUTFixedPool& operator=( const CDXUTFixedPool& );
+};
+
+//--------------------------------------------------------------------------------------
+// Typed front end to CDXUTFixedPool
+//--------------------------------------------------------------------------------------
+template<typename TYPE> class CDXUTObjectPool
+{
+public:
+                    CDXUTObjectPool( UINT nObjectsPerPage = 64 ) : m_Pool( sizeof( TYPE ), nObjectsPerPage )
+                    {
+                    }
+
+    template<typename... ARGS> TYPE* New( ARGS&&... args )
+    {
+        void* pData = m_Pool.Allocate();
+        return pData ? ::new ( pData ) TYPE( std::forward <ARGS>( args )... ) : NULL;
+    }
+    void            Delete( TYPE* pObject )
+    {
+        if( pObject ) { pObject->~TYPE(); m_Pool.Free( pObject ); }
+    }
+    UINT            GetLiveCount() const
+    {
+        return m_Pool.GetLiveCount();
+    }
+
+private:
+    CDXUTFixedPool m_Pool;
 };
 
+//--------------------------------------------------------------------------------------
+// Pooled new and delete for a class.  Put DXUT_DECLARE_POOLED_NEW() in the class and
+// DXUT_IMPLEMENT_POOLED_NEW( CClass ) in one .cpp file.  Derived classes of a different
+// size fall back to the heap, so the class needs a virtual destructor if it is deleted
+// through a base pointer.
+//--------------------------------------------------------------------------------------
+#define DXUT_DECLARE_POOLED_NEW() \
+    static CDXUTFixedPool& GetPool(); \
+    static void* operator new( size_t cbSize ); \
+    static void operator delete( void* pData, size_t cbSize )
+
+#define DXUT_IMPLEMENT_POOLED_NEW( classname ) \
+    CDXUTFixedPool& classname::GetPool() \
+    { \
+        static CDXUTFixedPool s_Pool( sizeof( classname ) ); \
+        return s_Pool; \
+    } \
+    void* classname::operator new( size_t cbSize ) \
+    { \
+        void* pData = ( cbSize == sizeof( classname ) ) ? GetPool().Allocate() : ::operator new( cbSize, std::nothrow ); \
+        if( !pData ) throw std::bad_alloc(); \
+        return pData; \
+    } \
+    void classname::operator delete( void* pData, size_t cbSize ) \
+    { \
+        if( cbSize == sizeof( classname ) ) GetPool().Free( pData ); else ::operator delete( pData ); \
+    }
+
 
 //--------------------------------------------------------------------------------------
 // Performs timer operations
@@ -198,6 +605,64 @@ protected:
 
 CDXUTTimer*                 WINAPI DXUTGetGlobalTimer();
 
+//--------------------------------------------------------------------------------------
+// Frame pacing
+//
+// The frame rate in DXUTGetFrameStats is an average over a second, which hides single
+// long frames.  DXUT also times every frame into a CDXUTFramePacer: a histogram of all
+// frame times, the recent frames, and the stutters among them, which are frames that
+// took more than a set factor times the median of the frames before them.  Each frame
+// records the time spent in each subsystem, so a stutter shows what was running.  DXUT
+// times FrameMove, FrameRender and Present; apps and other threads can add their own
+// with DXUTRegisterFrameSubsystem and CDXUTFrameSubsystemScope.  Time is added to the
+// frame in which the scope ends.
+//
+// Frames aren't recorded while rendering is paused, the window is inactive or
+// occluded, or the device is lost, as DXUT sleeps on purpose then.  The -framestats:file
+// command line flag writes the recent frames to a CSV file at exit.
+//
+// CDXUTFrameTimeHistogram and CDXUTFramePacer are in DXUTFramePacer.h, which only uses
+// standard C++, so they can be built and tested on their own.  -framestatscheck runs
+// DXUTCheckFramePacing and exits.
+//--------------------------------------------------------------------------------------
+enum DXUT_FRAME_SUBSYSTEM
+{
+    DXUT_FRAME_SUBSYSTEM_FRAMEMOVE = 0,
+    DXUT_FRAME_SUBSYSTEM_FRAMERENDER,
+    DXUT_FRAME_SUBSYSTEM_PRESENT,
+};
+
+CDXUTFramePacer* WINAPI DXUTGetFramePacer();
+int WINAPI DXUTRegisterFrameSubsystem( LPCWSTR strName );
+void WINAPI DXUTAddFrameSubsystemTime( int nSubsystem, LONGLONG llTicks );     // Thread safe
+void WINAPI DXUTUpdateFramePacing( bool bPaced );  // Called by DXUTRender3DEnvironment
+HRESULT WINAPI DXUTWriteFramePacingCSV( LPCWSTR strFileName );
+
+//--------------------------------------------------------------------------------------
+// Adds the time a block of code takes to a frame subsystem
+//--------------------------------------------------------------------------------------
+class CDXUTFrameSubsystemScope
+{
+public:
+CDXUTFrameSubsystemScope( int nSubsystem )
+{
+    LARGE_INTEGER qwTime;
+    QueryPerformanceCounter( &qwTime );
+    m_nSubsystem = nSubsystem;
+    m_llStart = qwTime.QuadPart;
+}
+~CDXUTFrameSubsystemScope( void )
+{
+    LARGE_INTEGER qwTime;
+    QueryPerformanceCounter( &qwTime );
+    DXUTAddFrameSubsystemTime( m_nSubsystem, qwTime.QuadPart - m_llStart );
+}
+
+private:
+    int m_nSubsystem;
+    LONGLONG m_llStart;
+};
+
 
 //--------------------------------------------------------------------------------------
 // Returns the string for the given D3DFORMAT.
@@ -365,12 +830,62 @@ const D3DCOLOR              DXUT_PERFEVENTCOLOR3 = D3DCOLOR_XRGB( 100, 100, 200
 #define DXUT_SetPerfMarker( color, pstrMessage )    (__noop)
 #endif
 
+//--------------------------------------------------------------------------------------
+// CPU profiler
+//
+// Records nested timings on any thread into a ring buffer owned by that thread, so
+// recording takes no locks.  Nothing is recorded until DXUTProfilerEnable( true ) is
+// called or the app is started with -profile:filename, which also writes a trace to
+// that file when DXUT shuts down.  Zone names are kept by pointer, so they must be
+// string literals or otherwise outlive the program.  The statistics and the trace
+// cover the zones still in the rings, which is the last DXUT_PROFILE_RING_SIZE zones
+// recorded by each thread.  Traces are in the Chrome trace event format, and can be
+// opened in chrome://tracing or Perfetto.
+//--------------------------------------------------------------------------------------
+#define DXUT_PROFILE_RING_SIZE      16384
+#define DXUT_PROFILE_MAX_DEPTH      64
+
+struct DXUT_PROFILE_ZONE_STATS
+{
+    LPCWSTR strName;
+    UINT nCount;
+    double fMinMs;
+    double fAvgMs;
+    double fP99Ms;
+    double fMaxMs;
+};
+
+void WINAPI DXUTProfilerEnable( bool bEnable );
+bool WINAPI DXUTProfilerIsEnabled();
+void WINAPI DXUTProfilerSetThreadName( LPCWSTR strName );      // Names the calling thread in traces
+void WINAPI DXUTProfileBegin( LPCWSTR strName );
+void WINAPI DXUTProfileEnd();
+HRESULT WINAPI DXUTProfilerGetZoneStats( CGrowableArray <DXUT_PROFILE_ZONE_STATS>* pStats );
+HRESULT WINAPI DXUTProfilerWriteTrace( LPCWSTR strFileName );
+
+//--------------------------------------------------------------------------------------
+// Times a block of code with the CPU profiler only
+//--------------------------------------------------------------------------------------
+class CDXUTProfileScope
+{
+public:
+CDXUTProfileScope( LPCWSTR strName )
+{
+    DXUTProfileBegin( strName );
+}
+~CDXUTProfileScope( void )
+{
+    DXUTProfileEnd();
+}
+};
+
 //--------------------------------------------------------------------------------------
 // CDXUTPerfEventGenerator is a helper class that makes it easy to attach begin and end
 // events to a block of code.  Simply define a CDXUTPerfEventGenerator variable anywhere 
 // in a block of code, and the class's constructor will call DXUT_BeginPerfEvent when 
 // the block of code begins, and the class's destructor will call DXUT_EndPerfEvent when 
-// the block ends.
+// the block ends.  The block is also timed by the CPU profiler, using the message as
+// the zone name.
 //--------------------------------------------------------------------------------------
 class CDXUTPerfEventGenerator
 {
@@ -378,9 +893,11 @@ public:
 CDXUTPerfEventGenerator( D3DCOLOR color, LPCWSTR pstrMessage )
 {
     DXUT_BeginPerfEvent( color, pstrMessage );
+    DXUTProfileBegin( pstrMessage );
 }
 ~CDXUTPerfEventGenerator( void )
 {
+    DXUTProfileEnd();
     DXUT_EndPerfEvent();
 }
 };
@@ -422,7 +939,7 @@ void WINAPI DXUTGetDesktopResolution( UINT AdapterOrdinal, UINT* pWidth, UINT* p
 //--------------------------------------------------------------------------------------
 
 // This version doesn't call ctor or dtor.
-template<typename TYPE> HRESULT CGrowableArray <TYPE>::SetSizeInternal( int nNewMaxSize )
+template<typename TYPE, typename ALLOC> HRESULT CGrowableArray <TYPE, ALLOC>::SetSizeInternal( int nNewMaxSize )
 {
     if( nNewMaxSize < 0 || ( nNewMaxSize > INT_MAX / sizeof( TYPE ) ) )
     {
@@ -433,93 +950,129 @@ template<typename TYPE> HRESULT CGrowableArray <TYPE>::SetSizeInternal( int nNew
     if( nNewMaxSize == 0 )
     {
         // Shrink to 0 size & cleanup
-        if( m_pData )
-        {
-            free( m_pData );
-            m_pData = NULL;
-        }
+        if( m_pData != m_pInline )
+            m_Alloc.Free( m_pData );
 
-        m_nMaxSize = 0;
+        m_pData = m_pInline;
+        m_nMaxSize = m_nInlineSize;
         m_nSize = 0;
     }
-    else if( m_pData == NULL || nNewMaxSize > m_nMaxSize )
+    else if( nNewMaxSize > m_nMaxSize )
     {
         // Grow array
         int nGrowBy = ( m_nMaxSize == 0 ) ? 16 : m_nMaxSize;
 
-        // Limit nGrowBy to keep m_nMaxSize less than INT_MAX
-        if( ( UINT )m_nMaxSize + ( UINT )nGrowBy > ( UINT )INT_MAX )
-            nGrowBy = INT_MAX - m_nMaxSize;
+        // Limit nGrowBy to keep (m_nMaxSize * sizeof(TYPE)) less than INT_MAX
+        int nLimit = ( int )( INT_MAX / sizeof( TYPE ) );
+        if( nGrowBy > nLimit - m_nMaxSize )
+            nGrowBy = nLimit - m_nMaxSize;
 
-        nNewMaxSize = __max( nNewMaxSize, m_nMaxSize + nGrowBy );
+        return Reallocate( __max( nNewMaxSize, m_nMaxSize + nGrowBy ) );
+    }
 
-        // Verify that (nNewMaxSize * sizeof(TYPE)) is not greater than UINT_MAX or the realloc will overrun
-        if( sizeof( TYPE ) > UINT_MAX / ( UINT )nNewMaxSize )
-            return E_INVALIDARG;
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Moves the elements into an allocation of exactly nNewMaxSize elements
+//--------------------------------------------------------------------------------------
+template<typename TYPE, typename ALLOC> HRESULT CGrowableArray <TYPE, ALLOC>::Reallocate( int nNewMaxSize )
+{
+    assert( nNewMaxSize >= m_nSize );
 
-        TYPE* pDataNew = ( TYPE* )realloc( m_pData, nNewMaxSize * sizeof( TYPE ) );
+    TYPE* pDataNew;
+    if( DXUTIsRelocatable <TYPE>::value && m_pData != m_pInline )
+    {
+        // The allocator may be able to grow the block where it is
+        pDataNew = ( TYPE* )m_Alloc.Reallocate( m_pData, m_nMaxSize * sizeof( TYPE ), nNewMaxSize * sizeof( TYPE ) );
+        if( pDataNew == NULL )
+            return E_OUTOFMEMORY;
+    }
+    else
+    {
+        pDataNew = ( TYPE* )m_Alloc.Allocate( nNewMaxSize * sizeof( TYPE ) );
         if( pDataNew == NULL )
             return E_OUTOFMEMORY;
 
-        m_pData = pDataNew;
-        m_nMaxSize = nNewMaxSize;
+        Relocate( pDataNew, m_pData, m_nSize, DXUTIsRelocatable <TYPE>() );
+        if( m_pData != m_pInline )
+            m_Alloc.Free( m_pData );
     }
 
+    m_pData = pDataNew;
+    m_nMaxSize = nNewMaxSize;
+
     return S_OK;
 }
 
 
 //--------------------------------------------------------------------------------------
-template<typename TYPE> HRESULT CGrowableArray <TYPE>::SetSize( int nNewMaxSize )
+template<typename TYPE, typename ALLOC> HRESULT CGrowableArray <TYPE, ALLOC>::SetSize( int nNewMaxSize )
 {
-    int nOldSize = m_nSize;
-
-    if( nOldSize > nNewMaxSize )
+    if( nNewMaxSize < 0 )
     {
-        assert( m_pData );
-        if( m_pData )
-        {
-            // Removing elements. Call dtor.
-
-            for( int i = nNewMaxSize; i < nOldSize; ++i )
-                m_pData[i].~TYPE();
-        }
+        assert( false );
+        return E_INVALIDARG;
     }
 
-    // Adjust buffer.  Note that there's no need to check for error
-    // since if it happens, nOldSize == nNewMaxSize will be true.)
+    // Removing elements. Call dtor.
+    for( int i = nNewMaxSize; i < m_nSize; ++i )
+        m_pData[i].~TYPE();
+    if( m_nSize > nNewMaxSize )
+        m_nSize = nNewMaxSize;
+
+    // Adjust buffer
     HRESULT hr = SetSizeInternal( nNewMaxSize );
+    if( FAILED( hr ) )
+        return hr;
+
+    // Adding elements. Call ctor.
+    for( int i = m_nSize; i < nNewMaxSize; ++i )
+        ::new ( &m_pData[i] ) TYPE;
+    m_nSize = nNewMaxSize;
+
+    return S_OK;
+}
 
-    if( nOldSize < nNewMaxSize )
-    {
-        assert( m_pData );
-        if( m_pData )
-        {
-            // Adding elements. Call ctor.
 
-            for( int i = nOldSize; i < nNewMaxSize; ++i )
-                ::new ( &m_pData[i] ) TYPE;
-        }
+//--------------------------------------------------------------------------------------
+template<typename TYPE, typename ALLOC> HRESULT CGrowableArray <TYPE, ALLOC>::Reserve( int nNewMaxSize )
+{
+    if( nNewMaxSize < 0 || ( nNewMaxSize > INT_MAX / sizeof( TYPE ) ) )
+    {
+        assert( false );
+        return E_INVALIDARG;
     }
 
-    return hr;
+    if( nNewMaxSize <= m_nMaxSize )
+        return S_OK;
+
+    return Reallocate( nNewMaxSize );
 }
 
 
 //--------------------------------------------------------------------------------------
-template<typename TYPE> HRESULT CGrowableArray <TYPE>::Add( const TYPE& value )
+template<typename TYPE, typename ALLOC> template<typename... ARGS>
+HRESULT CGrowableArray <TYPE, ALLOC>::Emplace( ARGS&&... args )
 {
-    HRESULT hr;
-    if( FAILED( hr = SetSizeInternal( m_nSize + 1 ) ) )
-        return hr;
+    if( m_nSize < m_nMaxSize )
+    {
+        ::new ( &m_pData[m_nSize] ) TYPE( std::forward <ARGS>( args )... );
+    }
+    else
+    {
+        // The arguments may refer to elements of this array, which move when it grows,
+        // so construct the new element first
+        TYPE value( std::forward <ARGS>( args )... );
 
-    assert( m_pData != NULL );
+        HRESULT hr;
+        if( FAILED( hr = SetSizeInternal( m_nSize + 1 ) ) )
+            return hr;
 
-    // Construct the new element
-    ::new ( &m_pData[m_nSize] ) TYPE;
+        ::new ( &m_pData[m_nSize] ) TYPE( std::move( value ) );
+    }
 
-    // Assign
-    m_pData[m_nSize] = value;
     ++m_nSize;
 
     return S_OK;
@@ -527,10 +1080,25 @@ template<typename TYPE> HRESULT CGrowableArray <TYPE>::Add( const TYPE& value )
 
 
 //--------------------------------------------------------------------------------------
-template<typename TYPE> HRESULT CGrowableArray <TYPE>::Insert( int nIndex, const TYPE& value )
+template<typename TYPE, typename ALLOC> HRESULT CGrowableArray <TYPE, ALLOC>::Insert( int nIndex, const TYPE& value )
 {
-    HRESULT hr;
+    // Validate index
+    if( nIndex < 0 ||
+        nIndex > m_nSize )
+    {
+        assert( false );
+        return E_INVALIDARG;
+    }
 
+    // Copy first, in case value is an element that is about to move
+    TYPE copy( value );
+    return InsertInternal( nIndex, copy );
+}
+
+
+//--------------------------------------------------------------------------------------
+template<typename TYPE, typename ALLOC> HRESULT CGrowableArray <TYPE, ALLOC>::Insert( int nIndex, TYPE&& value )
+{
     // Validate index
     if( nIndex < 0 ||
         nIndex > m_nSize )
@@ -539,18 +1107,25 @@ template<typename TYPE> HRESULT CGrowableArray <TYPE>::Insert( int nIndex, const
         return E_INVALIDARG;
     }
 
+    TYPE temp( std::move( value ) );
+    return InsertInternal( nIndex, temp );
+}
+
+
+//--------------------------------------------------------------------------------------
+template<typename TYPE, typename ALLOC> HRESULT CGrowableArray <TYPE, ALLOC>::InsertInternal( int nIndex, TYPE& value )
+{
+    HRESULT hr;
+
     // Prepare the buffer
     if( FAILED( hr = SetSizeInternal( m_nSize + 1 ) ) )
         return hr;
 
     // Shift the array
-    MoveMemory( &m_pData[nIndex + 1], &m_pData[nIndex], sizeof( TYPE ) * ( m_nSize - nIndex ) );
-
-    // Construct the new element
-    ::new ( &m_pData[nIndex] ) TYPE;
+    OpenGap( m_pData, nIndex, m_nSize, DXUTIsRelocatable <TYPE>() );
 
-    // Set the value and increase the size
-    m_pData[nIndex] = value;
+    // Construct the new element and increase the size
+    ::new ( &m_pData[nIndex] ) TYPE( std::move( value ) );
     ++m_nSize;
 
     return S_OK;
@@ -558,7 +1133,7 @@ template<typename TYPE> HRESULT CGrowableArray <TYPE>::Insert( int nIndex, const
 
 
 //--------------------------------------------------------------------------------------
-template<typename TYPE> HRESULT CGrowableArray <TYPE>::SetAt( int nIndex, const TYPE& value )
+template<typename TYPE, typename ALLOC> HRESULT CGrowableArray <TYPE, ALLOC>::SetAt( int nIndex, const TYPE& value )
 {
     // Validate arguments
     if( nIndex < 0 ||
@@ -573,13 +1148,30 @@ template<typename TYPE> HRESULT CGrowableArray <TYPE>::SetAt( int nIndex, const
 }
 
 
+//--------------------------------------------------------------------------------------
+template<typename TYPE, typename ALLOC> HRESULT CGrowableArray <TYPE, ALLOC>::SetAt( int nIndex, TYPE&& value )
+{
+    // Validate arguments
+    if( nIndex < 0 ||
+        nIndex >= m_nSize )
+    {
+        assert( false );
+        return E_INVALIDARG;
+    }
+
+    m_pData[nIndex] = std::move( value );
+    return S_OK;
+}
+
+
 //--------------------------------------------------------------------------------------
 // Searches for the specified value and returns the index of the first occurrence
 // within the section of the data array that extends from iStart and contains the 
 // specified number of elements. Returns -1 if value is not found within the given 
 // section.
 //--------------------------------------------------------------------------------------
-template<typename TYPE> int CGrowableArray <TYPE>::IndexOf( const TYPE& value, int iStart, int nNumElements )
+template<typename TYPE, typename ALLOC> int CGrowableArray <TYPE, ALLOC>::IndexOf( const TYPE& value, int iStart,
+                                                                                   int nNumElements )
 {
     // Validate arguments
     if( iStart < 0 ||
@@ -608,7 +1200,8 @@ template<typename TYPE> int CGrowableArray <TYPE>::IndexOf( const TYPE& value, i
 // within the section of the data array that contains the specified number of elements
 // and ends at iEnd. Returns -1 if value is not found within the given section.
 //--------------------------------------------------------------------------------------
-template<typename TYPE> int CGrowableArray <TYPE>::LastIndexOf( const TYPE& value, int iEnd, int nNumElements )
+template<typename TYPE, typename ALLOC> int CGrowableArray <TYPE, ALLOC>::LastIndexOf( const TYPE& value, int iEnd,
+                                                                                       int nNumElements )
 {
     // Validate arguments
     if( iEnd < 0 ||
@@ -634,7 +1227,25 @@ template<typename TYPE> int CGrowableArray <TYPE>::LastIndexOf( const TYPE& valu
 
 
 //--------------------------------------------------------------------------------------
-template<typename TYPE> HRESULT CGrowableArray <TYPE>::Remove( int nIndex )
+template<typename TYPE, typename ALLOC> HRESULT CGrowableArray <TYPE, ALLOC>::Remove( int nIndex )
+{
+    if( nIndex < 0 ||
+        nIndex >= m_nSize )
+    {
+        assert( false );
+        return E_INVALIDARG;
+    }
+
+    // Destruct the element to be removed, compact the array and decrease the size
+    CloseGap( m_pData, nIndex, m_nSize, DXUTIsRelocatable <TYPE>() );
+    --m_nSize;
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+template<typename TYPE, typename ALLOC> HRESULT CGrowableArray <TYPE, ALLOC>::SwapRemove( int nIndex )
 {
     if( nIndex < 0 ||
         nIndex >= m_nSize )
@@ -643,16 +1254,139 @@ template<typename TYPE> HRESULT CGrowableArray <TYPE>::Remove( int nIndex )
         return E_INVALIDARG;
     }
 
-    // Destruct the element to be removed
-    m_pData[nIndex].~TYPE();
+    if( nIndex != m_nSize - 1 )
+        m_pData[nIndex] = std::move( m_pData[m_nSize - 1] );
 
-    // Compact the array and decrease the size
-    MoveMemory( &m_pData[nIndex], &m_pData[nIndex + 1], sizeof( TYPE ) * ( m_nSize - ( nIndex + 1 ) ) );
+    m_pData[m_nSize - 1].~TYPE();
     --m_nSize;
 
     return S_OK;
 }
 
+
+//--------------------------------------------------------------------------------------
+template<typename TYPE, typename ALLOC> HRESULT CGrowableArray <TYPE, ALLOC>::Copy( const CGrowableArray <TYPE, ALLOC>& a )
+{
+    HRESULT hr;
+
+    assert( m_nSize == 0 );
+    if( FAILED( hr = Reserve( a.m_nSize ) ) )
+        return hr;
+
+    CopyElements( m_pData, a.m_pData, a.m_nSize, std::is_trivially_copyable <TYPE>() );
+    m_nSize = a.m_nSize;
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+template<typename TYPE, typename ALLOC> void CGrowableArray <TYPE, ALLOC>::Move( CGrowableArray <TYPE, ALLOC>& a )
+{
+    assert( m_nSize == 0 && m_pData == m_pInline );
+
+    if( a.m_pData != a.m_pInline )
+    {
+        // Take the other array's memory
+        m_Alloc = a.m_Alloc;
+        m_pData = a.m_pData;
+        m_nSize = a.m_nSize;
+        m_nMaxSize = a.m_nMaxSize;
+
+        a.m_pData = a.m_pInline;
+        a.m_nSize = 0;
+        a.m_nMaxSize = a.m_nInlineSize;
+    }
+    else if( SUCCEEDED( Reserve( a.m_nSize ) ) )
+    {
+        // Elements inside a CSmallGrowableArray have to be moved one at a time
+        Relocate( m_pData, a.m_pData, a.m_nSize, DXUTIsRelocatable <TYPE>() );
+        m_nSize = a.m_nSize;
+        a.m_nSize = 0;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Copy constructs nCount elements into raw memory
+//--------------------------------------------------------------------------------------
+template<typename TYPE, typename ALLOC> void CGrowableArray <TYPE, ALLOC>::CopyElements( TYPE* pDest, const TYPE* pSrc,
+                                                                                        int nCount, std::true_type )
+{
+    if( nCount > 0 )
+        memcpy( pDest, pSrc, sizeof( TYPE ) * nCount );
+}
+
+template<typename TYPE, typename ALLOC> void CGrowableArray <TYPE, ALLOC>::CopyElements( TYPE* pDest, const TYPE* pSrc,
+                                                                                        int nCount, std::false_type )
+{
+    for( int i = 0; i < nCount; ++i )
+        ::new ( &pDest[i] ) TYPE( pSrc[i] );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Moves nCount elements into raw memory, leaving raw memory behind
+//--------------------------------------------------------------------------------------
+template<typename TYPE, typename ALLOC> void CGrowableArray <TYPE, ALLOC>::Relocate( TYPE* pDest, TYPE* pSrc,
+                                                                                    int nCount, std::true_type )
+{
+    if( nCount > 0 )
+        memcpy( pDest, pSrc, sizeof( TYPE ) * nCount );
+}
+
+template<typename TYPE, typename ALLOC> void CGrowableArray <TYPE, ALLOC>::Relocate( TYPE* pDest, TYPE* pSrc,
+                                                                                    int nCount, std::false_type )
+{
+    for( int i = 0; i < nCount; ++i )
+    {
+        ::new ( &pDest[i] ) TYPE( std::move( pSrc[i] ) );
+        pSrc[i].~TYPE();
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Shifts elements nIndex..nSize-1 up by one, leaving raw memory at nIndex.  There must
+// be room for nSize + 1 elements.
+//--------------------------------------------------------------------------------------
+template<typename TYPE, typename ALLOC> void CGrowableArray <TYPE, ALLOC>::OpenGap( TYPE* pData, int nIndex, int nSize,
+                                                                                   std::true_type )
+{
+    MoveMemory( &pData[nIndex + 1], &pData[nIndex], sizeof( TYPE ) * ( nSize - nIndex ) );
+}
+
+template<typename TYPE, typename ALLOC> void CGrowableArray <TYPE, ALLOC>::OpenGap( TYPE* pData, int nIndex, int nSize,
+                                                                                   std::false_type )
+{
+    if( nIndex == nSize )
+        return;
+
+    ::new ( &pData[nSize] ) TYPE( std::move( pData[nSize - 1] ) );
+    for( int i = nSize - 1; i > nIndex; --i )
+        pData[i] = std::move( pData[i - 1] );
+    pData[nIndex].~TYPE();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Destroys element nIndex and shifts the elements above it down by one
+//--------------------------------------------------------------------------------------
+template<typename TYPE, typename ALLOC> void CGrowableArray <TYPE, ALLOC>::CloseGap( TYPE* pData, int nIndex, int nSize,
+                                                                                    std::true_type )
+{
+    pData[nIndex].~TYPE();
+    MoveMemory( &pData[nIndex], &pData[nIndex + 1], sizeof( TYPE ) * ( nSize - ( nIndex + 1 ) ) );
+}
+
+template<typename TYPE, typename ALLOC> void CGrowableArray <TYPE, ALLOC>::CloseGap( TYPE* pData, int nIndex, int nSize,
+                                                                                    std::false_type )
+{
+    for( int i = nIndex; i < nSize - 1; ++i )
+        pData[i] = std::move( pData[i + 1] );
+    pData[nSize - 1].~TYPE();
+}
+
 //--------------------------------------------------------------------------------------
 // Creates a REF or NULLREF D3D9 device and returns that device.  The caller should call
 // Release() when done with the device.
@@ -8,16 +8,21 @@
 //--------------------------------------------------------------------------------------
 #include "DXUT.h"
 #include "DXUTShapes.h"
+#include "DXUTWorkerPool.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#include <xmmintrin.h>
+#define DXUT_SHAPES_SSE
+#endif
+
+// Vertices below which CDXUTShapeGenerator doesn't wake its threads
+#define DXUT_SHAPES_MIN_PARALLEL    16384
 
 
 //--------------------------------------------------------------------------------------
 // VERTEX is the vertex layout for all DXUT created shapes
 //--------------------------------------------------------------------------------------
-struct VERTEX
-{
-    D3DXVECTOR3 pos;
-    D3DXVECTOR3 norm;
-};
+typedef DXUT_SHAPE_VERTEX VERTEX;
 
 static const D3D10_INPUT_ELEMENT_DESC s_ShapeLayout[] =
     {
@@ -26,6 +31,36 @@ static const D3D10_INPUT_ELEMENT_DESC s_ShapeLayout[] =
     };
 
 
+//--------------------------------------------------------------------------------------
+// A shape being generated.  Each shape is generated a row at a time, a row being a ring
+// of vertices and the band of faces that joins it to the next, or for a geosphere an
+// edge of the icosahedron or a row of one of its faces, so rows can be generated in any
+// order and on any thread.
+//--------------------------------------------------------------------------------------
+struct DXUT_SHAPE_JOB
+{
+    DXUT_SHAPE_DESC Desc;
+    VERTEX* pVertices;
+    WORD* pwIndices;            // One of these is set
+    DWORD* pdwIndices;
+    bool bSSE;
+    UINT nVertices;
+    UINT nRows;
+
+    // Sines and cosines of the angle of each slice or side, and of each stack or ring
+    float* pSinI;
+    float* pCosI;
+    float* pSinJ;
+    float* pCosJ;
+
+    // The ends of each edge of the icosahedron, lower first, and the edges of each face
+    // from its first corner to its second, from its first to its third and from its
+    // second to its third
+    UINT aEdges[30][2];
+    UINT aFaceEdges[20][3];
+};
+
+
 //--------------------------------------------------------------------------------------
 static inline void sincosf( float angle, float* psin, float* pcos )
 {
@@ -34,11 +69,70 @@ static inline void sincosf( float angle, float* psin, float* pcos )
 }
 
 
+#ifdef DXUT_SHAPES_SSE
+//--------------------------------------------------------------------------------------
+// Writes 4 vertices from the x, y and z of their positions and of their normals
+//--------------------------------------------------------------------------------------
+static inline void StoreVertices4( VERTEX* pVertex, __m128 PX, __m128 PY, __m128 PZ, __m128 NX, __m128 NY,
+                                   __m128 NZ )
+{
+    // Each of the first 4 now holds a vertex's position and its normal's x
+    _MM_TRANSPOSE4_PS( PX, PY, PZ, NX );
+    __m128 NYZ01 = _mm_unpacklo_ps( NY, NZ );
+    __m128 NYZ23 = _mm_unpackhi_ps( NY, NZ );
+
+    float* pFloats = ( float* )pVertex;
+    _mm_storeu_ps( pFloats, PX );
+    _mm_storeu_ps( pFloats + 4, _mm_movelh_ps( NYZ01, PY ) );
+    _mm_storeu_ps( pFloats + 8, _mm_shuffle_ps( PY, NYZ01, _MM_SHUFFLE( 3, 2, 3, 2 ) ) );
+    _mm_storeu_ps( pFloats + 12, PZ );
+    _mm_storeu_ps( pFloats + 16, _mm_movelh_ps( NYZ23, NX ) );
+    _mm_storeu_ps( pFloats + 20, _mm_shuffle_ps( NX, NYZ23, _MM_SHUFFLE( 3, 2, 3, 2 ) ) );
+}
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// Writes a ring of vertices around z, at ( fPosXY * sin, fPosXY * cos, fPosZ ) with the
+// normal ( fNormXY * sin, fNormXY * cos, fNormZ ), four at a time where SSE is available
+//--------------------------------------------------------------------------------------
+static void EmitRing( VERTEX* pVertex, UINT uSlices, const float* pSin, const float* pCos, float fPosXY,
+                      float fPosZ, float fNormXY, float fNormZ, bool bSSE )
+{
+    UINT i = 0;
+
+#ifdef DXUT_SHAPES_SSE
+    if( bSSE )
+    {
+        const __m128 PosXY = _mm_set1_ps( fPosXY );
+        const __m128 PosZ = _mm_set1_ps( fPosZ );
+        const __m128 NormXY = _mm_set1_ps( fNormXY );
+        const __m128 NormZ = _mm_set1_ps( fNormZ );
+        for( ; i + 4 <= uSlices; i += 4 )
+        {
+            __m128 Sin = _mm_loadu_ps( pSin + i );
+            __m128 Cos = _mm_loadu_ps( pCos + i );
+            StoreVertices4( pVertex + i, _mm_mul_ps( PosXY, Sin ), _mm_mul_ps( PosXY, Cos ), PosZ,
+                            _mm_mul_ps( NormXY, Sin ), _mm_mul_ps( NormXY, Cos ), NormZ );
+        }
+    }
+#else
+    UNREFERENCED_PARAMETER( bSSE );
+#endif
+
+    for( ; i < uSlices; i++ )
+    {
+        pVertex[i].pos = D3DXVECTOR3( fPosXY * pSin[i], fPosXY * pCos[i], fPosZ );
+        pVertex[i].norm = D3DXVECTOR3( fNormXY * pSin[i], fNormXY * pCos[i], fNormZ );
+    }
+}
+
+
 //--------------------------------------------------------------------------------------
 // Create D3DX10Mesh from the input vertex and index data
 //--------------------------------------------------------------------------------------
 HRESULT CreateShapeMesh( ID3D10Device* pDev10, ID3DX10Mesh** ppMesh, VERTEX* pVertices, UINT NumVertices,
-                         WORD* pIndices, UINT NumIndices )
+                         void* pIndices, UINT NumIndices, bool b32BitIndices )
 {
     HRESULT hr = S_OK;
 
@@ -49,7 +143,7 @@ HRESULT CreateShapeMesh( ID3D10Device* pDev10, ID3DX10Mesh** ppMesh, VERTEX* pVe
                            s_ShapeLayout[0].SemanticName,
                            NumVertices,
                            NumIndices / 3,
-                           0,
+                           b32BitIndices ? D3DX10_MESH_32_BIT : 0,
                            ppMesh );
     if( FAILED( hr ) )
         return hr;
@@ -81,6 +175,41 @@ HRESULT CreateShapeMesh( ID3D10Device* pDev10, ID3DX10Mesh** ppMesh, VERTEX* pVe
 }
 
 
+//--------------------------------------------------------------------------------------
+// Generates a shape into system memory and makes a mesh of it, with 32 bit indices if
+// there are too many vertices for 16
+//--------------------------------------------------------------------------------------
+static HRESULT CreateShape( ID3D10Device* pDevice, const DXUT_SHAPE_DESC* pDesc, ID3DX10Mesh** ppMesh )
+{
+    HRESULT hr;
+    UINT cVertices, cIndices;
+
+    V_RETURN( DXUTGetShapeSize( pDesc, &cVertices, &cIndices ) );
+    const bool b32BitIndices = cVertices > 65536;
+
+    // Create enough memory for the vertices and indices
+    VERTEX* pVertices = new VERTEX[ cVertices ];
+    BYTE* pIndices = new BYTE[ cIndices * ( b32BitIndices ? sizeof( DWORD ) : sizeof( WORD ) ) ];
+    if( !pVertices || !pIndices )
+    {
+        SAFE_DELETE_ARRAY( pVertices );
+        SAFE_DELETE_ARRAY( pIndices );
+        return E_OUTOFMEMORY;
+    }
+
+    // Create the shape, then a mesh
+    hr = DXUTGenerateShape( pDesc, pVertices, pIndices, b32BitIndices ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT );
+    if( SUCCEEDED( hr ) )
+        hr = CreateShapeMesh( pDevice, ppMesh, pVertices, cVertices, pIndices, cIndices, b32BitIndices );
+
+    // Free up the memory
+    SAFE_DELETE_ARRAY( pVertices );
+    SAFE_DELETE_ARRAY( pIndices );
+
+    return hr;
+}
+
+
 //----------------------------------------------------------------------------
 // Box
 //----------------------------------------------------------------------------
@@ -130,11 +259,12 @@ static WORD cubeFT[6][4] =
 //--------------------------------------------------------------------------------------
 // MakeBox helper
 //--------------------------------------------------------------------------------------
-static void MakeBox( VERTEX* pVertices, DWORD* pPointRep, WORD* pwIndices, float fWidth, float fHeight, float fDepth )
+template <class INDEX>
+static void MakeBox( VERTEX* pVertices, INDEX* pwIndices, float fWidth, float fHeight, float fDepth )
 {
     // Fill in the data
     VERTEX* pVertex = pVertices;
-    WORD* pwFace = pwIndices;
+    INDEX* pwFace = pwIndices;
     UINT iVertex = 0;
 
     // i iterates over the faces, 2 triangles per face
@@ -150,23 +280,17 @@ static void MakeBox( VERTEX* pVertices, DWORD* pPointRep, WORD* pwIndices, float
             pVertex->norm.y = cubeN[i][1];
             pVertex->norm.z = cubeN[i][2];
 
-            if( pPointRep != NULL )
-            {
-                *pPointRep = cubeF[i][j];
-                pPointRep++;
-            }
-
             pVertex++;
         }
 
-        pwFace[0] = ( WORD )( iVertex );
-        pwFace[1] = ( WORD )( iVertex + 1 );
-        pwFace[2] = ( WORD )( iVertex + 2 );
+        pwFace[0] = ( INDEX )( iVertex );
+        pwFace[1] = ( INDEX )( iVertex + 1 );
+        pwFace[2] = ( INDEX )( iVertex + 2 );
         pwFace += 3;
 
-        pwFace[0] = ( WORD )( iVertex + 2 );
-        pwFace[1] = ( WORD )( iVertex + 3 );
-        pwFace[2] = ( WORD )( iVertex );
+        pwFace[0] = ( INDEX )( iVertex + 2 );
+        pwFace[1] = ( INDEX )( iVertex + 3 );
+        pwFace[2] = ( INDEX )( iVertex );
         pwFace += 3;
 
         iVertex += 4;
@@ -179,11 +303,6 @@ static void MakeBox( VERTEX* pVertices, DWORD* pPointRep, WORD* pwIndices, float
 //--------------------------------------------------------------------------------------
 HRESULT WINAPI DXUTCreateBox( ID3D10Device* pDevice, float fWidth, float fHeight, float fDepth, ID3DX10Mesh** ppMesh )
 {
-    HRESULT hr = S_OK;
-
-    WORD* pwIndices = NULL;
-    VERTEX* pVertices = NULL;
-
     // Set up the defaults
     if( D3DX_DEFAULT_FLOAT == fWidth )
         fWidth = 1.0f;
@@ -198,55 +317,27 @@ HRESULT WINAPI DXUTCreateBox( ID3D10Device* pDevice, float fWidth, float fHeight
         return D3DERR_INVALIDCALL;
     if( !ppMesh )
         return D3DERR_INVALIDCALL;
-    if( fWidth < 0.0f )
-        return D3DERR_INVALIDCALL;
-    if( fHeight < 0.0f )
-        return D3DERR_INVALIDCALL;
-    if( fDepth < 0.0f )
-        return D3DERR_INVALIDCALL;
-
-    // Create the mesh
-    UINT cFaces = 12;
-    UINT cVertices = 24;
-
-    // Create enough memory for the vertices and indices
-    pVertices = new VERTEX[ cVertices ];
-    if( !pVertices )
-        return E_OUTOFMEMORY;
-    pwIndices = new WORD[ cFaces * 3 ];
-    if( !pwIndices )
-        return E_OUTOFMEMORY;
 
     // Create a box
-    MakeBox( pVertices, NULL, pwIndices, fWidth, fHeight, fDepth );
-
-    // Create a mesh
-    hr = CreateShapeMesh( pDevice, ppMesh, pVertices, cVertices, pwIndices, cFaces * 3 );
-
-    // Free up the memory
-    SAFE_DELETE_ARRAY( pVertices );
-    SAFE_DELETE_ARRAY( pwIndices );
-
-    return hr;
-
+    DXUT_SHAPE_DESC Desc = { DXUT_SHAPE_BOX, fWidth, fHeight, fDepth, 0, 0 };
+    return CreateShape( pDevice, &Desc, ppMesh );
 }
 
-#define CACHE_SIZE    240
 
 //----------------------------------------------------------------------------
-// MakeCylinder helper
+// MakeCylinder helper: row 0 is the base cap's centre and ring, rows 1 to uStacks + 1
+// the rings of the side and row uStacks + 2 the top cap's ring and centre.  Each row
+// but the last joins its ring to the next.
 //----------------------------------------------------------------------------
-static void MakeCylinder( VERTEX* pVertices, DWORD* pPointReps, WORD* pwIndices, float fRadius1, 
-                          float fRadius2, float fLength, UINT uSlices, UINT uStacks )
+template <class INDEX>
+static void MakeCylinder( const DXUT_SHAPE_JOB* pJob, UINT iRow, INDEX* pwIndices )
 {
-    UINT i, j;
-
-    // Sin/Cos caches
-    float sinI[CACHE_SIZE], cosI[CACHE_SIZE];
-
-    for( i = 0; i < uSlices; i++ )
-        sincosf( 2.0f * D3DX_PI * i / uSlices, sinI + i, cosI + i );
-
+    const float fRadius1 = pJob->Desc.fSize0;
+    const float fRadius2 = pJob->Desc.fSize1;
+    const float fLength = pJob->Desc.fSize2;
+    const UINT uSlices = pJob->Desc.uTess0;
+    const UINT uStacks = pJob->Desc.uTess1;
+    UINT i;
 
     // Compute side normal angle
     float fDeltaRadius = fRadius2 - fRadius1;
@@ -258,145 +349,108 @@ static void MakeCylinder( VERTEX* pVertices, DWORD* pPointReps, WORD* pwIndices,
 
 
     // Generate vertices
-    VERTEX* pVertex = pVertices;
-    float fZ, fRadius;
-    DWORD iVertex;
+    VERTEX* pVertex = pJob->pVertices;
 
-    // Base cap (uSlices + 1)
-    fZ = fLength * -0.5f;
-    fRadius = fRadius1;
-    iVertex = 0;
-
-    pVertex->pos = D3DXVECTOR3( 0.0f, 0.0f, fZ );
-    pVertex->norm = D3DXVECTOR3( 0.0f, 0.0f, -1.0f );
-    pVertex++;
-    if( pPointReps != NULL )
-        pPointReps[iVertex] = iVertex;
-    iVertex++;
-
-    for( i = 0; i < uSlices; i++ )
+    if( 0 == iRow )
     {
-        pVertex->pos = D3DXVECTOR3( fRadius * sinI[i], fRadius * cosI[i], fZ );
+        // Base cap (uSlices + 1)
+        float fZ = fLength * -0.5f;
+        pVertex->pos = D3DXVECTOR3( 0.0f, 0.0f, fZ );
         pVertex->norm = D3DXVECTOR3( 0.0f, 0.0f, -1.0f );
-        pVertex++;
-
-        // link into stack vertices, which follow
-        if( pPointReps != NULL )
-            pPointReps[iVertex] = iVertex + uSlices;
-        iVertex++;
+        EmitRing( pVertex + 1, uSlices, pJob->pSinI, pJob->pCosI, fRadius1, fZ, 0.0f, -1.0f, pJob->bSSE );
     }
-
-    // Stacks ((uStacks + 1)*uSlices)
-    for( j = 0; j <= uStacks; j++ )
+    else if( iRow <= uStacks + 1 )
     {
-        float f = ( float )j / ( float )uStacks;
-
-        fZ = fLength * ( f - 0.5f );
-        fRadius = fRadius1 + f * fDeltaRadius;
-
-        for( i = 0; i < uSlices; i++ )
-        {
-            pVertex->pos = D3DXVECTOR3( fRadius * sinI[i], fRadius * cosI[i], fZ );
-            pVertex->norm = D3DXVECTOR3( fNormalXY * sinI[i], fNormalXY * cosI[i], fNormalZ );
-            pVertex++;
-            if( pPointReps != NULL )
-                pPointReps[iVertex] = iVertex;
-            iVertex++;
-        }
+        // Stacks ((uStacks + 1)*uSlices)
+        float f = ( float )( iRow - 1 ) / ( float )uStacks;
+        float fZ = fLength * ( f - 0.5f );
+        float fRadius = fRadius1 + f * fDeltaRadius;
+        EmitRing( pVertex + 1 + iRow * uSlices, uSlices, pJob->pSinI, pJob->pCosI, fRadius, fZ, fNormalXY,
+                  fNormalZ, pJob->bSSE );
     }
-
-    // Top cap (uSlices + 1)
-    fZ = fLength * 0.5f;
-    fRadius = fRadius2;
-
-    for( i = 0; i < uSlices; i++ )
+    else
     {
-        pVertex->pos = D3DXVECTOR3( fRadius * sinI[i], fRadius * cosI[i], fZ );
-        pVertex->norm = D3DXVECTOR3( 0.0f, 0.0f, 1.0f );
-        pVertex++;
-
-        // link into stack vertices, which precede
-        if( pPointReps != NULL )
-            pPointReps[iVertex] = iVertex - uSlices;
-        iVertex++;
+        // Top cap (uSlices + 1)
+        float fZ = fLength * 0.5f;
+        pVertex += 1 + iRow * uSlices;
+        EmitRing( pVertex, uSlices, pJob->pSinI, pJob->pCosI, fRadius2, fZ, 0.0f, 1.0f, pJob->bSSE );
+        pVertex[uSlices].pos = D3DXVECTOR3( 0.0f, 0.0f, fZ );
+        pVertex[uSlices].norm = D3DXVECTOR3( 0.0f, 0.0f, 1.0f );
+        return;
     }
 
-    pVertex->pos = D3DXVECTOR3( 0.0f, 0.0f, fZ );
-    pVertex->norm = D3DXVECTOR3( 0.0f, 0.0f, 1.0f );
-    pVertex++;
-    if( pPointReps != NULL )
-        pPointReps[iVertex] = iVertex;
-    iVertex++;
-
 
 
     // Generate indices
-    WORD* pwFace = pwIndices;
+    INDEX* pwFace = pwIndices;
     UINT uRowA, uRowB;
 
-    // Z+ pole (uSlices)
-    uRowA = 0;
-    uRowB = 1;
-
-    for( i = 0; i < uSlices - 1; i++ )
+    if( 0 == iRow )
     {
-        pwFace[0] = ( WORD )( uRowA );
-        pwFace[1] = ( WORD )( uRowB + i );
-        pwFace[2] = ( WORD )( uRowB + i + 1 );
-        pwFace += 3;
-    }
+        // Z+ pole (uSlices)
+        uRowA = 0;
+        uRowB = 1;
 
-    pwFace[0] = ( WORD )( uRowA );
-    pwFace[1] = ( WORD )( uRowB + i );
-    pwFace[2] = ( WORD )( uRowB );
-    pwFace += 3;
+        for( i = 0; i < uSlices - 1; i++ )
+        {
+            pwFace[0] = ( INDEX )( uRowA );
+            pwFace[1] = ( INDEX )( uRowB + i );
+            pwFace[2] = ( INDEX )( uRowB + i + 1 );
+            pwFace += 3;
+        }
 
-    // Interior stacks (uStacks * uSlices * 2)
-    for( j = 0; j < uStacks; j++ )
+        pwFace[0] = ( INDEX )( uRowA );
+        pwFace[1] = ( INDEX )( uRowB + i );
+        pwFace[2] = ( INDEX )( uRowB );
+    }
+    else if( iRow <= uStacks )
     {
-        uRowA = 1 + ( j + 1 ) * uSlices;
+        // Interior stacks (uStacks * uSlices * 2)
+        pwFace += 3 * ( uSlices + ( iRow - 1 ) * 2 * uSlices );
+        uRowA = 1 + iRow * uSlices;
         uRowB = uRowA + uSlices;
 
         for( i = 0; i < uSlices - 1; i++ )
         {
-            pwFace[0] = ( WORD )( uRowA + i );
-            pwFace[1] = ( WORD )( uRowB + i );
-            pwFace[2] = ( WORD )( uRowA + i + 1 );
+            pwFace[0] = ( INDEX )( uRowA + i );
+            pwFace[1] = ( INDEX )( uRowB + i );
+            pwFace[2] = ( INDEX )( uRowA + i + 1 );
             pwFace += 3;
 
-            pwFace[0] = ( WORD )( uRowA + i + 1 );
-            pwFace[1] = ( WORD )( uRowB + i );
-            pwFace[2] = ( WORD )( uRowB + i + 1 );
+            pwFace[0] = ( INDEX )( uRowA + i + 1 );
+            pwFace[1] = ( INDEX )( uRowB + i );
+            pwFace[2] = ( INDEX )( uRowB + i + 1 );
             pwFace += 3;
         }
 
-        pwFace[0] = ( WORD )( uRowA + i );
-        pwFace[1] = ( WORD )( uRowB + i );
-        pwFace[2] = ( WORD )( uRowA );
+        pwFace[0] = ( INDEX )( uRowA + i );
+        pwFace[1] = ( INDEX )( uRowB + i );
+        pwFace[2] = ( INDEX )( uRowA );
         pwFace += 3;
 
-        pwFace[0] = ( WORD )( uRowA );
-        pwFace[1] = ( WORD )( uRowB + i );
-        pwFace[2] = ( WORD )( uRowB );
-        pwFace += 3;
+        pwFace[0] = ( INDEX )( uRowA );
+        pwFace[1] = ( INDEX )( uRowB + i );
+        pwFace[2] = ( INDEX )( uRowB );
     }
+    else
+    {
+        // Z- pole (uSlices)
+        pwFace += 3 * ( uSlices + uStacks * 2 * uSlices );
+        uRowA = 1 + ( uStacks + 2 ) * uSlices;
+        uRowB = uRowA + uSlices;
 
-    // Z- pole (uSlices)
-    uRowA = 1 + ( uStacks + 2 ) * uSlices;
-    uRowB = uRowA + uSlices;
+        for( i = 0; i < uSlices - 1; i++ )
+        {
+            pwFace[0] = ( INDEX )( uRowA + i );
+            pwFace[1] = ( INDEX )( uRowB );
+            pwFace[2] = ( INDEX )( uRowA + i + 1 );
+            pwFace += 3;
+        }
 
-    for( i = 0; i < uSlices - 1; i++ )
-    {
-        pwFace[0] = ( WORD )( uRowA + i );
-        pwFace[1] = ( WORD )( uRowB );
-        pwFace[2] = ( WORD )( uRowA + i + 1 );
-        pwFace += 3;
+        pwFace[0] = ( INDEX )( uRowA + i );
+        pwFace[1] = ( INDEX )( uRowB );
+        pwFace[2] = ( INDEX )( uRowA );
     }
-
-    pwFace[0] = ( WORD )( uRowA + i );
-    pwFace[1] = ( WORD )( uRowB );
-    pwFace[2] = ( WORD )( uRowA );
-    pwFace += 3;
 }
 
 
@@ -406,11 +460,6 @@ static void MakeCylinder( VERTEX* pVertices, DWORD* pPointReps, WORD* pwIndices,
 HRESULT WINAPI DXUTCreateCylinder( ID3D10Device* pDevice, float fRadius1, float fRadius2, float fLength, UINT uSlices,
                                    UINT uStacks, ID3DX10Mesh** ppMesh )
 {
-    HRESULT hr = S_OK;
-
-    WORD* pwIndices = NULL;
-    VERTEX* pVertices = NULL;
-
     // Set up the defaults
     if( D3DX_DEFAULT_FLOAT == fRadius1 )
         fRadius1 = 1.0f;
@@ -429,88 +478,51 @@ HRESULT WINAPI DXUTCreateCylinder( ID3D10Device* pDevice, float fRadius1, float
         return D3DERR_INVALIDCALL;
     if( !ppMesh )
         return D3DERR_INVALIDCALL;
-    if( fRadius1 < 0.0f )
-        return D3DERR_INVALIDCALL;
-    if( fRadius2 < 0.0f )
-        return D3DERR_INVALIDCALL;
-    if( fLength < 0.0f )
-        return D3DERR_INVALIDCALL;
-    if( uSlices < 2 )
-        return D3DERR_INVALIDCALL;
-    if( uStacks < 1 )
-        return D3DERR_INVALIDCALL;
-    if( uSlices >= CACHE_SIZE )
-        uSlices = CACHE_SIZE - 1;
-
-    // Create the mesh
-    UINT cFaces = ( uStacks + 1 ) * uSlices * 2;
-    UINT cVertices = 2 + ( uStacks + 3 ) * uSlices;
-
-    // Create enough memory for the vertices and indices
-    pVertices = new VERTEX[ cVertices ];
-    if( !pVertices )
-        return E_OUTOFMEMORY;
-    pwIndices = new WORD[ cFaces * 3 ];
-    if( !pwIndices )
-        return E_OUTOFMEMORY;
 
     // Create a cylinder
-    MakeCylinder( pVertices, NULL, pwIndices, fRadius1, fRadius2,
-                  fLength, uSlices, uStacks );
-
-    // Create a mesh
-    hr = CreateShapeMesh( pDevice, ppMesh, pVertices, cVertices, pwIndices, cFaces * 3 );
-
-    // Free up the memory
-    SAFE_DELETE_ARRAY( pVertices );
-    SAFE_DELETE_ARRAY( pwIndices );
-
-    return hr;
+    DXUT_SHAPE_DESC Desc = { DXUT_SHAPE_CYLINDER, fRadius1, fRadius2, fLength, uSlices, uStacks };
+    return CreateShape( pDevice, &Desc, ppMesh );
 }
 
 
 //--------------------------------------------------------------------------------------
 // MakePolygon helper
 //--------------------------------------------------------------------------------------
-static void MakePolygon( VERTEX* pVertices, WORD* pwIndices, float fLength, UINT uSides )
+template <class INDEX>
+static void MakePolygon( const DXUT_SHAPE_JOB* pJob, INDEX* pwIndices )
 {
+    const float fLength = pJob->Desc.fSize0;
+    const UINT uSides = pJob->Desc.uTess0;
+
     // Calculate the radius
     float radius = fLength * 0.5f / sinf( D3DX_PI / ( float )uSides );
-    float angle = ( float )( 2.0f * D3DX_PI / ( float )uSides );
 
     // Fill in vertices
-    VERTEX* pVertex = pVertices;
+    VERTEX* pVertex = pJob->pVertices;
 
     pVertex->pos = D3DXVECTOR3( 0.0f, 0.0f, 0.0f );
     pVertex->norm = D3DXVECTOR3( 0.0f, 0.0f, 1.0f );
     pVertex++;
 
-    for( UINT j = 0; j < uSides; j++ )
-    {
-        float s, c;
-        sincosf( angle * j, &s, &c );
-
-        pVertex->pos = D3DXVECTOR3( c * radius, s * radius, 0.0f );
-        pVertex->norm = D3DXVECTOR3( 0.0f, 0.0f, 1.0f );
-        pVertex++;
-    }
+    // The tables hold the sines and cosines the other way round for rings around z
+    EmitRing( pVertex, uSides, pJob->pCosI, pJob->pSinI, radius, 0.0f, 0.0f, 1.0f, pJob->bSSE );
 
     // Fill in indices
-    WORD* pwFace = pwIndices;
+    INDEX* pwFace = pwIndices;
 
     UINT iFace;
     for( iFace = 0; iFace < uSides - 1; iFace++ )
     {
         pwFace[0] = 0;
-        pwFace[1] = ( WORD )iFace + 1;
-        pwFace[2] = ( WORD )iFace + 2;
+        pwFace[1] = ( INDEX )( iFace + 1 );
+        pwFace[2] = ( INDEX )( iFace + 2 );
 
         pwFace += 3;
     }
 
     // handle the wrapping of the last case
     pwFace[0] = 0;
-    pwFace[1] = ( WORD )iFace + 1;
+    pwFace[1] = ( INDEX )( iFace + 1 );
     pwFace[2] = 1;
 }
 
@@ -520,10 +532,6 @@ static void MakePolygon( VERTEX* pVertices, WORD* pwIndices, float fLength, UINT
 //----------------------------------------------------------------------------
 HRESULT WINAPI DXUTCreatePolygon( ID3D10Device* pDevice, float fLength, UINT uSides, ID3DX10Mesh** ppMesh )
 {
-    HRESULT hr = S_OK;
-    WORD* pwIndices = NULL;
-    VERTEX* pVertices = NULL;
-
     // Set up the defaults
     if( D3DX_DEFAULT == uSides )
         uSides = 3;
@@ -536,153 +544,125 @@ HRESULT WINAPI DXUTCreatePolygon( ID3D10Device* pDevice, float fLength, UINT uSi
         return D3DERR_INVALIDCALL;
     if( !ppMesh )
         return D3DERR_INVALIDCALL;
-    if( fLength < 0.0f )
-        return D3DERR_INVALIDCALL;
-    if( uSides < 3 )
-        return D3DERR_INVALIDCALL;
-
-    // Create the mesh
-    UINT cFaces = uSides;
-    UINT cVertices = uSides + 1;
-
-    // Create enough memory for the vertices and indices
-    pVertices = new VERTEX[ cVertices ];
-    if( !pVertices )
-        return E_OUTOFMEMORY;
-    pwIndices = new WORD[ cFaces * 3 ];
-    if( !pwIndices )
-        return E_OUTOFMEMORY;
 
     // Create a polygon
-    MakePolygon( pVertices, pwIndices, fLength, uSides );
-
-    // Create a mesh
-    hr = CreateShapeMesh( pDevice, ppMesh, pVertices, cVertices, pwIndices, cFaces * 3 );
-
-    // Free up the memory
-    SAFE_DELETE_ARRAY( pVertices );
-    SAFE_DELETE_ARRAY( pwIndices );
-
-    return hr;
+    DXUT_SHAPE_DESC Desc = { DXUT_SHAPE_POLYGON, fLength, 0.0f, 0.0f, uSides, 0 };
+    return CreateShape( pDevice, &Desc, ppMesh );
 }
 
 
 //---------------------------------------------------------------------
-// MakeSphere helper
+// MakeSphere helper: row 0 is the +Z pole, rows 1 to uStacks - 1 the rings and row
+// uStacks the Z- pole.  Each row but the last joins to the next.
 //---------------------------------------------------------------------
-static void MakeSphere( VERTEX* pVertices, WORD* pwIndices, float fRadius, UINT uSlices, UINT uStacks )
+template <class INDEX>
+static void MakeSphere( const DXUT_SHAPE_JOB* pJob, UINT iRow, INDEX* pwIndices )
 {
-    UINT i, j;
-
-
-    // Sin/Cos caches
-    float sinI[CACHE_SIZE], cosI[CACHE_SIZE];
-    float sinJ[CACHE_SIZE], cosJ[CACHE_SIZE];
-
-    for( i = 0; i < uSlices; i++ )
-        sincosf( 2.0f * D3DX_PI * i / uSlices, sinI + i, cosI + i );
-
-    for( j = 0; j < uStacks; j++ )
-        sincosf( D3DX_PI * j / uStacks, sinJ + j, cosJ + j );
+    const float fRadius = pJob->Desc.fSize0;
+    const UINT uSlices = pJob->Desc.uTess0;
+    const UINT uStacks = pJob->Desc.uTess1;
+    UINT i;
 
 
 
     // Generate vertices
-    VERTEX* pVertex = pVertices;
+    VERTEX* pVertex = pJob->pVertices;
 
-    // +Z pole
-    pVertex->pos = D3DXVECTOR3( 0.0f, 0.0f, fRadius );
-    pVertex->norm = D3DXVECTOR3( 0.0f, 0.0f, 1.0f );
-    pVertex++;
-
-    // Stacks
-    for( j = 1; j < uStacks; j++ )
+    if( 0 == iRow )
     {
-        for( i = 0; i < uSlices; i++ )
-        {
-            D3DXVECTOR3 norm( sinI[i]* sinJ[j], cosI[i]* sinJ[j], cosJ[j] );
-
-            pVertex->pos = norm * fRadius;
-            pVertex->norm = norm;
-
-            pVertex++;
-        }
+        // +Z pole
+        pVertex->pos = D3DXVECTOR3( 0.0f, 0.0f, fRadius );
+        pVertex->norm = D3DXVECTOR3( 0.0f, 0.0f, 1.0f );
+    }
+    else if( iRow < uStacks )
+    {
+        // Stacks
+        const float fSinJ = pJob->pSinJ[iRow];
+        const float fCosJ = pJob->pCosJ[iRow];
+        EmitRing( pVertex + 1 + ( iRow - 1 ) * uSlices, uSlices, pJob->pSinI, pJob->pCosI, fSinJ * fRadius,
+                  fCosJ * fRadius, fSinJ, fCosJ, pJob->bSSE );
+    }
+    else
+    {
+        // Z- pole
+        pVertex += 1 + ( uStacks - 1 ) * uSlices;
+        pVertex->pos = D3DXVECTOR3( 0.0f, 0.0f, -fRadius );
+        pVertex->norm = D3DXVECTOR3( 0.0f, 0.0f, -1.0f );
+        return;
     }
-
-    // Z- pole
-    pVertex->pos = D3DXVECTOR3( 0.0f, 0.0f, -fRadius );
-    pVertex->norm = D3DXVECTOR3( 0.0f, 0.0f, -1.0f );
-    pVertex++;
 
 
 
     // Generate indices
-    WORD* pwFace = pwIndices;
+    INDEX* pwFace = pwIndices;
     UINT uRowA, uRowB;
 
-    // Z+ pole
-    uRowA = 0;
-    uRowB = 1;
-
-    for( i = 0; i < uSlices - 1; i++ )
+    if( 0 == iRow )
     {
-        pwFace[0] = ( WORD )( uRowA );
-        pwFace[1] = ( WORD )( uRowB + i + 1 );
-        pwFace[2] = ( WORD )( uRowB + i );
-        pwFace += 3;
-    }
+        // Z+ pole
+        uRowA = 0;
+        uRowB = 1;
 
-    pwFace[0] = ( WORD )( uRowA );
-    pwFace[1] = ( WORD )( uRowB );
-    pwFace[2] = ( WORD )( uRowB + i );
-    pwFace += 3;
+        for( i = 0; i < uSlices - 1; i++ )
+        {
+            pwFace[0] = ( INDEX )( uRowA );
+            pwFace[1] = ( INDEX )( uRowB + i + 1 );
+            pwFace[2] = ( INDEX )( uRowB + i );
+            pwFace += 3;
+        }
 
-    // Interior stacks
-    for( j = 1; j < uStacks - 1; j++ )
+        pwFace[0] = ( INDEX )( uRowA );
+        pwFace[1] = ( INDEX )( uRowB );
+        pwFace[2] = ( INDEX )( uRowB + i );
+    }
+    else if( iRow < uStacks - 1 )
     {
-        uRowA = 1 + ( j - 1 ) * uSlices;
+        // Interior stacks
+        pwFace += 3 * ( uSlices + ( iRow - 1 ) * 2 * uSlices );
+        uRowA = 1 + ( iRow - 1 ) * uSlices;
         uRowB = uRowA + uSlices;
 
         for( i = 0; i < uSlices - 1; i++ )
         {
-            pwFace[0] = ( WORD )( uRowA + i );
-            pwFace[1] = ( WORD )( uRowA + i + 1 );
-            pwFace[2] = ( WORD )( uRowB + i );
+            pwFace[0] = ( INDEX )( uRowA + i );
+            pwFace[1] = ( INDEX )( uRowA + i + 1 );
+            pwFace[2] = ( INDEX )( uRowB + i );
             pwFace += 3;
 
-            pwFace[0] = ( WORD )( uRowA + i + 1 );
-            pwFace[1] = ( WORD )( uRowB + i + 1 );
-            pwFace[2] = ( WORD )( uRowB + i );
+            pwFace[0] = ( INDEX )( uRowA + i + 1 );
+            pwFace[1] = ( INDEX )( uRowB + i + 1 );
+            pwFace[2] = ( INDEX )( uRowB + i );
             pwFace += 3;
         }
 
-        pwFace[0] = ( WORD )( uRowA + i );
-        pwFace[1] = ( WORD )( uRowA );
-        pwFace[2] = ( WORD )( uRowB + i );
+        pwFace[0] = ( INDEX )( uRowA + i );
+        pwFace[1] = ( INDEX )( uRowA );
+        pwFace[2] = ( INDEX )( uRowB + i );
         pwFace += 3;
 
-        pwFace[0] = ( WORD )( uRowA );
-        pwFace[1] = ( WORD )( uRowB );
-        pwFace[2] = ( WORD )( uRowB + i );
-        pwFace += 3;
+        pwFace[0] = ( INDEX )( uRowA );
+        pwFace[1] = ( INDEX )( uRowB );
+        pwFace[2] = ( INDEX )( uRowB + i );
     }
+    else
+    {
+        // Z- pole
+        pwFace += 3 * ( uSlices + ( uStacks - 2 ) * 2 * uSlices );
+        uRowA = 1 + ( uStacks - 2 ) * uSlices;
+        uRowB = uRowA + uSlices;
 
-    // Z- pole
-    uRowA = 1 + ( uStacks - 2 ) * uSlices;
-    uRowB = uRowA + uSlices;
+        for( i = 0; i < uSlices - 1; i++ )
+        {
+            pwFace[0] = ( INDEX )( uRowA + i );
+            pwFace[1] = ( INDEX )( uRowA + i + 1 );
+            pwFace[2] = ( INDEX )( uRowB );
+            pwFace += 3;
+        }
 
-    for( i = 0; i < uSlices - 1; i++ )
-    {
-        pwFace[0] = ( WORD )( uRowA + i );
-        pwFace[1] = ( WORD )( uRowA + i + 1 );
-        pwFace[2] = ( WORD )( uRowB );
-        pwFace += 3;
+        pwFace[0] = ( INDEX )( uRowA + i );
+        pwFace[1] = ( INDEX )( uRowA );
+        pwFace[2] = ( INDEX )( uRowB );
     }
-
-    pwFace[0] = ( WORD )( uRowA + i );
-    pwFace[1] = ( WORD )( uRowA );
-    pwFace[2] = ( WORD )( uRowB );
-    pwFace += 3;
 }
 
 
@@ -692,11 +672,6 @@ static void MakeSphere( VERTEX* pVertices, WORD* pwIndices, float fRadius, UINT
 HRESULT WINAPI DXUTCreateSphere( ID3D10Device* pDevice, float fRadius, UINT uSlices, UINT uStacks,
                                  ID3DX10Mesh** ppMesh )
 {
-    HRESULT hr = S_OK;
-
-    WORD* pwIndices = NULL;
-    VERTEX* pVertices = NULL;
-
     // Set up the defaults
     if( D3DX_DEFAULT_FLOAT == fRadius )
         fRadius = 1.0f;
@@ -710,81 +685,66 @@ HRESULT WINAPI DXUTCreateSphere( ID3D10Device* pDevice, float fRadius, UINT uSli
         return D3DERR_INVALIDCALL;
     if( !ppMesh )
         return D3DERR_INVALIDCALL;
-    if( fRadius < 0.0f )
-        return D3DERR_INVALIDCALL;
-    if( uSlices < 2 )
-        return D3DERR_INVALIDCALL;
-    if( uStacks < 2 )
-        return D3DERR_INVALIDCALL;
-
-    if( uSlices > CACHE_SIZE )
-        uSlices = CACHE_SIZE;
-    if( uStacks > CACHE_SIZE )
-        uStacks = CACHE_SIZE;
-
-    // Create the mesh
-    UINT cFaces = 2 * ( uStacks - 1 ) * uSlices;
-    UINT cVertices = ( uStacks - 1 ) * uSlices + 2;
-
-    // Create enough memory for the vertices and indices
-    pVertices = new VERTEX[ cVertices ];
-    if( !pVertices )
-        return E_OUTOFMEMORY;
-    pwIndices = new WORD[ cFaces * 3 ];
-    if( !pwIndices )
-        return E_OUTOFMEMORY;
 
     // Create a sphere
-    MakeSphere( pVertices, pwIndices, fRadius, uSlices, uStacks );
-
-    // Create a mesh
-    hr = CreateShapeMesh( pDevice, ppMesh, pVertices, cVertices, pwIndices, cFaces * 3 );
-
-    // Free up the memory
-    SAFE_DELETE_ARRAY( pVertices );
-    SAFE_DELETE_ARRAY( pwIndices );
-
-    return hr;
+    DXUT_SHAPE_DESC Desc = { DXUT_SHAPE_SPHERE, fRadius, 0.0f, 0.0f, uSlices, uStacks };
+    return CreateShape( pDevice, &Desc, ppMesh );
 }
 
 
 //---------------------------------------------------------------------
-// MakeTorus helper
+// MakeTorus helper: row i is ring i and the faces that join it to the next ring, the
+// last ring joining the first
 //---------------------------------------------------------------------
-static void MakeTorus( VERTEX* pVertices, WORD* pwIndices, float fInnerRadius, float fOuterRadius, UINT uSides, UINT uRings )
+template <class INDEX>
+static void MakeTorus( const DXUT_SHAPE_JOB* pJob, UINT i, INDEX* pwIndices )
 {
-    UINT i, j;
+    const float fInnerRadius = pJob->Desc.fSize0;
+    const float fOuterRadius = pJob->Desc.fSize1;
+    const UINT uSides = pJob->Desc.uTess0;
+    const UINT uRings = pJob->Desc.uTess1;
+    const float* pSinP = pJob->pSinI;
+    const float* pCosP = pJob->pCosI;
+    UINT j = 0;
 
     //
     // Compute the vertices
     //
 
-    VERTEX* pVertex = pVertices;
+    VERTEX* pVertex = pJob->pVertices + i * uSides;
+    const float st = pJob->pSinJ[i];
+    const float ct = pJob->pCosJ[i];
 
-    for( i = 0; i < uRings; i++ )
+#ifdef DXUT_SHAPES_SSE
+    if( pJob->bSSE )
     {
-        float theta = ( float )i * 2.0f * D3DX_PI / ( float )uRings;
-        float st, ct;
-
-        sincosf( theta, &st, &ct );
-
-        for( j = 0; j < uSides; j++ )
+        const __m128 CT = _mm_set1_ps( ct );
+        const __m128 NegST = _mm_set1_ps( -st );
+        const __m128 Inner = _mm_set1_ps( fInnerRadius );
+        const __m128 Outer = _mm_set1_ps( fOuterRadius );
+        for( ; j + 4 <= uSides; j += 4 )
         {
-            float phi = ( float )j * 2.0f * D3DX_PI / uSides;
-            float sp, cp;
-
-            sincosf( phi, &sp, &cp );
+            __m128 SP = _mm_loadu_ps( pSinP + j );
+            __m128 CP = _mm_loadu_ps( pCosP + j );
+            __m128 R = _mm_add_ps( Outer, _mm_mul_ps( Inner, CP ) );
+            StoreVertices4( pVertex + j, _mm_mul_ps( CT, R ), _mm_mul_ps( NegST, R ), _mm_mul_ps( SP, Inner ),
+                            _mm_mul_ps( CT, CP ), _mm_mul_ps( NegST, CP ), SP );
+        }
+    }
+#endif
 
-            pVertex->pos.x = ct * ( fOuterRadius + fInnerRadius * cp );
-            pVertex->pos.y = -st * ( fOuterRadius + fInnerRadius * cp );
-            pVertex->pos.z = sp * fInnerRadius;
+    for( ; j < uSides; j++ )
+    {
+        float sp = pSinP[j];
+        float cp = pCosP[j];
 
-            pVertex->norm.x = ct * cp;
-            pVertex->norm.y = -st * cp;
-            pVertex->norm.z = sp;
+        pVertex[j].pos.x = ct * ( fOuterRadius + fInnerRadius * cp );
+        pVertex[j].pos.y = -st * ( fOuterRadius + fInnerRadius * cp );
+        pVertex[j].pos.z = sp * fInnerRadius;
 
-            pVertex++;
-        }
+        pVertex[j].norm.x = ct * cp;
+        pVertex[j].norm.y = -st * cp;
+        pVertex[j].norm.z = sp;
     }
 
     //
@@ -793,75 +753,42 @@ static void MakeTorus( VERTEX* pVertices, WORD* pwIndices, float fInnerRadius, f
     // Each face has 2 triangles (6 indices)
     //
 
-    // Tube i has indices:  
-    //        Left Edge: i*(uSides+1) -- i*(uSides+1)+uSides
-    //        Right Edge: (i+1)*(uSides+1) -- (i+1)*(uSides+1)+uSides
-    //
     // Face j on tube i has the 4 indices:
-    //        Left Edge: i*(uSides+1)+j -- i*(uSides+1)+j+1
-    //        Right Edge: (i+1)*(uSides+1)+j -- (i+1)*(uSides+1)+j+1
+    //        Left Edge: i*uSides+j -- i*uSides+j+1
+    //        Right Edge: (i+1)*uSides+j -- (i+1)*uSides+j+1
     //
-    WORD* pwFace = pwIndices;
-
-    for( i = 0; i < uRings - 1; i++ )
-    {
-        for( j = 0; j < uSides - 1; j++ )
-        {
-
-            // Tri 1 (Top-Left tri, CCW)
-            pwFace[0] = ( WORD )( i * uSides + j );
-            pwFace[1] = ( WORD )( i * uSides + j + 1 );
-            pwFace[2] = ( WORD )( ( i + 1 ) * uSides + j );
-            pwFace += 3;
-
-            // Tri 2 (Bottom-Right tri, CCW)
-            pwFace[0] = ( WORD )( ( i + 1 ) * uSides + j );
-            pwFace[1] = ( WORD )( i * uSides + j + 1 );
-            pwFace[2] = ( WORD )( ( i + 1 ) * uSides + j + 1 );
-            pwFace += 3;
-        }
-
-        // Tri 1 (Top-Left tri, CCW)
-        pwFace[0] = ( WORD )( i * uSides + j );
-        pwFace[1] = ( WORD )( i * uSides );
-        pwFace[2] = ( WORD )( ( i + 1 ) * uSides + j );
-        pwFace += 3;
-
-        // Tri 2 (Bottom-Right tri, CCW)
-        pwFace[0] = ( WORD )( ( i + 1 ) * uSides + j );
-        pwFace[1] = ( WORD )( i * uSides + 0 );
-        pwFace[2] = ( WORD )( ( i + 1 ) * uSides + 0 );
-        pwFace += 3;
-    }
-
+    // The last tube joins the two ends of the torus, its right edge being the first ring
+    //
+    INDEX* pwFace = pwIndices + 6 * i * uSides;
+    UINT uRowA = i * uSides;
+    UINT uRowB = ( ( i + 1 ) % uRings ) * uSides;
 
-    // join the two ends of the tube
     for( j = 0; j < uSides - 1; j++ )
     {
+
         // Tri 1 (Top-Left tri, CCW)
-        pwFace[0] = ( WORD )( i * uSides + j );
-        pwFace[1] = ( WORD )( i * uSides + j + 1 );
-        pwFace[2] = ( WORD )( j );
+        pwFace[0] = ( INDEX )( uRowA + j );
+        pwFace[1] = ( INDEX )( uRowA + j + 1 );
+        pwFace[2] = ( INDEX )( uRowB + j );
         pwFace += 3;
 
         // Tri 2 (Bottom-Right tri, CCW)
-        pwFace[0] = ( WORD )( j );
-        pwFace[1] = ( WORD )( i * uSides + j + 1 );
-        pwFace[2] = ( WORD )( j + 1 );
+        pwFace[0] = ( INDEX )( uRowB + j );
+        pwFace[1] = ( INDEX )( uRowA + j + 1 );
+        pwFace[2] = ( INDEX )( uRowB + j + 1 );
         pwFace += 3;
     }
 
     // Tri 1 (Top-Left tri, CCW)
-    pwFace[0] = ( WORD )( i * uSides + j );
-    pwFace[1] = ( WORD )( i * uSides );
-    pwFace[2] = ( WORD )( j );
+    pwFace[0] = ( INDEX )( uRowA + j );
+    pwFace[1] = ( INDEX )( uRowA );
+    pwFace[2] = ( INDEX )( uRowB + j );
     pwFace += 3;
 
     // Tri 2 (Bottom-Right tri, CCW)
-    pwFace[0] = ( WORD )( j );
-    pwFace[1] = ( WORD )( i * uSides );
-    pwFace[2] = ( WORD )( 0 );
-    pwFace += 3;
+    pwFace[0] = ( INDEX )( uRowB + j );
+    pwFace[1] = ( INDEX )( uRowA );
+    pwFace[2] = ( INDEX )( uRowB );
 }
 
 
@@ -871,12 +798,6 @@ static void MakeTorus( VERTEX* pVertices, WORD* pwIndices, float fInnerRadius, f
 HRESULT WINAPI DXUTCreateTorus( ID3D10Device* pDevice, float fInnerRadius, float fOuterRadius, UINT uSides,
                                 UINT uRings, ID3DX10Mesh** ppMesh )
 {
-    HRESULT hr = S_OK;
-
-    WORD* pwIndices = NULL;
-    VERTEX* pVertices = NULL;
-
-
     // Set up the defaults
     if( D3DX_DEFAULT_FLOAT == fInnerRadius )
         fInnerRadius = 1.0f;
@@ -892,39 +813,10 @@ HRESULT WINAPI DXUTCreateTorus( ID3D10Device* pDevice, float fInnerRadius, float
         return D3DERR_INVALIDCALL;
     if( !ppMesh )
         return D3DERR_INVALIDCALL;
-    if( fInnerRadius < 0.0f )
-        return D3DERR_INVALIDCALL;
-    if( fOuterRadius < 0.0f )
-        return D3DERR_INVALIDCALL;
-    if( uSides < 3 )
-        return D3DERR_INVALIDCALL;
-    if( uRings < 3 )
-        return D3DERR_INVALIDCALL;
-
-    // Create the mesh
-    UINT cFaces = 2 * uSides * uRings;
-    UINT cVertices = uRings * uSides;
-
-    // Create enough memory for the vertices and indices
-    pVertices = new VERTEX[ cVertices ];
-    if( !pVertices )
-        return E_OUTOFMEMORY;
-    pwIndices = new WORD[ cFaces * 3 ];
-    if( !pwIndices )
-        return E_OUTOFMEMORY;
 
     // Create a torus
-    MakeTorus( pVertices, pwIndices, fInnerRadius, fOuterRadius,
-               uSides, uRings );
-
-    // Create a mesh
-    hr = CreateShapeMesh( pDevice, ppMesh, pVertices, cVertices, pwIndices, cFaces * 3 );
-
-    // Free up the memory
-    SAFE_DELETE_ARRAY( pVertices );
-    SAFE_DELETE_ARRAY( pwIndices );
-
-    return hr;
+    DXUT_SHAPE_DESC Desc = { DXUT_SHAPE_TORUS, fInnerRadius, fOuterRadius, 0.0f, uSides, uRings };
+    return CreateShape( pDevice, &Desc, ppMesh );
 }
 
 
@@ -5564,7 +5456,8 @@ static WORD teapotIndices[NUMTEAPOTINDICES] =
 //----------------------------------------------------------------------------
 // MakeTeapot Helper
 //----------------------------------------------------------------------------
-static void MakeTeapot( VERTEX* pVertices, WORD* pwIndices ) 
+template <class INDEX>
+static void MakeTeapot( VERTEX* pVertices, INDEX* pwIndices ) 
 {
     DWORD iVertex;
 
@@ -5576,8 +5469,8 @@ static void MakeTeapot( VERTEX* pVertices, WORD* pwIndices )
     }
 
     // Copy face indices
-    WORD* pwFace = pwIndices;
-    WORD* pwFaceLim = pwFace + NUMTEAPOTINDICES;
+    INDEX* pwFace = pwIndices;
+    INDEX* pwFaceLim = pwFace + NUMTEAPOTINDICES;
     WORD* pwTeapotFace = teapotIndices;
 
     while( pwFace < pwFaceLim )
@@ -5597,11 +5490,179 @@ static void MakeTeapot( VERTEX* pVertices, WORD* pwIndices )
 //----------------------------------------------------------------------------
 HRESULT WINAPI DXUTCreateTeapot( ID3D10Device* pDevice, ID3DX10Mesh** ppMesh )
 {
-    HRESULT hr = S_OK;
+    // Validate parameters
+    if( !pDevice )
+        return D3DERR_INVALIDCALL;
+    if( !ppMesh )
+        return D3DERR_INVALIDCALL;
 
-    WORD* pwIndices = NULL;
-    VERTEX* pVertices = NULL;
+    // Create a teapot
+    DXUT_SHAPE_DESC Desc = { DXUT_SHAPE_TEAPOT, 0.0f, 0.0f, 0.0f, 0, 0 };
+    return CreateShape( pDevice, &Desc, ppMesh );
+}
+
+
+//----------------------------------------------------------------------------
+// Geosphere data: an icosahedron, each face wound as the sphere's are
+//----------------------------------------------------------------------------
+#define GEO_T   1.6180340f      // The golden ratio
 
+static float icosahedronV[12][3] =
+    {
+        {-1.0f, GEO_T, 0.0f}, {1.0f, GEO_T, 0.0f}, {-1.0f, -GEO_T, 0.0f}, {1.0f, -GEO_T, 0.0f},
+        {0.0f, -1.0f, GEO_T}, {0.0f, 1.0f, GEO_T}, {0.0f, -1.0f, -GEO_T}, {0.0f, 1.0f, -GEO_T},
+        {GEO_T, 0.0f, -1.0f}, {GEO_T, 0.0f, 1.0f}, {-GEO_T, 0.0f, -1.0f}, {-GEO_T, 0.0f, 1.0f},
+    };
+
+static WORD icosahedronF[20][3] =
+    {
+        { 0, 11, 5 }, { 0, 5, 1 }, { 0, 1, 7 }, { 0, 7, 10 }, { 0, 10, 11 },
+        { 1, 5, 9 }, { 5, 11, 4 }, { 11, 10, 2 }, { 10, 7, 6 }, { 7, 1, 8 },
+        { 3, 9, 4 }, { 3, 4, 2 }, { 3, 2, 6 }, { 3, 6, 8 }, { 3, 8, 9 },
+        { 4, 9, 5 }, { 2, 4, 11 }, { 6, 2, 10 }, { 8, 6, 7 }, { 9, 8, 1 },
+    };
+
+
+//----------------------------------------------------------------------------
+// Geosphere vertices are numbered the 12 corners first, then the vertices inside each
+// edge of the icosahedron from its lower corner, then those inside each face a row at
+// a time.  Point ( i, j ) of a face is i / uDivisions of the way from its first corner to
+// its second and j / uDivisions of the way from its first corner to its third.
+//----------------------------------------------------------------------------
+static UINT GetGeoSphereVertex( const DXUT_SHAPE_JOB* pJob, UINT iFace, UINT i, UINT j )
+{
+    const UINT n = pJob->Desc.uTess0;
+    const UINT k = n - i - j;
+    const WORD* pCorners = icosahedronF[iFace];
+    UINT iEdge, iAlong;
+
+    if( 0 == j && 0 == i )
+        return pCorners[0];
+    if( 0 == j && n == i )
+        return pCorners[1];
+    if( n == j )
+        return pCorners[2];
+
+    if( 0 == j )
+    {
+        iEdge = pJob->aFaceEdges[iFace][0];
+        iAlong = pCorners[0] == pJob->aEdges[iEdge][0] ? i : n - i;
+    }
+    else if( 0 == i )
+    {
+        iEdge = pJob->aFaceEdges[iFace][1];
+        iAlong = pCorners[0] == pJob->aEdges[iEdge][0] ? j : n - j;
+    }
+    else if( 0 == k )
+    {
+        iEdge = pJob->aFaceEdges[iFace][2];
+        iAlong = pCorners[1] == pJob->aEdges[iEdge][0] ? j : n - j;
+    }
+    else
+    {
+        // Inside the face, n - 1 - j of them on row j
+        return 12 + 30 * ( n - 1 ) + iFace * ( n - 1 ) * ( n - 2 ) / 2 +
+            ( j - 1 ) * ( n - 1 ) - ( j - 1 ) * j / 2 + ( i - 1 );
+    }
+
+    return 12 + iEdge * ( n - 1 ) + iAlong - 1;
+}
+
+
+//----------------------------------------------------------------------------
+// Sets a geosphere vertex w0, w1 and w2 parts of the way to the corners
+//----------------------------------------------------------------------------
+static inline void SetGeoSphereVertex( VERTEX* pVertex, float fRadius, UINT i0, UINT i1, UINT i2, float w0,
+                                       float w1, float w2 )
+{
+    D3DXVECTOR3 norm( w0 * icosahedronV[i0][0] + w1 * icosahedronV[i1][0] + w2 * icosahedronV[i2][0],
+                      w0 * icosahedronV[i0][1] + w1 * icosahedronV[i1][1] + w2 * icosahedronV[i2][1],
+                      w0 * icosahedronV[i0][2] + w1 * icosahedronV[i1][2] + w2 * icosahedronV[i2][2] );
+    D3DXVec3Normalize( &norm, &norm );
+
+    pVertex->pos = norm * fRadius;
+    pVertex->norm = norm;
+}
+
+
+//----------------------------------------------------------------------------
+// MakeGeoSphere helper: row 0 is the corners, rows 1 to 30 the vertices inside each
+// edge and then each face has uDivisions rows, row j of a face being the vertices inside
+// it on row j and the faces between rows j and j + 1
+//----------------------------------------------------------------------------
+template <class INDEX>
+static void MakeGeoSphere( const DXUT_SHAPE_JOB* pJob, UINT iRow, INDEX* pwIndices )
+{
+    const float fRadius = pJob->Desc.fSize0;
+    const UINT n = pJob->Desc.uTess0;
+    const float fStep = 1.0f / n;
+    UINT i;
+
+    if( 0 == iRow )
+    {
+        for( i = 0; i < 12; i++ )
+            SetGeoSphereVertex( pJob->pVertices + i, fRadius, i, i, i, 1.0f, 0.0f, 0.0f );
+        return;
+    }
+
+    if( iRow <= 30 )
+    {
+        const UINT iEdge = iRow - 1;
+        VERTEX* pVertex = pJob->pVertices + 12 + iEdge * ( n - 1 );
+        for( i = 1; i < n; i++ )
+            SetGeoSphereVertex( pVertex + i - 1, fRadius, pJob->aEdges[iEdge][0], pJob->aEdges[iEdge][1], 0,
+                                ( n - i ) * fStep, i * fStep, 0.0f );
+        return;
+    }
+
+    const UINT iFace = ( iRow - 31 ) / n;
+    const UINT j = ( iRow - 31 ) % n;
+    const WORD* pCorners = icosahedronF[iFace];
+
+    // Vertices inside the face
+    if( j >= 1 && j + 2 <= n )
+    {
+        VERTEX* pVertex = pJob->pVertices + GetGeoSphereVertex( pJob, iFace, 1, j );
+        for( i = 1; i + j < n; i++ )
+            SetGeoSphereVertex( pVertex + i - 1, fRadius, pCorners[0], pCorners[1], pCorners[2],
+                                ( n - i - j ) * fStep, i * fStep, j * fStep );
+    }
+
+    // 2 * ( n - j ) - 1 faces between rows j and j + 1, wound as the corners are
+    INDEX* pwFace = pwIndices + 3 * ( iFace * n * n + 2 * n * j - j * j );
+    for( i = 0; i + j < n; i++ )
+    {
+        UINT i00 = GetGeoSphereVertex( pJob, iFace, i, j );
+        UINT i10 = GetGeoSphereVertex( pJob, iFace, i + 1, j );
+        UINT i01 = GetGeoSphereVertex( pJob, iFace, i, j + 1 );
+
+        pwFace[0] = ( INDEX )i00;
+        pwFace[1] = ( INDEX )i10;
+        pwFace[2] = ( INDEX )i01;
+        pwFace += 3;
+
+        if( i + j + 1 < n )
+        {
+            pwFace[0] = ( INDEX )i10;
+            pwFace[1] = ( INDEX )GetGeoSphereVertex( pJob, iFace, i + 1, j + 1 );
+            pwFace[2] = ( INDEX )i01;
+            pwFace += 3;
+        }
+    }
+}
+
+
+//----------------------------------------------------------------------------
+// DXUTCreateGeoSphere - create a geodesic sphere mesh, an icosahedron with each edge
+// divided into uDivisions
+//----------------------------------------------------------------------------
+HRESULT WINAPI DXUTCreateGeoSphere( ID3D10Device* pDevice, float fRadius, UINT uDivisions, ID3DX10Mesh** ppMesh )
+{
+    // Set up the defaults
+    if( D3DX_DEFAULT_FLOAT == fRadius )
+        fRadius = 1.0f;
+    if( D3DX_DEFAULT == uDivisions )
+        uDivisions = 4;
 
     // Validate parameters
     if( !pDevice )
@@ -5609,27 +5670,442 @@ HRESULT WINAPI DXUTCreateTeapot( ID3D10Device* pDevice, ID3DX10Mesh** ppMesh )
     if( !ppMesh )
         return D3DERR_INVALIDCALL;
 
-    // Create the mesh
-    UINT cFaces = NUMTEAPOTINDICES / 3;
-    UINT cVertices = NUMTEAPOTVERTICES;
+    // Create a geosphere
+    DXUT_SHAPE_DESC Desc = { DXUT_SHAPE_GEOSPHERE, fRadius, 0.0f, 0.0f, uDivisions, 0 };
+    return CreateShape( pDevice, &Desc, ppMesh );
+}
 
-    // Create enough memory for the vertices and indices
-    pVertices = new VERTEX[ cVertices ];
-    if( !pVertices )
-        return E_OUTOFMEMORY;
-    pwIndices = new WORD[ cFaces * 3 ];
-    if( !pwIndices )
-        return E_OUTOFMEMORY;
 
-    // Create a teapot
-    MakeTeapot( pVertices, pwIndices );
+//--------------------------------------------------------------------------------------
+// Device independent generation
+//--------------------------------------------------------------------------------------
+HRESULT WINAPI DXUTGetShapeSize( const DXUT_SHAPE_DESC* pDesc, UINT* pNumVertices, UINT* pNumIndices )
+{
+    if( !pDesc || !pNumVertices || !pNumIndices )
+        return D3DERR_INVALIDCALL;
+    if( pDesc->fSize0 < 0.0f || pDesc->fSize1 < 0.0f || pDesc->fSize2 < 0.0f )
+        return D3DERR_INVALIDCALL;
 
-    // Create a mesh
-    hr = CreateShapeMesh( pDevice, ppMesh, pVertices, cVertices, pwIndices, cFaces * 3 );
+    const ULONGLONG uTess0 = pDesc->uTess0;
+    const ULONGLONG uTess1 = pDesc->uTess1;
+    ULONGLONG cVertices, cFaces;
+    switch( pDesc->Shape )
+    {
+        case DXUT_SHAPE_BOX:
+            cVertices = 24;
+            cFaces = 12;
+            break;
+        case DXUT_SHAPE_CYLINDER:
+            if( uTess0 < 2 || uTess1 < 1 )
+                return D3DERR_INVALIDCALL;
+            cVertices = 2 + ( uTess1 + 3 ) * uTess0;
+            cFaces = ( uTess1 + 1 ) * uTess0 * 2;
+            break;
+        case DXUT_SHAPE_POLYGON:
+            if( uTess0 < 3 )
+                return D3DERR_INVALIDCALL;
+            cVertices = uTess0 + 1;
+            cFaces = uTess0;
+            break;
+        case DXUT_SHAPE_SPHERE:
+            if( uTess0 < 2 || uTess1 < 2 )
+                return D3DERR_INVALIDCALL;
+            cVertices = ( uTess1 - 1 ) * uTess0 + 2;
+            cFaces = 2 * ( uTess1 - 1 ) * uTess0;
+            break;
+        case DXUT_SHAPE_TORUS:
+            if( uTess0 < 3 || uTess1 < 3 )
+                return D3DERR_INVALIDCALL;
+            cVertices = uTess1 * uTess0;
+            cFaces = 2 * uTess0 * uTess1;
+            break;
+        case DXUT_SHAPE_TEAPOT:
+            cVertices = NUMTEAPOTVERTICES;
+            cFaces = NUMTEAPOTINDICES / 3;
+            break;
+        case DXUT_SHAPE_GEOSPHERE:
+            if( uTess0 < 1 )
+                return D3DERR_INVALIDCALL;
+            cVertices = 10 * uTess0 * uTess0 + 2;
+            cFaces = 20 * uTess0 * uTess0;
+            break;
+        default:
+            return D3DERR_INVALIDCALL;
+    }
 
-    // Free up the memory
-    SAFE_DELETE_ARRAY( pVertices );
-    SAFE_DELETE_ARRAY( pwIndices );
+    // Indices, and bytes of vertices, must be counted in a UINT
+    if( 3 * cFaces > 0xFFFFFFFF || cVertices * sizeof( VERTEX ) > 0xFFFFFFFF )
+        return D3DERR_INVALIDCALL;
+
+    *pNumVertices = ( UINT )cVertices;
+    *pNumIndices = ( UINT )( 3 * cFaces );
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Validates a shape and sets up a job to generate it: the rows it has, the sine and cosine
+// tables it needs and the icosahedron's edges
+//--------------------------------------------------------------------------------------
+static HRESULT BeginShapeJob( DXUT_SHAPE_JOB* pJob, const DXUT_SHAPE_DESC* pDesc, VERTEX* pVertices,
+                              void* pIndices, DXGI_FORMAT IndexFormat, bool bSSE )
+{
+    HRESULT hr;
+    UINT cIndices;
 
+    ZeroMemory( pJob, sizeof( DXUT_SHAPE_JOB ) );
+    V_RETURN( DXUTGetShapeSize( pDesc, &pJob->nVertices, &cIndices ) );
+    if( !pVertices || !pIndices )
+        return D3DERR_INVALIDCALL;
+    if( DXGI_FORMAT_R16_UINT == IndexFormat && pJob->nVertices <= 65536 )
+        pJob->pwIndices = ( WORD* )pIndices;
+    else if( DXGI_FORMAT_R32_UINT == IndexFormat )
+        pJob->pdwIndices = ( DWORD* )pIndices;
+    else
+        return D3DERR_INVALIDCALL;
+
+    pJob->Desc = *pDesc;
+    pJob->pVertices = pVertices;
+    pJob->bSSE = bSSE;
+
+    // Angles around each slice or side, and down each stack or around each ring
+    UINT uAnglesI = 0, uAnglesJ = 0;
+    float fAngleJ = 0.0f;
+    switch( pDesc->Shape )
+    {
+        case DXUT_SHAPE_CYLINDER:
+            uAnglesI = pDesc->uTess0;
+            pJob->nRows = pDesc->uTess1 + 3;
+            break;
+        case DXUT_SHAPE_SPHERE:
+            uAnglesI = pDesc->uTess0;
+            uAnglesJ = pDesc->uTess1;
+            fAngleJ = D3DX_PI;
+            pJob->nRows = pDesc->uTess1 + 1;
+            break;
+        case DXUT_SHAPE_TORUS:
+            uAnglesI = pDesc->uTess0;
+            uAnglesJ = pDesc->uTess1;
+            fAngleJ = 2.0f * D3DX_PI;
+            pJob->nRows = pDesc->uTess1;
+            break;
+        case DXUT_SHAPE_POLYGON:
+            uAnglesI = pDesc->uTess0;
+            pJob->nRows = 1;
+            break;
+        case DXUT_SHAPE_GEOSPHERE:
+            pJob->nRows = 31 + 20 * pDesc->uTess0;
+            break;
+        default:
+            pJob->nRows = 1;
+            break;
+    }
+
+    if( uAnglesI + uAnglesJ > 0 )
+    {
+        float* pTables = new float[ 2 * ( uAnglesI + uAnglesJ ) ];
+        if( !pTables )
+            return E_OUTOFMEMORY;
+        pJob->pSinI = pTables;
+        pJob->pCosI = pJob->pSinI + uAnglesI;
+        pJob->pSinJ = pJob->pCosI + uAnglesI;
+        pJob->pCosJ = pJob->pSinJ + uAnglesJ;
+
+        for( UINT i = 0; i < uAnglesI; i++ )
+            sincosf( 2.0f * D3DX_PI * i / uAnglesI, pJob->pSinI + i, pJob->pCosI + i );
+        for( UINT j = 0; j < uAnglesJ; j++ )
+            sincosf( fAngleJ * j / uAnglesJ, pJob->pSinJ + j, pJob->pCosJ + j );
+    }
+
+    if( DXUT_SHAPE_GEOSPHERE == pDesc->Shape )
+    {
+        UINT cEdges = 0;
+        for( UINT iFace = 0; iFace < 20; iFace++ )
+        {
+            static const UINT s_aEdgeCorners[3][2] = { { 0, 1 }, { 0, 2 }, { 1, 2 } };
+            for( UINT iSide = 0; iSide < 3; iSide++ )
+            {
+                UINT i0 = icosahedronF[iFace][s_aEdgeCorners[iSide][0]];
+                UINT i1 = icosahedronF[iFace][s_aEdgeCorners[iSide][1]];
+                UINT iLow = min( i0, i1 ), iHigh = max( i0, i1 );
+
+                UINT iEdge;
+                for( iEdge = 0; iEdge < cEdges; iEdge++ )
+                {
+                    if( pJob->aEdges[iEdge][0] == iLow && pJob->aEdges[iEdge][1] == iHigh )
+                        break;
+                }
+                if( iEdge == cEdges )
+                {
+                    pJob->aEdges[cEdges][0] = iLow;
+                    pJob->aEdges[cEdges][1] = iHigh;
+                    cEdges++;
+                }
+                pJob->aFaceEdges[iFace][iSide] = iEdge;
+            }
+        }
+    }
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+static void EndShapeJob( DXUT_SHAPE_JOB* pJob )
+{
+    SAFE_DELETE_ARRAY( pJob->pSinI );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Generates a row of a shape
+//--------------------------------------------------------------------------------------
+template <class INDEX>
+static void MakeShapeRow( const DXUT_SHAPE_JOB* pJob, UINT iRow, INDEX* pwIndices )
+{
+    switch( pJob->Desc.Shape )
+    {
+        case DXUT_SHAPE_BOX:
+            MakeBox( pJob->pVertices, pwIndices, pJob->Desc.fSize0, pJob->Desc.fSize1, pJob->Desc.fSize2 );
+            break;
+        case DXUT_SHAPE_CYLINDER:
+            MakeCylinder( pJob, iRow, pwIndices );
+            break;
+        case DXUT_SHAPE_POLYGON:
+            MakePolygon( pJob, pwIndices );
+            break;
+        case DXUT_SHAPE_SPHERE:
+            MakeSphere( pJob, iRow, pwIndices );
+            break;
+        case DXUT_SHAPE_TORUS:
+            MakeTorus( pJob, iRow, pwIndices );
+            break;
+        case DXUT_SHAPE_TEAPOT:
+            MakeTeapot( pJob->pVertices, pwIndices );
+            break;
+        case DXUT_SHAPE_GEOSPHERE:
+            MakeGeoSphere( pJob, iRow, pwIndices );
+            break;
+    }
+}
+
+static void MakeShapeRow( const DXUT_SHAPE_JOB* pJob, UINT iRow )
+{
+    if( pJob->pwIndices )
+        MakeShapeRow( pJob, iRow, pJob->pwIndices );
+    else
+        MakeShapeRow( pJob, iRow, pJob->pdwIndices );
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT WINAPI DXUTGenerateShape( const DXUT_SHAPE_DESC* pDesc, DXUT_SHAPE_VERTEX* pVertices, void* pIndices,
+                                  DXGI_FORMAT IndexFormat )
+{
+    HRESULT hr;
+    DXUT_SHAPE_JOB Job;
+
+#ifdef DXUT_SHAPES_SSE
+    V_RETURN( BeginShapeJob( &Job, pDesc, pVertices, pIndices, IndexFormat, true ) );
+#else
+    V_RETURN( BeginShapeJob( &Job, pDesc, pVertices, pIndices, IndexFormat, false ) );
+#endif
+    for( UINT iRow = 0; iRow < Job.nRows; iRow++ )
+        MakeShapeRow( &Job, iRow );
+    EndShapeJob( &Job );
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT WINAPI DXUTGetShapeLOD( const DXUT_SHAPE_DESC* pDesc, UINT uLOD, DXUT_SHAPE_DESC* pLODDesc )
+{
+    if( !pDesc || !pLODDesc )
+        return D3DERR_INVALIDCALL;
+
+    // The least tessellation each shape may have, and how many slices and stacks less it
+    // is drawn with.  Boxes and teapots only have the one.
+    UINT uMin0 = 0, uMin1 = 0;
+    switch( pDesc->Shape )
+    {
+        case DXUT_SHAPE_CYLINDER:
+            uMin0 = 3;
+            uMin1 = 1;
+            break;
+        case DXUT_SHAPE_POLYGON:
+            uMin0 = 3;
+            break;
+        case DXUT_SHAPE_SPHERE:
+            uMin0 = 4;
+            uMin1 = 3;
+            break;
+        case DXUT_SHAPE_TORUS:
+            uMin0 = 3;
+            uMin1 = 3;
+            break;
+        case DXUT_SHAPE_GEOSPHERE:
+            uMin0 = 1;
+            break;
+        default:
+            break;
+    }
+
+    *pLODDesc = *pDesc;
+    uLOD = min( uLOD, 31u );
+    if( pLODDesc->uTess0 > uMin0 )
+        pLODDesc->uTess0 = max( pLODDesc->uTess0 >> uLOD, uMin0 );
+    if( pLODDesc->uTess1 > uMin1 )
+        pLODDesc->uTess1 = max( pLODDesc->uTess1 >> uLOD, uMin1 );
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT WINAPI DXUTGetShapeLODChainSize( const DXUT_SHAPE_DESC* pDesc, UINT uLODs, UINT* pNumVertices,
+                                         UINT* pNumIndices )
+{
+    HRESULT hr;
+
+    if( !pNumVertices || !pNumIndices )
+        return D3DERR_INVALIDCALL;
+
+    ULONGLONG cVertices = 0, cIndices = 0;
+    for( UINT uLOD = 0; uLOD < uLODs; uLOD++ )
+    {
+        DXUT_SHAPE_DESC LODDesc;
+        UINT cLODVertices, cLODIndices;
+        V_RETURN( DXUTGetShapeLOD( pDesc, uLOD, &LODDesc ) );
+        V_RETURN( DXUTGetShapeSize( &LODDesc, &cLODVertices, &cLODIndices ) );
+        cVertices += cLODVertices;
+        cIndices += cLODIndices;
+    }
+    if( cIndices > 0xFFFFFFFF || cVertices * sizeof( VERTEX ) > 0xFFFFFFFF )
+        return D3DERR_INVALIDCALL;
+
+    *pNumVertices = ( UINT )cVertices;
+    *pNumIndices = ( UINT )cIndices;
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// CDXUTShapeGenerator
+//--------------------------------------------------------------------------------------
+CDXUTShapeGenerator::CDXUTShapeGenerator()
+{
+    m_dwFlags = 0;
+    m_nThreads = 1;
+    m_pJob = NULL;
+    m_fTime = 0.0;
+}
+
+
+//--------------------------------------------------------------------------------------
+CDXUTShapeGenerator::~CDXUTShapeGenerator()
+{
+    Destroy();
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CDXUTShapeGenerator::Create( UINT nThreads, DWORD dwFlags )
+{
+    Destroy();
+
+    m_dwFlags = dwFlags;
+    if( 0 == nThreads )
+        nThreads = CDXUTWorkerPool::GetNumProcessors();
+    nThreads = min( nThreads, ( UINT )DXUT_SHAPES_MAX_THREADS );
+    m_nThreads = min( nThreads, DXUTGetWorkerPool()->GetNumThreads() );
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CDXUTShapeGenerator::Destroy()
+{
+    m_nThreads = 1;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CDXUTShapeGenerator::Generate( const DXUT_SHAPE_DESC* pDesc, DXUT_SHAPE_VERTEX* pVertices, void* pIndices,
+                                       DXGI_FORMAT IndexFormat )
+{
+    double fStart = DXUTGetMilliseconds();
+
+    HRESULT hr = RunJob( pDesc, pVertices, pIndices, IndexFormat );
+
+    m_fTime = DXUTGetMilliseconds() - fStart;
     return hr;
 }
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CDXUTShapeGenerator::GenerateLODChain( const DXUT_SHAPE_DESC* pDesc, UINT uLODs,
+                                               DXUT_SHAPE_VERTEX* pVertices, void* pIndices,
+                                               DXGI_FORMAT IndexFormat, DXUT_SHAPE_LOD* pLODs )
+{
+    HRESULT hr;
+
+    if( !pLODs )
+        return D3DERR_INVALIDCALL;
+
+    double fStart = DXUTGetMilliseconds();
+
+    const UINT uIndexSize = DXGI_FORMAT_R32_UINT == IndexFormat ? sizeof( DWORD ) : sizeof( WORD );
+    UINT uBaseVertex = 0, uStartIndex = 0;
+    for( UINT uLOD = 0; uLOD < uLODs; uLOD++ )
+    {
+        DXUT_SHAPE_DESC LODDesc;
+        V_RETURN( DXUTGetShapeLOD( pDesc, uLOD, &LODDesc ) );
+        V_RETURN( DXUTGetShapeSize( &LODDesc, &pLODs[uLOD].NumVertices, &pLODs[uLOD].NumIndices ) );
+        pLODs[uLOD].BaseVertex = uBaseVertex;
+        pLODs[uLOD].StartIndex = uStartIndex;
+
+        V_RETURN( RunJob( &LODDesc, pVertices + uBaseVertex, ( BYTE* )pIndices + uStartIndex * uIndexSize,
+                          IndexFormat ) );
+        uBaseVertex += pLODs[uLOD].NumVertices;
+        uStartIndex += pLODs[uLOD].NumIndices;
+    }
+
+    m_fTime = DXUTGetMilliseconds() - fStart;
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CDXUTShapeGenerator::RunJob( const DXUT_SHAPE_DESC* pDesc, DXUT_SHAPE_VERTEX* pVertices, void* pIndices,
+                                     DXGI_FORMAT IndexFormat )
+{
+    HRESULT hr;
+    DXUT_SHAPE_JOB Job;
+
+#ifdef DXUT_SHAPES_SSE
+    const bool bSSE = 0 == ( m_dwFlags & DXUT_SHAPES_SCALAR );
+#else
+    const bool bSSE = false;
+#endif
+    V_RETURN( BeginShapeJob( &Job, pDesc, pVertices, pIndices, IndexFormat, bSSE ) );
+
+    m_pJob = &Job;
+
+    // Each row is written by one thread, so the shape is the same on any number of them
+    const UINT nThreads = Job.nVertices < DXUT_SHAPES_MIN_PARALLEL ? 1 : m_nThreads;
+    DXUTGetWorkerPool()->Run( RowProc, this, Job.nRows, nThreads );
+
+    m_pJob = NULL;
+    EndShapeJob( &Job );
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CDXUTShapeGenerator::RowProc( void* pContext, UINT iRow, UINT iThread )
+{
+    UNREFERENCED_PARAMETER( iThread );
+    MakeShapeRow( ( ( CDXUTShapeGenerator* )pContext )->m_pJob, iRow );
+}
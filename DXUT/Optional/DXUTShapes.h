@@ -10,6 +10,119 @@
 #ifndef DXUT_SHAPES_H
 #define DXUT_SHAPES_H
 
+//--------------------------------------------------------------------------------------
+// The vertex layout of all DXUT shapes, a POSITION and a NORMAL
+//--------------------------------------------------------------------------------------
+struct DXUT_SHAPE_VERTEX
+{
+    D3DXVECTOR3 pos;
+    D3DXVECTOR3 norm;
+};
+
+enum DXUT_SHAPE
+{
+    DXUT_SHAPE_BOX = 0,
+    DXUT_SHAPE_CYLINDER,
+    DXUT_SHAPE_POLYGON,
+    DXUT_SHAPE_SPHERE,
+    DXUT_SHAPE_TORUS,
+    DXUT_SHAPE_TEAPOT,
+    DXUT_SHAPE_GEOSPHERE,       // A subdivided icosahedron
+};
+
+//--------------------------------------------------------------------------------------
+// A shape to generate, with the parameters the DXUTCreate* function of the shape takes
+//--------------------------------------------------------------------------------------
+struct DXUT_SHAPE_DESC
+{
+    DXUT_SHAPE Shape;
+    float fSize0;       // Box width, cylinder radius 1, polygon length, sphere radius, torus inner radius
+    float fSize1;       // Box height, cylinder radius 2, torus outer radius
+    float fSize2;       // Box depth, cylinder length
+    UINT uTess0;        // Cylinder and sphere slices, polygon and torus sides, geosphere divisions of each edge
+    UINT uTess1;        // Cylinder and sphere stacks, torus rings
+};
+
+// Where each LOD of a chain is in the vertices and indices.  The indices of each LOD
+// start from 0 at its BaseVertex.
+struct DXUT_SHAPE_LOD
+{
+    UINT BaseVertex;
+    UINT StartIndex;
+    UINT NumVertices;
+    UINT NumIndices;
+};
+
+// Device independent generation.  The vertices and the indices, as DXGI_FORMAT_R16_UINT
+// or DXGI_FORMAT_R32_UINT, are written to the caller's memory, which may be a mapped
+// buffer, and DXUTGetShapeSize gives how many of each a shape needs.  16 bit indices
+// can reach 65536 vertices.
+HRESULT WINAPI DXUTGetShapeSize( const DXUT_SHAPE_DESC* pDesc, UINT* pNumVertices, UINT* pNumIndices );
+HRESULT WINAPI DXUTGenerateShape( const DXUT_SHAPE_DESC* pDesc, DXUT_SHAPE_VERTEX* pVertices, void* pIndices,
+                                  DXGI_FORMAT IndexFormat );
+
+// LOD uLOD of a shape, LOD 0 being the shape itself and each LOD after having half the
+// tessellation of the one before, down to the least each shape can have.  A chain of
+// LODs is drawn from one vertex and one index buffer, LOD 0 first.
+HRESULT WINAPI DXUTGetShapeLOD( const DXUT_SHAPE_DESC* pDesc, UINT uLOD, DXUT_SHAPE_DESC* pLODDesc );
+HRESULT WINAPI DXUTGetShapeLODChainSize( const DXUT_SHAPE_DESC* pDesc, UINT uLODs, UINT* pNumVertices,
+                                         UINT* pNumIndices );
+
+#define DXUT_SHAPES_MAX_THREADS 32
+
+// Use plain C++ to emit the vertices even where SSE is available
+#define DXUT_SHAPES_SCALAR      0x00000001
+
+struct DXUT_SHAPE_JOB;
+
+
+//--------------------------------------------------------------------------------------
+// Generates shapes on the DXUT worker pool, a few rows of a shape to each thread at a time,
+// for tessellations too big to generate in a frame on one.  DXUTGenerateShape generates
+// them on the calling thread.
+//--------------------------------------------------------------------------------------
+class CDXUTShapeGenerator
+{
+public:
+                        CDXUTShapeGenerator();
+                        ~CDXUTShapeGenerator();
+
+    // nThreads 0 uses a thread for each processor
+    HRESULT             Create( UINT nThreads = 0, DWORD dwFlags = 0 );
+    void                Destroy();
+
+    HRESULT             Generate( const DXUT_SHAPE_DESC* pDesc, DXUT_SHAPE_VERTEX* pVertices, void* pIndices,
+                                  DXGI_FORMAT IndexFormat );
+
+    // Generates uLODs LODs one after the other, filling pLODs with where each one went
+    HRESULT             GenerateLODChain( const DXUT_SHAPE_DESC* pDesc, UINT uLODs, DXUT_SHAPE_VERTEX* pVertices,
+                                          void* pIndices, DXGI_FORMAT IndexFormat, DXUT_SHAPE_LOD* pLODs );
+
+    UINT                GetNumThreads() const
+    {
+        return m_nThreads;
+    }
+
+    // Milliseconds the last call took
+    double              GetTime() const
+    {
+        return m_fTime;
+    }
+
+protected:
+    static void         RowProc( void* pContext, UINT iRow, UINT iThread );
+
+    HRESULT             RunJob( const DXUT_SHAPE_DESC* pDesc, DXUT_SHAPE_VERTEX* pVertices, void* pIndices,
+                                DXGI_FORMAT IndexFormat );
+
+    // Up to m_nThreads threads work on the rows, counting the one calling Generate
+    DWORD               m_dwFlags;
+    UINT                m_nThreads;
+    DXUT_SHAPE_JOB*     m_pJob;
+
+    double              m_fTime;
+};
+
 HRESULT WINAPI DXUTCreateBox( ID3D10Device* pDevice, float fWidth, float fHeight, float fDepth, ID3DX10Mesh** ppMesh );
 HRESULT WINAPI DXUTCreateCylinder( ID3D10Device* pDevice, float fRadius1, float fRadius2, float fLength, UINT uSlices,
                                    UINT uStacks, ID3DX10Mesh** ppMesh );
@@ -19,5 +132,6 @@ HRESULT WINAPI DXUTCreateSphere( ID3D10Device* pDevice, float fRadius, UINT uSli
 HRESULT WINAPI DXUTCreateTorus( ID3D10Device* pDevice, float fInnerRadius, float fOuterRadius, UINT uSides,
                                 UINT uRings, ID3DX10Mesh** ppMesh );
 HRESULT WINAPI DXUTCreateTeapot( ID3D10Device* pDevice, ID3DX10Mesh** ppMesh );
+HRESULT WINAPI DXUTCreateGeoSphere( ID3D10Device* pDevice, float fRadius, UINT uDivisions, ID3DX10Mesh** ppMesh );
 
 #endif
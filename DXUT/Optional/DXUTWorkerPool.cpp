@@ -0,0 +1,190 @@
+//--------------------------------------------------------------------------------------
+// File: DXUTWorkerPool.cpp
+//
+// Builds on its own with any C++11 compiler, e.g.
+//     g++ -O2 -std=c++11 -pthread -c DXUTWorkerPool.cpp
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#include "DXUTWorkerPool.h"
+#include <chrono>
+#include <system_error>
+
+
+//--------------------------------------------------------------------------------------
+CDXUTWorkerPool::CDXUTWorkerPool() : m_bRunning( false )
+{
+    m_nWorkers = 0;
+    m_bQuit = false;
+    m_nJob = 0;
+    m_nWake = 0;
+    m_nBusy = 0;
+    m_pfnItem = NULL;
+    m_pContext = NULL;
+    m_nItems = 0;
+    m_nNextItem = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+CDXUTWorkerPool::~CDXUTWorkerPool()
+{
+    Destroy();
+}
+
+
+//--------------------------------------------------------------------------------------
+UINT CDXUTWorkerPool::GetNumProcessors()
+{
+    UINT nProcessors = std::thread::hardware_concurrency();
+    return nProcessors ? nProcessors : 1;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CDXUTWorkerPool::Create( UINT nThreads )
+{
+    Destroy();
+
+    if( nThreads == 0 )
+        nThreads = GetNumProcessors();
+    if( nThreads > DXUT_WORKER_POOL_MAX_THREADS )
+        nThreads = DXUT_WORKER_POOL_MAX_THREADS;
+
+    m_bQuit = false;
+
+    // Each worker is told the Run it starts after, as one may come before it gets going
+    for( UINT i = 0; i < nThreads - 1; i++ )
+    {
+        try
+        {
+            m_aWorkers[i] = std::thread( &CDXUTWorkerPool::WorkerProc, this, i + 1, m_nJob );
+        }
+        catch( const std::system_error& )
+        {
+            break;
+        }
+        m_nWorkers++;
+    }
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CDXUTWorkerPool::Destroy()
+{
+    if( m_nWorkers == 0 )
+        return;
+
+    {
+        std::lock_guard <std::mutex> Lock( m_Mutex );
+        m_bQuit = true;
+    }
+    m_Start.notify_all();
+
+    for( UINT i = 0; i < m_nWorkers; i++ )
+        m_aWorkers[i].join();
+    m_nWorkers = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CDXUTWorkerPool::WorkerProc( UINT iThread, ULONGLONG nJob )
+{
+    std::unique_lock <std::mutex> Lock( m_Mutex );
+    for(; ; )
+    {
+        while( !m_bQuit && m_nJob == nJob )
+            m_Start.wait( Lock );
+        if( m_bQuit )
+            break;
+
+        nJob = m_nJob;
+        if( iThread > m_nWake )
+            continue;
+
+        Lock.unlock();
+        RunItems( iThread );
+        Lock.lock();
+
+        if( --m_nBusy == 0 )
+            m_Done.notify_one();
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+void CDXUTWorkerPool::RunItems( UINT iThread )
+{
+    for(; ; )
+    {
+        UINT iItem = m_nNextItem.fetch_add( 1 );
+        if( iItem >= m_nItems )
+            break;
+        m_pfnItem( m_pContext, iItem, iThread );
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+void CDXUTWorkerPool::Run( LPDXUTWORKITEM pfnItem, void* pContext, UINT nItems, UINT nMaxThreads )
+{
+    if( nItems == 0 )
+        return;
+
+    UINT nWake = m_nWorkers;
+    if( nMaxThreads > 0 && nWake > nMaxThreads - 1 )
+        nWake = nMaxThreads - 1;
+    if( nWake > nItems - 1 )
+        nWake = nItems - 1;
+
+    bool bIdle = false;
+    if( nWake == 0 || !m_bRunning.compare_exchange_strong( bIdle, true ) )
+    {
+        for( UINT i = 0; i < nItems; i++ )
+            pfnItem( pContext, i, 0 );
+        return;
+    }
+
+    {
+        std::lock_guard <std::mutex> Lock( m_Mutex );
+        m_pfnItem = pfnItem;
+        m_pContext = pContext;
+        m_nItems = nItems;
+        m_nNextItem = 0;
+        m_nWake = nWake;
+        m_nBusy = nWake;
+        m_nJob++;
+    }
+    m_Start.notify_all();
+
+    RunItems( 0 );
+
+    {
+        std::unique_lock <std::mutex> Lock( m_Mutex );
+        while( m_nBusy > 0 )
+            m_Done.wait( Lock );
+    }
+
+    m_bRunning = false;
+}
+
+
+//--------------------------------------------------------------------------------------
+CDXUTWorkerPool* WINAPI DXUTGetWorkerPool()
+{
+    static CDXUTWorkerPool s_Pool;
+    static std::once_flag s_Created;
+    std::call_once( s_Created, []() { s_Pool.Create(); } );
+    return &s_Pool;
+}
+
+
+//--------------------------------------------------------------------------------------
+double WINAPI DXUTGetMilliseconds()
+{
+    using namespace std::chrono;
+    return duration <double, std::milli>( steady_clock::now().time_since_epoch() ).count();
+}
@@ -0,0 +1,104 @@
+//--------------------------------------------------------------------------------------
+// File: DXUTWorkerPool.h
+//
+// A pool of worker threads for splitting CPU work into items.  The thread calling Run
+// works on the items too, and Run returns once every item is done.  DXUTGetWorkerPool
+// returns a pool shared by everything in a process, with a thread per processor.
+//
+// Only the C++ library is used, so this builds without DXUT.h and off Windows; the few
+// Win32 types it uses are defined here when windows.h isn't available.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#pragma once
+#ifndef DXUT_WORKERPOOL_H
+#define DXUT_WORKERPOOL_H
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+typedef unsigned int UINT;
+typedef unsigned int DWORD;
+typedef int LONG;
+typedef unsigned char BYTE;
+typedef unsigned long long ULONGLONG;
+typedef int HRESULT;
+#define WINAPI
+#define S_OK            ( ( HRESULT )0L )
+#define S_FALSE         ( ( HRESULT )1L )
+#define E_FAIL          ( ( HRESULT )0x80004005L )
+#define E_INVALIDARG    ( ( HRESULT )0x80070057L )
+#define E_OUTOFMEMORY   ( ( HRESULT )0x8007000EL )
+#define SUCCEEDED(hr)   ( ( HRESULT )( hr ) >= 0 )
+#define FAILED(hr)      ( ( HRESULT )( hr ) < 0 )
+#endif
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#define DXUT_WORKER_POOL_MAX_THREADS    64
+
+// Does item iItem.  iThread is 0 on the thread that called Run and 1 to nMaxThreads - 1
+// on the workers, and no two threads of the same Run share one, so it can pick
+// per-thread scratch memory or accumulators.
+typedef void ( *LPDXUTWORKITEM )( void* pContext, UINT iItem, UINT iThread );
+
+
+//--------------------------------------------------------------------------------------
+class CDXUTWorkerPool
+{
+public:
+                        CDXUTWorkerPool();
+                        ~CDXUTWorkerPool();
+
+    // nThreads counts the thread calling Run; 0 uses a thread for each processor.  Fewer
+    // are used if some can't be started.
+    HRESULT             Create( UINT nThreads = 0 );
+    void                Destroy();
+
+    // Runs pfnItem for items 0 to nItems - 1 on up to nMaxThreads threads (0 for all of
+    // them) and returns when all are done.  If the pool is already running items, as
+    // when Run is called from inside an item or from two threads at once, the items are
+    // done on the calling thread alone, as thread 0.
+    void                Run( LPDXUTWORKITEM pfnItem, void* pContext, UINT nItems, UINT nMaxThreads = 0 );
+
+    // Threads Run can use, counting the caller
+    UINT                GetNumThreads() const
+    {
+        return m_nWorkers + 1;
+    }
+
+    static UINT         GetNumProcessors();
+
+protected:
+    void                WorkerProc( UINT iThread, ULONGLONG nJob );
+    void                RunItems( UINT iThread );
+
+    std::thread         m_aWorkers[DXUT_WORKER_POOL_MAX_THREADS - 1];
+    UINT                m_nWorkers;
+
+    std::mutex          m_Mutex;
+    std::condition_variable m_Start;
+    std::condition_variable m_Done;
+    std::atomic <bool>  m_bRunning;
+    bool                m_bQuit;
+    ULONGLONG           m_nJob;             // Counts Runs, so workers see each one once
+    UINT                m_nWake;            // Workers taking part in the current Run
+    UINT                m_nBusy;            // Workers still in it
+
+    LPDXUTWORKITEM      m_pfnItem;
+    void*               m_pContext;
+    UINT                m_nItems;
+    std::atomic <UINT>  m_nNextItem;
+};
+
+CDXUTWorkerPool* WINAPI DXUTGetWorkerPool();
+
+// Milliseconds on a clock that only goes forwards, for timing work the same way on
+// every platform
+double WINAPI DXUTGetMilliseconds();
+
+#endif
@@ -2132,7 +2132,9 @@ HRESULT CDXUTDialog::DrawRect10( RECT* pRect, D3DCOLOR color )
 //--------------------------------------------------------------------------------------
 HRESULT CDXUTDialog::DrawPolyLine( POINT* apPoints, UINT nNumPoints, D3DCOLOR color )
 {
-    DXUT_SCREEN_VERTEX* vertices = new DXUT_SCREEN_VERTEX[ nNumPoints ];
+    // The vertices only live until DrawPrimitiveUP has copied them
+    CDXUTScratchScope Scratch;
+    DXUT_SCREEN_VERTEX* vertices = ( DXUT_SCREEN_VERTEX* )Scratch.Allocate( nNumPoints * sizeof( DXUT_SCREEN_VERTEX ) );
     if( vertices == NULL )
         return E_OUTOFMEMORY;
 
@@ -2172,7 +2174,6 @@ HRESULT CDXUTDialog::DrawPolyLine( POINT* apPoints, UINT nNumPoints, D3DCOLOR co
     pd3dDevice->SetVertexDeclaration( pDecl );
     pDecl->Release();
 
-    SAFE_DELETE_ARRAY( vertices );
     return S_OK;
 }
 
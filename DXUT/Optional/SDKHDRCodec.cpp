@@ -0,0 +1,949 @@
+//--------------------------------------------------------------------------------------
+// File: SDKHDRCodec.cpp
+//
+// Encodes and decodes the integer HDR texture formats used by the HDRFormats samples
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "SDKHDRCodec.h"
+#include "DXUTWorkerPool.h"
+#include <math.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define HDRCODEC_SSE
+#endif
+
+// Rows handed to a thread at a time
+#define HDR_BLOCK_ROWS          16
+
+// Texels converted from half to float at a time while encoding a row
+#define HDR_CHUNK_TEXELS        256
+
+#define HDR_HALF_MAX            65504.0f
+#define HDR_RGB9E5_MAX          65408.0f
+
+// Adding 0.5 lines a float below the smallest normal half up so that its low bits are
+// the half, rounded
+#define HDR_HALF_DENORM_MAGIC   ( 126 << 23 )
+
+// Rebiases the exponent from float to half and adds just under half an ulp
+#define HDR_HALF_NORMAL_BIAS    ( 0xfff - ( 112 << 23 ) )
+
+typedef void ( *LPHDRENCODEROW )( void* pDest, const float* pSrc, UINT Width );
+typedef void ( *LPHDRDECODEROW )( float* pDest, const void* pSrc, UINT Width );
+
+struct HDR_JOB
+{
+    const DXUT_HDR_SURFACE* pSurfaces;
+    UINT nSurfaces;
+    UINT nBlocks;
+    UINT TexelSize;
+    LPHDRENCODEROW pfnEncode;   // NULL when decoding
+    LPHDRDECODEROW pfnDecode;
+    DWORD dwFlags;
+};
+
+// sRGB primaries to CIE XYZ, and back
+static const float g_RGBToXYZ[3][3] =
+{
+    { 0.4124f, 0.3576f, 0.1805f },
+    { 0.2126f, 0.7152f, 0.0722f },
+    { 0.0193f, 0.1192f, 0.9505f },
+};
+
+static const float g_XYZToRGB[3][3] =
+{
+    {  3.2406f, -1.5372f, -0.4986f },
+    { -0.9689f,  1.8758f,  0.0415f },
+    {  0.0557f, -0.2040f,  1.0570f },
+};
+
+
+//--------------------------------------------------------------------------------------
+// Scalar conversions.  The SSE2 versions below do exactly the same operations on four
+// values at once, so both give the same bits.
+//--------------------------------------------------------------------------------------
+static inline UINT FloatBits( float f )
+{
+    UINT Bits;
+    memcpy( &Bits, &f, sizeof( UINT ) );
+    return Bits;
+}
+
+static inline float BitsFloat( UINT Bits )
+{
+    float f;
+    memcpy( &f, &Bits, sizeof( float ) );
+    return f;
+}
+
+// Negative and NaN give 0
+static inline float Sanitize( float c )
+{
+    c = ( c > 0.0f ) ? c : 0.0f;
+    return ( c < HDR_HALF_MAX ) ? c : HDR_HALF_MAX;
+}
+
+static inline float Max3( float a, float b, float c )
+{
+    float m = ( a > b ) ? a : b;
+    return ( m > c ) ? m : c;
+}
+
+//--------------------------------------------------------------------------------------
+// Moves the half's exponent and mantissa into place in a float and corrects the
+// exponent bias with a multiply, which also normalizes denormals.  Inf and NaN get all
+// the exponent bits set.
+//--------------------------------------------------------------------------------------
+static inline float HalfToFloat( WORD h )
+{
+    UINT ExpMant = h & 0x7fff;
+    UINT Bits = FloatBits( BitsFloat( ExpMant << 13 ) * BitsFloat( ( 254 - 15 ) << 23 ) );
+    if( ExpMant > 0x7bff )
+        Bits |= 255 << 23;
+    return BitsFloat( Bits | ( ( UINT )( h & 0x8000 ) << 16 ) );
+}
+
+//--------------------------------------------------------------------------------------
+static inline WORD FloatToHalf( float f )
+{
+    UINT Bits = FloatBits( f );
+    UINT Sign = Bits & 0x80000000;
+    Bits ^= Sign;
+
+    UINT h;
+    if( Bits >= ( 127 + 16 ) << 23 )
+    {
+        // Too big for a half, Inf or NaN
+        h = ( Bits > ( 255 << 23 ) ) ? 0x7e00 : 0x7c00;
+    }
+    else if( Bits < ( 127 - 14 ) << 23 )
+    {
+        // Denormal or zero, rounded by the float add
+        h = FloatBits( BitsFloat( Bits ) + BitsFloat( HDR_HALF_DENORM_MAGIC ) ) - HDR_HALF_DENORM_MAGIC;
+    }
+    else
+    {
+        // Round to nearest, ties to even
+        UINT MantOdd = ( Bits >> 13 ) & 1;
+        h = ( Bits + ( UINT )HDR_HALF_NORMAL_BIAS + MantOdd ) >> 13;
+    }
+
+    return ( WORD )( h | ( Sign >> 16 ) );
+}
+
+//--------------------------------------------------------------------------------------
+// RGBE8: the exponent is that of the largest component rounded up, found from the float
+// bits, so the largest mantissa is at most 255
+//--------------------------------------------------------------------------------------
+static inline UINT EncodeRGBE8Texel( const float* pSrc, bool bBGRA )
+{
+    float r = Sanitize( pSrc[0] );
+    float g = Sanitize( pSrc[1] );
+    float b = Sanitize( pSrc[2] );
+
+    UINT MaxBits = FloatBits( Max3( r, g, b ) );
+    int nExp = ( int )( MaxBits >> 23 ) - 127 + ( ( MaxBits & 0x7fffff ) ? 1 : 0 );
+    float fScale = BitsFloat( ( UINT )( 127 - nExp ) << 23 );
+
+    UINT R = ( UINT )( r * fScale * 255.0f + 0.5f );
+    UINT G = ( UINT )( g * fScale * 255.0f + 0.5f );
+    UINT B = ( UINT )( b * fScale * 255.0f + 0.5f );
+    UINT E = ( UINT )( nExp + 128 );
+
+    return bBGRA ? ( B | ( G << 8 ) | ( R << 16 ) | ( E << 24 ) ) :
+                   ( R | ( G << 8 ) | ( B << 16 ) | ( E << 24 ) );
+}
+
+static inline void DecodeRGBE8Texel( float* pDest, UINT Bits, bool bBGRA )
+{
+    UINT E = Bits >> 24;
+    float fScale = BitsFloat( ( E > 1 ) ? ( E - 1 ) << 23 : 0 );
+    float r = ( float )( ( Bits >> ( bBGRA ? 16 : 0 ) ) & 0xff );
+    float g = ( float )( ( Bits >> 8 ) & 0xff );
+    float b = ( float )( ( Bits >> ( bBGRA ? 0 : 16 ) ) & 0xff );
+
+    pDest[0] = r * ( 1.0f / 255.0f ) * fScale;
+    pDest[1] = g * ( 1.0f / 255.0f ) * fScale;
+    pDest[2] = b * ( 1.0f / 255.0f ) * fScale;
+    pDest[3] = 1.0f;
+}
+
+//--------------------------------------------------------------------------------------
+static inline UINT EncodeUNorm16( float c )
+{
+    float f = Sanitize( c ) * ( 65535.0f / DXUT_HDR_RGB16_MAX );
+    f = ( f < 65535.0f ) ? f : 65535.0f;
+    return ( UINT )( f + 0.5f );
+}
+
+//--------------------------------------------------------------------------------------
+// RGB9E5 as the DXGI spec describes it, with the exponent of the largest component
+// rounded down and then bumped if its mantissa rounds up to 512
+//--------------------------------------------------------------------------------------
+static inline UINT EncodeRGB9E5Texel( const float* pSrc )
+{
+    float r = Sanitize( pSrc[0] );
+    float g = Sanitize( pSrc[1] );
+    float b = Sanitize( pSrc[2] );
+    r = ( r < HDR_RGB9E5_MAX ) ? r : HDR_RGB9E5_MAX;
+    g = ( g < HDR_RGB9E5_MAX ) ? g : HDR_RGB9E5_MAX;
+    b = ( b < HDR_RGB9E5_MAX ) ? b : HDR_RGB9E5_MAX;
+
+    float fMax = Max3( r, g, b );
+    int nExp = ( int )( FloatBits( fMax ) >> 23 ) - 127;
+    nExp = ( ( nExp > -16 ) ? nExp : -16 ) + 16;
+    float fScale = BitsFloat( ( UINT )( 151 - nExp ) << 23 );
+
+    if( ( UINT )( fMax * fScale + 0.5f ) == 512 )
+    {
+        nExp++;
+        fScale *= 0.5f;
+    }
+
+    UINT R = ( UINT )( r * fScale + 0.5f );
+    UINT G = ( UINT )( g * fScale + 0.5f );
+    UINT B = ( UINT )( b * fScale + 0.5f );
+
+    return R | ( G << 9 ) | ( B << 18 ) | ( ( UINT )nExp << 27 );
+}
+
+static inline void DecodeRGB9E5Texel( float* pDest, UINT Bits )
+{
+    float fScale = BitsFloat( ( ( Bits >> 27 ) + 103 ) << 23 );
+    pDest[0] = ( float )( Bits & 0x1ff ) * fScale;
+    pDest[1] = ( float )( ( Bits >> 9 ) & 0x1ff ) * fScale;
+    pDest[2] = ( float )( ( Bits >> 18 ) & 0x1ff ) * fScale;
+    pDest[3] = 1.0f;
+}
+
+//--------------------------------------------------------------------------------------
+// LogLuv32: log2 of the luminance in 8.8 fixed point biased by 64, and the CIE 1976
+// u' v' chromaticity scaled by 410.  Black keeps the chromaticity of white.
+//--------------------------------------------------------------------------------------
+static inline UINT EncodeLogL( float Y )
+{
+    if( !( Y > 0.0f ) )
+        return 0;
+
+    float fLe = 256.0f * ( log2f( Y ) + 64.0f );
+    fLe = ( fLe > 1.0f ) ? fLe : 1.0f;
+    fLe = ( fLe < 32767.0f ) ? fLe : 32767.0f;
+    return ( UINT )fLe;
+}
+
+static inline UINT EncodeUV( float uv )
+{
+    UINT n = ( UINT )( 410.0f * uv );
+    return ( n < 255 ) ? n : 255;
+}
+
+static inline UINT EncodeLogLuvTexel( const float* pSrc )
+{
+    float r = Sanitize( pSrc[0] );
+    float g = Sanitize( pSrc[1] );
+    float b = Sanitize( pSrc[2] );
+
+    float X = g_RGBToXYZ[0][0] * r + g_RGBToXYZ[0][1] * g + g_RGBToXYZ[0][2] * b;
+    float Y = g_RGBToXYZ[1][0] * r + g_RGBToXYZ[1][1] * g + g_RGBToXYZ[1][2] * b;
+    float Z = g_RGBToXYZ[2][0] * r + g_RGBToXYZ[2][1] * g + g_RGBToXYZ[2][2] * b;
+
+    float fDen = X + 15.0f * Y + 3.0f * Z;
+    float u = 4.0f / 19.0f;
+    float v = 9.0f / 19.0f;
+    if( fDen > 0.0f )
+    {
+        u = 4.0f * X / fDen;
+        v = 9.0f * Y / fDen;
+    }
+
+    return ( EncodeLogL( Y ) << 16 ) | ( EncodeUV( u ) << 8 ) | EncodeUV( v );
+}
+
+static inline void DecodeLogLuvTexel( float* pDest, UINT Bits )
+{
+    UINT Le = ( Bits >> 16 ) & 0x7fff;
+    pDest[3] = 1.0f;
+    if( 0 == Le )
+    {
+        pDest[0] = pDest[1] = pDest[2] = 0.0f;
+        return;
+    }
+
+    float Y = exp2f( ( ( float )Le + 0.5f ) / 256.0f - 64.0f );
+    float u = ( ( float )( ( Bits >> 8 ) & 0xff ) + 0.5f ) / 410.0f;
+    float v = ( ( float )( Bits & 0xff ) + 0.5f ) / 410.0f;
+
+    // u' v' to x y, then to X and Z for this Y
+    float fDen = 6.0f * u - 16.0f * v + 12.0f;
+    float x = 9.0f * u / fDen;
+    float y = 4.0f * v / fDen;
+    float X = x / y * Y;
+    float Z = ( 1.0f - x - y ) / y * Y;
+
+    for( int i = 0; i < 3; i++ )
+    {
+        float c = g_XYZToRGB[i][0] * X + g_XYZToRGB[i][1] * Y + g_XYZToRGB[i][2] * Z;
+        pDest[i] = ( c > 0.0f ) ? c : 0.0f;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Scalar rows
+//--------------------------------------------------------------------------------------
+static void EncodeRowRGBE8( void* pDest, const float* pSrc, UINT Width )
+{
+    UINT* pTexels = ( UINT* )pDest;
+    for( UINT x = 0; x < Width; x++, pSrc += 4 )
+        pTexels[x] = EncodeRGBE8Texel( pSrc, false );
+}
+
+static void EncodeRowBGRE8( void* pDest, const float* pSrc, UINT Width )
+{
+    UINT* pTexels = ( UINT* )pDest;
+    for( UINT x = 0; x < Width; x++, pSrc += 4 )
+        pTexels[x] = EncodeRGBE8Texel( pSrc, true );
+}
+
+static void EncodeRowRGB16( void* pDest, const float* pSrc, UINT Width )
+{
+    WORD* pTexels = ( WORD* )pDest;
+    for( UINT x = 0; x < Width; x++, pSrc += 4, pTexels += 4 )
+    {
+        pTexels[0] = ( WORD )EncodeUNorm16( pSrc[0] );
+        pTexels[1] = ( WORD )EncodeUNorm16( pSrc[1] );
+        pTexels[2] = ( WORD )EncodeUNorm16( pSrc[2] );
+        pTexels[3] = 0;
+    }
+}
+
+static void EncodeRowRGB9E5( void* pDest, const float* pSrc, UINT Width )
+{
+    UINT* pTexels = ( UINT* )pDest;
+    for( UINT x = 0; x < Width; x++, pSrc += 4 )
+        pTexels[x] = EncodeRGB9E5Texel( pSrc );
+}
+
+static void EncodeRowLogLuv( void* pDest, const float* pSrc, UINT Width )
+{
+    UINT* pTexels = ( UINT* )pDest;
+    for( UINT x = 0; x < Width; x++, pSrc += 4 )
+        pTexels[x] = EncodeLogLuvTexel( pSrc );
+}
+
+static void DecodeRowRGBE8( float* pDest, const void* pSrc, UINT Width )
+{
+    const UINT* pTexels = ( const UINT* )pSrc;
+    for( UINT x = 0; x < Width; x++, pDest += 4 )
+        DecodeRGBE8Texel( pDest, pTexels[x], false );
+}
+
+static void DecodeRowBGRE8( float* pDest, const void* pSrc, UINT Width )
+{
+    const UINT* pTexels = ( const UINT* )pSrc;
+    for( UINT x = 0; x < Width; x++, pDest += 4 )
+        DecodeRGBE8Texel( pDest, pTexels[x], true );
+}
+
+static void DecodeRowRGB16( float* pDest, const void* pSrc, UINT Width )
+{
+    const WORD* pTexels = ( const WORD* )pSrc;
+    const float fScale = DXUT_HDR_RGB16_MAX / 65535.0f;
+    for( UINT x = 0; x < Width; x++, pDest += 4, pTexels += 4 )
+    {
+        pDest[0] = ( float )pTexels[0] * fScale;
+        pDest[1] = ( float )pTexels[1] * fScale;
+        pDest[2] = ( float )pTexels[2] * fScale;
+        pDest[3] = 1.0f;
+    }
+}
+
+static void DecodeRowRGB9E5( float* pDest, const void* pSrc, UINT Width )
+{
+    const UINT* pTexels = ( const UINT* )pSrc;
+    for( UINT x = 0; x < Width; x++, pDest += 4 )
+        DecodeRGB9E5Texel( pDest, pTexels[x] );
+}
+
+static void DecodeRowLogLuv( float* pDest, const void* pSrc, UINT Width )
+{
+    const UINT* pTexels = ( const UINT* )pSrc;
+    for( UINT x = 0; x < Width; x++, pDest += 4 )
+        DecodeLogLuvTexel( pDest, pTexels[x] );
+}
+
+
+#ifdef HDRCODEC_SSE
+//--------------------------------------------------------------------------------------
+// SSE2 rows, four texels at a time.  Each leaves the texels that don't make up a group
+// of four to the scalar row.
+//--------------------------------------------------------------------------------------
+static inline __m128i Select( __m128i Mask, __m128i a, __m128i b )
+{
+    return _mm_or_si128( _mm_and_si128( Mask, a ), _mm_andnot_si128( Mask, b ) );
+}
+
+static inline __m128 Select( __m128 Mask, __m128 a, __m128 b )
+{
+    return _mm_or_ps( _mm_and_ps( Mask, a ), _mm_andnot_ps( Mask, b ) );
+}
+
+// h holds a half in the low 16 bits of each lane
+static inline __m128 HalfToFloat4( __m128i h )
+{
+    const __m128i ExpMant = _mm_and_si128( h, _mm_set1_epi32( 0x7fff ) );
+    const __m128 Scaled = _mm_mul_ps( _mm_castsi128_ps( _mm_slli_epi32( ExpMant, 13 ) ),
+                                      _mm_castsi128_ps( _mm_set1_epi32( ( 254 - 15 ) << 23 ) ) );
+    const __m128i InfNaN = _mm_and_si128( _mm_cmpgt_epi32( ExpMant, _mm_set1_epi32( 0x7bff ) ),
+                                          _mm_set1_epi32( 255 << 23 ) );
+    const __m128i Sign = _mm_slli_epi32( _mm_xor_si128( h, ExpMant ), 16 );
+    return _mm_or_ps( Scaled, _mm_castsi128_ps( _mm_or_si128( Sign, InfNaN ) ) );
+}
+
+// Returns the halves sign extended to 32 bits, ready for _mm_packs_epi32
+static inline __m128i FloatToHalf4( __m128 f )
+{
+    const __m128i Bits = _mm_castps_si128( f );
+    const __m128i Sign = _mm_and_si128( Bits, _mm_set1_epi32( 0x80000000 ) );
+    const __m128i Abs = _mm_xor_si128( Bits, Sign );
+
+    const __m128i IsNaN = _mm_cmpgt_epi32( Abs, _mm_set1_epi32( 255 << 23 ) );
+    const __m128i Special = _mm_or_si128( _mm_and_si128( IsNaN, _mm_set1_epi32( 0x200 ) ), _mm_set1_epi32( 0x7c00 ) );
+
+    const __m128i Magic = _mm_set1_epi32( HDR_HALF_DENORM_MAGIC );
+    const __m128i Denorm = _mm_sub_epi32( _mm_castps_si128( _mm_add_ps( _mm_castsi128_ps( Abs ),
+                                                                        _mm_castsi128_ps( Magic ) ) ), Magic );
+
+    const __m128i MantOdd = _mm_and_si128( _mm_srli_epi32( Abs, 13 ), _mm_set1_epi32( 1 ) );
+    const __m128i Normal = _mm_srli_epi32( _mm_add_epi32( _mm_add_epi32( Abs, _mm_set1_epi32( HDR_HALF_NORMAL_BIAS ) ),
+                                                          MantOdd ), 13 );
+
+    const __m128i IsDenorm = _mm_cmpgt_epi32( _mm_set1_epi32( ( 127 - 14 ) << 23 ), Abs );
+    const __m128i IsRegular = _mm_cmpgt_epi32( _mm_set1_epi32( ( 127 + 16 ) << 23 ), Abs );
+    const __m128i h = Select( IsRegular, Select( IsDenorm, Denorm, Normal ), Special );
+
+    return _mm_or_si128( h, _mm_srai_epi32( Sign, 16 ) );
+}
+
+//--------------------------------------------------------------------------------------
+// Loads four RGBA texels as vectors of R, G and B, sanitized
+//--------------------------------------------------------------------------------------
+static inline void LoadRGB4( const float* pSrc, __m128* pR, __m128* pG, __m128* pB )
+{
+    __m128 t0 = _mm_loadu_ps( pSrc );
+    __m128 t1 = _mm_loadu_ps( pSrc + 4 );
+    __m128 t2 = _mm_loadu_ps( pSrc + 8 );
+    __m128 t3 = _mm_loadu_ps( pSrc + 12 );
+    _MM_TRANSPOSE4_PS( t0, t1, t2, t3 );
+
+    // maxps returns its second operand for NaN
+    const __m128 Zero = _mm_setzero_ps();
+    const __m128 HalfMax = _mm_set1_ps( HDR_HALF_MAX );
+    *pR = _mm_min_ps( _mm_max_ps( t0, Zero ), HalfMax );
+    *pG = _mm_min_ps( _mm_max_ps( t1, Zero ), HalfMax );
+    *pB = _mm_min_ps( _mm_max_ps( t2, Zero ), HalfMax );
+}
+
+// Stores four texels from vectors of R, G and B with alpha 1
+static inline void StoreRGB4( float* pDest, __m128 r, __m128 g, __m128 b )
+{
+    __m128 a = _mm_set1_ps( 1.0f );
+    _MM_TRANSPOSE4_PS( r, g, b, a );
+    _mm_storeu_ps( pDest, r );
+    _mm_storeu_ps( pDest + 4, g );
+    _mm_storeu_ps( pDest + 8, b );
+    _mm_storeu_ps( pDest + 12, a );
+}
+
+static inline __m128i RoundToInt( __m128 f )
+{
+    return _mm_cvttps_epi32( _mm_add_ps( f, _mm_set1_ps( 0.5f ) ) );
+}
+
+//--------------------------------------------------------------------------------------
+static inline void EncodeRowSharedExp8_SSE( void* pDest, const float* pSrc, UINT Width, bool bBGRA )
+{
+    UINT* pTexels = ( UINT* )pDest;
+    const __m128i MantMask = _mm_set1_epi32( 0x7fffff );
+    const __m128 k255 = _mm_set1_ps( 255.0f );
+
+    UINT x = 0;
+    for( ; x + 4 <= Width; x += 4, pSrc += 16 )
+    {
+        __m128 r, g, b;
+        LoadRGB4( pSrc, &r, &g, &b );
+
+        // The compare gives -1 where the mantissa is 0, taking back the 1 added to round up
+        const __m128i MaxBits = _mm_castps_si128( _mm_max_ps( _mm_max_ps( r, g ), b ) );
+        const __m128i MantZero = _mm_cmpeq_epi32( _mm_and_si128( MaxBits, MantMask ), _mm_setzero_si128() );
+        const __m128i Exp = _mm_add_epi32( _mm_sub_epi32( _mm_srli_epi32( MaxBits, 23 ), _mm_set1_epi32( 126 ) ),
+                                           MantZero );
+        const __m128 Scale = _mm_castsi128_ps( _mm_slli_epi32( _mm_sub_epi32( _mm_set1_epi32( 127 ), Exp ), 23 ) );
+
+        __m128i R = RoundToInt( _mm_mul_ps( _mm_mul_ps( r, Scale ), k255 ) );
+        const __m128i G = RoundToInt( _mm_mul_ps( _mm_mul_ps( g, Scale ), k255 ) );
+        __m128i B = RoundToInt( _mm_mul_ps( _mm_mul_ps( b, Scale ), k255 ) );
+        const __m128i E = _mm_add_epi32( Exp, _mm_set1_epi32( 128 ) );
+        if( bBGRA )
+        {
+            const __m128i Temp = R;
+            R = B;
+            B = Temp;
+        }
+
+        __m128i Packed = _mm_or_si128( R, _mm_slli_epi32( G, 8 ) );
+        Packed = _mm_or_si128( Packed, _mm_slli_epi32( B, 16 ) );
+        Packed = _mm_or_si128( Packed, _mm_slli_epi32( E, 24 ) );
+        _mm_storeu_si128( ( __m128i* )( pTexels + x ), Packed );
+    }
+
+    if( bBGRA )
+        EncodeRowBGRE8( pTexels + x, pSrc, Width - x );
+    else
+        EncodeRowRGBE8( pTexels + x, pSrc, Width - x );
+}
+
+static void EncodeRowRGBE8_SSE( void* pDest, const float* pSrc, UINT Width )
+{
+    EncodeRowSharedExp8_SSE( pDest, pSrc, Width, false );
+}
+
+static void EncodeRowBGRE8_SSE( void* pDest, const float* pSrc, UINT Width )
+{
+    EncodeRowSharedExp8_SSE( pDest, pSrc, Width, true );
+}
+
+//--------------------------------------------------------------------------------------
+static void EncodeRowRGB16_SSE( void* pDest, const float* pSrc, UINT Width )
+{
+    WORD* pTexels = ( WORD* )pDest;
+    const __m128 Scale = _mm_set1_ps( 65535.0f / DXUT_HDR_RGB16_MAX );
+    const __m128 Max = _mm_set1_ps( 65535.0f );
+
+    UINT x = 0;
+    for( ; x + 4 <= Width; x += 4, pSrc += 16 )
+    {
+        __m128 r, g, b;
+        LoadRGB4( pSrc, &r, &g, &b );
+
+        const __m128i R = RoundToInt( _mm_min_ps( _mm_mul_ps( r, Scale ), Max ) );
+        const __m128i G = RoundToInt( _mm_min_ps( _mm_mul_ps( g, Scale ), Max ) );
+        const __m128i B = RoundToInt( _mm_min_ps( _mm_mul_ps( b, Scale ), Max ) );
+
+        // Each texel is the dword R | G << 16 followed by the dword B with alpha 0
+        const __m128i RG = _mm_or_si128( R, _mm_slli_epi32( G, 16 ) );
+        _mm_storeu_si128( ( __m128i* )( pTexels + x * 4 ), _mm_unpacklo_epi32( RG, B ) );
+        _mm_storeu_si128( ( __m128i* )( pTexels + x * 4 + 8 ), _mm_unpackhi_epi32( RG, B ) );
+    }
+
+    EncodeRowRGB16( pTexels + x * 4, pSrc, Width - x );
+}
+
+//--------------------------------------------------------------------------------------
+static void EncodeRowRGB9E5_SSE( void* pDest, const float* pSrc, UINT Width )
+{
+    UINT* pTexels = ( UINT* )pDest;
+    const __m128 Max = _mm_set1_ps( HDR_RGB9E5_MAX );
+    const __m128i MinExp = _mm_set1_epi32( -16 );
+
+    UINT x = 0;
+    for( ; x + 4 <= Width; x += 4, pSrc += 16 )
+    {
+        __m128 r, g, b;
+        LoadRGB4( pSrc, &r, &g, &b );
+        r = _mm_min_ps( r, Max );
+        g = _mm_min_ps( g, Max );
+        b = _mm_min_ps( b, Max );
+
+        const __m128 MaxRGB = _mm_max_ps( _mm_max_ps( r, g ), b );
+        __m128i Exp = _mm_sub_epi32( _mm_srli_epi32( _mm_castps_si128( MaxRGB ), 23 ), _mm_set1_epi32( 127 ) );
+        Exp = _mm_add_epi32( Select( _mm_cmpgt_epi32( Exp, MinExp ), Exp, MinExp ), _mm_set1_epi32( 16 ) );
+        __m128i ScaleBits = _mm_slli_epi32( _mm_sub_epi32( _mm_set1_epi32( 151 ), Exp ), 23 );
+
+        // -1 where the largest mantissa rounds to 512
+        const __m128i Bump = _mm_cmpeq_epi32( RoundToInt( _mm_mul_ps( MaxRGB, _mm_castsi128_ps( ScaleBits ) ) ),
+                                              _mm_set1_epi32( 512 ) );
+        Exp = _mm_sub_epi32( Exp, Bump );
+        ScaleBits = _mm_add_epi32( ScaleBits, _mm_slli_epi32( Bump, 23 ) );
+        const __m128 Scale = _mm_castsi128_ps( ScaleBits );
+
+        const __m128i R = RoundToInt( _mm_mul_ps( r, Scale ) );
+        const __m128i G = RoundToInt( _mm_mul_ps( g, Scale ) );
+        const __m128i B = RoundToInt( _mm_mul_ps( b, Scale ) );
+
+        __m128i Packed = _mm_or_si128( R, _mm_slli_epi32( G, 9 ) );
+        Packed = _mm_or_si128( Packed, _mm_slli_epi32( B, 18 ) );
+        Packed = _mm_or_si128( Packed, _mm_slli_epi32( Exp, 27 ) );
+        _mm_storeu_si128( ( __m128i* )( pTexels + x ), Packed );
+    }
+
+    EncodeRowRGB9E5( pTexels + x, pSrc, Width - x );
+}
+
+//--------------------------------------------------------------------------------------
+// The log of the luminance is taken one lane at a time
+//--------------------------------------------------------------------------------------
+static void EncodeRowLogLuv_SSE( void* pDest, const float* pSrc, UINT Width )
+{
+    UINT* pTexels = ( UINT* )pDest;
+    const __m128 Zero = _mm_setzero_ps();
+    const __m128 k410 = _mm_set1_ps( 410.0f );
+    const __m128i k255 = _mm_set1_epi32( 255 );
+
+    UINT x = 0;
+    for( ; x + 4 <= Width; x += 4, pSrc += 16 )
+    {
+        __m128 r, g, b;
+        LoadRGB4( pSrc, &r, &g, &b );
+
+        __m128 XYZ[3];
+        for( int i = 0; i < 3; i++ )
+        {
+            XYZ[i] = _mm_add_ps( _mm_add_ps( _mm_mul_ps( _mm_set1_ps( g_RGBToXYZ[i][0] ), r ),
+                                             _mm_mul_ps( _mm_set1_ps( g_RGBToXYZ[i][1] ), g ) ),
+                                 _mm_mul_ps( _mm_set1_ps( g_RGBToXYZ[i][2] ), b ) );
+        }
+
+        const __m128 Den = _mm_add_ps( _mm_add_ps( XYZ[0], _mm_mul_ps( _mm_set1_ps( 15.0f ), XYZ[1] ) ),
+                                       _mm_mul_ps( _mm_set1_ps( 3.0f ), XYZ[2] ) );
+        const __m128 HasColor = _mm_cmpgt_ps( Den, Zero );
+        const __m128 u = Select( HasColor, _mm_div_ps( _mm_mul_ps( _mm_set1_ps( 4.0f ), XYZ[0] ), Den ),
+                                 _mm_set1_ps( 4.0f / 19.0f ) );
+        const __m128 v = Select( HasColor, _mm_div_ps( _mm_mul_ps( _mm_set1_ps( 9.0f ), XYZ[1] ), Den ),
+                                 _mm_set1_ps( 9.0f / 19.0f ) );
+
+        __m128i U = _mm_cvttps_epi32( _mm_mul_ps( k410, u ) );
+        __m128i V = _mm_cvttps_epi32( _mm_mul_ps( k410, v ) );
+        U = Select( _mm_cmpgt_epi32( U, k255 ), k255, U );
+        V = Select( _mm_cmpgt_epi32( V, k255 ), k255, V );
+
+        float afY[4];
+        _mm_storeu_ps( afY, XYZ[1] );
+        const __m128i L = _mm_set_epi32( ( int )EncodeLogL( afY[3] ), ( int )EncodeLogL( afY[2] ),
+                                         ( int )EncodeLogL( afY[1] ), ( int )EncodeLogL( afY[0] ) );
+
+        __m128i Packed = _mm_or_si128( _mm_slli_epi32( L, 16 ), _mm_slli_epi32( U, 8 ) );
+        Packed = _mm_or_si128( Packed, V );
+        _mm_storeu_si128( ( __m128i* )( pTexels + x ), Packed );
+    }
+
+    EncodeRowLogLuv( pTexels + x, pSrc, Width - x );
+}
+
+//--------------------------------------------------------------------------------------
+static inline void DecodeRowSharedExp8_SSE( float* pDest, const void* pSrc, UINT Width, bool bBGRA )
+{
+    const UINT* pTexels = ( const UINT* )pSrc;
+    const __m128i ByteMask = _mm_set1_epi32( 0xff );
+    const __m128i One = _mm_set1_epi32( 1 );
+    const __m128 InvMax = _mm_set1_ps( 1.0f / 255.0f );
+
+    UINT x = 0;
+    for( ; x + 4 <= Width; x += 4, pDest += 16 )
+    {
+        const __m128i Bits = _mm_loadu_si128( ( const __m128i* )( pTexels + x ) );
+
+        // Exponents of 0 and 1 both decode to 0
+        const __m128i E = _mm_srli_epi32( Bits, 24 );
+        const __m128i ScaleBits = _mm_slli_epi32( _mm_sub_epi32( E, One ), 23 );
+        const __m128 Scale = _mm_castsi128_ps( _mm_and_si128( _mm_cmpgt_epi32( E, One ), ScaleBits ) );
+
+        __m128 r = _mm_cvtepi32_ps( _mm_and_si128( Bits, ByteMask ) );
+        const __m128 g = _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( Bits, 8 ), ByteMask ) );
+        __m128 b = _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( Bits, 16 ), ByteMask ) );
+        if( bBGRA )
+        {
+            const __m128 Temp = r;
+            r = b;
+            b = Temp;
+        }
+
+        StoreRGB4( pDest, _mm_mul_ps( _mm_mul_ps( r, InvMax ), Scale ),
+                   _mm_mul_ps( _mm_mul_ps( g, InvMax ), Scale ),
+                   _mm_mul_ps( _mm_mul_ps( b, InvMax ), Scale ) );
+    }
+
+    if( bBGRA )
+        DecodeRowBGRE8( pDest, pTexels + x, Width - x );
+    else
+        DecodeRowRGBE8( pDest, pTexels + x, Width - x );
+}
+
+static void DecodeRowRGBE8_SSE( float* pDest, const void* pSrc, UINT Width )
+{
+    DecodeRowSharedExp8_SSE( pDest, pSrc, Width, false );
+}
+
+static void DecodeRowBGRE8_SSE( float* pDest, const void* pSrc, UINT Width )
+{
+    DecodeRowSharedExp8_SSE( pDest, pSrc, Width, true );
+}
+
+//--------------------------------------------------------------------------------------
+// Each texel unpacks to a whole vector, so alpha is scaled by 0 and has 1 added
+//--------------------------------------------------------------------------------------
+static void DecodeRowRGB16_SSE( float* pDest, const void* pSrc, UINT Width )
+{
+    const WORD* pTexels = ( const WORD* )pSrc;
+    const float fScale = DXUT_HDR_RGB16_MAX / 65535.0f;
+    const __m128 Scale = _mm_set_ps( 0.0f, fScale, fScale, fScale );
+    const __m128 Alpha = _mm_set_ps( 1.0f, 0.0f, 0.0f, 0.0f );
+    const __m128i Zero = _mm_setzero_si128();
+
+    UINT x = 0;
+    for( ; x + 2 <= Width; x += 2, pDest += 8 )
+    {
+        const __m128i Words = _mm_loadu_si128( ( const __m128i* )( pTexels + x * 4 ) );
+        _mm_storeu_ps( pDest, _mm_add_ps( _mm_mul_ps( _mm_cvtepi32_ps( _mm_unpacklo_epi16( Words, Zero ) ), Scale ),
+                                          Alpha ) );
+        _mm_storeu_ps( pDest + 4, _mm_add_ps( _mm_mul_ps( _mm_cvtepi32_ps( _mm_unpackhi_epi16( Words, Zero ) ), Scale ),
+                                              Alpha ) );
+    }
+
+    DecodeRowRGB16( pDest, pTexels + x * 4, Width - x );
+}
+
+//--------------------------------------------------------------------------------------
+static void DecodeRowRGB9E5_SSE( float* pDest, const void* pSrc, UINT Width )
+{
+    const UINT* pTexels = ( const UINT* )pSrc;
+    const __m128i MantMask = _mm_set1_epi32( 0x1ff );
+
+    UINT x = 0;
+    for( ; x + 4 <= Width; x += 4, pDest += 16 )
+    {
+        const __m128i Bits = _mm_loadu_si128( ( const __m128i* )( pTexels + x ) );
+        const __m128 Scale = _mm_castsi128_ps( _mm_slli_epi32( _mm_add_epi32( _mm_srli_epi32( Bits, 27 ),
+                                                                              _mm_set1_epi32( 103 ) ), 23 ) );
+
+        StoreRGB4( pDest, _mm_mul_ps( _mm_cvtepi32_ps( _mm_and_si128( Bits, MantMask ) ), Scale ),
+                   _mm_mul_ps( _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( Bits, 9 ), MantMask ) ), Scale ),
+                   _mm_mul_ps( _mm_cvtepi32_ps( _mm_and_si128( _mm_srli_epi32( Bits, 18 ), MantMask ) ), Scale ) );
+    }
+
+    DecodeRowRGB9E5( pDest, pTexels + x, Width - x );
+}
+#endif // HDRCODEC_SSE
+
+
+//--------------------------------------------------------------------------------------
+// Row functions for each format, plain and SSE2.  LogLuv decodes with a scalar exp2 a
+// texel at a time either way.
+//--------------------------------------------------------------------------------------
+#ifdef HDRCODEC_SSE
+static const LPHDRENCODEROW g_pfnEncodeRow[DXUT_HDR_NUM_FORMATS][2] =
+{
+    { EncodeRowRGBE8,  EncodeRowRGBE8_SSE },
+    { EncodeRowBGRE8,  EncodeRowBGRE8_SSE },
+    { EncodeRowRGB16,  EncodeRowRGB16_SSE },
+    { EncodeRowRGB9E5, EncodeRowRGB9E5_SSE },
+    { EncodeRowLogLuv, EncodeRowLogLuv_SSE },
+};
+
+static const LPHDRDECODEROW g_pfnDecodeRow[DXUT_HDR_NUM_FORMATS][2] =
+{
+    { DecodeRowRGBE8,  DecodeRowRGBE8_SSE },
+    { DecodeRowBGRE8,  DecodeRowBGRE8_SSE },
+    { DecodeRowRGB16,  DecodeRowRGB16_SSE },
+    { DecodeRowRGB9E5, DecodeRowRGB9E5_SSE },
+    { DecodeRowLogLuv, DecodeRowLogLuv },
+};
+#else
+static const LPHDRENCODEROW g_pfnEncodeRow[DXUT_HDR_NUM_FORMATS][2] =
+{
+    { EncodeRowRGBE8,  EncodeRowRGBE8 },
+    { EncodeRowBGRE8,  EncodeRowBGRE8 },
+    { EncodeRowRGB16,  EncodeRowRGB16 },
+    { EncodeRowRGB9E5, EncodeRowRGB9E5 },
+    { EncodeRowLogLuv, EncodeRowLogLuv },
+};
+
+static const LPHDRDECODEROW g_pfnDecodeRow[DXUT_HDR_NUM_FORMATS][2] =
+{
+    { DecodeRowRGBE8,  DecodeRowRGBE8 },
+    { DecodeRowBGRE8,  DecodeRowBGRE8 },
+    { DecodeRowRGB16,  DecodeRowRGB16 },
+    { DecodeRowRGB9E5, DecodeRowRGB9E5 },
+    { DecodeRowLogLuv, DecodeRowLogLuv },
+};
+#endif
+
+
+//--------------------------------------------------------------------------------------
+UINT WINAPI DXUTGetHDRTexelSize( DXUT_HDR_FORMAT Format )
+{
+    switch( Format )
+    {
+        case DXUT_HDR_RGBE8:
+        case DXUT_HDR_BGRE8:
+        case DXUT_HDR_RGB9E5:
+        case DXUT_HDR_LOGLUV32:
+            return sizeof( UINT );
+        case DXUT_HDR_RGB16:
+            return 4 * sizeof( WORD );
+    }
+    return 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+void WINAPI DXUTHalfToFloat( float* pDest, const WORD* pSrc, UINT Count, DWORD dwFlags )
+{
+    UINT i = 0;
+
+#ifdef HDRCODEC_SSE
+    if( !( dwFlags & DXUT_HDR_SCALAR ) )
+    {
+        const __m128i Zero = _mm_setzero_si128();
+        for( ; i + 8 <= Count; i += 8 )
+        {
+            const __m128i h = _mm_loadu_si128( ( const __m128i* )( pSrc + i ) );
+            _mm_storeu_ps( pDest + i, HalfToFloat4( _mm_unpacklo_epi16( h, Zero ) ) );
+            _mm_storeu_ps( pDest + i + 4, HalfToFloat4( _mm_unpackhi_epi16( h, Zero ) ) );
+        }
+    }
+#else
+    UNREFERENCED_PARAMETER( dwFlags );
+#endif
+
+    for( ; i < Count; i++ )
+        pDest[i] = HalfToFloat( pSrc[i] );
+}
+
+
+//--------------------------------------------------------------------------------------
+void WINAPI DXUTFloatToHalf( WORD* pDest, const float* pSrc, UINT Count, DWORD dwFlags )
+{
+    UINT i = 0;
+
+#ifdef HDRCODEC_SSE
+    if( !( dwFlags & DXUT_HDR_SCALAR ) )
+    {
+        for( ; i + 8 <= Count; i += 8 )
+        {
+            const __m128i h0 = FloatToHalf4( _mm_loadu_ps( pSrc + i ) );
+            const __m128i h1 = FloatToHalf4( _mm_loadu_ps( pSrc + i + 4 ) );
+            _mm_storeu_si128( ( __m128i* )( pDest + i ), _mm_packs_epi32( h0, h1 ) );
+        }
+    }
+#else
+    UNREFERENCED_PARAMETER( dwFlags );
+#endif
+
+    for( ; i < Count; i++ )
+        pDest[i] = FloatToHalf( pSrc[i] );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Converts rows iFirstRow to iFirstRow + nRows of a surface.  Encoding goes through a
+// float copy of a piece of the row small enough to stay in the L1 cache.
+//--------------------------------------------------------------------------------------
+static void ConvertRows( const HDR_JOB* pJob, const DXUT_HDR_SURFACE& Surface, UINT iFirstRow, UINT nRows )
+{
+    float afTexels[HDR_CHUNK_TEXELS * 4];
+
+    for( UINT y = iFirstRow; y < iFirstRow + nRows; y++ )
+    {
+        const BYTE* pSrc = ( const BYTE* )Surface.pSrc + ( SIZE_T )y * Surface.SrcPitch;
+        BYTE* pDest = ( BYTE* )Surface.pDest + ( SIZE_T )y * Surface.DestPitch;
+
+        if( !pJob->pfnEncode )
+        {
+            pJob->pfnDecode( ( float* )pDest, pSrc, Surface.Width );
+            continue;
+        }
+
+        for( UINT x = 0; x < Surface.Width; x += HDR_CHUNK_TEXELS )
+        {
+            UINT nTexels = min( ( UINT )HDR_CHUNK_TEXELS, Surface.Width - x );
+            DXUTHalfToFloat( afTexels, ( const WORD* )pSrc + x * 4, nTexels * 4, pJob->dwFlags );
+            pJob->pfnEncode( pDest + x * pJob->TexelSize, afTexels, nTexels );
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+static void HDRBlockProc( void* pContext, UINT iBlock, UINT iThread )
+{
+    UNREFERENCED_PARAMETER( iThread );
+    const HDR_JOB* pJob = ( const HDR_JOB* )pContext;
+
+    // Blocks are numbered through the surfaces in order
+    UINT iSurface = 0;
+    for( ; iSurface < pJob->nSurfaces; iSurface++ )
+    {
+        UINT nSurfaceBlocks = ( pJob->pSurfaces[iSurface].Height + HDR_BLOCK_ROWS - 1 ) / HDR_BLOCK_ROWS;
+        if( iBlock < nSurfaceBlocks )
+            break;
+        iBlock -= nSurfaceBlocks;
+    }
+
+    const DXUT_HDR_SURFACE& Surface = pJob->pSurfaces[iSurface];
+    UINT iFirstRow = iBlock * HDR_BLOCK_ROWS;
+    ConvertRows( pJob, Surface, iFirstRow, min( ( UINT )HDR_BLOCK_ROWS, Surface.Height - iFirstRow ) );
+}
+
+
+//--------------------------------------------------------------------------------------
+static HRESULT ConvertSurfaces( HDR_JOB* pJob, UINT nThreads )
+{
+    if( !pJob->pSurfaces && pJob->nSurfaces > 0 )
+        return E_INVALIDARG;
+
+    pJob->nBlocks = 0;
+    for( UINT i = 0; i < pJob->nSurfaces; i++ )
+    {
+        const DXUT_HDR_SURFACE& Surface = pJob->pSurfaces[i];
+        if( Surface.Width > 0 && Surface.Height > 0 && ( !Surface.pSrc || !Surface.pDest ) )
+            return E_INVALIDARG;
+        pJob->nBlocks += ( Surface.Height + HDR_BLOCK_ROWS - 1 ) / HDR_BLOCK_ROWS;
+    }
+
+    DXUTGetWorkerPool()->Run( HDRBlockProc, pJob, pJob->nBlocks, nThreads );
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT WINAPI DXUTEncodeHDRSurfaces( DXUT_HDR_FORMAT Format, const DXUT_HDR_SURFACE* pSurfaces, UINT nSurfaces,
+                                      UINT nThreads, DWORD dwFlags )
+{
+    if( ( UINT )Format >= DXUT_HDR_NUM_FORMATS )
+        return E_INVALIDARG;
+
+    HDR_JOB Job;
+    ZeroMemory( &Job, sizeof( HDR_JOB ) );
+    Job.pSurfaces = pSurfaces;
+    Job.nSurfaces = nSurfaces;
+    Job.TexelSize = DXUTGetHDRTexelSize( Format );
+    Job.pfnEncode = g_pfnEncodeRow[Format][( dwFlags & DXUT_HDR_SCALAR ) ? 0 : 1];
+    Job.dwFlags = dwFlags;
+
+    return ConvertSurfaces( &Job, nThreads );
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT WINAPI DXUTDecodeHDRSurfaces( DXUT_HDR_FORMAT Format, const DXUT_HDR_SURFACE* pSurfaces, UINT nSurfaces,
+                                      UINT nThreads, DWORD dwFlags )
+{
+    if( ( UINT )Format >= DXUT_HDR_NUM_FORMATS )
+        return E_INVALIDARG;
+
+    HDR_JOB Job;
+    ZeroMemory( &Job, sizeof( HDR_JOB ) );
+    Job.pSurfaces = pSurfaces;
+    Job.nSurfaces = nSurfaces;
+    Job.TexelSize = DXUTGetHDRTexelSize( Format );
+    Job.pfnDecode = g_pfnDecodeRow[Format][( dwFlags & DXUT_HDR_SCALAR ) ? 0 : 1];
+    Job.dwFlags = dwFlags;
+
+    return ConvertSurfaces( &Job, nThreads );
+}
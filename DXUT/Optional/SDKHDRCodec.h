@@ -0,0 +1,73 @@
+//--------------------------------------------------------------------------------------
+// File: SDKHDRCodec.h
+//
+// Encodes half float RGBA texels into the integer HDR formats used by the HDRFormats
+// samples, and decodes them back to float.  Whole rows are converted at a time, four
+// texels at once with SSE2 where available, and the rows of all the surfaces passed in
+// one call are shared out between the threads of the DXUT worker pool.
+//
+// Formats:
+//   RGBE8     RGB mantissas with a shared exponent in alpha, bytes in RGBA order
+//             (DXGI_FORMAT_R8G8B8A8_UNORM).  Decode with rgb * exp2( a * 255 - 128 ).
+//   BGRE8     The same in BGRA order (D3DFMT_A8R8G8B8)
+//   RGB16     rgb / DXUT_HDR_RGB16_MAX in 16 bit unorm, alpha 0 (D3DFMT_A16B16G16R16)
+//   RGB9E5    DXGI_FORMAT_R9G9B9E5_SHAREDEXP
+//   LOGLUV32  Greg Ward's LogLuv: 16 bits of log luminance and 8 bits each of u' and v'
+//
+// Negative and NaN components encode as 0 and components are clamped to the largest
+// half float.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#pragma once
+#ifndef SDKHDRCODEC_H
+#define SDKHDRCODEC_H
+
+// Largest value RGB16 can store
+#define DXUT_HDR_RGB16_MAX      100.0f
+
+// Use the plain C++ conversions even where SSE2 is available.  The results are the
+// same either way, bit for bit.
+#define DXUT_HDR_SCALAR         0x00000001
+
+enum DXUT_HDR_FORMAT
+{
+    DXUT_HDR_RGBE8 = 0,
+    DXUT_HDR_BGRE8,
+    DXUT_HDR_RGB16,
+    DXUT_HDR_RGB9E5,
+    DXUT_HDR_LOGLUV32,
+    DXUT_HDR_NUM_FORMATS
+};
+
+//--------------------------------------------------------------------------------------
+// One surface to convert.  When encoding pSrc holds 4 half floats a texel and pDest
+// the encoded texels; when decoding pSrc holds the encoded texels and pDest gets 4
+// floats a texel, with alpha 1.
+//--------------------------------------------------------------------------------------
+struct DXUT_HDR_SURFACE
+{
+    const void* pSrc;
+    UINT SrcPitch;
+    void* pDest;
+    UINT DestPitch;
+    UINT Width;
+    UINT Height;
+};
+
+// Bytes in an encoded texel
+UINT WINAPI     DXUTGetHDRTexelSize( DXUT_HDR_FORMAT Format );
+
+void WINAPI     DXUTHalfToFloat( float* pDest, const WORD* pSrc, UINT Count, DWORD dwFlags = 0 );
+
+// Rounds to the nearest half, ties to even
+void WINAPI     DXUTFloatToHalf( WORD* pDest, const float* pSrc, UINT Count, DWORD dwFlags = 0 );
+
+// Converts on up to nThreads threads of the DXUT worker pool; 0 uses all of them
+HRESULT WINAPI  DXUTEncodeHDRSurfaces( DXUT_HDR_FORMAT Format, const DXUT_HDR_SURFACE* pSurfaces, UINT nSurfaces,
+                                       UINT nThreads = 0, DWORD dwFlags = 0 );
+HRESULT WINAPI  DXUTDecodeHDRSurfaces( DXUT_HDR_FORMAT Format, const DXUT_HDR_SURFACE* pSurfaces, UINT nSurfaces,
+                                       UINT nThreads = 0, DWORD dwFlags = 0 );
+
+#endif
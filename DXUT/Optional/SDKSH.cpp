@@ -0,0 +1,1047 @@
+//--------------------------------------------------------------------------------------
+// File: SDKSH.cpp
+//
+// Spherical harmonic math for the PRT samples
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "SDKSH.h"
+#include "DXUTWorkerPool.h"
+#include <malloc.h>
+#include <math.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define SDKSH_SSE
+#endif
+
+// Cube map rows handed to a thread at a time
+#define SH_BLOCK_ROWS           16
+
+// Cone lights narrower than this are evaluated as directional lights, as D3DX does
+#define SH_MIN_CONE_RADIUS      0.0001f
+
+// Floats of the partial sums of one block: 3 channels of coefficients and the weight
+#define SH_PARTIAL_SIZE         ( 3 * DXUT_SH_MAX_COEFFS + 1 )
+
+// Clusters handed to a thread at a time, and the multiply-adds each thread woken to
+// compute cluster constants should have to do
+#define SH_CLUSTER_BLOCK        8
+#define SH_CLUSTER_THREAD_WORK  32768
+
+struct SH_PROJECT_JOB
+{
+    UINT Order;
+    UINT Size;
+    const FLOAT* const* ppFaces;
+    UINT Pitch;
+    UINT nFaceBlocks;
+    UINT nBlocks;
+    float* pPartials;           // SH_PARTIAL_SIZE floats for each block
+    DWORD dwFlags;
+};
+
+// Where the directions of each cube face come from, as D3DCUBEMAP_FACES: direction =
+// Axis + s * U + t * V, for texture coordinates s and t from -1 to 1
+static const float g_aafCubeFace[6][3][3] =
+{
+    { {  1.0f,  0.0f,  0.0f }, {  0.0f,  0.0f, -1.0f }, {  0.0f, -1.0f,  0.0f } },  // +X
+    { { -1.0f,  0.0f,  0.0f }, {  0.0f,  0.0f,  1.0f }, {  0.0f, -1.0f,  0.0f } },  // -X
+    { {  0.0f,  1.0f,  0.0f }, {  1.0f,  0.0f,  0.0f }, {  0.0f,  0.0f,  1.0f } },  // +Y
+    { {  0.0f, -1.0f,  0.0f }, {  1.0f,  0.0f,  0.0f }, {  0.0f,  0.0f, -1.0f } },  // -Y
+    { {  0.0f,  0.0f,  1.0f }, {  1.0f,  0.0f,  0.0f }, {  0.0f, -1.0f,  0.0f } },  // +Z
+    { {  0.0f,  0.0f, -1.0f }, { -1.0f,  0.0f,  0.0f }, {  0.0f, -1.0f,  0.0f } },  // -Z
+};
+
+
+//--------------------------------------------------------------------------------------
+// Four floats for the SSE2 code.  The same template code runs on plain floats for the
+// scalar code, one lane at a time, so the two give the same results.
+//--------------------------------------------------------------------------------------
+#ifdef SDKSH_SSE
+struct SH_VECTOR
+{
+    __m128 v;
+
+    SH_VECTOR()
+    {
+    }
+    SH_VECTOR( __m128 a ) : v( a )
+    {
+    }
+    SH_VECTOR( float f ) : v( _mm_set1_ps( f ) )
+    {
+    }
+};
+
+static inline SH_VECTOR operator+( SH_VECTOR a, SH_VECTOR b )
+{
+    return _mm_add_ps( a.v, b.v );
+}
+
+static inline SH_VECTOR operator-( SH_VECTOR a, SH_VECTOR b )
+{
+    return _mm_sub_ps( a.v, b.v );
+}
+
+static inline SH_VECTOR operator*( SH_VECTOR a, SH_VECTOR b )
+{
+    return _mm_mul_ps( a.v, b.v );
+}
+
+static inline SH_VECTOR operator/( SH_VECTOR a, SH_VECTOR b )
+{
+    return _mm_div_ps( a.v, b.v );
+}
+
+static inline SH_VECTOR Sqrt( SH_VECTOR a )
+{
+    return _mm_sqrt_ps( a.v );
+}
+
+static inline void Store( float* pDest, SH_VECTOR a )
+{
+    _mm_storeu_ps( pDest, a.v );
+}
+#endif
+
+static inline float Sqrt( float a )
+{
+    return sqrtf( a );
+}
+
+
+//--------------------------------------------------------------------------------------
+template <class V> static inline void Normalize( V* pX, V* pY, V* pZ )
+{
+    V Length = Sqrt( ( *pX * *pX + *pY * *pY ) + *pZ * *pZ );
+    V InvLength = V( 1.0f ) / Length;
+    *pX = *pX * InvLength;
+    *pY = *pY * InvLength;
+    *pZ = *pZ * InvLength;
+}
+
+
+//--------------------------------------------------------------------------------------
+static inline bool ValidOrder( UINT Order )
+{
+    return Order >= DXUT_SH_MIN_ORDER && Order <= DXUT_SH_MAX_ORDER;
+}
+
+
+//--------------------------------------------------------------------------------------
+// A light of unit intensity in direction d is afBand[l] * Y(l,m)(d) in band l.  For a
+// directional light this scales the harmonics so that the clamped cosine convolution of
+// the first Order bands gives 1 in the direction of the light.  A cone light is a cap of
+// radius fRadius with the radiance, 1 / sin^2 r, that gives a surface facing it an
+// irradiance of pi, and band l of a cap integrates to
+// 2 pi ( P(l-1)(cos r) - P(l+1)(cos r) ) / ( 2l + 1 ).
+//--------------------------------------------------------------------------------------
+static void GetLightBands( UINT Order, float fRadius, float* pfBands )
+{
+    if( fRadius < SH_MIN_CONE_RADIUS )
+    {
+        // Integrals of each band against the clamped cosine; odd bands above 1 have none
+        double fCosineIntegral = 0.25 + 0.5;
+        if( Order > 2 )
+            fCosineIntegral += 5.0 / 16.0;
+        if( Order > 4 )
+            fCosineIntegral -= 3.0 / 32.0;
+
+        for( UINT l = 0; l < Order; l++ )
+            pfBands[l] = ( float )( D3DX_PI / fCosineIntegral );
+        return;
+    }
+
+    // Legendre polynomials P(-1) to P(Order), with P(-1) taken as 1 to cover band 0
+    double afLegendre[DXUT_SH_MAX_ORDER + 2];
+    double fCos = cos( ( double )min( fRadius, D3DX_PI ) );
+    afLegendre[0] = 1.0;
+    afLegendre[1] = 1.0;
+    afLegendre[2] = fCos;
+    for( UINT l = 2; l <= Order; l++ )
+        afLegendre[l + 1] = ( ( 2 * l - 1 ) * fCos * afLegendre[l] - ( l - 1 ) * afLegendre[l - 1] ) / l;
+
+    // The cap of a wide cone is clipped to the hemisphere a surface can see
+    double fSin = sin( ( double )min( fRadius, D3DX_PI / 2 ) );
+    double fNorm = 2.0 * D3DX_PI / ( fSin * fSin );
+    for( UINT l = 0; l < Order; l++ )
+        pfBands[l] = ( float )( fNorm * ( afLegendre[l] - afLegendre[l + 2] ) / ( 2 * l + 1 ) );
+}
+
+
+//--------------------------------------------------------------------------------------
+FLOAT* WINAPI DXUTSHEvalDirection( FLOAT* pOut, UINT Order, const D3DXVECTOR3* pDir )
+{
+    if( !pOut || !pDir || !ValidOrder( Order ) )
+        return pOut;
+
+    DXUTSHEvalBasis( Order, pDir->x, pDir->y, pDir->z, pOut );
+    return pOut;
+}
+
+
+//--------------------------------------------------------------------------------------
+static HRESULT EvalLight( UINT Order, const D3DXVECTOR3* pDir, float fRadius, float fRed, float fGreen, float fBlue,
+                          FLOAT* pROut, FLOAT* pGOut, FLOAT* pBOut )
+{
+    if( !pDir || !pROut || !ValidOrder( Order ) || fRadius < 0.0f )
+        return E_INVALIDARG;
+
+    float afY[DXUT_SH_MAX_COEFFS];
+    float afBands[DXUT_SH_MAX_ORDER];
+    DXUTSHEvalBasis( Order, pDir->x, pDir->y, pDir->z, afY );
+    GetLightBands( Order, fRadius, afBands );
+
+    for( UINT l = 0; l < Order; l++ )
+    {
+        for( UINT i = l * l; i < ( l + 1 ) * ( l + 1 ); i++ )
+        {
+            float fValue = afY[i] * afBands[l];
+            pROut[i] = fValue * fRed;
+            if( pGOut )
+                pGOut[i] = fValue * fGreen;
+            if( pBOut )
+                pBOut[i] = fValue * fBlue;
+        }
+    }
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT WINAPI DXUTSHEvalDirectionalLight( UINT Order, const D3DXVECTOR3* pDir, FLOAT RIntensity,
+                                           FLOAT GIntensity, FLOAT BIntensity, FLOAT* pROut, FLOAT* pGOut,
+                                           FLOAT* pBOut )
+{
+    return EvalLight( Order, pDir, 0.0f, RIntensity, GIntensity, BIntensity, pROut, pGOut, pBOut );
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT WINAPI DXUTSHEvalConeLight( UINT Order, const D3DXVECTOR3* pDir, FLOAT Radius, FLOAT RIntensity,
+                                    FLOAT GIntensity, FLOAT BIntensity, FLOAT* pROut, FLOAT* pGOut,
+                                    FLOAT* pBOut )
+{
+    return EvalLight( Order, pDir, Radius, RIntensity, GIntensity, BIntensity, pROut, pGOut, pBOut );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Sums four lights at a time into one accumulator a lane, then adds the lanes together
+// at the end.  The scalar code keeps the same four sums.
+//--------------------------------------------------------------------------------------
+HRESULT WINAPI DXUTSHAddLights( UINT Order, const DXUT_SH_LIGHT* pLights, UINT nLights, FLOAT* pROut,
+                                FLOAT* pGOut, FLOAT* pBOut, DWORD dwFlags )
+{
+    if( ( !pLights && nLights > 0 ) || !pROut || !pGOut || !pBOut || !ValidOrder( Order ) )
+        return E_INVALIDARG;
+
+    const UINT nCoeffs = Order * Order;
+    float aafSum[3][DXUT_SH_MAX_COEFFS][4];
+    ZeroMemory( aafSum, sizeof( aafSum ) );
+
+    // Lights usually share a few radii, so the band factors of the last radius are kept
+    float afBands[DXUT_SH_MAX_ORDER];
+    float fBandsRadius = -1.0f;
+
+    for( UINT iFirst = 0; iFirst < nLights; iFirst += 4 )
+    {
+        // Lanes past the last light, and lights with no direction, add nothing
+        float afX[4], afY[4], afZ[4];
+        float aaafWeights[3][DXUT_SH_MAX_ORDER][4];
+        for( UINT j = 0; j < 4; j++ )
+        {
+            const DXUT_SH_LIGHT* pLight = ( iFirst + j < nLights ) ? &pLights[iFirst + j] : NULL;
+            bool bValid = pLight && pLight->fRadius >= 0.0f &&
+                D3DXVec3LengthSq( &pLight->vDirection ) > 0.0f;
+
+            if( bValid && pLight->fRadius != fBandsRadius )
+            {
+                GetLightBands( Order, pLight->fRadius, afBands );
+                fBandsRadius = pLight->fRadius;
+            }
+
+            afX[j] = bValid ? pLight->vDirection.x : 0.0f;
+            afY[j] = bValid ? pLight->vDirection.y : 0.0f;
+            afZ[j] = bValid ? pLight->vDirection.z : 1.0f;
+            for( UINT l = 0; l < Order; l++ )
+            {
+                aaafWeights[0][l][j] = bValid ? afBands[l] * pLight->fRed : 0.0f;
+                aaafWeights[1][l][j] = bValid ? afBands[l] * pLight->fGreen : 0.0f;
+                aaafWeights[2][l][j] = bValid ? afBands[l] * pLight->fBlue : 0.0f;
+            }
+        }
+
+#ifdef SDKSH_SSE
+        if( 0 == ( dwFlags & DXUT_SH_SCALAR ) )
+        {
+            SH_VECTOR x = _mm_loadu_ps( afX ), y = _mm_loadu_ps( afY ), z = _mm_loadu_ps( afZ );
+            Normalize( &x, &y, &z );
+
+            SH_VECTOR aY[DXUT_SH_MAX_COEFFS];
+            DXUTSHEvalBasis( Order, x, y, z, aY );
+
+            for( UINT l = 0; l < Order; l++ )
+            {
+                for( UINT c = 0; c < 3; c++ )
+                {
+                    SH_VECTOR Weight = _mm_loadu_ps( aaafWeights[c][l] );
+                    for( UINT i = l * l; i < ( l + 1 ) * ( l + 1 ); i++ )
+                        Store( aafSum[c][i], SH_VECTOR( _mm_loadu_ps( aafSum[c][i] ) ) + aY[i] * Weight );
+                }
+            }
+            continue;
+        }
+#endif
+
+        for( UINT j = 0; j < 4; j++ )
+        {
+            float x = afX[j], y = afY[j], z = afZ[j];
+            Normalize( &x, &y, &z );
+
+            float afBasis[DXUT_SH_MAX_COEFFS];
+            DXUTSHEvalBasis( Order, x, y, z, afBasis );
+
+            for( UINT l = 0; l < Order; l++ )
+            {
+                for( UINT c = 0; c < 3; c++ )
+                {
+                    for( UINT i = l * l; i < ( l + 1 ) * ( l + 1 ); i++ )
+                        aafSum[c][i][j] = aafSum[c][i][j] + afBasis[i] * aaafWeights[c][l][j];
+                }
+            }
+        }
+    }
+
+    FLOAT* apOut[3] = { pROut, pGOut, pBOut };
+    for( UINT c = 0; c < 3; c++ )
+    {
+        for( UINT i = 0; i < nCoeffs; i++ )
+            apOut[c][i] += ( aafSum[c][i][0] + aafSum[c][i][1] ) + ( aafSum[c][i][2] + aafSum[c][i][3] );
+    }
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// A zonal function z(l) rotated to direction d is sqrt( 4 pi / ( 2l + 1 ) ) z(l) Y(l,m)(d)
+//--------------------------------------------------------------------------------------
+FLOAT* WINAPI DXUTSHRotateZonal( FLOAT* pOut, UINT Order, const D3DXVECTOR3* pDir, const FLOAT* pZonal )
+{
+    if( !pOut || !pDir || !pZonal || !ValidOrder( Order ) )
+        return pOut;
+
+    float afY[DXUT_SH_MAX_COEFFS];
+    DXUTSHEvalBasis( Order, pDir->x, pDir->y, pDir->z, afY );
+
+    for( UINT l = 0; l < Order; l++ )
+    {
+        float fScale = sqrtf( 4.0f * D3DX_PI / ( 2 * l + 1 ) ) * pZonal[l];
+        for( UINT i = l * l; i < ( l + 1 ) * ( l + 1 ); i++ )
+            pOut[i] = afY[i] * fScale;
+    }
+
+    return pOut;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Band l of Ivanic and Ruedenberg's recurrence, "Rotation Matrices for Real Spherical
+// Harmonics. Direct Determination by Recursion", with the corrections of their 1998
+// addendum.  Their harmonics have no Condon-Shortley phase, so the bands are built
+// without it and the signs put in afterward.
+//--------------------------------------------------------------------------------------
+static inline float RotationP( int i, int l, int a, int b, const float* pR1, const float* pPrev )
+{
+    // pPrev is band l - 1, 2l - 1 wide, and pR1 is band 1, indexed from -1
+    const int Width = 2 * l - 1;
+    const float* pRow = pPrev + ( a + l - 1 ) * Width + l - 1;
+    const float* pR1Row = pR1 + ( i + 1 ) * 3 + 1;
+
+    if( b == l )
+        return pR1Row[1] * pRow[l - 1] - pR1Row[-1] * pRow[-l + 1];
+    if( b == -l )
+        return pR1Row[1] * pRow[-l + 1] + pR1Row[-1] * pRow[l - 1];
+    return pR1Row[0] * pRow[b];
+}
+
+static void BuildRotationBand( int l, float* pBand, const float* pR1, const float* pPrev )
+{
+    const int Width = 2 * l + 1;
+
+    for( int m = -l; m <= l; m++ )
+    {
+        const int AbsM = m < 0 ? -m : m;
+        const float fD = ( 0 == m ) ? 1.0f : 0.0f;
+
+        for( int n = -l; n <= l; n++ )
+        {
+            const float fDenom = ( n == l || n == -l ) ? ( float )( 2 * l * ( 2 * l - 1 ) ) :
+                                                         ( float )( ( l + n ) * ( l - n ) );
+            const float fU = sqrtf( ( l + m ) * ( l - m ) / fDenom );
+            const float fV = 0.5f * sqrtf( ( 1.0f + fD ) * ( l + AbsM - 1 ) * ( l + AbsM ) / fDenom ) *
+                             ( 1.0f - 2.0f * fD );
+            const float fW = -0.5f * sqrtf( ( l - AbsM - 1 ) * ( l - AbsM ) / fDenom ) * ( 1.0f - fD );
+
+            float fValue = 0.0f;
+            if( fU != 0.0f )
+                fValue += fU * RotationP( 0, l, m, n, pR1, pPrev );
+
+            if( fV != 0.0f )
+            {
+                float fTermV;
+                if( 0 == m )
+                    fTermV = RotationP( 1, l, 1, n, pR1, pPrev ) + RotationP( -1, l, -1, n, pR1, pPrev );
+                else if( m > 0 )
+                    fTermV = RotationP( 1, l, m - 1, n, pR1, pPrev ) * ( 1 == m ? sqrtf( 2.0f ) : 1.0f ) -
+                             ( 1 == m ? 0.0f : RotationP( -1, l, -m + 1, n, pR1, pPrev ) );
+                else
+                    fTermV = ( -1 == m ? 0.0f : RotationP( 1, l, m + 1, n, pR1, pPrev ) ) +
+                             RotationP( -1, l, -m - 1, n, pR1, pPrev ) * ( -1 == m ? sqrtf( 2.0f ) : 1.0f );
+                fValue += fV * fTermV;
+            }
+
+            if( fW != 0.0f )
+            {
+                float fTermW;
+                if( m > 0 )
+                    fTermW = RotationP( 1, l, m + 1, n, pR1, pPrev ) + RotationP( -1, l, -m - 1, n, pR1, pPrev );
+                else
+                    fTermW = RotationP( 1, l, m - 1, n, pR1, pPrev ) - RotationP( -1, l, -m + 1, n, pR1, pPrev );
+                fValue += fW * fTermW;
+            }
+
+            pBand[( m + l ) * Width + n + l] = fValue;
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT WINAPI DXUTSHCreateRotation( DXUT_SH_ROTATION* pRotation, UINT Order, const D3DXMATRIX* pMatrix )
+{
+    if( !pRotation || !pMatrix || !ValidOrder( Order ) )
+        return E_INVALIDARG;
+
+    pRotation->Order = Order;
+    pRotation->afBands[0] = 1.0f;
+    if( Order < 2 )
+        return S_OK;
+
+    // Band 1 is the rotation itself with the axes in the order of the harmonics, y, z, x.
+    // D3DX matrices transform row vectors, so the matrix of the harmonics is transposed.
+    static const int s_aiAxis[3] = { 1, 2, 0 };
+    float* pR1 = pRotation->afBands + 1;
+    for( int i = 0; i < 3; i++ )
+    {
+        for( int j = 0; j < 3; j++ )
+            pR1[i * 3 + j] = pMatrix->m[s_aiAxis[j]][s_aiAxis[i]];
+    }
+
+    for( int l = 2; l < ( int )Order; l++ )
+    {
+        float* pBand = pRotation->afBands + l * ( 4 * l * l - 1 ) / 3;
+        const float* pPrev = pRotation->afBands + ( l - 1 ) * ( 4 * ( l - 1 ) * ( l - 1 ) - 1 ) / 3;
+        BuildRotationBand( l, pBand, pR1, pPrev );
+    }
+
+    // The Condon-Shortley phase flips harmonic l,m when m is odd
+    for( int l = 1; l < ( int )Order; l++ )
+    {
+        float* pBand = pRotation->afBands + l * ( 4 * l * l - 1 ) / 3;
+        for( int m = -l; m <= l; m++ )
+        {
+            for( int n = -l; n <= l; n++ )
+            {
+                if( ( m + n ) & 1 )
+                    pBand[( m + l ) * ( 2 * l + 1 ) + n + l] = -pBand[( m + l ) * ( 2 * l + 1 ) + n + l];
+            }
+        }
+    }
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+FLOAT* WINAPI DXUTSHApplyRotation( FLOAT* pOut, const DXUT_SH_ROTATION* pRotation, const FLOAT* pIn )
+{
+    if( !pOut || !pRotation || !pIn || !ValidOrder( pRotation->Order ) )
+        return pOut;
+
+    // pOut may be pIn
+    float afIn[DXUT_SH_MAX_COEFFS];
+    memcpy( afIn, pIn, pRotation->Order * pRotation->Order * sizeof( float ) );
+
+    pOut[0] = afIn[0];
+    for( UINT l = 1; l < pRotation->Order; l++ )
+    {
+        const UINT Width = 2 * l + 1;
+        const float* pBand = pRotation->afBands + l * ( 4 * l * l - 1 ) / 3;
+        const float* pBandIn = afIn + l * l;
+        float* pBandOut = pOut + l * l;
+
+        for( UINT m = 0; m < Width; m++ )
+        {
+            float fSum = 0.0f;
+            for( UINT n = 0; n < Width; n++ )
+                fSum += pBand[m * Width + n] * pBandIn[n];
+            pBandOut[m] = fSum;
+        }
+    }
+
+    return pOut;
+}
+
+
+//--------------------------------------------------------------------------------------
+FLOAT* WINAPI DXUTSHRotate( FLOAT* pOut, UINT Order, const D3DXMATRIX* pMatrix, const FLOAT* pIn )
+{
+    DXUT_SH_ROTATION Rotation;
+    if( FAILED( DXUTSHCreateRotation( &Rotation, Order, pMatrix ) ) )
+        return pOut;
+
+    return DXUTSHApplyRotation( pOut, &Rotation, pIn );
+}
+
+
+//--------------------------------------------------------------------------------------
+FLOAT* WINAPI DXUTSHAdd( FLOAT* pOut, UINT Order, const FLOAT* pA, const FLOAT* pB )
+{
+    for( UINT i = 0; i < Order * Order; i++ )
+        pOut[i] = pA[i] + pB[i];
+    return pOut;
+}
+
+
+//--------------------------------------------------------------------------------------
+FLOAT* WINAPI DXUTSHScale( FLOAT* pOut, UINT Order, const FLOAT* pIn, FLOAT Scale )
+{
+    for( UINT i = 0; i < Order * Order; i++ )
+        pOut[i] = pIn[i] * Scale;
+    return pOut;
+}
+
+
+//--------------------------------------------------------------------------------------
+FLOAT WINAPI DXUTSHDot( UINT Order, const FLOAT* pA, const FLOAT* pB )
+{
+    float fSum = 0.0f;
+    for( UINT i = 0; i < Order * Order; i++ )
+        fSum += pA[i] * pB[i];
+    return fSum;
+}
+
+
+//--------------------------------------------------------------------------------------
+FLOAT* WINAPI DXUTSHScaleAdd( FLOAT* pOut, UINT Order, const FLOAT* pA, const FLOAT* pB, FLOAT Scale )
+{
+    for( UINT i = 0; i < Order * Order; i++ )
+        pOut[i] = pA[i] + pB[i] * Scale;
+    return pOut;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Projects a block of rows of one face.  Each texel is weighted by the solid angle it
+// covers, 4 / ( 1 + u^2 + v^2 )^(3/2), and its direction is taken from the texel center
+// as D3DXSHProjectCubeMap takes it.  Texels are taken four at a time, with a sum for each
+// of the four lanes.
+//--------------------------------------------------------------------------------------
+static void ProjectBlock( const SH_PROJECT_JOB* pJob, UINT iBlock )
+{
+    const UINT iFace = iBlock / pJob->nFaceBlocks;
+    const UINT iFirstRow = ( iBlock % pJob->nFaceBlocks ) * SH_BLOCK_ROWS;
+    const UINT nRows = min( ( UINT )SH_BLOCK_ROWS, pJob->Size - iFirstRow );
+    const UINT Order = pJob->Order;
+    const UINT nCoeffs = Order * Order;
+    const float ( *aAxes )[3] = g_aafCubeFace[iFace];
+
+    const float fSize = ( float )pJob->Size;
+    const float fPicSize = 1.0f / fSize;
+    const float fB = -1.0f + 1.0f / fSize;
+    const float fS = ( pJob->Size > 1 ) ? ( 2.0f * ( 1.0f - 1.0f / fSize ) / ( fSize - 1.0f ) ) : 0.0f;
+
+    float aafSum[3][DXUT_SH_MAX_COEFFS][4];
+    float afWeightSum[4];
+    ZeroMemory( aafSum, sizeof( aafSum ) );
+    ZeroMemory( afWeightSum, sizeof( afWeightSum ) );
+
+    for( UINT y = iFirstRow; y < iFirstRow + nRows; y++ )
+    {
+        const float* pRow = ( const float* )( ( const BYTE* )pJob->ppFaces[iFace] + ( SIZE_T )y * pJob->Pitch );
+        const float v = y * fS + fB;
+        const float t = ( 2.0f * y + 1.0f ) * fPicSize - 1.0f;
+
+        for( UINT x0 = 0; x0 < pJob->Size; x0 += 4 )
+        {
+            // Lanes past the end of the row have no weight
+            float afS[4], afSolid[4], aafColor[3][4];
+            for( UINT j = 0; j < 4; j++ )
+            {
+                const UINT x = x0 + j;
+                const float u = x * fS + fB;
+                afS[j] = ( 2.0f * x + 1.0f ) * fPicSize - 1.0f;
+
+                if( x < pJob->Size )
+                {
+                    float fTemp = ( 1.0f + u * u ) + v * v;
+                    afSolid[j] = 4.0f / ( fTemp * sqrtf( fTemp ) );
+                    aafColor[0][j] = pRow[x * 4 + 0] * afSolid[j];
+                    aafColor[1][j] = pRow[x * 4 + 1] * afSolid[j];
+                    aafColor[2][j] = pRow[x * 4 + 2] * afSolid[j];
+                }
+                else
+                {
+                    afSolid[j] = 0.0f;
+                    aafColor[0][j] = aafColor[1][j] = aafColor[2][j] = 0.0f;
+                }
+            }
+
+#ifdef SDKSH_SSE
+            if( 0 == ( pJob->dwFlags & DXUT_SH_SCALAR ) )
+            {
+                SH_VECTOR s = _mm_loadu_ps( afS );
+                SH_VECTOR dx = ( SH_VECTOR( aAxes[0][0] ) + s * aAxes[1][0] ) + t * aAxes[2][0];
+                SH_VECTOR dy = ( SH_VECTOR( aAxes[0][1] ) + s * aAxes[1][1] ) + t * aAxes[2][1];
+                SH_VECTOR dz = ( SH_VECTOR( aAxes[0][2] ) + s * aAxes[1][2] ) + t * aAxes[2][2];
+                Normalize( &dx, &dy, &dz );
+
+                SH_VECTOR aY[DXUT_SH_MAX_COEFFS];
+                DXUTSHEvalBasis( Order, dx, dy, dz, aY );
+
+                for( UINT c = 0; c < 3; c++ )
+                {
+                    SH_VECTOR Color = _mm_loadu_ps( aafColor[c] );
+                    for( UINT i = 0; i < nCoeffs; i++ )
+                        Store( aafSum[c][i], SH_VECTOR( _mm_loadu_ps( aafSum[c][i] ) ) + aY[i] * Color );
+                }
+                Store( afWeightSum, SH_VECTOR( _mm_loadu_ps( afWeightSum ) ) + SH_VECTOR( _mm_loadu_ps( afSolid ) ) );
+                continue;
+            }
+#endif
+
+            for( UINT j = 0; j < 4; j++ )
+            {
+                float dx = ( aAxes[0][0] + afS[j] * aAxes[1][0] ) + t * aAxes[2][0];
+                float dy = ( aAxes[0][1] + afS[j] * aAxes[1][1] ) + t * aAxes[2][1];
+                float dz = ( aAxes[0][2] + afS[j] * aAxes[1][2] ) + t * aAxes[2][2];
+                Normalize( &dx, &dy, &dz );
+
+                float afY[DXUT_SH_MAX_COEFFS];
+                DXUTSHEvalBasis( Order, dx, dy, dz, afY );
+
+                for( UINT c = 0; c < 3; c++ )
+                {
+                    for( UINT i = 0; i < nCoeffs; i++ )
+                        aafSum[c][i][j] = aafSum[c][i][j] + afY[i] * aafColor[c][j];
+                }
+                afWeightSum[j] = afWeightSum[j] + afSolid[j];
+            }
+        }
+    }
+
+    float* pPartial = pJob->pPartials + iBlock * SH_PARTIAL_SIZE;
+    for( UINT c = 0; c < 3; c++ )
+    {
+        for( UINT i = 0; i < nCoeffs; i++ )
+            pPartial[c * DXUT_SH_MAX_COEFFS + i] = ( aafSum[c][i][0] + aafSum[c][i][1] ) +
+                                                   ( aafSum[c][i][2] + aafSum[c][i][3] );
+    }
+    pPartial[3 * DXUT_SH_MAX_COEFFS] = ( afWeightSum[0] + afWeightSum[1] ) + ( afWeightSum[2] + afWeightSum[3] );
+}
+
+
+//--------------------------------------------------------------------------------------
+static void SHProjectBlockProc( void* pContext, UINT iBlock, UINT iThread )
+{
+    UNREFERENCED_PARAMETER( iThread );
+    ProjectBlock( ( const SH_PROJECT_JOB* )pContext, iBlock );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Each block keeps its own sums, which are added in order at the end, so the result
+// does not depend on which thread did which block
+//--------------------------------------------------------------------------------------
+HRESULT WINAPI DXUTSHProjectCubeMap( UINT Order, UINT Size, const FLOAT* const* ppFaces, UINT Pitch, FLOAT* pROut,
+                                     FLOAT* pGOut, FLOAT* pBOut, UINT nThreads, DWORD dwFlags )
+{
+    if( !ValidOrder( Order ) || 0 == Size || !ppFaces || !pROut )
+        return E_INVALIDARG;
+    for( UINT i = 0; i < 6; i++ )
+    {
+        if( !ppFaces[i] )
+            return E_INVALIDARG;
+    }
+
+    SH_PROJECT_JOB Job;
+    ZeroMemory( &Job, sizeof( SH_PROJECT_JOB ) );
+    Job.Order = Order;
+    Job.Size = Size;
+    Job.ppFaces = ppFaces;
+    Job.Pitch = Pitch;
+    Job.nFaceBlocks = ( Size + SH_BLOCK_ROWS - 1 ) / SH_BLOCK_ROWS;
+    Job.nBlocks = 6 * Job.nFaceBlocks;
+    Job.dwFlags = dwFlags;
+    Job.pPartials = new float[ Job.nBlocks * SH_PARTIAL_SIZE ];
+    if( !Job.pPartials )
+        return E_OUTOFMEMORY;
+
+    if( 0 == nThreads )
+        nThreads = CDXUTWorkerPool::GetNumProcessors();
+    nThreads = min( nThreads, ( UINT )DXUT_SH_MAX_THREADS );
+    DXUTGetWorkerPool()->Run( SHProjectBlockProc, &Job, Job.nBlocks, nThreads );
+
+    float afTotal[SH_PARTIAL_SIZE];
+    ZeroMemory( afTotal, sizeof( afTotal ) );
+    for( UINT iBlock = 0; iBlock < Job.nBlocks; iBlock++ )
+    {
+        const float* pPartial = Job.pPartials + iBlock * SH_PARTIAL_SIZE;
+        for( UINT i = 0; i < SH_PARTIAL_SIZE; i++ )
+            afTotal[i] += pPartial[i];
+    }
+    SAFE_DELETE_ARRAY( Job.pPartials );
+
+    // The weights add up to the area of the sphere, less what the texel centers miss
+    const float fNorm = ( 4.0f * D3DX_PI ) / afTotal[3 * DXUT_SH_MAX_COEFFS];
+    DXUTSHScale( pROut, Order, afTotal, fNorm );
+    if( pGOut )
+        DXUTSHScale( pGOut, Order, afTotal + DXUT_SH_MAX_COEFFS, fNorm );
+    if( pBOut )
+        DXUTSHScale( pBOut, Order, afTotal + 2 * DXUT_SH_MAX_COEFFS, fNorm );
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Reads the faces back as float through D3DX, from system memory copies for textures
+// the CPU can't lock
+//--------------------------------------------------------------------------------------
+HRESULT WINAPI DXUTSHProjectCubeTexture9( UINT Order, IDirect3DCubeTexture9* pCubeTexture, FLOAT* pROut,
+                                          FLOAT* pGOut, FLOAT* pBOut, UINT nThreads )
+{
+    HRESULT hr;
+
+    if( !pCubeTexture )
+        return E_INVALIDARG;
+
+    D3DSURFACE_DESC desc;
+    V_RETURN( pCubeTexture->GetLevelDesc( 0, &desc ) );
+
+    IDirect3DDevice9* pDevice = NULL;
+    V_RETURN( pCubeTexture->GetDevice( &pDevice ) );
+
+    const UINT Size = desc.Width;
+    const UINT Pitch = Size * 4 * sizeof( float );
+    float* pTexels = new float[ 6 * Size * Size * 4 ];
+    IDirect3DSurface9* pFloatSurface = NULL;
+    IDirect3DSurface9* pSysMemSurface = NULL;
+
+    hr = pTexels ? S_OK : E_OUTOFMEMORY;
+    if( SUCCEEDED( hr ) )
+        hr = pDevice->CreateOffscreenPlainSurface( Size, Size, D3DFMT_A32B32G32R32F, D3DPOOL_SCRATCH,
+                                                   &pFloatSurface, NULL );
+    if( SUCCEEDED( hr ) && D3DPOOL_DEFAULT == desc.Pool )
+        hr = pDevice->CreateOffscreenPlainSurface( Size, Size, desc.Format, D3DPOOL_SYSTEMMEM, &pSysMemSurface,
+                                                   NULL );
+
+    const FLOAT* apFaces[6] = { NULL };
+    for( UINT iFace = 0; iFace < 6 && SUCCEEDED( hr ); iFace++ )
+    {
+        IDirect3DSurface9* pFace = NULL;
+        hr = pCubeTexture->GetCubeMapSurface( ( D3DCUBEMAP_FACES )iFace, 0, &pFace );
+        if( FAILED( hr ) )
+            break;
+
+        IDirect3DSurface9* pSrc = pFace;
+        if( pSysMemSurface )
+        {
+            hr = pDevice->GetRenderTargetData( pFace, pSysMemSurface );
+            pSrc = pSysMemSurface;
+        }
+        if( SUCCEEDED( hr ) )
+            hr = D3DXLoadSurfaceFromSurface( pFloatSurface, NULL, NULL, pSrc, NULL, NULL, D3DX_FILTER_NONE, 0 );
+        SAFE_RELEASE( pFace );
+
+        D3DLOCKED_RECT LockedRect;
+        if( SUCCEEDED( hr ) )
+            hr = pFloatSurface->LockRect( &LockedRect, NULL, D3DLOCK_READONLY );
+        if( FAILED( hr ) )
+            break;
+
+        apFaces[iFace] = pTexels + iFace * Size * Size * 4;
+        for( UINT y = 0; y < Size; y++ )
+            memcpy( ( BYTE* )apFaces[iFace] + y * Pitch, ( BYTE* )LockedRect.pBits + y * LockedRect.Pitch, Pitch );
+        pFloatSurface->UnlockRect();
+    }
+
+    if( SUCCEEDED( hr ) )
+        hr = DXUTSHProjectCubeMap( Order, Size, apFaces, Pitch, pROut, pGOut, pBOut, nThreads );
+
+    SAFE_RELEASE( pSysMemSurface );
+    SAFE_RELEASE( pFloatSurface );
+    SAFE_RELEASE( pDevice );
+    SAFE_DELETE_ARRAY( pTexels );
+
+    return hr;
+}
+
+
+//--------------------------------------------------------------------------------------
+CDXUTPRTClusterBasis::CDXUTPRTClusterBasis()
+{
+    ZeroMemory( m_afLastLight, sizeof( m_afLastLight ) );
+    m_pRows = NULL;
+    m_pLight = NULL;
+    m_bValid = false;
+    m_nClusters = 0;
+    m_nChannels = 0;
+    m_nPCA = 0;
+    m_Order = 0;
+    m_nGroups = 0;
+    m_ClusterStride = 0;
+    m_dwFlags = 0;
+    m_nThreads = 1;
+    m_pConstants = NULL;
+    m_nBlocks = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+CDXUTPRTClusterBasis::~CDXUTPRTClusterBasis()
+{
+    Destroy();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Row 0 of each cluster and channel is the mean and row j + 1 is PCA vector j.  Rows
+// past the last PCA vector are left 0.
+//--------------------------------------------------------------------------------------
+HRESULT CDXUTPRTClusterBasis::Create( const FLOAT* pBases, UINT nClusters, UINT nChannels, UINT nPCA, UINT Order,
+                                      UINT nThreads, DWORD dwFlags )
+{
+    if( !pBases || 0 == nClusters || 0 == nChannels || nChannels > 3 || !ValidOrder( Order ) )
+        return E_INVALIDARG;
+
+    Destroy();
+
+    const UINT nCoeffs = Order * Order;
+    m_nClusters = nClusters;
+    m_nChannels = nChannels;
+    m_nPCA = nPCA;
+    m_Order = Order;
+    m_nGroups = ( nPCA + 1 + 3 ) / 4;
+    m_ClusterStride = 4 + nChannels * nPCA;
+    m_dwFlags = dwFlags;
+
+    const SIZE_T nRowFloats = ( SIZE_T )nClusters * nChannels * m_nGroups * nCoeffs * 4;
+    m_pRows = ( float* )_aligned_malloc( nRowFloats * sizeof( float ), 16 );
+    m_pLight = ( float* )_aligned_malloc( 3 * DXUT_SH_MAX_COEFFS * 4 * sizeof( float ), 16 );
+    if( !m_pRows || !m_pLight )
+    {
+        Destroy();
+        return E_OUTOFMEMORY;
+    }
+    ZeroMemory( m_pRows, nRowFloats * sizeof( float ) );
+
+    const UINT nBasisRows = nPCA + 1;
+    for( UINT k = 0; k < nClusters; k++ )
+    {
+        const float* pBasis = pBases + ( SIZE_T )k * nBasisRows * nChannels * nCoeffs;
+        for( UINT c = 0; c < nChannels; c++ )
+        {
+            float* pGroups = m_pRows + ( ( SIZE_T )k * nChannels + c ) * m_nGroups * nCoeffs * 4;
+            for( UINT r = 0; r < nBasisRows; r++ )
+            {
+                const float* pSrc = pBasis + ( r * nChannels + c ) * nCoeffs;
+                float* pDest = pGroups + ( r / 4 ) * nCoeffs * 4 + ( r % 4 );
+                for( UINT i = 0; i < nCoeffs; i++ )
+                    pDest[i * 4] = pSrc[i];
+            }
+        }
+    }
+
+    if( 0 == nThreads )
+        nThreads = CDXUTWorkerPool::GetNumProcessors();
+    nThreads = min( nThreads, ( UINT )DXUT_SH_MAX_THREADS );
+    m_nThreads = min( nThreads, DXUTGetWorkerPool()->GetNumThreads() );
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CDXUTPRTClusterBasis::Destroy()
+{
+    m_nThreads = 1;
+
+    if( m_pRows )
+        _aligned_free( m_pRows );
+    if( m_pLight )
+        _aligned_free( m_pLight );
+    m_pRows = NULL;
+    m_pLight = NULL;
+    m_bValid = false;
+    m_nClusters = 0;
+    m_ClusterStride = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CDXUTPRTClusterBasis::ComputeConstants( const FLOAT* pRed, const FLOAT* pGreen, const FLOAT* pBlue,
+                                                FLOAT* pConstants, FLOAT fThreshold )
+{
+    const FLOAT* apLight[3] = { pRed, pGreen, pBlue };
+    if( !m_pRows || !pConstants )
+        return E_FAIL;
+    for( UINT c = 0; c < m_nChannels; c++ )
+    {
+        if( !apLight[c] )
+            return E_INVALIDARG;
+    }
+
+    const UINT nCoeffs = m_Order * m_Order;
+    if( m_bValid )
+    {
+        float fMax = 0.0f, fMaxDelta = 0.0f;
+        for( UINT c = 0; c < m_nChannels; c++ )
+        {
+            for( UINT i = 0; i < nCoeffs; i++ )
+            {
+                fMax = __max( fMax, fabsf( apLight[c][i] ) );
+                fMaxDelta = __max( fMaxDelta, fabsf( apLight[c][i] - m_afLastLight[c][i] ) );
+            }
+        }
+        if( fMaxDelta <= fThreshold * fMax )
+            return S_FALSE;
+    }
+
+    for( UINT c = 0; c < m_nChannels; c++ )
+    {
+        for( UINT i = 0; i < nCoeffs; i++ )
+        {
+            m_afLastLight[c][i] = apLight[c][i];
+            for( UINT j = 0; j < 4; j++ )
+                m_pLight[( c * DXUT_SH_MAX_COEFFS + i ) * 4 + j] = apLight[c][i];
+        }
+    }
+    m_bValid = true;
+
+    m_pConstants = pConstants;
+    m_nBlocks = ( m_nClusters + SH_CLUSTER_BLOCK - 1 ) / SH_CLUSTER_BLOCK;
+
+    // Small bases are done on this thread alone
+    const UINT nWork = m_nClusters * m_nChannels * m_nGroups * 4 * nCoeffs;
+    const UINT nThreads = min( m_nThreads, nWork / SH_CLUSTER_THREAD_WORK + 1 );
+    DXUTGetWorkerPool()->Run( BlockProc, this, m_nBlocks, nThreads );
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CDXUTPRTClusterBasis::BlockProc( void* pContext, UINT iBlock, UINT iThread )
+{
+    UNREFERENCED_PARAMETER( iThread );
+    ( ( CDXUTPRTClusterBasis* )pContext )->ComputeBlock( iBlock );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Stores the dot products of rows iFirstRow to iFirstRow + 3 of one channel where the
+// effect expects them
+//--------------------------------------------------------------------------------------
+static inline void StoreRowDots( float* pCluster, UINT iChannel, UINT nPCA, UINT iFirstRow, const float* pDots )
+{
+    for( UINT j = 0; j < 4; j++ )
+    {
+        const UINT r = iFirstRow + j;
+        if( 0 == r )
+            pCluster[iChannel] = pDots[j];
+        else if( r <= nPCA )
+            pCluster[4 + iChannel * nPCA + r - 1] = pDots[j];
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Each lane sums its row's products in coefficient order from 0, as DXUTSHDot does.
+// SSE2 takes two groups at a time to keep two sums in flight.
+//--------------------------------------------------------------------------------------
+void CDXUTPRTClusterBasis::ComputeBlock( UINT iBlock )
+{
+    const UINT iFirst = iBlock * SH_CLUSTER_BLOCK;
+    const UINT iLast = min( iFirst + SH_CLUSTER_BLOCK, m_nClusters );
+    const UINT nCoeffs = m_Order * m_Order;
+    const UINT GroupSize = nCoeffs * 4;
+
+    for( UINT k = iFirst; k < iLast; k++ )
+    {
+        float* pCluster = m_pConstants + k * m_ClusterStride;
+        for( UINT c = m_nChannels; c < 4; c++ )
+            pCluster[c] = 0.0f;
+
+        for( UINT c = 0; c < m_nChannels; c++ )
+        {
+            const float* pLight = m_pLight + c * DXUT_SH_MAX_COEFFS * 4;
+            const float* pGroups = m_pRows + ( ( SIZE_T )k * m_nChannels + c ) * m_nGroups * GroupSize;
+            float afDots[8];
+            UINT g = 0;
+
+#ifdef SDKSH_SSE
+            if( 0 == ( m_dwFlags & DXUT_SH_SCALAR ) )
+            {
+                for( ; g + 1 < m_nGroups; g += 2 )
+                {
+                    const float* pA = pGroups + g * GroupSize;
+                    const float* pB = pA + GroupSize;
+                    SH_VECTOR SumA = _mm_setzero_ps(), SumB = _mm_setzero_ps();
+                    for( UINT i = 0; i < nCoeffs; i++ )
+                    {
+                        SH_VECTOR L = _mm_load_ps( pLight + i * 4 );
+                        SumA = SumA + SH_VECTOR( _mm_load_ps( pA + i * 4 ) ) * L;
+                        SumB = SumB + SH_VECTOR( _mm_load_ps( pB + i * 4 ) ) * L;
+                    }
+                    Store( afDots, SumA );
+                    Store( afDots + 4, SumB );
+                    StoreRowDots( pCluster, c, m_nPCA, g * 4, afDots );
+                    StoreRowDots( pCluster, c, m_nPCA, g * 4 + 4, afDots + 4 );
+                }
+                if( g < m_nGroups )
+                {
+                    const float* pA = pGroups + g * GroupSize;
+                    SH_VECTOR SumA = _mm_setzero_ps();
+                    for( UINT i = 0; i < nCoeffs; i++ )
+                    {
+                        SH_VECTOR L = _mm_load_ps( pLight + i * 4 );
+                        SumA = SumA + SH_VECTOR( _mm_load_ps( pA + i * 4 ) ) * L;
+                    }
+                    Store( afDots, SumA );
+                    StoreRowDots( pCluster, c, m_nPCA, g * 4, afDots );
+                }
+                continue;
+            }
+#endif
+
+            for( ; g < m_nGroups; g++ )
+            {
+                const float* pA = pGroups + g * GroupSize;
+                afDots[0] = afDots[1] = afDots[2] = afDots[3] = 0.0f;
+                for( UINT i = 0; i < nCoeffs; i++ )
+                {
+                    for( UINT j = 0; j < 4; j++ )
+                        afDots[j] += pA[i * 4 + j] * pLight[i * 4 + j];
+                }
+                StoreRowDots( pCluster, c, m_nPCA, g * 4, afDots );
+            }
+        }
+    }
+}
@@ -0,0 +1,181 @@
+//--------------------------------------------------------------------------------------
+// File: SDKSH.h
+//
+// Spherical harmonic math for the PRT samples, in place of the D3DXSH* functions.
+// Coefficients are stored as D3DX stores them: order N holds the N * N real harmonics
+// of bands 0 to N - 1, harmonic l,m at index l * l + l + m, with the same signs and
+// normalization, so the results can be passed to D3DX and the PRT effects unchanged.
+//
+// Besides one at a time versions of D3DXSHEvalDirection, D3DXSHEvalDirectionalLight,
+// D3DXSHEvalConeLight, D3DXSHRotate, D3DXSHProjectCubeMap, D3DXSHAdd, D3DXSHScale and
+// D3DXSHDot, there are:
+//   - DXUTSHAddLights, which evaluates and sums any number of directional and cone
+//     lights, four at a time with SSE2 where available
+//   - DXUT_SH_ROTATION, the band matrices of one rotation, built once and applied to
+//     as many coefficient vectors as use that rotation
+//   - DXUTSHRotateZonal, which turns a function symmetric about the z axis to point
+//     along a direction without building a rotation
+//   - DXUTSHProjectCubeMap, which projects float cube faces on a number of threads
+//   - CDXUTPRTClusterBasis, which turns the source radiance into the constants of
+//     compressed PRT for every cluster at once
+//
+// The SSE2 and plain C++ code give the same results bit for bit, on any number of
+// threads.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#pragma once
+#ifndef SDKSH_H
+#define SDKSH_H
+
+#include "SDKSHBasis.h"
+
+#define DXUT_SH_MAX_THREADS     32
+
+// Use the plain C++ code even where SSE2 is available
+#define DXUT_SH_SCALAR          0x00000001
+
+//--------------------------------------------------------------------------------------
+// A light for DXUTSHAddLights.  fRadius is the half angle of a cone light in radians,
+// or 0 for a directional light.  vDirection points toward the light and need not be
+// normalized.
+//--------------------------------------------------------------------------------------
+struct DXUT_SH_LIGHT
+{
+    D3DXVECTOR3 vDirection;
+    float fRadius;
+    float fRed;
+    float fGreen;
+    float fBlue;
+};
+
+//--------------------------------------------------------------------------------------
+// One rotation, as a matrix for each band.  Band l is (2l + 1) x (2l + 1) floats
+// starting at afBands[l * ( 4 * l * l - 1 ) / 3].
+//--------------------------------------------------------------------------------------
+struct DXUT_SH_ROTATION
+{
+    UINT Order;
+    float afBands[286];
+};
+
+FLOAT* WINAPI   DXUTSHEvalDirection( FLOAT* pOut, UINT Order, const D3DXVECTOR3* pDir );
+
+// Directional and cone lights, scaled as the D3DX versions are: a light of intensity 1
+// gives an exit radiance of 1 on a white diffuse surface facing it.  pGOut and pBOut
+// may be NULL.
+HRESULT WINAPI  DXUTSHEvalDirectionalLight( UINT Order, const D3DXVECTOR3* pDir, FLOAT RIntensity,
+                                            FLOAT GIntensity, FLOAT BIntensity, FLOAT* pROut, FLOAT* pGOut,
+                                            FLOAT* pBOut );
+HRESULT WINAPI  DXUTSHEvalConeLight( UINT Order, const D3DXVECTOR3* pDir, FLOAT Radius, FLOAT RIntensity,
+                                     FLOAT GIntensity, FLOAT BIntensity, FLOAT* pROut, FLOAT* pGOut,
+                                     FLOAT* pBOut );
+
+// Adds nLights lights to pROut, pGOut and pBOut, which must all be given
+HRESULT WINAPI  DXUTSHAddLights( UINT Order, const DXUT_SH_LIGHT* pLights, UINT nLights, FLOAT* pROut,
+                                 FLOAT* pGOut, FLOAT* pBOut, DWORD dwFlags = 0 );
+
+// pZonal holds Order coefficients of a function symmetric about +z, which is turned to
+// point along pDir
+FLOAT* WINAPI   DXUTSHRotateZonal( FLOAT* pOut, UINT Order, const D3DXVECTOR3* pDir, const FLOAT* pZonal );
+
+// pMatrix must be a rotation.  As with D3DXSHRotate, the function the coefficients
+// describe is rotated so that its value in direction d moves to direction d * pMatrix.
+HRESULT WINAPI  DXUTSHCreateRotation( DXUT_SH_ROTATION* pRotation, UINT Order, const D3DXMATRIX* pMatrix );
+FLOAT* WINAPI   DXUTSHApplyRotation( FLOAT* pOut, const DXUT_SH_ROTATION* pRotation, const FLOAT* pIn );
+FLOAT* WINAPI   DXUTSHRotate( FLOAT* pOut, UINT Order, const D3DXMATRIX* pMatrix, const FLOAT* pIn );
+
+FLOAT* WINAPI   DXUTSHAdd( FLOAT* pOut, UINT Order, const FLOAT* pA, const FLOAT* pB );
+FLOAT* WINAPI   DXUTSHScale( FLOAT* pOut, UINT Order, const FLOAT* pIn, FLOAT Scale );
+FLOAT WINAPI    DXUTSHDot( UINT Order, const FLOAT* pA, const FLOAT* pB );
+
+// pOut = pA + pB * Scale
+FLOAT* WINAPI   DXUTSHScaleAdd( FLOAT* pOut, UINT Order, const FLOAT* pA, const FLOAT* pB, FLOAT Scale );
+
+// ppFaces holds the six faces in D3DCUBEMAP_FACES order, each Size x Size texels of 4
+// floats with Pitch bytes between rows.  nThreads 0 uses a thread for each processor.
+HRESULT WINAPI  DXUTSHProjectCubeMap( UINT Order, UINT Size, const FLOAT* const* ppFaces, UINT Pitch, FLOAT* pROut,
+                                      FLOAT* pGOut, FLOAT* pBOut, UINT nThreads = 0, DWORD dwFlags = 0 );
+
+// Projects the top level of any cube texture D3DX can convert to float, including
+// D3DPOOL_DEFAULT render targets
+HRESULT WINAPI  DXUTSHProjectCubeTexture9( UINT Order, IDirect3DCubeTexture9* pCubeTexture, FLOAT* pROut,
+                                           FLOAT* pGOut, FLOAT* pBOut, UINT nThreads = 0 );
+
+
+//--------------------------------------------------------------------------------------
+// The cluster bases of compressed PRT.  Each frame every cluster needs the dot product
+// of the source radiance with its mean and with each of its PCA vectors, for every
+// channel, which is a matrix times a vector.  The rows of each cluster and channel are
+// kept four to a group, interleaved coefficient by coefficient and 16 byte aligned, so
+// SSE2 works out four dot products at once; the plain C++ code takes the same rows in
+// the same order and gives the same results as DXUTSHDot.  Blocks of clusters are
+// shared with the DXUT worker pool when there are enough of them to be worth waking
+// its threads for.
+//--------------------------------------------------------------------------------------
+class CDXUTPRTClusterBasis
+{
+public:
+                        CDXUTPRTClusterBasis();
+                        ~CDXUTPRTClusterBasis();
+
+    // pBases holds nClusters bases as ID3DXPRTCompBuffer::ExtractBasis gives them: the
+    // mean and then each PCA vector, each with Order * Order coefficients for each of
+    // nChannels channels.  nThreads 0 uses a thread for each processor.
+    HRESULT             Create( const FLOAT* pBases, UINT nClusters, UINT nChannels, UINT nPCA, UINT Order,
+                                UINT nThreads = 0, DWORD dwFlags = 0 );
+    void                Destroy();
+
+    // Writes GetNumConstants() floats to pConstants, laid out as the aPRTConstants of the
+    // PRT effects: for each cluster the mean of each channel padded to 4 floats, then the
+    // PCA vectors of the first channel, then those of the next.  pGreen and pBlue are
+    // only read for bases with that many channels.
+    //
+    // Returns S_FALSE, and leaves pConstants as it is, when no coefficient has moved by
+    // more than fThreshold times the largest coefficient since the constants were last
+    // computed, so the caller can keep the constants it has.
+    HRESULT             ComputeConstants( const FLOAT* pRed, const FLOAT* pGreen, const FLOAT* pBlue,
+                                          FLOAT* pConstants, FLOAT fThreshold = 0.0f );
+
+    // The next ComputeConstants computes the constants whatever the lighting, as it
+    // must when they are to be given to a new effect
+    void                Invalidate()
+    {
+        m_bValid = false;
+    }
+
+    UINT                GetNumConstants() const
+    {
+        return m_nClusters * m_ClusterStride;
+    }
+    UINT                GetNumThreads() const
+    {
+        return m_nThreads;
+    }
+
+protected:
+    static void         BlockProc( void* pContext, UINT iBlock, UINT iThread );
+
+    void                ComputeBlock( UINT iBlock );
+
+    float*              m_pRows;            // Groups of 4 rows, Order * Order * 4 floats each
+    float*              m_pLight;           // Each coefficient of each channel 4 times over
+    float               m_afLastLight[3][DXUT_SH_MAX_COEFFS];
+    bool                m_bValid;
+    UINT                m_nClusters;
+    UINT                m_nChannels;
+    UINT                m_nPCA;
+    UINT                m_Order;
+    UINT                m_nGroups;          // Groups for each cluster and channel
+    UINT                m_ClusterStride;    // Constants for each cluster
+    DWORD               m_dwFlags;
+
+    // Up to m_nThreads threads work on the clusters, counting the one calling
+    // ComputeConstants
+    UINT                m_nThreads;
+    float*              m_pConstants;
+    UINT                m_nBlocks;
+};
+
+#endif
@@ -0,0 +1,96 @@
+//--------------------------------------------------------------------------------------
+// File: SDKSHBasis.h
+//
+// The real spherical harmonics in a direction, as SDKSH evaluates them, for code that
+// builds without DXUT.h.  DXUTSHEvalBasis is a template so SDKSH can run it on four
+// directions at once with SSE2 and get the same results as on plain floats.
+//
+// UINT comes from windows.h, or from DXUTWorkerPool.h off Windows.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#pragma once
+#ifndef SDKSH_BASIS_H
+#define SDKSH_BASIS_H
+
+#define DXUT_SH_MIN_ORDER       1
+#define DXUT_SH_MAX_ORDER       6
+#define DXUT_SH_MAX_COEFFS      ( DXUT_SH_MAX_ORDER * DXUT_SH_MAX_ORDER )
+
+//--------------------------------------------------------------------------------------
+// The harmonics are evaluated as in "Spherical Harmonic Lighting: The Gritty Details",
+// with the sin^m factor of the associated Legendre polynomials folded into cos(m phi)
+// and sin(m phi), which are then polynomials in x and y.  Q(l,m) is the Legendre part
+// times the normalization, with Q(m,m) = g_afSHStart[m] and
+// Q(l,m) = a(l,m) * z * Q(l-1,m) + b(l,m) * Q(l-2,m).
+//--------------------------------------------------------------------------------------
+static const float g_afSHStart[DXUT_SH_MAX_ORDER] =
+{
+    0.282094792f, -0.488602512f, 0.546274215f, -0.59004359f, 0.625835735f, -0.656382057f
+};
+
+// { a(l,m), b(l,m) } for l > m
+static const float g_aafSHRecurrence[DXUT_SH_MAX_ORDER][DXUT_SH_MAX_ORDER][2] =
+{
+    { { 0.0f, 0.0f } },
+    { { 1.73205081f, 0.0f } },
+    { { 1.93649167f, -1.11803399f }, { 2.23606798f, 0.0f } },
+    { { 1.97202659f, -1.01835015f }, { 2.09165007f, -0.935414347f }, { 2.64575131f, 0.0f } },
+    { { 1.98431348f, -1.00623059f }, { 2.04939015f, -0.979795897f }, { 2.29128785f, -0.866025404f },
+      { 3.0f, 0.0f } },
+    { { 1.98997487f, -1.00285307f }, { 2.0310096f, -0.991031209f }, { 2.17124059f, -0.947607083f },
+      { 2.48746859f, -0.829156198f }, { 3.31662479f, 0.0f } },
+};
+
+
+//--------------------------------------------------------------------------------------
+// The Order * Order harmonics in unit direction x, y, z, harmonic l,m at l * l + l + m
+//--------------------------------------------------------------------------------------
+template <class V> static inline void DXUTSHEvalBasis( UINT Order, V x, V y, V z, V* pY )
+{
+    // cos(m phi) and sin(m phi) times sin^m theta
+    V c = V( 1.0f );
+    V s = V( 0.0f );
+
+    for( UINT m = 0; m < Order; m++ )
+    {
+        if( m > 0 )
+        {
+            V cPrev = c;
+            c = x * cPrev - y * s;
+            s = x * s + y * cPrev;
+        }
+
+        V q2 = V( 0.0f );
+        V q1 = V( g_afSHStart[m] );
+        for( UINT l = m; l < Order; l++ )
+        {
+            V q;
+            if( l == m )
+                q = q1;
+            else if( l == m + 1 )
+                q = V( g_aafSHRecurrence[l][m][0] ) * ( z * q1 );
+            else
+                q = V( g_aafSHRecurrence[l][m][0] ) * ( z * q1 ) + V( g_aafSHRecurrence[l][m][1] ) * q2;
+
+            if( 0 == m )
+            {
+                pY[l * l + l] = q;
+            }
+            else
+            {
+                pY[l * l + l + m] = q * c;
+                pY[l * l + l - m] = q * s;
+            }
+
+            if( l > m )
+            {
+                q2 = q1;
+                q1 = q;
+            }
+        }
+    }
+}
+
+#endif
@@ -1571,13 +1571,15 @@ void CDXUTTextHelper::Init( ID3DXFont* pFont9, ID3DXSprite* pSprite9, ID3DX10Fon
 //--------------------------------------------------------------------------------------
 HRESULT CDXUTTextHelper::DrawFormattedTextLine( const WCHAR* strMsg, ... )
 {
-    WCHAR strBuffer[512];
+    // Format into scratch memory so long lines aren't cut off
+    CDXUTScratchScope Scratch;
 
     va_list args;
     va_start( args, strMsg );
-    vswprintf_s( strBuffer, 512, strMsg, args );
-    strBuffer[511] = L'\0';
+    WCHAR* strBuffer = Scratch.GetArena()->FormatText( strMsg, args );
     va_end( args );
+    if( strBuffer == NULL )
+        return E_OUTOFMEMORY;
 
     return DrawTextLine( strBuffer );
 }
@@ -1607,13 +1609,15 @@ HRESULT CDXUTTextHelper::DrawTextLine( const WCHAR* strMsg )
 
 HRESULT CDXUTTextHelper::DrawFormattedTextLine( RECT& rc, DWORD dwFlags, const WCHAR* strMsg, ... )
 {
-    WCHAR strBuffer[512];
+    // Format into scratch memory so long lines aren't cut off
+    CDXUTScratchScope Scratch;
 
     va_list args;
     va_start( args, strMsg );
-    vswprintf_s( strBuffer, 512, strMsg, args );
-    strBuffer[511] = L'\0';
+    WCHAR* strBuffer = Scratch.GetArena()->FormatText( strMsg, args );
     va_end( args );
+    if( strBuffer == NULL )
+        return E_OUTOFMEMORY;
 
     return DrawTextLine( rc, dwFlags, strBuffer );
 }
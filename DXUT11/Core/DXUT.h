@@ -68,6 +68,8 @@
 #include <math.h>
 #include <limits.h>
 #include <stdio.h>
+#include <type_traits> // for CGrowableArray
+#include <utility>
 
 // CRT's memory leak detection
 #if defined(DEBUG) || defined(_DEBUG)
@@ -80,28 +80,68 @@ HRESULT DXUTSnapD3D9Screenshot( LPCTSTR szFileName );
 HRESULT DXUTSnapD3D11Screenshot( LPCTSTR szFileName, D3DX11_IMAGE_FILE_FORMAT iff = D3DX11_IFF_DDS  );
 
 
+//--------------------------------------------------------------------------------------
+// Default allocator for CGrowableArray.  Allocators provide
+//
+//      void* Allocate( size_t cbSize );
+//      void* Reallocate( void* pData, size_t cbOldSize, size_t cbNewSize );
+//      void  Free( void* pData );
+//
+// returning memory aligned for the element type, or NULL on failure.  Reallocate is only
+// used for elements that can be moved with memcpy, and must leave pData untouched if it
+// fails.  Arrays keep a copy of their allocator, so an allocator for an arena or a frame
+// heap should hold a pointer to it.
+//--------------------------------------------------------------------------------------
+struct CGrowableArrayHeap
+{
+    void*   Allocate( size_t cbSize ) { return malloc( cbSize ); }
+    void*   Reallocate( void* pData, size_t cbOldSize, size_t cbNewSize ) { UNREFERENCED_PARAMETER( cbOldSize ); return realloc( pData, cbNewSize ); }
+    void    Free( void* pData ) { free( pData ); }
+};
+
+template<typename TYPE, typename ALLOC = CGrowableArrayHeap> class CGrowableArray;
+
+//--------------------------------------------------------------------------------------
+// Elements for which this is true are moved with memcpy when an array grows or shifts,
+// everything else is move constructed.  Specialize it for types that own resources but
+// never point into themselves, such as COM smart pointers.
+//--------------------------------------------------------------------------------------
+template<typename TYPE> struct DXUTIsRelocatable : std::is_trivially_copyable<TYPE> {};
+template<typename TYPE, typename ALLOC> struct DXUTIsRelocatable< CGrowableArray<TYPE, ALLOC> > : std::true_type {};
+
 //--------------------------------------------------------------------------------------
 // A growable array
 //--------------------------------------------------------------------------------------
-template<typename TYPE> class CGrowableArray
+template<typename TYPE, typename ALLOC> class CGrowableArray
 {
 public:
-    CGrowableArray()  { m_pData = NULL; m_nSize = 0; m_nMaxSize = 0; }
-    CGrowableArray( const CGrowableArray<TYPE>& a ) { for( int i=0; i < a.m_nSize; i++ ) Add( a.m_pData[i] ); }
+    CGrowableArray()  { Construct( NULL, 0 ); }
+    explicit CGrowableArray( const ALLOC& Alloc ) : m_Alloc( Alloc ) { Construct( NULL, 0 ); }
+    CGrowableArray( const CGrowableArray<TYPE, ALLOC>& a ) : m_Alloc( a.m_Alloc ) { Construct( NULL, 0 ); Copy( a ); }
+    CGrowableArray( CGrowableArray<TYPE, ALLOC>&& a ) : m_Alloc( a.m_Alloc ) { Construct( NULL, 0 ); Move( a ); }
     ~CGrowableArray() { RemoveAll(); }
 
     const TYPE& operator[]( int nIndex ) const { return GetAt( nIndex ); }
     TYPE& operator[]( int nIndex ) { return GetAt( nIndex ); }
    
-    CGrowableArray& operator=( const CGrowableArray<TYPE>& a ) { if( this == &a ) return *this; RemoveAll(); for( int i=0; i < a.m_nSize; i++ ) Add( a.m_pData[i] ); return *this; }
+    CGrowableArray& operator=( const CGrowableArray<TYPE, ALLOC>& a ) { if( this == &a ) return *this; Reset(); Copy( a ); return *this; }
+    CGrowableArray& operator=( CGrowableArray<TYPE, ALLOC>&& a ) { if( this == &a ) return *this; RemoveAll(); Move( a ); return *this; }
 
     HRESULT SetSize( int nNewMaxSize );
-    HRESULT Add( const TYPE& value );
+    HRESULT Reserve( int nNewMaxSize );         // Allocates exactly, without adding elements
+    HRESULT Add( const TYPE& value ) { return Emplace( value ); }
+    HRESULT Add( TYPE&& value ) { return Emplace( std::move( value ) ); }
+    template<typename... ARGS> HRESULT Emplace( ARGS&&... args );   // Constructs in place at the end
     HRESULT Insert( int nIndex, const TYPE& value );
+    HRESULT Insert( int nIndex, TYPE&& value );
     HRESULT SetAt( int nIndex, const TYPE& value );
+    HRESULT SetAt( int nIndex, TYPE&& value );
     TYPE&   GetAt( int nIndex ) const { assert( nIndex >= 0 && nIndex < m_nSize ); return m_pData[nIndex]; }
     int     GetSize() const { return m_nSize; }
+    int     GetCapacity() const { return m_nMaxSize; }
     TYPE*   GetData() { return m_pData; }
+    const TYPE* GetData() const { return m_pData; }
+    ALLOC&  GetAllocator() { return m_Alloc; }
     bool    Contains( const TYPE& value ){ return ( -1 != IndexOf( value ) ); }
 
     int     IndexOf( const TYPE& value ) { return ( m_nSize > 0 ) ? IndexOf( value, 0, m_nSize ) : -1; }
@@ -113,15 +153,58 @@ public:
     int     LastIndexOf( const TYPE& value, int nIndex, int nNumElements );
 
     HRESULT Remove( int nIndex );
+    HRESULT SwapRemove( int nIndex );           // Moves the last element into the gap, so order isn't kept
     void    RemoveAll() { SetSize(0); }
-    void	Reset() { m_nSize = 0; }
+    void	Reset() { for( int i = 0; i < m_nSize; ++i ) m_pData[i].~TYPE(); m_nSize = 0; }   // Keeps the memory
 
 protected:
+    // For CSmallGrowableArray, which starts out in storage of its own
+    CGrowableArray( TYPE* pInline, int nInlineSize, const ALLOC& Alloc ) : m_Alloc( Alloc ) { Construct( pInline, nInlineSize ); }
+
     TYPE* m_pData;      // the actual array of data
     int m_nSize;        // # of elements (upperBound - 1)
     int m_nMaxSize;     // max allocated
+    TYPE* m_pInline;    // storage that isn't freed, or NULL
+    int m_nInlineSize;  // # of elements that fit in m_pInline
+    ALLOC m_Alloc;
 
+    void    Construct( TYPE* pInline, int nInlineSize ) { m_pData = m_pInline = pInline; m_nSize = 0; m_nMaxSize = m_nInlineSize = nInlineSize; }
+    HRESULT Copy( const CGrowableArray<TYPE, ALLOC>& a );   // Expects an empty array
+    void    Move( CGrowableArray<TYPE, ALLOC>& a );         // Expects an empty array with no memory
     HRESULT SetSizeInternal( int nNewMaxSize );  // This version doesn't call ctor or dtor.
+    HRESULT Reallocate( int nNewMaxSize );
+    HRESULT InsertInternal( int nIndex, TYPE& value );
+
+    // Element moves, with memcpy for the types that allow it
+    static void CopyElements( TYPE* pDest, const TYPE* pSrc, int nCount, std::true_type );
+    static void CopyElements( TYPE* pDest, const TYPE* pSrc, int nCount, std::false_type );
+    static void Relocate( TYPE* pDest, TYPE* pSrc, int nCount, std::true_type );
+    static void Relocate( TYPE* pDest, TYPE* pSrc, int nCount, std::false_type );
+    static void OpenGap( TYPE* pData, int nIndex, int nSize, std::true_type );
+    static void OpenGap( TYPE* pData, int nIndex, int nSize, std::false_type );
+    static void CloseGap( TYPE* pData, int nIndex, int nSize, std::true_type );
+    static void CloseGap( TYPE* pData, int nIndex, int nSize, std::false_type );
+};
+
+
+//--------------------------------------------------------------------------------------
+// A growable array that holds its first INLINE_COUNT elements inside the object, so short
+// lists never allocate.  It can't be moved with memcpy.
+//--------------------------------------------------------------------------------------
+template<typename TYPE, int INLINE_COUNT, typename ALLOC = CGrowableArrayHeap> class CSmallGrowableArray : public CGrowableArray<TYPE, ALLOC>
+{
+public:
+    CSmallGrowableArray() : CGrowableArray<TYPE, ALLOC>( ( TYPE* )m_Storage, INLINE_COUNT, ALLOC() ) {}
+    explicit CSmallGrowableArray( const ALLOC& Alloc ) : CGrowableArray<TYPE, ALLOC>( ( TYPE* )m_Storage, INLINE_COUNT, Alloc ) {}
+    CSmallGrowableArray( const CSmallGrowableArray& a ) : CGrowableArray<TYPE, ALLOC>( ( TYPE* )m_Storage, INLINE_COUNT, a.m_Alloc ) { this->Copy( a ); }
+    CSmallGrowableArray( CSmallGrowableArray&& a ) : CGrowableArray<TYPE, ALLOC>( ( TYPE* )m_Storage, INLINE_COUNT, a.m_Alloc ) { this->Move( a ); }
+    ~CSmallGrowableArray() { this->RemoveAll(); }
+
+    CSmallGrowableArray& operator=( const CSmallGrowableArray& a ) { CGrowableArray<TYPE, ALLOC>::operator=( a ); return *this; }
+    CSmallGrowableArray& operator=( CSmallGrowableArray&& a ) { CGrowableArray<TYPE, ALLOC>::operator=( std::move( a ) ); return *this; }
+
+private:
+    typename std::aligned_storage<sizeof( TYPE ), __alignof( TYPE )>::type m_Storage[INLINE_COUNT];
 };
 
 
@@ -378,7 +461,7 @@ void WINAPI DXUTGetDesktopResolution( UINT AdapterOrdinal, UINT* pWidth, UINT* p
 //--------------------------------------------------------------------------------------
 
 // This version doesn't call ctor or dtor.
-template<typename TYPE> HRESULT CGrowableArray <TYPE>::SetSizeInternal( int nNewMaxSize )
+template<typename TYPE, typename ALLOC> HRESULT CGrowableArray <TYPE, ALLOC>::SetSizeInternal( int nNewMaxSize )
 {
     if( nNewMaxSize < 0 || ( nNewMaxSize > INT_MAX / sizeof( TYPE ) ) )
     {
@@ -389,93 +472,129 @@ template<typename TYPE> HRESULT CGrowableArray <TYPE>::SetSizeInternal( int nNew
     if( nNewMaxSize == 0 )
     {
         // Shrink to 0 size & cleanup
-        if( m_pData )
-        {
-            free( m_pData );
-            m_pData = NULL;
-        }
+        if( m_pData != m_pInline )
+            m_Alloc.Free( m_pData );
 
-        m_nMaxSize = 0;
+        m_pData = m_pInline;
+        m_nMaxSize = m_nInlineSize;
         m_nSize = 0;
     }
-    else if( m_pData == NULL || nNewMaxSize > m_nMaxSize )
+    else if( nNewMaxSize > m_nMaxSize )
     {
         // Grow array
         int nGrowBy = ( m_nMaxSize == 0 ) ? 16 : m_nMaxSize;
 
-        // Limit nGrowBy to keep m_nMaxSize less than INT_MAX
-        if( ( UINT )m_nMaxSize + ( UINT )nGrowBy > ( UINT )INT_MAX )
-            nGrowBy = INT_MAX - m_nMaxSize;
+        // Limit nGrowBy to keep (m_nMaxSize * sizeof(TYPE)) less than INT_MAX
+        int nLimit = ( int )( INT_MAX / sizeof( TYPE ) );
+        if( nGrowBy > nLimit - m_nMaxSize )
+            nGrowBy = nLimit - m_nMaxSize;
 
-        nNewMaxSize = __max( nNewMaxSize, m_nMaxSize + nGrowBy );
+        return Reallocate( __max( nNewMaxSize, m_nMaxSize + nGrowBy ) );
+    }
+
+    return S_OK;
+}
 
-        // Verify that (nNewMaxSize * sizeof(TYPE)) is not greater than UINT_MAX or the realloc will overrun
-        if( sizeof( TYPE ) > UINT_MAX / ( UINT )nNewMaxSize )
-            return E_INVALIDARG;
 
-        TYPE* pDataNew = ( TYPE* )realloc( m_pData, nNewMaxSize * sizeof( TYPE ) );
+//--------------------------------------------------------------------------------------
+// Moves the elements into an allocation of exactly nNewMaxSize elements
+//--------------------------------------------------------------------------------------
+template<typename TYPE, typename ALLOC> HRESULT CGrowableArray <TYPE, ALLOC>::Reallocate( int nNewMaxSize )
+{
+    assert( nNewMaxSize >= m_nSize );
+
+    TYPE* pDataNew;
+    if( DXUTIsRelocatable <TYPE>::value && m_pData != m_pInline )
+    {
+        // The allocator may be able to grow the block where it is
+        pDataNew = ( TYPE* )m_Alloc.Reallocate( m_pData, m_nMaxSize * sizeof( TYPE ), nNewMaxSize * sizeof( TYPE ) );
+        if( pDataNew == NULL )
+            return E_OUTOFMEMORY;
+    }
+    else
+    {
+        pDataNew = ( TYPE* )m_Alloc.Allocate( nNewMaxSize * sizeof( TYPE ) );
         if( pDataNew == NULL )
             return E_OUTOFMEMORY;
 
-        m_pData = pDataNew;
-        m_nMaxSize = nNewMaxSize;
+        Relocate( pDataNew, m_pData, m_nSize, DXUTIsRelocatable <TYPE>() );
+        if( m_pData != m_pInline )
+            m_Alloc.Free( m_pData );
     }
 
+    m_pData = pDataNew;
+    m_nMaxSize = nNewMaxSize;
+
     return S_OK;
 }
 
 
 //--------------------------------------------------------------------------------------
-template<typename TYPE> HRESULT CGrowableArray <TYPE>::SetSize( int nNewMaxSize )
+template<typename TYPE, typename ALLOC> HRESULT CGrowableArray <TYPE, ALLOC>::SetSize( int nNewMaxSize )
 {
-    int nOldSize = m_nSize;
-
-    if( nOldSize > nNewMaxSize )
+    if( nNewMaxSize < 0 )
     {
-        assert( m_pData );
-        if( m_pData )
-        {
-            // Removing elements. Call dtor.
-
-            for( int i = nNewMaxSize; i < nOldSize; ++i )
-                m_pData[i].~TYPE();
-        }
+        assert( false );
+        return E_INVALIDARG;
     }
 
-    // Adjust buffer.  Note that there's no need to check for error
-    // since if it happens, nOldSize == nNewMaxSize will be true.)
+    // Removing elements. Call dtor.
+    for( int i = nNewMaxSize; i < m_nSize; ++i )
+        m_pData[i].~TYPE();
+    if( m_nSize > nNewMaxSize )
+        m_nSize = nNewMaxSize;
+
+    // Adjust buffer
     HRESULT hr = SetSizeInternal( nNewMaxSize );
+    if( FAILED( hr ) )
+        return hr;
+
+    // Adding elements. Call ctor.
+    for( int i = m_nSize; i < nNewMaxSize; ++i )
+        ::new ( &m_pData[i] ) TYPE;
+    m_nSize = nNewMaxSize;
 
-    if( nOldSize < nNewMaxSize )
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+template<typename TYPE, typename ALLOC> HRESULT CGrowableArray <TYPE, ALLOC>::Reserve( int nNewMaxSize )
+{
+    if( nNewMaxSize < 0 || ( nNewMaxSize > INT_MAX / sizeof( TYPE ) ) )
     {
-        assert( m_pData );
-        if( m_pData )
-        {
-            // Adding elements. Call ctor.
-
-            for( int i = nOldSize; i < nNewMaxSize; ++i )
-                ::new ( &m_pData[i] ) TYPE;
-        }
+        assert( false );
+        return E_INVALIDARG;
     }
 
-    return hr;
+    if( nNewMaxSize <= m_nMaxSize )
+        return S_OK;
+
+    return Reallocate( nNewMaxSize );
 }
 
 
 //--------------------------------------------------------------------------------------
-template<typename TYPE> HRESULT CGrowableArray <TYPE>::Add( const TYPE& value )
+template<typename TYPE, typename ALLOC> template<typename... ARGS>
+HRESULT CGrowableArray <TYPE, ALLOC>::Emplace( ARGS&&... args )
 {
-    HRESULT hr;
-    if( FAILED( hr = SetSizeInternal( m_nSize + 1 ) ) )
-        return hr;
+    if( m_nSize < m_nMaxSize )
+    {
+        ::new ( &m_pData[m_nSize] ) TYPE( std::forward <ARGS>( args )... );
+    }
+    else
+    {
+        // The arguments may refer to elements of this array, which move when it grows,
+        // so construct the new element first
+        TYPE value( std::forward <ARGS>( args )... );
 
-    assert( m_pData != NULL );
+        HRESULT hr;
+        if( FAILED( hr = SetSizeInternal( m_nSize + 1 ) ) )
+            return hr;
 
-    // Construct the new element
-    ::new ( &m_pData[m_nSize] ) TYPE;
+        ::new ( &m_pData[m_nSize] ) TYPE( std::move( value ) );
+    }
 
-    // Assign
-    m_pData[m_nSize] = value;
     ++m_nSize;
 
     return S_OK;
@@ -483,10 +602,25 @@ template<typename TYPE> HRESULT CGrowableArray <TYPE>::Add( const TYPE& value )
 
 
 //--------------------------------------------------------------------------------------
-template<typename TYPE> HRESULT CGrowableArray <TYPE>::Insert( int nIndex, const TYPE& value )
+template<typename TYPE, typename ALLOC> HRESULT CGrowableArray <TYPE, ALLOC>::Insert( int nIndex, const TYPE& value )
 {
-    HRESULT hr;
+    // Validate index
+    if( nIndex < 0 ||
+        nIndex > m_nSize )
+    {
+        assert( false );
+        return E_INVALIDARG;
+    }
+
+    // Copy first, in case value is an element that is about to move
+    TYPE copy( value );
+    return InsertInternal( nIndex, copy );
+}
+
 
+//--------------------------------------------------------------------------------------
+template<typename TYPE, typename ALLOC> HRESULT CGrowableArray <TYPE, ALLOC>::Insert( int nIndex, TYPE&& value )
+{
     // Validate index
     if( nIndex < 0 ||
         nIndex > m_nSize )
@@ -495,18 +629,25 @@ template<typename TYPE> HRESULT CGrowableArray <TYPE>::Insert( int nIndex, const
         return E_INVALIDARG;
     }
 
+    TYPE temp( std::move( value ) );
+    return InsertInternal( nIndex, temp );
+}
+
+
+//--------------------------------------------------------------------------------------
+template<typename TYPE, typename ALLOC> HRESULT CGrowableArray <TYPE, ALLOC>::InsertInternal( int nIndex, TYPE& value )
+{
+    HRESULT hr;
+
     // Prepare the buffer
     if( FAILED( hr = SetSizeInternal( m_nSize + 1 ) ) )
         return hr;
 
     // Shift the array
-    MoveMemory( &m_pData[nIndex + 1], &m_pData[nIndex], sizeof( TYPE ) * ( m_nSize - nIndex ) );
+    OpenGap( m_pData, nIndex, m_nSize, DXUTIsRelocatable <TYPE>() );
 
-    // Construct the new element
-    ::new ( &m_pData[nIndex] ) TYPE;
-
-    // Set the value and increase the size
-    m_pData[nIndex] = value;
+    // Construct the new element and increase the size
+    ::new ( &m_pData[nIndex] ) TYPE( std::move( value ) );
     ++m_nSize;
 
     return S_OK;
@@ -514,7 +655,7 @@ template<typename TYPE> HRESULT CGrowableArray <TYPE>::Insert( int nIndex, const
 
 
 //--------------------------------------------------------------------------------------
-template<typename TYPE> HRESULT CGrowableArray <TYPE>::SetAt( int nIndex, const TYPE& value )
+template<typename TYPE, typename ALLOC> HRESULT CGrowableArray <TYPE, ALLOC>::SetAt( int nIndex, const TYPE& value )
 {
     // Validate arguments
     if( nIndex < 0 ||
@@ -529,13 +670,29 @@ template<typename TYPE> HRESULT CGrowableArray <TYPE>::SetAt( int nIndex, const
 }
 
 
+//--------------------------------------------------------------------------------------
+template<typename TYPE, typename ALLOC> HRESULT CGrowableArray <TYPE, ALLOC>::SetAt( int nIndex, TYPE&& value )
+{
+    // Validate arguments
+    if( nIndex < 0 ||
+        nIndex >= m_nSize )
+    {
+        assert( false );
+        return E_INVALIDARG;
+    }
+
+    m_pData[nIndex] = std::move( value );
+    return S_OK;
+}
+
+
 //--------------------------------------------------------------------------------------
 // Searches for the specified value and returns the index of the first occurrence
 // within the section of the data array that extends from iStart and contains the 
 // specified number of elements. Returns -1 if value is not found within the given 
 // section.
 //--------------------------------------------------------------------------------------
-template<typename TYPE> int CGrowableArray <TYPE>::IndexOf( const TYPE& value, int iStart, int nNumElements )
+template<typename TYPE, typename ALLOC> int CGrowableArray <TYPE, ALLOC>::IndexOf( const TYPE& value, int iStart, int nNumElements )
 {
     // Validate arguments
     if( iStart < 0 ||
@@ -564,7 +721,7 @@ template<typename TYPE> int CGrowableArray <TYPE>::IndexOf( const TYPE& value, i
 // within the section of the data array that contains the specified number of elements
 // and ends at iEnd. Returns -1 if value is not found within the given section.
 //--------------------------------------------------------------------------------------
-template<typename TYPE> int CGrowableArray <TYPE>::LastIndexOf( const TYPE& value, int iEnd, int nNumElements )
+template<typename TYPE, typename ALLOC> int CGrowableArray <TYPE, ALLOC>::LastIndexOf( const TYPE& value, int iEnd, int nNumElements )
 {
     // Validate arguments
     if( iEnd < 0 ||
@@ -590,7 +747,25 @@ template<typename TYPE> int CGrowableArray <TYPE>::LastIndexOf( const TYPE& valu
 
 
 //--------------------------------------------------------------------------------------
-template<typename TYPE> HRESULT CGrowableArray <TYPE>::Remove( int nIndex )
+template<typename TYPE, typename ALLOC> HRESULT CGrowableArray <TYPE, ALLOC>::Remove( int nIndex )
+{
+    if( nIndex < 0 ||
+        nIndex >= m_nSize )
+    {
+        assert( false );
+        return E_INVALIDARG;
+    }
+
+    // Destruct the element to be removed, compact the array and decrease the size
+    CloseGap( m_pData, nIndex, m_nSize, DXUTIsRelocatable <TYPE>() );
+    --m_nSize;
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+template<typename TYPE, typename ALLOC> HRESULT CGrowableArray <TYPE, ALLOC>::SwapRemove( int nIndex )
 {
     if( nIndex < 0 ||
         nIndex >= m_nSize )
@@ -599,16 +774,139 @@ template<typename TYPE> HRESULT CGrowableArray <TYPE>::Remove( int nIndex )
         return E_INVALIDARG;
     }
 
-    // Destruct the element to be removed
-    m_pData[nIndex].~TYPE();
+    if( nIndex != m_nSize - 1 )
+        m_pData[nIndex] = std::move( m_pData[m_nSize - 1] );
 
-    // Compact the array and decrease the size
-    MoveMemory( &m_pData[nIndex], &m_pData[nIndex + 1], sizeof( TYPE ) * ( m_nSize - ( nIndex + 1 ) ) );
+    m_pData[m_nSize - 1].~TYPE();
     --m_nSize;
 
     return S_OK;
 }
 
+
+//--------------------------------------------------------------------------------------
+template<typename TYPE, typename ALLOC> HRESULT CGrowableArray <TYPE, ALLOC>::Copy( const CGrowableArray <TYPE, ALLOC>& a )
+{
+    HRESULT hr;
+
+    assert( m_nSize == 0 );
+    if( FAILED( hr = Reserve( a.m_nSize ) ) )
+        return hr;
+
+    CopyElements( m_pData, a.m_pData, a.m_nSize, std::is_trivially_copyable <TYPE>() );
+    m_nSize = a.m_nSize;
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+template<typename TYPE, typename ALLOC> void CGrowableArray <TYPE, ALLOC>::Move( CGrowableArray <TYPE, ALLOC>& a )
+{
+    assert( m_nSize == 0 && m_pData == m_pInline );
+
+    if( a.m_pData != a.m_pInline )
+    {
+        // Take the other array's memory
+        m_Alloc = a.m_Alloc;
+        m_pData = a.m_pData;
+        m_nSize = a.m_nSize;
+        m_nMaxSize = a.m_nMaxSize;
+
+        a.m_pData = a.m_pInline;
+        a.m_nSize = 0;
+        a.m_nMaxSize = a.m_nInlineSize;
+    }
+    else if( SUCCEEDED( Reserve( a.m_nSize ) ) )
+    {
+        // Elements inside a CSmallGrowableArray have to be moved one at a time
+        Relocate( m_pData, a.m_pData, a.m_nSize, DXUTIsRelocatable <TYPE>() );
+        m_nSize = a.m_nSize;
+        a.m_nSize = 0;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Copy constructs nCount elements into raw memory
+//--------------------------------------------------------------------------------------
+template<typename TYPE, typename ALLOC> void CGrowableArray <TYPE, ALLOC>::CopyElements( TYPE* pDest, const TYPE* pSrc,
+                                                                                        int nCount, std::true_type )
+{
+    if( nCount > 0 )
+        memcpy( pDest, pSrc, sizeof( TYPE ) * nCount );
+}
+
+template<typename TYPE, typename ALLOC> void CGrowableArray <TYPE, ALLOC>::CopyElements( TYPE* pDest, const TYPE* pSrc,
+                                                                                        int nCount, std::false_type )
+{
+    for( int i = 0; i < nCount; ++i )
+        ::new ( &pDest[i] ) TYPE( pSrc[i] );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Moves nCount elements into raw memory, leaving raw memory behind
+//--------------------------------------------------------------------------------------
+template<typename TYPE, typename ALLOC> void CGrowableArray <TYPE, ALLOC>::Relocate( TYPE* pDest, TYPE* pSrc,
+                                                                                    int nCount, std::true_type )
+{
+    if( nCount > 0 )
+        memcpy( pDest, pSrc, sizeof( TYPE ) * nCount );
+}
+
+template<typename TYPE, typename ALLOC> void CGrowableArray <TYPE, ALLOC>::Relocate( TYPE* pDest, TYPE* pSrc,
+                                                                                    int nCount, std::false_type )
+{
+    for( int i = 0; i < nCount; ++i )
+    {
+        ::new ( &pDest[i] ) TYPE( std::move( pSrc[i] ) );
+        pSrc[i].~TYPE();
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Shifts elements nIndex..nSize-1 up by one, leaving raw memory at nIndex.  There must
+// be room for nSize + 1 elements.
+//--------------------------------------------------------------------------------------
+template<typename TYPE, typename ALLOC> void CGrowableArray <TYPE, ALLOC>::OpenGap( TYPE* pData, int nIndex, int nSize,
+                                                                                   std::true_type )
+{
+    MoveMemory( &pData[nIndex + 1], &pData[nIndex], sizeof( TYPE ) * ( nSize - nIndex ) );
+}
+
+template<typename TYPE, typename ALLOC> void CGrowableArray <TYPE, ALLOC>::OpenGap( TYPE* pData, int nIndex, int nSize,
+                                                                                   std::false_type )
+{
+    if( nIndex == nSize )
+        return;
+
+    ::new ( &pData[nSize] ) TYPE( std::move( pData[nSize - 1] ) );
+    for( int i = nSize - 1; i > nIndex; --i )
+        pData[i] = std::move( pData[i - 1] );
+    pData[nIndex].~TYPE();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Destroys element nIndex and shifts the elements above it down by one
+//--------------------------------------------------------------------------------------
+template<typename TYPE, typename ALLOC> void CGrowableArray <TYPE, ALLOC>::CloseGap( TYPE* pData, int nIndex, int nSize,
+                                                                                    std::true_type )
+{
+    pData[nIndex].~TYPE();
+    MoveMemory( &pData[nIndex], &pData[nIndex + 1], sizeof( TYPE ) * ( nSize - ( nIndex + 1 ) ) );
+}
+
+template<typename TYPE, typename ALLOC> void CGrowableArray <TYPE, ALLOC>::CloseGap( TYPE* pData, int nIndex, int nSize,
+                                                                                    std::false_type )
+{
+    for( int i = nIndex; i < nSize - 1; ++i )
+        pData[i] = std::move( pData[i + 1] );
+    pData[nSize - 1].~TYPE();
+}
+
 //--------------------------------------------------------------------------------------
 // Creates a REF or NULLREF D3D9 device and returns that device.  The caller should call
 // Release() when done with the device.
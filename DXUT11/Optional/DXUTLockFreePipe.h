@@ -13,47 +13,67 @@
 #pragma once
 
 #include <sal.h>
+#include <string.h>
+#include <malloc.h>
+#include <atomic>
 
-#ifdef _XBOX_VER
-    // Prevent the CPU from rearranging loads
-    // and stores, sufficiently for read-acquire
-    // and write-release.
-    #define DXUTImportBarrier __lwsync
-    #define DXUTExportBarrier __lwsync
-#else
-    #pragma pack(push)
-    #pragma pack(8)
-    #include <windows.h>
-    #pragma pack (pop)
-
-    extern "C"
-        void _ReadWriteBarrier();
-    #pragma intrinsic(_ReadWriteBarrier)
-
-    // Prevent the compiler from rearranging loads
-    // and stores, sufficiently for read-acquire
-    // and write-release. This is sufficient on
-    // x86 and x64.
-    #define DXUTImportBarrier _ReadWriteBarrier
-    #define DXUTExportBarrier _ReadWriteBarrier
-#endif
+#pragma pack(push)
+#pragma pack(8)
+#include <windows.h>
+#pragma pack (pop)
+
+// The read-acquire and write-release ordering that these barriers used to provide
+// is now expressed directly on the std::atomic offsets below, which is correct on
+// every architecture rather than only on x86/x64. The macros are kept for any
+// external code that still uses them.
+#define DXUTImportBarrier() std::atomic_thread_fence( std::memory_order_acquire )
+#define DXUTExportBarrier() std::atomic_thread_fence( std::memory_order_release )
+
+// Offsets owned by different threads are kept on separate cache lines so that
+// the reader and writer do not invalidate each other's lines on every update.
+// The classes below allocate themselves with this alignment when created with new.
+#define DXUT_CACHE_LINE_SIZE 64
+
+#define DXUT_CACHE_ALIGNED_NEW \
+    void* operator new( size_t cb ) throw() { return _aligned_malloc( cb, DXUT_CACHE_LINE_SIZE ); } \
+    void operator delete( void* pv ) { _aligned_free( pv ); }
+
+//
+// A region of a pipe handed out by ReserveRead() or ReserveWrite(). Because the
+// buffer is circular the region may be split in two at the end of the buffer, in
+// the same way as IDirectSoundBuffer::Lock(). pbData[1] is NULL if it is not.
+//
+struct DXUT_PIPE_REGION
+{
+    BYTE* pbData[2];
+    DWORD cbData[2];
+};
 
 //
 // Pipe class designed for use by at most two threads: one reader, one writer.
-// Access by more than two threads isn't guaranteed to be safe. 
-// 
+// Access by more than two threads isn't guaranteed to be safe.
+//
 // In order to provide efficient access the size of the buffer is passed
 // as a template parameter and restricted to powers of two less than 31.
 //
+// Read() and Write() copy through the caller's memory. ReserveRead()/CommitRead()
+// and ReserveWrite()/CommitWrite() instead expose the pipe's own buffer so that
+// data can be produced or consumed in place. A reservation stays valid until it
+// is committed and only one reservation per side may be outstanding at a time.
+//
 
 template <BYTE cbBufferSizeLog2> class DXUTLockFreePipe
 {
 public:
     DXUTLockFreePipe() : m_readOffset( 0 ),
-                         m_writeOffset( 0 )
+                         m_cachedWriteOffset( 0 ),
+                         m_writeOffset( 0 ),
+                         m_cachedReadOffset( 0 )
                          {
                          }
 
+    DXUT_CACHE_ALIGNED_NEW
+
     DWORD                       GetBufferSize() const
     {
         return c_cbBufferSize;
@@ -61,158 +81,163 @@ public:
 
     __forceinline unsigned long BytesAvailable() const
     {
-        return m_writeOffset - m_readOffset;
+        return m_writeOffset.load( std::memory_order_acquire ) - m_readOffset.load( std::memory_order_acquire );
     }
 
     bool __forceinline          Read( void* pvDest, unsigned long cbDest )
     {
-        // Store the read and write offsets into local variables--this is
-        // essentially a snapshot of their values so that they stay constant
-        // for the duration of the function (and so we don't end up with cache 
-        // misses due to false sharing).
-        DWORD readOffset = m_readOffset;
-        DWORD writeOffset = m_writeOffset;
-
-        // Compare the two offsets to see if we have anything to read.
-        // Note that we don't do anything to synchronize the offsets here.
-        // Really there's not much we *can* do unless we're willing to completely
-        // synchronize access to the entire object. We have to assume that as we 
-        // read, someone else may be writing, and the write offset we have now
-        // may be out of date by the time we read it. Fortunately that's not a
-        // very big deal. We might miss reading some data that was just written.
-        // But the assumption is that we'll be back before long to grab more data
-        // anyway.
-        //
-        // Note that this comparison works because we're careful to constrain
-        // the total buffer size to be a power of 2, which means it will divide
-        // evenly into ULONG_MAX+1. That, and the fact that the offsets are 
-        // unsigned, means that the calculation returns correct results even
-        // when the values wrap around.
-        DWORD cbAvailable = writeOffset - readOffset;
-        if( cbDest > cbAvailable )
+        DXUT_PIPE_REGION region;
+        if( !ReserveRead( cbDest, &region ) )
         {
             return false;
         }
 
-        // The data has been made available, but we need to make sure
-        // that our view on the data is up to date -- at least as up to
-        // date as the control values we just read. We need to prevent
-        // the compiler or CPU from moving any of the data reads before
-        // the control value reads. This import barrier serves this
-        // purpose, on Xbox 360 and on Windows.
-
-        // Reading a control value and then having a barrier is known
-        // as a "read-acquire."
-        DXUTImportBarrier();
-
         unsigned char* pbDest = ( unsigned char* )pvDest;
-
-        unsigned long actualReadOffset = readOffset & c_sizeMask;
-        unsigned long bytesLeft = cbDest;
-
-        //
-        // Copy from the tail, then the head. Note that there's no explicit
-        // check to see if the write offset comes between the read offset
-        // and the end of the buffer--that particular condition is implicitly
-        // checked by the comparison with AvailableToRead(), above. If copying
-        // cbDest bytes off the tail would cause us to cross the write offset,
-        // then the previous comparison would have failed since that would imply
-        // that there were less than cbDest bytes available to read.
-        //
-        unsigned long cbTailBytes = min( bytesLeft, c_cbBufferSize - actualReadOffset );
-        memcpy( pbDest, m_pbBuffer + actualReadOffset, cbTailBytes );
-        bytesLeft -= cbTailBytes;
-
-        if( bytesLeft )
+        memcpy( pbDest, region.pbData[0], region.cbData[0] );
+        if( region.pbData[1] )
         {
-            memcpy( pbDest + cbTailBytes, m_pbBuffer, bytesLeft );
+            memcpy( pbDest + region.cbData[0], region.pbData[1], region.cbData[1] );
         }
 
-        // When we update the read offset we are, effectively, 'freeing' buffer
-        // memory so that the writing thread can use it. We need to make sure that
-        // we don't free the memory before we have finished reading it. That is,
-        // we need to make sure that the write to m_readOffset can't get reordered
-        // above the reads of the buffer data. The only way to guarantee this is to
-        // have an export barrier to prevent both compiler and CPU rearrangements.
-        DXUTExportBarrier();
-
-        // Advance the read offset. From the CPUs point of view this is several
-        // operations--read, modify, store--and we'd normally want to make sure that
-        // all of the operations happened atomically. But in the case of a single
-        // reader, only one thread updates this value and so the only operation that
-        // must be atomic is the store. That's lucky, because 32-bit aligned stores are
-        // atomic on all modern processors.
-        // 
-        readOffset += cbDest;
-        m_readOffset = readOffset;
-
+        CommitRead( cbDest );
         return true;
     }
 
     bool __forceinline          Write( const void* pvSrc, unsigned long cbSrc )
     {
-        // Reading the read offset here has the same caveats as reading
-        // the write offset had in the Read() function above. 
-        DWORD readOffset = m_readOffset;
-        DWORD writeOffset = m_writeOffset;
-
-        // Compute the available write size. This comparison relies on
-        // the fact that the buffer size is always a power of 2, and the
-        // offsets are unsigned integers, so that when the write pointer
-        // wraps around the subtraction still yields a value (assuming
-        // we haven't messed up somewhere else) between 0 and c_cbBufferSize - 1.
-        DWORD cbAvailable = c_cbBufferSize - ( writeOffset - readOffset );
-        if( cbSrc > cbAvailable )
+        DXUT_PIPE_REGION region;
+        if( !ReserveWrite( cbSrc, &region ) )
         {
             return false;
         }
 
-        // It is theoretically possible for writes of the data to be reordered
-        // above the reads to see if the data is available. Improbable perhaps,
-        // but possible. This barrier guarantees that the reordering will not
-        // happen.
-        DXUTImportBarrier();
-
-        // Write the data
         const unsigned char* pbSrc = ( const unsigned char* )pvSrc;
-        unsigned long actualWriteOffset = writeOffset & c_sizeMask;
-        unsigned long bytesLeft = cbSrc;
+        memcpy( region.pbData[0], pbSrc, region.cbData[0] );
+        if( region.pbData[1] )
+        {
+            memcpy( region.pbData[1], pbSrc + region.cbData[0], region.cbData[1] );
+        }
+
+        CommitWrite( cbSrc );
+        return true;
+    }
 
-        // See the explanation in the Read() function as to why we don't 
-        // explicitly check against the read offset here.
-        unsigned long cbTailBytes = min( bytesLeft, c_cbBufferSize - actualWriteOffset );
-        memcpy( m_pbBuffer + actualWriteOffset, pbSrc, cbTailBytes );
-        bytesLeft -= cbTailBytes;
+    //
+    // Zero-copy read. Returns false if fewer than cbDest bytes are available.
+    // The data in the region stays valid until CommitRead() is called.
+    //
+    bool __forceinline          ReserveRead( unsigned long cbDest, DXUT_PIPE_REGION* pRegion )
+    {
+        // Only this thread modifies the read offset, so a relaxed load is enough.
+        DWORD readOffset = m_readOffset.load( std::memory_order_relaxed );
 
-        if( bytesLeft )
+        // Compare the two offsets to see if we have anything to read. We first try
+        // the write offset we saw last time; only if that doesn't show enough data
+        // do we go back to the shared value, which avoids pulling the writer's cache
+        // line across on every call.
+        //
+        // Note that this comparison works because we're careful to constrain
+        // the total buffer size to be a power of 2, which means it will divide
+        // evenly into ULONG_MAX+1. That, and the fact that the offsets are
+        // unsigned, means that the calculation returns correct results even
+        // when the values wrap around.
+        if( cbDest > m_cachedWriteOffset - readOffset )
         {
-            memcpy( m_pbBuffer, pbSrc + cbTailBytes, bytesLeft );
+            // The data has been made available, but we need to make sure
+            // that our view on the data is up to date -- at least as up to
+            // date as the control value we just read. The acquire ordering
+            // prevents the compiler or CPU from moving any of the data reads
+            // before the control value read. This is a "read-acquire."
+            m_cachedWriteOffset = m_writeOffset.load( std::memory_order_acquire );
+            if( cbDest > m_cachedWriteOffset - readOffset )
+            {
+                return false;
+            }
         }
 
-        // Now it's time to update the write offset, but since the updated position
-        // of the write offset will imply that there's data to be read, we need to 
-        // make sure that the data all actually gets written before the update to
-        // the write offset. The writes could be reordered by the compiler (on any
-        // platform) or by the CPU (on Xbox 360). We need a barrier which prevents
-        // the writes from being reordered past each other.
+        GetRegion( readOffset, cbDest, pRegion );
+        return true;
+    }
+
+    void __forceinline          CommitRead( unsigned long cbDest )
+    {
+        // When we update the read offset we are, effectively, 'freeing' buffer
+        // memory so that the writing thread can use it. We need to make sure that
+        // we don't free the memory before we have finished reading it, so the
+        // store has release ordering. This is a "write-release."
         //
-        // Having a barrier and then writing a control value is called "write-release."
-        DXUTExportBarrier();
+        // Only one thread updates this value and so the only operation that must
+        // be atomic is the store.
+        DWORD readOffset = m_readOffset.load( std::memory_order_relaxed );
+        m_readOffset.store( readOffset + cbDest, std::memory_order_release );
+    }
+
+    //
+    // Zero-copy write. Returns false if there is not room for cbSrc bytes. The
+    // data written into the region is published by CommitWrite().
+    //
+    bool __forceinline          ReserveWrite( unsigned long cbSrc, DXUT_PIPE_REGION* pRegion )
+    {
+        DWORD writeOffset = m_writeOffset.load( std::memory_order_relaxed );
 
-        // See comments in Read() as to why this operation isn't interlocked.
-        writeOffset += cbSrc;
-        m_writeOffset = writeOffset;
+        // Compute the available write size. This comparison relies on
+        // the fact that the buffer size is always a power of 2, and the
+        // offsets are unsigned integers, so that when the write pointer
+        // wraps around the subtraction still yields a value (assuming
+        // we haven't messed up somewhere else) between 0 and c_cbBufferSize - 1.
+        if( cbSrc > c_cbBufferSize - ( writeOffset - m_cachedReadOffset ) )
+        {
+            // The acquire here guarantees that the reader has finished with the
+            // memory it released before we start overwriting it.
+            m_cachedReadOffset = m_readOffset.load( std::memory_order_acquire );
+            if( cbSrc > c_cbBufferSize - ( writeOffset - m_cachedReadOffset ) )
+            {
+                return false;
+            }
+        }
 
+        GetRegion( writeOffset, cbSrc, pRegion );
         return true;
     }
 
+    void __forceinline          CommitWrite( unsigned long cbSrc )
+    {
+        // The updated position of the write offset implies that there's data to be
+        // read, so all of the data must be visible before the offset is. Having the
+        // data writes and then a releasing store of the control value is called
+        // "write-release."
+        DWORD writeOffset = m_writeOffset.load( std::memory_order_relaxed );
+        m_writeOffset.store( writeOffset + cbSrc, std::memory_order_release );
+    }
+
 private:
     // Values derived from the buffer size template parameter
     //
-    const static BYTE c_cbBufferSizeLog2 = min( cbBufferSizeLog2, 31 );
+    const static BYTE c_cbBufferSizeLog2 = ( cbBufferSizeLog2 < 31 ) ? cbBufferSizeLog2 : 31;
     const static DWORD c_cbBufferSize = ( 1 << c_cbBufferSizeLog2 );
     const static DWORD c_sizeMask = c_cbBufferSize - 1;
 
+    //
+    // Splits [offset, offset + cb) into the tail of the buffer and, if it wraps,
+    // the head. Note that there's no explicit check to see if the other side's
+    // offset comes between the two--that is implicitly checked by the available
+    // size comparisons in ReserveRead() and ReserveWrite().
+    //
+    void __forceinline          GetRegion( DWORD offset, unsigned long cb, DXUT_PIPE_REGION* pRegion )
+    {
+        unsigned long actualOffset = offset & c_sizeMask;
+        unsigned long cbTailBytes = c_cbBufferSize - actualOffset;
+        if( cbTailBytes > cb )
+        {
+            cbTailBytes = cb;
+        }
+
+        pRegion->pbData[0] = m_pbBuffer + actualOffset;
+        pRegion->cbData[0] = cbTailBytes;
+        pRegion->pbData[1] = ( cb > cbTailBytes ) ? m_pbBuffer : NULL;
+        pRegion->cbData[1] = cb - cbTailBytes;
+    }
+
     // Leave these private and undefined to prevent their use
     DXUTLockFreePipe( const DXUTLockFreePipe& );
     DXUTLockFreePipe& operator =( const DXUTLockFreePipe& );
@@ -220,9 +245,203 @@ private:
     // Member data
     //
     BYTE                        m_pbBuffer[c_cbBufferSize];
+
     // Note that these offsets are not clamped to the buffer size.
     // Instead the calculations rely on wrapping at ULONG_MAX+1.
-    // See the comments in Read() for details.
-    volatile DWORD __declspec( align( 4 ) ) m_readOffset;
-    volatile DWORD __declspec( align( 4 ) ) m_writeOffset;
-};
\ No newline at end of file
+    // See the comments in ReserveRead() for details.
+    //
+    // Reader's cache line: the read offset and the reader's private copy of the
+    // last write offset it saw.
+    alignas( DXUT_CACHE_LINE_SIZE ) std::atomic<DWORD> m_readOffset;
+    DWORD                       m_cachedWriteOffset;
+
+    // Writer's cache line
+    alignas( DXUT_CACHE_LINE_SIZE ) std::atomic<DWORD> m_writeOffset;
+    DWORD                       m_cachedReadOffset;
+};
+
+
+//
+// Bounded queue of fixed-size entries that is safe for any number of reader and
+// writer threads.
+//
+// Each entry carries a sequence number that tells a thread whether the entry is
+// ready to be written (sequence == position) or read (sequence == position + 1)
+// on the current lap of the ring, so threads only contend on the shared
+// enqueue/dequeue positions and never on each other's entries. The number of
+// entries is passed as a template parameter and restricted to powers of two
+// less than 31. TYPE is copied by assignment.
+//
+
+template <typename TYPE, BYTE cEntriesLog2> class DXUTLockFreeQueue
+{
+public:
+    DXUTLockFreeQueue() : m_enqueuePos( 0 ),
+                          m_dequeuePos( 0 )
+    {
+        for( DWORD i = 0; i < c_cEntries; i++ )
+        {
+            m_entries[i].sequence.store( i, std::memory_order_relaxed );
+        }
+    }
+
+    DXUT_CACHE_ALIGNED_NEW
+
+    DWORD                       GetCapacity() const
+    {
+        return c_cEntries;
+    }
+
+    // Only a snapshot; other threads may change it immediately
+    DWORD                       GetCountApprox() const
+    {
+        DWORD dequeuePos = m_dequeuePos.load( std::memory_order_relaxed );
+        LONG count = ( LONG )( m_enqueuePos.load( std::memory_order_relaxed ) - dequeuePos );
+        return ( count > 0 ) ? ( DWORD )count : 0;
+    }
+
+    bool __forceinline          Push( const TYPE& value )
+    {
+        return PushBatch( &value, 1 ) == 1;
+    }
+
+    bool __forceinline          Pop( TYPE* pValue )
+    {
+        return PopBatch( pValue, 1 ) == 1;
+    }
+
+    //
+    // Pushes up to cValues entries with a single update of the shared position and
+    // returns how many were pushed. Entries pushed by one call are contiguous in
+    // the queue, so a single consumer sees them in order.
+    //
+    UINT                        PushBatch( const TYPE* pValues, UINT cValues )
+    {
+        DWORD pos = m_enqueuePos.load( std::memory_order_relaxed );
+        UINT cClaimed;
+
+        for( ;; )
+        {
+            // Count how many consecutive entries are free on this lap. Entries at or
+            // past the enqueue position can only be claimed through the exchange
+            // below, so once free they stay free until we claim them.
+            cClaimed = 0;
+            while( cClaimed < cValues && cClaimed < c_cEntries )
+            {
+                DWORD sequence = m_entries[( pos + cClaimed ) & c_indexMask].sequence.load( std::memory_order_acquire );
+                LONG diff = ( LONG )( sequence - ( pos + cClaimed ) );
+                if( diff != 0 )
+                {
+                    break;
+                }
+                cClaimed++;
+            }
+
+            if( cClaimed == 0 )
+            {
+                DWORD sequence = m_entries[pos & c_indexMask].sequence.load( std::memory_order_acquire );
+                if( ( LONG )( sequence - pos ) < 0 )
+                {
+                    // The entry still holds data from the previous lap: the queue is full
+                    return 0;
+                }
+
+                // Another producer got here first
+                pos = m_enqueuePos.load( std::memory_order_relaxed );
+                continue;
+            }
+
+            if( m_enqueuePos.compare_exchange_weak( pos, pos + cClaimed, std::memory_order_relaxed ) )
+            {
+                break;
+            }
+            // pos now holds the current value; try again from there
+        }
+
+        for( UINT i = 0; i < cClaimed; i++ )
+        {
+            Entry& entry = m_entries[( pos + i ) & c_indexMask];
+            entry.value = pValues[i];
+
+            // Publish the value to consumers
+            entry.sequence.store( pos + i + 1, std::memory_order_release );
+        }
+
+        return cClaimed;
+    }
+
+    //
+    // Pops up to cValues entries with a single update of the shared position and
+    // returns how many were popped.
+    //
+    UINT                        PopBatch( TYPE* pValues, UINT cValues )
+    {
+        DWORD pos = m_dequeuePos.load( std::memory_order_relaxed );
+        UINT cClaimed;
+
+        for( ;; )
+        {
+            cClaimed = 0;
+            while( cClaimed < cValues && cClaimed < c_cEntries )
+            {
+                DWORD sequence = m_entries[( pos + cClaimed ) & c_indexMask].sequence.load( std::memory_order_acquire );
+                LONG diff = ( LONG )( sequence - ( pos + cClaimed + 1 ) );
+                if( diff != 0 )
+                {
+                    break;
+                }
+                cClaimed++;
+            }
+
+            if( cClaimed == 0 )
+            {
+                DWORD sequence = m_entries[pos & c_indexMask].sequence.load( std::memory_order_acquire );
+                if( ( LONG )( sequence - ( pos + 1 ) ) < 0 )
+                {
+                    // Nothing has been published here yet: the queue is empty
+                    return 0;
+                }
+
+                pos = m_dequeuePos.load( std::memory_order_relaxed );
+                continue;
+            }
+
+            if( m_dequeuePos.compare_exchange_weak( pos, pos + cClaimed, std::memory_order_relaxed ) )
+            {
+                break;
+            }
+        }
+
+        for( UINT i = 0; i < cClaimed; i++ )
+        {
+            Entry& entry = m_entries[( pos + i ) & c_indexMask];
+            pValues[i] = entry.value;
+
+            // Hand the entry back to producers for the next lap
+            entry.sequence.store( pos + i + c_cEntries, std::memory_order_release );
+        }
+
+        return cClaimed;
+    }
+
+private:
+    const static BYTE c_cEntriesLog2 = ( cEntriesLog2 < 30 ) ? cEntriesLog2 : 30;
+    const static DWORD c_cEntries = ( 1 << c_cEntriesLog2 );
+    const static DWORD c_indexMask = c_cEntries - 1;
+
+    struct Entry
+    {
+        std::atomic<DWORD>      sequence;
+        TYPE                    value;
+    };
+
+    // Leave these private and undefined to prevent their use
+    DXUTLockFreeQueue( const DXUTLockFreeQueue& );
+    DXUTLockFreeQueue& operator =( const DXUTLockFreeQueue& );
+
+    // Member data
+    //
+    alignas( DXUT_CACHE_LINE_SIZE ) Entry m_entries[c_cEntries];
+    alignas( DXUT_CACHE_LINE_SIZE ) std::atomic<DWORD> m_enqueuePos;
+    alignas( DXUT_CACHE_LINE_SIZE ) std::atomic<DWORD> m_dequeuePos;
+};
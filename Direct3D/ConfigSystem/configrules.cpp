@@ -0,0 +1,2358 @@
+//--------------------------------------------------------------------------------------
+// File: ConfigRules.cpp
+//
+// Compiler and evaluator for the configuration database.
+//
+// The compiler walks the text exactly as the old interpreter did, but wherever the
+// interpreter would have looked at the hardware it records every possible outcome
+// instead.  Vendor and device scans become lookup tables, IF conditions become compare
+// instructions, and each property set body becomes a block of ops.  Blocks are shared
+// by every path that reaches the same place in the file.
+//
+// This file is built without the precompiled header and only uses the C and C++
+// runtime, so it can be compiled on other platforms.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#include "configrules.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <set>
+
+
+const char k_KeywordDisplayVendor[] = "displayvendor";
+const char k_KeywordAudioVendor[] = "audiovendor";
+const char k_KeywordApplyToAll[] = "applytoall";
+const char k_KeywordRequirements[] = "Requirements";
+const char k_KeywordPropertySet[] = "propertyset";
+const char k_KeywordIf[] = "if";
+const char k_KeywordEndif[] = "endif";
+const char k_KeywordBreak[] = "break";
+const char k_KeywordUnknown[] = "unknown";
+const char k_KeywordGuid[] = "guid";
+const char k_KeywordDriver[] = "driver";
+const char k_KeywordOs[] = "os";
+const char k_KeywordOverallGraphicDetail[] = "overallgraphicdetail";
+const char k_KeywordMaxOverallGraphicDetail[] = "MaxOverallGraphicDetail";
+
+//
+// Condition keywords, in the order the interpreter tested them.  MaxTextureHeight was
+// never accepted, so it is not here either.
+//
+struct CONFIG_KEYWORD
+{
+    const char* pszName;
+    uint8_t Source;
+};
+
+const CONFIG_KEYWORD k_ConditionKeywords[] =
+{
+    { "cpuspeed",                   CONFIG_VALUE_CPUSPEED },
+    { "ram",                        CONFIG_VALUE_RAM },
+    { "Caps",                       CONFIG_VALUE_CAPS },
+    { "Caps2",                      CONFIG_VALUE_CAPS2 },
+    { "Caps3",                      CONFIG_VALUE_CAPS3 },
+    { "PresentationIntervals",      CONFIG_VALUE_PRESENTATIONINTERVALS },
+    { "CursorCaps",                 CONFIG_VALUE_CURSORCAPS },
+    { "DevCaps",                    CONFIG_VALUE_DEVCAPS },
+    { "PrimitiveMiscCaps",          CONFIG_VALUE_PRIMITIVEMISCCAPS },
+    { "RasterCaps",                 CONFIG_VALUE_RASTERCAPS },
+    { "ZCmpCaps",                   CONFIG_VALUE_ZCMPCAPS },
+    { "SrcBlendCaps",               CONFIG_VALUE_SRCBLENDCAPS },
+    { "DestBlendCaps",              CONFIG_VALUE_DESTBLENDCAPS },
+    { "AlphaCmpCaps",               CONFIG_VALUE_ALPHACMPCAPS },
+    { "ShadeCaps",                  CONFIG_VALUE_SHADECAPS },
+    { "TextureCaps",                CONFIG_VALUE_TEXTURECAPS },
+    { "TextureFilterCaps",          CONFIG_VALUE_TEXTUREFILTERCAPS },
+    { "CubeTextureFilterCaps",      CONFIG_VALUE_CUBETEXTUREFILTERCAPS },
+    { "VolumeTextureFilterCaps",    CONFIG_VALUE_VOLUMETEXTUREFILTERCAPS },
+    { "TextureAddressCaps",         CONFIG_VALUE_TEXTUREADDRESSCAPS },
+    { "VolumeTextureAddressCaps",   CONFIG_VALUE_VOLUMETEXTUREADDRESSCAPS },
+    { "LineCaps",                   CONFIG_VALUE_LINECAPS },
+    { "MaxTextureWidth",            CONFIG_VALUE_MAXTEXTUREWIDTH },
+    { "MaxVolumeExtent",            CONFIG_VALUE_MAXVOLUMEEXTENT },
+    { "MaxTextureRepeat",           CONFIG_VALUE_MAXTEXTUREREPEAT },
+    { "MaxTextureAspectRatio",      CONFIG_VALUE_MAXTEXTUREASPECTRATIO },
+    { "MaxAnisotropy",              CONFIG_VALUE_MAXANISOTROPY },
+    { "StencilCaps",                CONFIG_VALUE_STENCILCAPS },
+    { "FVFCaps",                    CONFIG_VALUE_FVFCAPS },
+    { "TextureOpCaps",              CONFIG_VALUE_TEXTUREOPCAPS },
+    { "MaxTextureBlendStages",      CONFIG_VALUE_MAXTEXTUREBLENDSTAGES },
+    { "MaxSimultaneousTextures",    CONFIG_VALUE_MAXSIMULTANEOUSTEXTURES },
+    { "VertexProcessingCaps",       CONFIG_VALUE_VERTEXPROCESSINGCAPS },
+    { "MaxActiveLights",            CONFIG_VALUE_MAXACTIVELIGHTS },
+    { "MaxUserClipPlanes",          CONFIG_VALUE_MAXUSERCLIPPLANES },
+    { "MaxVertexBlendMatrices",     CONFIG_VALUE_MAXVERTEXBLENDMATRICES },
+    { "MaxVertexBlendMatrixIndex",  CONFIG_VALUE_MAXVERTEXBLENDMATRIXINDEX },
+    { "MaxPrimitiveCount",          CONFIG_VALUE_MAXPRIMITIVECOUNT },
+    { "MaxVertexIndex",             CONFIG_VALUE_MAXVERTEXINDEX },
+    { "MaxStreams",                 CONFIG_VALUE_MAXSTREAMS },
+    { "MaxStreamStride",            CONFIG_VALUE_MAXSTREAMSTRIDE },
+    { "VertexShaderVersion",        CONFIG_VALUE_VERTEXSHADERVERSION },
+    { "MaxVertexShaderConst",       CONFIG_VALUE_MAXVERTEXSHADERCONST },
+    { "PixelShaderVersion",         CONFIG_VALUE_PIXELSHADERVERSION },
+    { "videoram",                   CONFIG_VALUE_VIDEORAM },
+    { "subsysid",                   CONFIG_VALUE_SUBSYSID },
+    { "revision",                   CONFIG_VALUE_REVISION },
+    { k_KeywordGuid,                CONFIG_SOURCE_GUID },
+    { k_KeywordDriver,              CONFIG_SOURCE_DRIVER },
+    { k_KeywordOs,                  CONFIG_VALUE_OS },
+};
+
+// Operating systems, in CONFIG_VALUE_OS order
+const char* const k_OsKeywords[] =
+{
+    "win95", "win98", "win98se", "winme", "win2k", "winxp", "win2003",
+};
+
+#define CONFIG_MAX_NESTED_IF        16
+#define CONFIG_MAX_STRING           256
+#define CONFIG_TEXT_PADDING         1024        // Zeros after the text, so scans past the end stop
+
+const uint32_t k_ImageMagic = 0x52474643;       // 'CFGR'
+const uint32_t k_ImageVersion = 1;
+
+
+//--------------------------------------------------------------------------------------
+static char ToLower( char chr )
+{
+    return ( chr >= 'A' && chr <= 'Z' ) ? ( char )( chr + 'a' - 'A' ) : chr;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Return true if the character is not a alphanumeric
+//--------------------------------------------------------------------------------------
+static bool NotAscii( char Chr )
+{
+    return Chr == '>' || Chr == '<' || Chr == '!' || Chr == '=' || Chr == ' ' || Chr == 13 || Chr == 9;
+}
+
+
+//--------------------------------------------------------------------------------------
+static bool IsDigit( char chr )
+{
+    return chr >= '0' && chr <= '9';
+}
+
+
+//--------------------------------------------------------------------------------------
+static uint32_t HashId( uint32_t nTable, uint32_t Id )
+{
+    uint32_t h = Id * 0x9E3779B1 ^ ( nTable + 0x7F4A7C15 ) * 0x85EBCA77;
+    h ^= h >> 15;
+    h *= 0x2C1B3C6D;
+    h ^= h >> 12;
+    return h;
+}
+
+
+//--------------------------------------------------------------------------------------
+// CConfigPropertySet
+//--------------------------------------------------------------------------------------
+void CConfigPropertySet::Reset( uint32_t nKeys )
+{
+    // Only clear the slots in use, so a reused set costs nothing to reset
+    for( size_t i = 0; i < m_Keys.size(); i++ )
+    {
+        m_Slots[m_Keys[i]] = CONFIG_NO_INDEX;
+    }
+    m_Keys.clear();
+    m_Values.clear();
+    if( m_Slots.size() != nKeys )
+    {
+        m_Slots.assign( nKeys, CONFIG_NO_INDEX );
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+void CConfigPropertySet::Set( uint32_t nKey, uint32_t nValue )
+{
+    uint32_t nSlot = m_Slots[nKey];
+    if( nSlot != CONFIG_NO_INDEX )
+    {
+        m_Values[nSlot] = nValue;
+        return;
+    }
+    m_Slots[nKey] = ( uint32_t )m_Keys.size();
+    m_Keys.push_back( nKey );
+    m_Values.push_back( nValue );
+}
+
+
+//--------------------------------------------------------------------------------------
+void CConfigPropertySet::Apply( const CConfigPropertySet& Src )
+{
+    if( &Src == this )
+        return;
+
+    for( size_t i = 0; i < Src.m_Keys.size(); i++ )
+    {
+        Set( Src.m_Keys[i], Src.m_Values[i] );
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// CConfigCompiler
+//
+// Holds the text and the interpreter's read position while a CConfigRules is built.
+// The parsing helpers are the interpreter's, working on offsets.  Errors are formatted
+// as the interpreter formatted them and queued until the caller decides whether they
+// become ops or table entries.
+//--------------------------------------------------------------------------------------
+struct CONFIG_CURSOR
+{
+    uint32_t Pos;
+    uint32_t LinePos;                           // Start of the line errors are reported for
+    uint32_t LineNumber;
+};
+
+struct CONFIG_BLOCK_INFO
+{
+    uint32_t iOp;
+    CONFIG_CURSOR End;                          // Where the interpreter's DoPropertySet returned
+    bool bAborts;                               // Always fails
+};
+
+class CConfigCompiler
+{
+public:
+                    CConfigCompiler( CConfigRules* pRules ) : m_pRules( pRules )
+                    {
+                    }
+
+    bool            Compile( const char* pText, uint32_t cbText );
+
+protected:
+    typedef std::vector <CONFIG_OP> OpList;
+
+    // Text access and the interpreter's parsing helpers
+    char            Chr( uint32_t Pos ) const
+    {
+        return Pos < m_Text.size() ? m_Text[Pos] : 0;
+    }
+    char            Cur() const
+    {
+        return Chr( m_Cur.Pos );
+    }
+    bool            AtComment() const
+    {
+        return Cur() == '/' && Chr( m_Cur.Pos + 1 ) == '/';
+    }
+    void            SkipToNextLine();
+    void            SkipSpace();
+    bool            NextStringIs( const char* psz ) const;
+    void            SyntaxError( const char* pszErrorText );
+    uint32_t        FormatError( const char* pszErrorText );
+    uint32_t        GetDigit();
+    uint32_t        GetNumber();
+    bool            GetString( std::string& str );
+    uint32_t        Get4Digits();
+    uint32_t        sGet4Digits();
+    const char*     GetFlag( std::string& Flag, std::string& Value );
+    const char*     GetCondition( CONFIG_OP* pOp );
+
+    // Program construction
+    uint32_t        InternString( const char* psz );
+    uint32_t        InternKey( const char* psz );
+    uint32_t        InternName( const char* psz );
+    void            Emit( OpList& ops, uint8_t Op, uint8_t Flags, uint32_t Arg0 = 0, uint32_t Arg1 = 0,
+                          uint32_t Arg2 = 0 );
+    void            EmitPending( OpList& ops, uint8_t Flags );
+    void            EmitFailure( OpList& ops, const char* pszErrorText, uint8_t Flags );
+    void            EmitCall( OpList& ops, uint32_t nTarget, const CONFIG_BLOCK_INFO& block );
+    uint32_t        TakePending();
+    uint32_t        AddOps( const OpList& ops );
+
+    CONFIG_BLOCK_INFO CompileBlock();
+    void            CompileMainScript();
+    uint32_t        CompileVendorTable( bool bSound );
+    uint32_t        CompileVendorScript( bool bSound );
+    uint32_t        CompileDeviceTable( bool bSound );
+    uint32_t        CompileDeviceScript( bool bSound );
+    void            CompilePostBlocks();
+    void            BuildHash();
+    void            CheckDetailLevels();
+
+    CConfigRules* m_pRules;
+    std::vector <char> m_Text;
+    uint32_t m_EndOfFile;
+    CONFIG_CURSOR m_Cur;
+    std::vector <uint32_t> m_Pending;           // Errors not yet emitted
+    std::set <uint32_t> m_DiagnosticSet;
+
+    std::map <std::string, uint32_t> m_StringMap;
+    std::map <std::string, uint32_t> m_KeyMap;
+    std::map <std::string, uint32_t> m_NameMap;
+    std::map <std::string, uint32_t> m_SetNames;    // Named sets defined so far
+    uint32_t m_nGeneration;                         // Changes whenever m_SetNames does
+
+    // Blocks already compiled, by start position and the named sets visible to them
+    typedef std::pair <std::pair <uint32_t, uint32_t>, std::pair <uint32_t, uint32_t> > BlockKey;
+    std::map <BlockKey, CONFIG_BLOCK_INFO> m_BlockMap;
+    uint32_t m_nAlwaysOps;                          // Ops emitted so far that run inside a false IF
+
+    std::vector <std::pair <uint32_t, uint32_t> > m_MaxDetails;    // Level string and error of each MaxOverallGraphicDetail
+    std::set <uint32_t> m_DetailValues;                             // Values OverallGraphicDetail is set to
+
+    bool m_bFailed;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Skip to start of next line
+//--------------------------------------------------------------------------------------
+void CConfigCompiler::SkipToNextLine()
+{
+    do
+    {
+        m_Cur.Pos++;
+    } while( Chr( m_Cur.Pos - 1 ) != 13 && m_Cur.Pos < m_EndOfFile );
+
+    if( m_Cur.Pos < m_EndOfFile && Cur() == 10 )
+    {
+        m_Cur.Pos++;
+    }
+
+    m_Cur.LinePos = m_Cur.Pos;
+    m_Cur.LineNumber++;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Skip over blank spaces
+//--------------------------------------------------------------------------------------
+void CConfigCompiler::SkipSpace()
+{
+    while( Cur() == ' ' || Cur() == 9 )
+        m_Cur.Pos++;
+}
+
+
+//--------------------------------------------------------------------------------------
+bool CConfigCompiler::NextStringIs( const char* psz ) const
+{
+    uint32_t cch = ( uint32_t )strlen( psz );
+    for( uint32_t i = 0; i < cch; i++ )
+    {
+        if( ToLower( Chr( m_Cur.Pos + i ) ) != ToLower( psz[i] ) )
+            return false;
+    }
+    return NotAscii( Chr( m_Cur.Pos + cch ) );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Formats an error the way the interpreter reported it
+//--------------------------------------------------------------------------------------
+uint32_t CConfigCompiler::FormatError( const char* pszErrorText )
+{
+    char tempBuffer[40];
+    char* dest = tempBuffer;
+    uint32_t source = m_Cur.LinePos;
+    while( Chr( source ) != 13 && dest != &tempBuffer[36] )
+    {
+        *dest++ = Chr( source++ );          // Copy current line into error buffer
+    }
+    if( dest == &tempBuffer[36] )
+    {
+        *dest++ = '.';
+        *dest++ = '.';
+        *dest++ = '.';
+    }
+    *dest = 0;
+
+    char Buffer[256];
+    snprintf( Buffer, sizeof( Buffer ), "%s on line %d - '%s'", pszErrorText, ( int )m_Cur.LineNumber, tempBuffer );
+    Buffer[sizeof( Buffer ) - 1] = 0;
+    return InternString( Buffer );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Queues an error for the caller to emit, and records it as a diagnostic
+//--------------------------------------------------------------------------------------
+void CConfigCompiler::SyntaxError( const char* pszErrorText )
+{
+    uint32_t nError = FormatError( pszErrorText );
+    m_Pending.push_back( nError );
+    if( m_DiagnosticSet.insert( nError ).second )
+    {
+        m_pRules->m_Diagnostics.push_back( nError );
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Return a hex digit -1=error and move pointer on
+//--------------------------------------------------------------------------------------
+uint32_t CConfigCompiler::GetDigit()
+{
+    char chr = Cur();
+    if( chr >= '0' && chr <= '9' )
+    {
+        m_Cur.Pos++;
+        return ( uint32_t )( chr - '0' );
+    }
+    if( chr >= 'a' && chr <= 'f' )
+    {
+        m_Cur.Pos++;
+        return ( uint32_t )( chr - 'a' + 10 );
+    }
+    if( chr >= 'A' && chr <= 'F' )
+    {
+        m_Cur.Pos++;
+        return ( uint32_t )( chr - 'A' + 10 );
+    }
+    return CONFIG_NO_INDEX;
+}
+
+
+//--------------------------------------------------------------------------------------
+// A number is expected, get it - return -1 for error.  Decimal numbers wrap rather
+// than fail, as they always did.
+//--------------------------------------------------------------------------------------
+uint32_t CConfigCompiler::GetNumber()
+{
+    SkipSpace();
+
+    if( !( Cur() == '0' && Chr( m_Cur.Pos + 1 ) == 'x' ) )
+    {
+        if( !IsDigit( Cur() ) )
+        {
+            SyntaxError( "Number expected" );
+            return CONFIG_NO_INDEX;
+        }
+
+        uint32_t result = GetDigit();
+        while( IsDigit( Cur() ) )
+        {
+            result = result * 10 + GetDigit();
+        }
+
+        SkipSpace();
+        return result;
+    }
+
+    //
+    // Hex number
+    //
+    m_Cur.Pos += 2;
+
+    uint32_t tmp = GetDigit();
+    if( tmp == CONFIG_NO_INDEX )
+    {
+        SyntaxError( "Number expected" );
+        return CONFIG_NO_INDEX;
+    }
+
+    uint32_t result = 0;
+    uint32_t hexcount = 0;
+    do
+    {
+        if( hexcount >= 8 )
+        {
+            SyntaxError( "Number too large" );
+            return CONFIG_NO_INDEX;
+        }
+
+        result = result * 16 + tmp;
+        ++hexcount;
+        tmp = GetDigit();
+    } while( tmp != CONFIG_NO_INDEX );
+
+    SkipSpace();
+
+    return result;
+}
+
+
+//--------------------------------------------------------------------------------------
+// A string is expected, get it.  Like the interpreter this does not stop at the end of
+// the line.
+//--------------------------------------------------------------------------------------
+bool CConfigCompiler::GetString( std::string& str )
+{
+    SkipSpace();
+
+    if( Chr( m_Cur.Pos++ ) != '"' )
+    {
+        SyntaxError( "Expecting """ );
+        return false;
+    }
+
+    str.clear();
+    while( Cur() != '"' )
+    {
+        str += Chr( m_Cur.Pos++ );
+
+        if( str.size() >= CONFIG_MAX_STRING )
+        {
+            SyntaxError( "String too long" );
+            return false;
+        }
+    }
+
+    m_Cur.Pos++;
+
+    SkipSpace();
+
+    return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Returns the next 4 hex digits, -1 if any errors
+//--------------------------------------------------------------------------------------
+uint32_t CConfigCompiler::Get4Digits()
+{
+    uint32_t result = 0;
+    for( int i = 0; i < 4; i++ )
+    {
+        uint32_t tmp = GetDigit();
+        if( tmp == CONFIG_NO_INDEX )
+            return CONFIG_NO_INDEX;
+        result = ( result << 4 ) | tmp;
+    }
+    return result;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Returns the next 4 hex digits, -1 if any errors - SWAPPED version (for guids)
+//--------------------------------------------------------------------------------------
+uint32_t CConfigCompiler::sGet4Digits()
+{
+    uint32_t temp = Get4Digits();
+
+    if( temp == CONFIG_NO_INDEX )
+        return temp;
+
+    return ( ( temp & 0xff00 ) >> 8 ) + ( ( temp & 0xff ) << 8 );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Pointing at a flag = value line, read the flag and value.  Returns an error or NULL.
+//--------------------------------------------------------------------------------------
+const char* CConfigCompiler::GetFlag( std::string& Flag, std::string& Value )
+{
+    Flag.clear();
+    while( Cur() != ' ' && Cur() != '=' && Cur() != 13 )
+    {
+        Flag += ToLower( Chr( m_Cur.Pos++ ) );     // Convert to lower case
+
+        if( Flag.size() == CONFIG_MAX_STRING - 2 )
+        {
+            return "Flag too long";
+        }
+    }
+
+    SkipSpace();
+
+    Value.clear();
+    if( Cur() != 13 )
+    {
+        if( Cur() != '=' )
+        {
+            return "flag = xxx expected";
+        }
+
+        m_Cur.Pos++;
+        SkipSpace();
+
+        if( Cur() == '"' )
+        {
+            // Quoted values keep their quotes and case
+            do
+            {
+                Value += Chr( m_Cur.Pos++ );
+
+                if( Value.size() == CONFIG_MAX_STRING - 2 )
+                {
+                    return "Flag too long";
+                }
+
+            } while( Cur() != '"' && Cur() != 13 );
+
+            if( Cur() != '"' )
+            {
+                return "Missing Quote";
+            }
+
+            Value += '"';
+
+            if( Value.size() == CONFIG_MAX_STRING - 2 )
+            {
+                return "Flag too long";
+            }
+        }
+        else
+        {
+            while( Cur() != ' ' && Cur() != 13 )
+            {
+                Value += ToLower( Chr( m_Cur.Pos++ ) );
+
+                if( Value.size() == CONFIG_MAX_STRING - 2 )
+                {
+                    return "Flag too long";
+                }
+            }
+        }
+    }
+
+    return NULL;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Compiles an IF condition into pOp.  Returns an error or NULL.
+//--------------------------------------------------------------------------------------
+const char* CConfigCompiler::GetCondition( CONFIG_OP* pOp )
+{
+    SkipSpace();
+
+    const CONFIG_KEYWORD* pKeyword = NULL;
+    for( size_t i = 0; i < sizeof( k_ConditionKeywords ) / sizeof( k_ConditionKeywords[0] ); i++ )
+    {
+        if( NextStringIs( k_ConditionKeywords[i].pszName ) )
+        {
+            pKeyword = &k_ConditionKeywords[i];
+            m_Cur.Pos += ( uint32_t )strlen( pKeyword->pszName );
+            break;
+        }
+    }
+    if( !pKeyword )
+    {
+        return "Unknown value";
+    }
+    pOp->Source = pKeyword->Source;
+
+    SkipSpace();
+
+    //
+    // Operators, tested in the interpreter's order
+    //
+    static const struct
+    {
+        const char* psz;
+        uint8_t Compare;
+    } s_Operators[] =
+    {
+        { "==", CONFIG_CMP_EQUAL },
+        { "!=", CONFIG_CMP_NOT_EQUAL },
+        { "<>", CONFIG_CMP_NOT_EQUAL },
+        { "=>", CONFIG_CMP_GREATER_EQUAL },
+        { "=<", CONFIG_CMP_LESS_EQUAL },
+        { "<=", CONFIG_CMP_LESS_EQUAL },
+        { ">=", CONFIG_CMP_GREATER_EQUAL },
+        { "=", CONFIG_CMP_EQUAL },
+        { ">", CONFIG_CMP_GREATER },
+        { "<", CONFIG_CMP_LESS },
+        { "&", CONFIG_CMP_AND },
+    };
+    size_t iOperator;
+    for( iOperator = 0; iOperator < sizeof( s_Operators ) / sizeof( s_Operators[0] ); iOperator++ )
+    {
+        const char* psz = s_Operators[iOperator].psz;
+        if( Cur() == psz[0] && ( psz[1] == 0 || Chr( m_Cur.Pos + 1 ) == psz[1] ) )
+        {
+            m_Cur.Pos += ( uint32_t )strlen( psz );
+            break;
+        }
+    }
+    if( iOperator == sizeof( s_Operators ) / sizeof( s_Operators[0] ) )
+    {
+        return "Unknown operator";
+    }
+    pOp->Compare = s_Operators[iOperator].Compare;
+
+    SkipSpace();
+
+    if( pOp->Source == CONFIG_SOURCE_GUID )         // GUID  D7B71F83-6340-11CF-4C73-0100A7C2C935
+    {
+        if( pOp->Compare > CONFIG_CMP_NOT_EQUAL )
+        {
+            return "Only == or != allowed";
+        }
+
+        uint32_t tempGUID[4];
+        uint32_t res, res2;
+
+        if( ( res = Get4Digits() ) == CONFIG_NO_INDEX || ( res2 = Get4Digits() ) == CONFIG_NO_INDEX )
+            return "Invalid GUID";
+        tempGUID[0] = ( res << 16 ) + res2;
+
+        if( Chr( m_Cur.Pos++ ) != '-' || ( res = Get4Digits() ) == CONFIG_NO_INDEX ||
+            Chr( m_Cur.Pos++ ) != '-' || ( res2 = Get4Digits() ) == CONFIG_NO_INDEX )
+            return "Invalid GUID";
+        tempGUID[1] = ( res2 << 16 ) + res;
+
+        if( Chr( m_Cur.Pos++ ) != '-' || ( res = sGet4Digits() ) == CONFIG_NO_INDEX ||
+            Chr( m_Cur.Pos++ ) != '-' || ( res2 = sGet4Digits() ) == CONFIG_NO_INDEX )
+            return "Invalid GUID";
+        tempGUID[2] = ( res2 << 16 ) + res;
+
+        if( ( res = sGet4Digits() ) == CONFIG_NO_INDEX || ( res2 = sGet4Digits() ) == CONFIG_NO_INDEX )
+            return "Invalid GUID";
+        tempGUID[3] = ( res2 << 16 ) + res;
+
+        pOp->Arg[0] = ( uint32_t )( m_pRules->m_Guids.size() / 4 );
+        m_pRules->m_Guids.insert( m_pRules->m_Guids.end(), tempGUID, tempGUID + 4 );
+        return NULL;
+    }
+
+    if( pOp->Source == CONFIG_SOURCE_DRIVER )       // Driver 4.1.25.1111
+    {
+        // The interpreter checked the wrong part after the second number, and read on
+        // after a bad fourth number; both are kept so the same text gives the same result.
+        uint32_t result = GetNumber();
+        if( result == CONFIG_NO_INDEX || Chr( m_Cur.Pos++ ) != '.' )
+            return "Invalid driver number";
+
+        uint32_t result1 = GetNumber();
+        uint32_t HighPart = ( result << 16 ) + result1;
+        if( Chr( m_Cur.Pos++ ) != '.' )
+            return "Invalid driver number";
+
+        result = GetNumber();
+        if( result == CONFIG_NO_INDEX || Chr( m_Cur.Pos++ ) != '.' )
+            return "Invalid driver number";
+
+        result1 = GetNumber();
+        uint32_t LowPart = ( result << 16 ) + result1;
+
+        if( pOp->Compare > CONFIG_CMP_LESS_EQUAL )
+            return "Invalid";
+
+        pOp->Arg[0] = ( uint32_t )m_pRules->m_Drivers.size();
+        m_pRules->m_Drivers.push_back( ( int64_t )( ( ( uint64_t )HighPart << 32 ) | LowPart ) );
+        return NULL;
+    }
+
+    //
+    // Get Value (or OS)
+    //
+    if( pOp->Source == CONFIG_VALUE_OS )
+    {
+        uint32_t iOs;
+        for( iOs = 0; iOs < sizeof( k_OsKeywords ) / sizeof( k_OsKeywords[0] ); iOs++ )
+        {
+            if( NextStringIs( k_OsKeywords[iOs] ) )
+                break;
+        }
+        if( iOs == sizeof( k_OsKeywords ) / sizeof( k_OsKeywords[0] ) )
+        {
+            return "Unknown OS";
+        }
+        m_Cur.Pos += ( uint32_t )strlen( k_OsKeywords[iOs] );
+        pOp->Arg[0] = iOs;
+    }
+    else
+    {
+        pOp->Arg[0] = GetNumber();
+        if( pOp->Arg[0] == CONFIG_NO_INDEX )
+        {
+            return "Number expected";
+        }
+    }
+
+    return NULL;
+}
+
+
+//--------------------------------------------------------------------------------------
+uint32_t CConfigCompiler::InternString( const char* psz )
+{
+    std::map <std::string, uint32_t>::iterator it = m_StringMap.find( psz );
+    if( it != m_StringMap.end() )
+        return it->second;
+
+    uint32_t nString = ( uint32_t )m_pRules->m_StringOffsets.size();
+    m_pRules->m_StringOffsets.push_back( ( uint32_t )m_pRules->m_StringData.size() );
+    m_pRules->m_StringData.insert( m_pRules->m_StringData.end(), psz, psz + strlen( psz ) + 1 );
+    m_StringMap[psz] = nString;
+    return nString;
+}
+
+
+//--------------------------------------------------------------------------------------
+uint32_t CConfigCompiler::InternKey( const char* psz )
+{
+    std::map <std::string, uint32_t>::iterator it = m_KeyMap.find( psz );
+    if( it != m_KeyMap.end() )
+        return it->second;
+
+    uint32_t nKey = ( uint32_t )m_pRules->m_KeyStrings.size();
+    m_pRules->m_KeyStrings.push_back( InternString( psz ) );
+    m_KeyMap[psz] = nKey;
+    return nKey;
+}
+
+
+//--------------------------------------------------------------------------------------
+uint32_t CConfigCompiler::InternName( const char* psz )
+{
+    std::map <std::string, uint32_t>::iterator it = m_NameMap.find( psz );
+    if( it != m_NameMap.end() )
+        return it->second;
+
+    uint32_t nName = ( uint32_t )m_pRules->m_NameStrings.size();
+    m_pRules->m_NameStrings.push_back( InternString( psz ) );
+    m_NameMap[psz] = nName;
+    return nName;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CConfigCompiler::Emit( OpList& ops, uint8_t Op, uint8_t Flags, uint32_t Arg0, uint32_t Arg1, uint32_t Arg2 )
+{
+    CONFIG_OP op;
+    op.Op = Op;
+    op.Flags = Flags;
+    op.Source = 0;
+    op.Compare = 0;
+    op.Arg[0] = Arg0;
+    op.Arg[1] = Arg1;
+    op.Arg[2] = Arg2;
+    ops.push_back( op );
+
+    if( !( Flags & CONFIG_OP_FLAG_CONDITIONAL ) && ( Op == CONFIG_OP_ERROR || Op == CONFIG_OP_MAX_DETAIL ) )
+    {
+        m_nAlwaysOps++;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Turns the queued errors into ops
+//--------------------------------------------------------------------------------------
+void CConfigCompiler::EmitPending( OpList& ops, uint8_t Flags )
+{
+    for( size_t i = 0; i < m_Pending.size(); i++ )
+    {
+        Emit( ops, CONFIG_OP_ERROR, Flags, m_Pending[i] );
+    }
+    m_Pending.clear();
+}
+
+
+//--------------------------------------------------------------------------------------
+// An error that makes the interpreter give up.  Errors already queued come first.
+//--------------------------------------------------------------------------------------
+void CConfigCompiler::EmitFailure( OpList& ops, const char* pszErrorText, uint8_t Flags )
+{
+    if( pszErrorText )
+    {
+        SyntaxError( pszErrorText );
+    }
+    EmitPending( ops, Flags );
+    Emit( ops, CONFIG_OP_ABORT, Flags );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Runs a block.  A block that always fails is followed by an ABORT, so every run of
+// ops ends with an op that stops it.
+//--------------------------------------------------------------------------------------
+void CConfigCompiler::EmitCall( OpList& ops, uint32_t nTarget, const CONFIG_BLOCK_INFO& block )
+{
+    Emit( ops, CONFIG_OP_CALL, 0, nTarget, block.iOp );
+    if( block.bAborts )
+    {
+        Emit( ops, CONFIG_OP_ABORT, 0 );
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Returns the first queued error, for lookup tables, and empties the queue
+//--------------------------------------------------------------------------------------
+uint32_t CConfigCompiler::TakePending()
+{
+    uint32_t nError = m_Pending.empty() ? CONFIG_NO_INDEX : m_Pending[0];
+    m_Pending.clear();
+    return nError;
+}
+
+
+//--------------------------------------------------------------------------------------
+uint32_t CConfigCompiler::AddOps( const OpList& ops )
+{
+    uint32_t iOp = ( uint32_t )m_pRules->m_Ops.size();
+    m_pRules->m_Ops.insert( m_pRules->m_Ops.end(), ops.begin(), ops.end() );
+    return iOp;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Compiles the property set body starting at the current position, as DoPropertySet
+// read it.  Lines the interpreter only read outside a false IF become conditional ops;
+// IF, ENDIF and MaxOverallGraphicDetail lines were always read.
+//--------------------------------------------------------------------------------------
+CONFIG_BLOCK_INFO CConfigCompiler::CompileBlock()
+{
+    BlockKey key( std::make_pair( m_Cur.Pos, m_Cur.LinePos ), std::make_pair( m_Cur.LineNumber, m_nGeneration ) );
+    std::map <BlockKey, CONFIG_BLOCK_INFO>::iterator itBlock = m_BlockMap.find( key );
+    if( itBlock != m_BlockMap.end() )
+    {
+        m_Cur = itBlock->second.End;
+        return itBlock->second;
+    }
+
+    OpList ops;
+    uint32_t aIfOp[CONFIG_MAX_NESTED_IF];       // Open IF ops and the always-run op count when they opened
+    uint32_t aIfAlways[CONFIG_MAX_NESTED_IF];
+    int IfPointer = 0;
+    bool first = true;
+    bool bAborts = false;
+    std::string Flag, Value, strName;
+
+    do
+    {
+        if( first )
+        {
+            first = false;
+        }
+        else
+        {
+            SkipToNextLine();
+        }
+
+        //
+        // Check for unexpected keywords
+        //
+        if( NextStringIs( k_KeywordDisplayVendor ) || NextStringIs( k_KeywordAudioVendor ) ||
+            NextStringIs( k_KeywordRequirements ) )
+        {
+            goto Done;
+        }
+
+        SkipSpace();
+
+        if( Cur() == 13 || AtComment() )        // Ignore comments and blank lines
+        {
+            continue;
+        }
+
+        if( IsDigit( Cur() ) || NextStringIs( k_KeywordUnknown ) )     // Or another device
+        {
+            continue;
+        }
+
+        if( NextStringIs( k_KeywordBreak ) )
+        {
+            break;
+        }
+
+        if( NextStringIs( k_KeywordMaxOverallGraphicDetail ) )
+        {
+            m_Cur.Pos += ( uint32_t )strlen( k_KeywordMaxOverallGraphicDetail );
+
+            SkipSpace();
+            if( Cur() != '=' )
+            {
+                EmitFailure( ops, "Expecting \'=\', didn\'t get it", 0 );
+                bAborts = true;
+                goto Done;
+            }
+            m_Cur.Pos++;
+            SkipSpace();
+
+            uint32_t dwMaxOGD = GetNumber();
+            if( dwMaxOGD == CONFIG_NO_INDEX )
+            {
+                EmitFailure( ops, "MaxOverallGraphicDetail did not specify a number!", 0 );
+                bAborts = true;
+                goto Done;
+            }
+
+            char maxValue[16];
+            snprintf( maxValue, sizeof( maxValue ), "%d", ( int )dwMaxOGD );
+            uint32_t nLevel = InternString( maxValue );
+            uint32_t nError = FormatError( "Unrecognized graphic detail" );
+            m_MaxDetails.push_back( std::make_pair( nLevel, nError ) );
+            Emit( ops, CONFIG_OP_MAX_DETAIL, 0, dwMaxOGD, nLevel, nError );
+            continue;
+        }
+
+        if( NextStringIs( k_KeywordIf ) )
+        {
+            m_Cur.Pos += 2;
+
+            CONFIG_OP op;
+            memset( &op, 0, sizeof( op ) );
+            const char* pszError = GetCondition( &op );
+
+            if( ++IfPointer == CONFIG_MAX_NESTED_IF )
+            {
+                EmitFailure( ops, "IF's nested too deep", 0 );
+                bAborts = true;
+                goto Done;
+            }
+            if( pszError )
+            {
+                EmitFailure( ops, pszError, 0 );
+                bAborts = true;
+                goto Done;
+            }
+
+            // Errors from numbers the condition could still use
+            EmitPending( ops, 0 );
+
+            op.Op = CONFIG_OP_IF;
+            op.Arg[1] = CONFIG_NO_INDEX;
+            aIfOp[IfPointer - 1] = ( uint32_t )ops.size();
+            aIfAlways[IfPointer - 1] = m_nAlwaysOps;
+            ops.push_back( op );
+        }
+        else if( NextStringIs( k_KeywordEndif ) )
+        {
+            if( IfPointer == 0 )
+            {
+                EmitFailure( ops, "Unexpected ENDIF", 0 );
+                bAborts = true;
+                goto Done;
+            }
+
+            --IfPointer;
+
+            // A false IF can jump straight here if nothing inside has to run anyway
+            if( aIfAlways[IfPointer] == m_nAlwaysOps )
+            {
+                ops[aIfOp[IfPointer]].Arg[1] = ( uint32_t )ops.size();
+            }
+            Emit( ops, CONFIG_OP_ENDIF, 0 );
+        }
+        else
+        {
+            //
+            // Lines that are skipped inside a false IF.  If one of these fails, the
+            // interpreter only fails when it is not skipping; when it is skipping it
+            // carries on from the start of the next line.
+            //
+            CONFIG_CURSOR LineStart = m_Cur;
+
+            if( NextStringIs( k_KeywordPropertySet ) )
+            {
+                m_Cur.Pos += ( uint32_t )strlen( k_KeywordPropertySet );
+
+                SkipSpace();
+
+                if( Cur() != '=' )
+                {
+                    EmitFailure( ops, "Missing =", CONFIG_OP_FLAG_CONDITIONAL );
+                    m_Cur = LineStart;
+                    continue;
+                }
+
+                m_Cur.Pos++;
+                if( !GetString( strName ) )
+                {
+                    EmitFailure( ops, NULL, CONFIG_OP_FLAG_CONDITIONAL );
+                    m_Cur = LineStart;
+                    continue;
+                }
+
+                // A name closed on a later line would leave the interpreter reading from
+                // a different line depending on the IFs around it
+                for( uint32_t Pos = LineStart.Pos; Pos < m_Cur.Pos; Pos++ )
+                {
+                    if( Chr( Pos ) == 13 )
+                    {
+                        char szError[64];
+                        snprintf( szError, sizeof( szError ), "Unterminated property set name on line %d",
+                                  ( int )LineStart.LineNumber );
+                        m_pRules->m_CompileError = szError;
+                        m_bFailed = true;
+                        break;
+                    }
+                }
+
+                std::map <std::string, uint32_t>::iterator itSet = m_SetNames.find( strName.c_str() );
+                if( itSet == m_SetNames.end() )
+                {
+                    EmitFailure( ops, "Unrecognized property set", CONFIG_OP_FLAG_CONDITIONAL );
+                    continue;
+                }
+                Emit( ops, CONFIG_OP_APPLY, CONFIG_OP_FLAG_CONDITIONAL, itSet->second );
+            }
+            else
+            {
+                const char* pszError = GetFlag( Flag, Value );
+                if( pszError )
+                {
+                    EmitFailure( ops, pszError, CONFIG_OP_FLAG_CONDITIONAL );
+                    m_Cur = LineStart;
+                    continue;
+                }
+
+                uint32_t nKey = InternKey( Flag.c_str() );
+                uint32_t nValue = InternString( Value.c_str() );
+                Emit( ops, CONFIG_OP_SET, CONFIG_OP_FLAG_CONDITIONAL, nKey, nValue );
+
+                if( strcmp( Flag.c_str(), k_KeywordOverallGraphicDetail ) == 0 )
+                {
+                    m_DetailValues.insert( nValue );
+                }
+            }
+        }
+
+    } while( m_Cur.Pos < m_EndOfFile );
+
+    //
+    // Check for hanging endif
+    //
+    if( IfPointer != 0 )
+    {
+        EmitFailure( ops, "Bad IF/ENDIF", 0 );
+        bAborts = true;
+    }
+
+Done:
+    Emit( ops, CONFIG_OP_END, 0 );
+
+    CONFIG_BLOCK_INFO info;
+    info.iOp = AddOps( ops );
+    info.End = m_Cur;
+    info.bAborts = bAborts;
+
+    // Jump targets were relative to the block
+    for( size_t i = 0; i < ops.size(); i++ )
+    {
+        CONFIG_OP& op = m_pRules->m_Ops[info.iOp + i];
+        if( op.Op == CONFIG_OP_IF && op.Arg[1] != CONFIG_NO_INDEX )
+        {
+            op.Arg[1] += info.iOp;
+        }
+    }
+
+    m_BlockMap[key] = info;
+    return info;
+}
+
+
+//--------------------------------------------------------------------------------------
+// The Requirements section, the named PropertySets and the ApplyToAll sections before
+// the first vendor.  None of these depend on the hardware except through IFs.
+//--------------------------------------------------------------------------------------
+void CConfigCompiler::CompileMainScript()
+{
+    OpList ops;
+    CONFIG_CURSOR Start = { 0, 0, 1 };
+    CONFIG_BLOCK_INFO block;
+    std::string strName;
+
+    //
+    // Requirements
+    //
+    m_Cur = Start;
+    do
+    {
+        if( NextStringIs( k_KeywordRequirements ) )
+        {
+            break;
+        }
+        SkipToNextLine();
+
+    } while( m_Cur.Pos < m_EndOfFile );
+
+    if( m_Cur.Pos < m_EndOfFile )
+    {
+        SkipToNextLine();
+        block = CompileBlock();
+        EmitCall( ops, CONFIG_SET_REQUIREMENTS, block );
+        if( block.bAborts )
+            goto Done;
+    }
+
+    //
+    // Named property sets
+    //
+    m_Cur = Start;
+    do
+    {
+        if( NextStringIs( k_KeywordPropertySet ) )
+        {
+            m_Cur.Pos += ( uint32_t )strlen( k_KeywordPropertySet );
+
+            SkipSpace();
+
+            if( Cur() != '=' )
+            {
+                EmitFailure( ops, "Missing =", 0 );
+                goto Done;
+            }
+
+            m_Cur.Pos++;
+            if( !GetString( strName ) )
+            {
+                EmitFailure( ops, NULL, 0 );
+                goto Done;
+            }
+
+            SkipToNextLine();
+            uint32_t nSet = m_pRules->m_nNamedSets++;
+            block = CompileBlock();
+            EmitCall( ops, CONFIG_SET_FIRST_NAMED + nSet, block );
+            if( block.bAborts )
+                goto Done;
+
+            Emit( ops, CONFIG_OP_DEFINE, 0, nSet, InternName( strName.c_str() ) );
+            m_SetNames[strName.c_str()] = nSet;
+            m_nGeneration++;
+        }
+        else if( NextStringIs( k_KeywordDisplayVendor ) || NextStringIs( k_KeywordAudioVendor ) ||
+                 NextStringIs( k_KeywordApplyToAll ) )
+        {
+            break;
+        }
+
+        SkipToNextLine();
+
+    } while( m_Cur.Pos < m_EndOfFile );
+
+    //
+    // ApplyToAll sections before the vendors
+    //
+    do
+    {
+        if( NextStringIs( k_KeywordApplyToAll ) )
+        {
+            SkipToNextLine();
+            block = CompileBlock();
+            EmitCall( ops, CONFIG_SET_DEVICE, block );
+            if( block.bAborts )
+                goto Done;
+        }
+        else if( NextStringIs( k_KeywordDisplayVendor ) || NextStringIs( k_KeywordAudioVendor ) )
+        {
+            break;
+        }
+
+        SkipToNextLine();
+
+    } while( m_Cur.Pos < m_EndOfFile );
+
+    Emit( ops, CONFIG_OP_RETURN, 0, m_Cur.Pos );
+    m_pRules->m_MainScript = AddOps( ops );
+
+    //
+    // The vendor sections are searched from here, display first
+    //
+    {
+        CONFIG_CURSOR AfterPreApplyToAll = m_Cur;
+
+        m_pRules->m_DisplayTable = CompileVendorTable( false );
+        ops.clear();
+        Emit( ops, CONFIG_OP_MATCH, 0, m_pRules->m_DisplayTable, CONFIG_ID_GFX_VENDOR );
+        m_pRules->m_DisplayScript = AddOps( ops );
+
+        m_Cur = AfterPreApplyToAll;
+        m_pRules->m_SoundTable = CompileVendorTable( true );
+        ops.clear();
+        Emit( ops, CONFIG_OP_MATCH, 0, m_pRules->m_SoundTable, CONFIG_ID_SOUND_VENDOR );
+        m_pRules->m_SoundScript = AddOps( ops );
+    }
+
+    CompilePostBlocks();
+    return;
+
+Done:
+    // Every evaluation fails here, so nothing after this point can run
+    m_pRules->m_MainScript = AddOps( ops );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Find correct VendorID, as DoDisplayVendorAndDevice and DoSoundVendorAndDevice did
+//--------------------------------------------------------------------------------------
+uint32_t CConfigCompiler::CompileVendorTable( bool bSound )
+{
+    const char* pszVendor = bSound ? k_KeywordAudioVendor : k_KeywordDisplayVendor;
+
+    CONFIG_TABLE table;
+    table.FirstEntry = 0;
+    table.EntryCount = 0;
+    table.UnknownEntry = CONFIG_NO_INDEX;
+    table.ErrorEntry = CONFIG_NO_INDEX;
+    table.ErrorString = CONFIG_NO_INDEX;
+    table.NoIdEntry = CONFIG_NO_INDEX;
+    table.NoIdPos = 0;
+
+    // Entries are added to m_Entries while scripts add tables of their own, so this
+    // table's entries are gathered first and stored together at the end.
+    std::vector <CONFIG_ENTRY> Entries;
+    std::set <uint32_t> Seen;
+    do
+    {
+        if( NextStringIs( pszVendor ) )
+        {
+            m_Cur.Pos += ( uint32_t )strlen( pszVendor );
+
+            SkipSpace();
+
+            if( Cur() == '=' )
+            {
+                m_Cur.Pos++;
+
+                CONFIG_ENTRY entry;
+                CONFIG_CURSOR Saved;
+                if( NextStringIs( k_KeywordUnknown ) )
+                {
+                    // The name is read from the keyword itself, which always fails
+                    Saved = m_Cur;
+                    if( table.NoIdEntry == CONFIG_NO_INDEX )
+                    {
+                        table.NoIdEntry = ( uint32_t )Entries.size();
+                        table.NoIdPos = m_Cur.Pos;
+                    }
+                    entry.Id = CONFIG_NO_INDEX;
+                    entry.Script = CompileVendorScript( bSound );
+                    m_Cur = Saved;
+                    table.UnknownEntry = ( uint32_t )Entries.size();
+                    Entries.push_back( entry );
+                    break;
+                }
+
+                entry.Id = GetNumber();                       // Will be -1 if error
+                entry.Script = CONFIG_NO_INDEX;
+
+                uint32_t nError = TakePending();
+                if( nError != CONFIG_NO_INDEX && table.ErrorEntry == CONFIG_NO_INDEX )
+                {
+                    table.ErrorEntry = ( uint32_t )Entries.size();
+                    table.ErrorString = nError;
+                }
+                if( entry.Id == CONFIG_NO_INDEX && table.NoIdEntry == CONFIG_NO_INDEX )
+                {
+                    table.NoIdEntry = ( uint32_t )Entries.size();
+                    table.NoIdPos = m_Cur.Pos;
+                }
+                if( nError == CONFIG_NO_INDEX && Seen.insert( entry.Id ).second )
+                {
+                    Saved = m_Cur;
+                    entry.Script = CompileVendorScript( bSound );
+                    m_Cur = Saved;
+                }
+                Entries.push_back( entry );
+            }
+        }
+        else if( NextStringIs( k_KeywordApplyToAll ) )
+        {
+            break;
+        }
+
+        SkipToNextLine();
+
+    } while( m_Cur.Pos < m_EndOfFile );
+
+    table.EndPos = m_Cur.Pos;
+    table.FirstEntry = ( uint32_t )m_pRules->m_Entries.size();
+    table.EntryCount = ( uint32_t )Entries.size();
+    m_pRules->m_Entries.insert( m_pRules->m_Entries.end(), Entries.begin(), Entries.end() );
+    m_pRules->m_Tables.push_back( table );
+    return ( uint32_t )m_pRules->m_Tables.size() - 1;
+}
+
+
+//--------------------------------------------------------------------------------------
+// From a matching vendor line: the vendor name, any vendor-wide property sets, then
+// the device search
+//--------------------------------------------------------------------------------------
+uint32_t CConfigCompiler::CompileVendorScript( bool bSound )
+{
+    const char* pszVendor = bSound ? k_KeywordAudioVendor : k_KeywordDisplayVendor;
+    OpList ops;
+    std::string strVendor;
+
+    if( !GetString( strVendor ) )
+    {
+        EmitFailure( ops, NULL, 0 );
+        return AddOps( ops );
+    }
+    Emit( ops, CONFIG_OP_STRING, 0, bSound ? CONFIG_ID_SOUND_VENDOR : CONFIG_ID_GFX_VENDOR,
+          InternString( strVendor.c_str() ) );
+
+    //
+    // Skip over any other vendor names (Some devices have multiple vendors)
+    //
+    do
+    {
+        SkipToNextLine();
+
+        if( !NextStringIs( pszVendor ) )
+        {
+            SkipSpace();
+
+            if( IsDigit( Cur() ) )
+            {
+                break;
+            }
+
+            if( Cur() != 13 && !AtComment() )       // Ignore comments and blank lines
+            {
+                //
+                // If we find a line that is not a comment or vendor before
+                // the first device, it must be the start of a property set.
+                //
+                CONFIG_BLOCK_INFO block = CompileBlock();
+                EmitCall( ops, CONFIG_SET_DEVICE, block );
+                if( block.bAborts )
+                {
+                    return AddOps( ops );
+                }
+            }
+        }
+
+    } while( m_Cur.Pos < m_EndOfFile );
+
+    uint32_t nTable = CompileDeviceTable( bSound );
+    Emit( ops, CONFIG_OP_MATCH, 0, nTable, bSound ? CONFIG_ID_SOUND_DEVICE : CONFIG_ID_GFX_DEVICE );
+    return AddOps( ops );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Now search for DeviceID (Until next vendor or end of file is found)
+//--------------------------------------------------------------------------------------
+uint32_t CConfigCompiler::CompileDeviceTable( bool bSound )
+{
+    const char* pszVendor = bSound ? k_KeywordAudioVendor : k_KeywordDisplayVendor;
+
+    CONFIG_TABLE table;
+    table.FirstEntry = 0;
+    table.EntryCount = 0;
+    table.UnknownEntry = CONFIG_NO_INDEX;
+    table.ErrorEntry = CONFIG_NO_INDEX;
+    table.ErrorString = CONFIG_NO_INDEX;
+    table.NoIdEntry = CONFIG_NO_INDEX;
+    table.NoIdPos = 0;
+
+    std::vector <CONFIG_ENTRY> Entries;
+    std::set <uint32_t> Seen;
+    do
+    {
+        if( NextStringIs( pszVendor ) || ( bSound && NextStringIs( k_KeywordDisplayVendor ) ) )
+        {
+            break;
+        }
+
+        CONFIG_ENTRY entry;
+        CONFIG_CURSOR Saved;
+        if( NextStringIs( k_KeywordUnknown ) )
+        {
+            m_Cur.Pos += ( uint32_t )strlen( k_KeywordUnknown );
+            SkipSpace();
+
+            if( table.NoIdEntry == CONFIG_NO_INDEX )
+            {
+                table.NoIdEntry = ( uint32_t )Entries.size();
+                table.NoIdPos = m_Cur.Pos;
+            }
+            entry.Id = CONFIG_NO_INDEX;
+            entry.Script = CompileDeviceScript( bSound );
+            table.UnknownEntry = ( uint32_t )Entries.size();
+            Entries.push_back( entry );
+            break;
+        }
+
+        SkipSpace();
+
+        if( IsDigit( Cur() ) )
+        {
+            entry.Id = GetNumber();
+            entry.Script = CONFIG_NO_INDEX;
+
+            uint32_t nError = TakePending();
+            if( nError != CONFIG_NO_INDEX && table.ErrorEntry == CONFIG_NO_INDEX )
+            {
+                table.ErrorEntry = ( uint32_t )Entries.size();
+                table.ErrorString = nError;
+            }
+            if( entry.Id == CONFIG_NO_INDEX && table.NoIdEntry == CONFIG_NO_INDEX )
+            {
+                table.NoIdEntry = ( uint32_t )Entries.size();
+                table.NoIdPos = m_Cur.Pos;
+            }
+            if( nError == CONFIG_NO_INDEX && Seen.insert( entry.Id ).second )
+            {
+                Saved = m_Cur;
+                entry.Script = CompileDeviceScript( bSound );
+                m_Cur = Saved;
+            }
+            Entries.push_back( entry );
+        }
+
+        SkipToNextLine();
+
+    } while( m_Cur.Pos < m_EndOfFile );
+
+    table.EndPos = m_Cur.Pos;
+    table.FirstEntry = ( uint32_t )m_pRules->m_Entries.size();
+    table.EntryCount = ( uint32_t )Entries.size();
+    m_pRules->m_Entries.insert( m_pRules->m_Entries.end(), Entries.begin(), Entries.end() );
+    m_pRules->m_Tables.push_back( table );
+    return ( uint32_t )m_pRules->m_Tables.size() - 1;
+}
+
+
+//--------------------------------------------------------------------------------------
+// From a matching device line: the device name and its property set
+//--------------------------------------------------------------------------------------
+uint32_t CConfigCompiler::CompileDeviceScript( bool bSound )
+{
+    OpList ops;
+    std::string strDevice;
+
+    if( Cur() != '=' )
+    {
+        EmitFailure( ops, "xxx = Device Name expected", 0 );
+        return AddOps( ops );
+    }
+    m_Cur.Pos++;
+
+    if( !GetString( strDevice ) )
+    {
+        EmitFailure( ops, NULL, 0 );
+        return AddOps( ops );
+    }
+    Emit( ops, CONFIG_OP_STRING, 0, bSound ? CONFIG_ID_SOUND_DEVICE : CONFIG_ID_GFX_DEVICE,
+          InternString( strDevice.c_str() ) );
+
+    SkipToNextLine();
+    CONFIG_BLOCK_INFO block = CompileBlock();
+    EmitCall( ops, CONFIG_SET_DEVICE, block );
+    if( !block.bAborts )
+    {
+        Emit( ops, CONFIG_OP_RETURN, 0, block.End.Pos );
+    }
+    return AddOps( ops );
+}
+
+
+//--------------------------------------------------------------------------------------
+// ApplyToAll sections after the vendors.  Where the interpreter started looking for
+// them depends on the vendor and device found, so every section gets a script and
+// evaluation runs the ones at or after that point.  Errors in these sections give the
+// line number counted from the top of the file; the interpreter did not count line
+// breaks inside quoted names, so the two only differ after such a name.
+//--------------------------------------------------------------------------------------
+void CConfigCompiler::CompilePostBlocks()
+{
+    m_Cur.Pos = 0;
+    m_Cur.LinePos = 0;
+    m_Cur.LineNumber = 1;
+    do
+    {
+        if( NextStringIs( k_KeywordApplyToAll ) )
+        {
+            CONFIG_CURSOR Header = m_Cur;
+            OpList ops;
+
+            SkipToNextLine();
+            CONFIG_BLOCK_INFO block = CompileBlock();
+            EmitCall( ops, CONFIG_SET_DEVICE, block );
+            if( !block.bAborts )
+            {
+                SkipToNextLine();
+                Emit( ops, CONFIG_OP_RETURN, 0, m_Cur.Pos );
+            }
+
+            CONFIG_POST_BLOCK post;
+            post.Pos = Header.Pos;
+            post.Script = AddOps( ops );
+            m_pRules->m_PostBlocks.push_back( post );
+
+            m_Cur = Header;
+        }
+
+        SkipToNextLine();
+
+    } while( m_Cur.Pos < m_EndOfFile );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Open addressing table of ( table, id ) -> first entry with that id
+//--------------------------------------------------------------------------------------
+void CConfigCompiler::BuildHash()
+{
+    uint32_t nSize = 16;
+    while( nSize < m_pRules->m_Entries.size() * 2 )
+        nSize *= 2;
+
+    CONFIG_HASH_SLOT Empty = { 0, 0, CONFIG_NO_INDEX };
+    m_pRules->m_Hash.assign( nSize, Empty );
+
+    for( uint32_t nTable = 0; nTable < m_pRules->m_Tables.size(); nTable++ )
+    {
+        const CONFIG_TABLE& table = m_pRules->m_Tables[nTable];
+        for( uint32_t i = 0; i < table.EntryCount; i++ )
+        {
+            const CONFIG_ENTRY& entry = m_pRules->m_Entries[table.FirstEntry + i];
+            if( i == table.UnknownEntry || entry.Script == CONFIG_NO_INDEX )
+                continue;
+
+            uint32_t h = HashId( nTable, entry.Id ) & ( nSize - 1 );
+            while( m_pRules->m_Hash[h].Entry != CONFIG_NO_INDEX )
+                h = ( h + 1 ) & ( nSize - 1 );
+
+            m_pRules->m_Hash[h].Table = nTable;
+            m_pRules->m_Hash[h].Id = entry.Id;
+            m_pRules->m_Hash[h].Entry = i;
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// A MaxOverallGraphicDetail level that no OverallGraphicDetail line ever sets fails
+// whenever it lowers the detail, so it is worth reporting
+//--------------------------------------------------------------------------------------
+void CConfigCompiler::CheckDetailLevels()
+{
+    for( size_t i = 0; i < m_MaxDetails.size(); i++ )
+    {
+        if( m_DetailValues.count( m_MaxDetails[i].first ) == 0 &&
+            m_DiagnosticSet.insert( m_MaxDetails[i].second ).second )
+        {
+            m_pRules->m_Diagnostics.push_back( m_MaxDetails[i].second );
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+bool CConfigCompiler::Compile( const char* pText, uint32_t cbText )
+{
+    m_pRules->Clear();
+
+    // Lines end at a CR, as they did for the interpreter, which read the file as it was
+    // checked out on Windows.  A bare LF, as the file has when checked out elsewhere,
+    // becomes a CR; the LF of a CR LF is skipped after the CR.  Each character keeps its
+    // place, so positions are those of the original text.
+    m_Text.assign( pText, pText + cbText );
+    for( uint32_t i = 0; i < cbText; i++ )
+    {
+        if( m_Text[i] == 10 && ( i == 0 || m_Text[i - 1] != 13 ) )
+            m_Text[i] = 13;
+    }
+
+    // The interpreter made sure the last line ended with a CR
+    m_Text.push_back( 13 );
+    m_Text.resize( m_Text.size() + CONFIG_TEXT_PADDING, 0 );
+    m_EndOfFile = cbText;
+
+    m_nGeneration = 0;
+    m_nAlwaysOps = 0;
+    m_bFailed = false;
+
+    CompileMainScript();
+    BuildHash();
+    CheckDetailLevels();
+
+    std::map <std::string, uint32_t>::const_iterator it = m_KeyMap.find( k_KeywordOverallGraphicDetail );
+    m_pRules->m_nDetailKey = it != m_KeyMap.end() ? it->second : CONFIG_NO_INDEX;
+
+    if( m_bFailed )
+    {
+        std::string strError = m_pRules->m_CompileError;
+        m_pRules->Clear();
+        m_pRules->m_CompileError = strError;
+        return false;
+    }
+    return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// CConfigRules
+//--------------------------------------------------------------------------------------
+CConfigRules::CConfigRules()
+{
+    Clear();
+}
+
+
+//--------------------------------------------------------------------------------------
+void CConfigRules::Clear()
+{
+    m_StringData.clear();
+    m_StringOffsets.clear();
+    m_KeyStrings.clear();
+    m_NameStrings.clear();
+    m_Ops.clear();
+    m_Drivers.clear();
+    m_Guids.clear();
+    m_Tables.clear();
+    m_Entries.clear();
+    m_Hash.clear();
+    m_PostBlocks.clear();
+    m_Diagnostics.clear();
+    m_nNamedSets = 0;
+    m_nDetailKey = CONFIG_NO_INDEX;
+    m_MainScript = CONFIG_NO_INDEX;
+    m_DisplayScript = CONFIG_NO_INDEX;
+    m_SoundScript = CONFIG_NO_INDEX;
+    m_DisplayTable = CONFIG_NO_INDEX;
+    m_SoundTable = CONFIG_NO_INDEX;
+    m_CompileError.clear();
+}
+
+
+//--------------------------------------------------------------------------------------
+bool CConfigRules::Compile( const char* pText, uint32_t cbText )
+{
+    CConfigCompiler Compiler( this );
+    if( !Compiler.Compile( pText, cbText ) )
+        return false;
+
+    // A set whose block aborted the script is never used; Load expects no such sets
+    m_nNamedSets = CountNamedSets();
+    return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// One more than the highest named set any op uses
+//--------------------------------------------------------------------------------------
+uint32_t CConfigRules::CountNamedSets() const
+{
+    uint32_t nSets = 0;
+    for( uint32_t i = 0; i < m_Ops.size(); i++ )
+    {
+        const CONFIG_OP& op = m_Ops[i];
+        uint32_t nSet = CONFIG_NO_INDEX;
+        if( op.Op == CONFIG_OP_APPLY || op.Op == CONFIG_OP_DEFINE )
+            nSet = op.Arg[0];
+        else if( op.Op == CONFIG_OP_CALL && op.Arg[0] >= CONFIG_SET_FIRST_NAMED )
+            nSet = op.Arg[0] - CONFIG_SET_FIRST_NAMED;
+
+        if( nSet != CONFIG_NO_INDEX && nSet >= nSets )
+            nSets = nSet + 1;
+    }
+    return nSets;
+}
+
+
+//--------------------------------------------------------------------------------------
+uint32_t CConfigRules::FindName( const char* pszName ) const
+{
+    for( uint32_t i = 0; i < m_NameStrings.size(); i++ )
+    {
+        if( strcmp( GetString( m_NameStrings[i] ), pszName ) == 0 )
+            return i;
+    }
+    return CONFIG_NO_INDEX;
+}
+
+
+//--------------------------------------------------------------------------------------
+uint32_t CConfigRules::FindEntry( uint32_t nTable, uint32_t Id ) const
+{
+    if( m_Hash.empty() )
+        return CONFIG_NO_INDEX;
+
+    uint32_t nMask = ( uint32_t )m_Hash.size() - 1;
+    for( uint32_t h = HashId( nTable, Id ) & nMask; m_Hash[h].Entry != CONFIG_NO_INDEX; h = ( h + 1 ) & nMask )
+    {
+        if( m_Hash[h].Table == nTable && m_Hash[h].Id == Id )
+            return m_Hash[h].Entry;
+    }
+    return CONFIG_NO_INDEX;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Vendor ids in a vendor table, and device ids in the device table of a vendor
+//--------------------------------------------------------------------------------------
+void CConfigRules::GetVendorIds( bool bSound, std::vector <uint32_t>& VendorIds ) const
+{
+    VendorIds.clear();
+    uint32_t nTable = bSound ? m_SoundTable : m_DisplayTable;
+    if( nTable == CONFIG_NO_INDEX )
+        return;
+
+    const CONFIG_TABLE& table = m_Tables[nTable];
+    for( uint32_t i = 0; i < table.EntryCount; i++ )
+    {
+        const CONFIG_ENTRY& entry = m_Entries[table.FirstEntry + i];
+        if( i != table.UnknownEntry && entry.Script != CONFIG_NO_INDEX )
+            VendorIds.push_back( entry.Id );
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+void CConfigRules::GetDeviceIds( bool bSound, uint32_t VendorId, std::vector <uint32_t>& DeviceIds ) const
+{
+    DeviceIds.clear();
+    uint32_t nTable = bSound ? m_SoundTable : m_DisplayTable;
+    if( nTable == CONFIG_NO_INDEX )
+        return;
+
+    uint32_t iEntry = FindEntry( nTable, VendorId );
+    if( iEntry == CONFIG_NO_INDEX )
+        return;
+
+    // The vendor script ends with the match against its device table
+    for( uint32_t iOp = m_Entries[m_Tables[nTable].FirstEntry + iEntry].Script; iOp < m_Ops.size(); iOp++ )
+    {
+        const CONFIG_OP& op = m_Ops[iOp];
+        if( op.Op == CONFIG_OP_ABORT )
+            return;
+        if( op.Op == CONFIG_OP_MATCH )
+        {
+            const CONFIG_TABLE& table = m_Tables[op.Arg[0]];
+            for( uint32_t i = 0; i < table.EntryCount; i++ )
+            {
+                const CONFIG_ENTRY& entry = m_Entries[table.FirstEntry + i];
+                if( i != table.UnknownEntry && entry.Script != CONFIG_NO_INDEX )
+                    DeviceIds.push_back( entry.Id );
+            }
+            return;
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+CConfigPropertySet* CConfigRules::GetSet( CConfigResult* pResult, uint32_t nTarget )
+{
+    if( nTarget == CONFIG_SET_DEVICE )
+        return &pResult->Device;
+    if( nTarget == CONFIG_SET_REQUIREMENTS )
+        return &pResult->Requirements;
+    return &pResult->NamedSets[nTarget - CONFIG_SET_FIRST_NAMED];
+}
+
+
+//--------------------------------------------------------------------------------------
+static void RecordError( CConfigResult* pResult, uint32_t nError )
+{
+    if( !pResult->bError )
+    {
+        pResult->bError = true;
+        pResult->ErrorString = nError;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+bool CConfigRules::TestCondition( const CONFIG_OP& op, const CONFIG_SNAPSHOT& Snapshot ) const
+{
+    if( op.Source == CONFIG_SOURCE_GUID )
+    {
+        bool bEqual = memcmp( &m_Guids[op.Arg[0] * 4], Snapshot.DeviceIdentifier, 16 ) == 0;
+        return op.Compare == CONFIG_CMP_EQUAL ? bEqual : !bEqual;
+    }
+
+    if( op.Source == CONFIG_SOURCE_DRIVER )
+    {
+        int64_t lhs = Snapshot.DriverVersion;
+        int64_t rhs = m_Drivers[op.Arg[0]];
+        switch( op.Compare )
+        {
+            case CONFIG_CMP_EQUAL:          return lhs == rhs;
+            case CONFIG_CMP_NOT_EQUAL:      return lhs != rhs;
+            case CONFIG_CMP_GREATER:        return lhs > rhs;
+            case CONFIG_CMP_LESS:           return lhs < rhs;
+            case CONFIG_CMP_GREATER_EQUAL:  return lhs >= rhs;
+            default:                        return lhs <= rhs;
+        }
+    }
+
+    uint32_t Source = Snapshot.Values[op.Source];
+    uint32_t Value = op.Arg[0];
+    switch( op.Compare )
+    {
+        case CONFIG_CMP_EQUAL:          return Source == Value;
+        case CONFIG_CMP_NOT_EQUAL:      return Source != Value;
+        case CONFIG_CMP_GREATER:        return Source > Value;
+        case CONFIG_CMP_LESS:           return Source < Value;
+        case CONFIG_CMP_GREATER_EQUAL:  return Source >= Value;
+        case CONFIG_CMP_LESS_EQUAL:     return Source <= Value;
+        default:                        return ( Source & Value ) != 0;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Runs one property set body into the target set
+//--------------------------------------------------------------------------------------
+bool CConfigRules::RunBlock( uint32_t iOp, uint32_t nTarget, CConfigResult* pResult,
+                             const CONFIG_SNAPSHOT& Snapshot ) const
+{
+    CConfigPropertySet* pSet = GetSet( pResult, nTarget );
+    uint8_t NestedIf[CONFIG_MAX_NESTED_IF];
+    int IfPointer = 0;
+    uint8_t SkippingIF = 0;                     // 0=Not in an IF, 1=In True if, 2=In false IF
+
+    for( ; ; iOp++ )
+    {
+        const CONFIG_OP& op = m_Ops[iOp];
+        if( SkippingIF == 2 && ( op.Flags & CONFIG_OP_FLAG_CONDITIONAL ) )
+            continue;
+
+        switch( op.Op )
+        {
+            case CONFIG_OP_SET:
+                pSet->Set( op.Arg[0], op.Arg[1] );
+                if( op.Arg[0] == m_nDetailKey )
+                {
+                    // Remember which set each detail level was defined in
+                    size_t i;
+                    for( i = 0; i < pResult->DetailSets.size(); i += 2 )
+                    {
+                        if( pResult->DetailSets[i] == op.Arg[1] )
+                            break;
+                    }
+                    if( i == pResult->DetailSets.size() )
+                    {
+                        pResult->DetailSets.push_back( op.Arg[1] );
+                        pResult->DetailSets.push_back( nTarget );
+                    }
+                    else
+                    {
+                        pResult->DetailSets[i + 1] = nTarget;
+                    }
+                }
+                break;
+
+            case CONFIG_OP_APPLY:
+                pSet->Apply( pResult->NamedSets[op.Arg[0]] );
+                break;
+
+            case CONFIG_OP_MAX_DETAIL:
+            {
+                uint32_t nValue = pResult->Device.Get( m_nDetailKey );
+                if( nValue != CONFIG_NO_INDEX && ( uint32_t )atoi( GetString( nValue ) ) > op.Arg[0] )
+                {
+                    size_t i;
+                    for( i = 0; i < pResult->DetailSets.size(); i += 2 )
+                    {
+                        if( pResult->DetailSets[i] == op.Arg[1] )
+                            break;
+                    }
+                    if( i == pResult->DetailSets.size() )
+                    {
+                        RecordError( pResult, op.Arg[2] );
+                        return false;
+                    }
+                    pResult->Device.Apply( *GetSet( pResult, pResult->DetailSets[i + 1] ) );
+                }
+                break;
+            }
+
+            case CONFIG_OP_IF:
+                if( IfPointer == CONFIG_MAX_NESTED_IF )
+                    return false;
+                NestedIf[IfPointer++] = SkippingIF;
+                if( TestCondition( op, Snapshot ) )
+                {
+                    if( SkippingIF != 2 )
+                        SkippingIF = 1;
+                }
+                else
+                {
+                    SkippingIF = 2;
+                }
+                if( SkippingIF == 2 && op.Arg[1] != CONFIG_NO_INDEX )
+                {
+                    iOp = op.Arg[1] - 1;        // Straight to the ENDIF
+                }
+                break;
+
+            case CONFIG_OP_ENDIF:
+                if( IfPointer == 0 )
+                    return false;
+                SkippingIF = NestedIf[--IfPointer];
+                break;
+
+            case CONFIG_OP_ERROR:
+                RecordError( pResult, op.Arg[0] );
+                break;
+
+            case CONFIG_OP_END:
+                return true;
+
+            default:
+                return false;
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Runs a script.  *pEndPos receives the file position the interpreter would have
+// reached.
+//--------------------------------------------------------------------------------------
+bool CConfigRules::RunScript( uint32_t iOp, CConfigResult* pResult, const CONFIG_SNAPSHOT& Snapshot,
+                              uint32_t* pEndPos ) const
+{
+    // A script matches at most a vendor and then a device
+    int nMatches = 0;
+
+    for( ; ; iOp++ )
+    {
+        const CONFIG_OP& op = m_Ops[iOp];
+        switch( op.Op )
+        {
+            case CONFIG_OP_CALL:
+                if( !RunBlock( op.Arg[1], op.Arg[0], pResult, Snapshot ) )
+                    return false;
+                break;
+
+            case CONFIG_OP_DEFINE:
+                pResult->NameToSet[op.Arg[1]] = op.Arg[0];
+                break;
+
+            case CONFIG_OP_STRING:
+                pResult->Strings[op.Arg[0]] = op.Arg[1];
+                break;
+
+            case CONFIG_OP_MATCH:
+            {
+                if( ++nMatches > 2 )
+                    return false;
+
+                const CONFIG_TABLE& table = m_Tables[op.Arg[0]];
+                uint32_t Id = Snapshot.Ids[op.Arg[1]];
+                uint32_t iEntry = Id == CONFIG_NO_INDEX ? table.NoIdEntry :
+                                  std::min( FindEntry( op.Arg[0], Id ), table.UnknownEntry );
+
+                // The interpreter read every id up to the match, and reported the first
+                // it could not read
+                if( table.ErrorEntry != CONFIG_NO_INDEX && table.ErrorEntry <= iEntry )
+                {
+                    RecordError( pResult, table.ErrorString );
+                }
+
+                if( iEntry == CONFIG_NO_INDEX )
+                {
+                    *pEndPos = table.EndPos;
+                    return true;
+                }
+                if( Id == CONFIG_NO_INDEX )
+                {
+                    *pEndPos = table.NoIdPos;
+                    return true;
+                }
+                iOp = m_Entries[table.FirstEntry + iEntry].Script - 1;
+                break;
+            }
+
+            case CONFIG_OP_RETURN:
+                *pEndPos = op.Arg[0];
+                return true;
+
+            case CONFIG_OP_ERROR:
+                RecordError( pResult, op.Arg[0] );
+                break;
+
+            default:
+                return false;
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+bool CConfigRules::Evaluate( const CONFIG_SNAPSHOT& Snapshot, CConfigResult* pResult ) const
+{
+    uint32_t nKeys = GetKeyCount();
+    pResult->Device.Reset( nKeys );
+    pResult->Requirements.Reset( nKeys );
+    pResult->NamedSets.resize( m_nNamedSets );
+    for( uint32_t i = 0; i < m_nNamedSets; i++ )
+    {
+        pResult->NamedSets[i].Reset( nKeys );
+    }
+    pResult->NameToSet.assign( m_NameStrings.size(), CONFIG_NO_INDEX );
+    pResult->DetailSets.clear();
+    for( int i = 0; i < CONFIG_ID_COUNT; i++ )
+    {
+        pResult->Strings[i] = CONFIG_NO_INDEX;
+    }
+    pResult->bError = false;
+    pResult->ErrorString = CONFIG_NO_INDEX;
+
+    uint32_t EndPos;
+    if( m_MainScript == CONFIG_NO_INDEX || !RunScript( m_MainScript, pResult, Snapshot, &EndPos ) )
+        return false;
+
+    uint32_t DisplayEndPos, SoundEndPos;
+    if( !RunScript( m_DisplayScript, pResult, Snapshot, &DisplayEndPos ) )
+        return false;
+    if( !RunScript( m_SoundScript, pResult, Snapshot, &SoundEndPos ) )
+        return false;
+
+    //
+    // Post-ApplyToAll sections start at the end of both display and audio sections
+    //
+    uint32_t Pos = std::max( DisplayEndPos, SoundEndPos );
+    for( ; ; )
+    {
+        size_t iLow = 0, iHigh = m_PostBlocks.size();
+        while( iLow < iHigh )
+        {
+            size_t iMid = ( iLow + iHigh ) / 2;
+            if( m_PostBlocks[iMid].Pos < Pos )
+                iLow = iMid + 1;
+            else
+                iHigh = iMid;
+        }
+        if( iLow == m_PostBlocks.size() )
+            break;
+
+        if( !RunScript( m_PostBlocks[iLow].Script, pResult, Snapshot, &Pos ) )
+            return false;
+    }
+
+    return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Binary images: a header, then each array as a count followed by its elements
+//--------------------------------------------------------------------------------------
+template <class T> static void WriteArray( std::vector <uint8_t>& Image, const std::vector <T>& Array )
+{
+    uint32_t nCount = ( uint32_t )Array.size();
+    const uint8_t* pCount = ( const uint8_t* )&nCount;
+    Image.insert( Image.end(), pCount, pCount + sizeof( nCount ) );
+    if( nCount )
+    {
+        const uint8_t* pData = ( const uint8_t* )&Array[0];
+        Image.insert( Image.end(), pData, pData + nCount * sizeof( T ) );
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+template <class T> static bool ReadArray( const uint8_t*& pData, const uint8_t* pEnd, std::vector <T>& Array )
+{
+    uint32_t nCount;
+    if( ( size_t )( pEnd - pData ) < sizeof( nCount ) )
+        return false;
+    memcpy( &nCount, pData, sizeof( nCount ) );
+    pData += sizeof( nCount );
+
+    if( ( size_t )( pEnd - pData ) / sizeof( T ) < nCount )
+        return false;
+    Array.resize( nCount );
+    if( nCount )
+    {
+        memcpy( &Array[0], pData, nCount * sizeof( T ) );
+    }
+    pData += nCount * sizeof( T );
+    return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+bool CConfigRules::IsImage( const void* pData, size_t cbData )
+{
+    uint32_t Magic;
+    if( cbData < sizeof( Magic ) )
+        return false;
+    memcpy( &Magic, pData, sizeof( Magic ) );
+    return Magic == k_ImageMagic;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CConfigRules::Save( std::vector <uint8_t>& Image ) const
+{
+    uint32_t Header[] =
+    {
+        k_ImageMagic, k_ImageVersion, m_nNamedSets, m_nDetailKey, m_MainScript, m_DisplayScript,
+        m_SoundScript, m_DisplayTable, m_SoundTable
+    };
+
+    Image.clear();
+    Image.insert( Image.end(), ( const uint8_t* )Header, ( const uint8_t* )( Header + sizeof( Header ) / sizeof( Header[0] ) ) );
+    WriteArray( Image, m_StringData );
+    WriteArray( Image, m_StringOffsets );
+    WriteArray( Image, m_KeyStrings );
+    WriteArray( Image, m_NameStrings );
+    WriteArray( Image, m_Ops );
+    WriteArray( Image, m_Drivers );
+    WriteArray( Image, m_Guids );
+    WriteArray( Image, m_Tables );
+    WriteArray( Image, m_Entries );
+    WriteArray( Image, m_Hash );
+    WriteArray( Image, m_PostBlocks );
+    WriteArray( Image, m_Diagnostics );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Loads an image written by Save.  Every index is checked, so a damaged image fails
+// here rather than during evaluation.
+//--------------------------------------------------------------------------------------
+bool CConfigRules::Load( const void* pImage, size_t cbImage )
+{
+    Clear();
+
+    const uint8_t* pData = ( const uint8_t* )pImage;
+    const uint8_t* pEnd = pData + cbImage;
+
+    uint32_t Header[9];
+    if( cbImage < sizeof( Header ) )
+        return false;
+    memcpy( Header, pData, sizeof( Header ) );
+    pData += sizeof( Header );
+    if( Header[0] != k_ImageMagic || Header[1] != k_ImageVersion )
+        return false;
+
+    m_nNamedSets = Header[2];
+    m_nDetailKey = Header[3];
+    m_MainScript = Header[4];
+    m_DisplayScript = Header[5];
+    m_SoundScript = Header[6];
+    m_DisplayTable = Header[7];
+    m_SoundTable = Header[8];
+
+    bool bValid = ReadArray( pData, pEnd, m_StringData ) && ReadArray( pData, pEnd, m_StringOffsets ) &&
+                  ReadArray( pData, pEnd, m_KeyStrings ) && ReadArray( pData, pEnd, m_NameStrings ) &&
+                  ReadArray( pData, pEnd, m_Ops ) && ReadArray( pData, pEnd, m_Drivers ) &&
+                  ReadArray( pData, pEnd, m_Guids ) && ReadArray( pData, pEnd, m_Tables ) &&
+                  ReadArray( pData, pEnd, m_Entries ) && ReadArray( pData, pEnd, m_Hash ) &&
+                  ReadArray( pData, pEnd, m_PostBlocks ) && ReadArray( pData, pEnd, m_Diagnostics ) &&
+                  pData == pEnd;
+
+    //
+    // Strings must be terminated, and every index in range
+    //
+    uint32_t nStrings = ( uint32_t )m_StringOffsets.size();
+    uint32_t nOps = ( uint32_t )m_Ops.size();
+    uint32_t nTables = ( uint32_t )m_Tables.size();
+    uint32_t nKeys = ( uint32_t )m_KeyStrings.size();
+    bValid = bValid && ( m_StringData.empty() || m_StringData.back() == 0 );
+    for( uint32_t i = 0; bValid && i < nStrings; i++ )
+        bValid = m_StringOffsets[i] < m_StringData.size();
+    for( uint32_t i = 0; bValid && i < nKeys; i++ )
+        bValid = m_KeyStrings[i] < nStrings;
+    for( uint32_t i = 0; bValid && i < m_NameStrings.size(); i++ )
+        bValid = m_NameStrings[i] < nStrings;
+    for( uint32_t i = 0; bValid && i < m_Diagnostics.size(); i++ )
+        bValid = m_Diagnostics[i] < nStrings;
+
+    bValid = bValid && m_Guids.size() % 4 == 0 && ( m_nDetailKey == CONFIG_NO_INDEX || m_nDetailKey < nKeys ) &&
+             m_MainScript < nOps && ( m_DisplayScript == CONFIG_NO_INDEX || m_DisplayScript < nOps ) &&
+             ( m_SoundScript == CONFIG_NO_INDEX || m_SoundScript < nOps ) &&
+             ( m_DisplayScript == CONFIG_NO_INDEX ) == ( m_SoundScript == CONFIG_NO_INDEX );
+
+    // Runs of ops cannot fall off the end of the array
+    bValid = bValid && nOps > 0 && ( m_Ops[nOps - 1].Op == CONFIG_OP_END || m_Ops[nOps - 1].Op == CONFIG_OP_RETURN ||
+                                     m_Ops[nOps - 1].Op == CONFIG_OP_ABORT || m_Ops[nOps - 1].Op == CONFIG_OP_MATCH );
+
+    for( uint32_t i = 0; bValid && i < nOps; i++ )
+    {
+        const CONFIG_OP& op = m_Ops[i];
+        switch( op.Op )
+        {
+            case CONFIG_OP_SET:
+                bValid = op.Arg[0] < nKeys && op.Arg[1] < nStrings;
+                break;
+            case CONFIG_OP_APPLY:
+                bValid = op.Arg[0] < m_nNamedSets;
+                break;
+            case CONFIG_OP_MAX_DETAIL:
+                bValid = op.Arg[1] < nStrings && op.Arg[2] < nStrings;
+                break;
+            case CONFIG_OP_IF:
+                bValid = op.Compare <= CONFIG_CMP_AND && ( op.Arg[1] == CONFIG_NO_INDEX || ( op.Arg[1] > i && op.Arg[1] < nOps ) );
+                if( op.Source == CONFIG_SOURCE_GUID )
+                    bValid = bValid && op.Arg[0] < m_Guids.size() / 4;
+                else if( op.Source == CONFIG_SOURCE_DRIVER )
+                    bValid = bValid && op.Arg[0] < m_Drivers.size();
+                else
+                    bValid = bValid && op.Source < CONFIG_VALUE_COUNT;
+                break;
+            case CONFIG_OP_CALL:
+                // Blocks are added before the scripts that call them, which rules out cycles
+                bValid = op.Arg[0] < CONFIG_SET_FIRST_NAMED + m_nNamedSets && op.Arg[1] < i;
+                break;
+            case CONFIG_OP_DEFINE:
+                bValid = op.Arg[0] < m_nNamedSets && op.Arg[1] < m_NameStrings.size();
+                break;
+            case CONFIG_OP_STRING:
+                bValid = op.Arg[0] < CONFIG_ID_COUNT && op.Arg[1] < nStrings;
+                break;
+            case CONFIG_OP_MATCH:
+                bValid = op.Arg[0] < nTables && op.Arg[1] < CONFIG_ID_COUNT;
+                break;
+            case CONFIG_OP_ERROR:
+                bValid = op.Arg[0] < nStrings;
+                break;
+            case CONFIG_OP_ENDIF:
+            case CONFIG_OP_END:
+            case CONFIG_OP_RETURN:
+            case CONFIG_OP_ABORT:
+                break;
+            default:
+                bValid = false;
+        }
+    }
+
+    for( uint32_t i = 0; bValid && i < nTables; i++ )
+    {
+        const CONFIG_TABLE& table = m_Tables[i];
+        bValid = table.FirstEntry <= m_Entries.size() && table.EntryCount <= m_Entries.size() - table.FirstEntry &&
+                 ( table.UnknownEntry == CONFIG_NO_INDEX || table.UnknownEntry < table.EntryCount ) &&
+                 ( table.ErrorEntry == CONFIG_NO_INDEX || table.ErrorString < nStrings ) &&
+                 ( table.NoIdEntry == CONFIG_NO_INDEX || table.NoIdEntry < table.EntryCount );
+    }
+    for( uint32_t i = 0; bValid && i < m_Entries.size(); i++ )
+        bValid = m_Entries[i].Script == CONFIG_NO_INDEX || m_Entries[i].Script < nOps;
+
+    // Evaluate makes a property set for every named set, so the header may not claim
+    // more than the ops use.  The vendor tables are those the vendor scripts match in.
+    bValid = bValid && m_nNamedSets == CountNamedSets();
+    if( bValid && m_DisplayScript != CONFIG_NO_INDEX )
+    {
+        const CONFIG_OP& DisplayOp = m_Ops[m_DisplayScript];
+        const CONFIG_OP& SoundOp = m_Ops[m_SoundScript];
+        bValid = DisplayOp.Op == CONFIG_OP_MATCH && DisplayOp.Arg[0] == m_DisplayTable &&
+                 DisplayOp.Arg[1] == CONFIG_ID_GFX_VENDOR && SoundOp.Op == CONFIG_OP_MATCH &&
+                 SoundOp.Arg[0] == m_SoundTable && SoundOp.Arg[1] == CONFIG_ID_SOUND_VENDOR;
+    }
+    else
+    {
+        bValid = bValid && m_DisplayTable == CONFIG_NO_INDEX && m_SoundTable == CONFIG_NO_INDEX;
+    }
+    for( uint32_t i = 0; bValid && i < nTables; i++ )
+    {
+        if( m_Tables[i].UnknownEntry != CONFIG_NO_INDEX )
+            bValid = m_Entries[m_Tables[i].FirstEntry + m_Tables[i].UnknownEntry].Script != CONFIG_NO_INDEX;
+    }
+
+    bValid = bValid && ( m_Hash.size() & ( m_Hash.size() - 1 ) ) == 0 && ( m_Hash.empty() || m_Hash.size() > m_Entries.size() );
+    for( uint32_t i = 0; bValid && i < m_Hash.size(); i++ )
+    {
+        const CONFIG_HASH_SLOT& slot = m_Hash[i];
+        bValid = slot.Entry == CONFIG_NO_INDEX ||
+                 ( slot.Table < nTables && slot.Entry < m_Tables[slot.Table].EntryCount &&
+                   m_Entries[m_Tables[slot.Table].FirstEntry + slot.Entry].Script != CONFIG_NO_INDEX );
+    }
+
+    for( uint32_t i = 0; bValid && i < m_PostBlocks.size(); i++ )
+        bValid = m_PostBlocks[i].Script < nOps && ( i == 0 || m_PostBlocks[i - 1].Pos < m_PostBlocks[i].Pos );
+
+    if( !bValid )
+    {
+        Clear();
+        m_CompileError = "Invalid configuration image";
+        return false;
+    }
+    return true;
+}
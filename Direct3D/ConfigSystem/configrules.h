@@ -0,0 +1,375 @@
+//--------------------------------------------------------------------------------------
+// File: ConfigRules.h
+//
+// Compiled form of the configuration database.  The text database (see ConfigDatabase.h
+// for the syntax) is compiled once into a program:
+//
+//  - Property keys and values are interned, so a property set is an array of integer
+//    pairs with a direct key index instead of a list of strings.
+//  - Every IF condition becomes a single compare instruction against a CONFIG_SNAPSHOT,
+//    which holds the device caps, memory, OS and driver version.  Driver versions are
+//    compared as 64-bit numbers, so "driver < a.b.c.d" is one range check.
+//  - Vendor and device sections are looked up through hash tables rather than by
+//    scanning the text.
+//
+// Evaluating the program gives exactly the results the text interpreter gave, including
+// its error messages.  The compiler also reports every error in the database whatever
+// the hardware, which is what a validation tool wants.
+//
+// Nothing here depends on Windows or Direct3D, so databases can be compiled, validated
+// and benchmarked on any platform.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#pragma once
+#ifndef __CONFIGRULES_H__
+#define __CONFIGRULES_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define CONFIG_NO_INDEX             0xFFFFFFFF
+
+//
+// Values an IF condition can test.  The order matches the keyword table in ConfigRules.cpp.
+//
+enum CONFIG_VALUE
+{
+    CONFIG_VALUE_CPUSPEED = 0,
+    CONFIG_VALUE_RAM,
+    CONFIG_VALUE_CAPS,
+    CONFIG_VALUE_CAPS2,
+    CONFIG_VALUE_CAPS3,
+    CONFIG_VALUE_PRESENTATIONINTERVALS,
+    CONFIG_VALUE_CURSORCAPS,
+    CONFIG_VALUE_DEVCAPS,
+    CONFIG_VALUE_PRIMITIVEMISCCAPS,
+    CONFIG_VALUE_RASTERCAPS,
+    CONFIG_VALUE_ZCMPCAPS,
+    CONFIG_VALUE_SRCBLENDCAPS,
+    CONFIG_VALUE_DESTBLENDCAPS,
+    CONFIG_VALUE_ALPHACMPCAPS,
+    CONFIG_VALUE_SHADECAPS,
+    CONFIG_VALUE_TEXTURECAPS,
+    CONFIG_VALUE_TEXTUREFILTERCAPS,
+    CONFIG_VALUE_CUBETEXTUREFILTERCAPS,
+    CONFIG_VALUE_VOLUMETEXTUREFILTERCAPS,
+    CONFIG_VALUE_TEXTUREADDRESSCAPS,
+    CONFIG_VALUE_VOLUMETEXTUREADDRESSCAPS,
+    CONFIG_VALUE_LINECAPS,
+    CONFIG_VALUE_MAXTEXTUREWIDTH,
+    CONFIG_VALUE_MAXVOLUMEEXTENT,
+    CONFIG_VALUE_MAXTEXTUREREPEAT,
+    CONFIG_VALUE_MAXTEXTUREASPECTRATIO,
+    CONFIG_VALUE_MAXANISOTROPY,
+    CONFIG_VALUE_STENCILCAPS,
+    CONFIG_VALUE_FVFCAPS,
+    CONFIG_VALUE_TEXTUREOPCAPS,
+    CONFIG_VALUE_MAXTEXTUREBLENDSTAGES,
+    CONFIG_VALUE_MAXSIMULTANEOUSTEXTURES,
+    CONFIG_VALUE_VERTEXPROCESSINGCAPS,
+    CONFIG_VALUE_MAXACTIVELIGHTS,
+    CONFIG_VALUE_MAXUSERCLIPPLANES,
+    CONFIG_VALUE_MAXVERTEXBLENDMATRICES,
+    CONFIG_VALUE_MAXVERTEXBLENDMATRIXINDEX,
+    CONFIG_VALUE_MAXPRIMITIVECOUNT,
+    CONFIG_VALUE_MAXVERTEXINDEX,
+    CONFIG_VALUE_MAXSTREAMS,
+    CONFIG_VALUE_MAXSTREAMSTRIDE,
+    CONFIG_VALUE_VERTEXSHADERVERSION,
+    CONFIG_VALUE_MAXVERTEXSHADERCONST,
+    CONFIG_VALUE_PIXELSHADERVERSION,
+    CONFIG_VALUE_VIDEORAM,
+    CONFIG_VALUE_SUBSYSID,
+    CONFIG_VALUE_REVISION,
+    CONFIG_VALUE_OS,                            // 0=Win95, 1=Win98, 2=Win98SE, 3=WinME, 4=Win2K, 5=WinXP, 6=Win2003
+    CONFIG_VALUE_COUNT,
+
+    // Sources that are not plain values
+    CONFIG_SOURCE_GUID = CONFIG_VALUE_COUNT,
+    CONFIG_SOURCE_DRIVER,
+};
+
+// Ids used to find the vendor and device sections
+enum CONFIG_ID
+{
+    CONFIG_ID_GFX_VENDOR = 0,
+    CONFIG_ID_GFX_DEVICE,
+    CONFIG_ID_SOUND_VENDOR,
+    CONFIG_ID_SOUND_DEVICE,
+    CONFIG_ID_COUNT,
+};
+
+//
+// Everything a database can test, captured once before evaluation
+//
+struct CONFIG_SNAPSHOT
+{
+    uint32_t Values[CONFIG_VALUE_COUNT];
+    int64_t DriverVersion;                      // D3DADAPTER_IDENTIFIER9::DriverVersion
+    uint32_t DeviceIdentifier[4];               // D3DADAPTER_IDENTIFIER9::DeviceIdentifier
+    uint32_t Ids[CONFIG_ID_COUNT];
+};
+
+//--------------------------------------------------------------------------------------
+// Program representation.  Ops are 16 bytes; a block (one property set body) and a
+// script (the steps around it) are both runs of ops in the same array.
+//--------------------------------------------------------------------------------------
+enum CONFIG_OPCODE
+{
+    // Block ops
+    CONFIG_OP_SET = 0,                          // Arg[0]: key, Arg[1]: value string
+    CONFIG_OP_APPLY,                            // Arg[0]: named set
+    CONFIG_OP_MAX_DETAIL,                       // Arg[0]: detail level, Arg[1]: level as a string, Arg[2]: error string
+    CONFIG_OP_IF,                               // Source, Compare, Arg[0]: value or constant index, Arg[1]: matching ENDIF or CONFIG_NO_INDEX
+    CONFIG_OP_ENDIF,
+    CONFIG_OP_END,                              // End of block
+
+    // Script ops
+    CONFIG_OP_CALL,                             // Arg[0]: target set, Arg[1]: block
+    CONFIG_OP_DEFINE,                           // Arg[0]: named set, Arg[1]: name slot
+    CONFIG_OP_STRING,                           // Arg[0]: CONFIG_ID of the vendor or device, Arg[1]: string
+    CONFIG_OP_MATCH,                            // Arg[0]: table, Arg[1]: CONFIG_ID to look up
+    CONFIG_OP_RETURN,                           // Arg[0]: file position the script stopped at
+
+    // Either
+    CONFIG_OP_ERROR,                            // Arg[0]: error string.  Only the first error is kept.
+    CONFIG_OP_ABORT,                            // Evaluation fails
+};
+
+#define CONFIG_OP_FLAG_CONDITIONAL  0x01        // Not run inside a false IF
+
+// Compare codes, as the interpreter numbered them
+#define CONFIG_CMP_EQUAL            0
+#define CONFIG_CMP_NOT_EQUAL        1
+#define CONFIG_CMP_GREATER          2
+#define CONFIG_CMP_LESS             3
+#define CONFIG_CMP_GREATER_EQUAL    4
+#define CONFIG_CMP_LESS_EQUAL       5
+#define CONFIG_CMP_AND              6
+
+// Target sets for CONFIG_OP_CALL.  Named sets follow.
+#define CONFIG_SET_DEVICE           0
+#define CONFIG_SET_REQUIREMENTS     1
+#define CONFIG_SET_FIRST_NAMED      2
+
+struct CONFIG_OP
+{
+    uint8_t Op;
+    uint8_t Flags;
+    uint8_t Source;
+    uint8_t Compare;
+    uint32_t Arg[3];
+};
+
+// Vendor or device lookup.  Entries are kept in file order; the first entry whose id
+// matches, or the unknown entry, wins.
+struct CONFIG_TABLE
+{
+    uint32_t FirstEntry;
+    uint32_t EntryCount;
+    uint32_t UnknownEntry;                      // Relative to FirstEntry, or CONFIG_NO_INDEX
+    uint32_t ErrorEntry;                        // First entry whose id could not be read
+    uint32_t ErrorString;
+    uint32_t EndPos;                            // Where the search stops if nothing matches
+
+    // The interpreter used an id of 0xFFFFFFFF to mean "not found", so for that id it
+    // stopped at the first entry that matched and then behaved as if none had
+    uint32_t NoIdEntry;
+    uint32_t NoIdPos;
+};
+
+struct CONFIG_ENTRY
+{
+    uint32_t Id;
+    uint32_t Script;                            // CONFIG_NO_INDEX for ids that repeat an earlier entry
+};
+
+struct CONFIG_HASH_SLOT
+{
+    uint32_t Table;
+    uint32_t Id;
+    uint32_t Entry;                             // Relative to the table's FirstEntry, CONFIG_NO_INDEX if empty
+};
+
+// An ApplyToAll section that can follow the vendor sections
+struct CONFIG_POST_BLOCK
+{
+    uint32_t Pos;
+    uint32_t Script;
+};
+
+class CConfigRules;
+
+
+//--------------------------------------------------------------------------------------
+// A property set of interned keys and values.  Properties stay in the order they were
+// first set, as the text interpreter kept them.
+//--------------------------------------------------------------------------------------
+class CConfigPropertySet
+{
+public:
+    void            Reset( uint32_t nKeys );
+    void            Set( uint32_t nKey, uint32_t nValue );
+    void            Apply( const CConfigPropertySet& Src );
+
+    // Returns the value string, or CONFIG_NO_INDEX
+    uint32_t        Get( uint32_t nKey ) const
+    {
+        return nKey < m_Slots.size() && m_Slots[nKey] != CONFIG_NO_INDEX ? m_Values[m_Slots[nKey]] : CONFIG_NO_INDEX;
+    }
+    uint32_t        GetCount() const
+    {
+        return ( uint32_t )m_Keys.size();
+    }
+    uint32_t        GetKey( uint32_t i ) const
+    {
+        return m_Keys[i];
+    }
+    uint32_t        GetValue( uint32_t i ) const
+    {
+        return m_Values[i];
+    }
+
+protected:
+    std::vector <uint32_t> m_Keys;
+    std::vector <uint32_t> m_Values;
+    std::vector <uint32_t> m_Slots;             // Per key: index into m_Keys, or CONFIG_NO_INDEX
+};
+
+
+//--------------------------------------------------------------------------------------
+// The outcome of evaluating a program against one snapshot.  Can be reused.
+//--------------------------------------------------------------------------------------
+struct CConfigResult
+{
+    CConfigPropertySet Device;
+    CConfigPropertySet Requirements;
+    std::vector <CConfigPropertySet> NamedSets;
+    std::vector <uint32_t> NameToSet;           // Per name slot: named set, or CONFIG_NO_INDEX
+    std::vector <uint32_t> DetailSets;          // Pairs of OverallGraphicDetail value and the set it was set in
+    uint32_t Strings[CONFIG_ID_COUNT];          // Vendor and device names, or CONFIG_NO_INDEX
+    bool bError;
+    uint32_t ErrorString;
+};
+
+
+//--------------------------------------------------------------------------------------
+class CConfigRules
+{
+public:
+                    CConfigRules();
+
+    // Compiles a text database.  Fails only if the text cannot be represented (a string
+    // that is only closed on a later line where the interpreter would have behaved
+    // differently depending on the hardware); errors in the database itself are
+    // compiled into the program and listed in GetDiagnostic.
+    bool            Compile( const char* pText, uint32_t cbText );
+
+    // Binary images, as written by Save
+    static bool     IsImage( const void* pData, size_t cbData );
+    bool            Load( const void* pData, size_t cbData );
+    void            Save( std::vector <uint8_t>& Image ) const;
+
+    // Runs the program.  Returns false where the interpreter's Load returned false.
+    bool            Evaluate( const CONFIG_SNAPSHOT& Snapshot, CConfigResult* pResult ) const;
+
+    const char*     GetString( uint32_t nString ) const
+    {
+        return nString == CONFIG_NO_INDEX ? "" : &m_StringData[m_StringOffsets[nString]];
+    }
+    uint32_t        GetKeyCount() const
+    {
+        return ( uint32_t )m_KeyStrings.size();
+    }
+    const char*     GetKeyString( uint32_t nKey ) const
+    {
+        return GetString( m_KeyStrings[nKey] );
+    }
+
+    // Named sets are looked up by name slot
+    uint32_t        GetNameCount() const
+    {
+        return ( uint32_t )m_NameStrings.size();
+    }
+    const char*     GetName( uint32_t i ) const
+    {
+        return GetString( m_NameStrings[i] );
+    }
+    uint32_t        FindName( const char* pszName ) const;
+
+    // Every error the database can produce, whichever hardware it is evaluated for
+    uint32_t        GetDiagnosticCount() const
+    {
+        return ( uint32_t )m_Diagnostics.size();
+    }
+    const char*     GetDiagnostic( uint32_t i ) const
+    {
+        return GetString( m_Diagnostics[i] );
+    }
+    const char*     GetCompileError() const
+    {
+        return m_CompileError.c_str();
+    }
+
+    // Statistics, and the ids the lookup tables know about (for benchmarks)
+    uint32_t        GetOpCount() const
+    {
+        return ( uint32_t )m_Ops.size();
+    }
+    uint32_t        GetStringCount() const
+    {
+        return ( uint32_t )m_StringOffsets.size();
+    }
+    uint32_t        GetTableCount() const
+    {
+        return ( uint32_t )m_Tables.size();
+    }
+    uint32_t        GetEntryCount() const
+    {
+        return ( uint32_t )m_Entries.size();
+    }
+    void            GetVendorIds( bool bSound, std::vector <uint32_t>& VendorIds ) const;
+    void            GetDeviceIds( bool bSound, uint32_t VendorId, std::vector <uint32_t>& DeviceIds ) const;
+
+protected:
+    friend class CConfigCompiler;
+
+    void            Clear();
+    bool            RunBlock( uint32_t iOp, uint32_t nTarget, CConfigResult* pResult,
+                              const CONFIG_SNAPSHOT& Snapshot ) const;
+    bool            RunScript( uint32_t iOp, CConfigResult* pResult, const CONFIG_SNAPSHOT& Snapshot,
+                               uint32_t* pEndPos ) const;
+    bool            TestCondition( const CONFIG_OP& op, const CONFIG_SNAPSHOT& Snapshot ) const;
+    uint32_t        FindEntry( uint32_t nTable, uint32_t Id ) const;
+    uint32_t        CountNamedSets() const;
+    static CConfigPropertySet* GetSet( CConfigResult* pResult, uint32_t nTarget );
+
+    std::vector <char> m_StringData;
+    std::vector <uint32_t> m_StringOffsets;
+    std::vector <uint32_t> m_KeyStrings;        // Per key: string
+    std::vector <uint32_t> m_NameStrings;       // Per name slot: string
+    std::vector <CONFIG_OP> m_Ops;
+    std::vector <int64_t> m_Drivers;
+    std::vector <uint32_t> m_Guids;             // Four per GUID
+    std::vector <CONFIG_TABLE> m_Tables;
+    std::vector <CONFIG_ENTRY> m_Entries;
+    std::vector <CONFIG_HASH_SLOT> m_Hash;      // Power of two size
+    std::vector <CONFIG_POST_BLOCK> m_PostBlocks;
+    std::vector <uint32_t> m_Diagnostics;
+
+    uint32_t m_nNamedSets;
+    uint32_t m_nDetailKey;                      // "overallgraphicdetail", or CONFIG_NO_INDEX
+    uint32_t m_MainScript;                      // Requirements, PropertySets and the first ApplyToAll sections
+    uint32_t m_DisplayScript;
+    uint32_t m_SoundScript;
+    uint32_t m_DisplayTable;
+    uint32_t m_SoundTable;
+
+    std::string m_CompileError;
+};
+
+#endif // __CONFIGRULES_H__
@@ -0,0 +1,318 @@
+//--------------------------------------------------------------------------------------
+// File: ConfigTool.cpp
+//
+// Headless compiler, validator and benchmark for configuration databases.  Uses only
+// the C++ library and ConfigRules, so it builds and gives the same results on any
+// platform; see ConfigTool.h.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#include "configtool.h"
+#include "configrules.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+
+//--------------------------------------------------------------------------------------
+// Milliseconds on a monotonic clock
+//--------------------------------------------------------------------------------------
+static double GetMilliseconds()
+{
+    return std::chrono::duration <double, std::milli>(
+        std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Small deterministic generator, so benchmark snapshots are the same on every platform
+//--------------------------------------------------------------------------------------
+struct CONFIG_RANDOM
+{
+    uint32_t State;
+
+    uint32_t Next()
+    {
+        State = State * 1664525 + 1013904223;
+        return State >> 8 ^ State << 24;
+    }
+    uint32_t Next( uint32_t nRange )
+    {
+        return ( uint32_t )( ( ( uint64_t )( State = State * 1664525 + 1013904223 ) * nRange ) >> 32 );
+    }
+};
+
+
+//--------------------------------------------------------------------------------------
+static bool IsSamePropertySet( const CConfigPropertySet& A, const CConfigPropertySet& B )
+{
+    if( A.GetCount() != B.GetCount() )
+        return false;
+    for( uint32_t i = 0; i < A.GetCount(); i++ )
+    {
+        if( A.GetKey( i ) != B.GetKey( i ) || A.GetValue( i ) != B.GetValue( i ) )
+            return false;
+    }
+    return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+static bool IsSameResult( const CConfigResult& A, const CConfigResult& B )
+{
+    if( A.bError != B.bError || ( A.bError && A.ErrorString != B.ErrorString ) )
+        return false;
+    if( memcmp( A.Strings, B.Strings, sizeof( A.Strings ) ) != 0 )
+        return false;
+    return IsSamePropertySet( A.Device, B.Device ) && IsSamePropertySet( A.Requirements, B.Requirements );
+}
+
+
+//--------------------------------------------------------------------------------------
+static bool ReadDatabase( const char* pszFile, std::string& strText )
+{
+    FILE* pFile = fopen( pszFile, "rb" );
+    if( !pFile )
+        return false;
+    char chBuffer[4096];
+    size_t cbRead;
+    while( ( cbRead = fread( chBuffer, 1, sizeof( chBuffer ), pFile ) ) > 0 )
+        strText.append( chBuffer, cbRead );
+    bool bRead = !ferror( pFile );
+    fclose( pFile );
+    return bRead;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Builds a database with nVendors display vendors of 64 devices each, and a quarter as
+// many audio vendors, in the style of config.txt
+//--------------------------------------------------------------------------------------
+void BuildSyntheticDatabase( unsigned int nVendors, std::string& strText )
+{
+    static const char* s_szDetail[] = { "Low", "Medium", "High", "Ultra" };
+    char szLine[256];
+
+    strText = "Requirements\r\n    OS=Win98\r\n    CpuSpeed=733\r\n    Memory=128\r\n    break\r\n";
+
+    for( unsigned int i = 0; i < 4; i++ )
+    {
+        snprintf( szLine, 256, "PropertySet = \"%s\"\r\n    OverallGraphicDetail = %u\r\n    TextureDetail = %u\r\n"
+                  "    if PixelShaderVersion < 0xffff0200\r\n        DisableHDR\r\n    endif\r\n    break\r\n",
+                  s_szDetail[i], i, i * 2 );
+        strText += szLine;
+    }
+
+    strText += "ApplyToAll\r\n    if ram < 256\r\n        LowMemory\r\n    endif\r\n    break\r\n";
+
+    for( unsigned int v = 0; v < ( nVendors + 3 ) / 4; v++ )
+    {
+        snprintf( szLine, 256, "AudioVendor = 0x%04x \"Audio %u\"\r\n", 0x2000 + v, v );
+        strText += szLine;
+        for( unsigned int d = 0; d < 16; d++ )
+        {
+            snprintf( szLine, 256, "0x%04x = \"Audio Device %u\"\r\n    if driver <= 5.10.%u.0\r\n"
+                      "        OldSoundDriver\r\n    endif\r\n    break\r\n", d, d, 2000 + d );
+            strText += szLine;
+        }
+    }
+
+    for( unsigned int v = 0; v < nVendors; v++ )
+    {
+        snprintf( szLine, 256, "DisplayVendor = 0x%04x \"Vendor %u\"\r\n", 0x1000 + v, v );
+        strText += szLine;
+        for( unsigned int d = 0; d < 64; d++ )
+        {
+            snprintf( szLine, 256, "0x%04x = \"Device %u\"\r\n    PropertySet = \"%s\"\r\n", d, d, s_szDetail[d % 4] );
+            strText += szLine;
+            snprintf( szLine, 256, "    if driver < 6.14.%u.%u\r\n        OldDriver\r\n", 10 + d % 4, 1000 + d );
+            strText += szLine;
+            strText += "        if os < Win2K\r\n            MaxOverallGraphicDetail = 1\r\n        endif\r\n    endif\r\n";
+            snprintf( szLine, 256, "    if videoram < %u\r\n        MaxOverallGraphicDetail = 2\r\n    endif\r\n"
+                      "    if Caps2 & 0x%x\r\n        FullscreenGamma\r\n    endif\r\n    break\r\n",
+                      32u << ( d % 4 ), 1u << ( d % 16 ) );
+            strText += szLine;
+        }
+        strText += "Unknown = \"Unknown\"\r\n    PropertySet = \"Low\"\r\n    break\r\n";
+    }
+
+    strText += "ApplyToAll\r\n    if cpuspeed < 1000\r\n        MaxOverallGraphicDetail = 1\r\n    endif\r\n    break\r\n";
+}
+
+
+//--------------------------------------------------------------------------------------
+// Random hardware.  Most picks are devices the database knows about.
+//--------------------------------------------------------------------------------------
+static void BuildSnapshots( const CConfigRules& Rules, std::vector <CONFIG_SNAPSHOT>& Snapshots )
+{
+    std::vector <uint32_t> GfxVendors, SoundVendors, Devices;
+    Rules.GetVendorIds( false, GfxVendors );
+    Rules.GetVendorIds( true, SoundVendors );
+
+    CONFIG_RANDOM Random = { 100 };
+    for( size_t i = 0; i < Snapshots.size(); i++ )
+    {
+        CONFIG_SNAPSHOT& Snapshot = Snapshots[i];
+        for( uint32_t v = 0; v < CONFIG_VALUE_COUNT; v++ )
+            Snapshot.Values[v] = Random.Next();
+        Snapshot.Values[CONFIG_VALUE_CPUSPEED] = 500 + Random.Next( 3000 );
+        Snapshot.Values[CONFIG_VALUE_RAM] = 64 << Random.Next( 6 );
+        Snapshot.Values[CONFIG_VALUE_VIDEORAM] = 16 << Random.Next( 6 );
+        Snapshot.Values[CONFIG_VALUE_OS] = Random.Next( 7 );
+        Snapshot.DriverVersion = ( ( int64_t )( ( ( 4 + Random.Next( 3 ) ) << 16 ) + Random.Next( 16 ) ) << 32 ) |
+                                 ( ( Random.Next( 4000 ) << 16 ) + Random.Next( 4000 ) );
+        for( uint32_t g = 0; g < 4; g++ )
+            Snapshot.DeviceIdentifier[g] = Random.Next();
+
+        for( uint32_t b = 0; b < 2; b++ )
+        {
+            const std::vector <uint32_t>& Vendors = b ? SoundVendors : GfxVendors;
+            uint32_t VendorId = ( !Vendors.empty() && Random.Next( 8 ) ) ?
+                Vendors[Random.Next( ( uint32_t )Vendors.size() )] : Random.Next();
+            Rules.GetDeviceIds( b != 0, VendorId, Devices );
+            uint32_t DeviceId = ( !Devices.empty() && Random.Next( 8 ) ) ?
+                Devices[Random.Next( ( uint32_t )Devices.size() )] : Random.Next();
+            Snapshot.Ids[b ? CONFIG_ID_SOUND_VENDOR : CONFIG_ID_GFX_VENDOR] = VendorId;
+            Snapshot.Ids[b ? CONFIG_ID_SOUND_DEVICE : CONFIG_ID_GFX_DEVICE] = DeviceId;
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+int RunConfigTool( int nArgs, const char* const* pszArgs, const char* pszDefaultDatabase )
+{
+    std::string strDatabase = pszDefaultDatabase;
+    const char* pszOut = NULL;
+    unsigned int nSynthVendors = 0;
+    unsigned int nEvaluations = 0;
+    for( int i = 0; i < nArgs; i++ )
+    {
+        if( 0 == strcmp( pszArgs[i], "-out" ) && i + 1 < nArgs )
+            pszOut = pszArgs[++i];
+        else if( 0 == strcmp( pszArgs[i], "-synth" ) && i + 1 < nArgs )
+        {
+            int nValue = atoi( pszArgs[++i] );
+            nSynthVendors = nValue > 0 ? nValue : 1;
+        }
+        else if( 0 == strcmp( pszArgs[i], "-bench" ) && i + 1 < nArgs )
+        {
+            int nValue = atoi( pszArgs[++i] );
+            nEvaluations = nValue > 0 ? nValue : 1;
+        }
+        else if( pszArgs[i][0] != '-' )
+            strDatabase = pszArgs[i];
+    }
+
+    //
+    // Read the database
+    //
+    std::string strText;
+    if( nSynthVendors )
+    {
+        BuildSyntheticDatabase( nSynthVendors, strText );
+        char szName[64];
+        snprintf( szName, 64, "synthetic, %u vendors", nSynthVendors );
+        strDatabase = szName;
+    }
+    else if( !ReadDatabase( strDatabase.c_str(), strText ) )
+    {
+        printf( "Cannot open %s\n", strDatabase.c_str() );
+        return 1;
+    }
+
+    //
+    // Compile, or load a compiled image
+    //
+    CConfigRules Rules;
+    bool bImage = CConfigRules::IsImage( strText.data(), strText.size() );
+    double fStart = GetMilliseconds();
+    bool bLoaded = bImage ?
+        Rules.Load( strText.data(), strText.size() ) : Rules.Compile( strText.data(), ( uint32_t )strText.size() );
+    double fCompileMs = GetMilliseconds() - fStart;
+
+    if( !bLoaded )
+    {
+        printf( "%s: %s\n", strDatabase.c_str(), Rules.GetCompileError() );
+        return 1;
+    }
+
+    printf( "%s: %u bytes, %.3f ms to %s\n", strDatabase.c_str(), ( uint32_t )strText.size(), fCompileMs,
+            bImage ? "load" : "compile" );
+    printf( "  %u ops, %u strings, %u keys, %u lookup tables, %u entries\n", Rules.GetOpCount(),
+            Rules.GetStringCount(), Rules.GetKeyCount(), Rules.GetTableCount(), Rules.GetEntryCount() );
+    for( uint32_t i = 0; i < Rules.GetDiagnosticCount(); i++ )
+        printf( "  %s\n", Rules.GetDiagnostic( i ) );
+
+    std::vector <uint8_t> Image;
+    Rules.Save( Image );
+
+    if( pszOut )
+    {
+        FILE* pFile = fopen( pszOut, "wb" );
+        if( !pFile || fwrite( &Image[0], 1, Image.size(), pFile ) != Image.size() )
+        {
+            if( pFile )
+                fclose( pFile );
+            printf( "Cannot write %s\n", pszOut );
+            return 1;
+        }
+        fclose( pFile );
+        printf( "  Wrote %u byte image to %s\n", ( uint32_t )Image.size(), pszOut );
+    }
+
+    if( nEvaluations == 0 )
+        return 0;
+
+    std::vector <CONFIG_SNAPSHOT> Snapshots( nEvaluations );
+    BuildSnapshots( Rules, Snapshots );
+
+    CConfigResult Result;
+    uint32_t nFailed = 0, nErrors = 0, nProperties = 0;
+    fStart = GetMilliseconds();
+    for( uint32_t i = 0; i < nEvaluations; i++ )
+    {
+        if( !Rules.Evaluate( Snapshots[i], &Result ) )
+            nFailed++;
+        if( Result.bError )
+            nErrors++;
+        nProperties += Result.Device.GetCount();
+    }
+    double fEvaluateUs = ( GetMilliseconds() - fStart ) * 1000.0 / nEvaluations;
+
+    printf( "  %u evaluations: %.3f us each, %.1f device properties on average, %u failed, %u with errors\n",
+            nEvaluations, fEvaluateUs, nProperties / ( double )nEvaluations, nFailed, nErrors );
+    if( !bImage && fEvaluateUs > 0.0 )
+        printf( "  Compiling costs %.0f evaluations\n", fCompileMs * 1000.0 / fEvaluateUs );
+
+    //
+    // The saved image must behave exactly like the program it came from
+    //
+    CConfigRules Loaded;
+    if( !Loaded.Load( &Image[0], Image.size() ) )
+    {
+        printf( "  Saved image does not load: %s\n", Loaded.GetCompileError() );
+        return 1;
+    }
+
+    CConfigResult LoadedResult;
+    uint32_t nMismatches = 0;
+    for( uint32_t i = 0; i < nEvaluations; i++ )
+    {
+        bool bEvaluated = Rules.Evaluate( Snapshots[i], &Result );
+        if( bEvaluated != Loaded.Evaluate( Snapshots[i], &LoadedResult ) ||
+            ( bEvaluated && !IsSameResult( Result, LoadedResult ) ) )
+            nMismatches++;
+    }
+    if( nMismatches )
+    {
+        printf( "  Saved image differs for %u of %u evaluations\n", nMismatches, nEvaluations );
+        return 1;
+    }
+    printf( "  Saved image gives the same results\n" );
+
+    return 0;
+}
@@ -0,0 +1,37 @@
+//--------------------------------------------------------------------------------------
+// File: ConfigTool.h
+//
+// Headless compiler, validator and benchmark for configuration databases, built on
+// ConfigRules alone.  ConfigSystem runs it for -configtool, and ConfigToolMain.cpp runs
+// it on its own, so a database can be checked on any platform:
+//
+//   g++ -O2 -std=c++11 configrules.cpp configtool.cpp configtoolmain.cpp -o configtool
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#pragma once
+#ifndef __CONFIGTOOL_H__
+#define __CONFIGTOOL_H__
+
+#include <string>
+
+// Builds a database with nVendors display vendors of 64 devices each, and a quarter as
+// many audio vendors, in the style of config.txt
+void BuildSyntheticDatabase( unsigned int nVendors, std::string& strText );
+
+//
+//   configtool [database] [-synth N] [-out file] [-bench N]
+//
+// Compiles the database (pszDefaultDatabase if none is given), or with -synth a
+// generated one with N display vendors, and prints every error the database can
+// produce whatever the hardware.  A compiled image is loaded instead.  -out writes the
+// compiled image, which IConfigDatabase::Load accepts in place of the text.  -bench
+// times N evaluations for random hardware drawn from the vendors and devices in the
+// database, and checks that the image gives the same results once saved and loaded.
+// Returns 0 on success, 1 if the database could not be compiled or written or the
+// image differs.
+//
+int RunConfigTool( int nArgs, const char* const* pszArgs, const char* pszDefaultDatabase );
+
+#endif
@@ -0,0 +1,17 @@
+//--------------------------------------------------------------------------------------
+// File: ConfigToolMain.cpp
+//
+// Entry point of the configuration database tool when it is built on its own, outside
+// the ConfigSystem sample.  See ConfigTool.h.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#include "configtool.h"
+
+
+//--------------------------------------------------------------------------------------
+int main( int argc, char** argv )
+{
+    return RunConfigTool( argc - 1, argv + 1, "config.txt" );
+}
@@ -18,7 +18,9 @@
 #include <shlobj.h>
 #include "resource.h"
 #include "ConfigDatabase.h"
+#include "ConfigRules.h"
 #include "ConfigManager.h"
+#include "ConfigTool.h"
 #pragma warning(default: 4995)
 
 
@@ -184,6 +186,7 @@ void CALLBACK OnDestroyDevice( void* pUserContext );
 
 void InitApp();
 void RenderText();
+INT RunConfigTool( int nArgs, LPWSTR* pstrArgs );
 
 
 //--------------------------------------------------------------------------------------
@@ -339,6 +342,23 @@ INT WINAPI wWinMain( HINSTANCE, HINSTANCE, LPWSTR, int )
     _CrtSetDbgFlag( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );
 #endif
 
+    // -configtool compiles and benchmarks a database without creating a window
+    int nArgs = 0;
+    LPWSTR* pstrArgs = CommandLineToArgvW( GetCommandLineW(), &nArgs );
+    if( pstrArgs )
+    {
+        for( int i = 1; i < nArgs; i++ )
+        {
+            if( 0 == _wcsicmp( pstrArgs[i], L"-configtool" ) )
+            {
+                INT nResult = RunConfigTool( nArgs - i - 1, pstrArgs + i + 1 );
+                LocalFree( pstrArgs );
+                return nResult;
+            }
+        }
+        LocalFree( pstrArgs );
+    }
+
     HRESULT hr;
     bool bSafeMode = false;
     WCHAR wszLaunchFile[MAX_PATH] = L"";
@@ -1488,3 +1508,44 @@ void CALLBACK OnDestroyDevice( void* pUserContext )
 }
 
 
+
+
+//--------------------------------------------------------------------------------------
+// Headless compiler and benchmark for configuration databases:
+//
+//   ConfigSystem -configtool [database] [-synth N] [-out file] [-bench N]
+//
+// Runs the portable tool in ConfigTool.cpp against the console we were started from.
+// The default database is the config.txt found with the sample's media.
+//--------------------------------------------------------------------------------------
+INT RunConfigTool( int nArgs, LPWSTR* pstrArgs )
+{
+    // Report to the console we were started from, if any
+    if( AttachConsole( ATTACH_PARENT_PROCESS ) )
+    {
+        FILE* pFile;
+        freopen_s( &pFile, "CONOUT$", "w", stdout );
+    }
+
+    WCHAR str[MAX_PATH];
+    char szDefault[MAX_PATH];
+    if( FAILED( DXUTFindDXSDKMediaFileCch( str, MAX_PATH, L"config.txt" ) ) )
+        wcscpy_s( str, MAX_PATH, L"config.txt" );
+    WideCharToMultiByte( CP_ACP, 0, str, -1, szDefault, MAX_PATH, NULL, NULL );
+
+    std::vector <std::string> Args( nArgs );
+    std::vector <const char*> pszArgs( nArgs + 1, NULL );
+    for( int i = 0; i < nArgs; i++ )
+    {
+        int cchArg = WideCharToMultiByte( CP_ACP, 0, pstrArgs[i], -1, NULL, 0, NULL, NULL );
+        if( cchArg > 0 )
+        {
+            Args[i].resize( cchArg );
+            WideCharToMultiByte( CP_ACP, 0, pstrArgs[i], -1, &Args[i][0], cchArg, NULL, NULL );
+            Args[i].resize( cchArg - 1 );
+        }
+        pszArgs[i] = Args[i].c_str();
+    }
+
+    return RunConfigTool( nArgs, &pszArgs[0], szDefault );
+}
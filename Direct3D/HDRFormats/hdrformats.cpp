@@ -11,8 +11,10 @@
 #include "DXUTcamera.h"
 #include "DXUTsettingsdlg.h"
 #include "SDKmisc.h"
+#include "SDKHDRCodec.h"
 #include <stdio.h>
 #include <math.h>
+#include <float.h>
 #include "skybox.h"
 #include "resource.h"
 
@@ -23,7 +25,6 @@
 #define NUM_TONEMAP_TEXTURES  5       // Number of stages in the 3x3 down-scaling 
 // of average luminance textures
 #define NUM_BLOOM_TEXTURES    2
-#define RGB16_MAX             100
 
 
 enum ENCODING_MODE
@@ -87,7 +88,6 @@ TECH_HANDLES g_aTechHandles[NUM_ENCODING_MODES];
 TECH_HANDLES*               g_pCurTechnique;
 bool                        g_bShowHelp;
 bool                        g_bShowText;
-double g_aPowsOfTwo[257]; // Lookup table for log calculations
 bool                        g_bSupportsR16F = false;
 bool                        g_bSupportsR32F = false;
 bool                        g_bSupportsD16 = false;
@@ -150,6 +150,7 @@ HRESULT BrightPassFilter();
 
 HRESULT CreateEncodedTexture( IDirect3DCubeTexture9* pTexSrc, IDirect3DCubeTexture9** ppTexDest,
                               ENCODING_MODE eTarget );
+INT RunCodecBenchmark( int nArgs, LPWSTR* pstrArgs );
 
 
 //--------------------------------------------------------------------------------------
@@ -163,6 +164,23 @@ INT WINAPI wWinMain( HINSTANCE, HINSTANCE, LPWSTR, int )
     _CrtSetDbgFlag( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );
 #endif
 
+    // -codecbench tests and times the texel encoding without creating a window
+    int nArgs = 0;
+    LPWSTR* pstrArgs = CommandLineToArgvW( GetCommandLineW(), &nArgs );
+    if( pstrArgs )
+    {
+        for( int i = 1; i < nArgs; i++ )
+        {
+            if( 0 == _wcsicmp( pstrArgs[i], L"-codecbench" ) )
+            {
+                INT nResult = RunCodecBenchmark( nArgs - i - 1, pstrArgs + i + 1 );
+                LocalFree( pstrArgs );
+                return nResult;
+            }
+        }
+        LocalFree( pstrArgs );
+    }
+
     // Initialize the application
     AppInit();
 
@@ -241,11 +259,6 @@ void AppInit()
 
     g_pCurTechnique = &g_aTechHandles[ g_eEncodingMode ];
 
-    for( int i = 0; i <= 256; i++ )
-    {
-        g_aPowsOfTwo[i] = powf( 2.0f, ( float )( i - 128 ) );
-    }
-
     ZeroMemory( g_apTexToneMap, sizeof( g_apTexToneMap ) );
     ZeroMemory( g_apTexBloom, sizeof( g_apTexBloom ) );
     ZeroMemory( g_aTechHandles, sizeof( g_aTechHandles ) );
@@ -1171,89 +1184,6 @@ inline float GaussianDistribution( float x, float y, float rho )
 }
 
 
-//--------------------------------------------------------------------------------------
-inline int log2_ceiling( float val )
-{
-    int iMax = 256;
-    int iMin = 0;
-
-    while( iMax - iMin > 1 )
-    {
-        int iMiddle = ( iMax + iMin ) / 2;
-
-        if( val > g_aPowsOfTwo[iMiddle] )
-            iMin = iMiddle;
-        else
-            iMax = iMiddle;
-    }
-
-    return iMax - 128;
-}
-
-
-//--------------------------------------------------------------------------------------
-inline VOID EncodeRGBE8( D3DXFLOAT16* pSrc, BYTE** ppDest )
-{
-    FLOAT r, g, b;
-
-    r = ( FLOAT )*( pSrc + 0 );
-    g = ( FLOAT )*( pSrc + 1 );
-    b = ( FLOAT )*( pSrc + 2 );
-
-    // Determine the largest color component
-    float maxComponent = max( max( r, g ), b );
-
-    // Round to the nearest integer exponent
-    int nExp = log2_ceiling( maxComponent );
-
-    // Divide the components by the shared exponent
-    FLOAT fDivisor = ( FLOAT )g_aPowsOfTwo[ nExp + 128 ];
-
-    r /= fDivisor;
-    g /= fDivisor;
-    b /= fDivisor;
-
-    // Constrain the color components
-    r = max( 0, min( 1, r ) );
-    g = max( 0, min( 1, g ) );
-    b = max( 0, min( 1, b ) );
-
-    // Store the shared exponent in the alpha channel
-    D3DCOLOR* pDestColor = ( D3DCOLOR* )*ppDest;
-    *pDestColor = D3DCOLOR_RGBA( ( BYTE )( r * 255 ), ( BYTE )( g * 255 ), ( BYTE )( b * 255 ), nExp + 128 );
-    *ppDest += sizeof( D3DCOLOR );
-}
-
-
-//--------------------------------------------------------------------------------------
-inline VOID EncodeRGB16( D3DXFLOAT16* pSrc, BYTE** ppDest )
-{
-    FLOAT r, g, b;
-
-    r = ( FLOAT )*( pSrc + 0 );
-    g = ( FLOAT )*( pSrc + 1 );
-    b = ( FLOAT )*( pSrc + 2 );
-
-    // Divide the components by the multiplier
-    r /= RGB16_MAX;
-    g /= RGB16_MAX;
-    b /= RGB16_MAX;
-
-    // Constrain the color components
-    r = max( 0, min( 1, r ) );
-    g = max( 0, min( 1, g ) );
-    b = max( 0, min( 1, b ) );
-
-    // Store
-    USHORT* pDestColor = ( USHORT* )*ppDest;
-    *pDestColor++ = ( USHORT )( r * 65535 );
-    *pDestColor++ = ( USHORT )( g * 65535 );
-    *pDestColor++ = ( USHORT )( b * 65535 );
-
-    *ppDest += sizeof( UINT64 );
-}
-
-
 //-----------------------------------------------------------------------------
 // Name: RetrieveTechHandles()
 // Desc: 
@@ -1775,7 +1705,7 @@ void DrawFullScreenQuad( float fLeftU, float fTopV, float fRightU, float fBottom
 
 //-----------------------------------------------------------------------------
 // Name: CreateEncodedTexture
-// Desc: Create a copy of the input floating-point texture with RGBE8 or RGB16 
+// Desc: Create a copy of the input floating-point texture with RGBE8 or RGB16
 //       encoding
 //-----------------------------------------------------------------------------
 HRESULT CreateEncodedTexture( IDirect3DCubeTexture9* pTexSrc, IDirect3DCubeTexture9** ppTexDest,
@@ -1788,61 +1718,339 @@ HRESULT CreateEncodedTexture( IDirect3DCubeTexture9* pTexSrc, IDirect3DCubeTextu
 
     // Create a texture with equal dimensions to store the encoded texture
     D3DFORMAT fmt = D3DFMT_UNKNOWN;
+    DXUT_HDR_FORMAT HDRFormat;
     switch( eTarget )
     {
         case RGBE8:
-            fmt = D3DFMT_A8R8G8B8; break;
+            fmt = D3DFMT_A8R8G8B8; HDRFormat = DXUT_HDR_BGRE8; break;
         case RGB16:
-            fmt = D3DFMT_A16B16G16R16; break;
+            fmt = D3DFMT_A16B16G16R16; HDRFormat = DXUT_HDR_RGB16; break;
+        default:
+            return E_INVALIDARG;
     }
 
     V_RETURN( g_pd3dDevice->CreateCubeTexture( desc.Width, 1, 0,
                                                fmt, D3DPOOL_MANAGED,
                                                ppTexDest, NULL ) );
 
-    for( UINT iFace = 0; iFace < 6; iFace++ )
+    // Lock all the faces so they are encoded together
+    DXUT_HDR_SURFACE aSurfaces[6];
+    UINT nLocked = 0;
+    for( ; nLocked < 6; nLocked++ )
     {
-        // Lock the source texture for reading
         D3DLOCKED_RECT rcSrc;
-        V_RETURN( pTexSrc->LockRect( ( D3DCUBEMAP_FACES )iFace, 0, &rcSrc, NULL, D3DLOCK_READONLY ) );
+        hr = pTexSrc->LockRect( ( D3DCUBEMAP_FACES )nLocked, 0, &rcSrc, NULL, D3DLOCK_READONLY );
+        if( FAILED( hr ) )
+            break;
 
-        // Lock the destination texture for writing
         D3DLOCKED_RECT rcDest;
-        V_RETURN( ( *ppTexDest )->LockRect( ( D3DCUBEMAP_FACES )iFace, 0, &rcDest, NULL, 0 ) );
+        hr = ( *ppTexDest )->LockRect( ( D3DCUBEMAP_FACES )nLocked, 0, &rcDest, NULL, 0 );
+        if( FAILED( hr ) )
+        {
+            pTexSrc->UnlockRect( ( D3DCUBEMAP_FACES )nLocked, 0 );
+            break;
+        }
+
+        aSurfaces[nLocked].pSrc = rcSrc.pBits;
+        aSurfaces[nLocked].SrcPitch = rcSrc.Pitch;
+        aSurfaces[nLocked].pDest = rcDest.pBits;
+        aSurfaces[nLocked].DestPitch = rcDest.Pitch;
+        aSurfaces[nLocked].Width = desc.Width;
+        aSurfaces[nLocked].Height = desc.Height;
+    }
+
+    if( SUCCEEDED( hr ) )
+        hr = DXUTEncodeHDRSurfaces( HDRFormat, aSurfaces, 6 );
+
+    // Release the locks
+    for( UINT iFace = 0; iFace < nLocked; iFace++ )
+    {
+        ( *ppTexDest )->UnlockRect( ( D3DCUBEMAP_FACES )iFace, 0 );
+        pTexSrc->UnlockRect( ( D3DCUBEMAP_FACES )iFace, 0 );
+    }
+
+    if( FAILED( hr ) )
+        SAFE_RELEASE( *ppTexDest );
+
+    return hr;
+}
+
+
+//--------------------------------------------------------------------------------------
+// How far a decoded component may be from the original, given the largest component of
+// the texel after clamping to what the format can hold
+//--------------------------------------------------------------------------------------
+float GetCodecErrorBound( DXUT_HDR_FORMAT Format, float fMax )
+{
+    switch( Format )
+    {
+        case DXUT_HDR_RGBE8:
+        case DXUT_HDR_BGRE8:
+            // Half a step of a mantissa whose scale is under twice the largest component
+            return fMax / 255.0f * 1.001f;
+        case DXUT_HDR_RGB16:
+            return 0.5f * DXUT_HDR_RGB16_MAX / 65535.0f * 1.001f;
+        case DXUT_HDR_RGB9E5:
+            return __max( fMax / 512.0f, 1.0f / 16777216.0f );
+    }
+
+    // LogLuv32 keeps the luminance to 1/256 of a stop but quantizes the chromaticity,
+    // which moves the other components by up to a few percent of the largest
+    return fMax * 0.05f;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Best of three encodes of all the surfaces, in seconds
+//--------------------------------------------------------------------------------------
+double TimeEncode( DXUT_HDR_FORMAT Format, const DXUT_HDR_SURFACE* pSurfaces, UINT nSurfaces, UINT nThreads,
+                   DWORD dwFlags )
+{
+    LARGE_INTEGER Frequency, Start, End;
+    QueryPerformanceFrequency( &Frequency );
+
+    double fBest = DBL_MAX;
+    for( int i = 0; i < 3; i++ )
+    {
+        QueryPerformanceCounter( &Start );
+        DXUTEncodeHDRSurfaces( Format, pSurfaces, nSurfaces, nThreads, dwFlags );
+        QueryPerformanceCounter( &End );
+
+        double fSeconds = ( double )( End.QuadPart - Start.QuadPart ) / ( double )Frequency.QuadPart;
+        fBest = __min( fBest, fSeconds );
+    }
+
+    return fBest;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Headless test and benchmark of the HDR texel codec:
+//
+//   HDRFormats -codecbench [-size N] [-threads N]
+//
+// Checks that every half converts to float and back unchanged, and to the same float
+// as D3DX.  Then encodes six faces of N x N random texels (1024 by default) in each
+// format, decodes them again and checks each component is within what the format can
+// hold of the original, and that the SSE2 code gives the same bits as the scalar code.
+// Prints the worst and mean error relative to the largest component of each texel, and
+// the Mtexel/s encoded by the scalar code, by SSE2 on one thread, and by SSE2 on
+// -threads threads (one per processor by default).
+// Returns 0 on success, 1 if a check failed.
+//--------------------------------------------------------------------------------------
+INT RunCodecBenchmark( int nArgs, LPWSTR* pstrArgs )
+{
+    // Report to the console we were started from, if any
+    if( AttachConsole( ATTACH_PARENT_PROCESS ) )
+    {
+        FILE* pFile;
+        freopen_s( &pFile, "CONOUT$", "w", stdout );
+    }
+
+    UINT Size = 1024;
+    UINT nThreads = 0;
+    for( int i = 0; i < nArgs; i++ )
+    {
+        if( 0 == _wcsicmp( pstrArgs[i], L"-size" ) && i + 1 < nArgs )
+        {
+            int nValue = _wtoi( pstrArgs[++i] );
+            Size = nValue < 1 ? 1 : ( nValue > 4096 ? 4096 : nValue );
+        }
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-threads" ) && i + 1 < nArgs )
+        {
+            int nValue = _wtoi( pstrArgs[++i] );
+            nThreads = nValue > 0 ? nValue : 0;
+        }
+    }
+
+    INT nResult = 0;
+
+    // Every half to float and back.  NaNs come back as the one quiet NaN, and D3DX has no
+    // Inf or NaN to compare with.
+    WORD* pHalves = new WORD[ 3 * 65536 ];
+    float* pFloats = new float[ 3 * 65536 ];
+    if( !pHalves || !pFloats )
+    {
+        SAFE_DELETE_ARRAY( pHalves );
+        SAFE_DELETE_ARRAY( pFloats );
+        wprintf( L"Out of memory\n" );
+        return 1;
+    }
 
-        BYTE* pSrcBytes = ( BYTE* )rcSrc.pBits;
-        BYTE* pDestBytes = ( BYTE* )rcDest.pBits;
+    WORD* pBack = pHalves + 65536;
+    WORD* pBackScalar = pHalves + 2 * 65536;
+    float* pScalar = pFloats + 65536;
+    float* pD3DX = pFloats + 2 * 65536;
+    for( UINT i = 0; i < 65536; i++ )
+        pHalves[i] = ( WORD )i;
+
+    DXUTHalfToFloat( pFloats, pHalves, 65536 );
+    DXUTHalfToFloat( pScalar, pHalves, 65536, DXUT_HDR_SCALAR );
+    D3DXFloat16To32Array( pD3DX, ( const D3DXFLOAT16* )pHalves, 65536 );
+    DXUTFloatToHalf( pBack, pFloats, 65536 );
+    DXUTFloatToHalf( pBackScalar, pFloats, 65536, DXUT_HDR_SCALAR );
+
+    UINT nHalfErrors = 0;
+    UINT nD3DXErrors = 0;
+    UINT nSIMDErrors = 0;
+    for( UINT i = 0; i < 65536; i++ )
+    {
+        bool bInfNaN = ( i & 0x7c00 ) == 0x7c00;
+        bool bNaN = bInfNaN && ( i & 0x3ff ) != 0;
+        if( bNaN ? ( pBack[i] & 0x7fff ) != 0x7e00 : pBack[i] != i )
+            nHalfErrors++;
+        if( !bInfNaN && pFloats[i] != pD3DX[i] )
+            nD3DXErrors++;
+        if( memcmp( &pFloats[i], &pScalar[i], sizeof( float ) ) != 0 || pBack[i] != pBackScalar[i] )
+            nSIMDErrors++;
+    }
+    SAFE_DELETE_ARRAY( pHalves );
+    SAFE_DELETE_ARRAY( pFloats );
+
+    wprintf( L"half round trip: %u wrong, %u different from D3DX, %u SSE2 different from scalar\n",
+             nHalfErrors, nD3DXErrors, nSIMDErrors );
+    if( nHalfErrors > 0 || nD3DXErrors > 0 || nSIMDErrors > 0 )
+        nResult = 1;
+
+    // Six faces of random texels from 2^-16 to 2^16, with some zero and some negative
+    const UINT nTexels = Size * Size;
+    WORD* pTexels = new WORD[ 6 * nTexels * 4 ];
+    BYTE* pEncoded = new BYTE[ 6 * nTexels * 8 ];
+    BYTE* pEncodedScalar = new BYTE[ 6 * nTexels * 8 ];
+    float* pFace = new float[ 3 * nTexels * 4 ];
+    if( !pTexels || !pEncoded || !pEncodedScalar || !pFace )
+    {
+        SAFE_DELETE_ARRAY( pTexels );
+        SAFE_DELETE_ARRAY( pEncoded );
+        SAFE_DELETE_ARRAY( pEncodedScalar );
+        SAFE_DELETE_ARRAY( pFace );
+        wprintf( L"Out of memory\n" );
+        return 1;
+    }
 
+    float* pDecoded = pFace + nTexels * 4;
+    float* pDecodedScalar = pFace + 2 * nTexels * 4;
 
-        for( UINT y = 0; y < desc.Height; y++ )
+    srand( 1 );
+    for( UINT iFace = 0; iFace < 6; iFace++ )
+    {
+        for( UINT i = 0; i < nTexels * 4; i++ )
         {
-            D3DXFLOAT16* pSrc = ( D3DXFLOAT16* )pSrcBytes;
-            BYTE* pDest = pDestBytes;
+            int n = rand();
+            float f = powf( 2.0f, ( float )( n % 4096 ) / 128.0f - 16.0f );
+            if( 0 == n % 61 )
+                f = 0.0f;
+            else if( 0 == n % 127 )
+                f = -f;
+            pFace[i] = f;
+        }
+        DXUTFloatToHalf( pTexels + iFace * nTexels * 4, pFace, nTexels * 4 );
+    }
+
+    static const WCHAR* s_strFormats[DXUT_HDR_NUM_FORMATS] =
+    {
+        L"RGBE8", L"BGRE8", L"RGB16", L"RGB9E5", L"LogLuv32"
+    };
+
+    wprintf( L"\n%u x %u x 6 texels\n", Size, Size );
+    wprintf( L"%-9s %10s %10s %8s %6s %10s %10s %10s\n", L"format", L"max error", L"mean error", L"bad", L"same",
+             L"scalar", L"SSE2 1", L"SSE2 N" );
 
-            for( UINT x = 0; x < desc.Width; x++ )
+    for( UINT iFormat = 0; iFormat < DXUT_HDR_NUM_FORMATS; iFormat++ )
+    {
+        DXUT_HDR_FORMAT Format = ( DXUT_HDR_FORMAT )iFormat;
+        const UINT TexelSize = DXUTGetHDRTexelSize( Format );
+
+        DXUT_HDR_SURFACE aSurfaces[6];
+        DXUT_HDR_SURFACE aScalarSurfaces[6];
+        for( UINT iFace = 0; iFace < 6; iFace++ )
+        {
+            aSurfaces[iFace].pSrc = pTexels + iFace * nTexels * 4;
+            aSurfaces[iFace].SrcPitch = Size * 4 * sizeof( WORD );
+            aSurfaces[iFace].pDest = pEncoded + iFace * nTexels * TexelSize;
+            aSurfaces[iFace].DestPitch = Size * TexelSize;
+            aSurfaces[iFace].Width = Size;
+            aSurfaces[iFace].Height = Size;
+
+            aScalarSurfaces[iFace] = aSurfaces[iFace];
+            aScalarSurfaces[iFace].pDest = pEncodedScalar + iFace * nTexels * TexelSize;
+        }
+
+        double fScalar = TimeEncode( Format, aScalarSurfaces, 6, 1, DXUT_HDR_SCALAR );
+        double fSIMD = TimeEncode( Format, aSurfaces, 6, 1, 0 );
+        double fThreads = TimeEncode( Format, aSurfaces, 6, nThreads, 0 );
+        bool bSame = 0 == memcmp( pEncoded, pEncodedScalar, 6 * nTexels * TexelSize );
+
+        // Decode a face at a time and compare with the clamped original
+        const float fLimit = ( DXUT_HDR_RGB16 == Format ) ? DXUT_HDR_RGB16_MAX :
+                             ( DXUT_HDR_RGB9E5 == Format ) ? 65408.0f : 65504.0f;
+        double fMaxError = 0.0;
+        double fSumError = 0.0;
+        UINT nErrors = 0;
+        UINT nBad = 0;
+        for( UINT iFace = 0; iFace < 6; iFace++ )
+        {
+            DXUT_HDR_SURFACE Surface;
+            Surface.pSrc = aSurfaces[iFace].pDest;
+            Surface.SrcPitch = aSurfaces[iFace].DestPitch;
+            Surface.pDest = pDecoded;
+            Surface.DestPitch = Size * 4 * sizeof( float );
+            Surface.Width = Size;
+            Surface.Height = Size;
+            DXUTDecodeHDRSurfaces( Format, &Surface, 1, nThreads );
+
+            Surface.pDest = pDecodedScalar;
+            DXUTDecodeHDRSurfaces( Format, &Surface, 1, 1, DXUT_HDR_SCALAR );
+            if( memcmp( pDecoded, pDecodedScalar, nTexels * 4 * sizeof( float ) ) != 0 )
+                bSame = false;
+
+            DXUTHalfToFloat( pFace, pTexels + iFace * nTexels * 4, nTexels * 4 );
+            for( UINT i = 0; i < nTexels; i++ )
             {
-                switch( eTarget )
+                float afOriginal[3];
+                float fMax = 0.0f;
+                for( UINT c = 0; c < 3; c++ )
                 {
-                    case RGBE8:
-                        EncodeRGBE8( pSrc, &pDest ); break;
-                    case RGB16:
-                        EncodeRGB16( pSrc, &pDest ); break;
-                    default:
-                        return E_FAIL;
+                    float f = pFace[i * 4 + c];
+                    f = ( f > 0.0f ) ? f : 0.0f;
+                    f = ( f < fLimit ) ? f : fLimit;
+                    afOriginal[c] = f;
+                    fMax = __max( fMax, f );
                 }
 
-                pSrc += 4;
+                const float fBound = GetCodecErrorBound( Format, fMax );
+                for( UINT c = 0; c < 3; c++ )
+                {
+                    float fError = fabsf( pDecoded[i * 4 + c] - afOriginal[c] );
+                    if( fError > fBound )
+                        nBad++;
+                    if( fMax > 0.0f )
+                    {
+                        fMaxError = __max( fMaxError, ( double )( fError / fMax ) );
+                        fSumError += fError / fMax;
+                        nErrors++;
+                    }
+                }
+                if( pDecoded[i * 4 + 3] != 1.0f )
+                    nBad++;
             }
-
-            pSrcBytes += rcSrc.Pitch;
-            pDestBytes += rcDest.Pitch;
         }
 
-        // Release the locks
-        ( *ppTexDest )->UnlockRect( ( D3DCUBEMAP_FACES )iFace, 0 );
-        pTexSrc->UnlockRect( ( D3DCUBEMAP_FACES )iFace, 0 );
+        const double fMTexels = 6.0 * nTexels / 1000000.0;
+        wprintf( L"%-9s %10.6f %10.6f %8u %6s %10.1f %10.1f %10.1f\n", s_strFormats[iFormat], fMaxError,
+                 nErrors ? fSumError / nErrors : 0.0, nBad, bSame ? L"yes" : L"NO", fMTexels / fScalar,
+                 fMTexels / fSIMD, fMTexels / fThreads );
+
+        if( nBad > 0 || !bSame )
+            nResult = 1;
     }
 
-    return S_OK;
-}
+    wprintf( L"(Mtexel/s)\n" );
 
+    SAFE_DELETE_ARRAY( pTexels );
+    SAFE_DELETE_ARRAY( pEncoded );
+    SAFE_DELETE_ARRAY( pEncodedScalar );
+    SAFE_DELETE_ARRAY( pFace );
+
+    return nResult;
+}
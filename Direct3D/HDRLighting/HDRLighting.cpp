@@ -25,6 +25,7 @@
 #include "DXUTsettingsdlg.h"
 #include "SDKmisc.h"
 #include "glaredefd3d.h"
+#include "PostProcessCPU.h"
 #include <stdio.h>
 #include "resource.h"
 
@@ -50,14 +51,6 @@
 // post-processing effect
 
 
-// Texture coordinate rectangle
-struct CoordRect
-{
-    float fLeftU, fTopV;
-    float fRightU, fBottomV;
-};
-
-
 // World vertex format
 struct WorldVertex
 {
@@ -207,18 +200,6 @@ HRESULT GetTextureCoords( PDIRECT3DTEXTURE9 pTexSrc, RECT* pRectSrc, PDIRECT3DTE
                           CoordRect* pCoords );
 
 
-// Sample offset calculation. These offsets are passed to corresponding
-// pixel shaders.
-HRESULT GetSampleOffsets_GaussBlur5x5( DWORD dwD3DTexWidth, DWORD dwD3DTexHeight, D3DXVECTOR2* avTexCoordOffset,
-                                       D3DXVECTOR4* avSampleWeights, FLOAT fMultiplier = 1.0f );
-HRESULT GetSampleOffsets_Bloom( DWORD dwD3DTexSize, float afTexCoordOffset[15], D3DXVECTOR4* avColorWeight,
-                                float fDeviation, FLOAT fMultiplier=1.0f );
-HRESULT GetSampleOffsets_Star( DWORD dwD3DTexSize, float afTexCoordOffset[15], D3DXVECTOR4* avColorWeight,
-                               float fDeviation );
-HRESULT GetSampleOffsets_DownScale4x4( DWORD dwWidth, DWORD dwHeight, D3DXVECTOR2 avSampleOffsets[] );
-HRESULT GetSampleOffsets_DownScale2x2( DWORD dwWidth, DWORD dwHeight, D3DXVECTOR2 avSampleOffsets[] );
-
-
 // Tone mapping and post-process lighting effects
 HRESULT MeasureLuminance();
 HRESULT CalculateAdaptation();
@@ -244,6 +225,7 @@ VOID DrawFullScreenQuad( CoordRect c )
 LRESULT MsgProc( HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam );
 
 static inline float GaussianDistribution( float x, float y, float rho );
+INT RunCPUReference( int nArgs, LPWSTR* pstrArgs );
 
 
 
@@ -259,6 +241,23 @@ INT WINAPI wWinMain( HINSTANCE, HINSTANCE, LPWSTR, int )
     _CrtSetDbgFlag( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );
 #endif
 
+    // -cpureference runs the post-processing on the CPU without creating a window
+    int nArgs = 0;
+    LPWSTR* pstrArgs = CommandLineToArgvW( GetCommandLineW(), &nArgs );
+    if( pstrArgs )
+    {
+        for( int i = 1; i < nArgs; i++ )
+        {
+            if( 0 == _wcsicmp( pstrArgs[i], L"-cpureference" ) )
+            {
+                INT nResult = RunCPUReference( nArgs - i - 1, pstrArgs + i + 1 );
+                LocalFree( pstrArgs );
+                return nResult;
+            }
+        }
+        LocalFree( pstrArgs );
+    }
+
     // Set the callback functions. These functions allow DXUT to notify
     // the application about device changes, user input, and windows messages.  The 
     // callbacks are optional so you need only set callbacks for events you're interested 
@@ -3151,3 +3150,233 @@ void CALLBACK OnDestroyDevice( void* pUserContext )
 
 
 
+
+
+//--------------------------------------------------------------------------------------
+// Headless run of the CPU reference of the post-processing:
+//
+//   HDRLighting -cpureference [-width N] [-height N] [-threads N] [-frames N] [-glare N]
+//                             [-out file.pfm]
+//
+// Renders -frames frames (10 by default) of the chain over a made up W x H scene (1920 x
+// 1080 by default) of a dim checkerboard with a few bright lights, with the default
+// options of the sample and glare type -glare (GLT_DEFAULT by default).  This is done
+// with the scalar code, with SSE2 on one thread, and with SSE2 on -threads threads (one
+// per processor by default), and the mean milliseconds of each stage are printed.
+// Checks the three give the same bits and that every texel is finite, and writes the
+// last frame to a PFM file if -out is given.
+// Returns 0 on success, 1 if a check failed.
+//--------------------------------------------------------------------------------------
+INT RunCPUReference( int nArgs, LPWSTR* pstrArgs )
+{
+    // Report to the console we were started from, if any
+    if( AttachConsole( ATTACH_PARENT_PROCESS ) )
+    {
+        FILE* pFile;
+        freopen_s( &pFile, "CONOUT$", "w", stdout );
+    }
+
+    UINT Width = 1920;
+    UINT Height = 1080;
+    UINT nThreads = 0;
+    UINT nFrames = 10;
+    EGLARELIBTYPE eGlareType = GLT_DEFAULT;
+    LPCWSTR strOutput = NULL;
+    for( int i = 0; i < nArgs; i++ )
+    {
+        if( 0 == _wcsicmp( pstrArgs[i], L"-width" ) && i + 1 < nArgs )
+        {
+            int nValue = _wtoi( pstrArgs[++i] );
+            Width = nValue < 8 ? 8 : ( nValue > 8192 ? 8192 : nValue );
+        }
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-height" ) && i + 1 < nArgs )
+        {
+            int nValue = _wtoi( pstrArgs[++i] );
+            Height = nValue < 8 ? 8 : ( nValue > 8192 ? 8192 : nValue );
+        }
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-threads" ) && i + 1 < nArgs )
+        {
+            int nValue = _wtoi( pstrArgs[++i] );
+            nThreads = nValue > 0 ? nValue : 0;
+        }
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-frames" ) && i + 1 < nArgs )
+        {
+            int nValue = _wtoi( pstrArgs[++i] );
+            nFrames = nValue < 1 ? 1 : ( nValue > 1000 ? 1000 : nValue );
+        }
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-glare" ) && i + 1 < nArgs )
+        {
+            int nValue = _wtoi( pstrArgs[++i] );
+            if( nValue >= 0 && nValue < NUM_GLARELIBTYPES )
+                eGlareType = ( EGLARELIBTYPE )nValue;
+        }
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-out" ) && i + 1 < nArgs )
+        {
+            strOutput = pstrArgs[++i];
+        }
+    }
+
+    g_GlareDef.Initialize( eGlareType );
+
+    const SIZE_T nFloats = ( SIZE_T )Width * Height * 4;
+    float* pScene = new float[ nFloats ];
+    float* pOutputs = new float[ 3 * nFloats ];
+    if( !pScene || !pOutputs )
+    {
+        SAFE_DELETE_ARRAY( pScene );
+        SAFE_DELETE_ARRAY( pOutputs );
+        wprintf( L"Out of memory\n" );
+        return 1;
+    }
+
+    // A dim checkerboard brightening to the right, lit by a few small lights between 50
+    // and 500 times brighter, so the bright pass, bloom and star all have work to do
+    static const float s_aLights[6][4] =
+    {
+        // x, y, radius (all a fraction of the height), intensity
+        { 0.20f, 0.25f, 0.020f, 500.0f },
+        { 0.55f, 0.40f, 0.035f, 120.0f },
+        { 0.90f, 0.30f, 0.015f, 300.0f },
+        { 0.35f, 0.75f, 0.050f, 50.0f },
+        { 1.30f, 0.60f, 0.025f, 200.0f },
+        { 1.60f, 0.85f, 0.010f, 400.0f },
+    };
+
+    for( UINT y = 0; y < Height; y++ )
+    {
+        float* pTexel = pScene + ( SIZE_T )y * Width * 4;
+        for( UINT x = 0; x < Width; x++, pTexel += 4 )
+        {
+            float fChecker = ( ( ( x / 32 ) ^ ( y / 32 ) ) & 1 ) ? 1.0f : 0.5f;
+            float fBase = ( 0.02f + 0.3f * x / Width ) * fChecker;
+            pTexel[0] = fBase;
+            pTexel[1] = fBase * 0.9f;
+            pTexel[2] = fBase * 0.8f;
+            pTexel[3] = 1.0f;
+
+            for( UINT i = 0; i < 6; i++ )
+            {
+                float fX = ( float )x / Height - s_aLights[i][0];
+                float fY = ( float )y / Height - s_aLights[i][1];
+                if( fX * fX + fY * fY < s_aLights[i][2] * s_aLights[i][2] )
+                {
+                    pTexel[0] += s_aLights[i][3];
+                    pTexel[1] += s_aLights[i][3] * 0.85f;
+                    pTexel[2] += s_aLights[i][3] * 0.7f;
+                }
+            }
+        }
+    }
+
+    // The defaults of ResetOptions and OnCreateDevice
+    PPCPU_SETTINGS Settings;
+    Settings.fMiddleGray = 0.18f;
+    Settings.fBloomScale = 1.0f;
+    Settings.fStarScale = 0.5f;
+    Settings.bToneMap = true;
+    Settings.bBlueShift = true;
+
+    static const WCHAR* s_strStages[PPCPU_NUM_STAGES] =
+    {
+        L"Scene_To_SceneScaled", L"MeasureLuminance", L"CalculateAdaptation", L"SceneScaled_To_BrightPass",
+        L"BrightPass_To_StarSource", L"StarSource_To_BloomSource", L"RenderBloom", L"RenderStar",
+        L"FinalScenePass"
+    };
+
+    const UINT aThreads[3] = { 1, 1, nThreads };
+    const DWORD adwFlags[3] = { PPCPU_SCALAR, 0, 0 };
+    double aafStageTime[3][PPCPU_NUM_STAGES];
+    UINT nRunThreads = 1;
+    float fAdaptedLuminance = 0.0f;
+    INT nResult = 0;
+
+    ZeroMemory( aafStageTime, sizeof( aafStageTime ) );
+    for( UINT iRun = 0; iRun < 3; iRun++ )
+    {
+        CPostProcessCPU PostProcess;
+        if( FAILED( PostProcess.Create( Width, Height, aThreads[iRun], adwFlags[iRun] ) ) )
+        {
+            wprintf( L"Could not create the post-processing\n" );
+            nResult = 1;
+            break;
+        }
+
+        PPCPU_IMAGE Scene = { Width, Height, pScene };
+        PPCPU_IMAGE Output = { Width, Height, pOutputs + iRun * nFloats };
+
+        // A long first frame lets the eye adapt to the scene
+        Settings.fElapsedTime = 10.0f;
+        PostProcess.Render( &Scene, &Output, Settings, g_GlareDef );
+
+        Settings.fElapsedTime = 1.0f / 60.0f;
+        for( UINT iFrame = 0; iFrame < nFrames; iFrame++ )
+        {
+            PostProcess.Render( &Scene, &Output, Settings, g_GlareDef );
+            for( UINT iStage = 0; iStage < PPCPU_NUM_STAGES; iStage++ )
+                aafStageTime[iRun][iStage] += PostProcess.GetStageTime( ( PPCPU_STAGE )iStage ) / nFrames;
+        }
+
+        nRunThreads = PostProcess.GetNumThreads();
+        fAdaptedLuminance = PostProcess.GetAdaptedLuminance();
+    }
+
+    if( 0 == nResult )
+    {
+        wprintf( L"%u x %u, glare %s, %u frames, adapted luminance %f\n\n", Width, Height,
+                 g_GlareDef.m_strGlareName, nFrames, fAdaptedLuminance );
+        wprintf( L"%-26s %10s %10s %10s\n", L"ms", L"scalar", L"SSE2 1", L"SSE2 N" );
+
+        double afTotal[3] = { 0.0, 0.0, 0.0 };
+        for( UINT iStage = 0; iStage < PPCPU_NUM_STAGES; iStage++ )
+        {
+            wprintf( L"%-26s %10.3f %10.3f %10.3f\n", s_strStages[iStage], aafStageTime[0][iStage],
+                     aafStageTime[1][iStage], aafStageTime[2][iStage] );
+            for( UINT iRun = 0; iRun < 3; iRun++ )
+                afTotal[iRun] += aafStageTime[iRun][iStage];
+        }
+        wprintf( L"%-26s %10.3f %10.3f %10.3f\n", L"total", afTotal[0], afTotal[1], afTotal[2] );
+        wprintf( L"(SSE2 N is %u threads)\n\n", nRunThreads );
+
+        UINT nNotFinite = 0;
+        for( SIZE_T i = 0; i < nFloats; i++ )
+        {
+            if( !_finite( pOutputs[i] ) )
+                nNotFinite++;
+        }
+        bool bSIMDSame = 0 == memcmp( pOutputs, pOutputs + nFloats, nFloats * sizeof( float ) );
+        bool bThreadsSame = 0 == memcmp( pOutputs + nFloats, pOutputs + 2 * nFloats, nFloats * sizeof( float ) );
+
+        wprintf( L"%u components not finite, SSE2 %s as scalar, threads %s as one thread\n", nNotFinite,
+                 bSIMDSame ? L"same" : L"NOT the same", bThreadsSame ? L"same" : L"NOT the same" );
+        if( nNotFinite > 0 || !bSIMDSame || !bThreadsSame )
+            nResult = 1;
+    }
+
+    // Portable float map of the RGB, bottom row first
+    if( 0 == nResult && strOutput )
+    {
+        FILE* pFile = NULL;
+        if( 0 == _wfopen_s( &pFile, strOutput, L"wb" ) && pFile )
+        {
+            fprintf( pFile, "PF\n%u %u\n-1.0\n", Width, Height );
+            for( UINT y = Height; y-- > 0; )
+            {
+                const float* pTexel = pOutputs + ( SIZE_T )y * Width * 4;
+                for( UINT x = 0; x < Width; x++, pTexel += 4 )
+                    fwrite( pTexel, sizeof( float ), 3, pFile );
+            }
+            fclose( pFile );
+            wprintf( L"Wrote %s\n", strOutput );
+        }
+        else
+        {
+            wprintf( L"Could not write %s\n", strOutput );
+            nResult = 1;
+        }
+    }
+
+    SAFE_DELETE_ARRAY( pScene );
+    SAFE_DELETE_ARRAY( pOutputs );
+
+    return nResult;
+}
@@ -0,0 +1,1044 @@
+//--------------------------------------------------------------------------------------
+// File: PostProcessCPU.cpp
+//
+// CPU reference of the HDRLighting post-processing chain
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "GlareDefD3D.h"
+#include "PostProcessCPU.h"
+#include "DXUTWorkerPool.h"
+#include <math.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define PPCPU_SSE
+#endif
+
+// Size of the pieces a pass is cut into for the threads
+#define PPCPU_TILE_WIDTH        64
+#define PPCPU_TILE_HEIGHT       32
+
+// Constants of HDRLighting.fx
+#define BRIGHT_PASS_THRESHOLD   5.0f
+#define BRIGHT_PASS_OFFSET      10.0f
+
+static const float g_afLuminance[4] = { 0.2125f, 0.7154f, 0.0721f, 0.0f };
+static const float g_afBlueShift[4] = { 1.05f, 0.97f, 1.27f, 0.0f };
+
+// Source rows of one tap for the destination row being filtered
+struct PPCPU_ROW
+{
+    const float* p0;
+    const float* p1;
+    float f;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Where texture coordinate u lands in a source Size texels across, with clamp addressing
+//--------------------------------------------------------------------------------------
+static void GetTap( PPCPU_TAP* pTap, float u, UINT Size, bool bLinear )
+{
+    const int iLast = ( int )Size - 1;
+    float fTexel = u * ( float )Size;
+
+    if( bLinear )
+    {
+        // Texel centers are half a texel in
+        fTexel -= 0.5f;
+        float fFloor = floorf( fTexel );
+        int i = ( int )fFloor;
+        pTap->i0 = i < 0 ? 0 : ( i > iLast ? iLast : i );
+        pTap->i1 = i + 1 < 0 ? 0 : ( i + 1 > iLast ? iLast : i + 1 );
+        pTap->f = fTexel - fFloor;
+    }
+    else
+    {
+        int i = ( int )floorf( fTexel );
+        pTap->i0 = i < 0 ? 0 : ( i > iLast ? iLast : i );
+        pTap->i1 = pTap->i0;
+        pTap->f = 0.0f;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+static void GetRows( const PPCPU_PASS& Pass, const PPCPU_TAP* pRowTaps, UINT TapStride, UINT iRow,
+                     PPCPU_ROW* pRows )
+{
+    for( UINT t = 0; t < Pass.nTaps; t++ )
+    {
+        const PPCPU_TAP& Tap = pRowTaps[t * TapStride + iRow];
+        const PPCPU_IMAGE* pSrc = Pass.apSrc[t];
+        pRows[t].p0 = pSrc->pTexels + ( SIZE_T )Tap.i0 * pSrc->Width * 4;
+        pRows[t].p1 = pSrc->pTexels + ( SIZE_T )Tap.i1 * pSrc->Width * 4;
+        pRows[t].f = Tap.f;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// One sample of a texture.  Both versions blend in the same order, so they give the same
+// result.
+//--------------------------------------------------------------------------------------
+static inline void SampleScalar( float* pOut, const PPCPU_ROW& Row, const PPCPU_TAP& Column, bool bLinear )
+{
+    const float* p00 = Row.p0 + Column.i0 * 4;
+    if( !bLinear )
+    {
+        pOut[0] = p00[0];
+        pOut[1] = p00[1];
+        pOut[2] = p00[2];
+        pOut[3] = p00[3];
+        return;
+    }
+
+    const float* p01 = Row.p0 + Column.i1 * 4;
+    const float* p10 = Row.p1 + Column.i0 * 4;
+    const float* p11 = Row.p1 + Column.i1 * 4;
+    for( int c = 0; c < 4; c++ )
+    {
+        float fTop = p00[c] + ( p01[c] - p00[c] ) * Column.f;
+        float fBottom = p10[c] + ( p11[c] - p10[c] ) * Column.f;
+        pOut[c] = fTop + ( fBottom - fTop ) * Row.f;
+    }
+}
+
+#ifdef PPCPU_SSE
+static inline __m128 SampleSSE( const PPCPU_ROW& Row, const PPCPU_TAP& Column, bool bLinear )
+{
+    __m128 v00 = _mm_loadu_ps( Row.p0 + Column.i0 * 4 );
+    if( !bLinear )
+        return v00;
+
+    __m128 v01 = _mm_loadu_ps( Row.p0 + Column.i1 * 4 );
+    __m128 v10 = _mm_loadu_ps( Row.p1 + Column.i0 * 4 );
+    __m128 v11 = _mm_loadu_ps( Row.p1 + Column.i1 * 4 );
+    __m128 vFX = _mm_set1_ps( Column.f );
+    __m128 vTop = _mm_add_ps( v00, _mm_mul_ps( _mm_sub_ps( v01, v00 ), vFX ) );
+    __m128 vBottom = _mm_add_ps( v10, _mm_mul_ps( _mm_sub_ps( v11, v10 ), vFX ) );
+    return _mm_add_ps( vTop, _mm_mul_ps( _mm_sub_ps( vBottom, vTop ), _mm_set1_ps( Row.f ) ) );
+}
+#endif
+
+
+//--------------------------------------------------------------------------------------
+// Sum of the weighted samples: the DownScale, GaussBlur5x5, Bloom, Star and MergeTextures
+// shaders, and SampleLumIterative
+//--------------------------------------------------------------------------------------
+static void SumTile( const PPCPU_PASS& Pass, const PPCPU_TAP* pColumnTaps, const PPCPU_TAP* pRowTaps,
+                     UINT TapStride, const RECT& rcTile, bool bSSE )
+{
+    PPCPU_ROW aRows[PPCPU_MAX_TAPS];
+    const UINT nTaps = Pass.nTaps;
+    const UINT iFirstColumn = rcTile.left - Pass.rcDest.left;
+    const UINT nColumns = rcTile.right - rcTile.left;
+
+#ifdef PPCPU_SSE
+    __m128 avWeights[PPCPU_MAX_TAPS];
+    for( UINT t = 0; t < nTaps; t++ )
+        avWeights[t] = _mm_loadu_ps( ( const float* )&Pass.avWeights[t] );
+#endif
+
+    for( LONG y = rcTile.top; y < rcTile.bottom; y++ )
+    {
+        GetRows( Pass, pRowTaps, TapStride, y - Pass.rcDest.top, aRows );
+        float* pOut = Pass.pDest->pTexels + ( ( SIZE_T )y * Pass.pDest->Width + rcTile.left ) * 4;
+
+#ifdef PPCPU_SSE
+        if( bSSE )
+        {
+            for( UINT x = 0; x < nColumns; x++, pOut += 4 )
+            {
+                __m128 vSum = _mm_setzero_ps();
+                for( UINT t = 0; t < nTaps; t++ )
+                {
+                    __m128 vSample = SampleSSE( aRows[t], pColumnTaps[t * TapStride + iFirstColumn + x],
+                                                0 != ( Pass.dwLinearTaps & ( 1 << t ) ) );
+                    vSum = _mm_add_ps( vSum, _mm_mul_ps( avWeights[t], vSample ) );
+                }
+                _mm_storeu_ps( pOut, vSum );
+            }
+            continue;
+        }
+#endif
+
+        for( UINT x = 0; x < nColumns; x++, pOut += 4 )
+        {
+            float afSum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            for( UINT t = 0; t < nTaps; t++ )
+            {
+                float afSample[4];
+                SampleScalar( afSample, aRows[t], pColumnTaps[t * TapStride + iFirstColumn + x],
+                              0 != ( Pass.dwLinearTaps & ( 1 << t ) ) );
+                const float* pfWeight = ( const float* )&Pass.avWeights[t];
+                for( int c = 0; c < 4; c++ )
+                    afSum[c] = afSum[c] + pfWeight[c] * afSample[c];
+            }
+            pOut[0] = afSum[0];
+            pOut[1] = afSum[1];
+            pOut[2] = afSum[2];
+            pOut[3] = afSum[3];
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// SampleLumInitial: the average log luminance of the samples.  The target is 64 x 64 at
+// most, so this is left to the scalar code.
+//--------------------------------------------------------------------------------------
+static void LogLuminanceTile( const PPCPU_PASS& Pass, const PPCPU_TAP* pColumnTaps, const PPCPU_TAP* pRowTaps,
+                              UINT TapStride, const RECT& rcTile )
+{
+    PPCPU_ROW aRows[PPCPU_MAX_TAPS];
+    const UINT iFirstColumn = rcTile.left - Pass.rcDest.left;
+    const UINT nColumns = rcTile.right - rcTile.left;
+
+    for( LONG y = rcTile.top; y < rcTile.bottom; y++ )
+    {
+        GetRows( Pass, pRowTaps, TapStride, y - Pass.rcDest.top, aRows );
+        float* pOut = Pass.pDest->pTexels + ( ( SIZE_T )y * Pass.pDest->Width + rcTile.left ) * 4;
+
+        for( UINT x = 0; x < nColumns; x++, pOut += 4 )
+        {
+            float fLogLumSum = 0.0f;
+            for( UINT t = 0; t < Pass.nTaps; t++ )
+            {
+                float afSample[4];
+                SampleScalar( afSample, aRows[t], pColumnTaps[t * TapStride + iFirstColumn + x],
+                              0 != ( Pass.dwLinearTaps & ( 1 << t ) ) );
+                fLogLumSum += logf( afSample[0] * g_afLuminance[0] + afSample[1] * g_afLuminance[1] +
+                                    afSample[2] * g_afLuminance[2] + 0.0001f );
+            }
+            fLogLumSum /= ( float )Pass.nTaps;
+
+            pOut[0] = fLogLumSum;
+            pOut[1] = fLogLumSum;
+            pOut[2] = fLogLumSum;
+            pOut[3] = 1.0f;
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// BrightPassFilterPS.  Alpha is scaled by 1 and divided by 1 to keep the two versions
+// the same.
+//--------------------------------------------------------------------------------------
+static void BrightPassTile( const PPCPU_PASS& Pass, const PPCPU_TAP* pColumnTaps, const PPCPU_TAP* pRowTaps,
+                            UINT TapStride, const RECT& rcTile, bool bSSE )
+{
+    PPCPU_ROW Row;
+    const UINT iFirstColumn = rcTile.left - Pass.rcDest.left;
+    const UINT nColumns = rcTile.right - rcTile.left;
+    const float afScale[4] = { Pass.fScale, Pass.fScale, Pass.fScale, 1.0f };
+    const float afThreshold[4] = { BRIGHT_PASS_THRESHOLD, BRIGHT_PASS_THRESHOLD, BRIGHT_PASS_THRESHOLD, 0.0f };
+    const float afOffset[4] = { BRIGHT_PASS_OFFSET, BRIGHT_PASS_OFFSET, BRIGHT_PASS_OFFSET, 1.0f };
+
+    for( LONG y = rcTile.top; y < rcTile.bottom; y++ )
+    {
+        GetRows( Pass, pRowTaps, TapStride, y - Pass.rcDest.top, &Row );
+        float* pOut = Pass.pDest->pTexels + ( ( SIZE_T )y * Pass.pDest->Width + rcTile.left ) * 4;
+
+#ifdef PPCPU_SSE
+        if( bSSE )
+        {
+            const __m128 vScale = _mm_loadu_ps( afScale );
+            const __m128 vThreshold = _mm_loadu_ps( afThreshold );
+            const __m128 vOffset = _mm_loadu_ps( afOffset );
+            const __m128 vRGB = _mm_castsi128_ps( _mm_setr_epi32( -1, -1, -1, 0 ) );
+            const __m128 vZero = _mm_setzero_ps();
+
+            for( UINT x = 0; x < nColumns; x++, pOut += 4 )
+            {
+                __m128 v = SampleSSE( Row, pColumnTaps[iFirstColumn + x], false );
+                v = _mm_sub_ps( _mm_mul_ps( v, vScale ), vThreshold );
+                v = _mm_max_ps( v, vZero );
+                v = _mm_div_ps( v, _mm_add_ps( _mm_and_ps( v, vRGB ), vOffset ) );
+                _mm_storeu_ps( pOut, v );
+            }
+            continue;
+        }
+#endif
+
+        for( UINT x = 0; x < nColumns; x++, pOut += 4 )
+        {
+            float afSample[4];
+            SampleScalar( afSample, Row, pColumnTaps[iFirstColumn + x], false );
+            for( int c = 0; c < 4; c++ )
+            {
+                float f = afSample[c] * afScale[c] - afThreshold[c];
+                f = f > 0.0f ? f : 0.0f;
+                pOut[c] = f / ( ( c < 3 ? f : 0.0f ) + afOffset[c] );
+            }
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// FinalScenePassPS: tap 0 is the scene, tap 1 the bloom and tap 2 the star, each weighted
+// by its scale.  Alpha goes through the blue shift and tone mapping unchanged.
+//--------------------------------------------------------------------------------------
+static void FinalTile( const PPCPU_PASS& Pass, const PPCPU_TAP* pColumnTaps, const PPCPU_TAP* pRowTaps,
+                       UINT TapStride, const RECT& rcTile, bool bSSE )
+{
+    PPCPU_ROW aRows[3];
+    const UINT iFirstColumn = rcTile.left - Pass.rcDest.left;
+    const UINT nColumns = rcTile.right - rcTile.left;
+    const float afBlueShift[4] = { Pass.fBlueShift, Pass.fBlueShift, Pass.fBlueShift, 0.0f };
+    const float afScale[4] = { Pass.fScale, Pass.fScale, Pass.fScale, 1.0f };
+    const float* pfBloomScale = ( const float* )&Pass.avWeights[1];
+    const float* pfStarScale = ( const float* )&Pass.avWeights[2];
+    const bool bBloomLinear = 0 != ( Pass.dwLinearTaps & 2 );
+    const bool bStarLinear = 0 != ( Pass.dwLinearTaps & 4 );
+
+    for( LONG y = rcTile.top; y < rcTile.bottom; y++ )
+    {
+        GetRows( Pass, pRowTaps, TapStride, y - Pass.rcDest.top, aRows );
+        float* pOut = Pass.pDest->pTexels + ( ( SIZE_T )y * Pass.pDest->Width + rcTile.left ) * 4;
+
+#ifdef PPCPU_SSE
+        if( bSSE )
+        {
+            const __m128 vLuminance = _mm_loadu_ps( g_afLuminance );
+            const __m128 vBlueShiftVector = _mm_loadu_ps( g_afBlueShift );
+            const __m128 vBlueShift = _mm_loadu_ps( afBlueShift );
+            const __m128 vScale = _mm_loadu_ps( afScale );
+            const __m128 vOne = _mm_set1_ps( 1.0f );
+            const __m128 vRGB = _mm_castsi128_ps( _mm_setr_epi32( -1, -1, -1, 0 ) );
+            const __m128 vBloomScale = _mm_loadu_ps( pfBloomScale );
+            const __m128 vStarScale = _mm_loadu_ps( pfStarScale );
+
+            for( UINT x = iFirstColumn; x < iFirstColumn + nColumns; x++, pOut += 4 )
+            {
+                __m128 v = SampleSSE( aRows[0], pColumnTaps[x], false );
+
+                if( Pass.bBlueShift )
+                {
+                    __m128 vDot = _mm_mul_ps( v, vLuminance );
+                    vDot = _mm_add_ss( _mm_add_ss( vDot, _mm_shuffle_ps( vDot, vDot, _MM_SHUFFLE( 1, 1, 1, 1 ) ) ),
+                                       _mm_shuffle_ps( vDot, vDot, _MM_SHUFFLE( 2, 2, 2, 2 ) ) );
+                    __m128 vRodColor = _mm_mul_ps( _mm_shuffle_ps( vDot, vDot, 0 ), vBlueShiftVector );
+                    v = _mm_add_ps( v, _mm_mul_ps( vBlueShift, _mm_sub_ps( vRodColor, v ) ) );
+                }
+
+                if( Pass.bToneMap )
+                {
+                    v = _mm_mul_ps( v, vScale );
+                    v = _mm_div_ps( v, _mm_add_ps( _mm_and_ps( v, vRGB ), vOne ) );
+                }
+
+                __m128 vBloom = SampleSSE( aRows[1], pColumnTaps[TapStride + x], bBloomLinear );
+                __m128 vStar = SampleSSE( aRows[2], pColumnTaps[2 * TapStride + x], bStarLinear );
+                v = _mm_add_ps( v, _mm_mul_ps( vStarScale, vStar ) );
+                v = _mm_add_ps( v, _mm_mul_ps( vBloomScale, vBloom ) );
+                _mm_storeu_ps( pOut, v );
+            }
+            continue;
+        }
+#endif
+
+        for( UINT x = iFirstColumn; x < iFirstColumn + nColumns; x++, pOut += 4 )
+        {
+            float afSample[4], afBloom[4], afStar[4];
+            SampleScalar( afSample, aRows[0], pColumnTaps[x], false );
+
+            if( Pass.bBlueShift )
+            {
+                float fDot = afSample[0] * g_afLuminance[0] + afSample[1] * g_afLuminance[1];
+                fDot = fDot + afSample[2] * g_afLuminance[2];
+                for( int c = 0; c < 4; c++ )
+                {
+                    float fRodColor = fDot * g_afBlueShift[c];
+                    afSample[c] = afSample[c] + afBlueShift[c] * ( fRodColor - afSample[c] );
+                }
+            }
+
+            if( Pass.bToneMap )
+            {
+                for( int c = 0; c < 4; c++ )
+                {
+                    float f = afSample[c] * afScale[c];
+                    afSample[c] = f / ( ( c < 3 ? f : 0.0f ) + 1.0f );
+                }
+            }
+
+            SampleScalar( afBloom, aRows[1], pColumnTaps[TapStride + x], bBloomLinear );
+            SampleScalar( afStar, aRows[2], pColumnTaps[2 * TapStride + x], bStarLinear );
+            for( int c = 0; c < 4; c++ )
+            {
+                float f = afSample[c] + pfStarScale[c] * afStar[c];
+                pOut[c] = f + pfBloomScale[c] * afBloom[c];
+            }
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// CPU twins of GetTextureRect and GetTextureCoords
+//--------------------------------------------------------------------------------------
+static void GetImageRect( const PPCPU_IMAGE* pImage, RECT* pRect )
+{
+    SetRect( pRect, 0, 0, pImage->Width, pImage->Height );
+}
+
+static void GetImageCoords( const PPCPU_IMAGE* pSrc, const RECT* pRectSrc, const PPCPU_IMAGE* pDest,
+                            const RECT* pRectDest, CoordRect* pCoords )
+{
+    pCoords->fLeftU = 0.0f;
+    pCoords->fTopV = 0.0f;
+    pCoords->fRightU = 1.0f;
+    pCoords->fBottomV = 1.0f;
+
+    if( pRectSrc )
+    {
+        float tU = 1.0f / pSrc->Width;
+        float tV = 1.0f / pSrc->Height;
+
+        pCoords->fLeftU += pRectSrc->left * tU;
+        pCoords->fTopV += pRectSrc->top * tV;
+        pCoords->fRightU -= ( pSrc->Width - pRectSrc->right ) * tU;
+        pCoords->fBottomV -= ( pSrc->Height - pRectSrc->bottom ) * tV;
+    }
+
+    if( pRectDest )
+    {
+        float tU = 1.0f / pDest->Width;
+        float tV = 1.0f / pDest->Height;
+
+        pCoords->fLeftU -= pRectDest->left * tU;
+        pCoords->fTopV -= pRectDest->top * tV;
+        pCoords->fRightU += ( pDest->Width - pRectDest->right ) * tU;
+        pCoords->fBottomV += ( pDest->Height - pRectDest->bottom ) * tV;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// A pass that sums nTaps weighted samples of pSrc over the whole of pDest
+//--------------------------------------------------------------------------------------
+static void InitPass( PPCPU_PASS* pPass, const PPCPU_IMAGE* pSrc, PPCPU_IMAGE* pDest, UINT nTaps )
+{
+    ZeroMemory( pPass, sizeof( PPCPU_PASS ) );
+    for( UINT t = 0; t < PPCPU_MAX_TAPS; t++ )
+        pPass->apSrc[t] = pSrc;
+    pPass->pDest = pDest;
+    GetImageRect( pDest, &pPass->rcDest );
+    pPass->Coords.fRightU = 1.0f;
+    pPass->Coords.fBottomV = 1.0f;
+    pPass->nTaps = nTaps;
+    pPass->Op = PPCPU_OP_SUM;
+}
+
+
+//--------------------------------------------------------------------------------------
+CPostProcessCPU::CPostProcessCPU()
+{
+    ZeroMemory( m_aImages, sizeof( m_aImages ) );
+    ZeroMemory( m_afStageTime, sizeof( m_afStageTime ) );
+    m_Width = 0;
+    m_Height = 0;
+    m_dwFlags = 0;
+    m_fAdaptedLuminance = 0.0f;
+    m_pColumnTaps = NULL;
+    m_pRowTaps = NULL;
+    m_TapStride = 0;
+    m_nThreads = 1;
+    m_pPass = NULL;
+    m_nTilesX = 0;
+    m_nTiles = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+CPostProcessCPU::~CPostProcessCPU()
+{
+    Destroy();
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CPostProcessCPU::Create( UINT Width, UINT Height, UINT nThreads, DWORD dwFlags )
+{
+    Destroy();
+
+    // The bloom textures are 1/8 the size of the scene
+    if( Width < 8 || Height < 8 )
+        return E_INVALIDARG;
+
+    m_Width = Width;
+    m_Height = Height;
+    m_dwFlags = dwFlags;
+    m_fAdaptedLuminance = 0.0f;
+
+    // Sizes of the textures OnResetDevice creates, for the scene cropped to a multiple of 8
+    const UINT CropWidth = Width - Width % 8;
+    const UINT CropHeight = Height - Height % 8;
+
+    UINT aSizes[PPCPU_NUM_TEXTURES][2];
+    aSizes[PPCPU_TEX_SCENE_SCALED][0] = CropWidth / 4;
+    aSizes[PPCPU_TEX_SCENE_SCALED][1] = CropHeight / 4;
+    aSizes[PPCPU_TEX_BRIGHT_PASS][0] = CropWidth / 4 + 2;
+    aSizes[PPCPU_TEX_BRIGHT_PASS][1] = CropHeight / 4 + 2;
+    aSizes[PPCPU_TEX_STAR_SOURCE][0] = CropWidth / 4 + 2;
+    aSizes[PPCPU_TEX_STAR_SOURCE][1] = CropHeight / 4 + 2;
+    aSizes[PPCPU_TEX_BLOOM_SOURCE][0] = CropWidth / 8 + 2;
+    aSizes[PPCPU_TEX_BLOOM_SOURCE][1] = CropHeight / 8 + 2;
+    for( UINT i = 0; i < 4; i++ )
+    {
+        aSizes[PPCPU_TEX_TONEMAP + i][0] = 1 << ( 2 * i );
+        aSizes[PPCPU_TEX_TONEMAP + i][1] = 1 << ( 2 * i );
+    }
+    aSizes[PPCPU_TEX_BLOOM][0] = CropWidth / 8;
+    aSizes[PPCPU_TEX_BLOOM][1] = CropHeight / 8;
+    for( UINT i = 1; i < 3; i++ )
+    {
+        aSizes[PPCPU_TEX_BLOOM + i][0] = CropWidth / 8 + 2;
+        aSizes[PPCPU_TEX_BLOOM + i][1] = CropHeight / 8 + 2;
+    }
+    for( UINT i = 0; i < 12; i++ )
+    {
+        aSizes[PPCPU_TEX_STAR + i][0] = CropWidth / 4;
+        aSizes[PPCPU_TEX_STAR + i][1] = CropHeight / 4;
+    }
+
+    // All start black, which gives the bordered textures their border
+    for( UINT i = 0; i < PPCPU_NUM_TEXTURES; i++ )
+    {
+        const SIZE_T nFloats = ( SIZE_T )aSizes[i][0] * aSizes[i][1] * 4;
+        m_aImages[i].Width = aSizes[i][0];
+        m_aImages[i].Height = aSizes[i][1];
+        m_aImages[i].pTexels = new float[nFloats];
+        if( !m_aImages[i].pTexels )
+        {
+            Destroy();
+            return E_OUTOFMEMORY;
+        }
+        ZeroMemory( m_aImages[i].pTexels, nFloats * sizeof( float ) );
+    }
+
+    // The final pass is the widest and tallest, unless the scene is smaller than the
+    // 64x64 luminance texture
+    m_TapStride = max( max( Width, Height ), m_aImages[PPCPU_TEX_TONEMAP + 3].Width );
+    m_pColumnTaps = new PPCPU_TAP[ PPCPU_MAX_TAPS * m_TapStride ];
+    m_pRowTaps = new PPCPU_TAP[ PPCPU_MAX_TAPS * m_TapStride ];
+    if( !m_pColumnTaps || !m_pRowTaps )
+    {
+        Destroy();
+        return E_OUTOFMEMORY;
+    }
+
+    if( 0 == nThreads )
+        nThreads = CDXUTWorkerPool::GetNumProcessors();
+    nThreads = min( nThreads, ( UINT )PPCPU_MAX_THREADS );
+    m_nThreads = min( nThreads, DXUTGetWorkerPool()->GetNumThreads() );
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CPostProcessCPU::Destroy()
+{
+    for( UINT i = 0; i < PPCPU_NUM_TEXTURES; i++ )
+        SAFE_DELETE_ARRAY( m_aImages[i].pTexels );
+    ZeroMemory( m_aImages, sizeof( m_aImages ) );
+
+    SAFE_DELETE_ARRAY( m_pColumnTaps );
+    SAFE_DELETE_ARRAY( m_pRowTaps );
+    m_TapStride = 0;
+    m_nThreads = 1;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Works out where each tap lands for every column and row of the rectangle drawn, then
+// shares the tiles of the rectangle with the pool's workers
+//--------------------------------------------------------------------------------------
+void CPostProcessCPU::RunPass( const PPCPU_PASS& Pass )
+{
+    const UINT nColumns = Pass.rcDest.right - Pass.rcDest.left;
+    const UINT nRows = Pass.rcDest.bottom - Pass.rcDest.top;
+    if( 0 == nColumns || 0 == nRows || 0 == Pass.nTaps )
+        return;
+
+    // The texture coordinate DrawFullScreenQuad gives the center of each pixel
+    const float fDU = ( Pass.Coords.fRightU - Pass.Coords.fLeftU ) / ( float )Pass.pDest->Width;
+    const float fDV = ( Pass.Coords.fBottomV - Pass.Coords.fTopV ) / ( float )Pass.pDest->Height;
+    for( UINT t = 0; t < Pass.nTaps; t++ )
+    {
+        const PPCPU_IMAGE* pSrc = Pass.apSrc[t];
+        const bool bLinear = 0 != ( Pass.dwLinearTaps & ( 1 << t ) );
+
+        for( UINT x = 0; x < nColumns; x++ )
+        {
+            float u = Pass.Coords.fLeftU + ( ( float )( Pass.rcDest.left + x ) + 0.5f ) * fDU + Pass.avOffsets[t].x;
+            GetTap( &m_pColumnTaps[t * m_TapStride + x], u, pSrc->Width, bLinear );
+        }
+        for( UINT y = 0; y < nRows; y++ )
+        {
+            float v = Pass.Coords.fTopV + ( ( float )( Pass.rcDest.top + y ) + 0.5f ) * fDV + Pass.avOffsets[t].y;
+            GetTap( &m_pRowTaps[t * m_TapStride + y], v, pSrc->Height, bLinear );
+        }
+    }
+
+    m_pPass = &Pass;
+    m_nTilesX = ( nColumns + PPCPU_TILE_WIDTH - 1 ) / PPCPU_TILE_WIDTH;
+    m_nTiles = m_nTilesX * ( ( nRows + PPCPU_TILE_HEIGHT - 1 ) / PPCPU_TILE_HEIGHT );
+
+    // Passes of a single tile are done on this thread alone
+    DXUTGetWorkerPool()->Run( TileProc, this, m_nTiles, m_nThreads );
+}
+
+
+//--------------------------------------------------------------------------------------
+void CPostProcessCPU::TileProc( void* pContext, UINT iTile, UINT iThread )
+{
+    UNREFERENCED_PARAMETER( iThread );
+    ( ( CPostProcessCPU* )pContext )->FilterTile( iTile );
+}
+
+
+//--------------------------------------------------------------------------------------
+void CPostProcessCPU::FilterTile( UINT iTile )
+{
+    const PPCPU_PASS& Pass = *m_pPass;
+
+    RECT rcTile;
+    rcTile.left = Pass.rcDest.left + ( iTile % m_nTilesX ) * PPCPU_TILE_WIDTH;
+    rcTile.top = Pass.rcDest.top + ( iTile / m_nTilesX ) * PPCPU_TILE_HEIGHT;
+    rcTile.right = min( rcTile.left + PPCPU_TILE_WIDTH, Pass.rcDest.right );
+    rcTile.bottom = min( rcTile.top + PPCPU_TILE_HEIGHT, Pass.rcDest.bottom );
+
+    const bool bSSE = 0 == ( m_dwFlags & PPCPU_SCALAR );
+    switch( Pass.Op )
+    {
+        case PPCPU_OP_SUM:
+            SumTile( Pass, m_pColumnTaps, m_pRowTaps, m_TapStride, rcTile, bSSE );
+            break;
+        case PPCPU_OP_LOG_LUMINANCE:
+            LogLuminanceTile( Pass, m_pColumnTaps, m_pRowTaps, m_TapStride, rcTile );
+            break;
+        case PPCPU_OP_BRIGHT_PASS:
+            BrightPassTile( Pass, m_pColumnTaps, m_pRowTaps, m_TapStride, rcTile, bSSE );
+            break;
+        case PPCPU_OP_FINAL:
+            FinalTile( Pass, m_pColumnTaps, m_pRowTaps, m_TapStride, rcTile, bSSE );
+            break;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+void CPostProcessCPU::EndStage( PPCPU_STAGE Stage, double* pfStart )
+{
+    double fEnd = DXUTGetMilliseconds();
+    m_afStageTime[Stage] = fEnd - *pfStart;
+    *pfStart = fEnd;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CPostProcessCPU::Render( const PPCPU_IMAGE* pScene, PPCPU_IMAGE* pDest, const PPCPU_SETTINGS& Settings,
+                                 const CGlareDef& GlareDef )
+{
+    if( !m_pColumnTaps )
+        return E_FAIL;
+    if( !pScene || !pScene->pTexels || pScene->Width != m_Width || pScene->Height != m_Height )
+        return E_INVALIDARG;
+    if( pDest && ( !pDest->pTexels || pDest->Width != m_Width || pDest->Height != m_Height ) )
+        return E_INVALIDARG;
+
+    ZeroMemory( m_afStageTime, sizeof( m_afStageTime ) );
+
+    double fStart = DXUTGetMilliseconds();
+
+    ScaleScene( pScene );
+    EndStage( PPCPU_STAGE_SCENE_SCALED, &fStart );
+
+    if( Settings.bToneMap )
+    {
+        MeasureLuminance();
+        EndStage( PPCPU_STAGE_LUMINANCE, &fStart );
+    }
+
+    // CalculateAdaptedLumPS
+    const float fCurrentLum = GetSceneLuminance();
+    m_fAdaptedLuminance = m_fAdaptedLuminance + ( fCurrentLum - m_fAdaptedLuminance ) *
+                          ( 1 - powf( 0.98f, 30 * Settings.fElapsedTime ) );
+    EndStage( PPCPU_STAGE_ADAPTATION, &fStart );
+
+    BrightPass( Settings.fMiddleGray );
+    EndStage( PPCPU_STAGE_BRIGHT_PASS, &fStart );
+
+    BlurStarSource();
+    EndStage( PPCPU_STAGE_STAR_SOURCE, &fStart );
+
+    ScaleStarSource();
+    EndStage( PPCPU_STAGE_BLOOM_SOURCE, &fStart );
+
+    RenderBloom( GlareDef );
+    EndStage( PPCPU_STAGE_BLOOM, &fStart );
+
+    RenderStar( GlareDef );
+    EndStage( PPCPU_STAGE_STAR, &fStart );
+
+    if( pDest )
+    {
+        FinalPass( pScene, pDest, Settings );
+        EndStage( PPCPU_STAGE_FINAL, &fStart );
+    }
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Scene_To_SceneScaled
+//--------------------------------------------------------------------------------------
+void CPostProcessCPU::ScaleScene( const PPCPU_IMAGE* pScene )
+{
+    PPCPU_IMAGE* pScaled = &m_aImages[PPCPU_TEX_SCENE_SCALED];
+
+    // Place the rectangle in the center of the scene
+    RECT rectSrc;
+    rectSrc.left = ( m_Width - pScaled->Width * 4 ) / 2;
+    rectSrc.top = ( m_Height - pScaled->Height * 4 ) / 2;
+    rectSrc.right = rectSrc.left + pScaled->Width * 4;
+    rectSrc.bottom = rectSrc.top + pScaled->Height * 4;
+
+    PPCPU_PASS Pass;
+    InitPass( &Pass, pScene, pScaled, 16 );
+    GetImageCoords( pScene, &rectSrc, pScaled, NULL, &Pass.Coords );
+    GetSampleOffsets_DownScale4x4( m_Width, m_Height, Pass.avOffsets );
+    for( UINT i = 0; i < 16; i++ )
+        Pass.avWeights[i] = D3DXVECTOR4( 1.0f / 16, 1.0f / 16, 1.0f / 16, 1.0f / 16 );
+
+    RunPass( Pass );
+}
+
+
+//--------------------------------------------------------------------------------------
+// MeasureLuminance: the log average luminance down to 1x1, through the 64x64, 16x16 and
+// 4x4 textures
+//--------------------------------------------------------------------------------------
+void CPostProcessCPU::MeasureLuminance()
+{
+    PPCPU_IMAGE* pToneMap = &m_aImages[PPCPU_TEX_TONEMAP];
+    UINT iCurTexture = 3;
+
+    PPCPU_PASS Pass;
+    InitPass( &Pass, &m_aImages[PPCPU_TEX_SCENE_SCALED], &pToneMap[iCurTexture], 9 );
+    Pass.Op = PPCPU_OP_LOG_LUMINANCE;
+    Pass.dwLinearTaps = 0x1ff;
+
+    float tU = 1.0f / ( 3.0f * pToneMap[iCurTexture].Width );
+    float tV = 1.0f / ( 3.0f * pToneMap[iCurTexture].Height );
+    int index = 0;
+    for( int x = -1; x <= 1; x++ )
+    {
+        for( int y = -1; y <= 1; y++ )
+        {
+            Pass.avOffsets[index].x = x * tU;
+            Pass.avOffsets[index].y = y * tV;
+            index++;
+        }
+    }
+
+    RunPass( Pass );
+
+    // SampleLumIterative, then SampleLumFinal into the 1x1 texture.  Dividing by 16 is
+    // the same as weighting each sample by 1/16.
+    for( iCurTexture--; ; iCurTexture-- )
+    {
+        const PPCPU_IMAGE* pSrc = &pToneMap[iCurTexture + 1];
+        InitPass( &Pass, pSrc, &pToneMap[iCurTexture], 16 );
+        GetSampleOffsets_DownScale4x4( pSrc->Width, pSrc->Height, Pass.avOffsets );
+        for( UINT i = 0; i < 16; i++ )
+            Pass.avWeights[i] = D3DXVECTOR4( 1.0f / 16, 1.0f / 16, 1.0f / 16, 1.0f / 16 );
+
+        RunPass( Pass );
+
+        if( 0 == iCurTexture )
+            break;
+    }
+
+    float* pLum = pToneMap[0].pTexels;
+    float fLum = expf( pLum[0] );
+    pLum[0] = fLum;
+    pLum[1] = fLum;
+    pLum[2] = fLum;
+    pLum[3] = 1.0f;
+}
+
+
+//--------------------------------------------------------------------------------------
+// SceneScaled_To_BrightPass
+//--------------------------------------------------------------------------------------
+void CPostProcessCPU::BrightPass( float fMiddleGray )
+{
+    const PPCPU_IMAGE* pSrc = &m_aImages[PPCPU_TEX_SCENE_SCALED];
+    PPCPU_IMAGE* pDest = &m_aImages[PPCPU_TEX_BRIGHT_PASS];
+
+    // Both rectangles are decreased by the single pixel black border
+    RECT rectSrc;
+    GetImageRect( pSrc, &rectSrc );
+    InflateRect( &rectSrc, -1, -1 );
+
+    PPCPU_PASS Pass;
+    InitPass( &Pass, pSrc, pDest, 1 );
+    InflateRect( &Pass.rcDest, -1, -1 );
+    GetImageCoords( pSrc, &rectSrc, pDest, &Pass.rcDest, &Pass.Coords );
+    Pass.Op = PPCPU_OP_BRIGHT_PASS;
+    Pass.fScale = fMiddleGray / ( m_fAdaptedLuminance + 0.001f );
+
+    RunPass( Pass );
+}
+
+
+//--------------------------------------------------------------------------------------
+// BrightPass_To_StarSource: a 5x5 gaussian blur
+//--------------------------------------------------------------------------------------
+void CPostProcessCPU::BlurStarSource()
+{
+    const PPCPU_IMAGE* pSrc = &m_aImages[PPCPU_TEX_BRIGHT_PASS];
+    PPCPU_IMAGE* pDest = &m_aImages[PPCPU_TEX_STAR_SOURCE];
+
+    // GetSampleOffsets_GaussBlur5x5 gives 13 samples and the shader takes the first 12
+    PPCPU_PASS Pass;
+    InitPass( &Pass, pSrc, pDest, 12 );
+    InflateRect( &Pass.rcDest, -1, -1 );
+    GetImageCoords( pSrc, NULL, pDest, &Pass.rcDest, &Pass.Coords );
+    GetSampleOffsets_GaussBlur5x5( pSrc->Width, pSrc->Height, Pass.avOffsets, Pass.avWeights );
+
+    RunPass( Pass );
+}
+
+
+//--------------------------------------------------------------------------------------
+// StarSource_To_BloomSource
+//--------------------------------------------------------------------------------------
+void CPostProcessCPU::ScaleStarSource()
+{
+    const PPCPU_IMAGE* pSrc = &m_aImages[PPCPU_TEX_STAR_SOURCE];
+    PPCPU_IMAGE* pDest = &m_aImages[PPCPU_TEX_BLOOM_SOURCE];
+
+    RECT rectSrc;
+    GetImageRect( pSrc, &rectSrc );
+    InflateRect( &rectSrc, -1, -1 );
+
+    PPCPU_PASS Pass;
+    InitPass( &Pass, pSrc, pDest, 4 );
+    InflateRect( &Pass.rcDest, -1, -1 );
+    GetImageCoords( pSrc, &rectSrc, pDest, &Pass.rcDest, &Pass.Coords );
+
+    // The sample takes the offsets from the bright pass texture, the same size
+    const PPCPU_IMAGE* pBrightPass = &m_aImages[PPCPU_TEX_BRIGHT_PASS];
+    GetSampleOffsets_DownScale2x2( pBrightPass->Width, pBrightPass->Height, Pass.avOffsets );
+    for( UINT i = 0; i < 4; i++ )
+        Pass.avWeights[i] = D3DXVECTOR4( 1.0f / 4, 1.0f / 4, 1.0f / 4, 1.0f / 4 );
+
+    RunPass( Pass );
+}
+
+
+//--------------------------------------------------------------------------------------
+// RenderBloom: a 5x5 gaussian blur of the bloom source, then a wide gaussian blur across
+// and down
+//--------------------------------------------------------------------------------------
+void CPostProcessCPU::RenderBloom( const CGlareDef& GlareDef )
+{
+    PPCPU_IMAGE* pBloom = &m_aImages[PPCPU_TEX_BLOOM];
+    ZeroMemory( pBloom[0].pTexels, ( SIZE_T )pBloom[0].Width * pBloom[0].Height * 4 * sizeof( float ) );
+
+    if( GlareDef.m_fGlareLuminance <= 0.0f ||
+        GlareDef.m_fBloomLuminance <= 0.0f )
+        return;
+
+    const PPCPU_IMAGE* pSource = &m_aImages[PPCPU_TEX_BLOOM_SOURCE];
+
+    RECT rectSrc;
+    GetImageRect( pSource, &rectSrc );
+    InflateRect( &rectSrc, -1, -1 );
+
+    RECT rectDest;
+    GetImageRect( &pBloom[2], &rectDest );
+    InflateRect( &rectDest, -1, -1 );
+
+    CoordRect coords;
+    GetImageCoords( pSource, &rectSrc, &pBloom[2], &rectDest, &coords );
+
+    PPCPU_PASS Pass;
+    InitPass( &Pass, pSource, &pBloom[2], 12 );
+    Pass.rcDest = rectDest;
+    Pass.Coords = coords;
+    GetSampleOffsets_GaussBlur5x5( pSource->Width, pSource->Height, Pass.avOffsets, Pass.avWeights, 1.0f );
+    RunPass( Pass );
+
+    float afSampleOffsets[PPCPU_MAX_TAPS];
+    InitPass( &Pass, &pBloom[2], &pBloom[1], 15 );
+    Pass.rcDest = rectDest;
+    Pass.Coords = coords;
+    GetSampleOffsets_Bloom( pBloom[2].Width, afSampleOffsets, Pass.avWeights, 3.0f, 2.0f );
+    for( UINT i = 0; i < 15; i++ )
+        Pass.avOffsets[i] = D3DXVECTOR2( afSampleOffsets[i], 0.0f );
+    RunPass( Pass );
+
+    GetImageRect( &pBloom[1], &rectSrc );
+    InflateRect( &rectSrc, -1, -1 );
+
+    InitPass( &Pass, &pBloom[1], &pBloom[0], 15 );
+    GetImageCoords( &pBloom[1], &rectSrc, &pBloom[0], NULL, &Pass.Coords );
+    GetSampleOffsets_Bloom( pBloom[1].Height, afSampleOffsets, Pass.avWeights, 3.0f, 2.0f );
+    for( UINT i = 0; i < 15; i++ )
+        Pass.avOffsets[i] = D3DXVECTOR2( 0.0f, afSampleOffsets[i] );
+    RunPass( Pass );
+}
+
+
+//--------------------------------------------------------------------------------------
+// RenderStar: each line of the star is drawn by up to three passes that each sample 8
+// points along it, 8 times further apart than the last, and the lines are averaged
+//--------------------------------------------------------------------------------------
+void CPostProcessCPU::RenderStar( const CGlareDef& GlareDef )
+{
+    PPCPU_IMAGE* pStar = &m_aImages[PPCPU_TEX_STAR];
+    ZeroMemory( pStar[0].pTexels, ( SIZE_T )pStar[0].Width * pStar[0].Height * 4 * sizeof( float ) );
+
+    if( GlareDef.m_fGlareLuminance <= 0.0f ||
+        GlareDef.m_fStarLuminance <= 0.0f )
+        return;
+
+    const CStarDef& starDef = GlareDef.m_starDef;
+    const int nStarLines = min( starDef.m_nStarLines, PPCPU_MAX_STAR_LINES );
+    if( nStarLines <= 0 )
+        return;
+
+    // Constants as in RenderStar of the sample
+    const float fTanFoV = atanf( D3DX_PI / 8 );
+    const D3DXVECTOR4 vWhite( 1.0f, 1.0f, 1.0f, 1.0f );
+    const int s_maxPasses = 3;
+    const int nSamples = 8;
+    D3DXVECTOR4 aaColor[s_maxPasses][8];
+    const D3DXCOLOR colorWhite( 0.63f, 0.63f, 0.63f, 0.0f );
+
+    for( int p = 0; p < s_maxPasses; p++ )
+    {
+        float ratio = ( float )( p + 1 ) / ( float )s_maxPasses;
+
+        for( int s = 0; s < nSamples; s++ )
+        {
+            D3DXCOLOR chromaticAberrColor;
+            D3DXColorLerp( &chromaticAberrColor,
+                           &( CStarDef::GetChromaticAberrationColor( s ) ),
+                           &colorWhite,
+                           ratio );
+
+            D3DXColorLerp( ( D3DXCOLOR* )&( aaColor[p][s] ),
+                           &colorWhite, &chromaticAberrColor,
+                           GlareDef.m_fChromaticAberration );
+        }
+    }
+
+    const PPCPU_IMAGE* pStarSource = &m_aImages[PPCPU_TEX_STAR_SOURCE];
+    const float srcW = ( FLOAT )pStarSource->Width;
+    const float srcH = ( FLOAT )pStarSource->Height;
+    const float radOffset = GlareDef.m_fStarInclination + starDef.m_fInclination;
+
+    PPCPU_PASS Pass;
+    for( int d = 0; d < nStarLines; d++ )
+    {
+        const STARLINE& starLine = starDef.m_pStarLine[d];
+        const PPCPU_IMAGE* pSource = pStarSource;
+
+        float rad = radOffset + starLine.fInclination;
+        float sn = sinf( rad ), cs = cosf( rad );
+        D3DXVECTOR2 vtStepUV;
+        vtStepUV.x = sn / srcW * starLine.fSampleLength;
+        vtStepUV.y = cs / srcH * starLine.fSampleLength;
+
+        float attnPowScale = ( fTanFoV + 0.1f ) * 1.0f *
+            ( 160.0f + 120.0f ) / ( srcW + srcH ) * 1.2f;
+
+        int iWorkTexture = 1;
+        for( int p = 0; p < starLine.nPasses; p++ )
+        {
+            // The last pass goes to the texture of the line
+            PPCPU_IMAGE* pDest = ( p == starLine.nPasses - 1 ) ? &pStar[d + 4] : &pStar[iWorkTexture];
+
+            InitPass( &Pass, pSource, pDest, nSamples );
+            Pass.dwLinearTaps = ( 1 << nSamples ) - 1;
+            for( int i = 0; i < nSamples; i++ )
+            {
+                float lum = powf( starLine.fAttenuation, attnPowScale * i );
+
+                Pass.avWeights[i] = aaColor[starLine.nPasses - 1 - p][i] *
+                    lum * ( p + 1.0f ) * 0.5f;
+
+                Pass.avOffsets[i].x = vtStepUV.x * i;
+                Pass.avOffsets[i].y = vtStepUV.y * i;
+                if( fabs( Pass.avOffsets[i].x ) >= 0.9f ||
+                    fabs( Pass.avOffsets[i].y ) >= 0.9f )
+                {
+                    Pass.avOffsets[i].x = 0.0f;
+                    Pass.avOffsets[i].y = 0.0f;
+                    Pass.avWeights[i] *= 0.0f;
+                }
+            }
+
+            RunPass( Pass );
+
+            vtStepUV *= nSamples;
+            attnPowScale *= nSamples;
+
+            pSource = &pStar[iWorkTexture];
+            iWorkTexture += 1;
+            if( iWorkTexture > 2 )
+                iWorkTexture = 1;
+        }
+    }
+
+    // MergeTextures_N
+    InitPass( &Pass, NULL, &pStar[0], nStarLines );
+    Pass.dwLinearTaps = ( 1 << nStarLines ) - 1;
+    for( int i = 0; i < nStarLines; i++ )
+    {
+        Pass.apSrc[i] = &pStar[i + 4];
+        Pass.avWeights[i] = vWhite * 1.0f / ( FLOAT )nStarLines;
+    }
+    RunPass( Pass );
+}
+
+
+//--------------------------------------------------------------------------------------
+// FinalScenePass
+//--------------------------------------------------------------------------------------
+void CPostProcessCPU::FinalPass( const PPCPU_IMAGE* pScene, PPCPU_IMAGE* pDest, const PPCPU_SETTINGS& Settings )
+{
+    PPCPU_PASS Pass;
+    InitPass( &Pass, pScene, pDest, 3 );
+    Pass.Op = PPCPU_OP_FINAL;
+    Pass.apSrc[1] = &m_aImages[PPCPU_TEX_BLOOM];
+    Pass.apSrc[2] = &m_aImages[PPCPU_TEX_STAR];
+    Pass.dwLinearTaps = 0x6;
+    Pass.avWeights[1] = D3DXVECTOR4( Settings.fBloomScale, Settings.fBloomScale, Settings.fBloomScale,
+                                     Settings.fBloomScale );
+    Pass.avWeights[2] = D3DXVECTOR4( Settings.fStarScale, Settings.fStarScale, Settings.fStarScale,
+                                     Settings.fStarScale );
+
+    // Blue shift blends from -1.5 to 2.6 of log luminance
+    float fBlueShiftCoefficient = 1.0f - ( m_fAdaptedLuminance + 1.5f ) / 4.1f;
+    Pass.fBlueShift = fBlueShiftCoefficient < 0.0f ? 0.0f : ( fBlueShiftCoefficient > 1.0f ? 1.0f :
+                                                              fBlueShiftCoefficient );
+    Pass.bBlueShift = Settings.bBlueShift;
+    Pass.fScale = Settings.fMiddleGray / ( m_fAdaptedLuminance + 0.001f );
+    Pass.bToneMap = Settings.bToneMap;
+
+    RunPass( Pass );
+}
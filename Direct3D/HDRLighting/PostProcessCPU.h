@@ -0,0 +1,232 @@
+//--------------------------------------------------------------------------------------
+// File: PostProcessCPU.h
+//
+// A CPU reference of the HDRLighting post-processing chain: the 1/4 scale copy of the
+// scene, the log average luminance, light adaptation, the bright-pass filter, the bloom,
+// the star, and the final tone mapped composite.  Each pass samples its source with the
+// offsets and weights the effect pass gets from GetSampleOffsets_*, at the texture
+// coordinates DrawFullScreenQuad gives it, with the point or bilinear filtering the
+// sample sets, clamped at the edges.  It can render reference frames without a device,
+// and the images of each pass can be compared with the render targets of the sample.
+//
+// Every image is kept as 4 floats a texel.  The sample renders some passes to A8R8G8B8
+// and 16 bit float targets, and filters with the precision of the hardware, so its
+// output only matches to within a few 8 bit steps.
+//
+// Passes are cut into tiles that a pool of threads take in turn, and the texels of a tile
+// are filtered four components at a time with SSE2 where available.  The results are the
+// same bit for bit on any number of threads, with or without SSE2.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#pragma once
+#ifndef POSTPROCESSCPU_H
+#define POSTPROCESSCPU_H
+
+class CGlareDef;
+
+#define PPCPU_MAX_THREADS       32
+#define PPCPU_MAX_TAPS          16      // MAX_SAMPLES of the effect
+#define PPCPU_MAX_STAR_LINES    8       // MergeTextures_8 is the largest merge
+
+// Use the plain C++ filters even where SSE2 is available
+#define PPCPU_SCALAR            0x00000001
+
+
+// Texture coordinate rectangle
+struct CoordRect
+{
+    float fLeftU, fTopV;
+    float fRightU, fBottomV;
+};
+
+
+// Sample offset calculation. These offsets are passed to corresponding pixel shaders,
+// and used by the CPU passes.  Defined in HDRLighting.cpp.
+HRESULT GetSampleOffsets_GaussBlur5x5( DWORD dwD3DTexWidth, DWORD dwD3DTexHeight, D3DXVECTOR2* avTexCoordOffset,
+                                       D3DXVECTOR4* avSampleWeights, FLOAT fMultiplier = 1.0f );
+HRESULT GetSampleOffsets_Bloom( DWORD dwD3DTexSize, float afTexCoordOffset[15], D3DXVECTOR4* avColorWeight,
+                                float fDeviation, FLOAT fMultiplier=1.0f );
+HRESULT GetSampleOffsets_Star( DWORD dwD3DTexSize, float afTexCoordOffset[15], D3DXVECTOR4* avColorWeight,
+                               float fDeviation );
+HRESULT GetSampleOffsets_DownScale4x4( DWORD dwWidth, DWORD dwHeight, D3DXVECTOR2 avSampleOffsets[] );
+HRESULT GetSampleOffsets_DownScale2x2( DWORD dwWidth, DWORD dwHeight, D3DXVECTOR2 avSampleOffsets[] );
+
+
+//--------------------------------------------------------------------------------------
+// A float RGBA image, Width * 4 floats a row
+//--------------------------------------------------------------------------------------
+struct PPCPU_IMAGE
+{
+    UINT Width;
+    UINT Height;
+    float* pTexels;
+};
+
+// The parts of the chain that are timed, named after the functions of the sample
+enum PPCPU_STAGE
+{
+    PPCPU_STAGE_SCENE_SCALED = 0,   // Scene_To_SceneScaled
+    PPCPU_STAGE_LUMINANCE,          // MeasureLuminance
+    PPCPU_STAGE_ADAPTATION,         // CalculateAdaptation
+    PPCPU_STAGE_BRIGHT_PASS,        // SceneScaled_To_BrightPass
+    PPCPU_STAGE_STAR_SOURCE,        // BrightPass_To_StarSource
+    PPCPU_STAGE_BLOOM_SOURCE,       // StarSource_To_BloomSource
+    PPCPU_STAGE_BLOOM,              // RenderBloom
+    PPCPU_STAGE_STAR,               // RenderStar
+    PPCPU_STAGE_FINAL,              // FinalScenePass
+    PPCPU_NUM_STAGES
+};
+
+// The working images, matching the textures of the sample
+enum PPCPU_TEXTURE
+{
+    PPCPU_TEX_SCENE_SCALED = 0,
+    PPCPU_TEX_BRIGHT_PASS,
+    PPCPU_TEX_STAR_SOURCE,
+    PPCPU_TEX_BLOOM_SOURCE,
+    PPCPU_TEX_TONEMAP,                                  // g_apTexToneMap[0..3]
+    PPCPU_TEX_BLOOM = PPCPU_TEX_TONEMAP + 4,            // g_apTexBloom[0..2]
+    PPCPU_TEX_STAR = PPCPU_TEX_BLOOM + 3,               // g_apTexStar[0..11]
+    PPCPU_NUM_TEXTURES = PPCPU_TEX_STAR + 12
+};
+
+// The effect parameters the sample sets
+struct PPCPU_SETTINGS
+{
+    float fMiddleGray;          // g_fKeyValue
+    float fElapsedTime;         // Seconds since the last frame, for the adaptation
+    float fBloomScale;
+    float fStarScale;
+    bool bToneMap;
+    bool bBlueShift;
+};
+
+// What a pass does with its samples
+enum PPCPU_OP
+{
+    PPCPU_OP_SUM = 0,           // Sum of the weighted samples
+    PPCPU_OP_LOG_LUMINANCE,     // SampleLumInitial
+    PPCPU_OP_BRIGHT_PASS,       // BrightPassFilterPS
+    PPCPU_OP_FINAL,             // FinalScenePassPS, from the scene, bloom and star
+};
+
+//--------------------------------------------------------------------------------------
+// One effect pass: a full screen quad drawn over rcDest of the destination, sampling
+// each tap's source at the quad's texture coordinate plus the tap's offset
+//--------------------------------------------------------------------------------------
+struct PPCPU_PASS
+{
+    const PPCPU_IMAGE* apSrc[PPCPU_MAX_TAPS];
+    PPCPU_IMAGE* pDest;
+    RECT rcDest;
+    CoordRect Coords;
+    UINT nTaps;
+    DWORD dwLinearTaps;         // Bit i set when tap i is filtered bilinearly
+    D3DXVECTOR2 avOffsets[PPCPU_MAX_TAPS];
+    D3DXVECTOR4 avWeights[PPCPU_MAX_TAPS];
+    PPCPU_OP Op;
+    float fScale;               // g_fMiddleGray / adapted luminance, for the bright pass and final pass
+    float fBlueShift;           // Blue shift coefficient for the final pass
+    bool bToneMap;
+    bool bBlueShift;
+};
+
+// Where a tap lands in its source for one column or row of the destination.  Bilinear
+// filtering blends texel i0 with texel i1 by f.
+struct PPCPU_TAP
+{
+    int i0;
+    int i1;
+    float f;
+};
+
+
+//--------------------------------------------------------------------------------------
+class CPostProcessCPU
+{
+public:
+                        CPostProcessCPU();
+                        ~CPostProcessCPU();
+
+    // Width and Height are those of the scene.  nThreads 0 uses a thread for each
+    // processor.
+    HRESULT             Create( UINT Width, UINT Height, UINT nThreads = 0, DWORD dwFlags = 0 );
+    void                Destroy();
+
+    // Runs the chain on pScene and writes the composite to pDest, both the size given to
+    // Create.  pDest may be NULL to stop before the final pass.
+    HRESULT             Render( const PPCPU_IMAGE* pScene, PPCPU_IMAGE* pDest, const PPCPU_SETTINGS& Settings,
+                                const CGlareDef& GlareDef );
+
+    // The adapted luminance carries over from one frame to the next, as it does in the
+    // 1x1 textures of the sample.  It starts at 0.
+    void                SetAdaptedLuminance( float fLuminance )
+    {
+        m_fAdaptedLuminance = fLuminance;
+    }
+    float               GetAdaptedLuminance() const
+    {
+        return m_fAdaptedLuminance;
+    }
+
+    // Average luminance of the scene from the last frame that was tone mapped
+    float               GetSceneLuminance() const
+    {
+        return m_aImages[PPCPU_TEX_TONEMAP].pTexels ? m_aImages[PPCPU_TEX_TONEMAP].pTexels[0] : 0.0f;
+    }
+
+    const PPCPU_IMAGE*  GetImage( PPCPU_TEXTURE Texture ) const
+    {
+        return &m_aImages[Texture];
+    }
+
+    // Milliseconds the stage took in the last Render
+    double              GetStageTime( PPCPU_STAGE Stage ) const
+    {
+        return m_afStageTime[Stage];
+    }
+
+    UINT                GetNumThreads() const
+    {
+        return m_nThreads;
+    }
+
+protected:
+    static void         TileProc( void* pContext, UINT iTile, UINT iThread );
+
+    void                RunPass( const PPCPU_PASS& Pass );
+    void                FilterTile( UINT iTile );
+    void                EndStage( PPCPU_STAGE Stage, double* pfStart );
+
+    void                ScaleScene( const PPCPU_IMAGE* pScene );
+    void                MeasureLuminance();
+    void                BrightPass( float fMiddleGray );
+    void                BlurStarSource();
+    void                ScaleStarSource();
+    void                RenderBloom( const CGlareDef& GlareDef );
+    void                RenderStar( const CGlareDef& GlareDef );
+    void                FinalPass( const PPCPU_IMAGE* pScene, PPCPU_IMAGE* pDest, const PPCPU_SETTINGS& Settings );
+
+    PPCPU_IMAGE         m_aImages[PPCPU_NUM_TEXTURES];
+    UINT                m_Width;
+    UINT                m_Height;
+    DWORD               m_dwFlags;
+    float               m_fAdaptedLuminance;
+    double              m_afStageTime[PPCPU_NUM_STAGES];
+
+    // Taps of the pass being run, PPCPU_MAX_TAPS runs of m_TapStride each
+    PPCPU_TAP*          m_pColumnTaps;
+    PPCPU_TAP*          m_pRowTaps;
+    UINT                m_TapStride;
+
+    // Passes run on the DXUT worker pool, on up to m_nThreads threads counting the one
+    // calling Render
+    UINT                m_nThreads;
+    const PPCPU_PASS*   m_pPass;
+    UINT                m_nTilesX;
+    UINT                m_nTiles;
+};
+
+#endif
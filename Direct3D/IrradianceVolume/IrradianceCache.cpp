@@ -4,6 +4,7 @@
 //--------------------------------------------------------------------------------------
 #include "DXUT.h"
 #include "IrradianceCache.h"
+#include "SDKSH.h"
 #include "float.h"
 
 #define IRRADIANCECACHE_FILE_VERSION_STRING (L"ATI Irradiance Cache File v1.2")
@@ -671,10 +672,10 @@ bool CIrradianceCacheGenerator::SampleIncidentRadiance( D3DXVECTOR3* pPosition,
         return false;
     }
 
-    hResult = D3DXSHProjectCubeMap( IRRADIANCE_CACHE_MAX_SH_ORDER, m_pCubeTexture, pRed, pGreen, pBlue );
+    hResult = DXUTSHProjectCubeTexture9( IRRADIANCE_CACHE_MAX_SH_ORDER, m_pCubeTexture, pRed, pGreen, pBlue );
     if( FAILED( hResult ) )
     {
-        DXUT_ERR( L"D3DXSHProjectCubeMap() failed!\n", hResult );
+        DXUT_ERR( L"DXUTSHProjectCubeTexture9() failed!\n", hResult );
         return false;
     }
 
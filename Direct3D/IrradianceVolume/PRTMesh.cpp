@@ -6,12 +6,17 @@
 //--------------------------------------------------------------------------------------
 #include "DXUT.h"
 #include "SDKmisc.h"
+#include "SDKSH.h"
 #include "prtmesh.h"
 #include <stdio.h>
 
 //#define DEBUG_VS   // Uncomment this line to debug vertex shaders 
 //#define DEBUG_PS   // Uncomment this line to debug pixel shaders 
 
+// The PRT constants are only recomputed when a coefficient of the lighting has moved by
+// more than this fraction of the largest coefficient
+#define PRT_CONSTANTS_THRESHOLD 0.0001f
+
 //--------------------------------------------------------------------------------------
 CPRTMesh::CPRTMesh( void )
 {
@@ -105,7 +110,7 @@ VOID WINAPI CPRTMesh::StaticFillCubeTextureWithSHCallback( D3DXVECTOR4* pOut,
     D3DXVec3Normalize( &nrm,pTexCoord );
     float fBF[36];
 
-    D3DXSHEvalDirection( fBF,6,&nrm );
+    DXUTSHEvalDirection( fBF,6,&nrm );
 
     D3DXVECTOR4 vUse;
     for( int i=0;i<4;i++ ) vUse[i] = fBF[uStart+i];
@@ -570,6 +575,9 @@ HRESULT CPRTMesh::LoadEffects( IDirect3DDevice9* pd3dDevice, const D3DCAPS9* pDe
     SAFE_RELEASE( m_pNDotLEffect );
     SAFE_RELEASE( m_pLDPRTEffect );
 
+    // The new PRT effect needs its constants set whatever the lighting
+    m_PRTClusterBasis.Invalidate();
+
     D3DXMACRO aDefines[3];
     CHAR szMaxNumClusters[64];
     sprintf_s( szMaxNumClusters, 64, "%d", dwNumClusters );
@@ -725,6 +733,11 @@ void CPRTMesh::ExtractCompressedDataForPRTShader()
         V( m_pPRTCompBuffer->ExtractBasis( iCluster, &m_aPRTClusterBases[iCluster * nClusterBasisSize] ) );
     }
 
+    // Keep a copy of the bases laid out for ComputeShaderConstants, which works out the
+    // constants of all the clusters at once on a thread for each processor
+    V( m_PRTClusterBasis.Create( m_aPRTClusterBases, dwNumClusters, dwNumChannels, dwNumPCA,
+                                 GetOrderFromNumCoeffs( dwNumCoeffs ) ) );
+
     SAFE_DELETE_ARRAY( m_aPRTConstants );
     m_aPRTConstants = new float[dwNumClusters * ( 4 + dwNumChannels * dwNumPCA )];
     assert( m_aPRTConstants );
@@ -792,8 +805,6 @@ void CPRTMesh::ComputeShaderConstants( float* pSHCoeffsRed, float* pSHCoeffsGree
     HRESULT hr;
     assert( dwNumCoeffsPerChannel == m_pPRTCompBuffer->GetNumCoeffs() );
 
-    UINT dwNumCoeffs = m_pPRTCompBuffer->GetNumCoeffs();
-    UINT dwOrder = m_dwPRTOrder;
     UINT dwNumChannels = m_pPRTCompBuffer->GetNumChannels();
     UINT dwNumClusters = m_pPRTCompBuffer->GetNumClusters();
     UINT dwNumPCA = m_pPRTCompBuffer->GetNumPCA();
@@ -814,42 +825,20 @@ void CPRTMesh::ComputeShaderConstants( float* pSHCoeffsRed, float* pSHCoeffsGree
     // So we compute an array of floats, m_aPRTConstants, here.
     // This array is the L' dot M[k] and L' dot B[k][j].
     // The source radiance is the lighting environment in terms of spherical
-    // harmonic coefficients which can be computed with D3DXSHEval* or D3DXSHProjectCubeMap.  
+    // harmonic coefficients which can be computed with DXUTSHEval* or DXUTSHProjectCubeMap.  
     // M[k] and B[k][j] are also in terms of spherical harmonic basis coefficients 
     // and come from ID3DXPRTCompBuffer::ExtractBasis().
     //
-    DWORD dwClusterStride = dwNumChannels * dwNumPCA + 4;
-    DWORD dwBasisStride = dwNumCoeffs * dwNumChannels * ( dwNumPCA + 1 );
-
-    for( DWORD iCluster = 0; iCluster < dwNumClusters; iCluster++ )
-    {
-        // For each cluster, store L' dot M[k] per channel, where M[k] is the mean of cluster k
-        m_aPRTConstants[iCluster * dwClusterStride + 0] = D3DXSHDot( dwOrder, &m_aPRTClusterBases[iCluster *
-                                                                     dwBasisStride + 0 * dwNumCoeffs], pSHCoeffsRed );
-        m_aPRTConstants[iCluster * dwClusterStride + 1] = D3DXSHDot( dwOrder, &m_aPRTClusterBases[iCluster *
-                                                                     dwBasisStride + 1 * dwNumCoeffs],
-                                                                     pSHCoeffsGreen );
-        m_aPRTConstants[iCluster * dwClusterStride + 2] = D3DXSHDot( dwOrder, &m_aPRTClusterBases[iCluster *
-                                                                     dwBasisStride + 2 * dwNumCoeffs], pSHCoeffsBlue );
-        m_aPRTConstants[iCluster * dwClusterStride + 3] = 0.0f;
-
-        // Then per channel we compute L' dot B[k][j], where B[k][j] is the jth PCA basis vector for cluster k
-        float* pPCAStart = &m_aPRTConstants[iCluster * dwClusterStride + 4];
-        for( DWORD iPCA = 0; iPCA < dwNumPCA; iPCA++ )
-        {
-            int nOffset = iCluster * dwBasisStride + ( iPCA + 1 ) * dwNumCoeffs * dwNumChannels;
-
-            pPCAStart[0 * dwNumPCA + iPCA] = D3DXSHDot( dwOrder, &m_aPRTClusterBases[nOffset + 0 * dwNumCoeffs],
-                                                        pSHCoeffsRed );
-            pPCAStart[1 * dwNumPCA + iPCA] = D3DXSHDot( dwOrder, &m_aPRTClusterBases[nOffset + 1 * dwNumCoeffs],
-                                                        pSHCoeffsGreen );
-            pPCAStart[2 * dwNumPCA + iPCA] = D3DXSHDot( dwOrder, &m_aPRTClusterBases[nOffset + 2 * dwNumCoeffs],
-                                                        pSHCoeffsBlue );
-        }
-    }
-
-    V( m_pPRTEffect->SetFloatArray( "aPRTConstants", ( float* )m_aPRTConstants, dwNumClusters *
-                                    ( 4 + dwNumChannels * dwNumPCA ) ) );
+    // m_PRTClusterBasis holds M[k] and B[k][j] for every cluster, and computes all the
+    // dot products as one blocked matrix-vector product.  It returns S_FALSE when the
+    // lighting has hardly changed since the constants were last computed, and then the
+    // effect keeps the constants it has.
+    //
+    hr = m_PRTClusterBasis.ComputeConstants( pSHCoeffsRed, pSHCoeffsGreen, pSHCoeffsBlue, m_aPRTConstants,
+                                             PRT_CONSTANTS_THRESHOLD );
+    if( S_OK == hr )
+        V( m_pPRTEffect->SetFloatArray( "aPRTConstants", ( float* )m_aPRTConstants, dwNumClusters *
+                                        ( 4 + dwNumChannels * dwNumPCA ) ) );
 }
 
 
@@ -1292,7 +1281,7 @@ void CPRTMesh::GetSHTransferFunctionAtVertex( unsigned int uVert, int uTechnique
             // LDPRT transfer function (aka Zonal Harmonic coefficients)
             float fVals[36];
 
-            D3DXSHEvalDirection( fVals, 6, &m_pLDPRTShadingNormals[uVert] );
+            DXUTSHEvalDirection( fVals, 6, &m_pLDPRTShadingNormals[uVert] );
             int l, m, idx = 0;
             if( uChan >= m_pPRTBuffer->GetNumChannels() ) uChan = m_pPRTBuffer->GetNumChannels() - 1; // just get last channel
 
@@ -1329,7 +1318,7 @@ void CPRTMesh::GetSHTransferFunctionAtVertex( unsigned int uVert, int uTechnique
                 float fVals[36];
                 float fcCoefs[6] = {1.0f,2.0f / 3.0f,0.25f,0.0f,0.0f,0.0f};
 
-                D3DXSHEvalDirection( fVals, 6, &m_pLDPRTShadingNormals[uVert] );
+                DXUTSHEvalDirection( fVals, 6, &m_pLDPRTShadingNormals[uVert] );
                 int l, m, idx = 0;
 
                 for( l = 0; l < 6; l++ )
@@ -1473,6 +1462,7 @@ void CPRTMesh::OnDestroyDevice()
 
     SAFE_DELETE_ARRAY( m_aPRTClusterBases );
     SAFE_DELETE_ARRAY( m_aPRTConstants );
+    m_PRTClusterBasis.Destroy();
 }
 
 
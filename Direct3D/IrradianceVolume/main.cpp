@@ -10,6 +10,7 @@
 #include "DXUTcamera.h"
 #include "DXUTsettingsdlg.h"
 #include "SDKmisc.h"
+#include "SDKSH.h"
 #include <msxml.h>
 #include "PRTMesh.h"
 #include "SceneMesh.h"
@@ -1260,9 +1261,11 @@ void UpdateLightingEnvironment()
         D3DXVECTOR3 vDir = D3DXVECTOR3( vCentroidWS.x, vCentroidWS.y, vCentroidWS.z );
         g_pIrradianceCache->SampleTrilinear( &vDir, &sample, g_CurrentVoxelLineList );
 
-        D3DXSHRotate( fSum[0], dwOrder, &mModelInv, sample.pRedCoefs );
-        D3DXSHRotate( fSum[1], dwOrder, &mModelInv, sample.pGreenCoefs );
-        D3DXSHRotate( fSum[2], dwOrder, &mModelInv, sample.pBlueCoefs );
+        DXUT_SH_ROTATION Rotation;
+        DXUTSHCreateRotation( &Rotation, dwOrder, &mModelInv );
+        DXUTSHApplyRotation( fSum[0], &Rotation, sample.pRedCoefs );
+        DXUTSHApplyRotation( fSum[1], &Rotation, sample.pGreenCoefs );
+        DXUTSHApplyRotation( fSum[2], &Rotation, sample.pBlueCoefs );
     }
 
     g_PRTMesh.ComputeShaderConstants( fSum[0], fSum[1], fSum[2], dwOrder * dwOrder );
@@ -14,6 +14,7 @@
 #include "DXUTcamera.h"
 #include "DXUTsettingsdlg.h"
 #include "SDKmisc.h"
+#include "SDKSH.h"
 #include "resource.h"
 #include "skybox.h"
 #include "skinmesh.h"
@@ -490,8 +491,8 @@ HRESULT CALLBACK OnCreateDevice( IDirect3DDevice9* pd3dDevice, const D3DSURFACE_
 
     // Create the skybox
     g_Skybox.OnCreateDevice( pd3dDevice, 50, L"Light Probes\\rnl_cross.dds", L"SkyBox.fx" );
-    V( D3DXSHProjectCubeMap( 6, g_Skybox.GetEnvironmentMap(), g_fSkyBoxLightSH[0], g_fSkyBoxLightSH[1],
-                             g_fSkyBoxLightSH[2] ) );
+    V( DXUTSHProjectCubeTexture9( 6, g_Skybox.GetEnvironmentMap(), g_fSkyBoxLightSH[0], g_fSkyBoxLightSH[1],
+                                  g_fSkyBoxLightSH[2] ) );
 
     // Now compute the SH projection of the skybox...
     LPDIRECT3DCUBETEXTURE9 pSHCubeTex = NULL;
@@ -541,7 +542,7 @@ void WINAPI SHCubeFill( D3DXVECTOR4* pOut,
     D3DXVec3Normalize( &vDir,pTexCoord );
 
     float fVals[36];
-    D3DXSHEvalDirection( fVals, pCP->iOrderUse, &vDir );
+    DXUTSHEvalDirection( fVals, pCP->iOrderUse, &vDir );
 
     ( *pOut ) = D3DXVECTOR4( 0,0,0,0 ); // just clear it out...
 
@@ -575,7 +576,7 @@ void WINAPI myFillBF( D3DXVECTOR4* pOut,
     D3DXVec3Normalize( &vDir,pTexCoord );
 
     float fVals[16];
-    D3DXSHEvalDirection( fVals, 4, &vDir );
+    DXUTSHEvalDirection( fVals, 4, &vDir );
 
     ( *pOut ) = D3DXVECTOR4( fVals[iBase+0],fVals[iBase+1],fVals[iBase+2],fVals[iBase+3] );
 }
@@ -770,21 +771,14 @@ void UpdateLightingEnvironment()
     g_fEnvIntensity = g_SampleUI.GetSlider( IDC_ENV_SLIDER )->GetValue() / 1000.0f;
 
     // Create the spotlight
-    D3DXSHEvalConeLight( D3DXSH_MAXORDER, &g_vLightDirection, D3DX_PI / 8.0f,
+    DXUTSHEvalConeLight( D3DXSH_MAXORDER, &g_vLightDirection, D3DX_PI / 8.0f,
                          g_fLightIntensity, g_fLightIntensity, g_fLightIntensity,
                          m_fRLC, m_fGLC, m_fBLC );
 
-    float fSkybox[3][D3DXSH_MAXORDER*D3DXSH_MAXORDER];
-
-    // Scale the light probe environment contribution based on input options    
-    D3DXSHScale( fSkybox[0], D3DXSH_MAXORDER, g_fSkyBoxLightSH[0], g_fEnvIntensity );
-    D3DXSHScale( fSkybox[1], D3DXSH_MAXORDER, g_fSkyBoxLightSH[1], g_fEnvIntensity );
-    D3DXSHScale( fSkybox[2], D3DXSH_MAXORDER, g_fSkyBoxLightSH[2], g_fEnvIntensity );
-
-    // Combine the environment and the spotlight
-    D3DXSHAdd( m_fRLC, D3DXSH_MAXORDER, m_fRLC, fSkybox[0] );
-    D3DXSHAdd( m_fGLC, D3DXSH_MAXORDER, m_fGLC, fSkybox[1] );
-    D3DXSHAdd( m_fBLC, D3DXSH_MAXORDER, m_fBLC, fSkybox[2] );
+    // Combine the spotlight with the light probe environment, scaled based on input options
+    DXUTSHScaleAdd( m_fRLC, D3DXSH_MAXORDER, m_fRLC, g_fSkyBoxLightSH[0], g_fEnvIntensity );
+    DXUTSHScaleAdd( m_fGLC, D3DXSH_MAXORDER, m_fGLC, g_fSkyBoxLightSH[1], g_fEnvIntensity );
+    DXUTSHScaleAdd( m_fBLC, D3DXSH_MAXORDER, m_fBLC, g_fSkyBoxLightSH[2], g_fEnvIntensity );
 }
 
 
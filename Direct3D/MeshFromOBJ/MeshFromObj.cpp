@@ -94,6 +94,7 @@ void InitApp();
 void RenderText();
 void RenderSubset( UINT iSubset );
 void SaveMeshToXFile();
+INT RunArrayBench( int nArgs, LPWSTR* pstrArgs );
 
 //--------------------------------------------------------------------------------------
 // Entry point to the program. Initializes everything and goes into a message processing 
@@ -106,6 +107,23 @@ INT WINAPI wWinMain( HINSTANCE, HINSTANCE, LPWSTR, int )
     _CrtSetDbgFlag( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );
 #endif
 
+    // -arraybench times the mesh loader and dialog control lists without creating a window
+    int nArgs = 0;
+    LPWSTR* pstrArgs = CommandLineToArgvW( GetCommandLineW(), &nArgs );
+    if( pstrArgs )
+    {
+        for( int i = 1; i < nArgs; i++ )
+        {
+            if( 0 == _wcsicmp( pstrArgs[i], L"-arraybench" ) )
+            {
+                INT nResult = RunArrayBench( nArgs - i - 1, pstrArgs + i + 1 );
+                LocalFree( pstrArgs );
+                return nResult;
+            }
+        }
+        LocalFree( pstrArgs );
+    }
+
     // Set the callback functions. These functions allow DXUT to notify
     // the application about device changes, user input, and windows messages.  The 
     // callbacks are optional so you need only set callbacks for events you're interested 
@@ -777,4 +795,91 @@ void SaveMeshToXFile()
 }
 
 
+//--------------------------------------------------------------------------------------
+// Times the two heaviest users of CGrowableArray in this sample:
+//
+//   MeshFromOBJ -arraybench [file.obj] [-loads N] [-controls N]
+//
+// Parses the .obj file (media\cup.obj by default) N times, then fills a dialog with N
+// buttons and a list box with N items, looks every control up by ID and removes them all
+// from the front.  Run builds from before and after a change to CGrowableArray to compare.
+//--------------------------------------------------------------------------------------
+INT RunArrayBench( int nArgs, LPWSTR* pstrArgs )
+{
+    // Report to the console we were started from, if any
+    if( AttachConsole( ATTACH_PARENT_PROCESS ) )
+    {
+        FILE* pFile;
+        freopen_s( &pFile, "CONOUT$", "w", stdout );
+    }
+
+    LPCWSTR strMesh = L"media\\cup.obj";
+    int nLoads = 20;
+    int nControls = 2000;
+    for( int i = 0; i < nArgs; i++ )
+    {
+        if( 0 == _wcsicmp( pstrArgs[i], L"-loads" ) && i + 1 < nArgs )
+            nLoads = __max( _wtoi( pstrArgs[++i] ), 1 );
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-controls" ) && i + 1 < nArgs )
+            nControls = __max( _wtoi( pstrArgs[++i] ), 1 );
+        else if( pstrArgs[i][0] != L'-' )
+            strMesh = pstrArgs[i];
+    }
+
+    LARGE_INTEGER qwFreq, qwStart, qwEnd;
+    QueryPerformanceFrequency( &qwFreq );
+
+    //
+    // Mesh loading fills the position, vertex, index and attribute arrays and the vertex cache
+    //
+    CMeshLoader Loader;
+    UINT nVertices = 0, nFaces = 0;
+    QueryPerformanceCounter( &qwStart );
+    for( int i = 0; i < nLoads; i++ )
+    {
+        if( FAILED( Loader.LoadGeometry( strMesh, &nVertices, &nFaces ) ) )
+        {
+            wprintf( L"Cannot load %s\n", strMesh );
+            return 1;
+        }
+    }
+    QueryPerformanceCounter( &qwEnd );
+    Loader.Destroy();
+
+    wprintf( L"%s: %u vertices, %u faces, %.3f ms per load\n", strMesh, nVertices, nFaces,
+             ( qwEnd.QuadPart - qwStart.QuadPart ) * 1000.0 / qwFreq.QuadPart / nLoads );
+
+    //
+    // Dialogs keep their controls, and list boxes their items, in arrays of pointers
+    //
+    CDXUTDialogResourceManager Manager;
+    CDXUTDialog Dialog;
+    Dialog.Init( &Manager, false );
+
+    QueryPerformanceCounter( &qwStart );
+    for( int i = 0; i < nControls; i++ )
+        Dialog.AddButton( i, L"Button", 0, 0, 100, 22 );
+    for( int i = 0; i < nControls; i++ )
+        Dialog.GetControl( nControls - 1 - i );
+    for( int i = 0; i < nControls; i++ )
+        Dialog.RemoveControl( i );
+    QueryPerformanceCounter( &qwEnd );
+    double fControlsMs = ( qwEnd.QuadPart - qwStart.QuadPart ) * 1000.0 / qwFreq.QuadPart;
+
+    CDXUTListBox* pListBox = NULL;
+    if( FAILED( Dialog.AddListBox( 0, 0, 0, 200, 300, 0, &pListBox ) ) )
+        return 1;
+
+    QueryPerformanceCounter( &qwStart );
+    for( int i = 0; i < nControls; i++ )
+        pListBox->AddItem( L"Item", NULL );
+    for( int i = 0; i < nControls; i++ )
+        pListBox->RemoveItem( 0 );
+    QueryPerformanceCounter( &qwEnd );
+    double fItemsMs = ( qwEnd.QuadPart - qwStart.QuadPart ) * 1000.0 / qwFreq.QuadPart;
+
+    wprintf( L"%d controls: %.3f ms to add, find and remove\n", nControls, fControlsMs );
+    wprintf( L"%d list box items: %.3f ms to add and remove\n", nControls, fItemsMs );
 
+    return 0;
+}
@@ -170,6 +170,27 @@ HRESULT CMeshLoader::Create( IDirect3DDevice9* pd3dDevice, const WCHAR* strFilen
 }
 
 
+//--------------------------------------------------------------------------------------
+// Reads the vertices, indices and materials without creating the mesh or its textures
+//--------------------------------------------------------------------------------------
+HRESULT CMeshLoader::LoadGeometry( const WCHAR* strFilename, UINT* pNumVertices, UINT* pNumFaces )
+{
+    HRESULT hr;
+
+    // Start clean
+    Destroy();
+
+    V_RETURN( LoadGeometryFromOBJ( strFilename ) );
+
+    if( pNumVertices )
+        *pNumVertices = m_Vertices.GetSize();
+    if( pNumFaces )
+        *pNumFaces = m_Indices.GetSize() / 3;
+
+    return S_OK;
+}
+
+
 //--------------------------------------------------------------------------------------
 HRESULT CMeshLoader::LoadGeometryFromOBJ( const WCHAR* strFileName )
 {
@@ -55,6 +55,7 @@ public:
             ~CMeshLoader();
 
     HRESULT Create( IDirect3DDevice9* pd3dDevice, const WCHAR* strFilename );
+    HRESULT LoadGeometry( const WCHAR* strFilename, UINT* pNumVertices, UINT* pNumFaces );  // No device needed
     void    Destroy();
 
 
@@ -0,0 +1,927 @@
+//--------------------------------------------------------------------------------------
+// File: MeshOptimizer.cpp
+//
+// Vertex cache, overdraw and vertex fetch ordering, strips and cache measurement
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#include "MeshOptimizer.h"
+#include <float.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef SAFE_DELETE_ARRAY
+#define SAFE_DELETE_ARRAY(p) { if (p) { delete[] (p);   (p)=NULL; } }
+#endif
+
+// Forsyth's scoring: the vertices of the last face all score LAST_FACE_SCORE, the rest of
+// the cache falls off to 0 with CACHE_DECAY_POWER, and vertices with few faces to go get
+// a boost so lone faces are not left behind
+#define MESHOPT_LAST_FACE_SCORE     0.75f
+#define MESHOPT_CACHE_DECAY_POWER   1.5f
+#define MESHOPT_VALENCE_BOOST_SCALE 2.0f
+#define MESHOPT_VALENCE_BOOST_POWER 0.5f
+#define MESHOPT_VALENCE_TABLE_SIZE  32
+
+// How much worse than its own average the cache may do at the end of an overdraw cluster
+#define MESHOPT_OVERDRAW_THRESHOLD  1.05f
+
+// Faces ahead of the strip that may carry it on
+#define MESHOPT_STRIP_WINDOW        16
+
+#define MESHOPT_NONE                0xFFFFFFFF
+
+// Not windows.h's min and max, which are only there on Windows
+template <class T> static inline T MeshOptMin( T a, T b )
+{
+    return a < b ? a : b;
+}
+template <class T> static inline T MeshOptMax( T a, T b )
+{
+    return a > b ? a : b;
+}
+
+
+//--------------------------------------------------------------------------------------
+// The lowest vertex the faces use and how many from there to the highest
+//--------------------------------------------------------------------------------------
+static void GetVertexRange( const DWORD* pIndices, UINT nFaces, DWORD* piBase, UINT* pnVertices )
+{
+    DWORD iMin = MESHOPT_NONE, iMax = 0;
+    for( UINT i = 0; i < 3 * nFaces; i++ )
+    {
+        iMin = MeshOptMin( iMin, pIndices[i] );
+        iMax = MeshOptMax( iMax, pIndices[i] );
+    }
+    *piBase = nFaces ? iMin : 0;
+    *pnVertices = nFaces ? iMax - iMin + 1 : 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Counts a vertex through a FIFO cache whose entries hold the time each vertex went in;
+// returns 1 on a miss
+//--------------------------------------------------------------------------------------
+static inline UINT UpdateFIFO( UINT* pTimes, UINT iVertex, UINT nSize, UINT* pnTime )
+{
+    if( *pnTime - pTimes[iVertex] <= nSize )
+        return 0;
+
+    pTimes[iVertex] = ( *pnTime )++;
+    return 1;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT MeshOptSimulateCache( const DWORD* pIndices, UINT nFaces, const MESHOPT_CACHE& Cache,
+                              MESHOPT_STATS* pStats )
+{
+    memset( pStats, 0, sizeof( MESHOPT_STATS ) );
+    if( Cache.nSize < 3 || Cache.nSize > MESHOPT_MAX_CACHE_SIZE )
+        return E_INVALIDARG;
+    pStats->nFaces = nFaces;
+    if( 0 == nFaces )
+        return S_OK;
+
+    DWORD iBase;
+    UINT nVertices;
+    GetVertexRange( pIndices, nFaces, &iBase, &nVertices );
+
+    // A vertex that has never gone in has time 0
+    UINT* pTimes = new UINT[ nVertices ];
+    if( !pTimes )
+        return E_OUTOFMEMORY;
+    memset( pTimes, 0, nVertices * sizeof( UINT ) );
+
+    UINT nTime = Cache.nSize + 1;
+    if( MESHOPT_CACHE_FIFO == Cache.Type )
+    {
+        for( UINT i = 0; i < 3 * nFaces; i++ )
+        {
+            const UINT iVertex = pIndices[i] - iBase;
+            pStats->nVertices += ( 0 == pTimes[iVertex] );
+            pStats->nTransforms += UpdateFIFO( pTimes, iVertex, Cache.nSize, &nTime );
+        }
+    }
+    else
+    {
+        // Most recently used first
+        DWORD aCache[MESHOPT_MAX_CACHE_SIZE];
+        UINT nCache = 0;
+        for( UINT i = 0; i < 3 * nFaces; i++ )
+        {
+            const DWORD iVertex = pIndices[i] - iBase;
+            if( 0 == pTimes[iVertex] )
+            {
+                pTimes[iVertex] = 1;
+                pStats->nVertices++;
+            }
+
+            UINT iHit = 0;
+            while( iHit < nCache && aCache[iHit] != iVertex )
+                iHit++;
+            if( iHit == nCache )
+            {
+                pStats->nTransforms++;
+                if( nCache < Cache.nSize )
+                    nCache++;
+                iHit = nCache - 1;
+            }
+            memmove( aCache + 1, aCache, iHit * sizeof( DWORD ) );
+            aCache[0] = iVertex;
+        }
+    }
+
+    SAFE_DELETE_ARRAY( pTimes );
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Forsyth's score of a vertex at iCachePos in the cache, -1 when it is not in it, with
+// nFacesLeft faces still to go
+//--------------------------------------------------------------------------------------
+static inline float GetVertexScore( const float* pCacheScores, const float* pValenceScores, int iCachePos,
+                                    UINT nFacesLeft )
+{
+    if( 0 == nFacesLeft )
+        return -1.0f;
+
+    const float fValence = nFacesLeft < MESHOPT_VALENCE_TABLE_SIZE ? pValenceScores[nFacesLeft] :
+                           MESHOPT_VALENCE_BOOST_SCALE * powf( ( float )nFacesLeft, -MESHOPT_VALENCE_BOOST_POWER );
+    return ( iCachePos < 0 ? 0.0f : pCacheScores[iCachePos] ) + fValence;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT MeshOptVertexCache( DWORD* pIndices, UINT nFaces, UINT nCacheSize )
+{
+    if( nCacheSize < 3 || nCacheSize > MESHOPT_MAX_CACHE_SIZE )
+        return E_INVALIDARG;
+    if( 0 == nFaces )
+        return S_OK;
+
+    DWORD iBase;
+    UINT nVertices;
+    GetVertexRange( pIndices, nFaces, &iBase, &nVertices );
+
+    // The faces of each vertex, those still to go first: pFacesLeft[v] of them from
+    // pFirstFace[v] in pVertexFaces
+    UINT* pFirstFace = new UINT[ nVertices + 1 ];
+    UINT* pFacesLeft = new UINT[ nVertices ];
+    UINT* pVertexFaces = new UINT[ 3 * nFaces ];
+    int* pCachePos = new int[ nVertices ];
+    float* pVertexScores = new float[ nVertices ];
+    float* pFaceScores = new float[ nFaces ];
+    BYTE* pEmitted = new BYTE[ nFaces ];
+    DWORD* pOutput = new DWORD[ 3 * nFaces ];
+    if( !pFirstFace || !pFacesLeft || !pVertexFaces || !pCachePos || !pVertexScores || !pFaceScores || !pEmitted ||
+        !pOutput )
+    {
+        SAFE_DELETE_ARRAY( pFirstFace );
+        SAFE_DELETE_ARRAY( pFacesLeft );
+        SAFE_DELETE_ARRAY( pVertexFaces );
+        SAFE_DELETE_ARRAY( pCachePos );
+        SAFE_DELETE_ARRAY( pVertexScores );
+        SAFE_DELETE_ARRAY( pFaceScores );
+        SAFE_DELETE_ARRAY( pEmitted );
+        SAFE_DELETE_ARRAY( pOutput );
+        return E_OUTOFMEMORY;
+    }
+
+    float afCacheScores[MESHOPT_MAX_CACHE_SIZE + 3];
+    for( UINT i = 0; i < nCacheSize + 3; i++ )
+    {
+        if( i < 3 )
+            afCacheScores[i] = MESHOPT_LAST_FACE_SCORE;
+        else if( i < nCacheSize )
+            afCacheScores[i] = powf( 1.0f - ( float )( i - 3 ) / ( nCacheSize - 3 ), MESHOPT_CACHE_DECAY_POWER );
+        else
+            afCacheScores[i] = 0.0f;
+    }
+    float afValenceScores[MESHOPT_VALENCE_TABLE_SIZE];
+    afValenceScores[0] = 0.0f;
+    for( UINT i = 1; i < MESHOPT_VALENCE_TABLE_SIZE; i++ )
+        afValenceScores[i] = MESHOPT_VALENCE_BOOST_SCALE * powf( ( float )i, -MESHOPT_VALENCE_BOOST_POWER );
+
+    // Faces of each vertex, a face twice for a vertex it uses twice
+    memset( pFacesLeft, 0, nVertices * sizeof( UINT ) );
+    for( UINT i = 0; i < 3 * nFaces; i++ )
+        pFacesLeft[pIndices[i] - iBase]++;
+    pFirstFace[0] = 0;
+    for( UINT v = 0; v < nVertices; v++ )
+    {
+        pFirstFace[v + 1] = pFirstFace[v] + pFacesLeft[v];
+        pFacesLeft[v] = 0;
+    }
+    for( UINT i = 0; i < 3 * nFaces; i++ )
+    {
+        const UINT v = pIndices[i] - iBase;
+        pVertexFaces[pFirstFace[v] + pFacesLeft[v]++] = i / 3;
+    }
+
+    for( UINT v = 0; v < nVertices; v++ )
+    {
+        pCachePos[v] = -1;
+        pVertexScores[v] = GetVertexScore( afCacheScores, afValenceScores, -1, pFacesLeft[v] );
+    }
+    UINT iBest = 0;
+    for( UINT f = 0; f < nFaces; f++ )
+    {
+        pEmitted[f] = 0;
+        pFaceScores[f] = pVertexScores[pIndices[3 * f] - iBase] + pVertexScores[pIndices[3 * f + 1] - iBase] +
+                         pVertexScores[pIndices[3 * f + 2] - iBase];
+        if( pFaceScores[f] > pFaceScores[iBest] )
+            iBest = f;
+    }
+
+    DWORD aCache[MESHOPT_MAX_CACHE_SIZE + 3];
+    DWORD aNewCache[MESHOPT_MAX_CACHE_SIZE + 3];
+    UINT nCache = 0;
+    UINT iNextFace = 0;
+    for( UINT iOutput = 0; iOutput < nFaces; iOutput++ )
+    {
+        // When no face around the cache is left, carry on with the next in the old order
+        if( MESHOPT_NONE == iBest )
+        {
+            while( pEmitted[iNextFace] )
+                iNextFace++;
+            iBest = iNextFace;
+        }
+
+        DWORD aFace[3];
+        for( UINT k = 0; k < 3; k++ )
+        {
+            pOutput[3 * iOutput + k] = pIndices[3 * iBest + k];
+            aFace[k] = pIndices[3 * iBest + k] - iBase;
+        }
+        pEmitted[iBest] = 1;
+
+        // Take the face off the faces to go of its vertices
+        for( UINT k = 0; k < 3; k++ )
+        {
+            UINT* pFaces = pVertexFaces + pFirstFace[aFace[k]];
+            UINT& nLeft = pFacesLeft[aFace[k]];
+            for( UINT i = 0; i < nLeft; i++ )
+            {
+                if( pFaces[i] == iBest )
+                {
+                    pFaces[i] = pFaces[nLeft - 1];
+                    pFaces[nLeft - 1] = iBest;
+                    nLeft--;
+                    break;
+                }
+            }
+        }
+
+        // The face's vertices go to the front of the cache and the rest move down
+        UINT nNewCache = 0;
+        for( UINT k = 0; k < 3; k++ )
+        {
+            if( ( k < 1 || aFace[k] != aFace[0] ) && ( k < 2 || aFace[k] != aFace[1] ) )
+                aNewCache[nNewCache++] = aFace[k];
+        }
+        for( UINT i = 0; i < nCache; i++ )
+        {
+            if( aCache[i] != aFace[0] && aCache[i] != aFace[1] && aCache[i] != aFace[2] )
+                aNewCache[nNewCache++] = aCache[i];
+        }
+
+        // Rescore what is in the cache and what just fell out of it, and their faces
+        for( UINT i = 0; i < nNewCache; i++ )
+        {
+            const DWORD v = aNewCache[i];
+            pCachePos[v] = i < nCacheSize ? ( int )i : -1;
+            const float fScore = GetVertexScore( afCacheScores, afValenceScores, pCachePos[v], pFacesLeft[v] );
+            const float fDelta = fScore - pVertexScores[v];
+            pVertexScores[v] = fScore;
+            const UINT* pFaces = pVertexFaces + pFirstFace[v];
+            for( UINT j = 0; j < pFacesLeft[v]; j++ )
+                pFaceScores[pFaces[j]] += fDelta;
+        }
+        nCache = MeshOptMin( nNewCache, nCacheSize );
+        memcpy( aCache, aNewCache, nCache * sizeof( DWORD ) );
+
+        // The best face to go next is around the cache
+        iBest = MESHOPT_NONE;
+        float fBestScore = -FLT_MAX;
+        for( UINT i = 0; i < nCache; i++ )
+        {
+            const UINT* pFaces = pVertexFaces + pFirstFace[aCache[i]];
+            for( UINT j = 0; j < pFacesLeft[aCache[i]]; j++ )
+            {
+                if( pFaceScores[pFaces[j]] > fBestScore )
+                {
+                    fBestScore = pFaceScores[pFaces[j]];
+                    iBest = pFaces[j];
+                }
+            }
+        }
+    }
+
+    memcpy( pIndices, pOutput, 3 * nFaces * sizeof( DWORD ) );
+
+    SAFE_DELETE_ARRAY( pFirstFace );
+    SAFE_DELETE_ARRAY( pFacesLeft );
+    SAFE_DELETE_ARRAY( pVertexFaces );
+    SAFE_DELETE_ARRAY( pCachePos );
+    SAFE_DELETE_ARRAY( pVertexScores );
+    SAFE_DELETE_ARRAY( pFaceScores );
+    SAFE_DELETE_ARRAY( pEmitted );
+    SAFE_DELETE_ARRAY( pOutput );
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// An overdraw cluster: its first face, and how far it sits out from the middle of the
+// mesh along the way it faces
+//--------------------------------------------------------------------------------------
+struct MESHOPT_CLUSTER
+{
+    UINT iFirstFace;
+    UINT nFaces;
+    float afMiddle[3];
+    float afNormal[3];
+    float fSortKey;
+};
+
+static int CompareClusters( const void* pA, const void* pB )
+{
+    const MESHOPT_CLUSTER* a = ( const MESHOPT_CLUSTER* )pA;
+    const MESHOPT_CLUSTER* b = ( const MESHOPT_CLUSTER* )pB;
+
+    // Furthest out first, then in the order they were in
+    if( a->fSortKey != b->fSortKey )
+        return a->fSortKey > b->fSortKey ? -1 : 1;
+    return a->iFirstFace < b->iFirstFace ? -1 : ( a->iFirstFace > b->iFirstFace ? 1 : 0 );
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT MeshOptOverdraw( DWORD* pIndices, UINT nFaces, const void* pVertices, UINT nStride,
+                         UINT nCacheSize, float fThreshold )
+{
+    if( nCacheSize < 3 || nCacheSize > MESHOPT_MAX_CACHE_SIZE || !pVertices || nStride < 3 * sizeof( float ) )
+        return E_INVALIDARG;
+    if( nFaces < 2 )
+        return S_OK;
+
+    DWORD iBase;
+    UINT nVertices;
+    GetVertexRange( pIndices, nFaces, &iBase, &nVertices );
+
+    UINT* pTimes = new UINT[ nVertices ];
+    UINT* pMisses = new UINT[ nFaces ];
+    MESHOPT_CLUSTER* pClusters = new MESHOPT_CLUSTER[ nFaces ];
+    DWORD* pOutput = new DWORD[ 3 * nFaces ];
+    if( !pTimes || !pMisses || !pClusters || !pOutput )
+    {
+        SAFE_DELETE_ARRAY( pTimes );
+        SAFE_DELETE_ARRAY( pMisses );
+        SAFE_DELETE_ARRAY( pClusters );
+        SAFE_DELETE_ARRAY( pOutput );
+        return E_OUTOFMEMORY;
+    }
+
+    // The cache misses of each face in the order given.  A face that misses on all three
+    // vertices starts a new patch of the mesh, so a hard boundary.
+    memset( pTimes, 0, nVertices * sizeof( UINT ) );
+    UINT nTime = nCacheSize + 1;
+    for( UINT f = 0; f < nFaces; f++ )
+    {
+        pMisses[f] = 0;
+        for( UINT k = 0; k < 3; k++ )
+            pMisses[f] += UpdateFIFO( pTimes, pIndices[3 * f + k] - iBase, nCacheSize, &nTime );
+    }
+
+    // Cut each patch up further wherever the cache, starting empty, has got back down to
+    // within the threshold of the patch's average
+    UINT nClusters = 0;
+    for( UINT iPatch = 0; iPatch < nFaces; )
+    {
+        UINT iPatchEnd = iPatch + 1;
+        UINT nPatchMisses = pMisses[iPatch];
+        while( iPatchEnd < nFaces && pMisses[iPatchEnd] < 3 )
+            nPatchMisses += pMisses[iPatchEnd++];
+        const float fPatchThreshold = fThreshold * nPatchMisses / ( iPatchEnd - iPatch );
+
+        UINT iFirst = iPatch;
+        UINT nRunMisses = 0;
+        nTime += nCacheSize + 1;
+        for( UINT f = iPatch; f < iPatchEnd; f++ )
+        {
+            for( UINT k = 0; k < 3; k++ )
+                nRunMisses += UpdateFIFO( pTimes, pIndices[3 * f + k] - iBase, nCacheSize, &nTime );
+
+            if( nRunMisses <= fPatchThreshold * ( f + 1 - iFirst ) || f + 1 == iPatchEnd )
+            {
+                pClusters[nClusters].iFirstFace = iFirst;
+                pClusters[nClusters].nFaces = f + 1 - iFirst;
+                nClusters++;
+
+                iFirst = f + 1;
+                nRunMisses = 0;
+                nTime += nCacheSize + 1;
+            }
+        }
+        iPatch = iPatchEnd;
+    }
+
+    SAFE_DELETE_ARRAY( pTimes );
+    SAFE_DELETE_ARRAY( pMisses );
+
+    // The middle of each cluster and of the mesh, weighting each face by its area, and the
+    // way each cluster faces
+    const BYTE* pPositions = ( const BYTE* )pVertices;
+    double afMeshSum[3] = { 0.0, 0.0, 0.0 };
+    double fMeshArea = 0.0;
+    for( UINT iCluster = 0; iCluster < nClusters; iCluster++ )
+    {
+        MESHOPT_CLUSTER& Cluster = pClusters[iCluster];
+        float afSum[3] = { 0.0f, 0.0f, 0.0f }, afNormal[3] = { 0.0f, 0.0f, 0.0f };
+        float fArea = 0.0f;
+        for( UINT f = Cluster.iFirstFace; f < Cluster.iFirstFace + Cluster.nFaces; f++ )
+        {
+            const float* p0 = ( const float* )( pPositions + pIndices[3 * f] * ( size_t )nStride );
+            const float* p1 = ( const float* )( pPositions + pIndices[3 * f + 1] * ( size_t )nStride );
+            const float* p2 = ( const float* )( pPositions + pIndices[3 * f + 2] * ( size_t )nStride );
+            const float e1[3] = { p1[0] - p0[0], p1[1] - p0[1], p1[2] - p0[2] };
+            const float e2[3] = { p2[0] - p0[0], p2[1] - p0[1], p2[2] - p0[2] };
+            const float n[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2],
+                                 e1[0] * e2[1] - e1[1] * e2[0] };
+            const float fFaceArea = sqrtf( n[0] * n[0] + n[1] * n[1] + n[2] * n[2] );
+            for( UINT k = 0; k < 3; k++ )
+            {
+                afSum[k] += ( p0[k] + p1[k] + p2[k] ) * fFaceArea;
+                afNormal[k] += n[k];
+            }
+            fArea += fFaceArea;
+        }
+
+        const float fNormal = sqrtf( afNormal[0] * afNormal[0] + afNormal[1] * afNormal[1] +
+                                     afNormal[2] * afNormal[2] );
+        for( UINT k = 0; k < 3; k++ )
+        {
+            afMeshSum[k] += afSum[k];
+            Cluster.afMiddle[k] = afSum[k] / MeshOptMax( 3.0f * fArea, FLT_MIN );
+            Cluster.afNormal[k] = fNormal > 0.0f ? afNormal[k] / fNormal : 0.0f;
+        }
+        fMeshArea += fArea;
+    }
+
+    float afMeshMiddle[3];
+    for( UINT k = 0; k < 3; k++ )
+        afMeshMiddle[k] = ( float )( afMeshSum[k] / MeshOptMax( 3.0 * fMeshArea, DBL_MIN ) );
+
+    for( UINT iCluster = 0; iCluster < nClusters; iCluster++ )
+    {
+        MESHOPT_CLUSTER& Cluster = pClusters[iCluster];
+        Cluster.fSortKey = 0.0f;
+        for( UINT k = 0; k < 3; k++ )
+            Cluster.fSortKey += ( Cluster.afMiddle[k] - afMeshMiddle[k] ) * Cluster.afNormal[k];
+    }
+    qsort( pClusters, nClusters, sizeof( MESHOPT_CLUSTER ), CompareClusters );
+
+    UINT nOutput = 0;
+    for( UINT iCluster = 0; iCluster < nClusters; iCluster++ )
+    {
+        const UINT nIndices = 3 * pClusters[iCluster].nFaces;
+        memcpy( pOutput + nOutput, pIndices + 3 * pClusters[iCluster].iFirstFace, nIndices * sizeof( DWORD ) );
+        nOutput += nIndices;
+    }
+    memcpy( pIndices, pOutput, 3 * nFaces * sizeof( DWORD ) );
+
+    SAFE_DELETE_ARRAY( pClusters );
+    SAFE_DELETE_ARRAY( pOutput );
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT MeshOptVertexFetch( DWORD* pIndices, UINT nFaces, UINT nVertices, DWORD* pRemap )
+{
+    for( UINT i = 0; i < 3 * nFaces; i++ )
+    {
+        if( pIndices[i] >= nVertices )
+            return E_INVALIDARG;
+    }
+
+    memset( pRemap, 0xFF, nVertices * sizeof( DWORD ) );
+    DWORD iNext = 0;
+    for( UINT i = 0; i < 3 * nFaces; i++ )
+    {
+        DWORD& iNew = pRemap[pIndices[i]];
+        if( MESHOPT_NONE == iNew )
+            iNew = iNext++;
+        pIndices[i] = iNew;
+    }
+    for( UINT v = 0; v < nVertices; v++ )
+    {
+        if( MESHOPT_NONE == pRemap[v] )
+            pRemap[v] = iNext++;
+    }
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT MeshOptRemapVertices( void* pVertices, UINT nStride, UINT nVertices, const DWORD* pRemap )
+{
+    BYTE* pOld = new BYTE[ nStride * ( size_t )nVertices ];
+    if( !pOld )
+        return E_OUTOFMEMORY;
+
+    memcpy( pOld, pVertices, nStride * ( size_t )nVertices );
+    for( UINT v = 0; v < nVertices; v++ )
+        memcpy( ( BYTE* )pVertices + pRemap[v] * ( size_t )nStride, pOld + v * ( size_t )nStride, nStride );
+
+    SAFE_DELETE_ARRAY( pOld );
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Finds a face among the pending ones with the edge a to b, and the vertex it has besides
+//--------------------------------------------------------------------------------------
+static UINT FindEdge( const DWORD* pIndices, const UINT* pPending, UINT nPending, DWORD a, DWORD b, DWORD* pc )
+{
+    for( UINT i = 0; i < nPending; i++ )
+    {
+        const DWORD* pFace = pIndices + 3 * pPending[i];
+        for( UINT k = 0; k < 3; k++ )
+        {
+            if( pFace[k] == a && pFace[( k + 1 ) % 3] == b )
+            {
+                *pc = pFace[( k + 2 ) % 3];
+                return i;
+            }
+        }
+    }
+
+    return MESHOPT_NONE;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT MeshOptStrips( const DWORD* pIndices, UINT nFaces, MESHOPT_STRIPS* pStrips )
+{
+    memset( pStrips, 0, sizeof( MESHOPT_STRIPS ) );
+    if( 0 == nFaces )
+        return S_OK;
+
+    // At most a strip for each face; joining them takes at most 3 more indices each
+    pStrips->pIndices = new DWORD[ 3 * nFaces ];
+    pStrips->pLengths = new UINT[ nFaces ];
+    if( !pStrips->pIndices || !pStrips->pLengths )
+    {
+        MeshOptFreeStrips( pStrips );
+        return E_OUTOFMEMORY;
+    }
+
+    // The faces ahead, in order
+    UINT aPending[MESHOPT_STRIP_WINDOW];
+    UINT nPending = 0;
+    UINT iNextFace = 0;
+
+    DWORD* pStrip = pStrips->pIndices;
+    UINT nStrip = 0;
+    for( ; ; )
+    {
+        while( nPending < MESHOPT_STRIP_WINDOW && iNextFace < nFaces )
+            aPending[nPending++] = iNextFace++;
+
+        // Carry the strip on.  Every other face of a strip is wound the other way, so the
+        // face to come after a and b needs the edge a to b if it is even and b to a if not.
+        UINT iFound = MESHOPT_NONE;
+        if( nStrip > 0 )
+        {
+            const DWORD a = pStrip[nStrip - 2], b = pStrip[nStrip - 1];
+            DWORD c;
+            iFound = ( nStrip & 1 ) ? FindEdge( pIndices, aPending, nPending, b, a, &c ) :
+                                      FindEdge( pIndices, aPending, nPending, a, b, &c );
+            if( MESHOPT_NONE != iFound )
+            {
+                pStrip[nStrip++] = c;
+            }
+            else
+            {
+                pStrips->pLengths[pStrips->nStrips++] = nStrip - 2;
+                pStrip += nStrip;
+                nStrip = 0;
+            }
+        }
+        if( 0 == nPending )
+            break;
+
+        // Start a new strip on the first face to come, turned so the next face along has
+        // an edge with it the strip can go on through if one does
+        if( 0 == nStrip )
+        {
+            iFound = 0;
+            const DWORD* pFace = pIndices + 3 * aPending[0];
+            UINT iFirst = 0;
+            for( UINT k = 0; k < 3; k++ )
+            {
+                DWORD c;
+                if( MESHOPT_NONE != FindEdge( pIndices, aPending + 1, nPending - 1, pFace[( k + 2 ) % 3],
+                                              pFace[( k + 1 ) % 3], &c ) )
+                {
+                    iFirst = k;
+                    break;
+                }
+            }
+            for( UINT k = 0; k < 3; k++ )
+                pStrip[nStrip++] = pFace[( iFirst + k ) % 3];
+        }
+
+        nPending--;
+        memmove( aPending + iFound, aPending + iFound + 1, ( nPending - iFound ) * sizeof( UINT ) );
+    }
+    pStrips->nIndices = ( UINT )( pStrip - pStrips->pIndices );
+
+    // Join the strips into one, repeating the last index of a strip and the first of the
+    // next, and the first again if that leaves the next starting on an odd face
+    pStrips->pSingle = new DWORD[ pStrips->nIndices + 3 * pStrips->nStrips ];
+    if( !pStrips->pSingle )
+    {
+        MeshOptFreeStrips( pStrips );
+        return E_OUTOFMEMORY;
+    }
+    const DWORD* pFrom = pStrips->pIndices;
+    for( UINT iStrip = 0; iStrip < pStrips->nStrips; iStrip++ )
+    {
+        const UINT nIndices = pStrips->pLengths[iStrip] + 2;
+        if( iStrip > 0 )
+        {
+            pStrips->pSingle[pStrips->nSingle] = pStrips->pSingle[pStrips->nSingle - 1];
+            pStrips->nSingle++;
+            pStrips->pSingle[pStrips->nSingle++] = pFrom[0];
+            if( pStrips->nSingle & 1 )
+                pStrips->pSingle[pStrips->nSingle++] = pFrom[0];
+        }
+        memcpy( pStrips->pSingle + pStrips->nSingle, pFrom, nIndices * sizeof( DWORD ) );
+        pStrips->nSingle += nIndices;
+        pFrom += nIndices;
+    }
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void MeshOptFreeStrips( MESHOPT_STRIPS* pStrips )
+{
+    SAFE_DELETE_ARRAY( pStrips->pIndices );
+    SAFE_DELETE_ARRAY( pStrips->pLengths );
+    SAFE_DELETE_ARRAY( pStrips->pSingle );
+    memset( pStrips, 0, sizeof( MESHOPT_STRIPS ) );
+}
+
+
+//--------------------------------------------------------------------------------------
+CMeshOptimizer::CMeshOptimizer()
+{
+    m_Job = MESHOPT_JOB_OPTIMIZE;
+    m_pIndices = NULL;
+    m_pVertices = NULL;
+    m_nStride = 0;
+    m_Cache.Type = MESHOPT_CACHE_FIFO;
+    m_Cache.nSize = 16;
+    m_dwFlags = 0;
+    m_pSubsets = NULL;
+    m_pOrder = NULL;
+    m_pStats = NULL;
+    m_pStrips = NULL;
+    m_hrJob = S_OK;
+    m_nThreads = 1;
+    m_fTime = 0.0;
+}
+
+
+//--------------------------------------------------------------------------------------
+CMeshOptimizer::~CMeshOptimizer()
+{
+    Destroy();
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CMeshOptimizer::Create( UINT nThreads )
+{
+    Destroy();
+
+    if( 0 == nThreads )
+        nThreads = CDXUTWorkerPool::GetNumProcessors();
+    nThreads = MeshOptMin( nThreads, ( UINT )MESHOPT_MAX_THREADS );
+    m_nThreads = MeshOptMin( nThreads, DXUTGetWorkerPool()->GetNumThreads() );
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CMeshOptimizer::Destroy()
+{
+    m_nThreads = 1;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CMeshOptimizer::Optimize( DWORD* pIndices, void* pVertices, UINT nStride, UINT nVertices,
+                                  const MESHOPT_SUBSET* pSubsets, UINT nSubsets, const MESHOPT_CACHE& Cache,
+                                  DWORD dwFlags, DWORD* pRemap )
+{
+    HRESULT hr;
+
+    if( ( dwFlags & MESHOPT_OVERDRAW ) && !pVertices )
+        return E_INVALIDARG;
+
+    double fStart = DXUTGetMilliseconds();
+
+    m_pIndices = pIndices;
+    m_pVertices = pVertices;
+    m_nStride = nStride;
+    m_Cache = Cache;
+    m_dwFlags = dwFlags;
+    hr = RunJob( MESHOPT_JOB_OPTIMIZE, pSubsets, nSubsets );
+    if( FAILED( hr ) )
+        return hr;
+
+    // Vertices are shared between subsets, so they are put in order for the whole mesh
+    if( dwFlags & MESHOPT_VERTEX_FETCH )
+    {
+        UINT nFaces = 0;
+        for( UINT i = 0; i < nSubsets; i++ )
+            nFaces = MeshOptMax( nFaces, pSubsets[i].iFirstFace + pSubsets[i].nFaces );
+
+        DWORD* pNewRemap = pRemap ? pRemap : new DWORD[ nVertices ];
+        if( !pNewRemap )
+            return E_OUTOFMEMORY;
+        hr = MeshOptVertexFetch( pIndices, nFaces, nVertices, pNewRemap );
+        if( SUCCEEDED( hr ) && pVertices )
+            hr = MeshOptRemapVertices( pVertices, nStride, nVertices, pNewRemap );
+        if( pNewRemap != pRemap )
+            SAFE_DELETE_ARRAY( pNewRemap );
+        if( FAILED( hr ) )
+            return hr;
+    }
+    else if( pRemap )
+    {
+        for( UINT v = 0; v < nVertices; v++ )
+            pRemap[v] = v;
+    }
+
+    m_fTime = DXUTGetMilliseconds() - fStart;
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CMeshOptimizer::MeasureCache( const DWORD* pIndices, const MESHOPT_SUBSET* pSubsets, UINT nSubsets,
+                                      const MESHOPT_CACHE& Cache, MESHOPT_STATS* pStats, MESHOPT_STATS* pTotal )
+{
+    HRESULT hr;
+
+    memset( pTotal, 0, sizeof( MESHOPT_STATS ) );
+    if( 0 == nSubsets )
+        return S_OK;
+
+    double fStart = DXUTGetMilliseconds();
+
+    m_pIndices = ( DWORD* )pIndices;
+    m_Cache = Cache;
+    m_pStats = pStats ? pStats : new MESHOPT_STATS[ nSubsets ];
+    if( !m_pStats )
+        return E_OUTOFMEMORY;
+
+    hr = RunJob( MESHOPT_JOB_MEASURE, pSubsets, nSubsets );
+    for( UINT i = 0; i < nSubsets && SUCCEEDED( hr ); i++ )
+    {
+        pTotal->nFaces += m_pStats[i].nFaces;
+        pTotal->nVertices += m_pStats[i].nVertices;
+        pTotal->nTransforms += m_pStats[i].nTransforms;
+    }
+
+    if( m_pStats != pStats )
+        SAFE_DELETE_ARRAY( m_pStats );
+    m_pStats = NULL;
+
+    m_fTime = DXUTGetMilliseconds() - fStart;
+
+    return hr;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CMeshOptimizer::Stripify( const DWORD* pIndices, const MESHOPT_SUBSET* pSubsets, UINT nSubsets,
+                                  MESHOPT_STRIPS* pStrips )
+{
+    HRESULT hr;
+
+    double fStart = DXUTGetMilliseconds();
+
+    memset( pStrips, 0, nSubsets * sizeof( MESHOPT_STRIPS ) );
+    m_pIndices = ( DWORD* )pIndices;
+    m_pStrips = pStrips;
+    hr = RunJob( MESHOPT_JOB_STRIPS, pSubsets, nSubsets );
+    m_pStrips = NULL;
+    if( FAILED( hr ) )
+    {
+        for( UINT i = 0; i < nSubsets; i++ )
+            MeshOptFreeStrips( pStrips + i );
+    }
+
+    m_fTime = DXUTGetMilliseconds() - fStart;
+
+    return hr;
+}
+
+
+//--------------------------------------------------------------------------------------
+static int CompareOrder( const void* pA, const void* pB )
+{
+    const ULONGLONG a = *( const ULONGLONG* )pA, b = *( const ULONGLONG* )pB;
+    return a < b ? -1 : ( a > b ? 1 : 0 );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Shares the subsets between this thread and the pool's workers, the largest first so one
+// large subset is not left to last
+//--------------------------------------------------------------------------------------
+HRESULT CMeshOptimizer::RunJob( MESHOPT_JOB Job, const MESHOPT_SUBSET* pSubsets, UINT nSubsets )
+{
+    if( 0 == nSubsets )
+        return S_OK;
+
+    // Faces in the high 32 bits, inverted so the largest sort first, and the subset below
+    ULONGLONG* pOrder = new ULONGLONG[ nSubsets ];
+    m_pOrder = new UINT[ nSubsets ];
+    if( !pOrder || !m_pOrder )
+    {
+        SAFE_DELETE_ARRAY( pOrder );
+        SAFE_DELETE_ARRAY( m_pOrder );
+        return E_OUTOFMEMORY;
+    }
+    for( UINT i = 0; i < nSubsets; i++ )
+        pOrder[i] = ( ( ULONGLONG )( ~pSubsets[i].nFaces ) << 32 ) | i;
+    qsort( pOrder, nSubsets, sizeof( ULONGLONG ), CompareOrder );
+    for( UINT i = 0; i < nSubsets; i++ )
+        m_pOrder[i] = ( UINT )pOrder[i];
+    SAFE_DELETE_ARRAY( pOrder );
+
+    m_Job = Job;
+    m_pSubsets = pSubsets;
+    m_hrJob = S_OK;
+    DXUTGetWorkerPool()->Run( ItemProc, this, nSubsets, m_nThreads );
+
+    SAFE_DELETE_ARRAY( m_pOrder );
+    m_pSubsets = NULL;
+    return m_hrJob;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CMeshOptimizer::ItemProc( void* pContext, UINT iItem, UINT )
+{
+    CMeshOptimizer* pThis = ( CMeshOptimizer* )pContext;
+
+    // Keep the first failure
+    HRESULT hr = pThis->RunItem( pThis->m_pOrder[iItem] );
+    HRESULT hrOK = S_OK;
+    if( FAILED( hr ) )
+        pThis->m_hrJob.compare_exchange_strong( hrOK, hr );
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CMeshOptimizer::RunItem( UINT iSubset )
+{
+    HRESULT hr = S_OK;
+
+    const MESHOPT_SUBSET& Subset = m_pSubsets[iSubset];
+    DWORD* pIndices = m_pIndices + 3 * ( size_t )Subset.iFirstFace;
+    switch( m_Job )
+    {
+        case MESHOPT_JOB_OPTIMIZE:
+            if( m_dwFlags & MESHOPT_VERTEX_CACHE )
+                hr = MeshOptVertexCache( pIndices, Subset.nFaces, m_Cache.nSize );
+            if( SUCCEEDED( hr ) && ( m_dwFlags & MESHOPT_OVERDRAW ) )
+                hr = MeshOptOverdraw( pIndices, Subset.nFaces, m_pVertices, m_nStride, m_Cache.nSize,
+                                      MESHOPT_OVERDRAW_THRESHOLD );
+            break;
+        case MESHOPT_JOB_MEASURE:
+            hr = MeshOptSimulateCache( pIndices, Subset.nFaces, m_Cache, m_pStats + iSubset );
+            break;
+        case MESHOPT_JOB_STRIPS:
+            hr = MeshOptStrips( pIndices, Subset.nFaces, m_pStrips + iSubset );
+            break;
+    }
+
+    return hr;
+}
@@ -0,0 +1,192 @@
+//--------------------------------------------------------------------------------------
+// File: MeshOptimizer.h
+//
+// A mesh optimizer that works on plain index and vertex arrays, so it can run where
+// D3DXMESHOPT and D3DXConvertMeshSubsetTo*Strip* can't and measure what they do:
+//
+// - Vertex cache order: Tom Forsyth's linear-speed vertex cache optimization.  Each
+//   vertex is scored on its place in a simulated LRU cache and on how many of its faces
+//   are still to go, and the best face around the cache is emitted next.
+// - Overdraw order: the faces, in vertex cache order, are cut into clusters where the
+//   cache starts over and again wherever the cache does no worse than a threshold over
+//   the cluster's own average, then the clusters are sorted to draw the ones that face
+//   out from the middle of the mesh first (Sander, Nehab and Barczak, "Fast Triangle
+//   Reordering for Vertex Locality and Reduced Overdraw").
+// - Vertex fetch order: vertices in the order the faces first use them.
+// - Strips: the faces are walked in order, taking next whichever of the few faces
+//   ahead carries on the strip, and the strips can be joined with degenerate faces.
+//
+// The cache can be measured as a FIFO, as most hardware has, or as an LRU, giving the
+// average cache miss ratio (ACMR, transforms a face) and the average transform to
+// vertex ratio (ATVR, transforms a vertex used, 1 at best).
+//
+// Each function works on one subset's faces and may be called on its own.
+// CMeshOptimizer runs them across the subsets of a mesh in parallel on the DXUT worker
+// pool.  Neither DXUT nor Direct3D is used, so content tools can build it on any
+// platform with the pool, e.g.
+//     g++ -O2 -std=c++11 -pthread -I../../DXUT/Optional -c MeshOptimizer.cpp
+//         ../../DXUT/Optional/DXUTWorkerPool.cpp
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#pragma once
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include "DXUTWorkerPool.h"
+
+#define MESHOPT_MAX_THREADS     32
+#define MESHOPT_MAX_CACHE_SIZE  64
+
+// What CMeshOptimizer::Optimize does
+#define MESHOPT_VERTEX_CACHE    0x00000001
+#define MESHOPT_OVERDRAW        0x00000002
+#define MESHOPT_VERTEX_FETCH    0x00000004
+#define MESHOPT_ALL             0x00000007
+
+enum MESHOPT_CACHE_TYPE
+{
+    MESHOPT_CACHE_FIFO = 0,
+    MESHOPT_CACHE_LRU,
+};
+
+// A post-transform vertex cache, to optimize for or measure
+struct MESHOPT_CACHE
+{
+    MESHOPT_CACHE_TYPE Type;
+    UINT nSize;                 // Vertices it holds, 3 to MESHOPT_MAX_CACHE_SIZE
+};
+
+// What drawing some faces through a cache costs
+struct MESHOPT_STATS
+{
+    UINT nFaces;
+    UINT nVertices;             // Vertices the faces use
+    UINT nTransforms;           // Cache misses
+
+    float GetACMR() const
+    {
+        return nFaces ? ( float )nTransforms / nFaces : 0.0f;
+    }
+    float GetATVR() const
+    {
+        return nVertices ? ( float )nTransforms / nVertices : 0.0f;
+    }
+};
+
+// Faces drawn together, as a D3DXATTRIBUTERANGE gives them
+struct MESHOPT_SUBSET
+{
+    UINT iFirstFace;
+    UINT nFaces;
+};
+
+// Strips for one subset.  pIndices holds the strips one after the other and pLengths the
+// faces of each, as D3DXConvertMeshSubsetToStrips gives them; pSingle holds them joined
+// into a single strip with degenerate faces, as D3DXConvertMeshSubsetToSingleStrip does.
+struct MESHOPT_STRIPS
+{
+    DWORD* pIndices;
+    UINT nIndices;
+    UINT* pLengths;
+    UINT nStrips;
+    DWORD* pSingle;
+    UINT nSingle;
+};
+
+// Faces are 3 indices each.  Only the subset's faces are touched; the indices may be of
+// any vertices of the mesh.
+HRESULT MeshOptSimulateCache( const DWORD* pIndices, UINT nFaces, const MESHOPT_CACHE& Cache,
+                              MESHOPT_STATS* pStats );
+HRESULT MeshOptVertexCache( DWORD* pIndices, UINT nFaces, UINT nCacheSize );
+
+// Positions are the first 3 floats of each vertex.  fThreshold is how much worse than a
+// cluster's own average the cache may do at the end of a cluster, 1.05 being typical.
+HRESULT MeshOptOverdraw( DWORD* pIndices, UINT nFaces, const void* pVertices, UINT nStride,
+                         UINT nCacheSize, float fThreshold );
+
+// Fills pRemap with the new index of each vertex, those the faces use first, in the
+// order they use them, then the rest in their old order, and renumbers the faces.
+// MeshOptRemapVertices moves the vertices to their new places.
+HRESULT MeshOptVertexFetch( DWORD* pIndices, UINT nFaces, UINT nVertices, DWORD* pRemap );
+HRESULT MeshOptRemapVertices( void* pVertices, UINT nStride, UINT nVertices, const DWORD* pRemap );
+
+// Allocates the strips with new[]; MeshOptFreeStrips frees them
+HRESULT MeshOptStrips( const DWORD* pIndices, UINT nFaces, MESHOPT_STRIPS* pStrips );
+void MeshOptFreeStrips( MESHOPT_STRIPS* pStrips );
+
+
+//--------------------------------------------------------------------------------------
+class CMeshOptimizer
+{
+public:
+                        CMeshOptimizer();
+                        ~CMeshOptimizer();
+
+    // nThreads 0 uses a thread for each processor
+    HRESULT             Create( UINT nThreads = 0 );
+    void                Destroy();
+
+    // Reorders the faces of each subset for the vertex cache and then for overdraw, and
+    // then the vertices of the mesh for fetching, as dwFlags asks.  pVertices are only
+    // needed for overdraw, which reads them, and vertex fetch, which moves them; pRemap,
+    // which may be NULL, gets the new index of each vertex.  Subsets stay where they are.
+    HRESULT             Optimize( DWORD* pIndices, void* pVertices, UINT nStride, UINT nVertices,
+                                  const MESHOPT_SUBSET* pSubsets, UINT nSubsets, const MESHOPT_CACHE& Cache,
+                                  DWORD dwFlags, DWORD* pRemap = NULL );
+
+    // Measures each subset, the cache starting empty for each, into pStats, which may be
+    // NULL, and all of them into pTotal
+    HRESULT             MeasureCache( const DWORD* pIndices, const MESHOPT_SUBSET* pSubsets, UINT nSubsets,
+                                      const MESHOPT_CACHE& Cache, MESHOPT_STATS* pStats, MESHOPT_STATS* pTotal );
+
+    // Builds the strips of each subset into pStrips, one for each subset
+    HRESULT             Stripify( const DWORD* pIndices, const MESHOPT_SUBSET* pSubsets, UINT nSubsets,
+                                  MESHOPT_STRIPS* pStrips );
+
+    UINT                GetNumThreads() const
+    {
+        return m_nThreads;
+    }
+
+    // Milliseconds the last call took
+    double              GetTime() const
+    {
+        return m_fTime;
+    }
+
+protected:
+    enum MESHOPT_JOB
+    {
+        MESHOPT_JOB_OPTIMIZE = 0,
+        MESHOPT_JOB_MEASURE,
+        MESHOPT_JOB_STRIPS,
+    };
+
+    static void         ItemProc( void* pContext, UINT iItem, UINT iThread );
+
+    HRESULT             RunJob( MESHOPT_JOB Job, const MESHOPT_SUBSET* pSubsets, UINT nSubsets );
+    HRESULT             RunItem( UINT iSubset );
+
+    // The arguments of the job being run.  The subsets are taken largest first.
+    MESHOPT_JOB         m_Job;
+    DWORD*              m_pIndices;
+    const void*         m_pVertices;
+    UINT                m_nStride;
+    MESHOPT_CACHE       m_Cache;
+    DWORD               m_dwFlags;
+    const MESHOPT_SUBSET* m_pSubsets;
+    UINT*               m_pOrder;
+    MESHOPT_STATS*      m_pStats;
+    MESHOPT_STRIPS*     m_pStrips;
+    std::atomic <HRESULT> m_hrJob;
+
+    // Jobs run on the DXUT worker pool, on up to m_nThreads threads counting the one
+    // calling each method
+    UINT                m_nThreads;
+
+    double              m_fTime;
+};
+
+#endif
@@ -9,6 +9,7 @@
 #include "DXUTsettingsdlg.h"
 #include "SDKmisc.h"
 #include "resource.h"
+#include "MeshOptimizer.h"
 
 //#define DEBUG_VS   // Uncomment this line to debug vertex shaders 
 //#define DEBUG_PS   // Uncomment this line to debug pixel shaders 
@@ -44,11 +45,14 @@ struct SMeshData
     SStripData* m_rgStripData;      // strip indices split by attribute
     DWORD m_cStripDatas;
 
+    MESHOPT_STATS m_CacheStats;     // of the triangle lists through g_Cache
+
             SMeshData() : m_pMeshSysMem( NULL ),
                           m_pMesh( NULL ),
                           m_pVertexBuffer( NULL ),
                           m_rgStripData( NULL ),
-                          m_cStripDatas( 0 )
+                          m_cStripDatas( 0 ),
+                          m_CacheStats()
             {
             }
 
@@ -92,6 +96,7 @@ CD3DSettingsDlg             g_SettingsDlg;          // Device settings dialog
 CDXUTDialog                 g_HUD;                  // dialog for standard controls
 CDXUTDialog                 g_SampleUI;             // dialog for sample specific controls
 bool                        g_bShowVertexCacheOptimized = true;
+bool                        g_bShowNativeOptimized = false;
 bool                        g_bShowStripReordered = false;
 bool                        g_bShowStrips = false;
 bool                        g_bShowSingleStrip = false;
@@ -106,6 +111,10 @@ DWORD                       g_dwMemoryOptions = D3DXMESH_MANAGED;
 SMeshData                   g_MeshAttrSorted;
 SMeshData                   g_MeshStripReordered;
 SMeshData                   g_MeshVertexCacheOptimized;
+SMeshData                   g_MeshNativeOptimized;
+
+CMeshOptimizer              g_MeshOptimizer;        // Native optimizer, for g_MeshNativeOptimized
+MESHOPT_CACHE               g_Cache = { MESHOPT_CACHE_FIFO, 16 };  // Cache to optimize for and measure
 
 DWORD                       g_dwNumMaterials = 0;   // Number of materials
 IDirect3DTexture9**         g_ppMeshTextures = NULL;
@@ -121,6 +130,7 @@ D3DMATERIAL9*               g_pMeshMaterials = NULL;
 #define IDC_MESHTYPE            5
 #define IDC_GRIDSIZE            6
 #define IDC_PRIMTYPE            7
+#define IDC_CACHE               8
 
 
 //--------------------------------------------------------------------------------------
@@ -151,6 +161,9 @@ HRESULT OptimizeMeshData( LPD3DXMESH pMeshSysMem, LPD3DXBUFFER pAdjacencyBuffer,
                           SMeshData* pMeshData );
 HRESULT UpdateLocalMeshes( IDirect3DDevice9* pd3dDevice, SMeshData* pMeshData );
 HRESULT DrawMeshData( ID3DXEffect* pEffect, SMeshData* pMeshData );
+HRESULT NativeOptimizeMeshData( LPD3DXMESH pMeshSysMem, SMeshData* pMeshData );
+HRESULT MeasureMeshData( SMeshData* pMeshData );
+INT RunMeshBenchmark( int nArgs, LPWSTR* pstrArgs );
 
 
 //--------------------------------------------------------------------------------------
@@ -164,6 +177,23 @@ INT WINAPI wWinMain( HINSTANCE, HINSTANCE, LPWSTR, int )
     _CrtSetDbgFlag( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );
 #endif
 
+    // -meshbench runs the native optimizer over the sample meshes without a window
+    int nArgs = 0;
+    LPWSTR* pstrArgs = CommandLineToArgvW( GetCommandLineW(), &nArgs );
+    if( pstrArgs )
+    {
+        for( int i = 1; i < nArgs; i++ )
+        {
+            if( 0 == _wcsicmp( pstrArgs[i], L"-meshbench" ) )
+            {
+                INT nResult = RunMeshBenchmark( nArgs - i - 1, pstrArgs + i + 1 );
+                LocalFree( pstrArgs );
+                return nResult;
+            }
+        }
+        LocalFree( pstrArgs );
+    }
+
     // Set the callback functions. These functions allow DXUT to notify
     // the application about device changes, user input, and windows messages.  The 
     // callbacks are optional so you need only set callbacks for events you're interested 
@@ -187,6 +217,7 @@ INT WINAPI wWinMain( HINSTANCE, HINSTANCE, LPWSTR, int )
     DXUTSetCursorSettings( true, true );
 
     InitApp();
+    g_MeshOptimizer.Create();
 
     // Initialize DXUT and create the desired Win32 window and Direct3D 
     // device for the application. Calling each of these functions is optional, but they
@@ -226,6 +257,7 @@ void InitApp()
     g_SampleUI.SetCallback( OnGUIEvent ); iY = 10;
     g_SampleUI.AddComboBox( IDC_MESHTYPE, 0, iY, 200, 20, L'M' );
     g_SampleUI.GetComboBox( IDC_MESHTYPE )->AddItem( L"(M)esh type: VCache optimized", ( void* )0 );
+    g_SampleUI.GetComboBox( IDC_MESHTYPE )->AddItem( L"(M)esh type: Native optimized", ( void* )3 );
     g_SampleUI.GetComboBox( IDC_MESHTYPE )->AddItem( L"(M)esh type: Strip reordered", ( void* )1 );
     g_SampleUI.GetComboBox( IDC_MESHTYPE )->AddItem( L"(M)esh type: Unoptimized", ( void* )2 );
     g_SampleUI.AddComboBox( IDC_PRIMTYPE, 0, iY += 24, 200, 20, L'P' );
@@ -239,6 +271,11 @@ void InitApp()
     g_SampleUI.GetComboBox( IDC_GRIDSIZE )->AddItem( L"(G)rid size: 16 mesh", ( void* )4 );
     g_SampleUI.GetComboBox( IDC_GRIDSIZE )->AddItem( L"(G)rid size: 25 mesh", ( void* )5 );
     g_SampleUI.GetComboBox( IDC_GRIDSIZE )->AddItem( L"(G)rid size: 36 mesh", ( void* )6 );
+    g_SampleUI.AddComboBox( IDC_CACHE, 0, iY += 24, 200, 20, L'C' );
+    g_SampleUI.GetComboBox( IDC_CACHE )->AddItem( L"(C)ache: FIFO 16", ( void* )( ( MESHOPT_CACHE_FIFO << 8 ) | 16 ) );
+    g_SampleUI.GetComboBox( IDC_CACHE )->AddItem( L"(C)ache: FIFO 32", ( void* )( ( MESHOPT_CACHE_FIFO << 8 ) | 32 ) );
+    g_SampleUI.GetComboBox( IDC_CACHE )->AddItem( L"(C)ache: LRU 16", ( void* )( ( MESHOPT_CACHE_LRU << 8 ) | 16 ) );
+    g_SampleUI.GetComboBox( IDC_CACHE )->AddItem( L"(C)ache: LRU 32", ( void* )( ( MESHOPT_CACHE_LRU << 8 ) | 32 ) );
 
     g_Camera.SetButtonMasks( MOUSE_LEFT_BUTTON, MOUSE_WHEEL, 0 );
 }
@@ -518,6 +555,255 @@ End:
 }
 
 
+//--------------------------------------------------------------------------------------
+// Copies the faces of a mesh out as 32 bit indices, with a subset for each of its
+// attribute ranges.  The caller deletes the arrays.
+//--------------------------------------------------------------------------------------
+HRESULT GetMeshFaces( LPD3DXMESH pMesh, DWORD** ppIndices, D3DXATTRIBUTERANGE** ppAttribs,
+                      MESHOPT_SUBSET** ppSubsets, DWORD* pcSubsets )
+{
+    HRESULT hr;
+    const DWORD cFaces = pMesh->GetNumFaces();
+    const bool b32Bit = ( pMesh->GetOptions() & D3DXMESH_32BIT ) != 0;
+
+    *ppIndices = NULL;
+    *ppAttribs = NULL;
+    *ppSubsets = NULL;
+    *pcSubsets = 0;
+
+    // A mesh that has not been attribute sorted is drawn as one subset
+    DWORD cAttribs = 0;
+    V_RETURN( pMesh->GetAttributeTable( NULL, &cAttribs ) );
+    *ppIndices = new DWORD[ 3 * cFaces ];
+    *ppAttribs = new D3DXATTRIBUTERANGE[ max( cAttribs, 1 ) ];
+    *ppSubsets = new MESHOPT_SUBSET[ max( cAttribs, 1 ) ];
+    if( *ppIndices == NULL || *ppAttribs == NULL || *ppSubsets == NULL )
+    {
+        hr = E_OUTOFMEMORY;
+        goto End;
+    }
+    if( cAttribs > 0 )
+    {
+        hr = pMesh->GetAttributeTable( *ppAttribs, &cAttribs );
+        if( FAILED( hr ) )
+            goto End;
+    }
+    else
+    {
+        ( *ppAttribs )->AttribId = 0;
+        ( *ppAttribs )->FaceStart = 0;
+        ( *ppAttribs )->FaceCount = cFaces;
+        ( *ppAttribs )->VertexStart = 0;
+        ( *ppAttribs )->VertexCount = pMesh->GetNumVertices();
+        cAttribs = 1;
+    }
+    for( DWORD iAttrib = 0; iAttrib < cAttribs; iAttrib++ )
+    {
+        ( *ppSubsets )[iAttrib].iFirstFace = ( *ppAttribs )[iAttrib].FaceStart;
+        ( *ppSubsets )[iAttrib].nFaces = ( *ppAttribs )[iAttrib].FaceCount;
+    }
+
+    void* pMeshIndices;
+    hr = pMesh->LockIndexBuffer( D3DLOCK_READONLY, &pMeshIndices );
+    if( FAILED( hr ) )
+        goto End;
+    for( DWORD i = 0; i < 3 * cFaces; i++ )
+        ( *ppIndices )[i] = b32Bit ? ( ( DWORD* )pMeshIndices )[i] : ( ( WORD* )pMeshIndices )[i];
+    pMesh->UnlockIndexBuffer();
+
+    *pcSubsets = cAttribs;
+
+End:
+    if( FAILED( hr ) )
+    {
+        SAFE_DELETE_ARRAY( *ppIndices );
+        SAFE_DELETE_ARRAY( *ppAttribs );
+        SAFE_DELETE_ARRAY( *ppSubsets );
+    }
+
+    return hr;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Makes a managed index buffer of strip indices, 16 or 32 bit
+//--------------------------------------------------------------------------------------
+HRESULT CreateStripBuffer( IDirect3DDevice9* pd3dDevice, const DWORD* pIndices, UINT cIndices, bool b32Bit,
+                           LPDIRECT3DINDEXBUFFER9* ppIndexBuffer )
+{
+    HRESULT hr;
+    void* pData;
+
+    V_RETURN( pd3dDevice->CreateIndexBuffer( cIndices * ( b32Bit ? sizeof( DWORD ) : sizeof( WORD ) ),
+                                             D3DUSAGE_WRITEONLY, b32Bit ? D3DFMT_INDEX32 : D3DFMT_INDEX16,
+                                             D3DPOOL_MANAGED, ppIndexBuffer, NULL ) );
+    V_RETURN( ( *ppIndexBuffer )->Lock( 0, 0, &pData, 0 ) );
+    for( UINT i = 0; i < cIndices; i++ )
+    {
+        if( b32Bit )
+            ( ( DWORD* )pData )[i] = pIndices[i];
+        else
+            ( ( WORD* )pData )[i] = ( WORD )pIndices[i];
+    }
+    ( *ppIndexBuffer )->Unlock();
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// The native counterpart of OptimizeMeshData: reorders a copy of an attribute sorted
+// mesh with CMeshOptimizer for the vertex cache, overdraw and vertex fetch, and strips it
+//--------------------------------------------------------------------------------------
+HRESULT NativeOptimizeMeshData( LPD3DXMESH pMeshSysMem, SMeshData* pMeshData )
+{
+    HRESULT hr = S_OK;
+    IDirect3DDevice9* pd3dDevice = NULL;
+    DWORD* pIndices = NULL;
+    D3DXATTRIBUTERANGE* pAttribs = NULL;
+    MESHOPT_SUBSET* pSubsets = NULL;
+    MESHOPT_STRIPS* pStrips = NULL;
+    DWORD cSubsets = 0;
+    LPD3DXMESH pMesh;
+    void* pVertices;
+    void* pMeshIndices;
+    D3DCAPS9 d3dCaps;
+    bool b32Bit;
+
+    pMeshSysMem->GetDevice( &pd3dDevice );
+    pd3dDevice->GetDeviceCaps( &d3dCaps );
+
+    hr = pMeshSysMem->CloneMeshFVF( pMeshSysMem->GetOptions() | D3DXMESH_SYSTEMMEM, pMeshSysMem->GetFVF(),
+                                    pd3dDevice, &pMeshData->m_pMeshSysMem );
+    if( FAILED( hr ) )
+        goto End;
+    pMesh = pMeshData->m_pMeshSysMem;
+    b32Bit = ( pMesh->GetOptions() & D3DXMESH_32BIT ) != 0;
+
+    hr = GetMeshFaces( pMesh, &pIndices, &pAttribs, &pSubsets, &cSubsets );
+    if( FAILED( hr ) )
+        goto End;
+
+    // Faces stay in their subsets, so the attribute buffer still holds
+    hr = pMesh->LockVertexBuffer( 0, &pVertices );
+    if( FAILED( hr ) )
+        goto End;
+    hr = g_MeshOptimizer.Optimize( pIndices, pVertices, pMesh->GetNumBytesPerVertex(), pMesh->GetNumVertices(),
+                                   pSubsets, cSubsets, g_Cache, MESHOPT_ALL );
+    pMesh->UnlockVertexBuffer();
+    if( FAILED( hr ) )
+        goto End;
+
+    hr = pMesh->LockIndexBuffer( 0, &pMeshIndices );
+    if( FAILED( hr ) )
+        goto End;
+    for( DWORD i = 0; i < 3 * pMesh->GetNumFaces(); i++ )
+    {
+        if( b32Bit )
+            ( ( DWORD* )pMeshIndices )[i] = pIndices[i];
+        else
+            ( ( WORD* )pMeshIndices )[i] = ( WORD )pIndices[i];
+    }
+    pMesh->UnlockIndexBuffer();
+
+    // The vertices of each subset have moved
+    for( DWORD iSubset = 0; iSubset < cSubsets; iSubset++ )
+    {
+        DWORD iMin = pMesh->GetNumVertices(), iMax = 0;
+        const DWORD* pFace = pIndices + 3 * pAttribs[iSubset].FaceStart;
+        for( DWORD i = 0; i < 3 * pAttribs[iSubset].FaceCount; i++ )
+        {
+            iMin = min( iMin, pFace[i] );
+            iMax = max( iMax, pFace[i] );
+        }
+        pAttribs[iSubset].VertexStart = pAttribs[iSubset].FaceCount ? iMin : 0;
+        pAttribs[iSubset].VertexCount = pAttribs[iSubset].FaceCount ? iMax - iMin + 1 : 0;
+    }
+    hr = pMesh->SetAttributeTable( pAttribs, cSubsets );
+    if( FAILED( hr ) )
+        goto End;
+
+    // Strips, in place of D3DXConvertMeshSubsetToSingleStrip and D3DXConvertMeshSubsetToStrips
+    pStrips = new MESHOPT_STRIPS[ cSubsets ];
+    pMeshData->m_cStripDatas = g_dwNumMaterials;
+    pMeshData->m_rgStripData = new SStripData[ pMeshData->m_cStripDatas ];
+    if( pStrips == NULL || pMeshData->m_rgStripData == NULL )
+    {
+        hr = E_OUTOFMEMORY;
+        goto End;
+    }
+    hr = g_MeshOptimizer.Stripify( pIndices, pSubsets, cSubsets, pStrips );
+    if( FAILED( hr ) )
+    {
+        SAFE_DELETE_ARRAY( pStrips );
+        goto End;
+    }
+
+    for( DWORD iSubset = 0; iSubset < cSubsets && SUCCEEDED( hr ); iSubset++ )
+    {
+        const MESHOPT_STRIPS& Strips = pStrips[iSubset];
+        if( pAttribs[iSubset].AttribId >= pMeshData->m_cStripDatas || 0 == Strips.nStrips )
+            continue;
+        SStripData& StripData = pMeshData->m_rgStripData[pAttribs[iSubset].AttribId];
+
+        hr = CreateStripBuffer( pd3dDevice, Strips.pSingle, Strips.nSingle, b32Bit, &StripData.m_pStrips );
+        if( SUCCEEDED( hr ) )
+            hr = CreateStripBuffer( pd3dDevice, Strips.pIndices, Strips.nIndices, b32Bit, &StripData.m_pStripsMany );
+        StripData.m_cStripIndices = Strips.nSingle;
+        StripData.m_cStrips = Strips.nStrips;
+        StripData.m_rgcStripLengths = new DWORD[ Strips.nStrips ];
+        if( StripData.m_rgcStripLengths == NULL )
+        {
+            hr = E_OUTOFMEMORY;
+            break;
+        }
+        for( DWORD iStrip = 0; iStrip < Strips.nStrips; iStrip++ )
+            StripData.m_rgcStripLengths[iStrip] = Strips.pLengths[iStrip];
+
+        if( Strips.nSingle - 2 > d3dCaps.MaxPrimitiveCount )
+            g_bCantDoSingleStrip = true;
+    }
+
+    for( DWORD iSubset = 0; iSubset < cSubsets; iSubset++ )
+        MeshOptFreeStrips( pStrips + iSubset );
+
+End:
+    SAFE_DELETE_ARRAY( pIndices );
+    SAFE_DELETE_ARRAY( pAttribs );
+    SAFE_DELETE_ARRAY( pSubsets );
+    SAFE_DELETE_ARRAY( pStrips );
+    SAFE_RELEASE( pd3dDevice );
+
+    return hr;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Measures the triangle lists of a mesh through g_Cache
+//--------------------------------------------------------------------------------------
+HRESULT MeasureMeshData( SMeshData* pMeshData )
+{
+    HRESULT hr;
+    DWORD* pIndices;
+    D3DXATTRIBUTERANGE* pAttribs;
+    MESHOPT_SUBSET* pSubsets;
+    DWORD cSubsets;
+
+    ZeroMemory( &pMeshData->m_CacheStats, sizeof( MESHOPT_STATS ) );
+    if( pMeshData->m_pMeshSysMem == NULL )
+        return S_OK;
+
+    V_RETURN( GetMeshFaces( pMeshData->m_pMeshSysMem, &pIndices, &pAttribs, &pSubsets, &cSubsets ) );
+    hr = g_MeshOptimizer.MeasureCache( pIndices, pSubsets, cSubsets, g_Cache, NULL, &pMeshData->m_CacheStats );
+
+    SAFE_DELETE_ARRAY( pIndices );
+    SAFE_DELETE_ARRAY( pAttribs );
+    SAFE_DELETE_ARRAY( pSubsets );
+
+    return hr;
+}
+
+
 HRESULT UpdateLocalMeshes( IDirect3DDevice9* pd3dDevice, SMeshData* pMeshData )
 {
     HRESULT hr = S_OK;
@@ -579,7 +865,7 @@ HRESULT DrawMeshData( IDirect3DDevice9* pd3dDevice, ID3DXEffect* pEffect, SMeshD
 
                 if( g_bShowSingleStrip )
                 {
-                    if( !g_bCantDoSingleStrip )
+                    if( !g_bCantDoSingleStrip && pMeshData->m_rgStripData[iMaterial].m_pStrips )
                     {
                         V( pd3dDevice->SetIndices( pMeshData->m_rgStripData[iMaterial].m_pStrips ) );
 
@@ -589,7 +875,7 @@ HRESULT DrawMeshData( IDirect3DDevice9* pd3dDevice, ID3DXEffect* pEffect, SMeshD
                                                              2 ) );
                     }
                 }
-                else
+                else if( pMeshData->m_rgStripData[iMaterial].m_pStripsMany )
                 {
                     V( pd3dDevice->SetIndices( pMeshData->m_rgStripData[iMaterial].m_pStripsMany ) );
 
@@ -694,6 +980,14 @@ HRESULT CALLBACK OnCreateDevice( IDirect3DDevice9* pd3dDevice, const D3DSURFACE_
             hr = OptimizeMeshData( pMeshSysMem, pAdjacencyBuffer,
                                    D3DXMESHOPT_VERTEXCACHE, &g_MeshVertexCacheOptimized );
 
+        if( SUCCEEDED( hr ) )
+            hr = NativeOptimizeMeshData( g_MeshAttrSorted.m_pMeshSysMem, &g_MeshNativeOptimized );
+
+        MeasureMeshData( &g_MeshAttrSorted );
+        MeasureMeshData( &g_MeshStripReordered );
+        MeasureMeshData( &g_MeshVertexCacheOptimized );
+        MeasureMeshData( &g_MeshNativeOptimized );
+
         SAFE_RELEASE( pMeshSysMem );
         SAFE_RELEASE( pAdjacencyBuffer );
     }
@@ -746,6 +1040,7 @@ HRESULT CALLBACK OnResetDevice( IDirect3DDevice9* pd3dDevice,
     UpdateLocalMeshes( pd3dDevice, &g_MeshAttrSorted );
     UpdateLocalMeshes( pd3dDevice, &g_MeshStripReordered );
     UpdateLocalMeshes( pd3dDevice, &g_MeshVertexCacheOptimized );
+    UpdateLocalMeshes( pd3dDevice, &g_MeshNativeOptimized );
 
     g_HUD.SetLocation( pBackBufferSurfaceDesc->Width - 170, 0 );
     g_HUD.SetSize( 170, 170 );
@@ -823,6 +1118,8 @@ void CALLBACK OnFrameRender( IDirect3DDevice9* pd3dDevice, double fTime, float f
 
                 if( g_bShowVertexCacheOptimized )
                     DrawMeshData( pd3dDevice, g_pEffect, &g_MeshVertexCacheOptimized );
+                else if( g_bShowNativeOptimized )
+                    DrawMeshData( pd3dDevice, g_pEffect, &g_MeshNativeOptimized );
                 else if( g_bShowStripReordered )
                     DrawMeshData( pd3dDevice, g_pEffect, &g_MeshStripReordered );
                 else
@@ -866,10 +1163,22 @@ void RenderText()
 
     float fTrisPerSec = DXUTGetFPS() * cTriangles;
 
+    SMeshData* pMeshData = &g_MeshAttrSorted;
     if( g_bShowVertexCacheOptimized )
+    {
         wszOptString = L"VCache Optimized";
+        pMeshData = &g_MeshVertexCacheOptimized;
+    }
+    else if( g_bShowNativeOptimized )
+    {
+        wszOptString = L"Native Optimized";
+        pMeshData = &g_MeshNativeOptimized;
+    }
     else if( g_bShowStripReordered )
+    {
         wszOptString = L"Strip Reordered";
+        pMeshData = &g_MeshStripReordered;
+    }
     else
         wszOptString = L"Unoptimized";
 
@@ -881,6 +1190,11 @@ void RenderText()
     txtHelper.DrawTextLine( DXUTGetDeviceStats() );
     txtHelper.DrawFormattedTextLine( L"%s, %ld tris per sec, %ld triangles",
                                      wszOptString, ( DWORD )fTrisPerSec, cTriangles );
+    txtHelper.DrawFormattedTextLine( L"%s %u cache: ACMR %.3f, ATVR %.3f (unoptimized %.3f, %.3f)",
+                                     g_Cache.Type == MESHOPT_CACHE_FIFO ? L"FIFO" : L"LRU", g_Cache.nSize,
+                                     pMeshData->m_CacheStats.GetACMR(), pMeshData->m_CacheStats.GetATVR(),
+                                     g_MeshAttrSorted.m_CacheStats.GetACMR(),
+                                     g_MeshAttrSorted.m_CacheStats.GetATVR() );
 
     if( g_bShowSingleStrip && g_bCantDoSingleStrip )
         txtHelper.DrawTextLine( L"Couldn't draw to single strip -- too many primitives" );
@@ -979,14 +1293,22 @@ void CALLBACK OnGUIEvent( UINT nEvent, int nControlID, CDXUTControl* pControl, v
             {
                 case 0:
                     g_bShowVertexCacheOptimized = true;
+                    g_bShowNativeOptimized = false;
                     g_bShowStripReordered = false;
                     break;
                 case 1:
                     g_bShowVertexCacheOptimized = false;
+                    g_bShowNativeOptimized = false;
                     g_bShowStripReordered = true;
                     break;
                 case 2:
                     g_bShowVertexCacheOptimized = false;
+                    g_bShowNativeOptimized = false;
+                    g_bShowStripReordered = false;
+                    break;
+                case 3:
+                    g_bShowVertexCacheOptimized = false;
+                    g_bShowNativeOptimized = true;
                     g_bShowStripReordered = false;
                     break;
             }
@@ -1013,6 +1335,25 @@ void CALLBACK OnGUIEvent( UINT nEvent, int nControlID, CDXUTControl* pControl, v
         case IDC_GRIDSIZE:
             g_cObjectsPerSide = ( int )( size_t )( ( CDXUTComboBox* )pControl )->GetSelectedData();
             break;
+
+        case IDC_CACHE:
+        {
+            // Optimize for the new cache and measure everything through it
+            size_t nCache = ( size_t )( ( CDXUTComboBox* )pControl )->GetSelectedData();
+            g_Cache.Type = ( MESHOPT_CACHE_TYPE )( nCache >> 8 );
+            g_Cache.nSize = ( UINT )( nCache & 0xFF );
+
+            g_MeshNativeOptimized.ReleaseAll();
+            if( g_MeshAttrSorted.m_pMeshSysMem != NULL &&
+                SUCCEEDED( NativeOptimizeMeshData( g_MeshAttrSorted.m_pMeshSysMem, &g_MeshNativeOptimized ) ) )
+                UpdateLocalMeshes( DXUTGetD3D9Device(), &g_MeshNativeOptimized );
+
+            MeasureMeshData( &g_MeshAttrSorted );
+            MeasureMeshData( &g_MeshStripReordered );
+            MeasureMeshData( &g_MeshVertexCacheOptimized );
+            MeasureMeshData( &g_MeshNativeOptimized );
+            break;
+        }
     }
 }
 
@@ -1037,6 +1378,7 @@ void CALLBACK OnLostDevice( void* pUserContext )
     g_MeshAttrSorted.ReleaseLocalMeshes();
     g_MeshStripReordered.ReleaseLocalMeshes();
     g_MeshVertexCacheOptimized.ReleaseLocalMeshes();
+    g_MeshNativeOptimized.ReleaseLocalMeshes();
 }
 
 
@@ -1062,9 +1404,541 @@ void CALLBACK OnDestroyDevice( void* pUserContext )
     g_MeshAttrSorted.ReleaseAll();
     g_MeshStripReordered.ReleaseAll();
     g_MeshVertexCacheOptimized.ReleaseAll();
+    g_MeshNativeOptimized.ReleaseAll();
 
     g_dwNumMaterials = 0;
 }
 
 
+//--------------------------------------------------------------------------------------
+// -meshbench
+//--------------------------------------------------------------------------------------
+struct SBenchMesh
+{
+    WCHAR strName[MAX_PATH];
+    DWORD* pIndices;
+    BYTE* pVertices;
+    UINT nStride;
+    UINT nVertices;
+    UINT nFaces;
+    MESHOPT_SUBSET* pSubsets;
+    UINT nSubsets;
+
+    // D3DXMESHOPT_VERTEXCACHE on the same mesh, through the same cache, if it was loaded
+    bool bD3DX;
+    MESHOPT_STATS D3DXStats;
+    double fD3DXTime;
+};
+
+
+//--------------------------------------------------------------------------------------
+void FreeBenchMesh( SBenchMesh* pMesh )
+{
+    SAFE_DELETE_ARRAY( pMesh->pIndices );
+    SAFE_DELETE_ARRAY( pMesh->pVertices );
+    SAFE_DELETE_ARRAY( pMesh->pSubsets );
+}
+
+
+//--------------------------------------------------------------------------------------
+// A device for D3DX to load meshes with; nothing is drawn
+//--------------------------------------------------------------------------------------
+IDirect3DDevice9* CreateNullDevice()
+{
+    IDirect3D9* pD3D = Direct3DCreate9( D3D_SDK_VERSION );
+    if( NULL == pD3D )
+        return NULL;
+
+    D3DDISPLAYMODE Mode;
+    pD3D->GetAdapterDisplayMode( 0, &Mode );
+
+    D3DPRESENT_PARAMETERS pp;
+    ZeroMemory( &pp, sizeof( D3DPRESENT_PARAMETERS ) );
+    pp.BackBufferWidth = 1;
+    pp.BackBufferHeight = 1;
+    pp.BackBufferFormat = Mode.Format;
+    pp.BackBufferCount = 1;
+    pp.SwapEffect = D3DSWAPEFFECT_COPY;
+    pp.Windowed = TRUE;
+
+    IDirect3DDevice9* pd3dDevice = NULL;
+    HRESULT hr = pD3D->CreateDevice( D3DADAPTER_DEFAULT, D3DDEVTYPE_NULLREF, GetConsoleWindow(),
+                                     D3DCREATE_HARDWARE_VERTEXPROCESSING, &pp, &pd3dDevice );
+    SAFE_RELEASE( pD3D );
+    if( FAILED( hr ) )
+        return NULL;
+
+    return pd3dDevice;
+}
+
 
+//--------------------------------------------------------------------------------------
+// Loads a mesh and attribute sorts it as OnCreateDevice does, then times D3DX's vertex
+// cache optimization of it
+//--------------------------------------------------------------------------------------
+HRESULT LoadBenchMesh( IDirect3DDevice9* pd3dDevice, LPCWSTR wszMeshFile, const MESHOPT_CACHE& Cache,
+                       SBenchMesh* pMesh )
+{
+    HRESULT hr;
+    WCHAR strMesh[MAX_PATH];
+    LPD3DXMESH pMeshSysMem = NULL;
+    LPD3DXMESH pMeshD3DX = NULL;
+    LPD3DXBUFFER pAdjacencyBuffer = NULL;
+    D3DXATTRIBUTERANGE* pAttribs = NULL;
+    DWORD* pAdjacency = NULL;
+    DWORD* pD3DXIndices = NULL;
+    MESHOPT_SUBSET* pD3DXSubsets = NULL;
+    DWORD cSubsets;
+    void* pVertices;
+    LARGE_INTEGER nFreq, nStart, nEnd;
+
+    ZeroMemory( pMesh, sizeof( SBenchMesh ) );
+    LPCWSTR strName = wcsrchr( wszMeshFile, L'\\' );
+    wcscpy_s( pMesh->strName, MAX_PATH, strName ? strName + 1 : wszMeshFile );
+
+    if( FAILED( hr = DXUTFindDXSDKMediaFileCch( strMesh, MAX_PATH, wszMeshFile ) ) )
+        goto End;
+    hr = D3DXLoadMeshFromX( strMesh, D3DXMESH_SYSTEMMEM | D3DXMESH_32BIT, pd3dDevice, &pAdjacencyBuffer,
+                            NULL, NULL, NULL, &pMeshSysMem );
+    if( FAILED( hr ) )
+        goto End;
+
+    pAdjacency = new DWORD[ 3 * pMeshSysMem->GetNumFaces() ];
+    if( pAdjacency == NULL )
+    {
+        hr = E_OUTOFMEMORY;
+        goto End;
+    }
+    hr = pMeshSysMem->OptimizeInplace( D3DXMESHOPT_ATTRSORT, ( DWORD* )pAdjacencyBuffer->GetBufferPointer(),
+                                       pAdjacency, NULL, NULL );
+    if( FAILED( hr ) )
+        goto End;
+
+    hr = GetMeshFaces( pMeshSysMem, &pMesh->pIndices, &pAttribs, &pMesh->pSubsets, &cSubsets );
+    if( FAILED( hr ) )
+        goto End;
+    pMesh->nSubsets = cSubsets;
+    pMesh->nFaces = pMeshSysMem->GetNumFaces();
+    pMesh->nVertices = pMeshSysMem->GetNumVertices();
+    pMesh->nStride = pMeshSysMem->GetNumBytesPerVertex();
+    pMesh->pVertices = new BYTE[ pMesh->nVertices * pMesh->nStride ];
+    if( pMesh->pVertices == NULL )
+    {
+        hr = E_OUTOFMEMORY;
+        goto End;
+    }
+    hr = pMeshSysMem->LockVertexBuffer( D3DLOCK_READONLY, &pVertices );
+    if( FAILED( hr ) )
+        goto End;
+    memcpy( pMesh->pVertices, pVertices, pMesh->nVertices * pMesh->nStride );
+    pMeshSysMem->UnlockVertexBuffer();
+
+    // D3DX, for the cache as a whole rather than any one device's
+    hr = pMeshSysMem->CloneMeshFVF( pMeshSysMem->GetOptions(), pMeshSysMem->GetFVF(), pd3dDevice, &pMeshD3DX );
+    if( FAILED( hr ) )
+        goto End;
+    QueryPerformanceFrequency( &nFreq );
+    QueryPerformanceCounter( &nStart );
+    hr = pMeshD3DX->OptimizeInplace( D3DXMESHOPT_VERTEXCACHE | D3DXMESHOPT_DEVICEINDEPENDENT, pAdjacency,
+                                     NULL, NULL, NULL );
+    QueryPerformanceCounter( &nEnd );
+    if( FAILED( hr ) )
+        goto End;
+    pMesh->fD3DXTime = 1000.0 * ( nEnd.QuadPart - nStart.QuadPart ) / nFreq.QuadPart;
+
+    SAFE_DELETE_ARRAY( pAttribs );
+    hr = GetMeshFaces( pMeshD3DX, &pD3DXIndices, &pAttribs, &pD3DXSubsets, &cSubsets );
+    if( FAILED( hr ) )
+        goto End;
+    for( DWORD iSubset = 0; iSubset < cSubsets; iSubset++ )
+    {
+        MESHOPT_STATS Stats;
+        MeshOptSimulateCache( pD3DXIndices + 3 * pD3DXSubsets[iSubset].iFirstFace, pD3DXSubsets[iSubset].nFaces,
+                              Cache, &Stats );
+        pMesh->D3DXStats.nFaces += Stats.nFaces;
+        pMesh->D3DXStats.nVertices += Stats.nVertices;
+        pMesh->D3DXStats.nTransforms += Stats.nTransforms;
+    }
+    pMesh->bD3DX = true;
+
+End:
+    if( FAILED( hr ) )
+        FreeBenchMesh( pMesh );
+    SAFE_DELETE_ARRAY( pAdjacency );
+    SAFE_DELETE_ARRAY( pAttribs );
+    SAFE_DELETE_ARRAY( pD3DXIndices );
+    SAFE_DELETE_ARRAY( pD3DXSubsets );
+    SAFE_RELEASE( pAdjacencyBuffer );
+    SAFE_RELEASE( pMeshD3DX );
+    SAFE_RELEASE( pMeshSysMem );
+
+    return hr;
+}
+
+
+//--------------------------------------------------------------------------------------
+// A sphere of about nFaces faces in 16 subsets, with the faces of each subset and the
+// vertices shuffled, as a mesh that has never been optimized
+//--------------------------------------------------------------------------------------
+HRESULT MakeBenchSphere( UINT nFaces, SBenchMesh* pMesh )
+{
+    ZeroMemory( pMesh, sizeof( SBenchMesh ) );
+    swprintf_s( pMesh->strName, MAX_PATH, L"sphere" );
+
+    // Rings of slices vertices, leaving the poles open so no face is degenerate
+    const UINT nStacks = __max( ( UINT )sqrtf( nFaces / 4.0f ), 4u );
+    const UINT nSlices = 2 * nStacks;
+    pMesh->nFaces = 2 * nSlices * nStacks;
+    pMesh->nVertices = ( nStacks + 1 ) * nSlices;
+    pMesh->nStride = 3 * sizeof( float );
+    pMesh->nSubsets = 16;
+    pMesh->pIndices = new DWORD[ 3 * pMesh->nFaces ];
+    pMesh->pVertices = new BYTE[ pMesh->nVertices * pMesh->nStride ];
+    pMesh->pSubsets = new MESHOPT_SUBSET[ pMesh->nSubsets ];
+    DWORD* pShuffle = new DWORD[ pMesh->nVertices ];
+    if( pMesh->pIndices == NULL || pMesh->pVertices == NULL || pMesh->pSubsets == NULL || pShuffle == NULL )
+    {
+        FreeBenchMesh( pMesh );
+        SAFE_DELETE_ARRAY( pShuffle );
+        return E_OUTOFMEMORY;
+    }
+
+    UINT nSeed = 12345;
+    for( UINT i = 0; i < pMesh->nVertices; i++ )
+        pShuffle[i] = i;
+    for( UINT i = pMesh->nVertices - 1; i > 0; i-- )
+    {
+        nSeed = nSeed * 1664525 + 1013904223;
+        UINT j = ( UINT )( ( ( ULONGLONG )nSeed * ( i + 1 ) ) >> 32 );
+        DWORD dwSwap = pShuffle[i];
+        pShuffle[i] = pShuffle[j];
+        pShuffle[j] = dwSwap;
+    }
+
+    float* pPositions = ( float* )pMesh->pVertices;
+    for( UINT iStack = 0; iStack <= nStacks; iStack++ )
+    {
+        float fTheta = D3DX_PI * ( iStack + 1 ) / ( nStacks + 2 );
+        for( UINT iSlice = 0; iSlice < nSlices; iSlice++ )
+        {
+            float fPhi = 2.0f * D3DX_PI * iSlice / nSlices;
+            float* pPosition = pPositions + 3 * pShuffle[iStack * nSlices + iSlice];
+            pPosition[0] = sinf( fTheta ) * cosf( fPhi );
+            pPosition[1] = cosf( fTheta );
+            pPosition[2] = sinf( fTheta ) * sinf( fPhi );
+        }
+    }
+
+    DWORD* pFace = pMesh->pIndices;
+    for( UINT iStack = 0; iStack < nStacks; iStack++ )
+    {
+        for( UINT iSlice = 0; iSlice < nSlices; iSlice++ )
+        {
+            DWORD i0 = pShuffle[iStack * nSlices + iSlice];
+            DWORD i1 = pShuffle[iStack * nSlices + ( iSlice + 1 ) % nSlices];
+            DWORD i2 = pShuffle[( iStack + 1 ) * nSlices + iSlice];
+            DWORD i3 = pShuffle[( iStack + 1 ) * nSlices + ( iSlice + 1 ) % nSlices];
+            pFace[0] = i0; pFace[1] = i1; pFace[2] = i2;
+            pFace[3] = i1; pFace[4] = i3; pFace[5] = i2;
+            pFace += 6;
+        }
+    }
+    SAFE_DELETE_ARRAY( pShuffle );
+
+    for( UINT iSubset = 0; iSubset < pMesh->nSubsets; iSubset++ )
+    {
+        MESHOPT_SUBSET& Subset = pMesh->pSubsets[iSubset];
+        Subset.iFirstFace = ( UINT )( ( ULONGLONG )pMesh->nFaces * iSubset / pMesh->nSubsets );
+        Subset.nFaces = ( UINT )( ( ULONGLONG )pMesh->nFaces * ( iSubset + 1 ) / pMesh->nSubsets ) - Subset.iFirstFace;
+
+        DWORD* pSubsetFaces = pMesh->pIndices + 3 * Subset.iFirstFace;
+        for( UINT i = Subset.nFaces - 1; i > 0; i-- )
+        {
+            nSeed = nSeed * 1664525 + 1013904223;
+            UINT j = ( UINT )( ( ( ULONGLONG )nSeed * ( i + 1 ) ) >> 32 );
+            for( UINT k = 0; k < 3; k++ )
+            {
+                DWORD dwSwap = pSubsetFaces[3 * i + k];
+                pSubsetFaces[3 * i + k] = pSubsetFaces[3 * j + k];
+                pSubsetFaces[3 * j + k] = dwSwap;
+            }
+        }
+    }
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// A hash of a set of faces that does not depend on their order or on which of its
+// vertices each face starts at.  Degenerate faces are left out, as strips add them.
+//--------------------------------------------------------------------------------------
+ULONGLONG HashFace( DWORD i0, DWORD i1, DWORD i2 )
+{
+    if( i0 == i1 || i1 == i2 || i2 == i0 )
+        return 0;
+
+    // Start at the smallest index, keeping the winding
+    while( i0 > i1 || i0 > i2 )
+    {
+        DWORD dwFirst = i0;
+        i0 = i1;
+        i1 = i2;
+        i2 = dwFirst;
+    }
+
+    ULONGLONG h = ( ( ULONGLONG )i0 * 0x9E3779B1 ) ^ ( ( ULONGLONG )i1 << 21 ) ^ ( ( ULONGLONG )i2 << 42 );
+    h ^= h >> 31;
+    h *= 0x7FB5D329728EA185ULL;
+    h ^= h >> 27;
+    h *= 0x81DADEF4BC2DD44DULL;
+    return h ^ ( h >> 33 );
+}
+
+ULONGLONG HashFaces( const DWORD* pIndices, UINT nFaces, const DWORD* pRemap )
+{
+    ULONGLONG nHash = 0;
+    for( UINT iFace = 0; iFace < nFaces; iFace++ )
+    {
+        const DWORD* pFace = pIndices + 3 * iFace;
+        if( pRemap )
+            nHash += HashFace( pRemap[pFace[0]], pRemap[pFace[1]], pRemap[pFace[2]] );
+        else
+            nHash += HashFace( pFace[0], pFace[1], pFace[2] );
+    }
+    return nHash;
+}
+
+ULONGLONG HashStrip( const DWORD* pStrip, UINT nFaces )
+{
+    ULONGLONG nHash = 0;
+    for( UINT iFace = 0; iFace < nFaces; iFace++ )
+    {
+        // Every other face of a strip is wound the other way
+        if( iFace & 1 )
+            nHash += HashFace( pStrip[iFace + 1], pStrip[iFace], pStrip[iFace + 2] );
+        else
+            nHash += HashFace( pStrip[iFace], pStrip[iFace + 1], pStrip[iFace + 2] );
+    }
+    return nHash;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Optimizes and strips a mesh on each number of threads, checking that every result
+// holds the faces it started with
+//--------------------------------------------------------------------------------------
+INT BenchMesh( const SBenchMesh& Mesh, const MESHOPT_CACHE& Cache, const UINT* pThreads, UINT nThreadCounts )
+{
+    INT nResult = 0;
+    MESHOPT_STATS Before, After;
+    double fOneThreadTime = 0.0;
+    DWORD* pIndices = new DWORD[ 3 * Mesh.nFaces ];
+    BYTE* pVertices = new BYTE[ Mesh.nVertices * Mesh.nStride ];
+    DWORD* pRemap = new DWORD[ Mesh.nVertices ];
+    MESHOPT_STATS* pStats = new MESHOPT_STATS[ Mesh.nSubsets ];
+    MESHOPT_STRIPS* pStrips = new MESHOPT_STRIPS[ Mesh.nSubsets ];
+    if( pIndices == NULL || pVertices == NULL || pRemap == NULL || pStats == NULL || pStrips == NULL )
+    {
+        wprintf( L"Out of memory\n" );
+        nResult = 1;
+        goto End;
+    }
+
+    for( UINT iThreads = 0; iThreads < nThreadCounts && 0 == nResult; iThreads++ )
+    {
+        CMeshOptimizer Optimizer;
+        if( FAILED( Optimizer.Create( pThreads[iThreads] ) ) )
+        {
+            wprintf( L"Can't start %u threads\n", pThreads[iThreads] );
+            nResult = 1;
+            break;
+        }
+
+        memcpy( pIndices, Mesh.pIndices, 3 * Mesh.nFaces * sizeof( DWORD ) );
+        memcpy( pVertices, Mesh.pVertices, Mesh.nVertices * Mesh.nStride );
+        if( 0 == iThreads )
+            Optimizer.MeasureCache( pIndices, Mesh.pSubsets, Mesh.nSubsets, Cache, NULL, &Before );
+
+        if( FAILED( Optimizer.Optimize( pIndices, pVertices, Mesh.nStride, Mesh.nVertices, Mesh.pSubsets,
+                                        Mesh.nSubsets, Cache, MESHOPT_ALL, pRemap ) ) )
+        {
+            wprintf( L"%s: Optimize failed\n", Mesh.strName );
+            nResult = 1;
+            break;
+        }
+        double fTime = Optimizer.GetTime();
+        if( 0 == iThreads )
+            fOneThreadTime = fTime;
+        Optimizer.MeasureCache( pIndices, Mesh.pSubsets, Mesh.nSubsets, Cache, pStats, &After );
+
+        if( FAILED( Optimizer.Stripify( pIndices, Mesh.pSubsets, Mesh.nSubsets, pStrips ) ) )
+        {
+            wprintf( L"%s: Stripify failed\n", Mesh.strName );
+            nResult = 1;
+            break;
+        }
+        double fStripTime = Optimizer.GetTime();
+
+        // Each subset keeps its faces, the vertices go where pRemap says and the strips,
+        // separate or joined, draw the faces of their subset
+        UINT nStripIndices = 0;
+        for( UINT iSubset = 0; iSubset < Mesh.nSubsets; iSubset++ )
+        {
+            const MESHOPT_SUBSET& Subset = Mesh.pSubsets[iSubset];
+            const MESHOPT_STRIPS& Strips = pStrips[iSubset];
+            ULONGLONG nHash = HashFaces( Mesh.pIndices + 3 * Subset.iFirstFace, Subset.nFaces, pRemap );
+            bool bFaces = nHash == HashFaces( pIndices + 3 * Subset.iFirstFace, Subset.nFaces, NULL );
+
+            ULONGLONG nStripsHash = 0;
+            UINT iIndex = 0;
+            for( UINT iStrip = 0; iStrip < Strips.nStrips; iStrip++ )
+            {
+                nStripsHash += HashStrip( Strips.pIndices + iIndex, Strips.pLengths[iStrip] );
+                iIndex += Strips.pLengths[iStrip] + 2;
+            }
+            bool bStrips = iIndex == Strips.nIndices && nStripsHash == nHash;
+            bool bSingle = Strips.nSingle < 3 ? Strips.nStrips == 0 :
+                           HashStrip( Strips.pSingle, Strips.nSingle - 2 ) == nHash;
+            if( !bFaces || !bStrips || !bSingle )
+            {
+                wprintf( L"%s: subset %u lost faces in the%s%s%s\n", Mesh.strName, iSubset,
+                         bFaces ? L"" : L" optimized list", bStrips ? L"" : L" strips",
+                         bSingle ? L"" : L" single strip" );
+                nResult = 1;
+            }
+            nStripIndices += Strips.nIndices;
+            MeshOptFreeStrips( pStrips + iSubset );
+        }
+        for( UINT iVertex = 0; iVertex < Mesh.nVertices; iVertex++ )
+        {
+            if( pRemap[iVertex] >= Mesh.nVertices ||
+                0 != memcmp( pVertices + pRemap[iVertex] * Mesh.nStride, Mesh.pVertices + iVertex * Mesh.nStride,
+                             Mesh.nStride ) )
+            {
+                wprintf( L"%s: vertex %u was not moved where it was remapped to\n", Mesh.strName, iVertex );
+                nResult = 1;
+                break;
+            }
+        }
+
+        wprintf( L"%-12s %8u %7u %7.3f %7.3f %7.3f %7.3f %10.1f %7.2fx %9.1f %8.2f\n", Mesh.strName, Mesh.nFaces,
+                 Optimizer.GetNumThreads(), Before.GetACMR(), After.GetACMR(), Before.GetATVR(), After.GetATVR(),
+                 fTime, fOneThreadTime / __max( fTime, 1e-3 ), fStripTime,
+                 Mesh.nFaces ? ( float )nStripIndices / Mesh.nFaces : 0.0f );
+    }
+
+    if( Mesh.bD3DX && 0 == nResult )
+        wprintf( L"%-12s %8u %7s %7s %7.3f %7s %7.3f %10.1f   (D3DXMESHOPT_VERTEXCACHE)\n", Mesh.strName, Mesh.nFaces,
+                 L"D3DX", L"", Mesh.D3DXStats.GetACMR(), L"", Mesh.D3DXStats.GetATVR(), Mesh.fD3DXTime );
+
+End:
+    SAFE_DELETE_ARRAY( pIndices );
+    SAFE_DELETE_ARRAY( pVertices );
+    SAFE_DELETE_ARRAY( pRemap );
+    SAFE_DELETE_ARRAY( pStats );
+    SAFE_DELETE_ARRAY( pStrips );
+
+    return nResult;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Optimizes the sample meshes, or those given with -mesh, and spheres of 65536 faces up
+// to -faces with CMeshOptimizer on 1, 2, 4 and so on up to -threads threads, printing
+// the cache before and after, the times and the strips.  Returns 1 if any result does
+// not hold the faces it started with.
+//
+//  -meshbench [-mesh file]... [-cache fifo|lru] [-cachesize n] [-threads n] [-faces n]
+//--------------------------------------------------------------------------------------
+INT RunMeshBenchmark( int nArgs, LPWSTR* pstrArgs )
+{
+    // Report to the console we were started from, if any
+    if( AttachConsole( ATTACH_PARENT_PROCESS ) )
+    {
+        FILE* pFile;
+        freopen_s( &pFile, "CONOUT$", "w", stdout );
+    }
+
+    static LPCWSTR s_astrSampleMeshes[] =
+    {
+        MESHFILENAME, L"misc\\car.x", L"misc\\heli.x", L"misc\\bigship1.x", L"tiny\\tiny.x",
+    };
+    LPCWSTR astrMeshes[16];
+    UINT nMeshes = 0;
+    MESHOPT_CACHE Cache = g_Cache;
+    UINT nMaxThreads = 0;
+    UINT nMaxFaces = 1048576;
+
+    for( int i = 0; i < nArgs; i++ )
+    {
+        if( 0 == _wcsicmp( pstrArgs[i], L"-mesh" ) && i + 1 < nArgs && nMeshes < ARRAYSIZE( astrMeshes ) )
+            astrMeshes[nMeshes++] = pstrArgs[++i];
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-cache" ) && i + 1 < nArgs )
+            Cache.Type = 0 == _wcsicmp( pstrArgs[++i], L"lru" ) ? MESHOPT_CACHE_LRU : MESHOPT_CACHE_FIFO;
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-cachesize" ) && i + 1 < nArgs )
+            Cache.nSize = __min( __max( ( UINT )_wtoi( pstrArgs[++i] ), 3u ), ( UINT )MESHOPT_MAX_CACHE_SIZE );
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-threads" ) && i + 1 < nArgs )
+            nMaxThreads = ( UINT )_wtoi( pstrArgs[++i] );
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-faces" ) && i + 1 < nArgs )
+            nMaxFaces = ( UINT )_wtoi( pstrArgs[++i] );
+    }
+    if( 0 == nMeshes )
+    {
+        for( nMeshes = 0; nMeshes < ARRAYSIZE( s_astrSampleMeshes ); nMeshes++ )
+            astrMeshes[nMeshes] = s_astrSampleMeshes[nMeshes];
+    }
+    if( 0 == nMaxThreads )
+    {
+        SYSTEM_INFO SystemInfo;
+        GetSystemInfo( &SystemInfo );
+        nMaxThreads = SystemInfo.dwNumberOfProcessors;
+    }
+    nMaxThreads = __min( nMaxThreads, ( UINT )MESHOPT_MAX_THREADS );
+
+    UINT aThreads[MESHOPT_MAX_THREADS];
+    UINT nThreadCounts = 0;
+    for( UINT n = 1; n < nMaxThreads; n *= 2 )
+        aThreads[nThreadCounts++] = n;
+    aThreads[nThreadCounts++] = nMaxThreads;
+
+    INT nResult = 0;
+    wprintf( L"%s %u cache\n\n", Cache.Type == MESHOPT_CACHE_FIFO ? L"FIFO" : L"LRU", Cache.nSize );
+    wprintf( L"%-12s %8s %7s %7s %7s %7s %7s %10s %8s %9s %8s\n", L"mesh", L"faces", L"threads", L"ACMR", L"->",
+             L"ATVR", L"->", L"opt ms", L"speedup", L"strip ms", L"idx/face" );
+
+    // The sample meshes, through D3DX as the sample loads them
+    IDirect3DDevice9* pd3dDevice = CreateNullDevice();
+    if( pd3dDevice == NULL )
+        wprintf( L"Can't create a NULLREF device, so only spheres are measured\n" );
+    for( UINT iMesh = 0; iMesh < nMeshes && pd3dDevice && 0 == nResult; iMesh++ )
+    {
+        SBenchMesh Mesh;
+        if( FAILED( LoadBenchMesh( pd3dDevice, astrMeshes[iMesh], Cache, &Mesh ) ) )
+        {
+            wprintf( L"Can't load %s\n", astrMeshes[iMesh] );
+            continue;
+        }
+        nResult = BenchMesh( Mesh, Cache, aThreads, nThreadCounts );
+        FreeBenchMesh( &Mesh );
+    }
+    SAFE_RELEASE( pd3dDevice );
+
+    for( UINT nFaces = __min( 65536u, nMaxFaces ); nFaces <= nMaxFaces && 0 == nResult; nFaces *= 4 )
+    {
+        SBenchMesh Mesh;
+        if( FAILED( MakeBenchSphere( nFaces, &Mesh ) ) )
+        {
+            wprintf( L"Out of memory\n" );
+            nResult = 1;
+            break;
+        }
+        nResult = BenchMesh( Mesh, Cache, aThreads, nThreadCounts );
+        FreeBenchMesh( &Mesh );
+
+        if( nFaces > 0xFFFFFFFF / 4 )
+            break;
+    }
+
+    return nResult;
+}
@@ -1,7 +1,8 @@
 //----------------------------------------------------------------------------
 // File: Config.cpp
 //
-// Desc: 
+// Desc: The default options and the MSXML loader.  Options files are read and written
+//       by OptionsFile.cpp.
 //
 // Copyright (c) Microsoft Corporation.
 // Licensed under the MIT License (MIT).
@@ -10,10 +11,37 @@
 #include <msxml.h>
 #include <oleauto.h>
 #include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
 #include <conio.h>
 #include "config.h"
 
 
+//--------------------------------------------------------------------------------------
+class CXMLHelper
+{
+public:
+    static void     CreateNewValue( IXMLDOMDocument* pDoc, IXMLDOMNode* pNode, WCHAR* strName, WCHAR* strValue );
+    static void     CreateNewValue( IXMLDOMDocument* pDoc, IXMLDOMNode* pNode, WCHAR* strName, DWORD nValue );
+    static void     CreateNewValue( IXMLDOMDocument* pDoc, IXMLDOMNode* pNode, WCHAR* strName, float fValue );
+    static void     CreateChildNode( IXMLDOMDocument* pDoc, IXMLDOMNode* pParentNode, WCHAR* strName, int nType,
+                                     IXMLDOMNode** ppNewNode );
+
+    static void     GetValue( IXMLDOMNode*& pNode, WCHAR* strName, WCHAR* strValue, int cchValue );
+    static void     GetValue( IXMLDOMNode*& pNode, WCHAR* strName, int* pnValue );
+    static void     GetValue( IXMLDOMNode*& pNode, WCHAR* strName, bool* pbValue );
+    static void     GetValue( IXMLDOMNode*& pNode, WCHAR* strName, float* pfValue );
+    static void     GetValue( IXMLDOMNode*& pNode, WCHAR* strName, D3DXCOLOR* pclrValue );
+    static void     GetValue( IXMLDOMNode*& pNode, WCHAR* strName, DWORD* pdwValue );
+    static HRESULT  GetChild( IXMLDOMNode*& pNode, WCHAR* strName );
+    static void     GetParent( IXMLDOMNode*& pNode );
+    static void     GetSibling( IXMLDOMNode*& pNode );
+    static void     GetParentSibling( IXMLDOMNode*& pNode );
+    static void     SkipCommentNodes( IXMLDOMNode*& pNode );
+    static DWORD    GetNumberOfChildren( IXMLDOMNode* pNode, WCHAR* strName );
+};
+
+
 //--------------------------------------------------------------------------------------
 // Struct to store material params
 //--------------------------------------------------------------------------------------
@@ -69,141 +97,9 @@ const int g_aPredefinedMaterialsSize = sizeof( g_aPredefinedMaterials ) / sizeof
 
 
 //--------------------------------------------------------------------------------------
-COptionsFile::COptionsFile()
-{
-}
-
-
-//--------------------------------------------------------------------------------------
-COptionsFile::~COptionsFile()
-{
-}
-
-
-//--------------------------------------------------------------------------------------
-HRESULT COptionsFile::SaveOptions( WCHAR* strFile, SIMULATOR_OPTIONS* pOptions )
-{
-    HRESULT hr = S_OK;
-    IXMLDOMDocument* pDoc = NULL;
-
-    CoInitialize( NULL );
-
-    // Create an empty XML document
-    V_RETURN( CoCreateInstance( CLSID_DOMDocument, NULL,
-                                CLSCTX_INPROC_SERVER, IID_IXMLDOMDocument,
-                                ( void** )&pDoc ) );
-
-    IXMLDOMNode* pRootNode = NULL, *pTopNode = NULL;
-    IXMLDOMNode* pMTNode = NULL, *pGlobalsNode = NULL, *pMeshNode = NULL;
-    IXMLDOMNode* pCompressionNode = NULL, *pMeshArrayNode = NULL, *pOutputNode = NULL, *pSHMaterialNode = NULL;
-    pDoc->QueryInterface( IID_IXMLDOMNode, ( VOID** )&pRootNode );
-    CXMLHelper::CreateChildNode( pDoc, pRootNode, L"Options", NODE_ELEMENT, &pTopNode );
-
-    CXMLHelper::CreateChildNode( pDoc, pTopNode, L"Input", NODE_ELEMENT, &pMeshArrayNode );
-    for( DWORD iMesh = 0; iMesh < pOptions->dwNumMeshes; iMesh++ )
-    {
-        INPUT_MESH* pInputMesh = &pOptions->pInputMeshes[iMesh];
-
-        CXMLHelper::CreateChildNode( pDoc, pMeshArrayNode, L"Mesh", NODE_ELEMENT, &pMeshNode );
-        CXMLHelper::CreateNewValue( pDoc, pMeshNode, L"MeshFile", pInputMesh->strMeshFile );
-        CXMLHelper::CreateNewValue( pDoc, pMeshNode, L"IsBlockerMesh", ( DWORD )pInputMesh->bIsBlockerMesh );
-        CXMLHelper::CreateNewValue( pDoc, pMeshNode, L"Translate.x", pInputMesh->vTranslate.x );
-        CXMLHelper::CreateNewValue( pDoc, pMeshNode, L"Translate.y", pInputMesh->vTranslate.y );
-        CXMLHelper::CreateNewValue( pDoc, pMeshNode, L"Translate.z", pInputMesh->vTranslate.z );
-        CXMLHelper::CreateNewValue( pDoc, pMeshNode, L"Scale.x", pInputMesh->vScale.x );
-        CXMLHelper::CreateNewValue( pDoc, pMeshNode, L"Scale.y", pInputMesh->vScale.y );
-        CXMLHelper::CreateNewValue( pDoc, pMeshNode, L"Scale.z", pInputMesh->vScale.z );
-        CXMLHelper::CreateNewValue( pDoc, pMeshNode, L"Yaw", pInputMesh->fYaw );
-        CXMLHelper::CreateNewValue( pDoc, pMeshNode, L"Pitch", pInputMesh->fPitch );
-        CXMLHelper::CreateNewValue( pDoc, pMeshNode, L"Roll", pInputMesh->fRoll );
-
-        for( DWORD iSH = 0; iSH < pInputMesh->dwNumSHMaterials; iSH++ )
-        {
-            CXMLHelper::CreateChildNode( pDoc, pMeshNode, L"SHMaterial", NODE_ELEMENT, &pSHMaterialNode );
-            CXMLHelper::CreateNewValue( pDoc, pSHMaterialNode, L"Diffuse.r", pInputMesh->pSHMaterials[iSH].Diffuse.r );
-            CXMLHelper::CreateNewValue( pDoc, pSHMaterialNode, L"Diffuse.g", pInputMesh->pSHMaterials[iSH].Diffuse.g );
-            CXMLHelper::CreateNewValue( pDoc, pSHMaterialNode, L"Diffuse.b", pInputMesh->pSHMaterials[iSH].Diffuse.b );
-            CXMLHelper::CreateNewValue( pDoc, pSHMaterialNode, L"Absorption.r",
-                                        pInputMesh->pSHMaterials[iSH].Absorption.r );
-            CXMLHelper::CreateNewValue( pDoc, pSHMaterialNode, L"Absorption.g",
-                                        pInputMesh->pSHMaterials[iSH].Absorption.g );
-            CXMLHelper::CreateNewValue( pDoc, pSHMaterialNode, L"Absorption.b",
-                                        pInputMesh->pSHMaterials[iSH].Absorption.b );
-            CXMLHelper::CreateNewValue( pDoc, pSHMaterialNode, L"EnableSubsurfaceScattering",
-                                        ( DWORD )pInputMesh->pSHMaterials[iSH].bSubSurf );
-            CXMLHelper::CreateNewValue( pDoc, pSHMaterialNode, L"RelativeIndexOfRefraction",
-                                        pInputMesh->pSHMaterials[iSH].RelativeIndexOfRefraction );
-            CXMLHelper::CreateNewValue( pDoc, pSHMaterialNode, L"ReducedScattering.r",
-                                        pInputMesh->pSHMaterials[iSH].ReducedScattering.r );
-            CXMLHelper::CreateNewValue( pDoc, pSHMaterialNode, L"ReducedScattering.g",
-                                        pInputMesh->pSHMaterials[iSH].ReducedScattering.g );
-            CXMLHelper::CreateNewValue( pDoc, pSHMaterialNode, L"ReducedScattering.b",
-                                        pInputMesh->pSHMaterials[iSH].ReducedScattering.b );
-            SAFE_RELEASE( pSHMaterialNode );
-        }
-
-        SAFE_RELEASE( pMeshNode );
-    }
-
-    CXMLHelper::CreateChildNode( pDoc, pTopNode, L"Settings", NODE_ELEMENT, &pGlobalsNode );
-    CXMLHelper::CreateNewValue( pDoc, pGlobalsNode, L"Order", pOptions->dwOrder );
-    CXMLHelper::CreateNewValue( pDoc, pGlobalsNode, L"NumRays", pOptions->dwNumRays );
-    CXMLHelper::CreateNewValue( pDoc, pGlobalsNode, L"NumBounces", pOptions->dwNumBounces );
-    CXMLHelper::CreateNewValue( pDoc, pGlobalsNode, L"LengthScale", pOptions->fLengthScale );
-    CXMLHelper::CreateNewValue( pDoc, pGlobalsNode, L"NumChannels", ( DWORD )pOptions->dwNumChannels );
-
-    CXMLHelper::CreateChildNode( pDoc, pGlobalsNode, L"Compression", NODE_ELEMENT, &pCompressionNode );
-    CXMLHelper::CreateNewValue( pDoc, pCompressionNode, L"EnableCompression", ( DWORD )pOptions->bEnableCompression );
-    CXMLHelper::CreateNewValue( pDoc, pCompressionNode, L"NumClusters", pOptions->dwNumClusters );
-    CXMLHelper::CreateNewValue( pDoc, pCompressionNode, L"Quality", ( DWORD )pOptions->Quality );
-    CXMLHelper::CreateNewValue( pDoc, pCompressionNode, L"NumPCA", pOptions->dwNumPCA );
-    SAFE_RELEASE( pCompressionNode );
-
-    CXMLHelper::CreateChildNode( pDoc, pGlobalsNode, L"MeshTessellation", NODE_ELEMENT, &pMTNode );
-    CXMLHelper::CreateNewValue( pDoc, pMTNode, L"EnableTessellation", ( DWORD )pOptions->bEnableTessellation );
-    CXMLHelper::CreateNewValue( pDoc, pMTNode, L"RobustMeshRefine", ( DWORD )pOptions->bRobustMeshRefine );
-    CXMLHelper::CreateNewValue( pDoc, pMTNode, L"RobustMeshRefineMinEdgeLength",
-                                pOptions->fRobustMeshRefineMinEdgeLength );
-    CXMLHelper::CreateNewValue( pDoc, pMTNode, L"RobustMeshRefineMaxSubdiv", pOptions->dwRobustMeshRefineMaxSubdiv );
-    CXMLHelper::CreateNewValue( pDoc, pMTNode, L"AdaptiveDL", ( DWORD )pOptions->bAdaptiveDL );
-    CXMLHelper::CreateNewValue( pDoc, pMTNode, L"AdaptiveDLMinEdgeLength", pOptions->fAdaptiveDLMinEdgeLength );
-    CXMLHelper::CreateNewValue( pDoc, pMTNode, L"AdaptiveDLThreshold", pOptions->fAdaptiveDLThreshold );
-    CXMLHelper::CreateNewValue( pDoc, pMTNode, L"AdaptiveDLMaxSubdiv", pOptions->dwAdaptiveDLMaxSubdiv );
-    CXMLHelper::CreateNewValue( pDoc, pMTNode, L"AdaptiveBounce", ( DWORD )pOptions->bAdaptiveBounce );
-    CXMLHelper::CreateNewValue( pDoc, pMTNode, L"AdaptiveBounceMinEdgeLength",
-                                pOptions->fAdaptiveBounceMinEdgeLength );
-    CXMLHelper::CreateNewValue( pDoc, pMTNode, L"AdaptiveBounceThreshold", pOptions->fAdaptiveBounceThreshold );
-    CXMLHelper::CreateNewValue( pDoc, pMTNode, L"AdaptiveBounceMaxSubdiv", pOptions->dwAdaptiveBounceMaxSubdiv );
-    SAFE_RELEASE( pMTNode );
-    SAFE_RELEASE( pGlobalsNode );
-
-    CXMLHelper::CreateChildNode( pDoc, pTopNode, L"Output", NODE_ELEMENT, &pOutputNode );
-    CXMLHelper::CreateNewValue( pDoc, pOutputNode, L"OutputConcatPRTMesh", pOptions->strOutputConcatPRTMesh );
-    CXMLHelper::CreateNewValue( pDoc, pOutputNode, L"OutputConcatBlockerMesh", pOptions->strOutputConcatBlockerMesh );
-    CXMLHelper::CreateNewValue( pDoc, pOutputNode, L"OutputTessellatedMesh", pOptions->strOutputTessellatedMesh );
-    CXMLHelper::CreateNewValue( pDoc, pOutputNode, L"BinaryXFile", ( DWORD )pOptions->bBinaryXFile );
-    CXMLHelper::CreateNewValue( pDoc, pOutputNode, L"OutputPRTBuffer", pOptions->strOutputPRTBuffer );
-    CXMLHelper::CreateNewValue( pDoc, pOutputNode, L"OutputCompPRTBuffer", pOptions->strOutputCompPRTBuffer );
-    SAFE_RELEASE( pOutputNode );
-
-    SAFE_RELEASE( pTopNode );
-    SAFE_RELEASE( pRootNode );
-
-    // Save the doc
-    VARIANT vName;
-    vName.vt = VT_BSTR;
-    vName.bstrVal = SysAllocString( strFile );
-    hr = pDoc->save( vName );
-    VariantClear( &vName );
-
-    SAFE_RELEASE( pDoc );
-
-    return hr;
-}
-
-
+// The MSXML loader LoadOptions replaced.  The nodes must be in the order of options.xml.
 //--------------------------------------------------------------------------------------
-HRESULT COptionsFile::LoadOptions( WCHAR* strFile, SIMULATOR_OPTIONS* pOptions )
+HRESULT COptionsFile::LoadOptionsMSXML( WCHAR* strFile, SIMULATOR_OPTIONS* pOptions )
 {
     HRESULT hr = S_OK;
     VARIANT v;
@@ -348,28 +244,7 @@ HRESULT COptionsFile::LoadOptions( WCHAR* strFile, SIMULATOR_OPTIONS* pOptions )
     }
     else
     {
-        WCHAR szBaseName[MAX_PATH];
-        wcscpy_s( szBaseName, MAX_PATH, strFile );
-        WCHAR* strLastDot = wcsrchr( szBaseName, L'.' );
-        if( strLastDot )
-            *strLastDot = 0;
-
-        wcscpy_s( pOptions->strOutputConcatPRTMesh, MAX_PATH, szBaseName );
-        wcscat_s( pOptions->strOutputConcatPRTMesh, MAX_PATH, L".x" );
-
-        wcscpy_s( pOptions->strOutputConcatBlockerMesh, MAX_PATH, szBaseName );
-        wcscat_s( pOptions->strOutputConcatBlockerMesh, MAX_PATH, L"_blocker.x" );
-
-        wcscpy_s( pOptions->strOutputTessellatedMesh, MAX_PATH, szBaseName );
-        wcscat_s( pOptions->strOutputTessellatedMesh, MAX_PATH, L"_tessellated.x" );
-
-        pOptions->bBinaryXFile = false;
-
-        wcscpy_s( pOptions->strOutputPRTBuffer, MAX_PATH, szBaseName );
-        wcscat_s( pOptions->strOutputPRTBuffer, MAX_PATH, L"_prtresults.prt" );
-
-        wcscpy_s( pOptions->strOutputCompPRTBuffer, MAX_PATH, szBaseName );
-        wcscat_s( pOptions->strOutputCompPRTBuffer, MAX_PATH, L"_compprtresults.pca" );
+        SetDefaultOutputNames( strFile, pOptions );
     }
 
     SAFE_RELEASE( pNode );
@@ -448,16 +323,6 @@ HRESULT COptionsFile::ResetOptions( SIMULATOR_OPTIONS* pOptions )
 }
 
 
-//-----------------------------------------------------------------------------
-void COptionsFile::FreeOptions( SIMULATOR_OPTIONS* pOptions )
-{
-    for( DWORD iMesh = 0; iMesh < pOptions->dwNumMeshes; iMesh++ )
-    {
-        SAFE_DELETE_ARRAY( pOptions->pInputMeshes[iMesh].pSHMaterials );
-    }
-    SAFE_DELETE_ARRAY( pOptions->pInputMeshes );
-}
-
 //--------------------------------------------------------------------------------------
 void CXMLHelper::CreateChildNode( IXMLDOMDocument* pDoc, IXMLDOMNode* pParentNode,
                                   WCHAR* strName, int nType, IXMLDOMNode** ppNewNode )
@@ -741,4 +606,3 @@ void CXMLHelper::GetValue( IXMLDOMNode*& pNode, WCHAR* strName, DWORD* pdwValue
 #endif
 
 }
-
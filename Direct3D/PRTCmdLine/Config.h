@@ -1,9 +1,57 @@
 //----------------------------------------------------------------------------
 // File: Config.h
 //
+// The options of a simulation.  Off Windows the few Win32 and D3DX types they are made
+// of are defined here, so OptionsFile.cpp can read them there too.
+//
 // Copyright (c) Microsoft Corporation.
 // Licensed under the MIT License (MIT).
 //-----------------------------------------------------------------------------
+#pragma once
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#ifdef _WIN32
+#include <windows.h>
+#include <d3dx9.h>
+#else
+#include "DXUTWorkerPool.h"
+
+typedef unsigned short WORD;
+typedef int BOOL;
+#define TRUE        1
+#define FALSE       0
+typedef float FLOAT;
+typedef wchar_t WCHAR;
+#define MAX_PATH    260
+
+struct D3DXVECTOR3
+{
+    FLOAT x, y, z;
+};
+
+struct D3DCOLORVALUE
+{
+    FLOAT r, g, b, a;
+};
+
+struct D3DXSHMATERIAL
+{
+    D3DCOLORVALUE Diffuse;
+    BOOL bMirror;
+    BOOL bSubSurf;
+    FLOAT RelativeIndexOfRefraction;
+    D3DCOLORVALUE Absorption;
+    D3DCOLORVALUE ReducedScattering;
+};
+
+enum D3DXSHCOMPRESSQUALITYTYPE
+{
+    D3DXSHCQUAL_FASTLOWQUALITY = 1,
+    D3DXSHCQUAL_SLOWHIGHQUALITY = 2,
+    D3DXSHCQUAL_FORCE_DWORD = 0x7fffffff
+};
+#endif
 
 struct INPUT_MESH
 {
@@ -68,33 +116,21 @@ public:
             COptionsFile();
             ~COptionsFile();
 
+    // LoadOptions and SaveOptions read and write the XML themselves, with only the CRT.
+    // The elements may come in any order, and unknown ones are skipped.
     HRESULT LoadOptions( WCHAR* strFile, SIMULATOR_OPTIONS* pOptions );
     HRESULT SaveOptions( WCHAR* strFile, SIMULATOR_OPTIONS* pOptions );
+    HRESULT LoadOptionsMSXML( WCHAR* strFile, SIMULATOR_OPTIONS* pOptions );
     HRESULT ResetOptions( SIMULATOR_OPTIONS* pOptions );
     void    FreeOptions( SIMULATOR_OPTIONS* pOptions );
-};
 
+    // Whether every value of the two is the same
+    static bool SameOptions( const SIMULATOR_OPTIONS* pA, const SIMULATOR_OPTIONS* pB );
 
-class CXMLHelper
-{
-public:
-    static void     CreateNewValue( IXMLDOMDocument* pDoc, IXMLDOMNode* pNode, WCHAR* strName, WCHAR* strValue );
-    static void     CreateNewValue( IXMLDOMDocument* pDoc, IXMLDOMNode* pNode, WCHAR* strName, DWORD nValue );
-    static void     CreateNewValue( IXMLDOMDocument* pDoc, IXMLDOMNode* pNode, WCHAR* strName, float fValue );
-    static void     CreateChildNode( IXMLDOMDocument* pDoc, IXMLDOMNode* pParentNode, WCHAR* strName, int nType,
-                                     IXMLDOMNode** ppNewNode );
-
-    static void     GetValue( IXMLDOMNode*& pNode, WCHAR* strName, WCHAR* strValue, int cchValue );
-    static void     GetValue( IXMLDOMNode*& pNode, WCHAR* strName, int* pnValue );
-    static void     GetValue( IXMLDOMNode*& pNode, WCHAR* strName, bool* pbValue );
-    static void     GetValue( IXMLDOMNode*& pNode, WCHAR* strName, float* pfValue );
-    static void     GetValue( IXMLDOMNode*& pNode, WCHAR* strName, D3DXCOLOR* pclrValue );
-    static void     GetValue( IXMLDOMNode*& pNode, WCHAR* strName, DWORD* pdwValue );
-    static HRESULT  GetChild( IXMLDOMNode*& pNode, WCHAR* strName );
-    static void     GetParent( IXMLDOMNode*& pNode );
-    static void     GetSibling( IXMLDOMNode*& pNode );
-    static void     GetParentSibling( IXMLDOMNode*& pNode );
-    static void     SkipCommentNodes( IXMLDOMNode*& pNode );
-    static DWORD    GetNumberOfChildren( IXMLDOMNode* pNode, WCHAR* strName );
+protected:
+    // Output file names next to strFile, for options files that don't name them
+    static void SetDefaultOutputNames( const WCHAR* strFile, SIMULATOR_OPTIONS* pOptions );
 };
 
+#endif
+
@@ -0,0 +1,928 @@
+//----------------------------------------------------------------------------
+// File: OptionsFile.cpp
+//
+// Desc: Reads and writes options files with only the C and C++ libraries, so the
+//       options of a simulation can be read off Windows too.  The MSXML loader and
+//       the default options are in Config.cpp.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//-----------------------------------------------------------------------------
+#include "Config.h"
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <new>
+#include <vector>
+
+#ifndef SAFE_DELETE_ARRAY
+#define SAFE_DELETE_ARRAY(p) { if (p) { delete[] (p);   (p)=NULL; } }
+#endif
+#ifndef ARRAYSIZE
+#define ARRAYSIZE(a) ( sizeof( a ) / sizeof( a[0] ) )
+#endif
+
+//--------------------------------------------------------------------------------------
+// Every value of an options file, found by its path of element names below <Options>,
+// <Mesh> or <SHMaterial>.  LoadOptions looks values up here as it reads them, in any
+// order, and SaveOptions writes them in the order of these tables, which is the order
+// of options.xml.
+//--------------------------------------------------------------------------------------
+enum OPTION_TYPE
+{
+    OPTION_DWORD,
+    OPTION_FLOAT,
+    OPTION_BOOL,
+    OPTION_STRING,      // WCHAR[MAX_PATH]
+};
+
+struct OPTION_FIELD
+{
+    const char* strPath;
+    OPTION_TYPE Type;
+    size_t Offset;
+};
+
+#define OPTION_ENTRY( strPath, Type, Struct, Member ) { strPath, Type, offsetof( Struct, Member ) }
+
+// Quality and bSubSurf are read and written as DWORDs
+static_assert( sizeof( D3DXSHCOMPRESSQUALITYTYPE ) == sizeof( DWORD ), "Quality must be the size of a DWORD" );
+static_assert( sizeof( BOOL ) == sizeof( DWORD ), "bSubSurf must be the size of a DWORD" );
+
+const OPTION_FIELD g_aMeshFields[] =
+{
+    OPTION_ENTRY( "MeshFile", OPTION_STRING, INPUT_MESH, strMeshFile ),
+    OPTION_ENTRY( "IsBlockerMesh", OPTION_BOOL, INPUT_MESH, bIsBlockerMesh ),
+    OPTION_ENTRY( "Translate.x", OPTION_FLOAT, INPUT_MESH, vTranslate.x ),
+    OPTION_ENTRY( "Translate.y", OPTION_FLOAT, INPUT_MESH, vTranslate.y ),
+    OPTION_ENTRY( "Translate.z", OPTION_FLOAT, INPUT_MESH, vTranslate.z ),
+    OPTION_ENTRY( "Scale.x", OPTION_FLOAT, INPUT_MESH, vScale.x ),
+    OPTION_ENTRY( "Scale.y", OPTION_FLOAT, INPUT_MESH, vScale.y ),
+    OPTION_ENTRY( "Scale.z", OPTION_FLOAT, INPUT_MESH, vScale.z ),
+    OPTION_ENTRY( "Yaw", OPTION_FLOAT, INPUT_MESH, fYaw ),
+    OPTION_ENTRY( "Pitch", OPTION_FLOAT, INPUT_MESH, fPitch ),
+    OPTION_ENTRY( "Roll", OPTION_FLOAT, INPUT_MESH, fRoll ),
+};
+
+const OPTION_FIELD g_aSHMaterialFields[] =
+{
+    OPTION_ENTRY( "Diffuse.r", OPTION_FLOAT, D3DXSHMATERIAL, Diffuse.r ),
+    OPTION_ENTRY( "Diffuse.g", OPTION_FLOAT, D3DXSHMATERIAL, Diffuse.g ),
+    OPTION_ENTRY( "Diffuse.b", OPTION_FLOAT, D3DXSHMATERIAL, Diffuse.b ),
+    OPTION_ENTRY( "Absorption.r", OPTION_FLOAT, D3DXSHMATERIAL, Absorption.r ),
+    OPTION_ENTRY( "Absorption.g", OPTION_FLOAT, D3DXSHMATERIAL, Absorption.g ),
+    OPTION_ENTRY( "Absorption.b", OPTION_FLOAT, D3DXSHMATERIAL, Absorption.b ),
+    OPTION_ENTRY( "EnableSubsurfaceScattering", OPTION_DWORD, D3DXSHMATERIAL, bSubSurf ),
+    OPTION_ENTRY( "RelativeIndexOfRefraction", OPTION_FLOAT, D3DXSHMATERIAL, RelativeIndexOfRefraction ),
+    OPTION_ENTRY( "ReducedScattering.r", OPTION_FLOAT, D3DXSHMATERIAL, ReducedScattering.r ),
+    OPTION_ENTRY( "ReducedScattering.g", OPTION_FLOAT, D3DXSHMATERIAL, ReducedScattering.g ),
+    OPTION_ENTRY( "ReducedScattering.b", OPTION_FLOAT, D3DXSHMATERIAL, ReducedScattering.b ),
+};
+
+// Everything after <Input>
+const OPTION_FIELD g_aSettingsFields[] =
+{
+    OPTION_ENTRY( "Settings/Order", OPTION_DWORD, SIMULATOR_OPTIONS, dwOrder ),
+    OPTION_ENTRY( "Settings/NumRays", OPTION_DWORD, SIMULATOR_OPTIONS, dwNumRays ),
+    OPTION_ENTRY( "Settings/NumBounces", OPTION_DWORD, SIMULATOR_OPTIONS, dwNumBounces ),
+    OPTION_ENTRY( "Settings/LengthScale", OPTION_FLOAT, SIMULATOR_OPTIONS, fLengthScale ),
+    OPTION_ENTRY( "Settings/NumChannels", OPTION_DWORD, SIMULATOR_OPTIONS, dwNumChannels ),
+    OPTION_ENTRY( "Settings/Compression/EnableCompression", OPTION_BOOL, SIMULATOR_OPTIONS, bEnableCompression ),
+    OPTION_ENTRY( "Settings/Compression/NumClusters", OPTION_DWORD, SIMULATOR_OPTIONS, dwNumClusters ),
+    OPTION_ENTRY( "Settings/Compression/Quality", OPTION_DWORD, SIMULATOR_OPTIONS, Quality ),
+    OPTION_ENTRY( "Settings/Compression/NumPCA", OPTION_DWORD, SIMULATOR_OPTIONS, dwNumPCA ),
+    OPTION_ENTRY( "Settings/MeshTessellation/EnableTessellation", OPTION_BOOL, SIMULATOR_OPTIONS,
+                  bEnableTessellation ),
+    OPTION_ENTRY( "Settings/MeshTessellation/RobustMeshRefine", OPTION_BOOL, SIMULATOR_OPTIONS, bRobustMeshRefine ),
+    OPTION_ENTRY( "Settings/MeshTessellation/RobustMeshRefineMinEdgeLength", OPTION_FLOAT, SIMULATOR_OPTIONS,
+                  fRobustMeshRefineMinEdgeLength ),
+    OPTION_ENTRY( "Settings/MeshTessellation/RobustMeshRefineMaxSubdiv", OPTION_DWORD, SIMULATOR_OPTIONS,
+                  dwRobustMeshRefineMaxSubdiv ),
+    OPTION_ENTRY( "Settings/MeshTessellation/AdaptiveDL", OPTION_BOOL, SIMULATOR_OPTIONS, bAdaptiveDL ),
+    OPTION_ENTRY( "Settings/MeshTessellation/AdaptiveDLMinEdgeLength", OPTION_FLOAT, SIMULATOR_OPTIONS,
+                  fAdaptiveDLMinEdgeLength ),
+    OPTION_ENTRY( "Settings/MeshTessellation/AdaptiveDLThreshold", OPTION_FLOAT, SIMULATOR_OPTIONS,
+                  fAdaptiveDLThreshold ),
+    OPTION_ENTRY( "Settings/MeshTessellation/AdaptiveDLMaxSubdiv", OPTION_DWORD, SIMULATOR_OPTIONS,
+                  dwAdaptiveDLMaxSubdiv ),
+    OPTION_ENTRY( "Settings/MeshTessellation/AdaptiveBounce", OPTION_BOOL, SIMULATOR_OPTIONS, bAdaptiveBounce ),
+    OPTION_ENTRY( "Settings/MeshTessellation/AdaptiveBounceMinEdgeLength", OPTION_FLOAT, SIMULATOR_OPTIONS,
+                  fAdaptiveBounceMinEdgeLength ),
+    OPTION_ENTRY( "Settings/MeshTessellation/AdaptiveBounceThreshold", OPTION_FLOAT, SIMULATOR_OPTIONS,
+                  fAdaptiveBounceThreshold ),
+    OPTION_ENTRY( "Settings/MeshTessellation/AdaptiveBounceMaxSubdiv", OPTION_DWORD, SIMULATOR_OPTIONS,
+                  dwAdaptiveBounceMaxSubdiv ),
+    OPTION_ENTRY( "Output/OutputConcatPRTMesh", OPTION_STRING, SIMULATOR_OPTIONS, strOutputConcatPRTMesh ),
+    OPTION_ENTRY( "Output/OutputConcatBlockerMesh", OPTION_STRING, SIMULATOR_OPTIONS, strOutputConcatBlockerMesh ),
+    OPTION_ENTRY( "Output/OutputTessellatedMesh", OPTION_STRING, SIMULATOR_OPTIONS, strOutputTessellatedMesh ),
+    OPTION_ENTRY( "Output/BinaryXFile", OPTION_BOOL, SIMULATOR_OPTIONS, bBinaryXFile ),
+    OPTION_ENTRY( "Output/OutputPRTBuffer", OPTION_STRING, SIMULATOR_OPTIONS, strOutputPRTBuffer ),
+    OPTION_ENTRY( "Output/OutputCompPRTBuffer", OPTION_STRING, SIMULATOR_OPTIONS, strOutputCompPRTBuffer ),
+};
+
+#define OPTIONS_MAX_DEPTH   16
+#define OPTIONS_MAX_PATH    256
+#define OPTIONS_MAX_VALUE   ( 4 * MAX_PATH )
+
+
+//--------------------------------------------------------------------------------------
+// A forward only reader of the XML options files are written in.  Next() steps over the
+// UTF-8 buffer to the next tag or run of text; comments, processing instructions and the
+// DOCTYPE are skipped and attributes are ignored.  Nothing is copied: the token points
+// into the buffer.
+//--------------------------------------------------------------------------------------
+enum XML_TOKEN
+{
+    XML_TOKEN_EOF,
+    XML_TOKEN_START,        // <Name> or <Name/>, which sets m_bEmpty
+    XML_TOKEN_END,          // </Name>
+    XML_TOKEN_TEXT,         // Character data, with any references still in it
+    XML_TOKEN_CDATA,        // The contents of a CDATA section
+    XML_TOKEN_ERROR,
+};
+
+class CXMLReader
+{
+public:
+            CXMLReader( const char* pData, size_t nSize )
+            {
+                m_p = pData;
+                m_pEnd = pData + nSize;
+                m_pToken = NULL;
+                m_nToken = 0;
+                m_bEmpty = false;
+            }
+
+    XML_TOKEN Next();
+
+    const char* m_pToken;   // The name of a tag, or the text
+    size_t m_nToken;
+    bool m_bEmpty;
+
+protected:
+    const char* Find( const char* p, const char* str ) const;
+
+    const char* m_p;
+    const char* m_pEnd;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Where str next appears from p on, or NULL
+//--------------------------------------------------------------------------------------
+const char* CXMLReader::Find( const char* p, const char* str ) const
+{
+    const size_t nLength = strlen( str );
+    while( p && ( size_t )( m_pEnd - p ) >= nLength )
+    {
+        if( memcmp( p, str, nLength ) == 0 )
+            return p;
+        p = ( const char* )memchr( p + 1, str[0], m_pEnd - p - 1 );
+    }
+    return NULL;
+}
+
+
+//--------------------------------------------------------------------------------------
+XML_TOKEN CXMLReader::Next()
+{
+    for(; ; )
+    {
+        if( m_p >= m_pEnd )
+            return XML_TOKEN_EOF;
+
+        if( *m_p != '<' )
+        {
+            m_pToken = m_p;
+            m_p = ( const char* )memchr( m_p, '<', m_pEnd - m_p );
+            if( !m_p )
+                m_p = m_pEnd;
+            m_nToken = m_p - m_pToken;
+            return XML_TOKEN_TEXT;
+        }
+
+        const size_t nLeft = m_pEnd - m_p;
+        if( nLeft < 2 )
+            return XML_TOKEN_ERROR;
+
+        if( m_p[1] == '!' || m_p[1] == '?' )
+        {
+            const char* pClose;
+            if( nLeft >= 4 && memcmp( m_p, "<!--", 4 ) == 0 )
+            {
+                pClose = Find( m_p + 4, "-->" );
+                m_p = pClose ? pClose + 3 : NULL;
+            }
+            else if( nLeft >= 9 && memcmp( m_p, "<![CDATA[", 9 ) == 0 )
+            {
+                pClose = Find( m_p + 9, "]]>" );
+                if( !pClose )
+                    return XML_TOKEN_ERROR;
+                m_pToken = m_p + 9;
+                m_nToken = pClose - m_pToken;
+                m_p = pClose + 3;
+                return XML_TOKEN_CDATA;
+            }
+            else
+            {
+                pClose = Find( m_p + 2, m_p[1] == '?' ? "?>" : ">" );
+                m_p = pClose ? pClose + ( m_p[1] == '?' ? 2 : 1 ) : NULL;
+            }
+            if( !m_p )
+                return XML_TOKEN_ERROR;
+            continue;
+        }
+
+        const bool bEnd = ( m_p[1] == '/' );
+        const char* pName = m_p + ( bEnd ? 2 : 1 );
+        const char* pClose = ( const char* )memchr( pName, '>', m_pEnd - pName );
+        if( !pClose )
+            return XML_TOKEN_ERROR;
+
+        const char* pNameEnd = pName;
+        while( pNameEnd < pClose && *pNameEnd != '/' && *pNameEnd != ' ' && *pNameEnd != '\t' &&
+               *pNameEnd != '\r' && *pNameEnd != '\n' )
+            pNameEnd++;
+        if( pNameEnd == pName )
+            return XML_TOKEN_ERROR;
+
+        m_pToken = pName;
+        m_nToken = pNameEnd - pName;
+        m_bEmpty = !bEnd && pClose[-1] == '/';
+        m_p = pClose + 1;
+        return bEnd ? XML_TOKEN_END : XML_TOKEN_START;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Appends code point Code as UTF-8, returning the bytes written
+//--------------------------------------------------------------------------------------
+static size_t EncodeUTF8( UINT Code, char* pOut )
+{
+    if( Code < 0x80 )
+    {
+        pOut[0] = ( char )Code;
+        return 1;
+    }
+    if( Code < 0x800 )
+    {
+        pOut[0] = ( char )( 0xC0 | ( Code >> 6 ) );
+        pOut[1] = ( char )( 0x80 | ( Code & 0x3F ) );
+        return 2;
+    }
+    if( Code < 0x10000 )
+    {
+        pOut[0] = ( char )( 0xE0 | ( Code >> 12 ) );
+        pOut[1] = ( char )( 0x80 | ( ( Code >> 6 ) & 0x3F ) );
+        pOut[2] = ( char )( 0x80 | ( Code & 0x3F ) );
+        return 3;
+    }
+    pOut[0] = ( char )( 0xF0 | ( Code >> 18 ) );
+    pOut[1] = ( char )( 0x80 | ( ( Code >> 12 ) & 0x3F ) );
+    pOut[2] = ( char )( 0x80 | ( ( Code >> 6 ) & 0x3F ) );
+    pOut[3] = ( char )( 0x80 | ( Code & 0x3F ) );
+    return 4;
+}
+
+
+//--------------------------------------------------------------------------------------
+// The next code point of a UTF-8 string, or U+FFFD for a malformed sequence
+//--------------------------------------------------------------------------------------
+static UINT DecodeUTF8( const char*& p, const char* pEnd )
+{
+    const BYTE b = ( BYTE )*p++;
+    if( b < 0x80 )
+        return b;
+
+    UINT nMore = ( b >= 0xF0 ) ? 3 : ( b >= 0xE0 ) ? 2 : ( b >= 0xC0 ) ? 1 : 0;
+    UINT Code = b & ( 0x3F >> nMore );
+    if( 0 == nMore || b >= 0xF8 )
+        return 0xFFFD;
+    for( UINT i = 0; i < nMore; i++ )
+    {
+        if( p >= pEnd || ( ( BYTE )*p & 0xC0 ) != 0x80 )
+            return 0xFFFD;
+        Code = ( Code << 6 ) | ( ( BYTE )*p++ & 0x3F );
+    }
+    return ( Code > 0x10FFFF ) ? 0xFFFD : Code;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Appends text to a value, replacing character and entity references when bReferences
+// is set.  What doesn't fit in cchValue - 1 bytes is dropped.
+//--------------------------------------------------------------------------------------
+static void AppendXMLText( char* strValue, size_t* pnValue, size_t cchValue, const char* pText, size_t nText,
+                           bool bReferences )
+{
+    const char* pEnd = pText + nText;
+    size_t n = *pnValue;
+    while( pText < pEnd && n + 4 < cchValue )
+    {
+        if( *pText != '&' || !bReferences )
+        {
+            strValue[n++] = *pText++;
+            continue;
+        }
+
+        const size_t nSearch = ( size_t )( pEnd - pText ) < 12 ? ( size_t )( pEnd - pText ) : 12;
+        const char* pSemicolon = ( const char* )memchr( pText, ';', nSearch );
+        UINT Code = 0;
+        if( pSemicolon )
+        {
+            const size_t nName = pSemicolon - pText - 1;
+            const char* pName = pText + 1;
+            if( nName == 2 && memcmp( pName, "lt", 2 ) == 0 )
+                Code = '<';
+            else if( nName == 2 && memcmp( pName, "gt", 2 ) == 0 )
+                Code = '>';
+            else if( nName == 3 && memcmp( pName, "amp", 3 ) == 0 )
+                Code = '&';
+            else if( nName == 4 && memcmp( pName, "quot", 4 ) == 0 )
+                Code = '"';
+            else if( nName == 4 && memcmp( pName, "apos", 4 ) == 0 )
+                Code = '\'';
+            else if( nName >= 2 && pName[0] == '#' )
+            {
+                const bool bHex = ( pName[1] == 'x' || pName[1] == 'X' );
+                for( const char* p = pName + ( bHex ? 2 : 1 ); p < pSemicolon && Code <= 0x10FFFF; p++ )
+                {
+                    UINT Digit = ( *p >= '0' && *p <= '9' ) ? *p - '0' :
+                                 ( bHex && *p >= 'a' && *p <= 'f' ) ? *p - 'a' + 10 :
+                                 ( bHex && *p >= 'A' && *p <= 'F' ) ? *p - 'A' + 10 : 0x7FFFFFFF;
+                    if( Digit == 0x7FFFFFFF )
+                    {
+                        Code = 0;
+                        break;
+                    }
+                    Code = Code * ( bHex ? 16 : 10 ) + Digit;
+                }
+                if( Code > 0x10FFFF )
+                    Code = 0;
+            }
+        }
+
+        if( Code == 0 )
+        {
+            // Not a reference, so it is kept as it is
+            strValue[n++] = *pText++;
+            continue;
+        }
+        n += EncodeUTF8( Code, strValue + n );
+        pText = pSemicolon + 1;
+    }
+    strValue[n] = 0;
+    *pnValue = n;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Stores a value read from an options file in the field it belongs to.  Leading and
+// trailing white space are ignored, as are elements no table knows.
+//--------------------------------------------------------------------------------------
+static void SetOptionField( const OPTION_FIELD* pFields, UINT nFields, BYTE* pBase, const char* strPath,
+                            char* strValue, size_t nValue )
+{
+    const OPTION_FIELD* pField = NULL;
+    for( UINT i = 0; i < nFields; i++ )
+    {
+        if( strcmp( pFields[i].strPath, strPath ) == 0 )
+        {
+            pField = &pFields[i];
+            break;
+        }
+    }
+    if( !pField )
+        return;
+
+    while( nValue > 0 && ( BYTE )strValue[nValue - 1] <= ' ' )
+        strValue[--nValue] = 0;
+    const char* pValue = strValue;
+    while( *pValue && ( BYTE )*pValue <= ' ' )
+        pValue++;
+
+    void* pData = pBase + pField->Offset;
+    switch( pField->Type )
+    {
+        case OPTION_DWORD:
+            *( DWORD* )pData = ( DWORD )strtoul( pValue, NULL, 10 );
+            break;
+
+        case OPTION_FLOAT:
+            *( float* )pData = strtof( pValue, NULL );
+            break;
+
+        case OPTION_BOOL:
+            *( bool* )pData = ( atoi( pValue ) == 1 );
+            break;
+
+        case OPTION_STRING:
+        {
+            // UTF-8 to UTF-16, or to UTF-32 where WCHAR is 4 bytes
+            WCHAR* strOut = ( WCHAR* )pData;
+            const char* pEnd = strValue + nValue;
+            int n = 0;
+            while( pValue < pEnd && n < MAX_PATH - 2 )
+            {
+                UINT Code = DecodeUTF8( pValue, pEnd );
+                if( Code >= 0x10000 && sizeof( WCHAR ) == 2 )
+                {
+                    strOut[n++] = ( WCHAR )( 0xD800 + ( ( Code - 0x10000 ) >> 10 ) );
+                    strOut[n++] = ( WCHAR )( 0xDC00 + ( ( Code - 0x10000 ) & 0x3FF ) );
+                }
+                else
+                    strOut[n++] = ( WCHAR )Code;
+            }
+            strOut[n] = 0;
+            break;
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Reads the options from the UTF-8 text of an options file in one pass.  The fields of
+// the meshes and materials are gathered in vectors and moved to the arrays
+// SIMULATOR_OPTIONS holds at the end, so nothing is counted beforehand.
+//--------------------------------------------------------------------------------------
+static HRESULT ParseOptions( const char* pData, size_t nSize, SIMULATOR_OPTIONS* pOptions, bool* pbOutput )
+{
+    std::vector <INPUT_MESH> aMeshes;
+    std::vector <D3DXSHMATERIAL> aMaterials;
+    CXMLReader Reader( pData, nSize );
+
+    // The element path below <Options>, such as "Settings/Compression/NumPCA"
+    char strPath[OPTIONS_MAX_PATH] = {0};
+    size_t anPathLength[OPTIONS_MAX_DEPTH];
+    UINT nDepth = 0;
+    bool bLeaf = false;
+    bool bInput = false;
+    bool bDone = false;
+    char strValue[OPTIONS_MAX_VALUE];
+    size_t nValue = 0;
+
+    *pbOutput = false;
+    for(; ; )
+    {
+        XML_TOKEN Token = Reader.Next();
+        if( Token == XML_TOKEN_EOF )
+            break;
+
+        switch( Token )
+        {
+            case XML_TOKEN_START:
+            {
+                if( bDone )
+                    return E_FAIL;
+                if( nDepth == 0 )
+                {
+                    if( Reader.m_nToken != 7 || memcmp( Reader.m_pToken, "Options", 7 ) != 0 )
+                        return E_FAIL;
+                    anPathLength[nDepth++] = 0;
+                    bDone = Reader.m_bEmpty;
+                    continue;
+                }
+
+                const size_t nLength = anPathLength[nDepth - 1];
+                const size_t nNewLength = nLength + ( nLength > 0 ? 1 : 0 ) + Reader.m_nToken;
+                if( nDepth >= OPTIONS_MAX_DEPTH || nNewLength >= OPTIONS_MAX_PATH )
+                    return E_FAIL;
+                if( nLength > 0 )
+                    strPath[nLength] = '/';
+                memcpy( strPath + nNewLength - Reader.m_nToken, Reader.m_pToken, Reader.m_nToken );
+                strPath[nNewLength] = 0;
+                anPathLength[nDepth++] = nNewLength;
+                bLeaf = true;
+                nValue = 0;
+                strValue[0] = 0;
+
+                if( strcmp( strPath, "Input" ) == 0 )
+                {
+                    bInput = true;
+                }
+                else if( strcmp( strPath, "Input/Mesh" ) == 0 )
+                {
+                    INPUT_MESH Mesh;
+                    memset( &Mesh, 0, sizeof( INPUT_MESH ) );
+                    aMeshes.push_back( Mesh );
+                }
+                else if( strcmp( strPath, "Input/Mesh/SHMaterial" ) == 0 )
+                {
+                    D3DXSHMATERIAL Material;
+                    memset( &Material, 0, sizeof( D3DXSHMATERIAL ) );
+                    aMaterials.push_back( Material );
+                    aMeshes.back().dwNumSHMaterials++;
+                }
+                else if( strcmp( strPath, "Output" ) == 0 )
+                {
+                    *pbOutput = true;
+                }
+
+                if( !Reader.m_bEmpty )
+                    continue;
+            }
+            // Fall through - <Name/> ends where it starts
+            case XML_TOKEN_END:
+            {
+                if( nDepth == 0 )
+                    return E_FAIL;
+                if( nDepth == 1 )
+                {
+                    if( Token == XML_TOKEN_END &&
+                        ( Reader.m_nToken != 7 || memcmp( Reader.m_pToken, "Options", 7 ) != 0 ) )
+                        return E_FAIL;
+                    nDepth = 0;
+                    bDone = true;
+                    continue;
+                }
+
+                const size_t nLength = anPathLength[nDepth - 1];
+                if( Token == XML_TOKEN_END && ( nLength < Reader.m_nToken ||
+                    memcmp( strPath + nLength - Reader.m_nToken, Reader.m_pToken, Reader.m_nToken ) != 0 ) )
+                    return E_FAIL;
+
+                if( bLeaf )
+                {
+                    if( strncmp( strPath, "Input/Mesh/SHMaterial/", 22 ) == 0 )
+                        SetOptionField( g_aSHMaterialFields, ARRAYSIZE( g_aSHMaterialFields ),
+                                        ( BYTE* )&aMaterials.back(), strPath + 22, strValue,
+                                        nValue );
+                    else if( strncmp( strPath, "Input/Mesh/", 11 ) == 0 )
+                        SetOptionField( g_aMeshFields, ARRAYSIZE( g_aMeshFields ),
+                                        ( BYTE* )&aMeshes.back(), strPath + 11, strValue, nValue );
+                    else
+                        SetOptionField( g_aSettingsFields, ARRAYSIZE( g_aSettingsFields ), ( BYTE* )pOptions,
+                                        strPath, strValue, nValue );
+                    bLeaf = false;
+                }
+
+                nDepth--;
+                strPath[anPathLength[nDepth - 1]] = 0;
+                continue;
+            }
+
+            case XML_TOKEN_TEXT:
+            case XML_TOKEN_CDATA:
+                if( bLeaf )
+                    AppendXMLText( strValue, &nValue, OPTIONS_MAX_VALUE, Reader.m_pToken, Reader.m_nToken,
+                                   Token == XML_TOKEN_TEXT );
+                continue;
+
+            default:
+                return E_FAIL;
+        }
+    }
+
+    if( !bDone || !bInput )
+        return E_FAIL;
+
+    pOptions->pInputMeshes = new INPUT_MESH[aMeshes.size()];
+    if( pOptions->pInputMeshes == NULL )
+        return E_OUTOFMEMORY;
+    memset( pOptions->pInputMeshes, 0, aMeshes.size() * sizeof( INPUT_MESH ) );
+    pOptions->dwNumMeshes = ( DWORD )aMeshes.size();
+
+    size_t iMaterial = 0;
+    for( size_t iMesh = 0; iMesh < aMeshes.size(); iMesh++ )
+    {
+        INPUT_MESH* pInputMesh = &pOptions->pInputMeshes[iMesh];
+        *pInputMesh = aMeshes[iMesh];
+        pInputMesh->pSHMaterials = new D3DXSHMATERIAL[pInputMesh->dwNumSHMaterials];
+        if( pInputMesh->pSHMaterials == NULL )
+            return E_OUTOFMEMORY;
+        if( pInputMesh->dwNumSHMaterials > 0 )
+            memcpy( pInputMesh->pSHMaterials, &aMaterials[iMaterial],
+                    pInputMesh->dwNumSHMaterials * sizeof( D3DXSHMATERIAL ) );
+        iMaterial += pInputMesh->dwNumSHMaterials;
+    }
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Writes a string as UTF-8, escaping the characters XML text can't hold
+//--------------------------------------------------------------------------------------
+static void WriteXMLText( FILE* pFile, const WCHAR* strText )
+{
+    char strOut[4 * MAX_PATH + 8];
+    size_t n = 0;
+    for( const WCHAR* p = strText; *p && n < 4 * MAX_PATH; p++ )
+    {
+        UINT Code = *p;
+        if( Code >= 0xD800 && Code < 0xDC00 && p[1] >= 0xDC00 && p[1] < 0xE000 )
+        {
+            Code = 0x10000 + ( ( Code - 0xD800 ) << 10 ) + ( p[1] - 0xDC00 );
+            p++;
+        }
+
+        const char* strEscape = ( Code == '&' ) ? "&amp;" : ( Code == '<' ) ? "&lt;" : ( Code == '>' ) ? "&gt;" : NULL;
+        if( strEscape )
+        {
+            memcpy( strOut + n, strEscape, strlen( strEscape ) );
+            n += strlen( strEscape );
+        }
+        else
+            n += EncodeUTF8( Code, strOut + n );
+    }
+    fwrite( strOut, 1, n, pFile );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Writes the fields of a table, indented below nDepth open elements, opening and
+// closing the elements between them as their paths change
+//--------------------------------------------------------------------------------------
+static void WriteOptionFields( FILE* pFile, const OPTION_FIELD* pFields, UINT nFields, const BYTE* pBase,
+                               UINT nDepth )
+{
+    const char* astrOpen[OPTIONS_MAX_DEPTH];    // Elements this has opened
+    size_t anOpen[OPTIONS_MAX_DEPTH];
+    UINT nOpen = 0;
+
+    for( UINT iField = 0; iField <= nFields; iField++ )
+    {
+        // Close the elements this field isn't in, and open the ones it is
+        const char* strPath = ( iField < nFields ) ? pFields[iField].strPath : "";
+        UINT nSame = 0;
+        const char* p = strPath;
+        while( nSame < nOpen && strncmp( p, astrOpen[nSame], anOpen[nSame] ) == 0 && p[anOpen[nSame]] == '/' )
+            p += anOpen[nSame++] + 1;
+        while( nOpen > nSame )
+        {
+            nOpen--;
+            fprintf( pFile, "%*s</%.*s>\r\n", ( int )( 2 * ( nDepth + nOpen ) ), "", ( int )anOpen[nOpen],
+                     astrOpen[nOpen] );
+        }
+        if( iField == nFields )
+            break;
+        for( const char* pSlash = strchr( p, '/' ); pSlash; pSlash = strchr( p, '/' ) )
+        {
+            astrOpen[nOpen] = p;
+            anOpen[nOpen] = pSlash - p;
+            fprintf( pFile, "%*s<%.*s>\r\n", ( int )( 2 * ( nDepth + nOpen ) ), "", ( int )anOpen[nOpen], p );
+            nOpen++;
+            p = pSlash + 1;
+        }
+
+        // The value
+        const void* pData = pBase + pFields[iField].Offset;
+        fprintf( pFile, "%*s<%s>", ( int )( 2 * ( nDepth + nOpen ) ), "", p );
+        switch( pFields[iField].Type )
+        {
+            case OPTION_DWORD:
+                fprintf( pFile, "%u", *( const DWORD* )pData );
+                break;
+            case OPTION_FLOAT:
+                fprintf( pFile, "%f", *( const float* )pData );
+                break;
+            case OPTION_BOOL:
+                fprintf( pFile, "%d", *( const bool* )pData ? 1 : 0 );
+                break;
+            case OPTION_STRING:
+                WriteXMLText( pFile, ( const WCHAR* )pData );
+                break;
+        }
+        fprintf( pFile, "</%s>\r\n", p );
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// When an options file has no <Output>, the outputs are named after it
+//--------------------------------------------------------------------------------------
+void COptionsFile::SetDefaultOutputNames( const WCHAR* strFile, SIMULATOR_OPTIONS* pOptions )
+{
+    WCHAR szBaseName[MAX_PATH];
+    swprintf( szBaseName, MAX_PATH, L"%ls", strFile );
+    WCHAR* strLastDot = wcsrchr( szBaseName, L'.' );
+    if( strLastDot )
+        *strLastDot = 0;
+
+    swprintf( pOptions->strOutputConcatPRTMesh, MAX_PATH, L"%ls.x", szBaseName );
+    swprintf( pOptions->strOutputConcatBlockerMesh, MAX_PATH, L"%ls_blocker.x", szBaseName );
+    swprintf( pOptions->strOutputTessellatedMesh, MAX_PATH, L"%ls_tessellated.x", szBaseName );
+    pOptions->bBinaryXFile = false;
+    swprintf( pOptions->strOutputPRTBuffer, MAX_PATH, L"%ls_prtresults.prt", szBaseName );
+    swprintf( pOptions->strOutputCompPRTBuffer, MAX_PATH, L"%ls_compprtresults.pca", szBaseName );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Whether two sets of options hold the same values for every field of the tables
+//--------------------------------------------------------------------------------------
+static bool SameOptionFields( const OPTION_FIELD* pFields, UINT nFields, const BYTE* pA, const BYTE* pB )
+{
+    for( UINT i = 0; i < nFields; i++ )
+    {
+        const void* pDataA = pA + pFields[i].Offset;
+        const void* pDataB = pB + pFields[i].Offset;
+        bool bSame = true;
+        switch( pFields[i].Type )
+        {
+            case OPTION_DWORD:
+                bSame = *( const DWORD* )pDataA == *( const DWORD* )pDataB;
+                break;
+            case OPTION_FLOAT:
+                bSame = *( const float* )pDataA == *( const float* )pDataB;
+                break;
+            case OPTION_BOOL:
+                bSame = *( const bool* )pDataA == *( const bool* )pDataB;
+                break;
+            case OPTION_STRING:
+                bSame = wcscmp( ( const WCHAR* )pDataA, ( const WCHAR* )pDataB ) == 0;
+                break;
+        }
+        if( !bSame )
+            return false;
+    }
+    return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// An options file, by the wide path on Windows and by its multibyte form elsewhere
+//--------------------------------------------------------------------------------------
+static FILE* OpenOptionsFile( const WCHAR* strFile, bool bWrite )
+{
+#ifdef _WIN32
+    FILE* pFile = NULL;
+    if( _wfopen_s( &pFile, strFile, bWrite ? L"wb" : L"rb" ) != 0 )
+        return NULL;
+    return pFile;
+#else
+    char strPath[4 * MAX_PATH];
+    size_t nLength = wcstombs( strPath, strFile, sizeof( strPath ) );
+    if( nLength == ( size_t )-1 || nLength >= sizeof( strPath ) )
+        return NULL;
+    return fopen( strPath, bWrite ? "wb" : "rb" );
+#endif
+}
+
+
+//--------------------------------------------------------------------------------------
+COptionsFile::COptionsFile()
+{
+}
+
+
+//--------------------------------------------------------------------------------------
+COptionsFile::~COptionsFile()
+{
+}
+
+
+//--------------------------------------------------------------------------------------
+// Writes UTF-8 in the layout of options.xml
+//--------------------------------------------------------------------------------------
+HRESULT COptionsFile::SaveOptions( WCHAR* strFile, SIMULATOR_OPTIONS* pOptions )
+{
+    FILE* pFile = OpenOptionsFile( strFile, true );
+    if( pFile == NULL )
+        return E_FAIL;
+
+    fprintf( pFile, "<Options>\r\n  <Input>\r\n" );
+    for( DWORD iMesh = 0; iMesh < pOptions->dwNumMeshes; iMesh++ )
+    {
+        INPUT_MESH* pInputMesh = &pOptions->pInputMeshes[iMesh];
+
+        fprintf( pFile, "    <Mesh>\r\n" );
+        WriteOptionFields( pFile, g_aMeshFields, ARRAYSIZE( g_aMeshFields ), ( const BYTE* )pInputMesh, 3 );
+        for( DWORD iSH = 0; iSH < pInputMesh->dwNumSHMaterials; iSH++ )
+        {
+            fprintf( pFile, "      <SHMaterial>\r\n" );
+            WriteOptionFields( pFile, g_aSHMaterialFields, ARRAYSIZE( g_aSHMaterialFields ),
+                               ( const BYTE* )&pInputMesh->pSHMaterials[iSH], 4 );
+            fprintf( pFile, "      </SHMaterial>\r\n" );
+        }
+        fprintf( pFile, "    </Mesh>\r\n" );
+    }
+    fprintf( pFile, "  </Input>\r\n" );
+    WriteOptionFields( pFile, g_aSettingsFields, ARRAYSIZE( g_aSettingsFields ), ( const BYTE* )pOptions, 1 );
+    fprintf( pFile, "</Options>\r\n" );
+
+    bool bFailed = ( ferror( pFile ) != 0 );
+    if( fclose( pFile ) != 0 )
+        bFailed = true;
+
+    return bFailed ? E_FAIL : S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Reads the whole file and parses it in one pass.  UTF-16 files, as Notepad can save
+// them, are turned into UTF-8 first.
+//--------------------------------------------------------------------------------------
+HRESULT COptionsFile::LoadOptions( WCHAR* strFile, SIMULATOR_OPTIONS* pOptions )
+{
+    memset( pOptions, 0, sizeof( SIMULATOR_OPTIONS ) );
+
+    FILE* pFile = OpenOptionsFile( strFile, false );
+    if( pFile == NULL )
+        return E_FAIL;
+    fseek( pFile, 0, SEEK_END );
+    long nSize = ftell( pFile );
+    fseek( pFile, 0, SEEK_SET );
+    char* pData = ( nSize >= 0 ) ? new char[nSize + 1] : NULL;
+    bool bRead = pData && fread( pData, 1, nSize, pFile ) == ( size_t )nSize;
+    fclose( pFile );
+    if( !bRead )
+    {
+        SAFE_DELETE_ARRAY( pData );
+        return E_FAIL;
+    }
+
+    const char* pText = pData;
+    size_t nText = nSize;
+    if( nText >= 3 && memcmp( pText, "\xEF\xBB\xBF", 3 ) == 0 )
+    {
+        pText += 3;
+        nText -= 3;
+    }
+    else if( nText >= 2 && ( BYTE )pText[0] == 0xFF && ( BYTE )pText[1] == 0xFE )
+    {
+        const WORD* pUTF16 = ( const WORD* )( pText + 2 );
+        const size_t nUTF16 = ( nText - 2 ) / 2;
+        char* pUTF8 = new char[nUTF16 * 3 + 1];
+        if( pUTF8 == NULL )
+        {
+            SAFE_DELETE_ARRAY( pData );
+            return E_OUTOFMEMORY;
+        }
+
+        nText = 0;
+        for( size_t i = 0; i < nUTF16; i++ )
+        {
+            UINT Code = pUTF16[i];
+            if( Code >= 0xD800 && Code < 0xDC00 && i + 1 < nUTF16 && pUTF16[i + 1] >= 0xDC00 &&
+                pUTF16[i + 1] < 0xE000 )
+                Code = 0x10000 + ( ( Code - 0xD800 ) << 10 ) + ( pUTF16[++i] - 0xDC00 );
+            nText += EncodeUTF8( Code, pUTF8 + nText );
+        }
+        SAFE_DELETE_ARRAY( pData );
+        pData = pUTF8;
+        pText = pUTF8;
+    }
+
+    bool bOutput = false;
+    HRESULT hr;
+    try
+    {
+        hr = ParseOptions( pText, nText, pOptions, &bOutput );
+    }
+    catch( const std::bad_alloc& )
+    {
+        hr = E_OUTOFMEMORY;
+    }
+    SAFE_DELETE_ARRAY( pData );
+    if( FAILED( hr ) )
+        return hr;
+
+    if( !bOutput )
+        SetDefaultOutputNames( strFile, pOptions );
+
+    return S_OK;
+}
+
+
+//-----------------------------------------------------------------------------
+void COptionsFile::FreeOptions( SIMULATOR_OPTIONS* pOptions )
+{
+    for( DWORD iMesh = 0; iMesh < pOptions->dwNumMeshes; iMesh++ )
+    {
+        SAFE_DELETE_ARRAY( pOptions->pInputMeshes[iMesh].pSHMaterials );
+    }
+    SAFE_DELETE_ARRAY( pOptions->pInputMeshes );
+}
+
+
+//-----------------------------------------------------------------------------
+bool COptionsFile::SameOptions( const SIMULATOR_OPTIONS* pA, const SIMULATOR_OPTIONS* pB )
+{
+    if( pA->dwNumMeshes != pB->dwNumMeshes ||
+        !SameOptionFields( g_aSettingsFields, ARRAYSIZE( g_aSettingsFields ), ( const BYTE* )pA, ( const BYTE* )pB ) )
+        return false;
+
+    for( DWORD iMesh = 0; iMesh < pA->dwNumMeshes; iMesh++ )
+    {
+        const INPUT_MESH* pMeshA = &pA->pInputMeshes[iMesh];
+        const INPUT_MESH* pMeshB = &pB->pInputMeshes[iMesh];
+        if( pMeshA->dwNumSHMaterials != pMeshB->dwNumSHMaterials ||
+            !SameOptionFields( g_aMeshFields, ARRAYSIZE( g_aMeshFields ), ( const BYTE* )pMeshA,
+                               ( const BYTE* )pMeshB ) )
+            return false;
+
+        for( DWORD iSH = 0; iSH < pMeshA->dwNumSHMaterials; iSH++ )
+        {
+            if( !SameOptionFields( g_aSHMaterialFields, ARRAYSIZE( g_aSHMaterialFields ),
+                                   ( const BYTE* )&pMeshA->pSHMaterials[iSH],
+                                   ( const BYTE* )&pMeshB->pSHMaterials[iSH] ) )
+                return false;
+        }
+    }
+
+    return true;
+}
@@ -0,0 +1,503 @@
+//----------------------------------------------------------------------------
+// File: PRTNativeMain.cpp
+//
+// Desc: Runs the simulations of PRTCmdLine options files with CPRTNativeSimulator
+//       alone, without Direct3D, so they can run headless on Linux from the same
+//       options.xml.  It isn't part of PRTCmdLine.exe; build it with, e.g.
+//
+//   g++ -O2 -std=c++11 -pthread -I../../DXUT/Optional PRTNativeMain.cpp PRTNativeMesh.cpp
+//       PRTNativeSim.cpp OptionsFile.cpp ../../DXUT/Optional/DXUTWorkerPool.cpp -o prtnative
+//
+//       Meshes are read and concatenated as PRTCmdLine /native reads them, and found
+//       next to the options file, in the current directory or in a Media directory
+//       above either.  The concatenated meshes are saved as text .x files, and the
+//       transfer to <OutputPRTBuffer>.transfer, as this header followed by
+//       nVertices * nCoeffs * nChannels floats laid out as ID3DXPRTBuffer::LockBuffer
+//       gives them.  Saving .prt files and compressing the transfer need D3DX, so they
+//       are left to PRTCmdLine.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//-----------------------------------------------------------------------------
+#include "Config.h"
+#include "PRTNativeMesh.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <math.h>
+#include <locale.h>
+#include <signal.h>
+#include <new>
+#include <string>
+#include <vector>
+
+#define NATIVE_CHECKPOINT_SECONDS   30
+
+#define PRTNATIVE_TRANSFER_MAGIC    0x54545250      // 'PRTT'
+#define PRTNATIVE_TRANSFER_VERSION  1
+
+struct PRTNATIVE_TRANSFER_HEADER
+{
+    DWORD dwMagic;
+    DWORD dwVersion;
+    UINT nVertices;
+    UINT nCoeffs;               // Order * Order
+    UINT nChannels;
+};
+
+#ifdef _WIN32
+#define PATH_SEPARATOR  L'\\'
+#else
+#define PATH_SEPARATOR  L'/'
+#endif
+
+// Set by Ctrl+C, which stops the simulation with its work saved to the checkpoint
+static volatile sig_atomic_t g_bStop = 0;
+
+
+//-----------------------------------------------------------------------------
+static void StopHandler( int )
+{
+    g_bStop = 1;
+}
+
+
+//-----------------------------------------------------------------------------
+static HRESULT WINAPI StaticPRTNativeCB( float fPercentDone, void* )
+{
+    printf( "\r%6.2f%%", fPercentDone * 100.0f );
+    fflush( stdout );
+
+    // In this callback, returning anything except S_OK will stop the simulator
+    return g_bStop ? E_FAIL : S_OK;
+}
+
+
+//-----------------------------------------------------------------------------
+// Paths in options files are written for Windows
+//-----------------------------------------------------------------------------
+static std::wstring NativePath( const WCHAR* strPath )
+{
+    std::wstring str( strPath );
+    for( size_t i = 0; i < str.size(); i++ )
+    {
+        if( str[i] == L'\\' || str[i] == L'/' )
+            str[i] = PATH_SEPARATOR;
+    }
+    return str;
+}
+
+
+//-----------------------------------------------------------------------------
+static bool FileExists( const std::wstring& strFile )
+{
+    FILE* pFile = PRTNativeOpenFile( strFile.c_str(), "rb" );
+    if( pFile == NULL )
+        return false;
+    fclose( pFile );
+    return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Looks for strFile next to the options file, then in the current directory, then in
+// a Media directory in or above either, as DXUTFindDXSDKMediaFileCch looks
+//-----------------------------------------------------------------------------
+static bool FindMediaFile( const std::wstring& strOptionsDir, const WCHAR* strFile, std::wstring* pstrFound )
+{
+    std::wstring strName = NativePath( strFile );
+    if( FileExists( strName ) )
+    {
+        *pstrFound = strName;
+        return true;
+    }
+
+    const std::wstring astrBase[] = { strOptionsDir, std::wstring( L"." ) + PATH_SEPARATOR };
+    for( size_t iBase = 0; iBase < sizeof( astrBase ) / sizeof( astrBase[0] ); iBase++ )
+    {
+        std::wstring strDir = astrBase[iBase];
+        for( int nUp = 0; nUp < 6; nUp++ )
+        {
+            const std::wstring astrTry[] =
+            {
+                strDir + strName,
+                strDir + L"Media" + PATH_SEPARATOR + strName,
+            };
+            for( size_t i = 0; i < sizeof( astrTry ) / sizeof( astrTry[0] ); i++ )
+            {
+                if( FileExists( astrTry[i] ) )
+                {
+                    *pstrFound = astrTry[i];
+                    return true;
+                }
+            }
+            strDir += std::wstring( L".." ) + PATH_SEPARATOR;
+        }
+    }
+    return false;
+}
+
+
+//-----------------------------------------------------------------------------
+static void MultiplyMatrix( PRTNATIVE_MATRIX* pOut, const PRTNATIVE_MATRIX& a, const PRTNATIVE_MATRIX& b )
+{
+    PRTNATIVE_MATRIX m;
+    for( int i = 0; i < 4; i++ )
+    {
+        for( int j = 0; j < 4; j++ )
+            m.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j] + a.m[i][3] * b.m[3][j];
+    }
+    *pOut = m;
+}
+
+
+//-----------------------------------------------------------------------------
+// Scale * RotationYawPitchRoll * Translation, as PRTCmdLine places meshes
+//-----------------------------------------------------------------------------
+static void GetWorldMatrix( const INPUT_MESH* pInput, PRTNATIVE_MATRIX* pWorld )
+{
+    PRTNATIVE_MATRIX mScale, mRoll, mPitch, mYaw, mTranslate;
+    memset( &mScale, 0, sizeof( PRTNATIVE_MATRIX ) );
+    mScale.m[0][0] = pInput->vScale.x;
+    mScale.m[1][1] = pInput->vScale.y;
+    mScale.m[2][2] = pInput->vScale.z;
+    mScale.m[3][3] = 1.0f;
+
+    // D3DXMatrixRotationYawPitchRoll rolls about z, then pitches about x, then yaws about y
+    memset( &mRoll, 0, sizeof( PRTNATIVE_MATRIX ) );
+    float c = cosf( pInput->fRoll ), s = sinf( pInput->fRoll );
+    mRoll.m[0][0] = c; mRoll.m[0][1] = s;
+    mRoll.m[1][0] = -s; mRoll.m[1][1] = c;
+    mRoll.m[2][2] = 1.0f; mRoll.m[3][3] = 1.0f;
+
+    memset( &mPitch, 0, sizeof( PRTNATIVE_MATRIX ) );
+    c = cosf( pInput->fPitch ); s = sinf( pInput->fPitch );
+    mPitch.m[0][0] = 1.0f;
+    mPitch.m[1][1] = c; mPitch.m[1][2] = s;
+    mPitch.m[2][1] = -s; mPitch.m[2][2] = c;
+    mPitch.m[3][3] = 1.0f;
+
+    memset( &mYaw, 0, sizeof( PRTNATIVE_MATRIX ) );
+    c = cosf( pInput->fYaw ); s = sinf( pInput->fYaw );
+    mYaw.m[0][0] = c; mYaw.m[0][2] = -s;
+    mYaw.m[1][1] = 1.0f;
+    mYaw.m[2][0] = s; mYaw.m[2][2] = c;
+    mYaw.m[3][3] = 1.0f;
+
+    memset( &mTranslate, 0, sizeof( PRTNATIVE_MATRIX ) );
+    for( int i = 0; i < 4; i++ )
+        mTranslate.m[i][i] = 1.0f;
+    mTranslate.m[3][0] = pInput->vTranslate.x;
+    mTranslate.m[3][1] = pInput->vTranslate.y;
+    mTranslate.m[3][2] = pInput->vTranslate.z;
+
+    MultiplyMatrix( pWorld, mScale, mRoll );
+    MultiplyMatrix( pWorld, *pWorld, mPitch );
+    MultiplyMatrix( pWorld, *pWorld, mYaw );
+    MultiplyMatrix( pWorld, *pWorld, mTranslate );
+}
+
+
+//-----------------------------------------------------------------------------
+// Loads the meshes of the options and concatenates them into the PRT mesh and the
+// blocker mesh, with the SH materials of the PRT mesh's materials
+//-----------------------------------------------------------------------------
+static HRESULT LoadMeshes( const SIMULATOR_OPTIONS* pOptions, const std::wstring& strOptionsDir,
+                           PRTNATIVE_MESH* pPRTMesh, PRTNATIVE_MESH* pBlockerMesh,
+                           std::vector <D3DXSHMATERIAL>* paSHMaterials )
+{
+    HRESULT hr;
+    for( DWORD iMesh = 0; iMesh < pOptions->dwNumMeshes; iMesh++ )
+    {
+        const INPUT_MESH* pInput = &pOptions->pInputMeshes[iMesh];
+
+        std::wstring strFile;
+        if( !FindMediaFile( strOptionsDir, pInput->strMeshFile, &strFile ) )
+        {
+            printf( "Can not find mesh %ls\n", pInput->strMeshFile );
+            return E_FAIL;
+        }
+        printf( "Reading mesh: %ls\n", strFile.c_str() );
+
+        PRTNATIVE_MESH Mesh;
+        if( FAILED( hr = PRTNativeLoadMeshFromX( strFile.c_str(), &Mesh ) ) )
+            return hr;
+
+        PRTNATIVE_MATRIX mWorld;
+        GetWorldMatrix( pInput, &mWorld );
+        PRTNativeTransformMesh( &Mesh, 0, mWorld );
+
+        if( pInput->bIsBlockerMesh )
+        {
+            if( FAILED( hr = PRTNativeAppendMesh( pBlockerMesh, &Mesh ) ) )
+                return hr;
+            continue;
+        }
+
+        // handle if there's not enough SH materials specified for this mesh
+        for( size_t iMat = 0; iMat < Mesh.aMaterials.size(); iMat++ )
+        {
+            D3DXSHMATERIAL shMat;
+            memset( &shMat, 0, sizeof( D3DXSHMATERIAL ) );
+            if( pInput->dwNumSHMaterials == 0 )
+            {
+                D3DCOLORVALUE Diffuse = { 2.00f, 2.00f, 2.00f, 1.0f };
+                D3DCOLORVALUE Absorption = { 0.0030f, 0.0030f, 0.0460f, 1.0f };
+                D3DCOLORVALUE ReducedScattering = { 1.00f, 1.00f, 1.00f, 1.0f };
+                shMat.Diffuse = Diffuse;
+                shMat.Absorption = Absorption;
+                shMat.bSubSurf = FALSE;
+                shMat.RelativeIndexOfRefraction = 1.3f;
+                shMat.ReducedScattering = ReducedScattering;
+            }
+            else
+            {
+                DWORD iSH = ( DWORD )iMat;
+                if( iSH >= pInput->dwNumSHMaterials )
+                    iSH = pInput->dwNumSHMaterials - 1;
+                shMat = pInput->pSHMaterials[iSH];
+            }
+            paSHMaterials->push_back( shMat );
+        }
+
+        if( FAILED( hr = PRTNativeAppendMesh( pPRTMesh, &Mesh ) ) )
+            return hr;
+    }
+
+    // As NormalizeNormals does for PRTCmdLine
+    PRTNATIVE_MESH* apMeshes[] = { pPRTMesh, pBlockerMesh };
+    for( int i = 0; i < 2; i++ )
+    {
+        for( size_t iVertex = 0; iVertex < apMeshes[i]->aNormals.size(); iVertex++ )
+        {
+            PRTNATIVE_VECTOR& n = apMeshes[i]->aNormals[iVertex];
+            float fLength = sqrtf( n.x * n.x + n.y * n.y + n.z * n.z );
+            if( fLength > 0.0f )
+            {
+                n.x /= fLength;
+                n.y /= fLength;
+                n.z /= fLength;
+            }
+        }
+    }
+
+    return S_OK;
+}
+
+
+//-----------------------------------------------------------------------------
+static HRESULT SaveTransfer( const std::wstring& strFile, UINT nVertices, UINT nCoeffs, UINT nChannels,
+                             const float* pTransfer )
+{
+    FILE* pFile = PRTNativeOpenFile( strFile.c_str(), "wb" );
+    if( pFile == NULL )
+        return E_FAIL;
+
+    PRTNATIVE_TRANSFER_HEADER Header;
+    Header.dwMagic = PRTNATIVE_TRANSFER_MAGIC;
+    Header.dwVersion = PRTNATIVE_TRANSFER_VERSION;
+    Header.nVertices = nVertices;
+    Header.nCoeffs = nCoeffs;
+    Header.nChannels = nChannels;
+
+    const size_t nFloats = ( size_t )nVertices * nCoeffs * nChannels;
+    bool bFailed = fwrite( &Header, sizeof( Header ), 1, pFile ) != 1 ||
+        fwrite( pTransfer, sizeof( float ), nFloats, pFile ) != nFloats;
+    if( fclose( pFile ) != 0 )
+        bFailed = true;
+    return bFailed ? E_FAIL : S_OK;
+}
+
+
+//-----------------------------------------------------------------------------
+static HRESULT ProcessOptionsFile( const WCHAR* strOptionsFileName, UINT nThreads )
+{
+    HRESULT hr;
+    SIMULATOR_OPTIONS options;
+    COptionsFile optFile;
+    PRTNATIVE_MESH prtMesh, blockerMesh;
+    std::vector <D3DXSHMATERIAL> aSHMaterials;
+    std::vector <PRTNATIVE_COLOR> aAlbedos;
+    std::vector <float> aResults;
+    CPRTNativeSimulator Simulator;
+    std::wstring strCheckpoint, strTransfer;
+    UINT nVertices, nCoeffs;
+
+    printf( "Reading options file: %ls\n", strOptionsFileName );
+    if( FAILED( hr = optFile.LoadOptions( ( WCHAR* )strOptionsFileName, &options ) ) )
+    {
+        printf( "Error: Failure reading options file.  Ensure schema matchs example options.xml file\n" );
+        return hr;
+    }
+
+    std::wstring strOptionsDir = NativePath( strOptionsFileName );
+    size_t iSlash = strOptionsDir.rfind( PATH_SEPARATOR );
+    strOptionsDir = iSlash == std::wstring::npos ? std::wstring() : strOptionsDir.substr( 0, iSlash + 1 );
+
+    try
+    {
+        if( FAILED( hr = LoadMeshes( &options, strOptionsDir, &prtMesh, &blockerMesh, &aSHMaterials ) ) )
+        {
+            printf( "Error: Can not load meshes\n" );
+            goto LCleanup;
+        }
+
+        if( !prtMesh.aPositions.empty() )
+        {
+            printf( "Saving concatenated PRT meshes: %ls\n", options.strOutputConcatPRTMesh );
+            if( FAILED( hr = PRTNativeSaveMeshToX( NativePath( options.strOutputConcatPRTMesh ).c_str(), &prtMesh ) ) )
+            {
+                printf( "Error: Failed saving mesh\n" );
+                goto LCleanup;
+            }
+        }
+        if( !blockerMesh.aPositions.empty() )
+        {
+            printf( "Saving concatenated blocker meshes: %ls\n", options.strOutputConcatBlockerMesh );
+            if( FAILED( hr = PRTNativeSaveMeshToX( NativePath( options.strOutputConcatBlockerMesh ).c_str(),
+                                                   &blockerMesh ) ) )
+            {
+                printf( "Error: Failed saving mesh\n" );
+                goto LCleanup;
+            }
+        }
+
+        if( prtMesh.aPositions.empty() )
+        {
+            printf( "Error: Need at least 1 non-blocker mesh for PRT simulator\n" );
+            hr = E_FAIL;
+            goto LCleanup;
+        }
+
+        bool bSubsurfaceScattering = false;
+        for( size_t i = 0; i < aSHMaterials.size(); i++ )
+        {
+            if( aSHMaterials[i].bSubSurf )
+                bSubsurfaceScattering = true;
+            PRTNATIVE_COLOR Albedo = { aSHMaterials[i].Diffuse.r, aSHMaterials[i].Diffuse.g,
+                                       aSHMaterials[i].Diffuse.b };
+            aAlbedos.push_back( Albedo );
+        }
+        if( bSubsurfaceScattering || options.bEnableTessellation )
+            printf( "Warning: The native simulator ignores subsurface scattering and tessellation\n" );
+        if( options.bEnableCompression )
+            printf( "Warning: Compression needs D3DX, so only the uncompressed transfer is saved\n" );
+
+        if( FAILED( hr = Simulator.Create( prtMesh.aPositions.data(), prtMesh.aNormals.data(),
+                                           ( UINT )prtMesh.aPositions.size(), prtMesh.aIndices.data(),
+                                           prtMesh.aAttributes.data(), ( UINT )prtMesh.aAttributes.size(),
+                                           aAlbedos.data(), ( UINT )aAlbedos.size(),
+                                           blockerMesh.aPositions.data(), ( UINT )blockerMesh.aPositions.size(),
+                                           blockerMesh.aIndices.data(), ( UINT )blockerMesh.aAttributes.size() ) ) )
+            goto LCleanup;
+
+        nVertices = Simulator.GetNumVertices();
+        nCoeffs = options.dwOrder * options.dwOrder;
+        aResults.resize( ( size_t )nVertices * nCoeffs * options.dwNumChannels );
+
+        strTransfer = NativePath( options.strOutputPRTBuffer ) + L".transfer";
+        strCheckpoint = NativePath( options.strOutputPRTBuffer ) + L".checkpoint";
+
+        printf( "\nComputing Direct Lighting and %u Bounces..\n", options.dwNumBounces - 1 );
+        hr = Simulator.Simulate( options.dwOrder, options.dwNumRays, options.dwNumBounces, options.dwNumChannels,
+                                 aResults.data(), strCheckpoint.c_str(), NATIVE_CHECKPOINT_SECONDS, nThreads,
+                                 StaticPRTNativeCB, NULL );
+        printf( "\n" );
+
+        if( Simulator.GetResumedPass() >= 0 )
+            printf( "Carried on from pass %d of %ls\n", Simulator.GetResumedPass() + 1, strCheckpoint.c_str() );
+        if( FAILED( hr ) )
+        {
+            if( hr == E_FAIL )
+                printf( "The work so far is saved to %ls\n", strCheckpoint.c_str() );
+            goto LCleanup;
+        }
+        printf( "%llu rays in %0.1f s: %0.2f million rays a second\n", ( unsigned long long )Simulator.GetNumRays(),
+                Simulator.GetSeconds(),
+                Simulator.GetNumRays() / ( 1e6 * ( Simulator.GetSeconds() > 1e-6 ? Simulator.GetSeconds() : 1e-6 ) ) );
+
+        printf( "Saving PRT transfer: %ls\n", strTransfer.c_str() );
+        if( FAILED( hr = SaveTransfer( strTransfer, nVertices, nCoeffs, options.dwNumChannels, aResults.data() ) ) )
+            printf( "Error: Failed saving to %ls\n", strTransfer.c_str() );
+    }
+    catch( const std::bad_alloc& )
+    {
+        hr = E_OUTOFMEMORY;
+    }
+
+LCleanup:
+    optFile.FreeOptions( &options );
+    return hr;
+}
+
+
+//-----------------------------------------------------------------------------
+static void DisplayUsage()
+{
+    printf( "\n" );
+    printf( "prtnative - PRTCmdLine's native PRT simulator, without Direct3D\n" );
+    printf( "\n" );
+    printf( "Usage: prtnative [/threads n] [filename1] [filename2] ...\n" );
+    printf( "\n" );
+    printf( "where:\n" );
+    printf( "\n" );
+    printf( "  [/threads n]\tThreads to simulate on, up to and by default one for each\n" );
+    printf( "  \t\tprocessor\n" );
+    printf( "  [filename*]\tSpecifies the XML files to read, options.xml if none are\n" );
+    printf( "  \t\tgiven.  See options.xml for an example options XML file\n" );
+    printf( "\n" );
+    printf( "Ctrl+C stops a simulation with its work saved to the PRT buffer's name plus\n" );
+    printf( ".checkpoint, and running it again carries on from there.\n" );
+}
+
+
+//-----------------------------------------------------------------------------
+int main( int argc, char* argv[] )
+{
+    // For the multibyte paths of wcstombs
+    setlocale( LC_ALL, "" );
+    signal( SIGINT, StopHandler );
+
+    UINT nThreads = 0;
+    std::vector <std::wstring> aFiles;
+    for( int i = 1; i < argc; i++ )
+    {
+        const char* strArg = argv[i];
+        if( ( strArg[0] == '/' || strArg[0] == '-' ) && strcmp( strArg + 1, "threads" ) == 0 )
+        {
+            if( i + 1 >= argc )
+            {
+                printf( "Missing count after /threads\n" );
+                DisplayUsage();
+                return 1;
+            }
+            nThreads = ( UINT )atoi( argv[++i] );
+            continue;
+        }
+        if( ( strArg[0] == '/' || strArg[0] == '-' ) && strcmp( strArg + 1, "?" ) == 0 )
+        {
+            DisplayUsage();
+            return 0;
+        }
+
+        std::vector <wchar_t> strWide( strlen( strArg ) + 1 );
+        if( mbstowcs( strWide.data(), strArg, strWide.size() ) == ( size_t )-1 )
+        {
+            printf( "Can not read the file name %s\n", strArg );
+            return 1;
+        }
+        aFiles.push_back( strWide.data() );
+    }
+    if( aFiles.empty() )
+        aFiles.push_back( L"options.xml" );
+
+    int nRet = 0;
+    for( size_t i = 0; i < aFiles.size() && !g_bStop; i++ )
+    {
+        if( FAILED( ProcessOptionsFile( aFiles[i].c_str(), nThreads ) ) )
+            nRet = 1;
+    }
+
+    return nRet;
+}
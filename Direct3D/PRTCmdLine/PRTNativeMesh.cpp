@@ -0,0 +1,1471 @@
+//----------------------------------------------------------------------------
+// File: PRTNativeMesh.cpp
+//
+// Desc: .x files for the native PRT simulator, read and written without D3DX
+//
+// Builds on its own, e.g.
+//     g++ -O2 -std=c++11 -I../../DXUT/Optional -c PRTNativeMesh.cpp
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//-----------------------------------------------------------------------------
+#include "PRTNativeMesh.h"
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <math.h>
+#include <map>
+#include <new>
+
+#define PRTNATIVE_MAX_PATH      1024
+
+// A .x file starts "xof 0303txt 0032": the version, the format and the size of a float
+#define XFILE_HEADER_SIZE       16
+
+// Compressed files follow the header with the size of the file uncompressed, header
+// included, then blocks of MSZIP: the sizes of the block uncompressed and compressed,
+// "CK" and a deflate stream, which may refer back into the blocks before it
+#define XFILE_MSZIP_SIGNATURE   0x4B43
+
+#define XFILE_NO_INDEX          0xFFFFFFFF
+
+
+//-----------------------------------------------------------------------------
+FILE* PRTNativeOpenFile( const wchar_t* strFile, const char* strMode )
+{
+#ifdef _WIN32
+    wchar_t strWideMode[8];
+    size_t i = 0;
+    for(; strMode[i] && i < 7; i++ )
+        strWideMode[i] = ( wchar_t )strMode[i];
+    strWideMode[i] = 0;
+
+    FILE* pFile = NULL;
+    if( _wfopen_s( &pFile, strFile, strWideMode ) != 0 )
+        return NULL;
+    return pFile;
+#else
+    char strPath[PRTNATIVE_MAX_PATH];
+    size_t nLength = wcstombs( strPath, strFile, sizeof( strPath ) );
+    if( nLength == ( size_t )-1 || nLength >= sizeof( strPath ) )
+        return NULL;
+    return fopen( strPath, strMode );
+#endif
+}
+
+
+//-----------------------------------------------------------------------------
+// Inflate, after zlib's puff.c.  Codes are decoded a bit at a time, which is plenty
+// for meshes of a few megabytes.
+//-----------------------------------------------------------------------------
+#define INFLATE_MAX_BITS        15
+#define INFLATE_MAX_LITERALS    286
+#define INFLATE_MAX_DISTANCES   30
+#define INFLATE_FIXED_LITERALS  288
+
+struct INFLATE_HUFFMAN
+{
+    short aCount[INFLATE_MAX_BITS + 1];     // Codes of each length
+    short aSymbol[INFLATE_FIXED_LITERALS];  // Symbols in order of their codes
+};
+
+struct INFLATE_STATE
+{
+    const BYTE* pIn;
+    size_t nIn;
+    size_t iIn;
+    UINT nBitBuffer;
+    UINT nBits;
+    std::vector <BYTE>* pOut;               // Earlier blocks stay here as history
+};
+
+static const short g_anLengthBase[29] =
+{
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const short g_anLengthExtra[29] =
+{
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const short g_anDistanceBase[30] =
+{
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+    4097, 6145, 8193, 12289, 16385, 24577
+};
+static const short g_anDistanceExtra[30] =
+{
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+// Returns false past the end of the input
+static bool InflateBits( INFLATE_STATE* s, UINT nNeed, UINT* pValue )
+{
+    UINT nValue = s->nBitBuffer;
+    while( s->nBits < nNeed )
+    {
+        if( s->iIn >= s->nIn )
+            return false;
+        nValue |= ( UINT )s->pIn[s->iIn++] << s->nBits;
+        s->nBits += 8;
+    }
+    s->nBitBuffer = nValue >> nNeed;
+    s->nBits -= nNeed;
+    *pValue = nValue & ( ( 1U << nNeed ) - 1 );
+    return true;
+}
+
+// Returns the symbol, or -1
+static int InflateDecode( INFLATE_STATE* s, const INFLATE_HUFFMAN* h )
+{
+    int nCode = 0, nFirst = 0, iIndex = 0;
+    for( int nLength = 1; nLength <= INFLATE_MAX_BITS; nLength++ )
+    {
+        UINT nBit;
+        if( !InflateBits( s, 1, &nBit ) )
+            return -1;
+        nCode |= nBit;
+        int nCount = h->aCount[nLength];
+        if( nCode - nCount < nFirst )
+            return h->aSymbol[iIndex + ( nCode - nFirst )];
+        iIndex += nCount;
+        nFirst += nCount;
+        nFirst <<= 1;
+        nCode <<= 1;
+    }
+    return -1;
+}
+
+// Returns false for lengths no code can have
+static bool InflateBuild( INFLATE_HUFFMAN* h, const short* pnLengths, int nSymbols )
+{
+    memset( h->aCount, 0, sizeof( h->aCount ) );
+    for( int i = 0; i < nSymbols; i++ )
+        h->aCount[pnLengths[i]]++;
+    if( h->aCount[0] == nSymbols )
+        return true;
+
+    int nLeft = 1;
+    for( int nLength = 1; nLength <= INFLATE_MAX_BITS; nLength++ )
+    {
+        nLeft <<= 1;
+        nLeft -= h->aCount[nLength];
+        if( nLeft < 0 )
+            return false;
+    }
+
+    short anOffsets[INFLATE_MAX_BITS + 1];
+    anOffsets[1] = 0;
+    for( int nLength = 1; nLength < INFLATE_MAX_BITS; nLength++ )
+        anOffsets[nLength + 1] = anOffsets[nLength] + h->aCount[nLength];
+    for( int i = 0; i < nSymbols; i++ )
+    {
+        if( pnLengths[i] != 0 )
+            h->aSymbol[anOffsets[pnLengths[i]]++] = ( short )i;
+    }
+    return true;
+}
+
+static bool InflateCodes( INFLATE_STATE* s, const INFLATE_HUFFMAN* pLiterals, const INFLATE_HUFFMAN* pDistances )
+{
+    std::vector <BYTE>& Out = *s->pOut;
+    for(; ; )
+    {
+        int nSymbol = InflateDecode( s, pLiterals );
+        if( nSymbol < 0 )
+            return false;
+        if( nSymbol < 256 )
+        {
+            Out.push_back( ( BYTE )nSymbol );
+            continue;
+        }
+        if( nSymbol == 256 )
+            return true;
+
+        nSymbol -= 257;
+        if( nSymbol >= 29 )
+            return false;
+        UINT nExtra;
+        if( !InflateBits( s, g_anLengthExtra[nSymbol], &nExtra ) )
+            return false;
+        size_t nLength = g_anLengthBase[nSymbol] + nExtra;
+
+        nSymbol = InflateDecode( s, pDistances );
+        if( nSymbol < 0 || nSymbol >= 30 )
+            return false;
+        if( !InflateBits( s, g_anDistanceExtra[nSymbol], &nExtra ) )
+            return false;
+        size_t nDistance = g_anDistanceBase[nSymbol] + nExtra;
+        if( nDistance > Out.size() )
+            return false;
+
+        // The copy may overlap what it writes
+        size_t iFrom = Out.size() - nDistance;
+        for( size_t i = 0; i < nLength; i++ )
+            Out.push_back( Out[iFrom + i] );
+    }
+}
+
+static bool InflateStored( INFLATE_STATE* s )
+{
+    s->nBitBuffer = 0;
+    s->nBits = 0;
+    if( s->iIn + 4 > s->nIn )
+        return false;
+    UINT nLength = s->pIn[s->iIn] | ( s->pIn[s->iIn + 1] << 8 );
+    UINT nCheck = s->pIn[s->iIn + 2] | ( s->pIn[s->iIn + 3] << 8 );
+    s->iIn += 4;
+    if( nLength != ( ~nCheck & 0xFFFF ) || s->iIn + nLength > s->nIn )
+        return false;
+    s->pOut->insert( s->pOut->end(), s->pIn + s->iIn, s->pIn + s->iIn + nLength );
+    s->iIn += nLength;
+    return true;
+}
+
+static bool InflateFixed( INFLATE_STATE* s )
+{
+    INFLATE_HUFFMAN Literals, Distances;
+    short anLengths[INFLATE_FIXED_LITERALS];
+    int i = 0;
+    for(; i < 144; i++ )
+        anLengths[i] = 8;
+    for(; i < 256; i++ )
+        anLengths[i] = 9;
+    for(; i < 280; i++ )
+        anLengths[i] = 7;
+    for(; i < INFLATE_FIXED_LITERALS; i++ )
+        anLengths[i] = 8;
+    InflateBuild( &Literals, anLengths, INFLATE_FIXED_LITERALS );
+    for( i = 0; i < INFLATE_MAX_DISTANCES; i++ )
+        anLengths[i] = 5;
+    InflateBuild( &Distances, anLengths, INFLATE_MAX_DISTANCES );
+    return InflateCodes( s, &Literals, &Distances );
+}
+
+static bool InflateDynamic( INFLATE_STATE* s )
+{
+    static const short s_anOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    UINT nLiterals, nDistances, nCodeLengths;
+    if( !InflateBits( s, 5, &nLiterals ) || !InflateBits( s, 5, &nDistances ) ||
+        !InflateBits( s, 4, &nCodeLengths ) )
+        return false;
+    nLiterals += 257;
+    nDistances += 1;
+    nCodeLengths += 4;
+    if( nLiterals > INFLATE_MAX_LITERALS || nDistances > INFLATE_MAX_DISTANCES )
+        return false;
+
+    short anLengths[INFLATE_MAX_LITERALS + INFLATE_MAX_DISTANCES];
+    UINT i;
+    for( i = 0; i < 19; i++ )
+    {
+        UINT nLength = 0;
+        if( i < nCodeLengths && !InflateBits( s, 3, &nLength ) )
+            return false;
+        anLengths[s_anOrder[i]] = ( short )nLength;
+    }
+
+    INFLATE_HUFFMAN Lengths, Literals, Distances;
+    if( !InflateBuild( &Lengths, anLengths, 19 ) )
+        return false;
+
+    for( i = 0; i < nLiterals + nDistances; )
+    {
+        int nSymbol = InflateDecode( s, &Lengths );
+        if( nSymbol < 0 )
+            return false;
+        if( nSymbol < 16 )
+        {
+            anLengths[i++] = ( short )nSymbol;
+            continue;
+        }
+
+        short nLength = 0;
+        UINT nRepeat;
+        if( nSymbol == 16 )
+        {
+            if( i == 0 || !InflateBits( s, 2, &nRepeat ) )
+                return false;
+            nLength = anLengths[i - 1];
+            nRepeat += 3;
+        }
+        else if( nSymbol == 17 )
+        {
+            if( !InflateBits( s, 3, &nRepeat ) )
+                return false;
+            nRepeat += 3;
+        }
+        else
+        {
+            if( !InflateBits( s, 7, &nRepeat ) )
+                return false;
+            nRepeat += 11;
+        }
+        if( i + nRepeat > nLiterals + nDistances )
+            return false;
+        while( nRepeat-- )
+            anLengths[i++] = nLength;
+    }
+
+    if( anLengths[256] == 0 ||
+        !InflateBuild( &Literals, anLengths, nLiterals ) ||
+        !InflateBuild( &Distances, anLengths + nLiterals, nDistances ) )
+        return false;
+    return InflateCodes( s, &Literals, &Distances );
+}
+
+// Appends the stream at pIn to *pOut
+static bool Inflate( const BYTE* pIn, size_t nIn, std::vector <BYTE>* pOut )
+{
+    INFLATE_STATE s;
+    s.pIn = pIn;
+    s.nIn = nIn;
+    s.iIn = 0;
+    s.nBitBuffer = 0;
+    s.nBits = 0;
+    s.pOut = pOut;
+
+    UINT nLast;
+    do
+    {
+        UINT nType;
+        if( !InflateBits( &s, 1, &nLast ) || !InflateBits( &s, 2, &nType ) )
+            return false;
+
+        bool bOK;
+        if( nType == 0 )
+            bOK = InflateStored( &s );
+        else if( nType == 1 )
+            bOK = InflateFixed( &s );
+        else if( nType == 2 )
+            bOK = InflateDynamic( &s );
+        else
+            bOK = false;
+        if( !bOK )
+            return false;
+    } while( !nLast );
+
+    return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Uncompresses the MSZIP blocks after the header of a compressed .x file
+//-----------------------------------------------------------------------------
+static HRESULT DecompressXFile( const BYTE* pData, size_t nData, std::vector <BYTE>* pOut )
+{
+    if( nData < XFILE_HEADER_SIZE + 4 )
+        return E_FAIL;
+    const BYTE* p = pData + XFILE_HEADER_SIZE;
+    const BYTE* pEnd = pData + nData;
+
+    DWORD dwSize = p[0] | ( p[1] << 8 ) | ( p[2] << 16 ) | ( ( DWORD )p[3] << 24 );
+    p += 4;
+    if( dwSize < XFILE_HEADER_SIZE )
+        return E_FAIL;
+    pOut->reserve( dwSize - XFILE_HEADER_SIZE );
+
+    while( p < pEnd )
+    {
+        if( pEnd - p < 6 )
+            return E_FAIL;
+        UINT nUncompressed = p[0] | ( p[1] << 8 );
+        UINT nCompressed = p[2] | ( p[3] << 8 );
+        UINT nSignature = p[4] | ( p[5] << 8 );
+        p += 4;
+        if( nSignature != XFILE_MSZIP_SIGNATURE || nCompressed < 2 || ( size_t )( pEnd - p ) < nCompressed )
+            return E_FAIL;
+
+        size_t nBefore = pOut->size();
+        if( !Inflate( p + 2, nCompressed - 2, pOut ) || pOut->size() - nBefore != nUncompressed )
+            return E_FAIL;
+        p += nCompressed;
+    }
+
+    return pOut->size() == dwSize - XFILE_HEADER_SIZE ? S_OK : E_FAIL;
+}
+
+
+//-----------------------------------------------------------------------------
+// Tokens of the text and binary formats.  The text format's punctuation and keywords
+// are turned into the binary format's tokens, and its numbers are read as data.
+//-----------------------------------------------------------------------------
+enum XTOKEN_TYPE
+{
+    XTOKEN_EOF = 0,
+    XTOKEN_NAME = 1,
+    XTOKEN_STRING = 2,
+    XTOKEN_INTEGER = 3,
+    XTOKEN_GUID = 5,
+    XTOKEN_INTEGER_LIST = 6,
+    XTOKEN_FLOAT_LIST = 7,
+    XTOKEN_OBRACE = 10,
+    XTOKEN_CBRACE = 11,
+    XTOKEN_OPAREN = 12,
+    XTOKEN_CPAREN = 13,
+    XTOKEN_OBRACKET = 14,
+    XTOKEN_CBRACKET = 15,
+    XTOKEN_OANGLE = 16,
+    XTOKEN_CANGLE = 17,
+    XTOKEN_DOT = 18,
+    XTOKEN_COMMA = 19,
+    XTOKEN_SEMICOLON = 20,
+    XTOKEN_TEMPLATE = 31,
+    XTOKEN_FIRST_KEYWORD = 40,  // The binary format's type keywords, WORD to ARRAY
+    XTOKEN_LAST_KEYWORD = 52,
+    XTOKEN_NUMBER = 100,        // Text only
+    XTOKEN_ERROR = 101,
+};
+
+struct XTOKEN
+{
+    XTOKEN_TYPE Type;
+    const char* pText;          // Of a name, string or text number
+    size_t nText;
+};
+
+
+//-----------------------------------------------------------------------------
+// Steps through the tokens of a .x file.  Next gives the tokens objects are made of;
+// ReadDWORD, ReadFloat and ReadString read the data of an object, stepping over the
+// separators of the text format and through the lists of the binary format.
+//-----------------------------------------------------------------------------
+class CXFileReader
+{
+public:
+    CXFileReader( const BYTE* pData, size_t nData, bool bBinary, UINT nFloatSize )
+    {
+        m_p = pData;
+        m_pEnd = pData + nData;
+        m_bBinary = bBinary;
+        m_nFloatSize = nFloatSize;
+        m_nListLeft = 0;
+        m_bFloatList = false;
+    }
+
+    XTOKEN  Next();
+    bool    ReadDWORD( DWORD* pdwValue );
+    bool    ReadFloat( float* pfValue );
+    bool    ReadString( std::string* pstrValue );
+
+protected:
+    XTOKEN  NextBinary();
+    XTOKEN  NextText();
+    bool    NextListItem( bool bFloat );
+
+    const BYTE* m_p;
+    const BYTE* m_pEnd;
+    bool m_bBinary;
+    UINT m_nFloatSize;
+    DWORD m_nListLeft;          // Items of the binary list being read
+    bool m_bFloatList;
+};
+
+static DWORD ReadLittleEndian( const BYTE* p )
+{
+    return p[0] | ( p[1] << 8 ) | ( p[2] << 16 ) | ( ( DWORD )p[3] << 24 );
+}
+
+XTOKEN CXFileReader::NextBinary()
+{
+    XTOKEN Token = { XTOKEN_ERROR, NULL, 0 };
+    if( m_p == m_pEnd )
+    {
+        Token.Type = XTOKEN_EOF;
+        return Token;
+    }
+    if( m_pEnd - m_p < 2 )
+        return Token;
+    UINT nType = m_p[0] | ( m_p[1] << 8 );
+    m_p += 2;
+    size_t nLeft = m_pEnd - m_p;
+
+    switch( nType )
+    {
+        case XTOKEN_NAME:
+        case XTOKEN_STRING:
+        {
+            if( nLeft < 4 )
+                return Token;
+            DWORD nLength = ReadLittleEndian( m_p );
+            size_t nTerminator = nType == XTOKEN_STRING ? 2 : 0;
+            if( nLeft - 4 < ( size_t )nLength + nTerminator )
+                return Token;
+            Token.pText = ( const char* )m_p + 4;
+            Token.nText = nLength;
+            m_p += 4 + nLength + nTerminator;
+            break;
+        }
+        case XTOKEN_INTEGER:
+            if( nLeft < 4 )
+                return Token;
+            Token.pText = ( const char* )m_p;
+            m_p += 4;
+            break;
+        case XTOKEN_GUID:
+            if( nLeft < 16 )
+                return Token;
+            m_p += 16;
+            break;
+        case XTOKEN_INTEGER_LIST:
+        case XTOKEN_FLOAT_LIST:
+        {
+            if( nLeft < 4 )
+                return Token;
+            DWORD nCount = ReadLittleEndian( m_p );
+            size_t nItem = nType == XTOKEN_FLOAT_LIST ? m_nFloatSize : 4;
+            if( ( nLeft - 4 ) / nItem < nCount )
+                return Token;
+            Token.pText = ( const char* )m_p;
+            Token.nText = nCount;
+            m_p += 4 + nCount * nItem;
+            break;
+        }
+        default:
+            if( !( nType >= XTOKEN_OBRACE && nType <= XTOKEN_SEMICOLON ) && nType != XTOKEN_TEMPLATE &&
+                !( nType >= XTOKEN_FIRST_KEYWORD && nType <= XTOKEN_LAST_KEYWORD ) )
+                return Token;
+            break;
+    }
+
+    Token.Type = ( XTOKEN_TYPE )nType;
+    return Token;
+}
+
+XTOKEN CXFileReader::NextText()
+{
+    XTOKEN Token = { XTOKEN_ERROR, NULL, 0 };
+
+    // Whitespace and comments, which run from // or # to the end of the line
+    for(; ; )
+    {
+        while( m_p < m_pEnd && ( *m_p == ' ' || *m_p == '\t' || *m_p == '\r' || *m_p == '\n' ) )
+            m_p++;
+        if( m_p < m_pEnd && ( *m_p == '#' || ( *m_p == '/' && m_p + 1 < m_pEnd && m_p[1] == '/' ) ) )
+        {
+            while( m_p < m_pEnd && *m_p != '\n' )
+                m_p++;
+            continue;
+        }
+        break;
+    }
+    if( m_p == m_pEnd )
+    {
+        Token.Type = XTOKEN_EOF;
+        return Token;
+    }
+
+    const char c = *m_p;
+    switch( c )
+    {
+        case '{': Token.Type = XTOKEN_OBRACE; m_p++; return Token;
+        case '}': Token.Type = XTOKEN_CBRACE; m_p++; return Token;
+        case '[': Token.Type = XTOKEN_OBRACKET; m_p++; return Token;
+        case ']': Token.Type = XTOKEN_CBRACKET; m_p++; return Token;
+        case ',': Token.Type = XTOKEN_COMMA; m_p++; return Token;
+        case ';': Token.Type = XTOKEN_SEMICOLON; m_p++; return Token;
+        case '<':
+        {
+            const BYTE* pClose = ( const BYTE* )memchr( m_p, '>', m_pEnd - m_p );
+            if( pClose == NULL )
+                return Token;
+            Token.Type = XTOKEN_GUID;
+            m_p = pClose + 1;
+            return Token;
+        }
+        case '"':
+        {
+            const BYTE* pClose = ( const BYTE* )memchr( m_p + 1, '"', m_pEnd - m_p - 1 );
+            if( pClose == NULL )
+                return Token;
+            Token.Type = XTOKEN_STRING;
+            Token.pText = ( const char* )m_p + 1;
+            Token.nText = pClose - m_p - 1;
+            m_p = pClose + 1;
+            return Token;
+        }
+    }
+
+    // A name, keyword or number runs to the next space or punctuation
+    const BYTE* pStart = m_p;
+    while( m_p < m_pEnd && !strchr( " \t\r\n{}[],;<>\"", *m_p ) )
+        m_p++;
+    Token.pText = ( const char* )pStart;
+    Token.nText = m_p - pStart;
+    if( ( c >= '0' && c <= '9' ) || c == '-' || c == '+' || c == '.' )
+        Token.Type = XTOKEN_NUMBER;
+    else if( Token.nText == 8 && memcmp( pStart, "template", 8 ) == 0 )
+        Token.Type = XTOKEN_TEMPLATE;
+    else
+        Token.Type = XTOKEN_NAME;
+    return Token;
+}
+
+XTOKEN CXFileReader::Next()
+{
+    // What is left of a list is data no one asked for
+    if( m_nListLeft > 0 )
+    {
+        m_p += m_nListLeft * ( m_bFloatList ? m_nFloatSize : 4 );
+        m_nListLeft = 0;
+    }
+
+    for(; ; )
+    {
+        XTOKEN Token = m_bBinary ? NextBinary() : NextText();
+        if( Token.Type != XTOKEN_COMMA && Token.Type != XTOKEN_SEMICOLON )
+            return Token;
+    }
+}
+
+// Moves on to the next item of a binary list, starting a new list if need be
+bool CXFileReader::NextListItem( bool bFloat )
+{
+    if( m_nListLeft > 0 )
+        return m_bFloatList == bFloat;
+
+    for(; ; )
+    {
+        const BYTE* pStart = m_p;
+        XTOKEN Token = NextBinary();
+        if( Token.Type == XTOKEN_COMMA || Token.Type == XTOKEN_SEMICOLON )
+            continue;
+        if( Token.Type == XTOKEN_INTEGER && !bFloat )
+        {
+            // A lone integer reads as a list of one
+            m_p = ( const BYTE* )Token.pText;
+            m_nListLeft = 1;
+            m_bFloatList = false;
+            return true;
+        }
+        if( ( Token.Type == XTOKEN_INTEGER_LIST && !bFloat ) || ( Token.Type == XTOKEN_FLOAT_LIST && bFloat ) )
+        {
+            if( Token.nText == 0 )
+                continue;
+            m_p = ( const BYTE* )Token.pText + 4;
+            m_nListLeft = ( DWORD )Token.nText;
+            m_bFloatList = bFloat;
+            return true;
+        }
+        m_p = pStart;
+        return false;
+    }
+}
+
+bool CXFileReader::ReadDWORD( DWORD* pdwValue )
+{
+    if( m_bBinary )
+    {
+        if( !NextListItem( false ) )
+            return false;
+        *pdwValue = ReadLittleEndian( m_p );
+        m_p += 4;
+        m_nListLeft--;
+        return true;
+    }
+
+    XTOKEN Token = Next();
+    if( Token.Type != XTOKEN_NUMBER )
+        return false;
+    char* pEnd;
+    *pdwValue = ( DWORD )strtoul( Token.pText, &pEnd, 10 );
+    return pEnd == Token.pText + Token.nText;
+}
+
+bool CXFileReader::ReadFloat( float* pfValue )
+{
+    if( m_bBinary )
+    {
+        if( !NextListItem( true ) )
+            return false;
+        if( m_nFloatSize == 8 )
+        {
+            double f;
+            memcpy( &f, m_p, 8 );
+            *pfValue = ( float )f;
+        }
+        else
+        {
+            memcpy( pfValue, m_p, 4 );
+        }
+        m_p += m_nFloatSize;
+        m_nListLeft--;
+        return true;
+    }
+
+    XTOKEN Token = Next();
+    if( Token.Type != XTOKEN_NUMBER )
+        return false;
+
+    // strtod would run on past the token into the separator after it, which is fine,
+    // but the token must be a number all the way through
+    char strNumber[64];
+    if( Token.nText >= sizeof( strNumber ) )
+        return false;
+    memcpy( strNumber, Token.pText, Token.nText );
+    strNumber[Token.nText] = 0;
+    char* pEnd;
+    *pfValue = ( float )strtod( strNumber, &pEnd );
+    return pEnd == strNumber + Token.nText;
+}
+
+bool CXFileReader::ReadString( std::string* pstrValue )
+{
+    XTOKEN Token = Next();
+    if( Token.Type != XTOKEN_STRING )
+        return false;
+    pstrValue->assign( Token.pText, Token.nText );
+    return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Reads the objects of a .x file into one mesh
+//-----------------------------------------------------------------------------
+class CXMeshLoader
+{
+public:
+    CXMeshLoader( CXFileReader* pReader, PRTNATIVE_MESH* pMesh )
+    {
+        m_pReader = pReader;
+        m_pMesh = pMesh;
+    }
+
+    HRESULT Load();
+
+protected:
+    HRESULT OpenObject( std::string* pstrName );
+    HRESULT SkipObject();
+    HRESULT ParseObject( const XTOKEN& Type, std::string* pstrName );
+    HRESULT ParseFrame();
+    HRESULT ParseMesh();
+    HRESULT ParseMaterial( PRTNATIVE_MATERIAL* pMaterial );
+    HRESULT ParseMaterialList( std::vector <DWORD>* paFaceMaterials, std::vector <PRTNATIVE_MATERIAL>* paMaterials );
+    HRESULT ParseFaces( DWORD nFaces, std::vector <DWORD>* paFaces );
+
+    CXFileReader* m_pReader;
+    PRTNATIVE_MESH* m_pMesh;
+    std::map <std::string, PRTNATIVE_MATERIAL> m_NamedMaterials;   // Top level ones, for references
+};
+
+static bool IsName( const XTOKEN& Token, const char* strName )
+{
+    return Token.Type == XTOKEN_NAME && Token.nText == strlen( strName ) &&
+        memcmp( Token.pText, strName, Token.nText ) == 0;
+}
+
+static void SetDefaultMaterial( PRTNATIVE_MATERIAL* pMaterial )
+{
+    PRTNATIVE_COLOR White = { 1.0f, 1.0f, 1.0f };
+    PRTNATIVE_COLOR Black = { 0.0f, 0.0f, 0.0f };
+    pMaterial->Diffuse = White;
+    pMaterial->fAlpha = 1.0f;
+    pMaterial->fPower = 0.0f;
+    pMaterial->Specular = Black;
+    pMaterial->Emissive = Black;
+    pMaterial->strTexture.clear();
+}
+
+// Reads the name and GUID an object may have, and its opening brace
+HRESULT CXMeshLoader::OpenObject( std::string* pstrName )
+{
+    XTOKEN Token = m_pReader->Next();
+    if( Token.Type == XTOKEN_NAME )
+    {
+        if( pstrName )
+            pstrName->assign( Token.pText, Token.nText );
+        Token = m_pReader->Next();
+    }
+    if( Token.Type == XTOKEN_GUID )
+        Token = m_pReader->Next();
+    return Token.Type == XTOKEN_OBRACE ? S_OK : E_FAIL;
+}
+
+// Skips to the brace closing the object being read
+HRESULT CXMeshLoader::SkipObject()
+{
+    UINT nDepth = 1;
+    while( nDepth > 0 )
+    {
+        XTOKEN Token = m_pReader->Next();
+        if( Token.Type == XTOKEN_EOF || Token.Type == XTOKEN_ERROR )
+            return E_FAIL;
+        if( Token.Type == XTOKEN_OBRACE )
+            nDepth++;
+        else if( Token.Type == XTOKEN_CBRACE )
+            nDepth--;
+    }
+    return S_OK;
+}
+
+// Reads an object whose type has been read.  pstrName, which may be NULL, gets its name.
+HRESULT CXMeshLoader::ParseObject( const XTOKEN& Type, std::string* pstrName )
+{
+    HRESULT hr = OpenObject( pstrName );
+    if( FAILED( hr ) )
+        return hr;
+
+    if( IsName( Type, "Frame" ) )
+        return ParseFrame();
+    if( IsName( Type, "Mesh" ) )
+        return ParseMesh();
+    return SkipObject();
+}
+
+HRESULT CXMeshLoader::Load()
+{
+    HRESULT hr;
+    for(; ; )
+    {
+        XTOKEN Token = m_pReader->Next();
+        if( Token.Type == XTOKEN_EOF )
+            return S_OK;
+
+        if( Token.Type == XTOKEN_TEMPLATE )
+        {
+            if( FAILED( hr = OpenObject( NULL ) ) || FAILED( hr = SkipObject() ) )
+                return hr;
+        }
+        else if( IsName( Token, "Material" ) )
+        {
+            // Materials named at the top level are used by reference from the meshes
+            std::string strName;
+            PRTNATIVE_MATERIAL Material;
+            if( FAILED( hr = OpenObject( &strName ) ) || FAILED( hr = ParseMaterial( &Material ) ) )
+                return hr;
+            m_NamedMaterials[strName] = Material;
+        }
+        else if( Token.Type == XTOKEN_NAME )
+        {
+            if( FAILED( hr = ParseObject( Token, NULL ) ) )
+                return hr;
+        }
+        else
+        {
+            return E_FAIL;
+        }
+    }
+}
+
+// Moves the meshes in the frame, its own and those of the frames in it, by its transform
+HRESULT CXMeshLoader::ParseFrame()
+{
+    HRESULT hr;
+    const UINT iFirst = ( UINT )m_pMesh->aPositions.size();
+    PRTNATIVE_MATRIX mLocal;
+    memset( &mLocal, 0, sizeof( mLocal ) );
+    for( int i = 0; i < 4; i++ )
+        mLocal.m[i][i] = 1.0f;
+
+    for(; ; )
+    {
+        XTOKEN Token = m_pReader->Next();
+        if( Token.Type == XTOKEN_CBRACE )
+            break;
+
+        if( Token.Type == XTOKEN_OBRACE )
+        {
+            // A reference to an object elsewhere
+            if( FAILED( hr = SkipObject() ) )
+                return hr;
+        }
+        else if( IsName( Token, "FrameTransformMatrix" ) )
+        {
+            if( FAILED( hr = OpenObject( NULL ) ) )
+                return hr;
+            for( int i = 0; i < 16; i++ )
+            {
+                if( !m_pReader->ReadFloat( &mLocal.m[i / 4][i % 4] ) )
+                    return E_FAIL;
+            }
+            if( FAILED( hr = SkipObject() ) )
+                return hr;
+        }
+        else if( Token.Type == XTOKEN_NAME )
+        {
+            if( FAILED( hr = ParseObject( Token, NULL ) ) )
+                return hr;
+        }
+        else
+        {
+            return E_FAIL;
+        }
+    }
+
+    PRTNativeTransformMesh( m_pMesh, iFirst, mLocal );
+    return S_OK;
+}
+
+// Reads nFaces MeshFaces as their corner counts each followed by the corners
+HRESULT CXMeshLoader::ParseFaces( DWORD nFaces, std::vector <DWORD>* paFaces )
+{
+    for( DWORD iFace = 0; iFace < nFaces; iFace++ )
+    {
+        DWORD nCorners;
+        if( !m_pReader->ReadDWORD( &nCorners ) )
+            return E_FAIL;
+        paFaces->push_back( nCorners );
+        for( DWORD i = 0; i < nCorners; i++ )
+        {
+            DWORD iCorner;
+            if( !m_pReader->ReadDWORD( &iCorner ) )
+                return E_FAIL;
+            paFaces->push_back( iCorner );
+        }
+    }
+    return S_OK;
+}
+
+HRESULT CXMeshLoader::ParseMaterial( PRTNATIVE_MATERIAL* pMaterial )
+{
+    HRESULT hr;
+    SetDefaultMaterial( pMaterial );
+    float af[11];
+    for( int i = 0; i < 11; i++ )
+    {
+        if( !m_pReader->ReadFloat( &af[i] ) )
+            return E_FAIL;
+    }
+    PRTNATIVE_COLOR Diffuse = { af[0], af[1], af[2] };
+    PRTNATIVE_COLOR Specular = { af[5], af[6], af[7] };
+    PRTNATIVE_COLOR Emissive = { af[8], af[9], af[10] };
+    pMaterial->Diffuse = Diffuse;
+    pMaterial->fAlpha = af[3];
+    pMaterial->fPower = af[4];
+    pMaterial->Specular = Specular;
+    pMaterial->Emissive = Emissive;
+
+    for(; ; )
+    {
+        XTOKEN Token = m_pReader->Next();
+        if( Token.Type == XTOKEN_CBRACE )
+            return S_OK;
+
+        if( IsName( Token, "TextureFilename" ) || IsName( Token, "TextureFileName" ) )
+        {
+            if( FAILED( hr = OpenObject( NULL ) ) )
+                return hr;
+            if( !m_pReader->ReadString( &pMaterial->strTexture ) )
+                return E_FAIL;
+            if( FAILED( hr = SkipObject() ) )
+                return hr;
+        }
+        else if( Token.Type == XTOKEN_NAME )
+        {
+            if( FAILED( hr = OpenObject( NULL ) ) || FAILED( hr = SkipObject() ) )
+                return hr;
+        }
+        else if( Token.Type == XTOKEN_OBRACE )
+        {
+            if( FAILED( hr = SkipObject() ) )
+                return hr;
+        }
+        else
+        {
+            return E_FAIL;
+        }
+    }
+}
+
+// The material of each face, then the materials, inline or by reference
+HRESULT CXMeshLoader::ParseMaterialList( std::vector <DWORD>* paFaceMaterials,
+                                         std::vector <PRTNATIVE_MATERIAL>* paMaterials )
+{
+    HRESULT hr;
+    DWORD nMaterials, nFaceIndexes;
+    if( !m_pReader->ReadDWORD( &nMaterials ) || !m_pReader->ReadDWORD( &nFaceIndexes ) )
+        return E_FAIL;
+    for( DWORD i = 0; i < nFaceIndexes; i++ )
+    {
+        DWORD iMaterial;
+        if( !m_pReader->ReadDWORD( &iMaterial ) )
+            return E_FAIL;
+        paFaceMaterials->push_back( iMaterial );
+    }
+
+    for(; ; )
+    {
+        XTOKEN Token = m_pReader->Next();
+        if( Token.Type == XTOKEN_CBRACE )
+            break;
+
+        PRTNATIVE_MATERIAL Material;
+        if( IsName( Token, "Material" ) )
+        {
+            if( FAILED( hr = OpenObject( NULL ) ) || FAILED( hr = ParseMaterial( &Material ) ) )
+                return hr;
+            paMaterials->push_back( Material );
+        }
+        else if( Token.Type == XTOKEN_OBRACE )
+        {
+            // { Name } refers to a material at the top level
+            Token = m_pReader->Next();
+            if( Token.Type != XTOKEN_NAME )
+                return E_FAIL;
+            std::map <std::string, PRTNATIVE_MATERIAL>::const_iterator it =
+                m_NamedMaterials.find( std::string( Token.pText, Token.nText ) );
+            if( it != m_NamedMaterials.end() )
+                Material = it->second;
+            else
+                SetDefaultMaterial( &Material );
+            paMaterials->push_back( Material );
+            if( FAILED( hr = SkipObject() ) )
+                return hr;
+        }
+        else if( Token.Type == XTOKEN_NAME )
+        {
+            if( FAILED( hr = OpenObject( NULL ) ) || FAILED( hr = SkipObject() ) )
+                return hr;
+        }
+        else
+        {
+            return E_FAIL;
+        }
+    }
+
+    PRTNATIVE_MATERIAL Default;
+    SetDefaultMaterial( &Default );
+    paMaterials->resize( nMaterials > 0 ? nMaterials : 1, Default );
+    return S_OK;
+}
+
+HRESULT CXMeshLoader::ParseMesh()
+{
+    HRESULT hr;
+
+    DWORD nVertices;
+    if( !m_pReader->ReadDWORD( &nVertices ) )
+        return E_FAIL;
+    std::vector <PRTNATIVE_VECTOR> aPositions( nVertices );
+    for( DWORD i = 0; i < nVertices; i++ )
+    {
+        if( !m_pReader->ReadFloat( &aPositions[i].x ) || !m_pReader->ReadFloat( &aPositions[i].y ) ||
+            !m_pReader->ReadFloat( &aPositions[i].z ) )
+            return E_FAIL;
+    }
+
+    DWORD nFaces;
+    std::vector <DWORD> aFaces;
+    if( !m_pReader->ReadDWORD( &nFaces ) || FAILED( hr = ParseFaces( nFaces, &aFaces ) ) )
+        return E_FAIL;
+
+    std::vector <PRTNATIVE_VECTOR> aNormals;
+    std::vector <DWORD> aNormalFaces;
+    std::vector <float> aTexCoords;
+    std::vector <DWORD> aFaceMaterials;
+    std::vector <PRTNATIVE_MATERIAL> aMaterials;
+
+    for(; ; )
+    {
+        XTOKEN Token = m_pReader->Next();
+        if( Token.Type == XTOKEN_CBRACE )
+            break;
+
+        if( IsName( Token, "MeshNormals" ) )
+        {
+            DWORD nNormals, nNormalFaces;
+            if( FAILED( hr = OpenObject( NULL ) ) )
+                return hr;
+            if( !m_pReader->ReadDWORD( &nNormals ) )
+                return E_FAIL;
+            aNormals.resize( nNormals );
+            for( DWORD i = 0; i < nNormals; i++ )
+            {
+                if( !m_pReader->ReadFloat( &aNormals[i].x ) || !m_pReader->ReadFloat( &aNormals[i].y ) ||
+                    !m_pReader->ReadFloat( &aNormals[i].z ) )
+                    return E_FAIL;
+            }
+            if( !m_pReader->ReadDWORD( &nNormalFaces ) || FAILED( ParseFaces( nNormalFaces, &aNormalFaces ) ) )
+                return E_FAIL;
+            if( FAILED( hr = SkipObject() ) )
+                return hr;
+        }
+        else if( IsName( Token, "MeshTextureCoords" ) )
+        {
+            DWORD nCoords;
+            if( FAILED( hr = OpenObject( NULL ) ) )
+                return hr;
+            if( !m_pReader->ReadDWORD( &nCoords ) )
+                return E_FAIL;
+            aTexCoords.resize( ( size_t )nCoords * 2 );
+            for( size_t i = 0; i < aTexCoords.size(); i++ )
+            {
+                if( !m_pReader->ReadFloat( &aTexCoords[i] ) )
+                    return E_FAIL;
+            }
+            if( FAILED( hr = SkipObject() ) )
+                return hr;
+            if( nCoords != nVertices )
+                aTexCoords.clear();
+        }
+        else if( IsName( Token, "MeshMaterialList" ) )
+        {
+            if( FAILED( hr = OpenObject( NULL ) ) ||
+                FAILED( hr = ParseMaterialList( &aFaceMaterials, &aMaterials ) ) )
+                return hr;
+        }
+        else if( Token.Type == XTOKEN_NAME )
+        {
+            if( FAILED( hr = OpenObject( NULL ) ) || FAILED( hr = SkipObject() ) )
+                return hr;
+        }
+        else if( Token.Type == XTOKEN_OBRACE )
+        {
+            if( FAILED( hr = SkipObject() ) )
+                return hr;
+        }
+        else
+        {
+            return E_FAIL;
+        }
+    }
+
+    // The normals are used if their faces have the same corners as the mesh's
+    bool bNormals = aNormalFaces.size() == aFaces.size();
+    for( size_t i = 0; bNormals && i < aFaces.size(); )
+    {
+        bNormals = aNormalFaces[i] == aFaces[i];
+        i += 1 + aFaces[i];
+    }
+
+    if( aMaterials.empty() )
+    {
+        PRTNATIVE_MATERIAL Default;
+        SetDefaultMaterial( &Default );
+        aMaterials.push_back( Default );
+    }
+
+    // Each corner's vertex, split from the others where the normals differ.  The first
+    // normal a vertex is used with keeps the vertex, and the rest get copies of it
+    // after the mesh's own vertices.
+    PRTNATIVE_MESH Mesh;
+    Mesh.aPositions = aPositions;
+    Mesh.aNormals.resize( nVertices );
+    memset( Mesh.aNormals.data(), 0, nVertices * sizeof( PRTNATIVE_VECTOR ) );
+    Mesh.aTexCoords = aTexCoords;
+    Mesh.aMaterials = aMaterials;
+
+    std::vector <DWORD> aVertexNormal( nVertices, XFILE_NO_INDEX );
+    std::map <std::pair <DWORD, DWORD>, DWORD> Copies;
+    std::vector <DWORD> aCorners;
+    DWORD iFace = 0;
+    for( size_t i = 0; i < aFaces.size(); iFace++ )
+    {
+        const DWORD nCorners = aFaces[i];
+        if( nCorners > aFaces.size() - i - 1 )
+            return E_FAIL;
+
+        aCorners.resize( nCorners );
+        for( DWORD c = 0; c < nCorners; c++ )
+        {
+            DWORD iVertex = aFaces[i + 1 + c];
+            if( iVertex >= nVertices )
+                return E_FAIL;
+            if( bNormals )
+            {
+                DWORD iNormal = aNormalFaces[i + 1 + c];
+                if( iNormal >= aNormals.size() )
+                    return E_FAIL;
+                if( aVertexNormal[iVertex] == XFILE_NO_INDEX )
+                {
+                    aVertexNormal[iVertex] = iNormal;
+                    Mesh.aNormals[iVertex] = aNormals[iNormal];
+                }
+                else if( aVertexNormal[iVertex] != iNormal )
+                {
+                    std::pair <DWORD, DWORD> Key( iVertex, iNormal );
+                    std::map <std::pair <DWORD, DWORD>, DWORD>::const_iterator it = Copies.find( Key );
+                    if( it != Copies.end() )
+                    {
+                        iVertex = it->second;
+                    }
+                    else
+                    {
+                        DWORD iCopy = ( DWORD )Mesh.aPositions.size();
+                        Mesh.aPositions.push_back( aPositions[iVertex] );
+                        Mesh.aNormals.push_back( aNormals[iNormal] );
+                        if( !aTexCoords.empty() )
+                        {
+                            Mesh.aTexCoords.push_back( aTexCoords[iVertex * 2] );
+                            Mesh.aTexCoords.push_back( aTexCoords[iVertex * 2 + 1] );
+                        }
+                        Copies[Key] = iCopy;
+                        iVertex = iCopy;
+                    }
+                }
+            }
+            aCorners[c] = iVertex;
+        }
+
+        // A material list shorter than the faces repeats its last entry
+        DWORD iMaterial = 0;
+        if( !aFaceMaterials.empty() )
+            iMaterial = aFaceMaterials[iFace < aFaceMaterials.size() ? iFace : aFaceMaterials.size() - 1];
+        if( iMaterial >= aMaterials.size() )
+            iMaterial = ( DWORD )aMaterials.size() - 1;
+
+        for( DWORD c = 2; c < nCorners; c++ )
+        {
+            Mesh.aIndices.push_back( aCorners[0] );
+            Mesh.aIndices.push_back( aCorners[c - 1] );
+            Mesh.aIndices.push_back( aCorners[c] );
+            Mesh.aAttributes.push_back( iMaterial );
+        }
+        i += 1 + nCorners;
+    }
+
+    // Normals from the faces, weighted by their areas
+    if( !bNormals )
+    {
+        for( size_t i = 0; i < Mesh.aIndices.size(); i += 3 )
+        {
+            const PRTNATIVE_VECTOR& v0 = Mesh.aPositions[Mesh.aIndices[i]];
+            const PRTNATIVE_VECTOR& v1 = Mesh.aPositions[Mesh.aIndices[i + 1]];
+            const PRTNATIVE_VECTOR& v2 = Mesh.aPositions[Mesh.aIndices[i + 2]];
+            float e1x = v1.x - v0.x, e1y = v1.y - v0.y, e1z = v1.z - v0.z;
+            float e2x = v2.x - v0.x, e2y = v2.y - v0.y, e2z = v2.z - v0.z;
+            PRTNATIVE_VECTOR n = { e1y * e2z - e1z * e2y, e1z * e2x - e1x * e2z, e1x * e2y - e1y * e2x };
+            for( int c = 0; c < 3; c++ )
+            {
+                PRTNATIVE_VECTOR& Normal = Mesh.aNormals[Mesh.aIndices[i + c]];
+                Normal.x += n.x;
+                Normal.y += n.y;
+                Normal.z += n.z;
+            }
+        }
+    }
+
+    // Drop the vertices no face uses, keeping the order of the rest
+    std::vector <DWORD> aRemap( Mesh.aPositions.size(), XFILE_NO_INDEX );
+    for( size_t i = 0; i < Mesh.aIndices.size(); i++ )
+        aRemap[Mesh.aIndices[i]] = 0;
+    DWORD nUsed = 0;
+    for( size_t i = 0; i < aRemap.size(); i++ )
+    {
+        if( aRemap[i] == XFILE_NO_INDEX )
+            continue;
+        aRemap[i] = nUsed;
+        Mesh.aPositions[nUsed] = Mesh.aPositions[i];
+        Mesh.aNormals[nUsed] = Mesh.aNormals[i];
+        if( !Mesh.aTexCoords.empty() )
+        {
+            Mesh.aTexCoords[nUsed * 2] = Mesh.aTexCoords[i * 2];
+            Mesh.aTexCoords[nUsed * 2 + 1] = Mesh.aTexCoords[i * 2 + 1];
+        }
+        nUsed++;
+    }
+    Mesh.aPositions.resize( nUsed );
+    Mesh.aNormals.resize( nUsed );
+    if( !Mesh.aTexCoords.empty() )
+        Mesh.aTexCoords.resize( ( size_t )nUsed * 2 );
+    for( size_t i = 0; i < Mesh.aIndices.size(); i++ )
+        Mesh.aIndices[i] = aRemap[Mesh.aIndices[i]];
+
+    return PRTNativeAppendMesh( m_pMesh, &Mesh );
+}
+
+
+//-----------------------------------------------------------------------------
+HRESULT PRTNativeLoadMeshFromX( const wchar_t* strFile, PRTNATIVE_MESH* pMesh )
+{
+    *pMesh = PRTNATIVE_MESH();
+
+    FILE* pFile = PRTNativeOpenFile( strFile, "rb" );
+    if( pFile == NULL )
+        return E_FAIL;
+
+    HRESULT hr = E_FAIL;
+    try
+    {
+        std::vector <BYTE> aData;
+        BYTE aBuffer[65536];
+        size_t nRead;
+        while( ( nRead = fread( aBuffer, 1, sizeof( aBuffer ), pFile ) ) > 0 )
+            aData.insert( aData.end(), aBuffer, aBuffer + nRead );
+        fclose( pFile );
+        pFile = NULL;
+
+        if( aData.size() < XFILE_HEADER_SIZE || memcmp( aData.data(), "xof ", 4 ) != 0 )
+            return E_FAIL;
+        const char* strFormat = ( const char* )aData.data() + 8;
+        const char* strFloatSize = ( const char* )aData.data() + 12;
+        const bool bBinary = memcmp( strFormat, "bin ", 4 ) == 0 || memcmp( strFormat, "bzip", 4 ) == 0;
+        const bool bCompressed = memcmp( strFormat, "tzip", 4 ) == 0 || memcmp( strFormat, "bzip", 4 ) == 0;
+        if( !bBinary && !bCompressed && memcmp( strFormat, "txt ", 4 ) != 0 )
+            return E_FAIL;
+        UINT nFloatSize = memcmp( strFloatSize, "0064", 4 ) == 0 ? 8 : 4;
+
+        std::vector <BYTE> aUncompressed;
+        const BYTE* pBody = aData.data() + XFILE_HEADER_SIZE;
+        size_t nBody = aData.size() - XFILE_HEADER_SIZE;
+        if( bCompressed )
+        {
+            if( FAILED( hr = DecompressXFile( aData.data(), aData.size(), &aUncompressed ) ) )
+                return hr;
+            pBody = aUncompressed.data();
+            nBody = aUncompressed.size();
+        }
+
+        CXFileReader Reader( pBody, nBody, bBinary, nFloatSize );
+        CXMeshLoader Loader( &Reader, pMesh );
+        hr = Loader.Load();
+        if( SUCCEEDED( hr ) && pMesh->aIndices.empty() )
+            hr = E_FAIL;
+    }
+    catch( const std::bad_alloc& )
+    {
+        hr = E_OUTOFMEMORY;
+    }
+
+    if( pFile )
+        fclose( pFile );
+    return hr;
+}
+
+
+//-----------------------------------------------------------------------------
+HRESULT PRTNativeSaveMeshToX( const wchar_t* strFile, const PRTNATIVE_MESH* pMesh )
+{
+    FILE* pFile = PRTNativeOpenFile( strFile, "w" );
+    if( pFile == NULL )
+        return E_FAIL;
+
+    const size_t nVertices = pMesh->aPositions.size();
+    const size_t nFaces = pMesh->aAttributes.size();
+
+    fprintf( pFile, "xof 0303txt 0032\n\nMesh {\n %u;\n", ( UINT )nVertices );
+    for( size_t i = 0; i < nVertices; i++ )
+    {
+        const PRTNATIVE_VECTOR& v = pMesh->aPositions[i];
+        fprintf( pFile, " %f;%f;%f;%s\n", v.x, v.y, v.z, i + 1 < nVertices ? "," : ";" );
+    }
+    fprintf( pFile, " %u;\n", ( UINT )nFaces );
+    for( size_t i = 0; i < nFaces; i++ )
+    {
+        const DWORD* pFace = &pMesh->aIndices[i * 3];
+        fprintf( pFile, " 3;%u,%u,%u;%s\n", pFace[0], pFace[1], pFace[2], i + 1 < nFaces ? "," : ";" );
+    }
+
+    fprintf( pFile, "\n MeshNormals {\n  %u;\n", ( UINT )nVertices );
+    for( size_t i = 0; i < nVertices; i++ )
+    {
+        const PRTNATIVE_VECTOR& n = pMesh->aNormals[i];
+        fprintf( pFile, "  %f;%f;%f;%s\n", n.x, n.y, n.z, i + 1 < nVertices ? "," : ";" );
+    }
+    fprintf( pFile, "  %u;\n", ( UINT )nFaces );
+    for( size_t i = 0; i < nFaces; i++ )
+    {
+        const DWORD* pFace = &pMesh->aIndices[i * 3];
+        fprintf( pFile, "  3;%u,%u,%u;%s\n", pFace[0], pFace[1], pFace[2], i + 1 < nFaces ? "," : ";" );
+    }
+    fprintf( pFile, " }\n" );
+
+    if( !pMesh->aTexCoords.empty() )
+    {
+        fprintf( pFile, "\n MeshTextureCoords {\n  %u;\n", ( UINT )nVertices );
+        for( size_t i = 0; i < nVertices; i++ )
+            fprintf( pFile, "  %f;%f;%s\n", pMesh->aTexCoords[i * 2], pMesh->aTexCoords[i * 2 + 1],
+                     i + 1 < nVertices ? "," : ";" );
+        fprintf( pFile, " }\n" );
+    }
+
+    fprintf( pFile, "\n MeshMaterialList {\n  %u;\n  %u;\n", ( UINT )pMesh->aMaterials.size(), ( UINT )nFaces );
+    for( size_t i = 0; i < nFaces; i++ )
+        fprintf( pFile, "  %u%s\n", pMesh->aAttributes[i], i + 1 < nFaces ? "," : ";" );
+    for( size_t i = 0; i < pMesh->aMaterials.size(); i++ )
+    {
+        const PRTNATIVE_MATERIAL& m = pMesh->aMaterials[i];
+        fprintf( pFile, "\n  Material {\n   %f;%f;%f;%f;;\n   %f;\n   %f;%f;%f;;\n   %f;%f;%f;;\n",
+                 m.Diffuse.r, m.Diffuse.g, m.Diffuse.b, m.fAlpha, m.fPower, m.Specular.r, m.Specular.g,
+                 m.Specular.b, m.Emissive.r, m.Emissive.g, m.Emissive.b );
+        if( !m.strTexture.empty() )
+            fprintf( pFile, "\n   TextureFilename {\n    \"%s\";\n   }\n", m.strTexture.c_str() );
+        fprintf( pFile, "  }\n" );
+    }
+    fprintf( pFile, " }\n}\n" );
+
+    bool bFailed = ferror( pFile ) != 0;
+    if( fclose( pFile ) != 0 )
+        bFailed = true;
+    return bFailed ? E_FAIL : S_OK;
+}
+
+
+//-----------------------------------------------------------------------------
+void PRTNativeTransformMesh( PRTNATIVE_MESH* pMesh, UINT iFirst, const PRTNATIVE_MATRIX& m )
+{
+    // Normals go by the inverse transpose, which is the cofactors over the determinant
+    float c[3][3];
+    c[0][0] = m.m[1][1] * m.m[2][2] - m.m[1][2] * m.m[2][1];
+    c[0][1] = m.m[1][2] * m.m[2][0] - m.m[1][0] * m.m[2][2];
+    c[0][2] = m.m[1][0] * m.m[2][1] - m.m[1][1] * m.m[2][0];
+    c[1][0] = m.m[0][2] * m.m[2][1] - m.m[0][1] * m.m[2][2];
+    c[1][1] = m.m[0][0] * m.m[2][2] - m.m[0][2] * m.m[2][0];
+    c[1][2] = m.m[0][1] * m.m[2][0] - m.m[0][0] * m.m[2][1];
+    c[2][0] = m.m[0][1] * m.m[1][2] - m.m[0][2] * m.m[1][1];
+    c[2][1] = m.m[0][2] * m.m[1][0] - m.m[0][0] * m.m[1][2];
+    c[2][2] = m.m[0][0] * m.m[1][1] - m.m[0][1] * m.m[1][0];
+    float fDet = m.m[0][0] * c[0][0] + m.m[0][1] * c[0][1] + m.m[0][2] * c[0][2];
+    float fInvDet = fDet != 0.0f ? 1.0f / fDet : 1.0f;
+
+    for( size_t i = iFirst; i < pMesh->aPositions.size(); i++ )
+    {
+        PRTNATIVE_VECTOR& v = pMesh->aPositions[i];
+        float x = v.x * m.m[0][0] + v.y * m.m[1][0] + v.z * m.m[2][0] + m.m[3][0];
+        float y = v.x * m.m[0][1] + v.y * m.m[1][1] + v.z * m.m[2][1] + m.m[3][1];
+        float z = v.x * m.m[0][2] + v.y * m.m[1][2] + v.z * m.m[2][2] + m.m[3][2];
+        float w = v.x * m.m[0][3] + v.y * m.m[1][3] + v.z * m.m[2][3] + m.m[3][3];
+        if( w != 0.0f && w != 1.0f )
+        {
+            x /= w;
+            y /= w;
+            z /= w;
+        }
+        v.x = x;
+        v.y = y;
+        v.z = z;
+
+        PRTNATIVE_VECTOR& n = pMesh->aNormals[i];
+        float nx = ( n.x * c[0][0] + n.y * c[1][0] + n.z * c[2][0] ) * fInvDet;
+        float ny = ( n.x * c[0][1] + n.y * c[1][1] + n.z * c[2][1] ) * fInvDet;
+        float nz = ( n.x * c[0][2] + n.y * c[1][2] + n.z * c[2][2] ) * fInvDet;
+        n.x = nx;
+        n.y = ny;
+        n.z = nz;
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+HRESULT PRTNativeAppendMesh( PRTNATIVE_MESH* pMesh, const PRTNATIVE_MESH* pSource )
+{
+    try
+    {
+        const DWORD nVertices = ( DWORD )pMesh->aPositions.size();
+        const DWORD nMaterials = ( DWORD )pMesh->aMaterials.size();
+
+        // Texture coordinates are kept if either has them, and zero where one doesn't
+        if( !pSource->aTexCoords.empty() || !pMesh->aTexCoords.empty() )
+        {
+            pMesh->aTexCoords.resize( ( size_t )nVertices * 2, 0.0f );
+            if( !pSource->aTexCoords.empty() )
+                pMesh->aTexCoords.insert( pMesh->aTexCoords.end(), pSource->aTexCoords.begin(),
+                                          pSource->aTexCoords.end() );
+            else
+                pMesh->aTexCoords.resize( ( nVertices + pSource->aPositions.size() ) * 2, 0.0f );
+        }
+
+        pMesh->aPositions.insert( pMesh->aPositions.end(), pSource->aPositions.begin(), pSource->aPositions.end() );
+        pMesh->aNormals.insert( pMesh->aNormals.end(), pSource->aNormals.begin(), pSource->aNormals.end() );
+        for( size_t i = 0; i < pSource->aIndices.size(); i++ )
+            pMesh->aIndices.push_back( pSource->aIndices[i] + nVertices );
+        for( size_t i = 0; i < pSource->aAttributes.size(); i++ )
+            pMesh->aAttributes.push_back( pSource->aAttributes[i] + nMaterials );
+        pMesh->aMaterials.insert( pMesh->aMaterials.end(), pSource->aMaterials.begin(), pSource->aMaterials.end() );
+    }
+    catch( const std::bad_alloc& )
+    {
+        return E_OUTOFMEMORY;
+    }
+    return S_OK;
+}
@@ -0,0 +1,70 @@
+//----------------------------------------------------------------------------
+// File: PRTNativeMesh.h
+//
+// Triangle meshes read from and written to .x files with only the C++ library, for
+// running CPRTNativeSimulator where D3DX isn't available.  See PRTNativeMain.cpp.
+//
+// PRTNativeLoadMeshFromX reads text and binary files, compressed or not, as
+// D3DXLoadMeshFromX does: every mesh in the file is moved into place by the frames
+// around it and the meshes are concatenated, with their materials one after the other.
+// Polygons are split into fans of triangles, a vertex is split where its corners have
+// different normals, vertices no face uses are dropped, and meshes without normals get
+// them from the faces around each vertex.  Anything else in the file, such as skinning
+// and animation, is skipped.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//-----------------------------------------------------------------------------
+#pragma once
+#ifndef PRTNATIVEMESH_H
+#define PRTNATIVEMESH_H
+
+#include "PRTNativeSim.h"
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+// A D3DMATERIAL9 and the texture of a D3DXMATERIAL
+struct PRTNATIVE_MATERIAL
+{
+    PRTNATIVE_COLOR Diffuse;
+    float fAlpha;
+    float fPower;
+    PRTNATIVE_COLOR Specular;
+    PRTNATIVE_COLOR Emissive;
+    std::string strTexture;     // Empty for none
+};
+
+// The row vector matrix D3DXMATRIX is, so a vertex v goes to v * m
+struct PRTNATIVE_MATRIX
+{
+    float m[4][4];
+};
+
+struct PRTNATIVE_MESH
+{
+    std::vector <PRTNATIVE_VECTOR> aPositions;
+    std::vector <PRTNATIVE_VECTOR> aNormals;
+    std::vector <float> aTexCoords;             // Two for each vertex, or none
+    std::vector <DWORD> aIndices;               // Three for each face
+    std::vector <DWORD> aAttributes;            // The material of each face
+    std::vector <PRTNATIVE_MATERIAL> aMaterials;
+};
+
+HRESULT PRTNativeLoadMeshFromX( const wchar_t* strFile, PRTNATIVE_MESH* pMesh );
+
+// Writes the mesh as a text .x file D3DXLoadMeshFromX reads back with the same vertices
+// in the same order, which the transfer of each vertex relies on
+HRESULT PRTNativeSaveMeshToX( const wchar_t* strFile, const PRTNATIVE_MESH* pMesh );
+
+// Moves vertices iFirst on by m, and their normals by its inverse transpose.  The
+// normals are left unnormalized.
+void    PRTNativeTransformMesh( PRTNATIVE_MESH* pMesh, UINT iFirst, const PRTNATIVE_MATRIX& m );
+
+// Appends pSource to pMesh, its materials after those of pMesh
+HRESULT PRTNativeAppendMesh( PRTNATIVE_MESH* pMesh, const PRTNATIVE_MESH* pSource );
+
+// Opens a file by its wide path, through its multibyte form off Windows
+FILE*   PRTNativeOpenFile( const wchar_t* strFile, const char* strMode );
+
+#endif
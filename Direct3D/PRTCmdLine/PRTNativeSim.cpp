@@ -0,0 +1,1072 @@
+//----------------------------------------------------------------------------
+// File: PRTNativeSim.cpp
+//
+// Desc: CPU simulator for diffuse PRT transfer
+//
+// Builds on its own with the DXUT worker pool, e.g.
+//     g++ -O2 -std=c++11 -pthread -I../../DXUT/Optional -c PRTNativeSim.cpp
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//-----------------------------------------------------------------------------
+#include "PRTNativeSim.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <float.h>
+#include <math.h>
+
+#ifndef SAFE_DELETE_ARRAY
+#define SAFE_DELETE_ARRAY(p) { if (p) { delete[] (p);   (p)=NULL; } }
+#endif
+
+// Vertices a thread takes at a time, and the unit of a checkpoint
+#define PRTNATIVE_CHUNK_SIZE    64
+
+// Leaves are made at this many triangles, or fewer when splitting doesn't pay.  The
+// depth is limited so the traversal stack can't overflow.
+#define PRTNATIVE_LEAF_SIZE     2
+#define PRTNATIVE_MAX_LEAF_SIZE 8
+#define PRTNATIVE_MAX_DEPTH     48
+#define PRTNATIVE_STACK_SIZE    64
+#define PRTNATIVE_NUM_BINS      16
+
+// Rays start this fraction of the scene's size off the surface
+#define PRTNATIVE_EPSILON       1e-4f
+
+#define PRTNATIVE_PI            3.141592654f
+
+// How often the thread that called Simulate reports progress
+#define PRTNATIVE_PROGRESS_MS   250.0
+
+#define PRTNATIVE_MAX_PATH      1024
+
+#define PRTNATIVE_CHECKPOINT_MAGIC      0x4B435250      // 'PRCK'
+#define PRTNATIVE_CHECKPOINT_VERSION    1
+
+//-----------------------------------------------------------------------------
+// A checkpoint file is this header, a byte for each chunk of the pass saying whether
+// it is done, then the total of the passes done, the transfer of the pass before, and
+// the transfer of this pass so far, each nVertices * Order^2 * nChannels floats
+//-----------------------------------------------------------------------------
+struct PRTNATIVE_CHECKPOINT
+{
+    DWORD dwMagic;
+    DWORD dwVersion;
+    DWORD dwSceneHash;
+    UINT nVertices;
+    UINT Order;
+    UINT nRays;
+    UINT nBounces;
+    UINT nChannels;
+    UINT iPass;
+    UINT nChunks;
+};
+
+// Not windows.h's min and max, which are only there on Windows
+template <class T> static inline T PRTMin( T a, T b )
+{
+    return a < b ? a : b;
+}
+template <class T> static inline T PRTMax( T a, T b )
+{
+    return a > b ? a : b;
+}
+
+
+//-----------------------------------------------------------------------------
+// Vector math on PRTNATIVE_VECTOR, in place of D3DX's
+//-----------------------------------------------------------------------------
+static inline PRTNATIVE_VECTOR Vector( float x, float y, float z )
+{
+    PRTNATIVE_VECTOR v = { x, y, z };
+    return v;
+}
+
+static inline PRTNATIVE_VECTOR operator+( const PRTNATIVE_VECTOR& a, const PRTNATIVE_VECTOR& b )
+{
+    return Vector( a.x + b.x, a.y + b.y, a.z + b.z );
+}
+
+static inline PRTNATIVE_VECTOR operator-( const PRTNATIVE_VECTOR& a, const PRTNATIVE_VECTOR& b )
+{
+    return Vector( a.x - b.x, a.y - b.y, a.z - b.z );
+}
+
+static inline PRTNATIVE_VECTOR operator*( const PRTNATIVE_VECTOR& a, float f )
+{
+    return Vector( a.x * f, a.y * f, a.z * f );
+}
+
+static inline PRTNATIVE_VECTOR operator/( const PRTNATIVE_VECTOR& a, float f )
+{
+    float fInv = 1.0f / f;
+    return Vector( a.x * fInv, a.y * fInv, a.z * fInv );
+}
+
+static inline PRTNATIVE_VECTOR Cross( const PRTNATIVE_VECTOR& a, const PRTNATIVE_VECTOR& b )
+{
+    return Vector( a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x );
+}
+
+static inline float Dot( const PRTNATIVE_VECTOR& a, const PRTNATIVE_VECTOR& b )
+{
+    return a.x * b.x + a.y * b.y + a.z * b.z;
+}
+
+static inline float Length( const PRTNATIVE_VECTOR& a )
+{
+    return sqrtf( Dot( a, a ) );
+}
+
+static inline float GetAxis( const PRTNATIVE_VECTOR& a, int iAxis )
+{
+    return 0 == iAxis ? a.x : ( 1 == iAxis ? a.y : a.z );
+}
+
+
+//-----------------------------------------------------------------------------
+// The checkpoint file, by the wide path on Windows and by its multibyte form elsewhere
+//-----------------------------------------------------------------------------
+static FILE* OpenCheckpointFile( const wchar_t* strFile, bool bWrite )
+{
+#ifdef _WIN32
+    FILE* pFile = NULL;
+    if( 0 != _wfopen_s( &pFile, strFile, bWrite ? L"wb" : L"rb" ) )
+        return NULL;
+    return pFile;
+#else
+    char strPath[PRTNATIVE_MAX_PATH];
+    size_t nLength = wcstombs( strPath, strFile, PRTNATIVE_MAX_PATH );
+    if( nLength == ( size_t )-1 || nLength >= PRTNATIVE_MAX_PATH )
+        return NULL;
+    return fopen( strPath, bWrite ? "wb" : "rb" );
+#endif
+}
+
+static bool ReplaceCheckpointFile( const wchar_t* strFrom, const wchar_t* strTo )
+{
+#ifdef _WIN32
+    return FALSE != MoveFileExW( strFrom, strTo, MOVEFILE_REPLACE_EXISTING );
+#else
+    char strFromPath[PRTNATIVE_MAX_PATH], strToPath[PRTNATIVE_MAX_PATH];
+    size_t nFrom = wcstombs( strFromPath, strFrom, PRTNATIVE_MAX_PATH );
+    size_t nTo = wcstombs( strToPath, strTo, PRTNATIVE_MAX_PATH );
+    return nFrom < PRTNATIVE_MAX_PATH && nTo < PRTNATIVE_MAX_PATH && 0 == rename( strFromPath, strToPath );
+#endif
+}
+
+static void DeleteCheckpointFile( const wchar_t* strFile )
+{
+#ifdef _WIN32
+    DeleteFileW( strFile );
+#else
+    char strPath[PRTNATIVE_MAX_PATH];
+    size_t nLength = wcstombs( strPath, strFile, PRTNATIVE_MAX_PATH );
+    if( nLength < PRTNATIVE_MAX_PATH )
+        remove( strPath );
+#endif
+}
+
+
+//-----------------------------------------------------------------------------
+// FNV-1a, to tell whether a checkpoint was made from the same scene
+//-----------------------------------------------------------------------------
+static DWORD HashBytes( DWORD dwHash, const void* pData, size_t nBytes )
+{
+    const BYTE* pBytes = ( const BYTE* )pData;
+    for( size_t i = 0; i < nBytes; i++ )
+        dwHash = ( dwHash ^ pBytes[i] ) * 16777619;
+    return dwHash;
+}
+
+
+//-----------------------------------------------------------------------------
+// PCG random numbers.  Each vertex seeds its own sequence from its index and the pass.
+//-----------------------------------------------------------------------------
+static inline ULONGLONG SeedRandom( UINT iVertex, UINT iPass )
+{
+    return ( ( ULONGLONG )iVertex + 1 ) * 0x9E3779B97F4A7C15ULL ^ ( ( ULONGLONG )iPass + 1 ) * 0xD1B54A32D192ED03ULL;
+}
+
+static inline float NextRandom( ULONGLONG* pState )
+{
+    ULONGLONG State = *pState;
+    *pState = State * 6364136223846793005ULL + 1442695040888963407ULL;
+    UINT x = ( UINT )( ( ( State >> 18 ) ^ State ) >> 27 );
+    UINT Rotate = ( UINT )( State >> 59 );
+    x = ( x >> Rotate ) | ( x << ( ( 32 - Rotate ) & 31 ) );
+    return ( float )( x >> 8 ) * ( 1.0f / 16777216.0f );
+}
+
+
+//-----------------------------------------------------------------------------
+static inline float SurfaceArea( const PRTNATIVE_VECTOR& vMin, const PRTNATIVE_VECTOR& vMax )
+{
+    PRTNATIVE_VECTOR vSize = vMax - vMin;
+    return 2.0f * ( vSize.x * vSize.y + vSize.y * vSize.z + vSize.z * vSize.x );
+}
+
+static inline void GrowBox( PRTNATIVE_VECTOR* pMin, PRTNATIVE_VECTOR* pMax, const PRTNATIVE_VECTOR& vMin,
+                            const PRTNATIVE_VECTOR& vMax )
+{
+    pMin->x = PRTMin( pMin->x, vMin.x );
+    pMin->y = PRTMin( pMin->y, vMin.y );
+    pMin->z = PRTMin( pMin->z, vMin.z );
+    pMax->x = PRTMax( pMax->x, vMax.x );
+    pMax->y = PRTMax( pMax->y, vMax.y );
+    pMax->z = PRTMax( pMax->z, vMax.z );
+}
+
+
+//-----------------------------------------------------------------------------
+// Distance along the ray to where it enters the box, if it does before fMaxT
+//-----------------------------------------------------------------------------
+static inline bool HitBox( const PRTNATIVE_NODE& Node, const PRTNATIVE_VECTOR& vOrigin,
+                           const PRTNATIVE_VECTOR& vInvDir, float fMaxT, float* pfEntry )
+{
+    float fX0 = ( Node.vMin.x - vOrigin.x ) * vInvDir.x, fX1 = ( Node.vMax.x - vOrigin.x ) * vInvDir.x;
+    float fY0 = ( Node.vMin.y - vOrigin.y ) * vInvDir.y, fY1 = ( Node.vMax.y - vOrigin.y ) * vInvDir.y;
+    float fZ0 = ( Node.vMin.z - vOrigin.z ) * vInvDir.z, fZ1 = ( Node.vMax.z - vOrigin.z ) * vInvDir.z;
+    float fNear = PRTMax( PRTMax( PRTMin( fX0, fX1 ), PRTMin( fY0, fY1 ) ), PRTMax( PRTMin( fZ0, fZ1 ), 0.0f ) );
+    float fFar = PRTMin( PRTMin( PRTMax( fX0, fX1 ), PRTMax( fY0, fY1 ) ), PRTMin( PRTMax( fZ0, fZ1 ), fMaxT ) );
+    *pfEntry = fNear;
+    return fNear <= fFar;
+}
+
+
+//-----------------------------------------------------------------------------
+// Moller-Trumbore.  u and v weight the second and third corners.
+//-----------------------------------------------------------------------------
+static inline bool HitTriangle( const PRTNATIVE_TRIANGLE& Tri, const PRTNATIVE_VECTOR& vOrigin,
+                                const PRTNATIVE_VECTOR& vDir, float fMaxT, float* pfT, float* pfU, float* pfV )
+{
+    PRTNATIVE_VECTOR vP = Cross( vDir, Tri.vEdge2 );
+    float fDet = Dot( Tri.vEdge1, vP );
+    if( fDet == 0.0f )
+        return false;
+    float fInvDet = 1.0f / fDet;
+
+    PRTNATIVE_VECTOR vS = vOrigin - Tri.v0;
+    float u = Dot( vS, vP ) * fInvDet;
+    if( u < 0.0f || u > 1.0f )
+        return false;
+
+    PRTNATIVE_VECTOR vQ = Cross( vS, Tri.vEdge1 );
+    float v = Dot( vDir, vQ ) * fInvDet;
+    if( v < 0.0f || u + v > 1.0f )
+        return false;
+
+    float t = Dot( Tri.vEdge2, vQ ) * fInvDet;
+    if( t <= 0.0f || t >= fMaxT )
+        return false;
+
+    *pfT = t;
+    *pfU = u;
+    *pfV = v;
+    return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Axes with no direction get a huge reciprocal rather than an infinite one, so the
+// slabs of a box the ray starts on don't give 0 * infinity
+//-----------------------------------------------------------------------------
+static inline PRTNATIVE_VECTOR InverseDirection( const PRTNATIVE_VECTOR& vDir )
+{
+    return Vector( 1.0f / ( vDir.x != 0.0f ? vDir.x : 1e-30f ), 1.0f / ( vDir.y != 0.0f ? vDir.y : 1e-30f ),
+                   1.0f / ( vDir.z != 0.0f ? vDir.z : 1e-30f ) );
+}
+
+
+//-----------------------------------------------------------------------------
+CPRTNativeSimulator::CPRTNativeSimulator() : m_nChunksDone( 0 ), m_bAbort( false )
+{
+    m_pPositions = NULL;
+    m_pNormals = NULL;
+    m_pAlbedos = NULL;
+    m_pIndices = NULL;
+    m_nVertices = 0;
+    m_nFaces = 0;
+    m_pTriangles = NULL;
+    m_nTriangles = 0;
+    m_pNodes = NULL;
+    m_nNodes = 0;
+    m_fEpsilon = 0.0f;
+    m_dwSceneHash = 0;
+
+    m_Order = 0;
+    m_nRays = 0;
+    m_nBounces = 0;
+    m_nChannels = 0;
+    m_iPass = 0;
+    m_pPrevious = NULL;
+    m_pCurrent = NULL;
+    m_pChunkDone = NULL;
+    m_nChunks = 0;
+    for( UINT i = 0; i < PRTNATIVE_MAX_THREADS; i++ )
+    {
+        m_aRanges[i].nNext = 0;
+        m_aRanges[i].nEnd = 0;
+        m_anRays[i] = 0;
+    }
+    m_nRanges = 0;
+    m_nRaysShot = 0;
+    m_fSeconds = 0.0;
+    m_iResumedPass = -1;
+
+    m_strCheckpoint = NULL;
+    m_nCheckpointSeconds = 0;
+    m_pCB = NULL;
+    m_pUserContext = NULL;
+    m_pTotal = NULL;
+    m_fLastProgress = 0.0;
+    m_fLastCheckpoint = 0.0;
+}
+
+
+//-----------------------------------------------------------------------------
+CPRTNativeSimulator::~CPRTNativeSimulator()
+{
+    Destroy();
+}
+
+
+//-----------------------------------------------------------------------------
+void CPRTNativeSimulator::Destroy()
+{
+    SAFE_DELETE_ARRAY( m_pPositions );
+    SAFE_DELETE_ARRAY( m_pNormals );
+    SAFE_DELETE_ARRAY( m_pAlbedos );
+    SAFE_DELETE_ARRAY( m_pIndices );
+    SAFE_DELETE_ARRAY( m_pTriangles );
+    SAFE_DELETE_ARRAY( m_pNodes );
+    SAFE_DELETE_ARRAY( m_pPrevious );
+    SAFE_DELETE_ARRAY( m_pCurrent );
+    SAFE_DELETE_ARRAY( m_pChunkDone );
+    m_nVertices = 0;
+    m_nFaces = 0;
+    m_nTriangles = 0;
+    m_nNodes = 0;
+    m_nChunks = 0;
+}
+
+
+//-----------------------------------------------------------------------------
+HRESULT CPRTNativeSimulator::Create( const PRTNATIVE_VECTOR* pPositions, const PRTNATIVE_VECTOR* pNormals,
+                                     UINT nVertices, const DWORD* pIndices, const DWORD* pAttributes, UINT nFaces,
+                                     const PRTNATIVE_COLOR* pAlbedos, UINT nMaterials,
+                                     const PRTNATIVE_VECTOR* pBlockerPositions, UINT nBlockerVertices,
+                                     const DWORD* pBlockerIndices, UINT nBlockerFaces )
+{
+    if( !pPositions || !pNormals || !pIndices || !pAttributes || !pAlbedos || 0 == nVertices || 0 == nFaces ||
+        0 == nMaterials || ( nBlockerFaces > 0 && ( !pBlockerPositions || !pBlockerIndices ) ) )
+        return E_INVALIDARG;
+    for( UINT i = 0; i < nFaces * 3; i++ )
+    {
+        if( pIndices[i] >= nVertices )
+            return E_INVALIDARG;
+    }
+    for( UINT i = 0; i < nBlockerFaces * 3; i++ )
+    {
+        if( pBlockerIndices[i] >= nBlockerVertices )
+            return E_INVALIDARG;
+    }
+
+    Destroy();
+
+    m_nVertices = nVertices;
+    m_nFaces = nFaces;
+    m_nTriangles = nFaces + nBlockerFaces;
+    m_pPositions = new PRTNATIVE_VECTOR[nVertices];
+    m_pNormals = new PRTNATIVE_VECTOR[nVertices];
+    m_pAlbedos = new PRTNATIVE_COLOR[nVertices];
+    m_pIndices = new DWORD[nFaces * 3];
+    m_pTriangles = new PRTNATIVE_TRIANGLE[m_nTriangles];
+    m_pNodes = new PRTNATIVE_NODE[2 * m_nTriangles];
+    UINT* pOrder = new UINT[m_nTriangles];
+    PRTNATIVE_VECTOR* pCentroids = new PRTNATIVE_VECTOR[m_nTriangles];
+    PRTNATIVE_VECTOR* pBoxMin = new PRTNATIVE_VECTOR[m_nTriangles];
+    PRTNATIVE_VECTOR* pBoxMax = new PRTNATIVE_VECTOR[m_nTriangles];
+    PRTNATIVE_TRIANGLE* pUnsorted = new PRTNATIVE_TRIANGLE[m_nTriangles];
+    if( !m_pPositions || !m_pNormals || !m_pAlbedos || !m_pIndices || !m_pTriangles || !m_pNodes || !pOrder ||
+        !pCentroids || !pBoxMin || !pBoxMax || !pUnsorted )
+    {
+        SAFE_DELETE_ARRAY( pOrder );
+        SAFE_DELETE_ARRAY( pCentroids );
+        SAFE_DELETE_ARRAY( pBoxMin );
+        SAFE_DELETE_ARRAY( pBoxMax );
+        SAFE_DELETE_ARRAY( pUnsorted );
+        Destroy();
+        return E_OUTOFMEMORY;
+    }
+
+    memcpy( m_pPositions, pPositions, nVertices * sizeof( PRTNATIVE_VECTOR ) );
+    memcpy( m_pIndices, pIndices, nFaces * 3 * sizeof( DWORD ) );
+    for( UINT i = 0; i < nVertices; i++ )
+    {
+        float fLength = Length( pNormals[i] );
+        m_pNormals[i] = ( fLength > 0.0f ) ? pNormals[i] / fLength : Vector( 0.0f, 0.0f, 0.0f );
+        m_pAlbedos[i].r = m_pAlbedos[i].g = m_pAlbedos[i].b = 0.0f;
+    }
+
+    // Going backwards, the first face to use a vertex sets its albedo
+    for( UINT iFace = nFaces; iFace-- > 0; )
+    {
+        const PRTNATIVE_COLOR& Albedo = pAlbedos[PRTMin( pAttributes[iFace], ( DWORD )nMaterials - 1 )];
+        for( UINT j = 0; j < 3; j++ )
+            m_pAlbedos[pIndices[iFace * 3 + j]] = Albedo;
+    }
+
+    for( UINT i = 0; i < m_nTriangles; i++ )
+    {
+        const bool bBlocker = i >= nFaces;
+        const PRTNATIVE_VECTOR* pV = bBlocker ? pBlockerPositions : pPositions;
+        const DWORD* pI = bBlocker ? &pBlockerIndices[( i - nFaces ) * 3] : &pIndices[i * 3];
+        const PRTNATIVE_VECTOR& v0 = pV[pI[0]];
+        const PRTNATIVE_VECTOR& v1 = pV[pI[1]];
+        const PRTNATIVE_VECTOR& v2 = pV[pI[2]];
+
+        pUnsorted[i].v0 = v0;
+        pUnsorted[i].vEdge1 = v1 - v0;
+        pUnsorted[i].vEdge2 = v2 - v0;
+        pUnsorted[i].iFace = bBlocker ? PRTNATIVE_BLOCKER : i;
+
+        pBoxMin[i] = pBoxMax[i] = v0;
+        GrowBox( &pBoxMin[i], &pBoxMax[i], v1, v1 );
+        GrowBox( &pBoxMin[i], &pBoxMax[i], v2, v2 );
+        pCentroids[i] = ( v0 + v1 + v2 ) / 3.0f;
+        pOrder[i] = i;
+    }
+
+    m_nNodes = 0;
+    BuildNode( pOrder, 0, m_nTriangles, pCentroids, pBoxMin, pBoxMax, 0 );
+    for( UINT i = 0; i < m_nTriangles; i++ )
+        m_pTriangles[i] = pUnsorted[pOrder[i]];
+
+    SAFE_DELETE_ARRAY( pOrder );
+    SAFE_DELETE_ARRAY( pCentroids );
+    SAFE_DELETE_ARRAY( pBoxMin );
+    SAFE_DELETE_ARRAY( pBoxMax );
+    SAFE_DELETE_ARRAY( pUnsorted );
+
+    m_fEpsilon = PRTNATIVE_EPSILON * Length( m_pNodes[0].vMax - m_pNodes[0].vMin );
+
+    m_dwSceneHash = HashBytes( 2166136261, m_pPositions, nVertices * sizeof( PRTNATIVE_VECTOR ) );
+    m_dwSceneHash = HashBytes( m_dwSceneHash, m_pNormals, nVertices * sizeof( PRTNATIVE_VECTOR ) );
+    m_dwSceneHash = HashBytes( m_dwSceneHash, m_pAlbedos, nVertices * sizeof( PRTNATIVE_COLOR ) );
+    m_dwSceneHash = HashBytes( m_dwSceneHash, m_pTriangles, m_nTriangles * sizeof( PRTNATIVE_TRIANGLE ) );
+
+    return S_OK;
+}
+
+
+//-----------------------------------------------------------------------------
+// Splits the triangles pOrder[iFirst] to pOrder[iFirst + nCount - 1] where the surface
+// area heuristic says to, over PRTNATIVE_NUM_BINS bins of their centers along the
+// longest axis of the centers.  Returns the index of the node made.
+//-----------------------------------------------------------------------------
+UINT CPRTNativeSimulator::BuildNode( UINT* pOrder, UINT iFirst, UINT nCount, const PRTNATIVE_VECTOR* pCentroids,
+                                     const PRTNATIVE_VECTOR* pBoxMin, const PRTNATIVE_VECTOR* pBoxMax,
+                                     UINT nDepth )
+{
+    const UINT iNode = m_nNodes++;
+    const PRTNATIVE_VECTOR vEmptyMin = Vector( FLT_MAX, FLT_MAX, FLT_MAX );
+    const PRTNATIVE_VECTOR vEmptyMax = Vector( -FLT_MAX, -FLT_MAX, -FLT_MAX );
+
+    PRTNATIVE_VECTOR vMin = vEmptyMin, vMax = vEmptyMax;
+    PRTNATIVE_VECTOR vCenterMin = vEmptyMin, vCenterMax = vEmptyMax;
+    for( UINT i = iFirst; i < iFirst + nCount; i++ )
+    {
+        GrowBox( &vMin, &vMax, pBoxMin[pOrder[i]], pBoxMax[pOrder[i]] );
+        GrowBox( &vCenterMin, &vCenterMax, pCentroids[pOrder[i]], pCentroids[pOrder[i]] );
+    }
+    m_pNodes[iNode].vMin = vMin;
+    m_pNodes[iNode].vMax = vMax;
+    m_pNodes[iNode].iFirst = iFirst;
+    m_pNodes[iNode].nTriangles = nCount;
+
+    PRTNATIVE_VECTOR vCenterSize = vCenterMax - vCenterMin;
+    const int iAxis = ( vCenterSize.x >= vCenterSize.y && vCenterSize.x >= vCenterSize.z ) ? 0 :
+                      ( vCenterSize.y >= vCenterSize.z ? 1 : 2 );
+    const float fAxisMin = GetAxis( vCenterMin, iAxis );
+    const float fAxisSize = GetAxis( vCenterSize, iAxis );
+    if( nCount <= PRTNATIVE_LEAF_SIZE || nDepth >= PRTNATIVE_MAX_DEPTH || fAxisSize <= 0.0f )
+        return iNode;
+
+    // Bin the triangles by center
+    UINT anBinCount[PRTNATIVE_NUM_BINS] = { 0 };
+    PRTNATIVE_VECTOR avBinMin[PRTNATIVE_NUM_BINS], avBinMax[PRTNATIVE_NUM_BINS];
+    for( UINT b = 0; b < PRTNATIVE_NUM_BINS; b++ )
+    {
+        avBinMin[b] = vEmptyMin;
+        avBinMax[b] = vEmptyMax;
+    }
+    const float fBinScale = PRTNATIVE_NUM_BINS / fAxisSize;
+    for( UINT i = iFirst; i < iFirst + nCount; i++ )
+    {
+        float fCenter = GetAxis( pCentroids[pOrder[i]], iAxis );
+        UINT b = PRTMin( ( UINT )( ( fCenter - fAxisMin ) * fBinScale ), ( UINT )PRTNATIVE_NUM_BINS - 1 );
+        anBinCount[b]++;
+        GrowBox( &avBinMin[b], &avBinMax[b], pBoxMin[pOrder[i]], pBoxMax[pOrder[i]] );
+    }
+
+    // Area of the bins to the right of each split, then the best split from the left
+    float afRightArea[PRTNATIVE_NUM_BINS];
+    UINT anRightCount[PRTNATIVE_NUM_BINS];
+    PRTNATIVE_VECTOR vSideMin = vEmptyMin, vSideMax = vEmptyMax;
+    UINT nSide = 0;
+    for( UINT b = PRTNATIVE_NUM_BINS - 1; b > 0; b-- )
+    {
+        GrowBox( &vSideMin, &vSideMax, avBinMin[b], avBinMax[b] );
+        nSide += anBinCount[b];
+        afRightArea[b] = nSide > 0 ? SurfaceArea( vSideMin, vSideMax ) : 0.0f;
+        anRightCount[b] = nSide;
+    }
+
+    float fBestCost = FLT_MAX;
+    UINT iBestSplit = 0;
+    vSideMin = vEmptyMin;
+    vSideMax = vEmptyMax;
+    nSide = 0;
+    for( UINT b = 0; b < PRTNATIVE_NUM_BINS - 1; b++ )
+    {
+        GrowBox( &vSideMin, &vSideMax, avBinMin[b], avBinMax[b] );
+        nSide += anBinCount[b];
+        if( 0 == nSide || 0 == anRightCount[b + 1] )
+            continue;
+
+        float fCost = SurfaceArea( vSideMin, vSideMax ) * nSide + afRightArea[b + 1] * anRightCount[b + 1];
+        if( fCost < fBestCost )
+        {
+            fBestCost = fCost;
+            iBestSplit = b;
+        }
+    }
+
+    // A leaf is cheaper when testing all its triangles costs less than a traversal step
+    // and the triangles of the two sides
+    const float fArea = SurfaceArea( vMin, vMax );
+    if( fBestCost == FLT_MAX || ( nCount <= PRTNATIVE_MAX_LEAF_SIZE && fBestCost / fArea + 1.0f >= nCount ) )
+        return iNode;
+
+    UINT iMiddle = iFirst;
+    for( UINT i = iFirst; i < iFirst + nCount; i++ )
+    {
+        float fCenter = GetAxis( pCentroids[pOrder[i]], iAxis );
+        UINT b = PRTMin( ( UINT )( ( fCenter - fAxisMin ) * fBinScale ), ( UINT )PRTNATIVE_NUM_BINS - 1 );
+        if( b <= iBestSplit )
+        {
+            UINT Temp = pOrder[i];
+            pOrder[i] = pOrder[iMiddle];
+            pOrder[iMiddle++] = Temp;
+        }
+    }
+
+    // The first child follows this node
+    BuildNode( pOrder, iFirst, iMiddle - iFirst, pCentroids, pBoxMin, pBoxMax, nDepth + 1 );
+    UINT iSecond = BuildNode( pOrder, iMiddle, iFirst + nCount - iMiddle, pCentroids, pBoxMin, pBoxMax, nDepth + 1 );
+    m_pNodes[iNode].iFirst = iSecond;
+    m_pNodes[iNode].nTriangles = 0;
+
+    return iNode;
+}
+
+
+//-----------------------------------------------------------------------------
+// Whether the ray hits anything at all
+//-----------------------------------------------------------------------------
+bool CPRTNativeSimulator::Occluded( const PRTNATIVE_VECTOR& vOrigin, const PRTNATIVE_VECTOR& vDir ) const
+{
+    const PRTNATIVE_VECTOR vInvDir = InverseDirection( vDir );
+    UINT aStack[PRTNATIVE_STACK_SIZE];
+    UINT nStack = 0;
+    aStack[nStack++] = 0;
+
+    while( nStack > 0 )
+    {
+        const PRTNATIVE_NODE& Node = m_pNodes[aStack[--nStack]];
+        float fEntry;
+        if( !HitBox( Node, vOrigin, vInvDir, FLT_MAX, &fEntry ) )
+            continue;
+
+        if( Node.nTriangles > 0 )
+        {
+            for( UINT i = Node.iFirst; i < Node.iFirst + Node.nTriangles; i++ )
+            {
+                float t, u, v;
+                if( HitTriangle( m_pTriangles[i], vOrigin, vDir, FLT_MAX, &t, &u, &v ) )
+                    return true;
+            }
+        }
+        else
+        {
+            aStack[nStack++] = Node.iFirst;
+            aStack[nStack++] = ( UINT )( &Node - m_pNodes ) + 1;
+        }
+    }
+
+    return false;
+}
+
+
+//-----------------------------------------------------------------------------
+// The nearest triangle the ray hits, taking the nearer child first and skipping nodes
+// that start beyond the nearest hit so far
+//-----------------------------------------------------------------------------
+bool CPRTNativeSimulator::Intersect( const PRTNATIVE_VECTOR& vOrigin, const PRTNATIVE_VECTOR& vDir,
+                                     UINT* piTriangle, float* pfU, float* pfV ) const
+{
+    const PRTNATIVE_VECTOR vInvDir = InverseDirection( vDir );
+    UINT aStack[PRTNATIVE_STACK_SIZE];
+    float afStackEntry[PRTNATIVE_STACK_SIZE];
+    UINT nStack = 0;
+    float fNearest = FLT_MAX;
+    bool bHit = false;
+
+    float fEntry;
+    if( !HitBox( m_pNodes[0], vOrigin, vInvDir, fNearest, &fEntry ) )
+        return false;
+    aStack[nStack] = 0;
+    afStackEntry[nStack++] = fEntry;
+
+    while( nStack > 0 )
+    {
+        nStack--;
+        if( afStackEntry[nStack] >= fNearest )
+            continue;
+
+        const UINT iNode = aStack[nStack];
+        const PRTNATIVE_NODE& Node = m_pNodes[iNode];
+        if( Node.nTriangles > 0 )
+        {
+            for( UINT i = Node.iFirst; i < Node.iFirst + Node.nTriangles; i++ )
+            {
+                float t, u, v;
+                if( HitTriangle( m_pTriangles[i], vOrigin, vDir, fNearest, &t, &u, &v ) )
+                {
+                    fNearest = t;
+                    *piTriangle = i;
+                    *pfU = u;
+                    *pfV = v;
+                    bHit = true;
+                }
+            }
+            continue;
+        }
+
+        const UINT iNear = iNode + 1, iFar = Node.iFirst;
+        float fNearEntry, fFarEntry;
+        bool bNear = HitBox( m_pNodes[iNear], vOrigin, vInvDir, fNearest, &fNearEntry );
+        bool bFar = HitBox( m_pNodes[iFar], vOrigin, vInvDir, fNearest, &fFarEntry );
+        if( bNear && bFar && fFarEntry < fNearEntry )
+        {
+            aStack[nStack] = iNear;
+            afStackEntry[nStack++] = fNearEntry;
+            aStack[nStack] = iFar;
+            afStackEntry[nStack++] = fFarEntry;
+            continue;
+        }
+        if( bFar )
+        {
+            aStack[nStack] = iFar;
+            afStackEntry[nStack++] = fFarEntry;
+        }
+        if( bNear )
+        {
+            aStack[nStack] = iNear;
+            afStackEntry[nStack++] = fNearEntry;
+        }
+    }
+
+    return bHit;
+}
+
+
+//-----------------------------------------------------------------------------
+// Rays are spread over the hemisphere as cos(theta) / pi, so the transfer
+// albedo / pi * integral of f(w) cos(theta) is albedo times the average of f over the
+// rays.  The first nX * nY rays are stratified over an nX by nY grid.
+//-----------------------------------------------------------------------------
+UINT CPRTNativeSimulator::ComputeVertex( UINT iVertex )
+{
+    const UINT nCoeffs = m_Order * m_Order;
+    const UINT Stride = nCoeffs * m_nChannels;
+    float* pOut = m_pCurrent + ( size_t )iVertex * Stride;
+    const PRTNATIVE_VECTOR& vNormal = m_pNormals[iVertex];
+    if( Dot( vNormal, vNormal ) == 0.0f )
+    {
+        memset( pOut, 0, Stride * sizeof( float ) );
+        return 0;
+    }
+
+    // A tangent frame about the normal, as in "Building an Orthonormal Basis, Revisited"
+    const float fSign = vNormal.z >= 0.0f ? 1.0f : -1.0f;
+    const float a = -1.0f / ( fSign + vNormal.z );
+    const float b = vNormal.x * vNormal.y * a;
+    const PRTNATIVE_VECTOR vTangent = Vector( 1.0f + fSign * vNormal.x * vNormal.x * a, fSign * b, -fSign * vNormal.x );
+    const PRTNATIVE_VECTOR vBinormal = Vector( b, fSign + vNormal.y * vNormal.y * a, -vNormal.y );
+    const PRTNATIVE_VECTOR vOrigin = m_pPositions[iVertex] + vNormal * m_fEpsilon;
+
+    const UINT nX = PRTMax( ( UINT )sqrtf( ( float )m_nRays ), 1U );
+    const UINT nY = m_nRays / nX;
+    ULONGLONG State = SeedRandom( iVertex, m_iPass );
+
+    float afSum[3 * DXUT_SH_MAX_COEFFS];
+    memset( afSum, 0, sizeof( afSum ) );
+
+    for( UINT k = 0; k < m_nRays; k++ )
+    {
+        float u = NextRandom( &State );
+        float v = NextRandom( &State );
+        if( k < nX * nY )
+        {
+            u = ( ( k % nX ) + u ) / nX;
+            v = ( ( k / nX ) + v ) / nY;
+        }
+        const float fRadius = sqrtf( u );
+        const float fPhi = 2.0f * PRTNATIVE_PI * v;
+        PRTNATIVE_VECTOR vDir = vTangent * ( fRadius * cosf( fPhi ) ) + vBinormal * ( fRadius * sinf( fPhi ) ) +
+                                vNormal * sqrtf( PRTMax( 1.0f - u, 0.0f ) );
+
+        if( 0 == m_iPass )
+        {
+            // Direct lighting: the basis functions where the sky is visible
+            if( !Occluded( vOrigin, vDir ) )
+            {
+                float afY[DXUT_SH_MAX_COEFFS];
+                DXUTSHEvalBasis( m_Order, vDir.x, vDir.y, vDir.z, afY );
+                for( UINT i = 0; i < nCoeffs; i++ )
+                    afSum[i] += afY[i];
+            }
+            continue;
+        }
+
+        // A bounce: the last pass's transfer where the ray hits the front of the mesh
+        UINT iTriangle;
+        float fU, fV;
+        if( !Intersect( vOrigin, vDir, &iTriangle, &fU, &fV ) || PRTNATIVE_BLOCKER == m_pTriangles[iTriangle].iFace )
+            continue;
+
+        const DWORD* pCorners = &m_pIndices[m_pTriangles[iTriangle].iFace * 3];
+        const float fW = 1.0f - fU - fV;
+        PRTNATIVE_VECTOR vHitNormal = m_pNormals[pCorners[0]] * fW + m_pNormals[pCorners[1]] * fU +
+                                      m_pNormals[pCorners[2]] * fV;
+        if( Dot( vHitNormal, vDir ) >= 0.0f )
+            continue;
+
+        const float* p0 = m_pPrevious + ( size_t )pCorners[0] * Stride;
+        const float* p1 = m_pPrevious + ( size_t )pCorners[1] * Stride;
+        const float* p2 = m_pPrevious + ( size_t )pCorners[2] * Stride;
+        for( UINT i = 0; i < Stride; i++ )
+            afSum[i] += p0[i] * fW + p1[i] * fU + p2[i] * fV;
+    }
+
+    const float afAlbedo[3] = { m_pAlbedos[iVertex].r, m_pAlbedos[iVertex].g, m_pAlbedos[iVertex].b };
+    for( UINT c = 0; c < m_nChannels; c++ )
+    {
+        const float fScale = afAlbedo[c] / m_nRays;
+        const float* pSum = ( 0 == m_iPass ) ? afSum : afSum + c * nCoeffs;
+        for( UINT i = 0; i < nCoeffs; i++ )
+            pOut[c * nCoeffs + i] = pSum[i] * fScale;
+    }
+
+    return m_nRays;
+}
+
+
+//-----------------------------------------------------------------------------
+// Each thread starts on its own range of chunks, then helps with the ranges after it.
+// The thread that called Simulate reports progress between its chunks.
+//-----------------------------------------------------------------------------
+void CPRTNativeSimulator::RunChunks( UINT iRange, UINT iThread )
+{
+    ULONGLONG nRays = 0;
+    for( UINT i = 0; i < m_nRanges; i++ )
+    {
+        PRTNATIVE_RANGE& Range = m_aRanges[( iRange + i ) % m_nRanges];
+        while( !m_bAbort )
+        {
+            if( 0 == iThread )
+                ReportProgress();
+
+            LONG iChunk = Range.nNext.fetch_add( 1 );
+            if( iChunk >= Range.nEnd )
+                break;
+            if( m_pChunkDone[iChunk].load( std::memory_order_acquire ) )
+                continue;
+
+            const UINT iFirst = ( UINT )iChunk * PRTNATIVE_CHUNK_SIZE;
+            const UINT iLast = PRTMin( iFirst + PRTNATIVE_CHUNK_SIZE, m_nVertices );
+            for( UINT iVertex = iFirst; iVertex < iLast; iVertex++ )
+                nRays += ComputeVertex( iVertex );
+
+            m_pChunkDone[iChunk].store( true, std::memory_order_release );
+            m_nChunksDone++;
+        }
+    }
+    m_anRays[iThread] += nRays;
+}
+
+
+//-----------------------------------------------------------------------------
+void CPRTNativeSimulator::RangeProc( void* pContext, UINT iRange, UINT iThread )
+{
+    ( ( CPRTNativeSimulator* )pContext )->RunChunks( iRange, iThread );
+}
+
+
+//-----------------------------------------------------------------------------
+// Calls back with the fraction done and writes a checkpoint when they are due
+//-----------------------------------------------------------------------------
+void CPRTNativeSimulator::ReportProgress()
+{
+    const double fNow = DXUTGetMilliseconds();
+    if( fNow - m_fLastProgress < PRTNATIVE_PROGRESS_MS )
+        return;
+    m_fLastProgress = fNow;
+
+    float fDone = ( m_iPass + ( float )m_nChunksDone / m_nChunks ) / m_nBounces;
+    if( m_pCB && !m_bAbort && S_OK != m_pCB( fDone, m_pUserContext ) )
+        m_bAbort = true;
+
+    if( m_strCheckpoint && m_nCheckpointSeconds > 0 &&
+        fNow - m_fLastCheckpoint >= 1000.0 * m_nCheckpointSeconds )
+    {
+        SaveCheckpoint( m_strCheckpoint, m_pTotal );
+        m_fLastCheckpoint = fNow;
+    }
+}
+
+
+//-----------------------------------------------------------------------------
+HRESULT CPRTNativeSimulator::Simulate( UINT Order, UINT nRays, UINT nBounces, UINT nChannels, float* pOut,
+                                       const wchar_t* strCheckpoint, UINT nCheckpointSeconds, UINT nThreads,
+                                       LPPRTNATIVECALLBACK pCB, void* pUserContext )
+{
+    if( !m_pNodes || !pOut || Order < DXUT_SH_MIN_ORDER || Order > DXUT_SH_MAX_ORDER || 0 == nRays ||
+        0 == nBounces || 0 == nChannels || nChannels > 3 )
+        return E_INVALIDARG;
+
+    const size_t nFloats = ( size_t )m_nVertices * Order * Order * nChannels;
+    m_Order = Order;
+    m_nRays = nRays;
+    m_nBounces = nBounces;
+    m_nChannels = nChannels;
+    m_nChunks = ( m_nVertices + PRTNATIVE_CHUNK_SIZE - 1 ) / PRTNATIVE_CHUNK_SIZE;
+
+    SAFE_DELETE_ARRAY( m_pPrevious );
+    SAFE_DELETE_ARRAY( m_pCurrent );
+    SAFE_DELETE_ARRAY( m_pChunkDone );
+    m_pPrevious = new float[nFloats];
+    m_pCurrent = new float[nFloats];
+    m_pChunkDone = new std::atomic <bool>[m_nChunks];
+    if( !m_pPrevious || !m_pCurrent || !m_pChunkDone )
+        return E_OUTOFMEMORY;
+
+    memset( pOut, 0, nFloats * sizeof( float ) );
+    memset( m_pPrevious, 0, nFloats * sizeof( float ) );
+    memset( m_pCurrent, 0, nFloats * sizeof( float ) );
+    for( UINT i = 0; i < m_nChunks; i++ )
+        m_pChunkDone[i] = false;
+    m_iPass = 0;
+    m_nChunksDone = 0;
+    m_nRaysShot = 0;
+    m_iResumedPass = -1;
+    if( strCheckpoint && LoadCheckpoint( strCheckpoint, pOut ) )
+        m_iResumedPass = ( int )m_iPass;
+
+    CDXUTWorkerPool* pPool = DXUTGetWorkerPool();
+    if( 0 == nThreads )
+        nThreads = pPool->GetNumThreads();
+    nThreads = PRTMax( PRTMin( PRTMin( nThreads, ( UINT )PRTNATIVE_MAX_THREADS ), pPool->GetNumThreads() ), 1U );
+
+    const double fStart = DXUTGetMilliseconds();
+    m_strCheckpoint = strCheckpoint;
+    m_nCheckpointSeconds = nCheckpointSeconds;
+    m_pCB = pCB;
+    m_pUserContext = pUserContext;
+    m_pTotal = pOut;
+    m_fLastProgress = fStart;
+    m_fLastCheckpoint = fStart;
+
+    HRESULT hr = S_OK;
+    m_bAbort = false;
+    while( m_iPass < m_nBounces )
+    {
+        // Each thread's share of the chunks
+        m_nRanges = nThreads;
+        for( UINT i = 0; i < nThreads; i++ )
+        {
+            m_aRanges[i].nNext = ( LONG )( ( ULONGLONG )m_nChunks * i / nThreads );
+            m_aRanges[i].nEnd = ( LONG )( ( ULONGLONG )m_nChunks * ( i + 1 ) / nThreads );
+            m_anRays[i] = 0;
+        }
+
+        pPool->Run( RangeProc, this, nThreads, nThreads );
+
+        for( UINT i = 0; i < nThreads; i++ )
+            m_nRaysShot += m_anRays[i];
+
+        if( m_bAbort )
+        {
+            if( strCheckpoint )
+                SaveCheckpoint( strCheckpoint, pOut );
+            hr = E_FAIL;
+            break;
+        }
+
+        // Add the pass to the total, and it becomes the source of the next bounce
+        for( size_t i = 0; i < nFloats; i++ )
+            pOut[i] += m_pCurrent[i];
+        float* pTemp = m_pPrevious;
+        m_pPrevious = m_pCurrent;
+        m_pCurrent = pTemp;
+
+        m_iPass++;
+        for( UINT i = 0; i < m_nChunks; i++ )
+            m_pChunkDone[i] = false;
+        m_nChunksDone = 0;
+        if( strCheckpoint && m_iPass < m_nBounces )
+        {
+            SaveCheckpoint( strCheckpoint, pOut );
+            m_fLastCheckpoint = DXUTGetMilliseconds();
+        }
+    }
+
+    m_fSeconds = ( DXUTGetMilliseconds() - fStart ) / 1000.0;
+    m_strCheckpoint = NULL;
+    m_pCB = NULL;
+    m_pTotal = NULL;
+
+    if( SUCCEEDED( hr ) )
+    {
+        if( pCB )
+            pCB( 1.0f, pUserContext );
+        if( strCheckpoint )
+            DeleteCheckpointFile( strCheckpoint );
+    }
+
+    return hr;
+}
+
+
+//-----------------------------------------------------------------------------
+// Only chunks marked done when the flags are read are written, and zeros for the rest,
+// so the workers can go on writing other chunks while the file is written.  The file
+// is written beside the checkpoint and then moved over it, so a crash part way leaves
+// the last one whole.
+//-----------------------------------------------------------------------------
+HRESULT CPRTNativeSimulator::SaveCheckpoint( const wchar_t* strCheckpoint, const float* pOut )
+{
+    PRTNATIVE_CHECKPOINT Header;
+    Header.dwMagic = PRTNATIVE_CHECKPOINT_MAGIC;
+    Header.dwVersion = PRTNATIVE_CHECKPOINT_VERSION;
+    Header.dwSceneHash = m_dwSceneHash;
+    Header.nVertices = m_nVertices;
+    Header.Order = m_Order;
+    Header.nRays = m_nRays;
+    Header.nBounces = m_nBounces;
+    Header.nChannels = m_nChannels;
+    Header.iPass = m_iPass;
+    Header.nChunks = m_nChunks;
+
+    const size_t Stride = ( size_t )m_Order * m_Order * m_nChannels;
+    BYTE* pDone = new BYTE[m_nChunks];
+    float* pZeros = new float[PRTNATIVE_CHUNK_SIZE * Stride];
+    if( !pDone || !pZeros )
+    {
+        SAFE_DELETE_ARRAY( pDone );
+        SAFE_DELETE_ARRAY( pZeros );
+        return E_OUTOFMEMORY;
+    }
+    for( UINT i = 0; i < m_nChunks; i++ )
+        pDone[i] = m_pChunkDone[i].load( std::memory_order_acquire ) ? 1 : 0;
+    memset( pZeros, 0, PRTNATIVE_CHUNK_SIZE * Stride * sizeof( float ) );
+
+    wchar_t strTemp[PRTNATIVE_MAX_PATH];
+    if( swprintf( strTemp, PRTNATIVE_MAX_PATH, L"%ls.tmp", strCheckpoint ) < 0 )
+    {
+        SAFE_DELETE_ARRAY( pDone );
+        SAFE_DELETE_ARRAY( pZeros );
+        return E_INVALIDARG;
+    }
+
+    const size_t nFloats = ( size_t )m_nVertices * Stride;
+    FILE* pFile = OpenCheckpointFile( strTemp, true );
+    bool bWritten = false;
+    if( pFile )
+    {
+        bWritten = 1 == fwrite( &Header, sizeof( Header ), 1, pFile ) &&
+                   m_nChunks == fwrite( pDone, 1, m_nChunks, pFile ) &&
+                   nFloats == fwrite( pOut, sizeof( float ), nFloats, pFile ) &&
+                   nFloats == fwrite( m_pPrevious, sizeof( float ), nFloats, pFile );
+        for( UINT i = 0; bWritten && i < m_nChunks; i++ )
+        {
+            const UINT iFirst = i * PRTNATIVE_CHUNK_SIZE;
+            const size_t nChunkFloats = ( PRTMin( iFirst + PRTNATIVE_CHUNK_SIZE, m_nVertices ) - iFirst ) * Stride;
+            bWritten = nChunkFloats == fwrite( pDone[i] ? m_pCurrent + iFirst * Stride : pZeros, sizeof( float ),
+                                               nChunkFloats, pFile );
+        }
+        bWritten = ( 0 == fclose( pFile ) ) && bWritten;
+    }
+    SAFE_DELETE_ARRAY( pDone );
+    SAFE_DELETE_ARRAY( pZeros );
+
+    if( !bWritten || !ReplaceCheckpointFile( strTemp, strCheckpoint ) )
+    {
+        DeleteCheckpointFile( strTemp );
+        return E_FAIL;
+    }
+
+    return S_OK;
+}
+
+
+//-----------------------------------------------------------------------------
+// Takes up a checkpoint of the same scene and settings, if there is one
+//-----------------------------------------------------------------------------
+bool CPRTNativeSimulator::LoadCheckpoint( const wchar_t* strCheckpoint, float* pOut )
+{
+    FILE* pFile = OpenCheckpointFile( strCheckpoint, false );
+    if( !pFile )
+        return false;
+
+    const size_t nFloats = ( size_t )m_nVertices * m_Order * m_Order * m_nChannels;
+    PRTNATIVE_CHECKPOINT Header;
+    bool bRead = 1 == fread( &Header, sizeof( Header ), 1, pFile ) &&
+                 Header.dwMagic == PRTNATIVE_CHECKPOINT_MAGIC && Header.dwVersion == PRTNATIVE_CHECKPOINT_VERSION &&
+                 Header.dwSceneHash == m_dwSceneHash && Header.nVertices == m_nVertices &&
+                 Header.Order == m_Order && Header.nRays == m_nRays && Header.nBounces == m_nBounces &&
+                 Header.nChannels == m_nChannels && Header.nChunks == m_nChunks && Header.iPass < m_nBounces;
+
+    BYTE* pDone = bRead ? new BYTE[m_nChunks] : NULL;
+    bRead = bRead && pDone && m_nChunks == fread( pDone, 1, m_nChunks, pFile ) &&
+            nFloats == fread( pOut, sizeof( float ), nFloats, pFile ) &&
+            nFloats == fread( m_pPrevious, sizeof( float ), nFloats, pFile ) &&
+            nFloats == fread( m_pCurrent, sizeof( float ), nFloats, pFile );
+    fclose( pFile );
+
+    if( bRead )
+    {
+        m_iPass = Header.iPass;
+        m_nChunksDone = 0;
+        for( UINT i = 0; i < m_nChunks; i++ )
+        {
+            m_pChunkDone[i] = 0 != pDone[i];
+            if( pDone[i] )
+                m_nChunksDone++;
+        }
+    }
+    else
+    {
+        // Whatever was read of a bad checkpoint is thrown away
+        memset( pOut, 0, nFloats * sizeof( float ) );
+        memset( m_pPrevious, 0, nFloats * sizeof( float ) );
+        memset( m_pCurrent, 0, nFloats * sizeof( float ) );
+    }
+    SAFE_DELETE_ARRAY( pDone );
+
+    return bRead;
+}
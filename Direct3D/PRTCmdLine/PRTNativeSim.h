@@ -0,0 +1,195 @@
+//----------------------------------------------------------------------------
+// File: PRTNativeSim.h
+//
+// A CPU simulator for diffuse PRT transfer without subsurface scattering, in place of
+// ID3DXPRTEngine::ComputeDirectLightingSH and ComputeBounce.  Every vertex shoots
+// stratified, cosine distributed rays over the hemisphere about its normal through a
+// bounding volume hierarchy of the mesh and the blocker meshes.  The first pass gives
+// the shadowed direct lighting transfer, and each bounce after it gathers the transfer of
+// the pass before from where the rays hit the mesh, interpolated across the triangle.
+// The results are laid out as ID3DXPRTBuffer lays them out, so they are saved and
+// compressed with D3DX just as the engine's are.
+//
+// Each thread starts on its own share of the vertices, taking chunks from the front of
+// it, and then steals chunks from the shares of the others.  The rays of a vertex come
+// from a random sequence of its own, so the results are the same on any number of
+// threads and when a run is carried on from a checkpoint.  The threads come from the
+// shared DXUT worker pool.
+//
+// Only the C++ library, DXUTWorkerPool and SDKSHBasis.h are used, so the simulator
+// builds without DXUT.h and D3DX, and off Windows.  The vectors are laid out as
+// D3DXVECTOR3, so D3DX data can be passed in with a cast.  PRTNativeMain.cpp runs it
+// headless from the same options files as PRTCmdLine.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//-----------------------------------------------------------------------------
+#pragma once
+#ifndef PRTNATIVESIM_H
+#define PRTNATIVESIM_H
+
+#include "DXUTWorkerPool.h"
+#include "SDKSHBasis.h"
+#include <atomic>
+
+#define PRTNATIVE_MAX_THREADS   32
+
+struct PRTNATIVE_VECTOR
+{
+    float x, y, z;
+};
+
+// The diffuse albedo of a material
+struct PRTNATIVE_COLOR
+{
+    float r, g, b;
+};
+
+// Called with the fraction done, as LPD3DXSHPRTSIMCB is
+typedef HRESULT ( WINAPI* LPPRTNATIVECALLBACK )( float fPercentDone, void* pUserContext );
+
+// A triangle as the ray tracer tests it: the first corner and the two edges from it.
+// iFace is the face of the PRT mesh, or PRTNATIVE_BLOCKER for a blocker mesh face.
+#define PRTNATIVE_BLOCKER       0xFFFFFFFF
+struct PRTNATIVE_TRIANGLE
+{
+    PRTNATIVE_VECTOR v0;
+    PRTNATIVE_VECTOR vEdge1;
+    PRTNATIVE_VECTOR vEdge2;
+    DWORD iFace;
+};
+
+// A node of the bounding volume hierarchy.  A leaf holds nTriangles triangles from
+// iFirst; an interior node has nTriangles 0, its first child next to it and its second
+// child at iFirst.
+struct PRTNATIVE_NODE
+{
+    PRTNATIVE_VECTOR vMin;
+    UINT iFirst;
+    PRTNATIVE_VECTOR vMax;
+    UINT nTriangles;
+};
+
+// The chunks a thread owns.  Whoever takes the next chunk, owner or thief, moves nNext.
+struct PRTNATIVE_RANGE
+{
+    std::atomic <LONG> nNext;
+    LONG nEnd;
+    BYTE aPad[56];              // Each range on a cache line of its own
+};
+
+
+//-----------------------------------------------------------------------------
+class CPRTNativeSimulator
+{
+public:
+                        CPRTNativeSimulator();
+                        ~CPRTNativeSimulator();
+
+    // pAttributes gives the material of each face, and pAlbedos the diffuse albedo of
+    // each material.  The blocker mesh, which may be empty, casts shadows but receives no
+    // transfer.  The normals need not be normalized.
+    HRESULT             Create( const PRTNATIVE_VECTOR* pPositions, const PRTNATIVE_VECTOR* pNormals, UINT nVertices,
+                                const DWORD* pIndices, const DWORD* pAttributes, UINT nFaces,
+                                const PRTNATIVE_COLOR* pAlbedos, UINT nMaterials,
+                                const PRTNATIVE_VECTOR* pBlockerPositions, UINT nBlockerVertices,
+                                const DWORD* pBlockerIndices, UINT nBlockerFaces );
+    void                Destroy();
+
+    // Writes Order * Order coefficients for each of nChannels channels of every vertex
+    // to pOut, as ID3DXPRTBuffer::LockBuffer gives them: the direct lighting plus
+    // nBounces - 1 bounces.  A single channel takes the red albedo.
+    //
+    // When strCheckpoint is given, the work done so far is saved there every
+    // nCheckpointSeconds seconds and when the simulation is stopped, and a run of the same
+    // scene and settings carries on from it.  The file is deleted once the simulation is
+    // done.  pCB is called on the calling thread with the fraction done, as
+    // ID3DXPRTEngine calls it, and anything but S_OK from it stops the simulation with
+    // E_FAIL.  nThreads 0 uses every thread of DXUTGetWorkerPool().
+    HRESULT             Simulate( UINT Order, UINT nRays, UINT nBounces, UINT nChannels, float* pOut,
+                                  const wchar_t* strCheckpoint, UINT nCheckpointSeconds, UINT nThreads,
+                                  LPPRTNATIVECALLBACK pCB, void* pUserContext );
+
+    UINT                GetNumVertices() const
+    {
+        return m_nVertices;
+    }
+
+    // Rays shot and seconds taken by the last Simulate, not counting any run it carried
+    // on from
+    ULONGLONG           GetNumRays() const
+    {
+        return m_nRaysShot;
+    }
+    double              GetSeconds() const
+    {
+        return m_fSeconds;
+    }
+
+    // The pass the last Simulate carried on from a checkpoint at, or -1 if it started
+    // afresh
+    int                 GetResumedPass() const
+    {
+        return m_iResumedPass;
+    }
+
+protected:
+    static void         RangeProc( void* pContext, UINT iRange, UINT iThread );
+
+    UINT                BuildNode( UINT* pOrder, UINT iFirst, UINT nCount, const PRTNATIVE_VECTOR* pCentroids,
+                                   const PRTNATIVE_VECTOR* pBoxMin, const PRTNATIVE_VECTOR* pBoxMax, UINT nDepth );
+    bool                Occluded( const PRTNATIVE_VECTOR& vOrigin, const PRTNATIVE_VECTOR& vDir ) const;
+    bool                Intersect( const PRTNATIVE_VECTOR& vOrigin, const PRTNATIVE_VECTOR& vDir, UINT* piTriangle,
+                                   float* pfU, float* pfV ) const;
+
+    void                RunChunks( UINT iRange, UINT iThread );
+    void                ReportProgress();   // On the thread that called Simulate
+    UINT                ComputeVertex( UINT iVertex );      // Returns the rays shot
+
+    bool                LoadCheckpoint( const wchar_t* strCheckpoint, float* pOut );
+    HRESULT             SaveCheckpoint( const wchar_t* strCheckpoint, const float* pOut );
+
+    // The scene
+    PRTNATIVE_VECTOR*   m_pPositions;
+    PRTNATIVE_VECTOR*   m_pNormals;
+    PRTNATIVE_COLOR*    m_pAlbedos;         // Of each vertex, from the material of a face using it
+    DWORD*              m_pIndices;
+    UINT                m_nVertices;
+    UINT                m_nFaces;
+    PRTNATIVE_TRIANGLE* m_pTriangles;
+    UINT                m_nTriangles;
+    PRTNATIVE_NODE*     m_pNodes;
+    UINT                m_nNodes;
+    float               m_fEpsilon;         // How far rays start off the surface
+    DWORD               m_dwSceneHash;
+
+    // The simulation
+    UINT                m_Order;
+    UINT                m_nRays;
+    UINT                m_nBounces;
+    UINT                m_nChannels;
+    UINT                m_iPass;            // 0 for the direct lighting, then each bounce
+    float*              m_pPrevious;        // The transfer of the pass before
+    float*              m_pCurrent;         // The transfer of this pass
+    std::atomic <bool>* m_pChunkDone;
+    UINT                m_nChunks;
+    std::atomic <UINT>  m_nChunksDone;
+    std::atomic <bool>  m_bAbort;
+    PRTNATIVE_RANGE     m_aRanges[PRTNATIVE_MAX_THREADS];
+    UINT                m_nRanges;
+    ULONGLONG           m_anRays[PRTNATIVE_MAX_THREADS];    // Shot by each thread this pass
+    ULONGLONG           m_nRaysShot;
+    double              m_fSeconds;
+    int                 m_iResumedPass;
+
+    // Progress and checkpoints, for the thread that called Simulate
+    const wchar_t*      m_strCheckpoint;
+    UINT                m_nCheckpointSeconds;
+    LPPRTNATIVECALLBACK m_pCB;
+    void*               m_pUserContext;
+    const float*        m_pTotal;           // The pOut of Simulate
+    double              m_fLastProgress;
+    double              m_fLastCheckpoint;
+};
+
+#endif
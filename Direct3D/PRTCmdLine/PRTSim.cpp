@@ -11,6 +11,10 @@
 #include <conio.h>
 #include "config.h"
 #include "PRTSim.h"
+#include "PRTNativeSim.h"
+
+// The native simulator saves its work this often
+#define NATIVE_CHECKPOINT_SECONDS 30
 
 struct PRT_STATE
 {
@@ -32,6 +36,11 @@ struct PRT_STATE
 HRESULT RunPRTSimulator( IDirect3DDevice9* pd3dDevice, SIMULATOR_OPTIONS* pOptions, CONCAT_MESH* pPRTMesh,
                          CONCAT_MESH* pBlockerMesh );
 HRESULT WINAPI StaticPRTSimulatorCB( float fPercentDone, LPVOID pParam );
+HRESULT RunNativeSimulator( SIMULATOR_OPTIONS* pOptions, CONCAT_MESH* pPRTMesh, CONCAT_MESH* pBlockerMesh,
+                            SETTINGS* pSettings, PRT_STATE* pPRTState, ID3DXPRTBuffer** ppDataTotal );
+HRESULT GetMeshTriangles( ID3DXMesh* pMesh, CGrowableArray <PRTNATIVE_VECTOR>* pPositions,
+                          CGrowableArray <PRTNATIVE_VECTOR>* pNormals, CGrowableArray <DWORD>* pIndices,
+                          CGrowableArray <DWORD>* pAttributes );
 
 //-----------------------------------------------------------------------------
 // static helper function
@@ -44,6 +53,7 @@ DWORD WINAPI StaticUIThreadProc( LPVOID lpParameter )
     float fLastPercent = -1.0f;
     double fLastPercentAnnounceTime = 0.0f;
 
+    DXUTProfilerSetThreadName( L"Progress" );
     DXUTGetGlobalTimer()->Start();
 
     while( !bStop )
@@ -89,6 +99,7 @@ DWORD WINAPI StaticUIThreadProc( LPVOID lpParameter )
 HRESULT RunPRTSimulator( IDirect3DDevice9* pd3dDevice, SIMULATOR_OPTIONS* pOptions,
                          CONCAT_MESH* pPRTMesh, CONCAT_MESH* pBlockerMesh, SETTINGS* pSettings )
 {
+    CDXUTProfileScope ProfileScope( L"RunPRTSimulator" );
     DWORD dwResult;
     DWORD dwThreadId;
 
@@ -105,6 +116,12 @@ HRESULT RunPRTSimulator( IDirect3DDevice9* pd3dDevice, SIMULATOR_OPTIONS* pOptio
         }
     }
 
+    if( pSettings->bNative && ( bSubsurfaceScattering || pOptions->bEnableTessellation ) )
+    {
+        wprintf( L"\nWarning: The native simulator ignores subsurface scattering and tessellation" );
+        bSubsurfaceScattering = false;
+    }
+
     PRT_STATE prtState;
     ZeroMemory( &prtState, sizeof( PRT_STATE ) );
     InitializeCriticalSection( &prtState.cs );
@@ -117,6 +134,8 @@ HRESULT RunPRTSimulator( IDirect3DDevice9* pd3dDevice, SIMULATOR_OPTIONS* pOptio
         prtState.nNumPasses++;
     if( pOptions->bEnableTessellation )
         prtState.nNumPasses++;
+    if( pSettings->bNative )
+        prtState.nNumPasses = 1;
     if( pOptions->bEnableCompression )
         prtState.nNumPasses += 2;
     prtState.nNumPasses += 2;
@@ -138,37 +157,47 @@ HRESULT RunPRTSimulator( IDirect3DDevice9* pd3dDevice, SIMULATOR_OPTIONS* pOptio
     ID3DXPRTBuffer* pBufferB = NULL;
     ID3DXPRTBuffer* pBufferC = NULL;
     ID3DXPRTCompBuffer* pPRTCompBuffer = NULL;
+    D3DXSHMATERIAL** pMatPtrArray = NULL;
 
-    DWORD* pdwAdj = new DWORD[pPRTMesh->pMesh->GetNumFaces() * 3];
-    pPRTMesh->pMesh->GenerateAdjacency( 1e-6f, pdwAdj );
-    V( D3DXCreatePRTEngine( pPRTMesh->pMesh, pdwAdj, FALSE, pBlockerMesh->pMesh, &pPRTEngine ) );
-    delete[] pdwAdj;
+    if( !pSettings->bNative )
+    {
+        DWORD* pdwAdj = new DWORD[pPRTMesh->pMesh->GetNumFaces() * 3];
+        pPRTMesh->pMesh->GenerateAdjacency( 1e-6f, pdwAdj );
+        V( D3DXCreatePRTEngine( pPRTMesh->pMesh, pdwAdj, FALSE, pBlockerMesh->pMesh, &pPRTEngine ) );
+        delete[] pdwAdj;
 
-    V( pPRTEngine->SetCallBack( StaticPRTSimulatorCB, 0.001f, &prtState ) );
-    V( pPRTEngine->SetSamplingInfo( pOptions->dwNumRays, FALSE, TRUE, FALSE, 0.0f ) );
+        V( pPRTEngine->SetCallBack( StaticPRTSimulatorCB, 0.001f, &prtState ) );
+        V( pPRTEngine->SetSamplingInfo( pOptions->dwNumRays, FALSE, TRUE, FALSE, 0.0f ) );
 
-    //    if( pOptions->bEnableTessellation && pPRTMesh->materialArray.GetAt(1).->GetAlbedoTexture() )
-    {
-        //      V( pPRTEngine->SetPerTexelAlbedo( m_pPRTMesh->GetAlbedoTexture(), 
-        //                                        pOptions->dwNumChannels, NULL ) );
-    }
+        //    if( pOptions->bEnableTessellation && pPRTMesh->materialArray.GetAt(1).->GetAlbedoTexture() )
+        {
+            //      V( pPRTEngine->SetPerTexelAlbedo( m_pPRTMesh->GetAlbedoTexture(), 
+            //                                        pOptions->dwNumChannels, NULL ) );
+        }
 
-    bool bSetAlbedoFromMaterial = true;
-    //    if( pOptions->bEnableTessellation && m_pPRTMesh->GetAlbedoTexture() )
-    //        bSetAlbedoFromMaterial = false;
+        bool bSetAlbedoFromMaterial = true;
+        //    if( pOptions->bEnableTessellation && m_pPRTMesh->GetAlbedoTexture() )
+        //        bSetAlbedoFromMaterial = false;
 
-    D3DXSHMATERIAL* pMatPtr = pPRTMesh->shMaterialArray.GetData();
-    D3DXSHMATERIAL** pMatPtrArray = new D3DXSHMATERIAL*[nNumMaterials];
-    if( pMatPtrArray == NULL )
-        return E_OUTOFMEMORY;
-    for( int i = 0; i < nNumMaterials; ++i )
-        pMatPtrArray[i] = &pMatPtr[i];
+        D3DXSHMATERIAL* pMatPtr = pPRTMesh->shMaterialArray.GetData();
+        pMatPtrArray = new D3DXSHMATERIAL*[nNumMaterials];
+        if( pMatPtrArray == NULL )
+            return E_OUTOFMEMORY;
+        for( int i = 0; i < nNumMaterials; ++i )
+            pMatPtrArray[i] = &pMatPtr[i];
 
-    V( pPRTEngine->SetMeshMaterials( ( const D3DXSHMATERIAL** )pMatPtrArray, nNumMaterials,
-                                     pOptions->dwNumChannels,
-                                     bSetAlbedoFromMaterial, pOptions->fLengthScale ) );
+        V( pPRTEngine->SetMeshMaterials( ( const D3DXSHMATERIAL** )pMatPtrArray, nNumMaterials,
+                                         pOptions->dwNumChannels,
+                                         bSetAlbedoFromMaterial, pOptions->fLengthScale ) );
+    }
 
-    if( !bSubsurfaceScattering )
+    if( pSettings->bNative )
+    {
+        hr = RunNativeSimulator( pOptions, pPRTMesh, pBlockerMesh, pSettings, &prtState, &pDataTotal );
+        if( FAILED( hr ) )
+            goto LEarlyExit; // handle user aborting simulator via callback 
+    }
+    else if( !bSubsurfaceScattering )
     {
         // Not doing subsurface scattering
         if( pOptions->bEnableTessellation && pOptions->bRobustMeshRefine )
@@ -336,7 +365,7 @@ HRESULT RunPRTSimulator( IDirect3DDevice9* pd3dDevice, SIMULATOR_OPTIONS* pOptio
 
     }
 
-    if( pOptions->bEnableTessellation )
+    if( pOptions->bEnableTessellation && !pSettings->bNative )
     {
         ID3DXMesh* pAdaptedMesh;
         V( pPRTEngine->GetAdaptedMesh( pd3dDevice, NULL, NULL, NULL, &pAdaptedMesh ) );
@@ -409,8 +438,11 @@ HRESULT RunPRTSimulator( IDirect3DDevice9* pd3dDevice, SIMULATOR_OPTIONS* pOptio
         LeaveCriticalSection( &prtState.cs );
 
         // Limit the max number of PCA vectors to # channels * # coeffs
-        hr = D3DXCreatePRTCompBuffer( pOptions->Quality, pOptions->dwNumClusters, pOptions->dwNumPCA,
-                                      StaticPRTSimulatorCB, &prtState, pDataTotal, &pPRTCompBuffer );
+        {
+            CDXUTProfileScope CompressScope( L"D3DXCreatePRTCompBuffer" );
+            hr = D3DXCreatePRTCompBuffer( pOptions->Quality, pOptions->dwNumClusters, pOptions->dwNumPCA,
+                                          StaticPRTSimulatorCB, &prtState, pDataTotal, &pPRTCompBuffer );
+        }
         if( FAILED( hr ) )
             goto LEarlyExit; // handle user aborting simulator via callback 
 
@@ -496,3 +528,152 @@ HRESULT WINAPI StaticPRTSimulatorCB( float fPercentDone, LPVOID pParam )
     return hr;
 }
 
+
+
+//-----------------------------------------------------------------------------
+// Direct lighting and every bounce with CPRTNativeSimulator, into a PRT buffer as the
+// D3DX engine would have left it.  Albedos come from the diffuse color of the SH
+// materials, as the engine takes them.
+//-----------------------------------------------------------------------------
+HRESULT RunNativeSimulator( SIMULATOR_OPTIONS* pOptions, CONCAT_MESH* pPRTMesh, CONCAT_MESH* pBlockerMesh,
+                            SETTINGS* pSettings, PRT_STATE* pPRTState, ID3DXPRTBuffer** ppDataTotal )
+{
+    HRESULT hr;
+    CGrowableArray <PRTNATIVE_VECTOR> aPositions, aNormals, aBlockerPositions;
+    CGrowableArray <DWORD> aIndices, aAttributes, aBlockerIndices;
+    CGrowableArray <PRTNATIVE_COLOR> aAlbedos;
+
+    V_RETURN( GetMeshTriangles( pPRTMesh->pMesh, &aPositions, &aNormals, &aIndices, &aAttributes ) );
+    if( pBlockerMesh->pMesh )
+        V_RETURN( GetMeshTriangles( pBlockerMesh->pMesh, &aBlockerPositions, NULL, &aBlockerIndices, NULL ) );
+    for( int i = 0; i < pPRTMesh->shMaterialArray.GetSize(); i++ )
+    {
+        const D3DCOLORVALUE& Diffuse = pPRTMesh->shMaterialArray[i].Diffuse;
+        PRTNATIVE_COLOR Albedo = { Diffuse.r, Diffuse.g, Diffuse.b };
+        V_RETURN( aAlbedos.Add( Albedo ) );
+    }
+    if( aAlbedos.GetSize() == 0 )
+    {
+        PRTNATIVE_COLOR White = { 1.0f, 1.0f, 1.0f };
+        V_RETURN( aAlbedos.Add( White ) );
+    }
+
+    CPRTNativeSimulator Simulator;
+    V_RETURN( Simulator.Create( aPositions.GetData(), aNormals.GetData(), aPositions.GetSize(), aIndices.GetData(),
+                                aAttributes.GetData(), aAttributes.GetSize(), aAlbedos.GetData(),
+                                aAlbedos.GetSize(), aBlockerPositions.GetData(), aBlockerPositions.GetSize(),
+                                aBlockerIndices.GetData(), aBlockerIndices.GetSize() / 3 ) );
+
+    const UINT nVertices = Simulator.GetNumVertices();
+    const UINT nCoeffs = pOptions->dwOrder * pOptions->dwOrder;
+    V_RETURN( D3DXCreatePRTBuffer( nVertices, nCoeffs, pOptions->dwNumChannels, ppDataTotal ) );
+
+    FLOAT* pResults = new FLOAT[( SIZE_T )nVertices * nCoeffs * pOptions->dwNumChannels];
+    if( pResults == NULL )
+        return E_OUTOFMEMORY;
+
+    WCHAR strCheckpoint[MAX_PATH];
+    swprintf_s( strCheckpoint, MAX_PATH, L"%s.checkpoint", pOptions->strOutputPRTBuffer );
+
+    EnterCriticalSection( &pPRTState->cs );
+    pPRTState->nCurPass++;
+    swprintf_s( pPRTState->strCurPass, 256, L"\nStage %d of %d: Computing Direct Lighting and %d Bounces..",
+                     pPRTState->nCurPass, pPRTState->nNumPasses, pOptions->dwNumBounces - 1 );
+    wprintf( pPRTState->strCurPass );
+    pPRTState->fPercentDone = 0.0f;
+    LeaveCriticalSection( &pPRTState->cs );
+
+    {
+        CDXUTProfileScope SimulateScope( L"CPRTNativeSimulator::Simulate" );
+        hr = Simulator.Simulate( pOptions->dwOrder, pOptions->dwNumRays, pOptions->dwNumBounces,
+                                 pOptions->dwNumChannels, pResults, strCheckpoint, NATIVE_CHECKPOINT_SECONDS,
+                                 pSettings->nThreads, StaticPRTSimulatorCB, pPRTState );
+    }
+    if( SUCCEEDED( hr ) )
+    {
+        FLOAT* pData = NULL;
+        if( SUCCEEDED( hr = ( *ppDataTotal )->LockBuffer( 0, nVertices, &pData ) ) )
+        {
+            memcpy( pData, pResults, ( SIZE_T )nVertices * nCoeffs * pOptions->dwNumChannels * sizeof( FLOAT ) );
+            ( *ppDataTotal )->UnlockBuffer();
+        }
+    }
+    SAFE_DELETE_ARRAY( pResults );
+
+    EnterCriticalSection( &pPRTState->cs );
+    if( Simulator.GetResumedPass() >= 0 )
+        wprintf( L"\nCarried on from pass %d of %s", Simulator.GetResumedPass() + 1, strCheckpoint );
+    if( SUCCEEDED( hr ) )
+        wprintf( L"\n%I64u rays in %0.1f s: %0.2f million rays a second", Simulator.GetNumRays(),
+                 Simulator.GetSeconds(), Simulator.GetNumRays() / ( 1e6 * __max( Simulator.GetSeconds(), 1e-6 ) ) );
+    else if( hr == E_FAIL )
+        wprintf( L"\nThe work so far is saved to %s", strCheckpoint );
+    LeaveCriticalSection( &pPRTState->cs );
+
+    return hr;
+}
+
+
+//-----------------------------------------------------------------------------
+// Copies the positions, normals, indices and face attributes out of a mesh.  pNormals
+// and pAttributes may be NULL.
+//-----------------------------------------------------------------------------
+HRESULT GetMeshTriangles( ID3DXMesh* pMesh, CGrowableArray <PRTNATIVE_VECTOR>* pPositions,
+                          CGrowableArray <PRTNATIVE_VECTOR>* pNormals, CGrowableArray <DWORD>* pIndices,
+                          CGrowableArray <DWORD>* pAttributes )
+{
+    HRESULT hr;
+    D3DVERTEXELEMENT9 aDecl[MAX_FVF_DECL_SIZE];
+    V_RETURN( pMesh->GetDeclaration( aDecl ) );
+
+    int nPositionOffset = -1, nNormalOffset = -1;
+    for( UINT i = 0; aDecl[i].Stream != 0xFF; i++ )
+    {
+        if( aDecl[i].Usage == D3DDECLUSAGE_POSITION && aDecl[i].UsageIndex == 0 )
+            nPositionOffset = aDecl[i].Offset;
+        if( aDecl[i].Usage == D3DDECLUSAGE_NORMAL && aDecl[i].UsageIndex == 0 )
+            nNormalOffset = aDecl[i].Offset;
+    }
+    if( nPositionOffset < 0 || ( pNormals && nNormalOffset < 0 ) )
+    {
+        wprintf( L"\nError: The native simulator needs meshes with positions and normals" );
+        return E_FAIL;
+    }
+
+    const DWORD dwNumVertices = pMesh->GetNumVertices();
+    const DWORD dwNumFaces = pMesh->GetNumFaces();
+    const DWORD dwStride = pMesh->GetNumBytesPerVertex();
+    V_RETURN( pPositions->Reserve( dwNumVertices ) );
+    if( pNormals )
+        V_RETURN( pNormals->Reserve( dwNumVertices ) );
+    V_RETURN( pIndices->Reserve( dwNumFaces * 3 ) );
+
+    BYTE* pVertices = NULL;
+    V_RETURN( pMesh->LockVertexBuffer( D3DLOCK_READONLY, ( void** )&pVertices ) );
+    for( DWORD i = 0; i < dwNumVertices; i++ )
+    {
+        pPositions->Add( *( PRTNATIVE_VECTOR* )( pVertices + i * dwStride + nPositionOffset ) );
+        if( pNormals )
+            pNormals->Add( *( PRTNATIVE_VECTOR* )( pVertices + i * dwStride + nNormalOffset ) );
+    }
+    pMesh->UnlockVertexBuffer();
+
+    void* pIndexData = NULL;
+    V_RETURN( pMesh->LockIndexBuffer( D3DLOCK_READONLY, &pIndexData ) );
+    const bool b32Bit = ( pMesh->GetOptions() & D3DXMESH_32BIT ) != 0;
+    for( DWORD i = 0; i < dwNumFaces * 3; i++ )
+        pIndices->Add( b32Bit ? ( ( DWORD* )pIndexData )[i] : ( ( WORD* )pIndexData )[i] );
+    pMesh->UnlockIndexBuffer();
+
+    if( pAttributes )
+    {
+        DWORD* pdwAttributes = NULL;
+        V_RETURN( pAttributes->Reserve( dwNumFaces ) );
+        V_RETURN( pMesh->LockAttributeBuffer( D3DLOCK_READONLY, &pdwAttributes ) );
+        for( DWORD i = 0; i < dwNumFaces; i++ )
+            pAttributes->Add( pdwAttributes[i] );
+        pMesh->UnlockAttributeBuffer();
+    }
+
+    return S_OK;
+}
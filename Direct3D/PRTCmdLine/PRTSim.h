@@ -12,6 +12,10 @@ struct SETTINGS
     bool bSubDirs;
     bool bUserAbort;
     bool bVerbose;
+    WCHAR strTraceFile[MAX_PATH];   // If not empty, the CPU profiler's trace is written here
+    bool bNative;                   // Use CPRTNativeSimulator rather than the D3DX PRT engine
+    UINT nThreads;                  // Threads for the native simulator, 0 for one for each processor
+    bool bOptionsBenchmark;         // Time the options readers and writer rather than simulating
     CGrowableArray <WCHAR*> aFiles;
 };
 
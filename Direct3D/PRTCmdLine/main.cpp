@@ -10,6 +10,7 @@
 #include "SDKmisc.h"
 #include <stdio.h>
 #include <conio.h>
+#include <float.h>
 #include "config.h"
 #include "PRTSim.h"
 
@@ -29,6 +30,8 @@ bool GetNextArg( WCHAR*& strsettings, WCHAR* strArg, int cchArg );
 void SearchDirForFile( IDirect3DDevice9* pd3dDevice, WCHAR* strDir, WCHAR* strFile, SETTINGS* pSettings );
 void SeachSubdirsForFile( IDirect3DDevice9* pd3dDevice, WCHAR* strDir, WCHAR* strFile, SETTINGS* pSettings );
 HRESULT ProcessOptionsFile( IDirect3DDevice9* pd3dDevice, WCHAR* strOptionsFileName, SETTINGS* pSettings );
+void WriteProfile( WCHAR* strTraceFile );
+void RunOptionsBenchmark();
 
 
 //-----------------------------------------------------------------------------
@@ -48,6 +51,10 @@ int wmain( int argc, wchar_t* argv[] )
     settings.bUserAbort = false;
     settings.bSubDirs = false;
     settings.bVerbose = false;
+    settings.strTraceFile[0] = 0;
+    settings.bNative = false;
+    settings.nThreads = 0;
+    settings.bOptionsBenchmark = false;
 
     if( argc < 2 )
     {
@@ -61,6 +68,18 @@ int wmain( int argc, wchar_t* argv[] )
         goto LCleanup;
     }
 
+    if( settings.strTraceFile[0] != 0 )
+    {
+        DXUTProfilerSetThreadName( L"Simulator" );
+        DXUTProfilerEnable( true );
+    }
+
+    if( settings.bOptionsBenchmark )
+    {
+        RunOptionsBenchmark();
+        goto LCleanup;
+    }
+
     if( settings.aFiles.GetSize() == 0 )
     {
         WCHAR* strNewArg = new WCHAR[256];
@@ -114,6 +133,9 @@ int wmain( int argc, wchar_t* argv[] )
 LCleanup:
     wprintf( L"\n" );
 
+    if( settings.strTraceFile[0] != 0 )
+        WriteProfile( settings.strTraceFile );
+
     // Cleanup
     for( int i = 0; i < settings.aFiles.GetSize(); i++ )
         SAFE_DELETE_ARRAY( settings.aFiles[i] );
@@ -177,6 +199,43 @@ bool ParseCommandLine( SETTINGS* pSettings )
                 continue;
             }
 
+            if( IsNextArg( strsettings, L"trace" ) )
+            {
+                while( *strsettings && iswspace( *strsettings ) )
+                    strsettings++;
+                if( GetNextArg( strsettings, pSettings->strTraceFile, MAX_PATH ) )
+                    continue;
+                wprintf( L"Missing filename after /trace\n" );
+                bDisplayHelp = true;
+                continue;
+            }
+
+            if( IsNextArg( strsettings, L"native" ) )
+            {
+                pSettings->bNative = true;
+                continue;
+            }
+
+            if( IsNextArg( strsettings, L"optbench" ) )
+            {
+                pSettings->bOptionsBenchmark = true;
+                continue;
+            }
+
+            if( IsNextArg( strsettings, L"threads" ) )
+            {
+                while( *strsettings && iswspace( *strsettings ) )
+                    strsettings++;
+                if( GetNextArg( strsettings, strArg, 256 ) )
+                {
+                    pSettings->nThreads = ( UINT )_wtoi( strArg );
+                    continue;
+                }
+                wprintf( L"Missing count after /threads\n" );
+                bDisplayHelp = true;
+                continue;
+            }
+
             if( IsNextArg( strsettings, L"?" ) )
             {
                 DisplayUsage();
@@ -344,14 +403,22 @@ HRESULT ProcessOptionsFile( IDirect3DDevice9* pd3dDevice, WCHAR* strOptionsFileN
     // Load options xml file
     swprintf_s( sz, 256, L"Reading options file: %s\n", strOptionsFileName );
     wprintf( sz );
-    if( FAILED( hr = optFile.LoadOptions( strOptionsFileName, &options ) ) )
+    {
+        CDXUTProfileScope ProfileScope( L"LoadOptions" );
+        hr = optFile.LoadOptions( strOptionsFileName, &options );
+    }
+    if( FAILED( hr ) )
     {
         wprintf( L"Error: Failure reading options file.  Ensure schema matchs example options.xml file\n" );
         goto LCleanup;
     }
 
     // Load and concat meshes to a single mesh
-    if( FAILED( hr = LoadMeshes( pd3dDevice, &options, &prtMesh, &blockerMesh, pSettings ) ) )
+    {
+        CDXUTProfileScope ProfileScope( L"LoadMeshes" );
+        hr = LoadMeshes( pd3dDevice, &options, &prtMesh, &blockerMesh, pSettings );
+    }
+    if( FAILED( hr ) )
     {
         wprintf( L"Error: Can not load meshes\n" );
         goto LCleanup;
@@ -706,14 +773,181 @@ void DisplayUsage()
     wprintf( L"\n" );
     wprintf( L"PRTCmdLine - a command line PRT simulator tool\n" );
     wprintf( L"\n" );
-    wprintf( L"Usage: PRTCmdLine.exe [/s] [filename1] [filename2] ...\n" );
+    wprintf( L"Usage: PRTCmdLine.exe [/s] [/v] [/trace file] [/native] [/threads n]\n" );
+    wprintf( L"                      [/optbench] [filename1] [filename2] ...\n" );
     wprintf( L"\n" );
     wprintf( L"where:\n" );
     wprintf( L"\n" );
     wprintf( L"  [/v]\t\tVerbose output.  Useful for debugging\n" );
+    wprintf( L"  [/trace file]\tTimes the tool and writes a Chrome trace (chrome://tracing)\n" );
+    wprintf( L"  \t\tto file\n" );
+    wprintf( L"  [/native]\tSimulates on the CPU with the tool's own ray tracer rather than\n" );
+    wprintf( L"  \t\tthe D3DX PRT engine.  Subsurface scattering and tessellation\n" );
+    wprintf( L"  \t\tare not supported, and the work is saved to the PRT buffer's\n" );
+    wprintf( L"  \t\tname plus .checkpoint as it goes so a stopped run carries on\n" );
+    wprintf( L"  [/threads n]\tThreads for /native, up to and by default one for each\n" );
+    wprintf( L"  \t\tprocessor\n" );
+    wprintf( L"  [/optbench]\tTimes writing and reading options files of 10 to 10000 meshes\n" );
+    wprintf( L"  \t\twith the tool's own XML reader and with MSXML, and checks the\n" );
+    wprintf( L"  \t\ttwo read the same options\n" );
     wprintf( L"  [/s]\t\tSearches in the specified directory and all subdirectoies of\n" );
     wprintf( L"  \t\teach filename\n" );
     wprintf( L"  [filename*]\tSpecifies the directory and XML files to read.  Wildcards are\n" );
     wprintf( L"  \t\tsupported.\n" );
     wprintf( L"  \t\tSee options.xml for an example options XML file\n" );
 }
+
+
+//--------------------------------------------------------------------------------------
+// Writes the CPU profiler's trace and prints the time taken by each zone
+//--------------------------------------------------------------------------------------
+void WriteProfile( WCHAR* strTraceFile )
+{
+    if( FAILED( DXUTProfilerWriteTrace( strTraceFile ) ) )
+        wprintf( L"Error: Failed writing trace to %s\n", strTraceFile );
+    else
+        wprintf( L"Trace written to %s\n", strTraceFile );
+
+    CGrowableArray <DXUT_PROFILE_ZONE_STATS> Stats;
+    if( FAILED( DXUTProfilerGetZoneStats( &Stats ) ) )
+        return;
+
+    wprintf( L"%-24s %8s %12s %12s %12s %12s\n", L"zone", L"count", L"min ms", L"avg ms", L"p99 ms", L"max ms" );
+    for( int i = 0; i < Stats.GetSize(); i++ )
+    {
+        wprintf( L"%-24s %8u %12.3f %12.3f %12.3f %12.3f\n", Stats[i].strName, Stats[i].nCount, Stats[i].fMinMs,
+                 Stats[i].fAvgMs, Stats[i].fP99Ms, Stats[i].fMaxMs );
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Fills pOptions with the default settings and nMeshes meshes of two materials each,
+// every one a little different so a field read into the wrong place shows up
+//--------------------------------------------------------------------------------------
+HRESULT MakeBenchmarkOptions( COptionsFile* pOptFile, SIMULATOR_OPTIONS* pOptions, DWORD nMeshes )
+{
+    HRESULT hr;
+    ZeroMemory( pOptions, sizeof( SIMULATOR_OPTIONS ) );
+    V_RETURN( pOptFile->ResetOptions( pOptions ) );
+    pOptFile->FreeOptions( pOptions );
+
+    pOptions->pInputMeshes = new INPUT_MESH[nMeshes];
+    if( pOptions->pInputMeshes == NULL )
+        return E_OUTOFMEMORY;
+    ZeroMemory( pOptions->pInputMeshes, sizeof( INPUT_MESH ) * nMeshes );
+    pOptions->dwNumMeshes = nMeshes;
+
+    for( DWORD iMesh = 0; iMesh < nMeshes; iMesh++ )
+    {
+        INPUT_MESH* pMesh = &pOptions->pInputMeshes[iMesh];
+        swprintf_s( pMesh->strMeshFile, MAX_PATH, L"Meshes\\Mesh & Part %u.x", iMesh );
+        pMesh->bIsBlockerMesh = ( iMesh % 3 ) == 0;
+        pMesh->vTranslate = D3DXVECTOR3( iMesh * 0.25f, -( float )iMesh, 2.5f );
+        pMesh->vScale = D3DXVECTOR3( 1.0f, 2.0f, 0.5f );
+        pMesh->fYaw = iMesh * 0.125f;
+        pMesh->fPitch = 0.75f;
+        pMesh->fRoll = -0.5f;
+
+        pMesh->dwNumSHMaterials = 2;
+        pMesh->pSHMaterials = new D3DXSHMATERIAL[2];
+        if( pMesh->pSHMaterials == NULL )
+            return E_OUTOFMEMORY;
+        for( DWORD iSH = 0; iSH < 2; iSH++ )
+        {
+            D3DXSHMATERIAL* pMat = &pMesh->pSHMaterials[iSH];
+            ZeroMemory( pMat, sizeof( D3DXSHMATERIAL ) );
+            pMat->Diffuse = D3DXCOLOR( 0.5f, iSH * 0.25f, ( iMesh % 100 ) * 0.01f, 1.0f );
+            pMat->bSubSurf = iSH == 1;
+            pMat->RelativeIndexOfRefraction = 1.3f;
+            pMat->Absorption = D3DXCOLOR( 0.0021f, 0.0041f, 0.0071f, 1.0f );
+            pMat->ReducedScattering = D3DXCOLOR( 2.19f, 2.62f, 3.00f, 1.0f );
+        }
+    }
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Times SaveOptions, LoadOptionsMSXML and LoadOptions over growing options files and
+// checks the two readers agree
+//--------------------------------------------------------------------------------------
+void RunOptionsBenchmark()
+{
+    WCHAR strFile[MAX_PATH];
+    DWORD dwLen = GetTempPath( MAX_PATH, strFile );
+    if( dwLen == 0 || dwLen > MAX_PATH - 32 )
+        strFile[0] = 0;
+    wcscat_s( strFile, MAX_PATH, L"PRTCmdLineBench.xml" );
+
+    LARGE_INTEGER Frequency;
+    QueryPerformanceFrequency( &Frequency );
+
+    wprintf( L"%8s %10s %10s %10s %10s %8s %6s\n", L"meshes", L"file KB", L"save ms", L"MSXML ms", L"native ms",
+             L"speedup", L"same" );
+
+    const DWORD aMeshCounts[] = { 10, 100, 1000, 10000 };
+    for( UINT iCount = 0; iCount < ARRAYSIZE( aMeshCounts ); iCount++ )
+    {
+        DWORD nMeshes = aMeshCounts[iCount];
+        int nRuns = nMeshes >= 10000 ? 3 : 10;
+
+        COptionsFile optFile;
+        SIMULATOR_OPTIONS Options;
+        if( FAILED( MakeBenchmarkOptions( &optFile, &Options, nMeshes ) ) )
+        {
+            wprintf( L"Error: Out of memory\n" );
+            optFile.FreeOptions( &Options );
+            break;
+        }
+
+        // Best of nRuns for each, so the cache and the disk are warm for all three
+        double fSave = DBL_MAX, fMSXML = DBL_MAX, fNative = DBL_MAX;
+        bool bOk = true;
+        bool bSame = true;
+        for( int iRun = 0; iRun < nRuns && bOk; iRun++ )
+        {
+            LARGE_INTEGER Start, End;
+            QueryPerformanceCounter( &Start );
+            bOk = SUCCEEDED( optFile.SaveOptions( strFile, &Options ) );
+            QueryPerformanceCounter( &End );
+            fSave = __min( fSave, ( End.QuadPart - Start.QuadPart ) * 1000.0 / Frequency.QuadPart );
+
+            SIMULATOR_OPTIONS MSXMLOptions;
+            ZeroMemory( &MSXMLOptions, sizeof( SIMULATOR_OPTIONS ) );
+            QueryPerformanceCounter( &Start );
+            bOk = bOk && SUCCEEDED( optFile.LoadOptionsMSXML( strFile, &MSXMLOptions ) );
+            QueryPerformanceCounter( &End );
+            fMSXML = __min( fMSXML, ( End.QuadPart - Start.QuadPart ) * 1000.0 / Frequency.QuadPart );
+
+            SIMULATOR_OPTIONS NativeOptions;
+            ZeroMemory( &NativeOptions, sizeof( SIMULATOR_OPTIONS ) );
+            QueryPerformanceCounter( &Start );
+            bOk = bOk && SUCCEEDED( optFile.LoadOptions( strFile, &NativeOptions ) );
+            QueryPerformanceCounter( &End );
+            fNative = __min( fNative, ( End.QuadPart - Start.QuadPart ) * 1000.0 / Frequency.QuadPart );
+
+            if( bOk )
+                bSame = bSame && COptionsFile::SameOptions( &NativeOptions, &MSXMLOptions );
+
+            optFile.FreeOptions( &MSXMLOptions );
+            optFile.FreeOptions( &NativeOptions );
+        }
+
+        ULONGLONG nBytes = 0;
+        WIN32_FILE_ATTRIBUTE_DATA FileData;
+        if( GetFileAttributesEx( strFile, GetFileExInfoStandard, &FileData ) )
+            nBytes = ( ( ULONGLONG )FileData.nFileSizeHigh << 32 ) | FileData.nFileSizeLow;
+
+        if( bOk )
+            wprintf( L"%8u %10.1f %10.3f %10.3f %10.3f %7.1fx %6s\n", nMeshes, nBytes / 1024.0, fSave, fMSXML,
+                     fNative, fMSXML / __max( fNative, 0.001 ), bSame ? L"yes" : L"NO" );
+        else
+            wprintf( L"%8u Error: Failed writing or reading %s\n", nMeshes, strFile );
+
+        optFile.FreeOptions( &Options );
+    }
+
+    DeleteFile( strFile );
+}
@@ -6,6 +6,7 @@
 //-----------------------------------------------------------------------------
 #include "DXUT.h"
 #include "SDKmisc.h"
+#include "SDKSH.h"
 #include "lightprobe.h"
 
 //#define DEBUG_VS   // Uncomment this line to debug vertex shaders 
@@ -83,7 +84,7 @@ void WINAPI SHCubeFill( D3DXVECTOR4* pOut,
     D3DXVec3Normalize( &vDir,pTexCoord );
 
     float fVals[36];
-    D3DXSHEvalDirection( fVals, pCP->iOrderUse, &vDir );
+    DXUTSHEvalDirection( fVals, pCP->iOrderUse, &vDir );
 
     ( *pOut ) = D3DXVECTOR4( 0,0,0,0 ); // just clear it out...
 
@@ -125,7 +126,7 @@ HRESULT CLightProbe::OnCreateDevice( LPDIRECT3DDEVICE9 pd3dDevice, const WCHAR*
 
     // Some devices don't support D3DFMT_A16B16G16R16F textures and thus
     // D3DX will return the texture in a HW compatible format with the possibility of losing its 
-    // HDR lighting information.  This will change the SH values returned from D3DXSHProjectCubeMap()
+    // HDR lighting information.  This will change the SH values returned from DXUTSHProjectCubeTexture9()
     // as the cube map will no longer be HDR.  So if this happens, create a load the cube map on 
     // scratch memory and project using that cube map.  But keep the other one around to render the 
     // background texture with.
@@ -142,7 +143,7 @@ HRESULT CLightProbe::OnCreateDevice( LPDIRECT3DDEVICE9 pd3dDevice, const WCHAR*
         if( SUCCEEDED( hr ) )
         {
             // prefilter the lighting environment by projecting onto the order 6 SH basis.  
-            V( D3DXSHProjectCubeMap( 6, pScratchEnvironmentMap, m_fSHData[0], m_fSHData[1], m_fSHData[2] ) );
+            V( DXUTSHProjectCubeTexture9( 6, pScratchEnvironmentMap, m_fSHData[0], m_fSHData[1], m_fSHData[2] ) );
             bUsedScratchMem = true;
             SAFE_RELEASE( pScratchEnvironmentMap );
         }
@@ -151,7 +152,7 @@ HRESULT CLightProbe::OnCreateDevice( LPDIRECT3DDEVICE9 pd3dDevice, const WCHAR*
     if( !bUsedScratchMem )
     {
         // prefilter the lighting environment by projecting onto the order 6 SH basis.  
-        V( D3DXSHProjectCubeMap( 6, m_pEnvironmentMap, m_fSHData[0], m_fSHData[1], m_fSHData[2] ) );
+        V( DXUTSHProjectCubeTexture9( 6, m_pEnvironmentMap, m_fSHData[0], m_fSHData[1], m_fSHData[2] ) );
     }
 
     if( bCreateSHEnvironmentMapTexture )
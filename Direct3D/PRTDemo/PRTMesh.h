@@ -7,6 +7,7 @@
 #pragma once
 
 #include "DXUTcamera.h"
+#include "SDKSH.h"
 
 class CPRTMesh
 {
@@ -182,6 +183,8 @@ protected:
     // have up to NUM_PCA_VECTORS of PCA vectors.  Each cluster also has 
     // a mean PCA vector which is described with 4 floats (and hence the +4).
     float* m_aPRTConstants;
+    // The same bases, laid out to compute m_aPRTConstants for all the clusters at once
+    CDXUTPRTClusterBasis m_PRTClusterBasis;
 
     ///////////
     // LDPRT
@@ -148,6 +148,9 @@ DWORD CPRTSimulator::PRTCompressThreadProc()
 {
     HRESULT hr;
 
+    DXUTProfilerSetThreadName( L"PRT Compress" );
+    CDXUTProfileScope ProfileScope( L"PRT Compress" );
+
     // Reset precent complete
     m_fPercentDone = 0.0f;
 
@@ -203,6 +206,9 @@ DWORD CPRTSimulator::PRTSimulationThreadProc()
 {
     HRESULT hr;
 
+    DXUTProfilerSetThreadName( L"PRT Simulation" );
+    CDXUTProfileScope ProfileScope( L"PRT Simulation" );
+
     // Reset precent complete
     m_fPercentDone = 0.0f;
 
@@ -6,6 +6,7 @@
 //--------------------------------------------------------------------------------------
 #include "DXUT.h"
 #include "SDKmisc.h"
+#include "SDKSH.h"
 #include "SHFuncView.h"
 #include "PRTMesh.h"
 #include <stdio.h>
@@ -209,7 +210,7 @@ void CSHFunctionViewer::SetCoeffs( float* pCoeffs, unsigned int uOrder, bool bSt
                 float sP = sinf( fPhi );
 
                 D3DXVECTOR3 vPos( cP* sT, sP* sT, cT ), vDT( 0.0f,0.0f,0.0f ), vDP( 0.0f,0.0f,0.0f ), vNrm;
-                D3DXSHEvalDirection( fCurVals, 6, &vPos );
+                DXUTSHEvalDirection( fCurVals, 6, &vPos );
 
                 CompDerivs( sT, cT, sP, cP, fDerivs );
                 float fVal = 0.0f;
@@ -276,7 +277,7 @@ void CSHFunctionViewer::SetCoeffs( float* pCoeffs, unsigned int uOrder, bool bSt
             D3DCOLOR clr = D3DCOLOR_ARGB( 0, 255, 0, 0 );
             D3DXVECTOR3 vPos( cP* sT, sP* sT, cT ), vDT( 0.0f,0.0f,0.0f ), vDP( 0.0f,0.0f,0.0f ), vNrm;
 
-            D3DXSHEvalDirection( fCurVals, 6, &vPos );
+            DXUTSHEvalDirection( fCurVals, 6, &vPos );
 
             CompDerivs( sT, cT, sP, cP, fDerivs );
             float fVal = 0.0f;
@@ -15,6 +15,7 @@
 #include "DXUTcamera.h"
 #include "DXUTsettingsdlg.h"
 #include "SDKmisc.h"
+#include "SDKSH.h"
 #include <msxml.h>
 #include "PRTMesh.h"
 #include "PRTSimulator.h"
@@ -23,6 +24,7 @@
 #include "SHFuncView.h"
 #include "resource.h"
 #include <shlobj.h>
+#include <float.h>
 
 // Enable extra D3D debugging in debug builds.  This makes D3D objects work well
 // in the debugger watch window, but slows down performance slightly.
@@ -218,6 +220,7 @@ void LoadSceneAndOptGenResults( IDirect3DDevice9* pd3dDevice, WCHAR* strInputMes
 void GetSupportedTextureFormat( IDirect3D9* pD3D, D3DCAPS9* pCaps, D3DFORMAT AdapterFormat, D3DFORMAT* pfmtTexture,
                                 D3DFORMAT* pfmtCubeMap );
 HRESULT FindPRTMediaFile( WCHAR* strDestPath, int cchDest, LPCWSTR strFilename, bool bCreatePath=false );
+INT RunSHBenchmark( int nArgs, LPWSTR* pstrArgs );
 
 //--------------------------------------------------------------------------------------
 // Entry point to the program. Initializes everything and goes into a message processing 
@@ -230,6 +233,23 @@ INT WINAPI wWinMain( HINSTANCE, HINSTANCE, LPWSTR, int )
     _CrtSetDbgFlag( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );
 #endif
 
+    // -shbench tests and times the SH math without creating a window
+    int nArgs = 0;
+    LPWSTR* pstrArgs = CommandLineToArgvW( GetCommandLineW(), &nArgs );
+    if( pstrArgs )
+    {
+        for( int i = 1; i < nArgs; i++ )
+        {
+            if( 0 == _wcsicmp( pstrArgs[i], L"-shbench" ) )
+            {
+                INT nResult = RunSHBenchmark( nArgs - i - 1, pstrArgs + i + 1 );
+                LocalFree( pstrArgs );
+                return nResult;
+            }
+        }
+        LocalFree( pstrArgs );
+    }
+
     // Set the callback functions. These functions allow DXUT to notify
     // the application about device changes, user input, and windows messages.  The 
     // callbacks are optional so you need only set callbacks for events you're interested 
@@ -1126,19 +1146,15 @@ void UpdateLightingEnvironment()
     float fConeRadius = ( float )( ( D3DX_PI * ( float )g_RenderingUI2.GetSlider( IDC_LIGHT_ANGLE )->GetValue() ) /
                                    180.0f );
 
-    float fLight[MAX_LIGHTS][3][D3DXSH_MAXORDER*D3DXSH_MAXORDER];
-
     D3DXCOLOR lightColor( 1.0f, 1.0f, 1.0f, 1.0f );
     lightColor *= fLightScale;
 
     DWORD dwOrder = g_PRTMesh.GetPRTOrder();
 
-    // Pass in the light direction, the intensity of each channel, and it returns
-    // the source radiance as an array of order^2 SH coefficients for each color channel.  
-    D3DXVECTOR3 lightDirObjectSpace;
     D3DXMATRIX mWorldInv;
     D3DXMatrixInverse( &mWorldInv, NULL, g_Camera.GetWorldMatrix() );
 
+    DXUT_SH_LIGHT aLights[MAX_LIGHTS];
     int i;
     for( i = 0; i < g_nNumActiveLights; i++ )
     {
@@ -1148,62 +1164,37 @@ void UpdateLightingEnvironment()
         // evaulate the lights in world and rotate the light coefficients 
         // into object space.
         D3DXVECTOR3 vLight = g_LightControl[i].GetLightDirection();
-        D3DXVec3TransformNormal( &lightDirObjectSpace, &vLight, &mWorldInv );
-
-        // This sample uses D3DXSHEvalDirectionalLight(), but there's other 
-        // types of lights provided by D3DXSHEval*.  Pass in the 
-        // order of SH, color of the light, and the direction of the light 
-        // in object space.
-        // The output is the source radiance coefficients for the SH basis functions.  
-        // There are 3 outputs, one for each channel (R,G,B). 
-        // Each output is an array of m_dwOrder^2 floats.  
-        V( D3DXSHEvalConeLight( dwOrder, &lightDirObjectSpace, fConeRadius,
-                                lightColor.r, lightColor.g, lightColor.b,
-                                fLight[i][0], fLight[i][1], fLight[i][2] ) );
+        D3DXVec3TransformNormal( &aLights[i].vDirection, &vLight, &mWorldInv );
+        aLights[i].fRadius = fConeRadius;
+        aLights[i].fRed = lightColor.r;
+        aLights[i].fGreen = lightColor.g;
+        aLights[i].fBlue = lightColor.b;
     }
 
     float fSum[3][D3DXSH_MAXORDER*D3DXSH_MAXORDER];
     ZeroMemory( fSum, 3 * D3DXSH_MAXORDER * D3DXSH_MAXORDER * sizeof( float ) );
 
-    // For multiple lights, just them sum up using D3DXSHAdd().
-    for( i = 0; i < g_nNumActiveLights; i++ )
+    // DXUTSHAddLights evaluates cone lights as D3DXSHEvalConeLight() does, and adds
+    // them up for all three color channels at once.  The output is the source radiance
+    // coefficients for the SH basis functions, m_dwOrder^2 floats for each channel.
+    V( DXUTSHAddLights( dwOrder, aLights, g_nNumActiveLights, fSum[0], fSum[1], fSum[2] ) );
+
+    // Both light probes are rotated into object space by the same rotation, so it's
+    // set up once and applied to all six channels
+    DXUT_SH_ROTATION Rotation;
+    V( DXUTSHCreateRotation( &Rotation, dwOrder, &mWorldInv ) );
+
+    float fLightProbeRot[D3DXSH_MAXORDER*D3DXSH_MAXORDER];
+    float fProbe1Scale = fEnv1Scaler * ( 1.0f - fEnvBlendScaler );
+    float fProbe2Scale = fEnv2Scaler * fEnvBlendScaler;
+    for( int iChannel = 0; iChannel < 3; iChannel++ )
     {
-        // D3DXSHAdd will add Order^2 floats.  There are 3 color channels, 
-        // so call it 3 times.
-        D3DXSHAdd( fSum[0], dwOrder, fSum[0], fLight[i][0] );
-        D3DXSHAdd( fSum[1], dwOrder, fSum[1], fLight[i][1] );
-        D3DXSHAdd( fSum[2], dwOrder, fSum[2], fLight[i][2] );
-    }
+        DXUTSHApplyRotation( fLightProbeRot, &Rotation, g_LightProbe[g_dwLightProbeA].GetSHData( iChannel ) );
+        DXUTSHScaleAdd( fSum[iChannel], dwOrder, fSum[iChannel], fLightProbeRot, fProbe1Scale );
 
-    float fLightProbe1[3][D3DXSH_MAXORDER*D3DXSH_MAXORDER];
-    float fLightProbe1Rot[3][D3DXSH_MAXORDER*D3DXSH_MAXORDER];
-    D3DXSHScale( fLightProbe1[0], dwOrder, g_LightProbe[g_dwLightProbeA].GetSHData( 0 ), fEnv1Scaler *
-                 ( 1.0f - fEnvBlendScaler ) );
-    D3DXSHScale( fLightProbe1[1], dwOrder, g_LightProbe[g_dwLightProbeA].GetSHData( 1 ), fEnv1Scaler *
-                 ( 1.0f - fEnvBlendScaler ) );
-    D3DXSHScale( fLightProbe1[2], dwOrder, g_LightProbe[g_dwLightProbeA].GetSHData( 2 ), fEnv1Scaler *
-                 ( 1.0f - fEnvBlendScaler ) );
-    D3DXSHRotate( fLightProbe1Rot[0], dwOrder, &mWorldInv, fLightProbe1[0] );
-    D3DXSHRotate( fLightProbe1Rot[1], dwOrder, &mWorldInv, fLightProbe1[1] );
-    D3DXSHRotate( fLightProbe1Rot[2], dwOrder, &mWorldInv, fLightProbe1[2] );
-    D3DXSHAdd( fSum[0], dwOrder, fSum[0], fLightProbe1Rot[0] );
-    D3DXSHAdd( fSum[1], dwOrder, fSum[1], fLightProbe1Rot[1] );
-    D3DXSHAdd( fSum[2], dwOrder, fSum[2], fLightProbe1Rot[2] );
-
-    float fLightProbe2[3][D3DXSH_MAXORDER*D3DXSH_MAXORDER];
-    float fLightProbe2Rot[3][D3DXSH_MAXORDER*D3DXSH_MAXORDER];
-    D3DXSHScale( fLightProbe2[0], dwOrder, g_LightProbe[g_dwLightProbeB].GetSHData( 0 ),
-                 fEnv2Scaler * fEnvBlendScaler );
-    D3DXSHScale( fLightProbe2[1], dwOrder, g_LightProbe[g_dwLightProbeB].GetSHData( 1 ),
-                 fEnv2Scaler * fEnvBlendScaler );
-    D3DXSHScale( fLightProbe2[2], dwOrder, g_LightProbe[g_dwLightProbeB].GetSHData( 2 ),
-                 fEnv2Scaler * fEnvBlendScaler );
-    D3DXSHRotate( fLightProbe2Rot[0], dwOrder, &mWorldInv, fLightProbe2[0] );
-    D3DXSHRotate( fLightProbe2Rot[1], dwOrder, &mWorldInv, fLightProbe2[1] );
-    D3DXSHRotate( fLightProbe2Rot[2], dwOrder, &mWorldInv, fLightProbe2[2] );
-    D3DXSHAdd( fSum[0], dwOrder, fSum[0], fLightProbe2Rot[0] );
-    D3DXSHAdd( fSum[1], dwOrder, fSum[1], fLightProbe2Rot[1] );
-    D3DXSHAdd( fSum[2], dwOrder, fSum[2], fLightProbe2Rot[2] );
+        DXUTSHApplyRotation( fLightProbeRot, &Rotation, g_LightProbe[g_dwLightProbeB].GetSHData( iChannel ) );
+        DXUTSHScaleAdd( fSum[iChannel], dwOrder, fSum[iChannel], fLightProbeRot, fProbe2Scale );
+    }
 
     g_PRTMesh.ComputeShaderConstants( fSum[0], fSum[1], fSum[2], dwOrder * dwOrder );
     g_PRTMesh.ComputeSHIrradEnvMapConstants( fSum[0], fSum[1], fSum[2] );
@@ -2067,3 +2058,459 @@ HRESULT FindPRTMediaFile( WCHAR* strDestPath, int cchDest, LPCWSTR strFilename,
     // Check for the file in the normal DXUT directories
     return DXUTFindDXSDKMediaFileCch( strDestPath, cchDest, strFilename );
 }
+
+
+//--------------------------------------------------------------------------------------
+// Random float from fMin to fMax, for the SH benchmark
+//--------------------------------------------------------------------------------------
+float RandomFloat( float fMin, float fMax )
+{
+    return fMin + ( fMax - fMin ) * ( float )rand() / ( float )RAND_MAX;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Random unit vector
+//--------------------------------------------------------------------------------------
+D3DXVECTOR3 RandomDirection()
+{
+    D3DXVECTOR3 vDir;
+    do
+    {
+        vDir = D3DXVECTOR3( RandomFloat( -1.0f, 1.0f ), RandomFloat( -1.0f, 1.0f ), RandomFloat( -1.0f, 1.0f ) );
+    } while( D3DXVec3LengthSq( &vDir ) > 1.0f || D3DXVec3LengthSq( &vDir ) < 0.0001f );
+
+    D3DXVec3Normalize( &vDir, &vDir );
+    return vDir;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Largest difference between the first n floats of pA and pB
+//--------------------------------------------------------------------------------------
+float MaxDifference( const float* pA, const float* pB, UINT n )
+{
+    float fMax = 0.0f;
+    for( UINT i = 0; i < n; i++ )
+        fMax = __max( fMax, fabsf( pA[i] - pB[i] ) );
+    return fMax;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Seconds since Start
+//--------------------------------------------------------------------------------------
+double SecondsSince( const LARGE_INTEGER& Start )
+{
+    LARGE_INTEGER Frequency, End;
+    QueryPerformanceCounter( &End );
+    QueryPerformanceFrequency( &Frequency );
+    return ( double )( End.QuadPart - Start.QuadPart ) / ( double )Frequency.QuadPart;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Headless test and benchmark of the SH math in SDKSH.h:
+//
+//   PRTDemo -shbench [-lights N] [-size N] [-threads N] [-pca N]
+//
+// Checks DXUTSHEvalDirection, the directional and cone lights, DXUTSHRotate and the
+// vector functions against D3DX for every order, on random directions and rotations.
+// Projects cube maps of -size texels a side (64 by default) holding a constant and
+// single harmonics, whose coefficients are known, and checks the SSE2 code and any
+// number of threads give the same bits as the scalar code.  Then times the light
+// update of UpdateLightingEnvironment for -lights cone and directional lights (1000 by
+// default), as D3DXSHEvalConeLight and D3DXSHAdd for each light against
+// DXUTSHAddLights, and the rotation of both light probes.  Last it times the constants
+// of compressed PRT for 64 to 512 clusters of -pca PCA vectors (24 by default), as the
+// DXUTSHDot loop ComputeShaderConstants had against CDXUTPRTClusterBasis, and checks
+// they give the same bits and that unchanged lighting is skipped.
+// Returns 0 on success, 1 if a check failed.
+//--------------------------------------------------------------------------------------
+INT RunSHBenchmark( int nArgs, LPWSTR* pstrArgs )
+{
+    // Report to the console we were started from, if any
+    if( AttachConsole( ATTACH_PARENT_PROCESS ) )
+    {
+        FILE* pFile;
+        freopen_s( &pFile, "CONOUT$", "w", stdout );
+    }
+
+    UINT nLights = 1000;
+    UINT Size = 64;
+    UINT nThreads = 0;
+    UINT nPCA = 24;
+    for( int i = 0; i < nArgs; i++ )
+    {
+        if( 0 == _wcsicmp( pstrArgs[i], L"-lights" ) && i + 1 < nArgs )
+        {
+            int nValue = _wtoi( pstrArgs[++i] );
+            nLights = nValue < 1 ? 1 : ( nValue > 1000000 ? 1000000 : nValue );
+        }
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-size" ) && i + 1 < nArgs )
+        {
+            int nValue = _wtoi( pstrArgs[++i] );
+            Size = nValue < 8 ? 8 : ( nValue > 1024 ? 1024 : nValue );
+        }
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-threads" ) && i + 1 < nArgs )
+        {
+            int nValue = _wtoi( pstrArgs[++i] );
+            nThreads = nValue > 0 ? nValue : 0;
+        }
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-pca" ) && i + 1 < nArgs )
+        {
+            int nValue = _wtoi( pstrArgs[++i] );
+            nPCA = nValue < 0 ? 0 : ( nValue > 64 ? 64 : nValue );
+        }
+    }
+
+    INT nResult = 0;
+    srand( 1 );
+
+    // Against D3DX, one order at a time.  The lights are up to about 4 times their
+    // intensity, so their errors are relative to that.
+    wprintf( L"%-6s %10s %10s %10s %10s %10s\n", L"order", L"eval", L"direction", L"cone", L"rotate", L"vector" );
+    for( UINT Order = D3DXSH_MINORDER; Order <= D3DXSH_MAXORDER; Order++ )
+    {
+        const UINT nCoeffs = Order * Order;
+        float fEvalError = 0.0f, fDirectionalError = 0.0f, fConeError = 0.0f, fRotateError = 0.0f;
+        float fVectorError = 0.0f;
+
+        for( int i = 0; i < 256; i++ )
+        {
+            float afD3DX[3][D3DXSH_MAXORDER*D3DXSH_MAXORDER];
+            float afDXUT[3][D3DXSH_MAXORDER*D3DXSH_MAXORDER];
+            D3DXVECTOR3 vDir = RandomDirection();
+            float fRadius = RandomFloat( 0.01f, D3DX_PI / 2 );
+            float fIntensity = RandomFloat( 0.1f, 2.0f );
+
+            D3DXSHEvalDirection( afD3DX[0], Order, &vDir );
+            DXUTSHEvalDirection( afDXUT[0], Order, &vDir );
+            fEvalError = __max( fEvalError, MaxDifference( afD3DX[0], afDXUT[0], nCoeffs ) );
+
+            D3DXSHEvalDirectionalLight( Order, &vDir, fIntensity, 1.0f, 0.5f, afD3DX[0], afD3DX[1], afD3DX[2] );
+            DXUTSHEvalDirectionalLight( Order, &vDir, fIntensity, 1.0f, 0.5f, afDXUT[0], afDXUT[1], afDXUT[2] );
+            fDirectionalError = __max( fDirectionalError, MaxDifference( afD3DX[0], afDXUT[0], nCoeffs ) );
+            fDirectionalError = __max( fDirectionalError, MaxDifference( afD3DX[1], afDXUT[1], nCoeffs ) );
+            fDirectionalError = __max( fDirectionalError, MaxDifference( afD3DX[2], afDXUT[2], nCoeffs ) );
+
+            D3DXSHEvalConeLight( Order, &vDir, fRadius, fIntensity, 1.0f, 0.5f, afD3DX[0], afD3DX[1], afD3DX[2] );
+            DXUTSHEvalConeLight( Order, &vDir, fRadius, fIntensity, 1.0f, 0.5f, afDXUT[0], afDXUT[1], afDXUT[2] );
+            fConeError = __max( fConeError, MaxDifference( afD3DX[0], afDXUT[0], nCoeffs ) );
+            fConeError = __max( fConeError, MaxDifference( afD3DX[1], afDXUT[1], nCoeffs ) );
+            fConeError = __max( fConeError, MaxDifference( afD3DX[2], afDXUT[2], nCoeffs ) );
+
+            // Rotate the cone light
+            D3DXMATRIX mRotation;
+            D3DXMatrixRotationYawPitchRoll( &mRotation, RandomFloat( -D3DX_PI, D3DX_PI ),
+                                            RandomFloat( -D3DX_PI, D3DX_PI ), RandomFloat( -D3DX_PI, D3DX_PI ) );
+            D3DXSHRotate( afD3DX[1], Order, &mRotation, afD3DX[0] );
+            DXUTSHRotate( afDXUT[1], Order, &mRotation, afD3DX[0] );
+            fRotateError = __max( fRotateError, MaxDifference( afD3DX[1], afDXUT[1], nCoeffs ) );
+
+            // The vector functions on the light and its rotation
+            D3DXSHAdd( afD3DX[2], Order, afD3DX[0], afD3DX[1] );
+            DXUTSHAdd( afDXUT[2], Order, afD3DX[0], afD3DX[1] );
+            fVectorError = __max( fVectorError, MaxDifference( afD3DX[2], afDXUT[2], nCoeffs ) );
+            D3DXSHScale( afD3DX[2], Order, afD3DX[0], fRadius );
+            DXUTSHScale( afDXUT[2], Order, afD3DX[0], fRadius );
+            fVectorError = __max( fVectorError, MaxDifference( afD3DX[2], afDXUT[2], nCoeffs ) );
+            fVectorError = __max( fVectorError, fabsf( D3DXSHDot( Order, afD3DX[0], afD3DX[1] ) -
+                                                       DXUTSHDot( Order, afD3DX[0], afD3DX[1] ) ) );
+        }
+
+        wprintf( L"%-6u %10.2e %10.2e %10.2e %10.2e %10.2e\n", Order, fEvalError, fDirectionalError, fConeError,
+                 fRotateError, fVectorError );
+        if( fEvalError > 1e-5f || fDirectionalError > 1e-4f || fConeError > 1e-4f || fRotateError > 1e-4f ||
+            fVectorError > 1e-5f )
+            nResult = 1;
+    }
+
+    // Cube maps of a constant in red and harmonics 2,1 and 5,-3 in green and blue project
+    // to sqrt(4 pi) in coefficient 0 and 1 in coefficients 7 and 27, to within the
+    // sampling error of the texels
+    const UINT nTexels = Size * Size;
+    float* pTexels = new float[ 6 * nTexels * 4 ];
+    if( !pTexels )
+    {
+        wprintf( L"Out of memory\n" );
+        return 1;
+    }
+
+    const FLOAT* apFaces[6];
+    for( UINT iFace = 0; iFace < 6; iFace++ )
+    {
+        float* pFace = pTexels + iFace * nTexels * 4;
+        apFaces[iFace] = pFace;
+
+        for( UINT y = 0; y < Size; y++ )
+        {
+            for( UINT x = 0; x < Size; x++ )
+            {
+                // Direction of the texel center, as D3DXCreateCubeTexture gives it to a fill function
+                float s = ( 2.0f * x + 1.0f ) / Size - 1.0f;
+                float t = ( 2.0f * y + 1.0f ) / Size - 1.0f;
+                D3DXVECTOR3 vDir;
+                switch( iFace )
+                {
+                    case D3DCUBEMAP_FACE_POSITIVE_X:
+                        vDir = D3DXVECTOR3( 1.0f, -t, -s ); break;
+                    case D3DCUBEMAP_FACE_NEGATIVE_X:
+                        vDir = D3DXVECTOR3( -1.0f, -t, s ); break;
+                    case D3DCUBEMAP_FACE_POSITIVE_Y:
+                        vDir = D3DXVECTOR3( s, 1.0f, t ); break;
+                    case D3DCUBEMAP_FACE_NEGATIVE_Y:
+                        vDir = D3DXVECTOR3( s, -1.0f, -t ); break;
+                    case D3DCUBEMAP_FACE_POSITIVE_Z:
+                        vDir = D3DXVECTOR3( s, -t, 1.0f ); break;
+                    default:
+                        vDir = D3DXVECTOR3( -s, -t, -1.0f ); break;
+                }
+                D3DXVec3Normalize( &vDir, &vDir );
+
+                float afY[D3DXSH_MAXORDER*D3DXSH_MAXORDER];
+                D3DXSHEvalDirection( afY, D3DXSH_MAXORDER, &vDir );
+                float* pTexel = pFace + ( y * Size + x ) * 4;
+                pTexel[0] = 1.0f;
+                pTexel[1] = afY[7];
+                pTexel[2] = afY[27];
+                pTexel[3] = 1.0f;
+            }
+        }
+    }
+
+    const UINT Pitch = Size * 4 * sizeof( float );
+    float afProjected[3][D3DXSH_MAXORDER*D3DXSH_MAXORDER];
+    float afScalar[3][D3DXSH_MAXORDER*D3DXSH_MAXORDER];
+    float afThreads[3][D3DXSH_MAXORDER*D3DXSH_MAXORDER];
+    double afProjectTime[3];
+    const UINT anProjectThreads[3] = { 1, 1, nThreads };
+    const DWORD adwProjectFlags[3] = { DXUT_SH_SCALAR, 0, 0 };
+    float ( *apProjectOut[3] )[D3DXSH_MAXORDER*D3DXSH_MAXORDER] = { afScalar, afProjected, afThreads };
+    for( int iRun = 0; iRun < 3; iRun++ )
+    {
+        float ( *pOut )[D3DXSH_MAXORDER*D3DXSH_MAXORDER] = apProjectOut[iRun];
+        afProjectTime[iRun] = DBL_MAX;
+        for( int i = 0; i < 3; i++ )
+        {
+            LARGE_INTEGER Start;
+            QueryPerformanceCounter( &Start );
+            DXUTSHProjectCubeMap( D3DXSH_MAXORDER, Size, apFaces, Pitch, pOut[0], pOut[1], pOut[2],
+                                  anProjectThreads[iRun], adwProjectFlags[iRun] );
+            afProjectTime[iRun] = __min( afProjectTime[iRun], SecondsSince( Start ) );
+        }
+    }
+    SAFE_DELETE_ARRAY( pTexels );
+
+    float fProjectError = 0.0f;
+    for( UINT i = 0; i < D3DXSH_MAXORDER * D3DXSH_MAXORDER; i++ )
+    {
+        float fConstant = ( 0 == i ) ? sqrtf( 4.0f * D3DX_PI ) : 0.0f;
+        fProjectError = __max( fProjectError, fabsf( afProjected[0][i] - fConstant ) );
+        fProjectError = __max( fProjectError, fabsf( afProjected[1][i] - ( 7 == i ? 1.0f : 0.0f ) ) );
+        fProjectError = __max( fProjectError, fabsf( afProjected[2][i] - ( 27 == i ? 1.0f : 0.0f ) ) );
+    }
+    bool bProjectSame = 0 == memcmp( afProjected, afScalar, sizeof( afProjected ) ) &&
+                        0 == memcmp( afProjected, afThreads, sizeof( afProjected ) );
+
+    const double fMTexels = 6.0 * nTexels / 1000000.0;
+    wprintf( L"\nprojection of %u x %u x 6 texels: error %.2e, same %s, %.1f / %.1f / %.1f Mtexel/s "
+             L"(scalar / SSE2 1 / SSE2 N)\n", Size, Size, fProjectError, bProjectSame ? L"yes" : L"NO",
+             fMTexels / afProjectTime[0], fMTexels / afProjectTime[1], fMTexels / afProjectTime[2] );
+    if( fProjectError > 16.0f / nTexels || !bProjectSame )
+        nResult = 1;
+
+    // The light update, as UpdateLightingEnvironment did it and does it now.  A third of
+    // the lights are directional.
+    DXUT_SH_LIGHT* pLights = new DXUT_SH_LIGHT[ nLights ];
+    if( !pLights )
+    {
+        wprintf( L"Out of memory\n" );
+        return 1;
+    }
+    for( UINT i = 0; i < nLights; i++ )
+    {
+        pLights[i].vDirection = RandomDirection();
+        pLights[i].fRadius = ( 0 == i % 3 ) ? 0.0f : RandomFloat( 0.01f, D3DX_PI / 2 );
+        pLights[i].fRed = RandomFloat( 0.0f, 1.0f );
+        pLights[i].fGreen = RandomFloat( 0.0f, 1.0f );
+        pLights[i].fBlue = RandomFloat( 0.0f, 1.0f );
+    }
+
+    float afProbe[3][D3DXSH_MAXORDER*D3DXSH_MAXORDER];
+    for( UINT i = 0; i < D3DXSH_MAXORDER * D3DXSH_MAXORDER; i++ )
+    {
+        afProbe[0][i] = RandomFloat( -1.0f, 1.0f );
+        afProbe[1][i] = RandomFloat( -1.0f, 1.0f );
+        afProbe[2][i] = RandomFloat( -1.0f, 1.0f );
+    }
+
+    wprintf( L"\n%u lights, microseconds a frame\n", nLights );
+    wprintf( L"%-6s %10s %10s %10s %10s %10s %10s %6s\n", L"order", L"D3DX", L"scalar", L"SSE2", L"error",
+             L"D3DX rot", L"DXUT rot", L"same" );
+    for( UINT Order = 2; Order <= D3DXSH_MAXORDER; Order++ )
+    {
+        const UINT nCoeffs = Order * Order;
+        float afD3DX[3][D3DXSH_MAXORDER*D3DXSH_MAXORDER];
+        float afSSE[3][D3DXSH_MAXORDER*D3DXSH_MAXORDER];
+        float afPlain[3][D3DXSH_MAXORDER*D3DXSH_MAXORDER];
+        double fD3DXTime = DBL_MAX, fScalarTime = DBL_MAX, fSSETime = DBL_MAX;
+        double fD3DXRotateTime = DBL_MAX, fDXUTRotateTime = DBL_MAX;
+        LARGE_INTEGER Start;
+
+        for( int iFrame = 0; iFrame < 10; iFrame++ )
+        {
+            QueryPerformanceCounter( &Start );
+            ZeroMemory( afD3DX, sizeof( afD3DX ) );
+            for( UINT i = 0; i < nLights; i++ )
+            {
+                float afLight[3][D3DXSH_MAXORDER*D3DXSH_MAXORDER];
+                D3DXSHEvalConeLight( Order, &pLights[i].vDirection, pLights[i].fRadius, pLights[i].fRed,
+                                     pLights[i].fGreen, pLights[i].fBlue, afLight[0], afLight[1], afLight[2] );
+                D3DXSHAdd( afD3DX[0], Order, afD3DX[0], afLight[0] );
+                D3DXSHAdd( afD3DX[1], Order, afD3DX[1], afLight[1] );
+                D3DXSHAdd( afD3DX[2], Order, afD3DX[2], afLight[2] );
+            }
+            fD3DXTime = __min( fD3DXTime, SecondsSince( Start ) );
+
+            QueryPerformanceCounter( &Start );
+            ZeroMemory( afPlain, sizeof( afPlain ) );
+            DXUTSHAddLights( Order, pLights, nLights, afPlain[0], afPlain[1], afPlain[2], DXUT_SH_SCALAR );
+            fScalarTime = __min( fScalarTime, SecondsSince( Start ) );
+
+            QueryPerformanceCounter( &Start );
+            ZeroMemory( afSSE, sizeof( afSSE ) );
+            DXUTSHAddLights( Order, pLights, nLights, afSSE[0], afSSE[1], afSSE[2] );
+            fSSETime = __min( fSSETime, SecondsSince( Start ) );
+
+            // Both probes, three channels each, by the one matrix
+            float afRotated[D3DXSH_MAXORDER*D3DXSH_MAXORDER];
+            D3DXMATRIX mRotation;
+            D3DXMatrixRotationYawPitchRoll( &mRotation, 0.1f * iFrame, 0.2f, 0.3f );
+            QueryPerformanceCounter( &Start );
+            for( int iProbe = 0; iProbe < 2; iProbe++ )
+            {
+                for( int c = 0; c < 3; c++ )
+                    D3DXSHRotate( afRotated, Order, &mRotation, afProbe[c] );
+            }
+            fD3DXRotateTime = __min( fD3DXRotateTime, SecondsSince( Start ) );
+
+            QueryPerformanceCounter( &Start );
+            DXUT_SH_ROTATION Rotation;
+            DXUTSHCreateRotation( &Rotation, Order, &mRotation );
+            for( int iProbe = 0; iProbe < 2; iProbe++ )
+            {
+                for( int c = 0; c < 3; c++ )
+                    DXUTSHApplyRotation( afRotated, &Rotation, afProbe[c] );
+            }
+            fDXUTRotateTime = __min( fDXUTRotateTime, SecondsSince( Start ) );
+        }
+
+        // Relative to the largest coefficient of the sum
+        float fLargest = 0.0f;
+        for( UINT i = 0; i < nCoeffs; i++ )
+            fLargest = __max( fLargest, fabsf( afD3DX[0][i] ) );
+        float fError = 0.0f;
+        for( int c = 0; c < 3; c++ )
+            fError = __max( fError, MaxDifference( afD3DX[c], afSSE[c], nCoeffs ) );
+        fError /= __max( fLargest, 1.0f );
+        bool bSame = 0 == memcmp( afSSE, afPlain, sizeof( afSSE ) );
+
+        wprintf( L"%-6u %10.1f %10.1f %10.1f %10.2e %10.2f %10.2f %6s\n", Order, fD3DXTime * 1e6, fScalarTime * 1e6,
+                 fSSETime * 1e6, fError, fD3DXRotateTime * 1e6, fDXUTRotateTime * 1e6, bSame ? L"yes" : L"NO" );
+        if( fError > 1e-4f || !bSame )
+            nResult = 1;
+    }
+
+    SAFE_DELETE_ARRAY( pLights );
+
+    // The constants of compressed PRT, from random bases laid out as ExtractBasis gives
+    // them, with three channels
+    const UINT anClusters[4] = { 64, 128, 256, 512 };
+    const UINT nMaxBasisSize = ( nPCA + 1 ) * 3 * D3DXSH_MAXORDER * D3DXSH_MAXORDER;
+    const UINT ClusterStride = 4 + 3 * nPCA;
+    float* pBases = new float[ anClusters[3] * nMaxBasisSize ];
+    float* pLoop = new float[ anClusters[3] * ClusterStride ];
+    float* pScalar = new float[ anClusters[3] * ClusterStride ];
+    float* pSSE = new float[ anClusters[3] * ClusterStride ];
+    if( !pBases || !pLoop || !pScalar || !pSSE )
+    {
+        wprintf( L"Out of memory\n" );
+        return 1;
+    }
+    for( UINT i = 0; i < anClusters[3] * nMaxBasisSize; i++ )
+        pBases[i] = RandomFloat( -1.0f, 1.0f );
+
+    wprintf( L"\nPRT constants of %u PCA vectors, microseconds a frame\n", nPCA );
+    wprintf( L"%-8s %-6s %10s %10s %10s %10s %6s %6s\n", L"clusters", L"order", L"DXUTSHDot", L"scalar", L"SSE2 1",
+             L"SSE2 N", L"same", L"skip" );
+    for( UINT iClusters = 0; iClusters < 4; iClusters++ )
+    {
+        const UINT nClusters = anClusters[iClusters];
+        for( UINT Order = 4; Order <= D3DXSH_MAXORDER; Order++ )
+        {
+            const UINT nCoeffs = Order * Order;
+            const UINT BasisStride = ( nPCA + 1 ) * 3 * nCoeffs;
+            double fLoopTime = DBL_MAX;
+            double afBasisTime[3] = { DBL_MAX, DBL_MAX, DBL_MAX };
+            bool bSame = true, bSkip = true;
+            LARGE_INTEGER Start;
+
+            CDXUTPRTClusterBasis aBasis[3];
+            aBasis[0].Create( pBases, nClusters, 3, nPCA, Order, 1, DXUT_SH_SCALAR );
+            aBasis[1].Create( pBases, nClusters, 3, nPCA, Order, 1 );
+            aBasis[2].Create( pBases, nClusters, 3, nPCA, Order, nThreads );
+
+            for( int iFrame = 0; iFrame < 10; iFrame++ )
+            {
+                for( UINT i = 0; i < nCoeffs; i++ )
+                {
+                    afProbe[0][i] = RandomFloat( -1.0f, 1.0f );
+                    afProbe[1][i] = RandomFloat( -1.0f, 1.0f );
+                    afProbe[2][i] = RandomFloat( -1.0f, 1.0f );
+                }
+
+                QueryPerformanceCounter( &Start );
+                for( UINT k = 0; k < nClusters; k++ )
+                {
+                    float* pCluster = pLoop + k * ClusterStride;
+                    for( UINT c = 0; c < 3; c++ )
+                        pCluster[c] = DXUTSHDot( Order, pBases + k * BasisStride + c * nCoeffs, afProbe[c] );
+                    pCluster[3] = 0.0f;
+                    for( UINT j = 0; j < nPCA; j++ )
+                    {
+                        const float* pVector = pBases + k * BasisStride + ( j + 1 ) * 3 * nCoeffs;
+                        for( UINT c = 0; c < 3; c++ )
+                            pCluster[4 + c * nPCA + j] = DXUTSHDot( Order, pVector + c * nCoeffs, afProbe[c] );
+                    }
+                }
+                fLoopTime = __min( fLoopTime, SecondsSince( Start ) );
+
+                for( int iRun = 0; iRun < 3; iRun++ )
+                {
+                    QueryPerformanceCounter( &Start );
+                    aBasis[iRun].ComputeConstants( afProbe[0], afProbe[1], afProbe[2], iRun ? pSSE : pScalar );
+                    afBasisTime[iRun] = __min( afBasisTime[iRun], SecondsSince( Start ) );
+
+                    bSame = bSame && 0 == memcmp( pLoop, iRun ? pSSE : pScalar,
+                                                  nClusters * ClusterStride * sizeof( float ) );
+                    bSkip = bSkip && S_FALSE == aBasis[iRun].ComputeConstants( afProbe[0], afProbe[1], afProbe[2],
+                                                                               iRun ? pSSE : pScalar );
+                }
+            }
+
+            wprintf( L"%-8u %-6u %10.1f %10.1f %10.1f %10.1f %6s %6s\n", nClusters, Order, fLoopTime * 1e6,
+                     afBasisTime[0] * 1e6, afBasisTime[1] * 1e6, afBasisTime[2] * 1e6, bSame ? L"yes" : L"NO",
+                     bSkip ? L"yes" : L"NO" );
+            if( !bSame || !bSkip )
+                nResult = 1;
+        }
+    }
+
+    SAFE_DELETE_ARRAY( pBases );
+    SAFE_DELETE_ARRAY( pLoop );
+    SAFE_DELETE_ARRAY( pScalar );
+    SAFE_DELETE_ARRAY( pSSE );
+
+    return nResult;
+}
@@ -0,0 +1,277 @@
+//--------------------------------------------------------------------------------------
+// File: RenderQueue.cpp
+//
+// Sort-key based draw submission for the 'StateManager' Sample.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "RenderQueue.h"
+
+#define RQ_NO_STATE             0xFFFFFFFF
+
+
+//--------------------------------------------------------------------------------------
+CRenderQueue::CRenderQueue() : m_sortOrder( RQ_SORT_MATERIAL )
+{
+    ZeroMemory( &m_Stats, sizeof( RQ_STATS ) );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Sizes the queue for nDraws draws so that submitting them does not allocate
+//--------------------------------------------------------------------------------------
+void CRenderQueue::Reserve( UINT nDraws )
+{
+    m_vecDraws.reserve( nDraws );
+    m_vecKeys.reserve( nDraws );
+    m_vecOrder.reserve( nDraws );
+    m_vecKeysTemp.reserve( nDraws );
+    m_vecOrderTemp.reserve( nDraws );
+
+    // Worst case is an effect change on every draw
+    m_vecCommands.reserve( nDraws * 5 );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Empties the queue.  Capacity is kept for the next frame.
+//--------------------------------------------------------------------------------------
+void CRenderQueue::Reset()
+{
+    m_vecDraws.clear();
+    m_vecKeys.clear();
+    m_vecOrder.clear();
+    m_vecCommands.clear();
+    ZeroMemory( &m_Stats, sizeof( RQ_STATS ) );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Packs a draw into a sort key.  Depth is quantized by taking the high bits of its
+// float representation, which orders the same way as the float for values >= 0 and
+// keeps most of the precision close to the camera.
+//--------------------------------------------------------------------------------------
+UINT64 CRenderQueue::MakeKey( RQ_SORT_ORDER sortOrder, const RQ_DRAW& draw )
+{
+    UINT64 nKey = draw.nPass;
+
+    if( RQ_SORT_INSTANCE == sortOrder )
+    {
+        nKey = ( nKey << RQ_KEY_INSTANCE_BITS ) | draw.nInstance;
+        nKey = ( nKey << RQ_KEY_SUBSET_BITS ) | draw.nSubset;
+        return nKey << ( 64 - RQ_KEY_PASS_BITS - RQ_KEY_INSTANCE_BITS - RQ_KEY_SUBSET_BITS );
+    }
+
+    float fDepth = ( draw.fDepth > 0.0f ) ? draw.fDepth : 0.0f;
+    DWORD dwDepthBits;
+    memcpy( &dwDepthBits, &fDepth, sizeof( DWORD ) );
+
+    nKey = ( nKey << RQ_KEY_EFFECT_BITS ) | draw.nEffect;
+    nKey = ( nKey << RQ_KEY_MATERIAL_BITS ) | draw.nMaterial;
+    nKey = ( nKey << RQ_KEY_MESH_BITS ) | draw.nMesh;
+    nKey = ( nKey << RQ_KEY_DEPTH_BITS ) | ( dwDepthBits >> ( 31 - RQ_KEY_DEPTH_BITS ) );
+    return nKey;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CRenderQueue::Submit( const RQ_DRAW& draw )
+{
+    if( draw.nPass >= RQ_MAX_PASSES || draw.nEffect >= RQ_MAX_EFFECTS ||
+        draw.nMaterial >= RQ_MAX_MATERIALS || draw.nMesh >= RQ_MAX_MESHES ||
+        draw.nInstance >= RQ_MAX_INSTANCES || draw.nSubset >= RQ_MAX_SUBSETS )
+        return E_INVALIDARG;
+
+    m_vecKeys.push_back( MakeKey( m_sortOrder, draw ) );
+    m_vecOrder.push_back( ( UINT )m_vecDraws.size() );
+    m_vecDraws.push_back( draw );
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CRenderQueue::Sort()
+{
+    m_Stats.nRadixPasses = 0;
+    m_Stats.nDraws = GetDrawCount();
+
+    RadixSort();
+    BuildCommands();
+}
+
+
+//--------------------------------------------------------------------------------------
+// LSD radix sort of the keys, RQ_RADIX_BITS at a time, carrying the draw indices along.
+// All histograms are gathered in one read of the keys.  A digit that is the same in
+// every key does not change the order, so its pass is skipped; with few effects and
+// materials the high digits usually are.
+//--------------------------------------------------------------------------------------
+void CRenderQueue::RadixSort()
+{
+    const UINT nCount = ( UINT )m_vecKeys.size();
+    if( nCount < 2 )
+        return;
+
+    UINT ( *nHistogram )[RQ_RADIX_BUCKETS] = m_nHistogram;
+    ZeroMemory( m_nHistogram, sizeof( m_nHistogram ) );
+
+    const UINT64* pKeys = &m_vecKeys[0];
+    for( UINT i = 0; i < nCount; i++ )
+    {
+        UINT64 nKey = pKeys[i];
+        for( UINT nDigit = 0; nDigit < RQ_RADIX_DIGITS; nDigit++ )
+            nHistogram[nDigit][( nKey >> ( nDigit * RQ_RADIX_BITS ) ) & ( RQ_RADIX_BUCKETS - 1 )]++;
+    }
+
+    m_vecKeysTemp.resize( nCount );
+    m_vecOrderTemp.resize( nCount );
+
+    for( UINT nDigit = 0; nDigit < RQ_RADIX_DIGITS; nDigit++ )
+    {
+        const UINT nShift = nDigit * RQ_RADIX_BITS;
+        UINT* pBucket = nHistogram[nDigit];
+        if( nCount == pBucket[( m_vecKeys[0] >> nShift ) & ( RQ_RADIX_BUCKETS - 1 )] )
+            continue;
+
+        // Turn counts into starting offsets
+        UINT nOffset = 0;
+        for( UINT i = 0; i < RQ_RADIX_BUCKETS; i++ )
+        {
+            UINT nBucketCount = pBucket[i];
+            pBucket[i] = nOffset;
+            nOffset += nBucketCount;
+        }
+
+        const UINT64* pSrcKeys = &m_vecKeys[0];
+        const UINT* pSrcOrder = &m_vecOrder[0];
+        UINT64* pDstKeys = &m_vecKeysTemp[0];
+        UINT* pDstOrder = &m_vecOrderTemp[0];
+
+        for( UINT i = 0; i < nCount; i++ )
+        {
+            UINT nDst = pBucket[( pSrcKeys[i] >> nShift ) & ( RQ_RADIX_BUCKETS - 1 )]++;
+            pDstKeys[nDst] = pSrcKeys[i];
+            pDstOrder[nDst] = pSrcOrder[i];
+        }
+
+        m_vecKeys.swap( m_vecKeysTemp );
+        m_vecOrder.swap( m_vecOrderTemp );
+        m_Stats.nRadixPasses++;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Walks the sorted draws and emits a command only where state changes.  A batch is a
+// run of draws sharing scene pass and effect; each batch starts with no known state
+// because the backend replays it once per effect pass.
+//--------------------------------------------------------------------------------------
+void CRenderQueue::BuildCommands()
+{
+    m_vecCommands.clear();
+
+    UINT nBatchPass = RQ_NO_STATE;
+    UINT nBatchEffect = RQ_NO_STATE;
+    UINT nLastMaterial = RQ_NO_STATE;
+    UINT nLastInstance = RQ_NO_STATE;
+    size_t nBatchStart = 0;
+
+    const UINT nCount = GetDrawCount();
+    for( UINT i = 0; i < nCount; i++ )
+    {
+        const UINT nDraw = m_vecOrder[i];
+        const RQ_DRAW& draw = m_vecDraws[nDraw];
+        RQ_COMMAND cmd;
+        cmd.nCount = 0;
+
+        if( draw.nEffect != nBatchEffect || draw.nPass != nBatchPass )
+        {
+            if( RQ_NO_STATE != nBatchEffect )
+            {
+                m_vecCommands[nBatchStart].nCount = ( UINT )( m_vecCommands.size() - nBatchStart - 1 );
+                cmd.nOp = RQ_OP_END_EFFECT; cmd.nArg = nBatchEffect;
+                m_vecCommands.push_back( cmd );
+            }
+
+            nBatchStart = m_vecCommands.size();
+            nBatchPass = draw.nPass;
+            nBatchEffect = draw.nEffect;
+            nLastMaterial = RQ_NO_STATE;
+            nLastInstance = RQ_NO_STATE;
+
+            cmd.nOp = RQ_OP_BEGIN_EFFECT; cmd.nArg = draw.nEffect;
+            m_vecCommands.push_back( cmd );
+            m_Stats.nEffectChanges++;
+        }
+
+        if( draw.nInstance != nLastInstance )
+        {
+            cmd.nOp = RQ_OP_SET_INSTANCE; cmd.nArg = draw.nInstance;
+            m_vecCommands.push_back( cmd );
+            m_Stats.nInstanceChanges++;
+            nLastInstance = draw.nInstance;
+        }
+
+        if( draw.nMaterial != nLastMaterial )
+        {
+            cmd.nOp = RQ_OP_SET_MATERIAL; cmd.nArg = draw.nMaterial;
+            m_vecCommands.push_back( cmd );
+            m_Stats.nMaterialChanges++;
+            nLastMaterial = draw.nMaterial;
+        }
+
+        cmd.nOp = RQ_OP_DRAW; cmd.nArg = nDraw;
+        m_vecCommands.push_back( cmd );
+    }
+
+    if( RQ_NO_STATE != nBatchEffect )
+    {
+        m_vecCommands[nBatchStart].nCount = ( UINT )( m_vecCommands.size() - nBatchStart - 1 );
+        RQ_COMMAND cmd;
+        cmd.nOp = RQ_OP_END_EFFECT; cmd.nArg = nBatchEffect; cmd.nCount = 0;
+        m_vecCommands.push_back( cmd );
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+void CRenderQueue::Execute( CRenderQueueBackend* pBackend ) const
+{
+    const UINT nCommands = GetCommandCount();
+    const RQ_COMMAND* pCommands = GetCommands();
+
+    UINT i = 0;
+    while( i < nCommands )
+    {
+        assert( RQ_OP_BEGIN_EFFECT == pCommands[i].nOp );
+
+        const RQ_COMMAND* pBody = pCommands + i + 1;
+        const UINT nBody = pCommands[i].nCount;
+        const UINT nPasses = pBackend->BeginEffect( pCommands[i].nArg );
+
+        for( UINT nPass = 0; nPass < nPasses; nPass++ )
+        {
+            pBackend->BeginPass( nPass );
+            for( UINT j = 0; j < nBody; j++ )
+            {
+                switch( pBody[j].nOp )
+                {
+                    case RQ_OP_SET_INSTANCE:
+                        pBackend->SetInstance( pBody[j].nArg ); break;
+                    case RQ_OP_SET_MATERIAL:
+                        pBackend->SetMaterial( pBody[j].nArg ); break;
+                    case RQ_OP_DRAW:
+                        pBackend->Draw( pBody[j].nArg ); break;
+                }
+            }
+            pBackend->EndPass();
+        }
+        pBackend->EndEffect();
+
+        // Skip the body and the RQ_OP_END_EFFECT
+        i += nBody + 2;
+    }
+}
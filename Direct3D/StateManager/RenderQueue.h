@@ -0,0 +1,257 @@
+//--------------------------------------------------------------------------------------
+// File: RenderQueue.h
+//
+// Sort-key based draw submission for the 'StateManager' Sample.
+// Each draw is reduced to a 64-bit key when it is submitted, so sorting never has to
+// look at the effect, material or mesh objects themselves.  The sorted keys are turned
+// into a command stream that only contains the state changes actually required, which
+// can then be replayed to the device or to a null backend for measurement.
+//
+// The queue works on small integer ids rather than object pointers.  The application
+// decides what an id refers to (see CRenderQueueBackend).
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+
+#pragma once
+
+#pragma warning ( push )
+#pragma warning ( disable : 4702 ) // unreachable code
+#include <vector>
+#pragma warning ( pop )
+
+
+//--------------------------------------------------------------------------------------
+// Sort key layout, from the most significant bit down.
+//
+// RQ_SORT_MATERIAL:  scene pass | effect | material | mesh | depth
+// RQ_SORT_INSTANCE:  scene pass | instance | subset
+//
+// The scene pass always comes first so that scene-level ordering (eg, the sky box
+// before everything else) is kept.  Sorting by material groups all draws of an effect
+// together, then all draws of a material, and draws them front to back within that.
+//--------------------------------------------------------------------------------------
+#define RQ_KEY_PASS_BITS        4
+#define RQ_KEY_EFFECT_BITS      10
+#define RQ_KEY_MATERIAL_BITS    14
+#define RQ_KEY_MESH_BITS        14
+#define RQ_KEY_DEPTH_BITS       22
+#define RQ_KEY_INSTANCE_BITS    24
+#define RQ_KEY_SUBSET_BITS      16
+
+#define RQ_MAX_PASSES           ( 1 << RQ_KEY_PASS_BITS )
+#define RQ_MAX_EFFECTS          ( 1 << RQ_KEY_EFFECT_BITS )
+#define RQ_MAX_MATERIALS        ( 1 << RQ_KEY_MATERIAL_BITS )
+#define RQ_MAX_MESHES           ( 1 << RQ_KEY_MESH_BITS )
+#define RQ_MAX_INSTANCES        ( 1 << RQ_KEY_INSTANCE_BITS )
+#define RQ_MAX_SUBSETS          ( 1 << RQ_KEY_SUBSET_BITS )
+
+// 11-bit digits sort a 64-bit key in six passes with histograms that fit in L1
+#define RQ_RADIX_BITS           11
+#define RQ_RADIX_BUCKETS        ( 1 << RQ_RADIX_BITS )
+#define RQ_RADIX_DIGITS         ( ( 64 + RQ_RADIX_BITS - 1 ) / RQ_RADIX_BITS )
+
+enum RQ_SORT_ORDER
+{
+    RQ_SORT_MATERIAL = 0,
+    RQ_SORT_INSTANCE,
+};
+
+// One draw, as submitted by the application
+struct RQ_DRAW
+{
+    UINT nPass;                 // Scene-level pass
+    UINT nEffect;
+    UINT nMaterial;
+    UINT nMesh;
+    UINT nInstance;             // Supplies the world matrix
+    UINT nSubset;
+    float fDepth;               // View space depth, used to draw front to back
+};
+
+enum RQ_OP
+{
+    RQ_OP_BEGIN_EFFECT = 0,     // nArg: effect, nCount: commands up to the matching RQ_OP_END_EFFECT
+    RQ_OP_END_EFFECT,
+    RQ_OP_SET_INSTANCE,         // nArg: instance
+    RQ_OP_SET_MATERIAL,         // nArg: material
+    RQ_OP_DRAW,                 // nArg: index of the RQ_DRAW passed to Submit
+};
+
+struct RQ_COMMAND
+{
+    UINT nOp;
+    UINT nArg;
+    UINT nCount;
+};
+
+struct RQ_STATS
+{
+    UINT nDraws;
+    UINT nEffectChanges;
+    UINT nMaterialChanges;
+    UINT nInstanceChanges;
+    UINT nRadixPasses;          // Digit passes the radix sort could not skip
+};
+
+
+//--------------------------------------------------------------------------------------
+// Receives a command stream.  Everything between BeginEffect and EndEffect is replayed
+// once per effect pass, so the state set at the start of a batch is set again at the
+// start of every pass.
+//--------------------------------------------------------------------------------------
+class CRenderQueueBackend
+{
+public:
+    virtual         ~CRenderQueueBackend()
+    {
+    }
+
+    // Returns the number of effect passes to replay the batch for
+    virtual UINT    BeginEffect( UINT nEffect ) = 0;
+    virtual void    BeginPass( UINT nPass ) = 0;
+    virtual void    SetInstance( UINT nInstance ) = 0;
+    virtual void    SetMaterial( UINT nMaterial ) = 0;
+    virtual void    Draw( UINT nDraw ) = 0;
+    virtual void    EndPass() = 0;
+    virtual void    EndEffect() = 0;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Backend that only counts calls.  Used to time the queue without a device.
+//--------------------------------------------------------------------------------------
+class CNullRenderQueueBackend : public CRenderQueueBackend
+{
+public:
+                    CNullRenderQueueBackend( UINT nEffectPasses = 1 ) : m_nEffectPasses( nEffectPasses )
+                    {
+                        Reset();
+                    }
+
+    void            Reset()
+    {
+        m_nCalls = 0;
+        m_nDraws = 0;
+        m_nChecksum = 0;
+    }
+
+    virtual UINT    BeginEffect( UINT nEffect )
+    {
+        m_nCalls++; m_nChecksum = m_nChecksum * 31 + nEffect; return m_nEffectPasses;
+    }
+    virtual void    BeginPass( UINT nPass )
+    {
+        m_nCalls++;
+    }
+    virtual void    SetInstance( UINT nInstance )
+    {
+        m_nCalls++; m_nChecksum = m_nChecksum * 31 + nInstance;
+    }
+    virtual void    SetMaterial( UINT nMaterial )
+    {
+        m_nCalls++; m_nChecksum = m_nChecksum * 31 + nMaterial;
+    }
+    virtual void    Draw( UINT nDraw )
+    {
+        m_nCalls++; m_nDraws++; m_nChecksum = m_nChecksum * 31 + nDraw;
+    }
+    virtual void    EndPass()
+    {
+        m_nCalls++;
+    }
+    virtual void    EndEffect()
+    {
+        m_nCalls++;
+    }
+
+    UINT            GetCalls() const
+    {
+        return m_nCalls;
+    }
+    UINT            GetDraws() const
+    {
+        return m_nDraws;
+    }
+    UINT            GetChecksum() const
+    {
+        return m_nChecksum;
+    }
+
+protected:
+    UINT m_nEffectPasses;
+    UINT m_nCalls;
+    UINT m_nDraws;
+    UINT m_nChecksum;           // Depends on call order, to compare two streams
+};
+
+
+//--------------------------------------------------------------------------------------
+// The render queue.  Per frame: Reset, Submit each draw, Sort, then Execute.
+// Storage is kept between frames so a steady scene does not allocate.
+//--------------------------------------------------------------------------------------
+class CRenderQueue
+{
+public:
+                    CRenderQueue();
+
+    void            SetSortOrder( RQ_SORT_ORDER sortOrder )
+    {
+        m_sortOrder = sortOrder;
+    }
+    RQ_SORT_ORDER   GetSortOrder() const
+    {
+        return m_sortOrder;
+    }
+
+    void            Reserve( UINT nDraws );
+    void            Reset();
+
+    // Builds the key for the draw and queues it.  Fails if an id does not fit the key.
+    HRESULT         Submit( const RQ_DRAW& draw );
+
+    // Sorts the queued keys and builds the command stream
+    void            Sort();
+
+    // Replays the command stream built by Sort
+    void            Execute( CRenderQueueBackend* pBackend ) const;
+
+    UINT            GetDrawCount() const
+    {
+        return ( UINT )m_vecDraws.size();
+    }
+    const RQ_DRAW&  GetDraw( UINT nDraw ) const
+    {
+        return m_vecDraws[nDraw];
+    }
+    UINT            GetCommandCount() const
+    {
+        return ( UINT )m_vecCommands.size();
+    }
+    const RQ_COMMAND* GetCommands() const
+    {
+        return m_vecCommands.empty() ? NULL : &m_vecCommands[0];
+    }
+    const RQ_STATS& GetStats() const
+    {
+        return m_Stats;
+    }
+
+    // Key construction, exposed for the benchmark's reference sort
+    static UINT64   MakeKey( RQ_SORT_ORDER sortOrder, const RQ_DRAW& draw );
+
+protected:
+    void            RadixSort();
+    void            BuildCommands();
+
+    RQ_SORT_ORDER m_sortOrder;
+    std::vector <RQ_DRAW> m_vecDraws;
+    std::vector <UINT64> m_vecKeys;
+    std::vector <UINT> m_vecOrder;          // Draw indices, in sorted order after Sort
+    std::vector <UINT64> m_vecKeysTemp;     // Radix sort scratch
+    std::vector <UINT> m_vecOrderTemp;
+    std::vector <RQ_COMMAND> m_vecCommands;
+    UINT m_nHistogram[RQ_RADIX_DIGITS][RQ_RADIX_BUCKETS];
+    RQ_STATS m_Stats;
+};
@@ -33,6 +33,13 @@
 #include "renderables.h"
 
 
+//--------------------------------------------------------------------------------------
+// Draws are submitted to a render queue, which reduces each one to a 64-bit sort key
+// and emits only the state changes required between them.
+//--------------------------------------------------------------------------------------
+#include "RenderQueue.h"
+
+
 //--------------------------------------------------------------------------------------
 // The scene is loaded from an x-file, that has been extended to include templates for
 // specifying mesh filenames, and cameras.
@@ -55,14 +62,15 @@ CDXUTDialog                     g_HUD;                      // manages the 3D UI
 CDXUTDialog                     g_SampleUI;                 // dialog for sample specific controls
 CStateManagerInterface*         g_pStateManager = NULL;     // The current ID3DXEffectStateManager implementation
 bool                            g_bSortByMaterial = true;   // Sort by Material/Effect (versus mesh instance)
-bool                            g_bSortOrderDirty = true;   // Causes the Renderable Objects to be re-sorted
 bool                            g_bAppIsDebug = false;      // The application build is debug
 bool                            g_bRuntimeDebug = false;    // The D3D Debug Runtime was detected
 bool                            g_bStateManger = true;     // Enable custom-implemented d3dx effect state management
 bool                            g_bResetCamera = true;      // Causes camera to be (re)loaded from scene
 vector <CInstance*>             g_vecInstances;             // Contains the group of mesh instances composing the scene
-typedef vector <CRenderable>    pass;                   // A render-pass is composed of individual items to be rendered
-vector <pass>                   g_passes;                   // Contains a group of rendering passes
+vector <CEffect*>               g_vecEffects;               // Effects, indexed by render queue effect id
+vector <CEffectInstance*>       g_vecMaterials;             // Effect instances, indexed by render queue material id
+vector <RQ_DRAW>                g_vecDraws;                 // Mesh subsets to be drawn; depth is filled in per frame
+CRenderQueue                    g_RenderQueue;              // Sorts the draws and filters redundant state changes
 int                             g_iUpdateCPUUsageMessage = 0;   // controls when to update the CPU usage static control
 double                          g_fBurnAmount = 0.0;        // time in seconds to burn for during each burn period
 UINT                            g_nMaxRocksToRender = 200;  // The initial maximum number of rocks to be rendered
@@ -109,8 +117,9 @@ void CALLBACK OnDestroyDevice( void* pUserContext );
 void InitApp();
 HRESULT BuildSceneFromX( LPDIRECT3DDEVICE9 pd3dDevice );
 void RenderText( double fTime );
-void QueueAndSortRenderables();
-void SortRenderables();
+void QueueRenderables();
+void SubmitRenderables( const D3DXMATRIX* pView );
+INT RunBenchmark( UINT nDraws );
 void SetStateManager();
 HRESULT CreateInstance( LPDIRECT3DDEVICE9 pDevice, LPCWSTR wszFileName,
                         D3DXMATRIX* pWorld, UINT nRenderPass, CInstance** ppInstance = NULL );
@@ -127,6 +136,20 @@ INT WINAPI wWinMain( HINSTANCE, HINSTANCE, LPWSTR, int )
     _CrtSetDbgFlag( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );
 #endif
 
+    // "-benchmark [draws]" times render queue submission and sorting headless
+    int nNumArgs;
+    LPWSTR* pstrArgList = CommandLineToArgvW( GetCommandLineW(), &nNumArgs );
+    if( pstrArgList )
+    {
+        if( nNumArgs >= 2 && _wcsicmp( pstrArgList[1], L"-benchmark" ) == 0 )
+        {
+            int nDraws = ( nNumArgs >= 3 ) ? _wtoi( pstrArgList[2] ) : 100000;
+            LocalFree( pstrArgList );
+            return RunBenchmark( ( UINT )max( nDraws, 1 ) );
+        }
+        LocalFree( pstrArgList );
+    }
+
     try
     {
         // Set the callback functions. These functions allow DXUT to notify
@@ -319,8 +342,8 @@ HRESULT CALLBACK OnCreateDevice( IDirect3DDevice9* pd3dDevice, const D3DSURFACE_
 
     V_RETURN( BuildSceneFromX( pd3dDevice ) );
 
-    // Establish a sort-order for the render queue
-    QueueAndSortRenderables();
+    // Build the list of draws for the render queue
+    QueueRenderables();
 
     // Set a state manager for all loaded effects
     SetStateManager();
@@ -421,6 +444,72 @@ void CALLBACK OnFrameMove( double fTime, float fElapsedTime, void* pUserContext
 }
 
 
+//--------------------------------------------------------------------------------------
+// Replays the render queue through the D3DX Effects.  Each effect batch is drawn once
+// per effect pass; the queue has already removed redundant material and matrix updates
+// within a batch.
+//--------------------------------------------------------------------------------------
+class CEffectRenderQueueBackend : public CRenderQueueBackend
+{
+protected:
+    const D3DXMATRIX* m_pView;
+    const D3DXMATRIX* m_pProj;
+    UINT m_nFrameTimeStamp;
+    CEffect* m_pEffect;
+public:
+                    CEffectRenderQueueBackend( const D3DXMATRIX* pView, const D3DXMATRIX* pProj,
+                                               UINT nFrameTimeStamp ) : m_pView( pView ),
+                                                                        m_pProj( pProj ),
+                                                                        m_nFrameTimeStamp( nFrameTimeStamp ),
+                                                                        m_pEffect( NULL )
+                    {
+                    }
+
+    virtual UINT    BeginEffect( UINT nEffect )
+    {
+        UINT nPasses = 0;
+        m_pEffect = g_vecEffects[nEffect];
+        if( FAILED( m_pEffect->getPointer()->Begin( &nPasses, D3DXFX_DONOTSAVESTATE ) ) )
+            return 0;
+        return nPasses;
+    }
+    virtual void    BeginPass( UINT nPass )
+    {
+        // Effect-wide globals (scene-level info such as lighting, etc) should be
+        // set here, before the pass begins
+        m_pEffect->getPointer()->BeginPass( nPass );
+    }
+    virtual void    SetInstance( UINT nInstance )
+    {
+        // The timestamp ensures that view and project matrices are not updated redundantly
+        m_pEffect->SetMatrices( g_vecInstances[nInstance]->getMatrix(), m_pView, m_pProj, m_nFrameTimeStamp );
+    }
+    virtual void    SetMaterial( UINT nMaterial )
+    {
+        g_vecMaterials[nMaterial]->apply();
+    }
+    virtual void    Draw( UINT nDraw )
+    {
+        const RQ_DRAW& draw = g_RenderQueue.GetDraw( nDraw );
+
+        // Changing Effect Parameters mid-pass requires notifying ID3DXEffect
+        m_pEffect->getPointer()->CommitChanges();
+
+        // The Effect has been fully updated -- Render the mesh subset!
+        g_vecInstances[draw.nInstance]->getMeshObject()->getPointer()->DrawSubset( draw.nSubset );
+    }
+    virtual void    EndPass()
+    {
+        m_pEffect->getPointer()->EndPass();
+    }
+    virtual void    EndEffect()
+    {
+        m_pEffect->getPointer()->End();
+        m_pEffect = NULL;
+    }
+};
+
+
 //--------------------------------------------------------------------------------------
 // This callback function will be called at the end of every frame to perform all the 
 // rendering calls for the scene, and it will also be called if the window needs to be 
@@ -451,94 +540,18 @@ void CALLBACK OnFrameRender( IDirect3DDevice9* pd3dDevice, double fTime, float f
         matProj = *g_Camera.GetProjMatrix();
         matView = *g_Camera.GetViewMatrix();
 
-        // Sort the scene by either material or mesh instance
-        SortRenderables();
+        // Submit the scene to the render queue, sorted by either material or mesh instance
+        SubmitRenderables( &matView );
 
         DXUT_BeginPerfEvent( DXUT_PERFEVENTCOLOR, L"Draw Code" );
 
-        // Render each scene-level pass in turn
-        // A scene-level pass in different than an effects pass.
-        // Scene-level passes ensure that particular rendering orders are enforced, such as
-        // allowing for all transparent objects to be drawn last.
-        for( vector <pass>::iterator it_pass = g_passes.begin();
-             it_pass != g_passes.end();
-             it_pass++ )
-        {
-            pass& renderPass = *it_pass;
-
-            // iterators, used to access the render queue for this pass
-            pass::iterator it = renderPass.begin();
-            pass::iterator it_begin;
-            pass::iterator it_end;
-
-            while( renderPass.end() != it )
-            {
-                UINT nPasses = 0;
-                CEffect* pEffect = ( *it ).getEffect();
-
-                // Render various materials using the same effect technique in batches.
-                // Scan the list ahead to the next renderable not in this batch.
-                for( it_end = it_begin = it;
-                     ( it_end != renderPass.end() ) && ( ( *it_end ).getEffect() == ( *it ).getEffect() );
-                     it_end++ )
-                {
-                    // no action needed here
-                    // following the loop, it_end will point to the element beyond the last
-                    // renderable sharing the same effect
-                }
-
-                // Initialize the effect
-                pEffect->getPointer()->Begin( &nPasses, D3DXFX_DONOTSAVESTATE );
-
-                CInstance* pInstance, *pLastInstance = NULL;
-                CEffectInstance* pEffectInstance, *pLastEffectInstance = NULL;
-
-                // All materials sharing the same effect will be grouped into the effect pass.
-                // As-needed, the effect will be updated with material-specific (effect instance)
-                // or mesh/object instance (transformation matrices).
-                // Each time ID3DXEffect::BeginPass is invoked, state change commands to support
-                // the effect are invoked.  
-                for( UINT i = 0; i < nPasses; i++ )
-                {
-                    // Effect-wide globals (scene-level info such as lighting, etc) should be
-                    // set here, before the pass begins
-                    //
-
-                    // Initialize the pass
-                    pEffect->getPointer()->BeginPass( i );
-
-                    // Iterate across all renderables determined to share the same effect/technique 
-                    for( it = it_begin; it != it_end; it++ )
-                    {
-                        // The instance is needed to retrieve the world matrix for this object
-                        pInstance = ( *it ).getInstance();
-                        pEffectInstance = ( *it ).getEffectInstance();
-
-                        // If the mesh object instance changed, the new object matrices
-                        // must be sent to the effect
-                        // The timestamp ensures that view and project matrices are not updated redundantly
-                        if( pLastInstance != pInstance )
-                            pEffect->SetMatrices( pInstance->getMatrix(), &matView, &matProj, nFrameTimeStamp );
-
-                        // If the EffectInstance changed, the effect must be updated with the new
-                        // parameter values
-                        if( pLastEffectInstance != pEffectInstance )
-                            pEffectInstance->apply();
-
-                        // Changing Effect Parameters mid-pass requires notifying ID3DXEffect
-                        pEffect->getPointer()->CommitChanges();
-
-                        // The Effect has been fully updated -- Render the mesh subset!
-                        pInstance->getMeshObject()->getPointer()->DrawSubset( ( *it ).getSubset() );
-
-                        pLastInstance = pInstance;
-                        pLastEffectInstance = pEffectInstance;
-                    }
-                    pEffect->getPointer()->EndPass();
-                }
-                pEffect->getPointer()->End();
-            }
-        }
+        // Replay the sorted command stream.
+        // The scene-level pass is the most significant part of each sort key, so
+        // scene-level ordering (such as drawing the sky box first) is preserved.
+        // Each time ID3DXEffect::BeginPass is invoked, state change commands to support
+        // the effect are invoked.
+        CEffectRenderQueueBackend backend( &matView, &matProj, nFrameTimeStamp );
+        g_RenderQueue.Execute( &backend );
 
         DXUT_EndPerfEvent(); // end of draw code
 
@@ -623,6 +636,10 @@ void RenderText( double fTime )
             // amounts of text depending on the state manager statistics
             txtHelper.SetForegroundColor( D3DXCOLOR( 0.0f, 1.0f, 0.0f, 1.0f ) );
             txtHelper.DrawTextLine( g_bSortByMaterial ? L"Sorted By:  Material" : L"Sorted By:  Instance" );
+            const RQ_STATS& stats = g_RenderQueue.GetStats();
+            txtHelper.DrawFormattedTextLine( L"Queue: %u draws, %u effect, %u material, %u matrix changes",
+                                             stats.nDraws, stats.nEffectChanges, stats.nMaterialChanges,
+                                             stats.nInstanceChanges );
             if( g_pStateManager )
                 txtHelper.DrawTextLine( g_pStateManager->EndFrameStats() );
 
@@ -747,7 +764,7 @@ void CALLBACK OnGUIEvent( UINT nEvent, int nControlID, CDXUTControl* pControl, v
 
             swprintf_s( szMessage, 100, L"# Rocks: %d", g_nMaxRocksToRender ); szMessage[99] = 0;
             g_SampleUI.GetStatic( IDC_NUM_ROCKS_STATIC )->SetText( szMessage );
-            QueueAndSortRenderables();
+            QueueRenderables();
             break;
 
 
@@ -763,7 +780,6 @@ void CALLBACK OnGUIEvent( UINT nEvent, int nControlID, CDXUTControl* pControl, v
 
         case IDC_MATERIALSORT:
             g_bSortByMaterial = g_SampleUI.GetCheckBox( IDC_MATERIALSORT )->GetChecked();
-            g_bSortOrderDirty = true;
             break;
 
         case IDC_MS_PER_FRAME_SLIDER:
@@ -814,6 +830,12 @@ void CALLBACK OnDestroyDevice( void* pUserContext )
     SAFE_RELEASE( g_pStateManager );
     SAFE_RELEASE( g_pFont );
 
+    // The id tables point into the instances released below
+    g_vecDraws.clear();
+    g_vecEffects.clear();
+    g_vecMaterials.clear();
+    g_RenderQueue.Reset();
+
     while( !g_vecInstances.empty() )
     {
         CInstance* pInstance = g_vecInstances.back();
@@ -895,40 +917,73 @@ HRESULT BuildSceneFromX( LPDIRECT3DDEVICE9 pd3dDevice )
 
 //--------------------------------------------------------------------------------------
 // Renderable sub-items (mesh subsets with their associated materials) are maintained
-// in a render queue.  This queue allows for sorting by material or instance.
+// as a list of draws for the render queue.  Effects, materials (effect instances),
+// meshes and instances are given small integer ids here, which is what the queue
+// packs into its sort keys.
 //--------------------------------------------------------------------------------------
-void QueueAndSortRenderables()
+void QueueRenderables()
 {
-    // All render queue will be regenerated - ensure that the old queues are cleared
-    g_passes.clear();
+    // All draws will be regenerated - ensure that the old lists are cleared
+    g_vecDraws.clear();
+    g_vecEffects.clear();
+    g_vecMaterials.clear();
+
+    map <CEffect*, UINT> mapEffects;
+    map <CEffectInstance*, UINT> mapMaterials;
+    map <CMeshObject*, UINT> mapMeshes;
 
     UINT nRocksCount = 0;
 
-    // Add each mesh/object instance into the correct render queue
-    for( vector <CInstance*>::iterator it = g_vecInstances.begin();
-         it != g_vecInstances.end();
-         it++ )
+    // Add each mesh/object instance into the draw list
+    for( UINT nInstance = 0; nInstance < ( UINT )g_vecInstances.size(); nInstance++ )
     {
-        CInstance* pInstance = *it;
-        UINT nRenderPass = pInstance->getRenderPass();
-
-        // ensure that enough render passes exist
-        if( nRenderPass >= g_passes.size() )
-            g_passes.resize( nRenderPass + 1 );
+        CInstance* pInstance = g_vecInstances[nInstance];
+        CMeshObject* pMesh = pInstance->getMeshObject();
 
         // Constrain the number of rocks in the scene on the maximum limit
-        if( !_wcsicmp( pInstance->getMeshObject()->getName().c_str(), L"Rock.x" )
+        if( !_wcsicmp( pMesh->getName().c_str(), L"Rock.x" )
             && ++nRocksCount > g_nMaxRocksToRender )
             continue;
 
-        // Add this object's renderables to the render queue
-        DWORD dwSubsets = ( DWORD )pInstance->getMeshObject()->getSubsetCount();
+        UINT nMesh = mapMeshes.insert( map <CMeshObject*, UINT>::value_type( pMesh,
+                                                                             ( UINT )mapMeshes.size() ) ).first->second;
+
+        // Add this object's renderables to the draw list
+        DWORD dwSubsets = pMesh->getSubsetCount();
         for( DWORD dw = 0; dw < dwSubsets; dw++ )
         {
-            g_passes[nRenderPass].push_back( CRenderable( pInstance, dw ) );
+            CMaterial* pMaterial = pMesh->getMaterial( dw );
+
+            map <CEffect*, UINT>::iterator it_effect = mapEffects.find( pMaterial->getEffect() );
+            if( mapEffects.end() == it_effect )
+            {
+                it_effect = mapEffects.insert( map <CEffect*, UINT>::value_type( pMaterial->getEffect(),
+                                                                                 ( UINT )g_vecEffects.size() ) ).first;
+                g_vecEffects.push_back( pMaterial->getEffect() );
+            }
+
+            map <CEffectInstance*, UINT>::iterator it_material = mapMaterials.find( pMaterial->getEffectInstance() );
+            if( mapMaterials.end() == it_material )
+            {
+                it_material = mapMaterials.insert( map <CEffectInstance*, UINT>::value_type(
+                                                   pMaterial->getEffectInstance(), ( UINT )g_vecMaterials.size() ) ).first;
+                g_vecMaterials.push_back( pMaterial->getEffectInstance() );
+            }
+
+            RQ_DRAW draw;
+            draw.nPass = pInstance->getRenderPass();
+            draw.nEffect = ( *it_effect ).second;
+            draw.nMaterial = ( *it_material ).second;
+            draw.nMesh = nMesh;
+            draw.nInstance = nInstance;
+            draw.nSubset = dw;
+            draw.fDepth = 0.0f;
+            g_vecDraws.push_back( draw );
         }
     }
 
+    g_RenderQueue.Reserve( ( UINT )g_vecDraws.size() );
+
     if( g_nMaxRocksToRender > nRocksCount )
         g_nMaxRocksToRender = nRocksCount;
 
@@ -937,34 +992,217 @@ void QueueAndSortRenderables()
     g_SampleUI.GetSlider( IDC_NUM_ROCKS )->SetRange( 0, nRocksCount );
     swprintf_s( szMessage, 100, L"# Rocks: %d", g_nMaxRocksToRender ); szMessage[99] = 0;
     g_SampleUI.GetStatic( IDC_NUM_ROCKS_STATIC )->SetText( szMessage );
-
-    g_bSortOrderDirty = true;
 }
 
 
 //--------------------------------------------------------------------------------------
-// Re-sort the list of renderables (mesh subsets)
+// Submits every draw to the render queue and sorts it.
 // It should be more efficient to render groups of similar materials in batches
 // (g_bSortByMaterial).  This should serve to minimize the number of effect changes,
 // which in turn should minimize the number of state changes required to render the
-// scene.
+// scene.  Within a material, draws are ordered front to back.
+//--------------------------------------------------------------------------------------
+void SubmitRenderables( const D3DXMATRIX* pView )
+{
+    g_RenderQueue.SetSortOrder( g_bSortByMaterial ? RQ_SORT_MATERIAL : RQ_SORT_INSTANCE );
+    g_RenderQueue.Reset();
+
+    for( vector <RQ_DRAW>::iterator it = g_vecDraws.begin();
+         it != g_vecDraws.end();
+         it++ )
+    {
+        // View space depth of the instance origin
+        const D3DXMATRIX* pWorld = g_vecInstances[( *it ).nInstance]->getMatrix();
+        ( *it ).fDepth = pWorld->_41 * pView->_13 + pWorld->_42 * pView->_23 + pWorld->_43 * pView->_33 + pView->_43;
+
+        g_RenderQueue.Submit( *it );
+    }
+
+    g_RenderQueue.Sort();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Stand-ins for the sample's material classes, used by the benchmark to time a sort
+// that compares through pointers the way the sample used to.
+//--------------------------------------------------------------------------------------
+struct BENCH_EFFECT
+{
+    UINT nId;
+};
+
+struct BENCH_MATERIAL
+{
+    BENCH_EFFECT* pEffect;
+};
+
+struct BENCH_RENDERABLE
+{
+    BENCH_MATERIAL* pMaterial;
+    UINT nDraw;
+};
+
+inline bool greaterBenchMaterial( const BENCH_RENDERABLE& lhs, const BENCH_RENDERABLE& rhs )
+{
+    if( rhs.pMaterial->pEffect > lhs.pMaterial->pEffect )
+        return true;
+    else if( rhs.pMaterial->pEffect < lhs.pMaterial->pEffect )
+        return false;
+    return rhs.pMaterial > lhs.pMaterial;
+}
+
+
 //--------------------------------------------------------------------------------------
-void SortRenderables()
+// Fills the render queue with nDraws synthetic draws each iteration and reports
+// submit+sort throughput in draws per millisecond, compared with sorting the same
+// draws through material pointers.  The sorted order is checked against a stable
+// sort of the keys, and the command stream is replayed to a null backend.
+//--------------------------------------------------------------------------------------
+INT RunBenchmark( UINT nDraws )
 {
-    if( g_bSortOrderDirty )
+    const UINT nEffects = 64;
+    const UINT nMaterials = 4096;
+    const UINT nMeshes = 1024;
+    const UINT nSubsets = 4;
+    const UINT nIterations = 20;
+
+    // Report to the console we were started from, if any
+    if( AttachConsole( ATTACH_PARENT_PROCESS ) )
     {
-        // Each queue is sorted by material (effect) or instance
-        for( vector <pass>::iterator it = g_passes.begin();
-             it != g_passes.end();
-             it++ )
+        FILE* pFile;
+        freopen_s( &pFile, "CONOUT$", "w", stdout );
+    }
+
+    // Synthetic scene: each instance draws several subsets of one mesh.  Materials
+    // belong to one effect each.
+    srand( 0 );
+    vector <RQ_DRAW> vecDraws( nDraws );
+    for( UINT i = 0; i < nDraws; i++ )
+    {
+        RQ_DRAW& draw = vecDraws[i];
+        UINT nInstance = i / nSubsets;
+        UINT nMesh = ( nInstance * 2654435761U ) % nMeshes;
+
+        draw.nPass = ( 0 == nInstance ) ? 0 : 1;
+        draw.nMaterial = ( nMesh * nSubsets + i % nSubsets ) % nMaterials;
+        draw.nEffect = draw.nMaterial % nEffects;
+        draw.nMesh = nMesh;
+        draw.nInstance = nInstance;
+        draw.nSubset = i % nSubsets;
+        draw.fDepth = 0.1f + 500.0f * ( ( ( rand() & 0x7FFF ) << 15 ) | ( rand() & 0x7FFF ) ) / ( float )( 1 << 30 );
+    }
+
+    wprintf( L"%u draws, %u effects, %u materials, %u meshes, %u iterations\n",
+             nDraws, nEffects, nMaterials, nMeshes, nIterations );
+
+    LARGE_INTEGER qwFreq, qwStart, qwEnd;
+    QueryPerformanceFrequency( &qwFreq );
+
+    // Render queue: submit + radix sort + command stream
+    CRenderQueue queue;
+    queue.Reserve( nDraws );
+    LONGLONG llQueueTime = 0;
+    for( UINT nIteration = 0; nIteration < nIterations; nIteration++ )
+    {
+        QueryPerformanceCounter( &qwStart );
+        queue.Reset();
+        for( UINT i = 0; i < nDraws; i++ )
         {
-            sort( ( *it ).begin(),
-                  ( *it ).end(),
-                  g_bSortByMaterial ? greaterMaterial : greaterInstance );
+            if( FAILED( queue.Submit( vecDraws[i] ) ) )
+            {
+                wprintf( L"Submit failed for draw %u\n", i );
+                return 1;
+            }
         }
+        queue.Sort();
+        QueryPerformanceCounter( &qwEnd );
+        llQueueTime += qwEnd.QuadPart - qwStart.QuadPart;
     }
 
-    g_bSortOrderDirty = false;
+    // Pointer comparisons, as the sample used to sort
+    vector <BENCH_EFFECT*> vecEffects( nEffects );
+    vector <BENCH_MATERIAL*> vecMaterials( nMaterials );
+    for( UINT i = 0; i < nEffects; i++ )
+    {
+        vecEffects[i] = new BENCH_EFFECT;
+        vecEffects[i]->nId = i;
+    }
+    for( UINT i = 0; i < nMaterials; i++ )
+    {
+        vecMaterials[i] = new BENCH_MATERIAL;
+        vecMaterials[i]->pEffect = vecEffects[i % nEffects];
+    }
+
+    vector <BENCH_RENDERABLE> vecRenderables( nDraws );
+    LONGLONG llPointerTime = 0;
+    for( UINT nIteration = 0; nIteration < nIterations; nIteration++ )
+    {
+        QueryPerformanceCounter( &qwStart );
+        for( UINT i = 0; i < nDraws; i++ )
+        {
+            vecRenderables[i].pMaterial = vecMaterials[vecDraws[i].nMaterial];
+            vecRenderables[i].nDraw = i;
+        }
+        sort( vecRenderables.begin(), vecRenderables.end(), greaterBenchMaterial );
+        QueryPerformanceCounter( &qwEnd );
+        llPointerTime += qwEnd.QuadPart - qwStart.QuadPart;
+    }
+
+    for( UINT i = 0; i < nMaterials; i++ )
+        delete vecMaterials[i];
+    for( UINT i = 0; i < nEffects; i++ )
+        delete vecEffects[i];
+
+    double fQueueMs = 1000.0 * llQueueTime / qwFreq.QuadPart / nIterations;
+    double fPointerMs = 1000.0 * llPointerTime / qwFreq.QuadPart / nIterations;
+    wprintf( L"%-16s %8.3f ms  %10.0f draws/ms\n", L"Render queue:", fQueueMs, nDraws / fQueueMs );
+    wprintf( L"%-16s %8.3f ms  %10.0f draws/ms\n", L"Pointer sort:", fPointerMs, nDraws / fPointerMs );
+
+    const RQ_STATS& stats = queue.GetStats();
+    wprintf( L"%u radix passes, %u effect, %u material, %u matrix changes, %u commands\n",
+             stats.nRadixPasses, stats.nEffectChanges, stats.nMaterialChanges, stats.nInstanceChanges,
+             queue.GetCommandCount() );
+
+    // The queue must produce the same order as a stable sort of its keys
+    vector <pair <UINT64, UINT> > vecReference( nDraws );
+    for( UINT i = 0; i < nDraws; i++ )
+        vecReference[i] = pair <UINT64, UINT>( CRenderQueue::MakeKey( RQ_SORT_MATERIAL, vecDraws[i] ), i );
+    sort( vecReference.begin(), vecReference.end() );
+
+    const RQ_COMMAND* pCommands = queue.GetCommands();
+    UINT nSorted = 0;
+    for( UINT i = 0; i < queue.GetCommandCount(); i++ )
+    {
+        if( RQ_OP_DRAW != pCommands[i].nOp )
+            continue;
+        if( nSorted >= nDraws || pCommands[i].nArg != vecReference[nSorted].second )
+        {
+            wprintf( L"Sort order differs from the reference at draw %u\n", nSorted );
+            return 1;
+        }
+        nSorted++;
+    }
+    if( nSorted != nDraws )
+    {
+        wprintf( L"Command stream has %u of %u draws\n", nSorted, nDraws );
+        return 1;
+    }
+
+    // Replay to the null backend
+    CNullRenderQueueBackend backend;
+    QueryPerformanceCounter( &qwStart );
+    queue.Execute( &backend );
+    QueryPerformanceCounter( &qwEnd );
+    double fExecuteMs = 1000.0 * ( qwEnd.QuadPart - qwStart.QuadPart ) / qwFreq.QuadPart;
+    wprintf( L"%-16s %8.3f ms  %u calls\n", L"Null replay:", fExecuteMs, backend.GetCalls() );
+
+    if( backend.GetDraws() != nDraws )
+    {
+        wprintf( L"Null backend saw %u of %u draws\n", backend.GetDraws(), nDraws );
+        return 1;
+    }
+
+    return 0;
 }
 
 
@@ -430,96 +430,6 @@ public:
 };
 
 
-//--------------------------------------------------------------------------------------
-// A renderable object is the smallest unit that can be drawn by the sample.  It
-// corresponds to a binding between a Mesh Subset (plus it's associanted material)
-// and an instance of the mesh that provides the world position (m_pInstance).
-// For the purposes of this sample, sorting the render queue does is not required to
-// be particularly fast, as sorting occurs as a pre-render process.
-//--------------------------------------------------------------------------------------
-class CRenderable
-{
-protected:
-    // Defining values that uniquely specify the renderable item
-    CInstance* m_pInstance;
-    DWORD m_dwSubset;
-
-    // Derived/cached values
-    // For the purposes of this sample, the material pointer may safely be cached.
-    // (Any action that invalidates the material pointer also results in rebuilding the
-    // list of renderables)
-    CMaterial* m_pMaterial;
-
-public:
-    //
-    inline          CRenderable( CInstance* pInstance, DWORD dwSubset ) : m_pInstance( pInstance ),
-                                                                          m_dwSubset( dwSubset )
-    {
-        m_pMaterial = m_pInstance->getMeshObject()->getMaterial( m_dwSubset );
-    }
-
-    //
-    inline CInstance* getInstance()
-    {
-        return m_pInstance;
-    }
-    inline DWORD    getSubset()
-    {
-        return m_dwSubset;
-    }
-    inline CEffect* getEffect()
-    {
-        return m_pMaterial->getEffect();
-    }
-    inline CEffectInstance* getEffectInstance()
-    {
-        return m_pMaterial->getEffectInstance();
-    }
-};
-
-
-
-//--------------------------------------------------------------------------------------
-// Defines the sort order when CRenderable objects are sorted by Material.
-// The ordering in which renderables are sorted is:
-//      effect
-//      effect instance
-// Using this sort order causes all renderables of like effects to be grouped together
-//--------------------------------------------------------------------------------------
-inline bool greaterMaterial( CRenderable& lhs, CRenderable& rhs )
-{
-    // sort by effect, which can be costly to switch
-    if( rhs.getEffect() > lhs.getEffect() )
-        return true;
-    else if( rhs.getEffect() < lhs.getEffect() )
-        return false;
-
-    // enforce the sorting by effect instance, lastly
-    // changing parameter values within an effect is likely to be less costly than switching effects.
-    return rhs.getEffectInstance() > lhs.getEffectInstance();
-}
-
-
-//--------------------------------------------------------------------------------------
-// Defines the sort order when CRenderable objects are sorted by Instance
-// The ordering in which renderables are sorted is:
-//      instance of mesh
-//      mesh subset
-// Using this sort order causes all object instances to be drawn in their entirety
-// before moving on to the next object instance to be drawn.
-//--------------------------------------------------------------------------------------
-inline bool greaterInstance( CRenderable& lhs, CRenderable& rhs )
-{
-    // sort by instance
-    if( rhs.getInstance() > lhs.getInstance() )
-        return true;
-    else if( rhs.getInstance() < lhs.getInstance() )
-        return false;
-
-    // sort by mesh material subset
-    return rhs.getSubset() > lhs.getSubset();
-}
-
 //--------------------------------------------------------------------------------------
 // Required for std::find to operate on D3DVERTEXELEMENT9
 //--------------------------------------------------------------------------------------
@@ -10,8 +10,12 @@
 #include "SDKMisc.h"
 #include "AsyncLoader.h"
 #include "ContentLoaders.h"
+#include "PackedFile.h"
 #include <process.h>
 
+// How far down the IO queue to look for reads to merge with the one at the front
+#define MAX_QUEUED_REQUESTS_TO_SCAN 64
+
 //--------------------------------------------------------------------------------------
 // External flags
 //--------------------------------------------------------------------------------------
@@ -39,7 +43,7 @@ void WarmIOCache( BYTE* pData, SIZE_T size )
 {
     // read one byte in every 4k page in order to force all of the pages to load
     SIZE_T start = 0;
-    BYTE byteTemp = 0;
+    volatile BYTE byteTemp = 0;
 
     while( start < size )
     {
@@ -58,7 +62,9 @@ CAsyncLoader::CAsyncLoader( UINT NumProcessingThreads ) : m_bDone( false ),
                                                           m_hProcessQueueSemaphore( 0 ),
                                                           m_hIOThread( 0 ),
                                                           m_NumProcessingThreads( 0 ),
-                                                          m_phProcessThreads( NULL )
+                                                          m_phProcessThreads( NULL ),
+                                                          m_bUploadBudget( false ),
+                                                          m_llLastServiceTime( 0 )
 {
     InitAsyncLoadingThreadObjects( NumProcessingThreads );
     m_NumIORequests = 0;
@@ -75,21 +81,31 @@ CAsyncLoader::~CAsyncLoader()
 // Add a work item to the queue of work items
 //--------------------------------------------------------------------------------------
 HRESULT CAsyncLoader::AddWorkItem( IDataLoader* pDataLoader, IDataProcessor* pDataProcessor, HRESULT* pHResult,
-                                   void** ppDeviceObject )
+                                   void** ppDeviceObject, UINT64 Key )
 {
     if( !pDataLoader || !pDataProcessor )
         return E_INVALIDARG;
 
+    if( ppDeviceObject )
+        *ppDeviceObject = NULL;
+
+    // Wait for the copy already on its way instead of loading it again
+    if( Key && !m_Coalescer.AddRequest( Key, ppDeviceObject, pHResult ) )
+    {
+        SAFE_DELETE( pDataLoader );
+        SAFE_DELETE( pDataProcessor );
+        return S_OK;
+    }
+
     RESOURCE_REQUEST ResourceRequest;
     ResourceRequest.pDataLoader = pDataLoader;
     ResourceRequest.pDataProcessor = pDataProcessor;
     ResourceRequest.pHR = pHResult;
     ResourceRequest.ppDeviceObject = ppDeviceObject;
+    ResourceRequest.Key = Key;
     ResourceRequest.bCopy = false;
     ResourceRequest.bLock = false;
     ResourceRequest.bError = false;
-    if( ppDeviceObject )
-        *ppDeviceObject = NULL;
 
     // Add the request to the read queue
     EnterCriticalSection( &m_csIOQueue );
@@ -110,7 +126,8 @@ HRESULT CAsyncLoader::AddWorkItem( IDataLoader* pDataLoader, IDataProcessor* pDa
 //--------------------------------------------------------------------------------------
 void CAsyncLoader::WaitForAllItems()
 {
-    ProcessDeviceWorkItems( UINT_MAX, FALSE );
+    // Nothing is being drawn, so there is no frame to keep within budget
+    ServiceDeviceWorkItems( UINT_MAX, FALSE, false );
 
     for(; ; )
     {
@@ -119,7 +136,7 @@ void CAsyncLoader::WaitForAllItems()
             return;
 
         // Service Queues
-        ProcessDeviceWorkItems( UINT_MAX, FALSE );
+        ServiceDeviceWorkItems( UINT_MAX, FALSE, false );
         Sleep( 100 );
     }
 }
@@ -143,6 +160,8 @@ unsigned int CAsyncLoader::FileIOThreadProc()
 
     RESOURCE_REQUEST ResourceRequest = {0};
 
+    DXUTProfilerSetThreadName( L"Async IO" );
+
     while( !m_bDone )
     {
         // Wait for a read or create request
@@ -163,8 +182,16 @@ unsigned int CAsyncLoader::FileIOThreadProc()
         {
             if( !ResourceRequest.bError )
             {
+                // Read it along with the requests around it in the file
+                LOAD_SOURCE Source;
+                if( ResourceRequest.pDataLoader->GetSource( &Source ) )
+                    ReadMerged( Source );
+
                 // Load the data
-                hr = ResourceRequest.pDataLoader->Load();
+                {
+                    CDXUTProfileScope ProfileScope( L"Load" );
+                    hr = ResourceRequest.pDataLoader->Load();
+                }
 
                 if( FAILED( hr ) )
                 {
@@ -192,7 +219,10 @@ unsigned int CAsyncLoader::FileIOThreadProc()
             if( !ResourceRequest.bError )
             {
                 // Create the data
-                hr = ResourceRequest.pDataProcessor->CopyToResource();
+                {
+                    CDXUTProfileScope ProfileScope( L"CopyToResource" );
+                    hr = ResourceRequest.pDataProcessor->CopyToResource();
+                }
 
                 if( FAILED( hr ) )
                 {
@@ -219,6 +249,52 @@ unsigned int CAsyncLoader::FileIOThreadProc()
     return 0;
 }
 
+//--------------------------------------------------------------------------------------
+// Reads Source, taking in the reads queued behind it that are close to it in the same
+// chunk, unless an earlier read already covered it.  The requests then find their data
+// in memory when they load it.
+//--------------------------------------------------------------------------------------
+void CAsyncLoader::ReadMerged( const LOAD_SOURCE& Source )
+{
+    LOAD_SOURCE Queued[ LOAD_MERGE_LOOKAHEAD ];
+    UINT nQueued = 0;
+
+    EnterCriticalSection( &m_csIOQueue );
+    for( int i = 0; i < m_IOQueue.GetSize() && i < MAX_QUEUED_REQUESTS_TO_SCAN &&
+         nQueued < LOAD_MERGE_LOOKAHEAD; i++ )
+    {
+        RESOURCE_REQUEST& QueuedRequest = m_IOQueue.GetAt( i );
+        if( !QueuedRequest.bCopy && !QueuedRequest.bError &&
+            QueuedRequest.pDataLoader->GetSource( &Queued[nQueued] ) )
+            nQueued++;
+    }
+    LeaveCriticalSection( &m_csIOQueue );
+
+    LOAD_SOURCE Read;
+    if( m_Coalescer.BeginRead( Source, Queued, nQueued, &Read ) && Read.pPackedFile )
+    {
+        CDXUTProfileScope ProfileScope( L"MergedRead" );
+        Read.pPackedFile->ReadRange( Read );
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Gives the device object of a finished request to the requests that joined it
+//--------------------------------------------------------------------------------------
+void CAsyncLoader::CompleteShared( const RESOURCE_REQUEST& ResourceRequest, HRESULT hr )
+{
+    m_Coalescer.CompleteRequest( ResourceRequest.Key, &m_CompletedWaiters );
+    for( int i = 0; i < m_CompletedWaiters.GetSize(); i++ )
+    {
+        const LOAD_WAITER& Waiter = m_CompletedWaiters[i];
+        HRESULT hrShare = ResourceRequest.pDataProcessor->ShareDeviceObject( Waiter.ppDeviceObject );
+        if( FAILED( hrShare ) )
+            *Waiter.ppDeviceObject = ( void* )ERROR_RESOURCE_VALUE;
+        if( Waiter.pHR )
+            *Waiter.pHR = FAILED( hrShare ) ? hrShare : hr;
+    }
+}
+
 //--------------------------------------------------------------------------------------
 // ProcessingThreadProc
 // 
@@ -233,6 +309,9 @@ unsigned int CAsyncLoader::ProcessingThreadProc()
 
     HRESULT hr = S_OK;
     m_bProcessThreadDone = false;
+
+    DXUTProfilerSetThreadName( L"Async Processing" );
+
     while( !m_bDone )
     {
         // Acquire ProcessQueueSemaphore
@@ -253,10 +332,14 @@ unsigned int CAsyncLoader::ProcessingThreadProc()
         {
             void* pData = NULL;
             SIZE_T cDataSize = 0;
-            hr = ResourceRequest.pDataLoader->Decompress( &pData, &cDataSize );
+            {
+                CDXUTProfileScope ProfileScope( L"Decompress" );
+                hr = ResourceRequest.pDataLoader->Decompress( &pData, &cDataSize );
+            }
             if( SUCCEEDED( hr ) )
             {
                 // Process the data
+                CDXUTProfileScope ProfileScope( L"Process" );
                 hr = ResourceRequest.pDataProcessor->Process( pData, cDataSize );
             }
         }
@@ -352,12 +435,40 @@ void CAsyncLoader::DestroyAsyncLoadingThreadObjects()
 // it either Locks or Unlocks a resource (or calls UpdateSubresource for D3D10).  One of
 // of the arguments is the number of resources to service.  This ensure that no matter
 // how many items are in the queue, the graphics thread doesn't stall trying to process
-// all of them.
+// all of them.  With the upload budget enabled, the scheduler can also stop it early
+// when the next request isn't expected to fit in the frame.
 //--------------------------------------------------------------------------------------
 void CAsyncLoader::ProcessDeviceWorkItems( UINT CurrentNumResourcesToService, BOOL bRetryLoads )
 {
+    // The time since the last call is the length of the last frame
+    LARGE_INTEGER qwTime, qwTicksPerSec;
+    QueryPerformanceCounter( &qwTime );
+    QueryPerformanceFrequency( &qwTicksPerSec );
+    if( m_bUploadBudget )
+    {
+        float fLastFrameMs = m_UploadScheduler.GetSettings().fTargetFrameMs;
+        if( m_llLastServiceTime )
+            fLastFrameMs = ( float )( ( qwTime.QuadPart - m_llLastServiceTime ) * 1000.0 / qwTicksPerSec.QuadPart );
+        m_UploadScheduler.BeginFrame( fLastFrameMs );
+    }
+    m_llLastServiceTime = qwTime.QuadPart;
+
+    ServiceDeviceWorkItems( CurrentNumResourcesToService, bRetryLoads, m_bUploadBudget );
+}
+
+//--------------------------------------------------------------------------------------
+void CAsyncLoader::ServiceDeviceWorkItems( UINT CurrentNumResourcesToService, BOOL bRetryLoads, bool bBudget )
+{
+    // Shows up next to FrameMove and FrameRender in DXUT's per frame times
+    static int s_nFrameSubsystem = DXUTRegisterFrameSubsystem( L"ProcessDeviceWorkItems" );
+    CDXUTFrameSubsystemScope FrameScope( s_nFrameSubsystem );
+    CDXUTProfileScope ProfileScope( L"ProcessDeviceWorkItems" );
     HRESULT hr = S_OK;
 
+    LARGE_INTEGER qwTicksPerSec;
+    QueryPerformanceFrequency( &qwTicksPerSec );
+    double fMsPerTick = 1000.0 / qwTicksPerSec.QuadPart;
+
     EnterCriticalSection( &m_csRenderThreadQueue );
     UINT numJobs = m_RenderThreadQueue.GetSize();
     LeaveCriticalSection( &m_csRenderThreadQueue );
@@ -366,9 +477,24 @@ void CAsyncLoader::ProcessDeviceWorkItems( UINT CurrentNumResourcesToService, BO
     {
         EnterCriticalSection( &m_csRenderThreadQueue );
         RESOURCE_REQUEST ResourceRequest = m_RenderThreadQueue.GetAt( 0 );
+
+        // Leave the request at the front of the queue if it doesn't fit this frame
+        UPLOAD_TYPE UploadType;
+        SIZE_T cUploadBytes;
+        UPLOAD_STEP UploadStep = ResourceRequest.bLock ? UPLOAD_STEP_LOCK : UPLOAD_STEP_UNLOCK;
+        ResourceRequest.pDataProcessor->GetUploadInfo( &UploadType, &cUploadBytes );
+        if( bBudget && !m_UploadScheduler.CanService( UploadType, UploadStep, cUploadBytes ) )
+        {
+            LeaveCriticalSection( &m_csRenderThreadQueue );
+            break;
+        }
+
         m_RenderThreadQueue.Remove( 0 );
         LeaveCriticalSection( &m_csRenderThreadQueue );
 
+        LARGE_INTEGER qwStart, qwEnd;
+        QueryPerformanceCounter( &qwStart );
+
         if( ResourceRequest.bLock )
         {
             if( !ResourceRequest.bError )
@@ -381,7 +507,10 @@ void CAsyncLoader::ProcessDeviceWorkItems( UINT CurrentNumResourcesToService, BO
                     m_RenderThreadQueue.Add( ResourceRequest );
                     LeaveCriticalSection( &m_csRenderThreadQueue );
 
-                    // move on to the next guy
+                    // move on to the next guy, counting the time spent finding out
+                    QueryPerformanceCounter( &qwEnd );
+                    if( bBudget )
+                        m_UploadScheduler.AddSpentMs( ( float )( ( qwEnd.QuadPart - qwStart.QuadPart ) * fMsPerTick ) );
                     continue;
                 }
                 else if( FAILED( hr ) )
@@ -408,6 +537,8 @@ void CAsyncLoader::ProcessDeviceWorkItems( UINT CurrentNumResourcesToService, BO
                 if( ResourceRequest.pHR )
                     *ResourceRequest.pHR = hr;
             }
+            if( ResourceRequest.Key )
+                CompleteShared( ResourceRequest, ResourceRequest.bError ? E_FAIL : hr );
 
             SAFE_DELETE( ResourceRequest.pDataLoader );
             SAFE_DELETE( ResourceRequest.pDataProcessor );
@@ -415,5 +546,10 @@ void CAsyncLoader::ProcessDeviceWorkItems( UINT CurrentNumResourcesToService, BO
             // Decrement num oustanding resources
             m_NumOustandingResources --;
         }
+
+        QueryPerformanceCounter( &qwEnd );
+        if( bBudget )
+            m_UploadScheduler.ItemServiced( UploadType, UploadStep, cUploadBytes,
+                                            ( float )( ( qwEnd.QuadPart - qwStart.QuadPart ) * fMsPerTick ) );
     }
 }
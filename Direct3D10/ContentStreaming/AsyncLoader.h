@@ -13,6 +13,8 @@
 #include "DXUT.h"
 #include "SDKMesh.h"
 #include "ResourceReuseCache.h"
+#include "UploadScheduler.h"
+#include "LoadCoalescer.h"
 
 //--------------------------------------------------------------------------------------
 // Forward declarations
@@ -30,6 +32,7 @@ struct RESOURCE_REQUEST
     IDataProcessor* pDataProcessor;
     HRESULT* pHR;
     void** ppDeviceObject;
+    UINT64 Key;                 // 0 if the request is not shared
     bool bLock;
     bool bCopy;
 
@@ -61,12 +64,21 @@ private:
     HANDLE* m_phProcessThreads;
     UINT m_NumIORequests;
     UINT m_NumProcessRequests;
+    CUploadScheduler m_UploadScheduler;
+    bool m_bUploadBudget;
+    LONGLONG m_llLastServiceTime;
+    CLoadCoalescer m_Coalescer;
+    CGrowableArray <LOAD_WAITER> m_CompletedWaiters;
 
 private:
     unsigned int                FileIOThreadProc();
     unsigned int                ProcessingThreadProc();
     bool                        InitAsyncLoadingThreadObjects( UINT NumProcessingThreads );
     void                        DestroyAsyncLoadingThreadObjects();
+    void                        ReadMerged( const LOAD_SOURCE& Source );
+    void                        CompleteShared( const RESOURCE_REQUEST& ResourceRequest, HRESULT hr );
+    void                        ServiceDeviceWorkItems( UINT CurrentNumResourcesToService, BOOL bRetryLoads,
+                                                        bool bBudget );
 
 public:
     friend unsigned int WINAPI  _FileIOThreadProc( LPVOID lpParameter );
@@ -75,10 +87,32 @@ public:
                                 CAsyncLoader( UINT NumProcessingThreads );
                                 ~CAsyncLoader();
 
+    // A request with a Key other than 0 joins any request with the same Key still in
+    // flight.  Its loader and processor are deleted and it gets the device object when
+    // that request is done.
     HRESULT                     AddWorkItem( IDataLoader* pDataLoader, IDataProcessor* pDataProcessor,
-                                             HRESULT* pHResult, void** ppDeviceObject );
+                                             HRESULT* pHResult, void** ppDeviceObject, UINT64 Key=0 );
     void                        WaitForAllItems();
     void                        ProcessDeviceWorkItems( UINT CurrentNumResourcesToService, BOOL bRetryLoads=TRUE );
+
+    // With the budget on, ProcessDeviceWorkItems also stops once the scheduler's time
+    // or byte budget for the frame is used up
+    void                        EnableUploadBudget( bool bEnable )
+    {
+        m_bUploadBudget = bEnable;
+    }
+    bool                        IsUploadBudgetEnabled() const
+    {
+        return m_bUploadBudget;
+    }
+    CUploadScheduler*           GetUploadScheduler()
+    {
+        return &m_UploadScheduler;
+    }
+    const CLoadCoalescer*       GetCoalescer() const
+    {
+        return &m_Coalescer;
+    }
 };
 
 #endif
@@ -12,10 +12,21 @@
 #include "AsyncLoader.h"
 #include "PackedFile.h"
 
+// The loaders and processors are created for every streamed item and destroyed once it
+// is on the device, so they come from pools rather than the heap
+DXUT_IMPLEMENT_POOLED_NEW( CTextureLoader )
+DXUT_IMPLEMENT_POOLED_NEW( CTextureProcessor )
+DXUT_IMPLEMENT_POOLED_NEW( CVertexBufferLoader )
+DXUT_IMPLEMENT_POOLED_NEW( CVertexBufferProcessor )
+DXUT_IMPLEMENT_POOLED_NEW( CIndexBufferLoader )
+DXUT_IMPLEMENT_POOLED_NEW( CIndexBufferProcessor )
+
 //--------------------------------------------------------------------------------------
 CTextureLoader::CTextureLoader( WCHAR* szFileName, CPackedFile* pPackedFile ) : m_pData( NULL ),
                                                                                 m_cBytes( 0 ),
-                                                                                m_pPackedFile( pPackedFile )
+                                                                                m_pPackedFile( pPackedFile ),
+                                                                                m_bSourceChecked( false ),
+                                                                                m_bHaveSource( false )
 {
     wcscpy_s( m_szFileName, MAX_PATH, szFileName );
 }
@@ -78,6 +89,24 @@ HRESULT WINAPI CTextureLoader::Load()
     return S_OK;
 }
 
+//--------------------------------------------------------------------------------------
+// Looked up the first time the IO thread asks, and kept for when it asks again while
+// the request waits in the queue
+//--------------------------------------------------------------------------------------
+bool WINAPI CTextureLoader::GetSource( LOAD_SOURCE* pSource )
+{
+    if( !m_bSourceChecked )
+    {
+        m_bSourceChecked = true;
+        m_bHaveSource = m_pPackedFile->UsingMemoryMappedIO() &&
+            m_pPackedFile->FindPackedFile( m_szFileName, &m_Source );
+    }
+
+    if( m_bHaveSource )
+        *pSource = m_Source;
+    return m_bHaveSource;
+}
+
 //--------------------------------------------------------------------------------------
 // This is a private function that either Locks and copies the data (D3D9) or calls
 // UpdateSubresource (D3D10).
@@ -184,6 +213,8 @@ CTextureProcessor::CTextureProcessor( ID3D10Device* pDevice,
                                       UINT SkipMips ) : m_Device( pDevice ),
                                                         m_ppRV10( ppRV10 ),
                                                         m_ppTexture9( NULL ),
+                                                        m_pData( NULL ),
+                                                        m_cBytes( 0 ),
                                                         m_pResourceReuseCache( pResourceReuseCache ),
                                                         m_SkipMips( SkipMips )
 {
@@ -197,6 +228,8 @@ CTextureProcessor::CTextureProcessor( IDirect3DDevice9* pDevice,
                                       UINT SkipMips ) : m_Device( pDevice ),
                                                         m_ppRV10( NULL ),
                                                         m_ppTexture9( ppTexture9 ),
+                                                        m_pData( NULL ),
+                                                        m_cBytes( 0 ),
                                                         m_pResourceReuseCache( pResourceReuseCache ),
                                                         m_SkipMips( SkipMips )
 {
@@ -413,8 +446,44 @@ void WINAPI CTextureProcessor::SetResourceError()
 }
 
 //--------------------------------------------------------------------------------------
-CVertexBufferLoader::CVertexBufferLoader()
+// The size of the file, which includes the mips that are skipped
+//--------------------------------------------------------------------------------------
+void WINAPI CTextureProcessor::GetUploadInfo( UPLOAD_TYPE* pType, SIZE_T* pcBytes )
+{
+    *pType = UPLOAD_TYPE_TEXTURE;
+    *pcBytes = m_cBytes;
+}
+
+//--------------------------------------------------------------------------------------
+// Share the texture, adding a use so each of the requests can give it back
+//--------------------------------------------------------------------------------------
+HRESULT WINAPI CTextureProcessor::ShareDeviceObject( void** ppDeviceObject )
+{
+    if( LDT_D3D10 == m_Device.Type )
+    {
+        ID3D10ShaderResourceView* pRV10 = *m_ppRV10;
+        if( pRV10 && ( ID3D10ShaderResourceView* )ERROR_RESOURCE_VALUE != pRV10 )
+            m_pResourceReuseCache->AddDeviceTextureUse10( pRV10 );
+        *ppDeviceObject = pRV10;
+    }
+    else if( LDT_D3D9 == m_Device.Type )
+    {
+        IDirect3DTexture9* pTexture9 = *m_ppTexture9;
+        if( pTexture9 && ( IDirect3DTexture9* )ERROR_RESOURCE_VALUE != pTexture9 )
+            m_pResourceReuseCache->AddDeviceTextureUse9( pTexture9 );
+        *ppDeviceObject = pTexture9;
+    }
+
+    return S_OK;
+}
+
+//--------------------------------------------------------------------------------------
+// The buffer data is already in memory, but it may come from the packed file
+//--------------------------------------------------------------------------------------
+CVertexBufferLoader::CVertexBufferLoader( const LOAD_SOURCE* pSource ) : m_bHaveSource( pSource != NULL )
 {
+    if( pSource )
+        m_Source = *pSource;
 }
 CVertexBufferLoader::~CVertexBufferLoader()
 {
@@ -432,6 +501,12 @@ HRESULT WINAPI CVertexBufferLoader::Load()
 {
     return S_OK;
 }
+bool WINAPI CVertexBufferLoader::GetSource( LOAD_SOURCE* pSource )
+{
+    if( m_bHaveSource )
+        *pSource = m_Source;
+    return m_bHaveSource;
+}
 
 //--------------------------------------------------------------------------------------
 CVertexBufferProcessor::CVertexBufferProcessor( ID3D10Device* pDevice,
@@ -597,8 +672,25 @@ void WINAPI CVertexBufferProcessor::SetResourceError()
 }
 
 //--------------------------------------------------------------------------------------
-CIndexBufferLoader::CIndexBufferLoader()
+void WINAPI CVertexBufferProcessor::GetUploadInfo( UPLOAD_TYPE* pType, SIZE_T* pcBytes )
+{
+    *pType = UPLOAD_TYPE_VERTEXBUFFER;
+    *pcBytes = ( LDT_D3D10 == m_Device.Type ) ? m_BufferDesc.ByteWidth : m_iSizeBytes;
+}
+
+//--------------------------------------------------------------------------------------
+// Buffers belong to one tile and are never shared
+//--------------------------------------------------------------------------------------
+HRESULT WINAPI CVertexBufferProcessor::ShareDeviceObject( void** ppDeviceObject )
 {
+    return E_NOTIMPL;
+}
+
+//--------------------------------------------------------------------------------------
+CIndexBufferLoader::CIndexBufferLoader( const LOAD_SOURCE* pSource ) : m_bHaveSource( pSource != NULL )
+{
+    if( pSource )
+        m_Source = *pSource;
 }
 CIndexBufferLoader::~CIndexBufferLoader()
 {
@@ -616,6 +708,12 @@ HRESULT WINAPI CIndexBufferLoader::Load()
 {
     return S_OK;
 }
+bool WINAPI CIndexBufferLoader::GetSource( LOAD_SOURCE* pSource )
+{
+    if( m_bHaveSource )
+        *pSource = m_Source;
+    return m_bHaveSource;
+}
 
 //--------------------------------------------------------------------------------------
 CIndexBufferProcessor::CIndexBufferProcessor( ID3D10Device* pDevice,
@@ -783,6 +881,19 @@ void WINAPI CIndexBufferProcessor::SetResourceError()
     }
 }
 
+//--------------------------------------------------------------------------------------
+void WINAPI CIndexBufferProcessor::GetUploadInfo( UPLOAD_TYPE* pType, SIZE_T* pcBytes )
+{
+    *pType = UPLOAD_TYPE_INDEXBUFFER;
+    *pcBytes = ( LDT_D3D10 == m_Device.Type ) ? m_BufferDesc.ByteWidth : m_iSizeBytes;
+}
+
+//--------------------------------------------------------------------------------------
+HRESULT WINAPI CIndexBufferProcessor::ShareDeviceObject( void** ppDeviceObject )
+{
+    return E_NOTIMPL;
+}
+
 //--------------------------------------------------------------------------------------
 // SDKMesh
 //--------------------------------------------------------------------------------------
@@ -851,6 +962,14 @@ HRESULT WINAPI CSDKMeshLoader::Load()
     return hr;
 }
 
+//--------------------------------------------------------------------------------------
+// Meshes are loaded from their own files
+//--------------------------------------------------------------------------------------
+bool WINAPI CSDKMeshLoader::GetSource( LOAD_SOURCE* pSource )
+{
+    return false;
+}
+
 //--------------------------------------------------------------------------------------
 CSDKMeshProcessor::CSDKMeshProcessor()
 {
@@ -882,3 +1001,12 @@ HRESULT WINAPI CSDKMeshProcessor::CopyToResource()
 void    WINAPI CSDKMeshProcessor::SetResourceError()
 {
 }
+void    WINAPI CSDKMeshProcessor::GetUploadInfo( UPLOAD_TYPE* pType, SIZE_T* pcBytes )
+{
+    *pType = UPLOAD_TYPE_OTHER;
+    *pcBytes = 0;
+}
+HRESULT WINAPI CSDKMeshProcessor::ShareDeviceObject( void** ppDeviceObject )
+{
+    return E_NOTIMPL;
+}
@@ -25,6 +25,8 @@ class CPackedFile;
 // Load is called from the IO thread to load data.
 // Decompress is called by one of the processing threads to decompress the data.
 // Destroy is called by the graphics thread when it has consumed the data.
+// GetSource gives where in the packed file the data is, if it comes from one, so the IO
+//   thread can merge it with the reads around it.
 //--------------------------------------------------------------------------------------
 class IDataLoader
 {
@@ -35,6 +37,7 @@ public:
     virtual HRESULT WINAPI  Decompress( void** ppData, SIZE_T* pcBytes ) = 0;
     virtual HRESULT WINAPI  Destroy() = 0;
     virtual HRESULT WINAPI  Load() = 0;
+    virtual bool WINAPI     GetSource( LOAD_SOURCE* pSource ) = 0;
 };
 
 //--------------------------------------------------------------------------------------
@@ -50,6 +53,10 @@ public:
 // SetResourceError is called to set the resource pointer to an error code in the event
 //   that something went wrong.
 // Destroy is called by the graphics thread when it has consumed the data.
+// GetUploadInfo gives the kind and size of the device object, so the graphics thread
+//   work can be budgeted.
+// ShareDeviceObject hands the finished device object to a request that joined this one,
+//   taking a use of it for that request.
 //--------------------------------------------------------------------------------------
 class IDataProcessor
 {
@@ -63,6 +70,8 @@ public:
     virtual HRESULT WINAPI  Process( void* pData, SIZE_T cBytes ) = 0;
     virtual HRESULT WINAPI  CopyToResource() = 0;
     virtual void WINAPI     SetResourceError() = 0;
+    virtual void WINAPI     GetUploadInfo( UPLOAD_TYPE* pType, SIZE_T* pcBytes ) = 0;
+    virtual HRESULT WINAPI  ShareDeviceObject( void** ppDeviceObject ) = 0;
 };
 
 //--------------------------------------------------------------------------------------
@@ -75,16 +84,21 @@ private:
     BYTE* m_pData;
     UINT m_cBytes;
     CPackedFile* m_pPackedFile;
+    LOAD_SOURCE m_Source;
+    bool m_bSourceChecked;
+    bool m_bHaveSource;
 
 public:
                     CTextureLoader( WCHAR* szFileName, CPackedFile* pPackedFile );
                     ~CTextureLoader();
+                    DXUT_DECLARE_POOLED_NEW();
 
     // overrides
 public:
     HRESULT WINAPI  Decompress( void** ppData, SIZE_T* pcBytes );
     HRESULT WINAPI  Destroy();
     HRESULT WINAPI  Load();
+    bool WINAPI     GetSource( LOAD_SOURCE* pSource );
 };
 
 //--------------------------------------------------------------------------------------
@@ -117,6 +131,7 @@ public:
                             CTextureProcessor( IDirect3DDevice9* pDevice, IDirect3DTexture9** ppTexture9,
                                                CResourceReuseCache* pResourceReuseCache, UINT SkipMips );
                             ~CTextureProcessor();
+                            DXUT_DECLARE_POOLED_NEW();
 
     // overrides
 public:
@@ -126,6 +141,8 @@ public:
     HRESULT WINAPI          Process( void* pData, SIZE_T cBytes );
     HRESULT WINAPI          CopyToResource();
     void WINAPI             SetResourceError();
+    void WINAPI             GetUploadInfo( UPLOAD_TYPE* pType, SIZE_T* pcBytes );
+    HRESULT WINAPI          ShareDeviceObject( void** ppDeviceObject );
 };
 
 //--------------------------------------------------------------------------------------
@@ -134,16 +151,20 @@ public:
 class CVertexBufferLoader : public IDataLoader
 {
 private:
+    LOAD_SOURCE m_Source;
+    bool m_bHaveSource;
 
 public:
-                    CVertexBufferLoader();
+                    CVertexBufferLoader( const LOAD_SOURCE* pSource=NULL );
                     ~CVertexBufferLoader();
+                    DXUT_DECLARE_POOLED_NEW();
 
     // overrides
 public:
     HRESULT WINAPI  Decompress( void** ppData, SIZE_T* pcBytes );
     HRESULT WINAPI  Destroy();
     HRESULT WINAPI  Load();
+    bool WINAPI     GetSource( LOAD_SOURCE* pSource );
 };
 
 //--------------------------------------------------------------------------------------
@@ -181,6 +202,7 @@ public:
                                             void* pData,
                                             CResourceReuseCache* pResourceReuseCache );
                     ~CVertexBufferProcessor();
+                    DXUT_DECLARE_POOLED_NEW();
 
     // overrides
 public:
@@ -190,6 +212,8 @@ public:
     HRESULT WINAPI  Process( void* pData, SIZE_T cBytes );
     HRESULT WINAPI  CopyToResource();
     void WINAPI     SetResourceError();
+    void WINAPI     GetUploadInfo( UPLOAD_TYPE* pType, SIZE_T* pcBytes );
+    HRESULT WINAPI  ShareDeviceObject( void** ppDeviceObject );
 };
 
 //--------------------------------------------------------------------------------------
@@ -198,16 +222,20 @@ public:
 class CIndexBufferLoader : public IDataLoader
 {
 private:
+    LOAD_SOURCE m_Source;
+    bool m_bHaveSource;
 
 public:
-                    CIndexBufferLoader();
+                    CIndexBufferLoader( const LOAD_SOURCE* pSource=NULL );
                     ~CIndexBufferLoader();
+                    DXUT_DECLARE_POOLED_NEW();
 
     // overrides
 public:
     HRESULT WINAPI  Decompress( void** ppData, SIZE_T* pcBytes );
     HRESULT WINAPI  Destroy();
     HRESULT WINAPI  Load();
+    bool WINAPI     GetSource( LOAD_SOURCE* pSource );
 };
 
 //--------------------------------------------------------------------------------------
@@ -245,6 +273,7 @@ public:
                                            void* pData,
                                            CResourceReuseCache* pResourceReuseCache );
                     ~CIndexBufferProcessor();
+                    DXUT_DECLARE_POOLED_NEW();
 
     // overrides
 public:
@@ -254,6 +283,8 @@ public:
     HRESULT WINAPI  Process( void* pData, SIZE_T cBytes );
     HRESULT WINAPI  CopyToResource();
     void WINAPI     SetResourceError();
+    void WINAPI     GetUploadInfo( UPLOAD_TYPE* pType, SIZE_T* pcBytes );
+    HRESULT WINAPI  ShareDeviceObject( void** ppDeviceObject );
 };
 
 //--------------------------------------------------------------------------------------
@@ -287,6 +318,7 @@ public:
     HRESULT WINAPI  Decompress( void** ppData, SIZE_T* pcBytes );
     HRESULT WINAPI  Destroy();
     HRESULT WINAPI  Load();
+    bool WINAPI     GetSource( LOAD_SOURCE* pSource );
 };
 
 //--------------------------------------------------------------------------------------
@@ -306,4 +338,6 @@ public:
     HRESULT WINAPI  Process( void* pData, SIZE_T cBytes );
     HRESULT WINAPI  CopyToResource();
     void WINAPI     SetResourceError();
+    void WINAPI     GetUploadInfo( UPLOAD_TYPE* pType, SIZE_T* pcBytes );
+    HRESULT WINAPI  ShareDeviceObject( void** ppDeviceObject );
 };
@@ -18,6 +18,7 @@
 #include "ContentLoaders.h"
 #include "PackedFile.h"
 #include "Terrain.h"
+#include "VisibilityGrid.h"
 
 //--------------------------------------------------------------------------------------
 // Defines
@@ -85,10 +86,12 @@ bool                                g_bUseWDDMPaging = false;
 bool                                g_bStartupResourcesLoaded = false;
 bool                                g_bDrawUI = true;
 bool                                g_bWireframe = false;
+bool                                g_bUploadBudget = true;
 
 CGrowableArray <LEVEL_ITEM*>        g_LevelItemArray;
 CGrowableArray <LEVEL_ITEM*>        g_VisibleItemArray;
-CGrowableArray <LEVEL_ITEM*>        g_LoadedItemArray;
+CGrowableArray <LEVEL_ITEM*>        g_LoadingItemArray;
+CVisibilityGrid                     g_VisibilityGrid;   // Indexed the same as g_LevelItemArray
 CTerrain                            g_Terrain;
 
 enum LOAD_TYPE
@@ -129,6 +132,7 @@ APP_STATE                           g_AppState = APP_STATE_STARTUP; // Current s
 #define IDC_UPLOADTOVRAMFREQ		27
 #define IDC_WIREFRAME				28
 #define IDC_STARTOVER				29
+#define IDC_UPLOADBUDGET			30
 
 //--------------------------------------------------------------------------------------
 // Forward declarations 
@@ -173,10 +177,10 @@ extern void CALLBACK CreateTextureFromFile9_Async( IDirect3DDevice9* pDev, WCHAR
                                                    IDirect3DTexture9** ppTexture, void* pContext );
 extern void CALLBACK CreateVertexBuffer9_Async( IDirect3DDevice9* pDev, IDirect3DVertexBuffer9** ppBuffer,
                                                 UINT iSizeBytes, DWORD Usage, DWORD FVF, D3DPOOL Pool, void* pData,
-                                                void* pContext );
+                                                const LOAD_SOURCE* pSource, void* pContext );
 extern void CALLBACK CreateIndexBuffer9_Async( IDirect3DDevice9* pDev, IDirect3DIndexBuffer9** ppBuffer,
                                                UINT iSizeBytes, DWORD Usage, D3DFORMAT ibFormat, D3DPOOL Pool,
-                                               void* pData, void* pContext );
+                                               void* pData, const LOAD_SOURCE* pSource, void* pContext );
 
 void CALLBACK CreateTextureFromFile10_Serial( ID3D10Device* pDev, WCHAR* szFileName, ID3D10ShaderResourceView** ppRV,
                                               void* pContext );
@@ -187,9 +191,9 @@ void CALLBACK CreateIndexBuffer10_Serial( ID3D10Device* pDev, ID3D10Buffer** ppB
 void CALLBACK CreateTextureFromFile10_Async( ID3D10Device* pDev, WCHAR* szFileName, ID3D10ShaderResourceView** ppRV,
                                              void* pContext );
 void CALLBACK CreateVertexBuffer10_Async( ID3D10Device* pDev, ID3D10Buffer** ppBuffer, D3D10_BUFFER_DESC BufferDesc,
-                                          void* pData, void* pContext );
+                                          void* pData, const LOAD_SOURCE* pSource, void* pContext );
 void CALLBACK CreateIndexBuffer10_Async( ID3D10Device* pDev, ID3D10Buffer** ppBuffer, D3D10_BUFFER_DESC BufferDesc,
-                                         void* pData, void* pContext );
+                                         void* pData, const LOAD_SOURCE* pSource, void* pContext );
 
 void InitApp();
 void LoadStartupResources( IDirect3DDevice9* pDev9, ID3D10Device* pDev10, double fTime );
@@ -200,6 +204,10 @@ void SetTextureLOD( IDirect3DDevice9* pDev9, ID3D10Device* pDev10 );
 void RenderText();
 void DestroyAllMeshes( LOADER_DEVICE_TYPE ldt );
 void ClearD3D10State();
+INT RunVisibilityBenchmark( int nArgs, LPWSTR* pstrArgs );
+INT RunUploadBenchmark( int nArgs, LPWSTR* pstrArgs );
+INT RunLoadBenchmark( int nArgs, LPWSTR* pstrArgs );
+INT RunTerrainBenchmark( int nArgs, LPWSTR* pstrArgs );
 
 //--------------------------------------------------------------------------------------
 // Entry point to the program. Initializes everything and goes into a message processing 
@@ -212,6 +220,43 @@ int WINAPI wWinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdL
     _CrtSetDbgFlag( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );
 #endif
 
+    // -visbench times the visibility queries, -uploadbench simulates the upload budget,
+    // -loadbench replays load requests through the coalescer and -terrainbench times
+    // loading the terrain, all without creating a window
+    int nArgs = 0;
+    LPWSTR* pstrArgs = CommandLineToArgvW( GetCommandLineW(), &nArgs );
+    if( pstrArgs )
+    {
+        for( int i = 1; i < nArgs; i++ )
+        {
+            if( 0 == _wcsicmp( pstrArgs[i], L"-visbench" ) )
+            {
+                INT nResult = RunVisibilityBenchmark( nArgs - i - 1, pstrArgs + i + 1 );
+                LocalFree( pstrArgs );
+                return nResult;
+            }
+            if( 0 == _wcsicmp( pstrArgs[i], L"-uploadbench" ) )
+            {
+                INT nResult = RunUploadBenchmark( nArgs - i - 1, pstrArgs + i + 1 );
+                LocalFree( pstrArgs );
+                return nResult;
+            }
+            if( 0 == _wcsicmp( pstrArgs[i], L"-loadbench" ) )
+            {
+                INT nResult = RunLoadBenchmark( nArgs - i - 1, pstrArgs + i + 1 );
+                LocalFree( pstrArgs );
+                return nResult;
+            }
+            if( 0 == _wcsicmp( pstrArgs[i], L"-terrainbench" ) )
+            {
+                INT nResult = RunTerrainBenchmark( nArgs - i - 1, pstrArgs + i + 1 );
+                LocalFree( pstrArgs );
+                return nResult;
+            }
+        }
+        LocalFree( pstrArgs );
+    }
+
     // DXUT will create and use the best device (either D3D9 or D3D10) 
     // that is available on the system depending on which D3D callbacks are set below
 
@@ -285,6 +330,8 @@ void InitApp()
     g_SampleUI.AddStatic( IDC_UPLOADTOVRAMFREQ_STATIC, str, 5, iY += 24, 150, 22 );
     g_SampleUI.AddSlider( IDC_UPLOADTOVRAMFREQ, 15, iY += 24, 135, 22, 1, 10, g_UploadToVRamEveryNthFrame );
 
+    g_SampleUI.AddCheckBox( IDC_UPLOADBUDGET, L"Budget uploads", 35, iY += 24, 125, 22, g_bUploadBudget );
+
     g_SampleUI.AddCheckBox( IDC_WIREFRAME, L"Wireframe", 35, iY += 24, 125, 22, g_bWireframe );
 
     g_SampleUI.AddButton( IDC_STARTOVER, L"Start Over", 35, iY += 24, 125, 22 );
@@ -347,17 +394,20 @@ void SmartLoadMesh( IDirect3DDevice9* pDev9, ID3D10Device* pDev10, LEVEL_ITEM* p
         }
         else if( LOAD_TYPE_MULTITHREAD == g_LoadType )
         {
+            // The requests go in the order the files are in the tile's chunk, so the IO
+            // thread can read them together
             BYTE* pData;
             UINT DataBytes;
+            LOAD_SOURCE Source;
 
-            if( !g_PackFile.GetPackedFile( pItem->szVBName, &pData, &DataBytes ) )
+            if( !g_PackFile.GetPackedFile( pItem->szVBName, &pData, &DataBytes, &Source ) )
                 return;
             CreateVertexBuffer9_Async( pDev9, &pItem->VB.pVB9, DataBytes, D3DUSAGE_WRITEONLY, 0, D3DPOOL_MANAGED,
-                                       pData, ( void* )g_pAsyncLoader );
-            if( !g_PackFile.GetPackedFile( pItem->szIBName, &pData, &DataBytes ) )
+                                       pData, &Source, ( void* )g_pAsyncLoader );
+            if( !g_PackFile.GetPackedFile( pItem->szIBName, &pData, &DataBytes, &Source ) )
                 return;
             CreateIndexBuffer9_Async( pDev9, &pItem->IB.pIB9, DataBytes, D3DUSAGE_WRITEONLY, D3DFMT_INDEX16,
-                                      D3DPOOL_MANAGED, pData, ( void* )g_pAsyncLoader );
+                                      D3DPOOL_MANAGED, pData, &Source, ( void* )g_pAsyncLoader );
             CreateTextureFromFile9_Async( pDev9, pItem->szDiffuseName, &pItem->Diffuse.pTexture9,
                                           ( void* )g_pAsyncLoader );
             CreateTextureFromFile9_Async( pDev9, pItem->szNormalName, &pItem->Normal.pTexture9,
@@ -395,10 +445,13 @@ void SmartLoadMesh( IDirect3DDevice9* pDev9, ID3D10Device* pDev10, LEVEL_ITEM* p
         }
         else if( LOAD_TYPE_MULTITHREAD == g_LoadType )
         {
+            // The requests go in the order the files are in the tile's chunk, so the IO
+            // thread can read them together
             BYTE* pData;
             UINT DataBytes;
+            LOAD_SOURCE Source;
 
-            if( !g_PackFile.GetPackedFile( pItem->szVBName, &pData, &DataBytes ) )
+            if( !g_PackFile.GetPackedFile( pItem->szVBName, &pData, &DataBytes, &Source ) )
                 return;
             D3D10_BUFFER_DESC bufferDesc;
             bufferDesc.ByteWidth = DataBytes;
@@ -406,16 +459,18 @@ void SmartLoadMesh( IDirect3DDevice9* pDev9, ID3D10Device* pDev10, LEVEL_ITEM* p
             bufferDesc.BindFlags = D3D10_BIND_VERTEX_BUFFER;
             bufferDesc.CPUAccessFlags = 0;
             bufferDesc.MiscFlags = 0;
-            CreateVertexBuffer10_Async( pDev10, &pItem->VB.pVB10, bufferDesc, pData, ( void* )g_pAsyncLoader );
+            CreateVertexBuffer10_Async( pDev10, &pItem->VB.pVB10, bufferDesc, pData, &Source,
+                                        ( void* )g_pAsyncLoader );
 
-            if( !g_PackFile.GetPackedFile( pItem->szIBName, &pData, &DataBytes ) )
+            if( !g_PackFile.GetPackedFile( pItem->szIBName, &pData, &DataBytes, &Source ) )
                 return;
             bufferDesc.ByteWidth = DataBytes;
             bufferDesc.Usage = D3D10_USAGE_DEFAULT;
             bufferDesc.BindFlags = D3D10_BIND_INDEX_BUFFER;
             bufferDesc.CPUAccessFlags = 0;
             bufferDesc.MiscFlags = 0;
-            CreateIndexBuffer10_Async( pDev10, &pItem->IB.pIB10, bufferDesc, pData, ( void* )g_pAsyncLoader );
+            CreateIndexBuffer10_Async( pDev10, &pItem->IB.pIB10, bufferDesc, pData, &Source,
+                                       ( void* )g_pAsyncLoader );
 
             CreateTextureFromFile10_Async( pDev10, pItem->szDiffuseName, &pItem->Diffuse.pRV10,
                                            ( void* )g_pAsyncLoader );
@@ -550,6 +605,30 @@ void LoadStartupResources( IDirect3DDevice9* pDev9, ID3D10Device* pDev10, double
         return;
     }
 
+    // Index the items for CalculateVisibleItems.  Every item is one tile of the terrain.
+    if( g_LevelItemArray.GetSize() > 0 )
+    {
+        UINT nItems = ( UINT )g_LevelItemArray.GetSize();
+        D3DXVECTOR3* pCenters = new D3DXVECTOR3[ nItems ];
+        if( !pCenters )
+        {
+            PostQuitMessage( 0 );
+            return;
+        }
+        for( UINT i = 0; i < nItems; i++ )
+            pCenters[i] = g_LevelItemArray.GetAt( i )->vCenter;
+
+        float fTileSize = g_PackFile.GetTileSideSize();
+        D3DXVECTOR3 vExtents( fTileSize / 2.0f, fHeightScale / 2.0f, fTileSize / 2.0f );
+        HRESULT hr = g_VisibilityGrid.Build( pCenters, sizeof( D3DXVECTOR3 ), nItems, vExtents, fTileSize * 4.0f );
+        SAFE_DELETE_ARRAY( pCenters );
+        if( FAILED( hr ) )
+        {
+            PostQuitMessage( 0 );
+            return;
+        }
+    }
+
 #if defined(_AMD64_)
     // We don't have a VS space limit on X64
     UINT maxChunks = (UINT)g_PackFile.GetNumChunks();
@@ -591,77 +670,43 @@ void LoadStartupResources( IDirect3DDevice9* pDev9, ID3D10Device* pDev10, double
 }
 
 //--------------------------------------------------------------------------------------
-// GetCameraCullPlanes
-//--------------------------------------------------------------------------------------
-void GetCameraCullPlanes( D3DXVECTOR3* p1Normal, D3DXVECTOR3* p2Normal, float* p1D, float* p2D )
-{
-    D3DXVECTOR3 vEye;
-    D3DXVECTOR3 vDir;
-    vEye = *g_Camera.GetEyePt();
-    vDir = *g_Camera.GetLookAtPt() - vEye;
-    D3DXVec3Normalize( &vDir, &vDir );
-
-    // setup clip planes
-    D3DXVECTOR3 vLeftNormal;
-    D3DXVECTOR3 vRightNormal;
-    D3DXMATRIX mRotLeft;
-    D3DXMATRIX mRotRight;
-    float fAngle = D3DX_PI / 2.0f + ( DEG2RAD(g_fFOV) / 2.0f ) * 1.3333f;
-    D3DXMatrixRotationY( &mRotLeft, -fAngle );
-    D3DXMatrixRotationY( &mRotRight, fAngle );
-    D3DXVec3TransformNormal( &vLeftNormal, &vDir, &mRotLeft );
-    D3DXVec3TransformNormal( &vRightNormal, &vDir, &mRotRight );
-    *p1D = D3DXVec3Dot( &vLeftNormal, &vEye );
-    *p2D = D3DXVec3Dot( &vRightNormal, &vEye );
-    *p1Normal = vLeftNormal;
-    *p2Normal = vRightNormal;
-}
-
-//--------------------------------------------------------------------------------------
-// Calculate our visible and potentially visible items
+// Calculate our visible and potentially visible items.  The grid reports which items
+// came into and went out of the loading radius since the last frame, so the loader only
+// looks at those.
 //--------------------------------------------------------------------------------------
 void CalculateVisibleItems( D3DXVECTOR3 vEye, float fVisRadius, float fLoadRadius )
 {
     g_VisibleItemArray.Reset();
-    g_LoadedItemArray.Reset();
-
-    // setup cull planes
-    D3DXVECTOR3 vLeftNormal;
-    D3DXVECTOR3 vRightNormal;
-    float leftD;
-    float rightD;
-    GetCameraCullPlanes( &vLeftNormal, &vRightNormal, &leftD, &rightD );
-    float fTileSize = g_PackFile.GetTileSideSize();
-
-    for( int i = 0; i < g_LevelItemArray.GetSize(); i++ )
-    {
-        LEVEL_ITEM* pItem = g_LevelItemArray.GetAt( i );
-
-        // Default is not in loading radius
-        pItem->bInLoadRadius = false;
-
-        D3DXVECTOR3 vDelta = vEye - pItem->vCenter;
-        float len2 = D3DXVec3LengthSq( &vDelta );
-        if( len2 < fVisRadius * fVisRadius )
-        {
-            pItem->bInFrustum = false;
-
-            if( len2 < fTileSize * fTileSize ||
-                ( D3DXVec3Dot( &pItem->vCenter, &vLeftNormal ) < leftD + fTileSize &&
-                  D3DXVec3Dot( &pItem->vCenter, &vRightNormal ) < rightD + fTileSize )
-                )
-            {
-                pItem->bInFrustum = true;
-            }
+    if( 0 == g_VisibilityGrid.GetItemCount() )
+        return;
 
-            g_VisibleItemArray.Add( pItem );
-        }
-        if( len2 < fLoadRadius * fLoadRadius )
-        {
-            pItem->bInLoadRadius = true;
-            g_LoadedItemArray.Add( pItem );
-        }
-    }
+    VIS_QUERY Query;
+    D3DXMATRIX mViewProj = *g_Camera.GetViewMatrix() * *g_Camera.GetProjMatrix();
+    CVisibilityGrid::GetFrustumPlanes( &mViewProj, Query.Planes );
+    Query.vEye = vEye;
+    Query.fVisibleRadius = fVisRadius;
+    Query.fLoadRadius = fLoadRadius;
+    Query.fNearRadius = g_PackFile.GetTileSideSize();
+
+    g_VisibilityGrid.Update( Query );
+
+    const CGrowableArray <UINT>& Visible = g_VisibilityGrid.GetSet( VIS_SET_VISIBLE );
+    for( int i = 0; i < Visible.GetSize(); i++ )
+        g_VisibleItemArray.Add( g_LevelItemArray.GetAt( Visible.GetAt( i ) ) );
+
+    const CGrowableArray <UINT>& EnteredView = g_VisibilityGrid.GetEntered( VIS_SET_VISIBLE );
+    for( int i = 0; i < EnteredView.GetSize(); i++ )
+        g_LevelItemArray.GetAt( EnteredView.GetAt( i ) )->bInFrustum = true;
+    const CGrowableArray <UINT>& LeftView = g_VisibilityGrid.GetLeft( VIS_SET_VISIBLE );
+    for( int i = 0; i < LeftView.GetSize(); i++ )
+        g_LevelItemArray.GetAt( LeftView.GetAt( i ) )->bInFrustum = false;
+
+    const CGrowableArray <UINT>& EnteredLoad = g_VisibilityGrid.GetEntered( VIS_SET_LOAD );
+    for( int i = 0; i < EnteredLoad.GetSize(); i++ )
+        g_LevelItemArray.GetAt( EnteredLoad.GetAt( i ) )->bInLoadRadius = true;
+    const CGrowableArray <UINT>& LeftLoad = g_VisibilityGrid.GetLeft( VIS_SET_LOAD );
+    for( int i = 0; i < LeftLoad.GetSize(); i++ )
+        g_LevelItemArray.GetAt( LeftLoad.GetAt( i ) )->bInLoadRadius = false;
 }
 
 //--------------------------------------------------------------------------------------
@@ -670,14 +715,16 @@ void CalculateVisibleItems( D3DXVECTOR3 vEye, float fVisRadius, float fLoadRadiu
 UINT EnsureResourcesLoaded( IDirect3DDevice9* pDev9, ID3D10Device* pDev10, float fVisRadius, float fLoadRadius )
 {
     UINT NumToLoad = 0;
-    for( int i = 0; i < g_LoadedItemArray.GetSize(); i++ )
+    const CGrowableArray <UINT>& Entered = g_VisibilityGrid.GetEntered( VIS_SET_LOAD );
+    for( int i = 0; i < Entered.GetSize(); i++ )
     {
-        LEVEL_ITEM* pItem = g_LoadedItemArray.GetAt( i );
+        LEVEL_ITEM* pItem = g_LevelItemArray.GetAt( Entered.GetAt( i ) );
 
         if( !pItem->bLoaded && !pItem->bLoading )
         {
             pItem->bLoading = true;
             NumToLoad ++;
+            g_LoadingItemArray.Add( pItem );
             SmartLoadMesh( pDev9, pDev10, pItem );
         }
     }
@@ -705,24 +752,33 @@ void FreeUpMeshResources( LEVEL_ITEM* pItem, IDirect3DDevice9* pDev9, ID3D10Devi
 }
 
 //--------------------------------------------------------------------------------------
-// Ensure resources that are unused are unloaded
+void UnloadItem( LEVEL_ITEM* pItem, IDirect3DDevice9* pDev9, ID3D10Device* pDev10 )
+{
+    // Unload the mesh textures from the texture cache
+    FreeUpMeshResources( pItem, pDev9, pDev10 );
+    pItem->bLoading = false;
+    pItem->bLoaded = false;
+    pItem->bHasBeenRenderedDiffuse = false;
+    pItem->bHasBeenRenderedNormal = false;
+}
+
+//--------------------------------------------------------------------------------------
+// Ensure resources that are unused are unloaded.  Items still loading when they leave
+// the loading radius are unloaded by CheckForLoadDone once they finish.
 //--------------------------------------------------------------------------------------
 UINT EnsureUnusedResourcesUnloaded( IDirect3DDevice9* pDev9, ID3D10Device* pDev10, double fTime )
 {
     UINT NumToUnload = 0;
 
-    for( int i = 0; i < g_LevelItemArray.GetSize(); i++ )
+    const CGrowableArray <UINT>& Left = g_VisibilityGrid.GetLeft( VIS_SET_LOAD );
+    for( int i = 0; i < Left.GetSize(); i++ )
     {
-        LEVEL_ITEM* pItem = g_LevelItemArray.GetAt( i );
+        LEVEL_ITEM* pItem = g_LevelItemArray.GetAt( Left.GetAt( i ) );
 
         if( pItem->bLoaded && !pItem->bInLoadRadius )
         {
-            // Unload the mesh textures from the texture cache
-            FreeUpMeshResources( pItem, pDev9, pDev10 );
-            pItem->bLoading = false;
-            pItem->bLoaded = false;
-            pItem->bHasBeenRenderedDiffuse = false;
-            pItem->bHasBeenRenderedNormal = false;
+            UnloadItem( pItem, pDev9, pDev10 );
+            NumToUnload ++;
         }
     }
 
@@ -735,45 +791,29 @@ UINT EnsureUnusedResourcesUnloaded( IDirect3DDevice9* pDev9, ID3D10Device* pDev1
 //--------------------------------------------------------------------------------------
 void CheckForLoadDone( IDirect3DDevice9* pDev9, ID3D10Device* pDev10 )
 {
-    if( pDev9 )
+    for( int i = g_LoadingItemArray.GetSize() - 1; i >= 0; i-- )
     {
-        for( int i = 0; i < g_LevelItemArray.GetSize(); i++ )
-        {
-            LEVEL_ITEM* pItem = g_LevelItemArray.GetAt( i );
+        LEVEL_ITEM* pItem = g_LoadingItemArray.GetAt( i );
 
-            if( pItem->bLoading )
-            {
-                if( pItem->VB.pVB9 &&
-                    pItem->IB.pIB9 )
-                {
-                    pItem->bLoading = false;
-                    pItem->bLoaded = true;
+        bool bDone = false;
+        if( pDev9 )
+            bDone = pItem->VB.pVB9 && pItem->IB.pIB9;
+        else if( pDev10 )
+            bDone = pItem->VB.pVB10 && pItem->IB.pIB10;
+        if( !bDone )
+            continue;
 
-                    pItem->CurrentCountdownDiff = 5;
-                    pItem->CurrentCountdownNorm = 10;
-                }
-            }
-        }
-    }
-    else if( pDev10 )
-    {
-        for( int i = 0; i < g_LevelItemArray.GetSize(); i++ )
-        {
-            LEVEL_ITEM* pItem = g_LevelItemArray.GetAt( i );
+        pItem->bLoading = false;
+        pItem->bLoaded = true;
 
-            if( pItem->bLoading )
-            {
-                if( pItem->VB.pVB10 &&
-                    pItem->IB.pIB10 )
-                {
-                    pItem->bLoading = false;
-                    pItem->bLoaded = true;
+        pItem->CurrentCountdownDiff = 5;
+        pItem->CurrentCountdownNorm = 10;
 
-                    pItem->CurrentCountdownDiff = 5;
-                    pItem->CurrentCountdownNorm = 10;
-                }
-            }
-        }
+        // It may have left the loading radius while it was loading
+        if( !pItem->bInLoadRadius && !g_bUseWDDMPaging )
+            UnloadItem( pItem, pDev9, pDev10 );
+
+        g_LoadingItemArray.Remove( i );
     }
 }
 
@@ -795,6 +835,22 @@ void RenderText()
     g_pTxtHelper->DrawTextLine( str );
     swprintf_s( str, MAX_PATH, L"Models in Use: %d", g_NumModelsInUse );
     g_pTxtHelper->DrawTextLine( str );
+    if( g_pAsyncLoader && g_pAsyncLoader->IsUploadBudgetEnabled() )
+    {
+        CUploadScheduler* pScheduler = g_pAsyncLoader->GetUploadScheduler();
+        swprintf_s( str, MAX_PATH, L"Upload budget: %.02f ms, used %.02f ms, %d items, %d KB", pScheduler->GetBudgetMs(),
+                    pScheduler->GetSpentMs(), pScheduler->GetItemsThisFrame(),
+                    ( int )( pScheduler->GetBytesThisFrame() / 1024 ) );
+        g_pTxtHelper->DrawTextLine( str );
+    }
+    if( g_pAsyncLoader )
+    {
+        const CLoadCoalescer* pCoalescer = g_pAsyncLoader->GetCoalescer();
+        swprintf_s( str, MAX_PATH, L"Load requests: %.1f%% shared, %.2f files per read, %d in flight",
+                    pCoalescer->GetDedupRatio() * 100.0f, pCoalescer->GetMergeRatio(),
+                    pCoalescer->GetNumInFlight() );
+        g_pTxtHelper->DrawTextLine( str );
+    }
     g_pTxtHelper->DrawTextLine( L"" );
     if( g_pResourceReuseCache )
     {
@@ -938,6 +994,7 @@ HRESULT CALLBACK OnD3D10CreateDevice( ID3D10Device* pd3dDevice, const DXGI_SURFA
     g_pAsyncLoader = new CAsyncLoader( g_NumProcessingThreads );
     if( !g_pAsyncLoader )
         return E_OUTOFMEMORY;
+    g_pAsyncLoader->EnableUploadBudget( g_bUploadBudget );
 
     // Create the texture reuse cache
     g_pResourceReuseCache = new CResourceReuseCache( pd3dDevice );
@@ -1364,7 +1421,8 @@ void DestroyAllMeshes( LOADER_DEVICE_TYPE ldt )
     }
     g_LevelItemArray.RemoveAll();
     g_VisibleItemArray.RemoveAll();
-    g_LoadedItemArray.RemoveAll();
+    g_LoadingItemArray.RemoveAll();
+    g_VisibilityGrid.Destroy();
 }
 
 //--------------------------------------------------------------------------------------
@@ -1440,6 +1498,13 @@ void CALLBACK OnGUIEvent( UINT nEvent, int nControlID, CDXUTControl* pControl, v
             g_SampleUI.GetStatic( IDC_UPLOADTOVRAMFREQ_STATIC )->SetText( str );
             break;
         }
+        case IDC_UPLOADBUDGET:
+        {
+            g_bUploadBudget = !g_bUploadBudget;
+            if( g_pAsyncLoader )
+                g_pAsyncLoader->EnableUploadBudget( g_bUploadBudget );
+            break;
+        }
         case IDC_WIREFRAME:
         {
             g_bWireframe = !g_bWireframe;
@@ -1607,7 +1672,8 @@ void	CALLBACK CreateTextureFromFile10_Async( ID3D10Device* pDev, WCHAR* szFileNa
         CTextureLoader* pLoader = new CTextureLoader( szFileName, &g_PackFile );
         CTextureProcessor* pProcessor = new CTextureProcessor( pDev, ppRV, g_pResourceReuseCache, g_SkipMips );
 
-        pAsyncLoader->AddWorkItem( pLoader, pProcessor, NULL, ( void** )ppRV );
+        pAsyncLoader->AddWorkItem( pLoader, pProcessor, NULL, ( void** )ppRV,
+                                   CLoadCoalescer::MakeKey( szFileName, g_SkipMips ) );
     }
 }
 
@@ -1615,12 +1681,12 @@ void	CALLBACK CreateTextureFromFile10_Async( ID3D10Device* pDev, WCHAR* szFileNa
 // Async create buffer
 //--------------------------------------------------------------------------------------
 void	CALLBACK CreateVertexBuffer10_Async( ID3D10Device* pDev, ID3D10Buffer** ppBuffer, D3D10_BUFFER_DESC BufferDesc,
-                                             void* pData, void* pContext )
+                                             void* pData, const LOAD_SOURCE* pSource, void* pContext )
 {
     CAsyncLoader* pAsyncLoader = ( CAsyncLoader* )pContext;
     if( pAsyncLoader )
     {
-        CVertexBufferLoader* pLoader = new CVertexBufferLoader();
+        CVertexBufferLoader* pLoader = new CVertexBufferLoader( pSource );
         CVertexBufferProcessor* pProcessor = new CVertexBufferProcessor( pDev, ppBuffer, &BufferDesc, pData,
                                                                          g_pResourceReuseCache );
 
@@ -1632,12 +1698,12 @@ void	CALLBACK CreateVertexBuffer10_Async( ID3D10Device* pDev, ID3D10Buffer** ppB
 // Async create buffer
 //--------------------------------------------------------------------------------------
 void	CALLBACK CreateIndexBuffer10_Async( ID3D10Device* pDev, ID3D10Buffer** ppBuffer, D3D10_BUFFER_DESC BufferDesc,
-                                            void* pData, void* pContext )
+                                            void* pData, const LOAD_SOURCE* pSource, void* pContext )
 {
     CAsyncLoader* pAsyncLoader = ( CAsyncLoader* )pContext;
     if( pAsyncLoader )
     {
-        CIndexBufferLoader* pLoader = new CIndexBufferLoader();
+        CIndexBufferLoader* pLoader = new CIndexBufferLoader( pSource );
         CIndexBufferProcessor* pProcessor = new CIndexBufferProcessor( pDev, ppBuffer, &BufferDesc, pData,
                                                                        g_pResourceReuseCache );
 
@@ -1655,3 +1721,846 @@ void ClearD3D10State()
     OnD3D10CreateDevice( pd3dDevice, DXUTGetDXGIBackBufferSurfaceDesc(), NULL );
     OnD3D10ResizedSwapChain( pd3dDevice, DXUTGetDXGISwapChain(), DXUTGetDXGIBackBufferSurfaceDesc(), NULL );
 }
+
+
+//--------------------------------------------------------------------------------------
+// Headless benchmark of the visibility queries:
+//
+//   ContentStreaming -visbench [-frames N] [-noverify]
+//
+// Builds synthetic worlds of 128x128 up to 1024x1024 tiles and flies a camera around
+// each, timing CVisibilityGrid::Update against a loop over every LEVEL_ITEM applying the
+// same test.  The loop is only run on the smaller worlds, as it needs a LEVEL_ITEM per
+// tile.  Unless -noverify is given, the entered and left lists are applied to a copy of
+// the sets every frame, and every few frames that copy and the grid's sets are checked
+// against ClassifyItem run on every item.
+// Returns 0 on success, 1 if a check failed.
+//--------------------------------------------------------------------------------------
+INT RunVisibilityBenchmark( int nArgs, LPWSTR* pstrArgs )
+{
+    // Report to the console we were started from, if any
+    if( AttachConsole( ATTACH_PARENT_PROCESS ) )
+    {
+        FILE* pFile;
+        freopen_s( &pFile, "CONOUT$", "w", stdout );
+    }
+
+    UINT nFrames = 1000;
+    bool bVerify = true;
+    for( int i = 0; i < nArgs; i++ )
+    {
+        if( 0 == _wcsicmp( pstrArgs[i], L"-frames" ) && i + 1 < nArgs )
+        {
+            int nValue = _wtoi( pstrArgs[++i] );
+            nFrames = nValue > 0 ? nValue : 1;
+        }
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-noverify" ) )
+            bVerify = false;
+    }
+
+    // Same tile size and height range as the sample's world
+    const float fTileSize = 6667.0f / 20.0f;
+    const float fHeightScale = 300.0f;
+    const float fLoadRadius = fTileSize * 12.0f;
+    const D3DXVECTOR3 vExtents( fTileSize / 2.0f, fHeightScale / 2.0f, fTileSize / 2.0f );
+    const UINT nMaxLinearItems = 256 * 256;
+    const float fPathRadius = fTileSize * 40.0f;
+
+    LARGE_INTEGER qwFreq, qwStart, qwEnd;
+    QueryPerformanceFrequency( &qwFreq );
+
+    INT nResult = 0;
+    wprintf( L"%10s %10s %10s %8s %8s %8s %8s %8s\n", L"tiles", L"loop ms", L"grid ms", L"speedup",
+             L"tested", L"visible", L"loaded", L"changed" );
+
+    for( UINT nSide = 128; nSide <= 1024; nSide *= 2 )
+    {
+        const UINT nItems = nSide * nSide;
+        const float fWorldSize = nSide * fTileSize;
+
+        D3DXVECTOR3* pCenters = new D3DXVECTOR3[ nItems ];
+        BYTE* pMember = new BYTE[ nItems ];
+        if( !pCenters || !pMember )
+        {
+            SAFE_DELETE_ARRAY( pCenters );
+            SAFE_DELETE_ARRAY( pMember );
+            wprintf( L"Out of memory\n" );
+            return 1;
+        }
+        ZeroMemory( pMember, nItems );
+
+        srand( 100 );
+        for( UINT i = 0; i < nItems; i++ )
+        {
+            pCenters[i].x = ( ( i % nSide ) + 0.5f ) * fTileSize;
+            pCenters[i].y = ( rand() / ( float )RAND_MAX ) * fHeightScale;
+            pCenters[i].z = ( ( i / nSide ) + 0.5f ) * fTileSize;
+        }
+
+        CVisibilityGrid Grid;
+        if( FAILED( Grid.Build( pCenters, sizeof( D3DXVECTOR3 ), nItems, vExtents, fTileSize * 4.0f ) ) )
+        {
+            SAFE_DELETE_ARRAY( pCenters );
+            SAFE_DELETE_ARRAY( pMember );
+            wprintf( L"Could not build the grid for %u tiles\n", nItems );
+            return 1;
+        }
+
+        // The same camera path is used for both loops.  The camera circles the middle of
+        // the world looking from side to side, covering the same ground whatever the size
+        // of the world.
+        D3DXMATRIX mProj;
+        D3DXMatrixPerspectiveFovLH( &mProj, DEG2RAD( 70.0f ), 4.0f / 3.0f, 0.5f, fLoadRadius );
+
+        VIS_QUERY* pQueries = new VIS_QUERY[ nFrames ];
+        for( UINT nFrame = 0; nFrame < nFrames; nFrame++ )
+        {
+            float fAngle = nFrame * 2.0f * D3DX_PI / nFrames;
+            float fYaw = fAngle + D3DX_PI / 2.0f + sinf( nFrame * 0.05f ) * D3DX_PI / 4.0f;
+            D3DXVECTOR3 vEye( fWorldSize * 0.5f + fPathRadius * cosf( fAngle ), fHeightScale,
+                              fWorldSize * 0.5f + fPathRadius * sinf( fAngle ) );
+            D3DXVECTOR3 vAt = vEye + D3DXVECTOR3( cosf( fYaw ), -0.1f, sinf( fYaw ) );
+            D3DXVECTOR3 vUp( 0, 1, 0 );
+            D3DXMATRIX mView;
+            D3DXMatrixLookAtLH( &mView, &vEye, &vAt, &vUp );
+            D3DXMATRIX mViewProj = mView * mProj;
+
+            VIS_QUERY& Query = pQueries[nFrame];
+            CVisibilityGrid::GetFrustumPlanes( &mViewProj, Query.Planes );
+            Query.vEye = vEye;
+            Query.fVisibleRadius = fLoadRadius;
+            Query.fLoadRadius = fLoadRadius;
+            Query.fNearRadius = fTileSize;
+        }
+
+        // Loop over every item, as CalculateVisibleItems used to
+        double fLoopMs = 0.0;
+        if( nItems <= nMaxLinearItems )
+        {
+            CGrowableArray <LEVEL_ITEM*> ItemArray;
+            for( UINT i = 0; i < nItems; i++ )
+            {
+                LEVEL_ITEM* pItem = new LEVEL_ITEM;
+                ZeroMemory( pItem, sizeof( LEVEL_ITEM ) );
+                pItem->vCenter = pCenters[i];
+                ItemArray.Add( pItem );
+            }
+
+            CGrowableArray <LEVEL_ITEM*> VisibleArray;
+            CGrowableArray <LEVEL_ITEM*> LoadedArray;
+            QueryPerformanceCounter( &qwStart );
+            for( UINT nFrame = 0; nFrame < nFrames; nFrame++ )
+            {
+                VisibleArray.Reset();
+                LoadedArray.Reset();
+                for( int i = 0; i < ItemArray.GetSize(); i++ )
+                {
+                    LEVEL_ITEM* pItem = ItemArray.GetAt( i );
+                    DWORD dwSets = CVisibilityGrid::ClassifyItem( pQueries[nFrame], pItem->vCenter, vExtents );
+                    pItem->bInFrustum = ( dwSets & ( 1 << VIS_SET_VISIBLE ) ) != 0;
+                    pItem->bInLoadRadius = ( dwSets & ( 1 << VIS_SET_LOAD ) ) != 0;
+                    if( pItem->bInFrustum )
+                        VisibleArray.Add( pItem );
+                    if( pItem->bInLoadRadius )
+                        LoadedArray.Add( pItem );
+                }
+            }
+            QueryPerformanceCounter( &qwEnd );
+            fLoopMs = 1000.0 * ( qwEnd.QuadPart - qwStart.QuadPart ) / qwFreq.QuadPart / nFrames;
+
+            for( int i = 0; i < ItemArray.GetSize(); i++ )
+            {
+                LEVEL_ITEM* pItem = ItemArray.GetAt( i );
+                SAFE_DELETE( pItem );
+            }
+        }
+
+        // The grid.  Only Update is timed.
+        const UINT nVerifyEvery = nItems <= nMaxLinearItems ? 1 : 16;
+        LONGLONG llGridTime = 0;
+        UINT64 nTested = 0, nVisible = 0, nLoaded = 0, nChanged = 0;
+        UINT nErrors = 0;
+        for( UINT nFrame = 0; nFrame < nFrames; nFrame++ )
+        {
+            const VIS_QUERY& Query = pQueries[nFrame];
+
+            QueryPerformanceCounter( &qwStart );
+            Grid.Update( Query );
+            QueryPerformanceCounter( &qwEnd );
+            llGridTime += qwEnd.QuadPart - qwStart.QuadPart;
+
+            nTested += Grid.GetItemsTested();
+            nVisible += Grid.GetSet( VIS_SET_VISIBLE ).GetSize();
+            nLoaded += Grid.GetSet( VIS_SET_LOAD ).GetSize();
+
+            if( !bVerify )
+                continue;
+
+            // Apply this frame's changes to the copy of the sets
+            for( UINT iSet = 0; iSet < VIS_NUM_SETS; iSet++ )
+            {
+                const CGrowableArray <UINT>& Left = Grid.GetLeft( iSet );
+                for( int i = 0; i < Left.GetSize(); i++ )
+                {
+                    if( !( pMember[ Left.GetAt( i ) ] & ( 1 << iSet ) ) )
+                        nErrors++;
+                    pMember[ Left.GetAt( i ) ] &= ~( 1 << iSet );
+                }
+                const CGrowableArray <UINT>& Entered = Grid.GetEntered( iSet );
+                for( int i = 0; i < Entered.GetSize(); i++ )
+                {
+                    if( pMember[ Entered.GetAt( i ) ] & ( 1 << iSet ) )
+                        nErrors++;
+                    pMember[ Entered.GetAt( i ) ] |= 1 << iSet;
+                }
+                nChanged += Left.GetSize() + Entered.GetSize();
+            }
+
+            if( nFrame % nVerifyEvery != 0 && nFrame != nFrames - 1 )
+                continue;
+
+            UINT nCount[VIS_NUM_SETS] = { 0 };
+            for( UINT i = 0; i < nItems; i++ )
+            {
+                DWORD dwSets = CVisibilityGrid::ClassifyItem( Query, pCenters[i], vExtents );
+                for( UINT iSet = 0; iSet < VIS_NUM_SETS; iSet++ )
+                {
+                    bool bIn = ( dwSets & ( 1 << iSet ) ) != 0;
+                    if( bIn != Grid.IsInSet( i, iSet ) || bIn != ( ( pMember[i] & ( 1 << iSet ) ) != 0 ) )
+                        nErrors++;
+                    if( bIn )
+                        nCount[iSet]++;
+                }
+            }
+            for( UINT iSet = 0; iSet < VIS_NUM_SETS; iSet++ )
+            {
+                if( nCount[iSet] != ( UINT )Grid.GetSet( iSet ).GetSize() )
+                    nErrors++;
+            }
+        }
+        double fGridMs = 1000.0 * llGridTime / qwFreq.QuadPart / nFrames;
+
+        if( fLoopMs > 0.0 )
+            wprintf( L"%10u %10.3f %10.3f %7.1fx", nItems, fLoopMs, fGridMs, fLoopMs / fGridMs );
+        else
+            wprintf( L"%10u %10s %10.3f %8s", nItems, L"-", fGridMs, L"-" );
+        wprintf( L" %8u %8u %8u %8u\n", ( UINT )( nTested / nFrames ), ( UINT )( nVisible / nFrames ),
+                 ( UINT )( nLoaded / nFrames ), ( UINT )( nChanged / nFrames ) );
+
+        if( nErrors )
+        {
+            wprintf( L"  %u mismatches against ClassifyItem\n", nErrors );
+            nResult = 1;
+        }
+
+        SAFE_DELETE_ARRAY( pQueries );
+        SAFE_DELETE_ARRAY( pCenters );
+        SAFE_DELETE_ARRAY( pMember );
+    }
+
+    return nResult;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Headless run of the upload budget against a simulated device:
+//
+//   ContentStreaming -uploadbench [-frames N] [-items N] [-interval N] [-target ms]
+//                                 [-maxbudget ms] [-maxkb N] [-seed N]
+//
+// Bursts of -items requests arrive every -interval frames.  The same workload is run
+// servicing a fixed number of requests a frame, as the "Create up to N Items Per-Frame"
+// slider does, and then with CUploadScheduler.  Prints the frame times, how many frames
+// went over -target, and how long requests waited.
+// Returns 0.
+//--------------------------------------------------------------------------------------
+INT RunUploadBenchmark( int nArgs, LPWSTR* pstrArgs )
+{
+    // Report to the console we were started from, if any
+    if( AttachConsole( ATTACH_PARENT_PROCESS ) )
+    {
+        FILE* pFile;
+        freopen_s( &pFile, "CONOUT$", "w", stdout );
+    }
+
+    UPLOAD_SIM_WORKLOAD Workload;
+    GetDefaultUploadWorkload( &Workload );
+    UPLOAD_BUDGET_SETTINGS Settings;
+    CUploadScheduler::GetDefaultSettings( &Settings );
+
+    for( int i = 0; i + 1 < nArgs; i++ )
+    {
+        LPCWSTR strArg = pstrArgs[i];
+        LPCWSTR strValue = pstrArgs[i + 1];
+        int nValue = _wtoi( strValue );
+        if( 0 == _wcsicmp( strArg, L"-frames" ) )
+            Workload.nFrames = nValue > 0 ? nValue : 1;
+        else if( 0 == _wcsicmp( strArg, L"-items" ) )
+            Workload.nItemsPerBurst = nValue > 0 ? nValue : 0;
+        else if( 0 == _wcsicmp( strArg, L"-interval" ) )
+            Workload.nBurstInterval = nValue > 0 ? nValue : 1;
+        else if( 0 == _wcsicmp( strArg, L"-target" ) )
+            Settings.fTargetFrameMs = ( float )_wtof( strValue );
+        else if( 0 == _wcsicmp( strArg, L"-maxbudget" ) )
+            Settings.fMaxBudgetMs = ( float )_wtof( strValue );
+        else if( 0 == _wcsicmp( strArg, L"-maxkb" ) )
+            Settings.cMaxBytesPerFrame = ( SIZE_T )( nValue > 0 ? nValue : 0 ) * 1024;
+        else if( 0 == _wcsicmp( strArg, L"-seed" ) )
+            Workload.nSeed = ( UINT )nValue;
+        else
+            continue;
+        i++;
+    }
+
+    wprintf( L"%u frames, %u requests every %u frames, %.1f ms target\n", Workload.nFrames,
+             Workload.nItemsPerBurst, Workload.nBurstInterval, Settings.fTargetFrameMs );
+    wprintf( L"%-12s %8s %8s %8s %6s %8s %6s %10s %8s\n", L"policy", L"mean ms", L"p99 ms", L"max ms",
+             L"late", L"MB", L"left", L"wait", L"budget" );
+
+    const UINT anItemCounts[] = { 1, 5, 30 };
+    for( UINT i = 0; i <= ARRAYSIZE( anItemCounts ); i++ )
+    {
+        bool bBudget = ( i == ARRAYSIZE( anItemCounts ) );
+        UPLOAD_SIM_RESULT Result;
+        RunUploadSimulation( Workload, bBudget ? &Settings : NULL, bBudget ? UINT_MAX : anItemCounts[i],
+                             Settings.fTargetFrameMs, &Result );
+
+        WCHAR strPolicy[32];
+        if( bBudget )
+            wcscpy_s( strPolicy, 32, L"budget" );
+        else
+            swprintf_s( strPolicy, 32, L"%u/frame", anItemCounts[i] );
+        wprintf( L"%-12s %8.2f %8.2f %8.2f %6u %8.1f %6u %10.1f %8.2f\n", strPolicy, Result.fMeanFrameMs,
+                 Result.fP99FrameMs, Result.fMaxFrameMs, Result.nFramesOverTarget, Result.fMBUploaded,
+                 Result.nItemsLeft, Result.fMeanLatencyFrames, Result.fFinalBudgetMs );
+    }
+
+    return 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Headless replay of the load requests made walking through a generated world:
+//
+//   ContentStreaming -loadbench [-frames N] [-side N] [-latency N] [-seed N]
+//
+// Each tile's vertex and index buffers are next to each other in the tile's chunk, as
+// CreatePackedFile lays them out.  The textures are either the tile's own, following the
+// buffers in its chunk as in the sample's packed file, or picked from a palette of
+// diffuse and normal map pairs, each pair in a chunk of its own.  The camera circles the
+// world, and each tile that comes into the loading radius asks for its four resources
+// in the order SmartLoadMesh does.  Textures finish -latency frames after they are asked
+// for.  Each frame the reads asked for are replayed through the coalescer as the IO
+// thread does, looking the same distance down the queue.
+// Returns 0 on success, 1 if a request did not end up with its texture.
+//--------------------------------------------------------------------------------------
+INT RunLoadBenchmark( int nArgs, LPWSTR* pstrArgs )
+{
+    // Report to the console we were started from, if any
+    if( AttachConsole( ATTACH_PARENT_PROCESS ) )
+    {
+        FILE* pFile;
+        freopen_s( &pFile, "CONOUT$", "w", stdout );
+    }
+
+    UINT nFrames = 2000;
+    UINT nSide = 64;
+    UINT nLatency = 8;
+    UINT nSeed = 100;
+    for( int i = 0; i + 1 < nArgs; i++ )
+    {
+        LPCWSTR strArg = pstrArgs[i];
+        int nValue = _wtoi( pstrArgs[i + 1] );
+        if( 0 == _wcsicmp( strArg, L"-frames" ) )
+            nFrames = nValue > 0 ? nValue : 1;
+        else if( 0 == _wcsicmp( strArg, L"-side" ) )
+            nSide = nValue > 8 ? nValue : 8;
+        else if( 0 == _wcsicmp( strArg, L"-latency" ) )
+            nLatency = nValue > 0 ? nValue : 0;
+        else if( 0 == _wcsicmp( strArg, L"-seed" ) )
+            nSeed = ( UINT )nValue;
+        else
+            continue;
+        i++;
+    }
+
+    // Same tile size, loading radius and resource sizes as the sample's world
+    const float fTileSize = 6667.0f / 20.0f;
+    const float fHeightScale = 300.0f;
+    const float fLoadRadius = fTileSize * 6.0f;
+    const D3DXVECTOR3 vExtents( fTileSize / 2.0f, fHeightScale / 2.0f, fTileSize / 2.0f );
+    const UINT nItems = nSide * nSide;
+    const float fWorldSize = nSide * fTileSize;
+    const float fPathRadius = fWorldSize * 0.3f;
+    const UINT64 cVBBytes = 65 * 65 * sizeof( BOX_VERTEX );
+    const UINT64 cIBBytes = 64 * 64 * 6 * sizeof( WORD );
+    const UINT64 cTextureBytes = sizeof( DWORD ) + sizeof( DDS_HEADER ) + ( 2048 * 2048 / 2 ) * 4 / 3;
+
+    D3DXVECTOR3* pCenters = new D3DXVECTOR3[ nItems ];
+    UINT* pPaletteEntry = new UINT[ nItems ];
+    void** ppTextures = new void*[ nItems * 2 ];
+    UINT64* pTextureKeys = new UINT64[ nItems * 2 ];
+    if( !pCenters || !pPaletteEntry || !ppTextures || !pTextureKeys )
+    {
+        SAFE_DELETE_ARRAY( pCenters );
+        SAFE_DELETE_ARRAY( pPaletteEntry );
+        SAFE_DELETE_ARRAY( ppTextures );
+        SAFE_DELETE_ARRAY( pTextureKeys );
+        wprintf( L"Out of memory\n" );
+        return 1;
+    }
+
+    srand( nSeed );
+    for( UINT i = 0; i < nItems; i++ )
+    {
+        pCenters[i].x = ( ( i % nSide ) + 0.5f ) * fTileSize;
+        pCenters[i].y = ( rand() / ( float )RAND_MAX ) * fHeightScale;
+        pCenters[i].z = ( ( i / nSide ) + 0.5f ) * fTileSize;
+        pPaletteEntry[i] = ( UINT )rand();
+    }
+
+    D3DXMATRIX mProj;
+    D3DXMatrixPerspectiveFovLH( &mProj, DEG2RAD( 70.0f ), 4.0f / 3.0f, 0.5f, fLoadRadius );
+
+    LARGE_INTEGER qwFreq, qwStart, qwEnd;
+    QueryPerformanceFrequency( &qwFreq );
+
+    wprintf( L"%u tiles, %u frames, textures done after %u frames\n", nItems, nFrames, nLatency );
+    wprintf( L"%-10s %9s %9s %8s %9s %9s %8s %10s %10s %8s\n", L"textures", L"requests", L"loads", L"shared",
+             L"files", L"reads", L"per read", L"MB asked", L"MB read", L"us/req" );
+
+    INT nResult = 0;
+    const UINT anPaletteSizes[] = { 0, 256, 64, 16 };
+    for( UINT iPalette = 0; iPalette < ARRAYSIZE( anPaletteSizes ); iPalette++ )
+    {
+        const UINT nPalette = anPaletteSizes[iPalette];
+
+        CVisibilityGrid Grid;
+        if( FAILED( Grid.Build( pCenters, sizeof( D3DXVECTOR3 ), nItems, vExtents, fTileSize * 4.0f ) ) )
+        {
+            wprintf( L"Could not build the grid for %u tiles\n", nItems );
+            nResult = 1;
+            break;
+        }
+
+        // Instead of a device object, a finished request is given its key
+        CLoadCoalescer Coalescer;
+        CGrowableArray <LOAD_SOURCE> Reads;
+        CGrowableArray <LOAD_IN_FLIGHT> Pending;
+        CGrowableArray <UINT> PendingFrames;
+        CGrowableArray <LOAD_WAITER> Waiters;
+        UINT64 nRequests = 0;
+        LONGLONG llTime = 0;
+        ZeroMemory( ppTextures, sizeof( void* ) * nItems * 2 );
+        ZeroMemory( pTextureKeys, sizeof( UINT64 ) * nItems * 2 );
+
+        for( UINT nFrame = 0; nFrame <= nFrames + nLatency; nFrame++ )
+        {
+            // Walk until the last frame, then let the requests finish
+            Reads.Reset();
+            if( nFrame < nFrames )
+            {
+                float fAngle = nFrame * 2.0f * D3DX_PI / nFrames;
+                D3DXVECTOR3 vEye( fWorldSize * 0.5f + fPathRadius * cosf( fAngle ), fHeightScale,
+                                  fWorldSize * 0.5f + fPathRadius * sinf( fAngle ) );
+                D3DXVECTOR3 vAt = vEye + D3DXVECTOR3( -sinf( fAngle ), -0.1f, cosf( fAngle ) );
+                D3DXVECTOR3 vUp( 0, 1, 0 );
+                D3DXMATRIX mView;
+                D3DXMatrixLookAtLH( &mView, &vEye, &vAt, &vUp );
+                D3DXMATRIX mViewProj = mView * mProj;
+
+                VIS_QUERY Query;
+                CVisibilityGrid::GetFrustumPlanes( &mViewProj, Query.Planes );
+                Query.vEye = vEye;
+                Query.fVisibleRadius = fLoadRadius;
+                Query.fLoadRadius = fLoadRadius;
+                Query.fNearRadius = fTileSize;
+                Grid.Update( Query );
+
+                const CGrowableArray <UINT>& Entered = Grid.GetEntered( VIS_SET_LOAD );
+                for( int i = 0; i < Entered.GetSize(); i++ )
+                {
+                    UINT iTile = Entered.GetAt( i );
+
+                    // Where the tile's files are
+                    LOAD_SOURCE Sources[4];
+                    WCHAR szNames[2][MAX_PATH];
+                    for( UINT iFile = 0; iFile < 4; iFile++ )
+                    {
+                        Sources[iFile].pPackedFile = NULL;
+                        Sources[iFile].Chunk = iTile;
+                        Sources[iFile].cBytes = iFile < 2 ? ( iFile ? cIBBytes : cVBBytes ) : cTextureBytes;
+                        Sources[iFile].Offset = iFile ? Sources[iFile - 1].Offset + Sources[iFile - 1].cBytes : 0;
+                    }
+                    if( nPalette )
+                    {
+                        UINT iEntry = pPaletteEntry[iTile] % nPalette;
+                        Sources[2].Chunk = Sources[3].Chunk = nItems + iEntry;
+                        Sources[2].Offset = 0;
+                        Sources[3].Offset = cTextureBytes;
+                        swprintf_s( szNames[0], MAX_PATH, L"paletteDiff%d", iEntry );
+                        swprintf_s( szNames[1], MAX_PATH, L"paletteNorm%d", iEntry );
+                    }
+                    else
+                    {
+                        swprintf_s( szNames[0], MAX_PATH, L"terrainDiff%d_%d", iTile % nSide, iTile / nSide );
+                        swprintf_s( szNames[1], MAX_PATH, L"terrainNorm%d_%d", iTile % nSide, iTile / nSide );
+                    }
+
+                    // The buffers are never shared, the textures are
+                    QueryPerformanceCounter( &qwStart );
+                    Reads.Add( Sources[0] );
+                    Reads.Add( Sources[1] );
+                    for( UINT iTex = 0; iTex < 2; iTex++ )
+                    {
+                        LOAD_IN_FLIGHT Request;
+                        Request.Key = CLoadCoalescer::MakeKey( szNames[iTex], 0 );
+                        Request.ppDeviceObject = &ppTextures[iTile * 2 + iTex];
+                        Request.nWaiters = 0;
+                        pTextureKeys[iTile * 2 + iTex] = Request.Key;
+                        if( Coalescer.AddRequest( Request.Key, Request.ppDeviceObject, NULL ) )
+                        {
+                            Reads.Add( Sources[2 + iTex] );
+                            Pending.Add( Request );
+                            PendingFrames.Add( nFrame + nLatency );
+                        }
+                    }
+                    QueryPerformanceCounter( &qwEnd );
+                    llTime += qwEnd.QuadPart - qwStart.QuadPart;
+                    nRequests += 4;
+                }
+            }
+
+            // The IO thread's side
+            QueryPerformanceCounter( &qwStart );
+            for( int i = 0; i < Reads.GetSize(); i++ )
+            {
+                UINT nQueued = __min( ( UINT )( Reads.GetSize() - i - 1 ), ( UINT )LOAD_MERGE_LOOKAHEAD );
+                LOAD_SOURCE Read;
+                Coalescer.BeginRead( Reads[i], Reads.GetData() + i + 1, nQueued, &Read );
+            }
+
+            // Finish the textures that are done.  They were added in order of the frame
+            // they finish on.
+            while( PendingFrames.GetSize() > 0 && PendingFrames[0] <= nFrame )
+            {
+                const LOAD_IN_FLIGHT& Request = Pending[0];
+                *Request.ppDeviceObject = ( void* )( UINT_PTR )Request.Key;
+                Coalescer.CompleteRequest( Request.Key, &Waiters );
+                for( int i = 0; i < Waiters.GetSize(); i++ )
+                    *Waiters[i].ppDeviceObject = ( void* )( UINT_PTR )Request.Key;
+                Pending.Remove( 0 );
+                PendingFrames.Remove( 0 );
+            }
+            QueryPerformanceCounter( &qwEnd );
+            llTime += qwEnd.QuadPart - qwStart.QuadPart;
+        }
+
+        const LOAD_COALESCE_STATS& Stats = Coalescer.GetStats();
+        WCHAR strPalette[32];
+        if( nPalette )
+            swprintf_s( strPalette, 32, L"%u pairs", nPalette );
+        else
+            wcscpy_s( strPalette, 32, L"per tile" );
+        wprintf( L"%-10s %9u %9u %7.1f%% %9u %9u %8.2f %10.1f %10.1f %8.3f\n", strPalette, ( UINT )nRequests,
+                 ( UINT )( nRequests - Stats.nJoined ), 100.0f * Stats.nJoined / __max( nRequests, 1 ),
+                 ( UINT )Stats.nSources, ( UINT )Stats.nReads, Coalescer.GetMergeRatio(),
+                 Stats.cBytesRequested / ( 1024.0 * 1024.0 ), Stats.cBytesRead / ( 1024.0 * 1024.0 ),
+                 1000000.0 * llTime / qwFreq.QuadPart / __max( nRequests, 1 ) );
+
+        UINT nWrong = 0;
+        for( UINT i = 0; i < nItems * 2; i++ )
+        {
+            if( ppTextures[i] != ( void* )( UINT_PTR )pTextureKeys[i] )
+                nWrong++;
+        }
+        if( nWrong || Coalescer.GetNumInFlight() )
+        {
+            wprintf( L"  %u textures not given to their requests, %u requests still in flight\n", nWrong,
+                     Coalescer.GetNumInFlight() );
+            nResult = 1;
+        }
+    }
+
+    SAFE_DELETE_ARRAY( pCenters );
+    SAFE_DELETE_ARRAY( pPaletteEntry );
+    SAFE_DELETE_ARRAY( ppTextures );
+    SAFE_DELETE_ARRAY( pTextureKeys );
+
+    return nResult;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Writes a 24 bit grey heightmap of rolling hills with some noise on them
+//--------------------------------------------------------------------------------------
+bool WriteTestHeightMap( const WCHAR* strFileName, UINT Size )
+{
+    HANDLE hFile = CreateFile( strFileName, FILE_WRITE_DATA, 0, NULL, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN,
+                               NULL );
+    if( INVALID_HANDLE_VALUE == hFile )
+        return false;
+
+    UINT Pitch = ( Size * 3 + 3 ) & ~3;
+    BITMAPFILEHEADER bfh;
+    ZeroMemory( &bfh, sizeof( BITMAPFILEHEADER ) );
+    bfh.bfType = 0x4D42;    // 'BM'
+    bfh.bfOffBits = sizeof( BITMAPFILEHEADER ) + sizeof( BITMAPINFOHEADER );
+    bfh.bfSize = bfh.bfOffBits + Pitch * Size;
+
+    BITMAPINFOHEADER bih;
+    ZeroMemory( &bih, sizeof( BITMAPINFOHEADER ) );
+    bih.biSize = sizeof( BITMAPINFOHEADER );
+    bih.biWidth = Size;
+    bih.biHeight = Size;
+    bih.biPlanes = 1;
+    bih.biBitCount = 24;
+    bih.biCompression = BI_RGB;
+    bih.biSizeImage = Pitch * Size;
+
+    DWORD dwWritten;
+    bool bRet = WriteFile( hFile, &bfh, sizeof( BITMAPFILEHEADER ), &dwWritten, NULL ) &&
+                WriteFile( hFile, &bih, sizeof( BITMAPINFOHEADER ), &dwWritten, NULL );
+
+    BYTE* pRow = new BYTE[ Pitch ];
+    if( !pRow )
+        bRet = false;
+    else
+        ZeroMemory( pRow, Pitch );
+    for( UINT y = 0; y < Size && bRet; y++ )
+    {
+        float fy = ( float )y / ( float )Size;
+        for( UINT x = 0; x < Size; x++ )
+        {
+            float fx = ( float )x / ( float )Size;
+            float fHeight = 0.5f + 0.3f * sinf( fx * 2.0f * D3DX_PI * 3.0f ) * cosf( fy * 2.0f * D3DX_PI * 2.0f ) +
+                            0.1f * sinf( ( fx + fy ) * 2.0f * D3DX_PI * 11.0f ) +
+                            0.05f * ( ( rand() & 255 ) / 255.0f - 0.5f );
+            BYTE Value = ( BYTE )( __max( 0.0f, __min( fHeight, 1.0f ) ) * 255.0f );
+            pRow[x * 3 + 0] = Value;
+            pRow[x * 3 + 1] = Value;
+            pRow[x * 3 + 2] = Value;
+        }
+        bRet = WriteFile( hFile, pRow, Pitch, &dwWritten, NULL ) && dwWritten == Pitch;
+    }
+
+    SAFE_DELETE_ARRAY( pRow );
+    CloseHandle( hFile );
+    return bRet;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Returns true if two terrains have the same tiles, bit for bit
+//--------------------------------------------------------------------------------------
+bool TerrainTilesMatch( CTerrain* pA, CTerrain* pB )
+{
+    if( pA->GetNumTiles() != pB->GetNumTiles() || pA->GetNumTileVertices() != pB->GetNumTileVertices() )
+        return false;
+
+    for( UINT i = 0; i < pA->GetNumTiles(); i++ )
+    {
+        TERRAIN_TILE* pTileA = pA->GetTile( i );
+        TERRAIN_TILE* pTileB = pB->GetTile( i );
+        if( 0 != memcmp( &pTileA->Color, &pTileB->Color, sizeof( D3DXVECTOR4 ) ) ||
+            0 != memcmp( &pTileA->BBox, &pTileB->BBox, sizeof( BOUNDING_BOX ) ) ||
+            0 != memcmp( pTileA->pRawVertices, pTileB->pRawVertices,
+                         pTileA->NumVertices * sizeof( TERRAIN_VERTEX ) ) )
+            return false;
+    }
+    return true;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Headless benchmark of loading the terrain:
+//
+//   ContentStreaming -terrainbench [-maxsize N] [-sides N] [-threads N] [-noverify]
+//
+// Writes heightmaps of 512x512 up to -maxsize (4096 by default) to the temp folder and
+// loads each with tiles of -sides sides, about one vertex for every four texels across,
+// as CreatePackedFile does.  Each map is loaded on one thread, on -threads threads (one
+// per processor by default), once more writing the tile cache, and once reading it.
+// Prints the time taken to decode the heightmap and to build the tiles for each.
+// Unless -noverify is given, the tiles from one thread, from many and from the cache
+// are checked to be the same, and every vertex is checked against GetHeightOnMap and
+// GetNormalOnMap, which is how the tiles used to be built.  The time that takes is
+// printed as "per vertex".
+// Returns 0 on success, 1 if a check failed.
+//--------------------------------------------------------------------------------------
+INT RunTerrainBenchmark( int nArgs, LPWSTR* pstrArgs )
+{
+    // Report to the console we were started from, if any
+    if( AttachConsole( ATTACH_PARENT_PROCESS ) )
+    {
+        FILE* pFile;
+        freopen_s( &pFile, "CONOUT$", "w", stdout );
+    }
+
+    UINT nMaxSize = 4096;
+    UINT nSides = 50;
+    UINT nThreads = 0;
+    bool bVerify = true;
+    for( int i = 0; i < nArgs; i++ )
+    {
+        if( 0 == _wcsicmp( pstrArgs[i], L"-maxsize" ) && i + 1 < nArgs )
+        {
+            int nValue = _wtoi( pstrArgs[++i] );
+            nMaxSize = nValue > 512 ? nValue : 512;
+        }
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-sides" ) && i + 1 < nArgs )
+        {
+            // The strips use 16 bit indices
+            int nValue = _wtoi( pstrArgs[++i] );
+            nSides = nValue < 2 ? 2 : ( nValue > 180 ? 180 : nValue );
+        }
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-threads" ) && i + 1 < nArgs )
+        {
+            int nValue = _wtoi( pstrArgs[++i] );
+            nThreads = nValue > 0 ? nValue : 0;
+        }
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-noverify" ) )
+            bVerify = false;
+    }
+
+    WCHAR strTempPath[MAX_PATH];
+    WCHAR strHeightMap[MAX_PATH];
+    WCHAR strTileCache[MAX_PATH];
+    if( !GetTempPath( MAX_PATH, strTempPath ) )
+    {
+        wprintf( L"Could not find the temp folder\n" );
+        return 1;
+    }
+    swprintf_s( strHeightMap, MAX_PATH, L"%sContentStreamingTerrain.bmp", strTempPath );
+    swprintf_s( strTileCache, MAX_PATH, L"%sContentStreamingTerrain.tiles", strTempPath );
+
+    // Same tile size and height range as the sample's world
+    const float fTileSize = 6667.0f / 20.0f;
+    const float fHeightScale = 300.0f;
+    const UINT nSeed = 100;
+
+    wprintf( L"%-6s %6s %9s %10s %10s %10s %10s %8s %10s %10s %10s\n", L"map", L"tiles", L"vertices",
+             L"decode 1", L"tiles 1", L"decode N", L"tiles N", L"speedup", L"write ms", L"cached ms",
+             L"per vertex" );
+
+    INT nResult = 0;
+    UINT nThreadsUsed = 0;
+    for( UINT Size = 512; Size <= nMaxSize && 0 == nResult; Size *= 2 )
+    {
+        UINT SqrtNumTiles = Size / ( 4 * nSides );
+        if( SqrtNumTiles < 4 )
+            SqrtNumTiles = 4;
+        const float fWorldScale = fTileSize * SqrtNumTiles;
+
+        srand( nSeed );
+        if( !WriteTestHeightMap( strHeightMap, Size ) )
+        {
+            wprintf( L"Could not write %s\n", strHeightMap );
+            nResult = 1;
+            break;
+        }
+        DeleteFile( strTileCache );
+
+        // One thread, then many
+        CTerrain* pSerial = new CTerrain;
+        CTerrain* pParallel = new CTerrain;
+        srand( nSeed );
+        HRESULT hr = pSerial->LoadTerrain( strHeightMap, SqrtNumTiles, nSides, fWorldScale, fHeightScale, true,
+                                           NULL, 1 );
+        srand( nSeed );
+        if( SUCCEEDED( hr ) )
+            hr = pParallel->LoadTerrain( strHeightMap, SqrtNumTiles, nSides, fWorldScale, fHeightScale, true,
+                                         NULL, nThreads );
+        if( FAILED( hr ) )
+        {
+            wprintf( L"Could not load a %ux%u map (%x)\n", Size, Size, hr );
+            SAFE_DELETE( pSerial );
+            SAFE_DELETE( pParallel );
+            nResult = 1;
+            break;
+        }
+        if( bVerify && !TerrainTilesMatch( pSerial, pParallel ) )
+        {
+            wprintf( L"  Tiles built on %u threads differ from the ones built on one\n",
+                     pParallel->GetLoadStats().nThreads );
+            nResult = 1;
+        }
+        TERRAIN_LOAD_STATS SerialStats = pSerial->GetLoadStats();
+        SAFE_DELETE( pSerial );
+
+        // Writing the cache, then reading it
+        CTerrain* pWriter = new CTerrain;
+        srand( nSeed );
+        pWriter->LoadTerrain( strHeightMap, SqrtNumTiles, nSides, fWorldScale, fHeightScale, true, strTileCache,
+                              nThreads );
+        TERRAIN_LOAD_STATS WriterStats = pWriter->GetLoadStats();
+        SAFE_DELETE( pWriter );
+
+        CTerrain* pReader = new CTerrain;
+        pReader->LoadTerrain( strHeightMap, SqrtNumTiles, nSides, fWorldScale, fHeightScale, true, strTileCache,
+                              nThreads );
+        TERRAIN_LOAD_STATS ReaderStats = pReader->GetLoadStats();
+        if( !ReaderStats.bTilesFromCache )
+        {
+            wprintf( L"  The tile cache was not used\n" );
+            nResult = 1;
+        }
+        else if( bVerify && !TerrainTilesMatch( pReader, pParallel ) )
+        {
+            wprintf( L"  Tiles read from the cache differ from the ones built\n" );
+            nResult = 1;
+        }
+        SAFE_DELETE( pReader );
+
+        // The old way of building the vertices
+        float fPerVertexMs = 0.0f;
+        if( bVerify )
+        {
+            UINT nWrong = 0;
+            LARGE_INTEGER qwFreq, qwStart, qwEnd;
+            QueryPerformanceFrequency( &qwFreq );
+            QueryPerformanceCounter( &qwStart );
+            for( UINT i = 0; i < pParallel->GetNumTiles(); i++ )
+            {
+                TERRAIN_TILE* pTile = pParallel->GetTile( i );
+                for( UINT v = 0; v < pTile->NumVertices; v++ )
+                {
+                    const TERRAIN_VERTEX& Vertex = pTile->pRawVertices[v];
+                    D3DXVECTOR3 vPos = Vertex.pos;
+                    float fHeight = pParallel->GetHeightOnMap( &vPos );
+                    D3DXVECTOR3 vNormal = pParallel->GetNormalOnMap( &vPos );
+                    if( fabsf( fHeight - Vertex.pos.y ) > 0.001f || D3DXVec3Dot( &vNormal, &Vertex.norm ) < 0.9999f ||
+                        Vertex.pos.y < pTile->BBox.min.y || Vertex.pos.y > pTile->BBox.max.y )
+                        nWrong++;
+                }
+            }
+            QueryPerformanceCounter( &qwEnd );
+            fPerVertexMs = ( float )( 1000.0 * ( qwEnd.QuadPart - qwStart.QuadPart ) / qwFreq.QuadPart );
+            if( nWrong )
+            {
+                wprintf( L"  %u vertices differ from GetHeightOnMap and GetNormalOnMap\n", nWrong );
+                nResult = 1;
+            }
+        }
+
+        const TERRAIN_LOAD_STATS& ParallelStats = pParallel->GetLoadStats();
+        nThreadsUsed = ParallelStats.nThreads;
+        UINT64 nVertices = ( UINT64 )pParallel->GetNumTiles() * pParallel->GetNumTileVertices();
+        WCHAR strMap[32];
+        swprintf_s( strMap, 32, L"%u", Size );
+        wprintf( L"%-6s %6u %9u %10.1f %10.1f %10.1f %10.1f %7.2fx %10.1f %10.1f %10.1f\n", strMap,
+                 pParallel->GetNumTiles(), ( UINT )nVertices, SerialStats.fDecodeMs, SerialStats.fTilesMs,
+                 ParallelStats.fDecodeMs, ParallelStats.fTilesMs,
+                 ( SerialStats.fDecodeMs + SerialStats.fTilesMs ) /
+                 __max( ParallelStats.fDecodeMs + ParallelStats.fTilesMs, 0.001f ),
+                 WriterStats.fTilesMs, ReaderStats.fTilesMs, fPerVertexMs );
+        SAFE_DELETE( pParallel );
+    }
+    if( nThreadsUsed )
+        wprintf( L"Times in ms, N is %u threads\n", nThreadsUsed );
+
+    DeleteFile( strHeightMap );
+    DeleteFile( strTileCache );
+
+    return nResult;
+}
@@ -77,6 +77,7 @@ extern UINT                         g_NumLevelItems;
 extern bool                         g_bStartupResourcesLoaded;
 extern bool                         g_bDrawUI;
 extern bool                         g_bWireframe;
+extern bool                         g_bUploadBudget;
 extern UINT64                       g_AvailableVideoMem;
 
 enum LOAD_TYPE
@@ -115,9 +116,11 @@ void CALLBACK CreateIndexBuffer9_Serial( IDirect3DDevice9* pDev, IDirect3DIndexB
 void CALLBACK CreateTextureFromFile9_Async( IDirect3DDevice9* pDev, WCHAR* szFileName, IDirect3DTexture9** ppTexture,
                                             void* pContext );
 void CALLBACK CreateVertexBuffer9_Async( IDirect3DDevice9* pDev, IDirect3DVertexBuffer9** ppBuffer, UINT iSizeBytes,
-                                         DWORD Usage, DWORD FVF, D3DPOOL Pool, void* pData, void* pContext );
+                                         DWORD Usage, DWORD FVF, D3DPOOL Pool, void* pData,
+                                         const LOAD_SOURCE* pSource, void* pContext );
 void CALLBACK CreateIndexBuffer9_Async( IDirect3DDevice9* pDev, IDirect3DIndexBuffer9** ppBuffer, UINT iSizeBytes,
-                                        DWORD Usage, D3DFORMAT ibFormat, D3DPOOL Pool, void* pData, void* pContext );
+                                        DWORD Usage, D3DFORMAT ibFormat, D3DPOOL Pool, void* pData,
+                                        const LOAD_SOURCE* pSource, void* pContext );
 
 extern void LoadStartupResources( IDirect3DDevice9* pDev9, ID3D10Device* pDev10, double fTime );
 extern void RenderText();
@@ -192,6 +195,7 @@ HRESULT CALLBACK OnD3D9CreateDevice( IDirect3DDevice9* pd3dDevice, const D3DSURF
     g_pAsyncLoader = new CAsyncLoader( g_NumProcessingThreads );
     if( !g_pAsyncLoader )
         return E_OUTOFMEMORY;
+    g_pAsyncLoader->EnableUploadBudget( g_bUploadBudget );
 
     // Create the texture reuse cache
     g_pResourceReuseCache = new CResourceReuseCache( pd3dDevice );
@@ -697,7 +701,8 @@ void	CALLBACK CreateTextureFromFile9_Async( IDirect3DDevice9* pDev, WCHAR* szFil
         CTextureLoader* pLoader = new CTextureLoader( szFileName, &g_PackFile );
         CTextureProcessor* pProcessor = new CTextureProcessor( pDev, ppTexture, g_pResourceReuseCache, g_SkipMips );
 
-        pAsyncLoader->AddWorkItem( pLoader, pProcessor, NULL, ( void** )ppTexture );
+        pAsyncLoader->AddWorkItem( pLoader, pProcessor, NULL, ( void** )ppTexture,
+                                   CLoadCoalescer::MakeKey( szFileName, g_SkipMips ) );
     }
 }
 
@@ -705,12 +710,13 @@ void	CALLBACK CreateTextureFromFile9_Async( IDirect3DDevice9* pDev, WCHAR* szFil
 // Async create VB
 //--------------------------------------------------------------------------------------
 void	CALLBACK CreateVertexBuffer9_Async( IDirect3DDevice9* pDev, IDirect3DVertexBuffer9** ppBuffer, UINT iSizeBytes,
-                                            DWORD Usage, DWORD FVF, D3DPOOL Pool, void* pData, void* pContext )
+                                            DWORD Usage, DWORD FVF, D3DPOOL Pool, void* pData,
+                                            const LOAD_SOURCE* pSource, void* pContext )
 {
     CAsyncLoader* pAsyncLoader = ( CAsyncLoader* )pContext;
     if( pAsyncLoader )
     {
-        CVertexBufferLoader* pLoader = new CVertexBufferLoader();
+        CVertexBufferLoader* pLoader = new CVertexBufferLoader( pSource );
         CVertexBufferProcessor* pProcessor = new CVertexBufferProcessor( pDev, ppBuffer, iSizeBytes, Usage, FVF, Pool,
                                                                          pData, g_pResourceReuseCache );
 
@@ -722,12 +728,13 @@ void	CALLBACK CreateVertexBuffer9_Async( IDirect3DDevice9* pDev, IDirect3DVertex
 // Async create IB
 //--------------------------------------------------------------------------------------
 void	CALLBACK CreateIndexBuffer9_Async( IDirect3DDevice9* pDev, IDirect3DIndexBuffer9** ppBuffer, UINT iSizeBytes,
-                                           DWORD Usage, D3DFORMAT ibFormat, D3DPOOL Pool, void* pData, void* pContext )
+                                           DWORD Usage, D3DFORMAT ibFormat, D3DPOOL Pool, void* pData,
+                                           const LOAD_SOURCE* pSource, void* pContext )
 {
     CAsyncLoader* pAsyncLoader = ( CAsyncLoader* )pContext;
     if( pAsyncLoader )
     {
-        CIndexBufferLoader* pLoader = new CIndexBufferLoader();
+        CIndexBufferLoader* pLoader = new CIndexBufferLoader( pSource );
         CIndexBufferProcessor* pProcessor = new CIndexBufferProcessor( pDev, ppBuffer, iSizeBytes, Usage, ibFormat,
                                                                        Pool, pData, g_pResourceReuseCache );
 
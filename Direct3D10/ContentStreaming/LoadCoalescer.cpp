@@ -0,0 +1,193 @@
+//--------------------------------------------------------------------------------------
+// File: LoadCoalescer.cpp
+//
+// Illustrates streaming content using Direct3D 9/10
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "LoadCoalescer.h"
+
+// Reading this much that nobody asked for is cheaper than a second seek
+#define DEFAULT_MAX_GAP_BYTES   ( 64 * 1024 )
+#define DEFAULT_MAX_READ_BYTES  ( 16 * 1024 * 1024 )
+
+//--------------------------------------------------------------------------------------
+CLoadCoalescer::CLoadCoalescer() : m_bHaveLastRead( false ),
+                                   m_cMaxGapBytes( DEFAULT_MAX_GAP_BYTES ),
+                                   m_cMaxReadBytes( DEFAULT_MAX_READ_BYTES )
+{
+    ZeroMemory( &m_LastRead, sizeof( LOAD_SOURCE ) );
+    ResetStats();
+}
+
+//--------------------------------------------------------------------------------------
+void CLoadCoalescer::SetMergeLimits( UINT64 cMaxGapBytes, UINT64 cMaxReadBytes )
+{
+    m_cMaxGapBytes = cMaxGapBytes;
+    m_cMaxReadBytes = cMaxReadBytes;
+}
+
+//--------------------------------------------------------------------------------------
+void CLoadCoalescer::ResetStats()
+{
+    ZeroMemory( &m_Stats, sizeof( LOAD_COALESCE_STATS ) );
+}
+
+//--------------------------------------------------------------------------------------
+// 64 bit FNV-1a of the name, followed by the variant
+//--------------------------------------------------------------------------------------
+UINT64 CLoadCoalescer::MakeKey( const WCHAR* szName, UINT Variant )
+{
+    const UINT64 FNVPrime = 1099511628211ull;
+    UINT64 Key = 14695981039346656037ull;
+    for( const WCHAR* pch = szName; *pch; pch++ )
+    {
+        Key ^= ( UINT64 )*pch;
+        Key *= FNVPrime;
+    }
+    Key ^= Variant;
+    Key *= FNVPrime;
+
+    return Key ? Key : 1;
+}
+
+//--------------------------------------------------------------------------------------
+int CLoadCoalescer::FindInFlight( UINT64 Key ) const
+{
+    for( int i = 0; i < m_InFlight.GetSize(); i++ )
+    {
+        if( m_InFlight[i].Key == Key )
+            return i;
+    }
+    return -1;
+}
+
+//--------------------------------------------------------------------------------------
+bool CLoadCoalescer::AddRequest( UINT64 Key, void** ppDeviceObject, HRESULT* pHR )
+{
+    m_Stats.nRequests++;
+
+    int iInFlight = FindInFlight( Key );
+    if( iInFlight < 0 )
+    {
+        LOAD_IN_FLIGHT InFlight;
+        InFlight.Key = Key;
+        InFlight.ppDeviceObject = ppDeviceObject;
+        InFlight.nWaiters = 0;
+        m_InFlight.Add( InFlight );
+        return true;
+    }
+
+    // Asking again for the same pointer needs nothing more, it gets set anyway
+    m_Stats.nJoined++;
+    LOAD_IN_FLIGHT& InFlight = m_InFlight[iInFlight];
+    if( InFlight.ppDeviceObject != ppDeviceObject )
+    {
+        LOAD_WAITER Waiter;
+        Waiter.Key = Key;
+        Waiter.ppDeviceObject = ppDeviceObject;
+        Waiter.pHR = pHR;
+        m_Waiters.Add( Waiter );
+        InFlight.nWaiters++;
+    }
+    return false;
+}
+
+//--------------------------------------------------------------------------------------
+void CLoadCoalescer::CompleteRequest( UINT64 Key, CGrowableArray <LOAD_WAITER>* pWaiters )
+{
+    pWaiters->Reset();
+
+    int iInFlight = FindInFlight( Key );
+    if( iInFlight < 0 )
+        return;
+
+    UINT nWaiters = m_InFlight[iInFlight].nWaiters;
+    m_InFlight.SwapRemove( iInFlight );
+
+    for( int i = m_Waiters.GetSize() - 1; i >= 0 && nWaiters > 0; i-- )
+    {
+        if( m_Waiters[i].Key == Key )
+        {
+            pWaiters->Add( m_Waiters[i] );
+            m_Waiters.SwapRemove( i );
+            nWaiters--;
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------------
+bool CLoadCoalescer::BeginRead( const LOAD_SOURCE& Source, const LOAD_SOURCE* pQueued, UINT nQueued,
+                                LOAD_SOURCE* pRead )
+{
+    m_Stats.nSources++;
+    m_Stats.cBytesRequested += Source.cBytes;
+
+    if( m_bHaveLastRead &&
+        m_LastRead.pPackedFile == Source.pPackedFile &&
+        m_LastRead.Chunk == Source.Chunk &&
+        m_LastRead.Offset <= Source.Offset &&
+        Source.Offset + Source.cBytes <= m_LastRead.Offset + m_LastRead.cBytes )
+        return false;
+
+    // Keep taking in queued reads close to the range until none are left that fit.
+    // Each one taken in can bring others into reach.
+    UINT64 Start = Source.Offset;
+    UINT64 End = Source.Offset + Source.cBytes;
+    bool bGrew = true;
+    while( bGrew )
+    {
+        bGrew = false;
+        for( UINT i = 0; i < nQueued; i++ )
+        {
+            const LOAD_SOURCE& Queued = pQueued[i];
+            if( Queued.pPackedFile != Source.pPackedFile || Queued.Chunk != Source.Chunk )
+                continue;
+
+            UINT64 QueuedEnd = Queued.Offset + Queued.cBytes;
+            if( Queued.Offset >= Start && QueuedEnd <= End )
+                continue;
+            if( Queued.Offset > End + m_cMaxGapBytes || QueuedEnd + m_cMaxGapBytes < Start )
+                continue;
+
+            UINT64 NewStart = __min( Start, Queued.Offset );
+            UINT64 NewEnd = __max( End, QueuedEnd );
+            if( NewEnd - NewStart > m_cMaxReadBytes )
+                continue;
+
+            Start = NewStart;
+            End = NewEnd;
+            bGrew = true;
+        }
+    }
+
+    pRead->pPackedFile = Source.pPackedFile;
+    pRead->Chunk = Source.Chunk;
+    pRead->Offset = Start;
+    pRead->cBytes = End - Start;
+
+    m_LastRead = *pRead;
+    m_bHaveLastRead = true;
+    m_Stats.nReads++;
+    m_Stats.cBytesRead += pRead->cBytes;
+
+    return true;
+}
+
+//--------------------------------------------------------------------------------------
+float CLoadCoalescer::GetDedupRatio() const
+{
+    if( 0 == m_Stats.nRequests )
+        return 0.0f;
+    return ( float )m_Stats.nJoined / ( float )m_Stats.nRequests;
+}
+
+//--------------------------------------------------------------------------------------
+float CLoadCoalescer::GetMergeRatio() const
+{
+    if( 0 == m_Stats.nReads )
+        return 1.0f;
+    return ( float )m_Stats.nSources / ( float )m_Stats.nReads;
+}
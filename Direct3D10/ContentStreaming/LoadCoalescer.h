@@ -0,0 +1,118 @@
+//--------------------------------------------------------------------------------------
+// File: LoadCoalescer.h
+//
+// Cuts down the work the async loader does for requests that overlap.  Requests for a
+// resource that is already on its way (the same file at the same LOD) join the request
+// in flight instead of reading and processing it again, and all of them get the device
+// object when it is done.  Reads from the same chunk of the packed file that are next to
+// each other, or close, are issued as one read covering all of them.
+//
+// Nothing here touches a device or the file, so it can be driven by a replayed walk
+// through a generated world to measure it.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#pragma once
+#ifndef LOAD_COALESCER_H
+#define LOAD_COALESCER_H
+
+class CPackedFile;
+
+// How many of the reads queued behind a read are looked at to merge with it
+#define LOAD_MERGE_LOOKAHEAD    16
+
+//--------------------------------------------------------------------------------------
+// Where a request's data lives in the packed file
+//--------------------------------------------------------------------------------------
+struct LOAD_SOURCE
+{
+    CPackedFile* pPackedFile;
+    UINT64 Chunk;
+    UINT64 Offset;              // Into the chunk
+    UINT64 cBytes;
+};
+
+struct LOAD_WAITER
+{
+    UINT64 Key;
+    void** ppDeviceObject;
+    HRESULT* pHR;
+};
+
+struct LOAD_IN_FLIGHT
+{
+    UINT64 Key;
+    void** ppDeviceObject;
+    UINT nWaiters;
+};
+
+struct LOAD_COALESCE_STATS
+{
+    UINT64 nRequests;           // Requests with a key
+    UINT64 nJoined;             // Requests that joined one already in flight
+    UINT64 nSources;            // Reads asked for
+    UINT64 nReads;              // Reads issued
+    UINT64 cBytesRequested;
+    UINT64 cBytesRead;          // Includes any gaps read to join two ranges
+};
+
+//--------------------------------------------------------------------------------------
+// The request table is only used by the thread that adds and completes requests, and
+// the read merging only by the IO thread, so neither needs a lock.
+//--------------------------------------------------------------------------------------
+class CLoadCoalescer
+{
+public:
+                    CLoadCoalescer();
+
+    void            SetMergeLimits( UINT64 cMaxGapBytes, UINT64 cMaxReadBytes );
+    void            ResetStats();
+
+    // Key for a file at a LOD.  Never 0, which the loader uses for requests that are
+    // not shared.
+    static UINT64   MakeKey( const WCHAR* szName, UINT Variant );
+
+    // Returns true if the request is the first for Key and has to be loaded, or false
+    // if it joined the one in flight and will be given its device object.
+    bool            AddRequest( UINT64 Key, void** ppDeviceObject, HRESULT* pHR );
+
+    // Ends the request for Key and returns the requests that joined it
+    void            CompleteRequest( UINT64 Key, CGrowableArray <LOAD_WAITER>* pWaiters );
+
+    UINT            GetNumInFlight() const
+    {
+        return ( UINT )m_InFlight.GetSize();
+    }
+
+    // Called by the IO thread before it reads Source, with the sources of the reads
+    // queued behind it.  Returns false if an earlier read already covered Source.
+    // Otherwise returns true with the range to read in *pRead, which covers Source and
+    // any queued reads close to it in the same chunk.
+    bool            BeginRead( const LOAD_SOURCE& Source, const LOAD_SOURCE* pQueued, UINT nQueued,
+                               LOAD_SOURCE* pRead );
+
+    const LOAD_COALESCE_STATS& GetStats() const
+    {
+        return m_Stats;
+    }
+
+    // Fraction of requests that joined one in flight
+    float           GetDedupRatio() const;
+
+    // Reads asked for per read issued
+    float           GetMergeRatio() const;
+
+protected:
+    int             FindInFlight( UINT64 Key ) const;
+
+    CGrowableArray <LOAD_IN_FLIGHT> m_InFlight;
+    CGrowableArray <LOAD_WAITER> m_Waiters;
+    LOAD_SOURCE m_LastRead;
+    bool m_bHaveLastRead;
+    UINT64 m_cMaxGapBytes;
+    UINT64 m_cMaxReadBytes;
+    LOAD_COALESCE_STATS m_Stats;
+};
+
+#endif
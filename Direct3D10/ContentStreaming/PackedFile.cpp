@@ -8,6 +8,7 @@
 //--------------------------------------------------------------------------------------
 #include "DXUT.h"
 #include "PackedFile.h"
+#include "AsyncLoader.h"
 #include "SDKMisc.h"
 #include "Terrain.h"
 
@@ -131,9 +132,13 @@ bool CPackedFile::CreatePackedFile( ID3D10Device* pDev10, IDirect3DDevice9* pDev
     STRING strTerrainHeight;
     if( FAILED( DXUTFindDXSDKMediaFileCch( strTerrainHeight.str, MAX_PATH, L"contentstreaming\\terrain1.bmp" ) ) )
         return false;
+    // The tiles are kept next to the packed file so they only have to be generated
+    // again if the heightmap changes
+    STRING strTileCache;
+    swprintf_s( strTileCache.str, MAX_PATH, L"%s.tiles", szFileName );
     CTerrain Terrain;
     HRESULT hr = Terrain.LoadTerrain( strTerrainHeight.str, SqrtNumTiles, SidesPerTile, fWorldScale, fHeightScale,
-                                      true );
+                                      true, strTileCache.str );
     if( FAILED( hr ) )
         return false;
 
@@ -607,17 +612,7 @@ bool CPackedFile::GetPackedFileInfo( char* szFile, UINT* pDataBytes )
 //--------------------------------------------------------------------------------------
 bool CPackedFile::GetPackedFileInfo( WCHAR* szFile, UINT* pDataBytes )
 {
-    // Look the file up in the index
-    int iFoundIndex = -1;
-    for( UINT i = 0; i < m_FileHeader.NumFiles; i++ )
-    {
-        if( 0 == wcscmp( szFile, m_pFileIndices[i].szFileName ) )
-        {
-            iFoundIndex = i;
-            break;
-        }
-    }
-
+    int iFoundIndex = FindFileIndex( szFile );
     if( -1 == iFoundIndex )
         return false;
 
@@ -637,25 +632,17 @@ bool CPackedFile::GetPackedFile( char* szFile, BYTE** ppData, UINT* pDataBytes )
 
 //--------------------------------------------------------------------------------------
 // Finds the location of a resource in a packed file and returns its contents in 
-// *ppData.
+// *ppData.  pSource, if given, gets where the data is so reads can be merged.
 //--------------------------------------------------------------------------------------
-bool CPackedFile::GetPackedFile( WCHAR* szFile, BYTE** ppData, UINT* pDataBytes )
+bool CPackedFile::GetPackedFile( WCHAR* szFile, BYTE** ppData, UINT* pDataBytes, LOAD_SOURCE* pSource )
 {
-    // Look the file up in the index
-    int iFoundIndex = -1;
-    for( UINT i = 0; i < m_FileHeader.NumFiles; i++ )
-    {
-        if( 0 == wcscmp( szFile, m_pFileIndices[i].szFileName ) )
-        {
-            iFoundIndex = i;
-            break;
-        }
-    }
-
+    int iFoundIndex = FindFileIndex( szFile );
     if( -1 == iFoundIndex )
         return false;
 
     *pDataBytes = ( UINT )m_pFileIndices[iFoundIndex].FileSize;
+    if( pSource )
+        GetFileSource( iFoundIndex, pSource );
 
     // Memory mapped io
     EnsureChunkMapped( m_pFileIndices[iFoundIndex].ChunkIndex );
@@ -665,6 +652,58 @@ bool CPackedFile::GetPackedFile( WCHAR* szFile, BYTE** ppData, UINT* pDataBytes
     return true;
 }
 
+//--------------------------------------------------------------------------------------
+// Finds where a resource is in the packed file without mapping it
+//--------------------------------------------------------------------------------------
+bool CPackedFile::FindPackedFile( WCHAR* szFile, LOAD_SOURCE* pSource )
+{
+    int iFoundIndex = FindFileIndex( szFile );
+    if( -1 == iFoundIndex )
+        return false;
+
+    GetFileSource( iFoundIndex, pSource );
+    return true;
+}
+
+//--------------------------------------------------------------------------------------
+// Reads a range of a chunk into memory as one read, so the resources in it don't each
+// fault their own pages in later.  Only memory mapped IO is read ahead like this.
+//--------------------------------------------------------------------------------------
+void CPackedFile::ReadRange( const LOAD_SOURCE& Range )
+{
+    if( !UsingMemoryMappedIO() || Range.Chunk >= m_FileHeader.NumChunks )
+        return;
+
+    EnsureChunkMapped( Range.Chunk );
+    BYTE* pChunk = ( BYTE* )m_pMappedChunks[ Range.Chunk ].pMappingPointer;
+    if( !pChunk || Range.Offset + Range.cBytes > m_pChunks[ Range.Chunk ].ChunkSize )
+        return;
+
+    WarmIOCache( pChunk + Range.Offset, ( SIZE_T )Range.cBytes );
+}
+
+//--------------------------------------------------------------------------------------
+int CPackedFile::FindFileIndex( WCHAR* szFile )
+{
+    // Look the file up in the index
+    for( UINT i = 0; i < m_FileHeader.NumFiles; i++ )
+    {
+        if( 0 == wcscmp( szFile, m_pFileIndices[i].szFileName ) )
+            return i;
+    }
+
+    return -1;
+}
+
+//--------------------------------------------------------------------------------------
+void CPackedFile::GetFileSource( int iFile, LOAD_SOURCE* pSource )
+{
+    pSource->pPackedFile = this;
+    pSource->Chunk = m_pFileIndices[iFile].ChunkIndex;
+    pSource->Offset = m_pFileIndices[iFile].OffsetIntoChunk;
+    pSource->cBytes = m_pFileIndices[iFile].FileSize;
+}
+
 //--------------------------------------------------------------------------------------
 bool CPackedFile::UsingMemoryMappedIO()
 {
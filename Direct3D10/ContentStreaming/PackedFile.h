@@ -11,6 +11,7 @@
 #define PACKD_FILE_H
 
 #include "ResourceReuseCache.h"
+#include "LoadCoalescer.h"
 
 //--------------------------------------------------------------------------------------
 // Packed file structures
@@ -97,6 +98,9 @@ private:
     UINT m_MaxChunksMapped;
     UINT m_CurrentUseCounter;
 
+    int     FindFileIndex( WCHAR* szFile );
+    void    GetFileSource( int iFile, LOAD_SOURCE* pSource );
+
 public:
             CPackedFile();
             ~CPackedFile();
@@ -109,7 +113,9 @@ public:
     bool    GetPackedFileInfo( char* szFile, UINT* pDataBytes );
     bool    GetPackedFileInfo( WCHAR* szFile, UINT* pDataBytes );
     bool    GetPackedFile( char* szFile, BYTE** ppData, UINT* pDataBytes );
-    bool    GetPackedFile( WCHAR* szFile, BYTE** ppData, UINT* pDataBytes );
+    bool    GetPackedFile( WCHAR* szFile, BYTE** ppData, UINT* pDataBytes, LOAD_SOURCE* pSource=NULL );
+    bool    FindPackedFile( WCHAR* szFile, LOAD_SOURCE* pSource );
+    void    ReadRange( const LOAD_SOURCE& Range );
     bool    UsingMemoryMappedIO();
 
     void    SetMaxChunksMapped( UINT maxmapped );
@@ -161,6 +161,7 @@ int CResourceReuseCache::EnsureFreeTexture( UINT Width, UINT Height, UINT MipLev
             {
                 // Found one that matches all criteria
                 texTest->bInUse = TRUE;
+                texTest->UseCount = 1;
                 return i;
             }
         }
@@ -251,6 +252,7 @@ int CResourceReuseCache::EnsureFreeTexture( UINT Width, UINT Height, UINT MipLev
 
         m_UsedManagedMemory += tex->EstimatedSize;
         tex->bInUse = TRUE;
+        tex->UseCount = 1;
 
         int index = m_TextureList.GetSize();
         m_TextureList.Add( tex );
@@ -954,6 +956,8 @@ IDirect3DTexture9* CResourceReuseCache::GetFreeTexture9( UINT Width, UINT Height
     }
 }
 
+//--------------------------------------------------------------------------------------
+// The texture is free once every item sharing it has given it back
 //--------------------------------------------------------------------------------------
 void CResourceReuseCache::UnuseDeviceTexture10( ID3D10ShaderResourceView* pRV )
 {
@@ -961,7 +965,10 @@ void CResourceReuseCache::UnuseDeviceTexture10( ID3D10ShaderResourceView* pRV )
     if( index >= 0 )
     {
         DEVICE_TEXTURE* tex = m_TextureList.GetAt( index );
-        tex->bInUse = FALSE;
+        if( tex->UseCount > 0 )
+            tex->UseCount--;
+        if( 0 == tex->UseCount )
+            tex->bInUse = FALSE;
     }
 }
 
@@ -972,7 +979,36 @@ void CResourceReuseCache::UnuseDeviceTexture9( IDirect3DTexture9* pTexture )
     if( index >= 0 )
     {
         DEVICE_TEXTURE* tex = m_TextureList.GetAt( index );
-        tex->bInUse = FALSE;
+        if( tex->UseCount > 0 )
+            tex->UseCount--;
+        if( 0 == tex->UseCount )
+            tex->bInUse = FALSE;
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Another item shares a texture that is in use
+//--------------------------------------------------------------------------------------
+void CResourceReuseCache::AddDeviceTextureUse10( ID3D10ShaderResourceView* pRV )
+{
+    int index = FindTexture( pRV );
+    if( index >= 0 )
+    {
+        DEVICE_TEXTURE* tex = m_TextureList.GetAt( index );
+        tex->bInUse = TRUE;
+        tex->UseCount++;
+    }
+}
+
+//--------------------------------------------------------------------------------------
+void CResourceReuseCache::AddDeviceTextureUse9( IDirect3DTexture9* pTexture )
+{
+    int index = FindTexture( pTexture );
+    if( index >= 0 )
+    {
+        DEVICE_TEXTURE* tex = m_TextureList.GetAt( index );
+        tex->bInUse = TRUE;
+        tex->UseCount++;
     }
 }
 
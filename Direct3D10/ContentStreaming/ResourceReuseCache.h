@@ -62,6 +62,7 @@ ID3D10Texture2D*			  pStaging10;
 
 UINT64 EstimatedSize;
 BOOL bInUse;
+UINT UseCount;          // Items sharing the texture
 UINT RecentUseCounter;
 };
 
@@ -152,6 +153,8 @@ ID3D10ShaderResourceView* GetFreeTexture10( UINT Width, UINT Height, UINT MipLev
 IDirect3DTexture9* GetFreeTexture9( UINT Width, UINT Height, UINT MipLevels, UINT Format );
 void UnuseDeviceTexture10( ID3D10ShaderResourceView* pRV );
 void UnuseDeviceTexture9( IDirect3DTexture9* pTexture );
+void AddDeviceTextureUse10( ID3D10ShaderResourceView* pRV );
+void AddDeviceTextureUse9( IDirect3DTexture9* pTexture );
 int GetNumTextures();
 DEVICE_TEXTURE* GetTexture( int i );
 
@@ -6,6 +6,105 @@
 //--------------------------------------------------------------------------------------
 #include "DXUT.h"
 #include "Terrain.h"
+#include "DXUTWorkerPool.h"
+
+// Heightmap rows decoded by a thread each time it takes more work
+#define TERRAIN_DECODE_ROWS     64
+
+#define TERRAIN_CACHE_MAGIC     0x48435454  // 'TTCH'
+#define TERRAIN_CACHE_VERSION   1
+
+// Files are read and written in pieces no bigger than this
+#define TERRAIN_FILE_IO_BYTES   ( 16 * 1024 * 1024 )
+
+//--------------------------------------------------------------------------------------
+// The work the threads share while loading.  The DXUT worker pool hands them blocks of
+// rows or tiles until none are left.
+//--------------------------------------------------------------------------------------
+struct TERRAIN_JOB
+{
+    CTerrain* pTerrain;
+
+    // Decoding the heightmap
+    const BYTE* pBits;
+    UINT Pitch;
+    UINT BytesPerPixel;
+    const float* pSumToHeight;  // Height for each sum of a pixel's channels
+
+    // Generating tiles.  Heights under the tile's vertices with a border of one vertex,
+    // and where each column of them is on the heightmap, BlockSide columns for each
+    // thread.
+    UINT BlockSide;
+    float* pHeights;
+    UINT* pColumns;
+    float* pFractions;
+};
+
+//--------------------------------------------------------------------------------------
+// The tile cache is this header followed by the color and bounding box of each tile,
+// then the vertices of each tile in order.  The header has to match exactly for the
+// cache to be used.
+//--------------------------------------------------------------------------------------
+struct TERRAIN_CACHE_HEADER
+{
+    DWORD dwMagic;
+    DWORD dwVersion;
+    UINT64 HeightMapBytes;
+    FILETIME ftHeightMapWritten;
+    UINT SqrtNumTiles;
+    UINT NumSidesPerTile;
+    float fWorldScale;
+    float fHeightScale;
+    UINT HeightMapX;
+    UINT HeightMapY;
+};
+
+struct TERRAIN_CACHE_TILE
+{
+    D3DXVECTOR4 Color;
+    BOUNDING_BOX BBox;
+};
+
+//--------------------------------------------------------------------------------------
+static float GetMsSince( const LARGE_INTEGER& qwStart )
+{
+    LARGE_INTEGER qwFreq, qwNow;
+    QueryPerformanceFrequency( &qwFreq );
+    QueryPerformanceCounter( &qwNow );
+    return ( float )( 1000.0 * ( qwNow.QuadPart - qwStart.QuadPart ) / qwFreq.QuadPart );
+}
+
+//--------------------------------------------------------------------------------------
+static bool ReadAll( HANDLE hFile, void* pData, UINT64 cBytes )
+{
+    BYTE* pBytes = ( BYTE* )pData;
+    while( cBytes > 0 )
+    {
+        DWORD dwToRead = ( DWORD )__min( cBytes, ( UINT64 )TERRAIN_FILE_IO_BYTES );
+        DWORD dwRead = 0;
+        if( !ReadFile( hFile, pBytes, dwToRead, &dwRead, NULL ) || dwRead != dwToRead )
+            return false;
+        pBytes += dwRead;
+        cBytes -= dwRead;
+    }
+    return true;
+}
+
+//--------------------------------------------------------------------------------------
+static bool WriteAll( HANDLE hFile, const void* pData, UINT64 cBytes )
+{
+    const BYTE* pBytes = ( const BYTE* )pData;
+    while( cBytes > 0 )
+    {
+        DWORD dwToWrite = ( DWORD )__min( cBytes, ( UINT64 )TERRAIN_FILE_IO_BYTES );
+        DWORD dwWritten = 0;
+        if( !WriteFile( hFile, pBytes, dwToWrite, &dwWritten, NULL ) || dwWritten != dwToWrite )
+            return false;
+        pBytes += dwWritten;
+        cBytes -= dwWritten;
+    }
+    return true;
+}
 
 
 //--------------------------------------------------------------------------------------
@@ -19,30 +118,25 @@ CTerrain::CTerrain() : m_SqrtNumTiles( 0 ),
                        m_HeightMapY( 0 ),
                        m_pHeightBits( NULL ),
                        m_NumIndices( 0 ),
-                       m_pTerrainRawIndices( NULL )
+                       m_pTerrainRawIndices( NULL ),
+                       m_pVertices( NULL )
 {
+    ZeroMemory( &m_LoadStats, sizeof( TERRAIN_LOAD_STATS ) );
 }
 
 
 //--------------------------------------------------------------------------------------
 CTerrain::~CTerrain()
 {
-    if( m_pTiles )
-    {
-        for( UINT i = 0; i < m_NumTiles; i++ )
-        {
-            SAFE_DELETE_ARRAY( m_pTiles[i].pRawVertices );
-        }
-    }
-
     SAFE_DELETE_ARRAY( m_pTiles );
+    SAFE_DELETE_ARRAY( m_pVertices );
     SAFE_DELETE_ARRAY( m_pHeightBits );
     SAFE_DELETE_ARRAY( m_pTerrainRawIndices );
 }
 
 //--------------------------------------------------------------------------------------
 HRESULT CTerrain::LoadTerrain( WCHAR* strHeightMap, UINT SqrtNumTiles, UINT NumSidesPerTile, float fWorldScale,
-                               float fHeightScale, bool bCreateTiles )
+                               float fHeightScale, bool bCreateTiles, const WCHAR* strTileCache, UINT nThreads )
 {
     HRESULT hr = S_OK;
 
@@ -54,35 +148,90 @@ HRESULT CTerrain::LoadTerrain( WCHAR* strHeightMap, UINT SqrtNumTiles, UINT NumS
     m_NumTiles = SqrtNumTiles * SqrtNumTiles;
     m_NumIndices = ( m_NumSidesPerTile + 2 ) * 2 * ( m_NumSidesPerTile )- 2;
 
+    CDXUTWorkerPool* pPool = DXUTGetWorkerPool();
+    if( 0 == nThreads || nThreads > pPool->GetNumThreads() )
+        nThreads = pPool->GetNumThreads();
+
+    ZeroMemory( &m_LoadStats, sizeof( TERRAIN_LOAD_STATS ) );
+    m_LoadStats.nThreads = nThreads;
+
     // Load the image
-    V_RETURN( LoadBMPImage( strHeightMap ) );
+    LARGE_INTEGER qwStart;
+    QueryPerformanceCounter( &qwStart );
+    V_RETURN( LoadBMPImage( strHeightMap, nThreads ) );
+    m_LoadStats.fDecodeMs = GetMsSince( qwStart );
 
     // Create tiles
     if( bCreateTiles )
     {
+        QueryPerformanceCounter( &qwStart );
+
+        // The vertices of all the tiles are allocated together so they can be read from
+        // and written to the cache in one go
+        UINT NumVertices = GetNumTileVertices();
         m_pTiles = new TERRAIN_TILE[ m_NumTiles ];
-        if( !m_pTiles )
+        m_pVertices = new TERRAIN_VERTEX[ ( SIZE_T )m_NumTiles * NumVertices ];
+        if( !m_pTiles || !m_pVertices )
             return E_OUTOFMEMORY;
-
-        UINT iTile = 0;
-        float zStart = -m_fWorldScale / 2.0f;
-        float zDelta = m_fWorldScale / ( float )m_SqrtNumTiles;
-        float xDelta = m_fWorldScale / ( float )m_SqrtNumTiles;
-        for( UINT z = 0; z < m_SqrtNumTiles; z++ )
+        for( UINT i = 0; i < m_NumTiles; i++ )
         {
-            float xStart = -m_fWorldScale / 2.0f;
-            for( UINT x = 0; x < m_SqrtNumTiles; x++ )
-            {
-                BOUNDING_BOX BBox;
-                BBox.min = D3DXVECTOR3( xStart, 0, zStart );
-                BBox.max = D3DXVECTOR3( xStart + xDelta, 0, zStart + zDelta );
+            m_pTiles[i].NumVertices = NumVertices;
+            m_pTiles[i].pRawVertices = m_pVertices + ( SIZE_T )i * NumVertices;
+        }
 
-                V_RETURN( GenerateTile( &m_pTiles[iTile], &BBox ) );
+        TERRAIN_CACHE_HEADER Header;
+        ZeroMemory( &Header, sizeof( TERRAIN_CACHE_HEADER ) );
+        WIN32_FILE_ATTRIBUTE_DATA HeightMapData;
+        if( strTileCache && !GetFileAttributesEx( strHeightMap, GetFileExInfoStandard, &HeightMapData ) )
+            strTileCache = NULL;
+        if( strTileCache )
+        {
+            Header.dwMagic = TERRAIN_CACHE_MAGIC;
+            Header.dwVersion = TERRAIN_CACHE_VERSION;
+            Header.HeightMapBytes = ( ( UINT64 )HeightMapData.nFileSizeHigh << 32 ) | HeightMapData.nFileSizeLow;
+            Header.ftHeightMapWritten = HeightMapData.ftLastWriteTime;
+            Header.SqrtNumTiles = m_SqrtNumTiles;
+            Header.NumSidesPerTile = m_NumSidesPerTile;
+            Header.fWorldScale = m_fWorldScale;
+            Header.fHeightScale = m_fHeightScale;
+            Header.HeightMapX = m_HeightMapX;
+            Header.HeightMapY = m_HeightMapY;
+            m_LoadStats.bTilesFromCache = LoadTileCache( strTileCache, Header );
+        }
 
-                iTile ++;
-                xStart += xDelta;
+        if( !m_LoadStats.bTilesFromCache )
+        {
+            // The colors are picked up front, in tile order, so they do not depend on
+            // which thread generates which tile
+            for( UINT i = 0; i < m_NumTiles; i++ )
+            {
+                m_pTiles[i].Color.x = 0.60f + RPercent() * 0.40f;
+                m_pTiles[i].Color.y = 0.60f + RPercent() * 0.40f;
+                m_pTiles[i].Color.z = 0.60f + RPercent() * 0.40f;
+                m_pTiles[i].Color.w = 1.0f;
             }
-            zStart += zDelta;
+
+            UINT nTileThreads = min( nThreads, m_NumTiles );
+            TERRAIN_JOB Job;
+            ZeroMemory( &Job, sizeof( TERRAIN_JOB ) );
+            Job.pTerrain = this;
+            Job.BlockSide = m_NumSidesPerTile + 3;
+            Job.pHeights = new float[ ( SIZE_T )nTileThreads * Job.BlockSide * Job.BlockSide ];
+            Job.pColumns = new UINT[ nTileThreads * Job.BlockSide ];
+            Job.pFractions = new float[ nTileThreads * Job.BlockSide ];
+            if( Job.pHeights && Job.pColumns && Job.pFractions )
+                pPool->Run( TileProc, &Job, m_NumTiles, nTileThreads );
+            else
+                hr = E_OUTOFMEMORY;
+
+            SAFE_DELETE_ARRAY( Job.pHeights );
+            SAFE_DELETE_ARRAY( Job.pColumns );
+            SAFE_DELETE_ARRAY( Job.pFractions );
+            if( FAILED( hr ) )
+                return hr;
+
+            if( strTileCache )
+                SaveTileCache( strTileCache, Header );
         }
 
         // Create the indices for the tile strips
@@ -111,6 +260,8 @@ HRESULT CTerrain::LoadTerrain( WCHAR* strHeightMap, UINT SqrtNumTiles, UINT NumS
                 iIndex++;
             }
         }
+
+        m_LoadStats.fTilesMs = GetMsSince( qwStart );
     }
 
     return hr;
@@ -130,30 +281,12 @@ float CTerrain::GetHeightForTile( UINT iTile, D3DXVECTOR3* pPos )
 #define LINEAR_INTERPOLATE(a,b,x) (a*(1.0f-x) + b*x)
 float CTerrain::GetHeightOnMap( D3DXVECTOR3* pPos )
 {
-    // move x and z into [0..1] range
-    D3DXVECTOR2 uv = GetUVForPosition( pPos );
-    float x = uv.x;
-    float z = uv.y;
-
-    // scale into heightmap space
-    x *= m_HeightMapX;
-    z *= m_HeightMapY;
-    x += 0.5f;
-    z += 0.5f;
-    if( x >= m_HeightMapX - 1 )
-        x = ( float )m_HeightMapX - 2;
-    if( z >= m_HeightMapY - 1 )
-        z = ( float )m_HeightMapY - 2;
-    z = max( 0, z );
-    x = max( 0, x );
+    UINT integer_X, integer_Z;
+    float fractional_X, fractional_Z;
+    GetMapCoord( pPos->x, m_HeightMapX, &integer_X, &fractional_X );
+    GetMapCoord( pPos->z, m_HeightMapY, &integer_Z, &fractional_Z );
 
     // bilinearly interpolate
-    unsigned long integer_X = unsigned long( x );
-    float fractional_X = x - integer_X;
-
-    unsigned long integer_Z = unsigned long( z );
-    float fractional_Z = z - integer_Z;
-
     float v1 = m_pHeightBits[ HEIGHT_INDEX( integer_X,    integer_Z ) ];
     float v2 = m_pHeightBits[ HEIGHT_INDEX( integer_X + 1,integer_Z ) ];
     float v3 = m_pHeightBits[ HEIGHT_INDEX( integer_X,    integer_Z + 1 ) ];
@@ -168,6 +301,26 @@ float CTerrain::GetHeightOnMap( D3DXVECTOR3* pPos )
 }
 
 
+//--------------------------------------------------------------------------------------
+// Where a world x or z falls between the texels of the heightmap
+//--------------------------------------------------------------------------------------
+void CTerrain::GetMapCoord( float fPos, UINT MapSize, UINT* pIndex, float* pFraction )
+{
+    // move into [0..1] range
+    float x = ( fPos / m_fWorldScale ) + 0.5f;
+
+    // scale into heightmap space
+    x *= MapSize;
+    x += 0.5f;
+    if( x >= MapSize - 1 )
+        x = ( float )MapSize - 2;
+    x = max( 0, x );
+
+    *pIndex = ( UINT )x;
+    *pFraction = x - *pIndex;
+}
+
+
 //--------------------------------------------------------------------------------------
 D3DXVECTOR3 CTerrain::GetNormalOnMap( D3DXVECTOR3* pPos )
 {
@@ -226,130 +379,272 @@ D3DXVECTOR2 CTerrain::GetUVForPosition( D3DXVECTOR3* pPos )
 
 
 //--------------------------------------------------------------------------------------
-HRESULT CTerrain::LoadBMPImage( WCHAR* strHeightMap )
+HRESULT CTerrain::LoadBMPImage( WCHAR* strHeightMap, UINT nThreads )
 {
     HANDLE hFile = CreateFile( strHeightMap, FILE_READ_DATA, FILE_SHARE_READ, NULL, OPEN_EXISTING,
                                FILE_FLAG_SEQUENTIAL_SCAN, NULL );
     if( INVALID_HANDLE_VALUE == hFile )
         return E_INVALIDARG;
 
-    DWORD dwBytesRead = 0;
+    HRESULT hr = E_FAIL;
+    BYTE* pBits = NULL;
 
-    // read the bfh
+    // read the bfh and the header
     BITMAPFILEHEADER bfh;
-    ReadFile( hFile, &bfh, sizeof( BITMAPFILEHEADER ), &dwBytesRead, NULL );
-    unsigned long toBitmapData = bfh.bfOffBits;
-    unsigned long bitmapSize = bfh.bfSize;
-
-    // read the header
     BITMAPINFOHEADER bih;
-    ReadFile( hFile, &bih, sizeof( BITMAPINFOHEADER ), &dwBytesRead, NULL );
-    if( bih.biCompression != BI_RGB )
-        goto Error;
-
-    // alloc memory
-    unsigned long U = m_HeightMapX = bih.biWidth;
-    unsigned long V = m_HeightMapY = abs( bih.biHeight );
-    m_pHeightBits = new float[ U * V ];
-    if( !m_pHeightBits )
-        return E_OUTOFMEMORY;
-
-    // find the step size
-    unsigned long iStep = 4;
-    if( 24 == bih.biBitCount )
-        iStep = 3;
-
-    // final check for size
-    unsigned long UNew = ( ( U * iStep * 8 + 31 ) & ~31 ) / ( 8 * iStep );
-    if( bitmapSize < UNew * V * iStep * sizeof( BYTE ) )
-        goto Error;
-
-    // seek
-    LARGE_INTEGER liMove;
-    liMove.QuadPart = toBitmapData;
-    if( !SetFilePointerEx( hFile, liMove, NULL, FILE_BEGIN ) )
-        goto Error;
-
-    // read in the bits
-    BYTE* pBits = new BYTE[ bitmapSize ];
-    if( !pBits )
-        return E_OUTOFMEMORY;
-    ReadFile( hFile, pBits, bitmapSize * sizeof( BYTE ), &dwBytesRead, NULL );
-
-    // Load the Height Information
-    unsigned long iHeight = 0;
-    unsigned long iBitmap = 0;
-    for( unsigned long y = 0; y < V; y++ )
+    if( !ReadAll( hFile, &bfh, sizeof( BITMAPFILEHEADER ) ) ||
+        !ReadAll( hFile, &bih, sizeof( BITMAPINFOHEADER ) ) )
+        goto Done;
+    if( bih.biCompression != BI_RGB || bih.biWidth <= 0 || bih.biHeight == 0 )
+        goto Done;
+
     {
-        iBitmap = y * UNew * iStep;
-        for( unsigned long x = 0; x < U * iStep; x += iStep )
+        // find the step size
+        UINT U = bih.biWidth;
+        UINT V = abs( bih.biHeight );
+        UINT iStep = ( 24 == bih.biBitCount ) ? 3 : 4;
+
+        // rows are padded to 4 bytes
+        UINT Pitch = ( ( U * iStep * 8 + 31 ) & ~31 ) / 8;
+        UINT64 cbBits = ( UINT64 )Pitch * V;
+
+        // seek
+        LARGE_INTEGER liMove;
+        liMove.QuadPart = bfh.bfOffBits;
+        if( !SetFilePointerEx( hFile, liMove, NULL, FILE_BEGIN ) )
+            goto Done;
+
+        // alloc memory and read in the bits
+        m_HeightMapX = U;
+        m_HeightMapY = V;
+        m_pHeightBits = new float[ ( SIZE_T )U * V ];
+        pBits = new BYTE[ ( SIZE_T )cbBits ];
+        if( !m_pHeightBits || !pBits )
         {
-            m_pHeightBits[iHeight] = 0;
-            for( unsigned long c = 0; c < iStep; c++ )
-            {
-                m_pHeightBits[iHeight] += pBits[ iBitmap + c ];
-            }
-            m_pHeightBits[iHeight] /= ( FLOAT )( iStep * 255.0 );
-            m_pHeightBits[iHeight] *= m_fHeightScale;
+            hr = E_OUTOFMEMORY;
+            goto Done;
+        }
+        if( !ReadAll( hFile, pBits, cbBits ) )
+            goto Done;
 
-            iHeight ++;
-            iBitmap += iStep;
+        // A pixel's height only depends on the sum of its channels, so each possible sum
+        // is converted once
+        float SumToHeight[4 * 255 + 1];
+        for( UINT i = 0; i <= iStep * 255; i++ )
+        {
+            SumToHeight[i] = ( float )i;
+            SumToHeight[i] /= ( FLOAT )( iStep * 255.0 );
+            SumToHeight[i] *= m_fHeightScale;
         }
+
+        // Load the Height Information, handing blocks of rows to the threads
+        TERRAIN_JOB Job;
+        ZeroMemory( &Job, sizeof( TERRAIN_JOB ) );
+        Job.pTerrain = this;
+        Job.pBits = pBits;
+        Job.Pitch = Pitch;
+        Job.BytesPerPixel = iStep;
+        Job.pSumToHeight = SumToHeight;
+        UINT nBlocks = ( V + TERRAIN_DECODE_ROWS - 1 ) / TERRAIN_DECODE_ROWS;
+        DXUTGetWorkerPool()->Run( DecodeProc, &Job, nBlocks, nThreads );
     }
 
+    hr = S_OK;
+
+Done:
     SAFE_DELETE_ARRAY( pBits );
+    CloseHandle( hFile );
+    return hr;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CTerrain::DecodeRows( const TERRAIN_JOB* pJob, UINT iFirstRow, UINT nRows )
+{
+    const float* pSumToHeight = pJob->pSumToHeight;
+    for( UINT y = iFirstRow; y < iFirstRow + nRows; y++ )
+    {
+        const BYTE* pSrc = pJob->pBits + ( SIZE_T )y * pJob->Pitch;
+        float* pDest = m_pHeightBits + ( SIZE_T )y * m_HeightMapX;
+        if( 3 == pJob->BytesPerPixel )
+        {
+            for( UINT x = 0; x < m_HeightMapX; x++, pSrc += 3 )
+                pDest[x] = pSumToHeight[ pSrc[0] + pSrc[1] + pSrc[2] ];
+        }
+        else
+        {
+            for( UINT x = 0; x < m_HeightMapX; x++, pSrc += 4 )
+                pDest[x] = pSumToHeight[ pSrc[0] + pSrc[1] + pSrc[2] + pSrc[3] ];
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Fills in a tile's vertices and the height of its bounding box.  The heights under the
+// tile and one vertex around it are sampled first, a row at a time, and the normals are
+// taken from those: a vertex's neighbours in the grid are the points GetNormalOnMap
+// samples.
+//--------------------------------------------------------------------------------------
+void CTerrain::GenerateTile( UINT iTile, float* pHeights, UINT* pColumns, float* pFractions )
+{
+    TERRAIN_TILE* pTile = &m_pTiles[iTile];
+    const UINT Side = m_NumSidesPerTile + 1;
+    const UINT BlockSide = Side + 2;
+    const float fTileSize = m_fWorldScale / ( float )m_SqrtNumTiles;
+    const float fDelta = fTileSize / ( float )m_NumSidesPerTile;
+
+    BOUNDING_BOX BBox;
+    BBox.min.x = -m_fWorldScale / 2.0f + ( iTile % m_SqrtNumTiles ) * fTileSize;
+    BBox.min.z = -m_fWorldScale / 2.0f + ( iTile / m_SqrtNumTiles ) * fTileSize;
+    BBox.max.x = BBox.min.x + fTileSize;
+    BBox.max.z = BBox.min.z + fTileSize;
+    BBox.min.y = FLT_MAX;
+    BBox.max.y = -FLT_MAX;
+
+    // Where each column falls on the heightmap is the same for every row
+    for( UINT x = 0; x < BlockSide; x++ )
+        GetMapCoord( BBox.min.x + ( ( float )x - 1.0f ) * fDelta, m_HeightMapX, &pColumns[x], &pFractions[x] );
+
+    for( UINT z = 0; z < BlockSide; z++ )
+    {
+        UINT integer_Z;
+        float fractional_Z;
+        GetMapCoord( BBox.min.z + ( ( float )z - 1.0f ) * fDelta, m_HeightMapY, &integer_Z, &fractional_Z );
+
+        const float* pRow0 = m_pHeightBits + ( SIZE_T )integer_Z * m_HeightMapX;
+        const float* pRow1 = pRow0 + m_HeightMapX;
+        float* pDest = pHeights + z * BlockSide;
+        for( UINT x = 0; x < BlockSide; x++ )
+        {
+            UINT integer_X = pColumns[x];
+            float fractional_X = pFractions[x];
+            float i1 = LINEAR_INTERPOLATE( pRow0[integer_X], pRow0[integer_X + 1], fractional_X );
+            float i2 = LINEAR_INTERPOLATE( pRow1[integer_X], pRow1[integer_X + 1], fractional_X );
+            pDest[x] = LINEAR_INTERPOLATE( i1, i2, fractional_Z );
+        }
+    }
+
+    // With e0 from the left to the right neighbour and e1 from the one below to the one
+    // above, the normal e1 x e0 comes down to this, before it is normalized
+    const float fTwoDelta = 2.0f * fDelta;
+    TERRAIN_VERTEX* pVertex = pTile->pRawVertices;
+    for( UINT z = 0; z < Side; z++ )
+    {
+        // Rows of the block, starting at the column left of the tile
+        const float* pRowDown = pHeights + z * BlockSide;
+        const float* pRow = pRowDown + BlockSide;
+        const float* pRowUp = pRow + BlockSide;
+        float zPos = BBox.min.z + ( float )z * fDelta;
+        for( UINT x = 0; x < Side; x++, pVertex++ )
+        {
+            float y = pRow[x + 1];
+            pVertex->pos = D3DXVECTOR3( BBox.min.x + ( float )x * fDelta, y, zPos );
+            pVertex->uv.x = ( float )x / ( ( float )m_NumSidesPerTile );
+            pVertex->uv.y = 1.0f - ( float )z / ( ( float )m_NumSidesPerTile );
 
-    return S_OK;
+            D3DXVECTOR3 norm( pRow[x] - pRow[x + 2], fTwoDelta, pRowDown[x + 1] - pRowUp[x + 1] );
+            float fInvLength = 1.0f / sqrtf( norm.x * norm.x + norm.y * norm.y + norm.z * norm.z );
+            pVertex->norm = norm * fInvLength;
 
-Error:
+            BBox.min.y = min( BBox.min.y, y );
+            BBox.max.y = max( BBox.max.y, y );
+        }
+    }
+
+    pTile->BBox = BBox;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CTerrain::DecodeProc( void* pContext, UINT iBlock, UINT iThread )
+{
+    UNREFERENCED_PARAMETER( iThread );
+    const TERRAIN_JOB* pJob = ( const TERRAIN_JOB* )pContext;
+    CTerrain* pTerrain = pJob->pTerrain;
+
+    UINT iFirstRow = iBlock * TERRAIN_DECODE_ROWS;
+    UINT nRows = min( ( UINT )TERRAIN_DECODE_ROWS, pTerrain->m_HeightMapY - iFirstRow );
+    pTerrain->DecodeRows( pJob, iFirstRow, nRows );
+}
+
+
+//--------------------------------------------------------------------------------------
+void CTerrain::TileProc( void* pContext, UINT iTile, UINT iThread )
+{
+    const TERRAIN_JOB* pJob = ( const TERRAIN_JOB* )pContext;
+    const UINT BlockSide = pJob->BlockSide;
+
+    pJob->pTerrain->GenerateTile( iTile, pJob->pHeights + ( SIZE_T )iThread * BlockSide * BlockSide,
+                                  pJob->pColumns + iThread * BlockSide, pJob->pFractions + iThread * BlockSide );
+}
+
+
+//--------------------------------------------------------------------------------------
+bool CTerrain::LoadTileCache( const WCHAR* strTileCache, const TERRAIN_CACHE_HEADER& Header )
+{
+    HANDLE hFile = CreateFile( strTileCache, FILE_READ_DATA, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                               FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+    if( INVALID_HANDLE_VALUE == hFile )
+        return false;
+
+    // A cache that was not finished is shorter than it should be
+    UINT64 cVertexBytes = ( UINT64 )m_NumTiles * GetNumTileVertices() * sizeof( TERRAIN_VERTEX );
+    UINT64 cExpected = sizeof( TERRAIN_CACHE_HEADER ) + m_NumTiles * sizeof( TERRAIN_CACHE_TILE ) + cVertexBytes;
+    LARGE_INTEGER FileSize;
+    TERRAIN_CACHE_HEADER FileHeader;
+    CGrowableArray <TERRAIN_CACHE_TILE> CacheTiles;
+    bool bRet = false;
+    if( !GetFileSizeEx( hFile, &FileSize ) || ( UINT64 )FileSize.QuadPart != cExpected )
+        goto Done;
+    if( !ReadAll( hFile, &FileHeader, sizeof( TERRAIN_CACHE_HEADER ) ) ||
+        0 != memcmp( &FileHeader, &Header, sizeof( TERRAIN_CACHE_HEADER ) ) )
+        goto Done;
+    if( FAILED( CacheTiles.SetSize( m_NumTiles ) ) ||
+        !ReadAll( hFile, CacheTiles.GetData(), m_NumTiles * sizeof( TERRAIN_CACHE_TILE ) ) ||
+        !ReadAll( hFile, m_pVertices, cVertexBytes ) )
+        goto Done;
+
+    for( UINT i = 0; i < m_NumTiles; i++ )
+    {
+        m_pTiles[i].Color = CacheTiles[i].Color;
+        m_pTiles[i].BBox = CacheTiles[i].BBox;
+    }
+    bRet = true;
+
+Done:
     CloseHandle( hFile );
-    return E_FAIL;
+    return bRet;
 }
 
 
 //--------------------------------------------------------------------------------------
-HRESULT CTerrain::GenerateTile( TERRAIN_TILE* pTile, BOUNDING_BOX* pBBox )
+// The cache only saves time, so failing to write it is not an error
+//--------------------------------------------------------------------------------------
+void CTerrain::SaveTileCache( const WCHAR* strTileCache, const TERRAIN_CACHE_HEADER& Header )
 {
-    HRESULT hr = S_OK;
+    HANDLE hFile = CreateFile( strTileCache, FILE_WRITE_DATA, 0, NULL, CREATE_ALWAYS, FILE_FLAG_SEQUENTIAL_SCAN,
+                               NULL );
+    if( INVALID_HANDLE_VALUE == hFile )
+        return;
 
-    // Alloc memory for the vertices
-    pTile->NumVertices = ( m_NumSidesPerTile + 1 ) * ( m_NumSidesPerTile + 1 );
-    pTile->pRawVertices = new TERRAIN_VERTEX[ pTile->NumVertices ];
-    if( !pTile->pRawVertices )
-        return E_OUTOFMEMORY;
-
-    pTile->BBox = *pBBox;
-    pTile->Color.x = 0.60f + RPercent() * 0.40f;
-    pTile->Color.y = 0.60f + RPercent() * 0.40f;
-    pTile->Color.z = 0.60f + RPercent() * 0.40f;
-    pTile->Color.w = 1.0f;
-
-    UINT iVertex = 0;
-    float zStart = pBBox->min.z;
-    float xDelta = ( pBBox->max.x - pBBox->min.x ) / ( float )m_NumSidesPerTile;
-    float zDelta = ( pBBox->max.z - pBBox->min.z ) / ( float )m_NumSidesPerTile;
-
-    // Loop through terrain vertices and get height from the heightmap
-    for( UINT z = 0; z < m_NumSidesPerTile + 1; z++ )
+    CGrowableArray <TERRAIN_CACHE_TILE> CacheTiles;
+    bool bWritten = SUCCEEDED( CacheTiles.SetSize( m_NumTiles ) );
+    if( bWritten )
     {
-        float xStart = pBBox->min.x;
-        for( UINT x = 0; x < m_NumSidesPerTile + 1; x++ )
+        for( UINT i = 0; i < m_NumTiles; i++ )
         {
-            D3DXVECTOR3 pos( xStart,0,zStart );
-            D3DXVECTOR3 norm;
-            pos.y = GetHeightOnMap( &pos );
-            pTile->pRawVertices[iVertex].pos = pos;
-            //pTile->pRawVertices[iVertex].uv = GetUVForPosition( &pos );
-            //pTile->pRawVertices[iVertex].uv.y = 1.0f - pTile->pRawVertices[iVertex].uv.y;
-            pTile->pRawVertices[iVertex].uv.x = ( float )x / ( ( float )m_NumSidesPerTile );
-            pTile->pRawVertices[iVertex].uv.y = 1.0f - ( float )z / ( ( float )m_NumSidesPerTile );
-            pTile->pRawVertices[iVertex].norm = GetNormalOnMap( &pos );
-
-            iVertex ++;
-            xStart += xDelta;
+            CacheTiles[i].Color = m_pTiles[i].Color;
+            CacheTiles[i].BBox = m_pTiles[i].BBox;
         }
-        zStart += zDelta;
+
+        bWritten = WriteAll( hFile, &Header, sizeof( TERRAIN_CACHE_HEADER ) ) &&
+                   WriteAll( hFile, CacheTiles.GetData(), m_NumTiles * sizeof( TERRAIN_CACHE_TILE ) ) &&
+                   WriteAll( hFile, m_pVertices,
+                             ( UINT64 )m_NumTiles * GetNumTileVertices() * sizeof( TERRAIN_VERTEX ) );
     }
+    CloseHandle( hFile );
 
-    return hr;
+    if( !bWritten )
+        DeleteFile( strTileCache );
 }
@@ -27,6 +27,17 @@ struct TERRAIN_TILE
     BOUNDING_BOX BBox;
 };
 
+struct TERRAIN_LOAD_STATS
+{
+    float fDecodeMs;            // Reading and converting the heightmap
+    float fTilesMs;             // Generating the tiles or reading them from the cache
+    UINT nThreads;
+    bool bTilesFromCache;
+};
+
+struct TERRAIN_JOB;
+struct TERRAIN_CACHE_HEADER;
+
 class CTerrain
 {
 private:
@@ -43,12 +54,20 @@ private:
     UINT m_NumIndices;
     SHORT* m_pTerrainRawIndices;
 
+    TERRAIN_VERTEX* m_pVertices;    // Every tile's vertices, one tile after another
+    TERRAIN_LOAD_STATS m_LoadStats;
+
 public:
                 CTerrain();
                 ~CTerrain();
 
+    // Tiles are generated on up to nThreads threads of the DXUT worker pool, or all of
+    // them for 0.  If strTileCache is given the tiles are read from it when it was
+    // written from the same heightmap with the same parameters, and written to it
+    // otherwise.
     HRESULT     LoadTerrain( WCHAR* strHeightMap, UINT SqrtNumTiles, UINT NumSidesPerTile, float fWorldScale,
-                             float fHeightScale, bool bCreateTiles );
+                             float fHeightScale, bool bCreateTiles, const WCHAR* strTileCache = NULL,
+                             UINT nThreads = 0 );
     float       GetHeightForTile( UINT iTile, D3DXVECTOR3* pPos );
     float       GetHeightOnMap( D3DXVECTOR3* pPos );
     D3DXVECTOR3 GetNormalOnMap( D3DXVECTOR3* pPos );
@@ -77,11 +96,22 @@ public:
     {
         return ( m_NumSidesPerTile + 1 ) * ( m_NumSidesPerTile + 1 );
     }
+    const TERRAIN_LOAD_STATS& GetLoadStats()
+    {
+        return m_LoadStats;
+    }
 
 protected:
     D3DXVECTOR2 GetUVForPosition( D3DXVECTOR3* pPos );
-    HRESULT     LoadBMPImage( WCHAR* strHeightMap );
-    HRESULT     GenerateTile( TERRAIN_TILE* pTile, BOUNDING_BOX* pBBox );
+    void        GetMapCoord( float fPos, UINT MapSize, UINT* pIndex, float* pFraction );
+    HRESULT     LoadBMPImage( WCHAR* strHeightMap, UINT nThreads );
+    void        DecodeRows( const TERRAIN_JOB* pJob, UINT iFirstRow, UINT nRows );
+    void        GenerateTile( UINT iTile, float* pHeights, UINT* pColumns, float* pFractions );
+    bool        LoadTileCache( const WCHAR* strTileCache, const TERRAIN_CACHE_HEADER& Header );
+    void        SaveTileCache( const WCHAR* strTileCache, const TERRAIN_CACHE_HEADER& Header );
+
+    static void DecodeProc( void* pContext, UINT iBlock, UINT iThread );
+    static void TileProc( void* pContext, UINT iTile, UINT iThread );
 };
 
 float RPercent();
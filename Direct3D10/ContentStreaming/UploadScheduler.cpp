@@ -0,0 +1,359 @@
+//--------------------------------------------------------------------------------------
+// File: UploadScheduler.cpp
+//
+// Illustrates streaming content using Direct3D 9/10
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "UploadScheduler.h"
+
+// Weight of each new sample in the cost averages
+#define UPLOAD_COST_WEIGHT  0.1
+
+//--------------------------------------------------------------------------------------
+CUploadCostModel::CUploadCostModel()
+{
+    Reset();
+}
+
+//--------------------------------------------------------------------------------------
+void CUploadCostModel::Reset()
+{
+    m_fMeanBytes = 0.0;
+    m_fMeanMs = 0.0;
+    m_fMeanBytesSq = 0.0;
+    m_fMeanBytesMs = 0.0;
+    m_nSamples = 0;
+}
+
+//--------------------------------------------------------------------------------------
+void CUploadCostModel::AddSample( SIZE_T cBytes, float fMs )
+{
+    double fBytes = ( double )cBytes;
+
+    // Plain averages until there are enough samples for the weighted ones to settle
+    m_nSamples++;
+    double fWeight = 1.0 / m_nSamples;
+    if( fWeight < UPLOAD_COST_WEIGHT )
+        fWeight = UPLOAD_COST_WEIGHT;
+
+    m_fMeanBytes += ( fBytes - m_fMeanBytes ) * fWeight;
+    m_fMeanMs += ( fMs - m_fMeanMs ) * fWeight;
+    m_fMeanBytesSq += ( fBytes * fBytes - m_fMeanBytesSq ) * fWeight;
+    m_fMeanBytesMs += ( fBytes * fMs - m_fMeanBytesMs ) * fWeight;
+}
+
+//--------------------------------------------------------------------------------------
+// Least squares fit of the averages.  If the sizes have all been about the same there
+// is nothing to fit a slope to, so the time is scaled by size from the average.
+//--------------------------------------------------------------------------------------
+float CUploadCostModel::PredictMs( SIZE_T cBytes ) const
+{
+    double fBytes = ( double )cBytes;
+
+    // Until something has been measured, guess 50us plus 1ms per MB
+    if( 0 == m_nSamples )
+        return ( float )( 0.05 + fBytes / ( 1024.0 * 1024.0 ) );
+
+    double fVariance = m_fMeanBytesSq - m_fMeanBytes * m_fMeanBytes;
+    if( fVariance <= 0.01 * m_fMeanBytes * m_fMeanBytes || fVariance <= 1.0 )
+    {
+        if( m_fMeanBytes < 1.0 )
+            return ( float )m_fMeanMs;
+        return ( float )( m_fMeanMs * fBytes / m_fMeanBytes );
+    }
+
+    double fPerByte = ( m_fMeanBytesMs - m_fMeanBytes * m_fMeanMs ) / fVariance;
+    double fFixed = m_fMeanMs - fPerByte * m_fMeanBytes;
+    if( fPerByte < 0.0 )
+    {
+        // Bigger isn't slower; the average is the best guess
+        fPerByte = 0.0;
+        fFixed = m_fMeanMs;
+    }
+    else if( fFixed < 0.0 )
+    {
+        // Fit through zero instead
+        fPerByte = m_fMeanBytesMs / m_fMeanBytesSq;
+        fFixed = 0.0;
+    }
+
+    return ( float )( fFixed + fPerByte * fBytes );
+}
+
+
+//--------------------------------------------------------------------------------------
+CUploadScheduler::CUploadScheduler()
+{
+    GetDefaultSettings( &m_Settings );
+    Reset();
+}
+
+//--------------------------------------------------------------------------------------
+void CUploadScheduler::GetDefaultSettings( UPLOAD_BUDGET_SETTINGS* pSettings )
+{
+    pSettings->fTargetFrameMs = 1000.0f / 60.0f;
+    pSettings->fMinBudgetMs = 0.5f;
+    pSettings->fMaxBudgetMs = 8.0f;
+    pSettings->fStartBudgetMs = 2.0f;
+    pSettings->fIncreaseMs = 0.25f;
+    pSettings->fDecreaseFactor = 0.7f;
+    pSettings->cMaxBytesPerFrame = 0;
+}
+
+//--------------------------------------------------------------------------------------
+void CUploadScheduler::SetSettings( const UPLOAD_BUDGET_SETTINGS& Settings )
+{
+    m_Settings = Settings;
+    if( m_fBudgetMs < m_Settings.fMinBudgetMs )
+        m_fBudgetMs = m_Settings.fMinBudgetMs;
+    if( m_fBudgetMs > m_Settings.fMaxBudgetMs )
+        m_fBudgetMs = m_Settings.fMaxBudgetMs;
+}
+
+//--------------------------------------------------------------------------------------
+void CUploadScheduler::Reset()
+{
+    for( UINT i = 0; i < UPLOAD_NUM_TYPES; i++ )
+    {
+        for( UINT j = 0; j < UPLOAD_NUM_STEPS; j++ )
+            m_Costs[i][j].Reset();
+    }
+
+    m_fBudgetMs = m_Settings.fStartBudgetMs;
+    m_fSpentMs = 0.0f;
+    m_cBytes = 0;
+    m_nItems = 0;
+    m_bDeferred = false;
+}
+
+//--------------------------------------------------------------------------------------
+// Shrinks the budget by a factor when the last frame was late, and grows it by a step
+// when it was on time but had to hold requests back.  A late frame may not be the
+// loader's fault, but backing off quickly and creeping back keeps hitches short.
+//--------------------------------------------------------------------------------------
+void CUploadScheduler::BeginFrame( float fLastFrameMs )
+{
+    if( fLastFrameMs > m_Settings.fTargetFrameMs )
+        m_fBudgetMs *= m_Settings.fDecreaseFactor;
+    else if( m_bDeferred )
+        m_fBudgetMs += m_Settings.fIncreaseMs;
+
+    if( m_fBudgetMs < m_Settings.fMinBudgetMs )
+        m_fBudgetMs = m_Settings.fMinBudgetMs;
+    if( m_fBudgetMs > m_Settings.fMaxBudgetMs )
+        m_fBudgetMs = m_Settings.fMaxBudgetMs;
+
+    m_fSpentMs = 0.0f;
+    m_cBytes = 0;
+    m_nItems = 0;
+    m_bDeferred = false;
+}
+
+//--------------------------------------------------------------------------------------
+bool CUploadScheduler::CanService( UPLOAD_TYPE Type, UPLOAD_STEP Step, SIZE_T cBytes )
+{
+    if( 0 == m_nItems )
+        return true;
+
+    if( m_Settings.cMaxBytesPerFrame && m_cBytes + cBytes > m_Settings.cMaxBytesPerFrame )
+    {
+        m_bDeferred = true;
+        return false;
+    }
+
+    if( m_fSpentMs + PredictMs( Type, Step, cBytes ) > m_fBudgetMs )
+    {
+        m_bDeferred = true;
+        return false;
+    }
+
+    return true;
+}
+
+//--------------------------------------------------------------------------------------
+void CUploadScheduler::ItemServiced( UPLOAD_TYPE Type, UPLOAD_STEP Step, SIZE_T cBytes, float fMs )
+{
+    m_Costs[Type][Step].AddSample( cBytes, fMs );
+    m_fSpentMs += fMs;
+    m_cBytes += cBytes;
+    m_nItems++;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Simulation
+//--------------------------------------------------------------------------------------
+struct UPLOAD_SIM_ITEM
+{
+    UPLOAD_TYPE Type;
+    UPLOAD_STEP Step;
+    SIZE_T cBytes;
+    UINT nArrivedFrame;
+    UINT nReadyFrame;           // Frame the copy finishes, for items waiting to unlock
+};
+
+// Fixed ms and ms per MB of each step on the simulated device
+static const float g_afSimFixedMs[UPLOAD_NUM_TYPES][UPLOAD_NUM_STEPS] =
+{
+    { 0.05f, 0.10f },   // Texture: map the staging texture, then copy it to the real one
+    { 0.02f, 0.03f },   // Vertex buffer
+    { 0.02f, 0.03f },   // Index buffer
+    { 0.02f, 0.02f },
+};
+static const float g_afSimMsPerMB[UPLOAD_NUM_TYPES][UPLOAD_NUM_STEPS] =
+{
+    { 0.02f, 1.20f },
+    { 0.01f, 0.80f },
+    { 0.01f, 0.80f },
+    { 0.00f, 0.00f },
+};
+
+//--------------------------------------------------------------------------------------
+// A small generator of its own so runs are the same everywhere.  Returns 0 to 1.
+//--------------------------------------------------------------------------------------
+static float SimRandom( UINT* pnState )
+{
+    *pnState = *pnState * 1664525 + 1013904223;
+    return ( *pnState >> 8 ) / ( float )( 1 << 24 );
+}
+
+//--------------------------------------------------------------------------------------
+static SIZE_T SimRandomBytes( UINT* pnState, SIZE_T cMin, SIZE_T cMax )
+{
+    // Evenly spread over powers of two, as texture sizes are
+    double fLog = log( ( double )cMin ) + SimRandom( pnState ) * ( log( ( double )cMax ) - log( ( double )cMin ) );
+    return ( SIZE_T )exp( fLog );
+}
+
+//--------------------------------------------------------------------------------------
+void GetDefaultUploadWorkload( UPLOAD_SIM_WORKLOAD* pWorkload )
+{
+    pWorkload->nFrames = 3000;
+    pWorkload->nBurstInterval = 150;
+    pWorkload->nItemsPerBurst = 120;
+    pWorkload->cMinTextureBytes = 64 * 1024;
+    pWorkload->cMaxTextureBytes = 4 * 1024 * 1024;
+    pWorkload->fFrameMs = 9.0f;
+    pWorkload->fFrameJitterMs = 1.0f;
+    pWorkload->fStallChance = 0.005f;
+    pWorkload->fStallMs = 4.0f;
+    pWorkload->nSeed = 1;
+}
+
+//--------------------------------------------------------------------------------------
+void RunUploadSimulation( const UPLOAD_SIM_WORKLOAD& Workload, const UPLOAD_BUDGET_SETTINGS* pSettings,
+                          UINT nMaxItemsPerFrame, float fTargetFrameMs, UPLOAD_SIM_RESULT* pResult )
+{
+    ZeroMemory( pResult, sizeof( UPLOAD_SIM_RESULT ) );
+
+    CUploadScheduler Scheduler;
+    if( pSettings )
+        Scheduler.SetSettings( *pSettings );
+
+    CGrowableArray <UPLOAD_SIM_ITEM> Queue;         // Waiting for the graphics thread
+    CGrowableArray <UPLOAD_SIM_ITEM> Copying;       // Locked, being filled by another thread
+    CDXUTFrameTimeHistogram Histogram;
+    UINT nState = Workload.nSeed;
+    double fTotalLatency = 0.0;
+    double fTotalBytes = 0.0;
+    float fLastFrameMs = Workload.fFrameMs;
+
+    for( UINT nFrame = 0; nFrame < Workload.nFrames; nFrame++ )
+    {
+        // New requests
+        if( Workload.nBurstInterval && 0 == nFrame % Workload.nBurstInterval )
+        {
+            for( UINT i = 0; i < Workload.nItemsPerBurst; i++ )
+            {
+                UPLOAD_SIM_ITEM Item;
+                float fKind = SimRandom( &nState );
+                if( fKind < 0.7f )
+                {
+                    Item.Type = UPLOAD_TYPE_TEXTURE;
+                    Item.cBytes = SimRandomBytes( &nState, Workload.cMinTextureBytes, Workload.cMaxTextureBytes );
+                }
+                else if( fKind < 0.85f )
+                {
+                    Item.Type = UPLOAD_TYPE_VERTEXBUFFER;
+                    Item.cBytes = SimRandomBytes( &nState, 64 * 1024, 512 * 1024 );
+                }
+                else
+                {
+                    Item.Type = UPLOAD_TYPE_INDEXBUFFER;
+                    Item.cBytes = SimRandomBytes( &nState, 32 * 1024, 256 * 1024 );
+                }
+                Item.Step = UPLOAD_STEP_LOCK;
+                Item.nArrivedFrame = nFrame;
+                Item.nReadyFrame = nFrame;
+                Queue.Add( Item );
+            }
+        }
+
+        // Copies that have finished join the back of the queue
+        for( int i = 0; i < Copying.GetSize(); )
+        {
+            if( Copying[i].nReadyFrame <= nFrame )
+            {
+                Queue.Add( Copying[i] );
+                Copying.Remove( i );
+            }
+            else
+                i++;
+        }
+
+        float fFrameMs = Workload.fFrameMs + ( SimRandom( &nState ) * 2.0f - 1.0f ) * Workload.fFrameJitterMs;
+        if( pSettings )
+            Scheduler.BeginFrame( fLastFrameMs );
+
+        UINT nServiced = 0;
+        while( Queue.GetSize() > 0 && nServiced < nMaxItemsPerFrame )
+        {
+            UPLOAD_SIM_ITEM Item = Queue[0];
+            if( pSettings && !Scheduler.CanService( Item.Type, Item.Step, Item.cBytes ) )
+                break;
+            Queue.Remove( 0 );
+            nServiced++;
+
+            float fMs = g_afSimFixedMs[Item.Type][Item.Step] +
+                g_afSimMsPerMB[Item.Type][Item.Step] * ( float )( Item.cBytes / ( 1024.0 * 1024.0 ) );
+            fMs *= 0.75f + 0.5f * SimRandom( &nState );
+            if( SimRandom( &nState ) < Workload.fStallChance )
+                fMs += Workload.fStallMs;
+
+            fFrameMs += fMs;
+            if( pSettings )
+                Scheduler.ItemServiced( Item.Type, Item.Step, Item.cBytes, fMs );
+
+            if( UPLOAD_STEP_LOCK == Item.Step )
+            {
+                Item.Step = UPLOAD_STEP_UNLOCK;
+                Item.nReadyFrame = nFrame + 2;
+                Copying.Add( Item );
+            }
+            else
+            {
+                pResult->nItemsDone++;
+                fTotalLatency += nFrame - Item.nArrivedFrame;
+                fTotalBytes += ( double )Item.cBytes;
+            }
+        }
+
+        Histogram.Record( fFrameMs );
+        if( fFrameMs > fTargetFrameMs )
+            pResult->nFramesOverTarget++;
+        fLastFrameMs = fFrameMs;
+    }
+
+    // Each request is in one of the two lists until it is done
+    pResult->nItemsLeft = Queue.GetSize() + Copying.GetSize();
+
+    pResult->fMeanFrameMs = ( float )Histogram.GetMeanMs();
+    pResult->fP99FrameMs = ( float )Histogram.GetPercentileMs( 99.0 );
+    pResult->fMaxFrameMs = ( float )Histogram.GetMaxMs();
+    pResult->fMeanLatencyFrames = pResult->nItemsDone ? ( float )( fTotalLatency / pResult->nItemsDone ) : 0.0f;
+    pResult->fMBUploaded = fTotalBytes / ( 1024.0 * 1024.0 );
+    pResult->fFinalBudgetMs = pSettings ? Scheduler.GetBudgetMs() : 0.0f;
+}
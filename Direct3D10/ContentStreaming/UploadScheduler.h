@@ -0,0 +1,181 @@
+//--------------------------------------------------------------------------------------
+// File: UploadScheduler.h
+//
+// Decides how much device work the graphics thread does for the async loader each
+// frame.  Instead of a fixed number of requests, each frame gets a time budget and an
+// optional byte budget.  The cost of each kind of request is learned from how long it
+// actually took, as a fixed cost plus a cost per byte, so a request is only started if
+// it is expected to fit in what is left of the budget.  The budget itself follows the
+// frame time: it shrinks quickly when frames run over the target and grows slowly while
+// there is work waiting and frames are on time.
+//
+// Nothing here touches a device, so the scheduler can be driven by the simulated
+// device below to tune it without a GPU.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#pragma once
+#ifndef UPLOAD_SCHEDULER_H
+#define UPLOAD_SCHEDULER_H
+
+enum UPLOAD_TYPE
+{
+    UPLOAD_TYPE_TEXTURE = 0,
+    UPLOAD_TYPE_VERTEXBUFFER,
+    UPLOAD_TYPE_INDEXBUFFER,
+    UPLOAD_TYPE_OTHER,
+    UPLOAD_NUM_TYPES
+};
+
+// The two visits a request makes to the graphics thread
+enum UPLOAD_STEP
+{
+    UPLOAD_STEP_LOCK = 0,
+    UPLOAD_STEP_UNLOCK,
+    UPLOAD_NUM_STEPS
+};
+
+struct UPLOAD_BUDGET_SETTINGS
+{
+    float fTargetFrameMs;       // Frames longer than this shrink the budget
+    float fMinBudgetMs;
+    float fMaxBudgetMs;
+    float fStartBudgetMs;
+    float fIncreaseMs;          // Added each frame that is on time with work left over
+    float fDecreaseFactor;      // Applied each frame that is over the target
+    SIZE_T cMaxBytesPerFrame;   // 0 for no byte budget
+};
+
+//--------------------------------------------------------------------------------------
+// Learns the cost of one kind of request.  Keeps exponentially weighted averages of
+// the sizes and times so it follows changes, and fits time = fixed + per byte * size.
+//--------------------------------------------------------------------------------------
+class CUploadCostModel
+{
+public:
+                    CUploadCostModel();
+
+    void            Reset();
+    void            AddSample( SIZE_T cBytes, float fMs );
+    float           PredictMs( SIZE_T cBytes ) const;
+    UINT            GetSampleCount() const
+    {
+        return m_nSamples;
+    }
+
+protected:
+    double m_fMeanBytes;
+    double m_fMeanMs;
+    double m_fMeanBytesSq;
+    double m_fMeanBytesMs;
+    UINT m_nSamples;
+};
+
+//--------------------------------------------------------------------------------------
+class CUploadScheduler
+{
+public:
+                    CUploadScheduler();
+
+    void            SetSettings( const UPLOAD_BUDGET_SETTINGS& Settings );
+    const UPLOAD_BUDGET_SETTINGS& GetSettings() const
+    {
+        return m_Settings;
+    }
+
+    // Forgets the learned costs and restarts the budget
+    void            Reset();
+
+    // Starts a frame's budget.  fLastFrameMs is the length of the last frame.
+    void            BeginFrame( float fLastFrameMs );
+
+    // Returns true if a request is expected to fit in what is left of the frame's
+    // budget.  The first request of each frame is always allowed, so even requests
+    // bigger than the budget get through.
+    bool            CanService( UPLOAD_TYPE Type, UPLOAD_STEP Step, SIZE_T cBytes );
+
+    // Charges a request to the frame and learns from how long it took
+    void            ItemServiced( UPLOAD_TYPE Type, UPLOAD_STEP Step, SIZE_T cBytes, float fMs );
+
+    // Charges time to the frame that says nothing about what a request costs, such as
+    // finding there is no free resource to lock yet
+    void            AddSpentMs( float fMs )
+    {
+        m_fSpentMs += fMs;
+    }
+
+    float           PredictMs( UPLOAD_TYPE Type, UPLOAD_STEP Step, SIZE_T cBytes ) const
+    {
+        return m_Costs[Type][Step].PredictMs( cBytes );
+    }
+    float           GetBudgetMs() const
+    {
+        return m_fBudgetMs;
+    }
+    float           GetSpentMs() const
+    {
+        return m_fSpentMs;
+    }
+    SIZE_T          GetBytesThisFrame() const
+    {
+        return m_cBytes;
+    }
+    UINT            GetItemsThisFrame() const
+    {
+        return m_nItems;
+    }
+
+    static void     GetDefaultSettings( UPLOAD_BUDGET_SETTINGS* pSettings );
+
+protected:
+    UPLOAD_BUDGET_SETTINGS m_Settings;
+    CUploadCostModel m_Costs[UPLOAD_NUM_TYPES][UPLOAD_NUM_STEPS];
+    float m_fBudgetMs;
+    float m_fSpentMs;
+    SIZE_T m_cBytes;
+    UINT m_nItems;
+    bool m_bDeferred;           // A request was held back this frame
+};
+
+//--------------------------------------------------------------------------------------
+// Simulated device and workload.  Requests arrive in bursts, as when the camera moves
+// into a new part of the level, and each one is locked, copied by another thread for a
+// couple of frames, then unlocked.  Each step costs a fixed time plus a time per byte
+// with some noise and the odd driver stall, on top of the rest of the frame.
+//--------------------------------------------------------------------------------------
+struct UPLOAD_SIM_WORKLOAD
+{
+    UINT nFrames;
+    UINT nBurstInterval;        // Frames between bursts
+    UINT nItemsPerBurst;
+    SIZE_T cMinTextureBytes;
+    SIZE_T cMaxTextureBytes;
+    float fFrameMs;             // Frame time without any loading
+    float fFrameJitterMs;
+    float fStallChance;         // Chance a step stalls the driver
+    float fStallMs;
+    UINT nSeed;
+};
+
+struct UPLOAD_SIM_RESULT
+{
+    float fMeanFrameMs;
+    float fP99FrameMs;
+    float fMaxFrameMs;
+    UINT nFramesOverTarget;
+    UINT nItemsDone;
+    UINT nItemsLeft;
+    float fMeanLatencyFrames;   // From arriving to being unlocked
+    double fMBUploaded;
+    float fFinalBudgetMs;
+};
+
+void GetDefaultUploadWorkload( UPLOAD_SIM_WORKLOAD* pWorkload );
+
+// Runs the workload with a budget, or with pSettings NULL, servicing up to
+// nMaxItemsPerFrame requests a frame whatever they cost as the sample used to
+void RunUploadSimulation( const UPLOAD_SIM_WORKLOAD& Workload, const UPLOAD_BUDGET_SETTINGS* pSettings,
+                          UINT nMaxItemsPerFrame, float fTargetFrameMs, UPLOAD_SIM_RESULT* pResult );
+
+#endif
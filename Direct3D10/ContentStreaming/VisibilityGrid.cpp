@@ -0,0 +1,554 @@
+//--------------------------------------------------------------------------------------
+// File: VisibilityGrid.cpp
+//
+// Spatial index over the level items of the ContentStreaming sample
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "VisibilityGrid.h"
+#include <float.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define VIS_SSE
+#endif
+
+// Bit of m_pFlags holding this query's membership of a set
+#define VIS_CURRENT_SHIFT   2
+
+// Whole cells are only culled when they are clearly outside, so rounding in the cell
+// test never drops an item the per-item test would keep
+#define VIS_CELL_SLACK      0.001f
+
+#define VIS_MAX_CELLS       ( 1 << 22 )
+
+
+//--------------------------------------------------------------------------------------
+CVisibilityGrid::CVisibilityGrid() : m_nItems( 0 ),
+                                     m_nSlots( 0 ),
+                                     m_nCellsX( 0 ),
+                                     m_nCellsZ( 0 ),
+                                     m_fCellSize( 0 ),
+                                     m_fMinX( 0 ),
+                                     m_fMinZ( 0 ),
+                                     m_vMaxExtents( 0, 0, 0 ),
+                                     m_pCellStart( NULL ),
+                                     m_pCellMinY( NULL ),
+                                     m_pCellMaxY( NULL ),
+                                     m_pCenterX( NULL ),
+                                     m_pCenterY( NULL ),
+                                     m_pCenterZ( NULL ),
+                                     m_pExtentX( NULL ),
+                                     m_pExtentY( NULL ),
+                                     m_pExtentZ( NULL ),
+                                     m_pItem( NULL ),
+                                     m_pFlags( NULL ),
+                                     m_iTouched( 0 ),
+                                     m_nCellsVisited( 0 ),
+                                     m_nItemsTested( 0 )
+{
+}
+
+
+//--------------------------------------------------------------------------------------
+CVisibilityGrid::~CVisibilityGrid()
+{
+    Destroy();
+}
+
+
+//--------------------------------------------------------------------------------------
+void CVisibilityGrid::Destroy()
+{
+    SAFE_DELETE_ARRAY( m_pCellStart );
+    SAFE_DELETE_ARRAY( m_pCellMinY );
+    SAFE_DELETE_ARRAY( m_pCellMaxY );
+    SAFE_DELETE_ARRAY( m_pCenterX );
+    SAFE_DELETE_ARRAY( m_pCenterY );
+    SAFE_DELETE_ARRAY( m_pCenterZ );
+    SAFE_DELETE_ARRAY( m_pExtentX );
+    SAFE_DELETE_ARRAY( m_pExtentY );
+    SAFE_DELETE_ARRAY( m_pExtentZ );
+    SAFE_DELETE_ARRAY( m_pItem );
+    SAFE_DELETE_ARRAY( m_pFlags );
+
+    for( int i = 0; i < VIS_NUM_SETS; i++ )
+    {
+        m_Sets[i].RemoveAll();
+        m_Entered[i].RemoveAll();
+        m_Left[i].RemoveAll();
+    }
+    m_Touched[0].RemoveAll();
+    m_Touched[1].RemoveAll();
+
+    m_nItems = 0;
+    m_nSlots = 0;
+    m_nCellsX = 0;
+    m_nCellsZ = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Counting sort of the items into cells.  Each cell's run of slots is padded to a whole
+// number of batches with slots that can never pass a test.
+//--------------------------------------------------------------------------------------
+HRESULT CVisibilityGrid::Build( const D3DXVECTOR3* pCenters, UINT nCenterStride, UINT nItems,
+                                const D3DXVECTOR3& vExtents, float fCellSize )
+{
+    Destroy();
+
+    if( !pCenters || 0 == nItems || fCellSize <= 0.0f )
+        return E_INVALIDARG;
+
+#define CENTER( i ) ( *( const D3DXVECTOR3* )( ( const BYTE* )pCenters + ( i ) * nCenterStride ) )
+
+    float fMinX = FLT_MAX, fMaxX = -FLT_MAX;
+    float fMinZ = FLT_MAX, fMaxZ = -FLT_MAX;
+    for( UINT i = 0; i < nItems; i++ )
+    {
+        const D3DXVECTOR3& vCenter = CENTER( i );
+        fMinX = min( fMinX, vCenter.x );
+        fMaxX = max( fMaxX, vCenter.x );
+        fMinZ = min( fMinZ, vCenter.z );
+        fMaxZ = max( fMaxZ, vCenter.z );
+    }
+
+    // Keep the cell table a sensible size however small the cells asked for
+    while( ( ( fMaxX - fMinX ) / fCellSize + 1.0f ) * ( ( fMaxZ - fMinZ ) / fCellSize + 1.0f ) > VIS_MAX_CELLS )
+        fCellSize *= 2.0f;
+
+    m_nItems = nItems;
+    m_fCellSize = fCellSize;
+    m_fMinX = fMinX;
+    m_fMinZ = fMinZ;
+    m_nCellsX = ( UINT )( ( fMaxX - fMinX ) / fCellSize ) + 1;
+    m_nCellsZ = ( UINT )( ( fMaxZ - fMinZ ) / fCellSize ) + 1;
+    m_vMaxExtents = vExtents;
+
+    const UINT nCells = m_nCellsX * m_nCellsZ;
+    UINT* pItemCell = new UINT[ nItems ];
+    m_pCellStart = new UINT[ nCells + 1 ];
+    m_pCellMinY = new float[ nCells ];
+    m_pCellMaxY = new float[ nCells ];
+    m_pFlags = new BYTE[ nItems ];
+    if( !pItemCell || !m_pCellStart || !m_pCellMinY || !m_pCellMaxY || !m_pFlags )
+    {
+        SAFE_DELETE_ARRAY( pItemCell );
+        Destroy();
+        return E_OUTOFMEMORY;
+    }
+    ZeroMemory( m_pCellStart, sizeof( UINT ) * ( nCells + 1 ) );
+    ZeroMemory( m_pFlags, nItems );
+
+    for( UINT i = 0; i < nCells; i++ )
+    {
+        m_pCellMinY[i] = FLT_MAX;
+        m_pCellMaxY[i] = -FLT_MAX;
+    }
+
+    // Count the items in each cell
+    for( UINT i = 0; i < nItems; i++ )
+    {
+        const D3DXVECTOR3& vCenter = CENTER( i );
+        UINT cx = min( ( UINT )( ( vCenter.x - fMinX ) / fCellSize ), m_nCellsX - 1 );
+        UINT cz = min( ( UINT )( ( vCenter.z - fMinZ ) / fCellSize ), m_nCellsZ - 1 );
+        UINT iCell = cz * m_nCellsX + cx;
+        pItemCell[i] = iCell;
+        m_pCellStart[iCell + 1]++;
+        m_pCellMinY[iCell] = min( m_pCellMinY[iCell], vCenter.y );
+        m_pCellMaxY[iCell] = max( m_pCellMaxY[iCell], vCenter.y );
+    }
+
+    // Padded counts become starting slots
+    UINT nSlots = 0;
+    for( UINT i = 0; i < nCells; i++ )
+    {
+        UINT nCount = m_pCellStart[i + 1];
+        m_pCellStart[i] = nSlots;
+        nSlots += ( nCount + VIS_BATCH_SIZE - 1 ) & ~( VIS_BATCH_SIZE - 1 );
+    }
+    m_pCellStart[nCells] = nSlots;
+    m_nSlots = nSlots;
+
+    m_pCenterX = new float[ nSlots ];
+    m_pCenterY = new float[ nSlots ];
+    m_pCenterZ = new float[ nSlots ];
+    m_pExtentX = new float[ nSlots ];
+    m_pExtentY = new float[ nSlots ];
+    m_pExtentZ = new float[ nSlots ];
+    m_pItem = new UINT[ nSlots ];
+    if( !m_pCenterX || !m_pCenterY || !m_pCenterZ || !m_pExtentX || !m_pExtentY || !m_pExtentZ || !m_pItem )
+    {
+        SAFE_DELETE_ARRAY( pItemCell );
+        Destroy();
+        return E_OUTOFMEMORY;
+    }
+
+    for( UINT i = 0; i < nSlots; i++ )
+    {
+        m_pCenterX[i] = FLT_MAX;
+        m_pCenterY[i] = FLT_MAX;
+        m_pCenterZ[i] = FLT_MAX;
+        m_pExtentX[i] = 0.0f;
+        m_pExtentY[i] = 0.0f;
+        m_pExtentZ[i] = 0.0f;
+        m_pItem[i] = VIS_NO_ITEM;
+    }
+
+    // Place the items, keeping their original order within a cell
+    UINT* pNextSlot = new UINT[ nCells ];
+    if( !pNextSlot )
+    {
+        SAFE_DELETE_ARRAY( pItemCell );
+        Destroy();
+        return E_OUTOFMEMORY;
+    }
+    memcpy( pNextSlot, m_pCellStart, sizeof( UINT ) * nCells );
+
+    for( UINT i = 0; i < nItems; i++ )
+    {
+        const D3DXVECTOR3& vCenter = CENTER( i );
+        UINT nSlot = pNextSlot[ pItemCell[i] ]++;
+        m_pCenterX[nSlot] = vCenter.x;
+        m_pCenterY[nSlot] = vCenter.y;
+        m_pCenterZ[nSlot] = vCenter.z;
+        m_pExtentX[nSlot] = vExtents.x;
+        m_pExtentY[nSlot] = vExtents.y;
+        m_pExtentZ[nSlot] = vExtents.z;
+        m_pItem[nSlot] = i;
+    }
+
+#undef CENTER
+
+    SAFE_DELETE_ARRAY( pNextSlot );
+    SAFE_DELETE_ARRAY( pItemCell );
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CVisibilityGrid::ResetSets()
+{
+    for( int i = 0; i < m_Touched[m_iTouched].GetSize(); i++ )
+        m_pFlags[ m_Touched[m_iTouched].GetAt( i ) ] = 0;
+
+    for( int i = 0; i < VIS_NUM_SETS; i++ )
+    {
+        m_Sets[i].Reset();
+        m_Entered[i].Reset();
+        m_Left[i].Reset();
+    }
+    m_Touched[0].Reset();
+    m_Touched[1].Reset();
+}
+
+
+//--------------------------------------------------------------------------------------
+// Extracts the clip planes from the columns of a row-vector view-projection matrix
+//--------------------------------------------------------------------------------------
+void CVisibilityGrid::GetFrustumPlanes( const D3DXMATRIX* pViewProj, D3DXPLANE* pPlanes )
+{
+    const D3DXMATRIX& m = *pViewProj;
+
+    pPlanes[0] = D3DXPLANE( m._14 + m._11, m._24 + m._21, m._34 + m._31, m._44 + m._41 );  // Left
+    pPlanes[1] = D3DXPLANE( m._14 - m._11, m._24 - m._21, m._34 - m._31, m._44 - m._41 );  // Right
+    pPlanes[2] = D3DXPLANE( m._14 + m._12, m._24 + m._22, m._34 + m._32, m._44 + m._42 );  // Bottom
+    pPlanes[3] = D3DXPLANE( m._14 - m._12, m._24 - m._22, m._34 - m._32, m._44 - m._42 );  // Top
+    pPlanes[4] = D3DXPLANE( m._13, m._23, m._33, m._43 );                                  // Near
+    pPlanes[5] = D3DXPLANE( m._14 - m._13, m._24 - m._23, m._34 - m._33, m._44 - m._43 );  // Far
+
+    for( int i = 0; i < 6; i++ )
+        D3DXPlaneNormalize( &pPlanes[i], &pPlanes[i] );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Reference for the batched test in TestCell.  The arithmetic is done in the same
+// order so both give the same answer.
+//--------------------------------------------------------------------------------------
+DWORD CVisibilityGrid::ClassifyItem( const VIS_QUERY& Query, const D3DXVECTOR3& vCenter,
+                                     const D3DXVECTOR3& vExtents )
+{
+    const float dx = vCenter.x - Query.vEye.x;
+    const float dy = vCenter.y - Query.vEye.y;
+    const float dz = vCenter.z - Query.vEye.z;
+    const float fDistSq = dx * dx + dy * dy + dz * dz;
+
+    DWORD dwSets = 0;
+    if( fDistSq < Query.fLoadRadius * Query.fLoadRadius )
+        dwSets |= 1 << VIS_SET_LOAD;
+
+    if( fDistSq < Query.fVisibleRadius * Query.fVisibleRadius )
+    {
+        bool bInside = true;
+        for( int i = 0; i < 6 && bInside; i++ )
+        {
+            const D3DXPLANE& Plane = Query.Planes[i];
+            float fDist = Plane.a * vCenter.x + Plane.b * vCenter.y + Plane.c * vCenter.z + Plane.d;
+            float fRadius = fabsf( Plane.a ) * vExtents.x + fabsf( Plane.b ) * vExtents.y + fabsf( Plane.c ) * vExtents.z;
+            bInside = fDist + fRadius >= 0.0f;
+        }
+
+        if( bInside || fDistSq < Query.fNearRadius * Query.fNearRadius )
+            dwSets |= 1 << VIS_SET_VISIBLE;
+    }
+
+    return dwSets;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CVisibilityGrid::AddResult( UINT nSlot, DWORD dwSets )
+{
+    const UINT nItem = m_pItem[nSlot];
+
+    m_pFlags[nItem] |= ( BYTE )( dwSets << VIS_CURRENT_SHIFT );
+    for( UINT i = 0; i < VIS_NUM_SETS; i++ )
+    {
+        if( dwSets & ( 1 << i ) )
+            m_Sets[i].Add( nItem );
+    }
+    m_Touched[m_iTouched].Add( nItem );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Tests every item of a cell.  bTestVisible is false when no item in the cell can be
+// visible, and bTestFrustum is false when the whole cell is inside the frustum.
+//--------------------------------------------------------------------------------------
+void CVisibilityGrid::TestCell( const VIS_QUERY& Query, UINT iCell, bool bTestVisible, bool bTestFrustum )
+{
+    const UINT nStart = m_pCellStart[iCell];
+    const UINT nEnd = m_pCellStart[iCell + 1];
+    const float fVisibleSq = bTestVisible ? Query.fVisibleRadius * Query.fVisibleRadius : 0.0f;
+    const float fLoadSq = Query.fLoadRadius * Query.fLoadRadius;
+    const float fNearSq = Query.fNearRadius * Query.fNearRadius;
+
+    m_nItemsTested += nEnd - nStart;
+
+#ifdef VIS_SSE
+    const __m128 vEyeX = _mm_set1_ps( Query.vEye.x );
+    const __m128 vEyeY = _mm_set1_ps( Query.vEye.y );
+    const __m128 vEyeZ = _mm_set1_ps( Query.vEye.z );
+    const __m128 vVisibleSq = _mm_set1_ps( fVisibleSq );
+    const __m128 vLoadSq = _mm_set1_ps( fLoadSq );
+    const __m128 vNearSq = _mm_set1_ps( fNearSq );
+    const __m128 vZero = _mm_setzero_ps();
+
+    for( UINT nSlot = nStart; nSlot < nEnd; nSlot += VIS_BATCH_SIZE )
+    {
+        const __m128 vCenterX = _mm_loadu_ps( m_pCenterX + nSlot );
+        const __m128 vCenterY = _mm_loadu_ps( m_pCenterY + nSlot );
+        const __m128 vCenterZ = _mm_loadu_ps( m_pCenterZ + nSlot );
+
+        __m128 vDX = _mm_sub_ps( vCenterX, vEyeX );
+        __m128 vDY = _mm_sub_ps( vCenterY, vEyeY );
+        __m128 vDZ = _mm_sub_ps( vCenterZ, vEyeZ );
+        __m128 vDistSq = _mm_add_ps( _mm_add_ps( _mm_mul_ps( vDX, vDX ), _mm_mul_ps( vDY, vDY ) ),
+                                     _mm_mul_ps( vDZ, vDZ ) );
+
+        int nLoad = _mm_movemask_ps( _mm_cmplt_ps( vDistSq, vLoadSq ) );
+        __m128 vVisible = _mm_cmplt_ps( vDistSq, vVisibleSq );
+
+        if( bTestFrustum && _mm_movemask_ps( vVisible ) )
+        {
+            const __m128 vExtentX = _mm_loadu_ps( m_pExtentX + nSlot );
+            const __m128 vExtentY = _mm_loadu_ps( m_pExtentY + nSlot );
+            const __m128 vExtentZ = _mm_loadu_ps( m_pExtentZ + nSlot );
+
+            __m128 vInside = _mm_cmpeq_ps( vZero, vZero );
+            for( int i = 0; i < 6; i++ )
+            {
+                const D3DXPLANE& Plane = Query.Planes[i];
+                __m128 vDist = _mm_add_ps( _mm_add_ps( _mm_add_ps(
+                                           _mm_mul_ps( _mm_set1_ps( Plane.a ), vCenterX ),
+                                           _mm_mul_ps( _mm_set1_ps( Plane.b ), vCenterY ) ),
+                                           _mm_mul_ps( _mm_set1_ps( Plane.c ), vCenterZ ) ),
+                                           _mm_set1_ps( Plane.d ) );
+                __m128 vRadius = _mm_add_ps( _mm_add_ps(
+                                             _mm_mul_ps( _mm_set1_ps( fabsf( Plane.a ) ), vExtentX ),
+                                             _mm_mul_ps( _mm_set1_ps( fabsf( Plane.b ) ), vExtentY ) ),
+                                             _mm_mul_ps( _mm_set1_ps( fabsf( Plane.c ) ), vExtentZ ) );
+                vInside = _mm_and_ps( vInside, _mm_cmpge_ps( _mm_add_ps( vDist, vRadius ), vZero ) );
+            }
+
+            vInside = _mm_or_ps( vInside, _mm_cmplt_ps( vDistSq, vNearSq ) );
+            vVisible = _mm_and_ps( vVisible, vInside );
+        }
+
+        int nVisible = _mm_movemask_ps( vVisible );
+        if( 0 == ( nLoad | nVisible ) )
+            continue;
+
+        for( UINT i = 0; i < VIS_BATCH_SIZE; i++ )
+        {
+            DWORD dwSets = ( ( nVisible >> i ) & 1 ) << VIS_SET_VISIBLE | ( ( nLoad >> i ) & 1 ) << VIS_SET_LOAD;
+            if( dwSets )
+                AddResult( nSlot + i, dwSets );
+        }
+    }
+#else
+    VIS_QUERY CellQuery = Query;
+    if( !bTestVisible )
+        CellQuery.fVisibleRadius = 0.0f;
+
+    for( UINT nSlot = nStart; nSlot < nEnd; nSlot++ )
+    {
+        if( VIS_NO_ITEM == m_pItem[nSlot] )
+            continue;
+
+        DWORD dwSets;
+        D3DXVECTOR3 vCenter( m_pCenterX[nSlot], m_pCenterY[nSlot], m_pCenterZ[nSlot] );
+        if( bTestFrustum )
+        {
+            D3DXVECTOR3 vExtents( m_pExtentX[nSlot], m_pExtentY[nSlot], m_pExtentZ[nSlot] );
+            dwSets = ClassifyItem( CellQuery, vCenter, vExtents );
+        }
+        else
+        {
+            D3DXVECTOR3 vDelta = vCenter - Query.vEye;
+            float fDistSq = D3DXVec3LengthSq( &vDelta );
+            dwSets = ( fDistSq < fVisibleSq ? 1 << VIS_SET_VISIBLE : 0 ) | ( fDistSq < fLoadSq ? 1 << VIS_SET_LOAD : 0 );
+        }
+
+        if( dwSets )
+            AddResult( nSlot, dwSets );
+    }
+#endif
+}
+
+
+//--------------------------------------------------------------------------------------
+// Visits the cells within reach of the eye.  Cells too far away for any item to be
+// loaded or visible are skipped, as is the frustum test for cells wholly inside or
+// outside it.  The entered and left lists come from comparing the flags of the items
+// touched by this query and the last one.
+//--------------------------------------------------------------------------------------
+void CVisibilityGrid::Update( const VIS_QUERY& Query )
+{
+    for( int i = 0; i < VIS_NUM_SETS; i++ )
+    {
+        m_Sets[i].Reset();
+        m_Entered[i].Reset();
+        m_Left[i].Reset();
+    }
+    m_iTouched ^= 1;
+    m_Touched[m_iTouched].Reset();
+    m_nCellsVisited = 0;
+    m_nItemsTested = 0;
+
+    const float fReach = max( Query.fVisibleRadius, Query.fLoadRadius );
+    const float fVisibleSq = Query.fVisibleRadius * Query.fVisibleRadius;
+    const float fLoadSq = Query.fLoadRadius * Query.fLoadRadius;
+    const float fNearSq = Query.fNearRadius * Query.fNearRadius;
+    const float fSlack = m_fCellSize * VIS_CELL_SLACK;
+
+    // Range of cells whose centers can be within reach
+    float fCellX0 = floorf( ( Query.vEye.x - fReach - m_fMinX ) / m_fCellSize );
+    float fCellX1 = floorf( ( Query.vEye.x + fReach - m_fMinX ) / m_fCellSize );
+    float fCellZ0 = floorf( ( Query.vEye.z - fReach - m_fMinZ ) / m_fCellSize );
+    float fCellZ1 = floorf( ( Query.vEye.z + fReach - m_fMinZ ) / m_fCellSize );
+    if( m_nItems > 0 && fCellX1 >= 0.0f && fCellZ1 >= 0.0f &&
+        fCellX0 < ( float )m_nCellsX && fCellZ0 < ( float )m_nCellsZ )
+    {
+        const UINT cx0 = ( UINT )max( fCellX0, 0.0f );
+        const UINT cz0 = ( UINT )max( fCellZ0, 0.0f );
+        const UINT cx1 = ( UINT )min( fCellX1, ( float )( m_nCellsX - 1 ) );
+        const UINT cz1 = ( UINT )min( fCellZ1, ( float )( m_nCellsZ - 1 ) );
+
+        for( UINT cz = cz0; cz <= cz1; cz++ )
+        {
+            // Cell bounds are widened a little for centers that rounded into a neighbour
+            const float fZ0 = m_fMinZ + cz * m_fCellSize - fSlack;
+            const float fZ1 = fZ0 + m_fCellSize + 2.0f * fSlack;
+            const float fGapZ = max( 0.0f, max( fZ0 - Query.vEye.z, Query.vEye.z - fZ1 ) );
+
+            for( UINT cx = cx0; cx <= cx1; cx++ )
+            {
+                const UINT iCell = cz * m_nCellsX + cx;
+                if( m_pCellStart[iCell] == m_pCellStart[iCell + 1] )
+                    continue;
+
+                const float fX0 = m_fMinX + cx * m_fCellSize - fSlack;
+                const float fX1 = fX0 + m_fCellSize + 2.0f * fSlack;
+                const float fGapX = max( 0.0f, max( fX0 - Query.vEye.x, Query.vEye.x - fX1 ) );
+                const float fGapY = max( 0.0f, max( m_pCellMinY[iCell] - Query.vEye.y,
+                                                    Query.vEye.y - m_pCellMaxY[iCell] ) );
+                const float fCellDistSq = ( fGapX * fGapX + fGapY * fGapY + fGapZ * fGapZ ) * ( 1.0f - VIS_CELL_SLACK );
+
+                bool bTestVisible = fCellDistSq < fVisibleSq;
+                if( !bTestVisible && fCellDistSq >= fLoadSq )
+                    continue;
+
+                // Classify the cell's bounds against the frustum.  Cells within the near
+                // radius are left to the per-item test.
+                bool bTestFrustum = bTestVisible;
+                if( bTestVisible && fCellDistSq >= fNearSq )
+                {
+                    const D3DXVECTOR3 vCenter( ( fX0 + fX1 ) * 0.5f, ( m_pCellMinY[iCell] + m_pCellMaxY[iCell] ) * 0.5f,
+                                               ( fZ0 + fZ1 ) * 0.5f );
+                    const D3DXVECTOR3 vHalf( ( fX1 - fX0 ) * 0.5f + m_vMaxExtents.x,
+                                             ( m_pCellMaxY[iCell] - m_pCellMinY[iCell] ) * 0.5f + m_vMaxExtents.y,
+                                             ( fZ1 - fZ0 ) * 0.5f + m_vMaxExtents.z );
+
+                    bool bInside = true;
+                    for( int i = 0; i < 6 && bTestVisible; i++ )
+                    {
+                        const D3DXPLANE& Plane = Query.Planes[i];
+                        float fDist = Plane.a * vCenter.x + Plane.b * vCenter.y + Plane.c * vCenter.z + Plane.d;
+                        float fRadius = fabsf( Plane.a ) * vHalf.x + fabsf( Plane.b ) * vHalf.y +
+                                        fabsf( Plane.c ) * vHalf.z;
+                        float fPlaneSlack = ( fabsf( fDist ) + fRadius ) * VIS_CELL_SLACK;
+
+                        if( fDist + fRadius < -fPlaneSlack )
+                            bTestVisible = false;
+                        else if( fDist - fRadius <= fPlaneSlack )
+                            bInside = false;
+                    }
+
+                    bTestFrustum = bTestVisible && !bInside;
+                    if( !bTestVisible && fCellDistSq >= fLoadSq )
+                        continue;
+                }
+
+                m_nCellsVisited++;
+                TestCell( Query, iCell, bTestVisible, bTestFrustum );
+            }
+        }
+    }
+
+    // Work out what changed against the last query, then make this query's membership
+    // the last query's
+    const CGrowableArray <UINT>& Current = m_Touched[m_iTouched];
+    const CGrowableArray <UINT>& Previous = m_Touched[m_iTouched ^ 1];
+
+    for( int i = 0; i < Current.GetSize(); i++ )
+    {
+        const UINT nItem = Current.GetAt( i );
+        const BYTE Flags = m_pFlags[nItem];
+        const BYTE Entered = ( Flags >> VIS_CURRENT_SHIFT ) & ~Flags;
+        for( UINT iSet = 0; iSet < VIS_NUM_SETS; iSet++ )
+        {
+            if( Entered & ( 1 << iSet ) )
+                m_Entered[iSet].Add( nItem );
+        }
+    }
+
+    for( int i = 0; i < Previous.GetSize(); i++ )
+    {
+        const UINT nItem = Previous.GetAt( i );
+        const BYTE Flags = m_pFlags[nItem];
+        const BYTE Left = Flags & ~( Flags >> VIS_CURRENT_SHIFT ) & ( ( 1 << VIS_NUM_SETS ) - 1 );
+        for( UINT iSet = 0; iSet < VIS_NUM_SETS; iSet++ )
+        {
+            if( Left & ( 1 << iSet ) )
+                m_Left[iSet].Add( nItem );
+        }
+        m_pFlags[nItem] &= ~( ( 1 << VIS_NUM_SETS ) - 1 );
+    }
+
+    for( int i = 0; i < Current.GetSize(); i++ )
+        m_pFlags[ Current.GetAt( i ) ] >>= VIS_CURRENT_SHIFT;
+}
@@ -0,0 +1,143 @@
+//--------------------------------------------------------------------------------------
+// File: VisibilityGrid.h
+//
+// Spatial index over the level items of the ContentStreaming sample.  Items are
+// bucketed into a uniform grid of cells in the XZ plane and their bounds are kept as
+// separate arrays (SoA) sorted by cell, so a query only visits the cells around the
+// eye and tests the items in them four at a time.
+//
+// The grid keeps two sets from one query to the next: items that can be seen (inside
+// the visible radius and the view frustum) and items that should be loaded (inside
+// the loading radius).  Each Update reports the items that entered and left each set,
+// so the loader only has to look at what changed.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#pragma once
+#ifndef VISIBILITY_GRID_H
+#define VISIBILITY_GRID_H
+
+#define VIS_SET_VISIBLE     0
+#define VIS_SET_LOAD        1
+#define VIS_NUM_SETS        2
+
+// Items per SIMD batch.  Each cell's items are padded to a multiple of this.
+#define VIS_BATCH_SIZE      4
+
+#define VIS_NO_ITEM         0xFFFFFFFF
+
+//--------------------------------------------------------------------------------------
+// One visibility query.  Item centers are tested against the radii, and item bounds
+// against the frustum planes.
+//--------------------------------------------------------------------------------------
+struct VIS_QUERY
+{
+    D3DXVECTOR3 vEye;
+    float fVisibleRadius;
+    float fLoadRadius;
+    float fNearRadius;          // Items closer than this are visible whatever the frustum says
+    D3DXPLANE Planes[6];        // Frustum planes, normals pointing inwards
+};
+
+//--------------------------------------------------------------------------------------
+class CVisibilityGrid
+{
+public:
+                    CVisibilityGrid();
+                    ~CVisibilityGrid();
+
+    // Builds the grid.  pCenters is read with a stride of nCenterStride bytes so it can
+    // point into an array of larger structures.  vExtents is the half size of every item.
+    HRESULT         Build( const D3DXVECTOR3* pCenters, UINT nCenterStride, UINT nItems,
+                           const D3DXVECTOR3& vExtents, float fCellSize );
+    void            Destroy();
+
+    // Empties both sets without reporting anything as having left
+    void            ResetSets();
+
+    // Runs a query, replacing both sets and filling the entered and left lists
+    void            Update( const VIS_QUERY& Query );
+
+    UINT            GetItemCount() const
+    {
+        return m_nItems;
+    }
+    bool            IsInSet( UINT nItem, UINT iSet ) const
+    {
+        return ( m_pFlags[nItem] & ( 1 << iSet ) ) != 0;
+    }
+
+    // Item indices, in grid order.  Valid until the next Update.
+    const CGrowableArray <UINT>& GetSet( UINT iSet ) const
+    {
+        return m_Sets[iSet];
+    }
+    const CGrowableArray <UINT>& GetEntered( UINT iSet ) const
+    {
+        return m_Entered[iSet];
+    }
+    const CGrowableArray <UINT>& GetLeft( UINT iSet ) const
+    {
+        return m_Left[iSet];
+    }
+
+    // Work done by the last Update
+    UINT            GetCellsVisited() const
+    {
+        return m_nCellsVisited;
+    }
+    UINT            GetItemsTested() const
+    {
+        return m_nItemsTested;
+    }
+
+    // Frustum planes of a view-projection matrix, normals pointing inwards
+    static void     GetFrustumPlanes( const D3DXMATRIX* pViewProj, D3DXPLANE* pPlanes );
+
+    // The test Update applies to each item, one item at a time.  Returns a mask of
+    // ( 1 << VIS_SET_* ) bits.
+    static DWORD    ClassifyItem( const VIS_QUERY& Query, const D3DXVECTOR3& vCenter, const D3DXVECTOR3& vExtents );
+
+protected:
+    void            TestCell( const VIS_QUERY& Query, UINT iCell, bool bTestVisible, bool bTestFrustum );
+    void            AddResult( UINT nSlot, DWORD dwSets );
+
+    UINT m_nItems;
+    UINT m_nSlots;              // Items plus padding
+    UINT m_nCellsX;
+    UINT m_nCellsZ;
+    float m_fCellSize;
+    float m_fMinX;
+    float m_fMinZ;
+    D3DXVECTOR3 m_vMaxExtents;
+
+    // Per cell: first slot (m_nCellsX * m_nCellsZ + 1 entries) and height range of centers
+    UINT* m_pCellStart;
+    float* m_pCellMinY;
+    float* m_pCellMaxY;
+
+    // Per slot, sorted by cell.  Padding slots have m_pItem == VIS_NO_ITEM and a center
+    // no query can reach.
+    float* m_pCenterX;
+    float* m_pCenterY;
+    float* m_pCenterZ;
+    float* m_pExtentX;
+    float* m_pExtentY;
+    float* m_pExtentZ;
+    UINT* m_pItem;
+
+    // Per item: set membership for the last query (low bits) and the current one
+    BYTE* m_pFlags;
+
+    CGrowableArray <UINT> m_Sets[VIS_NUM_SETS];
+    CGrowableArray <UINT> m_Entered[VIS_NUM_SETS];
+    CGrowableArray <UINT> m_Left[VIS_NUM_SETS];
+    CGrowableArray <UINT> m_Touched[2];         // Items in either set, for this query and the last
+    UINT m_iTouched;                            // Which of m_Touched is this query's
+
+    UINT m_nCellsVisited;
+    UINT m_nItemsTested;
+};
+
+#endif
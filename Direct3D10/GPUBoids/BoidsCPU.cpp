@@ -0,0 +1,1121 @@
+//--------------------------------------------------------------------------------------
+// File: BoidsCPU.cpp
+//
+// A CPU flocking engine for the GPUBoids boids, with a uniform grid for the neighbours
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "BoidsCPU.h"
+#include "DXUTWorkerPool.h"
+#include <float.h>
+#include <math.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#include <xmmintrin.h>
+#define BOIDS_SSE
+#endif
+
+// Boids a thread takes at a time to bound, count and scatter, cells a thread takes at a
+// time to clear, scan and gather, and slots a thread takes at a time to apply the rules to
+#define BOIDS_CHUNK_SIZE        4096
+#define BOIDS_BLOCK_SIZE        4096
+#define BOIDS_RUN_SIZE          64
+
+// Cells above which a cell's boids are sorted with qsort rather than by insertion
+#define BOIDS_INSERTION_SORT    16
+
+// Each item of the bounds job keeps the least and greatest x, y and z, then the sums of
+// the positions, the headings and the speeds
+#define BOIDS_ITEM_FLOATS       13
+
+// The sums over a boid's neighbours: separation and avoidance as PSForce sums them, and
+// the positions and the velocities of the neighbours and how many there are
+struct BOIDS_SUMS
+{
+    float afForce[3];
+    float afPosition[3];
+    float afVelocity[3];
+    float fCount;
+};
+
+// What the neighbour sums read
+struct BOIDS_SLOTS
+{
+    const float* pX;
+    const float* pY;
+    const float* pZ;
+    const float* pVX;
+    const float* pVY;
+    const float* pVZ;
+    float fRadiusSq;
+    float fMaxForce;
+    float fAvoidScale;          // g_fMaxForce * g_fAvoidStrength^3
+};
+
+// What the rules read besides a boid's own state and its neighbour sums
+struct BOIDS_RULES
+{
+    BOIDS_PARAMS Params;
+    float fElapsedTime;
+    bool bFlockAverages;
+    D3DXVECTOR3 vFlockCenter;
+    D3DXVECTOR3 vFlockVelocity;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Sums the boids of slots aRanges[r][0] up to aRanges[r][1] that are within the radius of
+// a boid at pfPosition heading along pfHeading.  Separation pushes the boid away from each
+// by g_fMaxForce over the distance squared.  Avoidance, as Avoid works it out, pushes it
+// off the line it is heading along, away from where that passes the neighbour, by
+//
+//   g_fMaxForce * ( g_fAvoidStrength / r )^2 * ( g_fAvoidStrength / d )
+//
+// for a neighbour r away whose nearest point on the line is d from it.  A boid at the
+// same position, the boid itself among them, is not a neighbour.
+//--------------------------------------------------------------------------------------
+static void SumNeighborsScalar( const BOIDS_SLOTS& Slots, const UINT( *aRanges )[2], UINT nRanges,
+                               const float* pfPosition, const float* pfHeading, BOIDS_SUMS* pSums )
+{
+    ZeroMemory( pSums, sizeof( BOIDS_SUMS ) );
+
+    for( UINT r = 0; r < nRanges; r++ )
+    {
+        for( UINT j = aRanges[r][0]; j < aRanges[r][1]; j++ )
+        {
+            const float dx = pfPosition[0] - Slots.pX[j];
+            const float dy = pfPosition[1] - Slots.pY[j];
+            const float dz = pfPosition[2] - Slots.pZ[j];
+            const float r2 = dx * dx + dy * dy + dz * dz;
+            if( !( r2 > 0.0f && r2 < Slots.fRadiusSq ) )
+                continue;
+
+            const float fSeparation = Slots.fMaxForce / ( r2 * sqrtf( r2 ) );
+            pSums->afForce[0] += dx * fSeparation;
+            pSums->afForce[1] += dy * fSeparation;
+            pSums->afForce[2] += dz * fSeparation;
+
+            // From the neighbour to the nearest point of the line
+            const float t = -( dx * pfHeading[0] + dy * pfHeading[1] + dz * pfHeading[2] );
+            const float ax = dx + pfHeading[0] * t;
+            const float ay = dy + pfHeading[1] * t;
+            const float az = dz + pfHeading[2] * t;
+            const float d2 = ax * ax + ay * ay + az * az;
+            if( d2 > 0.0f )
+            {
+                const float fAvoid = Slots.fAvoidScale / ( r2 * d2 );
+                pSums->afForce[0] += ax * fAvoid;
+                pSums->afForce[1] += ay * fAvoid;
+                pSums->afForce[2] += az * fAvoid;
+            }
+
+            pSums->afPosition[0] += Slots.pX[j];
+            pSums->afPosition[1] += Slots.pY[j];
+            pSums->afPosition[2] += Slots.pZ[j];
+            pSums->afVelocity[0] += Slots.pVX[j];
+            pSums->afVelocity[1] += Slots.pVY[j];
+            pSums->afVelocity[2] += Slots.pVZ[j];
+            pSums->fCount += 1.0f;
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Scales a vector to unit length, leaving it 0 if it is 0
+//--------------------------------------------------------------------------------------
+static inline void Normalize( float* pf )
+{
+    const float fLengthSq = pf[0] * pf[0] + pf[1] * pf[1] + pf[2] * pf[2];
+    const float fScale = fLengthSq > 0.0f ? 1.0f / sqrtf( fLengthSq ) : 0.0f;
+    pf[0] *= fScale;
+    pf[1] *= fScale;
+    pf[2] *= fScale;
+}
+
+
+//--------------------------------------------------------------------------------------
+static inline void Cross( const float* a, const float* b, float* pResult )
+{
+    pResult[0] = a[1] * b[2] - a[2] * b[1];
+    pResult[1] = a[2] * b[0] - a[0] * b[2];
+    pResult[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+
+//--------------------------------------------------------------------------------------
+// Steers a boid with the rules and moves it on, as PSAdvance does.  Where the shader would
+// normalize a zero vector, the rule adds nothing.
+//--------------------------------------------------------------------------------------
+static void AdvanceScalar( const BOIDS_RULES& Rules, const BOIDS_SUMS& Sums, D3DXVECTOR4* pPosition,
+                           D3DXVECTOR4* pVelocity, D3DXVECTOR4* pUp )
+{
+    const BOIDS_PARAMS& Params = Rules.Params;
+    const float afPosition[3] = { pPosition->x, pPosition->y, pPosition->z };
+    const float afHeading[3] = { pVelocity->x, pVelocity->y, pVelocity->z };
+    const float afVelocity[3] = { afHeading[0] * pVelocity->w, afHeading[1] * pVelocity->w,
+                                  afHeading[2] * pVelocity->w };
+    const float* pfSeekPos = ( const float* )&Params.vSeekPos;
+    const float* pfFleePos = ( const float* )&Params.vFleePos;
+
+    // The averages cohesion and alignment steer toward: with no neighbours, the boid's own
+    float afCenter[3], afAverage[3];
+    const float fInvCount = Sums.fCount > 0.0f ? 1.0f / Sums.fCount : 0.0f;
+    for( UINT k = 0; k < 3; k++ )
+    {
+        if( Rules.bFlockAverages )
+        {
+            afCenter[k] = ( ( const float* )&Rules.vFlockCenter )[k];
+            afAverage[k] = ( ( const float* )&Rules.vFlockVelocity )[k];
+        }
+        else
+        {
+            afCenter[k] = Sums.fCount > 0.0f ? Sums.afPosition[k] * fInvCount : afPosition[k];
+            afAverage[k] = Sums.fCount > 0.0f ? Sums.afVelocity[k] * fInvCount : afVelocity[k];
+        }
+    }
+
+    float afSeek[3], afCohesion[3], afAlignment[3], afFlee[3];
+    for( UINT k = 0; k < 3; k++ )
+    {
+        afSeek[k] = pfSeekPos[k] - afPosition[k];
+        afCohesion[k] = afCenter[k] - afPosition[k];
+        afAlignment[k] = afAverage[k] - afVelocity[k];
+        afFlee[k] = afPosition[k] - pfFleePos[k];
+    }
+    Normalize( afSeek );
+    Normalize( afCohesion );
+    Normalize( afAlignment );
+    const float fFleeSq = afFlee[0] * afFlee[0] + afFlee[1] * afFlee[1] + afFlee[2] * afFlee[2];
+    const float fFleeLength = sqrtf( fFleeSq );
+
+    // Combine and clamp the forces
+    float afForce[3];
+    for( UINT k = 0; k < 3; k++ )
+    {
+        afForce[k] = Params.fSeparationStrength * Sums.afForce[k] +
+                     Params.fSeekStrength * ( afSeek[k] * Params.fMaxSpeed - afVelocity[k] ) +
+                     Params.fCohesionStrength * Params.fMaxForce * afCohesion[k] +
+                     Params.fAlignmentStrength * Params.fMaxForce * afAlignment[k];
+        if( fFleeSq > 0.0f )
+            afForce[k] += Params.fFleeStrength * ( afFlee[k] / fFleeLength * Params.fMaxSpeed - afVelocity[k] ) /
+                          fFleeSq;
+    }
+    if( afForce[0] * afForce[0] + afForce[1] * afForce[1] + afForce[2] * afForce[2] >
+        Params.fMaxForce * Params.fMaxForce )
+    {
+        Normalize( afForce );
+        for( UINT k = 0; k < 3; k++ )
+            afForce[k] *= Params.fMaxForce;
+    }
+
+    // Update the velocity, with a mass of 1, and clamp it to the top speed.  The position
+    // moves on with the velocity from before.
+    float afNewVelocity[3], afNewPosition[3];
+    for( UINT k = 0; k < 3; k++ )
+    {
+        afNewVelocity[k] = afVelocity[k] + afForce[k] * Rules.fElapsedTime;
+        afNewPosition[k] = afPosition[k] + afVelocity[k] * Rules.fElapsedTime;
+    }
+    const float fSpeedSq = afNewVelocity[0] * afNewVelocity[0] + afNewVelocity[1] * afNewVelocity[1] +
+                           afNewVelocity[2] * afNewVelocity[2];
+    float fSpeed = sqrtf( fSpeedSq );
+    if( fSpeedSq > Params.fMaxSpeed * Params.fMaxSpeed )
+        fSpeed = Params.fMaxSpeed;
+
+    // Reorient, keeping the heading when the boid has all but stopped
+    float afNewHeading[3] = { afHeading[0], afHeading[1], afHeading[2] };
+    if( fSpeed > 0.001f )
+    {
+        for( UINT k = 0; k < 3; k++ )
+            afNewHeading[k] = afNewVelocity[k];
+        Normalize( afNewHeading );
+    }
+    float afUp[3] = { pUp->x, pUp->y, pUp->z };
+    float afRight[3], afNewUp[3];
+    Normalize( afUp );
+    Cross( afUp, afNewHeading, afRight );
+    Normalize( afRight );
+    Cross( afNewHeading, afRight, afNewUp );
+    Normalize( afNewUp );
+
+    // The shader writes the top speed whatever the speed
+    *pPosition = D3DXVECTOR4( afNewPosition[0], afNewPosition[1], afNewPosition[2], 0.0f );
+    *pVelocity = D3DXVECTOR4( afNewHeading[0], afNewHeading[1], afNewHeading[2], Params.fMaxSpeed );
+    *pUp = D3DXVECTOR4( afNewUp[0], afNewUp[1], afNewUp[2], 0.0f );
+}
+
+
+#ifdef BOIDS_SSE
+//--------------------------------------------------------------------------------------
+static inline float SumLanes( __m128 v )
+{
+    float af[4];
+    _mm_storeu_ps( af, v );
+    return ( af[0] + af[1] ) + ( af[2] + af[3] );
+}
+
+
+//--------------------------------------------------------------------------------------
+// SumNeighborsScalar four neighbours at a time
+//--------------------------------------------------------------------------------------
+static void SumNeighborsSSE( const BOIDS_SLOTS& Slots, const UINT( *aRanges )[2], UINT nRanges,
+                             const float* pfPosition, const float* pfHeading, BOIDS_SUMS* pSums )
+{
+    const __m128 vZero = _mm_setzero_ps();
+    const __m128 vOne = _mm_set1_ps( 1.0f );
+    const __m128 vLanes = _mm_set_ps( 3.0f, 2.0f, 1.0f, 0.0f );
+    const __m128 vRadiusSq = _mm_set1_ps( Slots.fRadiusSq );
+    const __m128 vMaxForce = _mm_set1_ps( Slots.fMaxForce );
+    const __m128 vAvoidScale = _mm_set1_ps( Slots.fAvoidScale );
+    const __m128 px = _mm_set1_ps( pfPosition[0] );
+    const __m128 py = _mm_set1_ps( pfPosition[1] );
+    const __m128 pz = _mm_set1_ps( pfPosition[2] );
+    const __m128 hx = _mm_set1_ps( pfHeading[0] );
+    const __m128 hy = _mm_set1_ps( pfHeading[1] );
+    const __m128 hz = _mm_set1_ps( pfHeading[2] );
+
+    __m128 fx = vZero, fy = vZero, fz = vZero;
+    __m128 sx = vZero, sy = vZero, sz = vZero;
+    __m128 vx = vZero, vy = vZero, vz = vZero;
+    __m128 vCount = vZero;
+
+    for( UINT r = 0; r < nRanges; r++ )
+    {
+        const UINT iEnd = aRanges[r][1];
+        for( UINT j = aRanges[r][0]; j < iEnd; j += 4 )
+        {
+            // The slots are padded, so the lanes past the end of the range can be read
+            const __m128 x = _mm_loadu_ps( Slots.pX + j );
+            const __m128 y = _mm_loadu_ps( Slots.pY + j );
+            const __m128 z = _mm_loadu_ps( Slots.pZ + j );
+            const __m128 dx = _mm_sub_ps( px, x );
+            const __m128 dy = _mm_sub_ps( py, y );
+            const __m128 dz = _mm_sub_ps( pz, z );
+            const __m128 r2 = _mm_add_ps( _mm_add_ps( _mm_mul_ps( dx, dx ), _mm_mul_ps( dy, dy ) ),
+                                          _mm_mul_ps( dz, dz ) );
+            const __m128 vInRange = _mm_cmplt_ps( vLanes, _mm_set1_ps( ( float )( iEnd - j ) ) );
+            const __m128 vMask = _mm_and_ps( vInRange, _mm_and_ps( _mm_cmpgt_ps( r2, vZero ),
+                                                                   _mm_cmplt_ps( r2, vRadiusSq ) ) );
+            if( 0 == _mm_movemask_ps( vMask ) )
+                continue;
+
+            // Divisions by 0 are thrown away by the masks
+            const __m128 vSeparation = _mm_and_ps( vMask, _mm_div_ps( vMaxForce,
+                                                                      _mm_mul_ps( r2, _mm_sqrt_ps( r2 ) ) ) );
+            const __m128 t = _mm_sub_ps( vZero, _mm_add_ps( _mm_add_ps( _mm_mul_ps( dx, hx ), _mm_mul_ps( dy, hy ) ),
+                                                            _mm_mul_ps( dz, hz ) ) );
+            const __m128 ax = _mm_add_ps( dx, _mm_mul_ps( hx, t ) );
+            const __m128 ay = _mm_add_ps( dy, _mm_mul_ps( hy, t ) );
+            const __m128 az = _mm_add_ps( dz, _mm_mul_ps( hz, t ) );
+            const __m128 d2 = _mm_add_ps( _mm_add_ps( _mm_mul_ps( ax, ax ), _mm_mul_ps( ay, ay ) ),
+                                          _mm_mul_ps( az, az ) );
+            const __m128 vAvoid = _mm_and_ps( _mm_and_ps( vMask, _mm_cmpgt_ps( d2, vZero ) ),
+                                              _mm_div_ps( vAvoidScale, _mm_mul_ps( r2, d2 ) ) );
+
+            fx = _mm_add_ps( fx, _mm_add_ps( _mm_mul_ps( dx, vSeparation ), _mm_mul_ps( ax, vAvoid ) ) );
+            fy = _mm_add_ps( fy, _mm_add_ps( _mm_mul_ps( dy, vSeparation ), _mm_mul_ps( ay, vAvoid ) ) );
+            fz = _mm_add_ps( fz, _mm_add_ps( _mm_mul_ps( dz, vSeparation ), _mm_mul_ps( az, vAvoid ) ) );
+            sx = _mm_add_ps( sx, _mm_and_ps( vMask, x ) );
+            sy = _mm_add_ps( sy, _mm_and_ps( vMask, y ) );
+            sz = _mm_add_ps( sz, _mm_and_ps( vMask, z ) );
+            vx = _mm_add_ps( vx, _mm_and_ps( vMask, _mm_loadu_ps( Slots.pVX + j ) ) );
+            vy = _mm_add_ps( vy, _mm_and_ps( vMask, _mm_loadu_ps( Slots.pVY + j ) ) );
+            vz = _mm_add_ps( vz, _mm_and_ps( vMask, _mm_loadu_ps( Slots.pVZ + j ) ) );
+            vCount = _mm_add_ps( vCount, _mm_and_ps( vMask, vOne ) );
+        }
+    }
+
+    pSums->afForce[0] = SumLanes( fx );
+    pSums->afForce[1] = SumLanes( fy );
+    pSums->afForce[2] = SumLanes( fz );
+    pSums->afPosition[0] = SumLanes( sx );
+    pSums->afPosition[1] = SumLanes( sy );
+    pSums->afPosition[2] = SumLanes( sz );
+    pSums->afVelocity[0] = SumLanes( vx );
+    pSums->afVelocity[1] = SumLanes( vy );
+    pSums->afVelocity[2] = SumLanes( vz );
+    pSums->fCount = SumLanes( vCount );
+}
+
+
+//--------------------------------------------------------------------------------------
+static inline __m128 Dot3( __m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz )
+{
+    return _mm_add_ps( _mm_add_ps( _mm_mul_ps( ax, bx ), _mm_mul_ps( ay, by ) ), _mm_mul_ps( az, bz ) );
+}
+
+
+//--------------------------------------------------------------------------------------
+static inline __m128 Select( __m128 vMask, __m128 a, __m128 b )
+{
+    return _mm_or_ps( _mm_and_ps( vMask, a ), _mm_andnot_ps( vMask, b ) );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Normalize on four vectors
+//--------------------------------------------------------------------------------------
+static inline void Normalize4( __m128* px, __m128* py, __m128* pz )
+{
+    const __m128 vLengthSq = Dot3( *px, *py, *pz, *px, *py, *pz );
+    const __m128 vScale = _mm_and_ps( _mm_cmpgt_ps( vLengthSq, _mm_setzero_ps() ),
+                                      _mm_div_ps( _mm_set1_ps( 1.0f ), _mm_sqrt_ps( vLengthSq ) ) );
+    *px = _mm_mul_ps( *px, vScale );
+    *py = _mm_mul_ps( *py, vScale );
+    *pz = _mm_mul_ps( *pz, vScale );
+}
+
+
+//--------------------------------------------------------------------------------------
+// AdvanceScalar on four boids, apBoids[k] with sums aSums[k].  Each float4 is loaded into
+// the lanes and transposed to x, y, z and w.
+//--------------------------------------------------------------------------------------
+static void AdvanceSSE( const BOIDS_RULES& Rules, const BOIDS_SUMS* aSums, D3DXVECTOR4* apPositions[4],
+                        D3DXVECTOR4* apVelocities[4], D3DXVECTOR4* apUps[4], UINT nBoids )
+{
+    const BOIDS_PARAMS& Params = Rules.Params;
+    const __m128 vZero = _mm_setzero_ps();
+    const __m128 vMaxForce = _mm_set1_ps( Params.fMaxForce );
+    const __m128 vMaxSpeed = _mm_set1_ps( Params.fMaxSpeed );
+    const __m128 vElapsedTime = _mm_set1_ps( Rules.fElapsedTime );
+
+    __m128 px = _mm_loadu_ps( ( const float* )apPositions[0] );
+    __m128 py = _mm_loadu_ps( ( const float* )apPositions[1] );
+    __m128 pz = _mm_loadu_ps( ( const float* )apPositions[2] );
+    __m128 pw = _mm_loadu_ps( ( const float* )apPositions[3] );
+    _MM_TRANSPOSE4_PS( px, py, pz, pw );
+    __m128 hx = _mm_loadu_ps( ( const float* )apVelocities[0] );
+    __m128 hy = _mm_loadu_ps( ( const float* )apVelocities[1] );
+    __m128 hz = _mm_loadu_ps( ( const float* )apVelocities[2] );
+    __m128 vSpeed = _mm_loadu_ps( ( const float* )apVelocities[3] );
+    _MM_TRANSPOSE4_PS( hx, hy, hz, vSpeed );
+    __m128 ux = _mm_loadu_ps( ( const float* )apUps[0] );
+    __m128 uy = _mm_loadu_ps( ( const float* )apUps[1] );
+    __m128 uz = _mm_loadu_ps( ( const float* )apUps[2] );
+    __m128 uw = _mm_loadu_ps( ( const float* )apUps[3] );
+    _MM_TRANSPOSE4_PS( ux, uy, uz, uw );
+
+    const __m128 vx = _mm_mul_ps( hx, vSpeed );
+    const __m128 vy = _mm_mul_ps( hy, vSpeed );
+    const __m128 vz = _mm_mul_ps( hz, vSpeed );
+
+    __m128 fx = _mm_setr_ps( aSums[0].afForce[0], aSums[1].afForce[0], aSums[2].afForce[0], aSums[3].afForce[0] );
+    __m128 fy = _mm_setr_ps( aSums[0].afForce[1], aSums[1].afForce[1], aSums[2].afForce[1], aSums[3].afForce[1] );
+    __m128 fz = _mm_setr_ps( aSums[0].afForce[2], aSums[1].afForce[2], aSums[2].afForce[2], aSums[3].afForce[2] );
+    const __m128 vSeparationStrength = _mm_set1_ps( Params.fSeparationStrength );
+    fx = _mm_mul_ps( fx, vSeparationStrength );
+    fy = _mm_mul_ps( fy, vSeparationStrength );
+    fz = _mm_mul_ps( fz, vSeparationStrength );
+
+    // The averages cohesion and alignment steer toward: with no neighbours, the boid's own
+    __m128 cx, cy, cz, ax, ay, az;
+    if( Rules.bFlockAverages )
+    {
+        cx = _mm_set1_ps( Rules.vFlockCenter.x );
+        cy = _mm_set1_ps( Rules.vFlockCenter.y );
+        cz = _mm_set1_ps( Rules.vFlockCenter.z );
+        ax = _mm_set1_ps( Rules.vFlockVelocity.x );
+        ay = _mm_set1_ps( Rules.vFlockVelocity.y );
+        az = _mm_set1_ps( Rules.vFlockVelocity.z );
+    }
+    else
+    {
+        const __m128 vCount = _mm_setr_ps( aSums[0].fCount, aSums[1].fCount, aSums[2].fCount, aSums[3].fCount );
+        const __m128 vAny = _mm_cmpgt_ps( vCount, vZero );
+        const __m128 vInvCount = _mm_and_ps( vAny, _mm_div_ps( _mm_set1_ps( 1.0f ), vCount ) );
+        cx = Select( vAny, _mm_mul_ps( _mm_setr_ps( aSums[0].afPosition[0], aSums[1].afPosition[0],
+                                                    aSums[2].afPosition[0], aSums[3].afPosition[0] ), vInvCount ), px );
+        cy = Select( vAny, _mm_mul_ps( _mm_setr_ps( aSums[0].afPosition[1], aSums[1].afPosition[1],
+                                                    aSums[2].afPosition[1], aSums[3].afPosition[1] ), vInvCount ), py );
+        cz = Select( vAny, _mm_mul_ps( _mm_setr_ps( aSums[0].afPosition[2], aSums[1].afPosition[2],
+                                                    aSums[2].afPosition[2], aSums[3].afPosition[2] ), vInvCount ), pz );
+        ax = Select( vAny, _mm_mul_ps( _mm_setr_ps( aSums[0].afVelocity[0], aSums[1].afVelocity[0],
+                                                    aSums[2].afVelocity[0], aSums[3].afVelocity[0] ), vInvCount ), vx );
+        ay = Select( vAny, _mm_mul_ps( _mm_setr_ps( aSums[0].afVelocity[1], aSums[1].afVelocity[1],
+                                                    aSums[2].afVelocity[1], aSums[3].afVelocity[1] ), vInvCount ), vy );
+        az = Select( vAny, _mm_mul_ps( _mm_setr_ps( aSums[0].afVelocity[2], aSums[1].afVelocity[2],
+                                                    aSums[2].afVelocity[2], aSums[3].afVelocity[2] ), vInvCount ), vz );
+    }
+
+    // Seek
+    __m128 tx = _mm_sub_ps( _mm_set1_ps( Params.vSeekPos.x ), px );
+    __m128 ty = _mm_sub_ps( _mm_set1_ps( Params.vSeekPos.y ), py );
+    __m128 tz = _mm_sub_ps( _mm_set1_ps( Params.vSeekPos.z ), pz );
+    Normalize4( &tx, &ty, &tz );
+    __m128 vStrength = _mm_set1_ps( Params.fSeekStrength );
+    fx = _mm_add_ps( fx, _mm_mul_ps( vStrength, _mm_sub_ps( _mm_mul_ps( tx, vMaxSpeed ), vx ) ) );
+    fy = _mm_add_ps( fy, _mm_mul_ps( vStrength, _mm_sub_ps( _mm_mul_ps( ty, vMaxSpeed ), vy ) ) );
+    fz = _mm_add_ps( fz, _mm_mul_ps( vStrength, _mm_sub_ps( _mm_mul_ps( tz, vMaxSpeed ), vz ) ) );
+
+    // Cohesion
+    tx = _mm_sub_ps( cx, px );
+    ty = _mm_sub_ps( cy, py );
+    tz = _mm_sub_ps( cz, pz );
+    Normalize4( &tx, &ty, &tz );
+    vStrength = _mm_set1_ps( Params.fCohesionStrength * Params.fMaxForce );
+    fx = _mm_add_ps( fx, _mm_mul_ps( vStrength, tx ) );
+    fy = _mm_add_ps( fy, _mm_mul_ps( vStrength, ty ) );
+    fz = _mm_add_ps( fz, _mm_mul_ps( vStrength, tz ) );
+
+    // Alignment
+    tx = _mm_sub_ps( ax, vx );
+    ty = _mm_sub_ps( ay, vy );
+    tz = _mm_sub_ps( az, vz );
+    Normalize4( &tx, &ty, &tz );
+    vStrength = _mm_set1_ps( Params.fAlignmentStrength * Params.fMaxForce );
+    fx = _mm_add_ps( fx, _mm_mul_ps( vStrength, tx ) );
+    fy = _mm_add_ps( fy, _mm_mul_ps( vStrength, ty ) );
+    fz = _mm_add_ps( fz, _mm_mul_ps( vStrength, tz ) );
+
+    // Flee
+    tx = _mm_sub_ps( px, _mm_set1_ps( Params.vFleePos.x ) );
+    ty = _mm_sub_ps( py, _mm_set1_ps( Params.vFleePos.y ) );
+    tz = _mm_sub_ps( pz, _mm_set1_ps( Params.vFleePos.z ) );
+    const __m128 vFleeSq = Dot3( tx, ty, tz, tx, ty, tz );
+    const __m128 vFleeing = _mm_cmpgt_ps( vFleeSq, vZero );
+    const __m128 vFleeScale = _mm_div_ps( vMaxSpeed, _mm_sqrt_ps( vFleeSq ) );
+    vStrength = _mm_div_ps( _mm_set1_ps( Params.fFleeStrength ), vFleeSq );
+    fx = _mm_add_ps( fx, _mm_and_ps( vFleeing, _mm_mul_ps( vStrength, _mm_sub_ps( _mm_mul_ps( tx, vFleeScale ),
+                                                                                   vx ) ) ) );
+    fy = _mm_add_ps( fy, _mm_and_ps( vFleeing, _mm_mul_ps( vStrength, _mm_sub_ps( _mm_mul_ps( ty, vFleeScale ),
+                                                                                   vy ) ) ) );
+    fz = _mm_add_ps( fz, _mm_and_ps( vFleeing, _mm_mul_ps( vStrength, _mm_sub_ps( _mm_mul_ps( tz, vFleeScale ),
+                                                                                   vz ) ) ) );
+
+    // Clamp the force
+    const __m128 vClamp = _mm_cmpgt_ps( Dot3( fx, fy, fz, fx, fy, fz ), _mm_mul_ps( vMaxForce, vMaxForce ) );
+    tx = fx;
+    ty = fy;
+    tz = fz;
+    Normalize4( &tx, &ty, &tz );
+    fx = Select( vClamp, _mm_mul_ps( tx, vMaxForce ), fx );
+    fy = Select( vClamp, _mm_mul_ps( ty, vMaxForce ), fy );
+    fz = Select( vClamp, _mm_mul_ps( tz, vMaxForce ), fz );
+
+    // Update the velocity and the position, and clamp the speed
+    const __m128 nx = _mm_add_ps( vx, _mm_mul_ps( fx, vElapsedTime ) );
+    const __m128 ny = _mm_add_ps( vy, _mm_mul_ps( fy, vElapsedTime ) );
+    const __m128 nz = _mm_add_ps( vz, _mm_mul_ps( fz, vElapsedTime ) );
+    px = _mm_add_ps( px, _mm_mul_ps( vx, vElapsedTime ) );
+    py = _mm_add_ps( py, _mm_mul_ps( vy, vElapsedTime ) );
+    pz = _mm_add_ps( pz, _mm_mul_ps( vz, vElapsedTime ) );
+    const __m128 vSpeedSq = Dot3( nx, ny, nz, nx, ny, nz );
+    vSpeed = _mm_min_ps( _mm_sqrt_ps( vSpeedSq ), vMaxSpeed );
+
+    // Reorient
+    tx = nx;
+    ty = ny;
+    tz = nz;
+    Normalize4( &tx, &ty, &tz );
+    const __m128 vMoving = _mm_cmpgt_ps( vSpeed, _mm_set1_ps( 0.001f ) );
+    hx = Select( vMoving, tx, hx );
+    hy = Select( vMoving, ty, hy );
+    hz = Select( vMoving, tz, hz );
+    Normalize4( &ux, &uy, &uz );
+    __m128 rx = _mm_sub_ps( _mm_mul_ps( uy, hz ), _mm_mul_ps( uz, hy ) );
+    __m128 ry = _mm_sub_ps( _mm_mul_ps( uz, hx ), _mm_mul_ps( ux, hz ) );
+    __m128 rz = _mm_sub_ps( _mm_mul_ps( ux, hy ), _mm_mul_ps( uy, hx ) );
+    Normalize4( &rx, &ry, &rz );
+    ux = _mm_sub_ps( _mm_mul_ps( hy, rz ), _mm_mul_ps( hz, ry ) );
+    uy = _mm_sub_ps( _mm_mul_ps( hz, rx ), _mm_mul_ps( hx, rz ) );
+    uz = _mm_sub_ps( _mm_mul_ps( hx, ry ), _mm_mul_ps( hy, rx ) );
+    Normalize4( &ux, &uy, &uz );
+
+    // The shader writes the top speed whatever the speed
+    pw = vZero;
+    vSpeed = vMaxSpeed;
+    uw = vZero;
+    _MM_TRANSPOSE4_PS( px, py, pz, pw );
+    _MM_TRANSPOSE4_PS( hx, hy, hz, vSpeed );
+    _MM_TRANSPOSE4_PS( ux, uy, uz, uw );
+    const __m128 avPositions[4] = { px, py, pz, pw };
+    const __m128 avVelocities[4] = { hx, hy, hz, vSpeed };
+    const __m128 avUps[4] = { ux, uy, uz, uw };
+    for( UINT k = 0; k < nBoids; k++ )
+    {
+        _mm_storeu_ps( ( float* )apPositions[k], avPositions[k] );
+        _mm_storeu_ps( ( float* )apVelocities[k], avVelocities[k] );
+        _mm_storeu_ps( ( float* )apUps[k], avUps[k] );
+    }
+}
+#endif
+
+
+//--------------------------------------------------------------------------------------
+static int __cdecl CompareBoids( const void* pA, const void* pB )
+{
+    const UINT a = *( const UINT* )pA;
+    const UINT b = *( const UINT* )pB;
+    return a < b ? -1 : ( a > b ? 1 : 0 );
+}
+
+
+//--------------------------------------------------------------------------------------
+CBoidsCPU::CBoidsCPU()
+{
+    ZeroMemory( &m_Params, sizeof( m_Params ) );
+    m_dwFlags = 0;
+    m_nBoids = 0;
+    m_fElapsedTime = 0.0f;
+    m_pPositions = NULL;
+    m_pVelocities = NULL;
+    m_pUps = NULL;
+    m_nMaxCells = 0;
+    m_nCells = 0;
+    ZeroMemory( m_anGrid, sizeof( m_anGrid ) );
+    ZeroMemory( m_afGridMin, sizeof( m_afGridMin ) );
+    m_fCellScale = 0.0f;
+    m_pCell = NULL;
+    m_pCellStart = NULL;
+    m_pCellNext = NULL;
+    m_pBlockSums = NULL;
+    m_pOrder = NULL;
+    m_pSlotX = NULL;
+    m_pSlotY = NULL;
+    m_pSlotZ = NULL;
+    m_pSlotVX = NULL;
+    m_pSlotVY = NULL;
+    m_pSlotVZ = NULL;
+    m_pItemBounds = NULL;
+    m_nBoundsItems = 0;
+    m_vFlockCenter = D3DXVECTOR3( 0, 0, 0 );
+    m_vFlockVelocity = D3DXVECTOR3( 0, 0, 0 );
+    m_nThreads = 1;
+    m_Job = BOIDS_JOB_BOUNDS;
+    m_fGridTime = 0.0;
+    m_fRulesTime = 0.0;
+    ZeroMemory( m_anNeighbors, sizeof( m_anNeighbors ) );
+    m_nNeighbors = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+CBoidsCPU::~CBoidsCPU()
+{
+    Destroy();
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CBoidsCPU::Create( UINT nBoids, const BOIDS_PARAMS& Params, UINT nThreads, DWORD dwFlags )
+{
+    Destroy();
+
+    if( 0 == nBoids || nBoids > 0x10000000 )
+        return E_INVALIDARG;
+
+    m_Params = Params;
+    m_dwFlags = dwFlags;
+    m_nBoids = nBoids;
+
+    if( 0 == nThreads )
+        nThreads = CDXUTWorkerPool::GetNumProcessors();
+    nThreads = min( nThreads, ( UINT )BOIDS_MAX_THREADS );
+    nThreads = min( nThreads, DXUTGetWorkerPool()->GetNumThreads() );
+
+    // Twice as many cells as boids at most, so a sparse flock does not make a huge grid
+    m_nMaxCells = max( 2 * nBoids, ( UINT )BOIDS_BLOCK_SIZE );
+    m_nBoundsItems = ( nBoids + BOIDS_CHUNK_SIZE - 1 ) / BOIDS_CHUNK_SIZE;
+    const UINT nBlocks = ( m_nMaxCells + BOIDS_BLOCK_SIZE - 1 ) / BOIDS_BLOCK_SIZE;
+    m_pPositions = new D3DXVECTOR4[ nBoids ];
+    m_pVelocities = new D3DXVECTOR4[ nBoids ];
+    m_pUps = new D3DXVECTOR4[ nBoids ];
+    m_pCell = new UINT[ nBoids ];
+    m_pCellStart = new LONG[ m_nMaxCells + 1 ];
+    m_pCellNext = new LONG[ m_nMaxCells ];
+    m_pBlockSums = new UINT[ nBlocks ];
+    m_pOrder = new UINT[ nBoids ];
+    m_pSlotX = new float[ nBoids + 4 ];
+    m_pSlotY = new float[ nBoids + 4 ];
+    m_pSlotZ = new float[ nBoids + 4 ];
+    m_pSlotVX = new float[ nBoids + 4 ];
+    m_pSlotVY = new float[ nBoids + 4 ];
+    m_pSlotVZ = new float[ nBoids + 4 ];
+    m_pItemBounds = new float[ m_nBoundsItems * BOIDS_ITEM_FLOATS ];
+    if( !m_pPositions || !m_pVelocities || !m_pUps || !m_pCell || !m_pCellStart || !m_pCellNext ||
+        !m_pBlockSums || !m_pOrder || !m_pSlotX || !m_pSlotY || !m_pSlotZ || !m_pSlotVX || !m_pSlotVY ||
+        !m_pSlotVZ || !m_pItemBounds )
+    {
+        Destroy();
+        return E_OUTOFMEMORY;
+    }
+
+    for( UINT i = 0; i < nBoids; i++ )
+    {
+        m_pPositions[i] = D3DXVECTOR4( 0, 0, 0, 1 );
+        m_pVelocities[i] = D3DXVECTOR4( 0, 0, -1, 0 );
+        m_pUps[i] = D3DXVECTOR4( 0, 1, 0, 1 );
+    }
+    ZeroMemory( m_pSlotX + nBoids, 4 * sizeof( float ) );
+    ZeroMemory( m_pSlotY + nBoids, 4 * sizeof( float ) );
+    ZeroMemory( m_pSlotZ + nBoids, 4 * sizeof( float ) );
+    ZeroMemory( m_pSlotVX + nBoids, 4 * sizeof( float ) );
+    ZeroMemory( m_pSlotVY + nBoids, 4 * sizeof( float ) );
+    ZeroMemory( m_pSlotVZ + nBoids, 4 * sizeof( float ) );
+
+    m_nThreads = nThreads;
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CBoidsCPU::Destroy()
+{
+    SAFE_DELETE_ARRAY( m_pPositions );
+    SAFE_DELETE_ARRAY( m_pVelocities );
+    SAFE_DELETE_ARRAY( m_pUps );
+    SAFE_DELETE_ARRAY( m_pCell );
+    SAFE_DELETE_ARRAY( m_pCellStart );
+    SAFE_DELETE_ARRAY( m_pCellNext );
+    SAFE_DELETE_ARRAY( m_pBlockSums );
+    SAFE_DELETE_ARRAY( m_pOrder );
+    SAFE_DELETE_ARRAY( m_pSlotX );
+    SAFE_DELETE_ARRAY( m_pSlotY );
+    SAFE_DELETE_ARRAY( m_pSlotZ );
+    SAFE_DELETE_ARRAY( m_pSlotVX );
+    SAFE_DELETE_ARRAY( m_pSlotVY );
+    SAFE_DELETE_ARRAY( m_pSlotVZ );
+    SAFE_DELETE_ARRAY( m_pItemBounds );
+    m_nMaxCells = 0;
+    m_nCells = 0;
+    m_nBoundsItems = 0;
+    m_nBoids = 0;
+    m_nThreads = 1;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CBoidsCPU::SetState( const D3DXVECTOR4* pPositions, const D3DXVECTOR4* pVelocities, const D3DXVECTOR4* pUps )
+{
+    if( pPositions )
+        memcpy( m_pPositions, pPositions, m_nBoids * sizeof( D3DXVECTOR4 ) );
+    if( pVelocities )
+        memcpy( m_pVelocities, pVelocities, m_nBoids * sizeof( D3DXVECTOR4 ) );
+    if( pUps )
+        memcpy( m_pUps, pUps, m_nBoids * sizeof( D3DXVECTOR4 ) );
+}
+
+
+//--------------------------------------------------------------------------------------
+void CBoidsCPU::GetState( D3DXVECTOR4* pPositions, D3DXVECTOR4* pVelocities, D3DXVECTOR4* pUps ) const
+{
+    if( pPositions )
+        memcpy( pPositions, m_pPositions, m_nBoids * sizeof( D3DXVECTOR4 ) );
+    if( pVelocities )
+        memcpy( pVelocities, m_pVelocities, m_nBoids * sizeof( D3DXVECTOR4 ) );
+    if( pUps )
+        memcpy( pUps, m_pUps, m_nBoids * sizeof( D3DXVECTOR4 ) );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Shares the nItems items of a job between this thread and the pool's workers
+//--------------------------------------------------------------------------------------
+void CBoidsCPU::RunJob( BOIDS_JOB Job, UINT nItems )
+{
+    m_Job = Job;
+    DXUTGetWorkerPool()->Run( ItemProc, this, nItems, m_nThreads );
+}
+
+
+//--------------------------------------------------------------------------------------
+void CBoidsCPU::ItemProc( void* pContext, UINT iItem, UINT iWorker )
+{
+    ( ( CBoidsCPU* )pContext )->RunItem( iItem, iWorker );
+}
+
+
+//--------------------------------------------------------------------------------------
+void CBoidsCPU::RunItem( UINT iItem, UINT iWorker )
+{
+    const UINT iFirst = iItem * BOIDS_CHUNK_SIZE;
+    const UINT nChunk = min( ( UINT )BOIDS_CHUNK_SIZE, m_nBoids - min( iFirst, m_nBoids ) );
+    switch( m_Job )
+    {
+        case BOIDS_JOB_BOUNDS:
+            FindBounds( iItem );
+            break;
+        case BOIDS_JOB_CLEAR:
+            ZeroMemory( ( void* )( m_pCellStart + iItem * BOIDS_BLOCK_SIZE ),
+                        min( ( UINT )BOIDS_BLOCK_SIZE, m_nCells - iItem * BOIDS_BLOCK_SIZE ) * sizeof( LONG ) );
+            break;
+        case BOIDS_JOB_COUNT:
+            CountCells( iFirst, nChunk );
+            break;
+        case BOIDS_JOB_SCAN:
+            ScanCells( iItem );
+            break;
+        case BOIDS_JOB_OFFSET:
+            OffsetCells( iItem );
+            break;
+        case BOIDS_JOB_SCATTER:
+            ScatterBoids( iFirst, nChunk );
+            break;
+        case BOIDS_JOB_GATHER:
+            GatherCells( iItem );
+            break;
+        case BOIDS_JOB_RULES:
+            ApplyRules( iItem * BOIDS_RUN_SIZE, min( ( UINT )BOIDS_RUN_SIZE, m_nBoids - iItem * BOIDS_RUN_SIZE ),
+                        iWorker );
+            break;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+void CBoidsCPU::Step( float fElapsedTime )
+{
+    double fStart = DXUTGetMilliseconds();
+
+    BuildGrid();
+
+    double fGridded = DXUTGetMilliseconds();
+    m_fElapsedTime = fElapsedTime;
+    ZeroMemory( m_anNeighbors, sizeof( m_anNeighbors ) );
+    RunJob( BOIDS_JOB_RULES, ( m_nBoids + BOIDS_RUN_SIZE - 1 ) / BOIDS_RUN_SIZE );
+
+    m_fGridTime = fGridded - fStart;
+    m_fRulesTime = DXUTGetMilliseconds() - fGridded;
+
+    m_nNeighbors = 0;
+    for( UINT i = 0; i < BOIDS_MAX_THREADS; i++ )
+        m_nNeighbors += m_anNeighbors[i];
+}
+
+
+//--------------------------------------------------------------------------------------
+// Sorts the boids into a grid over their bounds with a counting sort: each boid's cell is
+// counted, the counts are scanned to the first slot of each cell, and the boids are
+// scattered to the slots of their cells.  Scattered in parallel, the boids of a cell come
+// in any order, so each cell's are sorted back into boid order before they are gathered.
+//--------------------------------------------------------------------------------------
+void CBoidsCPU::BuildGrid()
+{
+    RunJob( BOIDS_JOB_BOUNDS, m_nBoundsItems );
+
+    float afMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float afMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    double afSums[7] = { 0, 0, 0, 0, 0, 0, 0 };
+    for( UINT i = 0; i < m_nBoundsItems; i++ )
+    {
+        const float* pItem = m_pItemBounds + i * BOIDS_ITEM_FLOATS;
+        for( UINT k = 0; k < 3; k++ )
+        {
+            afMin[k] = __min( afMin[k], pItem[k] );
+            afMax[k] = __max( afMax[k], pItem[3 + k] );
+        }
+        for( UINT k = 0; k < 7; k++ )
+            afSums[k] += pItem[6 + k];
+    }
+
+    // The sample's top mip averages the headings and the speeds apart
+    const double fInvBoids = 1.0 / m_nBoids;
+    const double fAverageSpeed = afSums[6] * fInvBoids;
+    m_vFlockCenter = D3DXVECTOR3( ( float )( afSums[0] * fInvBoids ), ( float )( afSums[1] * fInvBoids ),
+                                  ( float )( afSums[2] * fInvBoids ) );
+    m_vFlockVelocity = D3DXVECTOR3( ( float )( afSums[3] * fInvBoids * fAverageSpeed ),
+                                    ( float )( afSums[4] * fInvBoids * fAverageSpeed ),
+                                    ( float )( afSums[5] * fInvBoids * fAverageSpeed ) );
+
+    // Cells the radius across, or wider if that would make too many
+    double afExtent[3];
+    for( UINT k = 0; k < 3; k++ )
+    {
+        afExtent[k] = ( double )afMax[k] - afMin[k];
+        if( !( afExtent[k] >= 0.0 && afExtent[k] <= FLT_MAX ) )
+        {
+            afExtent[k] = 0.0;
+            afMin[k] = 0.0f;
+        }
+        m_afGridMin[k] = afMin[k];
+    }
+    double fCellSize = __max( m_Params.fNeighborRadius, 1e-3f );
+    for( ; ; )
+    {
+        double fCells = 1.0;
+        for( UINT k = 0; k < 3; k++ )
+            fCells *= floor( afExtent[k] / fCellSize ) + 1.0;
+        if( fCells <= m_nMaxCells )
+            break;
+        fCellSize *= pow( fCells / m_nMaxCells, 1.0 / 3.0 ) * 1.001;
+    }
+    m_nCells = 1;
+    for( UINT k = 0; k < 3; k++ )
+    {
+        m_anGrid[k] = ( UINT )floor( afExtent[k] / fCellSize ) + 1;
+        m_nCells *= m_anGrid[k];
+    }
+    m_fCellScale = ( float )( 1.0 / fCellSize );
+
+    const UINT nChunks = m_nBoundsItems;
+    const UINT nBlocks = ( m_nCells + BOIDS_BLOCK_SIZE - 1 ) / BOIDS_BLOCK_SIZE;
+    RunJob( BOIDS_JOB_CLEAR, nBlocks );
+    RunJob( BOIDS_JOB_COUNT, nChunks );
+    RunJob( BOIDS_JOB_SCAN, nBlocks );
+
+    UINT nSum = 0;
+    for( UINT i = 0; i < nBlocks; i++ )
+    {
+        const UINT nBlock = m_pBlockSums[i];
+        m_pBlockSums[i] = nSum;
+        nSum += nBlock;
+    }
+    RunJob( BOIDS_JOB_OFFSET, nBlocks );
+    m_pCellStart[m_nCells] = ( LONG )m_nBoids;
+
+    RunJob( BOIDS_JOB_SCATTER, nChunks );
+    RunJob( BOIDS_JOB_GATHER, nBlocks );
+}
+
+
+//--------------------------------------------------------------------------------------
+// The cell of a position, and its coordinates in the grid.  Positions off the grid, which
+// the bounds should not allow, are clamped to it.
+//--------------------------------------------------------------------------------------
+UINT CBoidsCPU::GetCell( float x, float y, float z, UINT* pnX, UINT* pnY, UINT* pnZ ) const
+{
+    const float af[3] = { x, y, z };
+    UINT an[3];
+    for( UINT k = 0; k < 3; k++ )
+    {
+        const float f = ( af[k] - m_afGridMin[k] ) * m_fCellScale;
+        an[k] = f >= ( float )( m_anGrid[k] - 1 ) ? m_anGrid[k] - 1 : ( f >= 1.0f ? ( UINT )f : 0 );
+    }
+    *pnX = an[0];
+    *pnY = an[1];
+    *pnZ = an[2];
+    return ( an[2] * m_anGrid[1] + an[1] ) * m_anGrid[0] + an[0];
+}
+
+
+//--------------------------------------------------------------------------------------
+void CBoidsCPU::FindBounds( UINT iItem )
+{
+    const UINT iFirst = iItem * BOIDS_CHUNK_SIZE;
+    const UINT iEnd = min( iFirst + BOIDS_CHUNK_SIZE, m_nBoids );
+    float* pItem = m_pItemBounds + iItem * BOIDS_ITEM_FLOATS;
+    for( UINT k = 0; k < 3; k++ )
+    {
+        pItem[k] = FLT_MAX;
+        pItem[3 + k] = -FLT_MAX;
+    }
+    for( UINT k = 6; k < BOIDS_ITEM_FLOATS; k++ )
+        pItem[k] = 0.0f;
+
+    for( UINT i = iFirst; i < iEnd; i++ )
+    {
+        const float* pfPosition = ( const float* )&m_pPositions[i];
+        const float* pfVelocity = ( const float* )&m_pVelocities[i];
+        for( UINT k = 0; k < 3; k++ )
+        {
+            pItem[k] = __min( pItem[k], pfPosition[k] );
+            pItem[3 + k] = __max( pItem[3 + k], pfPosition[k] );
+            pItem[6 + k] += pfPosition[k];
+            pItem[9 + k] += pfVelocity[k];
+        }
+        pItem[12] += pfVelocity[3];
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+void CBoidsCPU::CountCells( UINT iFirst, UINT nBoids )
+{
+    UINT x, y, z;
+    for( UINT i = iFirst; i < iFirst + nBoids; i++ )
+    {
+        const UINT iCell = GetCell( m_pPositions[i].x, m_pPositions[i].y, m_pPositions[i].z, &x, &y, &z );
+        m_pCell[i] = iCell;
+        InterlockedIncrement( &m_pCellStart[iCell] );
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Turns the counts of a block of cells into the first slot of each from the start of the
+// block, and keeps the block's count
+//--------------------------------------------------------------------------------------
+void CBoidsCPU::ScanCells( UINT iBlock )
+{
+    const UINT iFirst = iBlock * BOIDS_BLOCK_SIZE;
+    const UINT iEnd = min( iFirst + BOIDS_BLOCK_SIZE, m_nCells );
+    LONG nSum = 0;
+    for( UINT i = iFirst; i < iEnd; i++ )
+    {
+        const LONG nCount = m_pCellStart[i];
+        m_pCellStart[i] = nSum;
+        nSum += nCount;
+    }
+    m_pBlockSums[iBlock] = ( UINT )nSum;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CBoidsCPU::OffsetCells( UINT iBlock )
+{
+    const UINT iFirst = iBlock * BOIDS_BLOCK_SIZE;
+    const UINT iEnd = min( iFirst + BOIDS_BLOCK_SIZE, m_nCells );
+    const LONG nOffset = ( LONG )m_pBlockSums[iBlock];
+    for( UINT i = iFirst; i < iEnd; i++ )
+    {
+        m_pCellStart[i] += nOffset;
+        m_pCellNext[i] = m_pCellStart[i];
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+void CBoidsCPU::ScatterBoids( UINT iFirst, UINT nBoids )
+{
+    for( UINT i = iFirst; i < iFirst + nBoids; i++ )
+    {
+        const UINT iSlot = ( UINT )( InterlockedIncrement( &m_pCellNext[m_pCell[i]] ) - 1 );
+        m_pOrder[iSlot] = i;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Sorts the boids of each cell of a block into boid order, and copies their positions and
+// velocities to their slots
+//--------------------------------------------------------------------------------------
+void CBoidsCPU::GatherCells( UINT iBlock )
+{
+    const UINT iFirstCell = iBlock * BOIDS_BLOCK_SIZE;
+    const UINT iEndCell = min( iFirstCell + BOIDS_BLOCK_SIZE, m_nCells );
+    for( UINT iCell = iFirstCell; iCell < iEndCell; iCell++ )
+    {
+        const UINT iFirst = ( UINT )m_pCellStart[iCell];
+        const UINT iEnd = ( UINT )m_pCellStart[iCell + 1];
+        if( iEnd - iFirst > BOIDS_INSERTION_SORT )
+        {
+            qsort( m_pOrder + iFirst, iEnd - iFirst, sizeof( UINT ), CompareBoids );
+        }
+        else
+        {
+            for( UINT i = iFirst + 1; i < iEnd; i++ )
+            {
+                const UINT iBoid = m_pOrder[i];
+                UINT j = i;
+                for( ; j > iFirst && m_pOrder[j - 1] > iBoid; j-- )
+                    m_pOrder[j] = m_pOrder[j - 1];
+                m_pOrder[j] = iBoid;
+            }
+        }
+    }
+
+    const UINT iFirstSlot = ( UINT )m_pCellStart[iFirstCell];
+    const UINT iEndSlot = ( UINT )m_pCellStart[iEndCell];
+    for( UINT i = iFirstSlot; i < iEndSlot; i++ )
+    {
+        const D3DXVECTOR4& Position = m_pPositions[m_pOrder[i]];
+        const D3DXVECTOR4& Velocity = m_pVelocities[m_pOrder[i]];
+        m_pSlotX[i] = Position.x;
+        m_pSlotY[i] = Position.y;
+        m_pSlotZ[i] = Position.z;
+        m_pSlotVX[i] = Velocity.x * Velocity.w;
+        m_pSlotVY[i] = Velocity.y * Velocity.w;
+        m_pSlotVZ[i] = Velocity.z * Velocity.w;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Sums the neighbours of the boids of nSlots slots from iFirst, four at a time, and steps
+// them.  The neighbours come from the slots, which do not change during the job, and each
+// boid is written by the thread that owns its slot.
+//--------------------------------------------------------------------------------------
+void CBoidsCPU::ApplyRules( UINT iFirst, UINT nSlots, UINT iWorker )
+{
+    BOIDS_SLOTS Slots;
+    Slots.pX = m_pSlotX;
+    Slots.pY = m_pSlotY;
+    Slots.pZ = m_pSlotZ;
+    Slots.pVX = m_pSlotVX;
+    Slots.pVY = m_pSlotVY;
+    Slots.pVZ = m_pSlotVZ;
+    Slots.fRadiusSq = m_Params.fNeighborRadius * m_Params.fNeighborRadius;
+    Slots.fMaxForce = m_Params.fMaxForce;
+    Slots.fAvoidScale = m_Params.fMaxForce * m_Params.fAvoidStrength * m_Params.fAvoidStrength *
+                        m_Params.fAvoidStrength;
+
+    BOIDS_RULES Rules;
+    Rules.Params = m_Params;
+    Rules.fElapsedTime = m_fElapsedTime;
+    Rules.bFlockAverages = 0 != ( m_dwFlags & BOIDS_FLOCK_AVERAGES );
+    Rules.vFlockCenter = m_vFlockCenter;
+    Rules.vFlockVelocity = m_vFlockVelocity;
+
+#ifdef BOIDS_SSE
+    const bool bSSE = 0 == ( m_dwFlags & BOIDS_SCALAR );
+#endif
+
+    ULONGLONG nNeighbors = 0;
+    for( UINT i = iFirst; i < iFirst + nSlots; i += 4 )
+    {
+        const UINT nBoids = min( 4u, iFirst + nSlots - i );
+        BOIDS_SUMS aSums[4];
+        D3DXVECTOR4* apPositions[4];
+        D3DXVECTOR4* apVelocities[4];
+        D3DXVECTOR4* apUps[4];
+        for( UINT k = 0; k < 4; k++ )
+        {
+            // Past the last slot, the lanes take the last boid again and are not written
+            const UINT iSlot = i + min( k, nBoids - 1 );
+            const UINT iBoid = m_pOrder[iSlot];
+            apPositions[k] = &m_pPositions[iBoid];
+            apVelocities[k] = &m_pVelocities[iBoid];
+            apUps[k] = &m_pUps[iBoid];
+            if( k >= nBoids )
+            {
+                aSums[k] = aSums[nBoids - 1];
+                continue;
+            }
+
+            // The rows of up to three cells along x about the boid's cell, in the 3 x 3 rows
+            // about it, are each a run of slots
+            const float afPosition[3] = { m_pSlotX[iSlot], m_pSlotY[iSlot], m_pSlotZ[iSlot] };
+            UINT x, y, z;
+            GetCell( afPosition[0], afPosition[1], afPosition[2], &x, &y, &z );
+            const UINT x0 = x > 0 ? x - 1 : 0;
+            const UINT x1 = min( x + 1, m_anGrid[0] - 1 );
+            UINT aRanges[9][2];
+            UINT nRanges = 0;
+            for( UINT iz = ( z > 0 ? z - 1 : 0 ); iz <= min( z + 1, m_anGrid[2] - 1 ); iz++ )
+            {
+                for( UINT iy = ( y > 0 ? y - 1 : 0 ); iy <= min( y + 1, m_anGrid[1] - 1 ); iy++ )
+                {
+                    const UINT iRow = ( iz * m_anGrid[1] + iy ) * m_anGrid[0];
+                    aRanges[nRanges][0] = ( UINT )m_pCellStart[iRow + x0];
+                    aRanges[nRanges][1] = ( UINT )m_pCellStart[iRow + x1 + 1];
+                    nRanges++;
+                }
+            }
+
+#ifdef BOIDS_SSE
+            if( bSSE )
+                SumNeighborsSSE( Slots, aRanges, nRanges, afPosition, ( const float* )apVelocities[k], &aSums[k] );
+            else
+#endif
+                SumNeighborsScalar( Slots, aRanges, nRanges, afPosition, ( const float* )apVelocities[k],
+                                    &aSums[k] );
+            nNeighbors += ( ULONGLONG )aSums[k].fCount;
+        }
+
+#ifdef BOIDS_SSE
+        if( bSSE )
+        {
+            AdvanceSSE( Rules, aSums, apPositions, apVelocities, apUps, nBoids );
+            continue;
+        }
+#endif
+        for( UINT k = 0; k < nBoids; k++ )
+            AdvanceScalar( Rules, aSums[k], apPositions[k], apVelocities[k], apUps[k] );
+    }
+
+    m_anNeighbors[iWorker] += nNeighbors;
+}
@@ -0,0 +1,208 @@
+//--------------------------------------------------------------------------------------
+// File: BoidsCPU.h
+//
+// A CPU flocking engine with the rules and integration of GPUBoids.fx, for trying out
+// changes to the rules and for running flocks without a device.  Boids are kept as the
+// particle texture keeps them: a float4 position, a float4 of the heading and the speed,
+// and a float4 up vector each, as LoadParticles seeds them and PSAdvance writes them.
+//
+// The sample splats every boid over every other one, so each boid is pushed apart from
+// the whole flock and steered toward the average of the whole flock.  Here a boid only
+// sees the boids within a neighbour radius.  Each step the boids are sorted into a
+// uniform grid of cells at least the radius across with a counting sort, so the
+// neighbours of a boid are all in the 27 cells around its own.  Separation and avoidance,
+// as PSForce sums them, are summed over the neighbours, and cohesion and alignment
+// steer toward their average position and velocity unless BOIDS_FLOCK_AVERAGES asks for
+// the averages of the whole flock, as the sample's top mip gives them.  Seek, flee and
+// the clamps, the step and the reorientation are those of PSAdvance.
+//
+// The neighbours are summed four at a time and the rules applied to four boids at a time
+// with SSE.  The grid is built and the boids stepped in parallel; a boid's neighbours are
+// always summed in the same order, so the result is the same on any number of threads.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#pragma once
+#ifndef BOIDSCPU_H
+#define BOIDSCPU_H
+
+#define BOIDS_MAX_THREADS       32
+
+// Use the plain C++ rules even where SSE is available
+#define BOIDS_SCALAR            0x00000001
+
+// Steer toward the average position and velocity of the whole flock, as the sample does,
+// rather than those of the neighbours
+#define BOIDS_FLOCK_AVERAGES    0x00000002
+
+// The effect parameters the force and advance passes use
+struct BOIDS_PARAMS
+{
+    float fMaxForce;            // g_fMaxForce
+    float fMaxSpeed;            // g_fMaxSpeed
+    float fAvoidStrength;       // g_fAvoidStrength
+    float fSeekStrength;        // g_fSeekStrength
+    float fFleeStrength;        // g_fFleeStrength
+    float fSeparationStrength;  // g_fSeparationStrength
+    float fCohesionStrength;    // g_fCohesionStrength
+    float fAlignmentStrength;   // g_fAlignmentStrength
+    D3DXVECTOR3 vSeekPos;       // g_vSeekPos
+    D3DXVECTOR3 vFleePos;       // g_vFleePos
+    float fNeighborRadius;      // Boids further apart than this do not see each other
+};
+
+
+
+//--------------------------------------------------------------------------------------
+class CBoidsCPU
+{
+public:
+                        CBoidsCPU();
+                        ~CBoidsCPU();
+
+    // nThreads 0 uses a thread for each processor.  The boids start at the origin, heading
+    // down z at rest.
+    HRESULT             Create( UINT nBoids, const BOIDS_PARAMS& Params, UINT nThreads = 0, DWORD dwFlags = 0 );
+    void                Destroy();
+
+    void                SetParams( const BOIDS_PARAMS& Params )
+    {
+        m_Params = Params;
+    }
+    const BOIDS_PARAMS& GetParams() const
+    {
+        return m_Params;
+    }
+
+    // Copies the boids in or out, GetNumBoids() of each.  Any pointer may be NULL.
+    void                SetState( const D3DXVECTOR4* pPositions, const D3DXVECTOR4* pVelocities,
+                                  const D3DXVECTOR4* pUps );
+    void                GetState( D3DXVECTOR4* pPositions, D3DXVECTOR4* pVelocities, D3DXVECTOR4* pUps ) const;
+
+    // Sorts the boids into the grid, then moves them on by fElapsedTime as the force and
+    // advance passes do
+    void                Step( float fElapsedTime );
+
+    const D3DXVECTOR4*  GetPositions() const
+    {
+        return m_pPositions;
+    }
+    const D3DXVECTOR4*  GetVelocities() const
+    {
+        return m_pVelocities;
+    }
+    const D3DXVECTOR4*  GetUps() const
+    {
+        return m_pUps;
+    }
+
+    UINT                GetNumBoids() const
+    {
+        return m_nBoids;
+    }
+    UINT                GetNumThreads() const
+    {
+        return m_nThreads;
+    }
+
+    // Milliseconds the last Step took to sort the boids into the grid, and to apply the
+    // rules and move them
+    double              GetGridTime() const
+    {
+        return m_fGridTime;
+    }
+    double              GetRulesTime() const
+    {
+        return m_fRulesTime;
+    }
+
+    // Cells of the last Step's grid, and pairs of boids within the radius of each other
+    // it found, each pair counted from both ends
+    UINT                GetNumCells() const
+    {
+        return m_nCells;
+    }
+    ULONGLONG           GetNumNeighbors() const
+    {
+        return m_nNeighbors;
+    }
+
+protected:
+    enum BOIDS_JOB
+    {
+        BOIDS_JOB_BOUNDS = 0,
+        BOIDS_JOB_CLEAR,
+        BOIDS_JOB_COUNT,
+        BOIDS_JOB_SCAN,
+        BOIDS_JOB_OFFSET,
+        BOIDS_JOB_SCATTER,
+        BOIDS_JOB_GATHER,
+        BOIDS_JOB_RULES,
+    };
+
+    static void         ItemProc( void* pContext, UINT iItem, UINT iWorker );
+
+    void                RunJob( BOIDS_JOB Job, UINT nItems );
+    void                RunItem( UINT iItem, UINT iWorker );
+
+    void                BuildGrid();
+    UINT                GetCell( float x, float y, float z, UINT* pnX, UINT* pnY, UINT* pnZ ) const;
+    void                FindBounds( UINT iItem );
+    void                CountCells( UINT iFirst, UINT nBoids );
+    void                ScanCells( UINT iBlock );
+    void                OffsetCells( UINT iBlock );
+    void                ScatterBoids( UINT iFirst, UINT nBoids );
+    void                GatherCells( UINT iBlock );
+    void                ApplyRules( UINT iFirst, UINT nSlots, UINT iWorker );
+
+    BOIDS_PARAMS        m_Params;
+    DWORD               m_dwFlags;
+    UINT                m_nBoids;
+    float               m_fElapsedTime;
+
+    D3DXVECTOR4*        m_pPositions;
+    D3DXVECTOR4*        m_pVelocities;      // Heading in xyz, speed in w
+    D3DXVECTOR4*        m_pUps;
+
+    // The grid.  m_pCellStart holds the count of each cell and then, once scanned, the
+    // first slot of each, with one more at the end for the slot after the last cell.
+    // Cells run along x, then y, then z.
+    UINT                m_nMaxCells;
+    UINT                m_nCells;
+    UINT                m_anGrid[3];
+    float               m_afGridMin[3];
+    float               m_fCellScale;       // Cells per unit
+    UINT*               m_pCell;            // Of each boid
+    volatile LONG*      m_pCellStart;
+    volatile LONG*      m_pCellNext;        // The next slot of each cell to fill
+    UINT*               m_pBlockSums;
+    UINT*               m_pOrder;           // The boid in each slot
+
+    // The boids in slot order, padded with 4 more, as the neighbour sums read them
+    float*              m_pSlotX;
+    float*              m_pSlotY;
+    float*              m_pSlotZ;
+    float*              m_pSlotVX;
+    float*              m_pSlotVY;
+    float*              m_pSlotVZ;
+
+    // The bounds and the sums of the positions, headings and speeds of each item of the
+    // bounds job, then the averages of the whole flock
+    float*              m_pItemBounds;
+    UINT                m_nBoundsItems;
+    D3DXVECTOR3         m_vFlockCenter;
+    D3DXVECTOR3         m_vFlockVelocity;
+
+    // Jobs run on the DXUT worker pool, on up to m_nThreads threads counting the one
+    // calling Step
+    UINT                m_nThreads;
+    BOIDS_JOB           m_Job;
+
+    double              m_fGridTime;
+    double              m_fRulesTime;
+    ULONGLONG           m_anNeighbors[BOIDS_MAX_THREADS];
+    ULONGLONG           m_nNeighbors;
+};
+
+#endif
@@ -11,6 +11,7 @@
 #include "SDKmisc.h"
 #include "SDKmesh.h"
 #include "resource.h"
+#include "BoidsCPU.h"
 
 //--------------------------------------------------------------------------------------
 // Global variables
@@ -44,6 +45,7 @@ ID3D10RenderTargetView*             g_pParticleDataTexRTVTo = NULL;
 ID3D10Texture2D*                    g_pParticleDataTextureFrom = NULL;
 ID3D10ShaderResourceView*           g_pParticleDataTexSRVFrom = NULL;
 ID3D10RenderTargetView*             g_pParticleDataTexRTVFrom = NULL;
+ID3D10Texture2D*                    g_pParticleDataStaging = NULL;  // For reading the boids back
 ID3D10Texture2D*                    g_pForceTexture = NULL;
 ID3D10ShaderResourceView*           g_pForceTexSRV = NULL;
 ID3D10RenderTargetView*             g_pForceTexRTV = NULL;
@@ -92,6 +94,11 @@ float                               g_fGConstant = 6.67300e-11f * 10000.0f;
 float                               g_fSpread = 50.0f;
 float                               g_fParticleRad = 1.0f;
 float                               g_fBoidScale = 3.0f;
+float                               g_fNeighborRadius = 15.0f;      // For CBoidsCPU
+
+bool                                g_bSimulateOnCPU = false;
+CBoidsCPU*                          g_pBoidsCPU = NULL;
+D3DXVECTOR4*                        g_pCPUTexels = NULL;    // The positions, velocities and ups of every texel
 
 //--------------------------------------------------------------------------------------
 // UI control IDs
@@ -104,6 +111,7 @@ float                               g_fBoidScale = 3.0f;
 #define IDC_ACCUMULATEWITHGS	10
 #define IDC_BOIDSCALE_STATIC	11
 #define IDC_BOIDSCALE			12
+#define IDC_SIMULATEONCPU       13
 
 
 //--------------------------------------------------------------------------------------
@@ -133,6 +141,10 @@ HRESULT CreateParticleTextures( ID3D10Device* pd3dDevice );
 HRESULT CreateParticleBuffer( ID3D10Device* pd3dDevice );
 HRESULT CreateForceTexture( ID3D10Device* pd3dDevice );
 HRESULT CreateSplatBuffer( ID3D10Device* pd3dDevice );
+HRESULT StartCPUSimulation( ID3D10Device* pd3dDevice );
+HRESULT StepOnCPU( ID3D10Device* pd3dDevice, float fElapsedTime );
+INT RunCPUSimulation( int nArgs, LPWSTR* pstrArgs );
+INT RunCPUBenchmark( int nArgs, LPWSTR* pstrArgs );
 
 //--------------------------------------------------------------------------------------
 // Entry point to the program. Initializes everything and goes into a message processing 
@@ -145,6 +157,25 @@ int WINAPI wWinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdL
     _CrtSetDbgFlag( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );
 #endif
 
+    // -cpusim and -cpubench run the boids on the CPU without creating a window
+    int nArgs = 0;
+    LPWSTR* pstrArgs = CommandLineToArgvW( GetCommandLineW(), &nArgs );
+    if( pstrArgs )
+    {
+        for( int i = 1; i < nArgs; i++ )
+        {
+            const bool bSimulate = 0 == _wcsicmp( pstrArgs[i], L"-cpusim" );
+            if( bSimulate || 0 == _wcsicmp( pstrArgs[i], L"-cpubench" ) )
+            {
+                INT nResult = bSimulate ? RunCPUSimulation( nArgs - i - 1, pstrArgs + i + 1 ) :
+                                          RunCPUBenchmark( nArgs - i - 1, pstrArgs + i + 1 );
+                LocalFree( pstrArgs );
+                return nResult;
+            }
+        }
+        LocalFree( pstrArgs );
+    }
+
     // DXUT will create and use the best device (either D3D9 or D3D10) 
     // that is available on the system depending on which D3D callbacks are set below
 
@@ -191,6 +222,7 @@ void InitApp()
     swprintf_s( str, MAX_PATH, L"BoidSize: %.2f", g_fBoidScale );
     g_SampleUI.AddStatic( IDC_BOIDSCALE_STATIC, str, 35, iY += 24, 125, 22 );
     g_SampleUI.AddSlider( IDC_BOIDSCALE, 35, iY += 24, 125, 22, 0, 500, ( int )( g_fBoidScale * 100 ) );
+    g_SampleUI.AddCheckBox( IDC_SIMULATEONCPU, L"Simulate on CPU", 35, iY += 24, 125, 22, g_bSimulateOnCPU );
 }
 
 
@@ -310,6 +342,17 @@ void CALLBACK OnGUIEvent( UINT nEvent, int nControlID, CDXUTControl* pControl, v
             g_SampleUI.GetStatic( IDC_BOIDSCALE_STATIC )->SetText( str );
         }
             break;
+
+        case IDC_SIMULATEONCPU:
+            g_bSimulateOnCPU = !g_bSimulateOnCPU;
+
+            // Carry on from where the GPU has got to
+            if( g_bSimulateOnCPU && FAILED( StartCPUSimulation( DXUTGetD3D10Device() ) ) )
+            {
+                g_bSimulateOnCPU = false;
+                g_SampleUI.GetCheckBox( IDC_SIMULATEONCPU )->SetChecked( false );
+            }
+            break;
     }
 }
 
@@ -818,20 +861,27 @@ void CALLBACK OnD3D10FrameRender( ID3D10Device* pd3dDevice, double fTime, float
 
     g_pvFleePos->SetFloatVector( ( float* )g_vFleePos );
 
-    // Average the velocities and positions
-    pd3dDevice->GenerateMips( g_pParticleDataTexSRVFrom );
-
-    // Accumulate forces
-    if( g_bAccumulateWithGS )
-        AccumulateForcesGS( pd3dDevice );
+    if( g_bSimulateOnCPU )
+    {
+        StepOnCPU( pd3dDevice, fElapsedTime );
+    }
     else
-        AccumulateForces( pd3dDevice );
+    {
+        // Average the velocities and positions
+        pd3dDevice->GenerateMips( g_pParticleDataTexSRVFrom );
+
+        // Accumulate forces
+        if( g_bAccumulateWithGS )
+            AccumulateForcesGS( pd3dDevice );
+        else
+            AccumulateForces( pd3dDevice );
 
-    // Apply forces to particles
-    AdvanceParticles( pd3dDevice, fElapsedTime );
+        // Apply forces to particles
+        AdvanceParticles( pd3dDevice, fElapsedTime );
 
-    // Swap the ping-pong buffers
-    SwapParticleTextures();
+        // Swap the ping-pong buffers
+        SwapParticleTextures();
+    }
 
     D3DXMATRIX mView;
     D3DXMATRIX mProj;
@@ -880,6 +930,14 @@ void RenderText()
     g_pTxtHelper->DrawTextLine( DXUTGetDeviceStats() );
     g_pTxtHelper->SetForegroundColor( D3DXCOLOR( 1.0f, 0.5f, 0.0f, 1.0f ) );
     g_pTxtHelper->DrawTextLine( L"Use A,D,S,W,Q,E keys to move the ball" );
+    if( g_bSimulateOnCPU && g_pBoidsCPU )
+    {
+        g_pTxtHelper->SetForegroundColor( D3DXCOLOR( 0.0f, 0.0f, 1.0f, 1.0f ) );
+        g_pTxtHelper->DrawFormattedTextLine( L"CPU step: %.2f ms grid, %.2f ms rules on %u threads, %.1f neighbors",
+                                             g_pBoidsCPU->GetGridTime(), g_pBoidsCPU->GetRulesTime(),
+                                             g_pBoidsCPU->GetNumThreads(),
+                                             ( double )g_pBoidsCPU->GetNumNeighbors() / g_pBoidsCPU->GetNumBoids() );
+    }
     g_pTxtHelper->End();
 }
 
@@ -917,12 +975,19 @@ void CALLBACK OnD3D10DestroyDevice( void* pUserContext )
     SAFE_RELEASE( g_pParticleDataTextureFrom );
     SAFE_RELEASE( g_pParticleDataTexSRVFrom );
     SAFE_RELEASE( g_pParticleDataTexRTVFrom );
+    SAFE_RELEASE( g_pParticleDataStaging );
     SAFE_RELEASE( g_pForceTexture );
     SAFE_RELEASE( g_pForceTexSRV );
     SAFE_RELEASE( g_pForceTexRTV );
 
     g_BoidMesh.Destroy();
     g_FleeMesh.Destroy();
+
+    // The texels the CPU simulation keeps are those of this device's textures
+    SAFE_DELETE( g_pBoidsCPU );
+    SAFE_DELETE_ARRAY( g_pCPUTexels );
+    g_bSimulateOnCPU = false;
+    g_SampleUI.GetCheckBox( IDC_SIMULATEONCPU )->SetChecked( false );
 }
 
 
@@ -962,6 +1027,20 @@ void LoadParticles( D3DXVECTOR4* pPositions, D3DXVECTOR4* pVelocities, D3DXVECTO
     }
 }
 
+
+//--------------------------------------------------------------------------------------
+// Seeds the boids of the sample, two clumps of them heading toward each other, on the GPU
+// or the CPU
+//--------------------------------------------------------------------------------------
+void SeedBoids( D3DXVECTOR4* pPositions, D3DXVECTOR4* pVelocities, D3DXVECTOR4* pUps, UINT nBoids, float fSpread )
+{
+    const UINT nFirst = nBoids / 2;
+    LoadParticles( pPositions, pVelocities, pUps, D3DXVECTOR3( fSpread, 0, 0 ), D3DXVECTOR4( 0, 0, -1, 0 ),
+                   fSpread, nFirst );
+    LoadParticles( pPositions + nFirst, pVelocities + nFirst, pUps + nFirst, D3DXVECTOR3( -fSpread, 0, 0 ),
+                   D3DXVECTOR4( 0, 0, 1, 0 ), fSpread, nBoids - nFirst );
+}
+
 //--------------------------------------------------------------------------------------
 // This helper function creates the texture array that will store all of the particle
 // data.  Position, Velocity.
@@ -1013,13 +1092,7 @@ HRESULT CreateParticleTextures( ID3D10Device* pd3dDevice )
 
     UINT MaxTextureParticles = SideSize * SideSize;
     // Two clumps
-    LoadParticles( ppData[0], ppData[1 * MipLevels], ppData[2 * MipLevels],
-                   D3DXVECTOR3( g_fSpread, 0, 0 ), D3DXVECTOR4( 0, 0, -1, 0 ),
-                   g_fSpread, MaxTextureParticles / 2 );
-    LoadParticles( &ppData[0][MaxTextureParticles / 2], &ppData[1 * MipLevels][MaxTextureParticles / 2], &ppData[2 *
-                   MipLevels][MaxTextureParticles / 2],
-                   D3DXVECTOR3( -g_fSpread, 0, 0 ), D3DXVECTOR4( 0, 0, 1, 0 ),
-                   g_fSpread, MaxTextureParticles / 2 );
+    SeedBoids( ppData[0], ppData[1 * MipLevels], ppData[2 * MipLevels], MaxTextureParticles, g_fSpread );
 
     D3D10_SUBRESOURCE_DATA* pInitData = new D3D10_SUBRESOURCE_DATA[3 * MipLevels];
 
@@ -1220,3 +1293,409 @@ HRESULT CreateSplatBuffer( ID3D10Device* pd3dDevice )
 
     return hr;
 }
+
+
+//--------------------------------------------------------------------------------------
+// The parameters of cb1 in GPUBoids.fx, with the flee position and neighbour radius given
+//--------------------------------------------------------------------------------------
+void GetBoidsParams( BOIDS_PARAMS* pParams, const D3DXVECTOR4& vFleePos, float fNeighborRadius )
+{
+    pParams->fMaxForce = 60.0f;
+    pParams->fMaxSpeed = 25.0f;
+    pParams->fAvoidStrength = 5.0f;
+    pParams->fSeekStrength = 3.0f;
+    pParams->fFleeStrength = 900000.0f;
+    pParams->fSeparationStrength = 1.0f;
+    pParams->fCohesionStrength = 0.5f;
+    pParams->fAlignmentStrength = 0.5f;
+    pParams->vSeekPos = D3DXVECTOR3( 0, 0, 0 );
+    pParams->vFleePos = D3DXVECTOR3( vFleePos.x, vFleePos.y, vFleePos.z );
+    pParams->fNeighborRadius = fNeighborRadius;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Reads the positions, velocities and ups of every texel of the particle texture back
+//--------------------------------------------------------------------------------------
+HRESULT ReadParticleState( ID3D10Device* pd3dDevice, ID3D10Texture2D* pTexture, D3DXVECTOR4* pTexels )
+{
+    HRESULT hr;
+
+    D3D10_TEXTURE2D_DESC dstex;
+    pTexture->GetDesc( &dstex );
+    if( !g_pParticleDataStaging )
+    {
+        dstex.Usage = D3D10_USAGE_STAGING;
+        dstex.BindFlags = 0;
+        dstex.CPUAccessFlags = D3D10_CPU_ACCESS_READ;
+        dstex.MiscFlags = 0;
+        V_RETURN( pd3dDevice->CreateTexture2D( &dstex, NULL, &g_pParticleDataStaging ) );
+    }
+    pd3dDevice->CopyResource( g_pParticleDataStaging, pTexture );
+
+    const UINT nTexels = g_iTexSize * g_iTexSize;
+    for( UINT iSlice = 0; iSlice < 3; iSlice++ )
+    {
+        const UINT iSubresource = D3D10CalcSubresource( 0, iSlice, dstex.MipLevels );
+        D3D10_MAPPED_TEXTURE2D Mapped;
+        V_RETURN( g_pParticleDataStaging->Map( iSubresource, D3D10_MAP_READ, 0, &Mapped ) );
+        for( UINT y = 0; y < g_iTexSize; y++ )
+        {
+            memcpy( pTexels + iSlice * nTexels + y * g_iTexSize, ( const BYTE* )Mapped.pData + y * Mapped.RowPitch,
+                    g_iTexSize * sizeof( D3DXVECTOR4 ) );
+        }
+        g_pParticleDataStaging->Unmap( iSubresource );
+    }
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Reads the boids back from the GPU and hands the ones the sample draws to the CPU
+//--------------------------------------------------------------------------------------
+HRESULT StartCPUSimulation( ID3D10Device* pd3dDevice )
+{
+    HRESULT hr;
+
+    const UINT nTexels = g_iTexSize * g_iTexSize;
+    if( !g_pBoidsCPU )
+    {
+        BOIDS_PARAMS Params;
+        GetBoidsParams( &Params, g_vFleePos, g_fNeighborRadius );
+
+        g_pBoidsCPU = new CBoidsCPU();
+        g_pCPUTexels = new D3DXVECTOR4[ 3 * nTexels ];
+        if( !g_pBoidsCPU || !g_pCPUTexels || FAILED( hr = g_pBoidsCPU->Create( MAX_PARTICLES, Params ) ) )
+        {
+            SAFE_DELETE( g_pBoidsCPU );
+            SAFE_DELETE_ARRAY( g_pCPUTexels );
+            return E_OUTOFMEMORY;
+        }
+    }
+
+    V_RETURN( ReadParticleState( pd3dDevice, g_pParticleDataTextureFrom, g_pCPUTexels ) );
+    g_pBoidsCPU->SetState( g_pCPUTexels, g_pCPUTexels + nTexels, g_pCPUTexels + 2 * nTexels );
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Steps the boids on the CPU and writes them to the particle texture in place of the
+// force and advance passes.  The texels past the boids the sample draws keep what they
+// held when the CPU took over.
+//--------------------------------------------------------------------------------------
+HRESULT StepOnCPU( ID3D10Device* pd3dDevice, float fElapsedTime )
+{
+    if( !g_pBoidsCPU )
+        return E_FAIL;
+
+    BOIDS_PARAMS Params;
+    GetBoidsParams( &Params, g_vFleePos, g_fNeighborRadius );
+    g_pBoidsCPU->SetParams( Params );
+    g_pBoidsCPU->Step( fElapsedTime );
+
+    const UINT nTexels = g_iTexSize * g_iTexSize;
+    g_pBoidsCPU->GetState( g_pCPUTexels, g_pCPUTexels + nTexels, g_pCPUTexels + 2 * nTexels );
+
+    D3D10_TEXTURE2D_DESC dstex;
+    g_pParticleDataTextureFrom->GetDesc( &dstex );
+    for( UINT iSlice = 0; iSlice < 3; iSlice++ )
+    {
+        pd3dDevice->UpdateSubresource( g_pParticleDataTextureFrom, D3D10CalcSubresource( 0, iSlice, dstex.MipLevels ),
+                                       NULL, g_pCPUTexels + iSlice * nTexels, g_iTexSize * sizeof( D3DXVECTOR4 ), 0 );
+    }
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Parses the options -cpusim and -cpubench share
+//--------------------------------------------------------------------------------------
+void ParseCPUArgs( int nArgs, LPWSTR* pstrArgs, UINT* pnBoids, UINT* pnThreads, UINT* pnSteps, float* pfRadius )
+{
+    for( int i = 0; i + 1 < nArgs; i++ )
+    {
+        if( 0 == _wcsicmp( pstrArgs[i], L"-boids" ) )
+        {
+            int nValue = _wtoi( pstrArgs[++i] );
+            *pnBoids = nValue < 1 ? 1 : ( nValue > 16777216 ? 16777216 : nValue );
+        }
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-threads" ) )
+        {
+            int nValue = _wtoi( pstrArgs[++i] );
+            *pnThreads = nValue > 0 ? nValue : 0;
+        }
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-steps" ) )
+        {
+            int nValue = _wtoi( pstrArgs[++i] );
+            *pnSteps = nValue < 1 ? 1 : nValue;
+        }
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-radius" ) )
+        {
+            float fValue = ( float )_wtof( pstrArgs[++i] );
+            *pfRadius = fValue < 0.0f ? 0.0f : fValue;
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Seeds nBoids boids as the sample seeds its own, spread out so they are as crowded as
+// the sample's MAX_PARTICLES are
+//--------------------------------------------------------------------------------------
+HRESULT SeedCPUBoids( D3DXVECTOR4** ppState, UINT nBoids )
+{
+    *ppState = new D3DXVECTOR4[ 3 * ( SIZE_T )nBoids ];
+    if( !*ppState )
+        return E_OUTOFMEMORY;
+
+    srand( 1 );
+    const float fSpread = g_fSpread * powf( ( float )nBoids / MAX_PARTICLES, 1.0f / 3.0f );
+    SeedBoids( *ppState, *ppState + nBoids, *ppState + 2 * ( SIZE_T )nBoids, nBoids, fSpread );
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Headless run of the boids on the CPU:
+//
+//   GPUBoids -cpusim [-boids N] [-steps N] [-threads N] [-radius f] [-flock] [-out file]
+//
+// Seeds -boids boids (MAX_PARTICLES by default) as the sample does and steps them -steps
+// times (100 by default) a 60th of a second apart, each seeing the boids within -radius
+// (15 by default), or steering toward the averages of the whole flock with -flock.
+// Prints the milliseconds a step takes, and writes the positions, the velocities then
+// the ups, as float4s, to -out if it is given.
+// Returns 0 on success, 1 on failure.
+//--------------------------------------------------------------------------------------
+INT RunCPUSimulation( int nArgs, LPWSTR* pstrArgs )
+{
+    // Report to the console we were started from, if any
+    if( AttachConsole( ATTACH_PARENT_PROCESS ) )
+    {
+        FILE* pFile;
+        freopen_s( &pFile, "CONOUT$", "w", stdout );
+    }
+
+    UINT nBoids = MAX_PARTICLES;
+    UINT nThreads = 0;
+    UINT nSteps = 100;
+    float fRadius = g_fNeighborRadius;
+    DWORD dwFlags = 0;
+    LPCWSTR strOutput = NULL;
+    ParseCPUArgs( nArgs, pstrArgs, &nBoids, &nThreads, &nSteps, &fRadius );
+    for( int i = 0; i < nArgs; i++ )
+    {
+        if( 0 == _wcsicmp( pstrArgs[i], L"-flock" ) )
+            dwFlags |= BOIDS_FLOCK_AVERAGES;
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-out" ) && i + 1 < nArgs )
+            strOutput = pstrArgs[++i];
+    }
+
+    D3DXVECTOR4* pState = NULL;
+    CBoidsCPU CPU;
+    BOIDS_PARAMS Params;
+    GetBoidsParams( &Params, g_vFleePos, fRadius );
+    if( FAILED( SeedCPUBoids( &pState, nBoids ) ) || FAILED( CPU.Create( nBoids, Params, nThreads, dwFlags ) ) )
+    {
+        SAFE_DELETE_ARRAY( pState );
+        wprintf( L"Out of memory\n" );
+        return 1;
+    }
+    CPU.SetState( pState, pState + nBoids, pState + 2 * ( SIZE_T )nBoids );
+
+    LARGE_INTEGER Frequency, Start, End;
+    QueryPerformanceFrequency( &Frequency );
+    double fGridTime = 0.0, fRulesTime = 0.0;
+    ULONGLONG nNeighbors = 0;
+    QueryPerformanceCounter( &Start );
+    for( UINT iStep = 0; iStep < nSteps; iStep++ )
+    {
+        CPU.Step( 1.0f / 60.0f );
+        fGridTime += CPU.GetGridTime();
+        fRulesTime += CPU.GetRulesTime();
+        nNeighbors += CPU.GetNumNeighbors();
+    }
+    QueryPerformanceCounter( &End );
+
+    wprintf( L"%u boids, %u steps on %u threads, radius %.2f, %s averages\n", nBoids, nSteps, CPU.GetNumThreads(),
+             fRadius, ( dwFlags & BOIDS_FLOCK_AVERAGES ) ? L"flock" : L"neighbor" );
+    wprintf( L"ms a step: %.3f grid, %.3f rules, %.3f in all; %.1f neighbors a boid\n", fGridTime / nSteps,
+             fRulesTime / nSteps, ( End.QuadPart - Start.QuadPart ) * 1000.0 / Frequency.QuadPart / nSteps,
+             ( double )nNeighbors / nSteps / nBoids );
+
+    INT nResult = 0;
+    if( strOutput )
+    {
+        CPU.GetState( pState, pState + nBoids, pState + 2 * ( SIZE_T )nBoids );
+
+        FILE* pFile = NULL;
+        bool bWritten = false;
+        if( 0 == _wfopen_s( &pFile, strOutput, L"wb" ) && pFile )
+        {
+            bWritten = fwrite( pState, sizeof( D3DXVECTOR4 ), 3 * ( SIZE_T )nBoids, pFile ) == 3 * ( SIZE_T )nBoids;
+            bWritten = ( 0 == fclose( pFile ) ) && bWritten;
+        }
+        if( bWritten )
+        {
+            wprintf( L"Wrote %s\n", strOutput );
+        }
+        else
+        {
+            wprintf( L"Could not write %s\n", strOutput );
+            nResult = 1;
+        }
+    }
+
+    SAFE_DELETE_ARRAY( pState );
+    return nResult;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Largest distance between the positions and between the velocities of two sets of boids
+//--------------------------------------------------------------------------------------
+void CompareCPUBoids( const CBoidsCPU& Reference, const CBoidsCPU& Test, double* pfPosition, double* pfVelocity )
+{
+    *pfPosition = 0.0;
+    *pfVelocity = 0.0;
+    for( UINT i = 0; i < Reference.GetNumBoids(); i++ )
+    {
+        const D3DXVECTOR4& p0 = Reference.GetPositions()[i];
+        const D3DXVECTOR4& p1 = Test.GetPositions()[i];
+        const D3DXVECTOR4& v0 = Reference.GetVelocities()[i];
+        const D3DXVECTOR4& v1 = Test.GetVelocities()[i];
+        D3DXVECTOR3 vPosition( p1.x - p0.x, p1.y - p0.y, p1.z - p0.z );
+        D3DXVECTOR3 vVelocity( v1.x * v1.w - v0.x * v0.w, v1.y * v1.w - v0.y * v0.w, v1.z * v1.w - v0.z * v0.w );
+        *pfPosition = __max( *pfPosition, ( double )D3DXVec3Length( &vPosition ) );
+        *pfVelocity = __max( *pfVelocity, ( double )D3DXVec3Length( &vVelocity ) );
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Headless scaling benchmark of the CPU flocking engine:
+//
+//   GPUBoids -cpubench [-boids N] [-threads N] [-steps N] [-radius f]
+//
+// For 16384 boids and every four times as many up to -boids (1048576 by default), seeded
+// as the sample seeds them and spread out to be as crowded, times -steps steps (10 by
+// default) a 60th of a second apart with neighbours within -radius (15 by default) on 1,
+// 2, 4 ... threads up to -threads (one per processor by default).  At 16384 boids checks
+// the SSE rules against the scalar ones, and every thread count against one thread.
+// Returns 0 on success, 1 if a check fails or something failed.
+//--------------------------------------------------------------------------------------
+INT RunCPUBenchmark( int nArgs, LPWSTR* pstrArgs )
+{
+    // Report to the console we were started from, if any
+    if( AttachConsole( ATTACH_PARENT_PROCESS ) )
+    {
+        FILE* pFile;
+        freopen_s( &pFile, "CONOUT$", "w", stdout );
+    }
+
+    UINT nMaxBoids = 1048576;
+    UINT nMaxThreads = 0;
+    UINT nSteps = 10;
+    float fRadius = g_fNeighborRadius;
+    ParseCPUArgs( nArgs, pstrArgs, &nMaxBoids, &nMaxThreads, &nSteps, &fRadius );
+    if( 0 == nMaxThreads )
+    {
+        SYSTEM_INFO SystemInfo;
+        GetSystemInfo( &SystemInfo );
+        nMaxThreads = SystemInfo.dwNumberOfProcessors;
+    }
+    nMaxThreads = __min( nMaxThreads, ( UINT )BOIDS_MAX_THREADS );
+
+    UINT aThreads[BOIDS_MAX_THREADS];
+    UINT nThreadCounts = 0;
+    for( UINT n = 1; n < nMaxThreads; n *= 2 )
+        aThreads[nThreadCounts++] = n;
+    aThreads[nThreadCounts++] = nMaxThreads;
+
+    BOIDS_PARAMS Params;
+    GetBoidsParams( &Params, g_vFleePos, fRadius );
+    INT nResult = 0;
+
+    wprintf( L"%u steps, radius %.2f\n\n", nSteps, fRadius );
+    wprintf( L"%8s %7s %10s %10s %10s %10s %8s\n", L"boids", L"threads", L"steps/s", L"grid ms", L"rules ms",
+             L"neighbors", L"speedup" );
+
+    for( UINT nBoids = __min( 16384u, nMaxBoids ); nBoids <= nMaxBoids && 0 == nResult; nBoids *= 4 )
+    {
+        D3DXVECTOR4* pState = NULL;
+        if( FAILED( SeedCPUBoids( &pState, nBoids ) ) )
+        {
+            wprintf( L"Out of memory\n" );
+            nResult = 1;
+            break;
+        }
+        const bool bCheck = nBoids <= 16384;
+
+        // One step with the scalar rules, for the SSE ones and the thread counts to match
+        CBoidsCPU Reference;
+        if( bCheck )
+        {
+            if( FAILED( Reference.Create( nBoids, Params, 1, BOIDS_SCALAR ) ) )
+            {
+                nResult = 1;
+            }
+            else
+            {
+                Reference.SetState( pState, pState + nBoids, pState + 2 * ( SIZE_T )nBoids );
+                Reference.Step( 1.0f / 60.0f );
+            }
+        }
+
+        double fOneThreadTime = 0.0;
+        for( UINT iThreads = 0; iThreads < nThreadCounts && 0 == nResult; iThreads++ )
+        {
+            CBoidsCPU CPU;
+            if( FAILED( CPU.Create( nBoids, Params, aThreads[iThreads] ) ) )
+            {
+                wprintf( L"Out of memory\n" );
+                nResult = 1;
+                break;
+            }
+            CPU.SetState( pState, pState + nBoids, pState + 2 * ( SIZE_T )nBoids );
+
+            double fGridTime = 0.0, fRulesTime = 0.0;
+            ULONGLONG nNeighbors = 0;
+            for( UINT iStep = 0; iStep < nSteps; iStep++ )
+            {
+                CPU.Step( 1.0f / 60.0f );
+                fGridTime += CPU.GetGridTime() / nSteps;
+                fRulesTime += CPU.GetRulesTime() / nSteps;
+                nNeighbors += CPU.GetNumNeighbors() / nSteps;
+
+                if( bCheck && 0 == iStep )
+                {
+                    double fPosition, fVelocity;
+                    CompareCPUBoids( Reference, CPU, &fPosition, &fVelocity );
+                    if( fPosition > 1e-3 || fVelocity > 1e-3 * Params.fMaxSpeed )
+                    {
+                        wprintf( L"%u threads are off the scalar rules by %g in position, %g in velocity\n",
+                                 CPU.GetNumThreads(), fPosition, fVelocity );
+                        nResult = 1;
+                    }
+                }
+            }
+            if( 0 == iThreads )
+                fOneThreadTime = fGridTime + fRulesTime;
+
+            wprintf( L"%8u %7u %10.1f %10.2f %10.2f %10.1f %7.2fx\n", nBoids, CPU.GetNumThreads(),
+                     1000.0 / ( fGridTime + fRulesTime ), fGridTime, fRulesTime, ( double )nNeighbors / nBoids,
+                     fOneThreadTime / ( fGridTime + fRulesTime ) );
+        }
+
+        SAFE_DELETE_ARRAY( pState );
+
+        if( nBoids > 0xFFFFFFFF / 4 )
+            break;
+    }
+
+    return nResult;
+}
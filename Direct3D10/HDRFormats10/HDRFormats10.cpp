@@ -13,13 +13,13 @@
 #include "DXUTSettingsDlg.h"
 #include "SDKmisc.h"
 #include "SDKmesh.h"
+#include "SDKHDRCodec.h"
 #include "resource.h"
 #include "skybox.h"
 
 #define NUM_TONEMAP_TEXTURES  5       // Number of stages in the 3x3 down-scaling 
 // of average luminance textures
 #define NUM_BLOOM_TEXTURES    2
-#define RGB16_MAX             100
 #define RGB32_MAX             10000
 
 
@@ -135,7 +135,6 @@ bool                        g_bSupportsD16 = false;
 bool                        g_bSupportsD32 = false;
 bool                        g_bSupportsD24X8 = false;
 bool                        g_bUseMultiSample = false; // True when using multisampling on a supported back buffer
-double g_aPowsOfTwo[257]; // Lookup table for log calculations
 
 extern IDirect3DDevice9*    g_pd3dDevice9;
 
@@ -307,10 +306,6 @@ void RenderD3D9Text( double fTime );
 void RenderD3D10Text( double fTime );
 
 float GaussianDistribution( float x, float y, float rho );
-int log2_ceiling( float val );
-VOID EncodeRGB9E5( D3DXFLOAT16* pSrc, BYTE** ppDest );
-VOID EncodeRGBE8( D3DXFLOAT16* pSrc, BYTE** ppDest );
-VOID EncodeRGB16( D3DXFLOAT16* pSrc, BYTE** ppDest );
 
 //--------------------------------------------------------------------------------------
 // Entry point to the program. Initializes everything and goes into a message processing 
@@ -400,11 +395,6 @@ void InitApp()
     g_bShowHelp = false;
     g_bShowText = true;
 
-    for( int i = 0; i <= 256; i++ )
-    {
-        g_aPowsOfTwo[i] = powf( 2.0f, ( float )( i - 128 ) );
-    }
-
     g_HUD.SetFont( 0, L"Arial", 14, 400 );
     g_HUD.SetCallback( OnGUIEvent );
 
@@ -1612,132 +1602,6 @@ float GaussianDistribution( float x, float y, float rho )
 }
 
 
-//--------------------------------------------------------------------------------------
-int log2_ceiling( float val )
-{
-    int iMax = 256;
-    int iMin = 0;
-
-    while( iMax - iMin > 1 )
-    {
-        int iMiddle = ( iMax + iMin ) / 2;
-
-        if( val > g_aPowsOfTwo[iMiddle] )
-            iMin = iMiddle;
-        else
-            iMax = iMiddle;
-    }
-
-    return iMax - 128;
-}
-
-
-//--------------------------------------------------------------------------------------
-VOID EncodeRGBE8( D3DXFLOAT16* pSrc, BYTE** ppDest )
-{
-    FLOAT r, g, b;
-
-    r = ( FLOAT )*( pSrc + 0 );
-    g = ( FLOAT )*( pSrc + 1 );
-    b = ( FLOAT )*( pSrc + 2 );
-
-    // Determine the largest color component
-    float maxComponent = max( max( r, g ), b );
-
-    // Round to the nearest integer exponent
-    int nExp = log2_ceiling( maxComponent );
-
-    // Divide the components by the shared exponent
-    FLOAT fDivisor = ( FLOAT )g_aPowsOfTwo[ nExp + 128 ];
-
-    r /= fDivisor;
-    g /= fDivisor;
-    b /= fDivisor;
-
-    // Constrain the color components
-    r = max( 0, min( 1, r ) );
-    g = max( 0, min( 1, g ) );
-    b = max( 0, min( 1, b ) );
-
-    // Store the shared exponent in the alpha channel
-    UINT* pDestColor = ( UINT* )*ppDest;
-    *pDestColor = ( ( nExp + 128 ) & 255 ) << 24;
-    *pDestColor |= ( ( UINT )( b * 255 ) & 255 ) << 16;
-    *pDestColor |= ( ( UINT )( g * 255 ) & 255 ) << 8;
-    *pDestColor |= ( ( UINT )( r * 255 ) & 255 );
-
-    *ppDest += sizeof( UINT );
-}
-
-//--------------------------------------------------------------------------------------
-VOID EncodeRGB9E5( D3DXFLOAT16* pSrc, BYTE** ppDest )
-{
-    FLOAT r, g, b;
-
-    r = ( FLOAT )*( pSrc + 0 );
-    g = ( FLOAT )*( pSrc + 1 );
-    b = ( FLOAT )*( pSrc + 2 );
-
-    // Determine the largest color component
-    float maxComponent = max( max( r, g ), b );
-
-    // Round to the nearest integer exponent
-    int nExp = log2_ceiling( maxComponent );
-    nExp = max( nExp, -15 );	//keep us in the -15 to 16 range
-    nExp = min( nExp, 16 );
-
-    // Divide the components by the shared exponent
-    FLOAT fDivisor = ( FLOAT )g_aPowsOfTwo[ nExp + 128 ];
-
-    r /= fDivisor;
-    g /= fDivisor;
-    b /= fDivisor;
-
-    // Constrain the color components
-    r = max( 0, min( 1, r ) );
-    g = max( 0, min( 1, g ) );
-    b = max( 0, min( 1, b ) );
-
-    // Store the shared exponent in the alpha channel
-    UINT32* pDestColor = ( UINT32* )*ppDest;
-    *pDestColor = ( ( nExp + 15 ) & 31 ) << 27;
-    *pDestColor |= ( ( UINT )( b * 511 ) & 511 ) << 18;
-    *pDestColor |= ( ( UINT )( g * 511 ) & 511 ) << 9;
-    *pDestColor |= ( ( UINT )( r * 511 ) & 511 );
-
-    *ppDest += sizeof( UINT32 );  // Move forward 32 bits
-}
-
-
-//--------------------------------------------------------------------------------------
-VOID EncodeRGB16( D3DXFLOAT16* pSrc, BYTE** ppDest )
-{
-    FLOAT r, g, b;
-
-    r = ( FLOAT )*( pSrc + 0 );
-    g = ( FLOAT )*( pSrc + 1 );
-    b = ( FLOAT )*( pSrc + 2 );
-
-    // Divide the components by the multiplier
-    r /= RGB16_MAX;
-    g /= RGB16_MAX;
-    b /= RGB16_MAX;
-
-    // Constrain the color components
-    r = max( 0, min( 1, r ) );
-    g = max( 0, min( 1, g ) );
-    b = max( 0, min( 1, b ) );
-
-    // Store
-    USHORT* pDestColor = ( USHORT* )*ppDest;
-    *pDestColor++ = ( USHORT )( r * 65536 );
-    *pDestColor++ = ( USHORT )( g * 65536 );
-    *pDestColor++ = ( USHORT )( b * 65536 );
-
-    *ppDest += sizeof( UINT64 );
-}
-
-
 //-----------------------------------------------------------------------------
 // Name: MeasureLuminance()
 // Desc: Measure the average log luminance in the scene.
@@ -1992,53 +1856,70 @@ HRESULT CreateEncodedTexture10( ID3D10Device* pd3dDevice, WCHAR* strPath, ENCODI
     desc.Usage = D3D10_USAGE_DEFAULT;
     V_RETURN( pd3dDevice->CreateTexture2D( &desc, NULL, ppTexOut ) );
 
-    for( UINT iFace = 0; iFace < 6; iFace++ )
+    DXUT_HDR_FORMAT HDRFormat;
+    switch( eTarget )
     {
-        UINT iSubResource = D3D10CalcSubresource( 0, iFace, desc.MipLevels );
+        case RGB9E5:
+            HDRFormat = DXUT_HDR_RGB9E5; break;
+        case RGBE8:
+            HDRFormat = DXUT_HDR_RGBE8; break;
+        case RGB16:
+            HDRFormat = DXUT_HDR_RGB16; break;
+        default:
+            SAFE_RELEASE( pTexDest );
+            SAFE_RELEASE( pTexSrc );
+            return E_INVALIDARG;
+    }
+
+    // Map all the faces so they are encoded together
+    DXUT_HDR_SURFACE aSurfaces[6];
+    UINT nMapped = 0;
+    for( ; nMapped < 6; nMapped++ )
+    {
+        UINT iSubResource = D3D10CalcSubresource( 0, nMapped, desc.MipLevels );
 
-        // Map the source texture for reading
         D3D10_MAPPED_TEXTURE2D MappedFaceSrc;
-        V_RETURN( pTexSrc->Map( iSubResource, D3D10_MAP_READ_WRITE, 0, &MappedFaceSrc ) );
+        hr = pTexSrc->Map( iSubResource, D3D10_MAP_READ, 0, &MappedFaceSrc );
+        if( FAILED( hr ) )
+            break;
 
-        // Map the destination texture for writing
         D3D10_MAPPED_TEXTURE2D MappedFaceDest;
-        V_RETURN( pTexDest->Map( iSubResource, D3D10_MAP_READ_WRITE, 0, &MappedFaceDest ) );
-
-        BYTE* pSrcBytes = ( BYTE* )MappedFaceSrc.pData;
-        BYTE* pDestBytes = ( BYTE* )MappedFaceDest.pData;
-
-        for( UINT y = 0; y < desc.Height; y++ )
+        hr = pTexDest->Map( iSubResource, D3D10_MAP_WRITE, 0, &MappedFaceDest );
+        if( FAILED( hr ) )
         {
-            D3DXFLOAT16* pSrc = ( D3DXFLOAT16* )pSrcBytes;
-            BYTE* pDest = pDestBytes;
-
-            for( UINT x = 0; x < desc.Width; x++ )
-            {
-                switch( eTarget )
-                {
-                    case RGB9E5:
-                        EncodeRGB9E5( pSrc, &pDest ); break;
-                    case RGBE8:
-                        EncodeRGBE8( pSrc, &pDest ); break;
-                    case RGB16:
-                        EncodeRGB16( pSrc, &pDest ); break;
-                    default:
-                        return E_FAIL;
-                }
+            pTexSrc->Unmap( iSubResource );
+            break;
+        }
 
-                pSrc += 4;
-            }
+        aSurfaces[nMapped].pSrc = MappedFaceSrc.pData;
+        aSurfaces[nMapped].SrcPitch = MappedFaceSrc.RowPitch;
+        aSurfaces[nMapped].pDest = MappedFaceDest.pData;
+        aSurfaces[nMapped].DestPitch = MappedFaceDest.RowPitch;
+        aSurfaces[nMapped].Width = desc.Width;
+        aSurfaces[nMapped].Height = desc.Height;
+    }
 
-            pSrcBytes += MappedFaceSrc.RowPitch;
-            pDestBytes += MappedFaceDest.RowPitch;
-        }
+    if( SUCCEEDED( hr ) )
+        hr = DXUTEncodeHDRSurfaces( HDRFormat, aSurfaces, 6 );
 
-        pd3dDevice->UpdateSubresource( ( *ppTexOut ), iSubResource, NULL, MappedFaceDest.pData,
-                                       MappedFaceDest.RowPitch, 0 );
+    for( UINT iFace = 0; iFace < nMapped; iFace++ )
+    {
+        UINT iSubResource = D3D10CalcSubresource( 0, iFace, desc.MipLevels );
+        if( SUCCEEDED( hr ) )
+            pd3dDevice->UpdateSubresource( ( *ppTexOut ), iSubResource, NULL, aSurfaces[iFace].pDest,
+                                           aSurfaces[iFace].DestPitch, 0 );
 
         // Release the maps
-        pTexDest->Unmap( iFace );
-        pTexSrc->Unmap( iFace );
+        pTexDest->Unmap( iSubResource );
+        pTexSrc->Unmap( iSubResource );
+    }
+
+    if( FAILED( hr ) )
+    {
+        SAFE_RELEASE( *ppTexOut );
+        SAFE_RELEASE( pTexDest );
+        SAFE_RELEASE( pTexSrc );
+        return hr;
     }
 
     // Create the resource view
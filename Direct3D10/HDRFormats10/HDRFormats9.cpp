@@ -13,13 +13,13 @@
 #include "DXUTSettingsDlg.h"
 #include "SDKmisc.h"
 #include "SDKmesh.h"
+#include "SDKHDRCodec.h"
 #include "resource.h"
 #include "skybox.h"
 
 #define NUM_TONEMAP_TEXTURES  5       // Number of stages in the 3x3 down-scaling 
 // of average luminance textures
 #define NUM_BLOOM_TEXTURES    2
-#define RGB16_MAX             100
 #define RGB32_MAX             10000
 
 
@@ -76,7 +76,6 @@ extern bool                         g_bSupportsD16;
 extern bool                         g_bSupportsD32;
 extern bool                         g_bSupportsD24X8;
 extern bool                         g_bUseMultiSample; // True when using multisampling on a supported back buffer
-extern double g_aPowsOfTwo[257]; // Lookup table for log calculations
 
 struct SCREEN_VERTEX
 {
@@ -163,41 +162,6 @@ HRESULT CreateEncodedTexture( IDirect3DCubeTexture9* pTexSrc, IDirect3DCubeTextu
                               ENCODING_MODE eTarget );
 
 void RenderD3D9Text( double fTime );
-extern VOID EncodeRGB16( D3DXFLOAT16* pSrc, BYTE** ppDest );
-extern int log2_ceiling( float val );
-
-//--------------------------------------------------------------------------------------
-VOID EncodeRGBE8_D3D9( D3DXFLOAT16* pSrc, BYTE** ppDest )
-{
-    FLOAT r, g, b;
-
-    r = ( FLOAT )*( pSrc + 0 );
-    g = ( FLOAT )*( pSrc + 1 );
-    b = ( FLOAT )*( pSrc + 2 );
-
-    // Determine the largest color component
-    float maxComponent = max( max( r, g ), b );
-
-    // Round to the nearest integer exponent
-    int nExp = log2_ceiling( maxComponent );
-
-    // Divide the components by the shared exponent
-    FLOAT fDivisor = ( FLOAT )g_aPowsOfTwo[ nExp + 128 ];
-
-    r /= fDivisor;
-    g /= fDivisor;
-    b /= fDivisor;
-
-    // Constrain the color components
-    r = max( 0, min( 1, r ) );
-    g = max( 0, min( 1, g ) );
-    b = max( 0, min( 1, b ) );
-
-    // Store the shared exponent in the alpha channel
-    D3DCOLOR* pDestColor = ( D3DCOLOR* )*ppDest;
-    *pDestColor = D3DCOLOR_RGBA( ( BYTE )( r * 255 ), ( BYTE )( g * 255 ), ( BYTE )( b * 255 ), nExp + 128 );
-    *ppDest += sizeof( D3DCOLOR );
-}
 
 //-----------------------------------------------------------------------------
 // Name: GetSampleOffsets_DownScale3x3
@@ -1373,62 +1337,61 @@ HRESULT CreateEncodedTexture( IDirect3DCubeTexture9* pTexSrc, IDirect3DCubeTextu
 
     // Create a texture with equal dimensions to store the encoded texture
     D3DFORMAT fmt = D3DFMT_UNKNOWN;
+    DXUT_HDR_FORMAT HDRFormat;
     switch( eTarget )
     {
         case RGBE8:
-            fmt = D3DFMT_A8R8G8B8; break;
+            fmt = D3DFMT_A8R8G8B8; HDRFormat = DXUT_HDR_BGRE8; break;
         case RGB16:
-            fmt = D3DFMT_A16B16G16R16; break;
+            fmt = D3DFMT_A16B16G16R16; HDRFormat = DXUT_HDR_RGB16; break;
+        default:
+            return E_INVALIDARG;
     }
 
     V_RETURN( g_pd3dDevice9->CreateCubeTexture( desc.Width, 1, 0,
                                                 fmt, D3DPOOL_MANAGED,
                                                 ppTexDest, NULL ) );
 
-    for( UINT iFace = 0; iFace < 6; iFace++ )
+    // Lock all the faces so they are encoded together
+    DXUT_HDR_SURFACE aSurfaces[6];
+    UINT nLocked = 0;
+    for( ; nLocked < 6; nLocked++ )
     {
-        // Lock the source texture for reading
         D3DLOCKED_RECT rcSrc;
-        V_RETURN( pTexSrc->LockRect( ( D3DCUBEMAP_FACES )iFace, 0, &rcSrc, NULL, D3DLOCK_READONLY ) );
+        hr = pTexSrc->LockRect( ( D3DCUBEMAP_FACES )nLocked, 0, &rcSrc, NULL, D3DLOCK_READONLY );
+        if( FAILED( hr ) )
+            break;
 
-        // Lock the destination texture for writing
         D3DLOCKED_RECT rcDest;
-        V_RETURN( ( *ppTexDest )->LockRect( ( D3DCUBEMAP_FACES )iFace, 0, &rcDest, NULL, 0 ) );
-
-        BYTE* pSrcBytes = ( BYTE* )rcSrc.pBits;
-        BYTE* pDestBytes = ( BYTE* )rcDest.pBits;
-
-
-        for( UINT y = 0; y < desc.Height; y++ )
+        hr = ( *ppTexDest )->LockRect( ( D3DCUBEMAP_FACES )nLocked, 0, &rcDest, NULL, 0 );
+        if( FAILED( hr ) )
         {
-            D3DXFLOAT16* pSrc = ( D3DXFLOAT16* )pSrcBytes;
-            BYTE* pDest = pDestBytes;
-
-            for( UINT x = 0; x < desc.Width; x++ )
-            {
-                switch( eTarget )
-                {
-                    case RGBE8:
-                        EncodeRGBE8_D3D9( pSrc, &pDest ); break;
-                    case RGB16:
-                        EncodeRGB16( pSrc, &pDest ); break;
-                    default:
-                        return E_FAIL;
-                }
+            pTexSrc->UnlockRect( ( D3DCUBEMAP_FACES )nLocked, 0 );
+            break;
+        }
 
-                pSrc += 4;
-            }
+        aSurfaces[nLocked].pSrc = rcSrc.pBits;
+        aSurfaces[nLocked].SrcPitch = rcSrc.Pitch;
+        aSurfaces[nLocked].pDest = rcDest.pBits;
+        aSurfaces[nLocked].DestPitch = rcDest.Pitch;
+        aSurfaces[nLocked].Width = desc.Width;
+        aSurfaces[nLocked].Height = desc.Height;
+    }
 
-            pSrcBytes += rcSrc.Pitch;
-            pDestBytes += rcDest.Pitch;
-        }
+    if( SUCCEEDED( hr ) )
+        hr = DXUTEncodeHDRSurfaces( HDRFormat, aSurfaces, 6 );
 
-        // Release the locks
+    // Release the locks
+    for( UINT iFace = 0; iFace < nLocked; iFace++ )
+    {
         ( *ppTexDest )->UnlockRect( ( D3DCUBEMAP_FACES )iFace, 0 );
         pTexSrc->UnlockRect( ( D3DCUBEMAP_FACES )iFace, 0 );
     }
 
-    return S_OK;
+    if( FAILED( hr ) )
+        SAFE_RELEASE( *ppTexDest );
+
+    return hr;
 }
 
 //-----------------------------------------------------------------------------
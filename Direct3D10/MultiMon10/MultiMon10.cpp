@@ -90,6 +90,7 @@ void DeviceCleanup();
 void FullCleanup();
 void RenderToAllMonitors( double fTime, float fElapsedTime );
 void PresentToAllMonitors();
+INT RunShapeBenchmark( int nArgs, LPWSTR* pstrArgs );
 
 //--------------------------------------------------------------------------------------
 // Entry point to the program. Initializes everything and goes into a message processing 
@@ -102,6 +103,23 @@ int WINAPI wWinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdL
     _CrtSetDbgFlag( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );
 #endif
 
+    // -shapebench times the DXUT shape generator without a window
+    int nArgs = 0;
+    LPWSTR* pstrArgs = CommandLineToArgvW( GetCommandLineW(), &nArgs );
+    if( pstrArgs )
+    {
+        for( int i = 1; i < nArgs; i++ )
+        {
+            if( 0 == _wcsicmp( pstrArgs[i], L"-shapebench" ) )
+            {
+                INT nResult = RunShapeBenchmark( nArgs - i - 1, pstrArgs + i + 1 );
+                LocalFree( pstrArgs );
+                return nResult;
+            }
+        }
+        LocalFree( pstrArgs );
+    }
+
     // Init D3D10
     if( FAILED( InitD3D10() ) )
     {
@@ -960,3 +978,169 @@ void PresentToAllMonitors()
         pWindowObj->pSwapChain->Present( 0, 0 );
     }
 }
+
+//--------------------------------------------------------------------------------------
+// Compares two generations of a shape, giving how far apart the vertices are and whether
+// the indices are the same
+//--------------------------------------------------------------------------------------
+float CompareShapes( const DXUT_SHAPE_VERTEX* pVertices1, const DXUT_SHAPE_VERTEX* pVertices2, UINT nVertices,
+                     const DWORD* pIndices1, const DWORD* pIndices2, UINT nIndices )
+{
+    float fError = 0.0f;
+    for( UINT i = 0; i < nVertices; i++ )
+    {
+        const float* pFloats1 = ( const float* )( pVertices1 + i );
+        const float* pFloats2 = ( const float* )( pVertices2 + i );
+        for( UINT j = 0; j < 6; j++ )
+            fError = __max( fError, fabsf( pFloats1[j] - pFloats2[j] ) );
+    }
+    if( 0 != memcmp( pIndices1, pIndices2, nIndices * sizeof( DWORD ) ) )
+        fError = FLT_MAX;
+    return fError;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Generates LOD chains of the shapes this sample draws at -tess slices, as an instanced
+// scene of many shapes at several distances would draw them, with CDXUTShapeGenerator on
+// 1, 2, 4 and so on up to -threads threads, and with the scalar code.  Returns 1 if a
+// chain differs between thread counts or from the scalar one.
+//
+//  -shapebench [-tess n] [-lods n] [-threads n]
+//--------------------------------------------------------------------------------------
+INT RunShapeBenchmark( int nArgs, LPWSTR* pstrArgs )
+{
+    // Report to the console we were started from, if any
+    if( AttachConsole( ATTACH_PARENT_PROCESS ) )
+    {
+        FILE* pFile;
+        freopen_s( &pFile, "CONOUT$", "w", stdout );
+    }
+
+    UINT uTess = 1024;
+    UINT uLODs = 6;
+    UINT nMaxThreads = 0;
+    for( int i = 0; i + 1 < nArgs; i++ )
+    {
+        if( 0 == _wcsicmp( pstrArgs[i], L"-tess" ) )
+            uTess = ( UINT )_wtoi( pstrArgs[++i] );
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-lods" ) )
+            uLODs = ( UINT )_wtoi( pstrArgs[++i] );
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-threads" ) )
+            nMaxThreads = ( UINT )_wtoi( pstrArgs[++i] );
+    }
+    uTess = __max( uTess, 8u );
+    uLODs = __min( __max( uLODs, 1u ), 16u );
+    if( 0 == nMaxThreads )
+    {
+        SYSTEM_INFO SystemInfo;
+        GetSystemInfo( &SystemInfo );
+        nMaxThreads = SystemInfo.dwNumberOfProcessors;
+    }
+    nMaxThreads = __min( nMaxThreads, ( UINT )DXUT_SHAPES_MAX_THREADS );
+
+    UINT aThreads[DXUT_SHAPES_MAX_THREADS];
+    UINT nThreadCounts = 0;
+    for( UINT n = 1; n < nMaxThreads; n *= 2 )
+        aThreads[nThreadCounts++] = n;
+    aThreads[nThreadCounts++] = nMaxThreads;
+
+    const DXUT_SHAPE_DESC aShapes[] =
+    {
+        { DXUT_SHAPE_CYLINDER, 1.0f, 1.0f, 1.0f, uTess, uTess / 2 },
+        { DXUT_SHAPE_SPHERE, 1.0f, 0.0f, 0.0f, uTess, uTess / 2 },
+        { DXUT_SHAPE_TORUS, 0.2f, 1.5f, 0.0f, uTess / 4, uTess },
+        { DXUT_SHAPE_GEOSPHERE, 1.0f, 0.0f, 0.0f, uTess / 4, 0 },
+    };
+    static LPCWSTR s_astrShapes[] = { L"cylinder", L"sphere", L"torus", L"geosphere" };
+
+    INT nResult = 0;
+    wprintf( L"%u LODs of each shape, each half the tessellation of the one before\n\n", uLODs );
+    wprintf( L"%-10s %9s %9s %7s %10s %10s %8s\n", L"shape", L"vertices", L"indices", L"threads", L"ms",
+             L"Mverts/s", L"speedup" );
+
+    for( UINT iShape = 0; iShape < ARRAYSIZE( aShapes ) && 0 == nResult; iShape++ )
+    {
+        UINT nVertices, nIndices;
+        if( FAILED( DXUTGetShapeLODChainSize( &aShapes[iShape], uLODs, &nVertices, &nIndices ) ) )
+        {
+            wprintf( L"%s: too big\n", s_astrShapes[iShape] );
+            nResult = 1;
+            break;
+        }
+
+        // The first chain is the reference, then one for each thread count and a scalar one
+        DXUT_SHAPE_VERTEX* pVertices = new DXUT_SHAPE_VERTEX[ 2 * ( SIZE_T )nVertices ];
+        DWORD* pIndices = new DWORD[ 2 * ( SIZE_T )nIndices ];
+        DXUT_SHAPE_LOD* pLODs = new DXUT_SHAPE_LOD[ uLODs ];
+        if( !pVertices || !pIndices || !pLODs )
+        {
+            wprintf( L"Out of memory\n" );
+            SAFE_DELETE_ARRAY( pVertices );
+            SAFE_DELETE_ARRAY( pIndices );
+            SAFE_DELETE_ARRAY( pLODs );
+            nResult = 1;
+            break;
+        }
+
+        double fOneThreadTime = 0.0;
+        for( UINT iRun = 0; iRun <= nThreadCounts && 0 == nResult; iRun++ )
+        {
+            const bool bScalar = iRun == nThreadCounts;
+            CDXUTShapeGenerator Generator;
+            Generator.Create( bScalar ? 1 : aThreads[iRun], bScalar ? DXUT_SHAPES_SCALAR : 0 );
+
+            DXUT_SHAPE_VERTEX* pRunVertices = pVertices + ( iRun > 0 ? nVertices : 0 );
+            DWORD* pRunIndices = pIndices + ( iRun > 0 ? nIndices : 0 );
+            if( FAILED( Generator.GenerateLODChain( &aShapes[iShape], uLODs, pRunVertices, pRunIndices,
+                                                    DXGI_FORMAT_R32_UINT, pLODs ) ) )
+            {
+                wprintf( L"%s: GenerateLODChain failed\n", s_astrShapes[iShape] );
+                nResult = 1;
+                break;
+            }
+            double fTime = Generator.GetTime();
+            if( 0 == iRun )
+                fOneThreadTime = fTime;
+
+            // Rows land in the same places on any number of threads; the scalar code may
+            // round differently
+            if( iRun > 0 )
+            {
+                float fError = CompareShapes( pVertices, pRunVertices, nVertices, pIndices, pRunIndices, nIndices );
+                if( fError > ( bScalar ? 1e-5f : 0.0f ) )
+                {
+                    wprintf( L"%s: %s differs from 1 thread by %g\n", s_astrShapes[iShape],
+                             bScalar ? L"the scalar code" : L"this thread count", fError );
+                    nResult = 1;
+                }
+            }
+
+            if( bScalar )
+                wprintf( L"%-10s %9u %9u %7s %10.2f %10.1f %7.2fx\n", s_astrShapes[iShape], nVertices, nIndices,
+                         L"scalar", fTime, nVertices / ( 1000.0 * __max( fTime, 1e-3 ) ),
+                         fOneThreadTime / __max( fTime, 1e-3 ) );
+            else
+                wprintf( L"%-10s %9u %9u %7u %10.2f %10.1f %7.2fx\n", s_astrShapes[iShape], nVertices, nIndices,
+                         Generator.GetNumThreads(), fTime, nVertices / ( 1000.0 * __max( fTime, 1e-3 ) ),
+                         fOneThreadTime / __max( fTime, 1e-3 ) );
+        }
+
+        // LODs small enough for 16 bit indices halve their index memory
+        UINT nLODs16 = 0;
+        for( UINT uLOD = 0; uLOD < uLODs; uLOD++ )
+        {
+            if( pLODs[uLOD].NumVertices <= 65536 )
+                nLODs16++;
+        }
+        wprintf( L"%-10s LOD 0 %u vertices, LOD %u %u vertices, %u of %u LODs fit 16 bit indices\n",
+                 s_astrShapes[iShape], pLODs[0].NumVertices, uLODs - 1, pLODs[uLODs - 1].NumVertices, nLODs16,
+                 uLODs );
+
+        SAFE_DELETE_ARRAY( pVertices );
+        SAFE_DELETE_ARRAY( pIndices );
+        SAFE_DELETE_ARRAY( pLODs );
+    }
+
+    return nResult;
+}
@@ -0,0 +1,814 @@
+//--------------------------------------------------------------------------------------
+// File: NBodyCPU.cpp
+//
+// CPU all pairs and Barnes-Hut solvers for the NBodyGravity bodies
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "NBodyCPU.h"
+#include "DXUTWorkerPool.h"
+#include <float.h>
+#include <math.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE__)
+#include <xmmintrin.h>
+#define NBODY_SSE
+#endif
+
+// Bodies a thread takes at a time: for the all pairs solver, for Barnes-Hut (neighbours
+// along the Morton curve that share a walk of the tree), and for the advance
+#define NBODY_RUN_SIZE          64
+#define NBODY_GROUP_SIZE        16
+#define NBODY_ADVANCE_SIZE      4096
+
+// Sources the all pairs solver sweeps a run over at a time, 16KB of them
+#define NBODY_TILE_SIZE         1024
+
+// Most bodies in an octree leaf, and the depth of the Morton codes, 10 bits an axis
+#define NBODY_LEAF_SIZE         8
+#define NBODY_MORTON_LEVELS     10
+
+// Cells and bodies a thread gathers before summing them
+#define NBODY_LIST_SIZE         2048
+
+// Positions of up to NBODY_RUN_SIZE bodies, and the sums of m / ( max( r, fMinDistance ) r^2 )
+// times the vector to each source
+struct NBODY_RUN
+{
+    UINT nBodies;
+    float afX[NBODY_RUN_SIZE];
+    float afY[NBODY_RUN_SIZE];
+    float afZ[NBODY_RUN_SIZE];
+    float afSumX[NBODY_RUN_SIZE];
+    float afSumY[NBODY_RUN_SIZE];
+    float afSumZ[NBODY_RUN_SIZE];
+};
+
+
+//--------------------------------------------------------------------------------------
+// Loads the positions of nBodies bodies, pBodies[i] or iFirst + i, into a run.  The run
+// is padded to a multiple of 4 with bodies whose sums are thrown away.
+//--------------------------------------------------------------------------------------
+static void LoadRun( NBODY_RUN* pRun, const D3DXVECTOR4* pPositions, const UINT* pBodies, UINT iFirst,
+                     UINT nBodies )
+{
+    pRun->nBodies = nBodies;
+    for( UINT i = 0; i < nBodies; i++ )
+    {
+        const D3DXVECTOR4& Position = pPositions[pBodies ? pBodies[i] : iFirst + i];
+        pRun->afX[i] = Position.x;
+        pRun->afY[i] = Position.y;
+        pRun->afZ[i] = Position.z;
+    }
+    for( UINT i = nBodies; i < ( ( nBodies + 3 ) & ~3 ); i++ )
+    {
+        pRun->afX[i] = 0.0f;
+        pRun->afY[i] = 0.0f;
+        pRun->afZ[i] = 0.0f;
+    }
+
+    ZeroMemory( pRun->afSumX, sizeof( pRun->afSumX ) );
+    ZeroMemory( pRun->afSumY, sizeof( pRun->afSumY ) );
+    ZeroMemory( pRun->afSumZ, sizeof( pRun->afSumZ ) );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Writes the forces of a run, G times each body's mass times its sums, as PSForce does
+//--------------------------------------------------------------------------------------
+static void StoreRun( const NBODY_RUN* pRun, D3DXVECTOR4* pForces, const UINT* pBodies, UINT iFirst,
+                      const NBODY_PARAMS& Params )
+{
+    const float fScale = Params.fG * Params.fParticleMass;
+    for( UINT i = 0; i < pRun->nBodies; i++ )
+    {
+        pForces[pBodies ? pBodies[i] : iFirst + i] = D3DXVECTOR4( pRun->afSumX[i] * fScale, pRun->afSumY[i] * fScale,
+                                                                  pRun->afSumZ[i] * fScale, 0.0f );
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Adds the pull of nSources sources, a multiple of 4, to the sums of every body of the
+// run.  A source at the position of a body adds nothing.
+//--------------------------------------------------------------------------------------
+static void SumRunScalar( NBODY_RUN* pRun, const float* pX, const float* pY, const float* pZ, const float* pMass,
+                          UINT nSources, float fMinDistance )
+{
+    for( UINT i = 0; i < pRun->nBodies; i++ )
+    {
+        const float x = pRun->afX[i];
+        const float y = pRun->afY[i];
+        const float z = pRun->afZ[i];
+        float fSumX = 0.0f, fSumY = 0.0f, fSumZ = 0.0f;
+
+        for( UINT j = 0; j < nSources; j++ )
+        {
+            const float dx = pX[j] - x;
+            const float dy = pY[j] - y;
+            const float dz = pZ[j] - z;
+            const float r2 = dx * dx + dy * dy + dz * dz;
+            if( r2 > 0.0f )
+            {
+                const float r = __max( sqrtf( r2 ), fMinDistance );
+                const float s = pMass[j] / ( r * r2 );
+                fSumX += dx * s;
+                fSumY += dy * s;
+                fSumZ += dz * s;
+            }
+        }
+
+        pRun->afSumX[i] += fSumX;
+        pRun->afSumY[i] += fSumY;
+        pRun->afSumZ[i] += fSumZ;
+    }
+}
+
+
+#ifdef NBODY_SSE
+//--------------------------------------------------------------------------------------
+// Sum of the four lanes of each of a, b, c and d, in that order
+//--------------------------------------------------------------------------------------
+static inline __m128 SumLanes( __m128 a, __m128 b, __m128 c, __m128 d )
+{
+    _MM_TRANSPOSE4_PS( a, b, c, d );
+    return _mm_add_ps( _mm_add_ps( a, b ), _mm_add_ps( c, d ) );
+}
+
+
+//--------------------------------------------------------------------------------------
+// SumRunScalar four bodies against four sources at a time: the bodies are splatted across
+// the lanes and each source vector is used for all four
+//--------------------------------------------------------------------------------------
+static void SumRunSSE( NBODY_RUN* pRun, const float* pX, const float* pY, const float* pZ, const float* pMass,
+                       UINT nSources, float fMinDistance )
+{
+    const __m128 vZero = _mm_setzero_ps();
+    const __m128 vMinDistance = _mm_set1_ps( fMinDistance );
+
+    for( UINT i = 0; i < pRun->nBodies; i += 4 )
+    {
+        __m128 avX[4], avY[4], avZ[4];
+        __m128 avSumX[4], avSumY[4], avSumZ[4];
+        for( UINT k = 0; k < 4; k++ )
+        {
+            avX[k] = _mm_set1_ps( pRun->afX[i + k] );
+            avY[k] = _mm_set1_ps( pRun->afY[i + k] );
+            avZ[k] = _mm_set1_ps( pRun->afZ[i + k] );
+            avSumX[k] = vZero;
+            avSumY[k] = vZero;
+            avSumZ[k] = vZero;
+        }
+
+        for( UINT j = 0; j < nSources; j += 4 )
+        {
+            const __m128 vSourceX = _mm_loadu_ps( pX + j );
+            const __m128 vSourceY = _mm_loadu_ps( pY + j );
+            const __m128 vSourceZ = _mm_loadu_ps( pZ + j );
+            const __m128 vMass = _mm_loadu_ps( pMass + j );
+
+            for( UINT k = 0; k < 4; k++ )
+            {
+                const __m128 dx = _mm_sub_ps( vSourceX, avX[k] );
+                const __m128 dy = _mm_sub_ps( vSourceY, avY[k] );
+                const __m128 dz = _mm_sub_ps( vSourceZ, avZ[k] );
+                const __m128 r2 = _mm_add_ps( _mm_add_ps( _mm_mul_ps( dx, dx ), _mm_mul_ps( dy, dy ) ),
+                                              _mm_mul_ps( dz, dz ) );
+                const __m128 r = _mm_max_ps( _mm_sqrt_ps( r2 ), vMinDistance );
+
+                // r2 of 0 divides by 0; the mask throws that away
+                const __m128 s = _mm_and_ps( _mm_cmpgt_ps( r2, vZero ), _mm_div_ps( vMass, _mm_mul_ps( r, r2 ) ) );
+                avSumX[k] = _mm_add_ps( avSumX[k], _mm_mul_ps( dx, s ) );
+                avSumY[k] = _mm_add_ps( avSumY[k], _mm_mul_ps( dy, s ) );
+                avSumZ[k] = _mm_add_ps( avSumZ[k], _mm_mul_ps( dz, s ) );
+            }
+        }
+
+        _mm_storeu_ps( pRun->afSumX + i, _mm_add_ps( _mm_loadu_ps( pRun->afSumX + i ),
+                                                     SumLanes( avSumX[0], avSumX[1], avSumX[2], avSumX[3] ) ) );
+        _mm_storeu_ps( pRun->afSumY + i, _mm_add_ps( _mm_loadu_ps( pRun->afSumY + i ),
+                                                     SumLanes( avSumY[0], avSumY[1], avSumY[2], avSumY[3] ) ) );
+        _mm_storeu_ps( pRun->afSumZ + i, _mm_add_ps( _mm_loadu_ps( pRun->afSumZ + i ),
+                                                     SumLanes( avSumZ[0], avSumZ[1], avSumZ[2], avSumZ[3] ) ) );
+    }
+}
+#endif
+
+
+//--------------------------------------------------------------------------------------
+static inline void SumRun( NBODY_RUN* pRun, const float* pX, const float* pY, const float* pZ, const float* pMass,
+                           UINT nSources, float fMinDistance, DWORD dwFlags )
+{
+#ifdef NBODY_SSE
+    if( 0 == ( dwFlags & NBODY_SCALAR ) )
+    {
+        SumRunSSE( pRun, pX, pY, pZ, pMass, nSources, fMinDistance );
+        return;
+    }
+#else
+    UNREFERENCED_PARAMETER( dwFlags );
+#endif
+    SumRunScalar( pRun, pX, pY, pZ, pMass, nSources, fMinDistance );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Spreads the low 10 bits of n to every third bit
+//--------------------------------------------------------------------------------------
+static inline UINT SpreadBits( UINT n )
+{
+    n &= 0x000003FF;
+    n = ( n | ( n << 16 ) ) & 0xFF0000FF;
+    n = ( n | ( n << 8 ) ) & 0x0300F00F;
+    n = ( n | ( n << 4 ) ) & 0x030C30C3;
+    n = ( n | ( n << 2 ) ) & 0x09249249;
+    return n;
+}
+
+
+//--------------------------------------------------------------------------------------
+// The Morton cell of a coordinate, clamped to the grid
+//--------------------------------------------------------------------------------------
+static inline UINT MortonCell( float f, float fMin, float fScale )
+{
+    const float fCell = ( f - fMin ) * fScale;
+    if( !( fCell > 0.0f ) )
+        return 0;
+    return __min( ( UINT )fCell, ( UINT )( ( 1 << NBODY_MORTON_LEVELS ) - 1 ) );
+}
+
+
+//--------------------------------------------------------------------------------------
+CNBodyCPU::CNBodyCPU()
+{
+    ZeroMemory( &m_Params, sizeof( m_Params ) );
+    m_dwFlags = 0;
+    m_nBodies = 0;
+    m_nSources = 0;
+    m_fElapsedTime = 0.0f;
+    m_pPositions = NULL;
+    m_pVelocities = NULL;
+    m_pForces = NULL;
+    m_pSourceX = NULL;
+    m_pSourceY = NULL;
+    m_pSourceZ = NULL;
+    m_pSourceMass = NULL;
+    m_pCodes = NULL;
+    m_pSortScratch = NULL;
+    m_pOrder = NULL;
+    m_pNodes = NULL;
+    m_nNodes = 0;
+    m_nMaxNodes = 0;
+    ZeroMemory( m_afBoxMin, sizeof( m_afBoxMin ) );
+    m_fBoxScale = 0.0f;
+    ZeroMemory( m_apList, sizeof( m_apList ) );
+    ZeroMemory( m_anList, sizeof( m_anList ) );
+    ZeroMemory( m_anInteractions, sizeof( m_anInteractions ) );
+    m_nThreads = 1;
+    m_Job = NBODY_JOB_ALL_PAIRS;
+    m_fBuildTime = 0.0;
+    m_fForceTime = 0.0;
+    m_nInteractions = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+CNBodyCPU::~CNBodyCPU()
+{
+    Destroy();
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CNBodyCPU::Create( UINT nBodies, const NBODY_PARAMS& Params, UINT nThreads, DWORD dwFlags )
+{
+    Destroy();
+
+    if( 0 == nBodies || nBodies > 0x7FFFFFF0 )
+        return E_INVALIDARG;
+
+    m_Params = Params;
+    m_dwFlags = dwFlags;
+    m_nBodies = nBodies;
+    m_nSources = nBodies;
+
+    if( 0 == nThreads )
+        nThreads = CDXUTWorkerPool::GetNumProcessors();
+    nThreads = min( nThreads, ( UINT )NBODY_MAX_THREADS );
+    nThreads = min( nThreads, DXUTGetWorkerPool()->GetNumThreads() );
+
+    const UINT nPadded = ( nBodies + 3 ) & ~3;
+    m_nMaxNodes = 2 * nBodies;
+    m_pPositions = new D3DXVECTOR4[ nBodies ];
+    m_pVelocities = new D3DXVECTOR4[ nBodies ];
+    m_pForces = new D3DXVECTOR4[ nBodies ];
+    m_pSourceX = new float[ nPadded ];
+    m_pSourceY = new float[ nPadded ];
+    m_pSourceZ = new float[ nPadded ];
+    m_pSourceMass = new float[ nPadded ];
+    m_pCodes = new ULONGLONG[ nBodies ];
+    m_pSortScratch = new ULONGLONG[ nBodies ];
+    m_pOrder = new UINT[ nBodies ];
+    m_pNodes = new NBODY_NODE[ m_nMaxNodes ];
+    if( !m_pPositions || !m_pVelocities || !m_pForces || !m_pSourceX || !m_pSourceY || !m_pSourceZ ||
+        !m_pSourceMass || !m_pCodes || !m_pSortScratch || !m_pOrder || !m_pNodes )
+    {
+        Destroy();
+        return E_OUTOFMEMORY;
+    }
+
+    for( UINT i = 0; i < nThreads; i++ )
+    {
+        m_apList[i] = new float[ 4 * NBODY_LIST_SIZE ];
+        if( !m_apList[i] )
+        {
+            Destroy();
+            return E_OUTOFMEMORY;
+        }
+    }
+
+    ZeroMemory( m_pPositions, nBodies * sizeof( D3DXVECTOR4 ) );
+    ZeroMemory( m_pVelocities, nBodies * sizeof( D3DXVECTOR4 ) );
+    ZeroMemory( m_pForces, nBodies * sizeof( D3DXVECTOR4 ) );
+    for( UINT i = 0; i < nBodies; i++ )
+        m_pPositions[i].w = 1.0f;
+
+    m_nThreads = nThreads;
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CNBodyCPU::Destroy()
+{
+    for( UINT i = 0; i < NBODY_MAX_THREADS; i++ )
+        SAFE_DELETE_ARRAY( m_apList[i] );
+
+    SAFE_DELETE_ARRAY( m_pPositions );
+    SAFE_DELETE_ARRAY( m_pVelocities );
+    SAFE_DELETE_ARRAY( m_pForces );
+    SAFE_DELETE_ARRAY( m_pSourceX );
+    SAFE_DELETE_ARRAY( m_pSourceY );
+    SAFE_DELETE_ARRAY( m_pSourceZ );
+    SAFE_DELETE_ARRAY( m_pSourceMass );
+    SAFE_DELETE_ARRAY( m_pCodes );
+    SAFE_DELETE_ARRAY( m_pSortScratch );
+    SAFE_DELETE_ARRAY( m_pOrder );
+    SAFE_DELETE_ARRAY( m_pNodes );
+    m_nNodes = 0;
+    m_nMaxNodes = 0;
+    m_nBodies = 0;
+    m_nSources = 0;
+    m_nThreads = 1;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CNBodyCPU::SetState( const D3DXVECTOR4* pPositions, const D3DXVECTOR4* pVelocities )
+{
+    if( pPositions )
+        memcpy( m_pPositions, pPositions, m_nBodies * sizeof( D3DXVECTOR4 ) );
+    if( pVelocities )
+        memcpy( m_pVelocities, pVelocities, m_nBodies * sizeof( D3DXVECTOR4 ) );
+}
+
+
+//--------------------------------------------------------------------------------------
+void CNBodyCPU::GetState( D3DXVECTOR4* pPositions, D3DXVECTOR4* pVelocities ) const
+{
+    if( pPositions )
+        memcpy( pPositions, m_pPositions, m_nBodies * sizeof( D3DXVECTOR4 ) );
+    if( pVelocities )
+        memcpy( pVelocities, m_pVelocities, m_nBodies * sizeof( D3DXVECTOR4 ) );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Shares the nItems items of a job between this thread and the pool's workers
+//--------------------------------------------------------------------------------------
+void CNBodyCPU::RunJob( NBODY_JOB Job, UINT nItems )
+{
+    m_Job = Job;
+    DXUTGetWorkerPool()->Run( ItemProc, this, nItems, m_nThreads );
+}
+
+
+//--------------------------------------------------------------------------------------
+void CNBodyCPU::ItemProc( void* pContext, UINT iItem, UINT iWorker )
+{
+    ( ( CNBodyCPU* )pContext )->RunItem( iItem, iWorker );
+}
+
+
+//--------------------------------------------------------------------------------------
+void CNBodyCPU::RunItem( UINT iItem, UINT iWorker )
+{
+    switch( m_Job )
+    {
+        case NBODY_JOB_ALL_PAIRS:
+            SumAllPairs( iItem * NBODY_RUN_SIZE, min( ( UINT )NBODY_RUN_SIZE, m_nBodies - iItem * NBODY_RUN_SIZE ),
+                         iWorker );
+            break;
+        case NBODY_JOB_MORTON:
+            ComputeMortonCodes( iItem * NBODY_ADVANCE_SIZE,
+                                min( ( UINT )NBODY_ADVANCE_SIZE, m_nSources - iItem * NBODY_ADVANCE_SIZE ) );
+            break;
+        case NBODY_JOB_BARNES_HUT:
+            SumBarnesHut( iItem, iWorker );
+            break;
+        case NBODY_JOB_ADVANCE:
+            Advance( iItem * NBODY_ADVANCE_SIZE, min( ( UINT )NBODY_ADVANCE_SIZE,
+                                                      m_nBodies - iItem * NBODY_ADVANCE_SIZE ) );
+            break;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Copies the positions of the sources to the arrays the kernel reads, in the order given
+// or in body order when pOrder is NULL
+//--------------------------------------------------------------------------------------
+void CNBodyCPU::CopySources( const UINT* pOrder )
+{
+    for( UINT i = 0; i < m_nSources; i++ )
+    {
+        const D3DXVECTOR4& Position = m_pPositions[pOrder ? pOrder[i] : i];
+        m_pSourceX[i] = Position.x;
+        m_pSourceY[i] = Position.y;
+        m_pSourceZ[i] = Position.z;
+        m_pSourceMass[i] = m_Params.fParticleMass;
+    }
+    for( UINT i = m_nSources; i < ( ( m_nSources + 3 ) & ~3 ); i++ )
+    {
+        m_pSourceX[i] = 0.0f;
+        m_pSourceY[i] = 0.0f;
+        m_pSourceZ[i] = 0.0f;
+        m_pSourceMass[i] = 0.0f;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+void CNBodyCPU::ComputeForces( NBODY_SOLVER Solver )
+{
+    double fStart = DXUTGetMilliseconds(), fBuilt;
+    ZeroMemory( m_anInteractions, sizeof( m_anInteractions ) );
+
+    if( NBODY_ALL_PAIRS == Solver )
+    {
+        CopySources( NULL );
+        fBuilt = DXUTGetMilliseconds();
+        RunJob( NBODY_JOB_ALL_PAIRS, ( m_nBodies + NBODY_RUN_SIZE - 1 ) / NBODY_RUN_SIZE );
+    }
+    else
+    {
+        // A cube around the sources, cut into 2^10 Morton cells a side
+        float afMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+        float afMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+        for( UINT i = 0; i < m_nSources; i++ )
+        {
+            const float* pf = ( const float* )&m_pPositions[i];
+            for( UINT k = 0; k < 3; k++ )
+            {
+                afMin[k] = __min( afMin[k], pf[k] );
+                afMax[k] = __max( afMax[k], pf[k] );
+            }
+        }
+        float fSize = __max( __max( afMax[0] - afMin[0], afMax[1] - afMin[1] ), afMax[2] - afMin[2] );
+        fSize = __max( fSize * 1.0001f, 1e-6f );
+        for( UINT k = 0; k < 3; k++ )
+            m_afBoxMin[k] = afMin[k];
+        m_fBoxScale = ( float )( 1 << NBODY_MORTON_LEVELS ) / fSize;
+
+        RunJob( NBODY_JOB_MORTON, ( m_nSources + NBODY_ADVANCE_SIZE - 1 ) / NBODY_ADVANCE_SIZE );
+        SortMortonCodes();
+
+        // The sources in Morton order, then the bodies that are not sources
+        for( UINT i = 0; i < m_nSources; i++ )
+            m_pOrder[i] = ( UINT )( m_pCodes[i] & 0xFFFFFFFF );
+        for( UINT i = m_nSources; i < m_nBodies; i++ )
+            m_pOrder[i] = i;
+        CopySources( m_pOrder );
+
+        m_nNodes = 0;
+        BuildNode( 0, m_nSources, 0 );
+
+        fBuilt = DXUTGetMilliseconds();
+        RunJob( NBODY_JOB_BARNES_HUT, ( m_nBodies + NBODY_GROUP_SIZE - 1 ) / NBODY_GROUP_SIZE );
+    }
+
+    m_fBuildTime = fBuilt - fStart;
+    m_fForceTime = DXUTGetMilliseconds() - fBuilt;
+
+    m_nInteractions = 0;
+    for( UINT i = 0; i < NBODY_MAX_THREADS; i++ )
+        m_nInteractions += m_anInteractions[i];
+}
+
+
+//--------------------------------------------------------------------------------------
+void CNBodyCPU::Step( float fElapsedTime, NBODY_SOLVER Solver )
+{
+    ComputeForces( Solver );
+
+    m_fElapsedTime = fElapsedTime;
+    RunJob( NBODY_JOB_ADVANCE, ( m_nBodies + NBODY_ADVANCE_SIZE - 1 ) / NBODY_ADVANCE_SIZE );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Sweeps a run of bodies over the sources a tile at a time
+//--------------------------------------------------------------------------------------
+void CNBodyCPU::SumAllPairs( UINT iFirst, UINT nBodies, UINT iWorker )
+{
+    NBODY_RUN Run;
+    LoadRun( &Run, m_pPositions, NULL, iFirst, nBodies );
+
+    const UINT nPadded = ( m_nSources + 3 ) & ~3;
+    for( UINT iTile = 0; iTile < nPadded; iTile += NBODY_TILE_SIZE )
+    {
+        SumRun( &Run, m_pSourceX + iTile, m_pSourceY + iTile, m_pSourceZ + iTile, m_pSourceMass + iTile,
+                min( ( UINT )NBODY_TILE_SIZE, nPadded - iTile ), m_Params.fMinDistance, m_dwFlags );
+    }
+
+    StoreRun( &Run, m_pForces, NULL, iFirst, m_Params );
+    m_anInteractions[iWorker] += ( ULONGLONG )nBodies * m_nSources;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CNBodyCPU::ComputeMortonCodes( UINT iFirst, UINT nBodies )
+{
+    for( UINT i = iFirst; i < iFirst + nBodies; i++ )
+    {
+        const D3DXVECTOR4& Position = m_pPositions[i];
+        UINT nCode = ( SpreadBits( MortonCell( Position.x, m_afBoxMin[0], m_fBoxScale ) ) << 2 ) |
+                     ( SpreadBits( MortonCell( Position.y, m_afBoxMin[1], m_fBoxScale ) ) << 1 ) |
+                     SpreadBits( MortonCell( Position.z, m_afBoxMin[2], m_fBoxScale ) );
+        m_pCodes[i] = ( ( ULONGLONG )nCode << 32 ) | i;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Radix sorts the codes of the sources on their 30 bit Morton codes, 10 bits a pass.  The
+// sort is stable, so sources in the same cell stay in body order.
+//--------------------------------------------------------------------------------------
+void CNBodyCPU::SortMortonCodes()
+{
+    UINT anCounts[1024];
+    ULONGLONG* pSrc = m_pCodes;
+    ULONGLONG* pDest = m_pSortScratch;
+
+    for( UINT nShift = 32; nShift < 62; nShift += 10 )
+    {
+        ZeroMemory( anCounts, sizeof( anCounts ) );
+        for( UINT i = 0; i < m_nSources; i++ )
+            anCounts[( pSrc[i] >> nShift ) & 1023]++;
+
+        UINT nTotal = 0;
+        for( UINT i = 0; i < 1024; i++ )
+        {
+            UINT nCount = anCounts[i];
+            anCounts[i] = nTotal;
+            nTotal += nCount;
+        }
+
+        for( UINT i = 0; i < m_nSources; i++ )
+            pDest[anCounts[( pSrc[i] >> nShift ) & 1023]++] = pSrc[i];
+
+        ULONGLONG* pTemp = pSrc;
+        pSrc = pDest;
+        pDest = pTemp;
+    }
+
+    // Three passes leave the sorted codes in the scratch array
+    if( pSrc != m_pCodes )
+        memcpy( m_pCodes, pSrc, m_nSources * sizeof( ULONGLONG ) );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Builds the subtree over nBodies sorted sources from iFirst that share their Morton code
+// down to level nLevel, and returns its node.  A cell with one child is not given a node
+// of its own; the child is built in its place.
+//--------------------------------------------------------------------------------------
+UINT CNBodyCPU::BuildNode( UINT iFirst, UINT nBodies, UINT nLevel )
+{
+    const UINT iNode = m_nNodes++;
+
+    // Go down while every body is in the same child
+    while( nBodies > NBODY_LEAF_SIZE && nLevel < NBODY_MORTON_LEVELS )
+    {
+        const UINT nShift = 32 + 3 * ( NBODY_MORTON_LEVELS - 1 - nLevel );
+        if( ( ( m_pCodes[iFirst] >> nShift ) & 7 ) != ( ( m_pCodes[iFirst + nBodies - 1] >> nShift ) & 7 ) )
+            break;
+        nLevel++;
+    }
+
+    float x = 0.0f, y = 0.0f, z = 0.0f, fMass = 0.0f;
+    UINT nLeafBodies = 0;
+    if( nBodies <= NBODY_LEAF_SIZE || nLevel >= NBODY_MORTON_LEVELS )
+    {
+        for( UINT i = iFirst; i < iFirst + nBodies; i++ )
+        {
+            x += m_pSourceX[i] * m_pSourceMass[i];
+            y += m_pSourceY[i] * m_pSourceMass[i];
+            z += m_pSourceZ[i] * m_pSourceMass[i];
+            fMass += m_pSourceMass[i];
+        }
+        nLeafBodies = nBodies;
+    }
+    else
+    {
+        // The children are runs of the sorted codes with the same 3 bits at this level
+        const UINT nShift = 32 + 3 * ( NBODY_MORTON_LEVELS - 1 - nLevel );
+        UINT iChildFirst = iFirst;
+        while( iChildFirst < iFirst + nBodies )
+        {
+            const ULONGLONG nOctant = ( m_pCodes[iChildFirst] >> nShift ) & 7;
+            UINT iChildEnd = iChildFirst + 1;
+            while( iChildEnd < iFirst + nBodies && ( ( m_pCodes[iChildEnd] >> nShift ) & 7 ) == nOctant )
+                iChildEnd++;
+
+            const NBODY_NODE& Child = m_pNodes[BuildNode( iChildFirst, iChildEnd - iChildFirst, nLevel + 1 )];
+            x += Child.x * Child.fMass;
+            y += Child.y * Child.fMass;
+            z += Child.z * Child.fMass;
+            fMass += Child.fMass;
+            iChildFirst = iChildEnd;
+        }
+    }
+
+    NBODY_NODE& Node = m_pNodes[iNode];
+    if( fMass > 0.0f )
+    {
+        Node.x = x / fMass;
+        Node.y = y / fMass;
+        Node.z = z / fMass;
+    }
+    else
+    {
+        Node.x = m_pSourceX[iFirst];
+        Node.y = m_pSourceY[iFirst];
+        Node.z = m_pSourceZ[iFirst];
+    }
+    Node.fMass = fMass;
+    Node.iNext = m_nNodes;
+    Node.iFirstBody = iFirst;
+    Node.nBodies = nLeafBodies;
+
+    // The cell is the one at nLevel holding the first body; it has to be opened for any
+    // body nearer its center of mass than its size over theta, plus the distance from its
+    // center of mass to its center so a body inside it is never too far
+    const float fCellSize = ( float )( 1 << ( NBODY_MORTON_LEVELS - nLevel ) ) / m_fBoxScale;
+    const float* afFirst[3] = { m_pSourceX, m_pSourceY, m_pSourceZ };
+    const float afCom[3] = { Node.x, Node.y, Node.z };
+    float fOffsetSq = 0.0f;
+    for( UINT k = 0; k < 3; k++ )
+    {
+        UINT nCell = MortonCell( afFirst[k][iFirst], m_afBoxMin[k], m_fBoxScale ) >> ( NBODY_MORTON_LEVELS - nLevel );
+        float fCenter = m_afBoxMin[k] + ( ( float )nCell + 0.5f ) * fCellSize;
+        fOffsetSq += ( afCom[k] - fCenter ) * ( afCom[k] - fCenter );
+    }
+
+    if( m_Params.fTheta > 0.0f )
+    {
+        const float fOpenDist = fCellSize / m_Params.fTheta + sqrtf( fOffsetSq );
+        Node.fOpenDistSq = fOpenDist * fOpenDist;
+    }
+    else
+    {
+        Node.fOpenDistSq = FLT_MAX;
+    }
+
+    return iNode;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Sums a thread's list of cells and bodies into a run and empties it
+//--------------------------------------------------------------------------------------
+void CNBodyCPU::FlushList( NBODY_RUN* pRun, UINT iWorker )
+{
+    float* pList = m_apList[iWorker];
+    UINT nList = m_anList[iWorker];
+    if( 0 == nList )
+        return;
+
+    for( ; nList & 3; nList++ )
+    {
+        pList[nList] = 0.0f;
+        pList[NBODY_LIST_SIZE + nList] = 0.0f;
+        pList[2 * NBODY_LIST_SIZE + nList] = 0.0f;
+        pList[3 * NBODY_LIST_SIZE + nList] = 0.0f;
+    }
+
+    SumRun( pRun, pList, pList + NBODY_LIST_SIZE, pList + 2 * NBODY_LIST_SIZE, pList + 3 * NBODY_LIST_SIZE, nList,
+            m_Params.fMinDistance, m_dwFlags );
+    m_anInteractions[iWorker] += ( ULONGLONG )pRun->nBodies * m_anList[iWorker];
+    m_anList[iWorker] = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Walks the tree once for a group of bodies.  A cell whose center of mass is far enough
+// from every body of the group is taken whole; a leaf that is not gives its bodies.
+//--------------------------------------------------------------------------------------
+void CNBodyCPU::SumBarnesHut( UINT iGroup, UINT iWorker )
+{
+    const UINT* pBodies = m_pOrder + iGroup * NBODY_GROUP_SIZE;
+    const UINT nBodies = min( ( UINT )NBODY_GROUP_SIZE, m_nBodies - iGroup * NBODY_GROUP_SIZE );
+
+    NBODY_RUN Run;
+    LoadRun( &Run, m_pPositions, pBodies, 0, nBodies );
+
+    float afMin[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float afMax[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for( UINT i = 0; i < nBodies; i++ )
+    {
+        afMin[0] = __min( afMin[0], Run.afX[i] );
+        afMin[1] = __min( afMin[1], Run.afY[i] );
+        afMin[2] = __min( afMin[2], Run.afZ[i] );
+        afMax[0] = __max( afMax[0], Run.afX[i] );
+        afMax[1] = __max( afMax[1], Run.afY[i] );
+        afMax[2] = __max( afMax[2], Run.afZ[i] );
+    }
+
+    float* pList = m_apList[iWorker];
+    m_anList[iWorker] = 0;
+
+    UINT iNode = 0;
+    while( iNode < m_nNodes )
+    {
+        const NBODY_NODE& Node = m_pNodes[iNode];
+
+        // Squared distance from the center of mass to the group's bounds
+        const float dx = __max( 0.0f, __max( afMin[0] - Node.x, Node.x - afMax[0] ) );
+        const float dy = __max( 0.0f, __max( afMin[1] - Node.y, Node.y - afMax[1] ) );
+        const float dz = __max( 0.0f, __max( afMin[2] - Node.z, Node.z - afMax[2] ) );
+        const float fDistSq = dx * dx + dy * dy + dz * dz;
+
+        if( fDistSq > Node.fOpenDistSq )
+        {
+            if( m_anList[iWorker] + 1 > NBODY_LIST_SIZE - 4 )
+                FlushList( &Run, iWorker );
+            UINT n = m_anList[iWorker]++;
+            pList[n] = Node.x;
+            pList[NBODY_LIST_SIZE + n] = Node.y;
+            pList[2 * NBODY_LIST_SIZE + n] = Node.z;
+            pList[3 * NBODY_LIST_SIZE + n] = Node.fMass;
+            iNode = Node.iNext;
+        }
+        else if( Node.nBodies > 0 )
+        {
+            for( UINT i = Node.iFirstBody; i < Node.iFirstBody + Node.nBodies; i++ )
+            {
+                if( m_anList[iWorker] + 1 > NBODY_LIST_SIZE - 4 )
+                    FlushList( &Run, iWorker );
+                UINT n = m_anList[iWorker]++;
+                pList[n] = m_pSourceX[i];
+                pList[NBODY_LIST_SIZE + n] = m_pSourceY[i];
+                pList[2 * NBODY_LIST_SIZE + n] = m_pSourceZ[i];
+                pList[3 * NBODY_LIST_SIZE + n] = m_pSourceMass[i];
+            }
+            iNode = Node.iNext;
+        }
+        else
+        {
+            iNode++;
+        }
+    }
+
+    FlushList( &Run, iWorker );
+    StoreRun( &Run, m_pForces, pBodies, 0, m_Params );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Moves bodies on by the step with their forces, as PSAdvance does
+//--------------------------------------------------------------------------------------
+void CNBodyCPU::Advance( UINT iFirst, UINT nBodies )
+{
+    const float fElapsedTime = m_fElapsedTime;
+    const float fInvMass = 1.0f / m_Params.fParticleMass;
+    for( UINT i = iFirst; i < iFirst + nBodies; i++ )
+    {
+        D3DXVECTOR4& Position = m_pPositions[i];
+        D3DXVECTOR4& Velocity = m_pVelocities[i];
+        const D3DXVECTOR4& Force = m_pForces[i];
+
+        Velocity.x += Force.x * fInvMass * fElapsedTime;
+        Velocity.y += Force.y * fInvMass * fElapsedTime;
+        Velocity.z += Force.z * fInvMass * fElapsedTime;
+        Velocity.w = 0.0f;
+
+        Position.x += Velocity.x * fElapsedTime;
+        Position.y += Velocity.y * fElapsedTime;
+        Position.z += Velocity.z * fElapsedTime;
+        Position.w = 0.0f;
+    }
+}
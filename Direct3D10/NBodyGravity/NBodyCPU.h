@@ -0,0 +1,209 @@
+//--------------------------------------------------------------------------------------
+// File: NBodyCPU.h
+//
+// A CPU N-body engine with the force law and integration of NBodyGravity.fx, for checking
+// the sample against and for running more bodies than the sample can without a device.
+// Bodies are kept as the particle texture keeps them, a float4 position and a float4
+// velocity each, and the forces as the force texture keeps them.
+//
+// The forces come from one of two solvers:
+//
+// - All pairs, O(N^2).  The sources are copied to arrays of x, y, z and mass, and each
+//   thread takes runs of bodies and sweeps them over tiles of the sources small enough to
+//   stay in the cache, four bodies against four sources at a time with SSE.
+// - Barnes-Hut, O(N log N).  The sources are sorted along a Morton curve and an octree is
+//   built over the sorted order, laid out depth first with the index of the node after
+//   each subtree so it is walked without a stack.  Each thread takes groups of bodies that
+//   are neighbours along the curve and walks the tree once for the group, gathering the
+//   cells far enough from the group's bounds and the bodies of the leaves that are not
+//   into a list, which is then summed with the all pairs kernel.
+//
+// Both keep the shader's softening, max( r, g_fParticleRad / 10 ), and a body exerts no
+// force on itself.  The step is the leapfrog the shader does: the velocities are those of
+// half a step before the positions, so each step kicks them a whole step with the forces
+// at the positions and then drifts the positions with them.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#pragma once
+#ifndef NBODYCPU_H
+#define NBODYCPU_H
+
+#define NBODY_MAX_THREADS       32
+
+// Use the plain C++ kernel even where SSE is available
+#define NBODY_SCALAR            0x00000001
+
+enum NBODY_SOLVER
+{
+    NBODY_ALL_PAIRS = 0,
+    NBODY_BARNES_HUT,
+};
+
+// The effect parameters the force and advance passes use
+struct NBODY_PARAMS
+{
+    float fG;                   // g_fG
+    float fParticleMass;        // g_fParticleMass, the mass of every body
+    float fMinDistance;         // g_fParticleRad / 10
+    float fTheta;               // Barnes-Hut opening angle: a cell is opened when its size is more
+                                // than fTheta times its distance
+};
+
+// A node of the octree.  An interior node's children follow it; iNext is the node after
+// its subtree.  fOpenDistSq is the squared distance within which the node must be
+// opened: its size over theta, plus how far its center of mass is from its center.
+struct NBODY_NODE
+{
+    float x, y, z;              // Center of mass
+    float fMass;
+    float fOpenDistSq;
+    UINT iNext;
+    UINT iFirstBody;            // Into the sorted sources
+    UINT nBodies;               // 0 for an interior node
+};
+
+struct NBODY_RUN;
+
+
+//--------------------------------------------------------------------------------------
+class CNBodyCPU
+{
+public:
+                        CNBodyCPU();
+                        ~CNBodyCPU();
+
+    // nThreads 0 uses a thread for each processor.  The bodies start at the origin at rest.
+    HRESULT             Create( UINT nBodies, const NBODY_PARAMS& Params, UINT nThreads = 0, DWORD dwFlags = 0 );
+    void                Destroy();
+
+    void                SetParams( const NBODY_PARAMS& Params )
+    {
+        m_Params = Params;
+    }
+
+    // Copies the bodies in or out, GetNumBodies() of each.  Either pointer may be NULL.
+    void                SetState( const D3DXVECTOR4* pPositions, const D3DXVECTOR4* pVelocities );
+    void                GetState( D3DXVECTOR4* pPositions, D3DXVECTOR4* pVelocities ) const;
+
+    // Only the first nSources bodies pull on the others; all of them are moved.  0, the
+    // default, makes every body a source.
+    void                SetNumSources( UINT nSources )
+    {
+        m_nSources = ( 0 == nSources || nSources > m_nBodies ) ? m_nBodies : nSources;
+    }
+
+    // Fills the forces from the positions, as AccumulateForces does
+    void                ComputeForces( NBODY_SOLVER Solver );
+
+    // ComputeForces, then moves the bodies on by fElapsedTime, as AdvanceParticles does
+    void                Step( float fElapsedTime, NBODY_SOLVER Solver );
+
+    const D3DXVECTOR4*  GetPositions() const
+    {
+        return m_pPositions;
+    }
+    const D3DXVECTOR4*  GetVelocities() const
+    {
+        return m_pVelocities;
+    }
+    const D3DXVECTOR4*  GetForces() const
+    {
+        return m_pForces;
+    }
+
+    UINT                GetNumBodies() const
+    {
+        return m_nBodies;
+    }
+    UINT                GetNumThreads() const
+    {
+        return m_nThreads;
+    }
+
+    // Milliseconds the last ComputeForces took to sort the sources and build the tree, and
+    // to sum the forces
+    double              GetBuildTime() const
+    {
+        return m_fBuildTime;
+    }
+    double              GetForceTime() const
+    {
+        return m_fForceTime;
+    }
+
+    // Pairs of bodies or of a body and a cell summed by the last ComputeForces
+    ULONGLONG           GetNumInteractions() const
+    {
+        return m_nInteractions;
+    }
+
+protected:
+    enum NBODY_JOB
+    {
+        NBODY_JOB_ALL_PAIRS = 0,
+        NBODY_JOB_MORTON,
+        NBODY_JOB_BARNES_HUT,
+        NBODY_JOB_ADVANCE,
+    };
+
+    static void         ItemProc( void* pContext, UINT iItem, UINT iWorker );
+
+    void                RunJob( NBODY_JOB Job, UINT nItems );
+    void                RunItem( UINT iItem, UINT iWorker );
+
+    void                CopySources( const UINT* pOrder );
+    void                SumAllPairs( UINT iFirst, UINT nBodies, UINT iWorker );
+    void                ComputeMortonCodes( UINT iFirst, UINT nBodies );
+    void                SortMortonCodes();
+    UINT                BuildNode( UINT iFirst, UINT nBodies, UINT nLevel );
+    void                SumBarnesHut( UINT iGroup, UINT iWorker );
+    void                FlushList( NBODY_RUN* pRun, UINT iWorker );
+    void                Advance( UINT iFirst, UINT nBodies );
+
+    NBODY_PARAMS        m_Params;
+    DWORD               m_dwFlags;
+    UINT                m_nBodies;
+    UINT                m_nSources;
+    float               m_fElapsedTime;
+
+    D3DXVECTOR4*        m_pPositions;
+    D3DXVECTOR4*        m_pVelocities;
+    D3DXVECTOR4*        m_pForces;
+
+    // Sources as the kernel reads them, padded to a multiple of 4 with massless bodies.  The
+    // all pairs solver keeps them in body order, Barnes-Hut in Morton order.
+    float*              m_pSourceX;
+    float*              m_pSourceY;
+    float*              m_pSourceZ;
+    float*              m_pSourceMass;
+
+    // Barnes-Hut.  m_pCodes holds the Morton code of each source in the high 32 bits and the
+    // body in the low 32 bits.
+    ULONGLONG*          m_pCodes;
+    ULONGLONG*          m_pSortScratch;
+    UINT*               m_pOrder;           // Bodies to sum, sources in Morton order first
+    NBODY_NODE*         m_pNodes;
+    UINT                m_nNodes;
+    UINT                m_nMaxNodes;
+    float               m_afBoxMin[3];
+    float               m_fBoxScale;        // Morton cells per unit
+
+    // A list of cells and bodies for each thread: the x, y, z and mass arrays of the
+    // sources one after the other
+    float*              m_apList[NBODY_MAX_THREADS];
+    UINT                m_anList[NBODY_MAX_THREADS];
+    ULONGLONG           m_anInteractions[NBODY_MAX_THREADS];
+
+    // Jobs run on the DXUT worker pool, on up to m_nThreads threads counting the one
+    // calling ComputeForces and Step
+    UINT                m_nThreads;
+    NBODY_JOB           m_Job;
+
+    double              m_fBuildTime;
+    double              m_fForceTime;
+    ULONGLONG           m_nInteractions;
+};
+
+#endif
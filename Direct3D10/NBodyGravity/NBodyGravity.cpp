@@ -10,6 +10,7 @@
 #include "DXUTcamera.h"
 #include "SDKmisc.h"
 #include "SDKmesh.h"
+#include "NBodyCPU.h"
 #include "resource.h"
 
 //--------------------------------------------------------------------------------------
@@ -40,6 +41,7 @@ ID3D10RenderTargetView*             g_pParticleDataTexRTVFrom = NULL;
 ID3D10Texture2D*                    g_pForceTexture = NULL;
 ID3D10ShaderResourceView*           g_pForceTexSRV = NULL;
 ID3D10RenderTargetView*             g_pForceTexRTV = NULL;
+ID3D10Texture2D*                    g_pParticleDataStaging = NULL;  // For reading the bodies back
 
 ID3D10EffectTechnique*              g_pRenderParticles;
 ID3D10EffectTechnique*              g_pAccumulateForces;
@@ -74,6 +76,9 @@ float                               g_fGConstant = 6.67300e-11f * 10000.0f;
 float                               g_fSpread = 400.0f;
 float                               g_fParticleRad = 10.0f;
 
+bool                                g_bCheckOnCPU = false;  // Check the next step against CNBodyCPU
+WCHAR                               g_strCPUCheck[256] = L"";
+
 //--------------------------------------------------------------------------------------
 // UI control IDs
 //--------------------------------------------------------------------------------------
@@ -81,6 +86,7 @@ float                               g_fParticleRad = 10.0f;
 #define IDC_TOGGLEREF           3
 #define IDC_CHANGEDEVICE        4
 #define IDC_TOGGLEWARP          5
+#define IDC_CHECKCPU            6
 
 
 //--------------------------------------------------------------------------------------
@@ -109,6 +115,12 @@ void RenderText();
 HRESULT CreateParticleTextures( ID3D10Device* pd3dDevice );
 HRESULT CreateParticleBuffer( ID3D10Device* pd3dDevice );
 HRESULT CreateForceTexture( ID3D10Device* pd3dDevice );
+void SeedGalaxies( D3DXVECTOR4* pPositions, D3DXVECTOR4* pVelocities, UINT NumParticles );
+HRESULT ReadParticleState( ID3D10Device* pd3dDevice, ID3D10Texture2D* pTexture, D3DXVECTOR4* pPositions,
+                           D3DXVECTOR4* pVelocities );
+void CheckOnCPU( ID3D10Device* pd3dDevice, const D3DXVECTOR4* pOldPositions, const D3DXVECTOR4* pOldVelocities );
+INT RunCPUSimulation( int nArgs, LPWSTR* pstrArgs );
+INT RunCPUBenchmark( int nArgs, LPWSTR* pstrArgs );
 
 //--------------------------------------------------------------------------------------
 // Entry point to the program. Initializes everything and goes into a message processing 
@@ -121,6 +133,25 @@ int WINAPI wWinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdL
     _CrtSetDbgFlag( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );
 #endif
 
+    // -cpusim and -cpubench run the bodies on the CPU without creating a window
+    int nArgs = 0;
+    LPWSTR* pstrArgs = CommandLineToArgvW( GetCommandLineW(), &nArgs );
+    if( pstrArgs )
+    {
+        for( int i = 1; i < nArgs; i++ )
+        {
+            const bool bSimulate = 0 == _wcsicmp( pstrArgs[i], L"-cpusim" );
+            if( bSimulate || 0 == _wcsicmp( pstrArgs[i], L"-cpubench" ) )
+            {
+                INT nResult = bSimulate ? RunCPUSimulation( nArgs - i - 1, pstrArgs + i + 1 ) :
+                                          RunCPUBenchmark( nArgs - i - 1, pstrArgs + i + 1 );
+                LocalFree( pstrArgs );
+                return nResult;
+            }
+        }
+        LocalFree( pstrArgs );
+    }
+
     // DXUT will create and use the best device (either D3D9 or D3D10) 
     // that is available on the system depending on which D3D callbacks are set below
 
@@ -159,6 +190,7 @@ void InitApp()
     g_HUD.AddButton( IDC_CHANGEDEVICE, L"Change device (F2)", 35, iY += 24, 125, 22, VK_F2 );
     g_HUD.AddButton( IDC_TOGGLEREF, L"Toggle REF (F3)", 35, iY += 24, 125, 22, VK_F3 );
     g_HUD.AddButton( IDC_TOGGLEWARP, L"Toggle WARP (F4)", 35, iY += 24, 125, 22, VK_F4 );
+    g_HUD.AddButton( IDC_CHECKCPU, L"Check on CPU (C)", 35, iY += 24, 125, 22, 'C' );
 
     g_SampleUI.SetCallback( OnGUIEvent ); iY = 10;
 
@@ -267,6 +299,8 @@ void CALLBACK OnGUIEvent( UINT nEvent, int nControlID, CDXUTControl* pControl, v
             g_D3DSettingsDlg.SetActive( !g_D3DSettingsDlg.IsActive() ); break;
         case IDC_TOGGLEWARP:
             DXUTToggleWARP(); break;
+        case IDC_CHECKCPU:
+            g_bCheckOnCPU = true; break;
     }
 }
 
@@ -616,6 +650,18 @@ void CALLBACK OnD3D10FrameRender( ID3D10Device* pd3dDevice, double fTime, float
     ID3D10DepthStencilView* pDSV = DXUTGetD3D10DepthStencilView();
     pd3dDevice->ClearDepthStencilView( pDSV, D3D10_CLEAR_DEPTH, 1.0, 0 );
 
+    // Keep the bodies from before the step to check it on the CPU
+    const UINT nTexels = g_iTexSize * g_iTexSize;
+    D3DXVECTOR4* pOldState = NULL;
+    if( g_bCheckOnCPU )
+    {
+        g_bCheckOnCPU = false;
+        pOldState = new D3DXVECTOR4[ 2 * nTexels ];
+        if( pOldState && FAILED( ReadParticleState( pd3dDevice, g_pParticleDataTextureFrom, pOldState,
+                                                    pOldState + nTexels ) ) )
+            SAFE_DELETE_ARRAY( pOldState );
+    }
+
     // Accumulate forces
     AccumulateForces( pd3dDevice );
 
@@ -625,6 +671,12 @@ void CALLBACK OnD3D10FrameRender( ID3D10Device* pd3dDevice, double fTime, float
     // Swap the ping-pong buffers
     SwapParticleTextures();
 
+    if( pOldState )
+    {
+        CheckOnCPU( pd3dDevice, pOldState, pOldState + nTexels );
+        SAFE_DELETE_ARRAY( pOldState );
+    }
+
     D3DXMATRIX mView;
     D3DXMATRIX mProj;
 
@@ -653,6 +705,8 @@ void RenderText()
     g_pTxtHelper->SetForegroundColor( D3DXCOLOR( 1.0f, 1.0f, 0.0f, 1.0f ) );
     g_pTxtHelper->DrawTextLine( DXUTGetFrameStats( DXUTIsVsyncEnabled() ) );
     g_pTxtHelper->DrawTextLine( DXUTGetDeviceStats() );
+    if( g_strCPUCheck[0] )
+        g_pTxtHelper->DrawTextLine( g_strCPUCheck );
     g_pTxtHelper->End();
 }
 
@@ -692,6 +746,7 @@ void CALLBACK OnD3D10DestroyDevice( void* pUserContext )
     SAFE_RELEASE( g_pForceTexture );
     SAFE_RELEASE( g_pForceTexSRV );
     SAFE_RELEASE( g_pForceTexRTV );
+    SAFE_RELEASE( g_pParticleDataStaging );
 }
 
 
@@ -729,6 +784,35 @@ void LoadParticles( D3DXVECTOR4* pPositions, D3DXVECTOR4* pVelocities,
     }
 }
 
+//--------------------------------------------------------------------------------------
+// Seeds the bodies of the sample, on the GPU or the CPU
+//--------------------------------------------------------------------------------------
+void SeedGalaxies( D3DXVECTOR4* pPositions, D3DXVECTOR4* pVelocities, UINT NumParticles )
+{
+#if 1
+    // Disk Galaxy Formation
+    float fCenterSpread = g_fSpread * 0.50f;
+    LoadParticles( pPositions, pVelocities,
+                   D3DXVECTOR3( fCenterSpread, 0, 0 ), D3DXVECTOR4( 0, 0, -20, 0 ),
+                   g_fSpread, NumParticles / 2 );
+    LoadParticles( &pPositions[NumParticles / 2], &pVelocities[NumParticles / 2],
+                   D3DXVECTOR3( -fCenterSpread, 0, 0 ), D3DXVECTOR4( 0, 0, 20, 0 ),
+                   g_fSpread, NumParticles - NumParticles / 2 );
+#else
+    // Disk Galaxy Formation with impacting third cluster
+    LoadParticles( pPositions, pVelocities,
+                   D3DXVECTOR3(g_fSpread,0,0), D3DXVECTOR4(0,0,-8,0),
+                   g_fSpread, NumParticles/3 );
+    LoadParticles( &pPositions[NumParticles/3], &pVelocities[NumParticles/3],
+                   D3DXVECTOR3(-g_fSpread,0,0), D3DXVECTOR4(0,0,8,0),
+                   g_fSpread, NumParticles/2 );
+    LoadParticles( &pPositions[2*(NumParticles/3)], &pVelocities[2*(NumParticles/3)],
+                   D3DXVECTOR3(0,0,g_fSpread*15.0f), D3DXVECTOR4(0,0,-60,0),
+                   g_fSpread, NumParticles - 2*(NumParticles/3) );
+#endif
+}
+
+
 //--------------------------------------------------------------------------------------
 // This helper function creates the texture array that will store all of the particle
 // data.  Position, Velocity.
@@ -765,28 +849,7 @@ HRESULT CreateParticleTextures( ID3D10Device* pd3dDevice )
         return E_OUTOFMEMORY;
 
     srand( timeGetTime() );
-
-#if 1
-    // Disk Galaxy Formation
-    float fCenterSpread = g_fSpread * 0.50f;
-    LoadParticles( pData1, pData2,
-                   D3DXVECTOR3( fCenterSpread, 0, 0 ), D3DXVECTOR4( 0, 0, -20, 0 ),
-                   g_fSpread, MaxTextureParticles / 2 );
-    LoadParticles( &pData1[MaxTextureParticles / 2], &pData2[MaxTextureParticles / 2],
-                   D3DXVECTOR3( -fCenterSpread, 0, 0 ), D3DXVECTOR4( 0, 0, 20, 0 ),
-                   g_fSpread, MaxTextureParticles / 2 );
-#else
-    // Disk Galaxy Formation with impacting third cluster
-    LoadParticles( pData1, pData2,
-                   D3DXVECTOR3(g_fSpread,0,0), D3DXVECTOR4(0,0,-8,0),
-                   g_fSpread, MaxTextureParticles/3 );
-    LoadParticles( &pData1[MaxTextureParticles/3], &pData2[MaxTextureParticles/3],
-                   D3DXVECTOR3(-g_fSpread,0,0), D3DXVECTOR4(0,0,8,0),
-                   g_fSpread, MaxTextureParticles/2 );
-    LoadParticles( &pData1[2*(MaxTextureParticles/3)], &pData2[2*(MaxTextureParticles/3)],
-                   D3DXVECTOR3(0,0,g_fSpread*15.0f), D3DXVECTOR4(0,0,-60,0),
-                   g_fSpread, MaxTextureParticles - 2*(MaxTextureParticles/3) );
-#endif
+    SeedGalaxies( pData1, pData2, MaxTextureParticles );
 
     D3D10_SUBRESOURCE_DATA InitData[2];
     InitData[0].pSysMem = pData1;
@@ -977,3 +1040,442 @@ HRESULT CreateParticleBuffer( ID3D10Device* pd3dDevice )
    
    return hr;
    }*/
+
+
+//--------------------------------------------------------------------------------------
+// Reads the positions and velocities of every texel of the particle texture back
+//--------------------------------------------------------------------------------------
+HRESULT ReadParticleState( ID3D10Device* pd3dDevice, ID3D10Texture2D* pTexture, D3DXVECTOR4* pPositions,
+                           D3DXVECTOR4* pVelocities )
+{
+    HRESULT hr;
+
+    if( !g_pParticleDataStaging )
+    {
+        D3D10_TEXTURE2D_DESC dstex;
+        pTexture->GetDesc( &dstex );
+        dstex.Usage = D3D10_USAGE_STAGING;
+        dstex.BindFlags = 0;
+        dstex.CPUAccessFlags = D3D10_CPU_ACCESS_READ;
+        dstex.MiscFlags = 0;
+        V_RETURN( pd3dDevice->CreateTexture2D( &dstex, NULL, &g_pParticleDataStaging ) );
+    }
+    pd3dDevice->CopyResource( g_pParticleDataStaging, pTexture );
+
+    D3DXVECTOR4* apDest[2] = { pPositions, pVelocities };
+    for( UINT iSlice = 0; iSlice < 2; iSlice++ )
+    {
+        const UINT iSubresource = D3D10CalcSubresource( 0, iSlice, 1 );
+        D3D10_MAPPED_TEXTURE2D Mapped;
+        V_RETURN( g_pParticleDataStaging->Map( iSubresource, D3D10_MAP_READ, 0, &Mapped ) );
+        for( UINT y = 0; y < g_iTexSize; y++ )
+        {
+            memcpy( apDest[iSlice] + y * g_iTexSize, ( const BYTE* )Mapped.pData + y * Mapped.RowPitch,
+                    g_iTexSize * sizeof( D3DXVECTOR4 ) );
+        }
+        g_pParticleDataStaging->Unmap( iSubresource );
+    }
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Steps the bodies from before the GPU's last step on the CPU and compares the change in
+// velocity, the force over the mass times the step, with the GPU's
+//--------------------------------------------------------------------------------------
+void CheckOnCPU( ID3D10Device* pd3dDevice, const D3DXVECTOR4* pOldPositions, const D3DXVECTOR4* pOldVelocities )
+{
+    const UINT nTexels = g_iTexSize * g_iTexSize;
+    D3DXVECTOR4* pState = new D3DXVECTOR4[ 4 * nTexels ];
+    UINT* pOrder = new UINT[ nTexels ];
+    if( !pState || !pOrder )
+    {
+        SAFE_DELETE_ARRAY( pState );
+        SAFE_DELETE_ARRAY( pOrder );
+        return;
+    }
+    D3DXVECTOR4* pPositions = pState;
+    D3DXVECTOR4* pVelocities = pState + nTexels;
+    D3DXVECTOR4* pNewPositions = pState + 2 * nTexels;
+    D3DXVECTOR4* pNewVelocities = pState + 3 * nTexels;
+
+    // PSForce sums the pull of the first MAX_PARTICLES_SIDE texels of the first
+    // MAX_PARTICLES_SIDE rows on every texel, so those go first as the sources
+    const UINT nSources = MAX_PARTICLES_SIDE * MAX_PARTICLES_SIDE;
+    UINT nOrder = 0;
+    for( UINT iPass = 0; iPass < 2; iPass++ )
+    {
+        for( UINT i = 0; i < nTexels; i++ )
+        {
+            const bool bSource = ( i % g_iTexSize ) < MAX_PARTICLES_SIDE && ( i / g_iTexSize ) < MAX_PARTICLES_SIDE;
+            if( bSource == ( 0 == iPass ) )
+                pOrder[nOrder++] = i;
+        }
+    }
+    for( UINT i = 0; i < nTexels; i++ )
+    {
+        pPositions[i] = pOldPositions[pOrder[i]];
+        pVelocities[i] = pOldVelocities[pOrder[i]];
+    }
+
+    CNBodyCPU CPU;
+    NBODY_PARAMS Params = { g_fGConstant, g_fParticleMass, g_fParticleRad / 10.0f, 0.5f };
+    if( SUCCEEDED( CPU.Create( nTexels, Params ) ) &&
+        SUCCEEDED( ReadParticleState( pd3dDevice, g_pParticleDataTextureFrom, pNewPositions, pNewVelocities ) ) )
+    {
+        CPU.SetNumSources( nSources );
+        CPU.SetState( pPositions, pVelocities );
+        CPU.Step( SIMULATION_SPEED, NBODY_ALL_PAIRS );
+
+        double fErrorSq = 0.0, fChangeSq = 0.0, fMaxErrorSq = 0.0;
+        const D3DXVECTOR4* pCPUVelocities = CPU.GetVelocities();
+        for( UINT i = 0; i < nTexels; i++ )
+        {
+            const UINT iTexel = pOrder[i];
+            D3DXVECTOR3 vCPU( pCPUVelocities[i].x - pVelocities[i].x, pCPUVelocities[i].y - pVelocities[i].y,
+                              pCPUVelocities[i].z - pVelocities[i].z );
+            D3DXVECTOR3 vGPU( pNewVelocities[iTexel].x - pVelocities[i].x, pNewVelocities[iTexel].y - pVelocities[i].y,
+                              pNewVelocities[iTexel].z - pVelocities[i].z );
+            D3DXVECTOR3 vError = vGPU - vCPU;
+            const double fSq = D3DXVec3LengthSq( &vError );
+            fErrorSq += fSq;
+            fMaxErrorSq = __max( fMaxErrorSq, fSq );
+            fChangeSq += D3DXVec3LengthSq( &vCPU );
+        }
+
+        // Both relative to the root mean square change
+        const double fChange = sqrt( __max( fChangeSq, 1e-30 ) / nTexels );
+        swprintf_s( g_strCPUCheck, 256, L"CPU check of %u bodies: velocity change off by %.4f%% RMS, %.4f%% at most",
+                    nTexels, 100.0 * sqrt( fErrorSq / nTexels ) / fChange, 100.0 * sqrt( fMaxErrorSq ) / fChange );
+    }
+    else
+    {
+        wcscpy_s( g_strCPUCheck, 256, L"CPU check failed" );
+    }
+
+    SAFE_DELETE_ARRAY( pState );
+    SAFE_DELETE_ARRAY( pOrder );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Parses the options -cpusim and -cpubench share
+//--------------------------------------------------------------------------------------
+void ParseCPUArgs( int nArgs, LPWSTR* pstrArgs, UINT* pnBodies, UINT* pnThreads, UINT* pnSteps, float* pfTheta )
+{
+    for( int i = 0; i + 1 < nArgs; i++ )
+    {
+        if( 0 == _wcsicmp( pstrArgs[i], L"-bodies" ) )
+        {
+            int nValue = _wtoi( pstrArgs[++i] );
+            *pnBodies = nValue < 1 ? 1 : ( nValue > 16777216 ? 16777216 : nValue );
+        }
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-threads" ) )
+        {
+            int nValue = _wtoi( pstrArgs[++i] );
+            *pnThreads = nValue > 0 ? nValue : 0;
+        }
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-steps" ) )
+        {
+            int nValue = _wtoi( pstrArgs[++i] );
+            *pnSteps = nValue < 1 ? 1 : nValue;
+        }
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-theta" ) )
+        {
+            float fValue = ( float )_wtof( pstrArgs[++i] );
+            *pfTheta = fValue < 0.0f ? 0.0f : fValue;
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Headless run of the bodies on the CPU:
+//
+//   NBodyGravity -cpusim [-bodies N] [-steps N] [-threads N] [-theta f] [-allpairs]
+//                        [-out file]
+//
+// Seeds -bodies bodies (as many as the sample's texture by default) as the sample does
+// and steps them -steps times (100 by default) with Barnes-Hut at opening angle -theta
+// (0.5 by default), or with all pairs.  Prints the milliseconds a step takes, and writes
+// the positions then the velocities, as float4s, to -out if it is given.
+// Returns 0 on success, 1 on failure.
+//--------------------------------------------------------------------------------------
+INT RunCPUSimulation( int nArgs, LPWSTR* pstrArgs )
+{
+    // Report to the console we were started from, if any
+    if( AttachConsole( ATTACH_PARENT_PROCESS ) )
+    {
+        FILE* pFile;
+        freopen_s( &pFile, "CONOUT$", "w", stdout );
+    }
+
+    UINT nSide = ( UINT )sqrtf( MAX_PARTICLES ) + 1;
+    UINT nBodies = nSide * nSide;
+    UINT nThreads = 0;
+    UINT nSteps = 100;
+    float fTheta = 0.5f;
+    NBODY_SOLVER Solver = NBODY_BARNES_HUT;
+    LPCWSTR strOutput = NULL;
+    ParseCPUArgs( nArgs, pstrArgs, &nBodies, &nThreads, &nSteps, &fTheta );
+    for( int i = 0; i < nArgs; i++ )
+    {
+        if( 0 == _wcsicmp( pstrArgs[i], L"-allpairs" ) )
+            Solver = NBODY_ALL_PAIRS;
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-out" ) && i + 1 < nArgs )
+            strOutput = pstrArgs[++i];
+    }
+
+    D3DXVECTOR4* pState = new D3DXVECTOR4[ 2 * ( SIZE_T )nBodies ];
+    CNBodyCPU CPU;
+    NBODY_PARAMS Params = { g_fGConstant, g_fParticleMass, g_fParticleRad / 10.0f, fTheta };
+    if( !pState || FAILED( CPU.Create( nBodies, Params, nThreads ) ) )
+    {
+        SAFE_DELETE_ARRAY( pState );
+        wprintf( L"Out of memory\n" );
+        return 1;
+    }
+
+    srand( 1 );
+    SeedGalaxies( pState, pState + nBodies, nBodies );
+    CPU.SetState( pState, pState + nBodies );
+
+    LARGE_INTEGER Frequency, Start, End;
+    QueryPerformanceFrequency( &Frequency );
+    double fBuildTime = 0.0, fForceTime = 0.0;
+    QueryPerformanceCounter( &Start );
+    for( UINT iStep = 0; iStep < nSteps; iStep++ )
+    {
+        CPU.Step( SIMULATION_SPEED, Solver );
+        fBuildTime += CPU.GetBuildTime();
+        fForceTime += CPU.GetForceTime();
+    }
+    QueryPerformanceCounter( &End );
+
+    wprintf( L"%u bodies, %u steps of %s on %u threads\n", nBodies, nSteps,
+             Solver == NBODY_ALL_PAIRS ? L"all pairs" : L"Barnes-Hut", CPU.GetNumThreads() );
+    wprintf( L"ms a step: %.3f build, %.3f forces, %.3f in all\n", fBuildTime / nSteps, fForceTime / nSteps,
+             ( End.QuadPart - Start.QuadPart ) * 1000.0 / Frequency.QuadPart / nSteps );
+
+    INT nResult = 0;
+    if( strOutput )
+    {
+        CPU.GetState( pState, pState + nBodies );
+
+        FILE* pFile = NULL;
+        bool bWritten = false;
+        if( 0 == _wfopen_s( &pFile, strOutput, L"wb" ) && pFile )
+        {
+            bWritten = fwrite( pState, sizeof( D3DXVECTOR4 ), 2 * ( SIZE_T )nBodies, pFile ) == 2 * ( SIZE_T )nBodies;
+            bWritten = ( 0 == fclose( pFile ) ) && bWritten;
+        }
+        if( bWritten )
+        {
+            wprintf( L"Wrote %s\n", strOutput );
+        }
+        else
+        {
+            wprintf( L"Could not write %s\n", strOutput );
+            nResult = 1;
+        }
+    }
+
+    SAFE_DELETE_ARRAY( pState );
+    return nResult;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Relative RMS and largest differences of forces pTest from forces pReference, both
+// relative to the RMS reference force
+//--------------------------------------------------------------------------------------
+void CompareForces( const D3DXVECTOR4* pReference, const D3DXVECTOR4* pTest, UINT nBodies, double* pfRMS,
+                    double* pfMax )
+{
+    double fErrorSq = 0.0, fReferenceSq = 0.0, fMaxErrorSq = 0.0;
+    for( UINT i = 0; i < nBodies; i++ )
+    {
+        const double dx = pTest[i].x - pReference[i].x;
+        const double dy = pTest[i].y - pReference[i].y;
+        const double dz = pTest[i].z - pReference[i].z;
+        const double fSq = dx * dx + dy * dy + dz * dz;
+        fErrorSq += fSq;
+        fMaxErrorSq = __max( fMaxErrorSq, fSq );
+        fReferenceSq += ( double )pReference[i].x * pReference[i].x + ( double )pReference[i].y * pReference[i].y +
+                        ( double )pReference[i].z * pReference[i].z;
+    }
+
+    const double fReference = sqrt( __max( fReferenceSq, 1e-30 ) / nBodies );
+    *pfRMS = sqrt( fErrorSq / nBodies ) / fReference;
+    *pfMax = sqrt( fMaxErrorSq ) / fReference;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Headless scaling benchmark of the CPU solvers:
+//
+//   NBodyGravity -cpubench [-bodies N] [-threads N] [-steps N] [-theta f]
+//                          [-allpairsmax N]
+//
+// For 4096 bodies and every four times as many up to -bodies (1048576 by default), seeded
+// as the sample seeds them, times -steps steps (3 by default) of Barnes-Hut at opening
+// angle -theta (0.5 by default) and one sum of all pairs, up to -allpairsmax bodies
+// (65536 by default), on 1, 2, 4 ... threads up to -threads (one per processor by
+// default).  Checks the SSE kernel against the scalar one at 4096 bodies and prints how
+// far Barnes-Hut is from all pairs.
+// Returns 0 on success, 1 if the SSE kernel is off or something failed.
+//--------------------------------------------------------------------------------------
+INT RunCPUBenchmark( int nArgs, LPWSTR* pstrArgs )
+{
+    // Report to the console we were started from, if any
+    if( AttachConsole( ATTACH_PARENT_PROCESS ) )
+    {
+        FILE* pFile;
+        freopen_s( &pFile, "CONOUT$", "w", stdout );
+    }
+
+    UINT nMaxBodies = 1048576;
+    UINT nMaxThreads = 0;
+    UINT nSteps = 3;
+    UINT nAllPairsMax = 65536;
+    float fTheta = 0.5f;
+    ParseCPUArgs( nArgs, pstrArgs, &nMaxBodies, &nMaxThreads, &nSteps, &fTheta );
+    for( int i = 0; i + 1 < nArgs; i++ )
+    {
+        if( 0 == _wcsicmp( pstrArgs[i], L"-allpairsmax" ) )
+        {
+            int nValue = _wtoi( pstrArgs[++i] );
+            nAllPairsMax = nValue > 0 ? nValue : 0;
+        }
+    }
+    if( 0 == nMaxThreads )
+    {
+        SYSTEM_INFO SystemInfo;
+        GetSystemInfo( &SystemInfo );
+        nMaxThreads = SystemInfo.dwNumberOfProcessors;
+    }
+    nMaxThreads = __min( nMaxThreads, ( UINT )NBODY_MAX_THREADS );
+
+    UINT aThreads[NBODY_MAX_THREADS];
+    UINT nThreadCounts = 0;
+    for( UINT n = 1; n < nMaxThreads; n *= 2 )
+        aThreads[nThreadCounts++] = n;
+    aThreads[nThreadCounts++] = nMaxThreads;
+
+    const NBODY_PARAMS Params = { g_fGConstant, g_fParticleMass, g_fParticleRad / 10.0f, fTheta };
+    INT nResult = 0;
+
+    wprintf( L"%u steps of Barnes-Hut at theta %.2f; one sum of all pairs\n\n", nSteps, fTheta );
+    wprintf( L"%8s %7s %12s %10s %10s %10s %10s %8s %9s %9s\n", L"bodies", L"threads", L"all pairs ms",
+             L"Gpairs/s", L"build ms", L"BH ms", L"Mpairs/s", L"speedup", L"BH RMS %", L"BH max %" );
+
+    for( UINT nBodies = __min( 4096u, nMaxBodies ); nBodies <= nMaxBodies && 0 == nResult; nBodies *= 4 )
+    {
+        D3DXVECTOR4* pState = new D3DXVECTOR4[ 2 * ( SIZE_T )nBodies ];
+        D3DXVECTOR4* pForces = new D3DXVECTOR4[ nBodies ];
+        if( !pState || !pForces )
+        {
+            SAFE_DELETE_ARRAY( pState );
+            SAFE_DELETE_ARRAY( pForces );
+            wprintf( L"Out of memory\n" );
+            nResult = 1;
+            break;
+        }
+        srand( 1 );
+        SeedGalaxies( pState, pState + nBodies, nBodies );
+        const bool bAllPairs = nBodies <= nAllPairsMax;
+        const bool bCheckSSE = bAllPairs && nBodies <= 4096;
+
+        // The scalar forces to check the SSE kernel against.  Barnes-Hut is checked against
+        // these, or against the first all pairs run when they are not summed.
+        if( bCheckSSE )
+        {
+            CNBodyCPU CPU;
+            if( FAILED( CPU.Create( nBodies, Params, nMaxThreads, NBODY_SCALAR ) ) )
+            {
+                nResult = 1;
+            }
+            else
+            {
+                CPU.SetState( pState, pState + nBodies );
+                CPU.ComputeForces( NBODY_ALL_PAIRS );
+                memcpy( pForces, CPU.GetForces(), nBodies * sizeof( D3DXVECTOR4 ) );
+            }
+        }
+
+        double fOneThreadTime = 0.0;
+        for( UINT iThreads = 0; iThreads < nThreadCounts && 0 == nResult; iThreads++ )
+        {
+            CNBodyCPU CPU;
+            if( FAILED( CPU.Create( nBodies, Params, aThreads[iThreads] ) ) )
+            {
+                wprintf( L"Out of memory\n" );
+                nResult = 1;
+                break;
+            }
+
+            double fAllPairsTime = 0.0;
+            ULONGLONG nAllPairs = 0;
+            double fRMS = 0.0, fMax = 0.0;
+            if( bAllPairs )
+            {
+                CPU.SetState( pState, pState + nBodies );
+                CPU.ComputeForces( NBODY_ALL_PAIRS );
+                fAllPairsTime = CPU.GetBuildTime() + CPU.GetForceTime();
+                nAllPairs = CPU.GetNumInteractions();
+
+                if( bCheckSSE )
+                {
+                    double fSSERMS, fSSEMax;
+                    CompareForces( pForces, CPU.GetForces(), nBodies, &fSSERMS, &fSSEMax );
+                    if( fSSEMax > 1e-4 )
+                    {
+                        wprintf( L"The SSE kernel is off the scalar one by %g\n", fSSEMax );
+                        nResult = 1;
+                    }
+                }
+                else if( 0 == iThreads )
+                {
+                    memcpy( pForces, CPU.GetForces(), nBodies * sizeof( D3DXVECTOR4 ) );
+                }
+
+                CPU.ComputeForces( NBODY_BARNES_HUT );
+                CompareForces( pForces, CPU.GetForces(), nBodies, &fRMS, &fMax );
+            }
+
+            CPU.SetState( pState, pState + nBodies );
+            double fBuildTime = 0.0, fForceTime = 0.0;
+            ULONGLONG nPairs = 0;
+            for( UINT iStep = 0; iStep < nSteps; iStep++ )
+            {
+                CPU.Step( SIMULATION_SPEED, NBODY_BARNES_HUT );
+                fBuildTime += CPU.GetBuildTime() / nSteps;
+                fForceTime += CPU.GetForceTime() / nSteps;
+                nPairs += CPU.GetNumInteractions() / nSteps;
+            }
+            if( 0 == iThreads )
+                fOneThreadTime = fBuildTime + fForceTime;
+
+            if( bAllPairs )
+                wprintf( L"%8u %7u %12.2f %10.3f ", nBodies, CPU.GetNumThreads(), fAllPairsTime,
+                         nAllPairs / ( fAllPairsTime * 1e6 ) );
+            else
+                wprintf( L"%8u %7u %12s %10s ", nBodies, CPU.GetNumThreads(), L"-", L"-" );
+            wprintf( L"%10.2f %10.2f %10.1f %7.2fx ", fBuildTime, fForceTime, nPairs / ( fForceTime * 1e3 ),
+                     fOneThreadTime / ( fBuildTime + fForceTime ) );
+            if( bAllPairs )
+                wprintf( L"%9.4f %9.4f\n", 100.0 * fRMS, 100.0 * fMax );
+            else
+                wprintf( L"%9s %9s\n", L"-", L"-" );
+        }
+
+        SAFE_DELETE_ARRAY( pState );
+        SAFE_DELETE_ARRAY( pForces );
+
+        if( nBodies > 0xFFFFFFFF / 4 )
+            break;
+    }
+
+    return nResult;
+}
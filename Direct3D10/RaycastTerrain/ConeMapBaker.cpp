@@ -0,0 +1,593 @@
+//--------------------------------------------------------------------------------------
+// File: ConeMapBaker.cpp
+//
+// Cone step map baking for the RaycastTerrain sample.
+//
+// For an explanation of the cone-step mapping technique see
+// www.lonesock.net/files/ConeStepMapping.pdf
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "ConeMapBaker.h"
+#include "DXUTWorkerPool.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define CONEMAP_SSE
+#endif
+
+// Blocks whose bound is within this factor of the best ratio are still searched, so
+// rounding in the bound never skips a texel the brute force search would count
+#define CONEMAP_BOUND_SLACK         0.9999f
+
+// Allowance for rounding in the ray height when bounding relaxed cones
+#define CONEMAP_RELAXED_MARGIN      0.000001f
+
+
+//--------------------------------------------------------------------------------------
+CConeMapBaker::CConeMapBaker() : m_Width( 0 ),
+                                 m_Height( 0 ),
+                                 m_nLevels( 0 ),
+                                 m_fInvWidth( 0 ),
+                                 m_fInvHeight( 0 )
+{
+    ZeroMemory( m_pLevels, sizeof( m_pLevels ) );
+}
+
+
+//--------------------------------------------------------------------------------------
+CConeMapBaker::~CConeMapBaker()
+{
+    for( int i = 0; i < m_nLevels; i++ )
+        SAFE_DELETE_ARRAY( m_pLevels[i] );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Copies the heights and builds the max-mip pyramid above them.  The pyramid always
+// reaches the leaf level, and continues until a single block covers the map.
+//--------------------------------------------------------------------------------------
+HRESULT CConeMapBaker::SetHeightMap( const float* pHeights, int Width, int Height )
+{
+    if( !pHeights || Width <= 0 || Height <= 0 )
+        return E_INVALIDARG;
+
+    for( int i = 0; i < m_nLevels; i++ )
+        SAFE_DELETE_ARRAY( m_pLevels[i] );
+    m_nLevels = 0;
+
+    m_Width = Width;
+    m_Height = Height;
+    m_fInvWidth = 1.0f / ( float )Width;
+    m_fInvHeight = 1.0f / ( float )Height;
+
+    m_pLevels[0] = new float[ Width * Height ];
+    if( !m_pLevels[0] )
+        return E_OUTOFMEMORY;
+    memcpy( m_pLevels[0], pHeights, sizeof( float ) * Width * Height );
+    m_LevelWidth[0] = Width;
+    m_LevelHeight[0] = Height;
+    m_nLevels = 1;
+
+    while( m_LevelWidth[m_nLevels - 1] > 1 || m_LevelHeight[m_nLevels - 1] > 1 || m_nLevels <= CONEMAP_LEAF_LEVEL )
+    {
+        const int SrcWidth = m_LevelWidth[m_nLevels - 1];
+        const int SrcHeight = m_LevelHeight[m_nLevels - 1];
+        const float* pSrc = m_pLevels[m_nLevels - 1];
+        const int DstWidth = ( SrcWidth + 1 ) / 2;
+        const int DstHeight = ( SrcHeight + 1 ) / 2;
+
+        float* pDst = new float[ DstWidth * DstHeight ];
+        if( !pDst )
+            return E_OUTOFMEMORY;
+
+        for( int y = 0; y < DstHeight; y++ )
+        {
+            const int y0 = y * 2;
+            const int y1 = min( y0 + 1, SrcHeight - 1 );
+            for( int x = 0; x < DstWidth; x++ )
+            {
+                const int x0 = x * 2;
+                const int x1 = min( x0 + 1, SrcWidth - 1 );
+                float fMax = pSrc[ y0 * SrcWidth + x0 ];
+                fMax = max( fMax, pSrc[ y0 * SrcWidth + x1 ] );
+                fMax = max( fMax, pSrc[ y1 * SrcWidth + x0 ] );
+                fMax = max( fMax, pSrc[ y1 * SrcWidth + x1 ] );
+                pDst[ y * DstWidth + x ] = fMax;
+            }
+        }
+
+        m_pLevels[m_nLevels] = pDst;
+        m_LevelWidth[m_nLevels] = DstWidth;
+        m_LevelHeight[m_nLevels] = DstHeight;
+        m_nLevels++;
+    }
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// The search works with the smallest radius^2 / height^2 found.  Anything at or above 1
+// bakes to a ratio of 1, so 1 is also where every search starts.
+//--------------------------------------------------------------------------------------
+float CConeMapBaker::ToConeRatio( float fMinRatioSq ) const
+{
+    return min( 1.0f, sqrtf( sqrtf( fMinRatioSq ) ) );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Relaxed cone term for the texel pair (s,t).  A ray is cast from the top of the
+// volume above s through the surface at t and followed until it leaves the surface.
+// The cone at s may not contain that exit point.
+//
+// Along the ray the distance from s only grows and the height above s only shrinks,
+// so once the ratio at the ray reaches fBest the exit cannot narrow the cone and the
+// march stops early.
+//--------------------------------------------------------------------------------------
+float CConeMapBaker::RelaxedTerm( int sx, int sy, float fStartHeight, int tx, int ty, float fTestHeight,
+                                  float fBest ) const
+{
+    const int dx = tx - sx;
+    const int dy = ty - sy;
+    const int nSteps = max( abs( dx ), abs( dy ) );
+    const float fStepX = dx / ( float )nSteps;
+    const float fStepY = dy / ( float )nSteps;
+    const float fDrop = ( 1.0f - fTestHeight ) / ( float )nSteps;
+    const float* pHeights = m_pLevels[0];
+
+    float fX = ( float )tx;
+    float fY = ( float )ty;
+    float fRay = fTestHeight;
+
+    // Each step moves a whole texel along the major axis, so the ray leaves the map
+    // after at most Width + Height steps
+    for( ; ; )
+    {
+        fX += fStepX;
+        fY += fStepY;
+        fRay -= fDrop;
+
+        // Below the start height the exit can no longer narrow the cone
+        if( fRay - fStartHeight <= CONEMAP_HEIGHT_EPSILON )
+            return fBest;
+
+        const float fExitX = ( fX - sx ) * m_fInvWidth;
+        const float fExitY = ( fY - sy ) * m_fInvHeight;
+        const float fDelta = fRay - fStartHeight;
+        const float fRatio = ( fExitX * fExitX + fExitY * fExitY ) / ( fDelta * fDelta );
+        if( fRatio >= fBest )
+            return fBest;
+
+        const int ix = ( int )floorf( fX + 0.5f );
+        const int iy = ( int )floorf( fY + 0.5f );
+        if( ix < 0 || iy < 0 || ix >= m_Width || iy >= m_Height || pHeights[ iy * m_Width + ix ] <= fRay )
+            return fRatio;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Tests every texel of leaf block (bx,by) against the start texel and returns the new
+// best ratio.  Flat or lower texels, including the start texel itself, never count.
+//--------------------------------------------------------------------------------------
+float CConeMapBaker::SearchLeaf( int sx, int sy, float fStartHeight, int bx, int by, float fBest,
+                                 DWORD dwFlags ) const
+{
+    const int x0 = bx * CONEMAP_LEAF_SIZE;
+    const int x1 = min( x0 + CONEMAP_LEAF_SIZE, m_Width );
+    const int y0 = by * CONEMAP_LEAF_SIZE;
+    const int y1 = min( y0 + CONEMAP_LEAF_SIZE, m_Height );
+    const bool bRelaxed = ( dwFlags & CONEMAP_RELAXED ) != 0;
+
+    for( int y = y0; y < y1; y++ )
+    {
+        const float* pRow = m_pLevels[0] + y * m_Width;
+        const float fDeltaY = ( float )( sy - y ) * m_fInvHeight;
+        const float fDeltaYSq = fDeltaY * fDeltaY;
+        int x = x0;
+
+#ifdef CONEMAP_SSE
+        const __m128 vStartHeight = _mm_set1_ps( fStartHeight );
+        const __m128 vEpsilon = _mm_set1_ps( CONEMAP_HEIGHT_EPSILON );
+        const __m128 vInvWidth = _mm_set1_ps( m_fInvWidth );
+        const __m128 vDeltaYSq = _mm_set1_ps( fDeltaYSq );
+        const __m128 vOne = _mm_set1_ps( 1.0f );
+        const __m128i vLane = _mm_set_epi32( 3, 2, 1, 0 );
+        __m128 vBest = _mm_set1_ps( fBest );
+
+        for( ; x + 4 <= x1; x += 4 )
+        {
+            __m128 vDelta = _mm_sub_ps( _mm_loadu_ps( pRow + x ), vStartHeight );
+            __m128 vValid = _mm_cmpgt_ps( vDelta, vEpsilon );
+            if( 0 == _mm_movemask_ps( vValid ) )
+                continue;
+
+            __m128i vX = _mm_add_epi32( _mm_set1_epi32( x ), vLane );
+            __m128 vDeltaX = _mm_mul_ps( _mm_cvtepi32_ps( _mm_sub_epi32( _mm_set1_epi32( sx ), vX ) ), vInvWidth );
+            __m128 vRadiusSq = _mm_add_ps( _mm_mul_ps( vDeltaX, vDeltaX ), vDeltaYSq );
+            __m128 vRatio = _mm_div_ps( vRadiusSq, _mm_mul_ps( vDelta, vDelta ) );
+            vRatio = _mm_or_ps( _mm_and_ps( vValid, vRatio ), _mm_andnot_ps( vValid, vOne ) );
+
+            if( !bRelaxed )
+            {
+                vBest = _mm_min_ps( vBest, vRatio );
+                continue;
+            }
+
+            // The cone term bounds the relaxed term from below, so only texels that
+            // pass it need a ray cast
+            int nCandidates = _mm_movemask_ps( _mm_cmplt_ps( vRatio, vBest ) );
+            while( nCandidates )
+            {
+                int iLane = 0;
+                while( 0 == ( nCandidates & ( 1 << iLane ) ) )
+                    iLane++;
+                nCandidates &= ~( 1 << iLane );
+
+                fBest = RelaxedTerm( sx, sy, fStartHeight, x + iLane, y, pRow[x + iLane], _mm_cvtss_f32( vBest ) );
+                vBest = _mm_set1_ps( fBest );
+            }
+        }
+
+        vBest = _mm_min_ps( vBest, _mm_shuffle_ps( vBest, vBest, _MM_SHUFFLE( 1, 0, 3, 2 ) ) );
+        vBest = _mm_min_ps( vBest, _mm_shuffle_ps( vBest, vBest, _MM_SHUFFLE( 2, 3, 0, 1 ) ) );
+        fBest = _mm_cvtss_f32( vBest );
+#endif
+
+        for( ; x < x1; x++ )
+        {
+            const float fDelta = pRow[x] - fStartHeight;
+            if( fDelta <= CONEMAP_HEIGHT_EPSILON )
+                continue;
+
+            const float fDeltaX = ( float )( sx - x ) * m_fInvWidth;
+            const float fRatio = ( fDeltaX * fDeltaX + fDeltaYSq ) / ( fDelta * fDelta );
+            if( fRatio >= fBest )
+                continue;
+
+            fBest = bRelaxed ? RelaxedTerm( sx, sy, fStartHeight, x, y, pRow[x], fBest ) : fRatio;
+        }
+    }
+
+    return fBest;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Walks the pyramid from the top, nearest blocks first.  A block is skipped when it is
+// no higher than the start texel, or when even its closest point at its highest height
+// could not narrow the cone further.  Relaxed rays must drop below the block before
+// they leave it, which tightens the bound; near blocks mostly drop out entirely.
+//--------------------------------------------------------------------------------------
+float CConeMapBaker::GetConeRatio( int sx, int sy, DWORD dwFlags ) const
+{
+    struct NODE
+    {
+        int nLevel;
+        int bx;
+        int by;
+        float fDistSq;
+        int nFarthest;          // Furthest texel of the block from the start texel, in steps
+    };
+
+    const float fStartHeight = m_pLevels[0][ sy * m_Width + sx ];
+    const bool bRelaxed = ( dwFlags & CONEMAP_RELAXED ) != 0;
+    float fBest = 1.0f;
+
+    NODE Stack[ 4 * 32 ];
+    int nStack = 0;
+    NODE Top = { m_nLevels - 1, 0, 0, 0.0f, max( max( sx, m_Width - 1 - sx ), max( sy, m_Height - 1 - sy ) ) };
+    Stack[nStack++] = Top;
+
+    while( nStack > 0 )
+    {
+        const NODE Node = Stack[--nStack];
+
+        const float fMax = m_pLevels[Node.nLevel][ Node.by * m_LevelWidth[Node.nLevel] + Node.bx ];
+        float fDelta = fMax - fStartHeight;
+        if( fDelta <= CONEMAP_HEIGHT_EPSILON )
+            continue;
+
+        // A relaxed ray drops at least ( 1 - h ) / n before it can leave the surface, and
+        // no later exit is any closer or any higher
+        if( bRelaxed )
+        {
+            if( 0 == Node.nFarthest )
+                continue;
+            fDelta -= ( 1.0f - fMax ) / ( float )Node.nFarthest - CONEMAP_RELAXED_MARGIN;
+            if( fDelta <= CONEMAP_HEIGHT_EPSILON )
+                continue;
+        }
+        if( Node.fDistSq * CONEMAP_BOUND_SLACK >= fBest * fDelta * fDelta )
+            continue;
+
+        if( Node.nLevel == CONEMAP_LEAF_LEVEL )
+        {
+            fBest = SearchLeaf( sx, sy, fStartHeight, Node.bx, Node.by, fBest, dwFlags );
+            continue;
+        }
+
+        // Gather the children with the distance from the start texel to each
+        const int nChildLevel = Node.nLevel - 1;
+        NODE Children[4];
+        int nChildren = 0;
+        for( int cy = Node.by * 2; cy <= Node.by * 2 + 1 && cy < m_LevelHeight[nChildLevel]; cy++ )
+        {
+            const int ty0 = cy << nChildLevel;
+            const int ty1 = min( ( cy + 1 ) << nChildLevel, m_Height ) - 1;
+            const int GapY = ( sy < ty0 ) ? ty0 - sy : ( ( sy > ty1 ) ? sy - ty1 : 0 );
+            const int FarY = max( abs( sy - ty0 ), abs( sy - ty1 ) );
+            const float fGapY = GapY * m_fInvHeight;
+
+            for( int cx = Node.bx * 2; cx <= Node.bx * 2 + 1 && cx < m_LevelWidth[nChildLevel]; cx++ )
+            {
+                const int tx0 = cx << nChildLevel;
+                const int tx1 = min( ( cx + 1 ) << nChildLevel, m_Width ) - 1;
+                const int GapX = ( sx < tx0 ) ? tx0 - sx : ( ( sx > tx1 ) ? sx - tx1 : 0 );
+                const int FarX = max( abs( sx - tx0 ), abs( sx - tx1 ) );
+                const float fGapX = GapX * m_fInvWidth;
+
+                NODE Child = { nChildLevel, cx, cy, fGapX * fGapX + fGapY * fGapY, max( FarX, FarY ) };
+
+                // Insertion sort, farthest first so the nearest is popped first
+                int i = nChildren++;
+                while( i > 0 && Children[i - 1].fDistSq < Child.fDistSq )
+                {
+                    Children[i] = Children[i - 1];
+                    i--;
+                }
+                Children[i] = Child;
+            }
+        }
+
+        for( int i = 0; i < nChildren; i++ )
+            Stack[nStack++] = Children[i];
+    }
+
+    return ToConeRatio( fBest );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Reference search over every texel.  Gives the same result as GetConeRatio.
+//--------------------------------------------------------------------------------------
+float CConeMapBaker::GetConeRatioBruteForce( int sx, int sy, DWORD dwFlags ) const
+{
+    const float* pHeights = m_pLevels[0];
+    const float fStartHeight = pHeights[ sy * m_Width + sx ];
+    float fBest = 1.0f;
+
+    for( int y = 0; y < m_Height; y++ )
+    {
+        const float fDeltaY = ( float )( sy - y ) * m_fInvHeight;
+        const float fDeltaYSq = fDeltaY * fDeltaY;
+        for( int x = 0; x < m_Width; x++ )
+        {
+            const float fDelta = pHeights[ y * m_Width + x ] - fStartHeight;
+            if( fDelta <= CONEMAP_HEIGHT_EPSILON )
+                continue;
+
+            if( dwFlags & CONEMAP_RELAXED )
+            {
+                fBest = RelaxedTerm( sx, sy, fStartHeight, x, y, pHeights[ y * m_Width + x ], fBest );
+            }
+            else
+            {
+                const float fDeltaX = ( float )( sx - x ) * m_fInvWidth;
+                fBest = min( fBest, ( fDeltaX * fDeltaX + fDeltaYSq ) / ( fDelta * fDelta ) );
+            }
+        }
+    }
+
+    return ToConeRatio( fBest );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Bakes one row.  Each row is written by one thread, so the map is the same on any
+// number of them.
+//--------------------------------------------------------------------------------------
+void CConeMapBaker::BakeRowProc( void* pContext, UINT iRow, UINT iThread )
+{
+    UNREFERENCED_PARAMETER( iThread );
+    const BAKE_JOB* pJob = ( const BAKE_JOB* )pContext;
+    const CConeMapBaker* pBaker = pJob->pBaker;
+
+    const int y = ( int )iRow;
+    float* pRow = pJob->pConeRatios + y * pBaker->m_Width;
+    for( int x = 0; x < pBaker->m_Width; x++ )
+        pRow[x] = pBaker->GetConeRatio( x, y, pJob->dwFlags );
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CConeMapBaker::Bake( float* pConeRatios, DWORD dwFlags, UINT nThreads )
+{
+    if( !pConeRatios || m_nLevels == 0 )
+        return E_INVALIDARG;
+
+    BAKE_JOB Job = { this, pConeRatios, dwFlags };
+    DXUTGetWorkerPool()->Run( BakeRowProc, &Job, ( UINT )m_Height, nThreads );
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Reads the first channel of an uncompressed 8, 24 or 32 bit BMP.  Rows are kept in
+// file order, which is what the sample has always baked from.
+//--------------------------------------------------------------------------------------
+HRESULT CConeMapBaker::LoadBMP( LPCWSTR strFileName, float** ppHeights, int* pWidth, int* pHeight )
+{
+    *ppHeights = NULL;
+
+    HANDLE hFile = CreateFile( strFileName, FILE_READ_DATA, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                               FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+    if( INVALID_HANDLE_VALUE == hFile )
+        return E_INVALIDARG;
+
+    HRESULT hr = E_FAIL;
+    DWORD dwBytesRead = 0;
+    BYTE* pBits = NULL;
+    float* pHeights = NULL;
+
+    BITMAPFILEHEADER bfh;
+    BITMAPINFOHEADER bih;
+    if( !ReadFile( hFile, &bfh, sizeof( BITMAPFILEHEADER ), &dwBytesRead, NULL ) ||
+        dwBytesRead != sizeof( BITMAPFILEHEADER ) ||
+        !ReadFile( hFile, &bih, sizeof( BITMAPINFOHEADER ), &dwBytesRead, NULL ) ||
+        dwBytesRead != sizeof( BITMAPINFOHEADER ) )
+        goto Error;
+
+    if( bih.biCompression != BI_RGB || bih.biWidth <= 0 || bih.biHeight == 0 ||
+        ( bih.biBitCount != 8 && bih.biBitCount != 24 && bih.biBitCount != 32 ) )
+        goto Error;
+
+    {
+        const int Width = bih.biWidth;
+        const int Height = abs( bih.biHeight );
+        const int iStep = bih.biBitCount / 8;
+        const DWORD dwPitch = ( ( Width * bih.biBitCount + 31 ) & ~31 ) / 8;
+        const DWORD dwSize = dwPitch * Height;
+
+        LARGE_INTEGER liMove;
+        liMove.QuadPart = bfh.bfOffBits;
+        if( !SetFilePointerEx( hFile, liMove, NULL, FILE_BEGIN ) )
+            goto Error;
+
+        pBits = new BYTE[ dwSize ];
+        pHeights = new float[ Width * Height ];
+        if( !pBits || !pHeights )
+        {
+            hr = E_OUTOFMEMORY;
+            goto Error;
+        }
+
+        if( !ReadFile( hFile, pBits, dwSize, &dwBytesRead, NULL ) || dwBytesRead != dwSize )
+            goto Error;
+
+        for( int y = 0; y < Height; y++ )
+        {
+            const BYTE* pRow = pBits + y * dwPitch;
+            for( int x = 0; x < Width; x++ )
+                pHeights[ y * Width + x ] = pRow[ x * iStep ] / 255.0f;
+        }
+
+        *ppHeights = pHeights;
+        *pWidth = Width;
+        *pHeight = Height;
+        pHeights = NULL;
+        hr = S_OK;
+    }
+
+Error:
+    CloseHandle( hFile );
+    SAFE_DELETE_ARRAY( pBits );
+    SAFE_DELETE_ARRAY( pHeights );
+    return hr;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CConeMapBaker::LoadRAW( LPCWSTR strFileName, int Width, int Height, UINT nBytesPerTexel,
+                                float** ppHeights )
+{
+    *ppHeights = NULL;
+    if( Width <= 0 || Height <= 0 || ( nBytesPerTexel != 1 && nBytesPerTexel != 2 ) )
+        return E_INVALIDARG;
+
+    HANDLE hFile = CreateFile( strFileName, FILE_READ_DATA, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                               FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+    if( INVALID_HANDLE_VALUE == hFile )
+        return E_INVALIDARG;
+
+    const DWORD dwSize = Width * Height * nBytesPerTexel;
+    BYTE* pBits = new BYTE[ dwSize ];
+    float* pHeights = new float[ Width * Height ];
+    DWORD dwBytesRead = 0;
+    HRESULT hr = S_OK;
+
+    if( !pBits || !pHeights )
+        hr = E_OUTOFMEMORY;
+    else if( !ReadFile( hFile, pBits, dwSize, &dwBytesRead, NULL ) || dwBytesRead != dwSize )
+        hr = E_FAIL;
+    CloseHandle( hFile );
+
+    if( SUCCEEDED( hr ) )
+    {
+        for( int i = 0; i < Width * Height; i++ )
+        {
+            if( 1 == nBytesPerTexel )
+                pHeights[i] = pBits[i] / 255.0f;
+            else
+                pHeights[i] = ( pBits[ i * 2 ] | ( pBits[ i * 2 + 1 ] << 8 ) ) / 65535.0f;
+        }
+        *ppHeights = pHeights;
+        pHeights = NULL;
+    }
+
+    SAFE_DELETE_ARRAY( pBits );
+    SAFE_DELETE_ARRAY( pHeights );
+    return hr;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Writes an uncompressed DDS without needing a device.  The layout matches the
+// DDS_HEADER in the DDSWithoutD3DX sample.
+//--------------------------------------------------------------------------------------
+HRESULT CConeMapBaker::SaveDDS( LPCWSTR strFileName, const float* pHeights, const float* pConeRatios,
+                                int Width, int Height )
+{
+    DWORD Header[32];
+    ZeroMemory( Header, sizeof( Header ) );
+    Header[0] = 0x20534444;                 // "DDS "
+    Header[1] = 124;                        // dwSize
+    Header[2] = 0x0000100F;                 // DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PITCH | DDSD_PIXELFORMAT
+    Header[3] = Height;
+    Header[4] = Width;
+    Header[5] = Width * 4;                  // dwPitchOrLinearSize
+    Header[19] = 32;                        // ddspf.dwSize
+    Header[20] = 0x00000041;                // DDPF_RGB | DDPF_ALPHAPIXELS
+    Header[22] = 32;                        // ddspf.dwRGBBitCount
+    Header[23] = 0x000000ff;                // R
+    Header[24] = 0x0000ff00;                // G
+    Header[25] = 0x00ff0000;                // B
+    Header[26] = 0xff000000;                // A
+    Header[27] = 0x00001000;                // DDSCAPS_TEXTURE
+
+    BYTE* pData = new BYTE[ Width * Height * 4 ];
+    if( !pData )
+        return E_OUTOFMEMORY;
+
+    for( int i = 0; i < Width * Height; i++ )
+    {
+        pData[ i * 4     ] = ( BYTE )( pHeights[i] * 255.0f );
+        pData[ i * 4 + 1 ] = ( BYTE )( pConeRatios[i] * 255.0f );
+        pData[ i * 4 + 2 ] = 0;
+        pData[ i * 4 + 3 ] = 0;
+    }
+
+    HRESULT hr = S_OK;
+    HANDLE hFile = CreateFile( strFileName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL );
+    if( INVALID_HANDLE_VALUE == hFile )
+    {
+        hr = E_FAIL;
+    }
+    else
+    {
+        DWORD dwWritten = 0;
+        DWORD dwDataSize = Width * Height * 4;
+        if( !WriteFile( hFile, Header, sizeof( Header ), &dwWritten, NULL ) || dwWritten != sizeof( Header ) ||
+            !WriteFile( hFile, pData, dwDataSize, &dwWritten, NULL ) || dwWritten != dwDataSize )
+            hr = E_FAIL;
+        CloseHandle( hFile );
+    }
+
+    SAFE_DELETE_ARRAY( pData );
+    return hr;
+}
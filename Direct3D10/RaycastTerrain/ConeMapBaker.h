@@ -0,0 +1,91 @@
+//--------------------------------------------------------------------------------------
+// File: ConeMapBaker.h
+//
+// Builds the cone step map used by the raycast terrain.  For every texel the baker
+// finds the widest upward cone that contains no other part of the height field.
+//
+// A max-mip pyramid of the heights lets whole blocks be skipped when no texel in them
+// can narrow the cone found so far, so each texel only looks at the part of the map
+// that matters.  Blocks are visited nearest first, leaf blocks are tested four texels
+// at a time with SSE, and rows are shared out between the threads of the DXUT worker
+// pool.
+//
+// With CONEMAP_RELAXED the baker builds relaxed cones instead (Policarpo and Oliveira,
+// "Relaxed Cone Stepping for Relief Mapping", GPU Gems 3).  A relaxed cone only has to
+// keep rays from passing through the surface more than once, so it is wider, but the
+// shader must finish with a binary search.  The sample's shader does not do that
+// search, so the sample itself always bakes standard cones.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#define CONEMAP_RELAXED             0x00000001
+
+// Texels in one side of a leaf block.  Leaves are tested texel by texel.
+#define CONEMAP_LEAF_LEVEL          3
+#define CONEMAP_LEAF_SIZE           ( 1 << CONEMAP_LEAF_LEVEL )
+
+// Height differences at or below this are treated as flat
+#define CONEMAP_HEIGHT_EPSILON      0.00001f
+
+
+//--------------------------------------------------------------------------------------
+class CConeMapBaker
+{
+public:
+    CConeMapBaker();
+    ~CConeMapBaker();
+
+    // Heights are in [0,1], rows of Width texels.  The baker keeps its own copy.
+    HRESULT SetHeightMap( const float* pHeights, int Width, int Height );
+
+    int GetWidth() const { return m_Width; }
+    int GetHeight() const { return m_Height; }
+    const float* GetHeights() const { return m_pLevels[0]; }
+
+    // Fills pConeRatios (Width * Height entries) using the pyramid, on up to nThreads
+    // threads of the DXUT worker pool.  nThreads of 0 uses all of them.
+    HRESULT Bake( float* pConeRatios, DWORD dwFlags, UINT nThreads );
+
+    // One texel, using the pyramid
+    float GetConeRatio( int x, int y, DWORD dwFlags ) const;
+
+    // One texel, testing every other texel.  Used to check Bake.
+    float GetConeRatioBruteForce( int x, int y, DWORD dwFlags ) const;
+
+    // Heightmap readers.  Both allocate *ppHeights with new[].  BMPs take the first
+    // channel of 8, 24 or 32 bit images, in file row order.  RAW files are Width*Height
+    // 8 bit or little-endian 16 bit values.
+    static HRESULT LoadBMP( LPCWSTR strFileName, float** ppHeights, int* pWidth, int* pHeight );
+    static HRESULT LoadRAW( LPCWSTR strFileName, int Width, int Height, UINT nBytesPerTexel, float** ppHeights );
+
+    // Writes the terrain texture the sample loads: R8G8B8A8 with height in red and
+    // cone ratio in green
+    static HRESULT SaveDDS( LPCWSTR strFileName, const float* pHeights, const float* pConeRatios,
+                            int Width, int Height );
+
+private:
+    struct BAKE_JOB
+    {
+        CConeMapBaker* pBaker;
+        float* pConeRatios;
+        DWORD dwFlags;
+    };
+
+    static void BakeRowProc( void* pContext, UINT iRow, UINT iThread );
+
+    float SearchLeaf( int sx, int sy, float fStartHeight, int bx, int by, float fBest, DWORD dwFlags ) const;
+    float RelaxedTerm( int sx, int sy, float fStartHeight, int tx, int ty, float fTestHeight, float fBest ) const;
+    float ToConeRatio( float fMinRatioSq ) const;
+
+    int m_Width;
+    int m_Height;
+    int m_nLevels;
+    float m_fInvWidth;
+    float m_fInvHeight;
+    float* m_pLevels[32];       // Level 0 is the height map, each level above holds the max of 2x2
+    int m_LevelWidth[32];
+    int m_LevelHeight[32];
+};
@@ -15,6 +15,7 @@
 #include "SDKMesh.h"
 #include "resource.h"
 #include "Terrain.h"
+#include "ConeMapBaker.h"
 
 #define MAX_LIGHTS 1
 //--------------------------------------------------------------------------------------
@@ -200,7 +201,8 @@ void CALLBACK OnD3D10FrameRender( ID3D10Device* pd3dDevice, double fTime, float
 
 void InitApp();
 void RenderText();
-HRESULT PreprocessTerrain( ID3D10Device* pd3dDevice, WCHAR* strHeightMap, WCHAR* strMapOut );
+HRESULT PreprocessTerrain( WCHAR* strHeightMap, WCHAR* strMapOut );
+INT RunConeMapTool( int nArgs, LPWSTR* pstrArgs );
 
 
 //--------------------------------------------------------------------------------------
@@ -214,6 +216,23 @@ int WINAPI wWinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdL
     _CrtSetDbgFlag( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );
 #endif
 
+    // -bakecones runs the cone map baker without creating a window
+    int nArgs = 0;
+    LPWSTR* pstrArgs = CommandLineToArgvW( GetCommandLineW(), &nArgs );
+    if( pstrArgs )
+    {
+        for( int i = 1; i < nArgs; i++ )
+        {
+            if( 0 == _wcsicmp( pstrArgs[i], L"-bakecones" ) )
+            {
+                INT nResult = RunConeMapTool( nArgs - i - 1, pstrArgs + i + 1 );
+                LocalFree( pstrArgs );
+                return nResult;
+            }
+        }
+        LocalFree( pstrArgs );
+    }
+
     // DXUT will create and use the best device (either D3D9 or D3D10) 
     // that is available on the system depending on which D3D callbacks are set below
     DXUTGetD3D10Enumeration( false, true );
@@ -757,7 +776,7 @@ HRESULT CALLBACK OnD3D10CreateDevice( ID3D10Device* pd3dDevice, const DXGI_SURFA
         {
             WCHAR bmp[MAX_PATH];
             V_RETURN( DXUTFindDXSDKMediaFileCch( bmp, MAX_PATH, g_TerrainTiles[i].m_szTerrainTextureBMP ) );
-            V_RETURN( PreprocessTerrain( pd3dDevice, bmp, g_TerrainTiles[i].m_szTerrainTextureDDS ) );
+            V_RETURN( PreprocessTerrain( bmp, g_TerrainTiles[i].m_szTerrainTextureDDS ) );
         }
 
         // Load the height and ddx,ddy texture
@@ -1256,194 +1275,172 @@ void CALLBACK OnD3D10DestroyDevice( void* pUserContext )
 }
 
 //--------------------------------------------------------------------------------------
-// This preprocessing code isn't used in the sample, but is provided for completeness.
-// It shows one way to create the cone ratios for an input texture.
+// Builds the terrain texture from a heightmap when the sample's media does not include
+// it.  The same bake is available from the command line, see RunConeMapTool.
 //--------------------------------------------------------------------------------------
+HRESULT PreprocessTerrain( WCHAR* strHeightMap, WCHAR* strMapOut )
+{
+    HRESULT hr;
+    float* pHeights = NULL;
+    int Width = 0;
+    int Height = 0;
+    V_RETURN( CConeMapBaker::LoadBMP( strHeightMap, &pHeights, &Width, &Height ) );
 
-//--------------------------------------------------------------------------------------
-// For an explanation of the cone-step mapping technique see
-// www.lonesock.net/files/ConeStepMapping.pdf
-//--------------------------------------------------------------------------------------
+    CConeMapBaker Baker;
+    float* pConeRatios = new float[ Width * Height ];
+    if( !pConeRatios )
+        hr = E_OUTOFMEMORY;
+    else if( SUCCEEDED( hr = Baker.SetHeightMap( pHeights, Width, Height ) ) &&
+             SUCCEEDED( hr = Baker.Bake( pConeRatios, 0, 0 ) ) )
+        hr = CConeMapBaker::SaveDDS( strMapOut, pHeights, pConeRatios, Width, Height );
 
+    SAFE_DELETE_ARRAY( pHeights );
+    SAFE_DELETE_ARRAY( pConeRatios );
+    return hr;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Headless cone map baker:
+//
+//   RaycastTerrain -bakecones <in.bmp|in.raw> <out.dds> [-raw W H [-16]] [-relaxed]
+//                  [-threads N] [-verify]
+//
+// -verify checks the bake against the brute force search, over every texel for maps
+// up to 256x256 and over a sample of texels for larger ones, and reports the speedup.
+// Relaxed cones are only checked exhaustively on small maps; a 256x256 map takes
+// minutes.
+// Returns 0 on success.
 //--------------------------------------------------------------------------------------
-float GetMaxConeRatio( int StartX, int StartY, float* pBits, int Width, int Height )
+INT RunConeMapTool( int nArgs, LPWSTR* pstrArgs )
 {
-    float fMinRatio = 27.0f; // Radius / DeltaHeight
-    float fConeStartHeight = pBits[ StartY * Width + StartX ];
-    float fStartX = StartX / ( float )Width;
-    float fStartY = StartY / ( float )Height;
-    float fY = 0;
-    float fStepX = 1.0f / ( float )Width;
-    float fStepY = 1.0f / ( float )Height;
-
-    for( int y = 0; y < Height; y++ )
+    // Report to the console we were started from, if any
+    if( AttachConsole( ATTACH_PARENT_PROCESS ) )
     {
-        float fDeltaY = fStartY - fY;
-        float fX = 0;
-        for( int x = 0; x < Width; x++ )
-        {
-            if( StartX != x && StartY != y )
-            {
-                float fTestHeight = pBits[ y * Width + x ];
-                float fHeightDeltaSq = fTestHeight - fConeStartHeight;
-
-                if( fHeightDeltaSq > 0.00001f )
-                {
-                    float fDeltaX = fStartX - fX;
-                    float fRadiusToTestSq = ( fDeltaX * fDeltaX + fDeltaY * fDeltaY );
-                    fHeightDeltaSq *= fHeightDeltaSq;
-
-                    if( fHeightDeltaSq * fMinRatio > fRadiusToTestSq )
-                    {
-                        fMinRatio = fRadiusToTestSq / fHeightDeltaSq;
-                    }
-                }
-            }
-            fX += fStepX;
-        }
-        fY += fStepY;
+        FILE* pFile;
+        freopen_s( &pFile, "CONOUT$", "w", stdout );
     }
 
-    return min( 1, sqrtf( sqrtf( fMinRatio ) ) );
-}
+    if( nArgs < 2 )
+    {
+        wprintf( L"Usage: -bakecones <in.bmp|in.raw> <out.dds> [-raw W H [-16]] [-relaxed] [-threads N] [-verify]\n" );
+        return 1;
+    }
 
-//--------------------------------------------------------------------------------------
-HRESULT PreprocessTerrain( ID3D10Device* pd3dDevice, WCHAR* strHeightMap, WCHAR* strMapOut )
-{
-    HRESULT hr = S_OK;
-    HANDLE hFile = CreateFile( strHeightMap, FILE_READ_DATA, FILE_SHARE_READ, NULL, OPEN_EXISTING,
-                               FILE_FLAG_SEQUENTIAL_SCAN, NULL );
-    if( INVALID_HANDLE_VALUE == hFile )
-        return E_INVALIDARG;
-
-    DWORD dwBytesRead = 0;
-
-    // read the bfh
-    BITMAPFILEHEADER bfh;
-    ReadFile( hFile, &bfh, sizeof( BITMAPFILEHEADER ), &dwBytesRead, NULL );
-    unsigned long toBitmapData = bfh.bfOffBits;
-    unsigned long bitmapSize = bfh.bfSize;
-
-    // read the header
-    BITMAPINFOHEADER bih;
-    ReadFile( hFile, &bih, sizeof( BITMAPINFOHEADER ), &dwBytesRead, NULL );
-    if( bih.biCompression != BI_RGB )
-        goto Error;
-
-    int HeightMapX;
-    int HeightMapY;
-    float* pHeightBits;
-
-    // alloc memory
-    int U = HeightMapX = bih.biWidth;
-    int V = HeightMapY = abs( bih.biHeight );
-    pHeightBits = new float[ U * V ];
-    if( !pHeightBits )
-        return E_OUTOFMEMORY;
-
-    // find the step size
-    int iStep = 4;
-    if( 24 == bih.biBitCount )
-        iStep = 3;
-
-    // final check for size
-    int UNew = ( ( U * iStep * 8 + 31 ) & ~31 ) / ( 8 * iStep );
-    if( bitmapSize < UNew * V * iStep * sizeof( BYTE ) )
-        goto Error;
-
-    // seek
-    LARGE_INTEGER liMove;
-    liMove.QuadPart = toBitmapData;
-    if( !SetFilePointerEx( hFile, liMove, NULL, FILE_BEGIN ) )
-        goto Error;
-
-    // read in the bits
-    BYTE* pBits = new BYTE[ bitmapSize ];
-    if( !pBits )
-        return E_OUTOFMEMORY;
-    ReadFile( hFile, pBits, bitmapSize * sizeof( BYTE ), &dwBytesRead, NULL );
-
-    CloseHandle( hFile );
-
-    // Load the Height Information
-    int iHeight = 0;
-    int iBitmap = 0;
-    for( int y = 0; y < V; y++ )
+    LPCWSTR strIn = pstrArgs[0];
+    LPCWSTR strOut = pstrArgs[1];
+    bool bRaw = false;
+    bool bVerify = false;
+    int Width = 0;
+    int Height = 0;
+    UINT nBytesPerTexel = 1;
+    UINT nThreads = 0;
+    DWORD dwFlags = 0;
+
+    for( int i = 2; i < nArgs; i++ )
     {
-        iBitmap = y * UNew * iStep;
-        for( int x = 0; x < U * iStep; x += iStep )
+        if( 0 == _wcsicmp( pstrArgs[i], L"-raw" ) && i + 2 < nArgs )
         {
-            pHeightBits[iHeight] = pBits[ iBitmap ] / 255.0f;
-
-            iHeight ++;
-            iBitmap += iStep;
+            bRaw = true;
+            Width = _wtoi( pstrArgs[++i] );
+            Height = _wtoi( pstrArgs[++i] );
         }
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-16" ) )
+            nBytesPerTexel = 2;
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-relaxed" ) )
+            dwFlags |= CONEMAP_RELAXED;
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-threads" ) && i + 1 < nArgs )
+            nThreads = _wtoi( pstrArgs[++i] );
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-verify" ) )
+            bVerify = true;
     }
 
-    SAFE_DELETE_ARRAY( pBits );
-
-    // Now create the cone ratios
-    float* pConeRatios = new float[ U * V ];
-    if( !pConeRatios )
-        return E_OUTOFMEMORY;
+    HRESULT hr;
+    float* pHeights = NULL;
+    if( bRaw )
+        hr = CConeMapBaker::LoadRAW( strIn, Width, Height, nBytesPerTexel, &pHeights );
+    else
+        hr = CConeMapBaker::LoadBMP( strIn, &pHeights, &Width, &Height );
+    if( FAILED( hr ) )
+    {
+        wprintf( L"Could not read %s\n", strIn );
+        return 1;
+    }
 
-    WCHAR str[100];
-    int index = 0;
-    for( int y = 0; y < V; y++ )
+    CConeMapBaker Baker;
+    float* pConeRatios = new float[ Width * Height ];
+    if( FAILED( Baker.SetHeightMap( pHeights, Width, Height ) ) )
     {
-        for( int x = 0; x < U; x++ )
-        {
-            pConeRatios[index] = GetMaxConeRatio( x, y, pHeightBits, U, V );
-            index ++;
-        }
-        swprintf_s( str, 100, L"Line: %d\n", y );
-        OutputDebugString( str );
+        wprintf( L"Invalid height map\n" );
+        SAFE_DELETE_ARRAY( pHeights );
+        SAFE_DELETE_ARRAY( pConeRatios );
+        return 1;
     }
 
-    // Put it all into one texture
-    D3D10_TEXTURE2D_DESC Desc;
-    Desc.Width = U;
-    Desc.Height = V;
-    Desc.MipLevels = 1;
-    Desc.ArraySize = 1;
-    Desc.Format = DXGI_FORMAT_R8G8B8A8_UNORM;
-    Desc.SampleDesc.Count = 1;
-    Desc.SampleDesc.Quality = 0;
-    Desc.Usage = D3D10_USAGE_IMMUTABLE;
-    Desc.BindFlags = D3D10_BIND_SHADER_RESOURCE;
-    Desc.CPUAccessFlags = 0;
-    Desc.MiscFlags = 0;
+    LARGE_INTEGER qwFreq, qwStart, qwEnd;
+    QueryPerformanceFrequency( &qwFreq );
 
-    D3D10_SUBRESOURCE_DATA InitData;
-    BYTE* pSysData = new BYTE[ U * V * 4 ];
-    InitData.pSysMem = pSysData;
-    InitData.SysMemPitch = V * 4;
+    QueryPerformanceCounter( &qwStart );
+    Baker.Bake( pConeRatios, dwFlags, nThreads );
+    QueryPerformanceCounter( &qwEnd );
+    double fBakeMs = 1000.0 * ( qwEnd.QuadPart - qwStart.QuadPart ) / qwFreq.QuadPart;
+    wprintf( L"%dx%d %s cones baked in %.1f ms\n", Width, Height,
+             ( dwFlags & CONEMAP_RELAXED ) ? L"relaxed" : L"standard", fBakeMs );
 
-    index = 0;
-    for( int i = 0; i < U * V * 4; i += 4 )
+    INT nResult = 0;
+    if( FAILED( CConeMapBaker::SaveDDS( strOut, pHeights, pConeRatios, Width, Height ) ) )
     {
-        pSysData[i    ] = ( BYTE )( pHeightBits[index] * 255.0f );
-
-        // cone ratios
-        pSysData[i + 1] = ( BYTE )( pConeRatios[index] * 255.0f );
-
-        index ++;
+        wprintf( L"Could not write %s\n", strOut );
+        nResult = 1;
     }
 
-    ID3D10Texture2D* pTerrainTexture = NULL;
-    V_RETURN( pd3dDevice->CreateTexture2D( &Desc, &InitData, &pTerrainTexture ) );
-    SAFE_DELETE_ARRAY( InitData.pSysMem );
-
-    // Save it out to a file
-    D3DX10SaveTextureToFile( pTerrainTexture, D3DX10_IFF_DDS, strMapOut );
+    if( bVerify )
+    {
+        // Every texel on small maps, a fixed sample on large ones.  A brute force relaxed
+        // cone casts a ray per texel of the map, so fewer are sampled.
+        const int nTexels = Width * Height;
+        const bool bAll = nTexels <= 256 * 256;
+        const int nSamples = bAll ? nTexels : ( ( dwFlags & CONEMAP_RELAXED ) ? 64 : 1024 );
+        float fMaxError = 0.0f;
+        int nMismatches = 0;
+        LONGLONG llFastTime = 0;
+        LONGLONG llBruteTime = 0;
+
+        srand( 0 );
+        for( int i = 0; i < nSamples; i++ )
+        {
+            int nTexel = bAll ? i : ( ( ( rand() & 0x7FFF ) << 15 ) | ( rand() & 0x7FFF ) ) % nTexels;
+            int x = nTexel % Width;
+            int y = nTexel / Width;
+
+            QueryPerformanceCounter( &qwStart );
+            float fFast = Baker.GetConeRatio( x, y, dwFlags );
+            QueryPerformanceCounter( &qwEnd );
+            llFastTime += qwEnd.QuadPart - qwStart.QuadPart;
+
+            float fBrute = Baker.GetConeRatioBruteForce( x, y, dwFlags );
+            QueryPerformanceCounter( &qwStart );
+            llBruteTime += qwStart.QuadPart - qwEnd.QuadPart;
+
+            float fError = max( fabsf( fFast - fBrute ), fabsf( pConeRatios[nTexel] - fBrute ) );
+            if( fError > 0.0f )
+                nMismatches++;
+            fMaxError = max( fMaxError, fError );
+        }
 
-    SAFE_RELEASE( pTerrainTexture );
-    SAFE_DELETE_ARRAY( pHeightBits );
-    SAFE_DELETE_ARRAY( pConeRatios );
-    return S_OK;
+        double fFastUs = 1000000.0 * llFastTime / qwFreq.QuadPart / nSamples;
+        double fBruteUs = 1000000.0 * llBruteTime / qwFreq.QuadPart / nSamples;
+        wprintf( L"Verified %d texels: %d mismatches, max error %g\n", nSamples, nMismatches, fMaxError );
+        wprintf( L"Per texel: %.2f us pyramid, %.2f us brute force (%.1fx single threaded)\n",
+                 fFastUs, fBruteUs, fBruteUs / fFastUs );
+        wprintf( L"Brute force bake estimate: %.1f s, %.1fx the threaded bake\n",
+                 fBruteUs * nTexels / 1000000.0, fBruteUs * nTexels / 1000.0 / fBakeMs );
 
-Error:
-    CloseHandle( hFile );
-    return E_FAIL;
+        if( nMismatches > 0 )
+            nResult = 1;
+    }
 
+    SAFE_DELETE_ARRAY( pHeights );
+    SAFE_DELETE_ARRAY( pConeRatios );
+    return nResult;
 }
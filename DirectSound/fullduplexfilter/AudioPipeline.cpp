@@ -0,0 +1,840 @@
+//-----------------------------------------------------------------------------
+// File: AudioPipeline.cpp
+//
+// Desc: Capture -> filter -> playback pipeline for the FullDuplexFilter sample.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//-----------------------------------------------------------------------------
+#include "DXUT.h"
+#include "AudioPipeline.h"
+#include <process.h>
+
+
+
+
+//-----------------------------------------------------------------------------
+// Thread entry points
+//-----------------------------------------------------------------------------
+unsigned int WINAPI _AudioCaptureThreadProc( LPVOID lpParameter )
+{
+    return ( ( CAudioPipeline* )lpParameter )->CaptureThreadProc();
+}
+
+unsigned int WINAPI _AudioFilterThreadProc( LPVOID lpParameter )
+{
+    return ( ( CAudioPipeline* )lpParameter )->FilterThreadProc();
+}
+
+unsigned int WINAPI _AudioPlaybackThreadProc( LPVOID lpParameter )
+{
+    return ( ( CAudioPipeline* )lpParameter )->PlaybackThreadProc();
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: ClampSample()
+// Desc: Saturates a widened sample back to the range of the stream format
+//-----------------------------------------------------------------------------
+static inline LONG ClampSample( LONG lSample, WORD wBitsPerSample )
+{
+    if( wBitsPerSample == 8 )
+        return ( lSample < -128 ) ? -128 : ( lSample > 127 ) ? 127 : lSample;
+    else
+        return ( lSample < -32768 ) ? -32768 : ( lSample > 32767 ) ? 32767 : lSample;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CGainFilter
+//-----------------------------------------------------------------------------
+CGainFilter::CGainFilter( float fGain ) : m_lGain( ( LONG )( fGain * 65536.0f ) ),
+                                          m_wBitsPerSample( 16 )
+{
+}
+
+HRESULT CGainFilter::Initialize( const WAVEFORMATEX* pwfx )
+{
+    m_wBitsPerSample = pwfx->wBitsPerSample;
+    return S_OK;
+}
+
+void CGainFilter::Process( BYTE* pbData, DWORD cbData )
+{
+    if( m_wBitsPerSample == 8 )
+    {
+        // 8-bit PCM is unsigned and centered on 128
+        for( DWORD i = 0; i < cbData; i++ )
+        {
+            LONG lSample = ( ( LONG )pbData[i] - 128 ) * m_lGain >> 16;
+            pbData[i] = ( BYTE )( ClampSample( lSample, 8 ) + 128 );
+        }
+    }
+    else
+    {
+        SHORT* psData = ( SHORT* )pbData;
+        DWORD dwSamples = cbData / sizeof( SHORT );
+        for( DWORD i = 0; i < dwSamples; i++ )
+        {
+            LONG lSample = ( LONG )psData[i] * m_lGain >> 16;
+            psData[i] = ( SHORT )ClampSample( lSample, 16 );
+        }
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CEchoFilter
+//-----------------------------------------------------------------------------
+CEchoFilter::CEchoFilter( DWORD dwDelayMs, float fFeedback ) : m_dwDelayMs( dwDelayMs ),
+                                                               m_lFeedback( ( LONG )( fFeedback * 65536.0f ) ),
+                                                               m_wBitsPerSample( 16 ),
+                                                               m_plDelayLine( NULL ),
+                                                               m_dwDelaySamples( 0 ),
+                                                               m_dwDelayPos( 0 )
+{
+}
+
+CEchoFilter::~CEchoFilter()
+{
+    SAFE_DELETE_ARRAY( m_plDelayLine );
+}
+
+HRESULT CEchoFilter::Initialize( const WAVEFORMATEX* pwfx )
+{
+    SAFE_DELETE_ARRAY( m_plDelayLine );
+
+    m_wBitsPerSample = pwfx->wBitsPerSample;
+    m_dwDelaySamples = MulDiv( pwfx->nSamplesPerSec, m_dwDelayMs, 1000 ) * pwfx->nChannels;
+    m_dwDelayPos = 0;
+
+    if( m_dwDelaySamples == 0 )
+        return S_OK;
+
+    m_plDelayLine = new LONG[ m_dwDelaySamples ];
+    if( !m_plDelayLine )
+        return E_OUTOFMEMORY;
+    ZeroMemory( m_plDelayLine, m_dwDelaySamples * sizeof( LONG ) );
+
+    return S_OK;
+}
+
+void CEchoFilter::Process( BYTE* pbData, DWORD cbData )
+{
+    if( !m_plDelayLine )
+        return;
+
+    DWORD dwSamples = ( m_wBitsPerSample == 8 ) ? cbData : cbData / sizeof( SHORT );
+    for( DWORD i = 0; i < dwSamples; i++ )
+    {
+        LONG lSample = ( m_wBitsPerSample == 8 ) ? ( LONG )pbData[i] - 128 : ( ( SHORT* )pbData )[i];
+
+        lSample = ClampSample( lSample + ( m_plDelayLine[ m_dwDelayPos ] * m_lFeedback >> 16 ),
+                               m_wBitsPerSample );
+        m_plDelayLine[ m_dwDelayPos ] = lSample;
+        if( ++m_dwDelayPos == m_dwDelaySamples )
+            m_dwDelayPos = 0;
+
+        if( m_wBitsPerSample == 8 )
+            pbData[i] = ( BYTE )( lSample + 128 );
+        else
+            ( ( SHORT* )pbData )[i] = ( SHORT )lSample;
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CAudioFilterGraph
+//-----------------------------------------------------------------------------
+CAudioFilterGraph::CAudioFilterGraph() : m_nFilters( 0 ),
+                                         m_bBypass( false )
+{
+    ZeroMemory( m_apFilters, sizeof( m_apFilters ) );
+}
+
+HRESULT CAudioFilterGraph::AddFilter( CAudioFilter* pFilter )
+{
+    if( !pFilter )
+        return E_INVALIDARG;
+    if( m_nFilters >= AUDIO_MAX_FILTERS )
+        return E_OUTOFMEMORY;
+
+    m_apFilters[ m_nFilters++ ] = pFilter;
+    return S_OK;
+}
+
+void CAudioFilterGraph::RemoveAll()
+{
+    ZeroMemory( m_apFilters, sizeof( m_apFilters ) );
+    m_nFilters = 0;
+}
+
+HRESULT CAudioFilterGraph::Initialize( const WAVEFORMATEX* pwfx )
+{
+    HRESULT hr;
+
+    for( int i = 0; i < m_nFilters; i++ )
+    {
+        if( FAILED( hr = m_apFilters[i]->Initialize( pwfx ) ) )
+            return DXTRACE_ERR( TEXT("CAudioFilter::Initialize"), hr );
+    }
+
+    return S_OK;
+}
+
+void CAudioFilterGraph::Process( BYTE* pbData, DWORD cbData )
+{
+    if( m_bBypass )
+        return;
+
+    for( int i = 0; i < m_nFilters; i++ )
+        m_apFilters[i]->Process( pbData, cbData );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CDSoundCaptureSource
+//-----------------------------------------------------------------------------
+CDSoundCaptureSource::CDSoundCaptureSource( LPDIRECTSOUNDCAPTUREBUFFER pDSBCapture, HANDLE hNotificationEvent,
+                                            DWORD dwBufferSize, DWORD dwNotifySize ) :
+    m_pDSBCapture( pDSBCapture ),
+    m_hNotificationEvent( hNotificationEvent ),
+    m_dwBufferSize( dwBufferSize ),
+    m_dwNotifySize( dwNotifySize ),
+    m_dwNextCaptureOffset( 0 )
+{
+}
+
+HRESULT CDSoundCaptureSource::ReadBlock( BYTE* pbData, DWORD cbData, DWORD* pcbRead, DWORD dwTimeoutMs )
+{
+    HRESULT hr;
+    VOID*   pvLocked = NULL;
+    DWORD   cbLocked = 0;
+    DWORD   dwReadPos;
+
+    *pcbRead = 0;
+
+    // The notification event is auto-reset, so several notifications that
+    // fire while we are busy collapse into one, and one left over from an
+    // earlier drain can wake us before a whole block has been captured.  So
+    // the read cursor is checked before and after every wait, and a block is
+    // only read once all of it has been captured.
+    DWORD dwStart = GetTickCount();
+    for( ; ; )
+    {
+        if( FAILED( hr = m_pDSBCapture->GetCurrentPosition( NULL, &dwReadPos ) ) )
+            return DXTRACE_ERR( TEXT("GetCurrentPosition"), hr );
+
+        DWORD cbAvailable = ( dwReadPos + m_dwBufferSize - m_dwNextCaptureOffset ) % m_dwBufferSize;
+        if( cbAvailable >= m_dwNotifySize )
+            break;
+
+        DWORD dwWaitMs = dwTimeoutMs;
+        if( dwTimeoutMs != INFINITE )
+        {
+            DWORD dwElapsed = GetTickCount() - dwStart;
+            if( dwElapsed >= dwTimeoutMs )
+                return S_OK;
+            dwWaitMs = dwTimeoutMs - dwElapsed;
+        }
+
+        if( WaitForSingleObject( m_hNotificationEvent, dwWaitMs ) != WAIT_OBJECT_0 )
+            return S_OK;
+    }
+
+    if( FAILED( hr = m_pDSBCapture->Lock( m_dwNextCaptureOffset, m_dwNotifySize,
+                                          &pvLocked, &cbLocked, NULL, NULL, 0L ) ) )
+        return DXTRACE_ERR( TEXT("Lock"), hr );
+
+    cbLocked = min( cbLocked, cbData );
+    CopyMemory( pbData, pvLocked, cbLocked );
+
+    m_pDSBCapture->Unlock( pvLocked, cbLocked, NULL, 0 );
+
+    // Move the capture offset along
+    m_dwNextCaptureOffset += cbLocked;
+    m_dwNextCaptureOffset %= m_dwBufferSize; // Circular buffer
+
+    *pcbRead = cbLocked;
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CDSoundOutputSink
+//-----------------------------------------------------------------------------
+CDSoundOutputSink::CDSoundOutputSink( LPDIRECTSOUNDBUFFER pDSBOutput, DWORD dwBufferSize,
+                                      DWORD dwAvgBytesPerSec ) :
+    m_pDSBOutput( pDSBOutput ),
+    m_dwBufferSize( dwBufferSize ),
+    m_dwAvgBytesPerSec( dwAvgBytesPerSec ),
+    m_dwNextOutputOffset( 0 )
+{
+}
+
+HRESULT CDSoundOutputSink::WriteBlock( const BYTE* pbData, DWORD cbData, LONGLONG* pllOutputTime )
+{
+    HRESULT hr;
+    VOID*   pvLocked1 = NULL;
+    VOID*   pvLocked2 = NULL;
+    DWORD   cbLocked1 = 0;
+    DWORD   cbLocked2 = 0;
+    DWORD   dwStatus;
+    DWORD   dwPlayPos;
+    LARGE_INTEGER liNow, liFreq;
+
+    // A lost buffer is restarted by the UI thread when the app is reactivated,
+    // so just drop the block here
+    if( FAILED( hr = m_pDSBOutput->GetStatus( &dwStatus ) ) )
+        return DXTRACE_ERR( TEXT("GetStatus"), hr );
+    if( dwStatus & DSBSTATUS_BUFFERLOST )
+        return S_FALSE;
+
+    if( FAILED( hr = m_pDSBOutput->Lock( m_dwNextOutputOffset, cbData,
+                                         &pvLocked1, &cbLocked1,
+                                         &pvLocked2, &cbLocked2, 0L ) ) )
+        return DXTRACE_ERR( TEXT("Lock"), hr );
+
+    CopyMemory( pvLocked1, pbData, cbLocked1 );
+    if( pvLocked2 )
+        CopyMemory( pvLocked2, pbData + cbLocked1, cbLocked2 );
+
+    m_pDSBOutput->Unlock( pvLocked1, cbLocked1, pvLocked2, cbLocked2 );
+
+    // The block will be heard once the play cursor reaches it
+    QueryPerformanceCounter( &liNow );
+    QueryPerformanceFrequency( &liFreq );
+    if( FAILED( hr = m_pDSBOutput->GetCurrentPosition( &dwPlayPos, NULL ) ) )
+        return DXTRACE_ERR( TEXT("GetCurrentPosition"), hr );
+
+    DWORD cbLead = ( m_dwNextOutputOffset + m_dwBufferSize - dwPlayPos ) % m_dwBufferSize;
+    *pllOutputTime = liNow.QuadPart + cbLead * liFreq.QuadPart / m_dwAvgBytesPerSec;
+
+    // Move the playback offset along
+    m_dwNextOutputOffset += cbLocked1 + cbLocked2;
+    m_dwNextOutputOffset %= m_dwBufferSize; // Circular buffer
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CWaveFileSource
+//-----------------------------------------------------------------------------
+CWaveFileSource::CWaveFileSource()
+{
+}
+
+CWaveFileSource::~CWaveFileSource()
+{
+    m_WaveFile.Close();
+}
+
+HRESULT CWaveFileSource::Open( LPWSTR strFileName )
+{
+    HRESULT hr;
+
+    if( FAILED( hr = m_WaveFile.Open( strFileName, NULL, WAVEFILE_READ ) ) )
+        return DXTRACE_ERR( TEXT("CWaveFile::Open"), hr );
+
+    if( m_WaveFile.GetFormat()->wFormatTag != WAVE_FORMAT_PCM )
+        return DXTRACE_ERR( TEXT("CWaveFileSource::Open"), E_NOTIMPL );
+
+    return S_OK;
+}
+
+HRESULT CWaveFileSource::ReadBlock( BYTE* pbData, DWORD cbData, DWORD* pcbRead, DWORD dwTimeoutMs )
+{
+    HRESULT hr;
+
+    *pcbRead = 0;
+    if( FAILED( hr = m_WaveFile.Read( pbData, cbData, pcbRead ) ) )
+        return DXTRACE_ERR( TEXT("CWaveFile::Read"), hr );
+
+    // A short read is the last block in the file
+    return ( *pcbRead < cbData ) ? S_FALSE : S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CWaveFileSink
+//-----------------------------------------------------------------------------
+CWaveFileSink::CWaveFileSink()
+{
+}
+
+CWaveFileSink::~CWaveFileSink()
+{
+    m_WaveFile.Close();
+}
+
+HRESULT CWaveFileSink::Open( LPWSTR strFileName, WAVEFORMATEX* pwfx )
+{
+    HRESULT hr;
+
+    if( FAILED( hr = m_WaveFile.Open( strFileName, pwfx, WAVEFILE_WRITE ) ) )
+        return DXTRACE_ERR( TEXT("CWaveFile::Open"), hr );
+
+    return S_OK;
+}
+
+HRESULT CWaveFileSink::WriteBlock( const BYTE* pbData, DWORD cbData, LONGLONG* pllOutputTime )
+{
+    HRESULT hr;
+    UINT    cbWrote;
+    LARGE_INTEGER liNow;
+
+    if( FAILED( hr = m_WaveFile.Write( cbData, ( BYTE* )pbData, &cbWrote ) ) )
+        return DXTRACE_ERR( TEXT("CWaveFile::Write"), hr );
+
+    QueryPerformanceCounter( &liNow );
+    *pllOutputTime = liNow.QuadPart;
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CAudioPipeline()
+//-----------------------------------------------------------------------------
+CAudioPipeline::CAudioPipeline() : m_pCapturePipe( NULL ),
+                                   m_pOutputPipe( NULL ),
+                                   m_pSource( NULL ),
+                                   m_pGraph( NULL ),
+                                   m_pSink( NULL ),
+                                   m_dwBlockSize( 0 ),
+                                   m_cbPacket( 0 ),
+                                   m_hCaptureThread( NULL ),
+                                   m_hFilterThread( NULL ),
+                                   m_hPlaybackThread( NULL ),
+                                   m_hCaptureDataReady( NULL ),
+                                   m_hOutputDataReady( NULL ),
+                                   m_hEndOfStream( NULL ),
+                                   m_bDone( FALSE ),
+                                   m_hrResult( S_OK ),
+                                   m_llFrequency( 1 ),
+                                   m_llStartTime( 0 ),
+                                   m_dwOverruns( 0 ),
+                                   m_llFilterTime( 0 ),
+                                   m_dwBlocks( 0 ),
+                                   m_llBytes( 0 ),
+                                   m_llLatencyMin( 0 ),
+                                   m_llLatencyMax( 0 ),
+                                   m_llLatencySum( 0 ),
+                                   m_llLastOutputTime( 0 )
+{
+}
+
+CAudioPipeline::~CAudioPipeline()
+{
+    Stop();
+
+    SAFE_DELETE( m_pCapturePipe );
+    SAFE_DELETE( m_pOutputPipe );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CAudioPipeline::Start()
+// Desc: Creates the rings and the three stage threads.  dwBlockSize is the
+//       largest block the source will produce.
+//-----------------------------------------------------------------------------
+HRESULT CAudioPipeline::Start( CAudioSource* pSource, CAudioFilterGraph* pGraph, CAudioSink* pSink,
+                               const WAVEFORMATEX* pwfx, DWORD dwBlockSize )
+{
+    HRESULT hr;
+
+    if( !pSource || !pSink || !pwfx || dwBlockSize == 0 )
+        return E_INVALIDARG;
+
+    Stop();
+
+    m_pSource = pSource;
+    m_pGraph = pGraph;
+    m_pSink = pSink;
+    m_dwBlockSize = dwBlockSize - dwBlockSize % pwfx->nBlockAlign;
+    m_cbPacket = sizeof( AUDIO_BLOCK_HEADER ) + m_dwBlockSize;
+
+    // Discard anything left over from a previous run.  Both ends are
+    // quiescent here so the pipes can simply be recreated.
+    SAFE_DELETE( m_pCapturePipe );
+    SAFE_DELETE( m_pOutputPipe );
+    m_pCapturePipe = new CAudioPipe;
+    m_pOutputPipe = new CAudioPipe;
+    if( !m_pCapturePipe || !m_pOutputPipe )
+        return E_OUTOFMEMORY;
+
+    // A ring must hold at least two packets or the stages can never overlap
+    if( m_cbPacket * 2 > m_pCapturePipe->GetBufferSize() )
+        return E_INVALIDARG;
+
+    if( m_pGraph && FAILED( hr = m_pGraph->Initialize( pwfx ) ) )
+        return DXTRACE_ERR( TEXT("CAudioFilterGraph::Initialize"), hr );
+
+    LARGE_INTEGER liFreq, liNow;
+    QueryPerformanceFrequency( &liFreq );
+    QueryPerformanceCounter( &liNow );
+    m_llFrequency = liFreq.QuadPart;
+    m_llStartTime = liNow.QuadPart;
+    m_llLastOutputTime = liNow.QuadPart;
+    m_dwOverruns = 0;
+    m_llFilterTime = 0;
+    m_dwBlocks = 0;
+    m_llBytes = 0;
+    m_llLatencyMin = LLONG_MAX;
+    m_llLatencyMax = 0;
+    m_llLatencySum = 0;
+    m_bDone = FALSE;
+    m_hrResult = S_OK;
+
+    m_hCaptureDataReady = CreateEvent( NULL, FALSE, FALSE, NULL );
+    m_hOutputDataReady = CreateEvent( NULL, FALSE, FALSE, NULL );
+    m_hEndOfStream = CreateEvent( NULL, TRUE, FALSE, NULL );
+    if( !m_hCaptureDataReady || !m_hOutputDataReady || !m_hEndOfStream )
+    {
+        hr = HRESULT_FROM_WIN32( GetLastError() );
+        Stop();
+        return DXTRACE_ERR( TEXT("CreateEvent"), hr );
+    }
+
+    // Start the consumers before the producer
+    m_hPlaybackThread = ( HANDLE )_beginthreadex( NULL, 0, _AudioPlaybackThreadProc, ( LPVOID )this, 0, NULL );
+    m_hFilterThread = ( HANDLE )_beginthreadex( NULL, 0, _AudioFilterThreadProc, ( LPVOID )this, 0, NULL );
+    m_hCaptureThread = ( HANDLE )_beginthreadex( NULL, 0, _AudioCaptureThreadProc, ( LPVOID )this, 0, NULL );
+    if( !m_hPlaybackThread || !m_hFilterThread || !m_hCaptureThread )
+    {
+        Stop();
+        return DXTRACE_ERR( TEXT("_beginthreadex"), E_FAIL );
+    }
+
+    // The capture and playback threads feed hardware buffers and must not be
+    // starved by the filter thread
+    SetThreadPriority( m_hCaptureThread, THREAD_PRIORITY_TIME_CRITICAL );
+    SetThreadPriority( m_hPlaybackThread, THREAD_PRIORITY_TIME_CRITICAL );
+    SetThreadPriority( m_hFilterThread, THREAD_PRIORITY_ABOVE_NORMAL );
+
+    return S_OK;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CAudioPipeline::Stop()
+// Desc: Stops all three threads.  Blocks still in flight are discarded.
+//-----------------------------------------------------------------------------
+void CAudioPipeline::Stop()
+{
+    m_bDone = TRUE;
+
+    if( m_hCaptureDataReady )
+        SetEvent( m_hCaptureDataReady );
+    if( m_hOutputDataReady )
+        SetEvent( m_hOutputDataReady );
+
+    HANDLE ahThreads[3];
+    DWORD dwNumThreads = 0;
+    if( m_hCaptureThread )
+        ahThreads[ dwNumThreads++ ] = m_hCaptureThread;
+    if( m_hFilterThread )
+        ahThreads[ dwNumThreads++ ] = m_hFilterThread;
+    if( m_hPlaybackThread )
+        ahThreads[ dwNumThreads++ ] = m_hPlaybackThread;
+
+    if( dwNumThreads )
+        WaitForMultipleObjects( dwNumThreads, ahThreads, TRUE, INFINITE );
+
+    for( DWORD i = 0; i < dwNumThreads; i++ )
+        CloseHandle( ahThreads[i] );
+    m_hCaptureThread = NULL;
+    m_hFilterThread = NULL;
+    m_hPlaybackThread = NULL;
+
+    if( m_hCaptureDataReady )
+        CloseHandle( m_hCaptureDataReady );
+    if( m_hOutputDataReady )
+        CloseHandle( m_hOutputDataReady );
+    if( m_hEndOfStream )
+        CloseHandle( m_hEndOfStream );
+    m_hCaptureDataReady = NULL;
+    m_hOutputDataReady = NULL;
+    m_hEndOfStream = NULL;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CAudioPipeline::WaitForEndOfStream()
+//-----------------------------------------------------------------------------
+DWORD CAudioPipeline::WaitForEndOfStream( DWORD dwTimeoutMs )
+{
+    if( !m_hEndOfStream )
+        return WAIT_FAILED;
+
+    return WaitForSingleObject( m_hEndOfStream, dwTimeoutMs );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CAudioPipeline::GetStats()
+// Desc: Exact once the pipeline has stopped; while running the counters
+//       may be a block or so out of step with each other
+//-----------------------------------------------------------------------------
+void CAudioPipeline::GetStats( AUDIO_PIPELINE_STATS* pStats )
+{
+    double fMsPerTick = 1000.0 / ( double )m_llFrequency;
+    DWORD dwBlocks = m_dwBlocks;
+
+    ZeroMemory( pStats, sizeof( AUDIO_PIPELINE_STATS ) );
+    pStats->dwBlocks = dwBlocks;
+    pStats->dwOverruns = m_dwOverruns;
+    pStats->llBytes = m_llBytes;
+    pStats->fElapsed = ( double )( m_llLastOutputTime - m_llStartTime ) / ( double )m_llFrequency;
+
+    if( dwBlocks > 0 )
+    {
+        pStats->fLatencyMin = m_llLatencyMin * fMsPerTick;
+        pStats->fLatencyMax = m_llLatencyMax * fMsPerTick;
+        pStats->fLatencyAvg = m_llLatencySum * fMsPerTick / dwBlocks;
+        pStats->fFilterTimeAvg = m_llFilterTime * fMsPerTick / dwBlocks;
+    }
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CAudioPipeline::Fail()
+// Desc: Records the first error, stops the other stages and releases anyone
+//       waiting for the end of the stream
+//-----------------------------------------------------------------------------
+void CAudioPipeline::Fail( HRESULT hr )
+{
+    InterlockedCompareExchange( &m_hrResult, hr, S_OK );
+    m_bDone = TRUE;
+
+    SetEvent( m_hCaptureDataReady );
+    SetEvent( m_hOutputDataReady );
+    SetEvent( m_hEndOfStream );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CAudioPipeline::WriteBlock()
+// Desc: Writes one packet into a ring.  If bWait is false the packet is
+//       dropped when the ring is full.
+//-----------------------------------------------------------------------------
+bool CAudioPipeline::WriteBlock( CAudioPipe* pPipe, HANDLE hDataReady, BYTE* pbPacket, bool bWait )
+{
+    while( !pPipe->Write( pbPacket, m_cbPacket ) )
+    {
+        if( !bWait || m_bDone )
+            return false;
+
+        // The consumer is behind; let it run
+        SwitchToThread();
+    }
+
+    SetEvent( hDataReady );
+    return true;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CAudioPipeline::ReadBlock()
+// Desc: Reads one packet from a ring, sleeping on hDataReady while it is empty.
+//       Returns false if the pipeline is stopping.
+//-----------------------------------------------------------------------------
+bool CAudioPipeline::ReadBlock( CAudioPipe* pPipe, HANDLE hDataReady, BYTE* pbPacket )
+{
+    while( !pPipe->Read( pbPacket, m_cbPacket ) )
+    {
+        if( m_bDone )
+            return false;
+
+        WaitForSingleObject( hDataReady, 10 );
+    }
+
+    return true;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CAudioPipeline::CaptureThreadProc()
+// Desc: Pulls blocks from the source, stamps them and hands them to the
+//       filter thread
+//-----------------------------------------------------------------------------
+unsigned int CAudioPipeline::CaptureThreadProc()
+{
+    BYTE* pbPacket = new BYTE[ m_cbPacket ];
+    if( !pbPacket )
+    {
+        Fail( E_OUTOFMEMORY );
+        return 1;
+    }
+
+    AUDIO_BLOCK_HEADER* pHeader = ( AUDIO_BLOCK_HEADER* )pbPacket;
+    BYTE* pbData = pbPacket + sizeof( AUDIO_BLOCK_HEADER );
+    bool bWait = !m_pSource->IsRealTime();
+    DWORD dwSequence = 0;
+
+    while( !m_bDone )
+    {
+        DWORD cbRead = 0;
+        HRESULT hr = m_pSource->ReadBlock( pbData, m_dwBlockSize, &cbRead, 100 );
+
+        // Treat a failing source as the end of the stream so that the
+        // downstream stages still shut down cleanly, but remember why
+        bool bEndOfStream = ( hr != S_OK );
+        if( FAILED( hr ) )
+            InterlockedCompareExchange( &m_hrResult, hr, S_OK );
+        if( cbRead == 0 && !bEndOfStream )
+            continue;
+
+        LARGE_INTEGER liNow;
+        QueryPerformanceCounter( &liNow );
+
+        pHeader->dwFlags = bEndOfStream ? AUDIO_BLOCK_ENDOFSTREAM : 0;
+        pHeader->dwSequence = dwSequence++;
+        pHeader->cbData = cbRead;
+        pHeader->dwPad = 0;
+        pHeader->llCaptureTime = liNow.QuadPart;
+
+        if( !WriteBlock( m_pCapturePipe, m_hCaptureDataReady, pbPacket, bWait || bEndOfStream ) )
+            m_dwOverruns++;
+
+        if( bEndOfStream )
+            break;
+    }
+
+    delete[] pbPacket;
+    return 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CAudioPipeline::FilterThreadProc()
+// Desc: Runs the filter graph on each block.  This is the only stage that
+//       is allowed to be slow.
+//-----------------------------------------------------------------------------
+unsigned int CAudioPipeline::FilterThreadProc()
+{
+    BYTE* pbPacket = new BYTE[ m_cbPacket ];
+    if( !pbPacket )
+    {
+        Fail( E_OUTOFMEMORY );
+        return 1;
+    }
+
+    AUDIO_BLOCK_HEADER* pHeader = ( AUDIO_BLOCK_HEADER* )pbPacket;
+    BYTE* pbData = pbPacket + sizeof( AUDIO_BLOCK_HEADER );
+
+    while( ReadBlock( m_pCapturePipe, m_hCaptureDataReady, pbPacket ) )
+    {
+        if( m_pGraph && pHeader->cbData > 0 )
+        {
+            LARGE_INTEGER liStart, liEnd;
+            QueryPerformanceCounter( &liStart );
+            m_pGraph->Process( pbData, pHeader->cbData );
+            QueryPerformanceCounter( &liEnd );
+            m_llFilterTime += liEnd.QuadPart - liStart.QuadPart;
+        }
+
+        // Never drop here; the playback thread drains this ring at the
+        // rate the source fills the other one
+        if( !WriteBlock( m_pOutputPipe, m_hOutputDataReady, pbPacket, true ) )
+            break;
+
+        if( pHeader->dwFlags & AUDIO_BLOCK_ENDOFSTREAM )
+            break;
+    }
+
+    delete[] pbPacket;
+    return 0;
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: CAudioPipeline::PlaybackThreadProc()
+// Desc: Hands filtered blocks to the sink and accumulates latency statistics
+//-----------------------------------------------------------------------------
+unsigned int CAudioPipeline::PlaybackThreadProc()
+{
+    BYTE* pbPacket = new BYTE[ m_cbPacket ];
+    if( !pbPacket )
+    {
+        Fail( E_OUTOFMEMORY );
+        return 1;
+    }
+
+    AUDIO_BLOCK_HEADER* pHeader = ( AUDIO_BLOCK_HEADER* )pbPacket;
+    BYTE* pbData = pbPacket + sizeof( AUDIO_BLOCK_HEADER );
+
+    while( ReadBlock( m_pOutputPipe, m_hOutputDataReady, pbPacket ) )
+    {
+        if( pHeader->cbData > 0 )
+        {
+            LONGLONG llOutputTime = 0;
+            HRESULT hr = m_pSink->WriteBlock( pbData, pHeader->cbData, &llOutputTime );
+            if( FAILED( hr ) )
+            {
+                Fail( hr );
+                break;
+            }
+            if( hr == S_OK )
+            {
+                LONGLONG llLatency = llOutputTime - pHeader->llCaptureTime;
+                if( llLatency < m_llLatencyMin )
+                    m_llLatencyMin = llLatency;
+                if( llLatency > m_llLatencyMax )
+                    m_llLatencyMax = llLatency;
+                m_llLatencySum += llLatency;
+                m_llBytes += pHeader->cbData;
+                m_llLastOutputTime = llOutputTime;
+                m_dwBlocks++;
+            }
+        }
+
+        if( pHeader->dwFlags & AUDIO_BLOCK_ENDOFSTREAM )
+        {
+            SetEvent( m_hEndOfStream );
+            break;
+        }
+    }
+
+    delete[] pbPacket;
+    return 0;
+}
@@ -0,0 +1,340 @@
+//-----------------------------------------------------------------------------
+// File: AudioPipeline.h
+//
+// Desc: Capture -> filter -> playback pipeline for the FullDuplexFilter sample.
+//       Each stage runs on its own thread and the stages are connected by
+//       single-reader/single-writer DXUTLockFreePipe rings, so a slow filter
+//       never holds the capture or output buffer locks.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//-----------------------------------------------------------------------------
+#pragma once
+#ifndef AUDIO_PIPELINE_H
+#define AUDIO_PIPELINE_H
+
+#include "DXUT.h"
+#include "SDKsound.h"
+#include "SDKwavefile.h"
+#include "DXUTLockFreePipe.h"
+
+//-----------------------------------------------------------------------------
+// Defines
+//-----------------------------------------------------------------------------
+#define AUDIO_PIPE_SIZE_LOG2        20      // 1MB per ring
+#define AUDIO_MAX_FILTERS           8
+#define AUDIO_BLOCK_ENDOFSTREAM     0x00000001
+
+//-----------------------------------------------------------------------------
+// Name: struct AUDIO_BLOCK_HEADER
+// Desc: Precedes every block of samples written into a pipeline ring.  The
+//       header and its payload are written with a single Write() so the
+//       reader never sees one without the other.
+//-----------------------------------------------------------------------------
+struct AUDIO_BLOCK_HEADER
+{
+    DWORD    dwFlags;
+    DWORD    dwSequence;
+    DWORD    cbData;
+    DWORD    dwPad;
+    LONGLONG llCaptureTime;     // QPC ticks when the block left the source
+};
+
+//-----------------------------------------------------------------------------
+// Name: struct AUDIO_PIPELINE_STATS
+// Desc: Latency and throughput counters.  Latency is measured from the time a
+//       block is read from the source to the time the sink reports it will be
+//       heard (or, for a file sink, the time it was written).
+//-----------------------------------------------------------------------------
+struct AUDIO_PIPELINE_STATS
+{
+    DWORD    dwBlocks;
+    DWORD    dwOverruns;        // Blocks dropped because the capture ring was full
+    LONGLONG llBytes;
+    double   fLatencyMin;       // Milliseconds
+    double   fLatencyAvg;
+    double   fLatencyMax;
+    double   fFilterTimeAvg;    // Milliseconds spent in the filter graph per block
+    double   fElapsed;          // Seconds between Start() and the last block
+};
+
+
+//-----------------------------------------------------------------------------
+// Name: class CAudioFilter
+// Desc: A single node in the filter graph.  Filters process PCM blocks in
+//       place and must not block; they run on the filter thread.
+//-----------------------------------------------------------------------------
+class CAudioFilter
+{
+public:
+    virtual         ~CAudioFilter() {}
+
+    virtual HRESULT Initialize( const WAVEFORMATEX* pwfx ) { return S_OK; }
+    virtual void    Process( BYTE* pbData, DWORD cbData ) = 0;
+};
+
+
+//-----------------------------------------------------------------------------
+// Name: class CGainFilter
+// Desc: Scales 8 or 16-bit PCM by a fixed-point gain with saturation
+//-----------------------------------------------------------------------------
+class CGainFilter : public CAudioFilter
+{
+public:
+                    CGainFilter( float fGain );
+
+    virtual HRESULT Initialize( const WAVEFORMATEX* pwfx );
+    virtual void    Process( BYTE* pbData, DWORD cbData );
+
+protected:
+    LONG            m_lGain;    // 16.16 fixed point
+    WORD            m_wBitsPerSample;
+};
+
+
+//-----------------------------------------------------------------------------
+// Name: class CEchoFilter
+// Desc: Mixes a delayed, attenuated copy of the signal back into itself
+//-----------------------------------------------------------------------------
+class CEchoFilter : public CAudioFilter
+{
+public:
+                    CEchoFilter( DWORD dwDelayMs, float fFeedback );
+    virtual         ~CEchoFilter();
+
+    virtual HRESULT Initialize( const WAVEFORMATEX* pwfx );
+    virtual void    Process( BYTE* pbData, DWORD cbData );
+
+protected:
+    DWORD           m_dwDelayMs;
+    LONG            m_lFeedback; // 16.16 fixed point
+    WORD            m_wBitsPerSample;
+    LONG*           m_plDelayLine;
+    DWORD           m_dwDelaySamples;
+    DWORD           m_dwDelayPos;
+};
+
+
+//-----------------------------------------------------------------------------
+// Name: class CAudioFilterGraph
+// Desc: An ordered chain of filters.  The graph does not own its filters.
+//-----------------------------------------------------------------------------
+class CAudioFilterGraph
+{
+public:
+                    CAudioFilterGraph();
+
+    HRESULT         AddFilter( CAudioFilter* pFilter );
+    void            RemoveAll();
+    HRESULT         Initialize( const WAVEFORMATEX* pwfx );
+    void            Process( BYTE* pbData, DWORD cbData );
+
+    void            SetBypass( bool bBypass ) { m_bBypass = bBypass; }
+    bool            GetBypass() const { return m_bBypass; }
+    int             GetNumFilters() const { return m_nFilters; }
+
+protected:
+    CAudioFilter*   m_apFilters[AUDIO_MAX_FILTERS];
+    int             m_nFilters;
+    volatile bool   m_bBypass;
+};
+
+
+//-----------------------------------------------------------------------------
+// Name: class CAudioSource
+// Desc: Produces blocks for the capture thread.  ReadBlock returns S_OK with
+//       *pcbRead == 0 if no data arrived before the timeout, and S_FALSE at the
+//       end of the stream.
+//-----------------------------------------------------------------------------
+class CAudioSource
+{
+public:
+    virtual         ~CAudioSource() {}
+
+    virtual HRESULT ReadBlock( BYTE* pbData, DWORD cbData, DWORD* pcbRead, DWORD dwTimeoutMs ) = 0;
+
+    // Real-time sources drop blocks when the pipeline falls behind.  Others
+    // wait for room so that every sample reaches the sink.
+    virtual bool    IsRealTime() const = 0;
+};
+
+
+//-----------------------------------------------------------------------------
+// Name: class CAudioSink
+// Desc: Consumes filtered blocks on the playback thread.  *pllOutputTime
+//       receives the QPC time at which the block is expected to be heard.
+//       S_FALSE skips the block; a failure stops the pipeline.
+//-----------------------------------------------------------------------------
+class CAudioSink
+{
+public:
+    virtual         ~CAudioSink() {}
+
+    virtual HRESULT WriteBlock( const BYTE* pbData, DWORD cbData, LONGLONG* pllOutputTime ) = 0;
+};
+
+
+//-----------------------------------------------------------------------------
+// Name: class CDSoundCaptureSource
+// Desc: Reads notification-sized blocks from a looping capture buffer
+//-----------------------------------------------------------------------------
+class CDSoundCaptureSource : public CAudioSource
+{
+public:
+                    CDSoundCaptureSource( LPDIRECTSOUNDCAPTUREBUFFER pDSBCapture, HANDLE hNotificationEvent,
+                                          DWORD dwBufferSize, DWORD dwNotifySize );
+
+    void            Reset( DWORD dwNextCaptureOffset ) { m_dwNextCaptureOffset = dwNextCaptureOffset; }
+
+    virtual HRESULT ReadBlock( BYTE* pbData, DWORD cbData, DWORD* pcbRead, DWORD dwTimeoutMs );
+    virtual bool    IsRealTime() const { return true; }
+
+protected:
+    LPDIRECTSOUNDCAPTUREBUFFER m_pDSBCapture;
+    HANDLE          m_hNotificationEvent;
+    DWORD           m_dwBufferSize;
+    DWORD           m_dwNotifySize;
+    DWORD           m_dwNextCaptureOffset;
+};
+
+
+//-----------------------------------------------------------------------------
+// Name: class CDSoundOutputSink
+// Desc: Writes blocks into a looping output buffer ahead of the play cursor
+//-----------------------------------------------------------------------------
+class CDSoundOutputSink : public CAudioSink
+{
+public:
+                    CDSoundOutputSink( LPDIRECTSOUNDBUFFER pDSBOutput, DWORD dwBufferSize,
+                                       DWORD dwAvgBytesPerSec );
+
+    void            Reset( DWORD dwNextOutputOffset ) { m_dwNextOutputOffset = dwNextOutputOffset; }
+
+    virtual HRESULT WriteBlock( const BYTE* pbData, DWORD cbData, LONGLONG* pllOutputTime );
+
+protected:
+    LPDIRECTSOUNDBUFFER m_pDSBOutput;
+    DWORD           m_dwBufferSize;
+    DWORD           m_dwAvgBytesPerSec;
+    DWORD           m_dwNextOutputOffset;
+};
+
+
+//-----------------------------------------------------------------------------
+// Name: class CWaveFileSource
+// Desc: Reads a .wav file as fast as the pipeline will accept it
+//-----------------------------------------------------------------------------
+class CWaveFileSource : public CAudioSource
+{
+public:
+                    CWaveFileSource();
+    virtual         ~CWaveFileSource();
+
+    HRESULT         Open( LPWSTR strFileName );
+    WAVEFORMATEX*   GetFormat() { return m_WaveFile.GetFormat(); }
+
+    virtual HRESULT ReadBlock( BYTE* pbData, DWORD cbData, DWORD* pcbRead, DWORD dwTimeoutMs );
+    virtual bool    IsRealTime() const { return false; }
+
+protected:
+    CWaveFile       m_WaveFile;
+};
+
+
+//-----------------------------------------------------------------------------
+// Name: class CWaveFileSink
+// Desc: Writes filtered blocks to a .wav file
+//-----------------------------------------------------------------------------
+class CWaveFileSink : public CAudioSink
+{
+public:
+                    CWaveFileSink();
+    virtual         ~CWaveFileSink();
+
+    HRESULT         Open( LPWSTR strFileName, WAVEFORMATEX* pwfx );
+    HRESULT         Close() { return m_WaveFile.Close(); }
+
+    virtual HRESULT WriteBlock( const BYTE* pbData, DWORD cbData, LONGLONG* pllOutputTime );
+
+protected:
+    CWaveFile       m_WaveFile;
+};
+
+
+//-----------------------------------------------------------------------------
+// Name: class CAudioPipeline
+// Desc: Owns the capture, filter and playback threads and the two rings that
+//       connect them.  The only synchronization on the data path is the
+//       read-acquire/write-release inside DXUTLockFreePipe; the events are
+//       used solely to wake an idle stage.
+//-----------------------------------------------------------------------------
+class CAudioPipeline
+{
+public:
+                    CAudioPipeline();
+                    ~CAudioPipeline();
+
+    HRESULT         Start( CAudioSource* pSource, CAudioFilterGraph* pGraph, CAudioSink* pSink,
+                           const WAVEFORMATEX* pwfx, DWORD dwBlockSize );
+    void            Stop();
+    bool            IsRunning() const { return m_hCaptureThread != NULL; }
+
+    // Blocks until the source has reached the end of the stream and the
+    // final block has reached the sink, or a stage has failed.  Only useful
+    // with non real-time sources.
+    DWORD           WaitForEndOfStream( DWORD dwTimeoutMs );
+
+    // S_OK, or the first error a stage ran into.  A failed stage stops the
+    // pipeline and signals the end of the stream.
+    HRESULT         GetResult() const { return ( HRESULT )m_hrResult; }
+
+    void            GetStats( AUDIO_PIPELINE_STATS* pStats );
+
+protected:
+    typedef DXUTLockFreePipe<AUDIO_PIPE_SIZE_LOG2> CAudioPipe;
+
+    unsigned int    CaptureThreadProc();
+    unsigned int    FilterThreadProc();
+    unsigned int    PlaybackThreadProc();
+
+    friend unsigned int WINAPI _AudioCaptureThreadProc( LPVOID lpParameter );
+    friend unsigned int WINAPI _AudioFilterThreadProc( LPVOID lpParameter );
+    friend unsigned int WINAPI _AudioPlaybackThreadProc( LPVOID lpParameter );
+
+    bool            WriteBlock( CAudioPipe* pPipe, HANDLE hDataReady, BYTE* pbPacket, bool bWait );
+    bool            ReadBlock( CAudioPipe* pPipe, HANDLE hDataReady, BYTE* pbPacket );
+    void            Fail( HRESULT hr );
+
+    CAudioPipe*     m_pCapturePipe;     // capture -> filter
+    CAudioPipe*     m_pOutputPipe;      // filter -> playback
+
+    CAudioSource*   m_pSource;
+    CAudioFilterGraph* m_pGraph;
+    CAudioSink*     m_pSink;
+    DWORD           m_dwBlockSize;
+    DWORD           m_cbPacket;
+
+    HANDLE          m_hCaptureThread;
+    HANDLE          m_hFilterThread;
+    HANDLE          m_hPlaybackThread;
+    HANDLE          m_hCaptureDataReady;
+    HANDLE          m_hOutputDataReady;
+    HANDLE          m_hEndOfStream;
+    volatile BOOL   m_bDone;
+    volatile LONG   m_hrResult;
+
+    // Written only by the thread named in the comment; read after Stop()
+    // or, for display, while running
+    LONGLONG        m_llFrequency;
+    LONGLONG        m_llStartTime;
+    DWORD           m_dwOverruns;       // capture thread
+    LONGLONG        m_llFilterTime;     // filter thread
+    DWORD           m_dwBlocks;         // playback thread
+    LONGLONG        m_llBytes;          // playback thread
+    LONGLONG        m_llLatencyMin;     // playback thread
+    LONGLONG        m_llLatencyMax;     // playback thread
+    LONGLONG        m_llLatencySum;     // playback thread
+    LONGLONG        m_llLastOutputTime; // playback thread
+};
+
+#endif
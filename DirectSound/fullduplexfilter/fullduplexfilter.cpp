@@ -9,6 +9,8 @@
 //-----------------------------------------------------------------------------
 #include "DXUT.h"
 #include "SDKsound.h"
+#include "AudioPipeline.h"
+#include <process.h>
 #include "resource.h"
 
 
@@ -37,10 +39,12 @@ INT_PTR CALLBACK MainDlgProc( HWND hDlg, UINT msg, WPARAM wParam, LPARAM lParam
 HRESULT SetMainDialogText( HWND hDlg );
 HRESULT OnInitMainDialog( HWND hDlg );
 HRESULT StartBuffers();
+VOID    StopBuffers();
 HRESULT RestoreBuffer( LPDIRECTSOUNDBUFFER pDSBuffer, BOOL* pbRestored );
+VOID    UpdateLatencyText( HWND hDlg );
 
-HRESULT HandleNotification();
-HRESULT TransformData( BYTE* pbOut, BYTE* pbIn, DWORD dwLength );
+INT     RunFilePipeline( LPWSTR strInputFile, LPWSTR strOutputFile );
+INT     RunPipeBenchmark( int nArgs, LPWSTR* pstrArgs );
 
 
 
@@ -50,6 +54,7 @@ HRESULT TransformData( BYTE* pbOut, BYTE* pbIn, DWORD dwLength );
 #define NUM_PLAY_NOTIFICATIONS  16
 #define NUM_BUFFERS     (16)
 #define MAX(a,b)        ( (a) > (b) ? (a) : (b) )
+#define IDT_LATENCY     1
 
 LPDIRECTSOUND              g_pDS            = NULL;
 LPDIRECTSOUNDCAPTURE       g_pDSCapture     = NULL;
@@ -70,6 +75,13 @@ DWORD                g_dwNotifySize;
 WAVEFORMATEX         g_wfxCaptureWaveFormat;
 BOOL                 g_bRecording;
 
+// Capture, filtering and playback each run on their own thread; see AudioPipeline.h
+CAudioPipeline        g_AudioPipeline;
+CAudioFilterGraph     g_FilterGraph;
+CEchoFilter           g_EchoFilter( 250, 0.4f );
+CDSoundCaptureSource* g_pCaptureSource = NULL;
+CDSoundOutputSink*    g_pOutputSink    = NULL;
+
 
 
 
@@ -83,9 +95,32 @@ INT APIENTRY wWinMain( HINSTANCE hInst, HINSTANCE hPrevInst, LPWSTR pCmdLine,
 {
     DWORD   dwResult;
     MSG     msg;
-    BOOL    bDone;
     HRESULT hr;
     HWND    hDlg;
+
+    g_FilterGraph.AddFilter( &g_EchoFilter );
+
+    // "-file input.wav output.wav" runs the filter pipeline headless
+    // between two wave files and reports latency and throughput.
+    // "-pipebench" checks and times the lock-free rings.
+    int nNumArgs;
+    LPWSTR* pstrArgList = CommandLineToArgvW( GetCommandLineW(), &nNumArgs );
+    if( pstrArgList )
+    {
+        if( nNumArgs == 4 && _wcsicmp( pstrArgList[1], L"-file" ) == 0 )
+        {
+            INT nResult = RunFilePipeline( pstrArgList[2], pstrArgList[3] );
+            LocalFree( pstrArgList );
+            return nResult;
+        }
+        if( nNumArgs >= 2 && _wcsicmp( pstrArgList[1], L"-pipebench" ) == 0 )
+        {
+            INT nResult = RunPipeBenchmark( nNumArgs - 2, pstrArgList + 2 );
+            LocalFree( pstrArgList );
+            return nResult;
+        }
+        LocalFree( pstrArgList );
+    }
     
     g_hNotificationEvent = CreateEvent( NULL, FALSE, FALSE, NULL );
 
@@ -141,48 +176,19 @@ INT APIENTRY wWinMain( HINSTANCE hInst, HINSTANCE hPrevInst, LPWSTR pCmdLine,
         ShowWindow( hDlg, SW_SHOW ); 
     }
 
-    bDone = FALSE;
-    while( !bDone ) 
+    // The capture notifications are serviced by the pipeline's capture
+    // thread, so this thread only needs to pump messages
+    while( GetMessage( &msg, NULL, 0, 0 ) > 0 ) 
     { 
-        dwResult = MsgWaitForMultipleObjects( 1, &g_hNotificationEvent, 
-                                              FALSE, INFINITE, QS_ALLEVENTS );
-        switch( dwResult )
+        if( !IsDialogMessage( hDlg, &msg ) )  
         {
-            case WAIT_OBJECT_0 + 0:
-                // g_hNotificationEvent is signaled
-
-                // This means that DirectSound just finished playing 
-                // a piece of the buffer, so we need to fill the circular 
-                // buffer with new sound from the wav file
-                if( FAILED( hr = HandleNotification() ) )
-                {
-                    DXTRACE_ERR_MSGBOX( TEXT("HandleNotification"), hr );
-                    MessageBox( hDlg, L"Error handling DirectSound notifications. "
-                               L"The sample will now exit.", L"DirectSound Sample", 
-                               MB_OK | MB_ICONERROR );
-                    bDone = TRUE;
-                }
-
-                break;
-
-            case WAIT_OBJECT_0 + 1:
-                // Messages are available
-                while( PeekMessage( &msg, NULL, 0, 0, PM_REMOVE ) ) 
-                { 
-                    if( !IsDialogMessage( hDlg, &msg ) )  
-                    {
-                        TranslateMessage( &msg ); 
-                        DispatchMessage( &msg ); 
-                    }
-
-                    if( msg.message == WM_QUIT )
-                        bDone = TRUE;
-                }
-                break;
+            TranslateMessage( &msg ); 
+            DispatchMessage( &msg ); 
         }
     }
 
     // Clean up everything
+    g_AudioPipeline.Stop();
     FreeDirectSound();
 
     CloseHandle( g_hNotificationEvent );
@@ -245,6 +251,9 @@ HRESULT InitDirectSound( HWND hDlg )
 //-----------------------------------------------------------------------------
 HRESULT FreeDirectSound()
 {
+    SAFE_DELETE( g_pCaptureSource );
+    SAFE_DELETE( g_pOutputSink );
+
     // Release DirectSound interfaces
     SAFE_RELEASE( g_pDSNotify );
 
@@ -756,9 +765,9 @@ HRESULT CreateOutputBuffer()
 
     // This sample works by creating notification events which 
     // are signaled when the capture buffer reachs specific offsets 
-    // WinMain() waits for the associated event to be signaled, and
-    // when it is, it calls HandleNotifications() which copy the 
-    // data from the capture buffer into the output buffer
+    // The pipeline's capture thread waits for the associated event to be
+    // signaled, and when it is, it copies the data out of the capture
+    // buffer and passes it on to the filter and playback threads
 
     ZeroMemory( &wfxInput, sizeof(wfxInput) );
     g_pDSBCapture->GetFormat( &wfxInput, sizeof(wfxInput), NULL );
@@ -795,6 +804,16 @@ HRESULT CreateOutputBuffer()
                                                             g_aPosNotify ) ) )
         return DXTRACE_ERR_MSGBOX( TEXT("SetNotificationPositions"), hr );
 
+    // Create the pipeline endpoints for the two buffers
+    SAFE_DELETE( g_pCaptureSource );
+    SAFE_DELETE( g_pOutputSink );
+    g_pCaptureSource = new CDSoundCaptureSource( g_pDSBCapture, g_hNotificationEvent,
+                                                 g_dwCaptureBufferSize, g_dwNotifySize );
+    g_pOutputSink = new CDSoundOutputSink( g_pDSBOutput, g_dwOutputBufferSize,
+                                           wfxInput.nAvgBytesPerSec );
+    if( !g_pCaptureSource || !g_pOutputSink )
+        return E_OUTOFMEMORY;
+
     return S_OK;
 }
 
@@ -840,14 +859,14 @@ INT_PTR CALLBACK MainDlgProc( HWND hDlg, UINT msg, WPARAM wParam, LPARAM lParam
                     }
                     else
                     {
-                        if( g_pDSBCapture && g_pDSBOutput )
-                        {
-                            g_pDSBCapture->Stop();
-                            g_pDSBOutput->Stop();
-                        }
+                        StopBuffers();
                     }
                     break;
 
+                case IDC_ENABLE_FILTER:
+                    g_FilterGraph.SetBypass( IsDlgButtonChecked( hDlg, IDC_ENABLE_FILTER ) != BST_CHECKED );
+                    break;
+
                 default:
                     return FALSE; // Didn't handle message
             }
@@ -856,11 +875,7 @@ INT_PTR CALLBACK MainDlgProc( HWND hDlg, UINT msg, WPARAM wParam, LPARAM lParam
         case WM_ACTIVATE:
             if( LOWORD(wParam) == WA_INACTIVE )
             {
-                if( g_pDSBCapture && g_pDSBOutput )
-                {
-                    g_pDSBCapture->Stop();
-                    g_pDSBOutput->Stop();
-                }
+                StopBuffers();
             }
             else
             {
@@ -879,6 +894,15 @@ INT_PTR CALLBACK MainDlgProc( HWND hDlg, UINT msg, WPARAM wParam, LPARAM lParam
             }
             break;
 
+        case WM_TIMER:
+            if( wParam == IDT_LATENCY )
+                UpdateLatencyText( hDlg );
+            break;
+
+        case WM_DESTROY:
+            KillTimer( hDlg, IDT_LATENCY );
+            break;
+
         default:
             return FALSE; // Didn't handle message
     }
@@ -910,6 +934,11 @@ HRESULT OnInitMainDialog( HWND hDlg )
     SendMessage( hDlg, WM_SETICON, ICON_BIG,   (LPARAM) hIcon );  // Set big icon
     SendMessage( hDlg, WM_SETICON, ICON_SMALL, (LPARAM) hIcon );  // Set small icon
 
+    CheckDlgButton( hDlg, IDC_ENABLE_FILTER, g_FilterGraph.GetBypass() ? BST_UNCHECKED : BST_CHECKED );
+
+    // Refresh the latency readout twice a second
+    SetTimer( hDlg, IDT_LATENCY, 500, NULL );
+
     return S_OK;
 }
 
@@ -927,6 +956,9 @@ HRESULT StartBuffers()
     DWORD        dwDSLockedBufferSize;
     HRESULT hr;
 
+    // The pipeline threads must not touch the buffers while we reset them
+    g_AudioPipeline.Stop();
+
     // Restore lost buffers
     if( FAILED( hr = RestoreBuffer( g_pDSBOutput, NULL ) ) )
         return DXTRACE_ERR_MSGBOX( TEXT("RestoreBuffer"), hr );
@@ -958,7 +990,7 @@ HRESULT StartBuffers()
     g_pDSBOutput->GetFormat( &wfxOutput, sizeof(wfxOutput), NULL );
 
     // Fill the output buffer with silence at first
-    // As capture data arrives, HandleNotifications() will fill
+    // As capture data arrives, the pipeline's playback thread will fill
     // the output buffer with wave data.
     if( FAILED( hr = g_pDSBOutput->Lock( 0, g_dwOutputBufferSize, 
                                          &pDSLockedBuffer, &dwDSLockedBufferSize, 
@@ -971,12 +1003,37 @@ HRESULT StartBuffers()
     // Play the output buffer 
     g_pDSBOutput->Play( 0, 0, DSBPLAY_LOOPING );
 
+    // Start the capture, filter and playback threads
+    g_pCaptureSource->Reset( g_dwNextCaptureOffset );
+    g_pOutputSink->Reset( g_dwNextOutputOffset );
+    if( FAILED( hr = g_AudioPipeline.Start( g_pCaptureSource, &g_FilterGraph, g_pOutputSink,
+                                            &g_wfxCaptureWaveFormat, g_dwNotifySize ) ) )
+        return DXTRACE_ERR_MSGBOX( TEXT("CAudioPipeline::Start"), hr );
+
     return S_OK;
 }
 
 
 
 
+//-----------------------------------------------------------------------------
+// Name: StopBuffers()
+// Desc: Stops the pipeline threads, then the capture and output buffers
+//-----------------------------------------------------------------------------
+VOID StopBuffers()
+{
+    g_AudioPipeline.Stop();
+
+    if( g_pDSBCapture && g_pDSBOutput )
+    {
+        g_pDSBCapture->Stop();
+        g_pDSBOutput->Stop();
+    }
+}
+
+
+
+
 //-----------------------------------------------------------------------------
 // Name: RestoreBuffer()
 // Desc: Restores a lost buffer. *pbWasRestored returns TRUE if the buffer was 
@@ -1025,76 +1082,605 @@ HRESULT RestoreBuffer( LPDIRECTSOUNDBUFFER pDSBuffer, BOOL* pbRestored )
 
 
 //-----------------------------------------------------------------------------
-// Name: HandleNotification()
-// Desc: Handle the notification that tells us to copy data from the 
-//       capture buffer to the output buffer 
+// Name: UpdateLatencyText()
+// Desc: Shows the capture-to-output latency measured by the pipeline
 //-----------------------------------------------------------------------------
-HRESULT HandleNotification() 
+VOID UpdateLatencyText( HWND hDlg )
+{
+    TCHAR strLatency[255];
+    AUDIO_PIPELINE_STATS stats;
+
+    if( !g_AudioPipeline.IsRunning() )
+        return;
+
+    g_AudioPipeline.GetStats( &stats );
+
+    swprintf_s( strLatency, 255, TEXT("%.1f ms avg (%.1f - %.1f), %u dropped"),
+                stats.fLatencyAvg, stats.fLatencyMin, stats.fLatencyMax, stats.dwOverruns );
+
+    SetWindowText( GetDlgItem( hDlg, IDC_MAIN_LATENCY_TEXT ), strLatency );
+}
+
+
+
+
+//-----------------------------------------------------------------------------
+// Name: RunFilePipeline()
+// Desc: Runs the filter graph headless from one wave file to another and
+//       writes the latency and throughput figures to the console
+//-----------------------------------------------------------------------------
+INT RunFilePipeline( LPWSTR strInputFile, LPWSTR strOutputFile )
 {
     HRESULT hr;
-    VOID* pDSCaptureLockedBuffer    = NULL;
-    VOID* pDSOutputLockedBuffer     = NULL;
-    DWORD dwDSCaptureLockedBufferSize;
-    DWORD dwDSOutputLockedBufferSize;
-   
-    DWORD dwStatus;
+    CWaveFileSource source;
+    CWaveFileSink   sink;
+    CAudioPipeline  pipeline;
+    AUDIO_PIPELINE_STATS stats;
 
-    // Make sure buffers were not lost, if the were we need 
-    // to start the capture again
-    if( FAILED( hr = g_pDSBOutput->GetStatus( &dwStatus ) ) )
-        return DXTRACE_ERR_MSGBOX( TEXT("GetStatus"), hr );
+    // Report to the console we were started from, if any
+    if( AttachConsole( ATTACH_PARENT_PROCESS ) )
+    {
+        FILE* pFile;
+        freopen_s( &pFile, "CONOUT$", "w", stdout );
+    }
 
-    if( dwStatus & DSBSTATUS_BUFFERLOST )
+    if( FAILED( hr = source.Open( strInputFile ) ) )
     {
-        if( FAILED( hr = StartBuffers() ) )
-            return DXTRACE_ERR_MSGBOX( TEXT("StartBuffers"), hr );
+        wprintf( L"Failed to open %s (0x%08X)\n", strInputFile, hr );
+        return 1;
+    }
 
-        return S_OK;
+    WAVEFORMATEX* pwfx = source.GetFormat();
+    if( FAILED( hr = sink.Open( strOutputFile, pwfx ) ) )
+    {
+        wprintf( L"Failed to create %s (0x%08X)\n", strOutputFile, hr );
+        return 1;
     }
 
-    // Lock the capture buffer down
-    if( FAILED( hr = g_pDSBCapture->Lock( g_dwNextCaptureOffset, g_dwNotifySize, 
-                                          &pDSCaptureLockedBuffer, 
-                                          &dwDSCaptureLockedBufferSize, 
-                                          NULL, NULL, 0L ) ) )
-        return DXTRACE_ERR_MSGBOX( TEXT("Lock"), hr );
+    // Use the same block size the live path would use for this format
+    DWORD dwBlockSize = MAX( 4096, pwfx->nAvgBytesPerSec / 8 );
+    dwBlockSize -= dwBlockSize % pwfx->nBlockAlign;
 
-    // Lock the output buffer down
-    if( FAILED( hr = g_pDSBOutput->Lock( g_dwNextOutputOffset, g_dwNotifySize, 
-                                         &pDSOutputLockedBuffer, 
-                                         &dwDSOutputLockedBufferSize, 
-                                         NULL, NULL, 0L ) ) )
-        return DXTRACE_ERR_MSGBOX( TEXT("Lock"), hr );
+    if( FAILED( hr = pipeline.Start( &source, &g_FilterGraph, &sink, pwfx, dwBlockSize ) ) )
+    {
+        wprintf( L"Failed to start the pipeline (0x%08X)\n", hr );
+        return 1;
+    }
 
-    // These should be equal
-    if( dwDSOutputLockedBufferSize != dwDSCaptureLockedBufferSize )
-        return E_FAIL;  // Sanity check unhandled case 
+    pipeline.WaitForEndOfStream( INFINITE );
+    pipeline.Stop();
+    sink.Close();
 
-    // Just copy the memory from the 
-    // capture buffer to the playback buffer 
-    CopyMemory( pDSOutputLockedBuffer, 
-                pDSCaptureLockedBuffer, 
-                dwDSOutputLockedBufferSize );
+    if( FAILED( hr = pipeline.GetResult() ) )
+    {
+        wprintf( L"The pipeline failed (0x%08X)\n", hr );
+        return 1;
+    }
 
-    // Unlock the play buffer
-    g_pDSBOutput->Unlock( pDSOutputLockedBuffer, dwDSOutputLockedBufferSize, 
-                          NULL, 0 );
+    pipeline.GetStats( &stats );
 
-    // Unlock the capture buffer
-    g_pDSBCapture->Unlock( pDSCaptureLockedBuffer, dwDSCaptureLockedBufferSize, 
-                           NULL, 0 );
+    double fAudioSeconds = ( double )stats.llBytes / pwfx->nAvgBytesPerSec;
+    wprintf( L"Blocks:     %u x %u bytes\n", stats.dwBlocks, dwBlockSize );
+    wprintf( L"Latency:    %.3f ms avg, %.3f ms min, %.3f ms max\n",
+             stats.fLatencyAvg, stats.fLatencyMin, stats.fLatencyMax );
+    wprintf( L"Filter:     %.3f ms per block\n", stats.fFilterTimeAvg );
+    wprintf( L"Throughput: %.1f MB/s, %.1fx real time\n",
+             stats.fElapsed > 0 ? stats.llBytes / ( 1024.0 * 1024.0 ) / stats.fElapsed : 0.0,
+             stats.fElapsed > 0 ? fAudioSeconds / stats.fElapsed : 0.0 );
 
-    // Move the capture offset along
-    g_dwNextCaptureOffset += dwDSCaptureLockedBufferSize; 
-    g_dwNextCaptureOffset %= g_dwCaptureBufferSize; // Circular buffer
+    return 0;
+}
 
-    // Move the playback offset along
-    g_dwNextOutputOffset += dwDSOutputLockedBufferSize; 
-    g_dwNextOutputOffset %= g_dwOutputBufferSize; // Circular buffer
 
-    return S_OK;
+
+
+//-----------------------------------------------------------------------------
+// Pipe benchmark
+//
+// "-pipebench [-mb n] [-items n] [-threads n]" checks DXUTLockFreePipe and
+// DXUTLockFreeQueue under load from several threads and times them:
+//
+//  - The pipe, through Read/Write and through ReserveRead/ReserveWrite,
+//    carries n MB of records of varying size, so they wrap around the end of
+//    the ring at every offset.  Each record holds its sequence number and a
+//    pattern made from it, and the reader checks both.
+//  - The queue is run with 1, 2, 4 and so on up to -threads producers and as
+//    many consumers, singly and in batches.  Each consumer checks that the
+//    items of each producer reach it in the order they were pushed, and the
+//    counts and sums of all the items popped must be those pushed.
+//
+// Returns 1 if any check fails.
+//-----------------------------------------------------------------------------
+#define PIPEBENCH_PIPE_SIZE_LOG2    16
+#define PIPEBENCH_QUEUE_SIZE_LOG2   12
+#define PIPEBENCH_MAX_RECORD        4096
+#define PIPEBENCH_MAX_THREADS       16
+#define PIPEBENCH_BATCH             16
+
+typedef DXUTLockFreePipe<PIPEBENCH_PIPE_SIZE_LOG2> CBenchPipe;
+typedef DXUTLockFreeQueue<ULONGLONG, PIPEBENCH_QUEUE_SIZE_LOG2> CBenchQueue;
+
+struct PIPEBENCH_RECORD_HEADER
+{
+    DWORD dwSequence;
+    DWORD cbRecord;             // Including this header
+};
+
+struct PIPEBENCH_PIPE_JOB
+{
+    CBenchPipe* pPipe;
+    bool bZeroCopy;
+    LONGLONG llBytes;           // To send
+    volatile LONG* pnStart;
+    volatile LONG nWriterDone;  // Set once the writer has sent everything
+    volatile LONG nAbort;       // Set by the reader when it finds a bad record
+    DWORD dwErrors;             // Found by the reader
+};
+
+struct PIPEBENCH_QUEUE_THREAD
+{
+    CBenchQueue* pQueue;
+    UINT iThread;               // Producer number, or consumer number
+    UINT nProducers;
+    UINT nItems;                // Each producer pushes this many
+    UINT nBatch;
+    volatile LONG* pnStart;
+    volatile LONG* pnProducersDone;
+    volatile LONG* pnPopped;
+    UINT nTotalItems;
+
+    // Consumer results
+    DWORD dwErrors;
+    ULONGLONG anCount[PIPEBENCH_MAX_THREADS];
+    ULONGLONG anSum[PIPEBENCH_MAX_THREADS];
+};
+
+
+//-----------------------------------------------------------------------------
+// Each record is a header and then bytes made from its sequence number.  The
+// sizes vary so that records land across the end of the ring at every offset.
+//-----------------------------------------------------------------------------
+static DWORD GetRecordSize( DWORD dwSequence )
+{
+    return sizeof( PIPEBENCH_RECORD_HEADER ) + ( dwSequence * 2654435761u >> 20 ) %
+           ( PIPEBENCH_MAX_RECORD - sizeof( PIPEBENCH_RECORD_HEADER ) );
+}
+
+static BYTE GetRecordByte( DWORD dwSequence, DWORD i )
+{
+    return ( BYTE )( dwSequence * 31 + i * 7 );
+}
+
+static void FillRecord( BYTE* pbRecord, DWORD dwSequence, DWORD cbRecord )
+{
+    PIPEBENCH_RECORD_HEADER* pHeader = ( PIPEBENCH_RECORD_HEADER* )pbRecord;
+    pHeader->dwSequence = dwSequence;
+    pHeader->cbRecord = cbRecord;
+    for( DWORD i = sizeof( PIPEBENCH_RECORD_HEADER ); i < cbRecord; i++ )
+        pbRecord[i] = GetRecordByte( dwSequence, i );
+}
+
+static bool CheckRecord( const BYTE* pbRecord, DWORD dwSequence )
+{
+    const PIPEBENCH_RECORD_HEADER* pHeader = ( const PIPEBENCH_RECORD_HEADER* )pbRecord;
+    if( pHeader->dwSequence != dwSequence || pHeader->cbRecord != GetRecordSize( dwSequence ) )
+        return false;
+    for( DWORD i = sizeof( PIPEBENCH_RECORD_HEADER ); i < pHeader->cbRecord; i++ )
+    {
+        if( pbRecord[i] != GetRecordByte( dwSequence, i ) )
+            return false;
+    }
+    return true;
+}
+
+static void CopyFromRegion( BYTE* pbDest, const DXUT_PIPE_REGION& Region )
+{
+    memcpy( pbDest, Region.pbData[0], Region.cbData[0] );
+    if( Region.pbData[1] )
+        memcpy( pbDest + Region.cbData[0], Region.pbData[1], Region.cbData[1] );
+}
+
+static void WaitForStart( volatile LONG* pnStart )
+{
+    while( 0 == *pnStart )
+        SwitchToThread();
+}
+
+// Called each time the reader finds too little in the pipe.  Once the writer has
+// finished the pipe gets one more try, and then the record is given up on.
+static bool KeepWaiting( const PIPEBENCH_PIPE_JOB* pJob, bool* pbLastTry )
+{
+    if( *pbLastTry )
+        return false;
+    *pbLastTry = 0 != pJob->nWriterDone;
+    SwitchToThread();
+    return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Name: PipeWriterThreadProc()
+// Desc: Writes records until llBytes have been sent.  Zero-copy records are
+//       built in the ring itself.  Stops early if the reader gives up.
+//-----------------------------------------------------------------------------
+unsigned int WINAPI PipeWriterThreadProc( LPVOID pParam )
+{
+    PIPEBENCH_PIPE_JOB* pJob = ( PIPEBENCH_PIPE_JOB* )pParam;
+    BYTE abRecord[PIPEBENCH_MAX_RECORD];
+
+    WaitForStart( pJob->pnStart );
+
+    LONGLONG llSent = 0;
+    for( DWORD dwSequence = 0; llSent < pJob->llBytes; dwSequence++ )
+    {
+        DWORD cbRecord = GetRecordSize( dwSequence );
+        FillRecord( abRecord, dwSequence, cbRecord );
+        if( pJob->bZeroCopy )
+        {
+            DXUT_PIPE_REGION Region;
+            while( !pJob->pPipe->ReserveWrite( cbRecord, &Region ) )
+            {
+                if( pJob->nAbort )
+                    return 0;
+                SwitchToThread();
+            }
+            memcpy( Region.pbData[0], abRecord, Region.cbData[0] );
+            if( Region.pbData[1] )
+                memcpy( Region.pbData[1], abRecord + Region.cbData[0], Region.cbData[1] );
+            pJob->pPipe->CommitWrite( cbRecord );
+        }
+        else
+        {
+            while( !pJob->pPipe->Write( abRecord, cbRecord ) )
+            {
+                if( pJob->nAbort )
+                    return 0;
+                SwitchToThread();
+            }
+        }
+        llSent += cbRecord;
+    }
+
+    InterlockedExchange( &pJob->nWriterDone, 1 );
+    return 0;
+}
+
+
+//-----------------------------------------------------------------------------
+// Name: ReadRecord()
+// Desc: Reads the next record into abRecord, in two parts so the size is known
+//       first.  Zero-copy records are reserved whole in the ring and copied
+//       out before they are let go.  Returns false if the writer finished
+//       before the whole record arrived.
+//-----------------------------------------------------------------------------
+static bool ReadRecord( PIPEBENCH_PIPE_JOB* pJob, BYTE* abRecord )
+{
+    const PIPEBENCH_RECORD_HEADER* pHeader = ( const PIPEBENCH_RECORD_HEADER* )abRecord;
+    bool bLastTry = false;
+
+    if( pJob->bZeroCopy )
+    {
+        DXUT_PIPE_REGION Region;
+        while( !pJob->pPipe->ReserveRead( sizeof( PIPEBENCH_RECORD_HEADER ), &Region ) )
+        {
+            if( !KeepWaiting( pJob, &bLastTry ) )
+                return false;
+        }
+        CopyFromRegion( abRecord, Region );
+
+        DWORD cbRecord = __min( pHeader->cbRecord, ( DWORD )PIPEBENCH_MAX_RECORD );
+        cbRecord = __max( cbRecord, ( DWORD )sizeof( PIPEBENCH_RECORD_HEADER ) );
+        bLastTry = false;
+        while( !pJob->pPipe->ReserveRead( cbRecord, &Region ) )
+        {
+            if( !KeepWaiting( pJob, &bLastTry ) )
+                return false;
+        }
+        CopyFromRegion( abRecord, Region );
+        pJob->pPipe->CommitRead( cbRecord );
+    }
+    else
+    {
+        while( !pJob->pPipe->Read( abRecord, sizeof( PIPEBENCH_RECORD_HEADER ) ) )
+        {
+            if( !KeepWaiting( pJob, &bLastTry ) )
+                return false;
+        }
+
+        DWORD cbRecord = __min( pHeader->cbRecord, ( DWORD )PIPEBENCH_MAX_RECORD );
+        cbRecord = __max( cbRecord, ( DWORD )sizeof( PIPEBENCH_RECORD_HEADER ) );
+        DWORD cbRest = cbRecord - sizeof( PIPEBENCH_RECORD_HEADER );
+        bLastTry = false;
+        while( !pJob->pPipe->Read( abRecord + sizeof( PIPEBENCH_RECORD_HEADER ), cbRest ) )
+        {
+            if( !KeepWaiting( pJob, &bLastTry ) )
+                return false;
+        }
+    }
+
+    return true;
+}
+
+
+//-----------------------------------------------------------------------------
+// Name: PipeReaderThreadProc()
+// Desc: Reads the records back and checks each one.  On the first bad record
+//       the writer is told to stop, as the stream can't be followed after it.
+//-----------------------------------------------------------------------------
+unsigned int WINAPI PipeReaderThreadProc( LPVOID pParam )
+{
+    PIPEBENCH_PIPE_JOB* pJob = ( PIPEBENCH_PIPE_JOB* )pParam;
+    BYTE abRecord[PIPEBENCH_MAX_RECORD];
+    const PIPEBENCH_RECORD_HEADER* pHeader = ( const PIPEBENCH_RECORD_HEADER* )abRecord;
+
+    WaitForStart( pJob->pnStart );
+
+    LONGLONG llReceived = 0;
+    for( DWORD dwSequence = 0; llReceived < pJob->llBytes; dwSequence++ )
+    {
+        if( !ReadRecord( pJob, abRecord ) || !CheckRecord( abRecord, dwSequence ) )
+        {
+            pJob->dwErrors++;
+            InterlockedExchange( &pJob->nAbort, 1 );
+            break;
+        }
+        llReceived += pHeader->cbRecord;
+    }
+
+    return 0;
+}
+
+
+//-----------------------------------------------------------------------------
+// Name: QueueProducerThreadProc()
+// Desc: Pushes the producer's number and a sequence number in each item
+//-----------------------------------------------------------------------------
+unsigned int WINAPI QueueProducerThreadProc( LPVOID pParam )
+{
+    PIPEBENCH_QUEUE_THREAD* pThread = ( PIPEBENCH_QUEUE_THREAD* )pParam;
+    ULONGLONG aItems[PIPEBENCH_BATCH];
+
+    WaitForStart( pThread->pnStart );
+
+    for( UINT i = 0; i < pThread->nItems; )
+    {
+        UINT nBatch = __min( pThread->nBatch, pThread->nItems - i );
+        for( UINT j = 0; j < nBatch; j++ )
+            aItems[j] = ( ( ULONGLONG )pThread->iThread << 32 ) | ( i + j );
+
+        UINT nPushed = ( 1 == nBatch ) ? ( pThread->pQueue->Push( aItems[0] ) ? 1 : 0 ) :
+                       pThread->pQueue->PushBatch( aItems, nBatch );
+        if( 0 == nPushed )
+            SwitchToThread();
+        i += nPushed;
+    }
+
+    InterlockedIncrement( pThread->pnProducersDone );
+    return 0;
+}
+
+
+//-----------------------------------------------------------------------------
+// Name: QueueConsumerThreadProc()
+// Desc: Pops until every item pushed has been popped by some consumer
+//-----------------------------------------------------------------------------
+unsigned int WINAPI QueueConsumerThreadProc( LPVOID pParam )
+{
+    PIPEBENCH_QUEUE_THREAD* pThread = ( PIPEBENCH_QUEUE_THREAD* )pParam;
+    ULONGLONG aItems[PIPEBENCH_BATCH];
+    LONGLONG anLast[PIPEBENCH_MAX_THREADS];
+    for( UINT i = 0; i < pThread->nProducers; i++ )
+        anLast[i] = -1;
+
+    WaitForStart( pThread->pnStart );
+
+    while( ( UINT )*pThread->pnPopped < pThread->nTotalItems )
+    {
+        UINT nPopped = ( 1 == pThread->nBatch ) ? ( pThread->pQueue->Pop( &aItems[0] ) ? 1 : 0 ) :
+                       pThread->pQueue->PopBatch( aItems, pThread->nBatch );
+        if( 0 == nPopped )
+        {
+            SwitchToThread();
+            continue;
+        }
+        InterlockedExchangeAdd( pThread->pnPopped, ( LONG )nPopped );
+
+        for( UINT j = 0; j < nPopped; j++ )
+        {
+            UINT iProducer = ( UINT )( aItems[j] >> 32 );
+            LONGLONG nSequence = ( LONGLONG )( aItems[j] & 0xFFFFFFFF );
+            if( iProducer >= pThread->nProducers || nSequence <= anLast[iProducer] )
+            {
+                pThread->dwErrors++;
+                continue;
+            }
+            anLast[iProducer] = nSequence;
+            pThread->anCount[iProducer]++;
+            pThread->anSum[iProducer] += ( ULONGLONG )nSequence;
+        }
+    }
+
+    return 0;
 }
 
 
+//-----------------------------------------------------------------------------
+// Name: RunBenchThreads()
+// Desc: Starts the threads, lets them all go at once, and returns the
+//       milliseconds until the last one finished, or -1 if they couldn't all
+//       be started
+//-----------------------------------------------------------------------------
+static double RunBenchThreads( UINT nThreads, _beginthreadex_proc_type* apfnProc, void** apParam,
+                               volatile LONG* pnStart )
+{
+    HANDLE ahThreads[2 * PIPEBENCH_MAX_THREADS];
+    UINT nStarted = 0;
+    *pnStart = 0;
+    for( ; nStarted < nThreads; nStarted++ )
+    {
+        ahThreads[nStarted] = ( HANDLE )_beginthreadex( NULL, 0, apfnProc[nStarted], apParam[nStarted], 0, NULL );
+        if( !ahThreads[nStarted] )
+            break;
+    }
+
+    // The threads that did start would wait forever for the others
+    if( nStarted < nThreads )
+    {
+        wprintf( L"Couldn't start %u threads\n", nThreads );
+        ExitProcess( 1 );
+    }
+
+    LARGE_INTEGER liFreq, liStart, liEnd;
+    QueryPerformanceFrequency( &liFreq );
+    QueryPerformanceCounter( &liStart );
+    InterlockedExchange( pnStart, 1 );
+    WaitForMultipleObjects( nStarted, ahThreads, TRUE, INFINITE );
+    QueryPerformanceCounter( &liEnd );
+
+    for( UINT i = 0; i < nStarted; i++ )
+        CloseHandle( ahThreads[i] );
+
+    return ( double )( liEnd.QuadPart - liStart.QuadPart ) * 1000.0 / ( double )liFreq.QuadPart;
+}
 
 
+//-----------------------------------------------------------------------------
+// Name: RunPipeBenchmark()
+//-----------------------------------------------------------------------------
+INT RunPipeBenchmark( int nArgs, LPWSTR* pstrArgs )
+{
+    // Report to the console we were started from, if any
+    if( AttachConsole( ATTACH_PARENT_PROCESS ) )
+    {
+        FILE* pFile;
+        freopen_s( &pFile, "CONOUT$", "w", stdout );
+    }
+
+    UINT nMegabytes = 256;
+    UINT nItems = 1 << 22;
+    UINT nMaxThreads = 0;
+    for( int i = 0; i + 1 < nArgs; i++ )
+    {
+        if( 0 == _wcsicmp( pstrArgs[i], L"-mb" ) )
+            nMegabytes = ( UINT )_wtoi( pstrArgs[++i] );
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-items" ) )
+            nItems = ( UINT )_wtoi( pstrArgs[++i] );
+        else if( 0 == _wcsicmp( pstrArgs[i], L"-threads" ) )
+            nMaxThreads = ( UINT )_wtoi( pstrArgs[++i] );
+    }
+    nMegabytes = __max( nMegabytes, 1u );
+    nItems = __max( nItems, 1u );
+    if( 0 == nMaxThreads )
+    {
+        SYSTEM_INFO SystemInfo;
+        GetSystemInfo( &SystemInfo );
+        nMaxThreads = SystemInfo.dwNumberOfProcessors;
+    }
+    nMaxThreads = __min( __max( nMaxThreads, 1u ), ( UINT )PIPEBENCH_MAX_THREADS );
+
+    INT nResult = 0;
+    volatile LONG nStart = 0;
+
+    // The pipe: one writer and one reader
+    wprintf( L"%-22s %9s %10s %8s\n", L"DXUTLockFreePipe", L"MB", L"ms", L"MB/s" );
+    for( UINT iMode = 0; iMode < 2; iMode++ )
+    {
+        CBenchPipe* pPipe = new CBenchPipe;
+        if( !pPipe )
+        {
+            wprintf( L"Out of memory\n" );
+            return 1;
+        }
+
+        PIPEBENCH_PIPE_JOB Job;
+        ZeroMemory( &Job, sizeof( Job ) );
+        Job.pPipe = pPipe;
+        Job.bZeroCopy = 1 == iMode;
+        Job.llBytes = ( LONGLONG )nMegabytes << 20;
+        Job.pnStart = &nStart;
+
+        _beginthreadex_proc_type apfnProc[2] = { PipeReaderThreadProc, PipeWriterThreadProc };
+        void* apParam[2] = { &Job, &Job };
+        double fTime = RunBenchThreads( 2, apfnProc, apParam, &nStart );
+        wprintf( L"%-22s %9u %10.1f %8.1f %s\n", Job.bZeroCopy ? L"ReserveWrite/Read" : L"Write/Read", nMegabytes,
+                 fTime, nMegabytes * 1000.0 / __max( fTime, 1e-3 ), Job.dwErrors ? L"FAILED" : L"" );
+        if( Job.dwErrors || 0 != pPipe->BytesAvailable() )
+            nResult = 1;
+
+        delete pPipe;
+    }
+
+    // The queue: n producers and n consumers
+    wprintf( L"\n%-22s %9s %10s %8s\n", L"DXUTLockFreeQueue", L"threads", L"ms", L"Mitems/s" );
+    for( UINT iMode = 0; iMode < 2; iMode++ )
+    {
+        const UINT nBatch = ( 0 == iMode ) ? 1 : PIPEBENCH_BATCH;
+        for( UINT nThreads = 1; ; nThreads = __min( nThreads * 2, nMaxThreads ) )
+        {
+            CBenchQueue* pQueue = new CBenchQueue;
+            PIPEBENCH_QUEUE_THREAD* aThreads = new PIPEBENCH_QUEUE_THREAD[ 2 * nThreads ];
+            if( !pQueue || !aThreads )
+            {
+                wprintf( L"Out of memory\n" );
+                return 1;
+            }
+
+            const UINT nPerProducer = __max( nItems / nThreads, 1u );
+            volatile LONG nProducersDone = 0;
+            volatile LONG nPopped = 0;
+            _beginthreadex_proc_type apfnProc[2 * PIPEBENCH_MAX_THREADS];
+            void* apParam[2 * PIPEBENCH_MAX_THREADS];
+            ZeroMemory( aThreads, 2 * nThreads * sizeof( PIPEBENCH_QUEUE_THREAD ) );
+            for( UINT i = 0; i < 2 * nThreads; i++ )
+            {
+                PIPEBENCH_QUEUE_THREAD& Thread = aThreads[i];
+                Thread.pQueue = pQueue;
+                Thread.iThread = i % nThreads;
+                Thread.nProducers = nThreads;
+                Thread.nItems = nPerProducer;
+                Thread.nBatch = nBatch;
+                Thread.pnStart = &nStart;
+                Thread.pnProducersDone = &nProducersDone;
+                Thread.pnPopped = &nPopped;
+                Thread.nTotalItems = nPerProducer * nThreads;
+                apfnProc[i] = ( i < nThreads ) ? QueueConsumerThreadProc : QueueProducerThreadProc;
+                apParam[i] = &Thread;
+            }
+
+            double fTime = RunBenchThreads( 2 * nThreads, apfnProc, apParam, &nStart );
+
+            // Every item of every producer popped exactly once
+            DWORD dwErrors = 0;
+            for( UINT iProducer = 0; iProducer < nThreads; iProducer++ )
+            {
+                ULONGLONG nCount = 0, nSum = 0;
+                for( UINT iConsumer = 0; iConsumer < nThreads; iConsumer++ )
+                {
+                    nCount += aThreads[iConsumer].anCount[iProducer];
+                    nSum += aThreads[iConsumer].anSum[iProducer];
+                }
+                if( nCount != nPerProducer || nSum != ( ULONGLONG )nPerProducer * ( nPerProducer - 1 ) / 2 )
+                    dwErrors++;
+            }
+            for( UINT iConsumer = 0; iConsumer < nThreads; iConsumer++ )
+                dwErrors += aThreads[iConsumer].dwErrors;
+            if( ( UINT )nProducersDone != nThreads || 0 != pQueue->GetCountApprox() )
+                dwErrors++;
+
+            WCHAR strName[32];
+            swprintf_s( strName, L"%s x%u", ( 1 == nBatch ) ? L"Push/Pop" : L"PushBatch/PopBatch", nBatch );
+            wprintf( L"%-22s %4u + %-2u %10.1f %8.2f %s\n", strName, nThreads, nThreads, fTime,
+                     nPerProducer * ( double )nThreads / ( 1000.0 * __max( fTime, 1e-3 ) ),
+                     dwErrors ? L"FAILED" : L"" );
+            if( dwErrors )
+                nResult = 1;
+
+            delete pQueue;
+            delete[] aThreads;
+            if( nThreads == nMaxThreads )
+                break;
+        }
+    }
+
+    return nResult;
+}
@@ -13,6 +13,7 @@
 #define IDC_ENABLE_FILTER               1017
 #define IDC_MAIN_SECONDARYFORMAT_TEXT   1018
 #define IDC_RECORD                      1019
+#define IDC_MAIN_LATENCY_TEXT           1021
 
 // Next default values for new objects
 // 
@@ -20,7 +21,7 @@
 #ifndef APSTUDIO_READONLY_SYMBOLS
 #define _APS_NEXT_RESOURCE_VALUE        133
 #define _APS_NEXT_COMMAND_VALUE         32771
-#define _APS_NEXT_CONTROL_VALUE         1021
+#define _APS_NEXT_CONTROL_VALUE         1022
 #define _APS_NEXT_SYMED_VALUE           101
 #endif
 #endif
@@ -0,0 +1,373 @@
+//--------------------------------------------------------------------------------------
+// File: GameReplay.cpp
+//
+// Input recording, snapshots and replay for the XInputGame simulation
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "GameReplay.h"
+
+
+//--------------------------------------------------------------------------------------
+CGameRollback::CGameRollback() :
+    m_pSlots( NULL ),
+    m_nSlots( 0 ),
+    m_nNextSlot( 0 ),
+    m_nInterval( 1 )
+{
+}
+
+
+//--------------------------------------------------------------------------------------
+CGameRollback::~CGameRollback()
+{
+    for( int i = 0; i < m_nSlots; i++ )
+        SAFE_DELETE_ARRAY( m_pSlots[i].pData );
+    SAFE_DELETE_ARRAY( m_pSlots );
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CGameRollback::Init( int nSlots, UINT nInterval )
+{
+    if( nSlots <= 0 || nInterval == 0 )
+        return E_INVALIDARG;
+
+    for( int i = 0; i < m_nSlots; i++ )
+        SAFE_DELETE_ARRAY( m_pSlots[i].pData );
+    SAFE_DELETE_ARRAY( m_pSlots );
+
+    m_pSlots = new SNAPSHOT[nSlots];
+    if( !m_pSlots )
+    {
+        m_nSlots = 0;
+        return E_OUTOFMEMORY;
+    }
+    ZeroMemory( m_pSlots, sizeof( SNAPSHOT ) * nSlots );
+
+    m_nSlots = nSlots;
+    m_nNextSlot = 0;
+    m_nInterval = nInterval;
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CGameRollback::Capture( const CGameSim* pSim )
+{
+    UINT nTick = pSim->GetState()->nTick;
+    if( m_nSlots == 0 || nTick % m_nInterval != 0 )
+        return S_FALSE;
+
+    // Slot buffers only ever grow, so steady state capture doesn't allocate
+    SNAPSHOT* pSlot = &m_pSlots[m_nNextSlot];
+    DWORD cbData = pSim->SaveState( NULL );
+    if( cbData > pSlot->cbMaxData )
+    {
+        SAFE_DELETE_ARRAY( pSlot->pData );
+        pSlot->bValid = false;
+        pSlot->cbMaxData = 0;
+        pSlot->pData = new BYTE[cbData];
+        if( !pSlot->pData )
+            return E_OUTOFMEMORY;
+        pSlot->cbMaxData = cbData;
+    }
+
+    pSim->SaveState( pSlot->pData );
+    pSlot->cbData = cbData;
+    pSlot->nTick = nTick;
+    pSlot->bValid = true;
+
+    m_nNextSlot = ( m_nNextSlot + 1 ) % m_nSlots;
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CGameRollback::Rewind( CGameSim* pSim, UINT nTick, UINT* pnRestoredTick )
+{
+    const SNAPSHOT* pBest = NULL;
+    for( int i = 0; i < m_nSlots; i++ )
+    {
+        const SNAPSHOT* pSlot = &m_pSlots[i];
+        if( pSlot->bValid && pSlot->nTick <= nTick && ( !pBest || pSlot->nTick > pBest->nTick ) )
+            pBest = pSlot;
+    }
+
+    if( !pBest )
+        return E_FAIL;
+
+    HRESULT hr = pSim->LoadState( pBest->pData, pBest->cbData );
+    if( SUCCEEDED( hr ) && pnRestoredTick )
+        *pnRestoredTick = pBest->nTick;
+    return hr;
+}
+
+
+//--------------------------------------------------------------------------------------
+CGameReplay::CGameReplay() :
+    m_pRecordSim( NULL ),
+    m_pInitialState( NULL ),
+    m_cbInitialState( 0 ),
+    m_fPendingWidth( 0.0f ),
+    m_fPendingHeight( 0.0f )
+{
+}
+
+
+//--------------------------------------------------------------------------------------
+CGameReplay::~CGameReplay()
+{
+    EndRecording();
+    SAFE_DELETE_ARRAY( m_pInitialState );
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CGameReplay::BeginRecording( CGameSim* pSim )
+{
+    EndRecording();
+    m_Ticks.RemoveAll();
+    m_fPendingWidth = 0.0f;
+    m_fPendingHeight = 0.0f;
+
+    SAFE_DELETE_ARRAY( m_pInitialState );
+    m_cbInitialState = pSim->SaveState( NULL );
+    m_pInitialState = new BYTE[m_cbInitialState];
+    if( !m_pInitialState )
+    {
+        m_cbInitialState = 0;
+        return E_OUTOFMEMORY;
+    }
+    pSim->SaveState( m_pInitialState );
+
+    m_pRecordSim = pSim;
+    pSim->SetRecorder( this );
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CGameReplay::EndRecording()
+{
+    if( m_pRecordSim )
+    {
+        m_pRecordSim->SetRecorder( NULL );
+        m_pRecordSim = NULL;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// A board size change lands between ticks, so it is kept until the next tick record
+//--------------------------------------------------------------------------------------
+void CGameReplay::RecordBoardSize( float fWidth, float fHeight )
+{
+    m_fPendingWidth = fWidth;
+    m_fPendingHeight = fHeight;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CGameReplay::RecordTick( const GAME_INPUT* pInput, UINT64 nHash )
+{
+    GAME_TICK_RECORD record;
+    ZeroMemory( &record, sizeof( GAME_TICK_RECORD ) );
+    record.input = *pInput;
+    record.fBoardWidth = m_fPendingWidth;
+    record.fBoardHeight = m_fPendingHeight;
+    record.nHash = nHash;
+    m_Ticks.Add( record );
+
+    m_fPendingWidth = 0.0f;
+    m_fPendingHeight = 0.0f;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CGameReplay::Save( LPCWSTR strFileName )
+{
+    if( !m_pInitialState )
+        return E_FAIL;
+
+    HANDLE hFile = CreateFile( strFileName, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL );
+    if( hFile == INVALID_HANDLE_VALUE )
+        return HRESULT_FROM_WIN32( GetLastError() );
+
+    GAME_REPLAY_HEADER header;
+    header.dwMagic = GAME_REPLAY_MAGIC;
+    header.dwVersion = GAME_REPLAY_VERSION;
+    header.dwTickRecordSize = sizeof( GAME_TICK_RECORD );
+    header.dwTicks = m_Ticks.GetSize();
+    header.cbInitialState = m_cbInitialState;
+
+    HRESULT hr = S_OK;
+    DWORD dwWritten;
+    if( !WriteFile( hFile, &header, sizeof( GAME_REPLAY_HEADER ), &dwWritten, NULL ) ||
+        !WriteFile( hFile, m_pInitialState, m_cbInitialState, &dwWritten, NULL ) ||
+        ( header.dwTicks > 0 &&
+          !WriteFile( hFile, m_Ticks.GetData(), header.dwTicks * sizeof( GAME_TICK_RECORD ), &dwWritten, NULL ) ) )
+    {
+        hr = HRESULT_FROM_WIN32( GetLastError() );
+    }
+
+    CloseHandle( hFile );
+    return hr;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CGameReplay::Load( LPCWSTR strFileName )
+{
+    EndRecording();
+    m_Ticks.RemoveAll();
+    SAFE_DELETE_ARRAY( m_pInitialState );
+    m_cbInitialState = 0;
+
+    HANDLE hFile = CreateFile( strFileName, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                               FILE_ATTRIBUTE_NORMAL, NULL );
+    if( hFile == INVALID_HANDLE_VALUE )
+        return HRESULT_FROM_WIN32( GetLastError() );
+
+    HRESULT hr = S_OK;
+    GAME_REPLAY_HEADER header;
+    DWORD dwRead;
+    if( !ReadFile( hFile, &header, sizeof( GAME_REPLAY_HEADER ), &dwRead, NULL ) ||
+        dwRead != sizeof( GAME_REPLAY_HEADER ) ||
+        header.dwMagic != GAME_REPLAY_MAGIC ||
+        header.dwVersion != GAME_REPLAY_VERSION ||
+        header.dwTickRecordSize != sizeof( GAME_TICK_RECORD ) ||
+        header.cbInitialState == 0 )
+    {
+        hr = E_FAIL;
+    }
+
+    if( SUCCEEDED( hr ) )
+    {
+        m_pInitialState = new BYTE[header.cbInitialState];
+        if( !m_pInitialState )
+            hr = E_OUTOFMEMORY;
+        else if( !ReadFile( hFile, m_pInitialState, header.cbInitialState, &dwRead, NULL ) ||
+                 dwRead != header.cbInitialState )
+            hr = E_FAIL;
+        else
+            m_cbInitialState = header.cbInitialState;
+    }
+
+    // The ticks are read a block at a time and added one by one, so the array's size
+    // is the number of ticks read
+    GAME_TICK_RECORD aTicks[GAME_REPLAY_READ_TICKS];
+    for( DWORD iTick = 0; SUCCEEDED( hr ) && iTick < header.dwTicks; )
+    {
+        DWORD nTicks = min( header.dwTicks - iTick, ( DWORD )GAME_REPLAY_READ_TICKS );
+        DWORD cbTicks = nTicks * sizeof( GAME_TICK_RECORD );
+        if( !ReadFile( hFile, aTicks, cbTicks, &dwRead, NULL ) || dwRead != cbTicks )
+            hr = E_FAIL;
+
+        for( DWORD i = 0; SUCCEEDED( hr ) && i < nTicks; i++ )
+            hr = m_Ticks.Add( aTicks[i] );
+        iTick += nTicks;
+    }
+
+    CloseHandle( hFile );
+
+    if( FAILED( hr ) )
+    {
+        m_Ticks.RemoveAll();
+        SAFE_DELETE_ARRAY( m_pInitialState );
+        m_cbInitialState = 0;
+    }
+
+    return hr;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CGameReplay::Play( CGameSim* pSim, GAME_REPLAY_STATS* pStats, UINT64* pHashes )
+{
+    HRESULT hr;
+
+    ZeroMemory( pStats, sizeof( GAME_REPLAY_STATS ) );
+    pStats->nFirstDivergence = -1;
+    pStats->nRollbackTick = -1;
+
+    if( !m_pInitialState )
+        return E_FAIL;
+    if( FAILED( hr = pSim->LoadState( m_pInitialState, m_cbInitialState ) ) )
+        return hr;
+
+    int nTicks = m_Ticks.GetSize();
+    UINT nStartTick = pSim->GetState()->nTick;
+
+    UINT64* pHashBuffer = pHashes;
+    if( !pHashBuffer && nTicks > 0 )
+    {
+        pHashBuffer = new UINT64[nTicks];
+        if( !pHashBuffer )
+            return E_OUTOFMEMORY;
+    }
+
+    CGameRollback rollback;
+    if( FAILED( hr = rollback.Init( GAME_ROLLBACK_SLOTS, GAME_ROLLBACK_INTERVAL ) ) )
+    {
+        if( pHashBuffer != pHashes )
+            delete[] pHashBuffer;
+        return hr;
+    }
+
+    LARGE_INTEGER qwFreq, qwStart, qwEnd;
+    QueryPerformanceFrequency( &qwFreq );
+    QueryPerformanceCounter( &qwStart );
+
+    for( int i = 0; i < nTicks; i++ )
+    {
+        const GAME_TICK_RECORD& record = m_Ticks[i];
+        if( record.fBoardWidth > 0.0f )
+            pSim->SetBoardSize( record.fBoardWidth, record.fBoardHeight );
+        pSim->Step( &record.input, NULL );
+
+        pHashBuffer[i] = pSim->GetStateHash();
+        if( pHashBuffer[i] != record.nHash && pStats->nFirstDivergence < 0 )
+            pStats->nFirstDivergence = i;
+
+        rollback.Capture( pSim );
+    }
+
+    QueryPerformanceCounter( &qwEnd );
+    pStats->nTicks = nTicks;
+    pStats->fSeconds = ( double )( qwEnd.QuadPart - qwStart.QuadPart ) / qwFreq.QuadPart;
+    pStats->fTicksPerSecond = ( pStats->fSeconds > 0.0 ) ? nTicks / pStats->fSeconds : 0.0;
+
+    // Rewind two thirds of the way in, or as far as the ring still reaches, and
+    // check that running forward again lands on the same states
+    if( nTicks > 0 )
+    {
+        int nTarget = max( nTicks * 2 / 3, nTicks - ( GAME_ROLLBACK_SLOTS - 1 ) * GAME_ROLLBACK_INTERVAL );
+        UINT nRestoredTick;
+        if( SUCCEEDED( rollback.Rewind( pSim, nStartTick + nTarget, &nRestoredTick ) ) )
+        {
+            pStats->nRollbackTick = ( int )( nRestoredTick - nStartTick );
+            pStats->bRollbackMatched = true;
+            for( int i = pStats->nRollbackTick; i < nTicks; i++ )
+            {
+                const GAME_TICK_RECORD& record = m_Ticks[i];
+                if( record.fBoardWidth > 0.0f )
+                    pSim->SetBoardSize( record.fBoardWidth, record.fBoardHeight );
+                pSim->Step( &record.input, NULL );
+
+                if( pSim->GetStateHash() != pHashBuffer[i] )
+                {
+                    pStats->bRollbackMatched = false;
+                    break;
+                }
+            }
+        }
+    }
+
+    if( pHashBuffer != pHashes )
+        delete[] pHashBuffer;
+
+    return S_OK;
+}
@@ -0,0 +1,124 @@
+//--------------------------------------------------------------------------------------
+// File: GameReplay.h
+//
+// Input recording, snapshots and replay for the XInputGame simulation.  A recording
+// is the state when recording began plus, for every tick, the controller input and
+// the hash of the state that tick produced.  Replaying re-runs the ticks headless and
+// reports the first tick whose hash differs from the recording.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#pragma once
+
+#include "GameSim.h"
+
+//--------------------------------------------------------------------------------------
+// Structs/defines
+//--------------------------------------------------------------------------------------
+#define GAME_REPLAY_MAGIC           0x50524758  // 'XGRP'
+#define GAME_REPLAY_VERSION         1
+
+#define GAME_ROLLBACK_SLOTS         8
+#define GAME_ROLLBACK_INTERVAL      60          // Ticks between snapshots
+#define GAME_REPLAY_READ_TICKS      256         // Ticks Load reads from the file at once
+
+struct GAME_TICK_RECORD
+{
+    GAME_INPUT input;
+    float fBoardWidth;          // Board size set before this tick, 0 if unchanged
+    float fBoardHeight;
+    UINT64 nHash;               // Hash of the state after the tick
+};
+
+// File layout: header, initial state, dwTicks GAME_TICK_RECORDs
+struct GAME_REPLAY_HEADER
+{
+    DWORD dwMagic;
+    DWORD dwVersion;
+    DWORD dwTickRecordSize;     // Catches recordings made with a different GAME_INPUT
+    DWORD dwTicks;
+    DWORD cbInitialState;
+};
+
+struct GAME_REPLAY_STATS
+{
+    int nTicks;
+    int nFirstDivergence;       // Tick index of the first hash mismatch, -1 if none
+    double fSeconds;            // Time spent simulating
+    double fTicksPerSecond;
+    int nRollbackTick;          // Tick index the rollback check rewound to, -1 if not run
+    bool bRollbackMatched;      // Re-simulating from the rewind reproduced the same hashes
+};
+
+
+//--------------------------------------------------------------------------------------
+// Ring of recent snapshots used to rewind the simulation
+//--------------------------------------------------------------------------------------
+class CGameRollback
+{
+public:
+    CGameRollback();
+    ~CGameRollback();
+
+    HRESULT Init( int nSlots, UINT nInterval );
+
+    // Saves a snapshot when the current tick is a multiple of the interval
+    HRESULT Capture( const CGameSim* pSim );
+
+    // Restores the newest snapshot taken at or before nTick
+    HRESULT Rewind( CGameSim* pSim, UINT nTick, UINT* pnRestoredTick );
+
+private:
+    struct SNAPSHOT
+    {
+        bool bValid;
+        UINT nTick;
+        DWORD cbData;
+        DWORD cbMaxData;
+        BYTE* pData;
+    };
+
+    SNAPSHOT* m_pSlots;
+    int m_nSlots;
+    int m_nNextSlot;
+    UINT m_nInterval;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Records a session and plays it back
+//--------------------------------------------------------------------------------------
+class CGameReplay
+{
+public:
+    CGameReplay();
+    ~CGameReplay();
+
+    // Saves the current state of pSim and attaches to it as its recorder
+    HRESULT BeginRecording( CGameSim* pSim );
+    void EndRecording();
+
+    // Called by CGameSim while recording
+    void RecordBoardSize( float fWidth, float fHeight );
+    void RecordTick( const GAME_INPUT* pInput, UINT64 nHash );
+
+    HRESULT Save( LPCWSTR strFileName );
+    HRESULT Load( LPCWSTR strFileName );
+
+    int GetTickCount() const { return m_Ticks.GetSize(); }
+
+    // Restores the recorded starting state into pSim and re-runs every tick.  pHashes,
+    // if given, receives the hash of each tick and must hold GetTickCount() entries.
+    // Afterwards the sim is rewound to a snapshot two thirds of the way in and run to
+    // the end again to check that rollback reproduces the same states.
+    HRESULT Play( CGameSim* pSim, GAME_REPLAY_STATS* pStats, UINT64* pHashes );
+
+private:
+    CGameSim* m_pRecordSim;
+    BYTE* m_pInitialState;
+    DWORD m_cbInitialState;
+    CGrowableArray <GAME_TICK_RECORD> m_Ticks;
+    float m_fPendingWidth;
+    float m_fPendingHeight;
+};
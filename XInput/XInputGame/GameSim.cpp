@@ -0,0 +1,887 @@
+//--------------------------------------------------------------------------------------
+// File: GameSim.cpp
+//
+// Device independent simulation for the XInputGame sample
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#include "DXUT.h"
+#include "GameSim.h"
+#include "GameReplay.h"
+#include <stddef.h>
+
+
+//--------------------------------------------------------------------------------------
+// The parts of GAME_STATE that are saved and hashed, in order: everything before the
+// arrays, the two counts, then the live prefix of each array.
+//--------------------------------------------------------------------------------------
+struct GAME_STATE_BLOCK
+{
+    BYTE* pData;
+    DWORD cbData;
+};
+
+#define GAME_STATE_HEADER_SIZE  ( offsetof( GAME_STATE, ammo ) )
+#define GAME_STATE_MAX_BLOCKS   17
+
+static int GetStateBlocks( GAME_STATE* pState, GAME_STATE_BLOCK* pBlocks )
+{
+    GAME_AMMO_SOA* pAmmo = &pState->ammo;
+    GAME_ASTEROID_SOA* pAsteroid = &pState->asteroid;
+    DWORD nAmmo = pAmmo->nCount;
+    DWORD nAsteroids = pAsteroid->nCount;
+    int nBlocks = 0;
+
+#define ADD_BLOCK( p, cb ) { pBlocks[nBlocks].pData = ( BYTE* )( p ); pBlocks[nBlocks].cbData = ( DWORD )( cb ); nBlocks++; }
+    ADD_BLOCK( pState, GAME_STATE_HEADER_SIZE );
+    ADD_BLOCK( &pAmmo->nCount, sizeof( int ) );
+    ADD_BLOCK( &pAsteroid->nCount, sizeof( int ) );
+
+    ADD_BLOCK( pAmmo->fCenterX, nAmmo * sizeof( float ) );
+    ADD_BLOCK( pAmmo->fCenterY, nAmmo * sizeof( float ) );
+    ADD_BLOCK( pAmmo->fVelX, nAmmo * sizeof( float ) );
+    ADD_BLOCK( pAmmo->fVelY, nAmmo * sizeof( float ) );
+    ADD_BLOCK( pAmmo->fLifeCountdown, nAmmo * sizeof( float ) );
+    ADD_BLOCK( pAmmo->nSerial, nAmmo * sizeof( UINT ) );
+    ADD_BLOCK( pAmmo->iFromPlayer, nAmmo * sizeof( BYTE ) );
+
+    ADD_BLOCK( pAsteroid->fCenterX, nAsteroids * sizeof( float ) );
+    ADD_BLOCK( pAsteroid->fCenterY, nAsteroids * sizeof( float ) );
+    ADD_BLOCK( pAsteroid->fVelX, nAsteroids * sizeof( float ) );
+    ADD_BLOCK( pAsteroid->fVelY, nAsteroids * sizeof( float ) );
+    ADD_BLOCK( pAsteroid->fDeathCountdown, nAsteroids * sizeof( float ) );
+    ADD_BLOCK( pAsteroid->bDead, nAsteroids * sizeof( BYTE ) );
+    ADD_BLOCK( pAsteroid->nAnimationState, nAsteroids * sizeof( BYTE ) );
+#undef ADD_BLOCK
+
+    assert( nBlocks == GAME_STATE_MAX_BLOCKS );
+    return nBlocks;
+}
+
+
+//--------------------------------------------------------------------------------------
+CGameBroadphase::CGameBroadphase() :
+    m_fInvCellSize( 0.0f ),
+    m_nCellsX( 0 ),
+    m_nCellsY( 0 ),
+    m_nMaxCells( 0 ),
+    m_pCellStart( NULL ),
+    m_pItemCell( NULL ),
+    m_pItems( NULL ),
+    m_pItemX( NULL ),
+    m_pItemY( NULL )
+{
+}
+
+
+//--------------------------------------------------------------------------------------
+CGameBroadphase::~CGameBroadphase()
+{
+    SAFE_DELETE_ARRAY( m_pCellStart );
+    SAFE_DELETE_ARRAY( m_pItemCell );
+    SAFE_DELETE_ARRAY( m_pItems );
+    SAFE_DELETE_ARRAY( m_pItemX );
+    SAFE_DELETE_ARRAY( m_pItemY );
+}
+
+
+//--------------------------------------------------------------------------------------
+int CGameBroadphase::GetCellX( float fX ) const
+{
+    int nCell = ( int )( fX * m_fInvCellSize );
+    return max( 0, min( nCell, m_nCellsX - 1 ) );
+}
+
+
+//--------------------------------------------------------------------------------------
+int CGameBroadphase::GetCellY( float fY ) const
+{
+    int nCell = ( int )( fY * m_fInvCellSize );
+    return max( 0, min( nCell, m_nCellsY - 1 ) );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Bins the live asteroids by cell.  Counts go into m_pCellStart[c+1], a prefix sum
+// turns them into start offsets, and the scatter pass uses the starts as cursors
+// before they are shifted back into place.
+//--------------------------------------------------------------------------------------
+HRESULT CGameBroadphase::Build( const GAME_ASTEROID_SOA& asteroids, float fBoardWidth, float fBoardHeight,
+                                float fCellSize )
+{
+    if( !m_pItems )
+    {
+        m_pItemCell = new int[GAME_SIM_MAX_ASTEROID];
+        m_pItems = new int[GAME_SIM_MAX_ASTEROID];
+        m_pItemX = new float[GAME_SIM_MAX_ASTEROID];
+        m_pItemY = new float[GAME_SIM_MAX_ASTEROID];
+        if( !m_pItemCell || !m_pItems || !m_pItemX || !m_pItemY )
+            return E_OUTOFMEMORY;
+    }
+
+    if( fCellSize > 0.0f )
+    {
+        m_fInvCellSize = 1.0f / fCellSize;
+        m_nCellsX = max( 1, ( int )ceilf( fBoardWidth * m_fInvCellSize ) );
+        m_nCellsY = max( 1, ( int )ceilf( fBoardHeight * m_fInvCellSize ) );
+    }
+    else
+    {
+        m_fInvCellSize = 0.0f;
+        m_nCellsX = 1;
+        m_nCellsY = 1;
+    }
+
+    int nCells = m_nCellsX * m_nCellsY;
+    if( nCells + 1 > m_nMaxCells )
+    {
+        SAFE_DELETE_ARRAY( m_pCellStart );
+        m_pCellStart = new int[nCells + 1];
+        if( !m_pCellStart )
+        {
+            m_nMaxCells = 0;
+            return E_OUTOFMEMORY;
+        }
+        m_nMaxCells = nCells + 1;
+    }
+    ZeroMemory( m_pCellStart, sizeof( int ) * ( nCells + 1 ) );
+
+    // Dead asteroids can't be hit, so leave them out
+    for( int i = 0; i < asteroids.nCount; i++ )
+    {
+        if( asteroids.bDead[i] )
+        {
+            m_pItemCell[i] = -1;
+            continue;
+        }
+        int nCell = GetCellY( asteroids.fCenterY[i] ) * m_nCellsX + GetCellX( asteroids.fCenterX[i] );
+        m_pItemCell[i] = nCell;
+        m_pCellStart[nCell + 1]++;
+    }
+
+    for( int nCell = 1; nCell <= nCells; nCell++ )
+        m_pCellStart[nCell] += m_pCellStart[nCell - 1];
+
+    for( int i = 0; i < asteroids.nCount; i++ )
+    {
+        int nCell = m_pItemCell[i];
+        if( nCell < 0 )
+            continue;
+        int nItem = m_pCellStart[nCell]++;
+        m_pItems[nItem] = i;
+        m_pItemX[nItem] = asteroids.fCenterX[i];
+        m_pItemY[nItem] = asteroids.fCenterY[i];
+    }
+
+    for( int nCell = nCells; nCell > 0; nCell-- )
+        m_pCellStart[nCell] = m_pCellStart[nCell - 1];
+    m_pCellStart[0] = 0;
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+CGameSim::CGameSim() :
+    m_pState( NULL ),
+    m_pRecorder( NULL ),
+    m_bUseBroadphase( true ),
+    m_fAccumulator( 0.0f )
+{
+}
+
+
+//--------------------------------------------------------------------------------------
+CGameSim::~CGameSim()
+{
+    SAFE_DELETE( m_pState );
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CGameSim::Init( UINT nSeed )
+{
+    if( !m_pState )
+    {
+        m_pState = new GAME_STATE;
+        if( !m_pState )
+            return E_OUTOFMEMORY;
+    }
+
+    ZeroMemory( m_pState, sizeof( GAME_STATE ) );
+    m_pState->gameMode = GAME_MAIN_MENU;
+    m_pState->nMaxAmmo = MAX_AMMO;
+    m_pState->nMaxAsteroids = MAX_ASTEROID;
+    m_pState->nAsteroidsPerPlayer = 10;
+    m_pState->nRandSeed = nSeed;
+    m_fAccumulator = 0.0f;
+
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Sizes everything relative to the board and puts the players back at their
+// starting positions
+//--------------------------------------------------------------------------------------
+void CGameSim::SetBoardSize( float fWidth, float fHeight )
+{
+    GAME_STATE* pState = m_pState;
+
+    pState->fBoardWidth = fWidth;
+    pState->fBoardHeight = fHeight;
+    pState->fPlayerSize = fWidth * GAME_PLAYER_SIZE;
+    pState->fAmmoSize = fWidth * GAME_AMMO_SIZE;
+    pState->fAsteroidSize = fWidth * GAME_ASTEROID_SIZE;
+
+    float fSize = pState->fPlayerSize;
+    float fCenterX = fWidth / 2.0f + fSize / 2.0f;
+    float fCenterY = fHeight / 2.0f + fSize / 2.0f;
+    pState->player[0].fCenterX = fCenterX;
+    pState->player[0].fCenterY = fCenterY;
+    pState->player[1].fCenterX = fCenterX - fSize * 4;
+    pState->player[1].fCenterY = fCenterY - fSize * 4;
+    pState->player[2].fCenterX = fCenterX - fSize * 4;
+    pState->player[2].fCenterY = fCenterY + fSize * 4;
+    pState->player[3].fCenterX = fCenterX + fSize * 4;
+    pState->player[3].fCenterY = fCenterY - fSize * 4;
+
+    if( m_pRecorder )
+        m_pRecorder->RecordBoardSize( fWidth, fHeight );
+}
+
+
+//--------------------------------------------------------------------------------------
+int CGameSim::Advance( float fElapsedTime, GAME_INPUT* pInput, GAME_RUMBLE* pRumble )
+{
+    int nTicks = 0;
+
+    m_fAccumulator += fElapsedTime;
+    while( m_fAccumulator >= GAME_TICK )
+    {
+        if( nTicks == GAME_MAX_TICKS_PER_FRAME )
+        {
+            m_fAccumulator = 0.0f;
+            break;
+        }
+
+        Step( pInput, pRumble );
+        m_fAccumulator -= GAME_TICK;
+        nTicks++;
+
+        for( int i = 0; i < GAME_MAX_PLAYERS; i++ )
+            pInput->pad[i].wPressedButtons = 0;
+    }
+
+    return nTicks;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CGameSim::Step( const GAME_INPUT* pInput, GAME_RUMBLE* pRumble )
+{
+    Simulate( pInput, pRumble );
+
+    if( m_pRecorder )
+        m_pRecorder->RecordTick( pInput, GetStateHash() );
+}
+
+
+//--------------------------------------------------------------------------------------
+void CGameSim::Simulate( const GAME_INPUT* pInput, GAME_RUMBLE* pRumble )
+{
+    GAME_STATE* pState = m_pState;
+
+    pState->nTick++;
+
+    if( pState->asteroid.nCount < pState->nAsteroidsPerPlayer * pState->nNumActivePlayers )
+        SpawnAsteroid();
+
+    if( pState->gameMode == GAME_RUNNING )
+    {
+        // Detect if any controller became unplugged.  If it did
+        // pause the game and display error text
+        for( int iPlayer = 0; iPlayer < GAME_MAX_PLAYERS; iPlayer++ )
+        {
+            if( !pState->player[iPlayer].bActive )
+                continue;
+
+            if( !pInput->pad[pState->player[iPlayer].controllerIndex].bConnected )
+            {
+                StopAllGameRumble( pRumble );
+                pState->gameMode = GAME_CONTROLLER_UNPLUGGED;
+                pState->nUnpluggedPlayer = iPlayer;
+                return;
+            }
+        }
+    }
+    else if( pState->gameMode == GAME_CONTROLLER_UNPLUGGED )
+    {
+        // Check to see if player's unplugged controller is reconnect and the
+        // player has pressed Start yet.
+        const GAME_PAD_INPUT* pPad = &pInput->pad[pState->player[pState->nUnpluggedPlayer].controllerIndex];
+        if( pPad->bConnected && ( pPad->wPressedButtons & XINPUT_GAMEPAD_START ) )
+            pState->gameMode = GAME_RUNNING;
+        return;
+    }
+
+    if( pState->gameMode == GAME_MAIN_MENU )
+    {
+        for( int iUserIndex = 0; iUserIndex < GAME_MAX_PLAYERS; iUserIndex++ )
+        {
+            if( !pInput->pad[iUserIndex].bConnected )
+                continue;
+
+            // If any button pressed
+            if( pInput->pad[iUserIndex].wPressedButtons != 0 )
+            {
+                pState->player[0].bActive = true;
+                pState->player[0].controllerIndex = iUserIndex;
+                pState->nNumActivePlayers = 1;
+                pState->gameMode = GAME_RUNNING;
+            }
+        }
+    }
+    else if( pState->gameMode == GAME_RUNNING )
+    {
+        UpdateAmmo( pRumble );
+        UpdateAsteroids( pRumble );
+        UpdatePlayers( pInput, pRumble );
+        UpdateJoins( pInput, pRumble );
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Adds ammo, recycling the oldest round if the world is full
+//--------------------------------------------------------------------------------------
+void CGameSim::SpawnAmmo( float fCenterX, float fCenterY, float fVelX, float fVelY, int iFromPlayer )
+{
+    GAME_AMMO_SOA* pAmmo = &m_pState->ammo;
+
+    int nNewIndex;
+    if( pAmmo->nCount < m_pState->nMaxAmmo )
+    {
+        nNewIndex = pAmmo->nCount++;
+    }
+    else
+    {
+        nNewIndex = 0;
+        for( int i = 1; i < pAmmo->nCount; i++ )
+        {
+            if( pAmmo->nSerial[i] < pAmmo->nSerial[nNewIndex] )
+                nNewIndex = i;
+        }
+    }
+
+    pAmmo->fCenterX[nNewIndex] = fCenterX;
+    pAmmo->fCenterY[nNewIndex] = fCenterY;
+    pAmmo->fVelX[nNewIndex] = fVelX;
+    pAmmo->fVelY[nNewIndex] = fVelY;
+    pAmmo->fLifeCountdown[nNewIndex] = 1.0f;
+    pAmmo->nSerial[nNewIndex] = m_pState->nNextAmmoSerial++;
+    pAmmo->iFromPlayer[nNewIndex] = ( BYTE )iFromPlayer;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CGameSim::SpawnAsteroid()
+{
+    GAME_ASTEROID_SOA* pAsteroid = &m_pState->asteroid;
+
+    // Check to see if there are already nMaxAsteroids in the world.
+    if( pAsteroid->nCount >= m_pState->nMaxAsteroids )
+        return;
+
+    int nNewIndex = pAsteroid->nCount++;
+
+    float fPosX = ( Rand() % 1000 ) / 1000.0f * m_pState->fBoardWidth;
+    float fPosY = ( Rand() % 1000 ) / 1000.0f * m_pState->fBoardHeight;
+
+    float fVelX = ( Rand() % 2000 - 1000 ) / 1000.0f * 0.1f;
+    float fVelY = ( Rand() % 2000 - 1000 ) / 1000.0f * 0.1f;
+
+    pAsteroid->fCenterX[nNewIndex] = fPosX;
+    pAsteroid->fCenterY[nNewIndex] = fPosY;
+    pAsteroid->fVelX[nNewIndex] = fVelX;
+    pAsteroid->fVelY[nNewIndex] = fVelY;
+    pAsteroid->fDeathCountdown[nNewIndex] = 0.0f;
+    pAsteroid->bDead[nNewIndex] = 0;
+    pAsteroid->nAnimationState[nNewIndex] = 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Same linear congruential generator as the CRT rand(), but seeded per game
+//--------------------------------------------------------------------------------------
+int CGameSim::Rand()
+{
+    m_pState->nRandSeed = m_pState->nRandSeed * 214013 + 2531011;
+    return ( int )( ( m_pState->nRandSeed >> 16 ) & 0x7FFF );
+}
+
+
+//--------------------------------------------------------------------------------------
+DWORD CGameSim::SaveState( BYTE* pDest ) const
+{
+    GAME_STATE_BLOCK blocks[GAME_STATE_MAX_BLOCKS];
+    int nBlocks = GetStateBlocks( m_pState, blocks );
+
+    DWORD cbTotal = 0;
+    for( int i = 0; i < nBlocks; i++ )
+    {
+        if( pDest )
+            memcpy( pDest + cbTotal, blocks[i].pData, blocks[i].cbData );
+        cbTotal += blocks[i].cbData;
+    }
+
+    return cbTotal;
+}
+
+
+//--------------------------------------------------------------------------------------
+HRESULT CGameSim::LoadState( const BYTE* pSrc, DWORD cbSrc )
+{
+    // The fixed size part carries the counts needed to size the rest
+    DWORD cbFixed = GAME_STATE_HEADER_SIZE + 2 * sizeof( int );
+    if( !pSrc || cbSrc < cbFixed )
+        return E_INVALIDARG;
+
+    int nAmmo, nAsteroids;
+    memcpy( &nAmmo, pSrc + GAME_STATE_HEADER_SIZE, sizeof( int ) );
+    memcpy( &nAsteroids, pSrc + GAME_STATE_HEADER_SIZE + sizeof( int ), sizeof( int ) );
+    if( nAmmo < 0 || nAmmo > GAME_SIM_MAX_AMMO || nAsteroids < 0 || nAsteroids > GAME_SIM_MAX_ASTEROID )
+        return E_INVALIDARG;
+
+    int nOldAmmo = m_pState->ammo.nCount;
+    int nOldAsteroids = m_pState->asteroid.nCount;
+    m_pState->ammo.nCount = nAmmo;
+    m_pState->asteroid.nCount = nAsteroids;
+    if( SaveState( NULL ) != cbSrc )
+    {
+        m_pState->ammo.nCount = nOldAmmo;
+        m_pState->asteroid.nCount = nOldAsteroids;
+        return E_INVALIDARG;
+    }
+
+    GAME_STATE_BLOCK blocks[GAME_STATE_MAX_BLOCKS];
+    int nBlocks = GetStateBlocks( m_pState, blocks );
+    for( int i = 0; i < nBlocks; i++ )
+    {
+        memcpy( blocks[i].pData, pSrc, blocks[i].cbData );
+        pSrc += blocks[i].cbData;
+    }
+
+    m_fAccumulator = 0.0f;
+    return S_OK;
+}
+
+
+//--------------------------------------------------------------------------------------
+// 64-bit FNV-1a over the same bytes SaveState writes
+//--------------------------------------------------------------------------------------
+UINT64 CGameSim::GetStateHash() const
+{
+    GAME_STATE_BLOCK blocks[GAME_STATE_MAX_BLOCKS];
+    int nBlocks = GetStateBlocks( m_pState, blocks );
+
+    UINT64 nHash = 14695981039346656037ULL;
+    for( int i = 0; i < nBlocks; i++ )
+    {
+        const BYTE* pData = blocks[i].pData;
+        for( DWORD j = 0; j < blocks[i].cbData; j++ )
+        {
+            nHash ^= pData[j];
+            nHash *= 1099511628211ULL;
+        }
+    }
+
+    return nHash;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CGameSim::HitAsteroid( int iAsteroid, int iFromPlayer )
+{
+    m_pState->player[iFromPlayer].nScore++;
+    m_pState->asteroid.bDead[iAsteroid] = 1;
+    m_pState->asteroid.nAnimationState[iAsteroid] = 2;
+    m_pState->asteroid.fDeathCountdown[iAsteroid] = 1.1f;
+}
+
+
+//--------------------------------------------------------------------------------------
+void CGameSim::DamagePlayer( int iPlayer, int nPenalty, GAME_RUMBLE* pRumble )
+{
+    GAME_PLAYER* pPlayer = &m_pState->player[iPlayer];
+
+    pPlayer->nScore -= nPenalty;
+    pPlayer->bDamageRumbleInEffect = true;
+    pPlayer->fDamageRumbleCountdown = 0.50f;
+    SetGameRumble( pRumble, pPlayer->controllerIndex, 0xFFFF, 0 );
+}
+
+
+//--------------------------------------------------------------------------------------
+// Moves the ammo and resolves hits against players and asteroids.  A round that
+// overlaps several targets in the same tick hits all of them.
+//--------------------------------------------------------------------------------------
+void CGameSim::UpdateAmmo( GAME_RUMBLE* pRumble )
+{
+    GAME_STATE* pState = m_pState;
+    GAME_AMMO_SOA* pAmmo = &pState->ammo;
+    const GAME_ASTEROID_SOA* pAsteroid = &pState->asteroid;
+
+    const float fStep = pState->fAmmoSize * GAME_TICK * 15.0f;
+    const float fMin = pState->fAmmoSize / 2.0f;
+    const float fMaxX = pState->fBoardWidth - fMin;
+    const float fMaxY = pState->fBoardHeight - fMin;
+    const float fPlayerHit = pState->fPlayerSize / 2.0f;
+    const float fAsteroidHit = pState->fAsteroidSize / 4.0f;
+
+    bool bBroadphase = m_bUseBroadphase &&
+        SUCCEEDED( m_Broadphase.Build( *pAsteroid, pState->fBoardWidth, pState->fBoardHeight,
+                                       pState->fAsteroidSize / 2.0f ) );
+
+    int iAmmo = 0;
+    while( iAmmo < pAmmo->nCount )
+    {
+        bool bRemove = false;
+
+        pAmmo->fLifeCountdown[iAmmo] -= GAME_TICK;
+        if( pAmmo->fLifeCountdown[iAmmo] < 0.0f )
+            bRemove = true;
+
+        if( !bRemove )
+        {
+            float fX = pAmmo->fCenterX[iAmmo] + pAmmo->fVelX[iAmmo] * fStep;
+            float fY = pAmmo->fCenterY[iAmmo] + pAmmo->fVelY[iAmmo] * fStep;
+
+            // Bounce ammo against walls
+            if( fX > fMaxX )
+            {
+                fX = fMaxX;
+                pAmmo->fVelX[iAmmo] = -pAmmo->fVelX[iAmmo];
+            }
+            if( fX < fMin )
+            {
+                fX = fMin;
+                pAmmo->fVelX[iAmmo] = -pAmmo->fVelX[iAmmo];
+            }
+            if( fY > fMaxY )
+            {
+                fY = fMaxY;
+                pAmmo->fVelY[iAmmo] = -pAmmo->fVelY[iAmmo];
+            }
+            if( fY < fMin )
+            {
+                fY = fMin;
+                pAmmo->fVelY[iAmmo] = -pAmmo->fVelY[iAmmo];
+            }
+            pAmmo->fCenterX[iAmmo] = fX;
+            pAmmo->fCenterY[iAmmo] = fY;
+
+            int iFromPlayer = pAmmo->iFromPlayer[iAmmo];
+
+            // Check if hit other player
+            for( int iPlayer = 0; iPlayer < GAME_MAX_PLAYERS; iPlayer++ )
+            {
+                const GAME_PLAYER* pPlayer = &pState->player[iPlayer];
+                if( iPlayer == iFromPlayer || !pPlayer->bActive )
+                    continue;
+
+                if( fabsf( fX - pPlayer->fCenterX ) < fPlayerHit &&
+                    fabsf( fY - pPlayer->fCenterY ) < fPlayerHit )
+                {
+                    pState->player[iFromPlayer].nScore++;
+                    DamagePlayer( iPlayer, 1, pRumble );
+                    bRemove = true;
+                }
+            }
+
+            // Check if hit asteroid
+            if( bBroadphase )
+            {
+                int nCellX = m_Broadphase.GetCellX( fX );
+                int nCellY = m_Broadphase.GetCellY( fY );
+                int nX0 = max( nCellX - 1, 0 );
+                int nX1 = min( nCellX + 1, m_Broadphase.GetCellsX() - 1 );
+                int nY0 = max( nCellY - 1, 0 );
+                int nY1 = min( nCellY + 1, m_Broadphase.GetCellsY() - 1 );
+
+                for( int nY = nY0; nY <= nY1; nY++ )
+                {
+                    // Neighbouring cells in a row are contiguous in the item list
+                    int nRow = nY * m_Broadphase.GetCellsX();
+                    int nEnd = m_Broadphase.GetCellStart( nRow + nX1 + 1 );
+                    for( int nItem = m_Broadphase.GetCellStart( nRow + nX0 ); nItem < nEnd; nItem++ )
+                    {
+                        if( fabsf( fX - m_Broadphase.GetItemX( nItem ) ) < fAsteroidHit &&
+                            fabsf( fY - m_Broadphase.GetItemY( nItem ) ) < fAsteroidHit )
+                        {
+                            int iAsteroid = m_Broadphase.GetItem( nItem );
+                            if( pAsteroid->bDead[iAsteroid] )
+                                continue;
+                            HitAsteroid( iAsteroid, iFromPlayer );
+                            bRemove = true;
+                        }
+                    }
+                }
+            }
+            else
+            {
+                for( int iAsteroid = 0; iAsteroid < pAsteroid->nCount; iAsteroid++ )
+                {
+                    if( pAsteroid->bDead[iAsteroid] )
+                        continue;
+
+                    if( fabsf( fX - pAsteroid->fCenterX[iAsteroid] ) < fAsteroidHit &&
+                        fabsf( fY - pAsteroid->fCenterY[iAsteroid] ) < fAsteroidHit )
+                    {
+                        HitAsteroid( iAsteroid, iFromPlayer );
+                        bRemove = true;
+                    }
+                }
+            }
+        }
+
+        if( bRemove )
+        {
+            int iLast = --pAmmo->nCount;
+            pAmmo->fCenterX[iAmmo] = pAmmo->fCenterX[iLast];
+            pAmmo->fCenterY[iAmmo] = pAmmo->fCenterY[iLast];
+            pAmmo->fVelX[iAmmo] = pAmmo->fVelX[iLast];
+            pAmmo->fVelY[iAmmo] = pAmmo->fVelY[iLast];
+            pAmmo->fLifeCountdown[iAmmo] = pAmmo->fLifeCountdown[iLast];
+            pAmmo->nSerial[iAmmo] = pAmmo->nSerial[iLast];
+            pAmmo->iFromPlayer[iAmmo] = pAmmo->iFromPlayer[iLast];
+            continue;
+        }
+
+        iAmmo++;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Moves the asteroids, runs the death animations and checks for player collisions.
+// There are at most GAME_MAX_PLAYERS players so no broadphase is needed here.
+//--------------------------------------------------------------------------------------
+void CGameSim::UpdateAsteroids( GAME_RUMBLE* pRumble )
+{
+    GAME_STATE* pState = m_pState;
+    GAME_ASTEROID_SOA* pAsteroid = &pState->asteroid;
+
+    const float fStep = pState->fAsteroidSize * GAME_TICK * 15.0f;
+    const float fMin = pState->fAsteroidSize / 2.0f;
+    const float fMaxX = pState->fBoardWidth - fMin;
+    const float fMaxY = pState->fBoardHeight - fMin;
+    const float fPlayerHit = pState->fPlayerSize / 2.0f;
+
+    int iAsteroid = 0;
+    while( iAsteroid < pAsteroid->nCount )
+    {
+        bool bRemove = false;
+
+        if( pAsteroid->bDead[iAsteroid] )
+        {
+            float fCountdown = pAsteroid->fDeathCountdown[iAsteroid] - GAME_TICK;
+            pAsteroid->fDeathCountdown[iAsteroid] = fCountdown;
+            pAsteroid->nAnimationState[iAsteroid] = ( BYTE )min( ( int )( ( 1.1f - fCountdown ) / 0.1f ) + 1,
+                                                                 GAME_ASTEROID_FRAMES - 1 );
+            if( fCountdown < 0.5f )
+                bRemove = true;
+        }
+        else
+        {
+            float fX = pAsteroid->fCenterX[iAsteroid] + pAsteroid->fVelX[iAsteroid] * fStep;
+            float fY = pAsteroid->fCenterY[iAsteroid] + pAsteroid->fVelY[iAsteroid] * fStep;
+
+            // Bounce asteroid against walls
+            if( fX > fMaxX )
+            {
+                fX = fMaxX;
+                pAsteroid->fVelX[iAsteroid] = -pAsteroid->fVelX[iAsteroid];
+            }
+            if( fX < fMin )
+            {
+                fX = fMin;
+                pAsteroid->fVelX[iAsteroid] = -pAsteroid->fVelX[iAsteroid];
+            }
+            if( fY > fMaxY )
+            {
+                fY = fMaxY;
+                pAsteroid->fVelY[iAsteroid] = -pAsteroid->fVelY[iAsteroid];
+            }
+            if( fY < fMin )
+            {
+                fY = fMin;
+                pAsteroid->fVelY[iAsteroid] = -pAsteroid->fVelY[iAsteroid];
+            }
+            pAsteroid->fCenterX[iAsteroid] = fX;
+            pAsteroid->fCenterY[iAsteroid] = fY;
+
+            // Check if asteroid hit player
+            for( int iPlayer = 0; iPlayer < GAME_MAX_PLAYERS; iPlayer++ )
+            {
+                const GAME_PLAYER* pPlayer = &pState->player[iPlayer];
+                if( !pPlayer->bActive )
+                    continue;
+
+                if( fabsf( fX - pPlayer->fCenterX ) < fPlayerHit &&
+                    fabsf( fY - pPlayer->fCenterY ) < fPlayerHit )
+                {
+                    DamagePlayer( iPlayer, 10, pRumble );
+                    bRemove = true;
+                }
+            }
+        }
+
+        if( bRemove )
+        {
+            int iLast = --pAsteroid->nCount;
+            pAsteroid->fCenterX[iAsteroid] = pAsteroid->fCenterX[iLast];
+            pAsteroid->fCenterY[iAsteroid] = pAsteroid->fCenterY[iLast];
+            pAsteroid->fVelX[iAsteroid] = pAsteroid->fVelX[iLast];
+            pAsteroid->fVelY[iAsteroid] = pAsteroid->fVelY[iLast];
+            pAsteroid->fDeathCountdown[iAsteroid] = pAsteroid->fDeathCountdown[iLast];
+            pAsteroid->bDead[iAsteroid] = pAsteroid->bDead[iLast];
+            pAsteroid->nAnimationState[iAsteroid] = pAsteroid->nAnimationState[iLast];
+            continue;
+        }
+
+        iAsteroid++;
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+void CGameSim::UpdatePlayers( const GAME_INPUT* pInput, GAME_RUMBLE* pRumble )
+{
+    GAME_STATE* pState = m_pState;
+
+    const float fSize = pState->fPlayerSize;
+    const float fMin = fSize / 2.0f;
+    const float fMaxX = pState->fBoardWidth - fMin;
+    const float fMaxY = pState->fBoardHeight - fMin;
+
+    for( int iPlayer = 0; iPlayer < GAME_MAX_PLAYERS; iPlayer++ )
+    {
+        GAME_PLAYER* pPlayer = &pState->player[iPlayer];
+        if( !pPlayer->bActive )
+            continue;
+
+        // Check controller index assigned to this player
+        int iUserIndex = pPlayer->controllerIndex;
+        const GAME_PAD_INPUT* pPad = &pInput->pad[iUserIndex];
+        if( !pPad->bConnected )
+            continue; // unplugged?
+
+        if( pPlayer->bFireRumbleInEffect )
+        {
+            pPlayer->fFireRumbleCountdown -= GAME_TICK;
+            if( pPlayer->fFireRumbleCountdown < 0.0f )
+            {
+                pPlayer->bFireRumbleInEffect = false;
+
+                // Turn off rumble if damage rumble not happening
+                if( !pPlayer->bDamageRumbleInEffect )
+                    SetGameRumble( pRumble, iUserIndex, 0, 0 );
+            }
+        }
+
+        if( pPlayer->bDamageRumbleInEffect )
+        {
+            pPlayer->fDamageRumbleCountdown -= GAME_TICK;
+            if( pPlayer->fDamageRumbleCountdown < 0.0f )
+            {
+                pPlayer->bDamageRumbleInEffect = false;
+
+                // Turn off rumble if fire rumble not happening
+                if( !pPlayer->bFireRumbleInEffect )
+                    SetGameRumble( pRumble, iUserIndex, 0, 0 );
+            }
+        }
+
+        // Move player based on left thumbstick, keeping it within map bounds
+        float fX = pPlayer->fCenterX + pPad->fThumbLX * GAME_TICK * fSize * 10.0f;
+        float fY = pPlayer->fCenterY - pPad->fThumbLY * GAME_TICK * fSize * 10.0f;
+        pPlayer->fCenterX = max( fMin, min( fX, fMaxX ) );
+        pPlayer->fCenterY = max( fMin, min( fY, fMaxY ) );
+
+        pPlayer->fFireReloadCountdown -= GAME_TICK;
+        if( pPlayer->fFireReloadCountdown < 0.0f && pPad->bFire )
+        {
+            // Fire ammo if right thumbstick non-zero
+            pPlayer->fFireReloadCountdown = 0.1f;
+            SpawnAmmo( pPlayer->fCenterX, pPlayer->fCenterY, pPad->fThumbRX, -pPad->fThumbRY, iPlayer );
+
+            pPlayer->bFireRumbleInEffect = true;
+            pPlayer->fFireRumbleCountdown = 0.15f;
+            SetGameRumble( pRumble, iUserIndex, 0, 15000 );
+        }
+    }
+}
+
+
+//--------------------------------------------------------------------------------------
+// Lets controllers join with any button and leave with Start
+//--------------------------------------------------------------------------------------
+void CGameSim::UpdateJoins( const GAME_INPUT* pInput, GAME_RUMBLE* pRumble )
+{
+    GAME_STATE* pState = m_pState;
+
+    for( int iUserIndex = 0; iUserIndex < GAME_MAX_PLAYERS; iUserIndex++ )
+    {
+        const GAME_PAD_INPUT* pPad = &pInput->pad[iUserIndex];
+
+        // Skip if controller not connected
+        if( !pPad->bConnected )
+            continue;
+
+        // Check if this controller is already being used by another player
+        int nPlayerUsingThisController = -1;
+        for( int iPlayer = 0; iPlayer < GAME_MAX_PLAYERS; iPlayer++ )
+        {
+            if( pState->player[iPlayer].bActive && pState->player[iPlayer].controllerIndex == iUserIndex )
+                nPlayerUsingThisController = iPlayer;
+        }
+
+        if( nPlayerUsingThisController < 0 )
+        {
+            if( pPad->wPressedButtons == 0 )
+                continue;
+
+            // If a button is pressed on an used controller, assign it
+            // to the first inactive player
+            for( int iPlayer = 0; iPlayer < GAME_MAX_PLAYERS; iPlayer++ )
+            {
+                if( !pState->player[iPlayer].bActive )
+                {
+                    pState->player[iPlayer].bActive = true;
+                    pState->nNumActivePlayers++;
+                    pState->player[iPlayer].controllerIndex = iUserIndex;
+
+                    // Reset all score when a new player joins
+                    for( int iPlayer2 = 0; iPlayer2 < GAME_MAX_PLAYERS; iPlayer2++ )
+                        pState->player[iPlayer2].nScore = 0;
+                    break;
+                }
+            }
+        }
+        else if( pPad->wPressedButtons & XINPUT_GAMEPAD_START )
+        {
+            pState->player[nPlayerUsingThisController].bActive = false;
+            pState->nNumActivePlayers--;
+            if( pState->nNumActivePlayers == 0 )
+            {
+                StopAllGameRumble( pRumble );
+                pState->gameMode = GAME_MAIN_MENU;
+            }
+
+            // Turn off rumble
+            SetGameRumble( pRumble, iUserIndex, 0, 0 );
+        }
+    }
+}
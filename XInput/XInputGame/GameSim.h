@@ -0,0 +1,257 @@
+//--------------------------------------------------------------------------------------
+// File: GameSim.h
+//
+// Device independent simulation for the XInputGame sample.  The game state is kept
+// in structure-of-arrays form and is advanced in fixed time steps.  Collisions
+// between ammo and asteroids go through a uniform grid instead of testing every
+// pair.  The simulation never touches Direct3D or XInput directly: board size comes
+// from the caller and controller rumble is returned as output.
+//
+// Copyright (c) Microsoft Corporation.
+// Licensed under the MIT License (MIT).
+//--------------------------------------------------------------------------------------
+#pragma once
+
+//--------------------------------------------------------------------------------------
+// Structs/defines
+//--------------------------------------------------------------------------------------
+#define GAME_MAX_PLAYERS            DXUT_MAX_CONTROLLERS
+
+// Storage capacity.  The game itself is limited to MAX_AMMO/MAX_ASTEROID at run time
+// (see GAME_STATE::nMaxAmmo), the extra room is there for the benchmark.
+#define GAME_SIM_MAX_AMMO           4096
+#define GAME_SIM_MAX_ASTEROID       4096
+
+#define MAX_AMMO                    100
+#define MAX_ASTEROID                100
+
+#define GAME_TICKS_PER_SECOND       60
+#define GAME_TICK                   ( 1.0f / GAME_TICKS_PER_SECOND )
+#define GAME_MAX_TICKS_PER_FRAME    8   // Drop time rather than spiral on slow frames
+
+// Sizes are relative to the board width
+#define GAME_PLAYER_SIZE            ( 1.0f / 15.0f )
+#define GAME_AMMO_SIZE              ( 1.0f / 20.0f )
+#define GAME_ASTEROID_SIZE          ( 1.0f / 10.0f )
+
+// Number of frames in the asteroid sprite sheet (alive + 5 death frames)
+#define GAME_ASTEROID_FRAMES        6
+
+enum GAME_MODE
+{
+    GAME_MAIN_MENU = 1,
+    GAME_RUNNING,
+    GAME_CONTROLLER_UNPLUGGED,
+};
+
+// Controller state consumed by one simulation tick.  wPressedButtons holds the
+// buttons pressed since the previous tick that consumed input.
+struct GAME_PAD_INPUT
+{
+    bool bConnected;
+    bool bFire;                 // Right thumbstick off center
+    WORD wPressedButtons;
+    float fThumbLX;
+    float fThumbLY;
+    float fThumbRX;
+    float fThumbRY;
+};
+
+struct GAME_INPUT
+{
+    GAME_PAD_INPUT pad[GAME_MAX_PLAYERS];
+};
+
+// Rumble requested by the simulation, indexed by controller.  Only entries with
+// bChanged set need to be sent to the device.
+struct GAME_RUMBLE
+{
+    bool bChanged[GAME_MAX_PLAYERS];
+    WORD wLeftMotorSpeed[GAME_MAX_PLAYERS];
+    WORD wRightMotorSpeed[GAME_MAX_PLAYERS];
+};
+
+// Ammo is stored densely in [0, nCount); removing an entry moves the last one into
+// its slot.  Positions are sprite centers in pixels.
+struct GAME_AMMO_SOA
+{
+    int nCount;
+    float fCenterX[GAME_SIM_MAX_AMMO];
+    float fCenterY[GAME_SIM_MAX_AMMO];
+    float fVelX[GAME_SIM_MAX_AMMO];
+    float fVelY[GAME_SIM_MAX_AMMO];
+    float fLifeCountdown[GAME_SIM_MAX_AMMO];
+    UINT nSerial[GAME_SIM_MAX_AMMO];        // Creation order, used to recycle the oldest
+    BYTE iFromPlayer[GAME_SIM_MAX_AMMO];
+};
+
+// Asteroids use the same dense layout.  Dying asteroids stay in the array until
+// their death animation is done.
+struct GAME_ASTEROID_SOA
+{
+    int nCount;
+    float fCenterX[GAME_SIM_MAX_ASTEROID];
+    float fCenterY[GAME_SIM_MAX_ASTEROID];
+    float fVelX[GAME_SIM_MAX_ASTEROID];
+    float fVelY[GAME_SIM_MAX_ASTEROID];
+    float fDeathCountdown[GAME_SIM_MAX_ASTEROID];
+    BYTE bDead[GAME_SIM_MAX_ASTEROID];
+    BYTE nAnimationState[GAME_SIM_MAX_ASTEROID];
+};
+
+struct GAME_PLAYER
+{
+    bool bActive;
+    int controllerIndex;
+    float fCenterX;
+    float fCenterY;
+    float fFireReloadCountdown;
+    int nScore;
+    bool bFireRumbleInEffect;
+    float fFireRumbleCountdown;
+    bool bDamageRumbleInEffect;
+    float fDamageRumbleCountdown;
+};
+
+struct GAME_STATE
+{
+    GAME_MODE gameMode;
+    int nNumActivePlayers;
+    int nUnpluggedPlayer;
+    UINT nTick;
+    UINT nNextAmmoSerial;
+    UINT nRandSeed;             // All randomness comes from here so ticks replay exactly
+
+    // Board and sprite sizes in pixels
+    float fBoardWidth;
+    float fBoardHeight;
+    float fPlayerSize;
+    float fAmmoSize;
+    float fAsteroidSize;
+
+    // Run time limits, at most GAME_SIM_MAX_AMMO/GAME_SIM_MAX_ASTEROID
+    int nMaxAmmo;
+    int nMaxAsteroids;
+    int nAsteroidsPerPlayer;
+
+    GAME_PLAYER player[GAME_MAX_PLAYERS];
+    GAME_AMMO_SOA ammo;
+    GAME_ASTEROID_SOA asteroid;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Uniform grid over the live asteroids, rebuilt every tick with a counting sort.
+// Cells are half an asteroid wide, so any asteroid close enough to collide with a
+// point lies in the point's cell or one of its eight neighbours.  Candidate centers
+// are copied next to their indices so a query only walks contiguous memory.
+//--------------------------------------------------------------------------------------
+class CGameBroadphase
+{
+public:
+    CGameBroadphase();
+    ~CGameBroadphase();
+
+    HRESULT Build( const GAME_ASTEROID_SOA& asteroids, float fBoardWidth, float fBoardHeight, float fCellSize );
+
+    int GetCellX( float fX ) const;
+    int GetCellY( float fY ) const;
+    int GetCellsX() const { return m_nCellsX; }
+    int GetCellsY() const { return m_nCellsY; }
+
+    // Items of a cell are [GetCellStart(i), GetCellStart(i+1))
+    int GetCellStart( int nCell ) const { return m_pCellStart[nCell]; }
+    int GetItem( int nItem ) const { return m_pItems[nItem]; }
+    float GetItemX( int nItem ) const { return m_pItemX[nItem]; }
+    float GetItemY( int nItem ) const { return m_pItemY[nItem]; }
+
+private:
+    float m_fInvCellSize;
+    int m_nCellsX;
+    int m_nCellsY;
+    int m_nMaxCells;
+    int* m_pCellStart;          // m_nCellsX * m_nCellsY + 1 entries
+    int* m_pItemCell;           // Cell of each asteroid, GAME_SIM_MAX_ASTEROID entries
+    int* m_pItems;              // Asteroid indices sorted by cell
+    float* m_pItemX;
+    float* m_pItemY;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Owns the game state and steps it
+//--------------------------------------------------------------------------------------
+class CGameReplay;
+
+class CGameSim
+{
+public:
+    CGameSim();
+    ~CGameSim();
+
+    HRESULT Init( UINT nSeed = 1 );
+    void SetBoardSize( float fWidth, float fHeight );
+
+    // Runs as many fixed ticks as fElapsedTime covers.  Pressed buttons in pInput are
+    // cleared once a tick has consumed them, so presses are never lost or repeated.
+    // Returns the number of ticks run.
+    int Advance( float fElapsedTime, GAME_INPUT* pInput, GAME_RUMBLE* pRumble );
+
+    // Runs exactly one tick of GAME_TICK seconds
+    void Step( const GAME_INPUT* pInput, GAME_RUMBLE* pRumble );
+
+    void SpawnAmmo( float fCenterX, float fCenterY, float fVelX, float fVelY, int iFromPlayer );
+    void SpawnAsteroid();
+
+    // Falls back to testing every ammo against every asteroid, for comparison
+    void EnableBroadphase( bool bEnable ) { m_bUseBroadphase = bEnable; }
+
+    GAME_STATE* GetState() { return m_pState; }
+    const GAME_STATE* GetState() const { return m_pState; }
+
+    // Flat copy of the state holding only the live part of each array.  SaveState
+    // returns the size written; pass NULL to query the size.
+    DWORD SaveState( BYTE* pDest ) const;
+    HRESULT LoadState( const BYTE* pSrc, DWORD cbSrc );
+    UINT64 GetStateHash() const;
+
+    // Every tick and board size change is reported to the recorder, if any
+    void SetRecorder( CGameReplay* pRecorder ) { m_pRecorder = pRecorder; }
+
+    // Deterministic rand(), 0..0x7FFF
+    int Rand();
+
+protected:
+    void Simulate( const GAME_INPUT* pInput, GAME_RUMBLE* pRumble );
+    void UpdateAmmo( GAME_RUMBLE* pRumble );
+    void UpdateAsteroids( GAME_RUMBLE* pRumble );
+    void UpdatePlayers( const GAME_INPUT* pInput, GAME_RUMBLE* pRumble );
+    void UpdateJoins( const GAME_INPUT* pInput, GAME_RUMBLE* pRumble );
+    void HitAsteroid( int iAsteroid, int iFromPlayer );
+    void DamagePlayer( int iPlayer, int nPenalty, GAME_RUMBLE* pRumble );
+
+    GAME_STATE* m_pState;
+    CGameBroadphase m_Broadphase;
+    CGameReplay* m_pRecorder;
+    bool m_bUseBroadphase;
+    float m_fAccumulator;
+};
+
+
+//--------------------------------------------------------------------------------------
+// Rumble helpers
+//--------------------------------------------------------------------------------------
+inline void SetGameRumble( GAME_RUMBLE* pRumble, int iController, WORD wLeft, WORD wRight )
+{
+    if( !pRumble || iController < 0 || iController >= GAME_MAX_PLAYERS )
+        return;
+    pRumble->bChanged[iController] = true;
+    pRumble->wLeftMotorSpeed[iController] = wLeft;
+    pRumble->wRightMotorSpeed[iController] = wRight;
+}
+
+inline void StopAllGameRumble( GAME_RUMBLE* pRumble )
+{
+    for( int i = 0; i < GAME_MAX_PLAYERS; i++ )
+        SetGameRumble( pRumble, i, 0, 0 );
+}
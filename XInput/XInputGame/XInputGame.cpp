@@ -10,86 +10,11 @@
 #include "DXUTsettingsdlg.h"
 #include "SDKmisc.h"
 #include "resource.h"
+#include "GameSim.h"
+#include "GameReplay.h"
 #include <XInput.h>
 
 
-//--------------------------------------------------------------------------------------
-// Structs/defines
-//--------------------------------------------------------------------------------------
-inline int RectWidth( RECT& rc )
-{
-    return ( ( rc ).right - ( rc ).left );
-}
-inline int RectHeight( RECT& rc )
-{
-    return ( ( rc ).bottom - ( rc ).top );
-}
-#define MAX_AMMO 100
-#define MAX_ASTEROID 100
-
-struct AMMO_STATE
-{
-    bool bActive;
-    double fTimeCreated;
-    float fLifeCountdown;
-    D3DXVECTOR2 vPosition;
-    D3DXVECTOR2 vVelocity;
-    int iFromPlayer;
-    D3DCOLOR clr;
-    RECT rcTexture;
-    float fSizeInPercent;
-    D3DXVECTOR2 vSizeInPixels;
-};
-
-struct ASTEROID_STATE
-{
-    bool bActive;
-    bool bDead;
-    float fDeathCountdown;
-    int nAnimationState;
-    D3DXVECTOR2 vPosition;
-    D3DXVECTOR2 vVelocity;
-    RECT rcTexture[6];
-    float fSizeInPercent;
-    D3DXVECTOR2 vSizeInPixels;
-    D3DCOLOR clr;
-};
-
-struct PLAYER_STATE
-{
-    int controllerIndex;
-    float fFireReloadCountdown;
-    bool bActive;
-    D3DXVECTOR2 vPosition;
-    RECT rcTexture;
-    D3DXVECTOR2 vSizeInPixels;
-    int nScore;
-    bool bFireRumbleInEffect;
-    float fFireRumbleCountdown;
-    bool bDamangeRumbleInEffect;
-    float fDamageRumbleCountdown;
-    D3DCOLOR clr;
-};
-
-enum GAME_MODE
-{
-    GAME_MAIN_MENU = 1,
-    GAME_RUNNING,
-    GAME_CONTROLLER_UNPLUGGED,
-};
-
-struct GAME_STATE
-{
-    int nNumActivePlayers;
-    PLAYER_STATE    player[DXUT_MAX_CONTROLLERS];
-    AMMO_STATE      AmmoQ[MAX_AMMO];
-    ASTEROID_STATE  AsteroidQ[MAX_ASTEROID];
-    int nAsteroidCount;
-    GAME_MODE gameMode;
-    int nUnpluggedPlayer;
-};
-
-
 //--------------------------------------------------------------------------------------
 // Global variables
 //--------------------------------------------------------------------------------------
@@ -101,7 +26,11 @@ CDXUTDialog                 g_SampleUI;                 // dialog for sample spe
 IDirect3DTexture9*          g_pSpriteTexture = NULL;
 IDirect3DTexture9*          g_pStarTexture = NULL;
 DXUT_GAMEPAD g_GamePads[DXUT_MAX_CONTROLLERS];
-GAME_STATE                  g_GameState;
+CGameSim                    g_GameSim;                  // Game state and simulation
+GAME_INPUT                  g_GameInput;                // Controller state not yet consumed by a tick
+RECT                        g_rcAsteroid[GAME_ASTEROID_FRAMES];
+CGameReplay                 g_GameReplay;               // Session recording for -record
+WCHAR                       g_strRecordFile[MAX_PATH] = L"";
 
 
 
@@ -122,6 +51,9 @@ void CALLBACK OnDestroyDevice( void* pUserContext );
 
 void InitApp();
 void RenderText();
+void SetAnimationRect( RECT* pRect, int nX, int nY );
+INT RunBenchmark( int nTicks );
+INT RunReplay( LPCWSTR strFileName, bool bPrintHashes );
 
 
 //--------------------------------------------------------------------------------------
@@ -135,7 +67,37 @@ INT WINAPI wWinMain( HINSTANCE, HINSTANCE, LPWSTR, int )
     _CrtSetDbgFlag( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );
 #endif
 
+    // "-benchmark [ticks]" runs the simulation headless with thousands of
+    // bullets and asteroids and reports the time per tick.
+    // "-replay file [-hashes]" re-simulates a recording headless and checks it
+    // for divergence.  "-record file" records this session for -replay.
+    int nNumArgs;
+    LPWSTR* pstrArgList = CommandLineToArgvW( GetCommandLineW(), &nNumArgs );
+    if( pstrArgList )
+    {
+        if( nNumArgs >= 2 && _wcsicmp( pstrArgList[1], L"-benchmark" ) == 0 )
+        {
+            int nTicks = ( nNumArgs >= 3 ) ? _wtoi( pstrArgList[2] ) : 600;
+            LocalFree( pstrArgList );
+            return RunBenchmark( max( nTicks, 1 ) );
+        }
+        if( nNumArgs >= 3 && _wcsicmp( pstrArgList[1], L"-replay" ) == 0 )
+        {
+            bool bPrintHashes = ( nNumArgs >= 4 && _wcsicmp( pstrArgList[3], L"-hashes" ) == 0 );
+            INT nResult = RunReplay( pstrArgList[2], bPrintHashes );
+            LocalFree( pstrArgList );
+            return nResult;
+        }
+        if( nNumArgs >= 3 && _wcsicmp( pstrArgList[1], L"-record" ) == 0 )
+            wcscpy_s( g_strRecordFile, MAX_PATH, pstrArgList[2] );
+        LocalFree( pstrArgList );
+    }
+
     // Init the app
+    if( FAILED( g_GameSim.Init( GetTickCount() ) ) )
+        return 1;
+    if( g_strRecordFile[0] && FAILED( g_GameReplay.BeginRecording( &g_GameSim ) ) )
+        g_strRecordFile[0] = 0;
     InitApp();
 
     // Init DXUT, and create the window and D3D device
@@ -154,6 +116,12 @@ INT WINAPI wWinMain( HINSTANCE, HINSTANCE, LPWSTR, int )
     // Start the message loop
     DXUTMainLoop();
 
+    if( g_strRecordFile[0] )
+    {
+        g_GameReplay.EndRecording();
+        g_GameReplay.Save( g_strRecordFile );
+    }
+
     return DXUTGetExitCode();
 }
 
@@ -163,8 +131,14 @@ INT WINAPI wWinMain( HINSTANCE, HINSTANCE, LPWSTR, int )
 //--------------------------------------------------------------------------------------
 void InitApp()
 {
-    ZeroMemory( &g_GameState, sizeof( GAME_STATE ) );
-    g_GameState.gameMode = GAME_MAIN_MENU;
+    ZeroMemory( &g_GameInput, sizeof( GAME_INPUT ) );
+
+    SetAnimationRect( &g_rcAsteroid[0], 0, 1 ); // alive
+    SetAnimationRect( &g_rcAsteroid[1], 1, 1 ); // death 1
+    SetAnimationRect( &g_rcAsteroid[2], 2, 1 ); // death 2
+    SetAnimationRect( &g_rcAsteroid[3], 3, 1 ); // death 3
+    SetAnimationRect( &g_rcAsteroid[4], 0, 2 ); // death 4
+    SetAnimationRect( &g_rcAsteroid[5], 1, 2 ); // death 5
 
     // Initialize dialogs
     g_SampleUI.Init( &g_DialogResourceManager );
@@ -227,543 +201,48 @@ HRESULT CALLBACK OnResetDevice( IDirect3DDevice9* pd3dDevice,
     g_SampleUI.SetLocation( pBackBufferSurfaceDesc->Width - 170, pBackBufferSurfaceDesc->Height - 350 );
     g_SampleUI.SetSize( 170, 300 );
 
-    {
-        float fSizeInPixels = pBackBufferSurfaceDesc->Width / 15.0f;
-        for (int iPlayer = 0; iPlayer < DXUT_MAX_CONTROLLERS; iPlayer++)
-        {
-            g_GameState.player[iPlayer].vSizeInPixels = D3DXVECTOR2(fSizeInPixels, fSizeInPixels);
-            SetAnimationRect(&g_GameState.player[iPlayer].rcTexture, iPlayer, 0);
-            g_GameState.player[iPlayer].clr = 0xFFFFFFFF;
-        }
-        g_GameState.player[0].vPosition = D3DXVECTOR2(pBackBufferSurfaceDesc->Width / 2.0f,
-            pBackBufferSurfaceDesc->Height / 2.0f);
-        g_GameState.player[1].vPosition = D3DXVECTOR2(pBackBufferSurfaceDesc->Width / 2.0f - fSizeInPixels * 4,
-            pBackBufferSurfaceDesc->Height / 2.0f - fSizeInPixels * 4);
-        g_GameState.player[2].vPosition = D3DXVECTOR2(pBackBufferSurfaceDesc->Width / 2.0f - fSizeInPixels * 4,
-            pBackBufferSurfaceDesc->Height / 2.0f + fSizeInPixels * 4);
-        g_GameState.player[3].vPosition = D3DXVECTOR2(pBackBufferSurfaceDesc->Width / 2.0f + fSizeInPixels * 4,
-            pBackBufferSurfaceDesc->Height / 2.0f - fSizeInPixels * 4);
-    }
-
-    for( int iAmmo = 0; iAmmo < MAX_AMMO; iAmmo++ )
-    {
-        if( !g_GameState.AmmoQ[iAmmo].bActive )
-            continue;
-        float fSizeInPixels = pBackBufferSurfaceDesc->Width * g_GameState.AmmoQ[iAmmo].fSizeInPercent;
-        g_GameState.AmmoQ[iAmmo].vSizeInPixels = D3DXVECTOR2( fSizeInPixels, fSizeInPixels );
-    }
-
-    for( int iAsteroid = 0; iAsteroid < MAX_ASTEROID; iAsteroid++ )
-    {
-        if( !g_GameState.AsteroidQ[iAsteroid].bActive )
-            continue;
-        float fSizeInPixels = pBackBufferSurfaceDesc->Width * g_GameState.AsteroidQ[iAsteroid].fSizeInPercent;
-        g_GameState.AsteroidQ[iAsteroid].vSizeInPixels = D3DXVECTOR2( fSizeInPixels, fSizeInPixels );
-    }
+    g_GameSim.SetBoardSize( ( float )pBackBufferSurfaceDesc->Width, ( float )pBackBufferSurfaceDesc->Height );
 
     return S_OK;
 }
 
 
-//--------------------------------------------------------------------------------------
-void FireAmmo( float fPosX, float fPosY, float fVelX, float fVelY, int iFromPlayer )
-{
-    // Check to see if there are already MAX_AMMO balls in the world.
-    // If there are, remove the oldest ammo to make room for the newest if necessary.
-    double fOldest = g_GameState.AmmoQ[0].fTimeCreated;
-    int nOldestIndex = 0;
-    int nInactiveIndex = -1;
-    for( int iAmmo = 0; iAmmo < MAX_AMMO; iAmmo++ )
-    {
-        if( !g_GameState.AmmoQ[iAmmo].bActive )
-        {
-            nInactiveIndex = iAmmo;
-            break;
-        }
-        if( g_GameState.AmmoQ[iAmmo].fTimeCreated < fOldest )
-        {
-            fOldest = g_GameState.AmmoQ[iAmmo].fTimeCreated;
-            nOldestIndex = iAmmo;
-        }
-    }
-
-    if( nInactiveIndex < 0 )
-    {
-        g_GameState.AmmoQ[nOldestIndex].bActive = false;
-        nInactiveIndex = nOldestIndex;
-    }
-
-    int nNewIndex = nInactiveIndex;
-    g_GameState.AmmoQ[nNewIndex].bActive = true;
-    g_GameState.AmmoQ[nNewIndex].fTimeCreated = DXUTGetTime();
-    g_GameState.AmmoQ[nNewIndex].fLifeCountdown = 1.0f;
-    g_GameState.AmmoQ[nNewIndex].iFromPlayer = iFromPlayer;
-    g_GameState.AmmoQ[nNewIndex].vVelocity = D3DXVECTOR2( fVelX, fVelY );
-    SetAnimationRect( &g_GameState.AmmoQ[nNewIndex].rcTexture, iFromPlayer, 3 );
-    g_GameState.AmmoQ[nNewIndex].fSizeInPercent = 1.0f / 20.0f;
-    float fSizeInPixels = DXUTGetD3D9BackBufferSurfaceDesc()->Width * g_GameState.AmmoQ[nNewIndex].fSizeInPercent;
-    g_GameState.AmmoQ[nNewIndex].vSizeInPixels = D3DXVECTOR2( fSizeInPixels, fSizeInPixels );
-    g_GameState.AmmoQ[nNewIndex].vPosition = D3DXVECTOR2( fPosX - fSizeInPixels / 2, fPosY - fSizeInPixels / 2 );
-    g_GameState.AmmoQ[nNewIndex].clr = g_GameState.player[iFromPlayer].clr;
-}
-
-
-//--------------------------------------------------------------------------------------
-void CreateAsteroid( bool bSmall )
-{
-    // Check to see if there are already MAX_ASTEROID in the world.
-    if( g_GameState.nAsteroidCount >= MAX_ASTEROID )
-        return;
-
-    int nInactiveIndex = -1;
-    for( int iAsteroid = 0; iAsteroid < MAX_ASTEROID; iAsteroid++ )
-    {
-        if( !g_GameState.AsteroidQ[iAsteroid].bActive )
-        {
-            nInactiveIndex = iAsteroid;
-            break;
-        }
-    }
-
-    if( nInactiveIndex < 0 )
-        return;
-
-    g_GameState.nAsteroidCount++;
-
-    float fPosX = ( rand() % 1000 ) / 1000.0f * DXUTGetD3D9BackBufferSurfaceDesc()->Width;
-    float fPosY = ( rand() % 1000 ) / 1000.0f * DXUTGetD3D9BackBufferSurfaceDesc()->Height;
-
-    float fVelX = ( rand() % 2000 - 1000 ) / 1000.0f * 0.1f;
-    float fVelY = ( rand() % 2000 - 1000 ) / 1000.0f * 0.1f;
-
-    int nNewIndex = nInactiveIndex;
-    g_GameState.AsteroidQ[nNewIndex].bActive = true;
-    g_GameState.AsteroidQ[nNewIndex].bDead = false;
-    g_GameState.AsteroidQ[nNewIndex].vVelocity = D3DXVECTOR2( fVelX, fVelY );
-
-    SetAnimationRect( &g_GameState.AsteroidQ[nNewIndex].rcTexture[0], 0, 1 ); // alive
-    SetAnimationRect( &g_GameState.AsteroidQ[nNewIndex].rcTexture[1], 1, 1 ); // death 1
-    SetAnimationRect( &g_GameState.AsteroidQ[nNewIndex].rcTexture[2], 2, 1 ); // death 2
-    SetAnimationRect( &g_GameState.AsteroidQ[nNewIndex].rcTexture[3], 3, 1 ); // death 3
-    SetAnimationRect( &g_GameState.AsteroidQ[nNewIndex].rcTexture[4], 0, 2 ); // death 4
-    SetAnimationRect( &g_GameState.AsteroidQ[nNewIndex].rcTexture[5], 1, 2 ); // death 5
-    g_GameState.AsteroidQ[nNewIndex].fSizeInPercent = 1.0f / 10.0f;
-
-    float fSizeInPixels = DXUTGetD3D9BackBufferSurfaceDesc()->Width * g_GameState.AsteroidQ[nNewIndex].fSizeInPercent;
-    g_GameState.AsteroidQ[nNewIndex].vSizeInPixels = D3DXVECTOR2( fSizeInPixels, fSizeInPixels );
-    g_GameState.AsteroidQ[nNewIndex].vPosition = D3DXVECTOR2( fPosX - fSizeInPixels / 2, fPosY - fSizeInPixels / 2 );
-    g_GameState.AsteroidQ[nNewIndex].clr = 0xFFFFFFFF;
-    g_GameState.AsteroidQ[nNewIndex].nAnimationState = 0;
-}
-
-
-//--------------------------------------------------------------------------------------
-void UpdateGame( IDirect3DDevice9* pd3dDevice, double fTime, float fElapsedTime )
-{
-    // Update active ammo
-    for( int iAmmo = 0; iAmmo < MAX_AMMO; iAmmo++ )
-    {
-        if( !g_GameState.AmmoQ[iAmmo].bActive )
-            continue;
-
-        AMMO_STATE* pAmmo = &g_GameState.AmmoQ[iAmmo];
-
-        pAmmo->fLifeCountdown -= fElapsedTime;
-        if( pAmmo->fLifeCountdown < 0.0f )
-        {
-            pAmmo->bActive = false;
-            continue;
-        }
-
-        pAmmo->vPosition.x += pAmmo->vVelocity.x * pAmmo->vSizeInPixels.x * fElapsedTime * 15.0f;
-        pAmmo->vPosition.y += pAmmo->vVelocity.y * pAmmo->vSizeInPixels.y * fElapsedTime * 15.0f;
-
-        // Bounce ammo against walls
-        float fMaxBoardY = ( float )DXUTGetD3D9BackBufferSurfaceDesc()->Height - pAmmo->vSizeInPixels.y;
-        float fMaxBoardX = ( float )DXUTGetD3D9BackBufferSurfaceDesc()->Width - pAmmo->vSizeInPixels.x;
-        if( pAmmo->vPosition.x > fMaxBoardX )
-        {
-            pAmmo->vPosition.x = fMaxBoardX;
-            pAmmo->vVelocity.x = -pAmmo->vVelocity.x;
-        }
-        if( pAmmo->vPosition.x < 0 )
-        {
-            pAmmo->vPosition.x = 0;
-            pAmmo->vVelocity.x = -pAmmo->vVelocity.x;
-        }
-        if( pAmmo->vPosition.y > fMaxBoardY )
-        {
-            pAmmo->vPosition.y = fMaxBoardY;
-            pAmmo->vVelocity.y = -pAmmo->vVelocity.y;
-        }
-        if( pAmmo->vPosition.y < 0 )
-        {
-            pAmmo->vPosition.y = 0;
-            pAmmo->vVelocity.y = -pAmmo->vVelocity.y;
-        }
-
-        float fAmmoCenterX = pAmmo->vPosition.x + pAmmo->vSizeInPixels.x / 2.0f;
-        float fAmmoCenterY = pAmmo->vPosition.y + pAmmo->vSizeInPixels.y / 2.0f;
-
-        // Check if hit other player
-        for( int iPlayer = 0; iPlayer < DXUT_MAX_CONTROLLERS; iPlayer++ )
-        {
-            if( iPlayer == pAmmo->iFromPlayer )
-                continue;
-            if( !g_GameState.player[iPlayer].bActive )
-                continue;
-
-            float fPlayerCenterX = g_GameState.player[iPlayer].vPosition.x +
-                g_GameState.player[iPlayer].vSizeInPixels.x / 2.0f;
-            float fPlayerCenterY = g_GameState.player[iPlayer].vPosition.y +
-                g_GameState.player[iPlayer].vSizeInPixels.y / 2.0f;
-            if( fabsf( fAmmoCenterX - fPlayerCenterX ) < g_GameState.player[iPlayer].vSizeInPixels.x / 2.0f &&
-                fabsf( fAmmoCenterY - fPlayerCenterY ) < g_GameState.player[iPlayer].vSizeInPixels.y / 2.0f )
-            {
-                g_GameState.player[pAmmo->iFromPlayer].nScore++;
-                pAmmo->bActive = false;
-
-                g_GameState.player[iPlayer].nScore -= 1;
-                g_GameState.player[iPlayer].bDamangeRumbleInEffect = true;
-                g_GameState.player[iPlayer].fDamageRumbleCountdown = 0.50f;
-
-                XINPUT_VIBRATION vibration;
-                vibration.wLeftMotorSpeed = 0xFFFF;
-                vibration.wRightMotorSpeed = 0;
-                XInputSetState( g_GameState.player[iPlayer].controllerIndex, &vibration );
-                continue;
-            }
-        }
-
-        for( int iAsteroid = 0; iAsteroid < MAX_ASTEROID; iAsteroid++ )
-        {
-            if( !g_GameState.AsteroidQ[iAsteroid].bActive || g_GameState.AsteroidQ[iAsteroid].bDead )
-                continue;
-
-            float fAsterCenterX = g_GameState.AsteroidQ[iAsteroid].vPosition.x +
-                g_GameState.AsteroidQ[iAsteroid].vSizeInPixels.x / 2.0f;
-            float fAsterCenterY = g_GameState.AsteroidQ[iAsteroid].vPosition.y +
-                g_GameState.AsteroidQ[iAsteroid].vSizeInPixels.y / 2.0f;
-            if( fabsf( fAmmoCenterX - fAsterCenterX ) < g_GameState.AsteroidQ[iAsteroid].vSizeInPixels.x / 4.0f &&
-                fabsf( fAmmoCenterY - fAsterCenterY ) < g_GameState.AsteroidQ[iAsteroid].vSizeInPixels.y / 4.0f )
-            {
-                g_GameState.player[pAmmo->iFromPlayer].nScore++;
-                pAmmo->bActive = false;
-                g_GameState.AsteroidQ[iAsteroid].bDead = true;
-                g_GameState.AsteroidQ[iAsteroid].nAnimationState = 2;
-                g_GameState.AsteroidQ[iAsteroid].fDeathCountdown = 1.1f;
-            }
-        }
-    }
-
-    // Update active asteroids
-    for( int iAsteroid = 0; iAsteroid < MAX_ASTEROID; iAsteroid++ )
-    {
-        if( !g_GameState.AsteroidQ[iAsteroid].bActive )
-            continue;
-
-        ASTEROID_STATE* pAsteroid = &g_GameState.AsteroidQ[iAsteroid];
-
-        if( pAsteroid->bDead )
-        {
-            pAsteroid->fDeathCountdown -= fElapsedTime;
-            g_GameState.AsteroidQ[iAsteroid].nAnimationState = min( ( int )( ( 1.1f - pAsteroid->fDeathCountdown ) /
-                                                                             0.1f ) + 1, 5 );
-            if( pAsteroid->fDeathCountdown < 0.5f )
-            {
-                pAsteroid->bActive = false;
-                g_GameState.nAsteroidCount--;
-            }
-            continue;
-        }
-
-        pAsteroid->vPosition.x += pAsteroid->vVelocity.x * pAsteroid->vSizeInPixels.x * fElapsedTime * 15.0f;
-        pAsteroid->vPosition.y += pAsteroid->vVelocity.y * pAsteroid->vSizeInPixels.y * fElapsedTime * 15.0f;
-
-        // Bounce asteroid against walls
-        float fMaxBoardY = ( float )DXUTGetD3D9BackBufferSurfaceDesc()->Height - pAsteroid->vSizeInPixels.y;
-        float fMaxBoardX = ( float )DXUTGetD3D9BackBufferSurfaceDesc()->Width - pAsteroid->vSizeInPixels.x;
-        if( pAsteroid->vPosition.x > fMaxBoardX )
-        {
-            pAsteroid->vPosition.x = fMaxBoardX;
-            pAsteroid->vVelocity.x = -pAsteroid->vVelocity.x;
-        }
-        if( pAsteroid->vPosition.x < 0 )
-        {
-            pAsteroid->vPosition.x = 0;
-            pAsteroid->vVelocity.x = -pAsteroid->vVelocity.x;
-        }
-        if( pAsteroid->vPosition.y > fMaxBoardY )
-        {
-            pAsteroid->vPosition.y = fMaxBoardY;
-            pAsteroid->vVelocity.y = -pAsteroid->vVelocity.y;
-        }
-        if( pAsteroid->vPosition.y < 0 )
-        {
-            pAsteroid->vPosition.y = 0;
-            pAsteroid->vVelocity.y = -pAsteroid->vVelocity.y;
-        }
-
-        float fAsteroidCenterX = pAsteroid->vPosition.x + pAsteroid->vSizeInPixels.x / 2.0f;
-        float fAsteroidCenterY = pAsteroid->vPosition.y + pAsteroid->vSizeInPixels.y / 2.0f;
-
-        // Check if asteroid hit player
-        for( int iPlayer = 0; iPlayer < DXUT_MAX_CONTROLLERS; iPlayer++ )
-        {
-            if( !g_GameState.player[iPlayer].bActive )
-                continue;
-
-            float fPlayerCenterX = g_GameState.player[iPlayer].vPosition.x +
-                g_GameState.player[iPlayer].vSizeInPixels.x / 2.0f;
-            float fPlayerCenterY = g_GameState.player[iPlayer].vPosition.y +
-                g_GameState.player[iPlayer].vSizeInPixels.y / 2.0f;
-            if( fabsf( fAsteroidCenterX - fPlayerCenterX ) < g_GameState.player[iPlayer].vSizeInPixels.x / 2.0f &&
-                fabsf( fAsteroidCenterY - fPlayerCenterY ) < g_GameState.player[iPlayer].vSizeInPixels.y / 2.0f )
-            {
-                pAsteroid->bActive = false;
-                g_GameState.nAsteroidCount--;
-
-                g_GameState.player[iPlayer].nScore -= 10;
-                g_GameState.player[iPlayer].bDamangeRumbleInEffect = true;
-                g_GameState.player[iPlayer].fDamageRumbleCountdown = 0.50f;
-
-                XINPUT_VIBRATION vibration;
-                vibration.wLeftMotorSpeed = 0xFFFF;
-                vibration.wRightMotorSpeed = 0;
-                XInputSetState( g_GameState.player[iPlayer].controllerIndex, &vibration );
-                continue;
-            }
-        }
-    }
-
-    // Update active players
-    for( int iPlayer = 0; iPlayer < DXUT_MAX_CONTROLLERS; iPlayer++ )
-    {
-        if( !g_GameState.player[iPlayer].bActive )
-            continue;
-
-        // Check controller index assigned to this player
-        int iUserIndex = g_GameState.player[iPlayer].controllerIndex;
-        if( !g_GamePads[iUserIndex].bConnected )
-            continue; // unplugged?
-
-        if( g_GameState.player[iPlayer].bFireRumbleInEffect )
-        {
-            g_GameState.player[iPlayer].fFireRumbleCountdown -= fElapsedTime;
-            if( g_GameState.player[iPlayer].fFireRumbleCountdown < 0.0f )
-            {
-                g_GameState.player[iPlayer].bFireRumbleInEffect = false;
-
-                // Turn off rumble if damage rumble not happening
-                if( !g_GameState.player[iPlayer].bDamangeRumbleInEffect )
-                {
-                    XINPUT_VIBRATION vibration;
-                    vibration.wLeftMotorSpeed = 0;
-                    vibration.wRightMotorSpeed = 0;
-                    XInputSetState( iUserIndex, &vibration );
-                }
-            }
-        }
-
-        if( g_GameState.player[iPlayer].bDamangeRumbleInEffect )
-        {
-            g_GameState.player[iPlayer].fDamageRumbleCountdown -= fElapsedTime;
-            if( g_GameState.player[iPlayer].fDamageRumbleCountdown < 0.0f )
-            {
-                g_GameState.player[iPlayer].fDamageRumbleCountdown = false;
-
-                // Turn off rumble if fire rumble not happening
-                if( !g_GameState.player[iPlayer].bFireRumbleInEffect )
-                {
-                    XINPUT_VIBRATION vibration;
-                    vibration.wLeftMotorSpeed = 0;
-                    vibration.wRightMotorSpeed = 0;
-                    XInputSetState( iUserIndex, &vibration );
-                }
-            }
-        }
-
-        // Move player based on left thumbstick
-        g_GameState.player[iPlayer].vPosition.x += g_GamePads[iUserIndex].fThumbLX * fElapsedTime *
-            g_GameState.player[iPlayer].vSizeInPixels.x * 10.0f;
-        g_GameState.player[iPlayer].vPosition.y += -g_GamePads[iUserIndex].fThumbLY * fElapsedTime *
-            g_GameState.player[iPlayer].vSizeInPixels.y * 10.0f;
-
-        // Keep player within map bounds
-        float fMaxBoardY = ( float )DXUTGetD3D9BackBufferSurfaceDesc()->Height -
-            g_GameState.player[iPlayer].vSizeInPixels.y;
-        float fMaxBoardX = ( float )DXUTGetD3D9BackBufferSurfaceDesc()->Width -
-            g_GameState.player[iPlayer].vSizeInPixels.x;
-        if( g_GameState.player[iPlayer].vPosition.x > fMaxBoardX )
-            g_GameState.player[iPlayer].vPosition.x = fMaxBoardX;
-        if( g_GameState.player[iPlayer].vPosition.x < 0 )
-            g_GameState.player[iPlayer].vPosition.x = 0;
-        if( g_GameState.player[iPlayer].vPosition.y > fMaxBoardY )
-            g_GameState.player[iPlayer].vPosition.y = fMaxBoardY;
-        if( g_GameState.player[iPlayer].vPosition.y < 0 )
-            g_GameState.player[iPlayer].vPosition.y = 0;
-
-        g_GameState.player[iPlayer].fFireReloadCountdown -= fElapsedTime;
-        if( g_GameState.player[iPlayer].fFireReloadCountdown < 0.0f )
-        {
-            // Fire ammo if right thumbstick non-zero
-            if( g_GamePads[iUserIndex].sThumbRX != 0 || g_GamePads[iUserIndex].sThumbRY != 0 )
-            {
-                g_GameState.player[iPlayer].fFireReloadCountdown = 0.1f;
-                float fVelX = g_GamePads[iUserIndex].fThumbRX;
-                float fVelY = -g_GamePads[iUserIndex].fThumbRY;
-                FireAmmo( g_GameState.player[iPlayer].vPosition.x + g_GameState.player[iPlayer].vSizeInPixels.x / 2,
-                          g_GameState.player[iPlayer].vPosition.y + g_GameState.player[iPlayer].vSizeInPixels.y / 2,
-                          fVelX, fVelY, iPlayer );
-
-                g_GameState.player[iPlayer].bFireRumbleInEffect = true;
-                g_GameState.player[iPlayer].fFireRumbleCountdown = 0.15f;
-                XINPUT_VIBRATION vibration;
-                vibration.wLeftMotorSpeed = 0;
-                vibration.wRightMotorSpeed = 15000;
-                XInputSetState( iUserIndex, &vibration );
-            }
-        }
-    }
-
-    // Check if another player is trying to join
-    for( int iUserIndex = 0; iUserIndex < DXUT_MAX_CONTROLLERS; iUserIndex++ )
-    {
-        // Skip if controller not connected
-        if( !g_GamePads[iUserIndex].bConnected )
-            continue;
-
-        // Check if this controller is already being used by another player
-        bool bControllerInUse = false;
-        int nPlayerUsingThisController = -1;
-        for( int iPlayer = 0; iPlayer < DXUT_MAX_CONTROLLERS; iPlayer++ )
-        {
-            if( !g_GameState.player[iPlayer].bActive )
-                continue;
-            if( g_GameState.player[iPlayer].controllerIndex == iUserIndex )
-            {
-                bControllerInUse = true;
-                nPlayerUsingThisController = iPlayer;
-            }
-        }
-
-        if( !bControllerInUse )
-        {
-            if( g_GamePads[iUserIndex].wPressedButtons != 0 )
-            {
-                // If a button is pressed on an used controller, assign it
-                // to the first inactive player
-                for( int iPlayer = 0; iPlayer < DXUT_MAX_CONTROLLERS; iPlayer++ )
-                {
-                    if( !g_GameState.player[iPlayer].bActive )
-                    {
-                        g_GameState.player[iPlayer].bActive = true;
-                        g_GameState.nNumActivePlayers++;
-                        g_GameState.player[iPlayer].controllerIndex = iUserIndex;
-
-                        // Reset all score when a new player joins
-                        for( int iPlayer2 = 0; iPlayer2 < DXUT_MAX_CONTROLLERS; iPlayer2++ )
-                            g_GameState.player[iPlayer2].nScore = 0;
-                        break;
-                    }
-                }
-            }
-        }
-        else
-        {
-            if( ( g_GamePads[iUserIndex].wPressedButtons & XINPUT_GAMEPAD_START ) )
-            {
-                if( nPlayerUsingThisController >= 0 && nPlayerUsingThisController < DXUT_MAX_CONTROLLERS )
-                {
-                    g_GameState.player[nPlayerUsingThisController].bActive = false;
-                    g_GameState.nNumActivePlayers--;
-                    if( g_GameState.nNumActivePlayers == 0 )
-                    {
-                        DXUTStopRumbleOnAllControllers();
-                        g_GameState.gameMode = GAME_MAIN_MENU;
-                    }
-
-                    // Turn off rumble
-                    XINPUT_VIBRATION vibration;
-                    vibration.wLeftMotorSpeed = 0;
-                    vibration.wRightMotorSpeed = 0;
-                    XInputSetState( g_GameState.player[nPlayerUsingThisController].controllerIndex, &vibration );
-                }
-            }
-        }
-    }
-
-}
-
-
 //--------------------------------------------------------------------------------------
 // Update scene
 //--------------------------------------------------------------------------------------
 void CALLBACK OnFrameMove( double fTime, float fElapsedTime, void* pUserContext )
 {
-    if( g_GameState.nAsteroidCount < 10 * g_GameState.nNumActivePlayers )
-        CreateAsteroid( ( rand() % 2 ) == 0 );
-
-    // Get the state of the gamepads
+    // Get the state of the gamepads.  Button presses are accumulated until a
+    // simulation tick consumes them.
     for( DWORD iUserIndex = 0; iUserIndex < DXUT_MAX_CONTROLLERS; iUserIndex++ )
-        DXUTGetGamepadState( iUserIndex, &g_GamePads[iUserIndex], true, false );
-
-    if( g_GameState.gameMode == GAME_RUNNING )
-    {
-        // Detect if any controller became unplugged.  If it did
-        // pause the game and display error text
-        for( int iPlayer = 0; iPlayer < DXUT_MAX_CONTROLLERS; iPlayer++ )
-        {
-            if( !g_GameState.player[iPlayer].bActive )
-                continue;
-
-            // Check controller index assigned to this player
-            int iUserIndex = g_GameState.player[iPlayer].controllerIndex;
-            if( !g_GamePads[iUserIndex].bConnected )
-            {
-                // Controller is unplugged
-                DXUTStopRumbleOnAllControllers();
-                g_GameState.gameMode = GAME_CONTROLLER_UNPLUGGED;
-                g_GameState.nUnpluggedPlayer = iPlayer;
-                return;
-            }
-        }
-    }
-    else if( g_GameState.gameMode == GAME_CONTROLLER_UNPLUGGED )
     {
-        // Check to see if player's unplugged controller is reconnect and the 
-        // player has pressed Start yet.
-        int iUserIndex = g_GameState.player[g_GameState.nUnpluggedPlayer].controllerIndex;
-        if( g_GamePads[iUserIndex].bConnected )
-        {
-            if( ( g_GamePads[iUserIndex].wPressedButtons & XINPUT_GAMEPAD_START ) )
-            {
-                g_GameState.gameMode = GAME_RUNNING;
-                return;
-            }
-        }
+        DXUT_GAMEPAD* pGamePad = &g_GamePads[iUserIndex];
+        GAME_PAD_INPUT* pPad = &g_GameInput.pad[iUserIndex];
+
+        DXUTGetGamepadState( iUserIndex, pGamePad, true, false );
+        pPad->bConnected = pGamePad->bConnected;
+        pPad->bFire = ( pGamePad->sThumbRX != 0 || pGamePad->sThumbRY != 0 );
+        pPad->wPressedButtons |= pGamePad->wPressedButtons;
+        pPad->fThumbLX = pGamePad->fThumbLX;
+        pPad->fThumbLY = pGamePad->fThumbLY;
+        pPad->fThumbRX = pGamePad->fThumbRX;
+        pPad->fThumbRY = pGamePad->fThumbRY;
     }
 
-    if( g_GameState.gameMode == GAME_MAIN_MENU )
-    {
-        for( int iUserIndex = 0; iUserIndex < DXUT_MAX_CONTROLLERS; iUserIndex++ )
-        {
-            if( !g_GamePads[iUserIndex].bConnected )
-                continue;
+    GAME_RUMBLE rumble;
+    ZeroMemory( &rumble, sizeof( GAME_RUMBLE ) );
+    g_GameSim.Advance( fElapsedTime, &g_GameInput, &rumble );
 
-            // If any button pressed
-            if( g_GamePads[iUserIndex].wPressedButtons != 0 )
-            {
-                g_GameState.player[0].bActive = true;
-                g_GameState.player[0].controllerIndex = iUserIndex;
-                g_GameState.nNumActivePlayers = 1;
-                g_GameState.gameMode = GAME_RUNNING;
-            }
-        }
-    }
-    else if( g_GameState.gameMode == GAME_RUNNING )
+    // Send the final rumble state of this frame to each controller that changed
+    for( int iUserIndex = 0; iUserIndex < DXUT_MAX_CONTROLLERS; iUserIndex++ )
     {
-        UpdateGame( DXUTGetD3D9Device(), fTime, fElapsedTime );
+        if( !rumble.bChanged[iUserIndex] )
+            continue;
+
+        XINPUT_VIBRATION vibration;
+        vibration.wLeftMotorSpeed = rumble.wLeftMotorSpeed[iUserIndex];
+        vibration.wRightMotorSpeed = rumble.wRightMotorSpeed[iUserIndex];
+        XInputSetState( iUserIndex, &vibration );
     }
 }
 
@@ -774,6 +253,7 @@ void CALLBACK OnFrameMove( double fTime, float fElapsedTime, void* pUserContext
 void CALLBACK OnFrameRender( IDirect3DDevice9* pd3dDevice, double fTime, float fElapsedTime, void* pUserContext )
 {
     HRESULT hr;
+    const GAME_STATE* pState = g_GameSim.GetState();
 
     // Clear the render target and the zbuffer 
     V( pd3dDevice->Clear( 0, NULL, D3DCLEAR_TARGET | D3DCLEAR_ZBUFFER, D3DCOLOR_ARGB( 0, 45, 0, 140 ), 1.0f, 0 ) );
@@ -781,7 +261,7 @@ void CALLBACK OnFrameRender( IDirect3DDevice9* pd3dDevice, double fTime, float f
     // Render the scene
     if( SUCCEEDED( pd3dDevice->BeginScene() ) )
     {
-        if( g_GameState.gameMode == GAME_MAIN_MENU )
+        if( pState->gameMode == GAME_MAIN_MENU )
         {
             CDXUTTextHelper txtHelper( g_pFont, g_pSprite, 25 );
             txtHelper.Begin();
@@ -832,52 +312,41 @@ void CALLBACK OnFrameRender( IDirect3DDevice9* pd3dDevice, double fTime, float f
                 g_pSprite->Draw(g_pStarTexture, &rcTexture, NULL, &vPos, 0xFFFFFFFF);
             }
 
-            for( int i = 0; i < MAX_AMMO; i++ )
+            // Every sprite cell is 128x128 texels
+            RECT rcSprite;
+            float fScale = pState->fAmmoSize / 128.0f;
+            D3DXMatrixScaling( &matTransform, fScale, fScale, 1.0f );
+            g_pSprite->SetTransform( &matTransform );
+            for( int i = 0; i < pState->ammo.nCount; i++ )
             {
-                if( g_GameState.AmmoQ[i].bActive )
-                {
-                    float fScaleX = ( float )g_GameState.AmmoQ[i].vSizeInPixels.x /
-                        RectWidth( g_GameState.AmmoQ[i].rcTexture );
-                    float fScaleY = ( float )g_GameState.AmmoQ[i].vSizeInPixels.y /
-                        RectHeight( g_GameState.AmmoQ[i].rcTexture );
-                    D3DXMatrixScaling( &matTransform, fScaleX, fScaleY, 1.0f );
-                    g_pSprite->SetTransform( &matTransform );
-                    D3DXVECTOR3 vPos( g_GameState.AmmoQ[i].vPosition.x / fScaleX, g_GameState.AmmoQ[i].vPosition.y /
-                                      fScaleY, 0.0f );
-                    g_pSprite->Draw( g_pSpriteTexture, &g_GameState.AmmoQ[i].rcTexture, NULL, &vPos,
-                                     g_GameState.AmmoQ[i].clr );
-                }
+                SetAnimationRect( &rcSprite, pState->ammo.iFromPlayer[i], 3 );
+                D3DXVECTOR3 vPos( pState->ammo.fCenterX[i] / fScale - 64.0f,
+                                  pState->ammo.fCenterY[i] / fScale - 64.0f, 0.0f );
+                g_pSprite->Draw( g_pSpriteTexture, &rcSprite, NULL, &vPos, 0xFFFFFFFF );
             }
 
-            for( int i = 0; i < MAX_ASTEROID; i++ )
+            fScale = pState->fAsteroidSize / 128.0f;
+            D3DXMatrixScaling( &matTransform, fScale, fScale, 1.0f );
+            g_pSprite->SetTransform( &matTransform );
+            for( int i = 0; i < pState->asteroid.nCount; i++ )
             {
-                if( g_GameState.AsteroidQ[i].bActive )
-                {
-                    RECT* pTexRect = &g_GameState.AsteroidQ[i].rcTexture[g_GameState.AsteroidQ[i].nAnimationState];
-                    float fScaleX = ( float )g_GameState.AsteroidQ[i].vSizeInPixels.x / RectWidth( *pTexRect );
-                    float fScaleY = ( float )g_GameState.AsteroidQ[i].vSizeInPixels.y / RectHeight( *pTexRect );
-                    D3DXMatrixScaling( &matTransform, fScaleX, fScaleY, 1.0f );
-                    g_pSprite->SetTransform( &matTransform );
-                    D3DXVECTOR3 vPos( g_GameState.AsteroidQ[i].vPosition.x / fScaleX,
-                                      g_GameState.AsteroidQ[i].vPosition.y / fScaleY, 0.0f );
-                    g_pSprite->Draw( g_pSpriteTexture, pTexRect, NULL, &vPos, g_GameState.AsteroidQ[i].clr );
-                }
+                D3DXVECTOR3 vPos( pState->asteroid.fCenterX[i] / fScale - 64.0f,
+                                  pState->asteroid.fCenterY[i] / fScale - 64.0f, 0.0f );
+                g_pSprite->Draw( g_pSpriteTexture, &g_rcAsteroid[pState->asteroid.nAnimationState[i]], NULL, &vPos,
+                                 0xFFFFFFFF );
             }
 
-            for( int i = 0; i < DXUT_MAX_CONTROLLERS; i++ )
+            fScale = pState->fPlayerSize / 128.0f;
+            D3DXMatrixScaling( &matTransform, fScale, fScale, 1.0f );
+            g_pSprite->SetTransform( &matTransform );
+            for( int i = 0; i < GAME_MAX_PLAYERS; i++ )
             {
-                if( g_GameState.player[i].bActive )
+                if( pState->player[i].bActive )
                 {
-                    float fScaleX = ( float )g_GameState.player[i].vSizeInPixels.x /
-                        RectWidth( g_GameState.player[i].rcTexture );
-                    float fScaleY = ( float )g_GameState.player[i].vSizeInPixels.y /
-                        RectHeight( g_GameState.player[i].rcTexture );
-                    D3DXMatrixScaling( &matTransform, fScaleX, fScaleY, 1.0f );
-                    g_pSprite->SetTransform( &matTransform );
-                    D3DXVECTOR3 vPos( g_GameState.player[i].vPosition.x / fScaleX, g_GameState.player[i].vPosition.y /
-                                      fScaleY, 0.0f );
-                    g_pSprite->Draw( g_pSpriteTexture, &g_GameState.player[i].rcTexture, NULL, &vPos,
-                                     g_GameState.player[i].clr );
+                    SetAnimationRect( &rcSprite, i, 0 );
+                    D3DXVECTOR3 vPos( pState->player[i].fCenterX / fScale - 64.0f,
+                                      pState->player[i].fCenterY / fScale - 64.0f, 0.0f );
+                    g_pSprite->Draw( g_pSpriteTexture, &rcSprite, NULL, &vPos, 0xFFFFFFFF );
                 }
             }
 
@@ -900,15 +369,16 @@ void CALLBACK OnFrameRender( IDirect3DDevice9* pd3dDevice, double fTime, float f
 //--------------------------------------------------------------------------------------
 void RenderText()
 {
+    const GAME_STATE* pState = g_GameSim.GetState();
     CDXUTTextHelper txtHelper( g_pFont, g_pSprite, 25 );
     txtHelper.Begin();
 
     for( int i = 0; i < DXUT_MAX_CONTROLLERS; i++ )
     {
-        if( !g_GameState.player[i].bActive )
+        if( !pState->player[i].bActive )
             continue;
 
-        switch( g_GameState.player[i].controllerIndex )
+        switch( pState->player[i].controllerIndex )
         {
             case 0:
                 txtHelper.SetInsertionPos( 5, 5 ); break;
@@ -938,17 +408,17 @@ void RenderText()
                 wcscpy_s( strName, 256, L"Red" ); break;
         }
 
-        txtHelper.DrawFormattedTextLine( L"%s Player: %d", strName, g_GameState.player[i].nScore );
+        txtHelper.DrawFormattedTextLine( L"%s Player: %d", strName, pState->player[i].nScore );
     }
 
     // Display reconnect message if controller came unplugged
-    if( g_GameState.gameMode == GAME_CONTROLLER_UNPLUGGED )
+    if( pState->gameMode == GAME_CONTROLLER_UNPLUGGED )
     {
         txtHelper.SetForegroundColor( D3DXCOLOR( 1.0f, 1.0f, 0.0f, 1.0f ) );
         txtHelper.SetInsertionPos( DXUTGetD3D9BackBufferSurfaceDesc()->Width / 2 - 512,
                                    DXUTGetD3D9BackBufferSurfaceDesc()->Height / 2 );
         txtHelper.DrawFormattedTextLine( L"Player %d's controller is unplugged.  Please reconnect and push Start",
-                                         g_GameState.nUnpluggedPlayer + 1 );
+                                         pState->nUnpluggedPlayer + 1 );
     }
     txtHelper.End();
 
@@ -1018,3 +488,157 @@ void CALLBACK OnDestroyDevice( void* pUserContext )
     SAFE_RELEASE( g_pFont );
     SAFE_RELEASE( g_pSmallFont );
 }
+
+
+//--------------------------------------------------------------------------------------
+// Runs the simulation without a device.  Four players fire continuously while the
+// world is topped up with bullets and asteroids every tick, once with the grid
+// broadphase and once testing every pair, and the time per tick is reported.
+//--------------------------------------------------------------------------------------
+INT RunBenchmark( int nTicks )
+{
+    const int nAmmo = GAME_SIM_MAX_AMMO;
+    const int nAsteroids = GAME_SIM_MAX_ASTEROID / 2;
+
+    // Report to the console we were started from, if any
+    if( AttachConsole( ATTACH_PARENT_PROCESS ) )
+    {
+        FILE* pFile;
+        freopen_s( &pFile, "CONOUT$", "w", stdout );
+    }
+
+    GAME_INPUT input;
+    ZeroMemory( &input, sizeof( GAME_INPUT ) );
+    for( int i = 0; i < GAME_MAX_PLAYERS; i++ )
+    {
+        input.pad[i].bConnected = true;
+        input.pad[i].bFire = true;
+        input.pad[i].fThumbLX = ( i & 1 ) ? 0.5f : -0.5f;
+        input.pad[i].fThumbRX = 1.0f;
+        input.pad[i].fThumbRY = ( i & 2 ) ? 1.0f : -1.0f;
+    }
+
+    LARGE_INTEGER qwFreq;
+    QueryPerformanceFrequency( &qwFreq );
+
+    wprintf( L"%d ticks, %d ammo, %d asteroids\n", nTicks, nAmmo, nAsteroids );
+
+    int nScore[2] = { 0, 0 };
+    for( int nPass = 0; nPass < 2; nPass++ )
+    {
+        CGameSim sim;
+        if( FAILED( sim.Init() ) )
+            return 1;
+        sim.EnableBroadphase( nPass == 0 );
+        sim.SetBoardSize( 1920.0f, 1080.0f );
+
+        GAME_STATE* pState = sim.GetState();
+        pState->gameMode = GAME_RUNNING;
+        pState->nMaxAmmo = nAmmo;
+        pState->nMaxAsteroids = nAsteroids;
+        pState->nAsteroidsPerPlayer = 0;
+        pState->nNumActivePlayers = GAME_MAX_PLAYERS;
+        for( int i = 0; i < GAME_MAX_PLAYERS; i++ )
+        {
+            pState->player[i].bActive = true;
+            pState->player[i].controllerIndex = i;
+        }
+
+        // Both passes see the same world
+        srand( 0 );
+        pState->nRandSeed = 1;
+
+        LONGLONG llTime = 0;
+        for( int nTick = 0; nTick < nTicks; nTick++ )
+        {
+            while( pState->asteroid.nCount < nAsteroids )
+                sim.SpawnAsteroid();
+            while( pState->ammo.nCount < nAmmo )
+            {
+                sim.SpawnAmmo( ( rand() % 1000 ) / 1000.0f * pState->fBoardWidth,
+                               ( rand() % 1000 ) / 1000.0f * pState->fBoardHeight,
+                               ( rand() % 2000 - 1000 ) / 1000.0f, ( rand() % 2000 - 1000 ) / 1000.0f,
+                               rand() % GAME_MAX_PLAYERS );
+            }
+
+            LARGE_INTEGER qwStart, qwEnd;
+            QueryPerformanceCounter( &qwStart );
+            sim.Step( &input, NULL );
+            QueryPerformanceCounter( &qwEnd );
+            llTime += qwEnd.QuadPart - qwStart.QuadPart;
+        }
+
+        for( int i = 0; i < GAME_MAX_PLAYERS; i++ )
+            nScore[nPass] += pState->player[i].nScore;
+
+        wprintf( L"%-12s %.3f ms per tick\n", ( nPass == 0 ) ? L"Grid:" : L"All pairs:",
+                 1000.0 * llTime / qwFreq.QuadPart / nTicks );
+    }
+
+    if( nScore[0] != nScore[1] )
+    {
+        wprintf( L"Results differ (score %d vs %d)\n", nScore[0], nScore[1] );
+        return 1;
+    }
+
+    return 0;
+}
+
+
+//--------------------------------------------------------------------------------------
+// Re-simulates a recording made with -record as fast as possible.  Reports the tick
+// rate, the first tick whose state hash differs from the recording and whether a
+// rollback to an earlier snapshot reproduces the same states.  With bPrintHashes
+// the hash of every tick is written out for diffing against another run.
+//--------------------------------------------------------------------------------------
+INT RunReplay( LPCWSTR strFileName, bool bPrintHashes )
+{
+    HRESULT hr;
+
+    // Report to the console we were started from, if any
+    if( AttachConsole( ATTACH_PARENT_PROCESS ) )
+    {
+        FILE* pFile;
+        freopen_s( &pFile, "CONOUT$", "w", stdout );
+    }
+
+    CGameReplay replay;
+    if( FAILED( hr = replay.Load( strFileName ) ) )
+    {
+        wprintf( L"Failed to load %s (0x%08X)\n", strFileName, hr );
+        return 1;
+    }
+
+    int nTicks = replay.GetTickCount();
+    UINT64* pHashes = new UINT64[max( nTicks, 1 )];
+    if( !pHashes )
+        return 1;
+
+    CGameSim sim;
+    GAME_REPLAY_STATS stats;
+    if( FAILED( hr = sim.Init() ) || FAILED( hr = replay.Play( &sim, &stats, pHashes ) ) )
+    {
+        wprintf( L"Replay failed (0x%08X)\n", hr );
+        delete[] pHashes;
+        return 1;
+    }
+
+    if( bPrintHashes )
+    {
+        for( int i = 0; i < nTicks; i++ )
+            wprintf( L"%d %016I64x\n", i, pHashes[i] );
+    }
+    delete[] pHashes;
+
+    wprintf( L"Ticks:      %d (%.1f s of game time)\n", stats.nTicks, stats.nTicks * GAME_TICK );
+    wprintf( L"Simulation: %.3f s, %.0f ticks per second\n", stats.fSeconds, stats.fTicksPerSecond );
+    if( stats.nFirstDivergence >= 0 )
+        wprintf( L"Diverged:   first mismatch at tick %d\n", stats.nFirstDivergence );
+    else
+        wprintf( L"Diverged:   no, every tick matched the recording\n" );
+    if( stats.nRollbackTick >= 0 )
+        wprintf( L"Rollback:   rewound to tick %d, %s\n", stats.nRollbackTick,
+                 stats.bRollbackMatched ? L"states matched" : L"states DIFFERED" );
+
+    return ( stats.nFirstDivergence < 0 && ( stats.nRollbackTick < 0 || stats.bRollbackMatched ) ) ? 0 : 1;
+}